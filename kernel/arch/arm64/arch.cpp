@@ -58,8 +58,8 @@ static_assert(TP_OFFSET(stack_guard) == ZX_TLS_STACK_GUARD_OFFSET, "");
 static_assert(TP_OFFSET(unsafe_sp) == ZX_TLS_UNSAFE_SP_OFFSET, "");
 #undef TP_OFFSET
 
-/* smp boot lock */
-static spin_lock_t arm_boot_cpu_lock = (spin_lock_t){1};
+/* smp boot lock, starts out held by the boot cpu */
+static spin_lock_t arm_boot_cpu_lock = (spin_lock_t){/* serving */ 0, /* next */ 1, /* holder */ 1};
 static volatile int secondaries_to_init = 0;
 static thread_t _init_thread[SMP_MAX_CPUS - 1];
 arm64_sp_info_t arm64_secondary_sp_list[SMP_MAX_CPUS];
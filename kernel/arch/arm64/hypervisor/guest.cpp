@@ -67,10 +67,11 @@ Guest::~Guest() {
 }
 
 zx_status_t Guest::SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                           fbl::RefPtr<PortDispatcher> port, uint64_t key) {
+                           fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                           uint64_t key) {
     switch (kind) {
     case ZX_GUEST_TRAP_MEM:
-        if (port)
+        if (port || event)
             return ZX_ERR_INVALID_ARGS;
     /* fall-through */
     case ZX_GUEST_TRAP_BELL:
@@ -87,7 +88,7 @@ zx_status_t Guest::SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
     zx_status_t status = gpas_->UnmapRange(addr, len);
     if (status != ZX_OK)
         return status;
-    return traps_.InsertTrap(kind, addr, len, fbl::move(port), key);
+    return traps_.InsertTrap(kind, addr, len, fbl::move(port), fbl::move(event), key);
 }
 
 zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Guest>* guest) {
@@ -97,6 +98,7 @@ zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Gue
 }
 
 zx_status_t arch_guest_set_trap(Guest* guest, uint32_t kind, zx_vaddr_t addr, size_t len,
-                                fbl::RefPtr<PortDispatcher> port, uint64_t key) {
-    return guest->SetTrap(kind, addr, len, port, key);
+                                fbl::RefPtr<PortDispatcher> port,
+                                fbl::RefPtr<EventDispatcher> event, uint64_t key) {
+    return guest->SetTrap(kind, addr, len, fbl::move(port), fbl::move(event), key);
 }
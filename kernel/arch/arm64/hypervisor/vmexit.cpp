@@ -176,6 +176,8 @@ static zx_status_t handle_data_abort(uint32_t iss, GuestState* guest_state,
 
     switch (trap->kind()) {
     case ZX_GUEST_TRAP_BELL:
+        if (trap->HasEvent())
+            return trap->Signal();
         *packet = {};
         packet->key = trap->key();
         packet->type = ZX_PKT_TYPE_GUEST_BELL;
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <arch/arm64/mmu.h>
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/mutex.h>
 #include <vm/arch_vm_aspace.h>
@@ -90,11 +91,18 @@ private:
 
     void FlushTLBEntry(vaddr_t vaddr, bool terminal) TA_REQ(lock_);
 
+    uint16_t asid() const {
+        return static_cast<uint16_t>(asid_.load(fbl::memory_order_relaxed));
+    }
+
     fbl::Canary<fbl::magic("VAAS")> canary_;
 
     fbl::Mutex lock_;
 
-    uint16_t asid_ = MMU_ARM64_UNUSED_ASID;
+    // The ASID in the low MMU_ARM64_ASID_BITS, and for user aspaces the
+    // generation it was assigned in above that. User aspaces get their ASID
+    // when they are first switched to, see AsidAllocator in mmu.cpp.
+    fbl::atomic<uint64_t> asid_ = {MMU_ARM64_UNUSED_ASID};
 
     // Pointer to the translation table.
     paddr_t tt_phys_ = 0;
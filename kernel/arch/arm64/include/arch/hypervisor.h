@@ -36,7 +36,8 @@ public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Guest);
 
     zx_status_t SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                        fbl::RefPtr<PortDispatcher> port, uint64_t key);
+                        fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                        uint64_t key);
 
     GuestPhysicalAddressSpace* AddressSpace() const { return gpas_.get(); }
     TrapMap* Traps() { return &traps_; }
@@ -134,7 +135,8 @@ zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Gue
 
 /* Set a trap within a guest. */
 zx_status_t arch_guest_set_trap(Guest* guest, uint32_t kind, zx_vaddr_t addr, size_t len,
-                                fbl::RefPtr<PortDispatcher> port, uint64_t key);
+                                fbl::RefPtr<PortDispatcher> port,
+                                fbl::RefPtr<EventDispatcher> event, uint64_t key);
 
 /* Create a VCPU. */
 zx_status_t arm_vcpu_create(zx_vaddr_t ip, uint8_t vmid, GuestPhysicalAddressSpace* gpas,
@@ -19,7 +19,9 @@
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
+#include <kernel/cpu.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <lib/heap.h>
 #include <lib/ktrace.h>
 #include <rand.h>
@@ -63,70 +65,171 @@ pte_t* arm64_get_kernel_ptable() {
 
 namespace {
 
+// ASIDs are assigned lazily, the first time an aspace is switched to, from a
+// generation of the whole ASID space.  When a generation runs out, a new one
+// starts: each cpu keeps the ASID it is running with, everything else is
+// free again, and every cpu flushes its whole TLB before it next uses an ASID
+// of the new generation.  Aspaces still holding an ASID of an old generation
+// get a new one the next time they are switched to.
+//
+// This means there is no limit on the number of aspaces, creating and
+// destroying one never touches the allocator, and a context switch to an
+// aspace whose ASID is current only costs a compare and swap.
+//
+// An aspace's ASID is kept in the low MMU_ARM64_ASID_BITS bits of a 64 bit
+// value, with the generation it belongs to above it.
 class AsidAllocator {
 public:
     AsidAllocator() { bitmap_.Reset(MMU_ARM64_MAX_USER_ASID + 1); }
     ~AsidAllocator() = default;
 
-    zx_status_t Alloc(uint16_t* asid);
-    zx_status_t Free(uint16_t asid);
+    // Returns the ASID to run the aspace owning |asid| with on the current
+    // cpu, assigning it a new one first if needed.  Called with interrupts
+    // disabled.
+    uint16_t Activate(fbl::atomic<uint64_t>* asid);
+
+    static uint16_t ToAsid(uint64_t asid) { return static_cast<uint16_t>(asid & kAsidMask); }
 
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(AsidAllocator);
 
-    fbl::Mutex lock_;
+    uint64_t NewAsidLocked(uint64_t asid) TA_REQ(lock_);
+    bool UpdateReservedLocked(uint64_t asid, uint64_t new_asid) TA_REQ(lock_);
+    void RolloverLocked() TA_REQ(lock_);
+
+    static constexpr uint64_t kAsidMask = (1ul << MMU_ARM64_ASID_BITS) - 1;
+    static constexpr uint64_t kFirstGeneration = 1ul << MMU_ARM64_ASID_BITS;
+
+    SpinLock lock_;
+    fbl::atomic<uint64_t> generation_ = {kFirstGeneration};
     uint16_t last_ TA_GUARDED(lock_) = MMU_ARM64_FIRST_USER_ASID - 1;
 
+    // ASIDs handed out in the current generation.
     bitmap::RawBitmapGeneric<bitmap::FixedStorage<MMU_ARM64_MAX_USER_ASID + 1>> bitmap_ TA_GUARDED(lock_);
 
+    // The ASID each cpu is running with, or 0 if a rollover happened since
+    // the cpu last switched aspaces.
+    fbl::atomic<uint64_t> active_[SMP_MAX_CPUS] = {};
+    // The ASID each cpu was running with at the last rollover.  They stay
+    // allocated in the new generation, since the aspaces owning them may
+    // still be running and have entries in the TLB.
+    uint64_t reserved_[SMP_MAX_CPUS] TA_GUARDED(lock_) = {};
+    // Cpus which have to flush their TLB before their next switch.
+    cpu_mask_t flush_pending_ TA_GUARDED(lock_) = 0;
+
     static_assert(MMU_ARM64_ASID_BITS <= 16, "");
+    static_assert(SMP_MAX_CPUS <= sizeof(cpu_mask_t) * 8, "");
 };
 
-zx_status_t AsidAllocator::Alloc(uint16_t* asid) {
-    uint16_t new_asid;
+uint16_t AsidAllocator::Activate(fbl::atomic<uint64_t>* asid) {
+    cpu_num_t cpu = arch_curr_cpu_num();
+    uint64_t cur = asid->load(fbl::memory_order_relaxed);
+
+    // Fast path: the ASID is from the current generation.  The cpu's active
+    // ASID is swapped to 0 by a rollover, so if the exchange succeeds the
+    // rollover is known to see this ASID.
+    uint64_t active = active_[cpu].load(fbl::memory_order_relaxed);
+    if (active != 0 &&
+        ((cur ^ generation_.load(fbl::memory_order_relaxed)) >> MMU_ARM64_ASID_BITS) == 0 &&
+        active_[cpu].compare_exchange_strong(&active, cur, fbl::memory_order_relaxed,
+                                              fbl::memory_order_relaxed)) {
+        return ToAsid(cur);
+    }
 
-    // use the bitmap allocator to allocate ids in the range of
-    // [MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID]
-    // start the search from the last found id + 1 and wrap when hitting the end of the range
-    {
-        fbl::AutoLock al(&lock_);
-
-        size_t val;
-        bool notfound = bitmap_.Get(last_ + 1, MMU_ARM64_MAX_USER_ASID + 1, &val);
-        if (unlikely(notfound)) {
-            // search again from the start
-            notfound = bitmap_.Get(MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID + 1, &val);
-            if (unlikely(notfound)) {
-                TRACEF("ARM64: out of ASIDs\n");
-                return ZX_ERR_NO_MEMORY;
-            }
-        }
-        bitmap_.SetOne(val);
+    spin_lock_saved_state_t state;
+    lock_.AcquireIrqSave(state);
 
-        DEBUG_ASSERT(val <= UINT16_MAX);
+    cur = asid->load(fbl::memory_order_relaxed);
+    if ((cur ^ generation_.load(fbl::memory_order_relaxed)) >> MMU_ARM64_ASID_BITS) {
+        cur = NewAsidLocked(cur);
+        asid->store(cur, fbl::memory_order_relaxed);
+    }
 
-        new_asid = (uint16_t)val;
-        last_ = new_asid;
+    cpu_mask_t mask = cpu_num_to_mask(cpu);
+    if (flush_pending_ & mask) {
+        flush_pending_ &= ~mask;
+        ARM64_TLBI_NOADDR(vmalle1);
+        DSB;
     }
 
-    LTRACEF("new asid %#x\n", new_asid);
+    active_[cpu].store(cur, fbl::memory_order_relaxed);
 
-    *asid = new_asid;
+    lock_.ReleaseIrqRestore(state);
 
-    return ZX_OK;
+    return ToAsid(cur);
+}
+
+uint64_t AsidAllocator::NewAsidLocked(uint64_t asid) {
+    uint64_t generation = generation_.load(fbl::memory_order_relaxed);
+
+    // Keep the same ASID in the new generation if nobody took it yet, so that
+    // an aspace which was running during the rollover stays consistent with
+    // the TLB entries tagged with it.
+    if (ToAsid(asid) != MMU_ARM64_UNUSED_ASID) {
+        uint64_t new_asid = generation | ToAsid(asid);
+        if (UpdateReservedLocked(asid, new_asid))
+            return new_asid;
+        if (!bitmap_.GetOne(ToAsid(asid))) {
+            bitmap_.SetOne(ToAsid(asid));
+            return new_asid;
+        }
+    }
+
+    // Otherwise search for a free one from the last found + 1, starting a new
+    // generation when there are none left.
+    size_t val;
+    bool notfound = bitmap_.Get(last_ + 1, MMU_ARM64_MAX_USER_ASID + 1, &val);
+    if (unlikely(notfound)) {
+        RolloverLocked();
+        generation = generation_.load(fbl::memory_order_relaxed);
+        notfound = bitmap_.Get(MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID + 1, &val);
+        // At most one ASID per cpu is reserved.
+        DEBUG_ASSERT(!notfound);
+    }
+    bitmap_.SetOne(val);
+
+    DEBUG_ASSERT(val <= UINT16_MAX);
+    last_ = static_cast<uint16_t>(val);
+
+    LTRACEF("new asid %#lx generation %#lx\n", val, generation >> MMU_ARM64_ASID_BITS);
+
+    return generation | val;
 }
 
-zx_status_t AsidAllocator::Free(uint16_t asid) {
-    LTRACEF("free asid %#x\n", asid);
+// If |asid| is reserved by any cpu, moves it to the current generation.
+bool AsidAllocator::UpdateReservedLocked(uint64_t asid, uint64_t new_asid) {
+    bool hit = false;
+    for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+        if (reserved_[i] == asid) {
+            reserved_[i] = new_asid;
+            hit = true;
+        }
+    }
+    return hit;
+}
 
-    fbl::AutoLock al(&lock_);
+void AsidAllocator::RolloverLocked() {
+    LTRACEF("asid rollover\n");
 
-    bitmap_.ClearOne(asid);
+    generation_.fetch_add(kFirstGeneration, fbl::memory_order_relaxed);
 
-    return ZX_OK;
+    bitmap_.ClearAll();
+
+    for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+        uint64_t asid = active_[i].exchange(0, fbl::memory_order_relaxed);
+        // A cpu which has not switched since the last rollover is still
+        // running with its reserved ASID.
+        if (asid == 0)
+            asid = reserved_[i];
+        bitmap_.SetOne(ToAsid(asid));
+        reserved_[i] = asid;
+    }
+
+    flush_pending_ = ~cpu_mask_t(0);
+    last_ = MMU_ARM64_FIRST_USER_ASID - 1;
 }
 
-AsidAllocator asid;
+AsidAllocator asid_allocator;
 
 } // namespace
 
@@ -442,10 +545,10 @@ static bool page_table_is_clear(volatile pte_t* page_table, uint page_size_shift
 // terminal is set when flushing at the final level of the page table.
 void ArmArchVmAspace::FlushTLBEntry(vaddr_t vaddr, bool terminal) {
     if (flags_ & ARCH_ASPACE_FLAG_GUEST) {
-        paddr_t vttbr = arm64_vttbr(asid_, tt_phys_);
+        paddr_t vttbr = arm64_vttbr(asid(), tt_phys_);
         __UNUSED zx_status_t status = arm64_el2_tlbi_ipa(vttbr, vaddr >> 12, terminal);
         DEBUG_ASSERT(status == ZX_OK);
-    } else if (asid_ == MMU_ARM64_GLOBAL_ASID) {
+    } else if (flags_ & ARCH_ASPACE_FLAG_KERNEL) {
         // flush this address on all ASIDs
         if (terminal) {
             ARM64_TLBI(vaale1is, vaddr >> 12);
@@ -453,11 +556,16 @@ void ArmArchVmAspace::FlushTLBEntry(vaddr_t vaddr, bool terminal) {
             ARM64_TLBI(vaae1is, vaddr >> 12);
         }
     } else {
-        // flush this address for the specific asid
+        // flush this address for the specific asid. The page table update
+        // has to be visible before the ASID is read: a cpu switching to this
+        // aspace with a new ASID after that point walks the new tables, and
+        // one that switched before is covered by the flush.
+        DSB_ISHST;
+        uint16_t cur_asid = asid();
         if (terminal) {
-            ARM64_TLBI(vale1is, vaddr >> 12 | (vaddr_t)asid_ << 48);
+            ARM64_TLBI(vale1is, vaddr >> 12 | (vaddr_t)cur_asid << 48);
         } else {
-            ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid_ << 48);
+            ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)cur_asid << 48);
         }
     }
 }
@@ -703,7 +811,7 @@ ssize_t ArmArchVmAspace::MapPages(vaddr_t vaddr, paddr_t paddr, size_t size,
 
     LTRACEF("vaddr %#" PRIxPTR ", paddr %#" PRIxPTR ", size %#" PRIxPTR
             ", attrs %#" PRIx64 ", asid %#x\n",
-            vaddr, paddr, size, attrs, asid_);
+            vaddr, paddr, size, attrs, asid());
 
     if (vaddr_rel > vaddr_rel_max - size || size > vaddr_rel_max) {
         TRACEF("vaddr %#" PRIxPTR ", size %#" PRIxPTR " out of range vaddr %#" PRIxPTR ", size %#" PRIxPTR "\n",
@@ -726,7 +834,7 @@ ssize_t ArmArchVmAspace::UnmapPages(vaddr_t vaddr, size_t size,
     vaddr_t vaddr_rel = vaddr - vaddr_base;
     vaddr_t vaddr_rel_max = 1UL << top_size_shift;
 
-    LTRACEF("vaddr 0x%lx, size 0x%lx, asid 0x%x\n", vaddr, size, asid_);
+    LTRACEF("vaddr 0x%lx, size 0x%lx, asid 0x%x\n", vaddr, size, asid());
 
     if (vaddr_rel > vaddr_rel_max - size || size > vaddr_rel_max) {
         TRACEF("vaddr 0x%lx, size 0x%lx out of range vaddr 0x%lx, size 0x%lx\n",
@@ -750,7 +858,7 @@ zx_status_t ArmArchVmAspace::ProtectPages(vaddr_t vaddr, size_t size, pte_t attr
 
     LTRACEF("vaddr %#" PRIxPTR ", size %#" PRIxPTR ", attrs %#" PRIx64
             ", asid %#x\n",
-            vaddr, size, attrs, asid_);
+            vaddr, size, attrs, asid());
 
     if (vaddr_rel > vaddr_rel_max - size || size > vaddr_rel_max) {
         TRACEF("vaddr %#" PRIxPTR ", size %#" PRIxPTR " out of range vaddr %#" PRIxPTR ", size %#" PRIxPTR "\n",
@@ -1004,14 +1112,12 @@ zx_status_t ArmArchVmAspace::Init(vaddr_t base, size_t size, uint flags) {
         size_ = size;
         tt_virt_ = arm64_kernel_translation_table;
         tt_phys_ = vaddr_to_paddr(const_cast<pte_t*>(tt_virt_));
-        asid_ = (uint16_t)MMU_ARM64_GLOBAL_ASID;
+        asid_.store(MMU_ARM64_GLOBAL_ASID);
     } else {
         if (flags & ARCH_ASPACE_FLAG_GUEST) {
             DEBUG_ASSERT(base + size <= 1UL << MMU_GUEST_SIZE_SHIFT);
         } else {
             DEBUG_ASSERT(base + size <= 1UL << MMU_USER_SIZE_SHIFT);
-            if (asid.Alloc(&asid_) != ZX_OK)
-                return ZX_ERR_NO_MEMORY;
         }
 
         base_ = base;
@@ -1051,13 +1157,13 @@ zx_status_t ArmArchVmAspace::Destroy() {
     pmm_free_page(page);
 
     if (flags_ & ARCH_ASPACE_FLAG_GUEST) {
-        paddr_t vttbr = arm64_vttbr(asid_, tt_phys_);
+        paddr_t vttbr = arm64_vttbr(asid(), tt_phys_);
         __UNUSED zx_status_t status = arm64_el2_tlbi_vmid(vttbr);
         DEBUG_ASSERT(status == ZX_OK);
-    } else {
-        ARM64_TLBI(ASIDE1IS, asid_);
-        asid.Free(asid_);
-        asid_ = MMU_ARM64_UNUSED_ASID;
+    } else if (asid() != MMU_ARM64_UNUSED_ASID) {
+        // The ASID stays allocated until the next rollover, which flushes
+        // every TLB, but get rid of this aspace's entries now.
+        ARM64_TLBI(aside1is, (uint64_t)asid() << 48);
     }
 
     return ZX_OK;
@@ -1074,7 +1180,8 @@ void ArmArchVmAspace::ContextSwitch(ArmArchVmAspace* old_aspace, ArmArchVmAspace
         DEBUG_ASSERT((aspace->flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)) == 0);
 
         tcr = MMU_TCR_FLAGS_USER;
-        ttbr = ((uint64_t)aspace->asid_ << 48) | aspace->tt_phys_;
+        uint16_t cur_asid = asid_allocator.Activate(&aspace->asid_);
+        ttbr = ((uint64_t)cur_asid << 48) | aspace->tt_phys_;
         ARM64_WRITE_SYSREG(ttbr0_el1, ttbr);
 
         if (TRACE_CONTEXT_SWITCH)
@@ -83,6 +83,19 @@ zx_status_t arch_mp_send_ipi(mp_ipi_target_t target, cpu_mask_t mask, mp_ipi_t i
     return interrupt_send_ipi(mask, ipi);
 }
 
+cpu_mask_t arch_mp_get_cache_siblings(cpu_num_t cpu_id) {
+    DEBUG_ASSERT(cpu_id < SMP_MAX_CPUS);
+
+    // cpus within a cluster share the last level cache
+    cpu_mask_t mask = 0;
+    for (uint i = 0; i < arm_num_cpus; i++) {
+        if (arm64_cpu_cluster_ids[i] == arm64_cpu_cluster_ids[cpu_id]) {
+            mask |= cpu_num_to_mask(i);
+        }
+    }
+    return mask | cpu_num_to_mask(cpu_id);
+}
+
 void arm64_init_percpu_early(void) {
     // slow lookup the current cpu id and setup the percpu structure
     uint cpu = arch_curr_cpu_num_slow();
@@ -7,43 +7,60 @@
 #include <arch/ops.h>
 #include <arch/spinlock.h>
 #include <kernel/atomic.h>
+#include <kernel/spinlock.h>
 
 // We need to disable thread safety analysis in this file, since we're
 // implementing the locks themselves.  Without this, the header-level
 // annotations cause Clang to detect violations.
 
-void arch_spin_lock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
-    unsigned long val = arch_curr_cpu_num() + 1;
-    uint64_t temp;
+// Waits for |serving| to reach |ticket|.  The exclusive load arms the event
+// monitor on the lock, so the store-release in arch_spin_unlock() wakes us
+// out of wfe without any explicit sev.
+static inline void wait_for_ticket(spin_lock_t* lock, uint32_t ticket) {
+    uint32_t temp;
 
     __asm__ volatile(
         "sevl;"
         "1: wfe;"
-        "ldaxr   %[temp], [%[lock]];"
-        "cbnz    %[temp], 1b;"
-        "stxr    %w[temp], %[val], [%[lock]];"
-        "cbnz    %w[temp], 1b;"
+        "ldaxr   %w[temp], [%[serving]];"
+        "cmp     %w[temp], %w[ticket];"
+        "b.ne    1b;"
         : [temp] "=&r"(temp)
-        : [lock] "r"(&lock->value), [val] "r"(val)
+        : [serving] "r"(&lock->serving), [ticket] "r"(ticket)
         : "cc", "memory");
 }
 
-int arch_spin_trylock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
-    unsigned long val = arch_curr_cpu_num() + 1;
-    uint64_t out;
+void arch_spin_lock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1u, __ATOMIC_RELAXED);
 
-    __asm__ volatile(
-        "ldaxr   %[out], [%[lock]];"
-        "cbnz    %[out], 1f;"
-        "stxr    %w[out], %[val], [%[lock]];"
-        "1:"
-        : [out] "=&r"(out)
-        : [lock] "r"(&lock->value), [val] "r"(val)
-        : "cc", "memory");
+    if (unlikely(__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) != ticket)) {
+#if WITH_SPINLOCK_STATS
+        uint64_t start = arch_cycle_count();
+        wait_for_ticket(lock, ticket);
+        spin_lock_contended(__builtin_return_address(0), arch_cycle_count() - start);
+#else
+        wait_for_ticket(lock, ticket);
+#endif
+    }
+
+    __atomic_store_n(&lock->holder, arch_curr_cpu_num() + 1, __ATOMIC_RELAXED);
+}
+
+int arch_spin_trylock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // The lock is free, with nobody waiting, only when the next ticket is
+    // the one being served; take it only in that case.
+    uint32_t ticket = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    if (!__atomic_compare_exchange_n(&lock->next, &ticket, ticket + 1, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return 1;
 
-    return (int)out;
+    __atomic_store_n(&lock->holder, arch_curr_cpu_num() + 1, __ATOMIC_RELAXED);
+    return 0;
 }
 
 void arch_spin_unlock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
-    __atomic_store_n(&lock->value, 0UL, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&lock->holder, 0UL, __ATOMIC_RELAXED);
+    // Only the holder writes |serving|.
+    uint32_t serving = __atomic_load_n(&lock->serving, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->serving, serving + 1, __ATOMIC_RELEASE);
 }
@@ -25,8 +25,14 @@ static uint32_t core_shift = 0;
 static uint32_t package_mask = ~0;
 static uint32_t package_shift = 0;
 
+// Number of low apic id bits that distinguish logical processors sharing
+// the last level cache. Defaults to the package, which is a safe guess.
+static uint32_t llc_shift = 0;
+static bool llc_shift_valid = false;
+
 static int initialized;
 
+static void llc_topology_init(void);
 static void legacy_topology_init(void);
 static void modern_intel_topology_init(void);
 static void extended_amd_topology_init(void);
@@ -43,6 +49,45 @@ void x86_cpu_topology_init(void) {
     } else {
         legacy_topology_init();
     }
+
+    llc_topology_init();
+}
+
+static void llc_topology_init(void) {
+    // Intel leaf 0x4 and AMD leaf 0x8000001d share a layout: each subleaf
+    // describes a cache, and eax[25:14] + 1 is the maximum number of
+    // addressable logical processor ids sharing it. Walk to the last valid
+    // subleaf with the highest level, which is the LLC.
+    enum x86_cpuid_leaf_num leaf_num;
+    if (x86_vendor == X86_VENDOR_INTEL) {
+        leaf_num = X86_CPUID_CACHE_V2;
+    } else if (x86_vendor == X86_VENDOR_AMD && x86_feature_test(X86_FEATURE_AMD_TOPO)) {
+        leaf_num = X86_CPUID_AMD_CACHE;
+    } else {
+        return;
+    }
+
+    uint32_t highest_level = 0;
+    for (uint32_t subleaf = 0; subleaf < 16; subleaf++) {
+        struct cpuid_leaf leaf;
+        if (!x86_get_cpuid_subleaf(leaf_num, subleaf, &leaf)) {
+            return;
+        }
+
+        uint32_t type = BITS(leaf.a, 4, 0);
+        if (type == 0) {
+            break;
+        }
+
+        uint32_t level = BITS_SHIFT(leaf.a, 7, 5);
+        if (level >= highest_level) {
+            highest_level = level;
+            llc_shift = log2_uint_ceil(BITS_SHIFT(leaf.a, 25, 14) + 1);
+            llc_shift_valid = true;
+        }
+    }
+
+    LTRACEF("llc level %u shift %u\n", highest_level, llc_shift);
 }
 
 static void modern_intel_topology_init(void) {
@@ -148,4 +193,10 @@ void x86_cpu_topology_decode(uint32_t apic_id, x86_cpu_topology_t* topo) {
     topo->package_id = (apic_id & package_mask) >> package_shift;
     topo->core_id = (apic_id & core_mask) >> core_shift;
     topo->smt_id = apic_id & smt_mask;
+
+    if (llc_shift_valid) {
+        topo->cache_id = apic_id >> llc_shift;
+    } else {
+        topo->cache_id = topo->package_id;
+    }
 }
@@ -423,6 +423,12 @@ void x86_exception_handler(x86_iframe_t* frame) {
         /* no return */
         break;
     }
+    case X86_INT_IPI_POSTED_INTERRUPT: {
+        /* posted interrupts for a vcpu that is not running in the guest are
+         * picked up the next time it enters, so there is nothing to do */
+        apic_issue_eoi();
+        break;
+    }
     case X86_INT_APIC_PMI: {
         ret = apic_pmi_interrupt_handler(frame);
         // Note: apic_pmi_interrupt_handler calls apic_issue_eoi().
@@ -9,9 +9,11 @@
 #include <hypervisor/guest_physical_address_space.h>
 #include <zircon/syscalls/hypervisor.h>
 
+#include "vcpu_priv.h"
+#include "vmexit_priv.h"
 #include "vmx_cpu_state_priv.h"
 
-static void ignore_msr(VmxPage* msr_bitmaps_page, uint32_t msr) {
+static void ignore_msr(VmxPage* msr_bitmaps_page, uint32_t msr, bool ignore_reads = true) {
     // From Volume 3, Section 24.6.9.
     uint8_t* msr_bitmaps = msr_bitmaps_page->VirtualAddress<uint8_t>();
     if (msr >= 0xc0000000)
@@ -22,7 +24,8 @@ static void ignore_msr(VmxPage* msr_bitmaps_page, uint32_t msr) {
     uint8_t msr_bit = msr_low % 8;
 
     // Ignore reads to the MSR.
-    msr_bitmaps[msr_byte] &= (uint8_t) ~(1 << msr_bit);
+    if (ignore_reads)
+        msr_bitmaps[msr_byte] &= (uint8_t) ~(1 << msr_bit);
 
     // Ignore writes to the MSR.
     msr_bitmaps += 2 << 10;
@@ -62,6 +65,14 @@ zx_status_t Guest::Create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Guest>*
     ignore_msr(&guest->msr_bitmaps_page_, X86_MSR_IA32_TSC_ADJUST);
     ignore_msr(&guest->msr_bitmaps_page_, X86_MSR_IA32_TSC_AUX);
 
+    // With virtual-interrupt delivery, EOI writes go to the virtual-APIC page.
+    // See Volume 3, Section 29.5.
+    ApicvInfo apicv_info;
+    if (apicv_info.posted_interrupts) {
+        ignore_msr(&guest->msr_bitmaps_page_, static_cast<uint32_t>(X2ApicMsr::EOI),
+                   /* ignore_reads */ false);
+    }
+
     *out = fbl::move(guest);
     return ZX_OK;
 }
@@ -72,14 +83,15 @@ Guest::~Guest() {
 }
 
 zx_status_t Guest::SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                           fbl::RefPtr<PortDispatcher> port, uint64_t key) {
+                           fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                           uint64_t key) {
     if (len == 0)
         return ZX_ERR_INVALID_ARGS;
     if (SIZE_MAX - len < addr)
         return ZX_ERR_OUT_OF_RANGE;
     switch (kind) {
     case ZX_GUEST_TRAP_MEM:
-        if (port)
+        if (port || event)
             return ZX_ERR_INVALID_ARGS;
         // fallthrough
     case ZX_GUEST_TRAP_BELL: {
@@ -109,7 +121,7 @@ zx_status_t Guest::SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
     default:
         return ZX_ERR_INVALID_ARGS;
     }
-    return traps_.InsertTrap(kind, addr, len, fbl::move(port), key);
+    return traps_.InsertTrap(kind, addr, len, fbl::move(port), fbl::move(event), key);
 }
 
 zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Guest>* guest) {
@@ -121,6 +133,7 @@ zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Gue
 }
 
 zx_status_t arch_guest_set_trap(Guest* guest, uint32_t kind, zx_vaddr_t addr, size_t len,
-                                fbl::RefPtr<PortDispatcher> port, uint64_t key) {
-    return guest->SetTrap(kind, addr, len, port, key);
+                                fbl::RefPtr<PortDispatcher> port,
+                                fbl::RefPtr<EventDispatcher> event, uint64_t key) {
+    return guest->SetTrap(kind, addr, len, fbl::move(port), fbl::move(event), key);
 }
@@ -8,9 +8,12 @@
 
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
+#include <arch/x86/mp.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <hypervisor/cpu.h>
 #include <hypervisor/guest_physical_address_space.h>
+#include <kernel/atomic.h>
 #include <kernel/mp.h>
 #include <vm/fault.h>
 #include <vm/physmap.h>
@@ -206,6 +209,17 @@ zx_status_t AutoVmcs::SetControl(VmcsField32 controls, uint64_t true_msr, uint64
     return ZX_OK;
 }
 
+ApicvInfo::ApicvInfo() {
+    // From Volume 3, Appendix A.3: The high 32 bits of each control MSR are
+    // the allowed 1-settings.
+    uint64_t pinbased_ctls = read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS);
+    uint64_t procbased_ctls2 = read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2);
+    posted_interrupts =
+        BIT_SHIFT(procbased_ctls2, 32 + 9) &&
+        // Posted-interrupt processing.
+        BIT_SHIFT(pinbased_ctls, 32 + 7);
+}
+
 AutoPin::AutoPin(uint16_t vpid)
     : prev_cpu_mask_(get_current_thread()->cpu_affinity), thread_(pin_thread(vpid)) {}
 
@@ -251,7 +265,8 @@ static void edit_msr_list(VmxPage* msr_list_page, size_t index, uint32_t msr, ui
 
 zx_status_t vmcs_init(paddr_t vmcs_address, uint16_t vpid, uintptr_t ip, uintptr_t cr3,
                       paddr_t msr_bitmaps_address, paddr_t pml4_address, VmxState* vmx_state,
-                      VmxPage* host_msr_page, VmxPage* guest_msr_page) {
+                      VmxPage* host_msr_page, VmxPage* guest_msr_page,
+                      VmxPage* virtual_apic_page, VmxPage* pi_desc_page) {
     zx_status_t status = vmclear(vmcs_address);
     if (status != ZX_OK)
         return status;
@@ -281,6 +296,20 @@ zx_status_t vmcs_init(paddr_t vmcs_address, uint16_t vpid, uintptr_t ip, uintptr
                     kProcbasedCtls2Invpcid,
                     0);
 
+    // From Volume 3, Section 29.2: With virtual-interrupt delivery, the
+    // processor delivers interrupts recorded in the virtual-APIC page once the
+    // guest can take them, and virtualizes EOI writes, without VM exits.
+    const bool posted_interrupts = pi_desc_page->IsAllocated();
+    if (posted_interrupts) {
+        status = vmcs.SetControl(VmcsField32::PROCBASED_CTLS2,
+                                 read_msr(X86_MSR_IA32_VMX_PROCBASED_CTLS2),
+                                 vmcs.Read(VmcsField32::PROCBASED_CTLS2),
+                                 kProcbasedCtls2VirtIntDelivery,
+                                 0);
+        if (status != ZX_OK)
+            return status;
+    }
+
     // Setup pin-based VMCS controls.
     status = vmcs.SetControl(VmcsField32::PINBASED_CTLS,
                              read_msr(X86_MSR_IA32_VMX_TRUE_PINBASED_CTLS),
@@ -288,7 +317,9 @@ zx_status_t vmcs_init(paddr_t vmcs_address, uint16_t vpid, uintptr_t ip, uintptr
                              // External interrupts cause a VM exit.
                              kPinbasedCtlsExtIntExiting |
                                  // Non-maskable interrupts cause a VM exit.
-                                 kPinbasedCtlsNmiExiting,
+                                 kPinbasedCtlsNmiExiting |
+                                 // Process posted interrupts, if we can.
+                                 (posted_interrupts ? kPinbasedCtlsPostedInterrupts : 0),
                              0);
     if (status != ZX_OK)
         return status;
@@ -410,6 +441,25 @@ zx_status_t vmcs_init(paddr_t vmcs_address, uint16_t vpid, uintptr_t ip, uintptr
     const auto eptp = ept_pointer(pml4_address);
     vmcs.Write(VmcsField64::EPT_POINTER, eptp);
 
+    // From Volume 3, Section 29.1: The TPR shadow, and any virtual interrupts,
+    // are kept in the virtual-APIC page.
+    vmcs.Write(VmcsField64::VIRTUAL_APIC_ADDRESS, virtual_apic_page->PhysicalAddress());
+
+    // From Volume 3, Section 29.6: When the processor receives the posted-
+    // interrupt notification vector while running the guest, it moves the
+    // interrupts posted in the descriptor into the virtual-APIC page. We don't
+    // need any EOI-induced VM exits, as our local APIC does nothing on EOI.
+    if (posted_interrupts) {
+        vmcs.Write(VmcsField16::POSTED_INTERRUPT_NOTIFICATION_VECTOR,
+                   X86_INT_IPI_POSTED_INTERRUPT);
+        vmcs.Write(VmcsField64::POSTED_INTERRUPT_DESC_ADDRESS, pi_desc_page->PhysicalAddress());
+        vmcs.Write(VmcsField64::EOI_EXIT_BITMAP_0, 0);
+        vmcs.Write(VmcsField64::EOI_EXIT_BITMAP_1, 0);
+        vmcs.Write(VmcsField64::EOI_EXIT_BITMAP_2, 0);
+        vmcs.Write(VmcsField64::EOI_EXIT_BITMAP_3, 0);
+        vmcs.Write(VmcsField16::GUEST_INTERRUPT_STATUS, 0);
+    }
+
     // Setup MSR handling.
     vmcs.Write(VmcsField64::MSR_BITMAPS_ADDRESS, msr_bitmaps_address);
 
@@ -589,13 +639,27 @@ zx_status_t Vcpu::Create(zx_vaddr_t ip, zx_vaddr_t cr3, paddr_t msr_bitmaps_addr
     status = vcpu->vmcs_page_.Alloc(vmx_info, 0);
     if (status != ZX_OK)
         return status;
+
+    status = vcpu->virtual_apic_page_.Alloc(vmx_info, 0);
+    if (status != ZX_OK)
+        return status;
+
+    ApicvInfo apicv_info;
+    if (apicv_info.posted_interrupts) {
+        status = vcpu->pi_desc_page_.Alloc(vmx_info, 0);
+        if (status != ZX_OK)
+            return status;
+        vcpu->local_apic_state_.pi_desc =
+            vcpu->pi_desc_page_.VirtualAddress<PostedInterruptDescriptor>();
+        vcpu->local_apic_state_.virtual_apic = vcpu->virtual_apic_page_.VirtualAddress<uint8_t>();
+    }
     auto_call.cancel();
 
     VmxRegion* region = vcpu->vmcs_page_.VirtualAddress<VmxRegion>();
     region->revision_id = vmx_info.revision_id;
     status = vmcs_init(vcpu->vmcs_page_.PhysicalAddress(), vpid, ip, cr3, msr_bitmaps_address,
                        gpas->table_phys(), &vcpu->vmx_state_, &vcpu->host_msr_page_,
-                       &vcpu->guest_msr_page_);
+                       &vcpu->guest_msr_page_, &vcpu->virtual_apic_page_, &vcpu->pi_desc_page_);
     if (status != ZX_OK)
         return status;
 
@@ -619,8 +683,58 @@ Vcpu::~Vcpu() {
     DEBUG_ASSERT(status == ZX_OK);
 }
 
+static void virtual_apic_set_irr(LocalApicState* local_apic_state, uint32_t reg, uint32_t bits) {
+    auto irr = reinterpret_cast<volatile uint32_t*>(local_apic_state->virtual_apic +
+                                                    kVirtualApicIrr + reg * 16);
+    *irr |= bits;
+}
+
+// Moves pending interrupts into the virtual-APIC page, from where the processor
+// delivers them once the guest can take them.
+static void local_apic_sync_posted_interrupts(AutoVmcs* vmcs, LocalApicState* local_apic_state) {
+    int highest = -1;
+
+    // Interrupts raised by the host are tracked.
+    uint32_t vector;
+    while (local_apic_state->interrupt_tracker.Pop(&vector) == ZX_OK) {
+        virtual_apic_set_irr(local_apic_state, vector / 32, 1u << (vector % 32));
+        highest = fbl::max(highest, static_cast<int>(vector));
+    }
+
+    // Interrupts posted while the VCPU was not running the guest are left in
+    // the descriptor. We clear the outstanding-notification bit first, so that
+    // anything posted after we look sends a notification.
+    PostedInterruptDescriptor* pi_desc = local_apic_state->pi_desc;
+    if (atomic_and_u64(&pi_desc->control, ~kPostedInterruptOutstanding) &
+        kPostedInterruptOutstanding) {
+        for (uint32_t i = 0; i < fbl::count_of(pi_desc->pir); i++) {
+            uint64_t pir = atomic_swap_u64(&pi_desc->pir[i], 0);
+            if (pir == 0)
+                continue;
+            virtual_apic_set_irr(local_apic_state, i * 2, static_cast<uint32_t>(pir));
+            virtual_apic_set_irr(local_apic_state, i * 2 + 1, static_cast<uint32_t>(pir >> 32));
+            highest = fbl::max(highest, static_cast<int>(i * 64 + 63 - __builtin_clzl(pir)));
+        }
+    }
+
+    // From Volume 3, Section 29.1.1: The requesting virtual interrupt (RVI) is
+    // the highest vector in the virtual IRR.
+    if (highest < 0)
+        return;
+    uint16_t interrupt_status = vmcs->Read(VmcsField16::GUEST_INTERRUPT_STATUS);
+    if (highest > (interrupt_status & UINT8_MAX)) {
+        vmcs->Write(VmcsField16::GUEST_INTERRUPT_STATUS,
+                    static_cast<uint16_t>((interrupt_status & ~UINT8_MAX) | highest));
+    }
+}
+
 // Injects an interrupt into the guest, if there is one pending.
 static void local_apic_maybe_interrupt(AutoVmcs* vmcs, LocalApicState* local_apic_state) {
+    if (local_apic_state->pi_desc != nullptr) {
+        local_apic_sync_posted_interrupts(vmcs, local_apic_state);
+        return;
+    }
+
     uint32_t vector;
     zx_status_t status = local_apic_state->interrupt_tracker.Pop(&vector);
     if (status != ZX_OK)
@@ -642,13 +756,15 @@ zx_status_t Vcpu::Resume(zx_port_packet_t* packet) {
     zx_status_t status;
     do {
         AutoVmcs vmcs(vmcs_page_.PhysicalAddress());
+        // Interrupts are disabled, so anyone who sees us running from here on
+        // can signal us, and the signal is taken once we are in the guest.
+        running_.store(true);
         local_apic_maybe_interrupt(&vmcs, &local_apic_state_);
         if (x86_feature_test(X86_FEATURE_XSAVE)) {
             // Save the host XCR0, and load the guest XCR0.
             vmx_state_.host_state.xcr0 = x86_xgetbv(0);
             x86_xsetbv(0, vmx_state_.guest_state.xcr0);
         }
-        running_.store(true);
         status = vmx_enter(&vmx_state_);
         running_.store(false);
         if (x86_feature_test(X86_FEATURE_XSAVE)) {
@@ -684,12 +800,29 @@ void vmx_exit(VmxState* vmx_state) {
 
 zx_status_t Vcpu::Interrupt(uint32_t vector) {
     bool signaled;
-    zx_status_t status = local_apic_state_.interrupt_tracker.Interrupt(vector, &signaled);
-    if (status != ZX_OK) {
-        return status;
+    PostedInterruptDescriptor* pi_desc = local_apic_state_.pi_desc;
+    if (pi_desc == nullptr) {
+        zx_status_t status = local_apic_state_.interrupt_tracker.Interrupt(vector, &signaled);
+        if (status != ZX_OK) {
+            return status;
+        }
+        if (!signaled && running_.load()) {
+            mp_reschedule(MP_IPI_TARGET_MASK, cpu_num_to_mask(cpu_of(vpid_)), 0);
+        }
+        return ZX_OK;
     }
-    if (!signaled && running_.load()) {
-        mp_reschedule(MP_IPI_TARGET_MASK, cpu_num_to_mask(cpu_of(vpid_)), 0);
+
+    // From Volume 3, Section 29.6: Post the interrupt, and if there was no
+    // notification outstanding, send one so that a running guest picks the
+    // interrupt up without a VM exit. Otherwise, it is synced on VM entry.
+    if (vector >= X86_INT_COUNT)
+        return ZX_ERR_OUT_OF_RANGE;
+    atomic_or_u64(&pi_desc->pir[vector / 64], 1ul << (vector % 64));
+    uint64_t control = atomic_or_u64(&pi_desc->control, kPostedInterruptOutstanding);
+    local_apic_state_.interrupt_tracker.Signal(&signaled);
+    if (!(control & kPostedInterruptOutstanding) && !signaled && running_.load()) {
+        apic_send_ipi(X86_INT_IPI_POSTED_INTERRUPT, x86_cpu_num_to_apic_id(cpu_of(vpid_)),
+                      DELIVERY_MODE_FIXED);
     }
     return ZX_OK;
 }
@@ -19,7 +19,9 @@
 #include <fbl/canary.h>
 #include <hypervisor/guest_physical_address_space.h>
 #include <hypervisor/interrupt_tracker.h>
+#include <kernel/atomic.h>
 #include <kernel/auto_lock.h>
+#include <lib/counters.h>
 #include <platform.h>
 #include <platform/pc/timer.h>
 #include <vm/fault.h>
@@ -53,6 +55,18 @@ static_assert(sizeof(kHypVendorId) - 1 == kHypVendorIdLength, "");
 
 extern "C" void x86_call_external_interrupt_handler(uint64_t vector);
 
+KCOUNTER(vmexit_external_interrupt, "kernel.hypervisor.vmexit.external_interrupt");
+KCOUNTER(vmexit_interrupt_window, "kernel.hypervisor.vmexit.interrupt_window");
+KCOUNTER(vmexit_cpuid, "kernel.hypervisor.vmexit.cpuid");
+KCOUNTER(vmexit_hlt, "kernel.hypervisor.vmexit.hlt");
+KCOUNTER(vmexit_io_instruction, "kernel.hypervisor.vmexit.io_instruction");
+KCOUNTER(vmexit_rdmsr, "kernel.hypervisor.vmexit.rdmsr");
+KCOUNTER(vmexit_wrmsr, "kernel.hypervisor.vmexit.wrmsr");
+KCOUNTER(vmexit_entry_failure, "kernel.hypervisor.vmexit.entry_failure");
+KCOUNTER(vmexit_ept_violation, "kernel.hypervisor.vmexit.ept_violation");
+KCOUNTER(vmexit_xsetbv, "kernel.hypervisor.vmexit.xsetbv");
+KCOUNTER(vmexit_unhandled, "kernel.hypervisor.vmexit.unhandled");
+
 ExitInfo::ExitInfo(const AutoVmcs& vmcs) {
     // From Volume 3, Section 26.7.
     uint32_t full_exit_reason = vmcs.Read(VmcsField32::EXIT_REASON);
@@ -289,10 +303,31 @@ static zx_status_t handle_cpuid(const ExitInfo& exit_info, AutoVmcs* vmcs,
     }
 }
 
+// Returns whether the virtual-APIC page holds an interrupt that the guest can
+// take. See Volume 3, Section 29.2.1.
+static bool virtual_interrupt_pending(const AutoVmcs& vmcs, LocalApicState* local_apic_state) {
+    if (!(vmcs.Read(VmcsFieldXX::GUEST_RFLAGS) & X86_FLAGS_IF))
+        return false;
+    uint8_t rvi = vmcs.Read(VmcsField16::GUEST_INTERRUPT_STATUS) & UINT8_MAX;
+    uint8_t ppr = local_apic_state->virtual_apic[kVirtualApicPpr];
+    return (rvi & 0xf0) > (ppr & 0xf0);
+}
+
 static zx_status_t handle_hlt(const ExitInfo& exit_info, AutoVmcs* vmcs,
                               LocalApicState* local_apic_state) {
     next_rip(exit_info, vmcs);
-    return local_apic_state->interrupt_tracker.Wait(vmcs);
+    PostedInterruptDescriptor* pi_desc = local_apic_state->pi_desc;
+    if (pi_desc == nullptr)
+        return local_apic_state->interrupt_tracker.Wait(vmcs);
+
+    // The guest may have halted with an interrupt already in the virtual-APIC
+    // page, for example after STI.
+    if (virtual_interrupt_pending(*vmcs, local_apic_state))
+        return ZX_OK;
+    return local_apic_state->interrupt_tracker.Wait(vmcs, [local_apic_state, pi_desc]() {
+        return local_apic_state->interrupt_tracker.Pending() ||
+               (atomic_load_u64(&pi_desc->control) & kPostedInterruptOutstanding);
+    });
 }
 
 static zx_status_t handle_io_instruction(const ExitInfo& exit_info, AutoVmcs* vmcs,
@@ -313,6 +348,17 @@ static zx_status_t handle_io_instruction(const ExitInfo& exit_info, AutoVmcs* vm
     }
     next_rip(exit_info, vmcs);
 
+    if (trap->HasEvent()) {
+        // Reads of a port that signals an event return zero.
+        if (io_info.input) {
+            if (io_info.access_size == 4)
+                guest_state->rax = 0;
+            else
+                memset(&guest_state->rax, 0, io_info.access_size);
+        }
+        return trap->Signal();
+    }
+
     memset(packet, 0, sizeof(*packet));
     packet->key = trap->key();
     packet->type = ZX_PKT_TYPE_GUEST_IO;
@@ -671,6 +717,8 @@ static zx_status_t handle_trap(const ExitInfo& exit_info, AutoVmcs* vmcs, zx_vad
 
     switch (trap->kind()) {
     case ZX_GUEST_TRAP_BELL:
+        if (trap->HasEvent())
+            return trap->Signal();
         memset(packet, 0, sizeof(*packet));
         packet->key = trap->key();
         packet->type = ZX_PKT_TYPE_GUEST_BELL;
@@ -764,38 +812,49 @@ zx_status_t vmexit_handler(AutoVmcs* vmcs, GuestState* guest_state,
 
     switch (exit_info.exit_reason) {
     case ExitReason::EXTERNAL_INTERRUPT:
+        kcounter_add(vmexit_external_interrupt, 1u);
         return handle_external_interrupt(vmcs, local_apic_state);
     case ExitReason::INTERRUPT_WINDOW:
         LTRACEF("handling interrupt window\n\n");
+        kcounter_add(vmexit_interrupt_window, 1u);
         return handle_interrupt_window(vmcs, local_apic_state);
     case ExitReason::CPUID:
         LTRACEF("handling CPUID instruction\n\n");
+        kcounter_add(vmexit_cpuid, 1u);
         return handle_cpuid(exit_info, vmcs, guest_state);
     case ExitReason::HLT:
         LTRACEF("handling HLT instruction\n\n");
+        kcounter_add(vmexit_hlt, 1u);
         return handle_hlt(exit_info, vmcs, local_apic_state);
     case ExitReason::IO_INSTRUCTION:
+        kcounter_add(vmexit_io_instruction, 1u);
         return handle_io_instruction(exit_info, vmcs, guest_state, traps, packet);
     case ExitReason::RDMSR:
         LTRACEF("handling RDMSR instruction %#" PRIx64 "\n\n", guest_state->rcx);
+        kcounter_add(vmexit_rdmsr, 1u);
         return handle_rdmsr(exit_info, vmcs, guest_state, local_apic_state);
     case ExitReason::WRMSR:
         LTRACEF("handling WRMSR instruction %#" PRIx64 "\n\n", guest_state->rcx);
+        kcounter_add(vmexit_wrmsr, 1u);
         return handle_wrmsr(exit_info, vmcs, guest_state, local_apic_state, packet);
     case ExitReason::ENTRY_FAILURE_GUEST_STATE:
     case ExitReason::ENTRY_FAILURE_MSR_LOADING:
         LTRACEF("handling VM entry failure\n\n");
+        kcounter_add(vmexit_entry_failure, 1u);
         return ZX_ERR_BAD_STATE;
     case ExitReason::EPT_VIOLATION:
         LTRACEF("handling EPT violation\n\n");
+        kcounter_add(vmexit_ept_violation, 1u);
         return handle_ept_violation(exit_info, vmcs, gpas, traps, packet);
     case ExitReason::XSETBV:
         LTRACEF("handling XSETBV instruction\n\n");
+        kcounter_add(vmexit_xsetbv, 1u);
         return handle_xsetbv(exit_info, vmcs, guest_state);
     case ExitReason::EXCEPTION:
         // Currently all exceptions except NMI delivered to guest directly. NMI causes vmexit
         // and handled by host via IDT as any other interrupt/exception.
     default:
+        kcounter_add(vmexit_unhandled, 1u);
         dprintf(CRITICAL, "Unhandled VM exit %u (%s)\n", static_cast<uint32_t>(exit_info.exit_reason),
                 exit_reason_name(exit_info.exit_reason));
         return ZX_ERR_NOT_SUPPORTED;
@@ -15,6 +15,8 @@
 
 __BEGIN_CDECLS
 
+struct ipt_thread_state;
+
 struct arch_thread {
     vaddr_t sp;
 #if __has_feature(safe_stack)
@@ -45,6 +47,9 @@ struct arch_thread {
 
     /* if non-NULL, address to return to on page fault */
     void *page_fault_resume;
+
+    /* if non-NULL, the Intel PT buffer this thread is traced into */
+    struct ipt_thread_state *ipt_state;
 };
 
 static inline void x86_set_suspended_general_regs(struct arch_thread *thread,
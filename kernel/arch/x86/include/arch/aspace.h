@@ -41,8 +41,7 @@ private:
     IntermediatePtFlags intermediate_flags() final;
     PtFlags terminal_flags(PageTableLevel level, uint flags) final;
     PtFlags split_flags(PageTableLevel level, PtFlags flags) final;
-    void TlbInvalidatePage(PageTableLevel level, vaddr_t vaddr, bool global_page,
-                           bool was_terminal) final;
+    void TlbInvalidate(PendingTlbInvalidation* pending) final;
     uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) final;
     bool needs_cache_flushes() final { return false; }
 
@@ -64,8 +63,7 @@ private:
     IntermediatePtFlags intermediate_flags() final;
     PtFlags terminal_flags(PageTableLevel level, uint flags) final;
     PtFlags split_flags(PageTableLevel level, PtFlags flags) final;
-    void TlbInvalidatePage(PageTableLevel level, vaddr_t vaddr, bool global_page,
-                           bool was_terminal) final;
+    void TlbInvalidate(PendingTlbInvalidation* pending) final;
     uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) final;
     bool needs_cache_flushes() final { return false; }
 };
@@ -98,6 +96,15 @@ public:
 
     int active_cpus() { return active_cpus_.load(); }
 
+    // Note that cpus not currently running in this aspace may hold stale TLB
+    // entries tagged with its PCID, so they must flush them when they next
+    // switch to it.
+    void MarkPcidStale() {
+        if (pcid_ != 0) {
+            pcid_stale_cpus_.fetch_or(-1);
+        }
+    }
+
     IoBitmap& io_bitmap() { return io_bitmap_; }
 
     static void ContextSwitch(X86ArchVmAspace* from, X86ArchVmAspace* to);
@@ -131,6 +138,14 @@ private:
     // CPUs that are currently executing in this aspace.
     // Actually an mp_cpu_mask_t, but header dependencies.
     fbl::atomic_int active_cpus_{0};
+
+    // PCID that tags this aspace's TLB entries, or 0 if it doesn't have one and
+    // has to be flushed on every switch to it.
+    uint16_t pcid_ = 0;
+
+    // CPUs that must flush this aspace's PCID the next time they switch to it.
+    // Actually an mp_cpu_mask_t, but header dependencies.
+    fbl::atomic_int pcid_stale_cpus_{0};
 };
 
 using ArchVmAspace = X86ArchVmAspace;
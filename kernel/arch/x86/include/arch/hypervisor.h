@@ -56,7 +56,8 @@ public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Guest);
 
     zx_status_t SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                        fbl::RefPtr<PortDispatcher> port, uint64_t key);
+                        fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                        uint64_t key);
 
     GuestPhysicalAddressSpace* AddressSpace() const { return gpas_.get(); }
     TrapMap* Traps() { return &traps_; }
@@ -72,12 +73,23 @@ private:
     Guest() = default;
 };
 
+// Posted-interrupt descriptor. See Volume 3, Section 29.6.
+struct PostedInterruptDescriptor {
+    uint64_t pir[4];
+    uint64_t control;
+    uint64_t reserved[3];
+};
+
 // Stores the local APIC state across VM exits.
 struct LocalApicState {
     // Timer for APIC timer.
     timer_t timer;
     // Tracks active interrupts.
     hypervisor::InterruptTracker<X86_INT_COUNT> interrupt_tracker;
+    // Set if the processor supports posted interrupts, in which case the
+    // tracker only holds interrupts raised by the host, such as the timer.
+    PostedInterruptDescriptor* pi_desc = nullptr;
+    uint8_t* virtual_apic = nullptr;
     // LVT timer configuration
     uint32_t lvt_timer = LVT_MASKED; // Initial state is masked (Vol 3 Section 10.12.5.1).
     uint32_t lvt_initial_count;
@@ -109,6 +121,8 @@ private:
     VmxPage host_msr_page_;
     VmxPage guest_msr_page_;
     VmxPage vmcs_page_;
+    VmxPage virtual_apic_page_;
+    VmxPage pi_desc_page_;
 
     Vcpu(uint16_t vpid, const thread_t* thread, GuestPhysicalAddressSpace* gpas, TrapMap* traps);
 };
@@ -118,7 +132,8 @@ zx_status_t arch_guest_create(fbl::RefPtr<VmObject> physmem, fbl::unique_ptr<Gue
 
 // Set a trap within a guest.
 zx_status_t arch_guest_set_trap(Guest* guest, uint32_t kind, zx_vaddr_t addr, size_t len,
-                                fbl::RefPtr<PortDispatcher> port, uint64_t key);
+                                fbl::RefPtr<PortDispatcher> port,
+                                fbl::RefPtr<EventDispatcher> event, uint64_t key);
 
 // Create a VCPU.
 zx_status_t x86_vcpu_create(zx_vaddr_t ip, zx_vaddr_t cr3, zx_paddr_t msr_bitmaps_address,
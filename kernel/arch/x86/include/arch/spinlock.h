@@ -17,8 +17,14 @@ __BEGIN_CDECLS
 
 #define SPIN_LOCK_INITIAL_VALUE (spin_lock_t){0}
 
+/* A ticket lock: each cpu takes the next ticket and waits for |serving| to
+ * reach it, so waiters get the lock in the order they asked for it and only
+ * the cpu next in line is woken by an unlock. */
 typedef struct TA_CAP("mutex") spin_lock {
-    unsigned long value;
+    uint32_t serving;
+    uint32_t next;
+    /* cpu number + 1 of the holder, or 0 */
+    unsigned long holder;
 } spin_lock_t;
 
 typedef x86_flags_t spin_lock_saved_state_t;
@@ -35,12 +41,12 @@ static inline void arch_spin_lock_init(spin_lock_t *lock)
 
 static inline bool arch_spin_lock_held(spin_lock_t *lock)
 {
-    return __atomic_load_n(&lock->value, __ATOMIC_RELAXED) != 0;
+    return __atomic_load_n(&lock->holder, __ATOMIC_RELAXED) != 0;
 }
 
 static inline uint arch_spin_lock_holder_cpu(spin_lock_t *lock)
 {
-    return (uint)__atomic_load_n(&lock->value, __ATOMIC_RELAXED) - 1;
+    return (uint)__atomic_load_n(&lock->holder, __ATOMIC_RELAXED) - 1;
 }
 
 /* flags are unused on x86 */
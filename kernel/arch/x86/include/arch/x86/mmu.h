@@ -64,6 +64,10 @@
 
 #define X86_MMU_PG_NX           (1UL << 63)
 
+/* CR3 fields used when PCIDs are enabled */
+#define X86_CR3_PCID_MASK       0xfffUL
+#define X86_CR3_NOFLUSH         (1UL << 63) /* keep TLB entries tagged with the new PCID */
+
 #define X86_PAGING_LEVELS       4
 
 #define MMU_GUEST_SIZE_SHIFT    48
@@ -7,6 +7,7 @@
 #pragma once
 
 #include <err.h>
+#include <kernel/thread.h>
 #include <stdint.h>
 
 #include <zircon/compiler.h>
@@ -38,4 +39,21 @@ zx_status_t x86_ipt_stage_cpu_data(uint32_t options, const zx_x86_pt_regs_t* reg
 
 zx_status_t x86_ipt_get_cpu_data(uint32_t options, zx_x86_pt_regs_t* regs);
 
+// Thread mode: |descriptor| is a slot in [0, IPT_MAX_NUM_THREADS).
+// The caller must keep |thread| alive until it is released or the trace is
+// freed.
+zx_status_t x86_ipt_assign_thread(uint32_t descriptor, thread_t* thread);
+
+zx_status_t x86_ipt_release_thread(uint32_t descriptor);
+
+zx_status_t x86_ipt_thread_mode_start();
+
+zx_status_t x86_ipt_thread_mode_stop();
+
+zx_status_t x86_ipt_stage_thread_data(uint32_t descriptor, const zx_x86_pt_regs_t* regs);
+
+zx_status_t x86_ipt_get_thread_data(uint32_t descriptor, zx_x86_pt_regs_t* regs);
+
+void x86_ipt_context_switch(thread_t* old_thread, thread_t* new_thread);
+
 #endif // __cplusplus
@@ -16,6 +16,9 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/mmu_mem_types.h>
+#include <fbl/algorithm.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
 #include <kernel/mp.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/pmm.h>
@@ -33,6 +36,14 @@ uint8_t g_paddr_width = 32;
 /* True if the system supports 1GB pages */
 static bool supports_huge_pages = false;
 
+/* True if TLB entries are tagged with process-context identifiers */
+static bool supports_pcid = false;
+
+/* PCIDs handed out to user address spaces.  PCID 0 belongs to the kernel
+ * aspace, and to any user aspace that couldn't get one of its own. */
+static fbl::Mutex pcid_lock;
+static uint64_t pcid_bitmap[(X86_CR3_PCID_MASK + 1) / 64] TA_GUARDED(pcid_lock) = {1};
+
 /* top level kernel page tables, initialized in start.S */
 volatile pt_entry_t pml4[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE);
 volatile pt_entry_t pdp[NO_OF_PT_ENTRIES] __ALIGNED(PAGE_SIZE); /* temporary */
@@ -105,6 +116,26 @@ static bool x86_mmu_check_paddr(paddr_t paddr) {
     return paddr <= max_paddr;
 }
 
+static uint16_t x86_pcid_alloc() {
+    fbl::AutoLock a(&pcid_lock);
+    for (size_t i = 0; i < fbl::count_of(pcid_bitmap); i++) {
+        if (~pcid_bitmap[i] != 0) {
+            uint bit = __builtin_ctzll(~pcid_bitmap[i]);
+            pcid_bitmap[i] |= 1ull << bit;
+            return static_cast<uint16_t>(i * 64 + bit);
+        }
+    }
+    return 0;
+}
+
+static void x86_pcid_free(uint16_t pcid) {
+    if (pcid == 0)
+        return;
+    fbl::AutoLock a(&pcid_lock);
+    DEBUG_ASSERT(pcid_bitmap[pcid / 64] & (1ull << (pcid % 64)));
+    pcid_bitmap[pcid / 64] &= ~(1ull << (pcid % 64));
+}
+
 /**
  * @brief  invalidate all TLB entries, including global entries
  */
@@ -119,67 +150,81 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
+/**
+ * @brief  invalidate all TLB entries for the current PCID, excluding global entries
+ */
+static void x86_tlb_nonglobal_invalidate() {
+    x86_set_cr3(x86_get_cr3());
+}
+
+/* Task used for invalidating a set of TLB entries on each CPU */
 struct TlbInvalidatePage_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum PageTableLevel level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
 static void TlbInvalidatePage_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     TlbInvalidatePage_context* context = (TlbInvalidatePage_context*)raw_context;
 
-    ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    ulong cr3 = x86_get_cr3() & ~X86_CR3_PCID_MASK;
+    bool is_target = context->target_cr3 == cr3;
+    if (!is_target && !context->pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (context->pending->full_shootdown) {
+        if (context->pending->contains_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            x86_tlb_nonglobal_invalidate();
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < context->pending->count; ++i) {
+        const auto& item = context->pending->item[i];
+        if (!is_target && !item.is_global) {
+            continue;
+        }
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.addr));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Perform a batch of TLB invalidations for a page table
  *
- * @param pt The page table we're invalidating for (if nullptr, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
+ * Issues a single mp_sync_exec for the whole batch, rather than one per page.
  *
- * TODO(ZX-979): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param pt The page table we're invalidating for (if nullptr, assume for current one)
+ * @param pending The invalidations to perform
  */
-static void x86_tlb_invalidate_page(X86PageTableBase* pt, vaddr_t vaddr,
-                                    enum PageTableLevel level, bool global_page) {
-    ulong cr3 = pt ? pt->phys() : x86_get_cr3();
+static void x86_tlb_invalidate(X86PageTableBase* pt, const PendingTlbInvalidation* pending) {
+    if (pending->count == 0 && !pending->full_shootdown) {
+        return;
+    }
+
+    ulong cr3 = pt ? pt->phys() : x86_get_cr3() & ~X86_CR3_PCID_MASK;
     struct TlbInvalidatePage_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
+        .target_cr3 = cr3, .pending = pending,
     };
 
     /* Target only CPUs this aspace is active on.  It may be the case that some
      * other CPU will become active in it after this load, or will have left it
      * just before this load.  In the former case, it is becoming active after
      * the write to the page table, so it will see the change.  In the latter
-     * case, it will get a spurious request to flush. */
+     * case, it will get a spurious request to flush.  CPUs that aren't
+     * targeted may still hold entries tagged with the aspace's PCID, so they
+     * are told to flush it the next time they switch to it. */
     mp_ipi_target_t target;
     cpu_mask_t target_mask = 0;
-    if (global_page || pt == nullptr) {
+    if (pending->contains_global || pt == nullptr) {
         target = MP_IPI_TARGET_ALL;
     } else {
         target = MP_IPI_TARGET_MASK;
-        target_mask = static_cast<X86ArchVmAspace*>(pt->ctx())->active_cpus();
+        auto aspace = static_cast<X86ArchVmAspace*>(pt->ctx());
+        aspace->MarkPcidStale();
+        target_mask = aspace->active_cpus();
     }
 
     mp_sync_exec(target, target_mask, TlbInvalidatePage_task, &task_context);
@@ -282,9 +327,8 @@ X86PageTableBase::PtFlags X86PageTableMmu::split_flags(PageTableLevel level,
     return flags;
 }
 
-void X86PageTableMmu::TlbInvalidatePage(PageTableLevel level, vaddr_t vaddr, bool global_page,
-                                        bool was_terminal) {
-    x86_tlb_invalidate_page(this, vaddr, level, global_page);
+void X86PageTableMmu::TlbInvalidate(PendingTlbInvalidation* pending) {
+    x86_tlb_invalidate(this, pending);
 }
 
 uint X86PageTableMmu::pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) {
@@ -392,8 +436,7 @@ X86PageTableBase::PtFlags X86PageTableEpt::split_flags(PageTableLevel level,
     return flags;
 }
 
-void X86PageTableEpt::TlbInvalidatePage(PageTableLevel level, vaddr_t vaddr, bool global_page,
-                                        bool was_terminal) {
+void X86PageTableEpt::TlbInvalidate(PendingTlbInvalidation* pending) {
     // TODO(ZX-981): Implement this.
 }
 
@@ -420,7 +463,9 @@ void x86_mmu_early_init() {
 
     // Unmap the lower identity mapping.
     pml4[0] = 0;
-    x86_tlb_invalidate_page(nullptr, 0, PML4_L, false);
+    PendingTlbInvalidation tlb;
+    tlb.enqueue(0, PML4_L, /* global */ false, /* terminal */ false);
+    x86_tlb_invalidate(nullptr, &tlb);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
@@ -532,6 +577,12 @@ zx_status_t X86ArchVmAspace::Init(vaddr_t base, size_t size, uint mmu_flags) {
             return status;
         }
 
+        if (supports_pcid) {
+            pcid_ = x86_pcid_alloc();
+            // A recycled PCID may still have entries from its last owner on any cpu.
+            pcid_stale_cpus_.store(-1);
+        }
+
         LTRACEF("user aspace: pt phys %#" PRIxPTR ", virt %p\n", pt_->phys(), pt_->virt());
     }
     fbl::atomic_init(&active_cpus_, 0);
@@ -548,6 +599,8 @@ zx_status_t X86ArchVmAspace::Destroy() {
     } else {
         static_cast<X86PageTableMmu*>(pt_)->Destroy(base_, size_);
     }
+    x86_pcid_free(pcid_);
+    pcid_ = 0;
     return ZX_OK;
 }
 
@@ -587,12 +640,24 @@ void X86ArchVmAspace::ContextSwitch(X86ArchVmAspace* old_aspace, X86ArchVmAspace
         aspace->canary_.Assert();
         paddr_t phys = aspace->pt_phys();
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, phys);
-        x86_set_cr3(phys);
+
+        // Become active before checking for stale entries, pairing with the
+        // order in x86_tlb_invalidate(): a concurrent invalidation either sees
+        // this cpu as active and sends it an IPI, or marks it stale here.
+        aspace->active_cpus_.fetch_or(cpu_bit);
+        ulong cr3 = phys;
+        if (aspace->pcid_ != 0) {
+            bool stale = aspace->pcid_stale_cpus_.fetch_and(~cpu_bit) & cpu_bit;
+            cr3 |= aspace->pcid_;
+            if (!stale) {
+                cr3 |= X86_CR3_NOFLUSH;
+            }
+        }
+        x86_set_cr3(cr3);
 
         if (old_aspace != nullptr) {
             old_aspace->active_cpus_.fetch_and(~cpu_bit);
         }
-        aspace->active_cpus_.fetch_or(cpu_bit);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -631,6 +696,13 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    /* Tag TLB entries with PCIDs, so switching aspaces needn't flush them.
+     * The current CR3 is the kernel's, with PCID 0, as required. */
+    if (x86_feature_test(X86_FEATURE_PCID)) {
+        DEBUG_ASSERT((x86_get_cr3() & X86_CR3_PCID_MASK) == 0);
+        cr4 |= X86_CR4_PCIDE;
+        supports_pcid = true;
+    }
     x86_set_cr4(cr4);
 
     // Set NXE bit in X86_MSR_IA32_EFER.
@@ -153,6 +153,80 @@ static bool mmu_tests(void* context) {
     END_TEST;
 }
 
+static bool pending_tlb_invalidation_tests(void* context) {
+    BEGIN_TEST;
+
+    unittest_printf("queueing a few pages keeps them individually\n");
+    {
+        PendingTlbInvalidation tlb;
+        tlb.enqueue(PAGE_SIZE, PT_L, false, true);
+        tlb.enqueue(2 * PAGE_SIZE, PT_L, false, true);
+        EXPECT_EQ(2u, tlb.count, "two pages queued");
+        EXPECT_FALSE(tlb.full_shootdown, "no full shootdown");
+        EXPECT_FALSE(tlb.contains_global, "no global pages");
+
+        tlb.clear();
+        EXPECT_EQ(0u, tlb.count, "cleared");
+    }
+
+    unittest_printf("queueing too many pages falls back to a full shootdown\n");
+    {
+        PendingTlbInvalidation tlb;
+        for (size_t i = 0; i <= PendingTlbInvalidation::kMaxPages; i++) {
+            tlb.enqueue(i * PAGE_SIZE, PT_L, i == 0, true);
+        }
+        EXPECT_TRUE(tlb.full_shootdown, "full shootdown");
+        EXPECT_TRUE(tlb.contains_global, "global page remembered");
+        tlb.clear();
+        EXPECT_FALSE(tlb.full_shootdown, "cleared");
+        EXPECT_FALSE(tlb.contains_global, "cleared");
+    }
+
+    unittest_printf("unlinking a top level entry is a full shootdown\n");
+    {
+        PendingTlbInvalidation tlb;
+        tlb.enqueue(0, PML4_L, false, false);
+        EXPECT_TRUE(tlb.full_shootdown, "full shootdown");
+        EXPECT_EQ(0u, tlb.count, "nothing queued individually");
+    }
+
+    unittest_printf("mapping and unmapping many pages in one call\n");
+    {
+        ArchVmAspace aspace;
+        vaddr_t base = 1UL << 20;
+        size_t size = (1UL << 47) - base - (1UL << 20);
+        zx_status_t err = aspace.Init(1UL << 20, size, 0);
+        EXPECT_EQ(err, ZX_OK, "init aspace");
+
+        const uint arch_rw_flags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+        static const size_t count = PendingTlbInvalidation::kMaxPages * 4;
+        vaddr_t va = 1UL << PDP_SHIFT;
+
+        size_t mapped;
+        err = aspace.MapContiguous(va, 0, count, arch_rw_flags, &mapped);
+        EXPECT_EQ(err, ZX_OK, "map pages");
+        EXPECT_EQ(count, mapped, "map pages");
+
+        err = aspace.Protect(va, count, ARCH_MMU_FLAG_PERM_READ);
+        EXPECT_EQ(err, ZX_OK, "protect pages");
+
+        size_t unmapped;
+        err = aspace.Unmap(va, count, &unmapped);
+        EXPECT_EQ(err, ZX_OK, "unmap pages");
+        EXPECT_EQ(count, unmapped, "unmap pages");
+        EXPECT_EQ(aspace.pt_pages(), 1u, "page tables freed after unmap");
+
+        paddr_t pa;
+        EXPECT_EQ(ZX_ERR_NOT_FOUND, aspace.Query(va, &pa, nullptr), "page is gone");
+
+        err = aspace.Destroy();
+        EXPECT_EQ(err, ZX_OK, "destroy aspace");
+    }
+
+    END_TEST;
+}
+
 UNITTEST_START_TESTCASE(x86_mmu_tests)
 UNITTEST("mmu tests", mmu_tests)
+UNITTEST("pending tlb invalidation tests", pending_tlb_invalidation_tests)
 UNITTEST_END_TESTCASE(x86_mmu_tests, "x86_mmu", "x86 mmu tests", nullptr, nullptr);
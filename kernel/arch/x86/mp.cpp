@@ -36,6 +36,28 @@
 struct x86_percpu* ap_percpus;
 uint8_t x86_num_cpus = 1;
 
+// set of cpus sharing a last level cache with each cpu, computed once the
+// apic ids of all of the cpus are known
+static cpu_mask_t cache_sibling_masks[SMP_MAX_CPUS];
+
+static void x86_compute_cache_siblings(const uint32_t* apic_ids, uint cpu_count) {
+    x86_cpu_topology_t topo[SMP_MAX_CPUS];
+    for (uint i = 0; i < cpu_count; ++i) {
+        x86_cpu_topology_decode(apic_ids[i], &topo[i]);
+    }
+
+    for (uint i = 0; i < cpu_count; ++i) {
+        cpu_mask_t mask = 0;
+        for (uint j = 0; j < cpu_count; ++j) {
+            if (topo[i].package_id == topo[j].package_id &&
+                topo[i].cache_id == topo[j].cache_id) {
+                mask |= cpu_num_to_mask(j);
+            }
+        }
+        cache_sibling_masks[i] = mask;
+    }
+}
+
 extern struct idt _idt;
 
 zx_status_t x86_allocate_ap_structures(uint32_t* apic_ids, uint8_t cpu_count) {
@@ -58,6 +80,9 @@ zx_status_t x86_allocate_ap_structures(uint32_t* apic_ids, uint8_t cpu_count) {
     uint32_t bootstrap_ap = apic_local_id();
     DEBUG_ASSERT(bootstrap_ap == apic_bsp_id());
 
+    uint32_t cpu_apic_ids[SMP_MAX_CPUS];
+    cpu_apic_ids[0] = bootstrap_ap;
+
     uint apic_idx = 0;
     for (uint i = 0; i < cpu_count; ++i) {
         if (apic_ids[i] == bootstrap_ap) {
@@ -71,9 +96,12 @@ zx_status_t x86_allocate_ap_structures(uint32_t* apic_ids, uint8_t cpu_count) {
         ap_percpus[apic_idx].cpu_num = apic_idx + 1;
         ap_percpus[apic_idx].apic_id = apic_ids[i];
         ap_percpus[apic_idx].direct = &ap_percpus[apic_idx];
+        cpu_apic_ids[apic_idx + 1] = apic_ids[i];
         apic_idx++;
     }
 
+    x86_compute_cache_siblings(cpu_apic_ids, cpu_count);
+
     x86_num_cpus = cpu_count;
     return ZX_OK;
 }
@@ -199,6 +227,19 @@ int x86_apic_id_to_cpu_num(uint32_t apic_id) {
     return -1;
 }
 
+uint32_t x86_cpu_num_to_apic_id(cpu_num_t cpu_num) {
+    DEBUG_ASSERT(cpu_num < x86_num_cpus);
+    if (cpu_num == 0) {
+        return bp_percpu.apic_id;
+    }
+    return ap_percpus[cpu_num - 1].apic_id;
+}
+
+cpu_mask_t arch_mp_get_cache_siblings(cpu_num_t cpu_num) {
+    DEBUG_ASSERT(cpu_num < SMP_MAX_CPUS);
+    return cache_sibling_masks[cpu_num] | cpu_num_to_mask(cpu_num);
+}
+
 zx_status_t arch_mp_send_ipi(mp_ipi_target_t target, cpu_mask_t mask, mp_ipi_t ipi) {
     uint8_t vector = 0;
     switch (ipi) {
@@ -20,6 +20,33 @@ enum PageTableLevel {
     PML4_L,
 };
 
+// Structure for tracking the TLB invalidations needed by a page table
+// operation, so that they can be performed with a single shootdown.
+struct PendingTlbInvalidation {
+    struct Item {
+        vaddr_t addr;
+        PageTableLevel level;
+        bool is_global;
+        bool is_terminal;
+    };
+
+    // Above this many pages, the whole TLB is flushed instead.
+    static constexpr size_t kMaxPages = 32;
+
+    // Add address |v|, translated at depth |level|, to the set of addresses to invalidate.
+    void enqueue(vaddr_t v, PageTableLevel level, bool is_global_page, bool is_terminal);
+
+    // Clear the list of pending invalidations.
+    void clear();
+
+    Item item[kMaxPages];
+    size_t count = 0;
+    // If true, ignore |item| and flush the whole TLB.
+    bool full_shootdown = false;
+    // If true, at least one enqueued entry was for a global page.
+    bool contains_global = false;
+};
+
 class X86PageTableBase {
 public:
     X86PageTableBase();
@@ -74,9 +101,8 @@ protected:
     // Return the hardware flags to use on smaller pages after a splitting a
     // large page with flags |flags|.
     virtual PtFlags split_flags(PageTableLevel level, PtFlags flags) = 0;
-    // Invalidate a single page at the given level
-    virtual void TlbInvalidatePage(PageTableLevel level, vaddr_t vaddr, bool global_page,
-                                   bool was_terminal) = 0;
+    // Perform the invalidations in |pending| on every cpu that may need them.
+    virtual void TlbInvalidate(PendingTlbInvalidation* pending) = 0;
     // Convert PtFlags to ARCH_MMU_* flags.
     virtual uint pt_flags_to_mmu_flags(PtFlags flags, PageTableLevel level) = 0;
     // Returns true if a cache flush is necessary for pagetable changes to be
@@ -98,28 +124,29 @@ private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(X86PageTableBase);
 
     class CacheLineFlusher;
+    class ConsistencyManager;
     struct MappingCursor;
 
     zx_status_t AddMapping(volatile pt_entry_t* table, uint mmu_flags,
                            PageTableLevel level, const MappingCursor& start_cursor,
-                           MappingCursor* new_cursor) TA_REQ(lock_);
+                           MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
     zx_status_t AddMappingL0(volatile pt_entry_t* table, uint mmu_flags,
                              const MappingCursor& start_cursor,
-                             MappingCursor* new_cursor) TA_REQ(lock_);
+                             MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
 
     bool RemoveMapping(volatile pt_entry_t* table,
                        PageTableLevel level, const MappingCursor& start_cursor,
-                       MappingCursor* new_cursor) TA_REQ(lock_);
+                       MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
     bool RemoveMappingL0(volatile pt_entry_t* table,
                          const MappingCursor& start_cursor,
-                         MappingCursor* new_cursor) TA_REQ(lock_);
+                         MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
 
     zx_status_t UpdateMapping(volatile pt_entry_t* table, uint mmu_flags,
                               PageTableLevel level, const MappingCursor& start_cursor,
-                              MappingCursor* new_cursor) TA_REQ(lock_);
+                              MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
     zx_status_t UpdateMappingL0(volatile pt_entry_t* table, uint mmu_flags,
                                 const MappingCursor& start_cursor,
-                                MappingCursor* new_cursor) TA_REQ(lock_);
+                                MappingCursor* new_cursor, ConsistencyManager* cm) TA_REQ(lock_);
 
     zx_status_t GetMapping(volatile pt_entry_t* table, vaddr_t vaddr,
                            PageTableLevel level,
@@ -130,12 +157,12 @@ private:
                              volatile pt_entry_t** mapping) TA_REQ(lock_);
 
     zx_status_t SplitLargePage(PageTableLevel level, vaddr_t vaddr,
-                               volatile pt_entry_t* pte) TA_REQ(lock_);
+                               volatile pt_entry_t* pte, ConsistencyManager* cm) TA_REQ(lock_);
 
-    void UpdateEntry(CacheLineFlusher* flusher,
+    void UpdateEntry(ConsistencyManager* cm, CacheLineFlusher* flusher,
                      PageTableLevel level, vaddr_t vaddr, volatile pt_entry_t* pte,
                      paddr_t paddr, PtFlags flags, bool was_terminal) TA_REQ(lock_);
-    void UnmapEntry(CacheLineFlusher* flusher,
+    void UnmapEntry(ConsistencyManager* cm, CacheLineFlusher* flusher,
                     PageTableLevel level, vaddr_t vaddr, volatile pt_entry_t* pte,
                     bool was_terminal) TA_REQ(lock_);
 
@@ -9,6 +9,7 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/page_tables/constants.h>
 #include <assert.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
 #include <trace.h>
@@ -134,6 +135,80 @@ void X86PageTableBase::CacheLineFlusher::FlushPtEntry(const volatile pt_entry_t*
     }
 }
 
+// Utility for gathering up the side effects of a page table operation: TLB
+// invalidations are batched into a single shootdown, and page tables that were
+// unlinked are only freed once no cpu can still be walking them.  Finishes on
+// destruction, which must happen with the page table lock held.
+class X86PageTableBase::ConsistencyManager {
+public:
+    explicit ConsistencyManager(X86PageTableBase* pt);
+    ~ConsistencyManager();
+
+    // Queue an invalidation of |vaddr|, which was translated at |level|.
+    void queue_invalidation(PageTableLevel level, vaddr_t vaddr, bool is_global,
+                            bool is_terminal) {
+        pending_tlb_.enqueue(vaddr, level, is_global, is_terminal);
+    }
+
+    // Queue an unlinked page table to be freed after the invalidations.
+    void queue_free(vm_page_t* page) {
+        list_add_tail(&to_free_, &page->free.node);
+    }
+
+    // Perform the queued work.
+    void Finish();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ConsistencyManager);
+
+    X86PageTableBase* const pt_;
+    PendingTlbInvalidation pending_tlb_;
+    list_node to_free_ = LIST_INITIAL_VALUE(to_free_);
+};
+
+X86PageTableBase::ConsistencyManager::ConsistencyManager(X86PageTableBase* pt)
+    : pt_(pt) {
+}
+
+X86PageTableBase::ConsistencyManager::~ConsistencyManager() {
+    Finish();
+}
+
+void X86PageTableBase::ConsistencyManager::Finish() {
+    if (pending_tlb_.count > 0 || pending_tlb_.full_shootdown) {
+        pt_->TlbInvalidate(&pending_tlb_);
+        pending_tlb_.clear();
+    }
+    if (!list_is_empty(&to_free_)) {
+        pmm_free(&to_free_);
+    }
+}
+
+void PendingTlbInvalidation::enqueue(vaddr_t v, PageTableLevel level, bool is_global_page,
+                                     bool is_terminal) {
+    if (is_global_page) {
+        contains_global = true;
+    }
+
+    // We mark PML4_L entries as full shootdowns, since it's going to be
+    // expensive one way or another.
+    if (count >= fbl::count_of(item) || level == PML4_L) {
+        full_shootdown = true;
+        return;
+    }
+    item[count].addr = v;
+    item[count].level = level;
+    item[count].is_global = is_global_page;
+    item[count].is_terminal = is_terminal;
+    count++;
+}
+
+void PendingTlbInvalidation::clear() {
+    count = 0;
+    full_shootdown = false;
+    contains_global = false;
+}
+
 struct X86PageTableBase::MappingCursor {
 public:
     /**
@@ -157,7 +232,7 @@ public:
     size_t size;
 };
 
-void X86PageTableBase::UpdateEntry(CacheLineFlusher* flusher,
+void X86PageTableBase::UpdateEntry(ConsistencyManager* cm, CacheLineFlusher* flusher,
                                    PageTableLevel level, vaddr_t vaddr, volatile pt_entry_t* pte,
                                    paddr_t paddr, PtFlags flags, bool was_terminal) {
     DEBUG_ASSERT(pte);
@@ -175,11 +250,11 @@ void X86PageTableBase::UpdateEntry(CacheLineFlusher* flusher,
         // non-coherent remapping hardware sees the old PTE after the
         // invalidation.
         flusher->ForceFlush();
-        TlbInvalidatePage(level, vaddr, is_kernel_address(vaddr), was_terminal);
+        cm->queue_invalidation(level, vaddr, is_kernel_address(vaddr), was_terminal);
     }
 }
 
-void X86PageTableBase::UnmapEntry(CacheLineFlusher* flusher,
+void X86PageTableBase::UnmapEntry(ConsistencyManager* cm, CacheLineFlusher* flusher,
                                   PageTableLevel level, vaddr_t vaddr, volatile pt_entry_t* pte,
                                   bool was_terminal) {
     DEBUG_ASSERT(pte);
@@ -195,7 +270,7 @@ void X86PageTableBase::UnmapEntry(CacheLineFlusher* flusher,
         // non-coherent remapping hardware sees the old PTE after the
         // invalidation.
         flusher->ForceFlush();
-        TlbInvalidatePage(level, vaddr, is_kernel_address(vaddr), was_terminal);
+        cm->queue_invalidation(level, vaddr, is_kernel_address(vaddr), was_terminal);
     }
 }
 
@@ -219,7 +294,7 @@ static volatile pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 zx_status_t X86PageTableBase::SplitLargePage(PageTableLevel level, vaddr_t vaddr,
-                                             volatile pt_entry_t* pte) {
+                                             volatile pt_entry_t* pte, ConsistencyManager* cm) {
     DEBUG_ASSERT_MSG(level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, level);
 
@@ -242,7 +317,7 @@ zx_status_t X86PageTableBase::SplitLargePage(PageTableLevel level, vaddr_t vaddr
         volatile pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        UpdateEntry(&clf, lower_level(level), new_vaddr, e, new_paddr, flags,
+        UpdateEntry(cm, &clf, lower_level(level), new_vaddr, e, new_paddr, flags,
                     false /* was_terminal */);
         new_vaddr += ps;
         new_paddr += ps;
@@ -250,7 +325,7 @@ zx_status_t X86PageTableBase::SplitLargePage(PageTableLevel level, vaddr_t vaddr
     DEBUG_ASSERT(new_vaddr == vaddr + page_size(level));
 
     flags = intermediate_flags();
-    UpdateEntry(&clf, level, vaddr, pte, X86_VIRT_TO_PHYS(m), flags, true /* was_terminal */);
+    UpdateEntry(cm, &clf, level, vaddr, pte, X86_VIRT_TO_PHYS(m), flags, true /* was_terminal */);
     pages_++;
     return ZX_OK;
 }
@@ -335,14 +410,15 @@ zx_status_t X86PageTableBase::GetMappingL0(volatile pt_entry_t* table, vaddr_t v
  * @return true if at least one page was unmapped at this level
  */
 bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel level,
-                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
+                                     const MappingCursor& start_cursor, MappingCursor* new_cursor,
+                                     ConsistencyManager* cm) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", level, start_cursor.vaddr,
             start_cursor.size);
     DEBUG_ASSERT(check_vaddr(start_cursor.vaddr));
 
     if (level == PT_L) {
-        return RemoveMappingL0(table, start_cursor, new_cursor);
+        return RemoveMappingL0(table, start_cursor, new_cursor, cm);
     }
 
     *new_cursor = start_cursor;
@@ -365,7 +441,7 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
             bool vaddr_level_aligned = page_aligned(level, new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                UnmapEntry(&clf, level, new_cursor->vaddr, e, true /* was_terminal */);
+                UnmapEntry(cm, &clf, level, new_cursor->vaddr, e, true /* was_terminal */);
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -375,11 +451,11 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            zx_status_t status = SplitLargePage(level, page_vaddr, e);
+            zx_status_t status = SplitLargePage(level, page_vaddr, e, cm);
             if (status != ZX_OK) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                UnmapEntry(&clf, level, new_cursor->vaddr, e, true /* was_terminal */);
+                UnmapEntry(cm, &clf, level, new_cursor->vaddr, e, true /* was_terminal */);
                 unmapped = true;
 
                 new_cursor->SkipEntry(level);
@@ -391,7 +467,7 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
         MappingCursor cursor;
         volatile pt_entry_t* next_table = get_next_table_from_entry(pt_val);
         bool lower_unmapped = RemoveMapping(next_table, lower_level(level),
-                                            *new_cursor, &cursor);
+                                            *new_cursor, &cursor, cm);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -415,7 +491,7 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
             LTRACEF("L: %d free pt v %#" PRIxPTR " phys %#" PRIxPTR "\n",
                     level, (uintptr_t)next_table, ptable_phys);
 
-            UnmapEntry(&clf, level, new_cursor->vaddr, e, false /* was_terminal */);
+            UnmapEntry(cm, &clf, level, new_cursor->vaddr, e, false /* was_terminal */);
             vm_page_t* page = paddr_to_vm_page(ptable_phys);
 
             DEBUG_ASSERT(page);
@@ -423,7 +499,7 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
                              "page %p state %u, paddr %#" PRIxPTR "\n", page, page->state,
                              X86_VIRT_TO_PHYS(next_table));
 
-            pmm_free_page(page);
+            cm->queue_free(page);
             pages_--;
             unmapped = true;
         }
@@ -439,7 +515,7 @@ bool X86PageTableBase::RemoveMapping(volatile pt_entry_t* table, PageTableLevel
 // Base case of RemoveMapping for smallest page size.
 bool X86PageTableBase::RemoveMappingL0(volatile pt_entry_t* table,
                                        const MappingCursor& start_cursor,
-                                       MappingCursor* new_cursor) {
+                                       MappingCursor* new_cursor, ConsistencyManager* cm) {
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
 
@@ -451,7 +527,7 @@ bool X86PageTableBase::RemoveMappingL0(volatile pt_entry_t* table,
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         volatile pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            UnmapEntry(&clf, PT_L, new_cursor->vaddr, e, true /* was_terminal */);
+            UnmapEntry(cm, &clf, PT_L, new_cursor->vaddr, e, true /* was_terminal */);
             unmapped = true;
         }
 
@@ -479,7 +555,7 @@ bool X86PageTableBase::RemoveMappingL0(volatile pt_entry_t* table,
  */
 zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_flags,
                                          PageTableLevel level, const MappingCursor& start_cursor,
-                                         MappingCursor* new_cursor) {
+                                         MappingCursor* new_cursor, ConsistencyManager* cm) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(check_vaddr(start_cursor.vaddr));
     DEBUG_ASSERT(check_paddr(start_cursor.paddr));
@@ -488,7 +564,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
     *new_cursor = start_cursor;
 
     if (level == PT_L) {
-        return AddMappingL0(table, mmu_flags, start_cursor, new_cursor);
+        return AddMappingL0(table, mmu_flags, start_cursor, new_cursor, cm);
     }
 
     // Disable thread safety analysis, since Clang has trouble noticing that
@@ -500,7 +576,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
             // new_cursor->size should be how much is left to be mapped still
             cursor.size -= new_cursor->size;
             if (cursor.size > 0) {
-                RemoveMapping(table, level, cursor, &result);
+                RemoveMapping(table, level, cursor, &result, cm);
                 DEBUG_ASSERT(result.size == 0);
             }
         }
@@ -528,7 +604,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
         if (level_supports_large_pages && !IS_PAGE_PRESENT(pt_val) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            UpdateEntry(&clf, level, new_cursor->vaddr, table + index,
+            UpdateEntry(cm, &clf, level, new_cursor->vaddr, table + index,
                         new_cursor->paddr, term_flags | X86_MMU_PG_PS, false /* was_terminal */);
             new_cursor->paddr += ps;
             new_cursor->vaddr += ps;
@@ -544,7 +620,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, level);
 
-                UpdateEntry(&clf, level, new_cursor->vaddr, e,
+                UpdateEntry(cm, &clf, level, new_cursor->vaddr, e,
                             X86_VIRT_TO_PHYS(m), interm_flags, false /* was_terminal */);
                 pt_val = *e;
                 pages_++;
@@ -552,7 +628,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
 
             MappingCursor cursor;
             ret = AddMapping(get_next_table_from_entry(pt_val), mmu_flags,
-                             lower_level(level), *new_cursor, &cursor);
+                             lower_level(level), *new_cursor, &cursor, cm);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != ZX_OK) {
@@ -567,7 +643,7 @@ zx_status_t X86PageTableBase::AddMapping(volatile pt_entry_t* table, uint mmu_fl
 // Base case of AddMapping for smallest page size.
 zx_status_t X86PageTableBase::AddMappingL0(volatile pt_entry_t* table, uint mmu_flags,
                                            const MappingCursor& start_cursor,
-                                           MappingCursor* new_cursor) {
+                                           MappingCursor* new_cursor, ConsistencyManager* cm) {
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
 
     *new_cursor = start_cursor;
@@ -582,7 +658,7 @@ zx_status_t X86PageTableBase::AddMappingL0(volatile pt_entry_t* table, uint mmu_
             return ZX_ERR_ALREADY_EXISTS;
         }
 
-        UpdateEntry(&clf, PT_L, new_cursor->vaddr, e, new_cursor->paddr, term_flags,
+        UpdateEntry(cm, &clf, PT_L, new_cursor->vaddr, e, new_cursor->paddr, term_flags,
                     false /* was_terminal */);
 
         new_cursor->paddr += PAGE_SIZE;
@@ -607,14 +683,14 @@ zx_status_t X86PageTableBase::AddMappingL0(volatile pt_entry_t* table, uint mmu_
  */
 zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu_flags,
                                             PageTableLevel level, const MappingCursor& start_cursor,
-                                            MappingCursor* new_cursor) {
+                                            MappingCursor* new_cursor, ConsistencyManager* cm) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", level, start_cursor.vaddr,
             start_cursor.size);
     DEBUG_ASSERT(check_vaddr(start_cursor.vaddr));
 
     if (level == PT_L) {
-        return UpdateMappingL0(table, mmu_flags, start_cursor, new_cursor);
+        return UpdateMappingL0(table, mmu_flags, start_cursor, new_cursor, cm);
     }
 
     zx_status_t ret = ZX_OK;
@@ -639,7 +715,7 @@ zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                UpdateEntry(&clf, level, new_cursor->vaddr, e,
+                UpdateEntry(cm, &clf, level, new_cursor->vaddr, e,
                             paddr_from_pte(level, pt_val),
                             term_flags | X86_MMU_PG_PS, true /* was_terminal */);
                 new_cursor->vaddr += ps;
@@ -649,7 +725,7 @@ zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = SplitLargePage(level, page_vaddr, e);
+            ret = SplitLargePage(level, page_vaddr, e, cm);
             if (ret != ZX_OK) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -658,7 +734,7 @@ zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                RemoveMapping(table, level, cursor, &tmp_cursor);
+                RemoveMapping(table, level, cursor, &tmp_cursor, cm);
 
                 new_cursor->SkipEntry(level);
             }
@@ -668,7 +744,7 @@ zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu
         MappingCursor cursor;
         volatile pt_entry_t* next_table = get_next_table_from_entry(pt_val);
         ret = UpdateMapping(next_table, mmu_flags, lower_level(level),
-                            *new_cursor, &cursor);
+                            *new_cursor, &cursor, cm);
         *new_cursor = cursor;
         if (ret != ZX_OK) {
             // Currently this can't happen
@@ -684,7 +760,7 @@ zx_status_t X86PageTableBase::UpdateMapping(volatile pt_entry_t* table, uint mmu
 zx_status_t X86PageTableBase::UpdateMappingL0(volatile pt_entry_t* table,
                                               uint mmu_flags,
                                               const MappingCursor& start_cursor,
-                                              MappingCursor* new_cursor) {
+                                              MappingCursor* new_cursor, ConsistencyManager* cm) {
     LTRACEF("%016" PRIxPTR " %016zx\n", start_cursor.vaddr, start_cursor.size);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(start_cursor.size));
 
@@ -699,7 +775,7 @@ zx_status_t X86PageTableBase::UpdateMappingL0(volatile pt_entry_t* table,
         pt_entry_t pt_val = *e;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(pt_val)) {
-            UpdateEntry(&clf, PT_L, new_cursor->vaddr, e, paddr_from_pte(PT_L, pt_val), term_flags,
+            UpdateEntry(cm, &clf, PT_L, new_cursor->vaddr, e, paddr_from_pte(PT_L, pt_val), term_flags,
                         true /* was_terminal */);
         }
 
@@ -725,12 +801,13 @@ zx_status_t X86PageTableBase::UnmapPages(vaddr_t vaddr, const size_t count,
     fbl::AutoLock a(&lock_);
     DEBUG_ASSERT(virt_);
 
+    ConsistencyManager cm(this);
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
 
     MappingCursor result;
-    RemoveMapping(virt_, top_level(), start, &result);
+    RemoveMapping(virt_, top_level(), start, &result, &cm);
     DEBUG_ASSERT(result.size == 0);
 
     if (unmapped)
@@ -763,6 +840,9 @@ zx_status_t X86PageTableBase::MapPages(vaddr_t vaddr, paddr_t* phys, size_t coun
 
     PageTableLevel top = top_level();
 
+    // Declared before |undo| so that it finishes after any undo work.
+    ConsistencyManager cm(this);
+
     // TODO(teisenbe): Improve performance of this function by integrating deeper into
     // the algorithm (e.g. make the cursors aware of the page array).
     size_t idx = 0;
@@ -773,25 +853,33 @@ zx_status_t X86PageTableBase::MapPages(vaddr_t vaddr, paddr_t* phys, size_t coun
             };
 
             MappingCursor result;
-            RemoveMapping(virt_, top, start, &result);
+            RemoveMapping(virt_, top, start, &result, &cm);
             DEBUG_ASSERT(result.size == 0);
         }
     });
 
     vaddr_t v = vaddr;
-    for (; idx < count; ++idx) {
+    while (idx < count) {
+        // map physically contiguous runs of the array with a single cursor, so that
+        // suitably aligned runs can be backed by large pages
+        size_t run = 1;
+        while (idx + run < count && phys[idx + run] == phys[idx] + run * PAGE_SIZE) {
+            run++;
+        }
+
         MappingCursor start = {
-            .paddr = phys[idx], .vaddr = v, .size = PAGE_SIZE,
+            .paddr = phys[idx], .vaddr = v, .size = run * PAGE_SIZE,
         };
         MappingCursor result;
-        zx_status_t status = AddMapping(virt_, mmu_flags, top, start, &result);
+        zx_status_t status = AddMapping(virt_, mmu_flags, top, start, &result, &cm);
         if (status != ZX_OK) {
             dprintf(SPEW, "Add mapping failed with err=%d\n", status);
             return status;
         }
         DEBUG_ASSERT(result.size == 0);
 
-        v += PAGE_SIZE;
+        idx += run;
+        v += run * PAGE_SIZE;
     }
 
     if (mapped) {
@@ -822,11 +910,12 @@ zx_status_t X86PageTableBase::MapPagesContiguous(vaddr_t vaddr, paddr_t paddr,
     fbl::AutoLock a(&lock_);
     DEBUG_ASSERT(virt_);
 
+    ConsistencyManager cm(this);
     MappingCursor start = {
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
-    zx_status_t status = AddMapping(virt_, mmu_flags, top_level(), start, &result);
+    zx_status_t status = AddMapping(virt_, mmu_flags, top_level(), start, &result, &cm);
     if (status != ZX_OK) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -855,11 +944,12 @@ zx_status_t X86PageTableBase::ProtectPages(vaddr_t vaddr, size_t count, uint mmu
 
     fbl::AutoLock a(&lock_);
 
+    ConsistencyManager cm(this);
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
     MappingCursor result;
-    zx_status_t status = UpdateMapping(virt_, mmu_flags, top_level(), start, &result);
+    zx_status_t status = UpdateMapping(virt_, mmu_flags, top_level(), start, &result, &cm);
     if (status != ZX_OK) {
         return status;
     }
@@ -41,6 +41,7 @@
 #include <arch/mmu.h>
 #include <arch/x86.h>
 #include <arch/x86/apic.h>
+#include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu.h>
 #include <arch/x86/perf_mon.h>
@@ -157,7 +158,7 @@ static_assert(1
 static uint64_t kGlobalCtrlWritableBits;
 static uint64_t kFixedCounterCtrlWritableBits;
 
-static constexpr size_t kMaxRecordSize = sizeof(cpuperf_pc_record_t);
+static constexpr size_t kMaxRecordSize = sizeof(cpuperf_sample_record_t);
 
 // Commented out values represent currently unsupported features.
 // They remain present for documentation purposes.
@@ -576,6 +577,45 @@ static cpuperf_record_header_t* x86_perfmon_write_pc_record(
     return reinterpret_cast<cpuperf_record_header_t*>(rec);
 }
 
+// Records the interrupted thread and, for kernel samples, the innermost
+// return addresses found by following the frame pointers. The walk stays
+// within the current thread's kernel stack so that it can't fault.
+static cpuperf_record_header_t* x86_perfmon_write_sample_record(
+        cpuperf_record_header_t* hdr,
+        cpuperf_event_id_t event, uint64_t cr3, const x86_iframe_t* frame) {
+    auto rec = reinterpret_cast<cpuperf_sample_record_t*>(hdr);
+    x86_perfmon_write_header(&rec->header, CPUPERF_RECORD_SAMPLE, event);
+    thread_t* thread = get_current_thread();
+    rec->tid = thread->user_tid;
+    rec->pid = thread->user_pid;
+    rec->aspace = cr3;
+    rec->pc = frame->ip;
+    memset(rec->callchain, 0, sizeof(rec->callchain));
+
+    if (SELECTOR_PL(frame->cs) == 0) {
+        rec->header.reserved_flags |= CPUPERF_SAMPLE_FLAG_KERNEL;
+    }
+    if (SELECTOR_PL(frame->cs) == 0 && thread->stack_size >= 2 * sizeof(uintptr_t)) {
+        const uintptr_t stack_bottom = reinterpret_cast<uintptr_t>(thread->stack);
+        const uintptr_t stack_top = stack_bottom + thread->stack_size;
+        uintptr_t fp = frame->rbp;
+        for (size_t i = 0; i < countof(rec->callchain); ++i) {
+            if (fp < stack_bottom || fp > stack_top - 2 * sizeof(uintptr_t) ||
+                    fp % sizeof(uintptr_t) != 0)
+                break;
+            const uintptr_t* fp_ptr = reinterpret_cast<const uintptr_t*>(fp);
+            rec->callchain[i] = fp_ptr[1];
+            // Frames only ever move up the stack.
+            if (fp_ptr[0] <= fp)
+                break;
+            fp = fp_ptr[0];
+        }
+    }
+
+    ++rec;
+    return reinterpret_cast<cpuperf_record_header_t*>(rec);
+}
+
 zx_status_t x86_ipm_get_properties(zx_x86_ipm_properties_t* props) {
     fbl::AutoLock al(&perfmon_lock);
 
@@ -702,6 +742,11 @@ static zx_status_t x86_ipm_verify_fixed_config(
                 TRACEF("Unused bits set in |fixed_flags[%u]|\n", i);
                 return ZX_ERR_INVALID_ARGS;
             }
+            if ((config->fixed_flags[i] & IPM_CONFIG_FLAG_CALLCHAIN) &&
+                    !(config->fixed_flags[i] & IPM_CONFIG_FLAG_PC)) {
+                TRACEF("Callchain requested for |fixed_flags[%u]| without pc\n", i);
+                return ZX_ERR_INVALID_ARGS;
+            }
             if ((config->fixed_flags[i] & IPM_CONFIG_FLAG_TIMEBASE) &&
                     config->timebase_id == CPUPERF_EVENT_ID_NONE) {
                 TRACEF("Timebase requested for |fixed_flags[%u]|, but not provided\n", i);
@@ -760,6 +805,11 @@ static zx_status_t x86_ipm_verify_programmable_config(
                 TRACEF("Unused bits set in |programmable_flags[%u]|\n", i);
                 return ZX_ERR_INVALID_ARGS;
             }
+            if ((config->programmable_flags[i] & IPM_CONFIG_FLAG_CALLCHAIN) &&
+                    !(config->programmable_flags[i] & IPM_CONFIG_FLAG_PC)) {
+                TRACEF("Callchain requested for |programmable_flags[%u]| without pc\n", i);
+                return ZX_ERR_INVALID_ARGS;
+            }
             if ((config->programmable_flags[i] & IPM_CONFIG_FLAG_TIMEBASE) &&
                     config->timebase_id == CPUPERF_EVENT_ID_NONE) {
                 TRACEF("Timebase requested for |programmable_flags[%u]|, but not provided\n", i);
@@ -801,7 +851,7 @@ static zx_status_t x86_ipm_verify_misc_config(
             }
             // Currently we only support the MCHBAR counters.
             // They cannot provide pc. We ignore the OS/USER bits.
-            if (config->misc_flags[i] & IPM_CONFIG_FLAG_PC) {
+            if (config->misc_flags[i] & (IPM_CONFIG_FLAG_PC | IPM_CONFIG_FLAG_CALLCHAIN)) {
                 TRACEF("Invalid bits (0x%x) in |misc_flags[%u]|\n",
                        config->misc_flags[i], i);
                 return ZX_ERR_INVALID_ARGS;
@@ -1733,7 +1783,7 @@ static bool pmi_interrupt_handler(x86_iframe_t *frame, PerfmonState* state) {
 
     const uint64_t status = read_msr(IA32_PERF_GLOBAL_STATUS);
     uint64_t bits_to_clear = 0;
-    uint64_t cr3 = x86_get_cr3();
+    uint64_t cr3 = x86_get_cr3() & ~X86_CR3_PCID_MASK;
 
     LTRACEF("cpu %u: status 0x%" PRIx64 "\n", cpu, status);
 
@@ -1769,7 +1819,9 @@ static bool pmi_interrupt_handler(x86_iframe_t *frame, PerfmonState* state) {
             } else if (state->programmable_flags[i] & IPM_CONFIG_FLAG_TIMEBASE) {
                 continue;
             }
-            if (state->programmable_flags[i] & IPM_CONFIG_FLAG_PC) {
+            if (state->programmable_flags[i] & IPM_CONFIG_FLAG_CALLCHAIN) {
+                next = x86_perfmon_write_sample_record(next, id, cr3, frame);
+            } else if (state->programmable_flags[i] & IPM_CONFIG_FLAG_PC) {
                 next = x86_perfmon_write_pc_record(next, id, cr3, frame->ip);
             } else {
                 next = x86_perfmon_write_tick_record(next, id);
@@ -1793,7 +1845,9 @@ static bool pmi_interrupt_handler(x86_iframe_t *frame, PerfmonState* state) {
             } else if (state->fixed_flags[i] & IPM_CONFIG_FLAG_TIMEBASE) {
                 continue;
             }
-            if (state->fixed_flags[i] & IPM_CONFIG_FLAG_PC) {
+            if (state->fixed_flags[i] & IPM_CONFIG_FLAG_CALLCHAIN) {
+                next = x86_perfmon_write_sample_record(next, id, cr3, frame);
+            } else if (state->fixed_flags[i] & IPM_CONFIG_FLAG_PC) {
                 next = x86_perfmon_write_pc_record(next, id, cr3, frame->ip);
             } else {
                 next = x86_perfmon_write_tick_record(next, id);
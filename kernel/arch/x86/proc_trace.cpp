@@ -18,13 +18,15 @@
 // IPT tracing has two "modes":
 // - per-cpu tracing
 // - thread-specific tracing
-// Tracing can only be done in one mode at a time. This is because saving/
-// restoring thread PT state via the xsaves/xrstors instructions is a global
-// flag in the XSS msr.
-// Plus once a trace has been done with IPT_TRACE_THREADS one cannot go back
-// to IPT_TRACE_CPUS: supporting this requires flushing trace state from all
-// threads which is a bit of work. For now it's easy enough to just require
-// the user to reboot. ZX-892
+// Tracing can only be done in one mode at a time.
+// In thread mode the PT MSRs are switched by hand in the context switch path
+// rather than with xsaves/xrstors: this keeps XSS.PT off in both modes, so
+// changing modes doesn't require flushing PT state out of every thread, and
+// the per-thread configuration can still use cr3 and user/kernel filtering.
+//
+// Circular buffers can be drained while tracing: fetching a cpu's or
+// thread's data while active briefly turns tracing off on the cpu it is
+// running on to flush buffered packets and read the current output position.
 
 #include <arch/arch_ops.h>
 #include <arch/mmu.h>
@@ -98,12 +100,29 @@ struct ipt_cpu_state_t {
     } addr_ranges[IPT_MAX_NUM_ADDR_RANGES];
 };
 
+// Each slot is a trace buffer descriptor that may be assigned a thread.
+// |regs| and |loaded| are only touched with interrupts off on the cpu the
+// thread is running on (or last ran on), or while tracing is off.
+struct ipt_thread_state {
+    thread_t* thread;
+    ipt_cpu_state_t regs;
+    // True if the PT MSRs of the cpu currently hold |regs|.
+    bool loaded;
+};
+
 static fbl::Mutex ipt_lock;
 
 static ipt_cpu_state_t* ipt_cpu_state TA_GUARDED(ipt_lock);
 
+static ipt_thread_state* ipt_thread_state_table TA_GUARDED(ipt_lock);
+
 static bool active TA_GUARDED(ipt_lock) = false;
 
+// Whether switched-in threads should have their trace loaded.
+// This is read in the context switch path, so it is guarded by thread_lock
+// rather than ipt_lock.
+static bool thread_tracing TA_GUARDED(thread_lock) = false;
+
 static ipt_trace_mode_t trace_mode TA_GUARDED(ipt_lock) = IPT_TRACE_CPUS;
 
 void x86_processor_trace_init(void) {
@@ -148,10 +167,6 @@ static void x86_ipt_set_mode_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSI
     DEBUG_ASSERT(!active);
 
     // When changing modes make sure all PT MSRs are in the init state.
-    // We don't want a value to appear in the xsave buffer and have xrstors
-    // #gp because XCOMP_BV has the PT bit set that's not set in XSS.
-    // We still need to do this, even with ZX-892, when transitioning
-    // from IPT_TRACE_CPUS to IPT_TRACE_THREADS.
     write_msr(IA32_RTIT_CTL, 0);
     write_msr(IA32_RTIT_STATUS, 0);
     write_msr(IA32_RTIT_OUTPUT_BASE, 0);
@@ -159,12 +174,6 @@ static void x86_ipt_set_mode_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSI
     if (supports_cr3_filtering)
         write_msr(IA32_RTIT_CR3_MATCH, 0);
     // TODO(dje): addr range msrs
-
-    ipt_trace_mode_t new_mode = static_cast<ipt_trace_mode_t>(reinterpret_cast<uintptr_t>(raw_context));
-
-    // PT state saving, if supported, was enabled during boot so there's no
-    // need to recalculate the xsave space needed.
-    x86_set_extended_register_pt_state(new_mode == IPT_TRACE_THREADS);
 }
 
 zx_status_t x86_ipt_alloc_trace(ipt_trace_mode_t mode) {
@@ -176,16 +185,9 @@ zx_status_t x86_ipt_alloc_trace(ipt_trace_mode_t mode) {
         return ZX_ERR_NOT_SUPPORTED;
     if (active)
         return ZX_ERR_BAD_STATE;
-    if (ipt_cpu_state)
+    if (ipt_cpu_state || ipt_thread_state_table)
         return ZX_ERR_BAD_STATE;
 
-    // ZX-892: We don't support changing the mode from IPT_TRACE_THREADS to
-    // IPT_TRACE_CPUS: We can't turn off XSS.PT until we're sure all threads
-    // have no PT state, and that's too tricky to do right now. Instead,
-    // require the developer to reboot.
-    if (trace_mode == IPT_TRACE_THREADS && mode == IPT_TRACE_CPUS)
-        return ZX_ERR_NOT_SUPPORTED;
-
     if (mode == IPT_TRACE_CPUS) {
         uint32_t num_cpus = arch_max_num_cpus();
         ipt_cpu_state =
@@ -194,12 +196,14 @@ zx_status_t x86_ipt_alloc_trace(ipt_trace_mode_t mode) {
         if (!ipt_cpu_state)
             return ZX_ERR_NO_MEMORY;
     } else {
-        // TODO(dje): support for IPT_TRACE_THREADS
-        return ZX_ERR_NOT_SUPPORTED;
+        ipt_thread_state_table =
+            reinterpret_cast<ipt_thread_state*>(calloc(IPT_MAX_NUM_THREADS,
+                                                       sizeof(*ipt_thread_state_table)));
+        if (!ipt_thread_state_table)
+            return ZX_ERR_NO_MEMORY;
     }
 
-    mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_set_mode_task,
-                 reinterpret_cast<void*>(static_cast<uintptr_t>(mode)));
+    mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_set_mode_task, nullptr);
 
     trace_mode = mode;
     return ZX_OK;
@@ -214,25 +218,29 @@ zx_status_t x86_ipt_free_trace() {
 
     if (!supports_pt)
         return ZX_ERR_NOT_SUPPORTED;
-    if (trace_mode == IPT_TRACE_THREADS)
-        return ZX_ERR_BAD_STATE;
     if (active)
         return ZX_ERR_BAD_STATE;
 
+    if (ipt_thread_state_table) {
+        THREAD_LOCK(state);
+        for (uint32_t i = 0; i < IPT_MAX_NUM_THREADS; ++i) {
+            thread_t* t = ipt_thread_state_table[i].thread;
+            if (t)
+                t->arch.ipt_state = nullptr;
+        }
+        THREAD_UNLOCK(state);
+    }
+
     free(ipt_cpu_state);
     ipt_cpu_state = nullptr;
+    free(ipt_thread_state_table);
+    ipt_thread_state_table = nullptr;
     return ZX_OK;
 }
 
-// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
-static void x86_ipt_start_cpu_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+// Load |state| into the PT MSRs and enable tracing if |state| says so.
+static void ipt_load_msrs(const ipt_cpu_state_t* state) {
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(active && raw_context);
-
-    ipt_cpu_state_t* context = reinterpret_cast<ipt_cpu_state_t*>(raw_context);
-    uint32_t cpu = arch_curr_cpu_num();
-    ipt_cpu_state_t* state = &context[cpu];
-
     DEBUG_ASSERT(!(read_msr(IA32_RTIT_CTL) & IPT_CTL_TRACE_EN_MASK));
 
     // Load the ToPA configuration
@@ -248,6 +256,63 @@ static void x86_ipt_start_cpu_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYS
     write_msr(IA32_RTIT_CTL, state->ctl);
 }
 
+// Disable tracing and save the output position and status into |state|.
+// |state->ctl| is left alone so that the trace can be resumed.
+static void ipt_save_msrs(ipt_cpu_state_t* state) {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    // Disable the trace
+    write_msr(IA32_RTIT_CTL, 0);
+
+    // Retrieve msr values for later providing to userspace
+    state->status = read_msr(IA32_RTIT_STATUS);
+    state->output_base = read_msr(IA32_RTIT_OUTPUT_BASE);
+    state->output_mask_ptrs = read_msr(IA32_RTIT_OUTPUT_MASK_PTRS);
+
+    // Zero all MSRs so that we are in the XSAVE initial configuration.
+    // This allows h/w to do some optimizations regarding the state.
+    write_msr(IA32_RTIT_STATUS, 0);
+    write_msr(IA32_RTIT_OUTPUT_BASE, 0);
+    write_msr(IA32_RTIT_OUTPUT_MASK_PTRS, 0);
+    if (supports_cr3_filtering)
+        write_msr(IA32_RTIT_CR3_MATCH, 0);
+
+    // TODO(dje): Make it explicit that packets have been completely written.
+    // See Intel Vol 3 chapter 36.2.4.
+
+    // TODO(teisenbe): Clear ADDR* MSRs depending on leaf 1
+}
+
+// Record where |state|'s trace has got to without stopping it.
+// Clearing TraceEn flushes packets the h/w has buffered internally so the
+// position covers everything traced so far.
+static void ipt_snapshot_msrs(ipt_cpu_state_t* state) {
+    ipt_save_msrs(state);
+    ipt_load_msrs(state);
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_ipt_start_cpu_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(active && raw_context);
+
+    ipt_cpu_state_t* context = reinterpret_cast<ipt_cpu_state_t*>(raw_context);
+    uint32_t cpu = arch_curr_cpu_num();
+    ipt_load_msrs(&context[cpu]);
+}
+
+// Sideband info needed by the trace reader.
+static void ipt_emit_start_records(uint64_t kernel_cr3) {
+    uint64_t platform_msr = read_msr(IA32_PLATFORM_INFO);
+    unsigned nom_freq = (platform_msr >> 8) & 0xff;
+    ktrace(TAG_IPT_START, (uint32_t)nom_freq, 0,
+           (uint32_t)kernel_cr3, (uint32_t)(kernel_cr3 >> 32));
+    const struct x86_model_info* model_info = x86_get_model();
+    ktrace(TAG_IPT_CPU_INFO, model_info->processor_type,
+           model_info->display_family, model_info->display_model,
+           model_info->stepping);
+}
+
 // Begin the trace.
 
 zx_status_t x86_ipt_cpu_mode_start() {
@@ -278,15 +343,7 @@ zx_status_t x86_ipt_cpu_mode_start() {
 
     active = true;
 
-    // Sideband info needed by the trace reader.
-    uint64_t platform_msr = read_msr(IA32_PLATFORM_INFO);
-    unsigned nom_freq = (platform_msr >> 8) & 0xff;
-    ktrace(TAG_IPT_START, (uint32_t)nom_freq, 0,
-           (uint32_t)kernel_cr3, (uint32_t)(kernel_cr3 >> 32));
-    const struct x86_model_info* model_info = x86_get_model();
-    ktrace(TAG_IPT_CPU_INFO, model_info->processor_type,
-           model_info->display_family, model_info->display_model,
-           model_info->stepping);
+    ipt_emit_start_records(kernel_cr3);
 
     mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_start_cpu_task, ipt_cpu_state);
     return ZX_OK;
@@ -301,27 +358,8 @@ static void x86_ipt_stop_cpu_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSI
     uint32_t cpu = arch_curr_cpu_num();
     ipt_cpu_state_t* state = &context[cpu];
 
-    // Disable the trace
-    write_msr(IA32_RTIT_CTL, 0);
-
-    // Retrieve msr values for later providing to userspace
+    ipt_save_msrs(state);
     state->ctl = 0;
-    state->status = read_msr(IA32_RTIT_STATUS);
-    state->output_base = read_msr(IA32_RTIT_OUTPUT_BASE);
-    state->output_mask_ptrs = read_msr(IA32_RTIT_OUTPUT_MASK_PTRS);
-
-    // Zero all MSRs so that we are in the XSAVE initial configuration.
-    // This allows h/w to do some optimizations regarding the state.
-    write_msr(IA32_RTIT_STATUS, 0);
-    write_msr(IA32_RTIT_OUTPUT_BASE, 0);
-    write_msr(IA32_RTIT_OUTPUT_MASK_PTRS, 0);
-    if (supports_cr3_filtering)
-        write_msr(IA32_RTIT_CR3_MATCH, 0);
-
-    // TODO(dje): Make it explicit that packets have been completely written.
-    // See Intel Vol 3 chapter 36.2.4.
-
-    // TODO(teisenbe): Clear ADDR* MSRs depending on leaf 1
 }
 
 // This can be called while not active, so the caller doesn't have to care
@@ -356,6 +394,26 @@ zx_status_t x86_ipt_cpu_mode_stop() {
     return ZX_OK;
 }
 
+static void copy_regs_to_state(ipt_cpu_state_t* state, const zx_x86_pt_regs_t* regs) {
+    state->ctl = regs->ctl;
+    state->status = regs->status;
+    state->output_base = regs->output_base;
+    state->output_mask_ptrs = regs->output_mask_ptrs;
+    state->cr3_match = regs->cr3_match;
+    static_assert(sizeof(state->addr_ranges) == sizeof(regs->addr_ranges), "addr_ranges size mismatch");
+    memcpy(state->addr_ranges, regs->addr_ranges, sizeof(regs->addr_ranges));
+}
+
+static void copy_state_to_regs(zx_x86_pt_regs_t* regs, const ipt_cpu_state_t* state) {
+    regs->ctl = state->ctl;
+    regs->status = state->status;
+    regs->output_base = state->output_base;
+    regs->output_mask_ptrs = state->output_mask_ptrs;
+    regs->cr3_match = state->cr3_match;
+    static_assert(sizeof(regs->addr_ranges) == sizeof(state->addr_ranges), "addr_ranges size mismatch");
+    memcpy(regs->addr_ranges, state->addr_ranges, sizeof(regs->addr_ranges));
+}
+
 zx_status_t x86_ipt_stage_cpu_data(uint32_t cpu, const zx_x86_pt_regs_t* regs) {
     AutoLock al(&ipt_lock);
 
@@ -371,17 +429,22 @@ zx_status_t x86_ipt_stage_cpu_data(uint32_t cpu, const zx_x86_pt_regs_t* regs) {
     if (cpu >= num_cpus)
         return ZX_ERR_INVALID_ARGS;
 
-    ipt_cpu_state[cpu].ctl = regs->ctl;
-    ipt_cpu_state[cpu].status = regs->status;
-    ipt_cpu_state[cpu].output_base = regs->output_base;
-    ipt_cpu_state[cpu].output_mask_ptrs = regs->output_mask_ptrs;
-    ipt_cpu_state[cpu].cr3_match = regs->cr3_match;
-    static_assert(sizeof(ipt_cpu_state[cpu].addr_ranges) == sizeof(regs->addr_ranges), "addr_ranges size mismatch");
-    memcpy(ipt_cpu_state[cpu].addr_ranges, regs->addr_ranges, sizeof(regs->addr_ranges));
-
+    copy_regs_to_state(&ipt_cpu_state[cpu], regs);
     return ZX_OK;
 }
 
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_ipt_snapshot_cpu_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(active && raw_context);
+
+    ipt_cpu_state_t* context = reinterpret_cast<ipt_cpu_state_t*>(raw_context);
+    ipt_snapshot_msrs(&context[arch_curr_cpu_num()]);
+}
+
+// If tracing is active this returns where the trace has got to so far,
+// which is what lets userspace drain a circular buffer as it fills.
+
 zx_status_t x86_ipt_get_cpu_data(uint32_t cpu, zx_x86_pt_regs_t* regs) {
     AutoLock al(&ipt_lock);
 
@@ -389,21 +452,235 @@ zx_status_t x86_ipt_get_cpu_data(uint32_t cpu, zx_x86_pt_regs_t* regs) {
         return ZX_ERR_NOT_SUPPORTED;
     if (trace_mode == IPT_TRACE_THREADS)
         return ZX_ERR_BAD_STATE;
-    if (active)
-        return ZX_ERR_BAD_STATE;
     if (!ipt_cpu_state)
         return ZX_ERR_BAD_STATE;
     uint32_t num_cpus = arch_max_num_cpus();
     if (cpu >= num_cpus)
         return ZX_ERR_INVALID_ARGS;
 
-    regs->ctl = ipt_cpu_state[cpu].ctl;
-    regs->status = ipt_cpu_state[cpu].status;
-    regs->output_base = ipt_cpu_state[cpu].output_base;
-    regs->output_mask_ptrs = ipt_cpu_state[cpu].output_mask_ptrs;
-    regs->cr3_match = ipt_cpu_state[cpu].cr3_match;
-    static_assert(sizeof(regs->addr_ranges) == sizeof(ipt_cpu_state[cpu].addr_ranges), "addr_ranges size mismatch");
-    memcpy(regs->addr_ranges, ipt_cpu_state[cpu].addr_ranges, sizeof(regs->addr_ranges));
+    if (active) {
+        mp_sync_exec(MP_IPI_TARGET_MASK, cpu_num_to_mask(cpu),
+                     x86_ipt_snapshot_cpu_task, ipt_cpu_state);
+    }
+
+    copy_state_to_regs(regs, &ipt_cpu_state[cpu]);
+    return ZX_OK;
+}
+
+// Thread mode.
+
+// Called from arch_context_switch, with the thread lock held, when either
+// thread has a trace buffer assigned.
+void x86_ipt_context_switch(thread_t* old_thread, thread_t* new_thread) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    ipt_thread_state* old_state = old_thread->arch.ipt_state;
+    if (old_state && old_state->loaded) {
+        ipt_save_msrs(&old_state->regs);
+        old_state->loaded = false;
+    }
+
+    ipt_thread_state* new_state = new_thread->arch.ipt_state;
+    if (new_state && thread_tracing) {
+        DEBUG_ASSERT(!new_state->loaded);
+        ipt_load_msrs(&new_state->regs);
+        new_state->loaded = true;
+    }
+}
+
+zx_status_t x86_ipt_assign_thread(uint32_t descriptor, thread_t* thread) {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (active)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+    if (descriptor >= IPT_MAX_NUM_THREADS)
+        return ZX_ERR_INVALID_ARGS;
+
+    ipt_thread_state* state = &ipt_thread_state_table[descriptor];
+    if (state->thread)
+        return ZX_ERR_BAD_STATE;
+
+    THREAD_LOCK(lock_state);
+    if (thread->arch.ipt_state) {
+        // Only one buffer per thread.
+        THREAD_UNLOCK(lock_state);
+        return ZX_ERR_ALREADY_BOUND;
+    }
+    memset(state, 0, sizeof(*state));
+    state->thread = thread;
+    thread->arch.ipt_state = state;
+    THREAD_UNLOCK(lock_state);
+    return ZX_OK;
+}
+
+zx_status_t x86_ipt_release_thread(uint32_t descriptor) {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (active)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+    if (descriptor >= IPT_MAX_NUM_THREADS)
+        return ZX_ERR_INVALID_ARGS;
+
+    ipt_thread_state* state = &ipt_thread_state_table[descriptor];
+    if (!state->thread)
+        return ZX_ERR_BAD_STATE;
+
+    THREAD_LOCK(lock_state);
+    DEBUG_ASSERT(!state->loaded);
+    state->thread->arch.ipt_state = nullptr;
+    state->thread = nullptr;
+    THREAD_UNLOCK(lock_state);
+    return ZX_OK;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_ipt_start_thread_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    // Threads switched in from now on are handled by x86_ipt_context_switch.
+    // This takes care of the ones that were already running.
+    ipt_thread_state* state = get_current_thread()->arch.ipt_state;
+    if (state && !state->loaded) {
+        ipt_load_msrs(&state->regs);
+        state->loaded = true;
+    }
+}
+
+zx_status_t x86_ipt_thread_mode_start() {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (active)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+
+    uint64_t kernel_cr3 = x86_kernel_cr3();
+    TRACEF("Starting thread processor trace, kernel cr3: 0x%" PRIxPTR "\n",
+           kernel_cr3);
+
+    active = true;
+
+    ipt_emit_start_records(kernel_cr3);
+
+    {
+        THREAD_LOCK(state);
+        thread_tracing = true;
+        THREAD_UNLOCK(state);
+    }
+    mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_start_thread_task, nullptr);
+    return ZX_OK;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_ipt_stop_thread_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    ipt_thread_state* state = get_current_thread()->arch.ipt_state;
+    if (state && state->loaded) {
+        ipt_save_msrs(&state->regs);
+        state->loaded = false;
+    }
+}
+
+// This can be called while not active, so the caller doesn't have to care
+// during any cleanup.
+
+zx_status_t x86_ipt_thread_mode_stop() {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+
+    TRACEF("Stopping thread processor trace\n");
+
+    {
+        THREAD_LOCK(state);
+        thread_tracing = false;
+        THREAD_UNLOCK(state);
+    }
+    // Threads switched out from now on save their own state. This takes care
+    // of the ones that are still running.
+    mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_stop_thread_task, nullptr);
+    ktrace(TAG_IPT_STOP, 0, 0, 0, 0);
+    active = false;
+    return ZX_OK;
+}
+
+zx_status_t x86_ipt_stage_thread_data(uint32_t descriptor, const zx_x86_pt_regs_t* regs) {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (active)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+    if (descriptor >= IPT_MAX_NUM_THREADS)
+        return ZX_ERR_INVALID_ARGS;
+    ipt_thread_state* state = &ipt_thread_state_table[descriptor];
+    if (!state->thread)
+        return ZX_ERR_BAD_STATE;
+
+    copy_regs_to_state(&state->regs, regs);
+    return ZX_OK;
+}
+
+// This is invoked via mp_sync_exec which thread safety analysis cannot follow.
+static void x86_ipt_snapshot_thread_task(void* raw_context) TA_NO_THREAD_SAFETY_ANALYSIS {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    ipt_thread_state* state = reinterpret_cast<ipt_thread_state*>(raw_context);
+    if (get_current_thread()->arch.ipt_state == state && state->loaded)
+        ipt_snapshot_msrs(&state->regs);
+}
+
+zx_status_t x86_ipt_get_thread_data(uint32_t descriptor, zx_x86_pt_regs_t* regs) {
+    AutoLock al(&ipt_lock);
+
+    if (!supports_pt)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (trace_mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (!ipt_thread_state_table)
+        return ZX_ERR_BAD_STATE;
+    if (descriptor >= IPT_MAX_NUM_THREADS)
+        return ZX_ERR_INVALID_ARGS;
+    ipt_thread_state* state = &ipt_thread_state_table[descriptor];
+    if (!state->thread)
+        return ZX_ERR_BAD_STATE;
+
+    // If the thread is running somewhere its position is only in that cpu's
+    // MSRs. We don't know which cpu without racing the scheduler, so ask them
+    // all; at most one has it loaded.
+    if (active)
+        mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_snapshot_thread_task, state);
 
+    // The thread may be switched out and back in behind our back, so read
+    // the copy under the thread lock.
+    THREAD_LOCK(lock_state);
+    copy_state_to_regs(regs, &state->regs);
+    THREAD_UNLOCK(lock_state);
     return ZX_OK;
 }
@@ -63,6 +63,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/perf_mon.cpp \
 	$(LOCAL_DIR)/proc_trace.cpp \
 	$(LOCAL_DIR)/registers.cpp \
+	$(LOCAL_DIR)/spinlock.cpp \
 	$(LOCAL_DIR)/start.S \
 	$(LOCAL_DIR)/syscall.S \
 	$(LOCAL_DIR)/thread.cpp \
@@ -75,6 +76,7 @@ MODULE_SRCS += \
 MODULE_DEPS += \
 	kernel/arch/x86/page_tables \
 	kernel/dev/iommu/dummy \
+	kernel/dev/iommu/intel \
 	kernel/lib/bitmap \
 	kernel/lib/code_patching \
 	kernel/lib/fbl \
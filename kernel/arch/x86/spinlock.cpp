@@ -0,0 +1,56 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <arch/ops.h>
+#include <arch/spinlock.h>
+#include <kernel/atomic.h>
+#include <kernel/spinlock.h>
+
+// We need to disable thread safety analysis in this file, since we're
+// implementing the locks themselves.  Without this, the header-level
+// annotations cause Clang to detect violations.
+
+// Waits for |serving| to reach |ticket|.  Only reads the lock, so waiting
+// cpus share the cache line until the holder's unlock invalidates it.
+static inline void wait_for_ticket(spin_lock_t* lock, uint32_t ticket) {
+    while (__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) != ticket)
+        arch_spinloop_pause();
+}
+
+void arch_spin_lock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    uint32_t ticket = __atomic_fetch_add(&lock->next, 1u, __ATOMIC_RELAXED);
+
+    if (unlikely(__atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE) != ticket)) {
+#if WITH_SPINLOCK_STATS
+        uint64_t start = arch_cycle_count();
+        wait_for_ticket(lock, ticket);
+        spin_lock_contended(__builtin_return_address(0), arch_cycle_count() - start);
+#else
+        wait_for_ticket(lock, ticket);
+#endif
+    }
+
+    __atomic_store_n(&lock->holder, arch_curr_cpu_num() + 1, __ATOMIC_RELAXED);
+}
+
+int arch_spin_trylock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // The lock is free, with nobody waiting, only when the next ticket is
+    // the one being served; take it only in that case.
+    uint32_t ticket = __atomic_load_n(&lock->serving, __ATOMIC_ACQUIRE);
+    if (!__atomic_compare_exchange_n(&lock->next, &ticket, ticket + 1, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return 1;
+
+    __atomic_store_n(&lock->holder, arch_curr_cpu_num() + 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void arch_spin_unlock(spin_lock_t* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
+    __atomic_store_n(&lock->holder, 0UL, __ATOMIC_RELAXED);
+    // Only the holder writes |serving|.
+    uint32_t serving = __atomic_load_n(&lock->serving, __ATOMIC_RELAXED);
+    __atomic_store_n(&lock->serving, serving + 1, __ATOMIC_RELEASE);
+}
@@ -11,6 +11,7 @@
 #include <arch/x86/descriptor.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/mp.h>
+#include <arch/x86/proc_trace.h>
 #include <arch/x86/registers.h>
 #include <arch/x86/x86intrin.h>
 #include <assert.h>
@@ -88,6 +89,9 @@ void* arch_thread_get_blocked_fp(struct thread* t) {
 __NO_SAFESTACK __attribute__((target("fsgsbase"))) void arch_context_switch(thread_t* oldthread, thread_t* newthread) {
     x86_extended_register_context_switch(oldthread, newthread);
 
+    if (unlikely(oldthread->arch.ipt_state || newthread->arch.ipt_state))
+        x86_ipt_context_switch(oldthread, newthread);
+
     //printf("cs 0x%llx\n", kstack_top);
 
     /* set the tss SP0 value to point at the top of our stack */
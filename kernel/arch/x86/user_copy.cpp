@@ -12,6 +12,7 @@
 #include <arch/x86.h>
 #include <arch/x86/feature.h>
 #include <arch/x86/user_copy.h>
+#include <fbl/algorithm.h>
 #include <kernel/thread.h>
 #include <lib/code_patching.h>
 #include <vm/vm.h>
@@ -23,8 +24,15 @@ CODE_TEMPLATE(kStacInstruction, "stac");
 CODE_TEMPLATE(kClacInstruction, "clac");
 static const uint8_t kNopInstruction = 0x90;
 
+// Below this, non-temporal stores don't pay for skipping the cache.
+static const size_t kMinNonTemporalCopy = 256 * 1024;
+
 extern "C" {
 
+extern uint64_t x86_user_copy_nt_threshold;
+extern const uint8_t _x86_user_copy_erms[];
+extern const uint8_t _x86_user_copy_quad[];
+
 void fill_out_stac_instruction(const CodePatchInfo* patch) {
     const size_t kSize = 3;
     DEBUG_ASSERT(patch->dest_size == kSize);
@@ -48,6 +56,53 @@ void fill_out_clac_instruction(const CodePatchInfo* patch) {
 }
 }
 
+// Returns the size of the largest cache described by cpuid leaf 4, or 0 if
+// the cpu doesn't report one.
+static size_t last_level_cache_size(void) {
+    size_t largest = 0;
+    for (uint32_t i = 0;; i++) {
+        struct cpuid_leaf leaf;
+        if (!x86_get_cpuid_subleaf(X86_CPUID_CACHE_V2, i, &leaf))
+            break;
+        // cache type 0 ends the list
+        if ((leaf.a & 0x1f) == 0)
+            break;
+        size_t ways = (leaf.b >> 22) + 1;
+        size_t partitions = ((leaf.b >> 12) & 0x3ff) + 1;
+        size_t line_size = (leaf.b & 0xfff) + 1;
+        size_t sets = static_cast<size_t>(leaf.c) + 1;
+        size_t size = ways * partitions * line_size * sets;
+        if (size > largest)
+            largest = size;
+    }
+    return largest;
+}
+
+extern "C" void x86_user_copy_select(const CodePatchInfo* patch) {
+    // We are patching a jmp rel8 instruction, which is two bytes.  The rel8
+    // value is a signed 8-bit value specifying an offset relative to the
+    // address of the next instruction in memory after the jmp instruction.
+    const size_t kSize = 2;
+    const intptr_t jmp_from_address = reinterpret_cast<intptr_t>(patch->dest_addr) + kSize;
+    DEBUG_ASSERT(patch->dest_size == kSize);
+
+    intptr_t offset;
+    if (x86_feature_test(X86_FEATURE_ERMS)) {
+        offset = reinterpret_cast<intptr_t>(_x86_user_copy_erms) - jmp_from_address;
+    } else {
+        offset = reinterpret_cast<intptr_t>(_x86_user_copy_quad) - jmp_from_address;
+    }
+    DEBUG_ASSERT(offset >= -128 && offset <= 127);
+    patch->dest_addr[0] = 0xeb; /* jmp rel8 */
+    patch->dest_addr[1] = static_cast<uint8_t>(offset);
+
+    // Copies larger than the last level cache would flush it anyway, so
+    // they skip it.
+    size_t llc_size = last_level_cache_size();
+    if (x86_feature_test(X86_FEATURE_SSE2) && llc_size != 0)
+        x86_user_copy_nt_threshold = fbl::max(llc_size, kMinNonTemporalCopy);
+}
+
 static inline bool ac_flag(void) {
     return x86_save_flags() & X86_FLAGS_AC;
 }
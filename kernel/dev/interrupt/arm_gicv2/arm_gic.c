@@ -245,6 +245,29 @@ static zx_status_t gic_get_interrupt_config(unsigned int vector,
     return ZX_OK;
 }
 
+static zx_status_t gic_set_interrupt_affinity(unsigned int vector, cpu_num_t cpu)
+{
+    // Only SPIs can be routed, and the GICv2 distributor addresses at most
+    // eight cpu interfaces, which we number the same as the cpus.
+    if ((vector >= max_irqs) || (vector < GIC_BASE_SPI))
+        return ZX_ERR_INVALID_ARGS;
+    if (cpu > (cpu_num_t)arm_gic_max_cpu())
+        return ZX_ERR_NOT_SUPPORTED;
+
+    uint32_t shift = (vector % 4) * 8;
+
+    spin_lock_saved_state_t state;
+    spin_lock_save(&gicd_lock, &state, GICD_LOCK_FLAGS);
+    uint32_t val = gicd_itargetsr[vector / 4];
+    val &= ~(0xffu << shift);
+    val |= (1u << cpu) << shift;
+    gicd_itargetsr[vector / 4] = val;
+    GICREG(0, GICD_ITARGETSR(vector / 4)) = val;
+    spin_unlock_restore(&gicd_lock, state, GICD_LOCK_FLAGS);
+
+    return ZX_OK;
+}
+
 static unsigned int gic_remap_interrupt(unsigned int vector)
 {
     return vector;
@@ -347,6 +370,7 @@ static const struct pdev_interrupt_ops gic_ops = {
     .unmask = gic_unmask_interrupt,
     .configure = gic_configure_interrupt,
     .get_config = gic_get_interrupt_config,
+    .set_affinity = gic_set_interrupt_affinity,
     .is_valid = gic_is_valid_interrupt,
     .remap = gic_remap_interrupt,
     .send_ipi = gic_send_ipi,
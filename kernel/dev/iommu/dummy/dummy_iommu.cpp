@@ -45,10 +45,11 @@ zx_status_t DummyIommu::Map(uint64_t bus_txn_id, const fbl::RefPtr<VmObject>& vm
     if (!IS_PAGE_ALIGNED(offset) || size == 0) {
         return ZX_ERR_INVALID_ARGS;
     }
-    if (perms & ~(IOMMU_FLAG_PERM_READ | IOMMU_FLAG_PERM_WRITE | IOMMU_FLAG_PERM_EXECUTE)) {
+    if (perms & ~(IOMMU_FLAG_PERM_READ | IOMMU_FLAG_PERM_WRITE | IOMMU_FLAG_PERM_EXECUTE |
+                  IOMMU_FLAG_CACHED)) {
         return ZX_ERR_INVALID_ARGS;
     }
-    if (perms == 0) {
+    if ((perms & ~IOMMU_FLAG_CACHED) == 0) {
         return ZX_ERR_INVALID_ARGS;
     }
     if (offset + size < offset || offset + size > vmo->size()) {
@@ -0,0 +1,315 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "device_context.h"
+
+#include <arch/ops.h>
+#include <err.h>
+#include <fbl/algorithm.h>
+#include <fbl/new.h>
+#include <string.h>
+#include <vm/physmap.h>
+#include <vm/pmm.h>
+#include <vm/vm.h>
+
+#include "hw.h"
+
+namespace intel_iommu {
+
+Mapping::~Mapping() {
+    if (pinned) {
+        vmo->Unpin(vmo_offset, size());
+    }
+}
+
+InvalidationBatch::~InvalidationBatch() {
+    while (Mapping* m = released.pop_front()) {
+        delete m;
+    }
+}
+
+void InvalidationBatch::AddRange(dev_vaddr_t base, size_t len) {
+    if (whole_domain || len == 0) {
+        return;
+    }
+    if (num_ranges > 0 && ranges[num_ranges - 1].base + ranges[num_ranges - 1].len == base) {
+        ranges[num_ranges - 1].len += len;
+        return;
+    }
+    if (num_ranges == kMaxRanges) {
+        whole_domain = true;
+        return;
+    }
+    ranges[num_ranges].base = base;
+    ranges[num_ranges].len = len;
+    num_ranges++;
+}
+
+DeviceContext::DeviceContext(IntelIommu* parent, uint16_t bdf, uint32_t domain_id,
+                             uint8_t levels)
+    : parent_(parent), bdf_(bdf), domain_id_(domain_id), levels_(levels) {}
+
+zx_status_t DeviceContext::Create(IntelIommu* parent, uint16_t bdf, uint32_t domain_id,
+                                  uint8_t address_width, uint64_t aspace_size,
+                                  fbl::unique_ptr<DeviceContext>* out) {
+    uint8_t levels = address_width == ds::kAddressWidth48Bit ? 4 : 3;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<DeviceContext> dev(new (&ac) DeviceContext(parent, bdf, domain_id, levels));
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    zx_status_t status = dev->allocator_.SetRegionPool(parent->region_pool());
+    if (status != ZX_OK) {
+        return status;
+    }
+    // Device address 0 is never handed out, so that it can't be mistaken
+    // for a missing mapping.
+    status = dev->allocator_.AddRegion({ .base = PAGE_SIZE, .size = aspace_size - PAGE_SIZE });
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = dev->AllocTable(&dev->root_pa_);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    *out = fbl::move(dev);
+    return ZX_OK;
+}
+
+DeviceContext::~DeviceContext() {
+    // The caller has already made the hardware forget this domain, so the
+    // cached mappings can go without any more invalidation.
+    idle_.clear_unsafe();
+    mappings_.clear();
+    pmm_free(&pages_);
+}
+
+zx_status_t DeviceContext::AllocTable(paddr_t* pa) {
+    vm_page_t* page = pmm_alloc_page(0, pa);
+    if (!page) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    page->state = VM_PAGE_STATE_MMU;
+    list_add_tail(&pages_, &page->free.node);
+
+    void* table = paddr_to_physmap(*pa);
+    memset(table, 0, PAGE_SIZE);
+    if (!parent_->page_walk_coherent()) {
+        arch_clean_cache_range(reinterpret_cast<addr_t>(table), PAGE_SIZE);
+    }
+    return ZX_OK;
+}
+
+void DeviceContext::SyncPte(uint64_t* pte) {
+    if (!parent_->page_walk_coherent()) {
+        arch_clean_cache_range(reinterpret_cast<addr_t>(pte), sizeof(*pte));
+    }
+}
+
+uint64_t* DeviceContext::WalkToPte(dev_vaddr_t vaddr, bool create) {
+    uint64_t* table = static_cast<uint64_t*>(paddr_to_physmap(root_pa_));
+    for (uint level = levels_ - 1; level > 0; --level) {
+        uint shift = PAGE_SIZE_SHIFT + level * ds::kPageTableShift;
+        uint64_t* entry = &table[(vaddr >> shift) & (ds::kPageTableEntries - 1)];
+        if (!(*entry & (ds::kPteRead | ds::kPteWrite))) {
+            if (!create) {
+                return nullptr;
+            }
+            paddr_t pa;
+            if (AllocTable(&pa) != ZX_OK) {
+                return nullptr;
+            }
+            // Permissions are checked at the last level only.
+            *entry = pa | ds::kPteRead | ds::kPteWrite;
+            SyncPte(entry);
+        }
+        table = static_cast<uint64_t*>(paddr_to_physmap(*entry & ds::kPteAddrMask));
+    }
+    return &table[(vaddr >> PAGE_SIZE_SHIFT) & (ds::kPageTableEntries - 1)];
+}
+
+zx_status_t DeviceContext::WritePte(dev_vaddr_t vaddr, uint64_t value) {
+    uint64_t* pte = WalkToPte(vaddr, true);
+    if (!pte) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    *pte = value;
+    SyncPte(pte);
+    return ZX_OK;
+}
+
+void DeviceContext::ClearPtes(dev_vaddr_t base, size_t len, InvalidationBatch* batch) {
+    for (dev_vaddr_t va = base; va < base + len; va += PAGE_SIZE) {
+        uint64_t* pte = WalkToPte(va, false);
+        if (pte && *pte) {
+            *pte = 0;
+            SyncPte(pte);
+        }
+    }
+    batch->AddRange(base, len);
+}
+
+void DeviceContext::ReleaseMapping(Mapping* mapping, InvalidationBatch* batch) {
+    if (mapping->idle) {
+        idle_.erase(*mapping);
+        idle_count_--;
+        mapping->idle = false;
+    }
+    batch->released.push_back(mappings_.erase(*mapping).release());
+}
+
+zx_status_t DeviceContext::Map(const fbl::RefPtr<VmObject>& vmo, uint64_t offset, size_t size,
+                               uint32_t perms, size_t max_len, InvalidationBatch* batch,
+                               dev_vaddr_t* vaddr, size_t* mapped_len) {
+    size_t len = fbl::min(ROUNDUP(size, PAGE_SIZE), max_len);
+    bool cached = perms & IOMMU_FLAG_CACHED;
+
+    if (cached) {
+        for (auto& m : idle_) {
+            if (m.vmo.get() == vmo.get() && m.vmo_offset == offset && m.size() == len &&
+                m.perms == perms) {
+                idle_.erase(m);
+                idle_count_--;
+                m.idle = false;
+                *vaddr = m.base();
+                *mapped_len = m.size();
+                return ZX_OK;
+            }
+        }
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Mapping> mapping(new (&ac) Mapping());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    if (allocator_.GetRegion(len, PAGE_SIZE, mapping->region) != ZX_OK) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+    mapping->perms = perms;
+    if (cached) {
+        zx_status_t status = vmo->Pin(offset, len);
+        if (status == ZX_OK) {
+            mapping->pinned = true;
+        } else if (vmo->is_paged()) {
+            return status;
+        }
+        mapping->vmo = vmo;
+        mapping->vmo_offset = offset;
+    }
+
+    uint64_t pte_flags = 0;
+    if (perms & IOMMU_FLAG_PERM_READ) {
+        pte_flags |= ds::kPteRead;
+    }
+    if (perms & IOMMU_FLAG_PERM_WRITE) {
+        pte_flags |= ds::kPteWrite;
+    }
+    if (parent_->snoop_control()) {
+        pte_flags |= ds::kPteSnoop;
+    }
+
+    struct Context {
+        DeviceContext* dev;
+        Mapping* mapping;
+        uint64_t pte_flags;
+    } ctx = { this, mapping.get(), pte_flags };
+    auto lookup_fn = [](void* context, size_t offset, size_t index, paddr_t pa) {
+        auto ctx = static_cast<Context*>(context);
+        zx_status_t status = ctx->dev->WritePte(ctx->mapping->base() + index * PAGE_SIZE,
+                                                pa | ctx->pte_flags);
+        if (status == ZX_OK) {
+            ctx->mapping->pages_mapped++;
+        }
+        return status;
+    };
+    zx_status_t status = vmo->Lookup(offset, len, 0, lookup_fn, &ctx);
+    if (status == ZX_OK && mapping->pages_mapped != len / PAGE_SIZE) {
+        status = ZX_ERR_BAD_STATE;
+    }
+    if (status != ZX_OK) {
+        // The device may have seen some of it; keep the pages and addresses
+        // until the invalidation is done.
+        ClearPtes(mapping->base(), len, batch);
+        batch->released.push_back(mapping.release());
+        return status;
+    }
+
+    batch->AddRange(mapping->base(), len);
+    *vaddr = mapping->base();
+    *mapped_len = len;
+    mappings_.insert(fbl::move(mapping));
+    return ZX_OK;
+}
+
+zx_status_t DeviceContext::Unmap(dev_vaddr_t vaddr, size_t size, InvalidationBatch* batch) {
+    const dev_vaddr_t end = vaddr + size;
+
+    auto iter = mappings_.upper_bound(vaddr);
+    if (iter != mappings_.begin()) {
+        --iter;
+    }
+    while (iter.IsValid() && iter->base() < end) {
+        Mapping* m = &*iter;
+        ++iter;
+        dev_vaddr_t start = fbl::max(vaddr, m->base());
+        dev_vaddr_t stop = fbl::min(end, m->base() + m->size());
+        if (start >= stop) {
+            continue;
+        }
+
+        if (m->vmo && !m->idle && start == m->base() && stop == m->base() + m->size()) {
+            // Keep it mapped for the next Map of the same range.
+            m->idle = true;
+            idle_.push_front(m);
+            if (++idle_count_ > kMaxIdleMappings) {
+                Mapping* oldest = idle_.pop_back();
+                idle_count_--;
+                oldest->idle = false;
+                ClearPtes(oldest->base(), oldest->size(), batch);
+                batch->released.push_back(mappings_.erase(*oldest).release());
+            }
+            continue;
+        }
+
+        ClearPtes(start, stop - start, batch);
+        m->pages_mapped -= fbl::min(m->pages_mapped, (stop - start) / PAGE_SIZE);
+        if (m->pages_mapped == 0) {
+            ReleaseMapping(m, batch);
+        }
+    }
+    return ZX_OK;
+}
+
+void DeviceContext::UnmapAll(InvalidationBatch* batch) {
+    batch->whole_domain = true;
+    while (!mappings_.is_empty()) {
+        Mapping* m = &*mappings_.begin();
+        ClearPtes(m->base(), m->size(), batch);
+        ReleaseMapping(m, batch);
+    }
+}
+
+zx_status_t DeviceContext::IdentityMap(paddr_t base, size_t len) {
+    base = ROUNDDOWN(base, PAGE_SIZE);
+    len = ROUNDUP(len, PAGE_SIZE);
+    zx_status_t status = allocator_.SubtractRegion({ .base = base, .size = len }, true);
+    if (status != ZX_OK) {
+        return status;
+    }
+    for (size_t off = 0; off < len; off += PAGE_SIZE) {
+        status = WritePte(base + off, (base + off) | ds::kPteRead | ds::kPteWrite);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
+} // namespace intel_iommu
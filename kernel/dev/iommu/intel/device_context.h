@@ -0,0 +1,118 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <dev/iommu.h>
+#include <dev/iommu/intel.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/ref_ptr.h>
+#include <fbl/unique_ptr.h>
+#include <list.h>
+#include <region-alloc/region-alloc.h>
+#include <vm/vm_object.h>
+
+namespace intel_iommu {
+
+class DeviceContext;
+
+// A range of device addresses that is mapped, or was until the IOTLB has
+// been invalidated.
+struct Mapping : public fbl::WAVLTreeContainable<fbl::unique_ptr<Mapping>>,
+                 public fbl::DoublyLinkedListable<Mapping*> {
+    ~Mapping();
+
+    dev_vaddr_t GetKey() const { return region->base; }
+    dev_vaddr_t base() const { return region->base; }
+    size_t size() const { return region->size; }
+
+    RegionAllocator::Region::UPtr region;
+    size_t pages_mapped = 0;
+
+    // Only for IOMMU_FLAG_CACHED: the range the IOMMU keeps pinned for as
+    // long as the mapping exists, and whether the caller has unmapped it.
+    fbl::RefPtr<VmObject> vmo;
+    uint64_t vmo_offset = 0;
+    bool pinned = false;
+    uint32_t perms = 0;
+    bool idle = false;
+};
+
+// What a Map/Unmap call changed, to be sent to the hardware as one batch.
+struct InvalidationBatch {
+    static constexpr size_t kMaxRanges = 16;
+
+    ~InvalidationBatch();
+
+    void AddRange(dev_vaddr_t base, size_t len);
+
+    struct {
+        dev_vaddr_t base;
+        size_t len;
+    } ranges[kMaxRanges];
+    size_t num_ranges = 0;
+    // Set when there were too many ranges to invalidate one by one.
+    bool whole_domain = false;
+
+    // Freed, unpinning what they pinned, once the invalidation is done.
+    fbl::DoublyLinkedList<Mapping*> released;
+};
+
+// The domain of one device: its second-level page tables and the device
+// addresses allocated in them.
+class DeviceContext : public fbl::DoublyLinkedListable<fbl::unique_ptr<DeviceContext>> {
+public:
+    // Idle cached mappings beyond this many are unmapped, oldest first.
+    static constexpr size_t kMaxIdleMappings = 32;
+
+    static zx_status_t Create(IntelIommu* parent, uint16_t bdf, uint32_t domain_id,
+                              uint8_t address_width, uint64_t aspace_size,
+                              fbl::unique_ptr<DeviceContext>* out);
+    ~DeviceContext();
+
+    uint16_t bdf() const { return bdf_; }
+    uint32_t domain_id() const { return domain_id_; }
+    paddr_t page_table_pa() const { return root_pa_; }
+
+    zx_status_t Map(const fbl::RefPtr<VmObject>& vmo, uint64_t offset, size_t size,
+                    uint32_t perms, size_t max_len, InvalidationBatch* batch,
+                    dev_vaddr_t* vaddr, size_t* mapped_len);
+    zx_status_t Unmap(dev_vaddr_t vaddr, size_t size, InvalidationBatch* batch);
+    void UnmapAll(InvalidationBatch* batch);
+
+    // Maps [base, base + len) to the same physical addresses, for reserved
+    // memory regions, and keeps other mappings out of it.
+    zx_status_t IdentityMap(paddr_t base, size_t len);
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DeviceContext);
+
+private:
+    DeviceContext(IntelIommu* parent, uint16_t bdf, uint32_t domain_id, uint8_t levels);
+
+    uint64_t* WalkToPte(dev_vaddr_t vaddr, bool create);
+    zx_status_t WritePte(dev_vaddr_t vaddr, uint64_t value);
+    void ClearPtes(dev_vaddr_t base, size_t len, InvalidationBatch* batch);
+    void ReleaseMapping(Mapping* mapping, InvalidationBatch* batch);
+    void SyncPte(uint64_t* pte);
+    zx_status_t AllocTable(paddr_t* pa);
+
+    IntelIommu* const parent_;
+    const uint16_t bdf_;
+    const uint32_t domain_id_;
+    const uint8_t levels_;
+
+    paddr_t root_pa_ = 0;
+    list_node pages_ = LIST_INITIAL_VALUE(pages_);
+
+    RegionAllocator allocator_;
+    fbl::WAVLTree<dev_vaddr_t, fbl::unique_ptr<Mapping>> mappings_;
+    // Most recently unmapped first.
+    fbl::DoublyLinkedList<Mapping*> idle_;
+    size_t idle_count_ = 0;
+};
+
+} // namespace intel_iommu
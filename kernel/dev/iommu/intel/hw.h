@@ -0,0 +1,197 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+// Registers and in-memory structures of a VT-d remapping unit, from the
+// Intel Virtualization Technology for Directed I/O specification.
+
+#include <hwreg/bitfields.h>
+#include <stdint.h>
+
+namespace intel_iommu {
+namespace reg {
+
+class Version : public hwreg::RegisterBase<Version, uint32_t> {
+public:
+    static constexpr uint32_t kAddr = 0x0;
+    static auto Get() { return hwreg::RegisterAddr<Version>(kAddr); }
+
+    DEF_FIELD(3, 0, minor);
+    DEF_FIELD(7, 4, major);
+};
+
+class Capability : public hwreg::RegisterBase<Capability, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x8;
+    static auto Get() { return hwreg::RegisterAddr<Capability>(kAddr); }
+
+    DEF_FIELD(2, 0, num_domains);
+    DEF_BIT(4, required_write_buf_flushing);
+    DEF_BIT(7, caching_mode);
+    DEF_FIELD(12, 8, supported_adjusted_guest_address_widths);
+    DEF_FIELD(21, 16, max_guest_addr_width);
+    DEF_BIT(39, page_selective_invld);
+    DEF_FIELD(53, 48, max_addr_mask_value);
+    DEF_BIT(54, drain_write);
+    DEF_BIT(55, drain_read);
+};
+
+class ExtendedCapability : public hwreg::RegisterBase<ExtendedCapability, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x10;
+    static auto Get() { return hwreg::RegisterAddr<ExtendedCapability>(kAddr); }
+
+    DEF_BIT(0, page_walk_coherency);
+    DEF_BIT(1, supports_queued_invld);
+    DEF_BIT(7, supports_snoop_control);
+};
+
+// GlobalCommand and GlobalStatus share bit positions.  Writes to the
+// command register must repeat the persistent enables that are already set.
+class GlobalCommand : public hwreg::RegisterBase<GlobalCommand, uint32_t> {
+public:
+    static constexpr uint32_t kAddr = 0x18;
+    static auto Get() { return hwreg::RegisterAddr<GlobalCommand>(kAddr); }
+
+    DEF_BIT(26, queued_invld_enable);
+    DEF_BIT(27, write_buffer_flush);
+    DEF_BIT(30, root_table_ptr);
+    DEF_BIT(31, translation_enable);
+};
+
+class GlobalStatus : public hwreg::RegisterBase<GlobalStatus, uint32_t> {
+public:
+    static constexpr uint32_t kAddr = 0x1c;
+    static auto Get() { return hwreg::RegisterAddr<GlobalStatus>(kAddr); }
+
+    DEF_BIT(23, compat_format_interrupt);
+    DEF_BIT(25, interrupt_remap_enable);
+    DEF_BIT(26, queued_invld_enable);
+    DEF_BIT(27, write_buffer_flush);
+    DEF_BIT(30, root_table_ptr);
+    DEF_BIT(31, translation_enable);
+
+    // The enables that must be carried into every GlobalCommand write.
+    static constexpr uint32_t kPersistentMask =
+        (1u << 23) | (1u << 25) | (1u << 26) | (1u << 31);
+};
+
+class RootTableAddress : public hwreg::RegisterBase<RootTableAddress, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x20;
+    static auto Get() { return hwreg::RegisterAddr<RootTableAddress>(kAddr); }
+
+    DEF_FIELD(11, 10, translation_table_mode);
+    DEF_FIELD(63, 12, root_table_address);
+};
+
+class FaultStatus : public hwreg::RegisterBase<FaultStatus, uint32_t> {
+public:
+    static constexpr uint32_t kAddr = 0x34;
+    static auto Get() { return hwreg::RegisterAddr<FaultStatus>(kAddr); }
+
+    DEF_BIT(0, primary_fault_overflow);
+    DEF_BIT(1, primary_pending_fault);
+    DEF_BIT(4, invalidation_queue_error);
+    DEF_BIT(5, invalidation_completion_error);
+    DEF_BIT(6, invalidation_timeout_error);
+};
+
+class InvalidationQueueHead : public hwreg::RegisterBase<InvalidationQueueHead, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x80;
+    static auto Get() { return hwreg::RegisterAddr<InvalidationQueueHead>(kAddr); }
+
+    DEF_FIELD(18, 4, queue_head);
+};
+
+class InvalidationQueueTail : public hwreg::RegisterBase<InvalidationQueueTail, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x88;
+    static auto Get() { return hwreg::RegisterAddr<InvalidationQueueTail>(kAddr); }
+
+    DEF_FIELD(18, 4, queue_tail);
+};
+
+class InvalidationQueueAddress : public hwreg::RegisterBase<InvalidationQueueAddress, uint64_t> {
+public:
+    static constexpr uint32_t kAddr = 0x90;
+    static auto Get() { return hwreg::RegisterAddr<InvalidationQueueAddress>(kAddr); }
+
+    // The queue is 2^queue_size pages long.
+    DEF_FIELD(2, 0, queue_size);
+    DEF_FIELD(63, 12, queue_base);
+};
+
+} // namespace reg
+
+namespace ds {
+
+// Address widths a domain can use, as values of ContextEntry::address_width
+// and bit numbers in Capability::supported_adjusted_guest_address_widths.
+enum AddressWidth : uint8_t {
+    kAddressWidth39Bit = 1, // 3-level page table
+    kAddressWidth48Bit = 2, // 4-level page table
+};
+
+struct RootEntry {
+    uint64_t lower;
+    uint64_t upper;
+
+    DEF_SUBBIT(lower, 0, present);
+    DEF_SUBFIELD(lower, 63, 12, context_table);
+};
+static_assert(sizeof(RootEntry) == 16, "");
+
+struct ContextEntry {
+    uint64_t lower;
+    uint64_t upper;
+
+    DEF_SUBBIT(lower, 0, present);
+    DEF_SUBBIT(lower, 1, fault_processing_disable);
+    DEF_SUBFIELD(lower, 3, 2, translation_type);
+    DEF_SUBFIELD(lower, 63, 12, second_level_pt_ptr);
+    DEF_SUBFIELD(upper, 2, 0, address_width);
+    DEF_SUBFIELD(upper, 23, 8, domain_id);
+};
+static_assert(sizeof(ContextEntry) == 16, "");
+
+// Second-level page table entries.
+constexpr uint64_t kPteRead = 1ull << 0;
+constexpr uint64_t kPteWrite = 1ull << 1;
+constexpr uint64_t kPteSnoop = 1ull << 11;
+constexpr uint64_t kPteAddrMask = 0x000ffffffffff000ull;
+constexpr uint kPageTableShift = 9;
+constexpr size_t kPageTableEntries = 1u << kPageTableShift;
+
+// Invalidation queue descriptors.
+struct InvalidationDescriptor {
+    uint64_t lower;
+    uint64_t upper;
+};
+static_assert(sizeof(InvalidationDescriptor) == 16, "");
+
+constexpr uint64_t kInvldTypeContextCache = 0x1;
+constexpr uint64_t kInvldTypeIotlb = 0x2;
+constexpr uint64_t kInvldTypeWait = 0x5;
+
+// Granularities, in bits 5:4 of the context-cache and IOTLB descriptors.
+constexpr uint64_t kInvldGlobal = 1ull << 4;
+constexpr uint64_t kInvldDomain = 2ull << 4;
+constexpr uint64_t kInvldPage = 3ull << 4;
+
+constexpr uint64_t kIotlbDrainWrites = 1ull << 6;
+constexpr uint64_t kIotlbDrainReads = 1ull << 7;
+constexpr uint64_t kWaitStatusWrite = 1ull << 5;
+constexpr uint64_t kWaitFence = 1ull << 6;
+
+constexpr uint64_t InvldDomainId(uint32_t domain_id) {
+    return static_cast<uint64_t>(domain_id & 0xffff) << 16;
+}
+
+} // namespace ds
+} // namespace intel_iommu
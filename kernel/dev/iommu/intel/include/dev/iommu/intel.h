@@ -0,0 +1,118 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <dev/iommu.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/unique_ptr.h>
+#include <kernel/mutex.h>
+#include <region-alloc/region-alloc.h>
+#include <zircon/compiler.h>
+#include <zircon/syscalls/iommu.h>
+
+namespace intel_iommu {
+class DeviceContext;
+struct InvalidationBatch;
+namespace ds {
+struct ContextEntry;
+struct InvalidationDescriptor;
+struct RootEntry;
+} // namespace ds
+} // namespace intel_iommu
+
+// One VT-d remapping unit.  Each device (bus_txn_id is the PCI
+// bus/device/function) gets a domain of its own, with its own second-level
+// page tables, the first time something is mapped for it; until then it
+// cannot reach memory at all.  Invalidations go through the queued
+// invalidation interface, one wait per Map/Unmap call however many ranges
+// it touched.
+class IntelIommu final : public Iommu {
+public:
+    static zx_status_t Create(fbl::unique_ptr<const uint8_t[]> desc, uint32_t desc_len,
+                              fbl::RefPtr<Iommu>* out);
+
+    bool IsValidBusTxnId(uint64_t bus_txn_id) const final;
+
+    zx_status_t Map(uint64_t bus_txn_id, const fbl::RefPtr<VmObject>& vmo,
+                    uint64_t offset, size_t size, uint32_t perms,
+                    dev_vaddr_t* vaddr, size_t* mapped_len) final;
+    zx_status_t Unmap(uint64_t bus_txn_id, dev_vaddr_t vaddr, size_t size) final;
+
+    zx_status_t ClearMappingsForBusTxnId(uint64_t bus_txn_id) final;
+
+    uint64_t minimum_contiguity(uint64_t bus_txn_id) const final;
+    uint64_t aspace_size(uint64_t bus_txn_id) const final;
+
+    ~IntelIommu() final;
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(IntelIommu);
+
+    // Used by DeviceContext.
+    bool page_walk_coherent() const { return page_walk_coherent_; }
+    bool snoop_control() const { return snoop_control_; }
+    RegionAllocator::RegionPool::RefPtr& region_pool() { return region_pool_; }
+
+private:
+    IntelIommu(fbl::unique_ptr<const uint8_t[]> desc);
+
+    zx_status_t Init(const zx_iommu_desc_intel_t* desc, uint32_t desc_len);
+    zx_status_t ParseAndMapReservedMemory(const zx_iommu_desc_intel_t* desc, uint32_t desc_len);
+
+    zx_status_t SetGlobalCommandBit(uint32_t bit, bool set);
+    zx_status_t WaitForStatus(uint32_t bit, bool set);
+    zx_status_t FlushWriteBuffer();
+
+    // Queues a descriptor; nothing is sent to the hardware until
+    // SubmitAndWaitLocked.
+    zx_status_t QueueLocked(const intel_iommu::ds::InvalidationDescriptor& desc) TA_REQ(lock_);
+    zx_status_t SubmitAndWaitLocked() TA_REQ(lock_);
+    zx_status_t FlushLocked(intel_iommu::DeviceContext* dev,
+                            intel_iommu::InvalidationBatch* batch) TA_REQ(lock_);
+
+    zx_status_t GetOrCreateContextLocked(uint16_t bdf, intel_iommu::DeviceContext** out)
+        TA_REQ(lock_);
+    intel_iommu::DeviceContext* FindContextLocked(uint16_t bdf) TA_REQ(lock_);
+
+    static bool ScopeMatches(const zx_iommu_desc_intel_scope_t& scope, uint16_t bdf);
+
+    fbl::Mutex lock_;
+
+    // The descriptor, kept around for the list of scopes.
+    const fbl::unique_ptr<const uint8_t[]> desc_;
+    const zx_iommu_desc_intel_scope_t* scopes_ = nullptr;
+    size_t num_scopes_ = 0;
+    bool whole_segment_ = false;
+
+    vaddr_t mmio_ = 0;
+    uint64_t caps_ = 0;
+    uint64_t ext_caps_ = 0;
+    bool page_walk_coherent_ = false;
+    bool snoop_control_ = false;
+    bool caching_mode_ = false;
+    bool write_buffer_flushing_ = false;
+    uint32_t num_domains_ = 0;
+    uint8_t address_width_ = 0;
+    uint64_t aspace_size_ = 0;
+
+    // Root table, context tables and the queue.
+    list_node pages_ = LIST_INITIAL_VALUE(pages_);
+    intel_iommu::ds::RootEntry* root_table_ = nullptr;
+    paddr_t root_table_pa_ = 0;
+    intel_iommu::ds::InvalidationDescriptor* queue_ = nullptr;
+    paddr_t queue_pa_ = 0;
+    uint32_t queue_tail_ TA_GUARDED(lock_) = 0;
+    uint32_t queue_pending_ TA_GUARDED(lock_) = 0;
+    // The wait descriptors write |wait_seq_| here when they complete.
+    volatile uint32_t* wait_status_ = nullptr;
+    paddr_t wait_status_pa_ = 0;
+    uint32_t wait_seq_ TA_GUARDED(lock_) = 0;
+
+    RegionAllocator::RegionPool::RefPtr region_pool_;
+    fbl::DoublyLinkedList<fbl::unique_ptr<intel_iommu::DeviceContext>> devices_
+        TA_GUARDED(lock_);
+    uint32_t next_domain_id_ TA_GUARDED(lock_) = 1;
+};
@@ -0,0 +1,628 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <dev/iommu/intel.h>
+
+#include <arch/ops.h>
+#include <err.h>
+#include <fbl/algorithm.h>
+#include <fbl/auto_lock.h>
+#include <fbl/new.h>
+#include <fbl/ref_ptr.h>
+#include <hwreg/mmio.h>
+#include <inttypes.h>
+#include <platform.h>
+#include <string.h>
+#include <trace.h>
+#include <vm/physmap.h>
+#include <vm/pmm.h>
+#include <vm/vm.h>
+#include <vm/vm_aspace.h>
+
+#include "device_context.h"
+#include "hw.h"
+
+#define LOCAL_TRACE 0
+
+using namespace intel_iommu;
+
+namespace {
+
+// The invalidation queue is a single page of descriptors.
+constexpr uint32_t kQueueEntries = PAGE_SIZE / sizeof(ds::InvalidationDescriptor);
+
+// A single Map() covers at most this much, so that the page tables it needs
+// are bounded.
+constexpr uint64_t kMaxMapLen = 1ull << 30;
+
+constexpr zx_time_t kInvalidationTimeout = ZX_SEC(1);
+
+uint16_t BdfBus(uint16_t bdf) { return static_cast<uint16_t>(bdf >> 8); }
+uint8_t BdfDevFunc(uint16_t bdf) { return static_cast<uint8_t>(bdf & 0xff); }
+
+} // namespace
+
+IntelIommu::IntelIommu(fbl::unique_ptr<const uint8_t[]> desc)
+    : desc_(fbl::move(desc)) {
+}
+
+zx_status_t IntelIommu::Create(fbl::unique_ptr<const uint8_t[]> desc_bytes, uint32_t desc_len,
+                               fbl::RefPtr<Iommu>* out) {
+    if (desc_len < sizeof(zx_iommu_desc_intel_t)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    auto desc = reinterpret_cast<const zx_iommu_desc_intel_t*>(desc_bytes.get());
+    if (sizeof(*desc) + desc->scope_bytes + desc->reserved_memory_bytes != desc_len ||
+        desc->scope_bytes % sizeof(zx_iommu_desc_intel_scope_t) != 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (!IS_PAGE_ALIGNED(desc->register_base)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    // Only segment 0 is reachable through the PCI bus driver.
+    if (desc->pci_segment != 0) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    fbl::AllocChecker ac;
+    auto instance = fbl::AdoptRef<IntelIommu>(new (&ac) IntelIommu(fbl::move(desc_bytes)));
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    zx_status_t status = instance->Init(desc, desc_len);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    *out = fbl::move(instance);
+    return ZX_OK;
+}
+
+zx_status_t IntelIommu::Init(const zx_iommu_desc_intel_t* desc, uint32_t desc_len) {
+    whole_segment_ = desc->whole_segment;
+    scopes_ = reinterpret_cast<const zx_iommu_desc_intel_scope_t*>(desc + 1);
+    num_scopes_ = desc->scope_bytes / sizeof(zx_iommu_desc_intel_scope_t);
+    for (size_t i = 0; i < num_scopes_; ++i) {
+        if (scopes_[i].num_hops == 0 || scopes_[i].num_hops > fbl::count_of(scopes_[i].dev_func)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+    }
+
+    region_pool_ = RegionAllocator::RegionPool::Create(PAGE_SIZE * 16);
+    if (!region_pool_) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    void* mmio;
+    zx_status_t status = VmAspace::kernel_aspace()->AllocPhysical(
+        "iommu", PAGE_SIZE, &mmio, PAGE_SIZE_SHIFT, desc->register_base, 0,
+        ARCH_MMU_FLAG_UNCACHED_DEVICE | ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE);
+    if (status != ZX_OK) {
+        return status;
+    }
+    mmio_ = reinterpret_cast<vaddr_t>(mmio);
+    hwreg::RegisterIo io(mmio);
+
+    auto caps = reg::Capability::Get().ReadFrom(&io);
+    auto ext_caps = reg::ExtendedCapability::Get().ReadFrom(&io);
+    caps_ = caps.reg_value();
+    ext_caps_ = ext_caps.reg_value();
+    if (!ext_caps.supports_queued_invld()) {
+        LTRACEF("iommu at %#" PRIx64 " lacks queued invalidation\n", desc->register_base);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    page_walk_coherent_ = ext_caps.page_walk_coherency();
+    snoop_control_ = ext_caps.supports_snoop_control();
+    caching_mode_ = caps.caching_mode();
+    write_buffer_flushing_ = caps.required_write_buf_flushing();
+    num_domains_ = 1u << (4 + 2 * caps.num_domains());
+
+    const uint32_t sagaw = static_cast<uint32_t>(caps.supported_adjusted_guest_address_widths());
+    if (sagaw & (1u << ds::kAddressWidth48Bit)) {
+        address_width_ = ds::kAddressWidth48Bit;
+        aspace_size_ = 1ull << 48;
+    } else if (sagaw & (1u << ds::kAddressWidth39Bit)) {
+        address_width_ = ds::kAddressWidth39Bit;
+        aspace_size_ = 1ull << 39;
+    } else {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    aspace_size_ = fbl::min<uint64_t>(aspace_size_, 1ull << (caps.max_guest_addr_width() + 1));
+
+    // Firmware may have left translation on; start from a known state.
+    auto gsts = reg::GlobalStatus::Get().ReadFrom(&io);
+    if (gsts.translation_enable()) {
+        status = SetGlobalCommandBit(1u << 31, false);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    if (gsts.queued_invld_enable()) {
+        status = SetGlobalCommandBit(1u << 26, false);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    auto alloc_page = [this](paddr_t* pa) -> void* {
+        vm_page_t* page = pmm_alloc_page(0, pa);
+        if (!page) {
+            return nullptr;
+        }
+        page->state = VM_PAGE_STATE_MMU;
+        list_add_tail(&pages_, &page->free.node);
+        void* va = paddr_to_physmap(*pa);
+        memset(va, 0, PAGE_SIZE);
+        arch_clean_cache_range(reinterpret_cast<addr_t>(va), PAGE_SIZE);
+        return va;
+    };
+    root_table_ = static_cast<ds::RootEntry*>(alloc_page(&root_table_pa_));
+    queue_ = static_cast<ds::InvalidationDescriptor*>(alloc_page(&queue_pa_));
+    wait_status_ = static_cast<volatile uint32_t*>(alloc_page(&wait_status_pa_));
+    if (!root_table_ || !queue_ || !wait_status_) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    auto rtaddr = reg::RootTableAddress::Get().FromValue(0);
+    rtaddr.set_root_table_address(root_table_pa_ >> PAGE_SIZE_SHIFT);
+    rtaddr.WriteTo(&io);
+    status = SetGlobalCommandBit(1u << 30, true);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = FlushWriteBuffer();
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    reg::InvalidationQueueTail::Get().FromValue(0).WriteTo(&io);
+    auto iqa = reg::InvalidationQueueAddress::Get().FromValue(0);
+    iqa.set_queue_base(queue_pa_ >> PAGE_SIZE_SHIFT);
+    iqa.set_queue_size(0);
+    iqa.WriteTo(&io);
+    status = SetGlobalCommandBit(1u << 26, true);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    {
+        fbl::AutoLock guard(&lock_);
+        status = QueueLocked({ ds::kInvldTypeContextCache | ds::kInvldGlobal, 0 });
+        if (status == ZX_OK) {
+            status = QueueLocked({ ds::kInvldTypeIotlb | ds::kInvldGlobal, 0 });
+        }
+        if (status == ZX_OK) {
+            status = SubmitAndWaitLocked();
+        }
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+
+    status = ParseAndMapReservedMemory(desc, desc_len);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    return SetGlobalCommandBit(1u << 31, true);
+}
+
+zx_status_t IntelIommu::ParseAndMapReservedMemory(const zx_iommu_desc_intel_t* desc,
+                                                  uint32_t desc_len) {
+    auto ptr = reinterpret_cast<const uint8_t*>(desc + 1) + desc->scope_bytes;
+    const uint8_t* end = ptr + desc->reserved_memory_bytes;
+
+    while (ptr < end) {
+        if (static_cast<size_t>(end - ptr) < sizeof(zx_iommu_desc_intel_reserved_memory_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        auto mem = reinterpret_cast<const zx_iommu_desc_intel_reserved_memory_t*>(ptr);
+        ptr += sizeof(*mem);
+        if (static_cast<size_t>(end - ptr) < mem->scope_bytes ||
+            mem->scope_bytes % sizeof(zx_iommu_desc_intel_scope_t) != 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        if (mem->base_addr + mem->len < mem->base_addr || mem->base_addr + mem->len > aspace_size_) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+
+        auto scopes = reinterpret_cast<const zx_iommu_desc_intel_scope_t*>(ptr);
+        size_t num_scopes = mem->scope_bytes / sizeof(zx_iommu_desc_intel_scope_t);
+        ptr += mem->scope_bytes;
+
+        for (size_t i = 0; i < num_scopes; ++i) {
+            // Devices behind bridges would need every bdf under the bridge
+            // mapped; leave those for later.
+            if (scopes[i].type != ZX_IOMMU_INTEL_SCOPE_ENDPOINT || scopes[i].num_hops != 1) {
+                TRACEF("iommu: skipping reserved memory for unsupported scope\n");
+                continue;
+            }
+            uint16_t bdf = static_cast<uint16_t>((scopes[i].start_bus << 8) |
+                                                 scopes[i].dev_func[0]);
+
+            fbl::AutoLock guard(&lock_);
+            DeviceContext* dev;
+            zx_status_t status = GetOrCreateContextLocked(bdf, &dev);
+            if (status != ZX_OK) {
+                return status;
+            }
+            status = dev->IdentityMap(mem->base_addr, mem->len);
+            if (status != ZX_OK) {
+                return status;
+            }
+            if (caching_mode_) {
+                InvalidationBatch batch;
+                batch.whole_domain = true;
+                status = FlushLocked(dev, &batch);
+                if (status != ZX_OK) {
+                    return status;
+                }
+            }
+        }
+    }
+    return ZX_OK;
+}
+
+IntelIommu::~IntelIommu() {
+    if (mmio_) {
+        hwreg::RegisterIo io(reinterpret_cast<void*>(mmio_));
+        auto gsts = reg::GlobalStatus::Get().ReadFrom(&io);
+        if (gsts.translation_enable()) {
+            SetGlobalCommandBit(1u << 31, false);
+        }
+        if (gsts.queued_invld_enable()) {
+            SetGlobalCommandBit(1u << 26, false);
+        }
+    }
+
+    {
+        fbl::AutoLock guard(&lock_);
+        devices_.clear();
+    }
+    pmm_free(&pages_);
+
+    if (mmio_) {
+        VmAspace::kernel_aspace()->FreeRegion(mmio_);
+    }
+}
+
+zx_status_t IntelIommu::SetGlobalCommandBit(uint32_t bit, bool set) {
+    hwreg::RegisterIo io(reinterpret_cast<void*>(mmio_));
+    uint32_t value = reg::GlobalStatus::Get().ReadFrom(&io).reg_value() &
+                     reg::GlobalStatus::kPersistentMask;
+    value = set ? (value | bit) : (value & ~bit);
+    reg::GlobalCommand::Get().FromValue(value).WriteTo(&io);
+    return WaitForStatus(bit, set);
+}
+
+zx_status_t IntelIommu::WaitForStatus(uint32_t bit, bool set) {
+    hwreg::RegisterIo io(reinterpret_cast<void*>(mmio_));
+    const zx_time_t deadline = current_time() + kInvalidationTimeout;
+    while (current_time() < deadline) {
+        bool value = reg::GlobalStatus::Get().ReadFrom(&io).reg_value() & bit;
+        if (value == set) {
+            return ZX_OK;
+        }
+        arch_spinloop_pause();
+    }
+    return ZX_ERR_TIMED_OUT;
+}
+
+zx_status_t IntelIommu::FlushWriteBuffer() {
+    if (!write_buffer_flushing_) {
+        return ZX_OK;
+    }
+    hwreg::RegisterIo io(reinterpret_cast<void*>(mmio_));
+    uint32_t value = reg::GlobalStatus::Get().ReadFrom(&io).reg_value() &
+                     reg::GlobalStatus::kPersistentMask;
+    reg::GlobalCommand::Get().FromValue(value | (1u << 27)).WriteTo(&io);
+    return WaitForStatus(1u << 27, false);
+}
+
+zx_status_t IntelIommu::QueueLocked(const ds::InvalidationDescriptor& desc) {
+    // Keep a slot free for the wait descriptor, and one more so that the
+    // tail never catches up with the head.
+    if (queue_pending_ + 2 >= kQueueEntries) {
+        zx_status_t status = SubmitAndWaitLocked();
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
+    queue_[queue_tail_] = desc;
+    if (!page_walk_coherent_) {
+        arch_clean_cache_range(reinterpret_cast<addr_t>(&queue_[queue_tail_]), sizeof(desc));
+    }
+    queue_tail_ = (queue_tail_ + 1) % kQueueEntries;
+    queue_pending_++;
+    return ZX_OK;
+}
+
+zx_status_t IntelIommu::SubmitAndWaitLocked() {
+    const uint32_t seq = ++wait_seq_;
+    queue_[queue_tail_] = {
+        ds::kInvldTypeWait | ds::kWaitStatusWrite | ds::kWaitFence |
+            (static_cast<uint64_t>(seq) << 32),
+        wait_status_pa_,
+    };
+    if (!page_walk_coherent_) {
+        arch_clean_cache_range(reinterpret_cast<addr_t>(&queue_[queue_tail_]),
+                               sizeof(queue_[0]));
+    }
+    queue_tail_ = (queue_tail_ + 1) % kQueueEntries;
+    queue_pending_ = 0;
+
+    hwreg::RegisterIo io(reinterpret_cast<void*>(mmio_));
+    mb();
+    auto tail = reg::InvalidationQueueTail::Get().FromValue(0);
+    tail.set_queue_tail(queue_tail_);
+    tail.WriteTo(&io);
+
+    const zx_time_t deadline = current_time() + kInvalidationTimeout;
+    while (*wait_status_ != seq) {
+        auto fsts = reg::FaultStatus::Get().ReadFrom(&io);
+        if (fsts.invalidation_queue_error() || fsts.invalidation_completion_error() ||
+            fsts.invalidation_timeout_error()) {
+            TRACEF("iommu: invalidation failed, fault status %#x\n", fsts.reg_value());
+            return ZX_ERR_IO;
+        }
+        if (current_time() >= deadline) {
+            TRACEF("iommu: invalidation timed out\n");
+            return ZX_ERR_TIMED_OUT;
+        }
+        arch_spinloop_pause();
+    }
+    return ZX_OK;
+}
+
+zx_status_t IntelIommu::FlushLocked(DeviceContext* dev, InvalidationBatch* batch) {
+    auto caps = reg::Capability::Get().FromValue(caps_);
+    uint64_t drain = 0;
+    if (caps.drain_write()) {
+        drain |= ds::kIotlbDrainWrites;
+    }
+    if (caps.drain_read()) {
+        drain |= ds::kIotlbDrainReads;
+    }
+    const uint64_t did = ds::InvldDomainId(dev->domain_id());
+
+    zx_status_t status;
+    if (batch->whole_domain || !caps.page_selective_invld()) {
+        status = QueueLocked({ ds::kInvldTypeIotlb | ds::kInvldDomain | drain | did, 0 });
+        if (status != ZX_OK) {
+            return status;
+        }
+    } else {
+        const uint max_mask = static_cast<uint>(caps.max_addr_mask_value());
+        for (size_t i = 0; i < batch->num_ranges; ++i) {
+            dev_vaddr_t va = batch->ranges[i].base;
+            const dev_vaddr_t end = va + batch->ranges[i].len;
+            while (va < end) {
+                // The largest naturally aligned power-of-two run of pages
+                // that starts at |va| and stays inside the range.
+                uint mask = 0;
+                while (mask < max_mask) {
+                    uint64_t chunk = PAGE_SIZE << (mask + 1);
+                    if ((va & (chunk - 1)) != 0 || va + chunk > end) {
+                        break;
+                    }
+                    mask++;
+                }
+                status = QueueLocked({ ds::kInvldTypeIotlb | ds::kInvldPage | drain | did,
+                                       va | mask });
+                if (status != ZX_OK) {
+                    return status;
+                }
+                va += PAGE_SIZE << mask;
+            }
+        }
+    }
+    return SubmitAndWaitLocked();
+}
+
+bool IntelIommu::ScopeMatches(const zx_iommu_desc_intel_scope_t& scope, uint16_t bdf) {
+    return scope.type == ZX_IOMMU_INTEL_SCOPE_ENDPOINT && scope.num_hops == 1 &&
+           scope.start_bus == BdfBus(bdf) && scope.dev_func[0] == BdfDevFunc(bdf);
+}
+
+bool IntelIommu::IsValidBusTxnId(uint64_t bus_txn_id) const {
+    if (bus_txn_id > UINT16_MAX) {
+        return false;
+    }
+    if (whole_segment_) {
+        return true;
+    }
+    for (size_t i = 0; i < num_scopes_; ++i) {
+        if (ScopeMatches(scopes_[i], static_cast<uint16_t>(bus_txn_id))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+DeviceContext* IntelIommu::FindContextLocked(uint16_t bdf) {
+    for (auto& dev : devices_) {
+        if (dev.bdf() == bdf) {
+            return &dev;
+        }
+    }
+    return nullptr;
+}
+
+zx_status_t IntelIommu::GetOrCreateContextLocked(uint16_t bdf, DeviceContext** out) {
+    DeviceContext* existing = FindContextLocked(bdf);
+    if (existing) {
+        *out = existing;
+        return ZX_OK;
+    }
+    if (next_domain_id_ >= num_domains_) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+
+    ds::RootEntry* root = &root_table_[BdfBus(bdf)];
+    if (!root->present()) {
+        vm_page_t* page = pmm_alloc_page(0, nullptr);
+        if (!page) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        page->state = VM_PAGE_STATE_MMU;
+        list_add_tail(&pages_, &page->free.node);
+        paddr_t pa = vm_page_to_paddr(page);
+        void* table = paddr_to_physmap(pa);
+        memset(table, 0, PAGE_SIZE);
+        if (!page_walk_coherent_) {
+            arch_clean_cache_range(reinterpret_cast<addr_t>(table), PAGE_SIZE);
+        }
+        root->set_context_table(pa >> PAGE_SIZE_SHIFT);
+        root->set_present(1);
+        if (!page_walk_coherent_) {
+            arch_clean_cache_range(reinterpret_cast<addr_t>(root), sizeof(*root));
+        }
+    }
+
+    fbl::unique_ptr<DeviceContext> dev;
+    zx_status_t status = DeviceContext::Create(this, bdf, next_domain_id_, address_width_,
+                                               aspace_size_, &dev);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    auto context_table = static_cast<ds::ContextEntry*>(
+        paddr_to_physmap(root->context_table() << PAGE_SIZE_SHIFT));
+    ds::ContextEntry* entry = &context_table[BdfDevFunc(bdf)];
+    ds::ContextEntry value = {};
+    value.set_address_width(address_width_);
+    value.set_domain_id(next_domain_id_);
+    value.set_second_level_pt_ptr(dev->page_table_pa() >> PAGE_SIZE_SHIFT);
+    value.set_translation_type(0);
+    value.set_present(1);
+    // The present bit is in the lower half, so write it last.
+    entry->upper = value.upper;
+    entry->lower = value.lower;
+    if (!page_walk_coherent_) {
+        arch_clean_cache_range(reinterpret_cast<addr_t>(entry), sizeof(*entry));
+    }
+    status = FlushWriteBuffer();
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Device-selective context-cache invalidation; the source id is the bdf,
+    // with no function mask.
+    status = QueueLocked({ ds::kInvldTypeContextCache | ds::kInvldPage |
+                           ds::InvldDomainId(next_domain_id_) |
+                           (static_cast<uint64_t>(bdf) << 32), 0 });
+    if (status == ZX_OK) {
+        status = QueueLocked({ ds::kInvldTypeIotlb | ds::kInvldDomain |
+                               ds::InvldDomainId(next_domain_id_), 0 });
+    }
+    if (status == ZX_OK) {
+        status = SubmitAndWaitLocked();
+    }
+    if (status != ZX_OK) {
+        entry->lower = 0;
+        return status;
+    }
+
+    next_domain_id_++;
+    *out = dev.get();
+    devices_.push_back(fbl::move(dev));
+    return ZX_OK;
+}
+
+zx_status_t IntelIommu::Map(uint64_t bus_txn_id, const fbl::RefPtr<VmObject>& vmo,
+                            uint64_t offset, size_t size, uint32_t perms,
+                            dev_vaddr_t* vaddr, size_t* mapped_len) {
+    DEBUG_ASSERT(vaddr);
+    DEBUG_ASSERT(mapped_len);
+
+    if (!IsValidBusTxnId(bus_txn_id)) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    if (!IS_PAGE_ALIGNED(offset) || size == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (perms & ~(IOMMU_FLAG_PERM_READ | IOMMU_FLAG_PERM_WRITE | IOMMU_FLAG_PERM_EXECUTE |
+                  IOMMU_FLAG_CACHED)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if ((perms & ~IOMMU_FLAG_CACHED) == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (offset + size < offset || offset + size > vmo->size()) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    fbl::AutoLock guard(&lock_);
+    DeviceContext* dev;
+    zx_status_t status = GetOrCreateContextLocked(static_cast<uint16_t>(bus_txn_id), &dev);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    InvalidationBatch batch;
+    status = dev->Map(vmo, offset, size, perms, kMaxMapLen, &batch, vaddr, mapped_len);
+    // Without caching mode the hardware doesn't cache non-present entries,
+    // so new mappings need no invalidation; only a failed Map's cleanup does.
+    if (status != ZX_OK || caching_mode_) {
+        zx_status_t flush_status = FlushLocked(dev, &batch);
+        if (status == ZX_OK) {
+            status = flush_status;
+        }
+    } else {
+        FlushWriteBuffer();
+    }
+    return status;
+}
+
+zx_status_t IntelIommu::Unmap(uint64_t bus_txn_id, dev_vaddr_t vaddr, size_t size) {
+    if (!IsValidBusTxnId(bus_txn_id)) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    if (!IS_PAGE_ALIGNED(vaddr) || !IS_PAGE_ALIGNED(size)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    fbl::AutoLock guard(&lock_);
+    DeviceContext* dev = FindContextLocked(static_cast<uint16_t>(bus_txn_id));
+    if (!dev) {
+        return ZX_OK;
+    }
+
+    InvalidationBatch batch;
+    zx_status_t status = dev->Unmap(vaddr, size, &batch);
+    if (status != ZX_OK) {
+        return status;
+    }
+    if (batch.num_ranges == 0 && !batch.whole_domain) {
+        return ZX_OK;
+    }
+    return FlushLocked(dev, &batch);
+}
+
+zx_status_t IntelIommu::ClearMappingsForBusTxnId(uint64_t bus_txn_id) {
+    if (!IsValidBusTxnId(bus_txn_id)) {
+        return ZX_ERR_NOT_FOUND;
+    }
+
+    fbl::AutoLock guard(&lock_);
+    DeviceContext* dev = FindContextLocked(static_cast<uint16_t>(bus_txn_id));
+    if (!dev) {
+        return ZX_OK;
+    }
+
+    InvalidationBatch batch;
+    dev->UnmapAll(&batch);
+    return FlushLocked(dev, &batch);
+}
+
+uint64_t IntelIommu::minimum_contiguity(uint64_t bus_txn_id) const {
+    return kMaxMapLen;
+}
+
+uint64_t IntelIommu::aspace_size(uint64_t bus_txn_id) const {
+    return aspace_size_;
+}
@@ -280,6 +280,27 @@ public:
      */
     zx_status_t MaskUnmaskIrq(uint irq_id, bool mask);
 
+    /**
+     * Steer the specified IRQ to a CPU.
+     *
+     * @param irq_id The ID of the IRQ to move.
+     * @param cpu The CPU which should handle the IRQ from now on.
+     *
+     * @return A zx_status_t indicating the success or failure of the operation.
+     * Status codes may include (but are not limited to)...
+     *
+     * ++ ZX_ERR_BAD_STATE
+     *    The device is in DISABLED IRQ mode.
+     * ++ ZX_ERR_INVALID_ARGS
+     *    The irq_id parameter is out of range for the currently configured mode,
+     *    or the CPU is not online.
+     * ++ ZX_ERR_NOT_SUPPORTED
+     *    The IRQ can't be moved on its own.  Legacy IRQs may be shared with
+     *    other devices, and all of the vectors of a multi-vector MSI block share
+     *    one target address.
+     */
+    zx_status_t SetIrqAffinity(uint irq_id, cpu_num_t cpu);
+
     void SetQuirksDone() { quirks_done_ = true; }
 
     /**
@@ -393,6 +414,7 @@ private:
     zx_status_t SetIrqModeLocked(pcie_irq_mode_t mode, uint requested_irqs);
     zx_status_t RegisterIrqHandlerLocked(uint irq_id, pcie_irq_handler_fn_t handler, void* ctx);
     zx_status_t MaskUnmaskIrqLocked(uint irq_id, bool mask);
+    zx_status_t SetIrqAffinityLocked(uint irq_id, cpu_num_t cpu);
 
     // Internal Legacy IRQ support.
     zx_status_t MaskUnmaskLegacyIrq(bool mask);
@@ -97,6 +97,21 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    /**
+     * Method used to move a block of MSI IRQs previously allocated with a call
+     * to a AllocMsiBlock implementation to a different CPU.  On success, the
+     * block's target address and data have been updated and must be written
+     * back to the device by the caller.
+     *
+     * @param block A pointer to the block to be retargeted.
+     * @param cpu The CPU which should receive the block's IRQs.
+     *
+     * @return A status code indicating the success or failure of the operation.
+     */
+    virtual zx_status_t RetargetMsiBlock(pcie_msi_block_t* block, cpu_num_t cpu) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     /**
      * Method used by the bus driver to return a block of MSI IRQs previously
      * allocated with a call to a AllocMsiBlock implementation to the platform
@@ -740,6 +740,37 @@ zx_status_t PcieDevice::MaskUnmaskIrqLocked(uint irq_id, bool mask) {
     return ZX_OK;
 }
 
+zx_status_t PcieDevice::SetIrqAffinityLocked(uint irq_id, cpu_num_t cpu) {
+    DEBUG_ASSERT(plugged_in_);
+    DEBUG_ASSERT(dev_lock_.IsHeld());
+
+    if (irq_.mode == PCIE_IRQ_MODE_DISABLED)
+        return ZX_ERR_BAD_STATE;
+
+    if (irq_id >= irq_.handler_count)
+        return ZX_ERR_INVALID_ARGS;
+
+    /* Only a single vector MSI block can be moved without dragging other IRQs
+     * along with it. */
+    if ((irq_.mode != PCIE_IRQ_MODE_MSI) || (irq_.handler_count != 1))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    DEBUG_ASSERT(irq_.msi);
+    zx_status_t res = bus_drv_.platform().RetargetMsiBlock(&irq_.msi->irq_block_, cpu);
+    if (res != ZX_OK)
+        return res;
+
+    /* Reprogramming the target disables MSI and masks the vector, so put the
+     * mask state back the way it was before turning MSI back on. */
+    bool was_masked = irq_.handlers[irq_id].masked;
+    SetMsiTarget(irq_.msi->irq_block_.tgt_addr, irq_.msi->irq_block_.tgt_data);
+    if (!was_masked)
+        MaskUnmaskMsiIrq(irq_id, false);
+    SetMsiEnb(true);
+
+    return ZX_OK;
+}
+
 /******************************************************************************
  *
  * Kernel API; prototypes in dev/pcie_irqs.h
@@ -792,6 +823,14 @@ zx_status_t PcieDevice::MaskUnmaskIrq(uint irq_id, bool mask) {
         : ZX_ERR_BAD_STATE;
 }
 
+zx_status_t PcieDevice::SetIrqAffinity(uint irq_id, cpu_num_t cpu) {
+    AutoLock dev_lock(&dev_lock_);
+
+    return (plugged_in_ && !disabled_)
+        ? SetIrqAffinityLocked(irq_id, cpu)
+        : ZX_ERR_BAD_STATE;
+}
+
 
 // Map from a device's interrupt pin ID to the proper system IRQ ID.  Follow the
 // PCIe graph up to the root, swizzling as we traverse PCIe switches,
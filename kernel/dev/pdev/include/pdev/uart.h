@@ -23,4 +23,7 @@ struct pdev_uart_ops {
 
 void pdev_register_uart(const struct pdev_uart_ops* ops);
 
+// Counts a character dropped because the driver's transmit buffer was full.
+void pdev_uart_tx_dropped(void);
+
 __END_CDECLS
@@ -127,6 +127,12 @@ zx_status_t get_interrupt_config(unsigned int vector, enum interrupt_trigger_mod
     return intr_ops->get_config(vector, tm, pol);
 }
 
+zx_status_t set_interrupt_affinity(unsigned int vector, cpu_num_t cpu) {
+    if (!intr_ops->set_affinity)
+        return ZX_ERR_NOT_SUPPORTED;
+    return intr_ops->set_affinity(vector, cpu);
+}
+
 bool is_valid_interrupt(unsigned int vector, uint32_t flags) {
     return intr_ops->is_valid(vector, flags);
 }
@@ -6,8 +6,11 @@
 
 #include <err.h>
 #include <arch/arch_ops.h>
+#include <lib/counters.h>
 #include <pdev/uart.h>
 
+KCOUNTER(uart_tx_dropped, "kernel.uart.tx_dropped");
+
 static int default_putc(char c) {
     return -1;
 }
@@ -60,3 +63,7 @@ void pdev_register_uart(const struct pdev_uart_ops* ops) {
     uart_ops = ops;
     smp_mb();
 }
+
+void pdev_uart_tx_dropped(void) {
+    kcounter_add(uart_tx_dropped, 1u);
+}
@@ -9,6 +9,7 @@
 #include <trace.h>
 #include <string.h>
 #include <lib/cbuf.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <dev/interrupt.h>
 #include <dev/uart.h>
@@ -67,6 +68,9 @@
 #define UARTREG(base, reg)  (*(volatile uint32_t*)((base)  + (reg)))
 
 #define RXBUF_SIZE 128
+#define TXBUF_SIZE 8192
+// Interrupt once fewer than this many bytes are left to send in the fifo.
+#define TX_IRQ_LEVEL 32
 #define NUM_UART 5
 
 #define S905_UART0_OFFSET          (0x011084c0)
@@ -82,6 +86,25 @@ static bool initialized = false;
 static uintptr_t s905_uart_base = 0;
 static uint32_t s905_uart_irq = 0;
 
+// Once the irq is set up, output goes through uart_tx_buf, and the tx
+// interrupt is enabled while there's anything in it.
+static cbuf_t uart_tx_buf;
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// Moves what fits from uart_tx_buf to the fifo. Called with uart_tx_lock held.
+static void s905_uart_tx_pump(uintptr_t base)
+{
+    char c;
+    while ((UARTREG(base, S905_UART_STATUS) & S905_UART_STATUS_TXFULL) == 0) {
+        if (cbuf_read_char(&uart_tx_buf, &c, false) == 0) {
+            UARTREG(base, S905_UART_CONTROL) &= ~S905_UART_CONTROL_TXINTEN;
+            return;
+        }
+        UARTREG(base, S905_UART_WFIFO) = c;
+    }
+    UARTREG(base, S905_UART_CONTROL) |= S905_UART_CONTROL_TXINTEN;
+}
+
 
 
 static enum handler_return uart_irq(void *arg)
@@ -98,6 +121,12 @@ static enum handler_return uart_irq(void *arg)
         cbuf_write_char(&uart_rx_buf, c);
     }
 
+    spin_lock(&uart_tx_lock);
+    if (UARTREG(base, S905_UART_CONTROL) & S905_UART_CONTROL_TXINTEN) {
+        s905_uart_tx_pump(base);
+    }
+    spin_unlock(&uart_tx_lock);
+
     return INT_NO_RESCHEDULE;
 }
 
@@ -106,8 +135,9 @@ static void s905_uart_init(mdi_node_ref_t* node, uint level)
     assert(s905_uart_base);
     assert(s905_uart_irq);
 
-    // create circular buffer to hold received data
+    // create circular buffers to hold received and pending transmit data
     cbuf_initialize(&uart_rx_buf, RXBUF_SIZE);
+    cbuf_initialize(&uart_tx_buf, TXBUF_SIZE);
 
     //reset the port
     UARTREG(s905_uart_base,S905_UART_CONTROL) |=  S905_UART_CONTROL_RSTRX |
@@ -124,10 +154,10 @@ static void s905_uart_init(mdi_node_ref_t* node, uint level)
                                                  S905_UART_CONTROL_RXINTEN |
                                                  S905_UART_CONTROL_TWOWIRE;
 
-    // Set to interrupt every 1 rx byte
+    // Set to interrupt every 1 rx byte, and when the tx fifo runs low
     uint32_t temp2 = UARTREG(s905_uart_base,S905_UART_IRQ_CONTROL);
     temp2 &= 0xffff0000;
-    temp2 |= (1 << 8) | ( 1 );
+    temp2 |= (TX_IRQ_LEVEL << 8) | ( 1 );
     UARTREG(s905_uart_base,S905_UART_IRQ_CONTROL) = temp2;
 
     zx_status_t status = register_int_handler(s905_uart_irq, &uart_irq, (void *)s905_uart_base);
@@ -145,6 +175,18 @@ static int s905_uart_pputc(char c)
     if (!s905_uart_base)
         return 0;
 
+    // Anything still buffered goes first. The lock isn't taken, since a cpu
+    // halted by the panic may be holding it.
+    if (initialized) {
+        char pending;
+        UARTREG(s905_uart_base, S905_UART_CONTROL) &= ~S905_UART_CONTROL_TXINTEN;
+        while (cbuf_read_char(&uart_tx_buf, &pending, false) == 1) {
+            while (UARTREG(s905_uart_base, S905_UART_STATUS) & S905_UART_STATUS_TXFULL)
+                ;
+            UARTREG(s905_uart_base, S905_UART_WFIFO) = pending;
+        }
+    }
+
     /* spin while fifo is full */
     while (UARTREG(s905_uart_base, S905_UART_STATUS) & S905_UART_STATUS_TXFULL)
         ;
@@ -171,12 +213,27 @@ static int s905_uart_putc(char c)
     if (!s905_uart_base)
         return 0;
 
-    /* spin while fifo is full */
-    while (UARTREG(s905_uart_base, S905_UART_STATUS) & S905_UART_STATUS_TXFULL)
-        ;
-    UARTREG(s905_uart_base, S905_UART_WFIFO) = c;
+    if (!initialized) {
+        /* spin while fifo is full */
+        while (UARTREG(s905_uart_base, S905_UART_STATUS) & S905_UART_STATUS_TXFULL)
+            ;
+        UARTREG(s905_uart_base, S905_UART_WFIFO) = c;
+        return 1;
+    }
 
-    return 1;
+    // Queue the character behind anything already waiting, and never wait for
+    // the fifo to drain.
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    int ret = 1;
+    if (cbuf_write_char_nosignal(&uart_tx_buf, c) == 0) {
+        pdev_uart_tx_dropped();
+        ret = -1;
+    }
+    s905_uart_tx_pump(s905_uart_base);
+    spin_unlock_irqrestore(&uart_tx_lock, state);
+
+    return ret;
 }
 
 static int s905_uart_getc(bool wait)
@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <trace.h>
 #include <lib/cbuf.h>
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
 #include <dev/interrupt.h>
 #include <dev/uart.h>
@@ -37,6 +38,7 @@
 #define UARTREG(base, reg)  (*REG32((base)  + (reg)))
 
 #define RXBUF_SIZE 16
+#define TXBUF_SIZE 8192
 
 // values read from MDI
 static uint64_t uart_base = 0;
@@ -44,6 +46,29 @@ static uint32_t uart_irq = 0;
 
 static cbuf_t uart_rx_buf;
 
+// Once the irq is set up, output goes through uart_tx_buf, and the tx
+// interrupt is unmasked while there's anything in it.  uart_tx_lock also
+// guards the updates of UART_IMSC.
+static cbuf_t uart_tx_buf;
+static bool uart_tx_buffered = false;
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE;
+
+// Moves what fits from uart_tx_buf to the fifo. Called with uart_tx_lock held.
+static void pl011_uart_tx_pump(void)
+{
+    char c;
+    while ((UARTREG(uart_base, UART_FR) & (1<<5)) == 0) { // !txff
+        if (cbuf_read_char(&uart_tx_buf, &c, false) == 0) {
+            UARTREG(uart_base, UART_IMSC) &= ~(1<<5); // !txim
+            return;
+        }
+        UARTREG(uart_base, UART_DR) = c;
+    }
+    // The tx interrupt only fires as the fifo drains past the trigger level,
+    // so only unmask it while the fifo is full.
+    UARTREG(uart_base, UART_IMSC) |= (1<<5); // txim
+}
+
 static enum handler_return pl011_uart_irq(void *arg)
 {
     /* read interrupt status and mask */
@@ -54,7 +79,9 @@ static enum handler_return pl011_uart_irq(void *arg)
         while ((UARTREG(uart_base, UART_FR) & (1<<4)) == 0) {
             /* if we're out of rx buffer, mask the irq instead of handling it */
             if (cbuf_space_avail(&uart_rx_buf) == 0) {
+                spin_lock(&uart_tx_lock);
                 UARTREG(uart_base, UART_IMSC) &= ~((1<<4)|(1<<6)); // !rxim
+                spin_unlock(&uart_tx_lock);
                 break;
             }
 
@@ -63,13 +90,21 @@ static enum handler_return pl011_uart_irq(void *arg)
         }
     }
 
+    if (isr & (1<<5)) { // txmis
+        spin_lock(&uart_tx_lock);
+        UARTREG(uart_base, UART_ICR) = (1<<5);
+        pl011_uart_tx_pump();
+        spin_unlock(&uart_tx_lock);
+    }
+
     return INT_NO_RESCHEDULE;
 }
 
 static void pl011_uart_init(mdi_node_ref_t* node, uint level)
 {
-    // create circular buffer to hold received data
+    // create circular buffers to hold received and pending transmit data
     cbuf_initialize(&uart_rx_buf, RXBUF_SIZE);
+    cbuf_initialize(&uart_tx_buf, TXBUF_SIZE);
 
     // assumes interrupts are contiguous
     zx_status_t status = register_int_handler(uart_irq, &pl011_uart_irq, NULL);
@@ -90,23 +125,43 @@ static void pl011_uart_init(mdi_node_ref_t* node, uint level)
 
     // enable interrupt
     unmask_interrupt(uart_irq);
+
+    uart_tx_buffered = true;
 }
 
 static int pl011_uart_putc(char c)
 {
-    /* spin while fifo is full */
-    while (UARTREG(uart_base, UART_FR) & (1<<5))
-        ;
-    UARTREG(uart_base, UART_DR) = c;
+    if (!uart_tx_buffered) {
+        /* spin while fifo is full */
+        while (UARTREG(uart_base, UART_FR) & (1<<5))
+            ;
+        UARTREG(uart_base, UART_DR) = c;
+        return 1;
+    }
 
-    return 1;
+    // Queue the character behind anything already waiting, and never wait for
+    // the fifo to drain.
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    int ret = 1;
+    if (cbuf_write_char_nosignal(&uart_tx_buf, c) == 0) {
+        pdev_uart_tx_dropped();
+        ret = -1;
+    }
+    pl011_uart_tx_pump();
+    spin_unlock_irqrestore(&uart_tx_lock, state);
+
+    return ret;
 }
 
 static int pl011_uart_getc(bool wait)
 {
     char c;
     if (cbuf_read_char(&uart_rx_buf, &c, wait) == 1) {
-        UARTREG(uart_base, UART_IMSC) = ((1<<4)|(1<<6)); // rxim
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&uart_tx_lock, state);
+        UARTREG(uart_base, UART_IMSC) |= ((1<<4)|(1<<6)); // rxim
+        spin_unlock_irqrestore(&uart_tx_lock, state);
         return c;
     }
 
@@ -116,6 +171,18 @@ static int pl011_uart_getc(bool wait)
 /* panic-time getc/putc */
 static int pl011_uart_pputc(char c)
 {
+    // Anything still buffered goes first. The lock isn't taken, since a cpu
+    // halted by the panic may be holding it.
+    if (uart_tx_buffered) {
+        char pending;
+        UARTREG(uart_base, UART_IMSC) &= ~(1<<5); // !txim
+        while (cbuf_read_char(&uart_tx_buf, &pending, false) == 1) {
+            while (UARTREG(uart_base, UART_FR) & (1<<5))
+                ;
+            UARTREG(uart_base, UART_DR) = pending;
+        }
+    }
+
     /* spin while fifo is full */
     while (UARTREG(uart_base, UART_FR) & (1<<5))
         ;
@@ -42,4 +42,9 @@ zx_status_t arch_mp_cpu_unplug(cpu_num_t cpu_id);
 
 void arch_mp_init_percpu(void);
 
+/* return the set of cpus that share a last level cache with the given cpu,
+ * including the cpu itself. used by the scheduler to prefer cache-local
+ * cpus when balancing. */
+cpu_mask_t arch_mp_get_cache_siblings(cpu_num_t cpu_id);
+
 __END_CDECLS
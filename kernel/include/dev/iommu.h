@@ -21,6 +21,13 @@
 #define IOMMU_FLAG_PERM_WRITE   (1<<1)
 #define IOMMU_FLAG_PERM_EXECUTE (1<<2)
 
+// Passed to Map() with the permissions for a range that will be mapped again
+// soon after it is unmapped, such as a driver's ring buffers.  The IOMMU may
+// then keep the range pinned, and mapped at the same address, after Unmap()
+// so that mapping it again is free.  The device keeps access to the range
+// until ClearMappingsForBusTxnId() or until the IOMMU needs the space back.
+#define IOMMU_FLAG_CACHED       (1<<3)
+
 // Type used to refer to virtual addresses presented to a device by the IOMMU.
 typedef uint64_t dev_vaddr_t;
 
@@ -44,7 +51,7 @@ public:
     // MUST NOT be unpined until after Unmap() is called on the returned range.
     //
     // |perms| defines the access permissions, using the IOMMU_FLAG_PERM_*
-    // flags.
+    // flags, optionally with IOMMU_FLAG_CACHED.
     //
     // If |size| is no more than |minimum_contiguity()|, this will never return
     // a partial mapping.
@@ -61,7 +68,8 @@ public:
                             dev_vaddr_t* vaddr, size_t* mapped_len) = 0;
 
     // Revoke access to the range of addresses [vaddr, vaddr + size) for the
-    // device identified by |bus_txn_id|.
+    // device identified by |bus_txn_id|.  A range mapped with IOMMU_FLAG_CACHED
+    // may instead stay mapped (see above); its pages may still be unpinned.
     //
     // Returns ZX_ERR_INVALID_ARGS if:
     //  |size| is not a multiple of PAGE_SIZE
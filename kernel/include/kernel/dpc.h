@@ -14,6 +14,16 @@ __BEGIN_CDECLS
 
 #define DPC_THREAD_PRIORITY HIGH_PRIORITY
 
+/* dpcs at high priority run ahead of every normal one queued on the same cpu,
+ * for latency sensitive follow ups to timers and ipis */
+#define DPC_PRIORITY_NORMAL 0u
+#define DPC_PRIORITY_HIGH 1u
+#define DPC_PRIORITY_COUNT 2u
+
+/* queueing latency histogram buckets: bucket 0 is under 1us, bucket i is
+ * [2^(i-1), 2^i) us, and the last one takes everything longer */
+#define DPC_LATENCY_BUCKETS 16u
+
 struct dpc;
 typedef void (*dpc_func_t)(struct dpc*);
 
@@ -22,6 +32,11 @@ typedef struct dpc {
 
     dpc_func_t func;
     void* arg;
+    uint32_t priority;
+
+    /* owned by the dpc code */
+    volatile int queued;
+    zx_time_t queued_time;
 } dpc_t;
 
 #define DPC_INITIAL_VALUE                   \
@@ -29,6 +44,9 @@ typedef struct dpc {
         .node = LIST_INITIAL_CLEARED_VALUE, \
         .func = 0,                          \
         .arg = 0,                           \
+        .priority = DPC_PRIORITY_NORMAL,    \
+        .queued = 0,                        \
+        .queued_time = 0,                   \
     }
 
 /* initializes dpc for the current cpu */
@@ -36,6 +54,8 @@ void dpc_init_for_cpu(void);
 
 /* queue an already filled out dpc, optionally reschedule immediately to run the dpc thread */
 /* the deferred procedure runs in a dedicated thread that runs at DPC_THREAD_PRIORITY */
+/* only the first dpc queued on an idle cpu wakes the thread, which then runs everything */
+/* queued by the time it gets there */
 zx_status_t dpc_queue(dpc_t* dpc, bool reschedule);
 
 /* queue a dpc, but must be holding the thread lock */
@@ -20,6 +20,17 @@ __BEGIN_CDECLS
 
 #define MUTEX_MAGIC (0x6D757478) // 'mutx'
 
+struct k_counter_desc;
+
+/* Contention counters shared by the mutexes that guard the same kind of
+ * object, see MUTEX_CLASS(). */
+typedef struct mutex_class {
+    /* contended, but acquired by spinning */
+    const struct k_counter_desc* spin_acquired;
+    /* contended, and had to block */
+    const struct k_counter_desc* blocked;
+} mutex_class_t;
+
 /* Body of the mutex.
  * The val field holds either 0 or a pointer to the thread_t holding the mutex.
  * If one or more threads are blocking and queued up, MUTEX_FLAG_QUEUED is ORed in as well.
@@ -29,6 +40,7 @@ typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
     uintptr_t val;
     wait_queue_t wait;
+    const mutex_class_t* cls;
 } mutex_t;
 
 #define MUTEX_FLAG_QUEUED ((uintptr_t)1)
@@ -44,16 +56,28 @@ static inline thread_t* mutex_holder(const mutex_t* m) {
     return (thread_t*)(mutex_val(m) & ~MUTEX_FLAG_QUEUED);
 }
 
-#define MUTEX_INITIAL_VALUE(m)                      \
+#define MUTEX_INITIAL_VALUE_CLASS(m, c)             \
     {                                               \
         .magic = MUTEX_MAGIC,                       \
         .val = 0,                                   \
         .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
+        .cls = (c),                                 \
     }
+#define MUTEX_INITIAL_VALUE(m) MUTEX_INITIAL_VALUE_CLASS(m, NULL)
+
+/* Defines the mutex class |var|, whose counters show up as
+ * kernel.mutex.<name>.spin and kernel.mutex.<name>.block.
+ * Requires <lib/counters.h>. */
+#define MUTEX_CLASS(var, name)                                    \
+    KCOUNTER(var##_spin_acquired, "kernel.mutex." name ".spin");  \
+    KCOUNTER(var##_blocked, "kernel.mutex." name ".block");       \
+    static const mutex_class_t var = { var##_spin_acquired, var##_blocked }
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - A contended acquire spins for a short while before blocking, as long as
+ *   the holder is running on another cpu.
 */
 void mutex_init(mutex_t* m);
 void mutex_destroy(mutex_t* m);
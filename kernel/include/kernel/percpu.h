@@ -7,6 +7,7 @@
 
 #include <arch/ops.h>
 #include <kernel/align.h>
+#include <kernel/dpc.h>
 #include <kernel/event.h>
 #include <kernel/stats.h>
 #include <kernel/thread.h>
@@ -18,8 +19,9 @@
 __BEGIN_CDECLS
 
 struct percpu {
-    /* per cpu timer queue */
+    /* per cpu timer queue and the lock protecting it */
     struct list_node timer_queue;
+    spin_lock_t timer_lock;
 
     /* per cpu preemption timer */
     timer_t preempt_timer;
@@ -28,6 +30,27 @@ struct percpu {
     struct list_node run_queue[NUM_PRIORITIES];
     uint32_t run_queue_bitmap;
 
+    /* number of threads sitting in the run queues, used to pick victims to steal from */
+    uint32_t run_queue_len;
+
+    /* the thread running on this cpu, for mutex spinners to look at */
+    thread_t* volatile running_thread;
+
+    /* reschedule ipis raised by this cpu under the thread lock, sent when it is dropped */
+    cpu_mask_t pending_reschedule_ipis;
+
+    /* set when the preemption timer was left unarmed because nothing else was
+     * waiting to run; it is armed again as soon as a thread is queued here */
+    bool preempt_tickless;
+
+    /* virtual runtime of the last fair-share thread picked to run on this cpu */
+    int64_t fair_clock;
+
+    /* deadline threads ready to run, ordered by absolute deadline, and the sum of
+     * the densities of the reservations admitted to this cpu */
+    struct list_node deadline_queue;
+    uint32_t deadline_utilization;
+
     /* thread/cpu level statistics */
     struct cpu_stats stats;
 
@@ -37,9 +60,11 @@ struct percpu {
     /* kernel counters arena */
     uint64_t* counters;
 
-    /* dpc context */
-    list_node_t dpc_list;
+    /* dpc context: one queue per priority, and the lock protecting them */
+    list_node_t dpc_list[DPC_PRIORITY_COUNT];
+    spin_lock_t dpc_lock;
     event_t dpc_event;
+    uint64_t dpc_latency[DPC_PRIORITY_COUNT][DPC_LATENCY_BUCKETS];
 } __CPU_ALIGN;
 
 /* the kernel per-cpu structure */
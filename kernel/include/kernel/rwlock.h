@@ -0,0 +1,99 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <kernel/atomic.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <stdbool.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+#define RWLOCK_MAGIC (0x72776C6B) // 'rwlk'
+
+/* A blocking reader/writer lock.
+ * Writers hold |writer| for their whole critical section. Readers only take it
+ * long enough to count themselves in |readers|, so a writer that is waiting for
+ * the readers to drain holds off any new ones and can't be starved.
+ */
+typedef struct rwlock {
+    uint32_t magic;
+    volatile int readers;
+    volatile int writer_waiting;
+    mutex_t writer;
+    event_t drained;
+} rwlock_t;
+
+#define RWLOCK_INITIAL_VALUE(l)                                                   \
+    {                                                                             \
+        .magic = RWLOCK_MAGIC,                                                    \
+        .readers = 0,                                                             \
+        .writer_waiting = 0,                                                      \
+        .writer = MUTEX_INITIAL_VALUE((l).writer),                                \
+        .drained = EVENT_INITIAL_VALUE((l).drained, false, EVENT_FLAG_AUTOUNSIGNAL), \
+    }
+
+/* Rules for rwlocks:
+ * - Only safe to use from thread context.
+ * - Not recursive, and a reader may not upgrade to a writer.
+ */
+void rwlock_init(rwlock_t* l);
+void rwlock_destroy(rwlock_t* l);
+void rwlock_acquire_read(rwlock_t* l);
+void rwlock_release_read(rwlock_t* l);
+void rwlock_acquire_write(rwlock_t* l);
+void rwlock_release_write(rwlock_t* l);
+
+/* does the current thread hold the lock for writing? */
+static inline bool rwlock_is_write_held(const rwlock_t* l) {
+    return is_mutex_held(&l->writer);
+}
+
+/* is the lock held for writing by the current thread, or held by any reader?
+ * readers aren't tracked individually, so this is only good for assertions
+ */
+static inline bool rwlock_is_held(const rwlock_t* l) {
+    return rwlock_is_write_held(l) || atomic_load((volatile int*)&l->readers) > 0;
+}
+
+__END_CDECLS
+
+#ifdef __cplusplus
+// Scoped holders of an rwlock_t, in the style of fbl::AutoLock.
+class AutoReadLock {
+public:
+    explicit AutoReadLock(rwlock_t* lock)
+        : lock_(lock) { rwlock_acquire_read(lock_); }
+    ~AutoReadLock() { rwlock_release_read(lock_); }
+
+    // suppress default constructors
+    AutoReadLock(const AutoReadLock& am) = delete;
+    AutoReadLock& operator=(const AutoReadLock& am) = delete;
+    AutoReadLock(AutoReadLock&& c) = delete;
+    AutoReadLock& operator=(AutoReadLock&& c) = delete;
+
+private:
+    rwlock_t* lock_;
+};
+
+class AutoWriteLock {
+public:
+    explicit AutoWriteLock(rwlock_t* lock)
+        : lock_(lock) { rwlock_acquire_write(lock_); }
+    ~AutoWriteLock() { rwlock_release_write(lock_); }
+
+    // suppress default constructors
+    AutoWriteLock(const AutoWriteLock& am) = delete;
+    AutoWriteLock& operator=(const AutoWriteLock& am) = delete;
+    AutoWriteLock(AutoWriteLock&& c) = delete;
+    AutoWriteLock& operator=(AutoWriteLock&& c) = delete;
+
+private:
+    rwlock_t* lock_;
+};
+#endif // ifdef __cplusplus
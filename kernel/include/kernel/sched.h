@@ -22,6 +22,10 @@ void sched_reschedule(void);
 void sched_resched_internal(void);
 void sched_unblock_idle(thread_t* t);
 void sched_migrate(thread_t* t);
+void sched_set_fair_weight(thread_t* t, uint32_t weight);
+void sched_update_inherited_priority(thread_t* t);
+zx_status_t sched_set_deadline(thread_t* t, zx_duration_t capacity,
+                               zx_duration_t relative_deadline, zx_duration_t period);
 
 /* return true if the thread was placed on the current cpu's run queue */
 /* this usually means the caller should locally reschedule soon */
@@ -71,6 +71,12 @@ static inline void spin_unlock_restore(spin_lock_t* lock, spin_lock_saved_state_
 #define spin_lock_irqsave(lock, statep) spin_lock_save(lock, &(statep), SPIN_LOCK_FLAG_INTERRUPTS)
 #define spin_unlock_irqrestore(lock, statep) spin_unlock_restore(lock, statep, SPIN_LOCK_FLAG_INTERRUPTS)
 
+#if WITH_SPINLOCK_STATS
+/* Called by the arch lock code when the lock taken at |caller| had to be
+ * waited for, for |cycles|. Dumped with the "spinstats" console command. */
+void spin_lock_contended(void* caller, uint64_t cycles);
+#endif
+
 __END_CDECLS
 
 #ifdef __cplusplus
@@ -20,6 +20,11 @@ struct cpu_stats {
     ulong preempts;
     ulong yields;
 
+    /* idle balancing: threads pulled from other cpus' run queues, and times
+     * the cpu went looking for work to steal and found none */
+    ulong steals;
+    ulong failed_steals;
+
     /* cpu level interrupts and exceptions */
     ulong interrupts;  /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
     ulong timer_ints;  /* timer interrupts */
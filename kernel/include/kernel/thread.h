@@ -74,7 +74,7 @@ typedef void (*thread_tls_callback_t)(void* tls_value);
 #define THREAD_LINEBUFFER_LENGTH 128
 
 // Number of kernel tls slots.
-#define THREAD_MAX_TLS_ENTRY 2
+#define THREAD_MAX_TLS_ENTRY 3
 
 struct vmm_aspace;
 
@@ -93,6 +93,39 @@ typedef struct thread {
     int base_priority;
     int priority_boost;
 
+    /* weighted fair-share scheduling. a thread with a nonzero fair_weight is
+     * ordered by virtual runtime within its priority band instead of round
+     * robin, and is not subject to priority boosting. fair_vruntime is relative
+     * to the fair clock of fair_cpu. */
+    uint32_t fair_weight;
+    cpu_num_t fair_cpu;
+    int64_t fair_vruntime;
+
+    /* deadline reservation, active if capacity is nonzero. the thread is
+     * scheduled earliest deadline first ahead of the priority bands on the cpu
+     * it was admitted to. when the budget runs out the deadline is postponed by
+     * a period and the budget refilled, so the thread cannot take more than its
+     * reserved share of the cpu from others. */
+    struct {
+        zx_duration_t capacity;
+        zx_duration_t relative_deadline;
+        zx_duration_t period;
+        zx_time_t abs_deadline;
+        int64_t budget; /* goes negative on overrun until recharged */
+        cpu_mask_t saved_affinity; /* affinity to restore when the reservation ends */
+    } deadline;
+
+    /* portion of the current run already charged to fair and deadline accounting */
+    zx_duration_t run_charged;
+
+    /* priority inheritance, guarded by the thread lock. while blocked on a
+     * futex that names an owner, a thread lends its priority to the owner,
+     * which runs at no less than the highest priority lent to it. */
+    int inherited_priority;        /* -1 if nothing is lent */
+    struct thread* pi_owner;       /* thread this one lends to while blocked */
+    struct list_node pi_node;      /* in pi_owner's pi_lenders */
+    struct list_node pi_lenders;   /* threads lending to this one */
+
     /* current cpu the thread is either running on or in the ready queue, undefined otherwise */
     cpu_num_t curr_cpu;
     cpu_num_t last_cpu;      /* last cpu the thread ran on, INVALID_CPU if it's never run */
@@ -152,6 +185,11 @@ typedef struct thread {
     /* This tracks whether a thread reschedule is pending.  This should
      * only be true if preempt_disable is also true. */
     bool preempt_pending;
+    /* While set, the next thread this one wakes is queued on this cpu, ahead
+     * of its priority band, with the rest of this thread's time slice.  Only
+     * for a waker which is about to block or yield to the thread it wakes.
+     * See thread_set_wakeup_handoff(). */
+    bool wakeup_handoff;
 
     /* thread local storage, intialized to zero */
     void* tls[THREAD_MAX_TLS_ENTRY];
@@ -177,6 +215,14 @@ typedef struct thread {
 #define DEFAULT_PRIORITY (NUM_PRIORITIES / 2)
 #define HIGH_PRIORITY ((NUM_PRIORITIES / 4) * 3)
 
+/* fair-share scheduling weights, 0 means the thread is not fair-share scheduled */
+#define THREAD_FAIR_WEIGHT_DEFAULT (1024)
+#define THREAD_FAIR_WEIGHT_MAX (65536)
+
+/* bounds on the parameters of a deadline reservation */
+#define THREAD_DEADLINE_MIN_PERIOD ZX_USEC(100)
+#define THREAD_DEADLINE_MAX_PERIOD ZX_SEC(1)
+
 /* stack size */
 #ifdef CUSTOM_DEFAULT_STACK_SIZE
 #define DEFAULT_STACK_SIZE CUSTOM_DEFAULT_STACK_SIZE
@@ -214,6 +260,14 @@ zx_status_t thread_detach(thread_t* t);
 zx_status_t thread_join(thread_t* t, int* retcode, zx_time_t deadline);
 zx_status_t thread_detach_and_resume(thread_t* t);
 zx_status_t thread_set_real_time(thread_t* t);
+zx_status_t thread_set_fair_weight(thread_t* t, uint32_t weight);
+zx_status_t thread_set_deadline(thread_t* t, zx_duration_t capacity,
+                                zx_duration_t relative_deadline, zx_duration_t period);
+
+/* lend the current thread's priority to |owner| until thread_reclaim_priority().
+ * both are called with the thread lock held, around blocking the current thread */
+void thread_lend_priority(thread_t* owner);
+void thread_reclaim_priority(void);
 
 /* scheduler routines to be used by regular kernel code */
 void thread_yield(void);      /* give up the cpu and time slice voluntarily */
@@ -229,6 +283,11 @@ void thread_print_current_backtrace(void);
 // print the backtrace of the passed in thread, if possible
 zx_status_t thread_print_backtrace(thread_t* t);
 
+// store up to |count| return addresses from the current thread's stack in
+// |pcs|, starting with the one in the frame |fp|. returns how many were
+// found, which is zero without frame pointers.
+size_t thread_get_current_backtrace(void* fp, void** pcs, size_t count);
+
 // Return true if stopped in an exception.
 static inline bool thread_stopped_in_exception(const thread_t* thread) {
     return !!thread->exception_context;
@@ -290,13 +349,33 @@ static inline bool thread_is_real_time_or_idle(thread_t* t) {
 thread_t* get_current_thread(void);
 void set_current_thread(thread_t*);
 
-/* scheduler lock */
+/* scheduler lock
+ *
+ * Guards the state of every thread, the run queues of every cpu and every
+ * wait queue. It is held across a context switch and dropped by the thread
+ * being switched to. The only spinlocks that may be taken while holding it
+ * are a cpu's timer_lock and the dpc lock; timer callbacks that need it go
+ * through timer_trylock_or_cancel() to avoid the inverse order.
+ *
+ * Reschedule ipis raised while holding it are not sent until it is dropped,
+ * so that other cpus don't spin on it while the ipi goes out. Anything that
+ * releases it by hand must call thread_lock_flush_ipis() right after, with
+ * interrupts still disabled.
+ */
 extern spin_lock_t thread_lock;
 
+void thread_lock_flush_ipis(void);
+
+static inline void thread_unlock_irqrestore(spin_lock_saved_state_t state) TA_REL(thread_lock) {
+    spin_unlock(&thread_lock);
+    thread_lock_flush_ipis();
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
 #define THREAD_LOCK(state)         \
     spin_lock_saved_state_t state; \
     spin_lock_irqsave(&thread_lock, state)
-#define THREAD_UNLOCK(state) spin_unlock_irqrestore(&thread_lock, state)
+#define THREAD_UNLOCK(state) thread_unlock_irqrestore(state)
 
 static inline bool thread_lock_held(void) {
     return spin_lock_held(&thread_lock);
@@ -375,6 +454,17 @@ static inline void thread_preempt_set_pending(void) {
     current_thread->preempt_pending = true;
 }
 
+/* thread_set_wakeup_handoff() hands the current cpu to the next thread the
+ * current thread wakes, as synchronous IPC does: a channel call wakes the
+ * server it is about to block waiting on, and the reply wakes the caller.
+ * Rather than being placed on another cpu and leaving this one to pick a
+ * thread, the woken thread runs here as soon as this one blocks or
+ * reschedules.  Threads whose affinity excludes this cpu and deadline threads
+ * are placed as usual.  Wakeups from interrupt handlers are never handed off. */
+static inline void thread_set_wakeup_handoff(bool handoff) {
+    get_current_thread()->wakeup_handoff = handoff;
+}
+
 __END_CDECLS
 
 #ifdef __cplusplus
@@ -388,7 +478,7 @@ public:
     }
 
     ~AutoThreadLock() {
-        spin_unlock_irqrestore(&thread_lock, state_);
+        thread_unlock_irqrestore(state_);
     }
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(AutoThreadLock);
@@ -39,6 +39,7 @@ typedef struct timer {
     void* arg;
 
     volatile int active_cpu; // <0 if inactive
+    volatile int queue_cpu;  // cpu whose queue holds the timer, <0 if not queued
     volatile bool cancel;    // true if cancel is pending
 } timer_t;
 
@@ -51,6 +52,7 @@ typedef struct timer {
         .callback = NULL,                   \
         .arg = NULL,                        \
         .active_cpu = -1,                   \
+        .queue_cpu = -1,                    \
         .cancel = false,                    \
     }
 
@@ -111,14 +113,21 @@ static inline void timer_set_oneshot(
     return timer_set(timer, deadline, TIMER_SLACK_CENTER, 0ull, callback, arg);
 }
 
-/* Similar to timer_set_oneshot, with additional constraints:
+/* Similar to timer_set, with additional constraints:
  * - Will reset a currently active timer
  * - Must be called with interrupts disabled
  * - Must be running on the cpu that the timer is set to fire on (if currently set)
  * - Cannot be called from the timer itself
  */
 /* NOTE: internal api that is needed probably only by the scheduler */
-void timer_reset_oneshot_local(timer_t* timer, zx_time_t deadline, timer_callback callback, void* arg);
+void timer_reset_local(timer_t* timer, zx_time_t deadline,
+                       enum slack_mode mode, uint64_t slack, timer_callback callback, void* arg);
+
+/* Equivalent to timer_reset_local with a slack of 0 */
+static inline void timer_reset_oneshot_local(
+    timer_t* timer, zx_time_t deadline, timer_callback callback, void* arg) {
+    timer_reset_local(timer, deadline, TIMER_SLACK_CENTER, 0ull, callback, arg);
+}
 
 /* Internal routines used when bringing cpus online/offline */
 
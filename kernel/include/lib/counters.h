@@ -55,3 +55,18 @@ static inline void kcounter_add(const struct k_counter_desc* var,
 }
 
 __END_CDECLS
+
+#ifdef __cplusplus
+
+#include <fbl/ref_ptr.h>
+#include <zircon/types.h>
+
+class VmObject;
+
+// Returns the kernel's counters as the VMOs described in
+// <lib/counter-vmo-abi.h>.  The arena VMO shares its pages with the live
+// counters, so it must only be handed out read-only.
+zx_status_t kcounters_get_vmos(fbl::RefPtr<VmObject>* desc_vmo,
+                               fbl::RefPtr<VmObject>* arena_vmo);
+
+#endif // __cplusplus
@@ -62,6 +62,12 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
+
+// Records a boot timeline marker as a probe named "|group|:|name|"; both
+// strings must outlive boot.  Markers made before the trace buffer exists are
+// kept and written out, with their original timestamps, once it does.  Only
+// for the boot thread.
+void ktrace_boot_mark(const char* group, const char* name);
 #else
 static inline void* ktrace_open(uint32_t tag) { return NULL; }
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
@@ -69,6 +75,7 @@ static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint
 static inline void ktrace_probe0(const char* name) {}
 static inline void ktrace_probe2(const char* name, uint32_t arg0, uint32_t arg1) {}
 static inline void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name) {}
+static inline void ktrace_boot_mark(const char* group, const char* name) {}
 static inline ssize_t ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     if ((len == 0) && (off == 0)) {
         return 0;
@@ -41,6 +41,11 @@ zx_status_t bootdata_append_section(uint8_t* bootdata_buf, const size_t buflen,
 // Save the crashlog for propagation to the next kernel.
 void mexec_stash_crashlog(fbl::RefPtr<VmObject> vmo);
 
+// Save the bootdata this kernel was booted with, so that a later mexec can
+// hand it to the next kernel without userspace supplying one.  Only kept if
+// kernel.mexec-preserve-bootdata is set.
+void mexec_stash_bootdata(fbl::RefPtr<VmObject> vmo);
+
 /* Allow the platform to patch the bootdata structure with any platform specific
  * data that might be necessary for the kernel that mexec is chain-loading.
  */
@@ -45,6 +45,11 @@ uint64_t ticks_per_second(void);
 /* high-precision timer current_ticks */
 uint64_t current_ticks(void);
 
+/* if current_time() is the ticks userspace reads with zx_ticks_get scaled by
+ * a fixed-point factor, store the factor in |ns_per_tick| and return true */
+struct fp_32_64;
+bool platform_get_ns_per_tick(struct fp_32_64* ns_per_tick);
+
 /* super early platform initialization, before almost everything */
 void platform_early_init(void);
 
@@ -6,38 +6,63 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
 #include <list.h>
+#include <platform.h>
 #include <trace.h>
 
+#include <kernel/atomic.h>
 #include <kernel/dpc.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/percpu.h>
 #include <kernel/spinlock.h>
+#include <lib/ktrace.h>
 #include <lk/init.h>
 
-static spin_lock_t dpc_lock = SPIN_LOCK_INITIAL_VALUE;
+// Each cpu's queues are guarded by that cpu's dpc_lock. Whether a dpc is
+// queued anywhere is tracked in the dpc itself, so that queueing on one cpu
+// doesn't need the lock of whichever cpu the dpc might already be on.
+
+static bool dpc_queue_locked(struct percpu* cpu, dpc_t* dpc) {
+    DEBUG_ASSERT(dpc->priority < DPC_PRIORITY_COUNT);
+
+    bool was_idle = true;
+    for (uint i = 0; i < DPC_PRIORITY_COUNT; i++) {
+        if (!list_is_empty(&cpu->dpc_list[i]))
+            was_idle = false;
+    }
+
+    dpc->queued_time = current_time();
+    list_add_tail(&cpu->dpc_list[dpc->priority], &dpc->node);
+
+    // the worker drains everything before it unsignals the event, so only
+    // the first dpc queued behind an empty list needs to wake it
+    return was_idle;
+}
 
 zx_status_t dpc_queue(dpc_t* dpc, bool reschedule) {
     DEBUG_ASSERT(dpc);
     DEBUG_ASSERT(dpc->func);
 
+    int expected = 0;
+    if (!atomic_cmpxchg(&dpc->queued, &expected, 1))
+        return ZX_ERR_ALREADY_EXISTS;
+
     // disable interrupts before finding lock
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
-
-    if (list_in_list(&dpc->node)) {
-        spin_unlock_irqrestore(&dpc_lock, state);
-        return ZX_ERR_ALREADY_EXISTS;
-    }
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     struct percpu* cpu = get_local_percpu();
 
-    // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&cpu->dpc_list, &dpc->node);
+    spin_lock(&cpu->dpc_lock);
+    bool wake = dpc_queue_locked(cpu, dpc);
+    spin_unlock(&cpu->dpc_lock);
 
-    spin_unlock_irqrestore(&dpc_lock, state);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    event_signal(&cpu->dpc_event, reschedule);
+    if (wake)
+        event_signal(&cpu->dpc_event, reschedule);
 
     return ZX_OK;
 }
@@ -46,21 +71,19 @@ zx_status_t dpc_queue_thread_locked(dpc_t* dpc) {
     DEBUG_ASSERT(dpc);
     DEBUG_ASSERT(dpc->func);
 
-    // interrupts are already disabled
-    spin_lock(&dpc_lock);
-
-    if (list_in_list(&dpc->node)) {
-        spin_unlock(&dpc_lock);
+    int expected = 0;
+    if (!atomic_cmpxchg(&dpc->queued, &expected, 1))
         return ZX_ERR_ALREADY_EXISTS;
-    }
 
+    // interrupts are already disabled
     struct percpu* cpu = get_local_percpu();
 
-    // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&cpu->dpc_list, &dpc->node);
-    event_signal_thread_locked(&cpu->dpc_event);
+    spin_lock(&cpu->dpc_lock);
+    bool wake = dpc_queue_locked(cpu, dpc);
+    spin_unlock(&cpu->dpc_lock);
 
-    spin_unlock(&dpc_lock);
+    if (wake)
+        event_signal_thread_locked(&cpu->dpc_event);
 
     return ZX_OK;
 }
@@ -69,23 +92,47 @@ void dpc_transition_off_cpu(uint cpu_id) {
     DEBUG_ASSERT(cpu_id < SMP_MAX_CPUS);
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     uint cur_cpu = arch_curr_cpu_num();
     DEBUG_ASSERT(cpu_id != cur_cpu);
 
-    list_node_t* src_list = &percpu[cpu_id].dpc_list;
-    list_node_t* dst_list = &percpu[cur_cpu].dpc_list;
+    // lower numbered cpu first
+    spin_lock(&percpu[MIN(cpu_id, cur_cpu)].dpc_lock);
+    spin_lock(&percpu[MAX(cpu_id, cur_cpu)].dpc_lock);
+
+    for (uint i = 0; i < DPC_PRIORITY_COUNT; i++) {
+        list_node_t* src_list = &percpu[cpu_id].dpc_list[i];
+        list_node_t* dst_list = &percpu[cur_cpu].dpc_list[i];
 
-    dpc_t* dpc;
-    while ((dpc = list_remove_head_type(src_list, dpc_t, node))) {
-        list_add_tail(dst_list, &dpc->node);
+        dpc_t* dpc;
+        while ((dpc = list_remove_head_type(src_list, dpc_t, node))) {
+            list_add_tail(dst_list, &dpc->node);
+        }
     }
-    spin_unlock_irqrestore(&dpc_lock, state);
+
+    spin_unlock(&percpu[MAX(cpu_id, cur_cpu)].dpc_lock);
+    spin_unlock(&percpu[MIN(cpu_id, cur_cpu)].dpc_lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     event_signal(&percpu[cur_cpu].dpc_event, false);
 }
 
+static void dpc_record_latency(struct percpu* cpu, uint cpu_num, const dpc_t* dpc,
+                               zx_time_t now) {
+    zx_duration_t latency = now - dpc->queued_time;
+
+    uint bucket = 0;
+    for (zx_duration_t us = latency / ZX_USEC(1); us != 0 && bucket < DPC_LATENCY_BUCKETS - 1;
+         us >>= 1) {
+        bucket++;
+    }
+    cpu->dpc_latency[dpc->priority][bucket]++;
+
+    ktrace(TAG_DPC_LATENCY, (uint32_t)latency, (uint32_t)(latency >> 32), dpc->priority,
+           cpu_num);
+}
+
 static int dpc_thread(void* arg) {
     dpc_t dpc_local;
 
@@ -93,8 +140,8 @@ static int dpc_thread(void* arg) {
     arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     struct percpu* cpu = get_local_percpu();
+    uint cpu_num = arch_curr_cpu_num();
     event_t* event = &cpu->dpc_event;
-    list_node_t* list = &cpu->dpc_list;
 
     arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
@@ -103,24 +150,33 @@ static int dpc_thread(void* arg) {
         __UNUSED zx_status_t err = event_wait(event);
         DEBUG_ASSERT(err == ZX_OK);
 
-        spin_lock_irqsave(&dpc_lock, state);
+        // run everything that is queued before waiting again, high priority first
+        for (;;) {
+            spin_lock_irqsave(&cpu->dpc_lock, state);
 
-        // pop a dpc off the list, make a local copy.
-        dpc_t* dpc = list_remove_head_type(list, dpc_t, node);
+            // pop a dpc off the list, make a local copy.
+            dpc_t* dpc = NULL;
+            for (uint i = DPC_PRIORITY_COUNT; i-- > 0 && !dpc;)
+                dpc = list_remove_head_type(&cpu->dpc_list[i], dpc_t, node);
 
-        // if the list is now empty, unsignal the event so we block until it is
-        if (!dpc) {
-            event_unsignal(event);
-            dpc_local.func = NULL;
-        } else {
-           dpc_local = *dpc;
-        }
+            // if the lists are now empty, unsignal the event so we block until they aren't
+            if (!dpc) {
+                event_unsignal(event);
+                spin_unlock_irqrestore(&cpu->dpc_lock, state);
+                break;
+            }
+
+            dpc_local = *dpc;
+            dpc_record_latency(cpu, cpu_num, dpc, current_time());
+
+            // after this the dpc may be queued again, or go away
+            atomic_store(&dpc->queued, 0);
 
-        spin_unlock_irqrestore(&dpc_lock, state);
+            spin_unlock_irqrestore(&cpu->dpc_lock, state);
 
-        // call the dpc
-        if (dpc_local.func)
+            // call the dpc
             dpc_local.func(&dpc_local);
+        }
     }
 
     return 0;
@@ -130,7 +186,9 @@ void dpc_init_for_cpu(void) {
     struct percpu* cpu = get_local_percpu();
     uint cpu_num = arch_curr_cpu_num();
 
-    list_initialize(&cpu->dpc_list);
+    for (uint i = 0; i < DPC_PRIORITY_COUNT; i++)
+        list_initialize(&cpu->dpc_list[i]);
+    cpu->dpc_lock = SPIN_LOCK_INITIAL_VALUE;
     event_init(&cpu->dpc_event, false, 0);
 
     char name[10];
@@ -146,3 +204,30 @@ static void dpc_init(unsigned int level) {
 }
 
 LK_INIT_HOOK(dpc, dpc_init, LK_INIT_LEVEL_THREADING);
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static int cmd_dpc(int argc, const cmd_args* argv, uint32_t flags) {
+    static const char* const names[DPC_PRIORITY_COUNT] = {"normal", "high"};
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_online(i))
+            continue;
+        for (uint p = 0; p < DPC_PRIORITY_COUNT; p++) {
+            printf("cpu %u %-6s latency:", i, names[p]);
+            for (uint b = 0; b < DPC_LATENCY_BUCKETS; b++)
+                printf(" %" PRIu64, percpu[i].dpc_latency[p][b]);
+            printf("\n");
+        }
+    }
+    printf("buckets: <1us, then powers of two up to %uus and beyond\n",
+           1u << (DPC_LATENCY_BUCKETS - 2));
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("dpc", "show dpc queueing latency histograms", &cmd_dpc)
+STATIC_COMMAND_END(dpc);
+
+#endif // WITH_LIB_CONSOLE
@@ -18,6 +18,7 @@
 #include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/percpu.h>
 #include <kernel/sched.h>
 #include <kernel/spinlock.h>
 #include <kernel/stats.h>
@@ -75,11 +76,31 @@ void mp_reschedule(mp_ipi_target_t target, cpu_mask_t mask, uint flags) {
 
         LTRACEF("local %u, post mask target now 0x%x\n", local_cpu, mask);
 
+        /* the caller is likely to be holding the thread lock that the target
+         * cpus need to reschedule, so leave the ipi to whoever drops it */
+        if (thread_lock_held()) {
+            percpu[local_cpu].pending_reschedule_ipis |= mask;
+            break;
+        }
+
         arch_mp_send_ipi(MP_IPI_TARGET_MASK, mask, MP_IPI_RESCHEDULE);
         break;
     }
 }
 
+void thread_lock_flush_ipis(void) {
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(!thread_lock_held());
+
+    struct percpu* c = get_local_percpu();
+    cpu_mask_t mask = c->pending_reschedule_ipis;
+    if (likely(mask == 0))
+        return;
+
+    c->pending_reschedule_ipis = 0;
+    arch_mp_send_ipi(MP_IPI_TARGET_MASK, mask, MP_IPI_RESCHEDULE);
+}
+
 struct mp_sync_context {
     mp_sync_task_t task;
     void* task_context;
@@ -228,6 +249,7 @@ static void mp_unplug_trampoline(void) {
     mp_set_curr_cpu_online(false);
 
     spin_unlock(&thread_lock);
+    thread_lock_flush_ipis();
 
     /* do *not* enable interrupts, we want this CPU to never receive another
      * interrupt */
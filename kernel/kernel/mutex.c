@@ -20,14 +20,26 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/mp.h>
+#include <kernel/percpu.h>
 #include <kernel/sched.h>
 #include <kernel/thread.h>
+#include <lib/counters.h>
 #include <lib/ktrace.h>
+#include <platform.h>
 #include <trace.h>
 #include <zircon/types.h>
 
 #define LOCAL_TRACE 0
 
+/* how long a contended acquire may spin before it blocks, and how many spins
+ * go by between checks that the holder is still running */
+#define MUTEX_SPIN_BUDGET ZX_USEC(20)
+#define MUTEX_SPIN_OWNER_CHECK_INTERVAL 64
+
+KCOUNTER(mutex_spin_acquired_count, "kernel.mutex.spin");
+KCOUNTER(mutex_blocked_count, "kernel.mutex.block");
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -59,6 +71,47 @@ void mutex_destroy(mutex_t* m) {
     wait_queue_destroy(&m->wait);
 }
 
+/* is |t| running on some cpu right now? |t| may already have been freed, so
+ * it is only compared against, never dereferenced */
+static bool mutex_owner_running(const thread_t* t) {
+    cpu_mask_t active = mp_get_active_mask();
+    for (cpu_num_t cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        if ((active & cpu_num_to_mask(cpu)) && percpu[cpu].running_thread == t)
+            return true;
+    }
+    return false;
+}
+
+/* Spin while the holder is running on another cpu, betting that it lets go
+ * sooner than blocking and being woken again would take. Gives up as soon as
+ * anyone is queued, since a contended release hands the mutex straight to the
+ * first waiter. */
+static bool mutex_spin(mutex_t* m, thread_t* ct) {
+    const zx_time_t deadline = current_time() + MUTEX_SPIN_BUDGET;
+    thread_t* checked_owner = NULL;
+
+    for (uint i = 1;; i++) {
+        uintptr_t oldval = mutex_val(m);
+        if (oldval == 0) {
+            if (atomic_cmpxchg_u64(&m->val, &oldval, (uintptr_t)ct))
+                return true;
+        } else if (oldval & MUTEX_FLAG_QUEUED) {
+            return false;
+        } else {
+            thread_t* owner = (thread_t*)oldval;
+            if (owner != checked_owner || (i % MUTEX_SPIN_OWNER_CHECK_INTERVAL) == 0) {
+                if (!mutex_owner_running(owner))
+                    return false;
+                checked_owner = owner;
+            }
+        }
+
+        if (current_time() >= deadline)
+            return false;
+        arch_spinloop_pause();
+    }
+}
+
 /**
  * @brief  Acquire the mutex
  */
@@ -68,6 +121,7 @@ void mutex_acquire(mutex_t* m) TA_NO_THREAD_SAFETY_ANALYSIS {
 
     thread_t* ct = get_current_thread();
     uintptr_t oldval;
+    bool spun = false;
 
 retry:
     // fast path: assume its unheld, try to grab it
@@ -83,7 +137,17 @@ retry:
               ct, ct->name, m);
 #endif
 
-    // we contended with someone else, will probably need to block
+    // we contended with someone else, try spinning once before blocking
+    if (!spun) {
+        spun = true;
+        if (mutex_spin(m, ct)) {
+            kcounter_add(mutex_spin_acquired_count, 1u);
+            if (m->cls)
+                kcounter_add(m->cls->spin_acquired, 1u);
+            return;
+        }
+    }
+
     THREAD_LOCK(state);
 
     // save the current state and check to see if it wasn't released in the interim
@@ -100,6 +164,10 @@ retry:
         goto retry;
     }
 
+    kcounter_add(mutex_blocked_count, 1u);
+    if (m->cls)
+        kcounter_add(m->cls->blocked, 1u);
+
     // we have signalled that we're blocking, so drop into the wait queue
     zx_status_t ret = wait_queue_block(&m->wait, ZX_TIME_INFINITE);
     if (unlikely(ret < ZX_OK)) {
@@ -167,7 +235,7 @@ static inline void mutex_release_internal(mutex_t* m, bool reschedule, bool thre
 
     // conditionally THREAD_UNLOCK
     if (!thread_lock_held)
-        spin_unlock_irqrestore(&thread_lock, state);
+        thread_unlock_irqrestore(state);
 }
 
 void mutex_release(mutex_t* m) TA_NO_THREAD_SAFETY_ANALYSIS {
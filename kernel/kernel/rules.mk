@@ -27,7 +27,9 @@ MODULE_SRCS := \
 	$(LOCAL_DIR)/mp.c \
 	$(LOCAL_DIR)/mutex.c \
 	$(LOCAL_DIR)/percpu.c \
+	$(LOCAL_DIR)/rwlock.c \
 	$(LOCAL_DIR)/sched.c \
+	$(LOCAL_DIR)/spinlock_stats.c \
 	$(LOCAL_DIR)/thread.c \
 	$(LOCAL_DIR)/timer.c \
 	$(LOCAL_DIR)/wait.c
@@ -0,0 +1,70 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/rwlock.h>
+
+#include <arch/ops.h>
+#include <assert.h>
+#include <debug.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+
+void rwlock_init(rwlock_t* l) {
+    *l = (rwlock_t)RWLOCK_INITIAL_VALUE(*l);
+}
+
+void rwlock_destroy(rwlock_t* l) {
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(atomic_load(&l->readers) == 0);
+
+    mutex_destroy(&l->writer);
+    event_destroy(&l->drained);
+    l->magic = 0;
+}
+
+void rwlock_acquire_read(rwlock_t* l) {
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    /* queue up behind any writer, but only for long enough to count ourselves in */
+    mutex_acquire(&l->writer);
+    atomic_add(&l->readers, 1);
+    mutex_release(&l->writer);
+}
+
+void rwlock_release_read(rwlock_t* l) {
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+
+    int old = atomic_add(&l->readers, -1);
+    DEBUG_ASSERT(old > 0);
+
+    /* the last reader out wakes a writer waiting for them to drain. both sides
+     * use sequentially consistent accesses, so at least one of us sees the other
+     */
+    if (old == 1 && atomic_load(&l->writer_waiting))
+        event_signal(&l->drained, true);
+}
+
+void rwlock_acquire_write(rwlock_t* l) {
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    /* holding the mutex keeps new readers out, then wait out the current ones.
+     * a spurious wakeup left over from a previous writer just loops again.
+     */
+    mutex_acquire(&l->writer);
+    atomic_store(&l->writer_waiting, 1);
+    while (atomic_load(&l->readers) != 0)
+        event_wait(&l->drained);
+    atomic_store(&l->writer_waiting, 0);
+}
+
+void rwlock_release_write(rwlock_t* l) {
+    DEBUG_ASSERT(l->magic == RWLOCK_MAGIC);
+    DEBUG_ASSERT(rwlock_is_write_held(l));
+
+    mutex_release(&l->writer);
+}
@@ -6,6 +6,7 @@
 // https://opensource.org/licenses/MIT
 #include <kernel/sched.h>
 
+#include <arch/mp.h>
 #include <assert.h>
 #include <debug.h>
 #include <err.h>
@@ -52,12 +53,43 @@
 /* threads get 10ms to run before they use up their time slice and the scheduler is invoked */
 #define THREAD_INITIAL_TIME_SLICE ZX_MSEC(10)
 
+/* fair-share threads split FAIR_TARGET_LATENCY between everything runnable on the
+ * cpu, in proportion to weight, but are never given less than FAIR_MIN_GRANULARITY */
+#define FAIR_TARGET_LATENCY ZX_MSEC(20)
+#define FAIR_MIN_GRANULARITY ZX_USEC(750)
+
+/* a fair-share thread waking from a sleep may be at most this far behind the
+ * cpu's fair clock, so that sleeping does not bank an unbounded amount of cpu */
+#define FAIR_WAKEUP_CREDIT (FAIR_TARGET_LATENCY / 2)
+
+/* deadline reservations are admitted to a cpu as long as the sum of their
+ * densities (capacity / relative deadline) stays under 90%, leaving the rest
+ * of the cpu for the priority bands. densities are in DEADLINE_UTIL_SCALE
+ * fixed point. */
+#define DEADLINE_UTIL_SCALE (1u << 20)
+#define DEADLINE_MAX_UTILIZATION (DEADLINE_UTIL_SCALE / 10 * 9)
+
+/* the preemption timer may fire up to 1/8th of a time slice late so that it
+ * can share an interrupt with another timer due shortly after it */
+#define PREEMPT_TIMER_SLACK(slice) ((slice) / 8)
+
 static bool local_migrate_if_needed(thread_t* curr_thread);
+static void sched_timer_tick(timer_t* t, zx_time_t now, void* arg);
+
+static inline bool thread_is_fair(const thread_t* t) {
+    return t->fair_weight != 0;
+}
+
+static inline bool thread_is_deadline(const thread_t* t) {
+    return t->deadline.capacity != 0;
+}
 
 /* compute the effective priority of a thread */
 static int effec_priority(const thread_t* t) {
     int ep = t->base_priority + t->priority_boost;
     DEBUG_ASSERT(ep >= LOWEST_PRIORITY && ep <= HIGHEST_PRIORITY);
+    if (t->inherited_priority > ep)
+        ep = t->inherited_priority;
     return ep;
 }
 
@@ -69,6 +101,11 @@ static void boost_thread(thread_t* t) {
     if (unlikely(thread_is_real_time_or_idle(t)))
         return;
 
+    /* fair-share and deadline threads are ordered by virtual runtime and
+     * deadline, not by boosting */
+    if (thread_is_fair(t) || thread_is_deadline(t))
+        return;
+
     if (t->priority_boost < MAX_PRIORITY_ADJ &&
         likely((t->base_priority + t->priority_boost) < HIGHEST_PRIORITY)) {
         t->priority_boost++;
@@ -86,6 +123,9 @@ static void deboost_thread(thread_t* t, bool quantum_expiration) {
     if (unlikely(thread_is_real_time_or_idle(t)))
         return;
 
+    if (thread_is_fair(t) || thread_is_deadline(t))
+        return;
+
     int boost_floor;
     if (quantum_expiration) {
         /* deboost into negative boost */
@@ -194,36 +234,332 @@ static cpu_mask_t find_cpu_mask(thread_t* t) {
     return mask;
 }
 
+/* a deadline thread has run for |delta| more, take it out of the budget. if that
+ * exhausts the budget, report the overrun and postpone the deadline by a period
+ * for each capacity's worth consumed */
+static void deadline_charge(thread_t* t, zx_duration_t delta) {
+    DEBUG_ASSERT(thread_is_deadline(t));
+
+    t->deadline.budget -= (int64_t)delta;
+    if (t->deadline.budget > 0)
+        return;
+
+    uint64_t overrun = (uint64_t)-t->deadline.budget;
+    ktrace(TAG_DEADLINE_OVERRUN, (uint32_t)t->user_tid, (uint32_t)overrun,
+           (uint32_t)(overrun >> 32), arch_curr_cpu_num());
+
+    while (t->deadline.budget <= 0) {
+        t->deadline.budget += (int64_t)t->deadline.capacity;
+        t->deadline.abs_deadline += t->deadline.period;
+    }
+}
+
+/* a deadline thread is waking up. if what's left of its budget could not be
+ * used by the current deadline without exceeding the reserved density, start a
+ * new period from now */
+static void deadline_wakeup(thread_t* t, zx_time_t now) {
+    if (!thread_is_deadline(t))
+        return;
+
+    DEBUG_ASSERT(t->deadline.budget > 0);
+    if (t->deadline.abs_deadline <= now ||
+        (zx_duration_t)t->deadline.budget * t->deadline.relative_deadline >
+            (t->deadline.abs_deadline - now) * t->deadline.capacity) {
+        t->deadline.abs_deadline = now + t->deadline.relative_deadline;
+        t->deadline.budget = (int64_t)t->deadline.capacity;
+    }
+}
+
+/* charge the part of the current run of |t| that hasn't been accounted for yet
+ * to its fair-share virtual runtime, scaled inversely by weight, and to its
+ * deadline budget */
+static void sched_charge(thread_t* t, zx_time_t now) {
+    zx_duration_t ran = now - t->last_started_running;
+    if (ran <= t->run_charged)
+        return;
+
+    zx_duration_t delta = ran - t->run_charged;
+    t->run_charged = ran;
+
+    if (thread_is_fair(t))
+        t->fair_vruntime += (int64_t)(delta * THREAD_FAIR_WEIGHT_DEFAULT / t->fair_weight);
+    if (thread_is_deadline(t))
+        deadline_charge(t, delta);
+}
+
+/* a fair-share thread is waking up, don't let it come back too far behind */
+static void fair_wakeup(thread_t* t) {
+    if (!thread_is_fair(t) || !is_valid_cpu_num(t->fair_cpu))
+        return;
+
+    int64_t floor = percpu[t->fair_cpu].fair_clock - (int64_t)FAIR_WAKEUP_CREDIT;
+    if (t->fair_vruntime < floor)
+        t->fair_vruntime = floor;
+}
+
+/* the time slice for a fair-share thread about to run on |cpu| */
+static zx_duration_t fair_time_slice(cpu_num_t cpu, const thread_t* t) {
+    zx_duration_t slice = FAIR_TARGET_LATENCY / (percpu[cpu].run_queue_len + 1);
+    slice = slice * t->fair_weight / THREAD_FAIR_WEIGHT_DEFAULT;
+    if (slice < FAIR_MIN_GRANULARITY)
+        return FAIR_MIN_GRANULARITY;
+    if (slice > FAIR_TARGET_LATENCY)
+        return FAIR_TARGET_LATENCY;
+    return slice;
+}
+
+/* insert a fair-share thread in virtual runtime order among the other fair-share
+ * threads in the queue, behind any with an equal virtual runtime */
+static void fair_insert_in_run_queue(cpu_num_t cpu, struct list_node* queue, thread_t* t) {
+    struct percpu* c = &percpu[cpu];
+
+    /* rebase the virtual runtime onto this cpu's fair clock if the thread moved */
+    if (t->fair_cpu != cpu) {
+        if (is_valid_cpu_num(t->fair_cpu)) {
+            t->fair_vruntime = t->fair_vruntime - percpu[t->fair_cpu].fair_clock + c->fair_clock;
+        } else {
+            t->fair_vruntime = c->fair_clock;
+        }
+        t->fair_cpu = cpu;
+    }
+
+    thread_t* pos;
+    list_for_every_entry (queue, pos, thread_t, queue_node) {
+        if (thread_is_fair(pos) && pos->fair_vruntime > t->fair_vruntime) {
+            list_add_before(&pos->queue_node, &t->queue_node);
+            return;
+        }
+    }
+    list_add_tail(queue, &t->queue_node);
+}
+
+/* arm the preemption timer on the local cpu for the end of the time slice of
+ * |t|, the thread that is running or about to run there. if nothing is waiting
+ * to run there is nothing to preempt |t| for, so leave the timer off until a
+ * thread gets queued. deadline threads always need it to enforce their budget. */
+static void sched_arm_preempt_timer(cpu_num_t cpu, thread_t* t) {
+    struct percpu* c = &percpu[cpu];
+
+    DEBUG_ASSERT(cpu == arch_curr_cpu_num());
+    DEBUG_ASSERT(!thread_is_real_time_or_idle(t));
+
+    if (c->run_queue_len == 0 && !thread_is_deadline(t)) {
+        if (!c->preempt_tickless) {
+            timer_cancel(&c->preempt_timer);
+            c->preempt_tickless = true;
+        }
+        return;
+    }
+
+    zx_time_t deadline = t->last_started_running + t->remaining_time_slice;
+    uint64_t slack = thread_is_deadline(t) ? 0 : PREEMPT_TIMER_SLACK(t->remaining_time_slice);
+
+    c->preempt_tickless = false;
+
+    /* use a special version of the timer set api that lets it reset an existing timer efficiently, given
+     * that we cannot possibly race with our own timer because interrupts are disabled.
+     */
+    timer_reset_local(&c->preempt_timer, deadline, TIMER_SLACK_LATE, slack, sched_timer_tick, NULL);
+}
+
+/* a thread was just queued on |cpu|, make sure whatever is running there can be
+ * preempted for it. remote cpus get a reschedule ipi from the caller, which
+ * rearms the timer from sched_resched_internal. */
+static void sched_end_tickless(cpu_num_t cpu) {
+    if (likely(!percpu[cpu].preempt_tickless) || cpu != arch_curr_cpu_num())
+        return;
+
+    thread_t* current_thread = get_current_thread();
+    if (current_thread->state == THREAD_RUNNING)
+        sched_arm_preempt_timer(cpu, current_thread);
+}
+
+/* insert a deadline thread in absolute deadline order, behind any with an
+ * equal deadline */
+static void deadline_insert(cpu_num_t cpu, thread_t* t) {
+    struct percpu* c = &percpu[cpu];
+
+    thread_t* pos;
+    list_for_every_entry (&c->deadline_queue, pos, thread_t, queue_node) {
+        if (pos->deadline.abs_deadline > t->deadline.abs_deadline) {
+            list_add_before(&pos->queue_node, &t->queue_node);
+            goto inserted;
+        }
+    }
+    list_add_tail(&c->deadline_queue, &t->queue_node);
+
+inserted:
+    c->run_queue_len++;
+    mp_set_cpu_busy(cpu);
+    sched_end_tickless(cpu);
+}
+
 /* run queue manipulation */
 static void insert_in_run_queue_head(cpu_num_t cpu, thread_t* t) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
+    if (thread_is_deadline(t)) {
+        deadline_insert(cpu, t);
+        return;
+    }
+
     int ep = effec_priority(t);
 
-    list_add_head(&percpu[cpu].run_queue[ep], &t->queue_node);
+    if (thread_is_fair(t)) {
+        fair_insert_in_run_queue(cpu, &percpu[cpu].run_queue[ep], t);
+    } else {
+        list_add_head(&percpu[cpu].run_queue[ep], &t->queue_node);
+    }
     percpu[cpu].run_queue_bitmap |= (1u << ep);
+    percpu[cpu].run_queue_len++;
 
     /* mark the cpu as busy since the run queue now has at least one item in it */
     mp_set_cpu_busy(cpu);
+    sched_end_tickless(cpu);
 }
 
 static void insert_in_run_queue_tail(cpu_num_t cpu, thread_t* t) {
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
 
+    if (thread_is_deadline(t)) {
+        deadline_insert(cpu, t);
+        return;
+    }
+
     int ep = effec_priority(t);
 
-    list_add_tail(&percpu[cpu].run_queue[ep], &t->queue_node);
+    if (thread_is_fair(t)) {
+        fair_insert_in_run_queue(cpu, &percpu[cpu].run_queue[ep], t);
+    } else {
+        list_add_tail(&percpu[cpu].run_queue[ep], &t->queue_node);
+    }
     percpu[cpu].run_queue_bitmap |= (1u << ep);
+    percpu[cpu].run_queue_len++;
 
     /* mark the cpu as busy since the run queue now has at least one item in it */
     mp_set_cpu_busy(cpu);
+    sched_end_tickless(cpu);
+}
+
+/* pull a thread out of the middle of the run queue of the cpu it is waiting on */
+static void remove_from_run_queue(cpu_num_t cpu, thread_t* t) {
+    DEBUG_ASSERT(list_in_list(&t->queue_node));
+
+    list_delete(&t->queue_node);
+
+    struct percpu* c = &percpu[cpu];
+    if (!thread_is_deadline(t)) {
+        int pri = effec_priority(t);
+        if (list_is_empty(&c->run_queue[pri])) {
+            c->run_queue_bitmap &= ~(1u << pri);
+        }
+    }
+    DEBUG_ASSERT(c->run_queue_len > 0);
+    c->run_queue_len--;
+}
+
+/* find a thread in |victim|'s run queues that is allowed to run on |cpu|.
+ * queues are searched from the highest priority down, and each queue from the
+ * tail, since the thread at the tail is the one that would wait the longest and
+ * is the least likely to still have state in the victim's caches.
+ */
+static thread_t* find_stealable_thread(cpu_num_t victim, cpu_num_t cpu) {
+    struct percpu* c = &percpu[victim];
+    cpu_mask_t cpu_mask = cpu_num_to_mask(cpu);
+
+    uint32_t bitmap = c->run_queue_bitmap;
+    while (bitmap) {
+        uint pri = HIGHEST_PRIORITY - __builtin_clz(bitmap) -
+                   (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+        bitmap &= ~(1u << pri);
+
+        thread_t* t = list_peek_tail_type(&c->run_queue[pri], thread_t, queue_node);
+        while (t) {
+            DEBUG_ASSERT(t->state == THREAD_READY);
+            if (t->cpu_affinity & cpu_mask) {
+                return t;
+            }
+            t = list_prev_type(&c->run_queue[pri], &t->queue_node, thread_t, queue_node);
+        }
+    }
+
+    return NULL;
+}
+
+/* steal a thread from the cpu in |candidates| with the deepest run queue, as long
+ * as it has at least |min_len| threads waiting */
+static thread_t* steal_from_busiest(cpu_num_t cpu, cpu_mask_t candidates, uint32_t min_len) {
+    while (candidates) {
+        cpu_num_t busiest = INVALID_CPU;
+        uint32_t busiest_len = min_len - 1;
+        for (cpu_mask_t mask = candidates; mask != 0; mask &= mask - 1) {
+            cpu_num_t i = lowest_cpu_set(mask);
+            if (percpu[i].run_queue_len > busiest_len) {
+                busiest = i;
+                busiest_len = percpu[i].run_queue_len;
+            }
+        }
+        if (busiest == INVALID_CPU)
+            return NULL;
+
+        thread_t* t = find_stealable_thread(busiest, cpu);
+        if (t) {
+            remove_from_run_queue(busiest, t);
+            return t;
+        }
+
+        /* nothing in that queue can run here, try the next busiest */
+        candidates &= ~cpu_num_to_mask(busiest);
+    }
+
+    return NULL;
+}
+
+/* the local run queue has drained, so try to pull a ready thread from another cpu
+ * before going idle. cpus that share a last level cache with this one are searched
+ * first, since migrating between them is cheap. a cpu that does not share a cache
+ * is only stolen from if it has more than one thread waiting, so a single waiter
+ * gets to run where its cache state is.
+ */
+static void sched_steal_work(cpu_num_t cpu) {
+    DEBUG_ASSERT(percpu[cpu].run_queue_len == 0);
+
+    cpu_mask_t candidates = mp_get_active_mask() & ~cpu_num_to_mask(cpu);
+    if (candidates == 0)
+        return;
+
+    cpu_mask_t siblings = candidates & arch_mp_get_cache_siblings(cpu);
+    thread_t* t = steal_from_busiest(cpu, siblings, 1);
+    if (!t)
+        t = steal_from_busiest(cpu, candidates & ~siblings, 2);
+
+    if (!t) {
+        CPU_STATS_INC(failed_steals);
+        return;
+    }
+
+    LOCAL_KTRACE2("sched_steal", (uint32_t)t->user_tid, t->curr_cpu);
+
+    CPU_STATS_INC(steals);
+    t->curr_cpu = cpu;
+    insert_in_run_queue_head(cpu, t);
 }
 
 static thread_t* sched_get_top_thread(cpu_num_t cpu) {
+    /* deadline threads with budget left run ahead of everything else, earliest
+     * deadline first */
+    struct percpu* c = &percpu[cpu];
+    if (unlikely(!list_is_empty(&c->deadline_queue))) {
+        thread_t* newthread = list_remove_head_type(&c->deadline_queue, thread_t, queue_node);
+        DEBUG_ASSERT(newthread->curr_cpu == cpu);
+        DEBUG_ASSERT(c->run_queue_len > 0);
+        c->run_queue_len--;
+        return newthread;
+    }
+
     /* pop the head of the highest priority queue with any threads
      * queued up on the passed in cpu.
      */
-    struct percpu* c = &percpu[cpu];
     if (likely(c->run_queue_bitmap)) {
         uint highest_queue = HIGHEST_PRIORITY - __builtin_clz(c->run_queue_bitmap) -
                              (sizeof(c->run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
@@ -238,6 +574,8 @@ static thread_t* sched_get_top_thread(cpu_num_t cpu) {
 
         if (list_is_empty(&c->run_queue[highest_queue]))
             c->run_queue_bitmap &= ~(1u << highest_queue);
+        DEBUG_ASSERT(c->run_queue_len > 0);
+        c->run_queue_len--;
 
         LOCAL_KTRACE2("sched_get_top", newthread->priority_boost, newthread->base_priority);
 
@@ -262,10 +600,55 @@ void sched_block(void) {
     sched_resched_internal();
 }
 
+/* if the current thread asked to hand off its cpu to the next thread it wakes,
+ * queue |t| on this cpu, passing on what is left of the current thread's time
+ * slice so that it goes to the head of its band. fair threads keep their own
+ * slices, which is what keeps their shares fair. */
+static bool sched_try_handoff(thread_t* t) {
+    thread_t* current_thread = get_current_thread();
+    cpu_num_t cpu = arch_curr_cpu_num();
+
+    if (likely(!current_thread->wakeup_handoff))
+        return false;
+    if (arch_in_int_handler() || thread_is_deadline(t) ||
+        !(t->cpu_affinity & cpu_num_to_mask(cpu)) || !mp_is_cpu_active(cpu))
+        return false;
+
+    /* only the first thread woken gets the cpu */
+    current_thread->wakeup_handoff = false;
+
+    if (!thread_is_fair(t) && !thread_is_real_time_or_idle(current_thread)) {
+        zx_duration_t ran = current_time() - current_thread->last_started_running;
+        zx_duration_t left = current_thread->remaining_time_slice -
+                             MIN(ran, current_thread->remaining_time_slice);
+        if (left > t->remaining_time_slice)
+            t->remaining_time_slice = left;
+
+        /* as with sched_yield(), the current thread goes behind |t| if it
+         * reschedules rather than blocking */
+        current_thread->remaining_time_slice = 0;
+    }
+
+    LOCAL_KTRACE2("sched handoff", (uint32_t)current_thread->user_tid, (uint32_t)t->user_tid);
+
+    t->curr_cpu = cpu;
+    if (t->remaining_time_slice > 0) {
+        insert_in_run_queue_head(cpu, t);
+    } else {
+        insert_in_run_queue_tail(cpu, t);
+    }
+    return true;
+}
+
 /* find a cpu to run the thread on, put it in the run queue for that cpu, and accumulate a list
  * of cpus we'll need to reschedule, including the local cpu.
  */
 static void find_cpu_and_insert(thread_t* t, bool* local_resched, cpu_mask_t* accum_cpu_mask) {
+    if (sched_try_handoff(t)) {
+        *local_resched = true;
+        return;
+    }
+
     /* find a core to run it on */
     cpu_mask_t cpu = find_cpu_mask(t);
     cpu_num_t cpu_num;
@@ -296,6 +679,8 @@ bool sched_unblock(thread_t* t) {
 
     /* thread is being woken up, boost its priority */
     boost_thread(t);
+    fair_wakeup(t);
+    deadline_wakeup(t, current_time());
 
     /* stuff the new thread in the run queue */
     t->state = THREAD_READY;
@@ -304,8 +689,10 @@ bool sched_unblock(thread_t* t) {
     cpu_mask_t mask = 0;
     find_cpu_and_insert(t, &local_resched, &mask);
 
+    /* a deadline thread gets to interrupt real time threads */
     if (mask)
-        mp_reschedule(MP_IPI_TARGET_MASK, mask, 0);
+        mp_reschedule(MP_IPI_TARGET_MASK, mask,
+                      thread_is_deadline(t) ? MP_RESCHEDULE_FLAG_REALTIME : 0);
     return local_resched;
 }
 
@@ -318,6 +705,8 @@ bool sched_unblock_list(struct list_node* list) {
     /* pop the list of threads and shove into the scheduler */
     bool local_resched = false;
     cpu_mask_t accum_cpu_mask = 0;
+    uint reschedule_flags = 0;
+    zx_time_t now = current_time();
     thread_t* t;
     while ((t = list_remove_tail_type(list, thread_t, queue_node))) {
         DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -325,6 +714,10 @@ bool sched_unblock_list(struct list_node* list) {
 
         /* thread is being woken up, boost its priority */
         boost_thread(t);
+        fair_wakeup(t);
+        deadline_wakeup(t, now);
+        if (thread_is_deadline(t))
+            reschedule_flags = MP_RESCHEDULE_FLAG_REALTIME;
 
         /* stuff the new thread in the run queue */
         t->state = THREAD_READY;
@@ -332,7 +725,7 @@ bool sched_unblock_list(struct list_node* list) {
     }
 
     if (accum_cpu_mask)
-        mp_reschedule(MP_IPI_TARGET_MASK, accum_cpu_mask, 0);
+        mp_reschedule(MP_IPI_TARGET_MASK, accum_cpu_mask, reschedule_flags);
 
     return local_resched;
 }
@@ -365,6 +758,7 @@ void sched_yield(void) {
     /* consume the rest of the time slice, deboost ourself, and go to the end of a queue */
     current_thread->remaining_time_slice = 0;
     deboost_thread(current_thread, false);
+    sched_charge(current_thread, current_time());
 
     current_thread->state = THREAD_READY;
 
@@ -394,6 +788,7 @@ void sched_preempt(void) {
             /* if we're out of quantum, deboost the thread and put it at the tail of a queue */
             deboost_thread(current_thread, true);
         }
+        sched_charge(current_thread, current_time());
 
         if (local_migrate_if_needed(current_thread))
             return;
@@ -431,6 +826,7 @@ void sched_reschedule(void) {
 
         /* deboost the current thread */
         deboost_thread(current_thread, false);
+        sched_charge(current_thread, current_time());
 
         if (local_migrate_if_needed(current_thread))
             return;
@@ -528,15 +924,8 @@ void sched_migrate(thread_t* t) {
 
         // it's sitting in a run queue somewhere, so pull it out of that one and find a new home
         DEBUG_ASSERT_MSG(list_in_list(&t->queue_node), "thread %p name %s curr_cpu %u\n", t, t->name, t->curr_cpu);
-        list_delete(&t->queue_node);
-
         DEBUG_ASSERT(is_valid_cpu_num(t->curr_cpu));
-
-        struct percpu* c = &percpu[t->curr_cpu];
-        int pri = effec_priority(t);
-        if (list_is_empty(&c->run_queue[pri])) {
-            c->run_queue_bitmap &= ~(1u << pri);
-        }
+        remove_from_run_queue(t->curr_cpu, t);
 
         find_cpu_and_insert(t, &local_resched, &accum_cpu_mask);
         break;
@@ -554,6 +943,147 @@ void sched_migrate(thread_t* t) {
     }
 }
 
+/* change the fair-share weight of a thread, requeueing it if it is waiting to run */
+void sched_set_fair_weight(thread_t* t, uint32_t weight) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(!thread_is_idle(t));
+
+    bool queued = (t->state == THREAD_READY);
+    if (queued)
+        remove_from_run_queue(t->curr_cpu, t);
+
+    if (t->state == THREAD_RUNNING)
+        sched_charge(t, current_time());
+
+    if (!thread_is_fair(t) && weight != 0) {
+        /* joining the fair class: drop any boost and start at the cpu's fair clock */
+        t->priority_boost = 0;
+        t->fair_cpu = INVALID_CPU;
+        t->fair_vruntime = 0;
+    }
+    t->fair_weight = weight;
+
+    if (queued)
+        insert_in_run_queue_tail(t->curr_cpu, t);
+}
+
+/* recompute the priority a thread inherits from the threads lending to it,
+ * requeueing it if it is waiting to run. the change is passed along the chain
+ * of owners, since an owner may itself be blocked lending to another thread. */
+void sched_update_inherited_priority(thread_t* t) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    while (t) {
+        int priority = -1;
+        thread_t* lender;
+        list_for_every_entry (&t->pi_lenders, lender, thread_t, pi_node) {
+            int ep = effec_priority(lender);
+            if (ep > priority)
+                priority = ep;
+        }
+        if (priority == t->inherited_priority)
+            return;
+
+        bool queued = (t->state == THREAD_READY);
+        if (queued)
+            remove_from_run_queue(t->curr_cpu, t);
+        t->inherited_priority = priority;
+        if (queued) {
+            insert_in_run_queue_head(t->curr_cpu, t);
+            if (t->curr_cpu != arch_curr_cpu_num())
+                mp_reschedule(MP_IPI_TARGET_MASK, cpu_num_to_mask(t->curr_cpu), 0);
+        }
+
+        t = t->pi_owner;
+    }
+}
+
+/* pick the cpu in |affinity| with the least deadline utilization that can
+ * still fit a reservation of |density|, INVALID_CPU if there is none */
+static cpu_num_t deadline_admit(cpu_mask_t affinity, uint32_t density) {
+    cpu_num_t best = INVALID_CPU;
+    for (cpu_mask_t mask = affinity & mp_get_active_mask(); mask != 0; mask &= mask - 1) {
+        cpu_num_t i = lowest_cpu_set(mask);
+        uint32_t util = percpu[i].deadline_utilization;
+        if (util + density > DEADLINE_MAX_UTILIZATION)
+            continue;
+        if (best == INVALID_CPU || util < percpu[best].deadline_utilization)
+            best = i;
+    }
+    return best;
+}
+
+/* give a thread a (capacity, deadline, period) cpu reservation, or take it
+ * away if |capacity| is 0. the thread is pinned to the cpu its reservation
+ * was admitted to until the reservation ends. */
+zx_status_t sched_set_deadline(thread_t* t, zx_duration_t capacity,
+                               zx_duration_t relative_deadline, zx_duration_t period) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(!thread_is_idle(t));
+    DEBUG_ASSERT(capacity == 0 || (capacity <= relative_deadline && relative_deadline <= period));
+
+    zx_time_t now = current_time();
+    bool was_deadline = thread_is_deadline(t);
+    cpu_mask_t affinity = was_deadline ? t->deadline.saved_affinity : t->cpu_affinity;
+
+    /* release the old reservation while looking for room for the new one */
+    uint32_t old_density = 0;
+    cpu_num_t old_cpu = INVALID_CPU;
+    if (was_deadline) {
+        old_density = (uint32_t)(t->deadline.capacity * DEADLINE_UTIL_SCALE /
+                                 t->deadline.relative_deadline);
+        old_cpu = lowest_cpu_set(t->cpu_affinity);
+        percpu[old_cpu].deadline_utilization -= old_density;
+    }
+
+    cpu_num_t cpu = INVALID_CPU;
+    uint32_t density = 0;
+    if (capacity != 0) {
+        density = (uint32_t)(capacity * DEADLINE_UTIL_SCALE / relative_deadline);
+        cpu = deadline_admit(affinity, density);
+        if (cpu == INVALID_CPU) {
+            if (was_deadline)
+                percpu[old_cpu].deadline_utilization += old_density;
+            return ZX_ERR_NO_RESOURCES;
+        }
+        percpu[cpu].deadline_utilization += density;
+    }
+
+    /* settle the accounting of the current run before the parameters change */
+    bool queued = (t->state == THREAD_READY);
+    if (queued)
+        remove_from_run_queue(t->curr_cpu, t);
+    if (t->state == THREAD_RUNNING)
+        sched_charge(t, now);
+
+    if (capacity != 0) {
+        t->deadline.capacity = capacity;
+        t->deadline.relative_deadline = relative_deadline;
+        t->deadline.period = period;
+        t->deadline.abs_deadline = now + relative_deadline;
+        t->deadline.budget = (int64_t)capacity;
+        t->deadline.saved_affinity = affinity;
+        t->priority_boost = 0;
+        t->cpu_affinity = cpu_num_to_mask(cpu);
+    } else {
+        t->deadline.capacity = 0;
+        t->cpu_affinity = affinity;
+    }
+
+    bool local_resched = false;
+    cpu_mask_t accum_cpu_mask = 0;
+    if (queued) {
+        find_cpu_and_insert(t, &local_resched, &accum_cpu_mask);
+        if (accum_cpu_mask)
+            mp_reschedule(MP_IPI_TARGET_MASK, accum_cpu_mask, MP_RESCHEDULE_FLAG_REALTIME);
+    } else if (t->state == THREAD_RUNNING) {
+        /* move it to the admitted cpu if it's running somewhere else */
+        sched_migrate(t);
+    }
+
+    return ZX_OK;
+}
+
 /* preemption timer that is set whenever a thread is scheduled */
 static void sched_timer_tick(timer_t* t, zx_time_t now, void* arg) {
     /* if the preemption timer went off on the idle or a real time thread, ignore it */
@@ -611,6 +1141,10 @@ void sched_resched_internal(void) {
 
     CPU_STATS_INC(reschedules);
 
+    /* if there is nothing left to run locally, look for work on busier cpus */
+    if (percpu[cpu].run_queue_len == 0 && mp_is_cpu_active(cpu))
+        sched_steal_work(cpu);
+
     /* pick a new thread to run */
     thread_t* newthread = sched_get_top_thread(cpu);
 
@@ -623,9 +1157,13 @@ void sched_resched_internal(void) {
     LOCAL_KTRACE2("resched old pri", (uint32_t)oldthread->user_tid, effec_priority(oldthread));
     LOCAL_KTRACE2("resched new pri", (uint32_t)newthread->user_tid, effec_priority(newthread));
 
-    /* if it's the same thread as we're already running, exit */
-    if (newthread == oldthread)
+    /* if it's the same thread as we're already running, exit. if it had the cpu
+     * to itself and now has company, start preempting it again. */
+    if (newthread == oldthread) {
+        if (percpu[cpu].preempt_tickless && percpu[cpu].run_queue_len > 0)
+            sched_arm_preempt_timer(cpu, newthread);
         return;
+    }
 
     zx_time_t now = current_time();
 
@@ -634,13 +1172,26 @@ void sched_resched_internal(void) {
     zx_duration_t old_runtime = now - oldthread->last_started_running;
     oldthread->runtime_ns += old_runtime;
     oldthread->remaining_time_slice -= MIN(old_runtime, oldthread->remaining_time_slice);
-
-    /* set up quantum for the new thread if it was consumed */
-    if (newthread->remaining_time_slice == 0) {
-        newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
+    sched_charge(oldthread, now);
+
+    /* set up quantum for the new thread if it was consumed. deadline threads
+     * always get to run until their budget runs out. */
+    if (thread_is_deadline(newthread)) {
+        newthread->remaining_time_slice = (zx_duration_t)newthread->deadline.budget;
+    } else if (newthread->remaining_time_slice == 0) {
+        if (thread_is_fair(newthread)) {
+            newthread->remaining_time_slice = fair_time_slice(cpu, newthread);
+        } else {
+            newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
+        }
     }
 
+    /* advance the cpu's fair clock to the thread at the front of the fair order */
+    if (thread_is_fair(newthread) && newthread->fair_vruntime > percpu[cpu].fair_clock)
+        percpu[cpu].fair_clock = newthread->fair_vruntime;
+
     newthread->last_started_running = now;
+    newthread->run_charged = 0;
 
     /* mark the cpu ownership of the threads */
     if (oldthread->state != THREAD_READY)
@@ -673,6 +1224,7 @@ void sched_resched_internal(void) {
            (uint32_t)(uintptr_t)oldthread, (uint32_t)(uintptr_t)newthread);
 
     if (thread_is_real_time_or_idle(newthread)) {
+        percpu[cpu].preempt_tickless = false;
         if (!thread_is_real_time_or_idle(oldthread)) {
             /* if we're switching from a non real time to a real time, cancel
              * the preemption timer. */
@@ -688,10 +1240,7 @@ void sched_resched_internal(void) {
         /* make sure the time slice is reasonable */
         DEBUG_ASSERT(newthread->remaining_time_slice > 0 && newthread->remaining_time_slice < ZX_SEC(1));
 
-        /* use a special version of the timer set api that lets it reset an existing timer efficiently, given
-         * that we cannot possibly race with our own timer because interrupts are disabled.
-         */
-        timer_reset_oneshot_local(&percpu[cpu].preempt_timer, now + newthread->remaining_time_slice, sched_timer_tick, NULL);
+        sched_arm_preempt_timer(cpu, newthread);
     }
 
     /* set some optional target debug leds */
@@ -727,6 +1276,8 @@ void sched_resched_internal(void) {
 #endif
     }
 
+    percpu[cpu].running_thread = newthread;
+
     /* see if we need to swap mmu context */
     if (newthread->aspace != oldthread->aspace) {
         vmm_context_switch(oldthread->aspace, newthread->aspace);
@@ -741,4 +1292,7 @@ void sched_init_early(void) {
     for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
         for (unsigned int i = 0; i < NUM_PRIORITIES; i++)
             list_initialize(&percpu[cpu].run_queue[i]);
+
+    for (unsigned int cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        list_initialize(&percpu[cpu].deadline_queue);
 }
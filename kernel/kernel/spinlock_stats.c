@@ -0,0 +1,89 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <kernel/spinlock.h>
+
+#if WITH_SPINLOCK_STATS
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Contention for each call site that had to wait for a spin lock, in a
+// small open addressed table.  Entries are claimed with a compare and swap
+// on |caller| and never freed, since taking a lock here is not an option.
+#define CALLER_TABLE_SIZE 256
+
+struct caller_stats {
+    uintptr_t caller;
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t max_cycles;
+};
+
+static struct caller_stats callers[CALLER_TABLE_SIZE];
+static uint64_t dropped;
+
+void spin_lock_contended(void* caller, uint64_t cycles) {
+    uintptr_t pc = (uintptr_t)caller;
+    size_t hash = (pc >> 2) * 0x9E3779B1u;
+
+    for (size_t i = 0; i < CALLER_TABLE_SIZE; i++) {
+        struct caller_stats* s = &callers[(hash + i) % CALLER_TABLE_SIZE];
+        uintptr_t cur = __atomic_load_n(&s->caller, __ATOMIC_RELAXED);
+        if (cur == 0) {
+            if (!__atomic_compare_exchange_n(&s->caller, &cur, pc, false,
+                                             __ATOMIC_RELAXED, __ATOMIC_RELAXED) &&
+                cur != pc)
+                continue;
+        } else if (cur != pc) {
+            continue;
+        }
+
+        __atomic_fetch_add(&s->count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->cycles, cycles, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&s->max_cycles, __ATOMIC_RELAXED);
+        while (cycles > max &&
+               !__atomic_compare_exchange_n(&s->max_cycles, &max, cycles, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+        return;
+    }
+
+    __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+}
+
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+
+static int cmd_spinstats(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+        memset(callers, 0, sizeof(callers));
+        dropped = 0;
+        return 0;
+    }
+
+    printf("%18s %12s %16s %12s %12s\n", "caller", "waits", "cycles", "avg", "max");
+    for (size_t i = 0; i < CALLER_TABLE_SIZE; i++) {
+        const struct caller_stats* s = &callers[i];
+        if (s->caller == 0 || s->count == 0)
+            continue;
+        printf("%#18" PRIxPTR " %12" PRIu64 " %16" PRIu64 " %12" PRIu64 " %12" PRIu64 "\n",
+               s->caller, s->count, s->cycles, s->cycles / s->count, s->max_cycles);
+    }
+    if (dropped)
+        printf("%" PRIu64 " waits from call sites past the first %d not counted\n",
+               dropped, CALLER_TABLE_SIZE);
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("spinstats", "spin lock contention by call site, or reset", &cmd_spinstats)
+STATIC_COMMAND_END(spinstats);
+
+#endif // WITH_LIB_CONSOLE
+
+#endif // WITH_SPINLOCK_STATS
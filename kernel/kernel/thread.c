@@ -73,6 +73,8 @@ static void init_thread_struct(thread_t* t, const char* name) {
     t->magic = THREAD_MAGIC;
     strlcpy(t->name, name, sizeof(t->name));
     wait_queue_init(&t->retcode_wait_queue);
+    t->inherited_priority = -1;
+    list_initialize(&t->pi_lenders);
 }
 
 static void initial_thread_func(void) TA_REQ(thread_lock) __NO_RETURN;
@@ -81,6 +83,7 @@ static void initial_thread_func(void) {
 
     /* release the thread lock that was implicitly held across the reschedule */
     spin_unlock(&thread_lock);
+    thread_lock_flush_ipis();
     arch_enable_ints();
 
     thread_t* ct = get_current_thread();
@@ -261,6 +264,7 @@ zx_status_t thread_set_real_time(thread_t* t) {
     if (t == get_current_thread()) {
         /* if we're currently running, cancel the preemption timer. */
         timer_cancel(&percpu[arch_curr_cpu_num()].preempt_timer);
+        percpu[arch_curr_cpu_num()].preempt_tickless = false;
     }
     t->flags |= THREAD_FLAG_REAL_TIME;
     THREAD_UNLOCK(state);
@@ -268,6 +272,128 @@ zx_status_t thread_set_real_time(thread_t* t) {
     return ZX_OK;
 }
 
+/**
+ * @brief  Opt a thread in or out of weighted fair-share scheduling
+ *
+ * Fair-share threads are ordered by virtual runtime within their priority
+ * band, with virtual runtime advancing more slowly for higher weights.
+ *
+ * @param t  Thread to change
+ * @param weight  Relative share of the cpu, THREAD_FAIR_WEIGHT_DEFAULT being
+ *                nominal, or 0 to return to round robin scheduling
+ *
+ * @return ZX_OK on success.
+ */
+zx_status_t thread_set_fair_weight(thread_t* t, uint32_t weight) {
+    if (!t)
+        return ZX_ERR_INVALID_ARGS;
+    if (weight > THREAD_FAIR_WEIGHT_MAX)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    THREAD_LOCK(state);
+    if (thread_is_real_time_or_idle(t) || t->deadline.capacity != 0) {
+        THREAD_UNLOCK(state);
+        return ZX_ERR_BAD_STATE;
+    }
+    sched_set_fair_weight(t, weight);
+    THREAD_UNLOCK(state);
+
+    return ZX_OK;
+}
+
+/**
+ * @brief  Lend the current thread's priority to another thread
+ *
+ * Used while the current thread blocks on a resource held by |owner|, so
+ * that |owner| cannot be starved by threads of lower priority than the one
+ * waiting for it.  Must be called with the thread lock held, and undone with
+ * thread_reclaim_priority() once the current thread stops waiting.
+ *
+ * Nothing is lent to a thread which has not started or has exited, or if
+ * lending would make a cycle of owners.
+ */
+void thread_lend_priority(thread_t* owner) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(owner->magic == THREAD_MAGIC);
+
+    thread_t* current_thread = get_current_thread();
+    DEBUG_ASSERT(current_thread->pi_owner == NULL);
+
+    if (owner->state == THREAD_INITIAL || owner->state == THREAD_DEATH)
+        return;
+    for (thread_t* t = owner; t; t = t->pi_owner) {
+        if (t == current_thread)
+            return;
+    }
+
+    current_thread->pi_owner = owner;
+    list_add_tail(&owner->pi_lenders, &current_thread->pi_node);
+    sched_update_inherited_priority(owner);
+}
+
+/**
+ * @brief  Take back the priority lent by thread_lend_priority()
+ *
+ * Must be called with the thread lock held.
+ */
+void thread_reclaim_priority(void) {
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    thread_t* current_thread = get_current_thread();
+    thread_t* owner = current_thread->pi_owner;
+    if (!owner)
+        return;
+
+    list_delete(&current_thread->pi_node);
+    current_thread->pi_owner = NULL;
+    sched_update_inherited_priority(owner);
+}
+
+/**
+ * @brief  Give a thread a guaranteed cpu reservation
+ *
+ * The thread is guaranteed |capacity| of cpu time within |relative_deadline|
+ * of the start of every |period|, scheduled earliest deadline first ahead of
+ * all priority based threads. Reservations are admitted to a single cpu in
+ * the thread's affinity mask, and the thread is pinned there while the
+ * reservation lasts. A thread that runs past its capacity within a period
+ * has its deadline postponed, and the overrun is reported through ktrace.
+ *
+ * @param t  Thread to change
+ * @param capacity  Cpu time per period, or 0 to end the reservation
+ * @param relative_deadline  Time from the start of the period by which the
+ *                           capacity must be delivered
+ * @param period  Reservation period
+ *
+ * @return ZX_OK on success, ZX_ERR_NO_RESOURCES if no cpu has room for the
+ * reservation.
+ */
+zx_status_t thread_set_deadline(thread_t* t, zx_duration_t capacity,
+                                zx_duration_t relative_deadline, zx_duration_t period) {
+    if (!t)
+        return ZX_ERR_INVALID_ARGS;
+    if (capacity != 0) {
+        if (capacity > relative_deadline || relative_deadline > period)
+            return ZX_ERR_INVALID_ARGS;
+        if (period < THREAD_DEADLINE_MIN_PERIOD || period > THREAD_DEADLINE_MAX_PERIOD)
+            return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
+
+    THREAD_LOCK(state);
+    if (thread_is_real_time_or_idle(t) || t->fair_weight != 0 || t->state == THREAD_DEATH) {
+        THREAD_UNLOCK(state);
+        return ZX_ERR_BAD_STATE;
+    }
+    zx_status_t status = sched_set_deadline(t, capacity, relative_deadline, period);
+    THREAD_UNLOCK(state);
+
+    return status;
+}
+
 /**
  * @brief  Make a suspended thread executable.
  *
@@ -488,7 +614,16 @@ __NO_RETURN static void thread_exit_locked(thread_t* current_thread, int retcode
     /* must be put at top scope in this function to force the compiler to keep it from
      * reusing the stack before the function exits
      */
-    dpc_t free_dpc;
+    dpc_t free_dpc = DPC_INITIAL_VALUE;
+
+    /* give back any cpu reservation */
+    if (current_thread->deadline.capacity != 0)
+        sched_set_deadline(current_thread, 0, 0, 0);
+
+    /* threads still blocked on futexes we owned keep waiting, but stop lending */
+    thread_t* lender;
+    while ((lender = list_remove_head_type(&current_thread->pi_lenders, thread_t, pi_node)))
+        lender->pi_owner = NULL;
 
     /* enter the dead state */
     current_thread->state = THREAD_DEATH;
@@ -843,6 +978,7 @@ static void thread_sleep_handler(timer_t* timer, zx_time_t now,
 
     if (t->state != THREAD_SLEEPING) {
         spin_unlock(&thread_lock);
+        thread_lock_flush_ipis();
         return;
     }
 
@@ -853,6 +989,7 @@ static void thread_sleep_handler(timer_t* timer, zx_time_t now,
         sched_reschedule();
 
     spin_unlock(&thread_lock);
+    thread_lock_flush_ipis();
 }
 
 #define MIN_SLEEP_SLACK ZX_USEC(1)
@@ -1313,7 +1450,7 @@ static zx_status_t thread_read_stack(thread_t* t, void* ptr, void* out, size_t s
     return ZX_OK;
 }
 
-static size_t thread_get_backtrace(thread_t* t, void* fp, thread_backtrace_t* tb) {
+static size_t thread_walk_frames(thread_t* t, void* fp, void** pcs, size_t count) {
     // without frame pointers, dont even try
     // the compiler should optimize out the body of all the callers if it's not present
     if (!WITH_FRAME_POINTERS)
@@ -1324,11 +1461,11 @@ static size_t thread_get_backtrace(thread_t* t, void* fp, thread_backtrace_t* tb
         return 0;
     }
     size_t n = 0;
-    for (; n < THREAD_BACKTRACE_DEPTH; n++) {
+    for (; n < count; n++) {
         if (thread_read_stack(t, fp + 8, &pc, sizeof(void*))) {
             break;
         }
-        tb->pc[n] = pc;
+        pcs[n] = pc;
         if (thread_read_stack(t, fp, &fp, sizeof(void*))) {
             break;
         }
@@ -1336,6 +1473,14 @@ static size_t thread_get_backtrace(thread_t* t, void* fp, thread_backtrace_t* tb
     return n;
 }
 
+static size_t thread_get_backtrace(thread_t* t, void* fp, thread_backtrace_t* tb) {
+    return thread_walk_frames(t, fp, tb->pc, THREAD_BACKTRACE_DEPTH);
+}
+
+size_t thread_get_current_backtrace(void* fp, void** pcs, size_t count) {
+    return thread_walk_frames(get_current_thread(), fp, pcs, count);
+}
+
 static zx_status_t _thread_print_backtrace(thread_t* t, void *fp) {
     if (!t || !fp) {
         return ZX_ERR_BAD_STATE;
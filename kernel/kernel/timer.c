@@ -37,18 +37,56 @@
 
 #define LOCAL_TRACE 0
 
-static spin_lock_t timer_lock;
+/* each cpu's timer queue is protected by its own percpu[].timer_lock. a timer is
+ * only ever set on the local cpu, but it may be canceled from any cpu, so
+ * timer_cancel has to find and lock the queue the timer lives in. */
 
 void timer_init(timer_t* timer) {
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
+/* the cpu whose lock guards the state of |timer|: the cpu it is queued on, else
+ * the cpu running its callback, else the local cpu */
+static uint timer_owner_cpu(const timer_t* timer) {
+    int cpu = timer->queue_cpu;
+    if (cpu >= 0)
+        return (uint)cpu;
+    cpu = timer->active_cpu;
+    if (cpu >= 0)
+        return (uint)cpu;
+    return arch_curr_cpu_num();
+}
+
+/* lock the timer queue that |timer| belongs to and return its cpu. interrupts
+ * must already be disabled. the timer can move between queues until the lock
+ * is held, so retry until the owner is stable. */
+static uint timer_lock_owner(const timer_t* timer) {
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    for (;;) {
+        uint cpu = timer_owner_cpu(timer);
+        spin_lock(&percpu[cpu].timer_lock);
+        if (likely(timer_owner_cpu(timer) == cpu))
+            return cpu;
+        spin_unlock(&percpu[cpu].timer_lock);
+    }
+}
+
+static void remove_timer_from_queue(timer_t* timer) {
+    list_delete(&timer->node);
+    timer->queue_cpu = -1;
+}
+
 static void insert_timer_in_queue(uint cpu, timer_t* timer,
                                   uint64_t early_slack, uint64_t late_slack) {
 
     DEBUG_ASSERT(arch_ints_disabled());
     LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 "\n", timer, cpu, timer->scheduled_time);
 
+    DEBUG_ASSERT(spin_lock_held(&percpu[cpu].timer_lock));
+
+    timer->queue_cpu = cpu;
+
     zx_time_t earliest_deadline = timer->scheduled_time - early_slack;
     zx_time_t latest_deadline = timer->scheduled_time + late_slack;
 
@@ -157,6 +195,33 @@ static void insert_timer_in_queue(uint cpu, timer_t* timer,
     list_add_tail(&percpu[cpu].timer_queue, &timer->node);
 }
 
+/* split |slack| into how early and how late around |deadline| the timer may fire */
+static void compute_slack(zx_time_t deadline, enum slack_mode mode, uint64_t slack,
+                          zx_duration_t* early_slack, zx_duration_t* late_slack) {
+    if (slack == 0u) {
+        *late_slack = 0u;
+        *early_slack = 0u;
+        return;
+    }
+
+    switch (mode) {
+    case TIMER_SLACK_CENTER:
+        *late_slack = ((deadline + slack) < deadline) ? (UINT64_MAX - deadline) : slack;
+        *early_slack = ((deadline - slack) > deadline) ? deadline : slack;
+        break;
+    case TIMER_SLACK_LATE:
+        *late_slack = ((deadline + slack) < deadline) ? (UINT64_MAX - deadline) : slack;
+        *early_slack = 0u;
+        break;
+    case TIMER_SLACK_EARLY:
+        *early_slack = ((deadline - slack) > deadline) ? deadline : slack;
+        *late_slack = 0u;
+        break;
+    default:
+        panic("invalid timer mode\n");
+    };
+}
+
 void timer_set(timer_t* timer, zx_time_t deadline,
                enum slack_mode mode, uint64_t slack,
                timer_callback callback, void* arg) {
@@ -172,33 +237,13 @@ void timer_set(timer_t* timer, zx_time_t deadline,
 
     zx_duration_t late_slack;
     zx_duration_t early_slack;
-
-    if (slack == 0u) {
-        late_slack = 0u;
-        early_slack = 0u;
-    } else {
-        switch (mode) {
-        case TIMER_SLACK_CENTER:
-            late_slack = ((deadline + slack) < deadline) ? (UINT64_MAX - deadline) : slack;
-            early_slack = ((deadline - slack) > deadline) ? deadline : slack;
-            break;
-        case TIMER_SLACK_LATE:
-            late_slack = ((deadline + slack) < deadline) ? (UINT64_MAX - deadline) : slack;
-            early_slack = 0u;
-            break;
-        case TIMER_SLACK_EARLY:
-            early_slack = ((deadline - slack) > deadline) ? deadline : slack;
-            late_slack = 0u;
-            break;
-        default:
-            panic("invalid timer mode\n");
-        };
-    }
+    compute_slack(deadline, mode, slack, &early_slack, &late_slack);
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     uint cpu = arch_curr_cpu_num();
+    spin_lock(&percpu[cpu].timer_lock);
 
     bool currently_active = (timer->active_cpu == (int)cpu);
     if (unlikely(currently_active)) {
@@ -227,33 +272,44 @@ void timer_set(timer_t* timer, zx_time_t deadline,
     }
 
 out:
-    spin_unlock_irqrestore(&timer_lock, state);
+    spin_unlock(&percpu[cpu].timer_lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 }
 
-/* similar to timer_set_oneshot, with additional features/constraints:
+/* similar to timer_set, with additional features/constraints:
  * - will reset a currently active timer
  * - must be called with interrupts disabled
  * - must be running on the cpu that the timer is set to fire on (if currently set)
  * - cannot be called from the timer itself
  */
-void timer_reset_oneshot_local(timer_t* timer, zx_time_t deadline, timer_callback callback, void* arg) {
-    LTRACEF("timer %p, deadline %" PRIu64 ", callback %p, arg %p\n", timer, deadline, callback, arg);
+void timer_reset_local(timer_t* timer, zx_time_t deadline,
+                       enum slack_mode mode, uint64_t slack,
+                       timer_callback callback, void* arg) {
+    LTRACEF("timer %p, deadline %" PRIu64 ", slack %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, slack, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
+    DEBUG_ASSERT(mode <= TIMER_SLACK_EARLY);
     DEBUG_ASSERT(arch_ints_disabled());
 
+    zx_duration_t late_slack;
+    zx_duration_t early_slack;
+    compute_slack(deadline, mode, slack, &early_slack, &late_slack);
+
     uint cpu = arch_curr_cpu_num();
 
     /* no need to disable interrupts when acquiring this lock */
-    spin_lock(&timer_lock);
+    spin_lock(&percpu[cpu].timer_lock);
 
     if (unlikely(timer->active_cpu >= 0)) {
         panic("timer %p currently active\n", timer);
     }
 
     /* remove it from the queue if it was present */
-    if (list_in_list(&timer->node))
-        list_delete(&timer->node);
+    if (list_in_list(&timer->node)) {
+        DEBUG_ASSERT(timer->queue_cpu == (int)cpu);
+        remove_timer_from_queue(timer);
+    }
 
     /* set up the structure */
     timer->scheduled_time = deadline;
@@ -265,24 +321,25 @@ void timer_reset_oneshot_local(timer_t* timer, zx_time_t deadline, timer_callbac
 
     LTRACEF("scheduled time %" PRIu64 "\n", timer->scheduled_time);
 
-    insert_timer_in_queue(cpu, timer, 0u, 0u);
+    insert_timer_in_queue(cpu, timer, early_slack, late_slack);
 
     if (list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node) == timer) {
         /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
-        platform_set_oneshot_timer(deadline);
+        LTRACEF("setting new timer for %" PRIu64 " nsecs\n", timer->scheduled_time);
+        platform_set_oneshot_timer(timer->scheduled_time);
     }
 
-    spin_unlock(&timer_lock);
+    spin_unlock(&percpu[cpu].timer_lock);
 }
 
 bool timer_cancel(timer_t* timer) {
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    uint cpu = arch_curr_cpu_num();
+    /* holding the owner's lock also keeps a callback running there from requeueing the timer */
+    uint cpu = timer_lock_owner(timer);
 
     /* mark the timer as canceled */
     timer->cancel = true;
@@ -292,13 +349,14 @@ bool timer_cancel(timer_t* timer) {
     arch_spinloop_signal();
 
     /* see if we're trying to cancel the timer we're currently in the middle of handling */
-    if (unlikely(timer->active_cpu == (int)cpu)) {
+    if (unlikely(timer->active_cpu == (int)arch_curr_cpu_num())) {
         /* zero it out */
         timer->callback = NULL;
         timer->arg = NULL;
 
         /* we're done, so return back to the callback */
-        spin_unlock_irqrestore(&timer_lock, state);
+        spin_unlock(&percpu[cpu].timer_lock);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
         return false;
     }
 
@@ -312,7 +370,7 @@ bool timer_cancel(timer_t* timer) {
         timer_t* oldhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
 
         /* remove our timer from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* TODO(cpu): if  after removing |timer| there is one other single timer with
            the same scheduled_time and slack non-zero then it is possible to return
@@ -320,7 +378,7 @@ bool timer_cancel(timer_t* timer) {
 
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        if (unlikely(oldhead == timer)) {
+        if (unlikely(oldhead == timer) && cpu == arch_curr_cpu_num()) {
             timer_t* newhead = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
             if (newhead) {
                 LTRACEF("setting new timer to %" PRIu64 "\n", newhead->scheduled_time);
@@ -334,7 +392,8 @@ bool timer_cancel(timer_t* timer) {
         callback_not_running = false;
     }
 
-    spin_unlock_irqrestore(&timer_lock, state);
+    spin_unlock(&percpu[cpu].timer_lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     /* wait for the timer to become un-busy in case a callback is currently active on another cpu */
     while (timer->active_cpu >= 0) {
@@ -360,7 +419,7 @@ enum handler_return timer_tick(zx_time_t now) {
 
     LTRACEF("cpu %u now %" PRIu64 ", sp %p\n", cpu, now, __GET_FRAME());
 
-    spin_lock(&timer_lock);
+    spin_lock(&percpu[cpu].timer_lock);
 
     for (;;) {
         /* see if there's an event to process */
@@ -377,14 +436,14 @@ enum handler_return timer_tick(zx_time_t now) {
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                          "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                          timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
         /* spinlock below acts as a memory barrier */
 
         /* we pulled it off the list, release the list lock to handle it */
-        spin_unlock(&timer_lock);
+        spin_unlock(&percpu[cpu].timer_lock);
 
         LTRACEF("dequeued timer %p, scheduled %" PRIu64 "\n", timer, timer->scheduled_time);
 
@@ -395,7 +454,7 @@ enum handler_return timer_tick(zx_time_t now) {
 
         DEBUG_ASSERT(arch_ints_disabled());
         /* it may have been requeued, grab the lock so we can safely inspect it */
-        spin_lock(&timer_lock);
+        spin_lock(&percpu[cpu].timer_lock);
 
         /* mark it not busy */
         timer->active_cpu = -1;
@@ -417,7 +476,7 @@ enum handler_return timer_tick(zx_time_t now) {
     }
 
     /* we're done manipulating the timer queue */
-    spin_unlock(&timer_lock);
+    spin_unlock(&percpu[cpu].timer_lock);
 
     return INT_NO_RESCHEDULE;
 }
@@ -441,15 +500,21 @@ zx_status_t timer_trylock_or_cancel(timer_t* t, spin_lock_t* lock) {
 
 void timer_transition_off_cpu(uint old_cpu) {
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
     uint cpu = arch_curr_cpu_num();
 
+    DEBUG_ASSERT(old_cpu != cpu);
+
+    /* take the two queue locks in cpu order */
+    spin_lock(&percpu[MIN(cpu, old_cpu)].timer_lock);
+    spin_lock(&percpu[MAX(cpu, old_cpu)].timer_lock);
+
     timer_t* old_head = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
 
     timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
     list_for_every_entry_safe (&percpu[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+        remove_timer_from_queue(entry);
         // We lost the original asymmetric slack information so when we combine them
         // with the other timer queue they are not coalesced again.
         // TODO(cpu): figure how important this case is.
@@ -463,14 +528,16 @@ void timer_transition_off_cpu(uint old_cpu) {
         platform_set_oneshot_timer(new_head->scheduled_time);
     }
 
-    spin_unlock_irqrestore(&timer_lock, state);
+    spin_unlock(&percpu[MAX(cpu, old_cpu)].timer_lock);
+    spin_unlock(&percpu[MIN(cpu, old_cpu)].timer_lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 }
 
 void timer_thaw_percpu(void) {
     DEBUG_ASSERT(arch_ints_disabled());
-    spin_lock(&timer_lock);
 
     uint cpu = arch_curr_cpu_num();
+    spin_lock(&percpu[cpu].timer_lock);
 
     timer_t* t = list_peek_head_type(&percpu[cpu].timer_queue, timer_t, node);
     if (t) {
@@ -478,13 +545,13 @@ void timer_thaw_percpu(void) {
         platform_set_oneshot_timer(t->scheduled_time);
     }
 
-    spin_unlock(&timer_lock);
+    spin_unlock(&percpu[cpu].timer_lock);
 }
 
 void timer_queue_init(void) {
-    timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
         list_initialize(&percpu[i].timer_queue);
+        percpu[i].timer_lock = SPIN_LOCK_INITIAL_VALUE;
     }
 }
 
@@ -493,11 +560,11 @@ static void dump_timer_queues(char* buf, size_t len) {
     size_t ptr = 0;
     zx_time_t now = current_time();
 
-    spin_lock_saved_state_t state;
-    spin_lock_irqsave(&timer_lock, state);
-
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
         if (mp_is_cpu_online(i)) {
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&percpu[i].timer_lock, state);
+
             ptr += snprintf(buf + ptr, len - ptr, "cpu %u:\n", i);
 
             timer_t* t;
@@ -510,10 +577,10 @@ static void dump_timer_queues(char* buf, size_t len) {
                                 t->scheduled_time, delta_now, delta_last, t->callback, t->arg);
                 last = t->scheduled_time;
             }
+
+            spin_unlock_irqrestore(&percpu[i].timer_lock, state);
         }
     }
-
-    spin_unlock_irqrestore(&timer_lock, state);
 }
 
 #if WITH_LIB_CONSOLE
@@ -36,6 +36,7 @@ static void wait_queue_timeout_handler(timer_t* timer, zx_time_t now,
     wait_queue_unblock_thread(thread, ZX_ERR_TIMED_OUT);
 
     spin_unlock(&thread_lock);
+    thread_lock_flush_ipis();
 }
 
 static zx_status_t wait_queue_block_worker(wait_queue_t* wait, zx_time_t deadline,
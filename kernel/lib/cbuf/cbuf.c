@@ -70,6 +70,26 @@ size_t cbuf_write_char(cbuf_t *cbuf, char c)
     return ret;
 }
 
+size_t cbuf_write_char_nosignal(cbuf_t *cbuf, char c)
+{
+    DEBUG_ASSERT(cbuf);
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cbuf->lock, state);
+
+    size_t ret = 0;
+    if (cbuf_space_avail(cbuf) > 0) {
+        cbuf->buf[cbuf->head] = c;
+
+        cbuf->head = INC_POINTER(cbuf, cbuf->head, 1);
+        ret = 1;
+    }
+
+    spin_unlock_irqrestore(&cbuf->lock, state);
+
+    return ret;
+}
+
 size_t cbuf_read_char(cbuf_t *cbuf, char *c, bool block)
 {
     DEBUG_ASSERT(cbuf);
@@ -60,5 +60,11 @@ size_t cbuf_space_avail(cbuf_t *cbuf);
 size_t cbuf_read_char(cbuf_t *cbuf, char *c, bool block);
 size_t cbuf_write_char(cbuf_t *cbuf, char c);
 
+/* Like cbuf_write_char(), but doesn't signal the event, so it's safe to call
+ * with the thread lock held.  For buffers that are drained by polling or from
+ * an interrupt handler rather than by a blocked reader, such as a uart's
+ * transmit buffer. */
+size_t cbuf_write_char_nosignal(cbuf_t *cbuf, char c);
+
 __END_CDECLS
 
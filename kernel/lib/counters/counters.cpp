@@ -6,11 +6,16 @@
 
 #include <lib/counters.h>
 
+#include <stddef.h>
 #include <string.h>
 
 #include <arch/ops.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
 #include <kernel/cmdline.h>
 #include <kernel/percpu.h>
+#include <lib/counter-vmo-abi.h>
+#include <vm/vm_object_paged.h>
 
 #include <lk/init.h>
 
@@ -59,6 +64,82 @@ static void counters_init(unsigned level) {
     }
 }
 
+static fbl::Mutex vmo_lock;
+// Never released, since the arena VMO holds the kernel's own pages.
+static fbl::RefPtr<VmObject> desc_vmo TA_GUARDED(vmo_lock);
+static fbl::RefPtr<VmObject> arena_vmo TA_GUARDED(vmo_lock);
+
+static zx_status_t make_desc_vmo(fbl::RefPtr<VmObject>* out) {
+    const size_t num_counters = get_num_counters();
+    const size_t size = sizeof(counter_descriptor_vmo) +
+                        num_counters * sizeof(counter_descriptor);
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY,
+                                               ROUNDUP(size, PAGE_SIZE), &vmo);
+    if (status != ZX_OK)
+        return status;
+
+    counter_descriptor_vmo header = {
+        COUNTER_DESC_VMO_MAGIC,
+        SMP_MAX_CPUS,
+        num_counters,
+    };
+    size_t actual;
+    status = vmo->Write(&header, 0, sizeof(header), &actual);
+    if (status != ZX_OK)
+        return status;
+
+    uint64_t offset = offsetof(counter_descriptor_vmo, descriptor_table);
+    for (auto it = kcountdesc_begin; it != kcountdesc_end; ++it) {
+        counter_descriptor desc = {};
+        ASSERT(strlen(it->name) < sizeof(desc.name));
+        strlcpy(desc.name, it->name, sizeof(desc.name));
+        status = vmo->Write(&desc, offset, sizeof(desc), &actual);
+        if (status != ZX_OK)
+            return status;
+        offset += sizeof(desc);
+    }
+
+    vmo->set_name(COUNTERS_VMO_DESC_NAME, sizeof(COUNTERS_VMO_DESC_NAME) - 1);
+    *out = fbl::move(vmo);
+    return ZX_OK;
+}
+
+static zx_status_t make_arena_vmo(fbl::RefPtr<VmObject>* out) {
+    // kernel.ld gives the arena whole pages of its own.
+    const size_t size = get_num_counters() * SMP_MAX_CPUS * sizeof(kcounters_arena[0]);
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::CreateFromROData(kcounters_arena,
+                                                         ROUNDUP(size, PAGE_SIZE), &vmo);
+    if (status != ZX_OK)
+        return status;
+
+    vmo->set_name(COUNTERS_VMO_ARENA_NAME, sizeof(COUNTERS_VMO_ARENA_NAME) - 1);
+    *out = fbl::move(vmo);
+    return ZX_OK;
+}
+
+zx_status_t kcounters_get_vmos(fbl::RefPtr<VmObject>* desc_vmo_out,
+                               fbl::RefPtr<VmObject>* arena_vmo_out) {
+    fbl::AutoLock lock(&vmo_lock);
+
+    if (!desc_vmo) {
+        zx_status_t status = make_desc_vmo(&desc_vmo);
+        if (status != ZX_OK)
+            return status;
+    }
+    if (!arena_vmo) {
+        zx_status_t status = make_arena_vmo(&arena_vmo);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    *desc_vmo_out = desc_vmo;
+    *arena_vmo_out = arena_vmo;
+    return ZX_OK;
+}
+
 static void dump_counter(const k_counter_desc* desc) {
     size_t counter_index = kcounter_index(desc);
 
@@ -0,0 +1,41 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+// This file is used both in the kernel and in userspace tools that read
+// the counters.  So it must be compatible with both the kernel and
+// userland header environments.  It must use only the basic types so
+// that struct layouts match exactly in both contexts.
+
+#include <stdint.h>
+
+// The kernel hands out two read-only VMOs, which show up in the file
+// system as /boot/kernel/counters/desc and /boot/kernel/counters/arena.
+#define COUNTERS_VMO_DESC_NAME "counters/desc"
+#define COUNTERS_VMO_ARENA_NAME "counters/arena"
+
+#define COUNTER_DESC_VMO_MAGIC 0x5352544e434b0001ull
+#define COUNTER_NAME_LEN 56
+
+struct counter_descriptor {
+    // NUL-terminated, e.g. "kernel.hypervisor.vmexit.hlt".
+    char name[COUNTER_NAME_LEN];
+};
+
+// The contents of the descriptor VMO, which never changes.  The arena
+// VMO is an array of uint64_t[max_cpus][num_counters] that the kernel
+// keeps updating: the value of descriptor_table[i] on cpu c is at
+// arena[c * num_counters + i], and the counter's value is the sum over
+// all the cpus.  Reads of a single cpu's slot are not synchronized with
+// the cpu updating it, so the sums are only approximate.
+struct counter_descriptor_vmo {
+    uint64_t magic;
+    uint64_t max_cpus;
+    uint64_t num_counters;
+    // Sorted by name.
+    struct counter_descriptor descriptor_table[];
+};
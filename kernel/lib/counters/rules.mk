@@ -12,6 +12,7 @@ MODULE_SRCS += \
 	$(LOCAL_DIR)/counters.cpp
 
 MODULE_DEPS += \
-	kernel/lib/console
+	kernel/lib/console \
+	kernel/lib/fbl
 
 include make/module.mk
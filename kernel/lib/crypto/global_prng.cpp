@@ -6,11 +6,13 @@
 
 #include <lib/crypto/global_prng.h>
 
+#include <arch/ops.h>
 #include <assert.h>
 #include <ctype.h>
 #include <err.h>
 #include <explicit-memory/bytes.h>
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
 #include <kernel/mutex.h>
@@ -38,6 +40,45 @@ PRNG* GetInstance() {
     return kGlobalPrng;
 }
 
+// Each per-CPU PRNG mixes in a fresh draw from the global PRNG once it has
+// been charged this many bytes.  Every draw is charged at least
+// kPerCpuMinCharge, so a stream of small draws still reseeds every 4096
+// calls.  This also bounds how long entropy added through
+// zx_cprng_add_entropy() takes to reach the per-CPU instances.
+static constexpr uint64_t kPerCpuReseedBytes = 1 << 20;
+static constexpr uint64_t kPerCpuMinCharge = kPerCpuReseedBytes / 4096;
+
+struct PerCpuPrng {
+    PRNG* prng = nullptr;
+    fbl::atomic<uint64_t> charged{0};
+};
+
+static PerCpuPrng kPerCpuPrngs[SMP_MAX_CPUS];
+
+static void ReseedPerCpu(PerCpuPrng* cpu) {
+    uint8_t seed[PRNG::kMinEntropy];
+    GetInstance()->Draw(seed, sizeof(seed));
+    cpu->prng->AddEntropy(seed, sizeof(seed));
+    mandatory_memset(seed, 0, sizeof(seed));
+}
+
+void DrawPerCpu(void* out, size_t size) {
+    PerCpuPrng* cpu = &kPerCpuPrngs[arch_curr_cpu_num()];
+    if (unlikely(cpu->prng == nullptr)) {
+        GetInstance()->Draw(out, size);
+        return;
+    }
+
+    const uint64_t charge = fbl::max(static_cast<uint64_t>(size), kPerCpuMinCharge);
+    if (unlikely(cpu->charged.fetch_add(charge) + charge >= kPerCpuReseedBytes)) {
+        // Racing threads may both reseed; either way the state only gains
+        // entropy.
+        cpu->charged.store(0);
+        ReseedPerCpu(cpu);
+    }
+    cpu->prng->Draw(out, size);
+}
+
 // Returns true if the kernel cmdline provided at least PRNG::kMinEntropy bytes
 // of entropy, and false otherwise.
 //
@@ -167,6 +208,18 @@ static void BecomeThreadSafe(uint level) {
     GetInstance()->BecomeThreadSafe();
 }
 
+// Creates and seeds the per-CPU PRNGs.  These are made for every possible
+// CPU up front so DrawPerCpu() never has to synchronize their creation.
+static void InitPerCpu(uint level) {
+    alignas(alignof(PRNG))static uint8_t prng_space[SMP_MAX_CPUS][sizeof(PRNG)];
+    for (uint i = 0; i < SMP_MAX_CPUS; ++i) {
+        uint8_t seed[PRNG::kMinEntropy];
+        GetInstance()->Draw(seed, sizeof(seed));
+        kPerCpuPrngs[i].prng = new (&prng_space[i]) PRNG(seed, sizeof(seed));
+        mandatory_memset(seed, 0, sizeof(seed));
+    }
+}
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
@@ -177,3 +230,6 @@ LK_INIT_HOOK(global_prng_seed, crypto::GlobalPRNG::EarlyBootSeed,
 
 LK_INIT_HOOK(global_prng_thread_safe, crypto::GlobalPRNG::BecomeThreadSafe,
              LK_INIT_LEVEL_THREADING - 1)
+
+LK_INIT_HOOK(global_prng_per_cpu, crypto::GlobalPRNG::InitPerCpu,
+             LK_INIT_LEVEL_THREADING)
@@ -16,6 +16,13 @@ namespace GlobalPRNG {
 // guaranteed to be non-null.
 PRNG* GetInstance();
 
+// Fills |out| with |size| bytes from a PRNG belonging to the current CPU.
+// The per-CPU PRNGs are seeded from, and periodically reseeded with, draws
+// from the global PRNG, so this has the same guarantees as
+// GetInstance()->Draw() without every caller contending on one lock.  The
+// caller may migrate between CPUs while drawing; that only costs sharing.
+void DrawPerCpu(void* out, size_t size);
+
 } //namespace GlobalPRNG
 
 } // namespace crypto
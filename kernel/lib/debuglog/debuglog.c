@@ -8,8 +8,10 @@
 
 #include <err.h>
 #include <dev/udisplay.h>
+#include <kernel/align.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <lib/counters.h>
 #include <lib/io.h>
 #include <lib/version.h>
 #include <lk/init.h>
@@ -67,6 +69,118 @@ static dlog_t DLOG = {
 
 #define ALIGN4(n) (((n) + 3) & (~3))
 
+// Once the debuglog-merger thread is running, writers do not touch the
+// global fifo.  Each cpu has a small staging fifo of its own which only it
+// writes, with interrupts disabled, so dlog_write() never waits for another
+// cpu.  Every staged record is preceded by a sequence number taken from a
+// global counter, and the merger moves records into the global fifo in
+// sequence order, so readers see them in the order they were written.
+//
+// A record is only given a sequence number once there is room for it in
+// the staging fifo, so the merger never waits on a number that will not
+// show up.  When a staging fifo is full the new record is dropped and
+// counted in kernel.debuglog.dropped.
+#define DLOG_STAGE_SIZE (8u * 1024u)
+#define DLOG_STAGE_MASK (DLOG_STAGE_SIZE - 1u)
+
+static_assert((DLOG_STAGE_SIZE & DLOG_STAGE_MASK) == 0u, "must be power of two");
+static_assert(sizeof(uint64_t) + DLOG_MAX_RECORD <= DLOG_STAGE_SIZE, "");
+
+typedef struct dlog_stage {
+    // Written by the owning cpu only.
+    size_t head;
+    // Written by the merger only.
+    size_t tail;
+    uint8_t data[DLOG_STAGE_SIZE];
+} __CPU_ALIGN dlog_stage_t;
+
+static dlog_stage_t dlog_stages[SMP_MAX_CPUS];
+
+static bool dlog_staging;
+static uint64_t dlog_next_seq;
+static bool dlog_merger_idle;
+static event_t dlog_merge_event = EVENT_INITIAL_VALUE(dlog_merge_event, 0, EVENT_FLAG_AUTOUNSIGNAL);
+
+KCOUNTER(dlog_dropped, "kernel.debuglog.dropped");
+
+static void stage_write(dlog_stage_t* stage, size_t pos, const void* ptr, size_t len) {
+    size_t offset = pos & DLOG_STAGE_MASK;
+    size_t space = DLOG_STAGE_SIZE - offset;
+    if (space >= len) {
+        memcpy(stage->data + offset, ptr, len);
+    } else {
+        memcpy(stage->data + offset, ptr, space);
+        memcpy(stage->data, ptr + space, len - space);
+    }
+}
+
+static void stage_read(const dlog_stage_t* stage, size_t pos, void* ptr, size_t len) {
+    size_t offset = pos & DLOG_STAGE_MASK;
+    size_t space = DLOG_STAGE_SIZE - offset;
+    if (space >= len) {
+        memcpy(ptr, stage->data + offset, len);
+    } else {
+        memcpy(ptr, stage->data + offset, space);
+        memcpy(ptr + space, stage->data, len - space);
+    }
+}
+
+// Appends a record to the global fifo.  The caller holds log->lock.
+static void dlog_append_locked(dlog_t* log, const dlog_header_t* hdr, const void* ptr) {
+    size_t wiresize = DLOG_HDR_GET_FIFOLEN(hdr->header);
+    size_t len = hdr->datalen;
+
+    // Discard records at tail until there is enough
+    // space for the new record.
+    while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
+        uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
+        log->tail += DLOG_HDR_GET_FIFOLEN(header);
+    }
+
+    size_t offset = (log->head & DLOG_MASK);
+
+    size_t fifospace = DLOG_SIZE - offset;
+
+    if (fifospace >= wiresize) {
+        // everything fits in one write, simple case!
+        memcpy(log->data + offset, hdr, sizeof(*hdr));
+        memcpy(log->data + offset + sizeof(*hdr), ptr, len);
+    } else if (fifospace < sizeof(*hdr)) {
+        // the wrap happens in the header
+        memcpy(log->data + offset, hdr, fifospace);
+        memcpy(log->data, ((const void*) hdr) + fifospace, sizeof(*hdr) - fifospace);
+        memcpy(log->data + (sizeof(*hdr) - fifospace), ptr, len);
+    } else {
+        // the wrap happens in the data
+        memcpy(log->data + offset, hdr, sizeof(*hdr));
+        offset += sizeof(*hdr);
+        fifospace -= sizeof(*hdr);
+        memcpy(log->data + offset, ptr, fifospace);
+        memcpy(log->data, ptr + fifospace, len - fifospace);
+    }
+    log->head += wiresize;
+}
+
+// Copies the record into this cpu's staging fifo.  Called with interrupts
+// disabled.
+static void dlog_stage_record(const dlog_header_t* hdr, const void* ptr) {
+    dlog_stage_t* stage = &dlog_stages[arch_curr_cpu_num()];
+    size_t size = sizeof(uint64_t) + DLOG_HDR_GET_FIFOLEN(hdr->header);
+
+    size_t head = stage->head;
+    size_t tail = __atomic_load_n(&stage->tail, __ATOMIC_ACQUIRE);
+    if ((DLOG_STAGE_SIZE - (head - tail)) < size) {
+        kcounter_add(dlog_dropped, 1u);
+        return;
+    }
+
+    uint64_t seq = __atomic_fetch_add(&dlog_next_seq, 1u, __ATOMIC_RELAXED);
+    stage_write(stage, head, &seq, sizeof(seq));
+    stage_write(stage, head + sizeof(seq), hdr, sizeof(*hdr));
+    stage_write(stage, head + sizeof(seq) + sizeof(*hdr), ptr, hdr->datalen);
+    __atomic_store_n(&stage->head, head + size, __ATOMIC_SEQ_CST);
+}
+
 zx_status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     dlog_t* log = &DLOG;
 
@@ -99,42 +213,22 @@ zx_status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     }
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&log->lock, state);
-
-    // Discard records at tail until there is enough
-    // space for the new record.
-    while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
-        uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
-        log->tail += DLOG_HDR_GET_FIFOLEN(header);
-    }
-
-    size_t offset = (log->head & DLOG_MASK);
-
-    size_t fifospace = DLOG_SIZE - offset;
-
-    if (fifospace >= wiresize) {
-        // everything fits in one write, simple case!
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        memcpy(log->data + offset + sizeof(hdr), ptr, len);
-    } else if (fifospace < sizeof(hdr)) {
-        // the wrap happens in the header
-        memcpy(log->data + offset, &hdr, fifospace);
-        memcpy(log->data, ((void*) &hdr) + fifospace, sizeof(hdr) - fifospace);
-        memcpy(log->data + (sizeof(hdr) - fifospace), ptr, len);
+    event_t* event;
+    if (__atomic_load_n(&dlog_staging, __ATOMIC_ACQUIRE)) {
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        dlog_stage_record(&hdr, ptr);
+        event = __atomic_exchange_n(&dlog_merger_idle, false, __ATOMIC_SEQ_CST) ?
+            &dlog_merge_event : NULL;
     } else {
-        // the wrap happens in the data
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        offset += sizeof(hdr);
-        fifospace -= sizeof(hdr);
-        memcpy(log->data + offset, ptr, fifospace);
-        memcpy(log->data, ptr + fifospace, len - fifospace);
+        spin_lock_irqsave(&log->lock, state);
+        dlog_append_locked(log, &hdr, ptr);
+        event = &log->event;
     }
-    log->head += wiresize;
 
-    // Need to check this before re-releasing the log lock, since we may
-    // re-enable interrupts while doing that.  If interrupts are enabled when we
-    // make this check, we could see the following sequence of events between
-    // two CPUs and incorrectly conclude we are holding the thread lock:
+    // Need to check this before re-enabling interrupts.  If interrupts are
+    // enabled when we make this check, we could see the following sequence
+    // of events between two CPUs and incorrectly conclude we are holding
+    // the thread lock:
     // C2: Acquire thread_lock
     // C1: Running this thread, evaluate spin_lock_holder_cpu(&thread_lock) -> C2
     // C1: Context switch away
@@ -143,19 +237,100 @@ zx_status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     // C2: Running this thread, evaluate arch_curr_cpu_num() -> C2
     bool holding_thread_lock = spin_lock_holder_cpu(&thread_lock) == arch_curr_cpu_num();
 
-    spin_unlock_irqrestore(&log->lock, state);
+    if (event == &log->event) {
+        spin_unlock_irqrestore(&log->lock, state);
+    } else {
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    }
+
+    if (event == NULL) {
+        return ZX_OK;
+    }
 
     // if we happen to be called from within the global thread lock, use a
     // special version of event signal
     if (holding_thread_lock) {
-        event_signal_thread_locked(&log->event);
+        event_signal_thread_locked(event);
     } else {
-        event_signal(&log->event, false);
+        event_signal(event, false);
     }
 
     return ZX_OK;
 }
 
+// Returns the staging fifo with the oldest record, or NULL if they are all
+// empty.
+static dlog_stage_t* dlog_oldest_stage(uint64_t* seq) {
+    dlog_stage_t* oldest = NULL;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        dlog_stage_t* stage = &dlog_stages[i];
+        size_t head = __atomic_load_n(&stage->head, __ATOMIC_SEQ_CST);
+        if (head == stage->tail) {
+            continue;
+        }
+        uint64_t s;
+        stage_read(stage, stage->tail, &s, sizeof(s));
+        if (oldest == NULL || s < *seq) {
+            oldest = stage;
+            *seq = s;
+        }
+    }
+    return oldest;
+}
+
+// The debuglog merger thread moves staged records into the global
+// fifo, in sequence order, and then notifies readers.
+static int debuglog_merger(void* arg) {
+    dlog_t* log = &DLOG;
+    dlog_record_t rec;
+
+    // Writers start staging from here on.
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&log->lock, state);
+    uint64_t next_seq = __atomic_load_n(&dlog_next_seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&dlog_staging, true, __ATOMIC_RELEASE);
+    spin_unlock_irqrestore(&log->lock, state);
+
+    for (;;) {
+        bool merged = false;
+        uint64_t seq;
+        dlog_stage_t* stage;
+        while ((stage = dlog_oldest_stage(&seq)) != NULL) {
+            // A lower sequence number has been taken but its record is still
+            // being copied on another cpu, with interrupts disabled, so it is
+            // about to show up.
+            if (seq != next_seq) {
+                continue;
+            }
+
+            size_t tail = stage->tail + sizeof(seq);
+            stage_read(stage, tail, &rec.hdr, sizeof(rec.hdr));
+            stage_read(stage, tail + sizeof(rec.hdr), rec.data, rec.hdr.datalen);
+            __atomic_store_n(&stage->tail, tail + DLOG_HDR_GET_FIFOLEN(rec.hdr.header),
+                             __ATOMIC_RELEASE);
+            next_seq++;
+
+            spin_lock_irqsave(&log->lock, state);
+            dlog_append_locked(log, &rec.hdr, rec.data);
+            spin_unlock_irqrestore(&log->lock, state);
+            merged = true;
+        }
+
+        if (merged) {
+            event_signal(&log->event, false);
+        }
+
+        // Writers signal the merge event only when they see the merger idle,
+        // so look at the fifos once more after saying so.
+        __atomic_store_n(&dlog_merger_idle, true, __ATOMIC_SEQ_CST);
+        if (dlog_oldest_stage(&seq) == NULL) {
+            event_wait(&dlog_merge_event);
+        }
+        __atomic_store_n(&dlog_merger_idle, false, __ATOMIC_SEQ_CST);
+    }
+    return ZX_OK;
+}
+
 // TODO: support reading multiple messages at a time
 // TODO: filter with flags
 zx_status_t dlog_read(dlog_reader_t* rdr, uint32_t flags, void* ptr, size_t len, size_t* _actual) {
@@ -339,6 +514,10 @@ void dlog_bluescreen_init(void) {
 static void dlog_init_hook(uint level) {
     thread_t* rthread;
 
+    if ((rthread = thread_create("debuglog-merger", debuglog_merger, NULL,
+                                 HIGH_PRIORITY, DEFAULT_STACK_SIZE)) != NULL) {
+        thread_resume(rthread);
+    }
     if ((rthread = thread_create("debuglog-notifier", debuglog_notifier, NULL,
                                  HIGH_PRIORITY - 1, DEFAULT_STACK_SIZE)) != NULL) {
         thread_resume(rthread);
@@ -13,6 +13,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/debuglog.c \
 
 MODULE_DEPS := \
+    kernel/lib/counters \
     kernel/lib/version
 
 include make/module.mk
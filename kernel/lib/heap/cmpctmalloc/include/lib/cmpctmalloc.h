@@ -18,6 +18,9 @@ void* cmpct_alloc(size_t);
 void* cmpct_realloc(void*, size_t);
 void cmpct_free(void*);
 void* cmpct_memalign(size_t size, size_t alignment);
+// Returns how many bytes of the allocation at |ptr| can be used, which is at
+// least what was asked for.
+size_t cmpct_usable_size(void* ptr);
 
 void cmpct_init(void);
 void cmpct_dump(bool panic_time);
@@ -13,13 +13,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#include <inttypes.h>
 #include <list.h>
 #include <arch/ops.h>
+#include <kernel/align.h>
+#include <kernel/cmdline.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <vm/vm.h>
 #include <vm/pmm.h>
 #include <lib/cmpctmalloc.h>
 #include <lib/console.h>
+#include <lk/init.h>
 
 #define LOCAL_TRACE 0
 
@@ -38,13 +43,345 @@ static bool heap_trace = false;
 #define heap_trace (false)
 #endif
 
+/*
+ * Per-cpu caches of small allocations in front of cmpctmalloc, so that the
+ * common object sizes don't all serialize on the heap lock. Cached objects
+ * are ordinary cmpctmalloc allocations that haven't been handed back yet;
+ * the heap is only entered to refill an empty cache or drain a full one.
+ */
+#define SLAB_CLASSES 10
+#define SLAB_MAGAZINE_SIZE 32
+#define SLAB_BATCH (SLAB_MAGAZINE_SIZE / 2)
+
+/* match cmpctmalloc's own buckets so rounding up doesn't waste space */
+static const size_t slab_class_size[SLAB_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512,
+};
+
+struct slab_class {
+    uint32_t count;
+    void *objects[SLAB_MAGAZINE_SIZE];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t drains;
+};
+
+struct slab_cache {
+    /* only contended by a thread that migrated, or by a trim */
+    spin_lock_t lock;
+    struct slab_class classes[SLAB_CLASSES];
+} __CPU_ALIGN;
+
+static struct slab_cache slab_caches[SMP_MAX_CPUS];
+
+/* smallest class that holds |size|, or -1 */
+static int slab_alloc_class(size_t size)
+{
+    if (size == 0)
+        return -1;
+    for (int i = 0; i < SLAB_CLASSES; i++) {
+        if (size <= slab_class_size[i])
+            return i;
+    }
+    return -1;
+}
+
+/* largest class a free block of |usable| bytes can serve, or -1 */
+static int slab_free_class(size_t usable)
+{
+    if (usable > slab_class_size[SLAB_CLASSES - 1])
+        return -1;
+    for (int i = SLAB_CLASSES - 1; i >= 0; i--) {
+        if (usable >= slab_class_size[i])
+            return i;
+    }
+    return -1;
+}
+
+static void *slab_alloc(size_t size)
+{
+    int index = slab_alloc_class(size);
+    if (index < 0)
+        return cmpct_alloc(size);
+
+    struct slab_cache *cache = &slab_caches[arch_curr_cpu_num()];
+    struct slab_class *sc = &cache->classes[index];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    if (likely(sc->count > 0)) {
+        void *ptr = sc->objects[--sc->count];
+        sc->hits++;
+        spin_unlock_irqrestore(&cache->lock, state);
+        return ptr;
+    }
+    sc->misses++;
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    /* refill from the heap, keeping the first object for the caller */
+    void *batch[SLAB_BATCH];
+    size_t n = 0;
+    while (n < SLAB_BATCH) {
+        void *obj = cmpct_alloc(slab_class_size[index]);
+        if (!obj)
+            break;
+        batch[n++] = obj;
+    }
+    if (n == 0)
+        return NULL;
+
+    /* the thread may have moved, which is fine: any cpu's cache will do */
+    cache = &slab_caches[arch_curr_cpu_num()];
+    sc = &cache->classes[index];
+    spin_lock_irqsave(&cache->lock, state);
+    size_t i = 1;
+    while (i < n && sc->count < SLAB_MAGAZINE_SIZE)
+        sc->objects[sc->count++] = batch[i++];
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    while (i < n)
+        cmpct_free(batch[i++]);
+    return batch[0];
+}
+
+static void slab_free(void *ptr)
+{
+    int index = slab_free_class(cmpct_usable_size(ptr));
+    if (index < 0) {
+        cmpct_free(ptr);
+        return;
+    }
+
+    struct slab_cache *cache = &slab_caches[arch_curr_cpu_num()];
+    struct slab_class *sc = &cache->classes[index];
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&cache->lock, state);
+    if (likely(sc->count < SLAB_MAGAZINE_SIZE)) {
+        sc->objects[sc->count++] = ptr;
+        spin_unlock_irqrestore(&cache->lock, state);
+        return;
+    }
+
+    /* full; hand the older half back to the heap */
+    void *batch[SLAB_BATCH];
+    memcpy(batch, sc->objects, sizeof(batch));
+    memmove(sc->objects, sc->objects + SLAB_BATCH,
+            (SLAB_MAGAZINE_SIZE - SLAB_BATCH) * sizeof(void *));
+    sc->count = SLAB_MAGAZINE_SIZE - SLAB_BATCH;
+    sc->objects[sc->count++] = ptr;
+    sc->drains++;
+    spin_unlock_irqrestore(&cache->lock, state);
+
+    for (size_t i = 0; i < SLAB_BATCH; i++)
+        cmpct_free(batch[i]);
+}
+
+/* returns every cached object to the heap */
+static void slab_drain_all(void)
+{
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        struct slab_cache *cache = &slab_caches[cpu];
+        for (int index = 0; index < SLAB_CLASSES; index++) {
+            struct slab_class *sc = &cache->classes[index];
+            void *batch[SLAB_MAGAZINE_SIZE];
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&cache->lock, state);
+            uint32_t n = sc->count;
+            memcpy(batch, sc->objects, n * sizeof(void *));
+            sc->count = 0;
+            spin_unlock_irqrestore(&cache->lock, state);
+
+            for (uint32_t i = 0; i < n; i++)
+                cmpct_free(batch[i]);
+        }
+    }
+}
+
+static void slab_dump(void)
+{
+    printf("\tslab class  cached        hits      misses      drains\n");
+    for (int index = 0; index < SLAB_CLASSES; index++) {
+        uint64_t cached = 0, hits = 0, misses = 0, drains = 0;
+        for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+            const struct slab_class *sc = &slab_caches[cpu].classes[index];
+            cached += sc->count;
+            hits += sc->hits;
+            misses += sc->misses;
+            drains += sc->drains;
+        }
+        printf("\t%10zu %7" PRIu64 " %11" PRIu64 " %11" PRIu64 " %11" PRIu64 "\n",
+               slab_class_size[index], cached, hits, misses, drains);
+    }
+}
+
+/*
+ * Sampled allocation profiling. Each cpu counts down the bytes left until
+ * its next sample, and the allocation that reaches zero is recorded in a
+ * fixed table, hashed by address, until it is freed. While the rate is zero
+ * the only cost is a load and a branch in the allocation and free paths.
+ */
+#define HEAP_PROFILE_SLOTS_SHIFT 10
+#define HEAP_PROFILE_SLOTS (1u << HEAP_PROFILE_SLOTS_SHIFT)
+/* keeping the table at most half full keeps the probe runs short */
+#define HEAP_PROFILE_MAX_LIVE (HEAP_PROFILE_SLOTS / 2)
+
+struct heap_profile_slot {
+    void *ptr;
+    heap_sample_t sample;
+};
+
+struct heap_profile_countdown {
+    int64_t bytes;
+} __CPU_ALIGN;
+
+/* only written with the lock held */
+static size_t heap_profile_rate;
+static spin_lock_t heap_profile_lock = SPIN_LOCK_INITIAL_VALUE;
+static struct heap_profile_slot heap_profile_table[HEAP_PROFILE_SLOTS];
+static size_t heap_profile_live;
+static uint64_t heap_profile_dropped;
+static struct heap_profile_countdown heap_profile_countdown[SMP_MAX_CPUS];
+
+static size_t heap_profile_home(const void *ptr)
+{
+    /* heap blocks are 16 byte aligned, the low bits carry nothing */
+    uint64_t h = ((uintptr_t)ptr >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h >> (64 - HEAP_PROFILE_SLOTS_SHIFT));
+}
+
+static void heap_profile_record(void *ptr, size_t size, size_t weight,
+                                void *caller, void *fp)
+{
+    heap_sample_t sample = {};
+    sample.size = size;
+    sample.weight = weight;
+    /* the first frame walked is the allocator's, so it yields |caller| */
+    if (thread_get_current_backtrace(fp, sample.pc, HEAP_PROFILE_DEPTH) == 0)
+        sample.pc[0] = caller;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&heap_profile_lock, state);
+    /* the table may have been reset for a new rate since the caller looked */
+    if (heap_profile_rate != 0) {
+        if (heap_profile_live < HEAP_PROFILE_MAX_LIVE) {
+            size_t i = heap_profile_home(ptr);
+            while (heap_profile_table[i].ptr && heap_profile_table[i].ptr != ptr)
+                i = (i + 1) % HEAP_PROFILE_SLOTS;
+            if (!heap_profile_table[i].ptr)
+                heap_profile_live++;
+            heap_profile_table[i].ptr = ptr;
+            heap_profile_table[i].sample = sample;
+        } else {
+            heap_profile_dropped++;
+        }
+    }
+    spin_unlock_irqrestore(&heap_profile_lock, state);
+}
+
+static void heap_profile_forget(void *ptr)
+{
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&heap_profile_lock, state);
+    size_t i = heap_profile_home(ptr);
+    while (heap_profile_table[i].ptr && heap_profile_table[i].ptr != ptr)
+        i = (i + 1) % HEAP_PROFILE_SLOTS;
+    if (heap_profile_table[i].ptr) {
+        /* shift the rest of the run back, so that every entry can still be
+         * found by probing from its home slot */
+        heap_profile_table[i].ptr = NULL;
+        for (size_t j = (i + 1) % HEAP_PROFILE_SLOTS; heap_profile_table[j].ptr;
+             j = (j + 1) % HEAP_PROFILE_SLOTS) {
+            size_t k = heap_profile_home(heap_profile_table[j].ptr);
+            bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+            if (!stays) {
+                heap_profile_table[i] = heap_profile_table[j];
+                heap_profile_table[j].ptr = NULL;
+                i = j;
+            }
+        }
+        heap_profile_live--;
+    }
+    spin_unlock_irqrestore(&heap_profile_lock, state);
+}
+
+static inline void heap_profile_alloc(void *ptr, size_t size, void *caller, void *fp)
+{
+    size_t rate = __atomic_load_n(&heap_profile_rate, __ATOMIC_RELAXED);
+    if (likely(rate == 0) || unlikely(!ptr) || size == 0)
+        return;
+
+    int64_t *bytes = &heap_profile_countdown[arch_curr_cpu_num()].bytes;
+    int64_t left = __atomic_sub_fetch(bytes, (int64_t)size, __ATOMIC_RELAXED);
+    if (likely(left > 0))
+        return;
+
+    /* a large allocation stands for every sampling period it used up */
+    size_t periods = 1 + (size_t)(-left) / rate;
+    __atomic_add_fetch(bytes, (int64_t)(periods * rate), __ATOMIC_RELAXED);
+    heap_profile_record(ptr, size, periods * rate, caller, fp);
+}
+
+static inline void heap_profile_free(void *ptr)
+{
+    if (unlikely(__atomic_load_n(&heap_profile_rate, __ATOMIC_RELAXED) != 0))
+        heap_profile_forget(ptr);
+}
+
+void heap_profile_set_rate(size_t rate)
+{
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&heap_profile_lock, state);
+    memset(heap_profile_table, 0, sizeof(heap_profile_table));
+    heap_profile_live = 0;
+    heap_profile_dropped = 0;
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        heap_profile_countdown[cpu].bytes = (int64_t)rate;
+    __atomic_store_n(&heap_profile_rate, rate, __ATOMIC_RELAXED);
+    spin_unlock_irqrestore(&heap_profile_lock, state);
+}
+
+size_t heap_profile_get_rate(void)
+{
+    return __atomic_load_n(&heap_profile_rate, __ATOMIC_RELAXED);
+}
+
+size_t heap_profile_get_samples(heap_sample_t *samples, size_t count)
+{
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&heap_profile_lock, state);
+    size_t n = 0;
+    for (size_t i = 0; i < HEAP_PROFILE_SLOTS && n < count; i++) {
+        if (heap_profile_table[i].ptr)
+            samples[n++] = heap_profile_table[i].sample;
+    }
+    size_t live = heap_profile_live;
+    spin_unlock_irqrestore(&heap_profile_lock, state);
+    return live;
+}
+
+size_t heap_profile_max_samples(void)
+{
+    return HEAP_PROFILE_MAX_LIVE;
+}
+
+static void heap_profile_init(uint level)
+{
+    uint64_t rate = cmdline_get_uint64("kernel.heap.profile-rate", 0);
+    if (rate)
+        heap_profile_set_rate((size_t)rate);
+}
+
+LK_INIT_HOOK(heap_profile, heap_profile_init, LK_INIT_LEVEL_THREADING);
+
 void heap_init(void)
 {
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++)
+        spin_lock_init(&slab_caches[cpu].lock);
     cmpct_init();
 }
 
 void heap_trim(void)
 {
+    slab_drain_all();
     cmpct_trim();
 }
 
@@ -54,7 +391,8 @@ void *malloc(size_t size)
 
     LTRACEF("size %zu\n", size);
 
-    void *ptr = cmpct_alloc(size);
+    void *ptr = slab_alloc(size);
+    heap_profile_alloc(ptr, size, __GET_CALLER(), __GET_FRAME());
     if (unlikely(heap_trace))
         printf("caller %p malloc %zu -> %p\n", __GET_CALLER(), size, ptr);
 
@@ -72,6 +410,7 @@ void *memalign(size_t boundary, size_t size)
     LTRACEF("boundary %zu, size %zu\n", boundary, size);
 
     void *ptr = cmpct_memalign(size, boundary);
+    heap_profile_alloc(ptr, size, __GET_CALLER(), __GET_FRAME());
     if (unlikely(heap_trace))
         printf("caller %p memalign %zu, %zu -> %p\n", __GET_CALLER(), boundary, size, ptr);
 
@@ -90,9 +429,10 @@ void *calloc(size_t count, size_t size)
 
     size_t realsize = count * size;
 
-    void *ptr = cmpct_alloc(realsize);
+    void *ptr = slab_alloc(realsize);
     if (likely(ptr))
         memset(ptr, 0, realsize);
+    heap_profile_alloc(ptr, realsize, __GET_CALLER(), __GET_FRAME());
     if (unlikely(heap_trace))
         printf("caller %p calloc %zu, %zu -> %p\n", __GET_CALLER(), count, size, ptr);
     return ptr;
@@ -105,6 +445,9 @@ void *realloc(void *ptr, size_t size)
     LTRACEF("ptr %p, size %zu\n", ptr, size);
 
     void *ptr2 = cmpct_realloc(ptr, size);
+    if (ptr)
+        heap_profile_free(ptr);
+    heap_profile_alloc(ptr2, size, __GET_CALLER(), __GET_FRAME());
     if (unlikely(heap_trace))
         printf("caller %p realloc %p, %zu -> %p\n", __GET_CALLER(), ptr, size, ptr2);
 
@@ -123,18 +466,65 @@ void free(void *ptr)
     if (unlikely(heap_trace))
         printf("caller %p free %p\n", __GET_CALLER(), ptr);
 
-    cmpct_free(ptr);
+    if (ptr) {
+        heap_profile_free(ptr);
+        slab_free(ptr);
+    }
 }
 
 static void heap_dump(bool panic_time)
 {
     cmpct_dump(panic_time);
+    slab_dump();
 }
 
 void heap_get_info(size_t *size_bytes, size_t *free_bytes) {
     cmpct_get_info(size_bytes, free_bytes);
 }
 
+static int heap_sample_compare(const void *a, const void *b)
+{
+    const heap_sample_t *sa = (const heap_sample_t *)a;
+    const heap_sample_t *sb = (const heap_sample_t *)b;
+    for (size_t i = 0; i < HEAP_PROFILE_DEPTH; i++) {
+        if (sa->pc[i] != sb->pc[i])
+            return (uintptr_t)sa->pc[i] < (uintptr_t)sb->pc[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* prints the live samples, one line per distinct backtrace */
+static void heap_profile_dump(void)
+{
+    size_t max = heap_profile_max_samples();
+    heap_sample_t *samples = (heap_sample_t *)malloc(max * sizeof(*samples));
+    if (!samples) {
+        printf("no memory for the samples\n");
+        return;
+    }
+    size_t live = heap_profile_get_samples(samples, max);
+    size_t n = MIN(live, max);
+    printf("rate %zu, %zu samples, %" PRIu64 " dropped\n",
+           heap_profile_get_rate(), n, heap_profile_dropped);
+
+    qsort(samples, n, sizeof(*samples), heap_sample_compare);
+    printf("\t      bytes   count  backtrace\n");
+    for (size_t i = 0; i < n;) {
+        size_t weight = 0, count = 0;
+        size_t j = i;
+        for (; j < n && heap_sample_compare(&samples[i], &samples[j]) == 0; j++) {
+            weight += samples[j].weight;
+            count++;
+        }
+        printf("\t%11zu %7zu ", weight, count);
+        for (size_t d = 0; d < HEAP_PROFILE_DEPTH && samples[i].pc[d]; d++)
+            printf(" %p", samples[i].pc[d]);
+        printf("\n");
+        i = j;
+    }
+    free(samples);
+}
+
 static void heap_test(void)
 {
     cmpct_test();
@@ -189,6 +579,8 @@ usage:
         if (!(flags & CMD_FLAG_PANIC)) {
             printf("\t%s trace\n", argv[0].str);
             printf("\t%s trim\n", argv[0].str);
+            printf("\t%s profile <rate in bytes, 0 for off>\n", argv[0].str);
+            printf("\t%s samples\n", argv[0].str);
             printf("\t%s alloc <size> [alignment]\n", argv[0].str);
             printf("\t%s realloc <ptr> <size>\n", argv[0].str);
             printf("\t%s free <address>\n", argv[0].str);
@@ -205,6 +597,13 @@ usage:
         printf("heap trace is now %s\n", heap_trace ? "on" : "off");
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "trim") == 0) {
         heap_trim();
+    } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "profile") == 0) {
+        if (argc < 3) goto notenoughargs;
+
+        heap_profile_set_rate(argv[2].u);
+        printf("heap profile rate is now %zu\n", heap_profile_get_rate());
+    } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "samples") == 0) {
+        heap_profile_dump();
     } else if (!(flags & CMD_FLAG_PANIC) && strcmp(argv[1].str, "alloc") == 0) {
         if (argc < 3) goto notenoughargs;
 
@@ -34,4 +34,31 @@ void heap_page_free(void *ptr, size_t pages);
  */
 void heap_get_info(size_t *size_bytes, size_t *free_bytes);
 
+/* Sampled allocation profiling.
+ * With a nonzero rate, about one allocation per |rate| bytes allocated is
+ * recorded along with a short backtrace of its caller, and kept until it is
+ * freed. Setting the rate forgets the samples recorded so far; a rate of
+ * zero turns profiling off.
+ */
+#define HEAP_PROFILE_DEPTH 5
+
+typedef struct heap_sample {
+    size_t size;
+    /* the number of bytes allocated that the sample stands for */
+    size_t weight;
+    /* the allocation's caller first, then its callers; null past the end */
+    void *pc[HEAP_PROFILE_DEPTH];
+} heap_sample_t;
+
+void heap_profile_set_rate(size_t rate);
+size_t heap_profile_get_rate(void);
+
+/* Copies up to |count| of the live samples into |samples|. Returns the
+ * number of live samples, which may be more than |count|.
+ */
+size_t heap_profile_get_samples(heap_sample_t *samples, size_t count);
+
+/* The most samples that are kept at any one time. */
+size_t heap_profile_max_samples(void);
+
 __END_CDECLS
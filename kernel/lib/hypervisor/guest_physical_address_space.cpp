@@ -56,7 +56,9 @@ zx_status_t GuestPhysicalAddressSpace::Create(fbl::RefPtr<VmObject> guest_phys_m
     if (!gpas->paspace_)
         return ZX_ERR_NO_MEMORY;
 
-    // Initialize our VMAR with the provided VMO, mapped at address 0.
+    // Initialize our VMAR with the provided VMO, mapped at address 0. Nothing
+    // is mapped yet; EPT violations fault pages in as the guest touches them,
+    // and a VMO created with large pages gets each 2MB run mapped whole.
     fbl::RefPtr<VmMapping> mapping;
     zx_status_t status = gpas->paspace_->RootVmar()->CreateVmMapping(
         0 /* mapping_offset */, guest_phys_mem->size(), /* align_pow2*/ 0, VMAR_FLAG_SPECIFIC,
@@ -70,13 +70,20 @@ public:
 
     // Waits for an interrupt.
     zx_status_t Wait(StateInvalidator* invalidator) {
+        return Wait(invalidator, [this]() { return Pending(); });
+    }
+
+    // Waits until |pending| returns true. This is for interrupts that are kept
+    // outside of the tracker, whose senders call Signal().
+    template <typename F>
+    zx_status_t Wait(StateInvalidator* invalidator, F pending) {
         if (invalidator != nullptr)
             invalidator->Invalidate();
         do {
             zx_status_t status = event_wait_deadline(&event_, ZX_TIME_INFINITE, true);
             if (status != ZX_OK)
                 return ZX_ERR_CANCELED;
-        } while (!Pending());
+        } while (!pending());
         return ZX_OK;
     }
 
@@ -10,6 +10,7 @@
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/ref_ptr.h>
 #include <hypervisor/state_invalidator.h>
+#include <object/event_dispatcher.h>
 #include <object/port_dispatcher.h>
 #include <object/semaphore.h>
 
@@ -33,14 +34,18 @@ private:
 class Trap : public fbl::WAVLTreeContainable<fbl::unique_ptr<Trap>> {
 public:
     Trap(uint32_t kind, zx_vaddr_t addr, size_t len, fbl::RefPtr<PortDispatcher> port,
-         uint64_t key);
+         fbl::RefPtr<EventDispatcher> event, uint64_t key);
 
     zx_status_t Init();
     zx_status_t Queue(const zx_port_packet_t& packet, StateInvalidator* invalidator);
+    // Signals the trap's event. Unlike a packet, this never blocks, and
+    // signals coalesce until the event is cleared.
+    zx_status_t Signal();
 
     zx_vaddr_t GetKey() const { return addr_; }
     bool Contains(zx_vaddr_t val) const { return val >= addr_ && val < addr_ + len_; }
     bool HasPort() const { return !!port_; }
+    bool HasEvent() const { return !!event_; }
 
     uint32_t kind() const { return kind_; }
     zx_vaddr_t addr() const { return addr_; }
@@ -52,6 +57,7 @@ private:
     const zx_vaddr_t addr_;
     const size_t len_;
     const fbl::RefPtr<PortDispatcher> port_;
+    const fbl::RefPtr<EventDispatcher> event_;
     const uint64_t key_; // Key for packets in this port range.
     BlockingPortAllocator port_allocator_;
 };
@@ -60,7 +66,8 @@ private:
 class TrapMap {
 public:
     zx_status_t InsertTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                           fbl::RefPtr<PortDispatcher> port, uint64_t key);
+                           fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                           uint64_t key);
     zx_status_t FindTrap(uint32_t kind, zx_vaddr_t addr, Trap** trap);
 
 private:
@@ -37,8 +37,9 @@ void BlockingPortAllocator::Free(PortPacket* port_packet) {
 }
 
 Trap::Trap(uint32_t kind, zx_vaddr_t addr, size_t len, fbl::RefPtr<PortDispatcher> port,
-                     uint64_t key)
-    : kind_(kind), addr_(addr), len_(len), port_(fbl::move(port)), key_(key) {
+           fbl::RefPtr<EventDispatcher> event, uint64_t key)
+    : kind_(kind), addr_(addr), len_(len), port_(fbl::move(port)), event_(fbl::move(event)),
+      key_(key) {
     (void) key_;
 }
 
@@ -61,8 +62,15 @@ zx_status_t Trap::Queue(const zx_port_packet_t& packet, StateInvalidator* invali
     return status;
 }
 
+zx_status_t Trap::Signal() {
+    if (event_ == nullptr)
+        return ZX_ERR_NOT_FOUND;
+    return event_->user_signal(0u, ZX_EVENT_SIGNALED, false);
+}
+
 zx_status_t TrapMap::InsertTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                                fbl::RefPtr<PortDispatcher> port, uint64_t key) {
+                                fbl::RefPtr<PortDispatcher> port, fbl::RefPtr<EventDispatcher> event,
+                                uint64_t key) {
     TrapTree* traps = TreeOf(kind);
     if (traps == nullptr)
         return ZX_ERR_INVALID_ARGS;
@@ -74,7 +82,8 @@ zx_status_t TrapMap::InsertTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
         return ZX_ERR_ALREADY_EXISTS;
     }
     fbl::AllocChecker ac;
-    fbl::unique_ptr<Trap> range(new (&ac) Trap(kind, addr, len, fbl::move(port), key));
+    fbl::unique_ptr<Trap> range(new (&ac) Trap(kind, addr, len, fbl::move(port),
+                                               fbl::move(event), key));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
     zx_status_t status = range->Init();
@@ -0,0 +1,84 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+/*
+ * Macros for writing kernel microbenchmarks.
+ *
+ * Benchmarks are registered in cases, the same way lib/unittest test cases
+ * are:
+ *
+ *  KBENCH_START_CASE(pmm_benchmarks)
+ *  KBENCH("alloc_free_page", bench_alloc_free_page)
+ *  KBENCH("alloc_free_pages", bench_alloc_free_pages)
+ *  KBENCH_END_CASE(pmm_benchmarks, "pmm", "Physical page allocator",
+ *                  init_pmm_bench, cleanup_pmm_bench);
+ *
+ * A benchmark function performs the operation being measured |iterations|
+ * times.  The framework runs it on one thread pinned to each of the cpus
+ * asked for, all at the same time, and times whole calls with
+ * current_ticks(), so the loop overhead is counted too.  The case's init and
+ * cleanup functions, if any, run on every one of those threads, before and
+ * after all of the case's benchmarks, so each cpu gets a context of its own.
+ *
+ * From the kernel console:
+ *
+ *  kbench ?                              list the cases
+ *  kbench <case|all> [cpus] [iterations] run them, on cpus 0 to cpus - 1
+ *
+ * Userspace holding the root resource can run the same commands with
+ * zx_debug_send_command().
+ */
+
+#include <stddef.h>
+#include <zircon/compiler.h>
+#include <zircon/types.h>
+
+__BEGIN_CDECLS
+
+typedef void        (*kbench_fn_t)(void* context, size_t iterations);
+typedef zx_status_t (*kbench_init_fn_t)(void** context);
+typedef void        (*kbench_cleanup_fn_t)(void* context);
+
+typedef struct kbench_registration {
+    const char* name;
+    kbench_fn_t fn;
+} kbench_registration_t;
+
+typedef struct kbench_case_registration {
+    const char*                  name;
+    const char*                  desc;
+    kbench_init_fn_t             init;
+    kbench_cleanup_fn_t          cleanup;
+    const kbench_registration_t* benches;
+    size_t                       bench_cnt;
+} kbench_case_registration_t;
+
+#ifdef WITH_LIB_KBENCH
+#define KBENCH_START_CASE(_global_id) \
+    static const kbench_registration_t __kbench_table_##_global_id[] = {
+
+#define KBENCH(_name, _fn) \
+    { .name = _name, .fn = _fn },
+
+#define KBENCH_END_CASE(_global_id, _name, _desc, _init, _cleanup)        \
+    };  /* __kbench_table_##_global_id */                                 \
+    __ALIGNED(sizeof(void *)) __USED __SECTION(".data.rel.ro.kbench_cases") \
+    static const kbench_case_registration_t __kbench_case_##_global_id = { \
+        .name = _name,                                                    \
+        .desc = _desc,                                                    \
+        .init = _init,                                                    \
+        .cleanup = _cleanup,                                              \
+        .benches = __kbench_table_##_global_id,                           \
+        .bench_cnt = countof(__kbench_table_##_global_id),                \
+    }
+#else   // WITH_LIB_KBENCH
+#define KBENCH_START_CASE(_global_id)
+#define KBENCH(_name, _fn)
+#define KBENCH_END_CASE(_global_id, _name, _desc, _init, _cleanup)
+#endif  // WITH_LIB_KBENCH
+
+__END_CDECLS
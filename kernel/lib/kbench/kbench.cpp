@@ -0,0 +1,240 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// Runs the benchmarks registered with lib/kbench.h.  See the header for usage.
+
+#include <lib/kbench.h>
+
+#include <arch/ops.h>
+#include <debug.h>
+#include <err.h>
+#include <inttypes.h>
+#include <kernel/atomic.h>
+#include <kernel/cpu.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+
+#if defined(WITH_LIB_CONSOLE)
+#include <lib/console.h>
+
+// External references to the case registration table.
+extern const kbench_case_registration_t __start_kbench_cases[];
+extern const kbench_case_registration_t __stop_kbench_cases[];
+
+namespace {
+
+constexpr size_t kDefaultIterations = 10000;
+// Every benchmark is timed this many times on each cpu.
+constexpr size_t kRounds = 16;
+
+// The last thread to get to the barrier lets all of them go.  The threads
+// spin rather than block while they wait, so that they all start together,
+// and so mustn't depend on anything else getting to run on their cpus.
+struct Barrier {
+    int expected;
+    volatile int ready;
+    volatile int go;
+};
+
+// The state of one pinned benchmark thread.
+struct Runner {
+    const kbench_case_registration_t* kcase;
+    size_t iterations;
+    Barrier* barriers;  // one per benchmark in the case
+    thread_t* thread;
+    zx_status_t init_status;
+    uint64_t* results;  // [bench_cnt][kRounds]
+};
+
+uint64_t ticks_to_ns(uint64_t ticks) {
+    uint64_t tps = ticks_per_second();
+    return (ticks / tps) * ZX_SEC(1) + (ticks % tps) * ZX_SEC(1) / tps;
+}
+
+int runner_thread(void* arg) {
+    Runner* r = static_cast<Runner*>(arg);
+    const kbench_case_registration_t* kcase = r->kcase;
+
+    void* context = nullptr;
+    r->init_status = kcase->init ? kcase->init(&context) : ZX_OK;
+
+    for (size_t b = 0; b < kcase->bench_cnt; b++) {
+        const kbench_registration_t* bench = &kcase->benches[b];
+        Barrier* barrier = &r->barriers[b];
+
+        // Warm up the caches and whatever the benchmark allocates, then wait
+        // for every other cpu to get here too.
+        if (r->init_status == ZX_OK)
+            bench->fn(context, r->iterations);
+        if (atomic_add(&barrier->ready, 1) + 1 == barrier->expected)
+            atomic_store(&barrier->go, 1);
+        while (!atomic_load(&barrier->go))
+            arch_spinloop_pause();
+
+        for (size_t i = 0; i < kRounds; i++) {
+            if (r->init_status != ZX_OK)
+                break;
+            uint64_t start = current_ticks();
+            bench->fn(context, r->iterations);
+            r->results[b * kRounds + i] = current_ticks() - start;
+        }
+    }
+
+    if (r->init_status == ZX_OK && kcase->cleanup)
+        kcase->cleanup(context);
+    return 0;
+}
+
+int compare_ticks(const void* a, const void* b) {
+    uint64_t ta = *static_cast<const uint64_t*>(a);
+    uint64_t tb = *static_cast<const uint64_t*>(b);
+    return ta < tb ? -1 : ta > tb;
+}
+
+// Prints a time per iteration, in ns with one decimal.
+void print_per_op(uint64_t ticks, size_t iterations) {
+    uint64_t tenths = ticks_to_ns(ticks * 10) / iterations;
+    printf(" %9" PRIu64 ".%" PRIu64, tenths / 10, tenths % 10);
+}
+
+bool run_case(const kbench_case_registration_t* kcase, uint num_cpus, size_t iterations) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Barrier[]> barriers(new (&ac) Barrier[kcase->bench_cnt]());
+    if (!ac.check())
+        return false;
+    fbl::unique_ptr<Runner[]> runners(new (&ac) Runner[num_cpus]());
+    if (!ac.check())
+        return false;
+    fbl::unique_ptr<uint64_t[]> results(new (&ac) uint64_t[num_cpus * kcase->bench_cnt * kRounds]());
+    if (!ac.check())
+        return false;
+
+    printf("%s : %zu benchmark%s, %zu iterations x %zu rounds on %u cpu%s\n",
+           kcase->name, kcase->bench_cnt, kcase->bench_cnt == 1 ? "" : "s",
+           iterations, kRounds, num_cpus, num_cpus == 1 ? "" : "s");
+
+    uint started = 0;
+    for (uint cpu = 0; cpu < num_cpus; cpu++) {
+        Runner* r = &runners[cpu];
+        r->kcase = kcase;
+        r->iterations = iterations;
+        r->barriers = barriers.get();
+        r->results = &results[cpu * kcase->bench_cnt * kRounds];
+        r->thread = thread_create("kbench", runner_thread, r, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+        if (!r->thread)
+            break;
+        thread_set_cpu_affinity(r->thread, cpu_num_to_mask(cpu));
+        started++;
+    }
+    if (started < num_cpus)
+        printf("%s : only started %u of %u threads\n", kcase->name, started, num_cpus);
+
+    for (size_t b = 0; b < kcase->bench_cnt; b++)
+        barriers[b].expected = started;
+    for (uint cpu = 0; cpu < started; cpu++)
+        thread_resume(runners[cpu].thread);
+
+    bool ok = started == num_cpus;
+    for (uint cpu = 0; cpu < started; cpu++) {
+        thread_join(runners[cpu].thread, nullptr, ZX_TIME_INFINITE);
+        if (runners[cpu].init_status != ZX_OK) {
+            printf("%s : init failed on cpu %u (status %d)\n",
+                   kcase->name, cpu, runners[cpu].init_status);
+            ok = false;
+        }
+    }
+    if (!ok)
+        return false;
+
+    // The rows are ns per iteration: the fastest, median and slowest round.
+    printf("  %-24s %4s %11s %11s %11s\n", "benchmark", "cpu", "min ns", "median ns", "max ns");
+    for (size_t b = 0; b < kcase->bench_cnt; b++) {
+        for (uint cpu = 0; cpu < num_cpus; cpu++) {
+            uint64_t* ticks = &runners[cpu].results[b * kRounds];
+            qsort(ticks, kRounds, sizeof(*ticks), compare_ticks);
+            printf("  %-24s %4u", cpu == 0 ? kcase->benches[b].name : "", cpu);
+            print_per_op(ticks[0], iterations);
+            print_per_op(ticks[kRounds / 2], iterations);
+            print_per_op(ticks[kRounds - 1], iterations);
+            printf("\n");
+        }
+    }
+    return true;
+}
+
+void list_cases() {
+    for (const kbench_case_registration_t* kcase = __start_kbench_cases;
+         kcase != __stop_kbench_cases; ++kcase) {
+        printf("  %-16s : %s\n", kcase->name, kcase->desc ? kcase->desc : "<no description>");
+        for (size_t b = 0; b < kcase->bench_cnt; b++)
+            printf("      %s\n", kcase->benches[b].name);
+    }
+}
+
+int cmd_kbench(int argc, const cmd_args* argv, uint32_t flags) {
+    if (argc < 2 || argc > 4) {
+        printf("Usage:\n"
+               "%s <case> [cpus] [iterations]\n"
+               "  where case is a specific case name, or...\n"
+               "  all : run all cases\n"
+               "  ?   : list cases\n"
+               "  cpus defaults to 1, and 0 means every cpu\n",
+               argv[0].str);
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    const char* name = argv[1].str;
+    if (!strcmp(name, "?")) {
+        list_cases();
+        return 0;
+    }
+
+    uint num_cpus = (argc > 2) ? static_cast<uint>(argv[2].u) : 1;
+    if (num_cpus == 0 || num_cpus > arch_max_num_cpus())
+        num_cpus = arch_max_num_cpus();
+    for (uint cpu = 0; cpu < num_cpus; cpu++) {
+        if (!mp_is_cpu_online(cpu)) {
+            printf("cpu %u is not online\n", cpu);
+            return ZX_ERR_BAD_STATE;
+        }
+    }
+    size_t iterations = (argc > 3) ? argv[3].u : kDefaultIterations;
+    if (iterations == 0)
+        iterations = kDefaultIterations;
+
+    bool all = !strcmp(name, "all");
+    bool found = false;
+    bool ok = true;
+    for (const kbench_case_registration_t* kcase = __start_kbench_cases;
+         kcase != __stop_kbench_cases; ++kcase) {
+        if (all || !strcmp(name, kcase->name)) {
+            found = true;
+            ok = run_case(kcase, num_cpus, iterations) && ok;
+            printf("\n");
+        }
+    }
+    if (!found) {
+        printf("Benchmark case \"%s\" not found!\n", name);
+        list_cases();
+        return ZX_ERR_NOT_FOUND;
+    }
+    return ok ? 0 : ZX_ERR_INTERNAL;
+}
+
+}  // namespace
+
+STATIC_COMMAND_START
+STATIC_COMMAND("kbench", "run kernel microbenchmarks", &cmd_kbench)
+STATIC_COMMAND_END(kbench);
+
+#endif  // WITH_LIB_CONSOLE
@@ -7,10 +7,15 @@
 #include <debug.h>
 #include <err.h>
 #include <platform.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <inttypes.h>
+#include <kernel/align.h>
 #include <kernel/cmdline.h>
 #include <vm/vm_aspace.h>
 #include <lib/ktrace.h>
@@ -68,6 +73,22 @@ static void ktrace_add_probe(ktrace_probe_info_t* probe) TA_REQ(probe_list_lock)
     ktrace_name_etc(TAG_PROBE_NAME, probe->num, 0, probe->name, true);
 }
 
+// Returns the number of the probe called |name|, registering it if needed.
+static int ktrace_probe_by_name(const char* name) TA_REQ(probe_list_lock) {
+    ktrace_probe_info_t* probe;
+    if ((probe = ktrace_find_probe(name)) != nullptr) {
+        return probe->num;
+    }
+    probe = (ktrace_probe_info_t*) calloc(sizeof(*probe) + ZX_MAX_NAME_LEN, 1);
+    if (probe == nullptr) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    probe->name = (const char*) (probe + 1);
+    strlcpy((char*) (probe + 1), name, ZX_MAX_NAME_LEN);
+    ktrace_add_probe(probe);
+    return probe->num;
+}
+
 static void ktrace_report_probes(void) {
     fbl::AutoLock lock(&probe_list_lock);
     ktrace_probe_info_t *probe;
@@ -76,59 +97,269 @@ static void ktrace_report_probes(void) {
     }
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
+// Each cpu writes into its own slice of the trace buffer, so writers on
+// different cpus never share a cache line. A slice is split into blocks and
+// records never straddle a block, which means every block starts on a record
+// boundary and whole blocks can be recycled in circular mode.
+static constexpr uint32_t kBlockSize = 16 * 1024;
+
+typedef struct ktrace_cpu {
+    // virtual offset where the next record will be written; it grows
+    // without wrapping and maps to block (head / kBlockSize) % nblocks
+    fbl::atomic<uint64_t> head;
+
+    // streaming: virtual offset of the first byte not yet drained
+    fbl::atomic<uint64_t> tail;
+
+    // streaming: head as seen by the previous drain. Records below it have
+    // had a whole drain interval to be filled in.
+    uint64_t drain_limit;
+
+    // streaming: records dropped because the ring was full
+    fbl::atomic<uint64_t> dropped;
+
+    // this cpu's slice of the trace buffer
+    uint8_t* buffer;
 
+    // bytes of each block holding records, stored when a writer moves on
+    // to the next block
+    uint32_t* block_used;
+} __CPU_ALIGN ktrace_cpu_t;
+
+typedef struct ktrace_state {
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // KTRACE_MODE_*, only changed while tracing is stopped
+    uint32_t mode;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // number of cpu slices, 0 if there is no trace buffer
+    uint32_t ncpus;
 
-    // raw trace buffer
-    uint8_t* buffer;
+    // blocks in each cpu slice
+    uint32_t nblocks;
+
+    // streaming: the metadata records have not been drained yet
+    bool metadata_pending;
+
+    // version and ticks per ms, reported ahead of all other records
+    ktrace_rec_32b_t metadata[2];
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
+static ktrace_cpu_t ktrace_cpus[SMP_MAX_CPUS];
+
+// Serializes readers, which move the streaming tails.
+static fbl::Mutex ktrace_read_lock;
 
+static uint64_t ktrace_capacity(ktrace_state_t* ks) {
+    return static_cast<uint64_t>(ks->nblocks) * kBlockSize;
+}
+
+// Claims |len| bytes in the current cpu's slice, or returns nullptr if the
+// record can't be written in the current mode.
+static void* ktrace_reserve(ktrace_state_t* ks, uint32_t len) {
+    if (ks->ncpus == 0) {
+        return nullptr;
+    }
+
+    // A thread that migrates after this still reserves atomically, it just
+    // writes into the slice of the cpu it started on.
+    ktrace_cpu_t* cpu = &ktrace_cpus[arch_curr_cpu_num()];
+    uint64_t pos = cpu->head.load(fbl::memory_order_relaxed);
+    uint64_t start;
+    do {
+        uint64_t in_block = pos % kBlockSize;
+        start = (in_block + len > kBlockSize) ? pos - in_block + kBlockSize : pos;
+
+        switch (ks->mode) {
+        case KTRACE_MODE_LINEAR:
+            if (start + len > ktrace_capacity(ks)) {
+                // if we arrive at the end, stop
+                atomic_store(&ks->grpmask, 0);
+                return nullptr;
+            }
+            break;
+        case KTRACE_MODE_STREAMING:
+            if (start + len - cpu->tail.load() > ktrace_capacity(ks)) {
+                cpu->dropped.fetch_add(1);
+                return nullptr;
+            }
+            break;
+        }
+    } while (!cpu->head.compare_exchange_strong(&pos, start + len, fbl::memory_order_relaxed,
+                                                fbl::memory_order_relaxed));
+
+    // Moving into a new block closes the previous one.
+    if (start % kBlockSize == 0 && start != 0) {
+        cpu->block_used[(start / kBlockSize - 1) % ks->nblocks] =
+            static_cast<uint32_t>(pos + kBlockSize - start);
+    }
+
+    return cpu->buffer + (start / kBlockSize % ks->nblocks) * kBlockSize + start % kBlockSize;
+}
+
+// Returns the virtual offset of the oldest record still held by |cpu|.
+static uint64_t ktrace_oldest(ktrace_state_t* ks, ktrace_cpu_t* cpu, uint64_t head) {
+    if (ks->mode == KTRACE_MODE_STREAMING) {
+        return cpu->tail.load();
+    }
+    uint64_t last = (head == 0) ? 0 : (head - 1) / kBlockSize;
+    return (last >= ks->nblocks) ? (last - ks->nblocks + 1) * kBlockSize : 0;
+}
+
+// Calls |fn(data, len)| on each run of records in |cpu| between the virtual
+// offsets |from| and |to|, oldest first. |fn| returns how much of the run it
+// consumed; a short count ends the walk. Returns where the walk stopped.
+template <typename F>
+static uint64_t ktrace_for_each_run(ktrace_state_t* ks, ktrace_cpu_t* cpu,
+                                    uint64_t from, uint64_t to, F fn) {
+    uint64_t pos = from;
+    while (pos < to) {
+        uint64_t block_start = pos - pos % kBlockSize;
+        uint64_t end = (to - block_start <= kBlockSize)
+                           ? to
+                           : block_start + cpu->block_used[block_start / kBlockSize % ks->nblocks];
+        if (end > pos) {
+            uint64_t size = end - pos;
+            uint64_t n = fn(cpu->buffer + (block_start / kBlockSize % ks->nblocks) * kBlockSize +
+                                pos % kBlockSize,
+                            size);
+            if (n < size) {
+                return pos + n;
+            }
+        }
+        pos = (end == to) ? to : block_start + kBlockSize;
+    }
+    return pos;
+}
+
+// Starts every cpu slice over, keeping the metadata.
+static void ktrace_rewind(ktrace_state_t* ks) {
+    fbl::AutoLock lock(&ktrace_read_lock);
+    for (uint32_t i = 0; i < ks->ncpus; i++) {
+        ktrace_cpu_t* cpu = &ktrace_cpus[i];
+        cpu->head.store(0);
+        cpu->tail.store(0);
+        cpu->drain_limit = 0;
+        cpu->dropped.store(0);
+    }
+    ks->metadata_pending = true;
+}
+
+// Reads the trace as if it were one buffer: the metadata followed by each
+// cpu's records, oldest first.
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->ncpus == 0) {
+        return 0;
+    }
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+    fbl::AutoLock lock(&ktrace_read_lock);
+
+    uint64_t pos = 0;
+    uint32_t copied = 0;
+    zx_status_t status = ZX_OK;
+    auto copy_run = [&](const uint8_t* data, uint64_t size) -> uint64_t {
+        // copy the part of [pos, pos + size) that falls inside [off, off + len)
+        if (ptr != nullptr && pos + size > off && pos < static_cast<uint64_t>(off) + len) {
+            uint64_t skip = (pos < off) ? off - pos : 0;
+            uint64_t n = fbl::min(size - skip, static_cast<uint64_t>(len - copied));
+            if (arch_copy_to_user(static_cast<uint8_t*>(ptr) + copied, data + skip, n) != ZX_OK) {
+                status = ZX_ERR_INVALID_ARGS;
+                return 0;
+            }
+            copied += static_cast<uint32_t>(n);
         }
+        pos += size;
+        return size;
+    };
+
+    copy_run(reinterpret_cast<const uint8_t*>(ks->metadata), sizeof(ks->metadata));
+    for (uint32_t i = 0; i < ks->ncpus && status == ZX_OK; i++) {
+        ktrace_cpu_t* cpu = &ktrace_cpus[i];
+        uint64_t head = cpu->head.load();
+        ktrace_for_each_run(ks, cpu, ktrace_oldest(ks, cpu, head), head, copy_run);
+    }
+    if (status != ZX_OK) {
+        return status;
     }
 
     // null read is a query for trace buffer size
     if (ptr == nullptr) {
-        return max;
+        return static_cast<int>(fbl::min(pos, static_cast<uint64_t>(INT32_MAX)));
     }
+    return copied;
+}
 
-    // constrain read to available buffer
-    if (off >= max) {
+// Moves complete records that haven't been drained yet into |ptr|, while
+// tracing carries on. Returns the number of bytes copied.
+static int ktrace_drain_user(ktrace_state_t* ks, void* ptr, uint32_t len) {
+    if (ks->mode != KTRACE_MODE_STREAMING) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (ks->ncpus == 0) {
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+    len = fbl::min(len, static_cast<uint32_t>(INT32_MAX));
+
+    fbl::AutoLock lock(&ktrace_read_lock);
+
+    uint32_t copied = 0;
+    if (ks->metadata_pending) {
+        if (len < sizeof(ks->metadata)) {
+            return ZX_ERR_BUFFER_TOO_SMALL;
+        }
+        if (arch_copy_to_user(ptr, ks->metadata, sizeof(ks->metadata)) != ZX_OK) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        copied = sizeof(ks->metadata);
+        ks->metadata_pending = false;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
-        return ZX_ERR_INVALID_ARGS;
+    zx_status_t status = ZX_OK;
+    auto copy_records = [&](const uint8_t* data, uint64_t size) -> uint64_t {
+        // only whole records go out, so stop at the last one that fits
+        uint64_t n = 0;
+        uint64_t consumed = 0;
+        while (n < size) {
+            uint32_t rec_len = KTRACE_LEN(*reinterpret_cast<const uint32_t*>(data + n));
+            if (rec_len == 0 || rec_len > size - n) {
+                // a record that was never filled in; give up on the run
+                consumed = size;
+                break;
+            }
+            if (rec_len > len - copied - n) {
+                break;
+            }
+            n += rec_len;
+            consumed = n;
+        }
+        if (arch_copy_to_user(static_cast<uint8_t*>(ptr) + copied, data, n) != ZX_OK) {
+            status = ZX_ERR_INVALID_ARGS;
+            return 0;
+        }
+        copied += static_cast<uint32_t>(n);
+        return consumed;
+    };
+
+    // While tracing is on, a record below the head may still be being
+    // written, so only drain up to where the head was last time.
+    bool active = atomic_load(&ks->grpmask) != 0;
+    for (uint32_t i = 0; i < ks->ncpus && status == ZX_OK; i++) {
+        ktrace_cpu_t* cpu = &ktrace_cpus[i];
+        uint64_t head = cpu->head.load();
+        uint64_t limit = active ? cpu->drain_limit : head;
+        uint64_t tail = cpu->tail.load();
+        if (limit > tail) {
+            cpu->tail.store(ktrace_for_each_run(ks, cpu, tail, limit, copy_records));
+        }
+        cpu->drain_limit = head;
     }
-    return len;
+    if (status != ZX_OK) {
+        return status;
+    }
+    return copied;
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
@@ -136,42 +367,53 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     switch (action) {
     case KTRACE_ACTION_START:
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
         atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
         ktrace_report_live_processes();
         ktrace_report_live_threads();
         break;
     case KTRACE_ACTION_STOP: {
+        if (ks->mode == KTRACE_MODE_CIRCULAR && atomic_load(&ks->grpmask) != 0) {
+            // the names written at the start may have been recycled
+            ktrace_report_syscalls(kt_syscall_info);
+            ktrace_report_probes();
+            ktrace_report_live_processes();
+            ktrace_report_live_threads();
+        }
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
+        uint64_t dropped = 0;
+        for (uint32_t i = 0; i < ks->ncpus; i++) {
+            dropped += ktrace_cpus[i].dropped.load();
+        }
+        if (dropped != 0) {
+            dprintf(INFO, "ktrace: %" PRIu64 " records dropped\n", dropped);
         }
         break;
     }
     case KTRACE_ACTION_REWIND:
         // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+        ktrace_rewind(ks);
         ktrace_report_syscalls(kt_syscall_info);
         ktrace_report_probes();
         break;
     case KTRACE_ACTION_NEW_PROBE: {
         fbl::AutoLock lock(&probe_list_lock);
-        ktrace_probe_info_t* probe;
-        if ((probe = ktrace_find_probe((const char*) ptr)) != nullptr) {
-            return probe->num;
+        return ktrace_probe_by_name((const char*) ptr);
+    }
+    case KTRACE_ACTION_SET_MODE:
+        if (options > KTRACE_MODE_STREAMING) {
+            return ZX_ERR_INVALID_ARGS;
         }
-        probe = (ktrace_probe_info_t*) calloc(sizeof(*probe) + ZX_MAX_NAME_LEN, 1);
-        if (probe == nullptr) {
-            return ZX_ERR_NO_MEMORY;
+        if (atomic_load(&ks->grpmask) != 0) {
+            return ZX_ERR_BAD_STATE;
         }
-        probe->name = (const char*) (probe + 1);
-        memcpy(probe + 1, ptr, ZX_MAX_NAME_LEN);
-        ktrace_add_probe(probe);
-        return probe->num;
-    }
+        // the slices are laid out differently in each mode
+        ks->mode = options;
+        ktrace_rewind(ks);
+        ktrace_report_syscalls(kt_syscall_info);
+        ktrace_report_probes();
+        break;
+    case KTRACE_ACTION_DRAIN:
+        return ktrace_drain_user(ks, ptr, options);
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -180,6 +422,63 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
 
 int trace_not_ready = 0;
 
+// Boot markers made before ktrace_init, in the order they were made.
+static constexpr size_t kMaxEarlyBootMarks = 128;
+
+struct early_boot_mark {
+    const char* group;
+    const char* name;
+    uint64_t ts;
+};
+
+static early_boot_mark early_boot_marks[kMaxEarlyBootMarks];
+static size_t early_boot_mark_count;
+static bool boot_marks_live;
+
+static void ktrace_write_boot_mark(ktrace_state_t* ks, const char* group, const char* name,
+                                   uint64_t ts) {
+    if (!(TAG_PROBE_24(0) & atomic_load(&ks->grpmask))) {
+        return;
+    }
+    char probe[ZX_MAX_NAME_LEN];
+    snprintf(probe, sizeof(probe), "%s:%s", group, name);
+    int num;
+    {
+        fbl::AutoLock lock(&probe_list_lock);
+        num = ktrace_probe_by_name(probe);
+    }
+    if (num < 0) {
+        return;
+    }
+    uint32_t tag = TAG_PROBE_24(num);
+    ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, KTRACE_LEN(tag));
+    if (hdr != nullptr) {
+        hdr->ts = ts;
+        hdr->tag = tag;
+        hdr->tid = 0;
+        memset(hdr + 1, 0, KTRACE_LEN(tag) - KTRACE_HDRSIZE);
+    }
+}
+
+void ktrace_boot_mark(const char* group, const char* name) {
+    uint64_t ts = ktrace_timestamp();
+    if (boot_marks_live) {
+        ktrace_write_boot_mark(&KTRACE_STATE, group, name, ts);
+    } else if (early_boot_mark_count < kMaxEarlyBootMarks) {
+        early_boot_marks[early_boot_mark_count++] = {group, name, ts};
+    }
+}
+
+// Writes out the markers made before the trace buffer existed.  From here on
+// markers go straight into the trace, or nowhere if it is disabled.
+static void ktrace_flush_early_boot_marks(ktrace_state_t* ks) {
+    for (size_t i = 0; i < early_boot_mark_count; i++) {
+        const early_boot_mark& mark = early_boot_marks[i];
+        ktrace_write_boot_mark(ks, mark.group, mark.name, mark.ts);
+    }
+    boot_marks_live = true;
+}
+
 void ktrace_init(unsigned level) {
     ktrace_state_t* ks = &KTRACE_STATE;
 
@@ -188,24 +487,62 @@ void ktrace_init(unsigned level) {
 
     if (mb == 0) {
         dprintf(INFO, "ktrace: disabled\n");
+        boot_marks_live = true;
         return;
     }
 
     mb *= (1024*1024);
 
+    uint32_t mode = cmdline_get_uint32("ktrace.mode", KTRACE_MODE_LINEAR);
+    if (mode > KTRACE_MODE_STREAMING) {
+        dprintf(INFO, "ktrace: unknown mode %u\n", mode);
+        mode = KTRACE_MODE_LINEAR;
+    }
+
+    // give each cpu at least one block
+    uint32_t ncpus = arch_max_num_cpus();
+    uint32_t nblocks = mb / ncpus / kBlockSize;
+    if (nblocks == 0) {
+        nblocks = 1;
+        mb = ncpus * kBlockSize;
+    }
+
+    uint8_t* buffer;
     zx_status_t status;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VmAspace::VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", mb, (void**)&buffer, 0, VmAspace::VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
+        boot_marks_live = true;
+        return;
+    }
+
+    uint32_t* block_used = static_cast<uint32_t*>(calloc(ncpus * nblocks, sizeof(uint32_t)));
+    if (block_used == nullptr) {
+        dprintf(INFO, "ktrace: cannot alloc block table\n");
+        aspace->FreeRegion(reinterpret_cast<vaddr_t>(buffer));
+        boot_marks_live = true;
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    for (uint32_t i = 0; i < ncpus; i++) {
+        ktrace_cpus[i].buffer = buffer + static_cast<size_t>(i) * nblocks * kBlockSize;
+        ktrace_cpus[i].block_used = block_used + i * nblocks;
+    }
+    ks->mode = mode;
+    ks->nblocks = nblocks;
+
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u cpus)\n", buffer, mb, ncpus);
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    // write metadata; it is kept apart from the cpu slices so it can't be
+    // overwritten
+    uint64_t n = ktrace_ticks_per_ms();
+    ks->metadata[0].tag = TAG_VERSION;
+    ks->metadata[0].a = KTRACE_VERSION;
+    ks->metadata[1].tag = TAG_TICKS_PER_MS;
+    ks->metadata[1].a = (uint32_t)n;
+    ks->metadata[1].b = (uint32_t)(n >> 32);
+    ks->metadata_pending = true;
 
     // register all static probes
     {
@@ -217,17 +554,8 @@ void ktrace_init(unsigned level) {
         }
     }
 
-    // write metadata to the first two event slots
-    uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
-    rec[0].tag = TAG_VERSION;
-    rec[0].a = KTRACE_VERSION;
-    rec[1].tag = TAG_TICKS_PER_MS;
-    rec[1].a = (uint32_t)n;
-    rec[1].b = (uint32_t)(n >> 32);
-
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+    ks->ncpus = ncpus;
     ktrace_report_syscalls(kt_syscall_info);
     ktrace_report_probes();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
@@ -240,18 +568,16 @@ void ktrace_init(unsigned level) {
     // entry so that the __{start,stop}_ktrace_probe symbols above
     // will be defined by the linker.
     ktrace_probe0("ktrace_ready");
+
+    ktrace_flush_early_boot_marks(ks);
 }
 
 void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
+        ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, KTRACE_HDRSIZE);
+        if (hdr != nullptr) {
             hdr->ts = ktrace_timestamp();
             hdr->tag = tag;
             hdr->tid = arg;
@@ -265,14 +591,11 @@ void* ktrace_open(uint32_t tag) {
         return nullptr;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
+    ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, KTRACE_LEN(tag));
+    if (hdr == nullptr) {
         return nullptr;
     }
 
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
     hdr->ts = ktrace_timestamp();
     hdr->tag = tag;
     hdr->tid = (uint32_t)get_current_thread()->user_tid;
@@ -287,12 +610,8 @@ static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char*
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+        ktrace_rec_name_t* rec = (ktrace_rec_name_t*) ktrace_reserve(ks, KTRACE_LEN(tag));
+        if (rec != nullptr) {
             rec->tag = tag;
             rec->id = id;
             rec->arg = arg;
@@ -17,12 +17,30 @@
 #include "lib/mtrace.h"
 #include "trace.h"
 
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
+#include <object/process_dispatcher.h>
+#include <object/thread_dispatcher.h>
 #include <zircon/mtrace.h>
 
 #include "arch/x86/proc_trace.h"
 
 #define LOCAL_TRACE 0
 
+// The kernel side of PT only knows about thread_t; these keep the threads
+// assigned to each trace buffer descriptor alive.
+static fbl::Mutex ipt_threads_lock;
+static fbl::RefPtr<ThreadDispatcher> ipt_threads[IPT_MAX_NUM_THREADS] TA_GUARDED(ipt_threads_lock);
+
+static zx_status_t get_thread_descriptor(uint32_t options, uint32_t* descriptor) {
+    if ((options & ~MTRACE_IPT_OPTIONS_CPU_MASK) != 0)
+        return ZX_ERR_INVALID_ARGS;
+    *descriptor = MTRACE_IPT_OPTIONS_DESCRIPTOR(options);
+    if (*descriptor >= IPT_MAX_NUM_THREADS)
+        return ZX_ERR_INVALID_ARGS;
+    return ZX_OK;
+}
+
 zx_status_t mtrace_ipt_control(uint32_t action, uint32_t options,
                                user_inout_ptr<void> arg, uint32_t size) {
     TRACEF("action %u, options 0x%x, arg %p, size 0x%x\n",
@@ -49,10 +67,17 @@ zx_status_t mtrace_ipt_control(uint32_t action, uint32_t options,
         }
     }
 
-    case MTRACE_IPT_FREE_TRACE:
+    case MTRACE_IPT_FREE_TRACE: {
         if (options != 0 || size != 0)
             return ZX_ERR_INVALID_ARGS;
-        return x86_ipt_free_trace();
+        fbl::AutoLock al(&ipt_threads_lock);
+        zx_status_t status = x86_ipt_free_trace();
+        if (status != ZX_OK)
+            return status;
+        for (auto& thread : ipt_threads)
+            thread.reset();
+        return ZX_OK;
+    }
 
     case MTRACE_IPT_STAGE_CPU_DATA: {
         zx_x86_pt_regs_t regs;
@@ -97,6 +122,88 @@ zx_status_t mtrace_ipt_control(uint32_t action, uint32_t options,
             return ZX_ERR_INVALID_ARGS;
         return x86_ipt_cpu_mode_stop();
 
+    case MTRACE_IPT_ASSIGN_THREAD: {
+        uint32_t descriptor;
+        zx_status_t status = get_thread_descriptor(options, &descriptor);
+        if (status != ZX_OK)
+            return status;
+        zx_handle_t handle;
+        if (size != sizeof(handle))
+            return ZX_ERR_INVALID_ARGS;
+        status = arg.reinterpret<zx_handle_t>().copy_from_user(&handle);
+        if (status != ZX_OK)
+            return status;
+
+        auto up = ProcessDispatcher::GetCurrent();
+        fbl::RefPtr<ThreadDispatcher> thread;
+        status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ | ZX_RIGHT_WRITE,
+                                             &thread);
+        if (status != ZX_OK)
+            return status;
+
+        fbl::AutoLock al(&ipt_threads_lock);
+        status = x86_ipt_assign_thread(descriptor, thread->thread());
+        if (status != ZX_OK)
+            return status;
+        ipt_threads[descriptor] = fbl::move(thread);
+        return ZX_OK;
+    }
+
+    case MTRACE_IPT_RELEASE_THREAD: {
+        uint32_t descriptor;
+        zx_status_t status = get_thread_descriptor(options, &descriptor);
+        if (status != ZX_OK)
+            return status;
+        if (size != 0)
+            return ZX_ERR_INVALID_ARGS;
+        fbl::AutoLock al(&ipt_threads_lock);
+        status = x86_ipt_release_thread(descriptor);
+        if (status != ZX_OK)
+            return status;
+        ipt_threads[descriptor].reset();
+        return ZX_OK;
+    }
+
+    case MTRACE_IPT_STAGE_THREAD_DATA: {
+        uint32_t descriptor;
+        zx_status_t status = get_thread_descriptor(options, &descriptor);
+        if (status != ZX_OK)
+            return status;
+        zx_x86_pt_regs_t regs;
+        if (size != sizeof(regs))
+            return ZX_ERR_INVALID_ARGS;
+        status = arg.reinterpret<zx_x86_pt_regs_t>().copy_from_user(&regs);
+        if (status != ZX_OK)
+            return status;
+        TRACEF("action %u, descriptor %u, ctl 0x%" PRIx64 ", output_base 0x%" PRIx64 "\n",
+               action, descriptor, regs.ctl, regs.output_base);
+        return x86_ipt_stage_thread_data(descriptor, &regs);
+    }
+
+    case MTRACE_IPT_GET_THREAD_DATA: {
+        uint32_t descriptor;
+        zx_status_t status = get_thread_descriptor(options, &descriptor);
+        if (status != ZX_OK)
+            return status;
+        zx_x86_pt_regs_t regs;
+        if (size != sizeof(regs))
+            return ZX_ERR_INVALID_ARGS;
+        status = x86_ipt_get_thread_data(descriptor, &regs);
+        if (status != ZX_OK)
+            return status;
+        return arg.reinterpret<zx_x86_pt_regs_t>().copy_to_user(regs);
+    }
+
+    case MTRACE_IPT_THREAD_MODE_START:
+        if (options != 0 || size != 0)
+            return ZX_ERR_INVALID_ARGS;
+        return x86_ipt_thread_mode_start();
+
+    case MTRACE_IPT_THREAD_MODE_STOP:
+        if (options != 0 || size != 0)
+            return ZX_ERR_INVALID_ARGS;
+        return x86_ipt_thread_mode_stop();
+
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -12,12 +12,29 @@
 // redline.
 typedef void(oom_lowmem_callback_t)(size_t shortfall_bytes);
 
+// Memory pressure levels, from least to most severe.
+enum oom_pressure_level_t {
+    OOM_PRESSURE_NORMAL,
+    OOM_PRESSURE_WARNING,
+    OOM_PRESSURE_CRITICAL,
+};
+
+// Called from the memory-watcher thread whenever the pressure level changes.
+typedef void(oom_pressure_callback_t)(oom_pressure_level_t level);
+
 // Initializes the out-of-memory system. If |enable| is true, starts the
 // memory-watcher thread, which calls |lowmem_callback| when the PMM has less
 // than |redline_bytes| free memory, sleeping for |sleep_duration_ns| between
 // checks.
 //
+// The thread also reports the memory pressure level to |pressure_callback|:
+// warning below |warning_bytes| free, and critical below |critical_bytes|.
+// Before reporting critical pressure it frees the pages of unlocked
+// discardable VMOs.
+//
 // If |enable| is false, the thread can be started manually using 'k oom start'.
 // TODO(dbort): Add a programmatic way to start/stop the thread.
 void oom_init(bool enable, uint64_t sleep_duration_ns, size_t redline_bytes,
-              oom_lowmem_callback_t* lowmem_callback);
+              size_t warning_bytes, size_t critical_bytes,
+              oom_lowmem_callback_t* lowmem_callback,
+              oom_pressure_callback_t* pressure_callback);
@@ -8,6 +8,7 @@
 
 #include <kernel/thread.h>
 #include <vm/pmm.h>
+#include <vm/vm_object_paged.h>
 #include <lib/console.h>
 #include <fbl/auto_lock.h>
 #include <fbl/mutex.h>
@@ -28,6 +29,9 @@ static fbl::Mutex oom_mutex;
 // Function to call when we hit a low-memory condition.
 static oom_lowmem_callback_t* oom_lowmem_callback TA_GUARDED(oom_mutex);
 
+// Function to call when the memory pressure level changes.
+static oom_pressure_callback_t* oom_pressure_callback TA_GUARDED(oom_mutex);
+
 // The thread, if it's running; nullptr otherwise.
 static thread_t* oom_thread TA_GUARDED(oom_mutex);
 
@@ -40,12 +44,79 @@ static uint64_t oom_sleep_duration_ns TA_GUARDED(oom_mutex);
 // If the PMM has fewer than this many bytes free, start killing processes.
 static uint64_t oom_redline_bytes TA_GUARDED(oom_mutex);
 
+// Below these many free bytes, memory pressure is at the warning or critical
+// level.
+static uint64_t oom_warning_bytes TA_GUARDED(oom_mutex);
+static uint64_t oom_critical_bytes TA_GUARDED(oom_mutex);
+
+// The last level reported to |oom_pressure_callback|.
+static oom_pressure_level_t oom_pressure_level TA_GUARDED(oom_mutex);
+
 // True if the thread should print the current free value when it runs.
 static bool oom_printing TA_GUARDED(oom_mutex);
 
 // True if the thread should simulate a low-memory condition on its next loop.
 static bool oom_simulate_lowmem TA_GUARDED(oom_mutex);
 
+static const char* pressure_level_name(oom_pressure_level_t level) {
+    switch (level) {
+    case OOM_PRESSURE_NORMAL:
+        return "normal";
+    case OOM_PRESSURE_WARNING:
+        return "warning";
+    case OOM_PRESSURE_CRITICAL:
+        return "critical";
+    }
+    return "unknown";
+}
+
+// Frees discardable pages if needed and reports any change in the pressure
+// level. Returns the number of free bytes afterwards.
+static size_t update_pressure(size_t free_bytes) {
+    oom_pressure_callback_t* pressure_callback = nullptr;
+    oom_pressure_level_t level;
+    oom_pressure_level_t last_level;
+    uint64_t warning_bytes;
+    uint64_t critical_bytes;
+    {
+        AutoLock lock(&oom_mutex);
+        warning_bytes = oom_warning_bytes;
+        critical_bytes = oom_critical_bytes;
+        last_level = oom_pressure_level;
+    }
+
+    // Discardable pages are the cheapest memory to get back, so try them
+    // before telling anyone that things are critical.
+    if (free_bytes < critical_bytes) {
+        size_t target_pages = (critical_bytes - free_bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+        size_t discarded_pages = VmObjectPaged::DiscardUnlockedPages(target_pages);
+        if (discarded_pages > 0) {
+            printf("OOM: discarded %zu pages\n", discarded_pages);
+            free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+        }
+    }
+
+    if (free_bytes < critical_bytes) {
+        level = OOM_PRESSURE_CRITICAL;
+    } else if (free_bytes < warning_bytes) {
+        level = OOM_PRESSURE_WARNING;
+    } else {
+        level = OOM_PRESSURE_NORMAL;
+    }
+
+    if (level != last_level) {
+        AutoLock lock(&oom_mutex);
+        oom_pressure_level = level;
+        pressure_callback = oom_pressure_callback;
+    }
+    if (pressure_callback != nullptr) {
+        printf("OOM: memory pressure %s -> %s\n",
+               pressure_level_name(last_level), pressure_level_name(level));
+        pressure_callback(level);
+    }
+    return free_bytes;
+}
+
 static int oom_loop(void* arg) {
     const size_t total_bytes = pmm_count_total_bytes();
     char total_buf[MAX_FORMAT_SIZE_LEN];
@@ -53,7 +124,7 @@ static int oom_loop(void* arg) {
 
     size_t last_free_bytes = total_bytes;
     while (true) {
-        const size_t free_bytes = pmm_count_free_pages() * PAGE_SIZE;
+        const size_t free_bytes = update_pressure(pmm_count_free_pages() * PAGE_SIZE);
 
         bool lowmem = false;
         bool printing = false;
@@ -131,16 +202,23 @@ static void start_thread_locked() TA_REQ(oom_mutex) {
 }
 
 void oom_init(bool enable, uint64_t sleep_duration_ns, size_t redline_bytes,
-              oom_lowmem_callback_t* lowmem_callback) {
+              size_t warning_bytes, size_t critical_bytes,
+              oom_lowmem_callback_t* lowmem_callback,
+              oom_pressure_callback_t* pressure_callback) {
     DEBUG_ASSERT(sleep_duration_ns > 0);
     DEBUG_ASSERT(redline_bytes > 0);
     DEBUG_ASSERT(lowmem_callback != nullptr);
+    DEBUG_ASSERT(pressure_callback != nullptr);
 
     AutoLock lock(&oom_mutex);
     DEBUG_ASSERT(oom_lowmem_callback == nullptr);
     oom_lowmem_callback = lowmem_callback;
+    oom_pressure_callback = pressure_callback;
     oom_sleep_duration_ns = sleep_duration_ns;
     oom_redline_bytes = redline_bytes;
+    oom_warning_bytes = warning_bytes;
+    oom_critical_bytes = critical_bytes;
+    oom_pressure_level = OOM_PRESSURE_NORMAL;
     oom_printing = false;
     oom_simulate_lowmem = false;
     if (enable) {
@@ -202,6 +280,11 @@ static int cmd_oom(int argc, const cmd_args* argv, uint32_t flags) {
         char buf[MAX_FORMAT_SIZE_LEN];
         format_size_fixed(buf, sizeof(buf), oom_redline_bytes, 'M');
         printf("  redline: %s (%" PRIu64 " bytes)\n", buf, oom_redline_bytes);
+        format_size_fixed(buf, sizeof(buf), oom_warning_bytes, 'M');
+        printf("  warning: %s (%" PRIu64 " bytes)\n", buf, oom_warning_bytes);
+        format_size_fixed(buf, sizeof(buf), oom_critical_bytes, 'M');
+        printf("  critical: %s (%" PRIu64 " bytes)\n", buf, oom_critical_bytes);
+        printf("  pressure: %s\n", pressure_level_name(oom_pressure_level));
     } else if (strcmp(argv[1].str, "print") == 0) {
         oom_printing = !oom_printing;
         printf("OOM print is now %s\n", oom_printing ? "on" : "off");
@@ -11,9 +11,12 @@
 // environments.  It must use only the basic types so that struct
 // layouts match exactly in both contexts.
 
-#define VDSO_CONSTANTS_SIZE (4 * 4 + 2 * 8)
+#define VDSO_CONSTANTS_SIZE (4 * 4 + 2 * 8 + 4 * 4)
 #define VDSO_CONSTANTS_ALIGN 8
 
+#define VDSO_TIME_VALUES_SIZE 8
+#define VDSO_TIME_VALUES_ALIGN 8
+
 #ifndef __ASSEMBLER__
 
 #include <stdint.h>
@@ -39,6 +42,14 @@ struct vdso_constants {
 
     // Total amount of physical memory in the system, in bytes.
     uint64_t physmem;
+
+    // Fixed-point factor (integer part, then the first and second 32 bits
+    // of the fraction) that turns zx_ticks_get values into
+    // ZX_CLOCK_MONOTONIC nanoseconds.  All zero if the monotonic clock
+    // can't be derived from the ticks, in which case the syscall is used.
+    uint32_t ns_per_tick_l0;
+    uint32_t ns_per_tick_l32;
+    uint32_t ns_per_tick_l64;
 };
 
 static_assert(VDSO_CONSTANTS_SIZE == sizeof(vdso_constants),
@@ -46,4 +57,17 @@ static_assert(VDSO_CONSTANTS_SIZE == sizeof(vdso_constants),
 static_assert(VDSO_CONSTANTS_ALIGN == alignof(vdso_constants),
               "Need to adjust VDSO_CONSTANTS_ALIGN");
 
+// Unlike vdso_constants, the kernel keeps updating this struct after boot,
+// so the vDSO code must read its members atomically.
+struct vdso_time_values {
+    // Offset from ZX_CLOCK_MONOTONIC to ZX_CLOCK_UTC, as last set with
+    // zx_clock_adjust.
+    int64_t utc_offset;
+};
+
+static_assert(VDSO_TIME_VALUES_SIZE == sizeof(vdso_time_values),
+              "Need to adjust VDSO_TIME_VALUES_SIZE");
+static_assert(VDSO_TIME_VALUES_ALIGN == alignof(vdso_time_values),
+              "Need to adjust VDSO_TIME_VALUES_ALIGN");
+
 #endif // __ASSEMBLER__
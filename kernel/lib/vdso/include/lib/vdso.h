@@ -10,6 +10,7 @@
 #include <vm/vm_object.h>
 
 class VmMapping;
+struct vdso_time_values;
 
 class VDso : public RoDso {
 public:
@@ -24,6 +25,9 @@ public:
         return instance_->RoDso::valid_code_mapping(vmo_offset, size);
     }
 
+    // Publish a new ZX_CLOCK_UTC offset to every vDSO variant.
+    static void SetUtcOffset(int64_t offset);
+
     // Given VmAspace::vdso_code_mapping_, return the vDSO base address or 0.
     static uintptr_t base_address(const fbl::RefPtr<VmMapping>& code_mapping);
 
@@ -72,5 +76,9 @@ private:
     fbl::RefPtr<VmObjectDispatcher> variant_vmo_[
         static_cast<size_t>(Variant::COUNT) - 1];
 
+    // Kernel mappings of each variant's vdso_time_values, indexed by
+    // Variant.  These stay mapped for the life of the system.
+    vdso_time_values* time_values_[static_cast<size_t>(Variant::COUNT)] = {};
+
     static const VDso* instance_;
 };
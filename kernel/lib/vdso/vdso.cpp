@@ -10,6 +10,7 @@
 #include <fbl/alloc_checker.h>
 #include <fbl/type_support.h>
 #include <kernel/cmdline.h>
+#include <lib/fixed_point.h>
 #include <object/handle.h>
 #include <platform.h>
 #include <vm/pmm.h>
@@ -72,6 +73,21 @@ struct VDsoDynSym {
     } table[VDSO_DYNSYM_COUNT];
 };
 
+// Map the vdso_time_values of |vmo| for good and initialize it.
+vdso_time_values* map_time_values(const char* name, fbl::RefPtr<VmObject> vmo) {
+    static_assert(sizeof(vdso_time_values) == VDSO_DATA_TIME_VALUES_SIZE,
+                  "gen-rodso-code.sh is suspect");
+    fbl::AllocChecker ac;
+    auto window = new (&ac) KernelVmoWindow<vdso_time_values>(
+        name, fbl::move(vmo), VDSO_DATA_TIME_VALUES);
+    ASSERT(ac.check());
+    // Writing the page now also gives a COW clone its own copy of it.
+    *window->data() = (vdso_time_values) {
+        0,
+    };
+    return window->data();
+}
+
 #define PASTE(a, b, c) PASTE_1(a, b, c)
 #define PASTE_1(a, b, c) a##b##c
 
@@ -221,6 +237,8 @@ const VDso* VDso::Create() {
     KernelVmoWindow<vdso_constants> constants_window(
         "vDSO constants", vdso->vmo()->vmo(), VDSO_DATA_CONSTANTS);
     uint64_t per_second = ticks_per_second();
+    struct fp_32_64 ns_per_tick = {};
+    platform_get_ns_per_tick(&ns_per_tick);
 
     // Initialize the constants that should be visible to the vDSO.
     // Rather than assigning each member individually, do this with
@@ -232,6 +250,9 @@ const VDso* VDso::Create() {
         arch_icache_line_size(),
         per_second,
         pmm_count_total_bytes(),
+        ns_per_tick.l0,
+        ns_per_tick.l32,
+        ns_per_tick.l64,
     };
 
     // If ticks_per_second has not been calibrated, it will return 0. In this
@@ -240,11 +261,20 @@ const VDso* VDso::Create() {
         // Make zx_ticks_per_second return nanoseconds per second.
         constants_window.data()->ticks_per_second = ZX_SEC(1);
 
+        // The soft ticks come from the syscall anyway, so let
+        // zx_time_get make the syscall directly.
+        constants_window.data()->ns_per_tick_l0 = 0;
+        constants_window.data()->ns_per_tick_l32 = 0;
+        constants_window.data()->ns_per_tick_l64 = 0;
+
         // Adjust the zx_ticks_get entry point to be soft_ticks_get.
         VDsoDynSymWindow dynsym_window(vdso->vmo()->vmo());
         REDIRECT_SYSCALL(dynsym_window, zx_ticks_get, soft_ticks_get);
     }
 
+    vdso->time_values_[static_cast<size_t>(Variant::FULL)] =
+        map_time_values("vDSO time values", vdso->vmo()->vmo());
+
     for (size_t v = static_cast<size_t>(Variant::FULL) + 1;
          v < static_cast<size_t>(Variant::COUNT);
          ++v)
@@ -254,6 +284,13 @@ const VDso* VDso::Create() {
     return instance_;
 }
 
+void VDso::SetUtcOffset(int64_t offset) {
+    // Processes can only be started once the vDSO exists.
+    ASSERT(instance_);
+    for (vdso_time_values* values : instance_->time_values_)
+        __atomic_store_n(&values->utc_offset, offset, __ATOMIC_RELAXED);
+}
+
 uintptr_t VDso::base_address(const fbl::RefPtr<VmMapping>& code_mapping) {
     return code_mapping ? code_mapping->base() - VDSO_CODE_START : 0;
 }
@@ -289,6 +326,9 @@ void VDso::CreateVariant(Variant variant) {
                                       false, &new_vmo);
     ASSERT(status == ZX_OK);
 
+    time_values_[static_cast<size_t>(variant)] =
+        map_time_values("vDSO variant time values", new_vmo);
+
     VDsoDynSymWindow dynsym_window(new_vmo);
     VDsoCodeWindow code_window(new_vmo);
 
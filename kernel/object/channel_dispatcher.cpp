@@ -13,12 +13,15 @@
 #include <trace.h>
 
 #include <kernel/event.h>
+#include <kernel/thread.h>
+#include <lib/counters.h>
 #include <platform.h>
 #include <object/handle.h>
 #include <object/message_packet.h>
 #include <object/process_dispatcher.h>
 #include <object/thread_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <fbl/type_support.h>
@@ -27,6 +30,8 @@
 
 using fbl::AutoLock;
 
+MUTEX_CLASS(channel_lock_class, "channel");
+
 #define LOCAL_TRACE 0
 
 // static
@@ -52,7 +57,7 @@ zx_status_t ChannelDispatcher::Create(fbl::RefPtr<Dispatcher>* dispatcher0,
 }
 
 ChannelDispatcher::ChannelDispatcher()
-    : Dispatcher(ZX_CHANNEL_WRITABLE) {
+    : Dispatcher(ZX_CHANNEL_WRITABLE), lock_(&channel_lock_class) {
 }
 
 // This is called before either ChannelDispatcher is accessible from threads other than the one
@@ -71,6 +76,8 @@ ChannelDispatcher::~ChannelDispatcher() {
 
     messages_.clear();
     message_count_ = 0;
+    message_bytes_ = 0;
+    memory_bytes_ = 0;
 }
 
 zx_status_t ChannelDispatcher::add_observer(StateObserver* observer) {
@@ -156,6 +163,8 @@ zx_status_t ChannelDispatcher::Read(uint32_t* msg_size,
 
     *msg = messages_.pop_front();
     message_count_--;
+    message_bytes_ -= (*msg)->data_size();
+    memory_bytes_ -= (*msg)->buffer_size();
 
     if (messages_.is_empty())
         UpdateState(ZX_CHANNEL_READABLE, 0u);
@@ -163,6 +172,54 @@ zx_status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
+zx_status_t ChannelDispatcher::ReadMany(zx_channel_msg_t* descs, uint32_t count,
+                                        MessageList* msgs, uint32_t* actual) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    if (messages_.is_empty())
+        return other_ ? ZX_ERR_SHOULD_WAIT : ZX_ERR_PEER_CLOSED;
+
+    uint32_t n = 0;
+    for (; n < count && !messages_.is_empty(); n++) {
+        const MessagePacket& front = messages_.front();
+        if (front.data_size() > descs[n].num_bytes ||
+            front.num_handles() > descs[n].num_handles) {
+            if (n == 0) {
+                descs[0].num_bytes = front.data_size();
+                descs[0].num_handles = front.num_handles();
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            }
+            break;
+        }
+        descs[n].num_bytes = front.data_size();
+        descs[n].num_handles = front.num_handles();
+
+        auto msg = messages_.pop_front();
+        message_count_--;
+        message_bytes_ -= msg->data_size();
+        memory_bytes_ -= msg->buffer_size();
+        msgs->push_back(fbl::move(msg));
+    }
+    *actual = n;
+
+    if (messages_.is_empty())
+        UpdateState(ZX_CHANNEL_READABLE, 0u);
+
+    return ZX_OK;
+}
+
+void ChannelDispatcher::GetInfo(zx_info_channel_t* info) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    info->message_count = message_count_;
+    info->message_bytes = message_bytes_;
+    info->memory_bytes = memory_bytes_;
+    info->peak_memory_bytes = peak_memory_bytes_;
+}
+
 zx_status_t ChannelDispatcher::Write(fbl::unique_ptr<MessagePacket> msg) {
     canary_.Assert();
 
@@ -184,6 +241,23 @@ zx_status_t ChannelDispatcher::Write(fbl::unique_ptr<MessagePacket> msg) {
     return ZX_OK;
 }
 
+zx_status_t ChannelDispatcher::WriteMany(MessageList* msgs) {
+    canary_.Assert();
+
+    fbl::RefPtr<ChannelDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ZX_ERR_PEER_CLOSED;
+        other = other_;
+    }
+
+    if (other->WriteSelfMany(msgs) > 0)
+        thread_reschedule();
+
+    return ZX_OK;
+}
+
 zx_status_t ChannelDispatcher::Call(fbl::unique_ptr<MessagePacket> msg,
                                     zx_time_t deadline, bool* return_handles,
                                     fbl::unique_ptr<MessagePacket>* reply) {
@@ -216,8 +290,11 @@ zx_status_t ChannelDispatcher::Call(fbl::unique_ptr<MessagePacket> msg,
         waiters_.push_back(waiter);
     }
 
-    // (1) Write outbound message to opposing endpoint.
+    // (1) Write outbound message to opposing endpoint.  We are about to
+    // block for the reply, so a server woken by the write gets this cpu.
+    thread_set_wakeup_handoff(true);
     other->WriteSelf(fbl::move(msg));
+    thread_set_wakeup_handoff(false);
 
     // Reuse the code from the half-call used for retrying a Call after thread
     // suspend.
@@ -264,6 +341,29 @@ int ChannelDispatcher::WriteSelf(fbl::unique_ptr<MessagePacket> msg) {
 
     AutoLock lock(&lock_);
 
+    bool queued = false;
+    int woken = EnqueueLocked(fbl::move(msg), &queued);
+    if (queued)
+        UpdateState(0u, ZX_CHANNEL_READABLE);
+    return woken;
+}
+
+int ChannelDispatcher::WriteSelfMany(MessageList* msgs) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    // observers only hear about the batch once
+    bool queued = false;
+    int woken = 0;
+    while (!msgs->is_empty())
+        woken += EnqueueLocked(msgs->pop_front(), &queued);
+    if (queued)
+        UpdateState(0u, ZX_CHANNEL_READABLE);
+    return woken;
+}
+
+int ChannelDispatcher::EnqueueLocked(fbl::unique_ptr<MessagePacket> msg, bool* queued) {
     if (!waiters_.is_empty()) {
         // If the far side is waiting for replies to messages
         // send via "call", see if this message has a matching
@@ -279,10 +379,12 @@ int ChannelDispatcher::WriteSelf(fbl::unique_ptr<MessagePacket> msg) {
             }
         }
     }
+    message_bytes_ += msg->data_size();
+    memory_bytes_ += msg->buffer_size();
+    peak_memory_bytes_ = fbl::max(peak_memory_bytes_, memory_bytes_);
     messages_.push_back(fbl::move(msg));
     message_count_++;
-
-    UpdateState(0u, ZX_CHANNEL_READABLE);
+    *queued = true;
     return 0;
 }
 
@@ -340,7 +442,13 @@ int ChannelDispatcher::MessageWaiter::Deliver(fbl::unique_ptr<MessagePacket> msg
 
     msg_ = fbl::move(msg);
     status_ = ZX_OK;
-    return event_.Signal(ZX_OK);
+
+    // The replying thread reschedules once it has woken the caller (see
+    // Write()), so the caller can run right here rather than on another cpu.
+    thread_set_wakeup_handoff(true);
+    int woken = event_.Signal(ZX_OK);
+    thread_set_wakeup_handoff(false);
+    return woken;
 }
 
 int ChannelDispatcher::MessageWaiter::Cancel(zx_status_t status) {
@@ -12,7 +12,9 @@
 
 #include <lib/console.h>
 #include <lib/ktrace.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_lock.h>
+#include <platform.h>
 #include <object/handle.h>
 #include <object/job_dispatcher.h>
 #include <object/port_dispatcher.h>
@@ -20,6 +22,7 @@
 #include <object/vm_object_dispatcher.h>
 #include <pretty/sizes.h>
 #include <zircon/types.h>
+#include <zircon/zx-syscall-numbers.h>
 
 // Machinery to walk over a job tree and run a callback on each process.
 template <typename ProcessCallbackType>
@@ -60,7 +63,7 @@ static void DumpProcessListKeyMap() {
 }
 
 static const char* ObjectTypeToString(zx_obj_type_t type) {
-    static_assert(ZX_OBJ_TYPE_LAST == 24, "need to update switch below");
+    static_assert(ZX_OBJ_TYPE_LAST == 25, "need to update switch below");
 
     switch (type) {
         case ZX_OBJ_TYPE_PROCESS: return "process";
@@ -82,6 +85,7 @@ static const char* ObjectTypeToString(zx_obj_type_t type) {
         case ZX_OBJ_TYPE_VCPU: return "vcpu";
         case ZX_OBJ_TYPE_TIMER: return "timer";
         case ZX_OBJ_TYPE_IOMMU: return "iommu";
+        case ZX_OBJ_TYPE_WAIT_SET: return "wait-set";
         default: return "???";
     }
 }
@@ -309,6 +313,39 @@ static void DumpAllVmObjects(bool hidden_only, char format_unit) {
     PrintVmoDumpHeader(/* handles */ false);
 }
 
+// Prints a histogram of the clone chain depths of all VMOs, and the VMOs
+// whose chains are at least |min_depth| deep (if non-zero).
+static void DumpVmObjectChainDepths(uint32_t min_depth) {
+    static constexpr uint32_t kMaxBucket = 16;
+    size_t buckets[kMaxBucket + 1] = {};
+    uint32_t max_depth = 0;
+
+    if (min_depth > 0) {
+        printf("VMOs with clone chains at least %u deep, oldest to newest:\n", min_depth);
+    }
+    VmObject::ForEach([&](const VmObject& vmo) {
+        const uint32_t depth = vmo.chain_depth();
+        buckets[depth < kMaxBucket ? depth : kMaxBucket]++;
+        if (depth > max_depth) {
+            max_depth = depth;
+        }
+        if (min_depth > 0 && depth >= min_depth) {
+            char name[ZX_MAX_NAME_LEN];
+            vmo.get_name(name, sizeof(name));
+            printf("  koid %5" PRIu64 " parent %5" PRIu64 " depth %3u %s\n",
+                   vmo.user_id(), vmo.parent_user_id(), depth, name[0] ? name : "-");
+        }
+        return ZX_OK;
+    });
+
+    printf("VMO clone chain depths (max %u):\n", max_depth);
+    for (uint32_t i = 0; i <= kMaxBucket; i++) {
+        if (buckets[i] != 0) {
+            printf("  %3u%s %zu\n", i, i == kMaxBucket ? "+" : " ", buckets[i]);
+        }
+    }
+}
+
 namespace {
 // Dumps VMOs under a VmAspace.
 class AspaceVmoDumper final : public VmEnumerator {
@@ -391,6 +428,61 @@ void KillProcess(zx_koid_t id) {
     pd->Kill();
 }
 
+static const struct {
+    uint32_t id;
+    uint32_t nargs;
+    const char* name;
+} kSyscallInfo[] = {
+#include <zircon/syscall-ktrace-info.inc>
+};
+
+static const char* SyscallName(uint32_t num) {
+    for (const auto& info : kSyscallInfo) {
+        if (info.id == num)
+            return info.name;
+    }
+    return "?";
+}
+
+// Lists the syscalls a process has made, most time spent first.
+static void DumpProcessSyscallStats(zx_koid_t id) {
+    auto pd = ProcessDispatcher::LookupProcessById(id);
+    if (!pd) {
+        printf("process not found!\n");
+        return;
+    }
+    if (!pd->has_syscall_stats()) {
+        printf("syscall stats are off, boot with kernel.syscall-stats=true\n");
+        return;
+    }
+
+    uint32_t order[ZX_SYS_COUNT];
+    uint32_t n = 0;
+    for (uint32_t num = 0; num < ZX_SYS_COUNT; ++num) {
+        if (pd->syscall_stats(num)->count.load(fbl::memory_order_relaxed) == 0)
+            continue;
+        uint64_t ticks = pd->syscall_stats(num)->ticks.load(fbl::memory_order_relaxed);
+        uint32_t i = n++;
+        while (i > 0 &&
+               pd->syscall_stats(order[i - 1])->ticks.load(fbl::memory_order_relaxed) < ticks) {
+            order[i] = order[i - 1];
+            --i;
+        }
+        order[i] = num;
+    }
+
+    const uint64_t ticks_per_us = fbl::max<uint64_t>(ticks_per_second() / 1000000u, 1u);
+    printf("%-28s %12s %14s %10s\n", "syscall", "calls", "total us", "avg ns");
+    for (uint32_t i = 0; i < n; ++i) {
+        const auto* stats = pd->syscall_stats(order[i]);
+        uint64_t count = stats->count.load(fbl::memory_order_relaxed);
+        uint64_t ticks = stats->ticks.load(fbl::memory_order_relaxed);
+        printf("%-28s %12" PRIu64 " %14" PRIu64 " %10" PRIu64 "\n",
+               SyscallName(order[i]), count, ticks / ticks_per_us,
+               ticks * 1000u / ticks_per_us / count);
+    }
+}
+
 namespace {
 // Counts memory usage under a VmAspace.
 class VmCounter final : public VmEnumerator {
@@ -760,11 +852,14 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         printf("                     : dump process/all/hidden VMOs\n");
         printf("                 -u? : fix all sizes to the named unit\n");
         printf("                       where ? is one of [BkMGTPE]\n");
+        printf("%s vmodepth [<min>]  : histogram of vmo clone chain depths,\n", argv[0].str);
+        printf("                       listing vmos at least <min> deep\n");
         printf("%s ppinfo            : port packet arena info\n", argv[0].str);
         printf("%s kill <pid>        : kill process\n", argv[0].str);
         printf("%s asd  <pid>|kernel : dump process/kernel address space\n",
                argv[0].str);
         printf("%s htinfo            : handle table info\n", argv[0].str);
+        printf("%s sc   <pid>        : per-syscall counts and time\n", argv[0].str);
         return -1;
     }
 
@@ -821,6 +916,8 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         } else {
             DumpProcessVmObjects(argv[2].u, format_unit);
         }
+    } else if (strcmp(argv[1].str, "vmodepth") == 0) {
+        DumpVmObjectChainDepths(argc >= 3 ? static_cast<uint32_t>(argv[2].u) : 0u);
     } else if (strcmp(argv[1].str, "ppinfo") == 0) {
         if (argc != 2)
             goto usage;
@@ -837,6 +934,10 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         if (argc != 2)
             goto usage;
         DumpHandleTable();
+    } else if (strcmp(argv[1].str, "sc") == 0) {
+        if (argc < 3)
+            goto usage;
+        DumpProcessSyscallStats(argv[2].u);
     } else {
         printf("unrecognized subcommand '%s'\n", argv[1].str);
         goto usage;
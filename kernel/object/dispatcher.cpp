@@ -280,7 +280,23 @@ void Dispatcher::UpdateStateHelper(zx_signals_t clear_mask,
         obs_to_remove.pop_front()->OnRemoved();
     }
 
-    if (flags & StateObserver::kWokeThreads)
+    if (flags & StateObserver::kWokeThreads) {
+        auto batch = reinterpret_cast<SignalBatch*>(tls_get(TLS_ENTRY_SIGNAL_BATCH));
+        if (batch)
+            batch->woke_threads_ = true;
+        else
+            thread_reschedule();
+    }
+}
+
+Dispatcher::SignalBatch::SignalBatch() {
+    __UNUSED void* previous = tls_set(TLS_ENTRY_SIGNAL_BATCH, this);
+    DEBUG_ASSERT(previous == nullptr);
+}
+
+Dispatcher::SignalBatch::~SignalBatch() {
+    tls_set(TLS_ENTRY_SIGNAL_BATCH, nullptr);
+    if (woke_threads_)
         thread_reschedule();
 }
 
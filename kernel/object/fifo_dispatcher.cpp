@@ -6,15 +6,20 @@
 
 #include <object/fifo_dispatcher.h>
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <zircon/rights.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <object/handle.h>
+#include <vm/vm_object_paged.h>
 
 using fbl::AutoLock;
 
+static_assert(sizeof(zx_fifo_ring_header_t) == ZX_FIFO_RING_ENTRIES_OFFSET,
+              "fifo ring entries must follow the header");
+
 // static
 zx_status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t options,
                                    fbl::RefPtr<Dispatcher>* dispatcher0,
@@ -29,20 +34,38 @@ zx_status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t o
         return ZX_ERR_OUT_OF_RANGE;
     }
 
-    fbl::AllocChecker ac;
-    auto data0 = fbl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[count * elemsize]);
-    if (!ac.check())
-        return ZX_ERR_NO_MEMORY;
+    if (options & ~ZX_FIFO_SHARED_RING)
+        return ZX_ERR_INVALID_ARGS;
 
-    auto fifo0 = fbl::AdoptRef(new (&ac) FifoDispatcher(options, count, elemsize, fbl::move(data0)));
-    if (!ac.check())
-        return ZX_ERR_NO_MEMORY;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data0;
+    fbl::unique_ptr<uint8_t[]> data1;
+    fbl::RefPtr<VmObject> ring0;
+    fbl::RefPtr<VmObject> ring1;
+
+    if (options & ZX_FIFO_SHARED_RING) {
+        zx_status_t status = CreateRing(count, elemsize, &ring0);
+        if (status != ZX_OK)
+            return status;
+        status = CreateRing(count, elemsize, &ring1);
+        if (status != ZX_OK)
+            return status;
+    } else {
+        data0 = fbl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[count * elemsize]);
+        if (!ac.check())
+            return ZX_ERR_NO_MEMORY;
+        data1 = fbl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[count * elemsize]);
+        if (!ac.check())
+            return ZX_ERR_NO_MEMORY;
+    }
 
-    auto data1 = fbl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[count * elemsize]);
+    auto fifo0 = fbl::AdoptRef(new (&ac) FifoDispatcher(options, count, elemsize,
+                                                        fbl::move(data0), fbl::move(ring0)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
-    auto fifo1 = fbl::AdoptRef(new (&ac) FifoDispatcher(options, count, elemsize, fbl::move(data1)));
+    auto fifo1 = fbl::AdoptRef(new (&ac) FifoDispatcher(options, count, elemsize,
+                                                        fbl::move(data1), fbl::move(ring1)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -55,11 +78,19 @@ zx_status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t o
     return ZX_OK;
 }
 
+// static
+zx_status_t FifoDispatcher::CreateRing(uint32_t count, uint32_t elemsize,
+                                       fbl::RefPtr<VmObject>* ring) {
+    // a fresh vmo reads as zeroes, so the ring starts out empty
+    size_t size = ROUNDUP(ZX_FIFO_RING_ENTRIES_OFFSET + count * elemsize, PAGE_SIZE);
+    return VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, size, ring);
+}
+
 FifoDispatcher::FifoDispatcher(uint32_t /*options*/, uint32_t count, uint32_t elem_size,
-                               fbl::unique_ptr<uint8_t[]> data)
+                               fbl::unique_ptr<uint8_t[]> data, fbl::RefPtr<VmObject> ring)
     : Dispatcher(ZX_FIFO_WRITABLE),
       elem_count_(count), elem_size_(elem_size), mask_(count - 1),
-      peer_koid_(0u), head_(0u), tail_(0u), data_(fbl::move(data)) {
+      peer_koid_(0u), head_(0u), tail_(0u), data_(fbl::move(data)), ring_(fbl::move(ring)) {
 }
 
 FifoDispatcher::~FifoDispatcher() {
@@ -123,6 +154,10 @@ void FifoDispatcher::OnPeerZeroHandles() {
 zx_status_t FifoDispatcher::WriteFromUser(user_in_ptr<const uint8_t> ptr, size_t len, uint32_t* actual) {
     canary_.Assert();
 
+    // shared rings are written directly by userspace
+    if (ring_)
+        return ZX_ERR_BAD_STATE;
+
     fbl::RefPtr<FifoDispatcher> other;
     {
         AutoLock lock(&lock_);
@@ -195,6 +230,9 @@ zx_status_t FifoDispatcher::WriteSelf(user_in_ptr<const uint8_t> ptr, size_t byt
 zx_status_t FifoDispatcher::ReadToUser(user_out_ptr<uint8_t> ptr, size_t bytelen, uint32_t* actual) {
     canary_.Assert();
 
+    if (ring_)
+        return ZX_ERR_BAD_STATE;
+
     size_t count = bytelen / elem_size_;
     if (count == 0)
         return ZX_ERR_OUT_OF_RANGE;
@@ -249,3 +287,70 @@ zx_status_t FifoDispatcher::ReadToUser(user_out_ptr<uint8_t> ptr, size_t bytelen
     *actual = (tail_ - old_tail);
     return ZX_OK;
 }
+
+zx_status_t FifoDispatcher::GetRings(fbl::RefPtr<VmObject>* rx, fbl::RefPtr<VmObject>* tx) {
+    canary_.Assert();
+
+    if (!ring_)
+        return ZX_ERR_BAD_STATE;
+
+    AutoLock lock(&lock_);
+    if (!other_)
+        return ZX_ERR_PEER_CLOSED;
+
+    *rx = ring_;
+    *tx = other_->ring_;
+    return ZX_OK;
+}
+
+zx_status_t FifoDispatcher::Notify() {
+    canary_.Assert();
+
+    if (!ring_)
+        return ZX_ERR_BAD_STATE;
+
+    fbl::RefPtr<FifoDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ZX_ERR_PEER_CLOSED;
+        other = other_;
+    }
+
+    zx_status_t status = RefreshRing();
+    if (status != ZX_OK)
+        return status;
+    return other->RefreshRing();
+}
+
+// Each ring drives the READABLE signal of its consumer and the WRITABLE
+// signal of its producer. Both are updated under the consumer's lock so
+// that concurrent doorbells can't apply a stale snapshot last.
+zx_status_t FifoDispatcher::RefreshRing() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    zx_fifo_ring_header_t header;
+    zx_status_t status = ring_->Read(&header, 0, sizeof(header), nullptr);
+    if (status != ZX_OK)
+        return status;
+
+    // nonsense indices from userspace read as a full ring
+    uint32_t used = header.head - header.tail;
+    if (used > elem_count_)
+        used = elem_count_;
+
+    if (used == 0)
+        UpdateState(ZX_FIFO_READABLE, 0u);
+    else
+        UpdateState(0u, ZX_FIFO_READABLE);
+
+    if (other_) {
+        if (used == elem_count_)
+            other_->UpdateState(ZX_FIFO_WRITABLE, 0u);
+        else
+            other_->UpdateState(0u, ZX_FIFO_WRITABLE);
+    }
+    return ZX_OK;
+}
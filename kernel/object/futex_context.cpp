@@ -26,16 +26,39 @@ FutexContext::~FutexContext() {
 
     // All of the threads should have removed themselves from wait queues
     // by the time the process has exited.
-    DEBUG_ASSERT(futex_table_.is_empty());
+    for (auto& shard : shards_) {
+        AutoLock lock(&shard.lock);
+        DEBUG_ASSERT(shard.futex_table.is_empty());
+    }
+}
+
+FutexContext::Shard* FutexContext::ShardFor(uintptr_t futex_key) {
+    // Futexes of one cache line share a shard, so that requeueing between a
+    // condition variable and the mutex next to it only takes one lock.
+    uint64_t line = futex_key >> 6;
+    return &shards_[(line * 0x9E3779B97F4A7C15ull) >> (64 - kShardBits)];
 }
 
 zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int current_value, zx_time_t deadline) {
     LTRACE_ENTRY;
 
+    return Wait(value_ptr, current_value, nullptr, deadline);
+}
+
+zx_status_t FutexContext::FutexWaitPi(user_in_ptr<const int> value_ptr, int current_value,
+                                      ThreadDispatcher* owner, zx_time_t deadline) {
+    LTRACE_ENTRY;
+
+    return Wait(value_ptr, current_value, owner->thread(), deadline);
+}
+
+zx_status_t FutexContext::Wait(user_in_ptr<const int> value_ptr, int current_value,
+                               thread_t* owner, zx_time_t deadline) {
     uintptr_t futex_key = reinterpret_cast<uintptr_t>(value_ptr.get());
     if (futex_key % sizeof(int))
         return ZX_ERR_INVALID_ARGS;
 
+    Shard* shard = ShardFor(futex_key);
     FutexNode* node;
 
     // FutexWait() checks that the address value_ptr still contains
@@ -44,16 +67,16 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     // If a FutexWake() operation could occur between them, a userland mutex
     // operation built on top of futexes would have a race condition that
     // could miss wakeups.
-    lock_.Acquire();
+    shard->lock.Acquire();
 
     int value;
     zx_status_t result = value_ptr.copy_from_user(&value);
     if (result != ZX_OK) {
-        lock_.Release();
+        shard->lock.Release();
         return result;
     }
     if (value != current_value) {
-        lock_.Release();
+        shard->lock.Release();
         return ZX_ERR_BAD_STATE;
     }
 
@@ -62,10 +85,11 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     node->set_hash_key(futex_key);
     node->SetAsSingletonList();
 
-    QueueNodesLocked(node);
+    QueueNodesLocked(shard, node);
 
-    // Block current thread.  This releases lock_ and does not reacquire it.
-    result = node->BlockThread(&lock_, deadline);
+    // Block current thread.  This releases the shard lock and does not
+    // reacquire it.
+    result = node->BlockThread(&shard->lock, deadline, owner);
     if (result == ZX_OK) {
         DEBUG_ASSERT(!node->IsInQueue());
         // All the work necessary for removing us from the hash table was done by FutexWake()
@@ -78,8 +102,7 @@ zx_status_t FutexContext::FutexWait(user_in_ptr<const int> value_ptr, int curren
     //
     // We need to ensure that the thread's node is removed from the wait
     // queue, because FutexWake() probably didn't do that.
-    AutoLock lock(&lock_);
-    if (UnqueueNodeLocked(node)) {
+    if (UnqueueNode(node)) {
         return result;
     }
     // The current thread was not found on the wait queue.  This means
@@ -114,9 +137,10 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const int> value_ptr,
     if (futex_key % sizeof(int))
         return ZX_ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
+    Shard* shard = ShardFor(futex_key);
+    AutoLock lock(&shard->lock);
 
-    FutexNode* node = futex_table_.erase(futex_key);
+    FutexNode* node = shard->futex_table.erase(futex_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
         return ZX_OK;
@@ -129,7 +153,7 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const int> value_ptr,
 
     if (remaining_waiters) {
         DEBUG_ASSERT(remaining_waiters->GetKey() == futex_key);
-        futex_table_.insert(remaining_waiters);
+        shard->futex_table.insert(remaining_waiters);
     }
 
     if (any_woken) {
@@ -141,31 +165,48 @@ zx_status_t FutexContext::FutexWake(user_in_ptr<const int> value_ptr,
 }
 
 zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t wake_count, int current_value,
-                                       user_in_ptr<const int> requeue_ptr, uint32_t requeue_count) {
+                                       user_in_ptr<const int> requeue_ptr, uint32_t requeue_count)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
     LTRACE_ENTRY;
 
     if ((requeue_ptr.get() == nullptr) && requeue_count)
         return ZX_ERR_INVALID_ARGS;
 
-    AutoLock lock(&lock_);
-
-    int value;
-    zx_status_t result = wake_ptr.copy_from_user(&value);
-    if (result != ZX_OK) return result;
-    if (value != current_value) return ZX_ERR_BAD_STATE;
-
     uintptr_t wake_key = reinterpret_cast<uintptr_t>(wake_ptr.get());
     uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
     if (wake_key == requeue_key) return ZX_ERR_INVALID_ARGS;
     if (wake_key % sizeof(int) || requeue_key % sizeof(int))
         return ZX_ERR_INVALID_ARGS;
 
+    // Take both shard locks, in address order so that requeues going in
+    // opposite directions cannot deadlock.
+    Shard* wake_shard = ShardFor(wake_key);
+    Shard* requeue_shard = ShardFor(requeue_key);
+    Shard* first = wake_shard < requeue_shard ? wake_shard : requeue_shard;
+    Shard* second = wake_shard < requeue_shard ? requeue_shard : wake_shard;
+    first->lock.Acquire();
+    if (second != first)
+        second->lock.Acquire();
+    auto unlock = [first, second]() TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (second != first)
+            second->lock.Release();
+        first->lock.Release();
+    };
+
+    int value;
+    zx_status_t result = wake_ptr.copy_from_user(&value);
+    if (result != ZX_OK || value != current_value) {
+        unlock();
+        return result != ZX_OK ? result : ZX_ERR_BAD_STATE;
+    }
+
     // This must happen before RemoveFromHead() calls set_hash_key() on
-    // nodes below, because operations on futex_table_ look at the GetKey
+    // nodes below, because operations on the futex tables look at the GetKey
     // field of the list head nodes for wake_key and requeue_key.
-    FutexNode* node = futex_table_.erase(wake_key);
+    FutexNode* node = wake_shard->futex_table.erase(wake_key);
     if (!node) {
         // nothing blocked on this futex if we can't find it
+        unlock();
         return ZX_OK;
     }
 
@@ -184,26 +225,91 @@ zx_status_t FutexContext::FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t
 
             // now requeue our nodes to requeue_ptr mutex
             DEBUG_ASSERT(requeue_head->GetKey() == requeue_key);
-            QueueNodesLocked(requeue_head);
+            QueueNodesLocked(requeue_shard, requeue_head);
         }
     }
 
     // add any remaining nodes back to wake_key futex
     if (node != nullptr) {
         DEBUG_ASSERT(node->GetKey() == wake_key);
-        futex_table_.insert(node);
+        wake_shard->futex_table.insert(node);
     }
 
+    unlock();
     if (any_woken) {
-        lock.release();
         thread_reschedule();
     }
 
     return ZX_OK;
 }
 
-void FutexContext::QueueNodesLocked(FutexNode* head) {
-    DEBUG_ASSERT(lock_.IsHeld());
+zx_status_t FutexContext::FutexRequeueMany(const uintptr_t* wake_keys, uint32_t count,
+                                           int current_value, uint32_t wake_count,
+                                           user_in_ptr<const int> requeue_ptr)
+    TA_NO_THREAD_SAFETY_ANALYSIS {
+    LTRACE_ENTRY;
+
+    uintptr_t requeue_key = reinterpret_cast<uintptr_t>(requeue_ptr.get());
+    if (requeue_key == 0 || requeue_key % sizeof(int))
+        return ZX_ERR_INVALID_ARGS;
+
+    static_assert(kNumShards <= 32, "shard mask too small");
+    uint32_t shard_mask = 1u << (ShardFor(requeue_key) - shards_);
+    for (uint32_t i = 0; i < count; i++) {
+        if (wake_keys[i] == requeue_key || wake_keys[i] % sizeof(int))
+            return ZX_ERR_INVALID_ARGS;
+        shard_mask |= 1u << (ShardFor(wake_keys[i]) - shards_);
+    }
+
+    // Take every shard lock needed up front, in index order so that this
+    // cannot deadlock against FutexRequeue() or another FutexRequeueMany().
+    for (size_t i = 0; i < kNumShards; i++) {
+        if (shard_mask & (1u << i))
+            shards_[i].lock.Acquire();
+    }
+
+    Shard* requeue_shard = ShardFor(requeue_key);
+    bool any_woken = false;
+    for (uint32_t i = 0; i < count; i++) {
+        uintptr_t wake_key = wake_keys[i];
+        user_in_ptr<const int> wake_ptr(reinterpret_cast<const int*>(wake_key));
+
+        // A futex that cannot be read or was changed since the caller looked
+        // at it is left alone rather than failing the whole batch.
+        int value;
+        if (wake_ptr.copy_from_user(&value) != ZX_OK || value != current_value)
+            continue;
+
+        Shard* wake_shard = ShardFor(wake_key);
+        FutexNode* node = wake_shard->futex_table.erase(wake_key);
+        if (!node)
+            continue;
+
+        while (node && wake_count > 0) {
+            node = FutexNode::WakeThreads(node, 1, wake_key, &any_woken);
+            wake_count--;
+        }
+
+        if (node) {
+            FutexNode::RemoveFromHead(node, UINT32_MAX, wake_key, requeue_key);
+            DEBUG_ASSERT(node->GetKey() == requeue_key);
+            QueueNodesLocked(requeue_shard, node);
+        }
+    }
+
+    for (size_t i = kNumShards; i-- > 0;) {
+        if (shard_mask & (1u << i))
+            shards_[i].lock.Release();
+    }
+    if (any_woken) {
+        thread_reschedule();
+    }
+
+    return ZX_OK;
+}
+
+void FutexContext::QueueNodesLocked(Shard* shard, FutexNode* head) {
+    DEBUG_ASSERT(shard->lock.IsHeld());
 
     FutexNode::HashTable::iterator iter;
 
@@ -211,29 +317,35 @@ void FutexContext::QueueNodesLocked(FutexNode* head) {
     // succeeds, then the current thread is first to block on this futex and we
     // are finished.  If the insert fails, then there is already a thread
     // waiting on this futex.  Add ourselves to that thread's list.
-    if (!futex_table_.insert_or_find(head, &iter))
+    if (!shard->futex_table.insert_or_find(head, &iter))
         iter->AppendList(head);
 }
 
 // This attempts to unqueue a thread (which may or may not be waiting on a
 // futex), given its FutexNode.  This returns whether the FutexNode was
 // found and removed from a futex wait queue.
-bool FutexContext::UnqueueNodeLocked(FutexNode* node) {
-    DEBUG_ASSERT(lock_.IsHeld());
-
-    if (!node->IsInQueue())
-        return false;
-
+bool FutexContext::UnqueueNode(FutexNode* node) {
     // Note: When UnqueueNode() is called from FutexWait(), it might be
     // tempting to reuse the futex key that was passed to FutexWait().
     // However, that could be out of date if the thread was requeued by
-    // FutexRequeue(), so we need to re-get the hash table key here.
-    uintptr_t futex_key = node->GetKey();
-
-    FutexNode* old_head = futex_table_.erase(futex_key);
-    DEBUG_ASSERT(old_head);
-    FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
-    if (new_head)
-        futex_table_.insert(new_head);
-    return true;
+    // FutexRequeue(), so we need to re-get the hash table key here.  The key
+    // only changes with the locks of both the old and new shard held, so once
+    // it matches the shard whose lock we hold it can no longer move.
+    while (true) {
+        uintptr_t futex_key = node->GetKey();
+        Shard* shard = ShardFor(futex_key);
+        AutoLock lock(&shard->lock);
+        if (node->GetKey() != futex_key)
+            continue;
+
+        if (!node->IsInQueue())
+            return false;
+
+        FutexNode* old_head = shard->futex_table.erase(futex_key);
+        DEBUG_ASSERT(old_head);
+        FutexNode* new_head = FutexNode::RemoveNodeFromList(old_head, node);
+        if (new_head)
+            shard->futex_table.insert(new_head);
+        return true;
+    }
 }
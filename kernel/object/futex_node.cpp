@@ -85,8 +85,8 @@ FutexNode* FutexNode::WakeThreads(FutexNode* node, uint32_t count,
     FutexNode* const list_end = node->queue_prev_;
     for (uint32_t i = 0; i < count; i++) {
         DEBUG_ASSERT(node->GetKey() == old_hash_key);
-        // Clear this field to avoid any possible confusion.
-        node->set_hash_key(0);
+        // The key is left alone: a thread whose wait times out as it is
+        // being woken uses it to find, and wait for, the lock we hold.
 
         const bool is_last_node = (node == list_end);
         FutexNode* next = node->queue_next_;
@@ -149,7 +149,8 @@ FutexNode* FutexNode::RemoveFromHead(FutexNode* list_head, uint32_t count,
 // This blocks the current thread.  This releases the given mutex (which
 // must be held when BlockThread() is called).  To reduce contention, it
 // does not reclaim the mutex on return.
-zx_status_t FutexNode::BlockThread(fbl::Mutex* mutex, zx_time_t deadline) TA_NO_THREAD_SAFETY_ANALYSIS {
+zx_status_t FutexNode::BlockThread(fbl::Mutex* mutex, zx_time_t deadline,
+                                   thread_t* owner) TA_NO_THREAD_SAFETY_ANALYSIS {
     AutoThreadLock lock;
 
     // We specifically want reschedule=false here, otherwise the
@@ -159,9 +160,13 @@ zx_status_t FutexNode::BlockThread(fbl::Mutex* mutex, zx_time_t deadline) TA_NO_
 
     thread_t* current_thread = get_current_thread();
     zx_status_t result;
+    if (owner)
+        thread_lend_priority(owner);
     current_thread->interruptable = true;
     result = wait_queue_block(&wait_queue_, deadline);
     current_thread->interruptable = false;
+    if (owner)
+        thread_reclaim_priority();
 
     return result;
 }
@@ -175,8 +180,8 @@ bool FutexNode::WakeThread() {
     // cases to consider:
     //  1) The thread's wait times out, or the thread is killed or
     //     suspended.  In those cases, FutexWait() will reacquire the
-    //     FutexContext lock.  We are currently holding that lock, so
-    //     FutexWait() will not race with us.
+    //     lock of the FutexContext shard for this futex.  We are currently
+    //     holding that lock, so FutexWait() will not race with us.
     //  2) The thread is woken by our wait_queue_wake_one() call.  In
     //     this case, FutexWait() will *not* reacquire the FutexContext
     //     lock.  To handle this correctly, we must not access |this|
@@ -20,6 +20,7 @@
 #include <lib/oom.h>
 
 #include <object/diagnostics.h>
+#include <object/event_dispatcher.h>
 #include <object/excp_port.h>
 #include <object/job_dispatcher.h>
 #include <object/policy_manager.h>
@@ -28,6 +29,7 @@
 
 #include <fbl/function.h>
 
+#include <zircon/syscalls/system.h>
 #include <zircon/types.h>
 
 #define LOCAL_TRACE 0
@@ -56,6 +58,51 @@ PolicyManager* GetSystemPolicyManager() {
     return policy_manager;
 }
 
+// One event per memory pressure level; only the current level's is signaled.
+static fbl::RefPtr<EventDispatcher> memory_pressure_events[ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT];
+
+fbl::RefPtr<EventDispatcher> GetMemoryPressureEvent(uint32_t kind) {
+    if (kind >= ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT)
+        return nullptr;
+    return memory_pressure_events[kind];
+}
+
+static uint32_t pressure_event_kind(oom_pressure_level_t level) {
+    switch (level) {
+    case OOM_PRESSURE_WARNING:
+        return ZX_SYSTEM_EVENT_MEMORY_PRESSURE_WARNING;
+    case OOM_PRESSURE_CRITICAL:
+        return ZX_SYSTEM_EVENT_MEMORY_PRESSURE_CRITICAL;
+    case OOM_PRESSURE_NORMAL:
+    default:
+        return ZX_SYSTEM_EVENT_MEMORY_PRESSURE_NORMAL;
+    }
+}
+
+// Called from the OOM thread when the memory pressure level changes.
+static void oom_pressure(oom_pressure_level_t level) {
+    const uint32_t kind = pressure_event_kind(level);
+    // signal the new level before clearing the old one, so that a waiter on
+    // every level never sees none of them signaled
+    memory_pressure_events[kind]->user_signal(0u, ZX_EVENT_SIGNALED, false);
+    for (uint32_t i = 0; i < ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT; i++) {
+        if (i != kind)
+            memory_pressure_events[i]->user_signal(ZX_EVENT_SIGNALED, 0u, false);
+    }
+}
+
+static void create_memory_pressure_events() {
+    for (auto& event : memory_pressure_events) {
+        fbl::RefPtr<Dispatcher> dispatcher;
+        zx_rights_t rights;
+        zx_status_t status = EventDispatcher::Create(0u, &dispatcher, &rights);
+        ASSERT(status == ZX_OK);
+        event = DownCastDispatcher<EventDispatcher>(&dispatcher);
+    }
+    memory_pressure_events[ZX_SYSTEM_EVENT_MEMORY_PRESSURE_NORMAL]->user_signal(
+        0u, ZX_EVENT_SIGNALED, false);
+}
+
 // Counts and optionally prints all job/process descendants of a job.
 namespace {
 class OomJobEnumerator final : public JobEnumerator {
@@ -183,11 +230,14 @@ static void object_glue_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
     root_job = JobDispatcher::CreateRootJob();
     policy_manager = PolicyManager::Create();
     PortDispatcher::Init();
+    create_memory_pressure_events();
     // Be sure to update kernel_cmdline.md if any of these defaults change.
     oom_init(cmdline_get_bool("kernel.oom.enable", true),
              ZX_SEC(cmdline_get_uint64("kernel.oom.sleep-sec", 1)),
              cmdline_get_uint64("kernel.oom.redline-mb", 50) * MB,
-             oom_lowmem);
+             cmdline_get_uint64("kernel.oom.warning-mb", 300) * MB,
+             cmdline_get_uint64("kernel.oom.critical-mb", 150) * MB,
+             oom_lowmem, oom_pressure);
 }
 
 LK_INIT_HOOK(libobject, object_glue_init, LK_INIT_LEVEL_THREADING);
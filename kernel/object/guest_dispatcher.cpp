@@ -36,8 +36,10 @@ GuestDispatcher::GuestDispatcher(fbl::unique_ptr<Guest> guest)
 GuestDispatcher::~GuestDispatcher() {}
 
 zx_status_t GuestDispatcher::SetTrap(uint32_t kind, zx_vaddr_t addr, size_t len,
-                                     fbl::RefPtr<PortDispatcher> port, uint64_t key) {
+                                     fbl::RefPtr<PortDispatcher> port,
+                                     fbl::RefPtr<EventDispatcher> event, uint64_t key) {
     canary_.Assert();
 
-    return arch_guest_set_trap(guest_.get(), kind, addr, len, fbl::move(port), key);
+    return arch_guest_set_trap(guest_.get(), kind, addr, len, fbl::move(port), fbl::move(event),
+                               key);
 }
@@ -6,11 +6,16 @@
 
 #include <object/handle.h>
 
+#include <arch/ops.h>
 #include <object/dispatcher.h>
 #include <fbl/arena.h>
 #include <fbl/auto_lock.h>
 #include <fbl/mutex.h>
+#include <kernel/align.h>
+#include <kernel/auto_lock.h>
+#include <kernel/spinlock.h>
 #include <pow2.h>
+#include <string.h>
 
 using fbl::AutoLock;
 
@@ -46,6 +51,55 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
                   0xffffffffu,
               "Masks do not agree");
 
+// Free slots are kept in small per-cpu caches so that making and deleting
+// handles doesn't take the global Handle::mutex_ every time. A cache refills
+// from, and spills back to, the arena a batch at a time. Cached slots keep
+// their stashed base_value, so handle values behave as if the slots had gone
+// straight back to the arena.
+constexpr size_t kHandleCacheSize = 64;
+constexpr size_t kHandleCacheBatch = kHandleCacheSize / 2;
+
+struct HandleCache {
+    SpinLock lock;
+    size_t count TA_GUARDED(lock) = 0;
+    void* slots[kHandleCacheSize] TA_GUARDED(lock);
+} __CPU_ALIGN;
+
+HandleCache handle_caches[SMP_MAX_CPUS];
+
+// Being migrated after picking a cache is harmless, the cache is only ever
+// touched under its own lock.
+HandleCache& current_cache() {
+    return handle_caches[arch_curr_cpu_num()];
+}
+
+// Used once the arena is exhausted, since other cpus may still be
+// holding free slots.
+void* steal_cached_slot() {
+    for (auto& cache : handle_caches) {
+        AutoSpinLockIrqSave guard(&cache.lock);
+        if (cache.count > 0)
+            return cache.slots[--cache.count];
+    }
+    return nullptr;
+}
+
+// Per-cpu read section counts. Odd while a ReadSection is running on the cpu.
+struct HandleReaders {
+    fbl::atomic<uint64_t> seq;
+} __CPU_ALIGN;
+
+HandleReaders handle_readers[SMP_MAX_CPUS];
+
+size_t cached_slot_count() {
+    size_t count = 0;
+    for (auto& cache : handle_caches) {
+        AutoSpinLockIrqSave guard(&cache.lock);
+        count += cache.count;
+    }
+    return count;
+}
+
 }  // namespace
 
 fbl::Mutex Handle::mutex_;
@@ -58,7 +112,7 @@ void Handle::Init() TA_NO_THREAD_SAFETY_ANALYSIS {
 // Returns a new |base_value| based on the value stored in the free
 // arena slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(mutex_) {
+uint32_t Handle::GetNewBaseValue(void* addr) {
     // Get the index of this slot within the arena.
     uint32_t handle_index = HandleToIndex(reinterpret_cast<Handle*>(addr));
     DEBUG_ASSERT((handle_index & ~kHandleIndexMask) == 0);
@@ -76,33 +130,88 @@ uint32_t Handle::GetNewBaseValue(void* addr) TA_REQ(mutex_) {
     return (handle_index | new_gen);
 }
 
-// Allocate space for a Handle from the arena, but don't instantiate the
-// object.  |base_value| gets the value for Handle::base_value_.  |what|
-// says whether this is allocation or duplication, for the error message.
-void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher,
-                    const char* what, uint32_t* base_value) {
+// Takes a free slot from the current cpu's cache, refilling the cache
+// from the arena when it has run dry.
+void* Handle::AllocSlot() {
+    HandleCache& cache = current_cache();
+    {
+        AutoSpinLockIrqSave guard(&cache.lock);
+        if (likely(cache.count > 0))
+            return cache.slots[--cache.count];
+    }
+
+    void* batch[kHandleCacheBatch];
+    size_t n = 0;
     size_t outstanding_handles;
     {
         AutoLock lock(&mutex_);
-        void* addr = arena_.Alloc();
+        for (; n < kHandleCacheBatch; n++) {
+            batch[n] = arena_.Alloc();
+            if (!batch[n])
+                break;
+        }
         outstanding_handles = arena_.DiagnosticCount();
-        if (likely(addr)) {
-            if (outstanding_handles > kHighHandleCount) {
-                // TODO: Avoid calling this for every handle after
-                // kHighHandleCount; printfs are slow and we're
-                // holding the mutex.
-                printf("WARNING: High handle count: %zu handles\n",
-                       outstanding_handles);
-            }
-            dispatcher->increment_handle_count();
-            *base_value = GetNewBaseValue(addr);
-            return addr;
+    }
+    if (outstanding_handles > kHighHandleCount) {
+        // Only warned about once per refill, rather than for every handle.
+        printf("WARNING: High handle count: %zu handles\n", outstanding_handles);
+    }
+    if (unlikely(n == 0))
+        return steal_cached_slot();
+
+    // Keep the first slot for ourselves and cache the rest. If the cache
+    // filled back up in the meantime, the overflow goes back to the arena.
+    size_t next = 1;
+    {
+        AutoSpinLockIrqSave guard(&cache.lock);
+        while (next < n && cache.count < kHandleCacheSize)
+            cache.slots[cache.count++] = batch[next++];
+    }
+    if (unlikely(next < n)) {
+        AutoLock lock(&mutex_);
+        while (next < n)
+            arena_.Free(batch[next++]);
+    }
+    return batch[0];
+}
+
+// Returns a torn down slot to the current cpu's cache. A full cache spills
+// its coldest half back to the arena.
+void Handle::FreeSlot(void* addr) {
+    HandleCache& cache = current_cache();
+    void* batch[kHandleCacheBatch];
+    {
+        AutoSpinLockIrqSave guard(&cache.lock);
+        if (likely(cache.count < kHandleCacheSize)) {
+            cache.slots[cache.count++] = addr;
+            return;
         }
+        memcpy(batch, cache.slots, sizeof(batch));
+        cache.count -= kHandleCacheBatch;
+        memmove(cache.slots, cache.slots + kHandleCacheBatch,
+                cache.count * sizeof(cache.slots[0]));
+        cache.slots[cache.count++] = addr;
     }
 
-    printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
-           what, outstanding_handles);
-    return nullptr;
+    AutoLock lock(&mutex_);
+    for (void* slot : batch)
+        arena_.Free(slot);
+}
+
+// Allocate space for a Handle, but don't instantiate the object.
+// |base_value| gets the value for Handle::base_value_.  |what| says whether
+// this is allocation or duplication, for the error message.
+void* Handle::Alloc(const fbl::RefPtr<Dispatcher>& dispatcher,
+                    const char* what, uint32_t* base_value) {
+    void* addr = AllocSlot();
+    if (unlikely(!addr)) {
+        printf("WARNING: Could not allocate %s handle (%zu outstanding)\n",
+               what, diagnostics::OutstandingHandles());
+        return nullptr;
+    }
+    dispatcher->increment_handle_count();
+    *base_value = GetNewBaseValue(addr);
+    return addr;
 }
 
 HandleOwner Handle::Make(fbl::RefPtr<Dispatcher> dispatcher,
@@ -174,12 +283,8 @@ void Handle::Delete() {
 
     TearDown();
 
-    bool zero_handles = false;
-    {
-        AutoLock lock(&mutex_);
-        zero_handles = disp->decrement_handle_count();
-        arena_.Free(this);
-    }
+    bool zero_handles = disp->decrement_handle_count();
+    FreeSlot(this);
 
     if (zero_handles)
         disp->on_zero_handles();
@@ -190,26 +295,57 @@ void Handle::Delete() {
 
 Handle* Handle::FromU32(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
     Handle* handle = IndexToHandle(value & kHandleIndexMask);
-    {
-        AutoLock lock(&mutex_);
-        if (unlikely(!arena_.in_range(handle)))
-            return nullptr;
-    }
+    // The arena's bounds are fixed by Init(), so checking against them
+    // doesn't need the mutex.
+    if (unlikely(!arena_.in_range(handle)))
+        return nullptr;
     return likely(handle->base_value() == value) ? handle : nullptr;
 }
 
+Handle::ReadSection::ReadSection() {
+    arch_interrupt_save(&state_, SPIN_LOCK_FLAG_INTERRUPTS);
+    cpu_ = arch_curr_cpu_num();
+    handle_readers[cpu_].seq.fetch_add(1u, fbl::memory_order_relaxed);
+    // Order the count before any process_id() the section reads, pairing
+    // with the fence in WaitForReaders().
+    fbl::atomic_thread_fence();
+}
+
+Handle::ReadSection::~ReadSection() {
+    handle_readers[cpu_].seq.fetch_add(1u, fbl::memory_order_release);
+    arch_interrupt_restore(state_, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+void Handle::WaitForReaders() {
+    // A section that starts after this fence sees the cleared process_id()
+    // and leaves the handle alone, so only the running ones need waiting for.
+    fbl::atomic_thread_fence();
+    const uint num_cpus = arch_max_num_cpus();
+    for (uint i = 0; i < num_cpus; i++) {
+        uint64_t seq = handle_readers[i].seq.load(fbl::memory_order_acquire);
+        if (!(seq & 1))
+            continue;
+        while (handle_readers[i].seq.load(fbl::memory_order_acquire) == seq)
+            arch_spinloop_pause();
+    }
+}
+
 uint32_t Handle::Count(const fbl::RefPtr<const Dispatcher>& dispatcher) {
-    // Handle::mutex_ also guards Dispatcher::handle_count_.
-    AutoLock lock(&mutex_);
     return dispatcher->current_handle_count();
 }
 
 size_t Handle::diagnostics::OutstandingHandles() {
+    // Slots sitting in the per-cpu caches are free as far as callers are
+    // concerned, even though the arena counts them as allocated.
+    size_t cached = cached_slot_count();
     AutoLock lock(&mutex_);
-    return arena_.DiagnosticCount();
+    size_t count = arena_.DiagnosticCount();
+    return count > cached ? count - cached : 0;
 }
 
 void Handle::diagnostics::DumpTableInfo() {
+    size_t cached = cached_slot_count();
     AutoLock lock(&mutex_);
     arena_.Dump();
+    printf("handles: %zu free slots in per-cpu caches\n", cached);
 }
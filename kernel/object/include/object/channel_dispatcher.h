@@ -12,6 +12,7 @@
 #include <object/dispatcher.h>
 #include <object/message_packet.h>
 
+#include <zircon/syscalls/object.h>
 #include <zircon/types.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
@@ -22,6 +23,7 @@
 class ChannelDispatcher final : public Dispatcher {
 public:
     class MessageWaiter;
+    using MessageList = fbl::DoublyLinkedList<fbl::unique_ptr<MessagePacket>>;
 
     static zx_status_t Create(fbl::RefPtr<Dispatcher>* dispatcher0,
                               fbl::RefPtr<Dispatcher>* dispatcher1, zx_rights_t* rights);
@@ -45,12 +47,26 @@ public:
                      fbl::unique_ptr<MessagePacket>* msg,
                      bool may_disard);
 
+    // Read up to |count| messages from this endpoint's message queue at once, stopping at the
+    // first message that doesn't fit the buffers described by the matching entry of |descs|.
+    // The sizes of the messages read, which are appended to |msgs|, are written back to |descs|
+    // and their number to |*actual|. If not even the first message fits, its size is written to
+    // |descs[0]| and ZX_ERR_BUFFER_TOO_SMALL is returned.
+    zx_status_t ReadMany(zx_channel_msg_t* descs, uint32_t count, MessageList* msgs,
+                         uint32_t* actual);
+
     // Write to the opposing endpoint's message queue.
     zx_status_t Write(fbl::unique_ptr<MessagePacket> msg);
+    // Write all of |msgs| to the opposing endpoint's message queue at once. On failure
+    // |msgs| is left untouched.
+    zx_status_t WriteMany(MessageList* msgs);
     zx_status_t Call(fbl::unique_ptr<MessagePacket> msg,
                      zx_time_t deadline, bool* return_handles,
                      fbl::unique_ptr<MessagePacket>* reply);
 
+    // Reports the messages queued on this endpoint and the memory they hold.
+    void GetInfo(zx_info_channel_t* info);
+
     // Performs the wait-then-read half of Call.  This is meant for retrying
     // after an interruption caused by suspending.
     zx_status_t ResumeInterruptedCall(MessageWaiter* waiter, zx_time_t deadline,
@@ -93,7 +109,6 @@ public:
     };
 
 private:
-    using MessageList = fbl::DoublyLinkedList<fbl::unique_ptr<MessagePacket>>;
     using WaiterList = fbl::DoublyLinkedList<MessageWaiter*>;
 
     void RemoveWaiter(MessageWaiter* waiter);
@@ -101,6 +116,10 @@ private:
     ChannelDispatcher();
     void Init(fbl::RefPtr<ChannelDispatcher> other);
     int WriteSelf(fbl::unique_ptr<MessagePacket> msg);
+    int WriteSelfMany(MessageList* msgs);
+    // Hands |msg| to the Call waiting for it, or queues it. Returns the number of threads
+    // woken up.
+    int EnqueueLocked(fbl::unique_ptr<MessagePacket> msg, bool* queued) TA_REQ(lock_);
     zx_status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     void OnPeerZeroHandles();
 
@@ -109,6 +128,10 @@ private:
     fbl::Mutex lock_;
     MessageList messages_ TA_GUARDED(lock_);
     uint64_t message_count_ TA_GUARDED(lock_) = 0;
+    // Payload and total packet memory of |messages_|, for GetInfo().
+    uint64_t message_bytes_ TA_GUARDED(lock_) = 0;
+    uint64_t memory_bytes_ TA_GUARDED(lock_) = 0;
+    uint64_t peak_memory_bytes_ TA_GUARDED(lock_) = 0;
     WaiterList waiters_ TA_GUARDED(lock_);
     fbl::RefPtr<ChannelDispatcher> other_ TA_GUARDED(lock_);
     zx_koid_t other_koid_ TA_GUARDED(lock_);
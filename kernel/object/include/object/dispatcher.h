@@ -10,6 +10,7 @@
 #include <stdint.h>
 #include <stdint.h>
 
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_single_list.h>
@@ -59,6 +60,7 @@ DECLARE_DISPTAG(GuestDispatcher, ZX_OBJ_TYPE_GUEST)
 DECLARE_DISPTAG(VcpuDispatcher, ZX_OBJ_TYPE_VCPU)
 DECLARE_DISPTAG(TimerDispatcher, ZX_OBJ_TYPE_TIMER)
 DECLARE_DISPTAG(IommuDispatcher, ZX_OBJ_TYPE_IOMMU)
+DECLARE_DISPTAG(WaitSetDispatcher, ZX_OBJ_TYPE_WAIT_SET)
 
 #undef DECLARE_DISPTAG
 
@@ -72,21 +74,19 @@ public:
 
     zx_koid_t get_koid() const { return koid_; }
 
-    // Must be called under the handle table lock.
+    // Only to be called by Handle.
     void increment_handle_count() {
-        ++handle_count_;
+        handle_count_.fetch_add(1u);
     }
 
-    // Must be called under the handle table lock.
+    // Only to be called by Handle.
     // Returns true exactly when the handle count goes to zero.
     bool decrement_handle_count() {
-        --handle_count_;
-        return handle_count_ == 0u;
+        return handle_count_.fetch_sub(1u) == 1u;
     }
 
-    // Must be called under the handle table lock.
     uint32_t current_handle_count() const {
-        return handle_count_;
+        return handle_count_.load();
     }
 
     // The following are only to be called when |has_state_tracker| reports true.
@@ -126,6 +126,24 @@ public:
 
     virtual zx_status_t user_signal(uint32_t clear_mask, uint32_t set_mask, bool peer);
 
+    // While a SignalBatch is in scope, state updates made by the current
+    // thread that wake other threads don't reschedule one by one; the batch
+    // reschedules once, when it goes out of scope, if any of them woke a
+    // thread. Batches don't nest.
+    class SignalBatch {
+    public:
+        SignalBatch();
+        ~SignalBatch();
+
+    private:
+        friend class Dispatcher;
+
+        SignalBatch(const SignalBatch&) = delete;
+        SignalBatch& operator=(const SignalBatch&) = delete;
+
+        bool woke_threads_ = false;
+    };
+
     virtual void on_zero_handles() { }
 
     virtual zx_koid_t get_related_koid() const { return 0ULL; }
@@ -181,7 +199,7 @@ private:
     StateObserver::Flags UpdateInternalLocked(ObserverList* obs_to_remove, zx_signals_t signals) TA_REQ(lock_);
 
     const zx_koid_t koid_;
-    uint32_t handle_count_;
+    fbl::atomic<uint32_t> handle_count_;
 
     // TODO(kulakowski) Make signals_ TA_GUARDED(lock_).
     // Right now, signals_ is almost entirely accessed under the
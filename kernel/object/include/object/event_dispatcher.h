@@ -9,10 +9,12 @@
 #include <zircon/types.h>
 #include <fbl/canary.h>
 #include <object/dispatcher.h>
+#include <object/object_cache.h>
 
 #include <sys/types.h>
 
-class EventDispatcher final : public Dispatcher {
+class EventDispatcher final : public Dispatcher,
+                              public ObjectCacheAllocated<&event_dispatcher_cache> {
 public:
     static zx_status_t Create(uint32_t options, fbl::RefPtr<Dispatcher>* dispatcher,
                               zx_rights_t* rights);
@@ -28,3 +30,8 @@ private:
     fbl::Canary<fbl::magic("EVTD")> canary_;
     CookieJar cookie_jar_;
 };
+
+// Returns the event that is signaled while memory pressure is at the level
+// |kind|, one of ZX_SYSTEM_EVENT_MEMORY_PRESSURE_*, or null if |kind| is not
+// one of them.
+fbl::RefPtr<EventDispatcher> GetMemoryPressureEvent(uint32_t kind);
@@ -11,9 +11,12 @@
 #include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
 #include <object/dispatcher.h>
+#include <object/object_cache.h>
 #include <sys/types.h>
 
-class EventPairDispatcher final : public Dispatcher {
+class EventPairDispatcher final
+    : public Dispatcher,
+      public ObjectCacheAllocated<&event_pair_dispatcher_cache> {
 public:
     static zx_status_t Create(fbl::RefPtr<Dispatcher>* dispatcher0,
                               fbl::RefPtr<Dispatcher>* dispatcher1,
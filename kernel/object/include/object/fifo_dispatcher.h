@@ -15,6 +15,7 @@
 #include <fbl/mutex.h>
 #include <fbl/ref_counted.h>
 #include <lib/user_copy/user_ptr.h>
+#include <vm/vm_object.h>
 
 class FifoDispatcher final : public Dispatcher {
 public:
@@ -34,10 +35,20 @@ public:
     zx_status_t WriteFromUser(user_in_ptr<const uint8_t> src, size_t len, uint32_t* actual);
     zx_status_t ReadToUser(user_out_ptr<uint8_t> dst, size_t len, uint32_t* actual);
 
+    // ZX_FIFO_SHARED_RING mode only. |rx| is the ring this endpoint reads
+    // from and |tx| the ring its peer reads from.
+    zx_status_t GetRings(fbl::RefPtr<VmObject>* rx, fbl::RefPtr<VmObject>* tx);
+    // Recomputes the READABLE and WRITABLE signals of both endpoints from
+    // the head and tail values userspace left in the rings.
+    zx_status_t Notify();
+
 private:
     FifoDispatcher(uint32_t options, uint32_t elem_count, uint32_t elem_size,
-                   fbl::unique_ptr<uint8_t[]> data);
+                   fbl::unique_ptr<uint8_t[]> data, fbl::RefPtr<VmObject> ring);
+    static zx_status_t CreateRing(uint32_t count, uint32_t elemsize,
+                                  fbl::RefPtr<VmObject>* ring);
     void Init(fbl::RefPtr<FifoDispatcher> other);
+    zx_status_t RefreshRing();
     zx_status_t WriteSelf(user_in_ptr<const uint8_t> ptr, size_t len, uint32_t* actual);
     zx_status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
 
@@ -54,6 +65,8 @@ private:
     uint32_t head_ TA_GUARDED(lock_);
     uint32_t tail_ TA_GUARDED(lock_);
     fbl::unique_ptr<uint8_t[]> data_ TA_GUARDED(lock_);
+    // Receive ring in ZX_FIFO_SHARED_RING mode, where |data_| is unused.
+    const fbl::RefPtr<VmObject> ring_;
 
     static constexpr uint32_t kMaxSizeBytes = PAGE_SIZE;
 };
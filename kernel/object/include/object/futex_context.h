@@ -23,6 +23,10 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+// The hash table is split into shards by futex address, each with its own lock, so
+// that threads using unrelated futexes in the same process do not contend.
+class ThreadDispatcher;
+
 class FutexContext {
 public:
     FutexContext();
@@ -35,6 +39,12 @@ public:
     // on the same |value_ptr| futex.
     zx_status_t FutexWait(user_in_ptr<const int> value_ptr, int current_value, zx_time_t deadline);
 
+    // FutexWaitPi is FutexWait for futexes held by a known thread, such as a
+    // mutex lock word. While the current thread is blocked, |owner| runs at
+    // no less than the current thread's priority.
+    zx_status_t FutexWaitPi(user_in_ptr<const int> value_ptr, int current_value,
+                            ThreadDispatcher* owner, zx_time_t deadline);
+
     // FutexWake will wake up to |count| number of threads blocked on the |value_ptr| futex.
     zx_status_t FutexWake(user_in_ptr<const int> value_ptr, uint32_t count);
 
@@ -47,18 +57,39 @@ public:
     zx_status_t FutexRequeue(user_in_ptr<const int> wake_ptr, uint32_t wake_count, int current_value,
                              user_in_ptr<const int> requeue_ptr, uint32_t requeue_count);
 
+    // FutexRequeueMany is FutexRequeue over the |count| futexes whose
+    // addresses are in |wake_keys|, all moving to the one |requeue_ptr| futex.
+    // Futexes that do not hold |current_value| are skipped. Up to |wake_count|
+    // threads are woken, taken from the futexes in array order, and all the
+    // remaining waiters of the matching futexes are requeued.
+    zx_status_t FutexRequeueMany(const uintptr_t* wake_keys, uint32_t count, int current_value,
+                                 uint32_t wake_count, user_in_ptr<const int> requeue_ptr);
+
 private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    static constexpr uint32_t kShardBits = 4;
+    static constexpr size_t kNumShards = 1u << kShardBits;
+
+    struct Shard {
+        // protects futex_table
+        fbl::Mutex lock;
+
+        // Hash table for the futexes of this shard.
+        // Key is futex address, value is the FutexNode for the head of futex's blocked
+        // thread list.
+        FutexNode::HashTable futex_table TA_GUARDED(lock);
+    };
+
+    Shard* ShardFor(uintptr_t futex_key);
+
+    zx_status_t Wait(user_in_ptr<const int> value_ptr, int current_value, thread_t* owner,
+                     zx_time_t deadline);
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    void QueueNodesLocked(Shard* shard, FutexNode* head) TA_REQ(shard->lock);
 
-    // protects futex_table_
-    fbl::Mutex lock_;
+    bool UnqueueNode(FutexNode* node);
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+    Shard shards_[kNumShards];
 };
@@ -42,7 +42,9 @@ public:
                                      uintptr_t new_hash_key);
 
     // This must be called with |mutex| held and returns without |mutex| held.
-    zx_status_t BlockThread(fbl::Mutex* mutex, zx_time_t deadline) TA_REL(mutex);
+    // If |owner| is not null the current thread lends it its priority while
+    // blocked.
+    zx_status_t BlockThread(fbl::Mutex* mutex, zx_time_t deadline, thread_t* owner) TA_REL(mutex);
 
     void set_hash_key(uintptr_t key) {
         hash_key_ = key;
@@ -12,6 +12,7 @@
 #include <fbl/macros.h>
 #include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
+#include <kernel/spinlock.h>
 #include <stdint.h>
 #include <zircon/types.h>
 
@@ -87,9 +88,11 @@ public:
         return process_id_.load(fbl::memory_order_relaxed);
     }
 
-    // Sets the value returned by process_id().
+    // Sets the value returned by process_id(). The store is a release so
+    // that a ReadSection that sees the new owner also sees the handle's
+    // contents.
     void set_process_id(zx_koid_t pid) {
-        process_id_.store(pid, fbl::memory_order_relaxed);
+        process_id_.store(pid, fbl::memory_order_release);
     }
 
     // Returns the |rights| parameter that was provided when this instance
@@ -116,6 +119,27 @@ public:
     // Maps an integer obtained by Handle::base_value() back to a Handle.
     static Handle* FromU32(uint32_t value);
 
+    // Brackets a lookup by value that doesn't hold the owning process's
+    // handle table lock. A handle seen with the expected process_id() inside
+    // the section isn't torn down until the section ends, so its rights and
+    // dispatcher may be read and the dispatcher referenced. Interrupts are
+    // disabled throughout, so keep sections short and never block in one.
+    class ReadSection {
+    public:
+        ReadSection();
+        ~ReadSection();
+
+        DISALLOW_COPY_ASSIGN_AND_MOVE(ReadSection);
+
+    private:
+        spin_lock_saved_state_t state_;
+        uint cpu_;
+    };
+
+    // Waits out every ReadSection in progress. Called after clearing the
+    // process_id() of handles leaving a process, before they can be torn down.
+    static void WaitForReaders();
+
     // Get the number of outstanding handles for a given dispatcher.
     static uint32_t Count(const fbl::RefPtr<const Dispatcher>&);
 
@@ -147,6 +171,10 @@ private:
                        uint32_t* base_value);
     static uint32_t GetNewBaseValue(void* addr);
 
+    // Get and return arena slots through the per-cpu caches.
+    static void* AllocSlot() TA_EXCL(mutex_);
+    static void FreeSlot(void* addr) TA_EXCL(mutex_);
+
     // Handle should never be destroyed by anything other than Delete,
     // which uses TearDown to do the actual destruction.
     ~Handle() = default;
@@ -164,7 +192,8 @@ private:
     const zx_rights_t rights_;
     const uint32_t base_value_;
 
-    // The handle arena and its mutex; also guards Dispatcher::handle_count_.
+    // The handle arena and its mutex. Most allocations and frees are
+    // satisfied by per-cpu caches without taking it.
     static fbl::Mutex mutex_;
     static fbl::Arena TA_GUARDED(mutex_) arena_;
 
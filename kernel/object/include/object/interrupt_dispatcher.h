@@ -6,12 +6,15 @@
 
 #pragma once
 
+#include <kernel/dpc.h>
 #include <kernel/event.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/types.h>
 #include <fbl/atomic.h>
 #include <fbl/mutex.h>
 #include <fbl/vector.h>
 #include <object/dispatcher.h>
+#include <object/port_dispatcher.h>
 #include <sys/types.h>
 
 #define SIGNAL_MASK(signal) (1ul << (signal))
@@ -30,12 +33,30 @@ public:
     zx_status_t UserSignal(uint32_t slot, zx_time_t timestamp);
     zx_status_t WaitForInterrupt(uint64_t* out_slots);
     zx_status_t GetTimeStamp(uint32_t slot, zx_time_t* out_timestamp);
+    // Steers the interrupt bound to |slot| to |cpu|.
+    zx_status_t SetAffinity(uint32_t slot, cpu_num_t cpu);
+    // Fills in up to |max| records, one per bound slot, and returns the
+    // number of bound slots.
+    size_t GetSlotInfo(zx_info_interrupt_slot_t* info, size_t max);
+
+    // Once bound to a port, interrupts are reported as ZX_PKT_TYPE_INTERRUPT
+    // packets instead of by WaitForInterrupt(). At most one packet is
+    // outstanding; Ack() re-arms the reported slots and lets the next one go.
+    zx_status_t BindPort(fbl::RefPtr<PortDispatcher> port, uint64_t key);
+    zx_status_t Ack();
+
+    // How long WaitForInterrupt() polls for another interrupt before it
+    // blocks, so that a busy driver doesn't context switch for every one.
+    static constexpr zx_duration_t kMaxPollWindow = ZX_MSEC(1);
+    zx_status_t set_poll_window(zx_duration_t window);
+    zx_duration_t get_poll_window() const { return poll_window_.load(); }
 
 protected:
     virtual void MaskInterrupt(uint32_t vector) = 0;
     virtual void UnmaskInterrupt(uint32_t vector) = 0;
     virtual zx_status_t RegisterInterruptHandler(uint32_t vector, void* data) = 0;
     virtual void UnregisterInterruptHandler(uint32_t vector) = 0;
+    virtual zx_status_t SetInterruptAffinity(uint32_t vector, cpu_num_t cpu) = 0;
 
     zx_status_t AddSlot(uint32_t slot, uint32_t vector, uint32_t flags) TA_REQ(lock_);
 
@@ -44,9 +65,18 @@ protected:
 
     void on_zero_handles() final;
 
-    int Signal(uint64_t signals, bool reschedule) {
+    void Signal(uint64_t signals, bool reschedule) {
         signals_.fetch_or(signals);
-        return event_signal_etc(&event_, reschedule, ZX_OK);
+        if (port_bound_.load()) {
+            // Ports can't be touched from irq context, so the packet goes
+            // out from a dpc. The ref is dropped in PortDpc().
+            if (port_armed_.exchange(false)) {
+                AddRef();
+                dpc_queue(&port_dpc_, reschedule);
+            }
+        } else {
+            event_signal_etc(&event_, reschedule, ZX_OK);
+        }
     }
 
     // slot used for canceling wait on last handle closed
@@ -60,6 +90,8 @@ protected:
     struct Interrupt {
         InterruptDispatcher* dispatcher;
         volatile zx_time_t timestamp;
+        // bumped from the irq handler, never reset
+        volatile uint64_t count;
         uint16_t vector;
         uint16_t slot;
         uint32_t flags;
@@ -68,6 +100,13 @@ protected:
     fbl::Mutex lock_;
 
 private:
+    static void PortDpc(dpc_t* dpc);
+    void SendPortPacketLocked() TA_REQ(lock_);
+    // Masks the signaled slots that are masked until the next wait and
+    // remembers them to unmask later.
+    void ReportSignals(uint64_t signals);
+    void RearmReportedSlots();
+
     // interrupts bound to this dispatcher
     fbl::Vector<Interrupt> interrupts_;
 
@@ -78,5 +117,16 @@ private:
     // current signaled slots
     fbl::atomic<uint64_t> signals_;
     // the signaled slots most recently returned from WaitForInterrupt()
+    // or sent in a port packet
     fbl::atomic<uint64_t> reported_signals_;
+    fbl::atomic<zx_duration_t> poll_window_;
+
+    // port delivery: |port_armed_| is true while no packet is outstanding
+    fbl::atomic<bool> port_bound_;
+    fbl::atomic<bool> port_armed_;
+    fbl::RefPtr<PortDispatcher> port_ TA_GUARDED(lock_);
+    // a packet went out and hasn't been acked yet
+    bool packet_sent_ TA_GUARDED(lock_);
+    PortPacket port_packet_;
+    dpc_t port_dpc_;
 };
@@ -12,18 +12,50 @@
 #include <zircon/types.h>
 #include <fbl/intrusive_single_list.h>
 
+// A position within an array of user buffers, which lets an MBufChain fill
+// or drain its mbufs across buffer boundaries. The buffer descriptors
+// themselves must already be in kernel memory.
+class UserIovecCursor {
+public:
+    UserIovecCursor(const zx_iovec_t* vec, size_t count) : vec_(vec), count_(count) {}
+
+    // Copy |len| bytes between the user buffers and |dst| or |src|, and
+    // advance past them. The position is undefined after a failure.
+    zx_status_t CopyFrom(void* dst, size_t len);
+    zx_status_t CopyTo(const void* src, size_t len);
+
+private:
+    const zx_iovec_t* vec_;
+    size_t count_;
+    size_t index_ = 0u;
+    size_t offset_ = 0u;
+};
+
 class MBufChain {
 public:
     MBufChain() = default;
     ~MBufChain();
 
-    zx_status_t WriteStream(user_in_ptr<const void> src, size_t len, size_t* written);
-    zx_status_t WriteDatagram(user_in_ptr<const void> src, size_t len, size_t* written);
-    size_t Read(user_out_ptr<void> dst, size_t len, bool datagram);
+    zx_status_t WriteStream(UserIovecCursor* src, size_t len, size_t* written);
+    zx_status_t WriteDatagram(UserIovecCursor* src, size_t len, size_t* written);
+    size_t Read(UserIovecCursor* dst, size_t len, bool datagram);
+
+    // Moves up to |len| bytes from the front of |src| to the back of this
+    // chain without copying through user memory. Whole mbufs are relinked;
+    // only a stream's last, partially moved mbuf is copied. A datagram
+    // chain moves whole packets, and returns ZX_ERR_OUT_OF_RANGE if the
+    // first one is larger than |len|. Returns ZX_ERR_SHOULD_WAIT if
+    // nothing could be moved.
+    zx_status_t SpliceFrom(MBufChain* src, size_t len, bool datagram, size_t* moved);
     bool is_full() const;
     bool is_empty() const;
     size_t size() const { return size_; }
 
+    // The number of bytes the chain holds before it is full. Lowering it
+    // below size() keeps the data already queued.
+    size_t capacity() const { return capacity_; }
+    zx_status_t set_capacity(size_t capacity);
+
 private:
     // An MBuf is a small fixed-size chainable memory buffer.
     struct MBuf : public fbl::SinglyLinkedListable<MBuf*> {
@@ -49,13 +81,20 @@ private:
     };
     static_assert(sizeof(MBuf) == MBuf::kMallocSize, "");
 
-    static constexpr size_t kSizeMax = 128 * MBuf::kPayloadSize;
+    static constexpr size_t kDefaultCapacity = 128 * MBuf::kPayloadSize;
+    static constexpr size_t kMinCapacity = MBuf::kPayloadSize;
+    static constexpr size_t kMaxCapacity = 16 * 1024 * 1024;
 
     MBuf* AllocMBuf();
     void FreeMBuf(MBuf* buf);
+    // Links |buf| in after |head_| and makes it the new head.
+    void AppendMBuf(MBuf* buf);
+    // Unlinks and returns the oldest mbuf, whose bytes the caller takes.
+    MBuf* PopMBuf();
 
     fbl::SinglyLinkedList<MBuf*> freelist_;
     fbl::SinglyLinkedList<MBuf*> tail_;
     MBuf* head_ = nullptr;;
     size_t size_ = 0u;
+    size_t capacity_ = kDefaultCapacity;
 };
@@ -11,14 +11,21 @@
 #include <lib/user_copy/user_ptr.h>
 #include <zircon/types.h>
 #include <fbl/intrusive_double_list.h>
+#include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
+#include <vm/vm_object.h>
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 64u;
+constexpr uint32_t kMaxBatchMessages = 32u;
+// Page aligned payloads at least this large may be loaned to the channel
+// instead of copied, see ZX_CHANNEL_WRITE_LOAN.
+constexpr uint32_t kMinLoanedMessageSize = 16384u;
 
 // ensure public constants are aligned
 static_assert(ZX_CHANNEL_MAX_MSG_BYTES == kMaxMessageSize, "");
 static_assert(ZX_CHANNEL_MAX_MSG_HANDLES == kMaxMessageHandles, "");
+static_assert(ZX_CHANNEL_MAX_BATCH_MSGS == kMaxBatchMessages, "");
 
 class Handle;
 
@@ -33,14 +40,26 @@ public:
     static zx_status_t Create(const void* data, uint32_t data_size,
                               uint32_t num_handles,
                               fbl::unique_ptr<MessagePacket>* msg);
+    // Creates a message packet whose payload is the first |data_size| bytes
+    // of |pages|, which must not be shared with anyone else.
+    static zx_status_t Create(fbl::RefPtr<VmObject> pages, uint32_t data_size,
+                              uint32_t num_handles,
+                              fbl::unique_ptr<MessagePacket>* msg);
 
     uint32_t data_size() const { return data_size_; }
 
+    // The vmo holding the payload of a loaned packet, or nullptr if the
+    // payload was copied into the packet.
+    VmObject* loaned_pages() const { return loaned_pages_.get(); }
+
+    // The kernel memory backing this packet: the header, handle array
+    // and payload, rounded up to the size class it was allocated from,
+    // plus the pages of a loaned payload.
+    size_t buffer_size() const;
+
     // Copies the packet's |data_size()| bytes to |buf|.
     // Returns an error if |buf| points to a bad user address.
-    zx_status_t CopyDataTo(user_out_ptr<void> buf) const {
-        return buf.copy_array_to_user(data(), data_size_);
-    }
+    zx_status_t CopyDataTo(user_out_ptr<void> buf) const;
 
     uint32_t num_handles() const { return num_handles_; }
     Handle* const* handles() const { return handles_; }
@@ -50,27 +69,23 @@ public:
 
     // zx_channel_call treats the leading bytes of the payload as
     // a transaction id of type zx_txid_t.
-    zx_txid_t get_txid() const {
-        if (data_size_ < sizeof(zx_txid_t)) {
-            return 0;
-        } else {
-            return *(reinterpret_cast<const zx_txid_t*>(data()));
-        }
-    }
+    zx_txid_t get_txid() const;
 
 private:
-    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
+    MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles,
+                  fbl::RefPtr<VmObject> loaned_pages, uint8_t size_class);
     ~MessagePacket();
 
     // Allocates a new packet that can hold the specified amount of
-    // data/handles.
+    // data/handles. A packet with |loaned_pages| only makes room for the
+    // handles.
     static zx_status_t NewPacket(uint32_t data_size, uint32_t num_handles,
+                                 fbl::RefPtr<VmObject> loaned_pages,
                                  fbl::unique_ptr<MessagePacket>* msg);
 
-    // Create() uses malloc(), so we must delete using free().
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    // NewPacket() carves packets out of size class slabs or, for large
+    // messages, the heap. Returns the memory to wherever it came from.
+    static void operator delete(void* ptr);
     friend class fbl::unique_ptr<MessagePacket>;
 
     // Handles and data are stored in the same buffer: num_handles_ Handle*
@@ -78,7 +93,10 @@ private:
     void* data() const { return static_cast<void*>(handles_ + num_handles_); }
 
     Handle** const handles_;
+    const fbl::RefPtr<VmObject> loaned_pages_;
     const uint32_t data_size_;
     const uint16_t num_handles_;
     bool owns_handles_;
+    // Index of the slab size class backing this packet, or kHeapSizeClass.
+    const uint8_t size_class_;
 };
@@ -0,0 +1,95 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
+#include <zircon/syscalls/object.h>
+#include <zircon/types.h>
+#include <fbl/alloc_checker.h>
+
+// A cache of same-sized objects carved out of slabs of their own, for
+// kernel objects that are created and destroyed at a high rate. Each cpu
+// keeps a magazine of free objects and only goes to the shared depot, one
+// batch at a time, when its magazine runs empty or full. Slabs are never
+// returned to the heap.
+class ObjectCache {
+public:
+    constexpr ObjectCache(const char* name, size_t object_size, size_t object_align)
+        : name_(name), object_size_(object_size), object_align_(object_align) {}
+
+    void* Alloc();
+    void Free(void* ptr);
+
+    size_t object_size() const { return object_size_; }
+    void GetInfo(zx_info_kmem_cache_t* info);
+
+    // Visits every cache, for ZX_INFO_KMEM_CACHES.
+    static size_t Count();
+    static ObjectCache* Get(size_t index);
+
+private:
+    ObjectCache(const ObjectCache&) = delete;
+    ObjectCache& operator=(const ObjectCache&) = delete;
+
+    static constexpr size_t kMagazineSize = 16;
+    static constexpr size_t kBatch = kMagazineSize / 2;
+    static constexpr size_t kSlabSize = 16 * 1024;
+
+    struct FreeObject {
+        FreeObject* next;
+    };
+
+    struct Magazine {
+        spin_lock_t lock = {};
+        size_t count = 0;
+        void* objects[kMagazineSize] = {};
+        // counted per cpu so that there is no shared counter to bounce
+        uint64_t allocs = 0;
+        uint64_t frees = 0;
+    } __CPU_ALIGN;
+
+    size_t TakeFromDepot(void** objects, size_t count);
+    void ReturnToDepot(void* const* objects, size_t count);
+    bool Grow();
+
+    const char* const name_;
+    const size_t object_size_;
+    const size_t object_align_;
+
+    Magazine magazines_[SMP_MAX_CPUS];
+
+    spin_lock_t depot_lock_ = {};
+    FreeObject* depot_ = nullptr;
+    size_t depot_count_ = 0;
+    size_t slab_count_ = 0;
+};
+
+// Objects of a class deriving from ObjectCacheAllocated<cache> that are made
+// with new (&ac) come from |cache| instead of the heap.
+template <ObjectCache* Cache>
+class ObjectCacheAllocated {
+public:
+    static void* operator new(size_t size, fbl::AllocChecker* ac) noexcept {
+        DEBUG_ASSERT(size <= Cache->object_size());
+        void* ptr = Cache->Alloc();
+        ac->arm(size, ptr != nullptr);
+        return ptr;
+    }
+
+    static void operator delete(void* ptr) {
+        Cache->Free(ptr);
+    }
+};
+
+extern ObjectCache event_dispatcher_cache;
+extern ObjectCache event_pair_dispatcher_cache;
+extern ObjectCache timer_dispatcher_cache;
+extern ObjectCache port_observer_cache;
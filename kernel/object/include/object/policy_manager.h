@@ -71,6 +71,12 @@ public:
     // ZX_POL_ACTION_DENY all other failure modes.
     uint32_t QueryBasicPolicy(pol_cookie_t policy, uint32_t condition);
 
+    // Returns a mask with bit (1 << condition) set for every condition
+    // that |policy| plainly allows, that is, for which QueryBasicPolicy()
+    // returns exactly ZX_POL_ACTION_ALLOW. Callers can skip the full query
+    // for those.
+    uint32_t QueryAllowedMask(pol_cookie_t policy);
+
 private:
     explicit PolicyManager(uint32_t default_action);
     ~PolicyManager() = default;
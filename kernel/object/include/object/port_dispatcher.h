@@ -7,6 +7,7 @@
 #pragma once
 
 #include <object/dispatcher.h>
+#include <object/object_cache.h>
 #include <object/semaphore.h>
 #include <object/state_observer.h>
 
@@ -14,6 +15,7 @@
 #include <zircon/types.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
 #include <fbl/mutex.h>
 #include <fbl/unique_ptr.h>
 
@@ -91,6 +93,23 @@ struct PortPacket final : public fbl::DoublyLinkedListable<PortPacket*> {
     const void* const handle;
     PortObserver* observer;
     PortAllocator* const allocator;
+    // One of ZX_PORT_PRIORITY_*, picks the queue the packet goes on.
+    uint32_t priority;
+    // Signal packets from other waits with the same key merge into this
+    // one while it is queued.
+    bool coalesce;
+    fbl::WAVLTreeNodeState<PortPacket*> coalesce_node;
+
+    struct CoalesceKeyTraits {
+        static uint64_t GetKey(const PortPacket& p) { return p.key(); }
+        static bool LessThan(uint64_t key1, uint64_t key2) { return key1 < key2; }
+        static bool EqualTo(uint64_t key1, uint64_t key2) { return key1 == key2; }
+    };
+    struct CoalesceNodeTraits {
+        static fbl::WAVLTreeNodeState<PortPacket*>& node_state(PortPacket& p) {
+            return p.coalesce_node;
+        }
+    };
 
     PortPacket(const void* handle, PortAllocator* allocator);
     PortPacket(const PortPacket&) = delete;
@@ -108,10 +127,11 @@ struct PortPacket final : public fbl::DoublyLinkedListable<PortPacket*> {
 // Observers are weakly contained in state trackers until |remove_| member
 // is false at the end of one of OnInitialize(), OnStateChange() or OnCancel()
 // callbacks.
-class PortObserver final : public StateObserver {
+class PortObserver final : public StateObserver,
+                           public ObjectCacheAllocated<&port_observer_cache> {
 public:
     PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<PortDispatcher> port,
-                 uint64_t key, zx_signals_t signals);
+                 uint64_t key, zx_signals_t signals, uint32_t priority, bool coalesce);
     ~PortObserver() = default;
 
 private:
@@ -152,6 +172,12 @@ public:
     zx_status_t QueueUser(const zx_port_packet_t& packet);
     zx_status_t Dequeue(zx_time_t deadline, zx_port_packet_t* packet);
 
+    // Waits like Dequeue() for the first packet, then also takes up to
+    // |max_packets| - 1 more that are already queued. The number of packets
+    // written to |packets| is returned in |count|.
+    zx_status_t DequeueMany(zx_time_t deadline, zx_port_packet_t* packets, size_t max_packets,
+                            size_t* count);
+
     // Decides who is going to destroy the observer. If it returns |true| it
     // is the duty of the caller. If it is false it is the duty of the port.
     bool CanReap(PortObserver* observer, PortPacket* port_packet);
@@ -163,6 +189,12 @@ public:
     // removed from the queue.
     bool CancelQueued(const void* handle, uint64_t key);
 
+    // For packets owned by other objects, which must not queue a packet
+    // again before it has been dequeued, and must take it back out before
+    // they go away.
+    bool IsQueued(const PortPacket* port_packet);
+    void RemovePacket(PortPacket* port_packet);
+
 private:
     friend class ExceptionPort;
 
@@ -177,10 +209,25 @@ private:
     // Called by ExceptionPort.
     void UnlinkExceptionPort(ExceptionPort* eport);
 
+    // Takes the packet at the front of the highest priority queue that
+    // isn't empty, or returns null.
+    PortPacket* PopLocked() TA_REQ(lock_);
+    // Takes |port_packet| out of its queue.
+    void EraseLocked(PortPacket* port_packet) TA_REQ(lock_);
+
+    static constexpr uint32_t kNumPriorities = ZX_PORT_PRIORITY_URGENT + 1;
+
+    using CoalesceTree = fbl::WAVLTree<uint64_t, PortPacket*, PortPacket::CoalesceKeyTraits,
+                                       PortPacket::CoalesceNodeTraits>;
+
     fbl::Canary<fbl::magic("PORT")> canary_;
     fbl::Mutex lock_;
     Semaphore sema_;
     bool zero_handles_ TA_GUARDED(lock_);
-    fbl::DoublyLinkedList<PortPacket*> packets_ TA_GUARDED(lock_);
+    // One queue per priority.
+    fbl::DoublyLinkedList<PortPacket*> packets_[kNumPriorities] TA_GUARDED(lock_);
+    // The queued packets that others may merge into, by key. There is at
+    // most one per key.
+    CoalesceTree coalescing_ TA_GUARDED(lock_);
     fbl::DoublyLinkedList<fbl::RefPtr<ExceptionPort>> eports_ TA_GUARDED(lock_);
 };
@@ -18,6 +18,7 @@
 #include <zircon/syscalls/object.h>
 #include <zircon/types.h>
 #include <fbl/array.h>
+#include <fbl/atomic.h>
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
@@ -25,6 +26,7 @@
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/string_piece.h>
+#include <fbl/unique_ptr.h>
 
 class JobDispatcher;
 
@@ -199,6 +201,9 @@ public:
 
     zx_status_t GetThreads(fbl::Array<zx_koid_t>* threads);
 
+    // Fills in a zx_info_job_thread_t for each of the process's threads.
+    zx_status_t GetThreadStats(fbl::Array<zx_info_job_thread_t>* stats);
+
     // exception handling support
     zx_status_t SetExceptionPort(fbl::RefPtr<ExceptionPort> eport);
     // Returns true if a port had been set.
@@ -251,6 +256,27 @@ public:
         return vdso_code_address_;
     }
 
+    // Per-syscall call counts and time, kept only when the
+    // kernel.syscall-stats command line option is set.
+    struct SyscallStats {
+        fbl::atomic<uint64_t> count;
+        fbl::atomic<uint64_t> ticks;
+    };
+
+    bool has_syscall_stats() const { return syscall_stats_ != nullptr; }
+
+    // Called by the syscall path after syscall |num| returns, with the ticks
+    // it took.  Requires has_syscall_stats().
+    void AccountSyscall(uint32_t num, uint64_t ticks) {
+        syscall_stats_[num].count.fetch_add(1u, fbl::memory_order_relaxed);
+        syscall_stats_[num].ticks.fetch_add(ticks, fbl::memory_order_relaxed);
+    }
+
+    // Returns the stats for syscall |num|, or null if they are not kept.
+    const SyscallStats* syscall_stats(uint32_t num) const {
+        return syscall_stats_ ? &syscall_stats_[num] : nullptr;
+    }
+
 private:
     // compute the vdso code address and store in vdso_code_address_
     uintptr_t cache_vdso_code_address();
@@ -266,6 +292,12 @@ private:
     ProcessDispatcher& operator=(const ProcessDispatcher&) = delete;
 
 
+    // Looks up |handle_value| without taking |handle_table_lock_|, returning
+    // a reference to its dispatcher and its rights. Returns false after
+    // applying the bad handle policy if the value isn't one of our handles.
+    bool GetHandleNoLock(zx_handle_t handle_value, fbl::RefPtr<Dispatcher>* dispatcher,
+                         zx_rights_t* rights);
+
     zx_status_t GetDispatcherInternal(zx_handle_t handle_value, fbl::RefPtr<Dispatcher>* dispatcher,
                                       zx_rights_t* rights);
 
@@ -280,6 +312,7 @@ private:
 
     void SetStateLocked(State) TA_REQ(state_lock_);
     void FinishDeadTransition();
+    void TraceSyscallStats(uint32_t koid);
 
     // Kill all threads
     void KillAllThreadsLocked() TA_REQ(state_lock_);
@@ -293,6 +326,11 @@ private:
     // Policy set by the Job during Create().
     const pol_cookie_t policy_;
 
+    // The conditions |policy_| allows outright, see PolicyManager::QueryAllowedMask().
+    // A job can't change its policy once it has processes, so this never
+    // goes stale.
+    const uint32_t allowed_policy_mask_;
+
     // The process can belong to either of these lists independently.
     fbl::DoublyLinkedListNodeState<ProcessDispatcher*> dll_job_raw_;
     fbl::SinglyLinkedListNodeState<fbl::RefPtr<ProcessDispatcher>> dll_job_;
@@ -306,7 +344,8 @@ private:
     // our address space
     fbl::RefPtr<VmAspace> aspace_;
 
-    // our list of handles
+    // our list of handles. lookups by value don't need the lock, see
+    // Handle::ReadSection.
     mutable fbl::Mutex handle_table_lock_; // protects |handles_|.
     fbl::DoublyLinkedList<Handle*> handles_ TA_GUARDED(handle_table_lock_);
 
@@ -334,6 +373,9 @@ private:
     // This is a cache of aspace()->vdso_code_address().
     uintptr_t vdso_code_address_ = 0;
 
+    // ZX_SYS_COUNT entries, or null if syscall stats are off.
+    fbl::unique_ptr<SyscallStats[]> syscall_stats_;
+
     // The user-friendly process name. For debug purposes only. That
     // is, there is no mechanism to mint a handle to a process via this name.
     fbl::Name<ZX_MAX_NAME_LEN> name_;
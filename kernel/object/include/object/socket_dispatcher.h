@@ -38,6 +38,10 @@ public:
     // Socket methods.
     zx_status_t Write(user_in_ptr<const void> src, size_t len, size_t* written);
 
+    // Write the user buffers described by |vec| as if they were one buffer.
+    // A datagram socket queues them as a single packet.
+    zx_status_t Writev(const zx_iovec_t* vec, size_t count, size_t* written);
+
     zx_status_t WriteControl(user_in_ptr<const void> src, size_t len);
 
     // Shut this endpoint of the socket down for reading, writing, or both.
@@ -47,8 +51,17 @@ public:
 
     zx_status_t Read(user_out_ptr<void> dst, size_t len, size_t* nread);
 
+    // Read into the user buffers described by |vec| in order.
+    zx_status_t Readv(const zx_iovec_t* vec, size_t count, size_t* nread);
+
     zx_status_t ReadControl(user_out_ptr<void> dst, size_t len, size_t* nread);
 
+    // Move up to |len| bytes that this endpoint would read into the peer of
+    // |dst|, as if they were read here and written to |dst|, without
+    // copying them through user memory. Both sockets must have the same
+    // mode; a datagram socket moves whole packets.
+    zx_status_t Splice(SocketDispatcher* dst, size_t len, size_t* nmoved);
+
     // On success, share takes ownership of h
     zx_status_t Share(Handle* h);
 
@@ -59,17 +72,23 @@ public:
 
     zx_status_t CheckShareable(SocketDispatcher* to_send);
 
+    // How many bytes this endpoint buffers for reading before the peer
+    // stops being writable.
+    size_t GetReadCapacity();
+    zx_status_t SetReadCapacity(size_t capacity);
+
 private:
     // The control_msg must be either nullptr or an allocation of
     // size kControlMsgSize.
     SocketDispatcher(zx_signals_t starting_signals, uint32_t flags,
                      fbl::unique_ptr<char[]> control_msg);
     void Init(fbl::RefPtr<SocketDispatcher> other);
-    zx_status_t WriteSelf(user_in_ptr<const void> src, size_t len, size_t* nwritten);
+    zx_status_t WriteSelf(UserIovecCursor* src, size_t len, size_t* nwritten);
     zx_status_t WriteControlSelf(user_in_ptr<const void> src, size_t len);
     zx_status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     zx_status_t ShutdownOther(uint32_t how);
     zx_status_t ShareSelf(Handle* h);
+    zx_status_t SpliceLocked(SocketDispatcher* dst, size_t len, size_t* nmoved);
 
     bool is_full() const TA_REQ(lock_) { return data_.is_full(); }
     bool is_empty() const TA_REQ(lock_) { return data_.is_empty(); }
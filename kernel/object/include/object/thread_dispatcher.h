@@ -108,10 +108,21 @@ public:
     ProcessDispatcher* process() const { return process_.get(); }
 
     FutexNode* futex_node() { return &futex_node_; }
+    // The kernel thread, e.g. for lending it priority while blocked on it.
+    thread_t* thread() { return &thread_; }
     zx_status_t set_name(const char* name, size_t len) final;
     void get_name(char out_name[ZX_MAX_NAME_LEN]) const final;
     uint64_t runtime_ns() const { return thread_runtime(&thread_); }
 
+    // Fair-share scheduling weight, ZX_THREAD_SCHED_WEIGHT_NONE if the
+    // thread is round robin scheduled.
+    zx_status_t SetSchedWeight(uint32_t weight);
+    uint32_t sched_weight() const;
+
+    // Deadline cpu reservation, all zero if the thread has none.
+    zx_status_t SetSchedDeadline(const zx_sched_deadline_params_t& params);
+    void GetSchedDeadline(zx_sched_deadline_params_t* params);
+
     zx_status_t SetExceptionPort(fbl::RefPtr<ExceptionPort> eport);
     // Returns true if a port had been set.
     bool ResetExceptionPort(bool quietly);
@@ -12,10 +12,12 @@
 #include <fbl/canary.h>
 #include <fbl/mutex.h>
 #include <object/dispatcher.h>
+#include <object/object_cache.h>
 
 #include <sys/types.h>
 
-class TimerDispatcher final : public Dispatcher {
+class TimerDispatcher final : public Dispatcher,
+                              public ObjectCacheAllocated<&timer_dispatcher_cache> {
 public:
     static zx_status_t Create(uint32_t options,
                               fbl::RefPtr<Dispatcher>* dispatcher,
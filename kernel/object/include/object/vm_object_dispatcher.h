@@ -48,6 +48,10 @@ public:
 private:
     explicit VmObjectDispatcher(fbl::RefPtr<VmObject> vmo);
 
+    zx_status_t CacheOp(uint32_t op, uint64_t offset, uint64_t size);
+    zx_status_t CacheOpRanges(uint32_t op, uint64_t offset, uint64_t size,
+                              user_inout_ptr<zx_vmo_range_t> ranges, size_t buffer_size);
+
     fbl::Canary<fbl::magic("VMOD")> canary_;
     fbl::RefPtr<VmObject> vmo_;
 
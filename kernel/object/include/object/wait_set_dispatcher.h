@@ -0,0 +1,120 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <stdint.h>
+
+#include <kernel/event.h>
+#include <object/dispatcher.h>
+#include <object/state_observer.h>
+
+#include <zircon/types.h>
+#include <fbl/canary.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/mutex.h>
+#include <fbl/ref_ptr.h>
+
+class WaitSetDispatcher;
+
+// One handle watched by a wait set. Entries stay on their object's observer
+// list for as long as they are in the wait set, or until the handle is
+// closed, so a wait does not have to register anything.
+class WaitSetEntry final : public StateObserver,
+                           public fbl::WAVLTreeContainable<WaitSetEntry*> {
+public:
+    WaitSetEntry(fbl::RefPtr<WaitSetDispatcher> wait_set, uint64_t cookie,
+                 const Handle* handle, Dispatcher* dispatcher, zx_signals_t signals);
+    ~WaitSetEntry();
+
+    uint64_t GetKey() const { return cookie_; }
+
+private:
+    friend class WaitSetDispatcher;
+
+    WaitSetEntry(const WaitSetEntry&) = delete;
+    WaitSetEntry& operator=(const WaitSetEntry&) = delete;
+
+    // StateObserver implementation:
+    Flags OnInitialize(zx_signals_t initial_state, const StateObserver::CountInfo* cinfo) final;
+    Flags OnStateChange(zx_signals_t new_state) final;
+    Flags OnCancel(const Handle* handle) final;
+    Flags OnCancelByKey(const Handle* handle, const void* port, uint64_t key) final;
+    void OnRemoved() final;
+
+    struct TriggeredListTraits {
+        static fbl::DoublyLinkedListNodeState<WaitSetEntry*>& node_state(WaitSetEntry& entry) {
+            return entry.triggered_list_node_state_;
+        }
+    };
+
+    fbl::Canary<fbl::magic("WSEN")> canary_;
+
+    // Keeps the wait set alive until the entry is freed, which can happen
+    // after the wait set lost its last handle.
+    const fbl::RefPtr<WaitSetDispatcher> wait_set_;
+    const uint64_t cookie_;
+    const Handle* const handle_;
+    const zx_signals_t signals_;
+
+    // The members below are guarded by the wait set's lock.
+
+    // Valid while |attached_|; the object can't go away before the entry is
+    // removed from its observer list.
+    Dispatcher* dispatcher_;
+    bool attached_ = true;
+    // Set once the entry has left the wait set, after which whoever sees it
+    // detached last frees it.
+    bool orphaned_ = false;
+    zx_signals_t observed_ = 0u;
+    fbl::DoublyLinkedListNodeState<WaitSetEntry*> triggered_list_node_state_;
+};
+
+class WaitSetDispatcher final : public Dispatcher {
+public:
+    static zx_status_t Create(uint32_t options, fbl::RefPtr<Dispatcher>* dispatcher,
+                              zx_rights_t* rights);
+
+    ~WaitSetDispatcher() final;
+
+    zx_obj_type_t get_type() const final { return ZX_OBJ_TYPE_WAIT_SET; }
+    void on_zero_handles() final;
+
+    // Called under the handle table lock.
+    zx_status_t AddEntry(uint64_t cookie, Handle* handle, zx_signals_t signals);
+    zx_status_t RemoveEntry(uint64_t cookie);
+
+    // Blocks until at least one entry is ready, then copies up to |max|
+    // ready entries into |results|. Reported entries move behind the rest
+    // so that a small |max| doesn't starve anyone.
+    zx_status_t Wait(zx_time_t deadline, zx_waitset_result_t* results, size_t max,
+                     size_t* count);
+
+private:
+    friend class WaitSetEntry;
+
+    WaitSetDispatcher();
+
+    // Takes an entry that was just removed from |entries_| off its object.
+    void DetachEntry(WaitSetEntry* entry) TA_REQ(registration_lock_);
+    // Called by entries with |lock_| held.
+    StateObserver::Flags UpdateEntryLocked(WaitSetEntry* entry, zx_signals_t state)
+        TA_REQ(lock_);
+
+    fbl::Canary<fbl::magic("WSET")> canary_;
+
+    // Serializes adding and removing entries, so an entry is never removed
+    // halfway through being attached. Taken before any object's state lock.
+    fbl::Mutex registration_lock_;
+
+    // Taken by entries under their object's state lock.
+    fbl::Mutex lock_;
+    Event event_;
+    fbl::WAVLTree<uint64_t, WaitSetEntry*> entries_ TA_GUARDED(registration_lock_);
+    fbl::DoublyLinkedList<WaitSetEntry*, WaitSetEntry::TriggeredListTraits>
+        triggered_ TA_GUARDED(lock_);
+};
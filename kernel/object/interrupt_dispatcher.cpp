@@ -6,9 +6,15 @@
 
 #include <object/interrupt_dispatcher.h>
 
+#include <arch/ops.h>
 #include <fbl/auto_lock.h>
+#include <platform.h>
+#include <zircon/syscalls/port.h>
 
-InterruptDispatcher::InterruptDispatcher() : signals_(0) {
+InterruptDispatcher::InterruptDispatcher()
+    : signals_(0), poll_window_(0), port_bound_(false), port_armed_(false),
+      packet_sent_(false), port_packet_(nullptr, nullptr),
+      port_dpc_({LIST_INITIAL_CLEARED_VALUE, &PortDpc, this, DPC_PRIORITY_HIGH}) {
     event_init(&event_, false, EVENT_FLAG_AUTOUNSIGNAL);
     reported_signals_.store(0);
     memset(slot_map_, 0xff, sizeof(slot_map_));
@@ -30,6 +36,7 @@ zx_status_t InterruptDispatcher::AddSlot(uint32_t slot, uint32_t vector, uint32_
     Interrupt interrupt;
     interrupt.dispatcher = this;
     atomic_store_u64(&interrupt.timestamp, 0);
+    atomic_store_u64(&interrupt.count, 0);
     interrupt.flags = flags;
     interrupt.vector = static_cast<uint16_t>(vector);
     interrupt.slot = static_cast<uint16_t>(slot);
@@ -52,29 +59,53 @@ zx_status_t InterruptDispatcher::AddSlot(uint32_t slot, uint32_t vector, uint32_
     return ZX_OK;
 }
 
+void InterruptDispatcher::ReportSignals(uint64_t signals) {
+    for (const auto& interrupt : interrupts_) {
+        if ((interrupt.flags & INTERRUPT_MASK_POSTWAIT) &&
+                (signals & (SIGNAL_MASK(interrupt.slot))))
+            MaskInterrupt(interrupt.vector);
+    }
+
+    reported_signals_.fetch_or(signals);
+}
+
+void InterruptDispatcher::RearmReportedSlots() {
+    uint64_t last_signals = reported_signals_.exchange(0);
+    for (auto& interrupt : interrupts_) {
+        if ((interrupt.flags & INTERRUPT_UNMASK_PREWAIT) &&
+                (last_signals & (SIGNAL_MASK(interrupt.slot)))) {
+            UnmaskInterrupt(interrupt.vector);
+        }
+    }
+}
+
 zx_status_t InterruptDispatcher::WaitForInterrupt(uint64_t* out_slots) {
     while (true) {
+        if (port_bound_.load())
+            return ZX_ERR_BAD_STATE;
+
         uint64_t signals = signals_.exchange(0);
         if (signals) {
             if (signals & INTERRUPT_CANCEL_MASK)
                 return ZX_ERR_CANCELED;
 
-            for (const auto& interrupt : interrupts_) {
-                if ((interrupt.flags & INTERRUPT_MASK_POSTWAIT) &&
-                        (signals & (SIGNAL_MASK(interrupt.slot))))
-                    MaskInterrupt(interrupt.vector);
-            }
-
-            reported_signals_.fetch_or(signals);
+            ReportSignals(signals);
             *out_slots = signals;
             return ZX_OK;
         }
 
-        uint64_t last_signals = reported_signals_.exchange(0);
-        for (auto& interrupt : interrupts_) {
-            if ((interrupt.flags & INTERRUPT_UNMASK_PREWAIT) &&
-                    (last_signals & (SIGNAL_MASK(interrupt.slot)))) {
-                UnmaskInterrupt(interrupt.vector);
+        RearmReportedSlots();
+
+        zx_duration_t window = poll_window_.load();
+        if (window) {
+            zx_time_t deadline = current_time() + window;
+            while (!signals_.load() && current_time() < deadline)
+                arch_spinloop_pause();
+            if (signals_.load()) {
+                // the handler signaled the event as well, which would only
+                // wake the next wait for nothing
+                event_unsignal(&event_);
+                continue;
             }
         }
 
@@ -85,6 +116,85 @@ zx_status_t InterruptDispatcher::WaitForInterrupt(uint64_t* out_slots) {
     }
 }
 
+zx_status_t InterruptDispatcher::set_poll_window(zx_duration_t window) {
+    if (window > kMaxPollWindow)
+        return ZX_ERR_OUT_OF_RANGE;
+    poll_window_.store(window);
+    return ZX_OK;
+}
+
+zx_status_t InterruptDispatcher::BindPort(fbl::RefPtr<PortDispatcher> port, uint64_t key) {
+    fbl::AutoLock lock(&lock_);
+
+    if (port_)
+        return ZX_ERR_ALREADY_BOUND;
+
+    port_ = fbl::move(port);
+    port_packet_.packet = {};
+    port_packet_.packet.key = key;
+    port_packet_.packet.type = ZX_PKT_TYPE_INTERRUPT;
+    port_packet_.packet.status = ZX_OK;
+    port_bound_.store(true);
+
+    // Send out anything that came in before the port was bound, and kick
+    // threads out of WaitForInterrupt().
+    SendPortPacketLocked();
+    event_signal(&event_, false);
+    return ZX_OK;
+}
+
+zx_status_t InterruptDispatcher::Ack() {
+    fbl::AutoLock lock(&lock_);
+
+    if (!port_)
+        return ZX_ERR_BAD_STATE;
+    // the packet has to have been read before it can be sent again
+    if (!packet_sent_ || port_->IsQueued(&port_packet_))
+        return ZX_ERR_BAD_STATE;
+
+    packet_sent_ = false;
+    RearmReportedSlots();
+    SendPortPacketLocked();
+    return ZX_OK;
+}
+
+// Called with the packet taken: either to send it, or to re-arm if there is
+// nothing to report.
+void InterruptDispatcher::SendPortPacketLocked() {
+    // the port was dropped in on_zero_handles()
+    if (!port_)
+        return;
+
+    while (true) {
+        uint64_t signals = signals_.exchange(0) & ~INTERRUPT_CANCEL_MASK;
+        if (signals) {
+            ReportSignals(signals);
+            port_packet_.packet.interrupt.slots = signals;
+            packet_sent_ = port_->Queue(&port_packet_, 0u, 0u) == ZX_OK;
+            return;
+        }
+
+        // An interrupt that comes in after the exchange but before the
+        // re-arm sees the packet still taken, so look again.
+        port_armed_.store(true);
+        if (!signals_.load() || !port_armed_.exchange(false))
+            return;
+    }
+}
+
+void InterruptDispatcher::PortDpc(dpc_t* dpc) {
+    InterruptDispatcher* thiz = reinterpret_cast<InterruptDispatcher*>(dpc->arg);
+    {
+        fbl::AutoLock lock(&thiz->lock_);
+        thiz->SendPortPacketLocked();
+    }
+
+    // Drop the reference taken in Signal(). If this was the last one, the
+    // RefCounted contract requires that we delete ourselves.
+    if (thiz->Release())
+        delete thiz;
+}
+
 zx_status_t InterruptDispatcher::GetTimeStamp(uint32_t slot, zx_time_t* out_timestamp) {
     if (slot > ZX_INTERRUPT_MAX_SLOTS)
         return ZX_ERR_INVALID_ARGS;
@@ -118,11 +228,45 @@ zx_status_t InterruptDispatcher::UserSignal(uint32_t slot, zx_time_t timestamp)
     // only record timestamp if this is the first signal since we started waiting
     zx_time_t zero_timestamp = 0;
     atomic_cmpxchg_u64(&interrupt.timestamp, &zero_timestamp, timestamp);
+    atomic_add_u64(&interrupt.count, 1);
 
     Signal(SIGNAL_MASK(slot), true);
     return ZX_OK;
 }
 
+zx_status_t InterruptDispatcher::SetAffinity(uint32_t slot, cpu_num_t cpu) {
+    if (slot > ZX_INTERRUPT_MAX_SLOTS)
+        return ZX_ERR_INVALID_ARGS;
+
+    fbl::AutoLock lock(&lock_);
+
+    uint8_t index = slot_map_[slot];
+    if (index == 0xff)
+        return ZX_ERR_NOT_FOUND;
+
+    const Interrupt& interrupt = interrupts_[index];
+    // virtual interrupts are delivered to whoever is waiting
+    if (interrupt.flags & INTERRUPT_VIRTUAL)
+        return ZX_ERR_BAD_STATE;
+
+    return SetInterruptAffinity(interrupt.vector, cpu);
+}
+
+size_t InterruptDispatcher::GetSlotInfo(zx_info_interrupt_slot_t* info, size_t max) {
+    fbl::AutoLock lock(&lock_);
+
+    size_t count = interrupts_.size();
+    for (size_t i = 0; i < count && i < max; i++) {
+        Interrupt& interrupt = interrupts_[i];
+        info[i].slot = interrupt.slot;
+        info[i].vector = interrupt.vector;
+        info[i].flags = (interrupt.flags & INTERRUPT_VIRTUAL) ? ZX_INFO_INTERRUPT_SLOT_VIRTUAL : 0;
+        info[i].reserved = 0;
+        info[i].count = atomic_load_u64(&interrupt.count);
+    }
+    return count;
+}
+
 void InterruptDispatcher::on_zero_handles() {
     for (const auto& interrupt : interrupts_) {
         if (!(interrupt.flags & INTERRUPT_VIRTUAL)) {
@@ -131,5 +275,14 @@ void InterruptDispatcher::on_zero_handles() {
         }
     }
 
+    {
+        fbl::AutoLock lock(&lock_);
+        if (port_) {
+            port_->RemovePacket(&port_packet_);
+            port_.reset();
+            port_bound_.store(false);
+        }
+    }
+
     Signal(INTERRUPT_CANCEL_MASK, true);
 }
@@ -121,6 +121,7 @@ enum handler_return InterruptEventDispatcher::IrqHandler(void* ctx) {
     // only record timestamp if this is the first IRQ since we started waiting
     zx_time_t zero_timestamp = 0;
     atomic_cmpxchg_u64(&interrupt->timestamp, &zero_timestamp, current_time());
+    atomic_add_u64(&interrupt->count, 1);
 
     InterruptEventDispatcher* thiz
             = reinterpret_cast<InterruptEventDispatcher *>(interrupt->dispatcher);
@@ -146,3 +147,7 @@ zx_status_t InterruptEventDispatcher::RegisterInterruptHandler(uint32_t vector,
 void InterruptEventDispatcher::UnregisterInterruptHandler(uint32_t vector) {
     register_int_handler(vector, nullptr, nullptr);
 }
+
+zx_status_t InterruptEventDispatcher::SetInterruptAffinity(uint32_t vector, cpu_num_t cpu) {
+    return set_interrupt_affinity(vector, cpu);
+}
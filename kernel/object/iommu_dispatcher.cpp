@@ -19,6 +19,9 @@
 #if WITH_DEV_IOMMU_DUMMY
 #include <dev/iommu/dummy.h>
 #endif
+#if WITH_DEV_IOMMU_INTEL
+#include <dev/iommu/intel.h>
+#endif
 
 #define LOCAL_TRACE 0
 
@@ -33,6 +36,11 @@ zx_status_t IommuDispatcher::Create(uint32_t type, fbl::unique_ptr<const uint8_t
         case ZX_IOMMU_TYPE_DUMMY:
             status = DummyIommu::Create(fbl::move(desc), desc_len, &iommu);
             break;
+#endif
+#if WITH_DEV_IOMMU_INTEL
+        case ZX_IOMMU_TYPE_INTEL:
+            status = IntelIommu::Create(fbl::move(desc), desc_len, &iommu);
+            break;
 #endif
         default:
             return ZX_ERR_NOT_SUPPORTED;
@@ -6,6 +6,8 @@
 
 #include <object/mbuf.h>
 
+#include <string.h>
+
 #include <lib/user_copy/user_ptr.h>
 
 #include <fbl/algorithm.h>
@@ -16,7 +18,51 @@
 constexpr size_t MBufChain::MBuf::kHeaderSize;
 constexpr size_t MBufChain::MBuf::kMallocSize;
 constexpr size_t MBufChain::MBuf::kPayloadSize;
-constexpr size_t MBufChain::kSizeMax;
+constexpr size_t MBufChain::kDefaultCapacity;
+constexpr size_t MBufChain::kMinCapacity;
+constexpr size_t MBufChain::kMaxCapacity;
+
+zx_status_t UserIovecCursor::CopyFrom(void* dst, size_t len) {
+    char* out = static_cast<char*>(dst);
+    while (len > 0) {
+        if (index_ == count_)
+            return ZX_ERR_INVALID_ARGS;
+        const zx_iovec_t& vec = vec_[index_];
+        size_t copy_len = fbl::min(vec.size - offset_, len);
+        user_in_ptr<const char> src(static_cast<const char*>(vec.buffer) + offset_);
+        if (copy_len > 0 && src.copy_array_from_user(out, copy_len) != ZX_OK)
+            return ZX_ERR_INVALID_ARGS;
+        out += copy_len;
+        len -= copy_len;
+        offset_ += copy_len;
+        if (offset_ == vec.size) {
+            index_++;
+            offset_ = 0u;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t UserIovecCursor::CopyTo(const void* src, size_t len) {
+    const char* in = static_cast<const char*>(src);
+    while (len > 0) {
+        if (index_ == count_)
+            return ZX_ERR_INVALID_ARGS;
+        const zx_iovec_t& vec = vec_[index_];
+        size_t copy_len = fbl::min(vec.size - offset_, len);
+        user_out_ptr<char> dst(static_cast<char*>(vec.buffer) + offset_);
+        if (copy_len > 0 && dst.copy_array_to_user(in, copy_len) != ZX_OK)
+            return ZX_ERR_INVALID_ARGS;
+        in += copy_len;
+        len -= copy_len;
+        offset_ += copy_len;
+        if (offset_ == vec.size) {
+            index_++;
+            offset_ = 0u;
+        }
+    }
+    return ZX_OK;
+}
 
 size_t MBufChain::MBuf::rem() const {
     return kPayloadSize - (off_ + len_);
@@ -30,14 +76,21 @@ MBufChain::~MBufChain() {
 }
 
 bool MBufChain::is_full() const {
-    return size_ >= kSizeMax;
+    return size_ >= capacity_;
 }
 
 bool MBufChain::is_empty() const {
     return size_ == 0;
 }
 
-size_t MBufChain::Read(user_out_ptr<void> dst, size_t len, bool datagram) {
+zx_status_t MBufChain::set_capacity(size_t capacity) {
+    if (capacity < kMinCapacity || capacity > kMaxCapacity)
+        return ZX_ERR_OUT_OF_RANGE;
+    capacity_ = capacity;
+    return ZX_OK;
+}
+
+size_t MBufChain::Read(UserIovecCursor* dst, size_t len, bool datagram) {
     if (datagram && len > tail_.front().pkt_len_)
         len = tail_.front().pkt_len_;
 
@@ -46,7 +99,7 @@ size_t MBufChain::Read(user_out_ptr<void> dst, size_t len, bool datagram) {
         MBuf& cur = tail_.front();
         char* src = cur.data_ + cur.off_;
         size_t copy_len = MIN(cur.len_, len - pos);
-        if (dst.byte_offset(pos).copy_array_to_user(src, copy_len) != ZX_OK)
+        if (dst->CopyTo(src, copy_len) != ZX_OK)
             return pos;
         pos += copy_len;
         cur.off_ += static_cast<uint32_t>(copy_len);
@@ -72,9 +125,69 @@ size_t MBufChain::Read(user_out_ptr<void> dst, size_t len, bool datagram) {
     return pos;
 }
 
-zx_status_t MBufChain::WriteDatagram(user_in_ptr<const void> src,
+zx_status_t MBufChain::SpliceFrom(MBufChain* src, size_t len, bool datagram,
+                                  size_t* moved) {
+    if (datagram && !src->tail_.is_empty() && src->tail_.front().pkt_len_ > len)
+        return ZX_ERR_OUT_OF_RANGE;
+    if (size_ >= capacity_)
+        return ZX_ERR_SHOULD_WAIT;
+    len = fbl::min(len, capacity_ - size_);
+
+    size_t pos = 0;
+    while (pos < len && !src->tail_.is_empty()) {
+        MBuf& cur = src->tail_.front();
+        if (datagram) {
+            if (cur.pkt_len_ > len - pos)
+                break;
+            // The packet's mbufs go over in order; only the first one has
+            // a pkt_len_.
+            size_t pkt_len = cur.pkt_len_;
+            AppendMBuf(src->PopMBuf());
+            while (!src->tail_.is_empty() && src->tail_.front().pkt_len_ == 0)
+                AppendMBuf(src->PopMBuf());
+            src->size_ -= pkt_len;
+            size_ += pkt_len;
+            pos += pkt_len;
+            continue;
+        }
+
+        if (cur.len_ <= len - pos) {
+            size_t buf_len = cur.len_;
+            AppendMBuf(src->PopMBuf());
+            src->size_ -= buf_len;
+            size_ += buf_len;
+            pos += buf_len;
+            continue;
+        }
+
+        // Only part of |cur| fits, which is less than one payload, so it
+        // is copied and the rest stays queued in |src|.
+        size_t copy_len = len - pos;
+        if (head_ == nullptr || head_->rem() < copy_len) {
+            MBuf* next = AllocMBuf();
+            if (next == nullptr)
+                break;
+            AppendMBuf(next);
+        }
+        memcpy(head_->data_ + head_->off_ + head_->len_, cur.data_ + cur.off_, copy_len);
+        head_->len_ += static_cast<uint32_t>(copy_len);
+        size_ += copy_len;
+        cur.off_ += static_cast<uint32_t>(copy_len);
+        cur.len_ -= static_cast<uint32_t>(copy_len);
+        src->size_ -= copy_len;
+        pos += copy_len;
+    }
+
+    if (pos == 0)
+        return ZX_ERR_SHOULD_WAIT;
+
+    *moved = pos;
+    return ZX_OK;
+}
+
+zx_status_t MBufChain::WriteDatagram(UserIovecCursor* src,
                                      size_t len, size_t* written) {
-    if (len + size_ > kSizeMax)
+    if (len + size_ > capacity_)
         return ZX_ERR_SHOULD_WAIT;
 
     fbl::SinglyLinkedList<MBuf*> bufs;
@@ -91,7 +204,7 @@ zx_status_t MBufChain::WriteDatagram(user_in_ptr<const void> src,
     size_t pos = 0;
     for (auto& buf : bufs) {
         size_t copy_len = fbl::min(MBuf::kPayloadSize, len - pos);
-        if (src.byte_offset(pos).copy_array_from_user(buf.data_, copy_len) != ZX_OK) {
+        if (src->CopyFrom(buf.data_, copy_len) != ZX_OK) {
             while (!bufs.is_empty())
                 FreeMBuf(bufs.pop_front());
             return ZX_ERR_INVALID_ARGS; // Bad user buffer.
@@ -118,7 +231,7 @@ zx_status_t MBufChain::WriteDatagram(user_in_ptr<const void> src,
     return ZX_OK;
 }
 
-zx_status_t MBufChain::WriteStream(user_in_ptr<const void> src,
+zx_status_t MBufChain::WriteStream(UserIovecCursor* src,
                                    size_t len, size_t* written) {
     if (head_ == nullptr) {
         head_ = AllocMBuf();
@@ -138,12 +251,12 @@ zx_status_t MBufChain::WriteStream(user_in_ptr<const void> src,
         }
         void* dst = head_->data_ + head_->off_ + head_->len_;
         size_t copy_len = fbl::min(head_->rem(), len - pos);
-        if (size_ + copy_len > kSizeMax) {
-            copy_len = kSizeMax - size_;
+        if (size_ + copy_len > capacity_) {
+            copy_len = capacity_ - size_;
             if (copy_len == 0)
                 break;
         }
-        if (src.byte_offset(pos).copy_array_from_user(dst, copy_len) != ZX_OK)
+        if (src->CopyFrom(dst, copy_len) != ZX_OK)
             break;
         pos += copy_len;
         head_->len_ += static_cast<uint32_t>(copy_len);
@@ -166,6 +279,22 @@ MBufChain::MBuf* MBufChain::AllocMBuf() {
     return freelist_.pop_front();
 }
 
+void MBufChain::AppendMBuf(MBuf* buf) {
+    if (head_ == nullptr) {
+        tail_.push_front(buf);
+    } else {
+        tail_.insert_after(tail_.make_iterator(*head_), buf);
+    }
+    head_ = buf;
+}
+
+MBufChain::MBuf* MBufChain::PopMBuf() {
+    MBuf* buf = tail_.pop_front();
+    if (head_ == buf)
+        head_ = nullptr;
+    return buf;
+}
+
 void MBufChain::FreeMBuf(MBuf* buf) {
     buf->off_ = 0u;
     buf->len_ = 0u;
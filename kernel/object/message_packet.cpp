@@ -7,14 +7,89 @@
 #include <object/message_packet.h>
 
 #include <err.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
+#include <fbl/algorithm.h>
+#include <fbl/slab_allocator.h>
+#include <lib/counters.h>
 #include <zxcpp/new.h>
 #include <object/handle.h>
 
+KCOUNTER(packet_slab_count, "kernel.channel.packet.slab");
+KCOUNTER(packet_heap_count, "kernel.channel.packet.heap");
+KCOUNTER(packet_loaned_count, "kernel.channel.packet.loaned");
+
+namespace {
+
+// Packets are carved out of slab caches in a few size classes, which keeps
+// small messages off the heap and its lock. Each buffer holds the whole
+// packet: the MessagePacket, its Handle* array and the payload. Packets too
+// large for the biggest class, or made while their class is at its slab
+// limit, come from the heap.
+template <size_t Size, size_t SlabSize>
+struct PacketBuffer;
+
+template <size_t Size, size_t SlabSize>
+using PacketBufferTraits =
+    fbl::StaticSlabAllocatorTraits<PacketBuffer<Size, SlabSize>*, SlabSize>;
+
+template <size_t Size, size_t SlabSize>
+struct PacketBuffer : public fbl::SlabAllocated<PacketBufferTraits<Size, SlabSize>> {
+    using Traits = PacketBufferTraits<Size, SlabSize>;
+    static constexpr size_t kSize = Size;
+
+    alignas(MessagePacket) char storage[Size];
+};
+
+using SmallPacketBuffer = PacketBuffer<256, fbl::DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE>;
+using MediumPacketBuffer = PacketBuffer<1024, fbl::DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE>;
+using LargePacketBuffer = PacketBuffer<4096, 64 * 1024>;
+
+template <typename Buffer>
+void* AllocPacketBuffer() {
+    static_assert(offsetof(Buffer, storage) == 0, "");
+    return fbl::SlabAllocator<typename Buffer::Traits>::New();
+}
+
+template <typename Buffer>
+void FreePacketBuffer(void* ptr) {
+    delete reinterpret_cast<Buffer*>(ptr);
+}
+
+struct PacketSizeClass {
+    size_t size;
+    void* (*alloc)();
+    void (*free)(void*);
+};
+
+// Ordered by size.
+const PacketSizeClass kPacketSizeClasses[] = {
+    {SmallPacketBuffer::kSize, AllocPacketBuffer<SmallPacketBuffer>,
+     FreePacketBuffer<SmallPacketBuffer>},
+    {MediumPacketBuffer::kSize, AllocPacketBuffer<MediumPacketBuffer>,
+     FreePacketBuffer<MediumPacketBuffer>},
+    {LargePacketBuffer::kSize, AllocPacketBuffer<LargePacketBuffer>,
+     FreePacketBuffer<LargePacketBuffer>},
+};
+
+constexpr uint8_t kHeapSizeClass = UINT8_MAX;
+
+constexpr size_t PacketSize(uint32_t data_size, uint32_t num_handles) {
+    return sizeof(MessagePacket) + num_handles * sizeof(Handle*) + data_size;
+}
+
+} // namespace
+
+// Each size class may use up to 8MB of slabs.
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(SmallPacketBuffer::Traits, 512);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(MediumPacketBuffer::Traits, 512);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(LargePacketBuffer::Traits, 128);
+
 // static
 zx_status_t MessagePacket::NewPacket(uint32_t data_size, uint32_t num_handles,
+                                     fbl::RefPtr<VmObject> loaned_pages,
                                      fbl::unique_ptr<MessagePacket>* msg) {
     // Although the API uses uint32_t, we pack the handle count into a smaller
     // field internally. Make sure it fits.
@@ -24,15 +99,26 @@ zx_status_t MessagePacket::NewPacket(uint32_t data_size, uint32_t num_handles,
     }
 
     // Allocate space for the MessagePacket object followed by num_handles
-    // Handle*s followed by data_size bytes.
-    // TODO(dbort): Use mbuf-style memory for data_size, ideally allocating from
-    // somewhere other than the heap. Lets us better track and isolate channel
-    // memory usage.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
-    if (ptr == nullptr) {
-        return ZX_ERR_NO_MEMORY;
+    // Handle*s followed by data_size bytes, from the smallest size class
+    // that fits.
+    const size_t size = PacketSize(loaned_pages ? 0u : data_size, num_handles);
+    char* ptr = nullptr;
+    uint8_t size_class = 0;
+    for (; size_class < fbl::count_of(kPacketSizeClasses); size_class++) {
+        if (size <= kPacketSizeClasses[size_class].size) {
+            ptr = static_cast<char*>(kPacketSizeClasses[size_class].alloc());
+            break;
+        }
+    }
+    if (ptr != nullptr) {
+        kcounter_add(packet_slab_count, 1);
+    } else {
+        size_class = kHeapSizeClass;
+        ptr = static_cast<char*>(malloc(size));
+        if (ptr == nullptr) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        kcounter_add(packet_heap_count, 1);
     }
 
     // The storage space for the Handle*s is not initialized because
@@ -41,15 +127,64 @@ zx_status_t MessagePacket::NewPacket(uint32_t data_size, uint32_t num_handles,
     // of the object.
     msg->reset(new (ptr) MessagePacket(
         data_size, num_handles,
-        reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket))));
+        reinterpret_cast<Handle**>(ptr + sizeof(MessagePacket)),
+        fbl::move(loaned_pages), size_class));
     return ZX_OK;
 }
 
+// static
+void MessagePacket::operator delete(void* ptr) {
+    // The packet has already been destructed, but ~MessagePacket() leaves
+    // size_class_ alone, so it is still safe to read here. This is the same
+    // trick fbl::SlabAllocated uses to find its way home.
+    const uint8_t size_class = static_cast<MessagePacket*>(ptr)->size_class_;
+    if (size_class == kHeapSizeClass) {
+        free(ptr);
+    } else {
+        DEBUG_ASSERT(size_class < fbl::count_of(kPacketSizeClasses));
+        kPacketSizeClasses[size_class].free(ptr);
+    }
+}
+
+size_t MessagePacket::buffer_size() const {
+    size_t size;
+    if (size_class_ == kHeapSizeClass) {
+        size = PacketSize(loaned_pages_ ? 0u : data_size_, num_handles_);
+    } else {
+        size = kPacketSizeClasses[size_class_].size;
+    }
+    if (loaned_pages_)
+        size += ROUNDUP(data_size_, PAGE_SIZE);
+    return size;
+}
+
+zx_status_t MessagePacket::CopyDataTo(user_out_ptr<void> buf) const {
+    if (loaned_pages_)
+        return loaned_pages_->ReadUser(buf, 0, data_size_, nullptr);
+    return buf.copy_array_to_user(data(), data_size_);
+}
+
+zx_txid_t MessagePacket::get_txid() const {
+    if (data_size_ < sizeof(zx_txid_t))
+        return 0;
+
+    zx_txid_t txid;
+    if (loaned_pages_) {
+        // the pages were all committed when they were loaned, so reading
+        // them back can't fail
+        zx_status_t status = loaned_pages_->Read(&txid, 0, sizeof(txid), nullptr);
+        DEBUG_ASSERT(status == ZX_OK);
+    } else {
+        memcpy(&txid, data(), sizeof(txid));
+    }
+    return txid;
+}
+
 // static
 zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_size,
                                   uint32_t num_handles,
                                   fbl::unique_ptr<MessagePacket>* msg) {
-    zx_status_t status = NewPacket(data_size, num_handles, msg);
+    zx_status_t status = NewPacket(data_size, num_handles, nullptr, msg);
     if (status != ZX_OK) {
         return status;
     }
@@ -66,7 +201,7 @@ zx_status_t MessagePacket::Create(user_in_ptr<const void> data, uint32_t data_si
 zx_status_t MessagePacket::Create(const void* data, uint32_t data_size,
                                   uint32_t num_handles,
                                   fbl::unique_ptr<MessagePacket>* msg) {
-    zx_status_t status = NewPacket(data_size, num_handles, msg);
+    zx_status_t status = NewPacket(data_size, num_handles, nullptr, msg);
     if (status != ZX_OK) {
         return status;
     }
@@ -76,6 +211,19 @@ zx_status_t MessagePacket::Create(const void* data, uint32_t data_size,
     return ZX_OK;
 }
 
+// static
+zx_status_t MessagePacket::Create(fbl::RefPtr<VmObject> pages, uint32_t data_size,
+                                  uint32_t num_handles,
+                                  fbl::unique_ptr<MessagePacket>* msg) {
+    DEBUG_ASSERT(pages && pages->size() >= data_size);
+    zx_status_t status = NewPacket(data_size, num_handles, fbl::move(pages), msg);
+    if (status != ZX_OK) {
+        return status;
+    }
+    kcounter_add(packet_loaned_count, 1);
+    return ZX_OK;
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         for (size_t ix = 0; ix != num_handles_; ++ix) {
@@ -86,8 +234,10 @@ MessagePacket::~MessagePacket() {
 }
 
 MessagePacket::MessagePacket(uint32_t data_size,
-                             uint32_t num_handles, Handle** handles)
-    : handles_(handles), data_size_(data_size),
+                             uint32_t num_handles, Handle** handles,
+                             fbl::RefPtr<VmObject> loaned_pages, uint8_t size_class)
+    : handles_(handles), loaned_pages_(fbl::move(loaned_pages)), data_size_(data_size),
       // NewPacket ensures that num_handles fits in 16 bits.
-      num_handles_(static_cast<uint16_t>(num_handles)), owns_handles_(false) {
+      num_handles_(static_cast<uint16_t>(num_handles)), owns_handles_(false),
+      size_class_(size_class) {
 }
@@ -0,0 +1,175 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/object_cache.h>
+
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <object/event_dispatcher.h>
+#include <object/event_pair_dispatcher.h>
+#include <object/port_dispatcher.h>
+#include <object/timer_dispatcher.h>
+
+ObjectCache event_dispatcher_cache(
+    "event", sizeof(EventDispatcher), alignof(EventDispatcher));
+ObjectCache event_pair_dispatcher_cache(
+    "eventpair", sizeof(EventPairDispatcher), alignof(EventPairDispatcher));
+ObjectCache timer_dispatcher_cache(
+    "timer", sizeof(TimerDispatcher), alignof(TimerDispatcher));
+ObjectCache port_observer_cache(
+    "port-observer", sizeof(PortObserver), alignof(PortObserver));
+
+static ObjectCache* const kObjectCaches[] = {
+    &event_dispatcher_cache,
+    &event_pair_dispatcher_cache,
+    &timer_dispatcher_cache,
+    &port_observer_cache,
+};
+
+// static
+size_t ObjectCache::Count() {
+    return fbl::count_of(kObjectCaches);
+}
+
+// static
+ObjectCache* ObjectCache::Get(size_t index) {
+    return (index < Count()) ? kObjectCaches[index] : nullptr;
+}
+
+void* ObjectCache::Alloc() {
+    Magazine* mag = &magazines_[arch_curr_cpu_num()];
+    {
+        AutoSpinLockIrqSave lock(&mag->lock);
+        if (likely(mag->count > 0)) {
+            mag->allocs++;
+            return mag->objects[--mag->count];
+        }
+    }
+
+    // Refill with a whole batch, keeping the first object for the caller.
+    void* batch[kBatch];
+    size_t n = TakeFromDepot(batch, kBatch);
+    if (n == 0) {
+        if (!Grow())
+            return nullptr;
+        n = TakeFromDepot(batch, kBatch);
+        if (n == 0)
+            return nullptr;
+    }
+
+    // We may be on another cpu by now, which only means that one gets the
+    // batch.
+    mag = &magazines_[arch_curr_cpu_num()];
+    size_t i = 1;
+    {
+        AutoSpinLockIrqSave lock(&mag->lock);
+        mag->allocs++;
+        while (i < n && mag->count < kMagazineSize)
+            mag->objects[mag->count++] = batch[i++];
+    }
+    if (i < n)
+        ReturnToDepot(batch + i, n - i);
+    return batch[0];
+}
+
+void ObjectCache::Free(void* ptr) {
+    DEBUG_ASSERT(ptr != nullptr);
+
+    void* batch[kBatch];
+    Magazine* mag = &magazines_[arch_curr_cpu_num()];
+    {
+        AutoSpinLockIrqSave lock(&mag->lock);
+        mag->frees++;
+        if (likely(mag->count < kMagazineSize)) {
+            mag->objects[mag->count++] = ptr;
+            return;
+        }
+
+        // Full; the oldest half goes back to the depot.
+        memcpy(batch, mag->objects, sizeof(batch));
+        memmove(mag->objects, mag->objects + kBatch, (kMagazineSize - kBatch) * sizeof(void*));
+        mag->count = kMagazineSize - kBatch;
+        mag->objects[mag->count++] = ptr;
+    }
+    ReturnToDepot(batch, kBatch);
+}
+
+size_t ObjectCache::TakeFromDepot(void** objects, size_t count) {
+    AutoSpinLockIrqSave lock(&depot_lock_);
+    size_t n = 0;
+    while (n < count && depot_ != nullptr) {
+        FreeObject* obj = depot_;
+        depot_ = obj->next;
+        objects[n++] = obj;
+    }
+    depot_count_ -= n;
+    return n;
+}
+
+void ObjectCache::ReturnToDepot(void* const* objects, size_t count) {
+    AutoSpinLockIrqSave lock(&depot_lock_);
+    for (size_t i = 0; i < count; i++) {
+        FreeObject* obj = static_cast<FreeObject*>(objects[i]);
+        obj->next = depot_;
+        depot_ = obj;
+    }
+    depot_count_ += count;
+}
+
+bool ObjectCache::Grow() {
+    const size_t align = fbl::max(object_align_, alignof(FreeObject));
+    const size_t stride = fbl::round_up(fbl::max(object_size_, sizeof(FreeObject)), align);
+    DEBUG_ASSERT(stride <= kSlabSize);
+
+    // The heap lock is only taken here, outside of any spinlock.
+    uint8_t* slab = static_cast<uint8_t*>(memalign(align, kSlabSize));
+    if (slab == nullptr)
+        return false;
+
+    FreeObject* head = nullptr;
+    FreeObject* tail = nullptr;
+    size_t n = 0;
+    for (size_t off = 0; off + stride <= kSlabSize; off += stride, n++) {
+        FreeObject* obj = reinterpret_cast<FreeObject*>(slab + off);
+        obj->next = head;
+        head = obj;
+        if (tail == nullptr)
+            tail = obj;
+    }
+
+    AutoSpinLockIrqSave lock(&depot_lock_);
+    tail->next = depot_;
+    depot_ = head;
+    depot_count_ += n;
+    slab_count_++;
+    return true;
+}
+
+void ObjectCache::GetInfo(zx_info_kmem_cache_t* info) {
+    *info = {};
+    strlcpy(info->name, name_, sizeof(info->name));
+    info->object_size = object_size_;
+
+    uint64_t allocs = 0;
+    uint64_t frees = 0;
+    uint64_t cached = 0;
+    for (uint cpu = 0; cpu < arch_max_num_cpus(); cpu++) {
+        Magazine* mag = &magazines_[cpu];
+        AutoSpinLockIrqSave lock(&mag->lock);
+        allocs += mag->allocs;
+        frees += mag->frees;
+        cached += mag->count;
+    }
+
+    AutoSpinLockIrqSave lock(&depot_lock_);
+    info->slab_bytes = slab_count_ * kSlabSize;
+    info->objects_in_use = allocs - frees;
+    info->objects_free = cached + depot_count_;
+}
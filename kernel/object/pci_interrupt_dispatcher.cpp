@@ -29,6 +29,7 @@ pcie_irq_handler_retval_t PciInterruptDispatcher::IrqThunk(const PcieDevice& dev
     // only record timestamp if this is the first IRQ since we started waiting
     zx_time_t zero_timestamp = 0;
     atomic_cmpxchg_u64(&interrupt->timestamp, &zero_timestamp, current_time());
+    atomic_add_u64(&interrupt->count, 1);
 
     PciInterruptDispatcher* thiz
             = reinterpret_cast<PciInterruptDispatcher *>(interrupt->dispatcher);
@@ -117,4 +118,8 @@ void PciInterruptDispatcher::UnregisterInterruptHandler(uint32_t vector) {
     device_->RegisterIrqHandler(vector, nullptr, nullptr);
 }
 
+zx_status_t PciInterruptDispatcher::SetInterruptAffinity(uint32_t vector, cpu_num_t cpu) {
+    return device_->SetIrqAffinity(vector, cpu);
+}
+
 #endif  // if WITH_DEV_PCIE
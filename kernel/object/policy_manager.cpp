@@ -156,6 +156,17 @@ uint32_t PolicyManager::QueryBasicPolicy(pol_cookie_t policy, uint32_t condition
     }
 }
 
+uint32_t PolicyManager::QueryAllowedMask(pol_cookie_t policy) {
+    static_assert(ZX_POL_MAX <= 32u, "allowed mask is too small");
+
+    uint32_t mask = 0u;
+    for (uint32_t condition = 0; condition != ZX_POL_MAX; ++condition) {
+        if (QueryBasicPolicy(policy, condition) == ZX_POL_ACTION_ALLOW)
+            mask |= 1u << condition;
+    }
+    return mask;
+}
+
 uint32_t PolicyManager::GetEffectiveAction(uint64_t policy) {
     return Encoding::is_default(policy) ?
         default_action_ : Encoding::action(policy);
@@ -8,6 +8,7 @@
 
 #include <assert.h>
 #include <err.h>
+#include <lib/counters.h>
 #include <platform.h>
 #include <pow2.h>
 
@@ -23,6 +24,8 @@
 
 using fbl::AutoLock;
 
+MUTEX_CLASS(port_lock_class, "port");
+
 static_assert(sizeof(zx_packet_signal_t) == sizeof(zx_packet_user_t),
               "size of zx_packet_signal_t must match zx_packet_user_t");
 static_assert(sizeof(zx_packet_exception_t) == sizeof(zx_packet_user_t),
@@ -73,7 +76,8 @@ void ArenaPortAllocator::Free(PortPacket* port_packet) {
 }
 
 PortPacket::PortPacket(const void* handle, PortAllocator* allocator)
-    : packet{}, handle(handle), observer(nullptr), allocator(allocator) {
+    : packet{}, handle(handle), observer(nullptr), allocator(allocator),
+      priority(ZX_PORT_PRIORITY_DEFAULT), coalesce(false) {
     // Note that packet is initialized to zeros.
     if (handle) {
         // Currently |handle| is only valid if the packets are not ephemeral
@@ -88,7 +92,7 @@ size_t PortPacket::DiagnosticAllocationCount() {
 }
 
 PortObserver::PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<PortDispatcher> port,
-                           uint64_t key, zx_signals_t signals)
+                           uint64_t key, zx_signals_t signals, uint32_t priority, bool coalesce)
     : type_(type),
       trigger_(signals),
       packet_(handle, nullptr),
@@ -101,6 +105,8 @@ PortObserver::PortObserver(uint32_t type, const Handle* handle, fbl::RefPtr<Port
     packet.key = key;
     packet.type = type_;
     packet.signal.trigger = trigger_;
+    packet_.priority = priority;
+    packet_.coalesce = coalesce;
 }
 
 StateObserver::Flags PortObserver::OnInitialize(zx_signals_t initial_state,
@@ -146,6 +152,8 @@ StateObserver::Flags PortObserver::MaybeQueue(zx_signals_t new_state, uint64_t c
     if ((trigger_ & new_state) == 0u)
         return 0;
 
+    // If the port merged the signals into another wait's packet, ours was
+    // never queued; a one-shot wait is done all the same.
     auto status = port_->Queue(&packet_, new_state, count);
 
     if ((type_ == ZX_PKT_TYPE_SIGNAL_ONE) || (status < 0))
@@ -178,7 +186,7 @@ zx_status_t PortDispatcher::Create(uint32_t options, fbl::RefPtr<Dispatcher>* di
 }
 
 PortDispatcher::PortDispatcher(uint32_t /*options*/)
-    : zero_handles_(false) {
+    : lock_(&port_lock_class), zero_handles_(false) {
 }
 
 PortDispatcher::~PortDispatcher() {
@@ -208,12 +216,17 @@ void PortDispatcher::on_zero_handles() {
 zx_status_t PortDispatcher::QueueUser(const zx_port_packet_t& packet) {
     canary_.Assert();
 
+    const uint32_t priority = (packet.type & ZX_PKT_PRIORITY_MASK) >> 24;
+    if (priority >= kNumPriorities)
+        return ZX_ERR_INVALID_ARGS;
+
     auto port_packet = port_allocator.Alloc();
     if (!port_packet)
         return ZX_ERR_NO_MEMORY;
 
     port_packet->packet = packet;
     port_packet->packet.type = ZX_PKT_TYPE_USER;
+    port_packet->priority = priority;
 
     auto status = Queue(port_packet, 0u, 0u);
     if (status < 0)
@@ -224,6 +237,8 @@ zx_status_t PortDispatcher::QueueUser(const zx_port_packet_t& packet) {
 zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed, uint64_t count) {
     canary_.Assert();
 
+    DEBUG_ASSERT(port_packet->priority < kNumPriorities);
+
     int wake_count = 0;
     {
         AutoLock al(&lock_);
@@ -236,11 +251,22 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
                 // |count| is deliberately left as is.
                 return ZX_OK;
             }
+            if (port_packet->coalesce) {
+                auto it = coalescing_.find(port_packet->key());
+                if (it.IsValid()) {
+                    PortPacket* queued = &(*it);
+                    // As above, |count| is left as is, and so is the
+                    // priority the packet was queued with.
+                    queued->packet.signal.observed |= observed;
+                    return ZX_OK;
+                }
+                coalescing_.insert(port_packet);
+            }
             port_packet->packet.signal.observed = observed;
             port_packet->packet.signal.count = count;
         }
 
-        packets_.push_back(port_packet);
+        packets_[port_packet->priority].push_back(port_packet);
         wake_count = sema_.Post();
     }
 
@@ -251,41 +277,91 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 }
 
 zx_status_t PortDispatcher::Dequeue(zx_time_t deadline, zx_port_packet_t* out_packet) {
+    size_t count;
+    return DequeueMany(deadline, out_packet, 1u, &count);
+}
+
+zx_status_t PortDispatcher::DequeueMany(zx_time_t deadline, zx_port_packet_t* out_packets,
+                                        size_t max_packets, size_t* count) {
     canary_.Assert();
+    DEBUG_ASSERT(max_packets > 0u);
 
     while (true) {
+        size_t n = 0;
         {
             AutoLock al(&lock_);
 
-            PortPacket* port_packet = packets_.pop_front();
-            if (port_packet == nullptr)
-                goto wait;
-
-            if (out_packet != nullptr)
-                *out_packet = port_packet->packet;
-
-            PortObserver* observer = port_packet->observer;
-
-            if (observer) {
-                // Deleting the observer under the lock is fine because
-                // the reference that holds to this PortDispatcher is by
-                // construction not the last one. We need to do this under
-                // the lock because another thread can call CanReap().
-                delete observer;
-            } else if (port_packet->is_ephemeral()) {
-                port_packet->Free();
+            // Only the first packet is waited for; the rest are whatever is
+            // already queued. The semaphore keeps the extra posts, so other
+            // waiters may wake to an empty queue and go back to waiting.
+            while (n < max_packets) {
+                PortPacket* port_packet = PopLocked();
+                if (port_packet == nullptr)
+                    break;
+
+                if (out_packets != nullptr)
+                    out_packets[n] = port_packet->packet;
+                ++n;
+
+                PortObserver* observer = port_packet->observer;
+
+                if (observer) {
+                    // Deleting the observer under the lock is fine because
+                    // the reference that holds to this PortDispatcher is by
+                    // construction not the last one. We need to do this under
+                    // the lock because another thread can call CanReap().
+                    delete observer;
+                } else if (port_packet->is_ephemeral()) {
+                    port_packet->Free();
+                }
             }
         }
 
-        return ZX_OK;
+        if (n > 0u) {
+            *count = n;
+            return ZX_OK;
+        }
 
-wait:
         zx_status_t st = sema_.Wait(deadline, nullptr);
         if (st != ZX_OK)
             return st;
     }
 }
 
+bool PortDispatcher::IsQueued(const PortPacket* port_packet) {
+    canary_.Assert();
+
+    AutoLock al(&lock_);
+    return port_packet->InContainer();
+}
+
+void PortDispatcher::RemovePacket(PortPacket* port_packet) {
+    canary_.Assert();
+
+    AutoLock al(&lock_);
+    // The semaphore keeps its post, which only costs a waiter a retry.
+    if (port_packet->InContainer())
+        EraseLocked(port_packet);
+}
+
+PortPacket* PortDispatcher::PopLocked() {
+    for (uint32_t priority = kNumPriorities; priority-- > 0;) {
+        PortPacket* port_packet = packets_[priority].pop_front();
+        if (port_packet != nullptr) {
+            if (port_packet->coalesce_node.InContainer())
+                coalescing_.erase(*port_packet);
+            return port_packet;
+        }
+    }
+    return nullptr;
+}
+
+void PortDispatcher::EraseLocked(PortPacket* port_packet) {
+    packets_[port_packet->priority].erase(*port_packet);
+    if (port_packet->coalesce_node.InContainer())
+        coalescing_.erase(*port_packet);
+}
+
 bool PortDispatcher::CanReap(PortObserver* observer, PortPacket* port_packet) {
     canary_.Assert();
 
@@ -308,8 +384,13 @@ zx_status_t PortDispatcher::MakeObserver(uint32_t options, Handle* handle, uint6
     if (!dispatcher->has_state_tracker())
         return ZX_ERR_NOT_SUPPORTED;
 
+    const bool coalesce = (options & ZX_WAIT_ASYNC_COALESCE) != 0;
+    const uint32_t priority = (options & ZX_WAIT_ASYNC_PRIORITY_MASK) >> 16;
+    if (priority >= kNumPriorities)
+        return ZX_ERR_INVALID_ARGS;
+
     uint32_t type;
-    switch (options) {
+    switch (options & ~(ZX_WAIT_ASYNC_COALESCE | ZX_WAIT_ASYNC_PRIORITY_MASK)) {
         case ZX_WAIT_ASYNC_ONCE:
             type = ZX_PKT_TYPE_SIGNAL_ONE;
             break;
@@ -322,7 +403,7 @@ zx_status_t PortDispatcher::MakeObserver(uint32_t options, Handle* handle, uint6
 
     fbl::AllocChecker ac;
     auto observer = new (&ac) PortObserver(type, handle, fbl::RefPtr<PortDispatcher>(this), key,
-                                           signals);
+                                           signals, priority, coalesce);
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -357,18 +438,23 @@ bool PortDispatcher::CancelQueued(const void* handle, uint64_t key) {
 
     bool packet_removed = false;
 
-    for (auto it = packets_.begin(); it != packets_.end();) {
-        if (it->handle == nullptr) {
-            ++it;
-            continue;
-        }
+    for (auto& packets : packets_) {
+        for (auto it = packets.begin(); it != packets.end();) {
+            if (it->handle == nullptr) {
+                ++it;
+                continue;
+            }
 
-        if ((it->handle == handle) && (it->key() == key)) {
-            auto to_remove = it++;
-            delete packets_.erase(to_remove)->observer;
-            packet_removed = true;
-        } else {
-            ++it;
+            if ((it->handle == handle) && (it->key() == key)) {
+                auto to_remove = it++;
+                PortPacket* port_packet = packets.erase(to_remove);
+                if (port_packet->coalesce_node.InContainer())
+                    coalescing_.erase(*port_packet);
+                delete port_packet->observer;
+                packet_removed = true;
+            } else {
+                ++it;
+            }
         }
     }
 
@@ -15,6 +15,7 @@
 
 #include <arch/defines.h>
 
+#include <kernel/cmdline.h>
 #include <kernel/thread.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
@@ -22,8 +23,11 @@
 
 #include <lib/crypto/global_prng.h>
 #include <lib/ktrace.h>
+#include <lk/init.h>
+#include <platform.h>
 
 #include <zircon/rights.h>
+#include <zircon/zx-syscall-numbers.h>
 
 #include <object/diagnostics.h>
 #include <object/futex_context.h>
@@ -33,6 +37,7 @@
 #include <object/vm_address_region_dispatcher.h>
 #include <object/vm_object_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 
@@ -56,6 +61,16 @@ static Handle* map_value_to_handle(zx_handle_t value, uint32_t mixer) {
     return Handle::FromU32(handle_id);
 }
 
+// Set by kernel.syscall-stats; processes created while it is set count their
+// syscalls, see ProcessDispatcher::AccountSyscall().
+static bool syscall_stats_enabled = false;
+
+static void syscall_stats_init_hook(uint) {
+    syscall_stats_enabled = cmdline_get_bool("kernel.syscall-stats", false);
+}
+
+LK_INIT_HOOK(syscall_stats, syscall_stats_init_hook, LK_INIT_LEVEL_THREADING - 1);
+
 zx_status_t ProcessDispatcher::Create(
     fbl::RefPtr<JobDispatcher> job, fbl::StringPiece name, uint32_t flags,
     fbl::RefPtr<Dispatcher>* dispatcher, zx_rights_t* rights,
@@ -66,6 +81,12 @@ zx_status_t ProcessDispatcher::Create(
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
+    if (syscall_stats_enabled) {
+        process->syscall_stats_.reset(new (&ac) SyscallStats[ZX_SYS_COUNT]());
+        if (!ac.check())
+            return ZX_ERR_NO_MEMORY;
+    }
+
     if (!job->AddChildProcess(process.get()))
         return ZX_ERR_BAD_STATE;
 
@@ -95,6 +116,7 @@ ProcessDispatcher::ProcessDispatcher(fbl::RefPtr<JobDispatcher> job,
                                      fbl::StringPiece name,
                                      uint32_t flags)
   : job_(fbl::move(job)), policy_(job_->GetPolicy()),
+    allowed_policy_mask_(GetSystemPolicyManager()->QueryAllowedMask(policy_)),
     name_(name.data(), name.length()) {
     LTRACE_ENTRY_OBJ;
 
@@ -314,6 +336,22 @@ void ProcessDispatcher::SetStateLocked(State s) {
     }
 }
 
+// Emits a record for each syscall the process made, with the number of
+// calls and the total time spent in them.
+void ProcessDispatcher::TraceSyscallStats(uint32_t koid) {
+    const uint64_t tps = ticks_per_second();
+    for (uint32_t num = 0; num < ZX_SYS_COUNT; ++num) {
+        uint64_t count = syscall_stats_[num].count.load(fbl::memory_order_relaxed);
+        if (count == 0)
+            continue;
+        uint64_t ticks = syscall_stats_[num].ticks.load(fbl::memory_order_relaxed);
+        uint64_t usec = ticks / tps * 1000000u + ticks % tps * 1000000u / tps;
+        ktrace(TAG_PROC_SYSCALLS, koid, num,
+               static_cast<uint32_t>(fbl::min<uint64_t>(count, UINT32_MAX)),
+               static_cast<uint32_t>(fbl::min<uint64_t>(usec, UINT32_MAX)));
+    }
+}
+
 // Finish processing of the transition to State::DEAD.
 // Some things need to be done outside of holding |state_lock_|.
 void ProcessDispatcher::FinishDeadTransition() {
@@ -331,6 +369,7 @@ void ProcessDispatcher::FinishDeadTransition() {
         }
         to_clean.swap(handles_);
     }
+    Handle::WaitForReaders();
 
     // zx-1544: Here is where if we're the last holder of a handle of one of
     // our exception ports then ResetExceptionPort will get called (by
@@ -353,6 +392,8 @@ void ProcessDispatcher::FinishDeadTransition() {
     // The PROC_CREATE record currently emits a uint32_t koid.
     uint32_t koid = static_cast<uint32_t>(get_koid());
     ktrace(TAG_PROC_EXIT, koid, 0, 0, 0);
+    if (syscall_stats_)
+        TraceSyscallStats(koid);
 
     // Call job_->RemoveChildProcess(this) outside of |state_lock_|. Otherwise
     // we risk a deadlock as we have |state_lock_| and RemoveChildProcess grabs
@@ -389,6 +430,27 @@ Handle* ProcessDispatcher::GetHandleLocked(zx_handle_t handle_value) {
     return nullptr;
 }
 
+bool ProcessDispatcher::GetHandleNoLock(zx_handle_t handle_value,
+                                        fbl::RefPtr<Dispatcher>* dispatcher,
+                                        zx_rights_t* rights) {
+    {
+        Handle::ReadSection read;
+        Handle* handle = map_value_to_handle(handle_value, handle_rand_);
+        if (handle && handle->process_id() == get_koid()) {
+            // Pairs with the release in set_process_id().
+            fbl::atomic_thread_fence(fbl::memory_order_acquire);
+            *dispatcher = handle->dispatcher();
+            *rights = handle->rights();
+            return true;
+        }
+    }
+
+    // Same policy as a failed GetHandleLocked(), applied outside the
+    // read section since it may raise an exception.
+    QueryPolicy(ZX_POL_BAD_HANDLE);
+    return false;
+}
+
 void ProcessDispatcher::AddHandle(HandleOwner handle) {
     AutoLock lock(&handle_table_lock_);
     AddHandleLocked(fbl::move(handle));
@@ -412,6 +474,9 @@ HandleOwner ProcessDispatcher::RemoveHandleLocked(zx_handle_t handle_value) {
     handle->set_process_id(0u);
     handles_.erase(*handle);
 
+    // Lock-free lookups may still be using the handle.
+    Handle::WaitForReaders();
+
     return HandleOwner(handle);
 }
 
@@ -421,24 +486,22 @@ void ProcessDispatcher::UndoRemoveHandleLocked(zx_handle_t handle_value) {
 }
 
 zx_koid_t ProcessDispatcher::GetKoidForHandle(zx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    if (!GetHandleNoLock(handle_value, &dispatcher, &rights))
         return ZX_KOID_INVALID;
-    return handle->dispatcher()->get_koid();
+    return dispatcher->get_koid();
 }
 
 zx_status_t ProcessDispatcher::GetDispatcherInternal(zx_handle_t handle_value,
                                                      fbl::RefPtr<Dispatcher>* dispatcher,
                                                      zx_rights_t* rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    zx_rights_t handle_rights;
+    if (!GetHandleNoLock(handle_value, dispatcher, &handle_rights))
         return ZX_ERR_BAD_HANDLE;
 
-    *dispatcher = handle->dispatcher();
     if (rights)
-        *rights = handle->rights();
+        *rights = handle_rights;
     return ZX_OK;
 }
 
@@ -446,17 +509,17 @@ zx_status_t ProcessDispatcher::GetDispatcherWithRightsInternal(zx_handle_t handl
                                                                zx_rights_t desired_rights,
                                                                fbl::RefPtr<Dispatcher>* dispatcher_out,
                                                                zx_rights_t* out_rights) {
-    AutoLock lock(&handle_table_lock_);
-    Handle* handle = GetHandleLocked(handle_value);
-    if (!handle)
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    if (!GetHandleNoLock(handle_value, &dispatcher, &rights))
         return ZX_ERR_BAD_HANDLE;
 
-    if (!handle->HasRights(desired_rights))
+    if ((rights & desired_rights) != desired_rights)
         return ZX_ERR_ACCESS_DENIED;
 
-    *dispatcher_out = handle->dispatcher();
+    *dispatcher_out = fbl::move(dispatcher);
     if (out_rights)
-        *out_rights = handle->rights();
+        *out_rights = rights;
     return ZX_OK;
 }
 
@@ -561,6 +624,50 @@ zx_status_t ProcessDispatcher::GetThreads(fbl::Array<zx_koid_t>* out_threads) {
     return ZX_OK;
 }
 
+zx_status_t ProcessDispatcher::GetThreadStats(fbl::Array<zx_info_job_thread_t>* out_stats) {
+    // Only hold the state lock long enough to take references to the
+    // threads; each thread takes its own lock to report its state.
+    fbl::Array<fbl::RefPtr<ThreadDispatcher>> threads;
+    {
+        AutoLock lock(&state_lock_);
+        size_t n = thread_list_.size_slow();
+        fbl::AllocChecker ac;
+        threads.reset(new (&ac) fbl::RefPtr<ThreadDispatcher>[n], n);
+        if (!ac.check())
+            return ZX_ERR_NO_MEMORY;
+        size_t i = 0;
+        for (auto& thread : thread_list_) {
+            threads[i] = fbl::WrapRefPtr(&thread);
+            ++i;
+        }
+    }
+
+    fbl::AllocChecker ac;
+    fbl::Array<zx_info_job_thread_t> stats(
+        new (&ac) zx_info_job_thread_t[threads.size()](), threads.size());
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+
+    char process_name[ZX_MAX_NAME_LEN];
+    get_name(process_name);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        zx_info_thread_t info;
+        zx_status_t status = threads[i]->GetInfoForUserspace(&info);
+        if (status != ZX_OK)
+            return status;
+        zx_info_job_thread_t* e = &stats[i];
+        e->koid = threads[i]->get_koid();
+        e->process_koid = get_koid();
+        e->total_runtime = threads[i]->runtime_ns();
+        e->state = info.state;
+        e->wait_exception_port_type = info.wait_exception_port_type;
+        threads[i]->get_name(e->name);
+        memcpy(e->process_name, process_name, sizeof(e->process_name));
+    }
+    *out_stats = fbl::move(stats);
+    return ZX_OK;
+}
+
 zx_status_t ProcessDispatcher::SetExceptionPort(fbl::RefPtr<ExceptionPort> eport) {
     LTRACE_ENTRY_OBJ;
     bool debugger = false;
@@ -729,6 +836,10 @@ zx_status_t ProcessDispatcher::set_debug_addr(uintptr_t addr) {
 }
 
 zx_status_t ProcessDispatcher::QueryPolicy(uint32_t condition) const {
+    // the common case: the job allows this without any exception
+    if (likely(condition < ZX_POL_MAX && (allowed_policy_mask_ & (1u << condition))))
+        return ZX_OK;
+
     auto action = GetSystemPolicyManager()->QueryBasicPolicy(policy_, condition);
     if (action & ZX_POL_ACTION_EXCEPTION) {
         thread_signal_policy_exception();
@@ -759,6 +870,7 @@ const char* StateToString(ProcessDispatcher::State state) {
 }
 
 bool ProcessDispatcher::IsHandleValid(zx_handle_t handle_value) {
-    AutoLock lock(&handle_table_lock_);
-    return (GetHandleLocked(handle_value) != nullptr);
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    return GetHandleNoLock(handle_value, &dispatcher, &rights);
 }
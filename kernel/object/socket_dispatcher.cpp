@@ -220,6 +220,12 @@ zx_status_t SocketDispatcher::ShutdownOther(uint32_t how) {
 
 zx_status_t SocketDispatcher::Write(user_in_ptr<const void> src, size_t len,
                                     size_t* nwritten) {
+    zx_iovec_t vec = {const_cast<void*>(src.get()), len};
+    return Writev(&vec, 1u, nwritten);
+}
+
+zx_status_t SocketDispatcher::Writev(const zx_iovec_t* vec, size_t count,
+                                     size_t* nwritten) {
     canary_.Assert();
 
     LTRACE_ENTRY;
@@ -235,14 +241,19 @@ zx_status_t SocketDispatcher::Write(user_in_ptr<const void> src, size_t len,
         other = other_;
     }
 
+    size_t len = 0u;
+    for (size_t i = 0; i < count; i++) {
+        if (vec[i].size > UINT32_MAX - len)
+            return ZX_ERR_INVALID_ARGS;
+        len += vec[i].size;
+    }
     if (len == 0) {
         *nwritten = 0;
         return ZX_OK;
     }
-    if (len != static_cast<size_t>(static_cast<uint32_t>(len)))
-        return ZX_ERR_INVALID_ARGS;
 
-    return other->WriteSelf(src, len, nwritten);
+    UserIovecCursor src(vec, count);
+    return other->WriteSelf(&src, len, nwritten);
 }
 
 zx_status_t SocketDispatcher::WriteControl(user_in_ptr<const void> src, size_t len) {
@@ -289,7 +300,7 @@ zx_status_t SocketDispatcher::WriteControlSelf(user_in_ptr<const void> src,
     return ZX_OK;
 }
 
-zx_status_t SocketDispatcher::WriteSelf(user_in_ptr<const void> src, size_t len,
+zx_status_t SocketDispatcher::WriteSelf(UserIovecCursor* src, size_t len,
                                         size_t* written) {
     canary_.Assert();
 
@@ -328,16 +339,29 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
 
     LTRACE_ENTRY;
 
-    AutoLock lock(&lock_);
-
     // Just query for bytes outstanding.
     if (!dst && len == 0) {
+        AutoLock lock(&lock_);
         *nread = data_.size();
         return ZX_OK;
     }
 
-    if (len != (size_t)((uint32_t)len))
-        return ZX_ERR_INVALID_ARGS;
+    zx_iovec_t vec = {dst.get(), len};
+    return Readv(&vec, 1u, nread);
+}
+
+zx_status_t SocketDispatcher::Readv(const zx_iovec_t* vec, size_t count,
+                                    size_t* nread) {
+    canary_.Assert();
+
+    size_t len = 0u;
+    for (size_t i = 0; i < count; i++) {
+        if (vec[i].size > UINT32_MAX - len)
+            return ZX_ERR_INVALID_ARGS;
+        len += vec[i].size;
+    }
+
+    AutoLock lock(&lock_);
 
     if (is_empty()) {
         if (!other_)
@@ -351,7 +375,8 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
 
     bool was_full = is_full();
 
-    auto st = data_.Read(dst, len, flags_ & ZX_SOCKET_DATAGRAM);
+    UserIovecCursor dst(vec, count);
+    auto st = data_.Read(&dst, len, flags_ & ZX_SOCKET_DATAGRAM);
 
     if (is_empty()) {
         uint32_t set_mask = 0u;
@@ -360,13 +385,116 @@ zx_status_t SocketDispatcher::Read(user_out_ptr<void> dst, size_t len,
         UpdateState(ZX_SOCKET_READABLE, set_mask);
     }
 
-    if (other_ && was_full && (st > 0))
+    if (other_ && was_full && !is_full())
         other_->UpdateState(0u, ZX_SOCKET_WRITABLE);
 
     *nread = static_cast<size_t>(st);
     return ZX_OK;
 }
 
+zx_status_t SocketDispatcher::Splice(SocketDispatcher* dst, size_t len, size_t* nmoved) {
+    canary_.Assert();
+
+    LTRACE_ENTRY;
+
+    if ((flags_ & ZX_SOCKET_DATAGRAM) != (dst->flags_ & ZX_SOCKET_DATAGRAM))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    fbl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&dst->lock_);
+        if (!dst->other_)
+            return ZX_ERR_PEER_CLOSED;
+        zx_signals_t signals = dst->GetSignalsState();
+        if (signals & ZX_SOCKET_WRITE_DISABLED)
+            return ZX_ERR_BAD_STATE;
+        other = dst->other_;
+    }
+    // Writing to our own peer would feed our reads back to us.
+    if (other.get() == this)
+        return ZX_ERR_INVALID_ARGS;
+
+    if (len == 0) {
+        *nmoved = 0;
+        return ZX_OK;
+    }
+
+    // Both buffers change at once, so both locks are held. Taking them in
+    // address order keeps splices running in opposite directions from
+    // deadlocking.
+    SocketDispatcher* first = (this < other.get()) ? this : other.get();
+    SocketDispatcher* second = (this < other.get()) ? other.get() : this;
+    AutoLock lock1(&first->lock_);
+    AutoLock lock2(&second->lock_);
+    return SpliceLocked(other.get(), len, nmoved);
+}
+
+// |dst| here is the endpoint that receives the data, and both its lock and
+// ours are held. The analysis can't see through the address ordering above.
+zx_status_t SocketDispatcher::SpliceLocked(SocketDispatcher* dst, size_t len,
+                                           size_t* nmoved) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (is_empty()) {
+        if (!other_)
+            return ZX_ERR_PEER_CLOSED;
+        if (read_disabled_)
+            return ZX_ERR_BAD_STATE;
+        return ZX_ERR_SHOULD_WAIT;
+    }
+
+    bool was_full = is_full();
+    bool dst_was_empty = dst->is_empty();
+
+    size_t moved = 0u;
+    zx_status_t status = dst->data_.SpliceFrom(&data_, len, flags_ & ZX_SOCKET_DATAGRAM, &moved);
+    if (status != ZX_OK)
+        return status;
+
+    if (is_empty()) {
+        uint32_t set_mask = 0u;
+        if (read_disabled_)
+            set_mask |= ZX_SOCKET_READ_DISABLED;
+        UpdateState(ZX_SOCKET_READABLE, set_mask);
+    }
+    if (other_ && was_full && !is_full())
+        other_->UpdateState(0u, ZX_SOCKET_WRITABLE);
+
+    if (dst_was_empty)
+        dst->UpdateState(0u, ZX_SOCKET_READABLE);
+    if (dst->other_ && dst->is_full())
+        dst->other_->UpdateState(ZX_SOCKET_WRITABLE, 0u);
+
+    *nmoved = moved;
+    return ZX_OK;
+}
+
+size_t SocketDispatcher::GetReadCapacity() {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    return data_.capacity();
+}
+
+zx_status_t SocketDispatcher::SetReadCapacity(size_t capacity) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    bool was_full = is_full();
+    zx_status_t status = data_.set_capacity(capacity);
+    if (status != ZX_OK)
+        return status;
+
+    // The peer writes into our buffer, so its writability follows our
+    // capacity.
+    if (other_ && was_full != is_full()) {
+        if (is_full())
+            other_->UpdateState(ZX_SOCKET_WRITABLE, 0u);
+        else
+            other_->UpdateState(0u, ZX_SOCKET_WRITABLE);
+    }
+    return ZX_OK;
+}
+
 zx_status_t SocketDispatcher::ReadControl(user_out_ptr<void> dst, size_t len,
                                           size_t* nread) {
     canary_.Assert();
@@ -15,8 +15,11 @@
 
 #include <arch/debugger.h>
 #include <arch/exception.h>
+#include <arch/ops.h>
 
+#include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <lib/counters.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_address_region.h>
@@ -59,6 +62,100 @@ zx_status_t ThreadDispatcher::Create(fbl::RefPtr<ProcessDispatcher> process, uin
     return ZX_OK;
 }
 
+namespace {
+
+// A user thread's kernel stack, and its unsafe stack when safe-stack is on.
+// Each stack is mapped in a vmar of its own that leaves an unmapped guard
+// page either side of it.
+struct KernelStacks {
+    fbl::RefPtr<VmMapping> kstack_mapping;
+    fbl::RefPtr<VmAddressRegion> kstack_vmar;
+#if __has_feature(safe_stack)
+    fbl::RefPtr<VmMapping> unsafe_kstack_mapping;
+    fbl::RefPtr<VmAddressRegion> unsafe_kstack_vmar;
+#endif
+
+    // True if every stack the thread needs is here.
+    bool complete() const {
+#if __has_feature(safe_stack)
+        if (!unsafe_kstack_vmar)
+            return false;
+#endif
+        return !!kstack_vmar;
+    }
+
+    void Destroy() {
+        kstack_mapping.reset();
+        if (kstack_vmar) {
+            kstack_vmar->Destroy();
+            kstack_vmar.reset();
+        }
+#if __has_feature(safe_stack)
+        unsafe_kstack_mapping.reset();
+        if (unsafe_kstack_vmar) {
+            unsafe_kstack_vmar->Destroy();
+            unsafe_kstack_vmar.reset();
+        }
+#endif
+    }
+};
+
+// Each cpu keeps the stacks of a few dead threads, still mapped and committed,
+// so that creating a thread doesn't usually have to make a VMO, two vmars and
+// a mapping and then fault the stack in. The guard pages stay reserved in the
+// stacks' vmars while they sit here. Like the pmm page cache, a cpu's cache is
+// only touched by that cpu with interrupts disabled, so it needs no lock; the
+// stacks are only ever moved in and out with interrupts off, never destroyed.
+constexpr size_t kStackCacheMax = 4;
+
+struct StackCache {
+    KernelStacks stacks[kStackCacheMax];
+    size_t count;
+} __CPU_ALIGN;
+
+StackCache stack_cache[SMP_MAX_CPUS];
+
+KCOUNTER(stack_cache_hit, "kernel.thread.stack_cache.hit");
+KCOUNTER(stack_cache_miss, "kernel.thread.stack_cache.miss");
+KCOUNTER(stack_cache_full, "kernel.thread.stack_cache.full");
+
+// Moves a set of cached stacks to |out|, which must be empty. Returns false
+// if this cpu's cache has none.
+bool stack_cache_take(KernelStacks* out) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    StackCache* c = &stack_cache[arch_curr_cpu_num()];
+    bool hit = c->count > 0;
+    if (hit)
+        *out = fbl::move(c->stacks[--c->count]);
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    kcounter_add(hit ? stack_cache_hit : stack_cache_miss, 1);
+    return hit;
+}
+
+// Moves |stacks| into this cpu's cache. Returns false, leaving |stacks| to the
+// caller, if the cache is full.
+bool stack_cache_put(KernelStacks* stacks) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    StackCache* c = &stack_cache[arch_curr_cpu_num()];
+    bool stored = c->count < kStackCacheMax;
+    if (stored)
+        c->stacks[c->count++] = fbl::move(*stacks);
+
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (!stored)
+        kcounter_add(stack_cache_full, 1);
+    return stored;
+}
+
+} // namespace
+
 ThreadDispatcher::ThreadDispatcher(fbl::RefPtr<ProcessDispatcher> process,
                                    uint32_t flags)
     : process_(fbl::move(process)) {
@@ -87,19 +184,16 @@ ThreadDispatcher::~ThreadDispatcher() {
         DEBUG_ASSERT_MSG(false, "bad state %s, this %p\n", StateToString(state_), this);
     }
 
-    // free the kernel stack
-    kstack_mapping_.reset();
-    if (kstack_vmar_) {
-        kstack_vmar_->Destroy();
-        kstack_vmar_.reset();
-    }
+    // free the kernel stack, or keep it around for the next thread
+    KernelStacks stacks;
+    stacks.kstack_mapping = fbl::move(kstack_mapping_);
+    stacks.kstack_vmar = fbl::move(kstack_vmar_);
 #if __has_feature(safe_stack)
-    unsafe_kstack_mapping_.reset();
-    if (unsafe_kstack_vmar_) {
-        unsafe_kstack_vmar_->Destroy();
-        unsafe_kstack_vmar_.reset();
-    }
+    stacks.unsafe_kstack_mapping = fbl::move(unsafe_kstack_mapping_);
+    stacks.unsafe_kstack_vmar = fbl::move(unsafe_kstack_vmar_);
 #endif
+    if (!stacks.complete() || !stack_cache_put(&stacks))
+        stacks.Destroy();
 
     event_destroy(&exception_event_);
 }
@@ -196,15 +290,25 @@ zx_status_t ThreadDispatcher::Initialize(const char* name, size_t len) {
     auto vmar = VmAspace::kernel_aspace()->RootVmar()->as_vm_address_region();
     DEBUG_ASSERT(!!vmar);
 
-    auto status = allocate_stack(vmar, false, &kstack_mapping_, &kstack_vmar_);
-    if (status != ZX_OK)
-        return status;
+    KernelStacks stacks;
+    if (stack_cache_take(&stacks)) {
+        kstack_mapping_ = fbl::move(stacks.kstack_mapping);
+        kstack_vmar_ = fbl::move(stacks.kstack_vmar);
 #if __has_feature(safe_stack)
-    status = allocate_stack(vmar, true,
-                            &unsafe_kstack_mapping_, &unsafe_kstack_vmar_);
-    if (status != ZX_OK)
-        return status;
+        unsafe_kstack_mapping_ = fbl::move(stacks.unsafe_kstack_mapping);
+        unsafe_kstack_vmar_ = fbl::move(stacks.unsafe_kstack_vmar);
+#endif
+    } else {
+        auto status = allocate_stack(vmar, false, &kstack_mapping_, &kstack_vmar_);
+        if (status != ZX_OK)
+            return status;
+#if __has_feature(safe_stack)
+        status = allocate_stack(vmar, true,
+                                &unsafe_kstack_mapping_, &unsafe_kstack_vmar_);
+        if (status != ZX_OK)
+            return status;
 #endif
+    }
 
     // create an underlying LK thread
     thread_t* lkthread = thread_create_etc(
@@ -253,6 +357,42 @@ zx_status_t ThreadDispatcher::set_name(const char* name, size_t len) {
     return ZX_OK;
 }
 
+zx_status_t ThreadDispatcher::SetSchedWeight(uint32_t weight) {
+    canary_.Assert();
+
+    static_assert(ZX_THREAD_SCHED_WEIGHT_DEFAULT == THREAD_FAIR_WEIGHT_DEFAULT, "");
+    static_assert(ZX_THREAD_SCHED_WEIGHT_MAX == THREAD_FAIR_WEIGHT_MAX, "");
+
+    return thread_set_fair_weight(&thread_, weight);
+}
+
+uint32_t ThreadDispatcher::sched_weight() const {
+    canary_.Assert();
+
+    return __atomic_load_n(&thread_.fair_weight, __ATOMIC_RELAXED);
+}
+
+zx_status_t ThreadDispatcher::SetSchedDeadline(const zx_sched_deadline_params_t& params) {
+    canary_.Assert();
+
+    return thread_set_deadline(&thread_, params.capacity, params.relative_deadline,
+                               params.period);
+}
+
+void ThreadDispatcher::GetSchedDeadline(zx_sched_deadline_params_t* params) {
+    canary_.Assert();
+
+    THREAD_LOCK(state);
+    if (thread_.deadline.capacity != 0) {
+        params->capacity = thread_.deadline.capacity;
+        params->relative_deadline = thread_.deadline.relative_deadline;
+        params->period = thread_.deadline.period;
+    } else {
+        *params = {};
+    }
+    THREAD_UNLOCK(state);
+}
+
 void ThreadDispatcher::get_name(char out_name[ZX_MAX_NAME_LEN]) const {
     canary_.Assert();
 
@@ -11,6 +11,7 @@
 
 #include <zircon/rights.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 
 #include <assert.h>
@@ -104,10 +105,24 @@ zx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             auto status = vmo_->DecommitRange(offset, size, nullptr);
             return status;
         }
-        case ZX_VMO_OP_LOCK:
+        case ZX_VMO_OP_LOCK: {
+            // locks the whole object; the range is ignored. if there is a
+            // buffer, the caller is told whether the old contents are gone.
+            bool report = buffer && buffer_size >= sizeof(uint32_t);
+            if (report) {
+                // fail on a bad buffer before the discarded state is consumed
+                auto status = buffer.reinterpret<uint32_t>().copy_to_user(0u);
+                if (status != ZX_OK)
+                    return status;
+            }
+            bool discarded = false;
+            auto status = vmo_->LockDiscardable(&discarded);
+            if (status != ZX_OK || !report)
+                return status;
+            return buffer.reinterpret<uint32_t>().copy_to_user(discarded ? 1u : 0u);
+        }
         case ZX_VMO_OP_UNLOCK:
-            // TODO: handle
-            return ZX_ERR_NOT_SUPPORTED;
+            return vmo_->UnlockDiscardable();
         case ZX_VMO_OP_LOOKUP:
             // we will be using the user pointer
             if (!buffer)
@@ -117,6 +132,31 @@ zx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
             static_assert(sizeof(zx_paddr_t) == sizeof(paddr_t), "");
 
             return vmo_->LookupUser(offset, size, buffer.reinterpret<paddr_t>(), buffer_size);
+        case ZX_VMO_OP_CACHE_SYNC:
+        case ZX_VMO_OP_CACHE_INVALIDATE:
+        case ZX_VMO_OP_CACHE_CLEAN:
+        case ZX_VMO_OP_CACHE_CLEAN_INVALIDATE:
+            if (buffer)
+                return CacheOpRanges(op, offset, size, buffer.reinterpret<zx_vmo_range_t>(),
+                                     buffer_size);
+            return CacheOp(op, offset, size);
+        case ZX_VMO_OP_TRACK_DIRTY:
+            return vmo_->TrackDirty(true);
+        case ZX_VMO_OP_UNTRACK_DIRTY:
+            return vmo_->TrackDirty(false);
+        case ZX_VMO_OP_QUERY_DIRTY:
+            // we will be using the user pointer
+            if (!buffer)
+                return ZX_ERR_INVALID_ARGS;
+
+            return vmo_->QueryDirtyUser(offset, size, buffer.reinterpret<uint8_t>(), buffer_size);
+        default:
+            return ZX_ERR_INVALID_ARGS;
+    }
+}
+
+zx_status_t VmObjectDispatcher::CacheOp(uint32_t op, uint64_t offset, uint64_t size) {
+    switch (op) {
         case ZX_VMO_OP_CACHE_SYNC:
             return vmo_->SyncCache(offset, size);
         case ZX_VMO_OP_CACHE_INVALIDATE:
@@ -130,6 +170,33 @@ zx_status_t VmObjectDispatcher::RangeOp(uint32_t op, uint64_t offset, uint64_t s
     }
 }
 
+// Applies a cache op to every range in |ranges|, a buffer of zx_vmo_range_t.
+// The ranges are copied in a few at a time; the op stops at the first range
+// that fails.
+zx_status_t VmObjectDispatcher::CacheOpRanges(uint32_t op, uint64_t offset, uint64_t size,
+                                              user_inout_ptr<zx_vmo_range_t> ranges,
+                                              size_t buffer_size) {
+    if (offset != 0 || size != 0)
+        return ZX_ERR_INVALID_ARGS;
+    if (buffer_size == 0 || buffer_size % sizeof(zx_vmo_range_t) != 0)
+        return ZX_ERR_INVALID_ARGS;
+
+    const size_t count = buffer_size / sizeof(zx_vmo_range_t);
+    zx_vmo_range_t chunk[16];
+    for (size_t i = 0; i < count; i += fbl::count_of(chunk)) {
+        const size_t n = fbl::min(count - i, fbl::count_of(chunk));
+        auto status = ranges.copy_array_from_user(chunk, n, i);
+        if (status != ZX_OK)
+            return status;
+        for (size_t j = 0; j < n; j++) {
+            status = CacheOp(op, chunk[j].offset, chunk[j].size);
+            if (status != ZX_OK)
+                return status;
+        }
+    }
+    return ZX_OK;
+}
+
 zx_status_t VmObjectDispatcher::SetMappingCachePolicy(uint32_t cache_policy) {
     return vmo_->SetMappingCachePolicy(cache_policy);
 }
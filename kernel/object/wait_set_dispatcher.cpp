@@ -0,0 +1,229 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <object/wait_set_dispatcher.h>
+
+#include <assert.h>
+#include <err.h>
+
+#include <object/handle.h>
+
+#include <zircon/rights.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/auto_lock.h>
+
+using fbl::AutoLock;
+
+WaitSetEntry::WaitSetEntry(fbl::RefPtr<WaitSetDispatcher> wait_set, uint64_t cookie,
+                           const Handle* handle, Dispatcher* dispatcher, zx_signals_t signals)
+    : wait_set_(fbl::move(wait_set)), cookie_(cookie), handle_(handle), signals_(signals),
+      dispatcher_(dispatcher) {
+}
+
+WaitSetEntry::~WaitSetEntry() {
+    DEBUG_ASSERT(!attached_);
+}
+
+StateObserver::Flags WaitSetEntry::OnInitialize(zx_signals_t initial_state,
+                                                const StateObserver::CountInfo* cinfo) {
+    canary_.Assert();
+
+    AutoLock lock(&wait_set_->lock_);
+    return wait_set_->UpdateEntryLocked(this, initial_state);
+}
+
+StateObserver::Flags WaitSetEntry::OnStateChange(zx_signals_t new_state) {
+    canary_.Assert();
+
+    AutoLock lock(&wait_set_->lock_);
+    return wait_set_->UpdateEntryLocked(this, new_state);
+}
+
+StateObserver::Flags WaitSetEntry::OnCancel(const Handle* handle) {
+    canary_.Assert();
+
+    if (handle != handle_)
+        return 0;
+
+    // The entry stays in the wait set, reporting the closed handle, until
+    // userspace removes it.
+    AutoLock lock(&wait_set_->lock_);
+    Flags flags = wait_set_->UpdateEntryLocked(this, observed_ | ZX_SIGNAL_HANDLE_CLOSED);
+    return flags | kHandled | kNeedRemoval;
+}
+
+StateObserver::Flags WaitSetEntry::OnCancelByKey(const Handle* handle, const void* port,
+                                                 uint64_t key) {
+    canary_.Assert();
+
+    if ((handle != handle_) || (port != wait_set_.get()) || (key != cookie_))
+        return 0;
+    return kHandled | kNeedRemoval;
+}
+
+void WaitSetEntry::OnRemoved() {
+    canary_.Assert();
+
+    bool orphaned;
+    {
+        AutoLock lock(&wait_set_->lock_);
+        attached_ = false;
+        dispatcher_ = nullptr;
+        orphaned = orphaned_;
+    }
+    if (orphaned)
+        delete this;
+}
+
+// static
+zx_status_t WaitSetDispatcher::Create(uint32_t options, fbl::RefPtr<Dispatcher>* dispatcher,
+                                      zx_rights_t* rights) {
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    fbl::AllocChecker ac;
+    auto disp = new (&ac) WaitSetDispatcher();
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+
+    *rights = ZX_DEFAULT_WAIT_SET_RIGHTS;
+    *dispatcher = fbl::AdoptRef<Dispatcher>(disp);
+    return ZX_OK;
+}
+
+WaitSetDispatcher::WaitSetDispatcher() {
+}
+
+WaitSetDispatcher::~WaitSetDispatcher() {
+}
+
+void WaitSetDispatcher::on_zero_handles() {
+    canary_.Assert();
+
+    AutoLock registration(&registration_lock_);
+    while (!entries_.is_empty())
+        DetachEntry(entries_.pop_front());
+}
+
+zx_status_t WaitSetDispatcher::AddEntry(uint64_t cookie, Handle* handle, zx_signals_t signals) {
+    canary_.Assert();
+
+    Dispatcher* dispatcher = handle->dispatcher().get();
+    if (!dispatcher->has_state_tracker())
+        return ZX_ERR_NOT_SUPPORTED;
+
+    AutoLock registration(&registration_lock_);
+    if (entries_.find(cookie).IsValid())
+        return ZX_ERR_ALREADY_EXISTS;
+
+    fbl::AllocChecker ac;
+    auto entry = new (&ac) WaitSetEntry(fbl::WrapRefPtr(this), cookie, handle, dispatcher,
+                                        signals);
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+
+    entries_.insert(entry);
+    zx_status_t status = dispatcher->add_observer(entry);
+    if (status != ZX_OK) {
+        // never attached, so nothing else can be looking at it
+        entries_.erase(*entry);
+        {
+            AutoLock lock(&lock_);
+            entry->attached_ = false;
+        }
+        delete entry;
+    }
+    return status;
+}
+
+zx_status_t WaitSetDispatcher::RemoveEntry(uint64_t cookie) {
+    canary_.Assert();
+
+    AutoLock registration(&registration_lock_);
+    auto it = entries_.find(cookie);
+    if (!it.IsValid())
+        return ZX_ERR_NOT_FOUND;
+
+    DetachEntry(entries_.erase(it));
+    return ZX_OK;
+}
+
+void WaitSetDispatcher::DetachEntry(WaitSetEntry* entry) {
+    fbl::RefPtr<Dispatcher> dispatcher;
+    {
+        AutoLock lock(&lock_);
+        if (entry->triggered_list_node_state_.InContainer())
+            triggered_.erase(*entry);
+        entry->orphaned_ = true;
+        // A still attached entry means its object is alive, at least until
+        // a racing handle close finishes with it.
+        if (entry->attached_)
+            dispatcher = fbl::WrapRefPtr(entry->dispatcher_);
+    }
+    const Handle* handle = entry->handle_;
+    uint64_t cookie = entry->cookie_;
+
+    if (!dispatcher) {
+        delete entry;
+        return;
+    }
+
+    // Either this removes the entry or a racing handle close already has;
+    // OnRemoved() frees it in both cases, so |entry| can't be touched here.
+    dispatcher->CancelByKey(const_cast<Handle*>(handle), this, cookie);
+}
+
+StateObserver::Flags WaitSetDispatcher::UpdateEntryLocked(WaitSetEntry* entry,
+                                                          zx_signals_t state) {
+    entry->observed_ = state | (entry->observed_ & ZX_SIGNAL_HANDLE_CLOSED);
+    if (entry->orphaned_)
+        return 0;
+
+    bool ready = (entry->observed_ & (entry->signals_ | ZX_SIGNAL_HANDLE_CLOSED)) != 0u;
+    bool triggered = entry->triggered_list_node_state_.InContainer();
+
+    if (ready && !triggered) {
+        // waiters only sleep once they have seen the list empty
+        bool was_empty = triggered_.is_empty();
+        triggered_.push_back(entry);
+        if (was_empty && event_.Signal() > 0)
+            return StateObserver::kWokeThreads;
+    } else if (!ready && triggered) {
+        triggered_.erase(*entry);
+    }
+    return 0;
+}
+
+zx_status_t WaitSetDispatcher::Wait(zx_time_t deadline, zx_waitset_result_t* results,
+                                    size_t max, size_t* count) {
+    canary_.Assert();
+
+    for (;;) {
+        {
+            AutoLock lock(&lock_);
+            if (!triggered_.is_empty()) {
+                fbl::DoublyLinkedList<WaitSetEntry*, WaitSetEntry::TriggeredListTraits> reported;
+                size_t n = 0;
+                while (n < max && !triggered_.is_empty()) {
+                    WaitSetEntry* entry = triggered_.pop_front();
+                    results[n].cookie = entry->cookie_;
+                    results[n].observed = entry->observed_;
+                    results[n].reserved = 0u;
+                    reported.push_back(entry);
+                    ++n;
+                }
+                triggered_.splice(triggered_.end(), reported);
+                *count = n;
+                return ZX_OK;
+            }
+            event_.Unsignal();
+        }
+
+        zx_status_t status = event_.Wait(deadline);
+        if (status != ZX_OK)
+            return status;
+    }
+}
@@ -626,12 +626,15 @@ static void platform_init_postvm(uint level) {
 LK_INIT_HOOK(platform_postvm, platform_init_postvm, LK_INIT_LEVEL_VM);
 
 void platform_dputs(const char* str, size_t len) {
+    // After a panic the uart's interrupt may never be taken again, so output
+    // is written out directly instead of being buffered.
+    int (*putc)(char) = panic_started ? uart_pputc : uart_putc;
     while (len-- > 0) {
         char c = *str++;
         if (c == '\n') {
-            uart_putc('\r');
+            putc('\r');
         }
-        uart_putc(c);
+        putc(c);
     }
 }
 
@@ -9,13 +9,16 @@
 #include <acpica/acpi.h>
 
 #include <assert.h>
+#include <debug.h>
 #include <err.h>
+#include <inttypes.h>
 #include <trace.h>
 
 #include <lk/init.h>
 
 #include <arch/x86/apic.h>
 #include <platform/pc/acpi.h>
+#include <vm/pmm.h>
 #include <zircon/types.h>
 
 #define LOCAL_TRACE 0
@@ -307,3 +310,147 @@ zx_status_t platform_find_hpet(struct acpi_hpet_descriptor* hpet) {
 
     return ZX_OK;
 }
+
+// Proximity domains are arbitrary 32 bit numbers. They become pmm NUMA nodes
+// in the order they first show up in the SRAT.
+static uint32_t numa_domains[PMM_MAX_NUMA_NODES];
+static uint numa_domain_count;
+
+#define NUMA_MAX_APICS 256
+static struct {
+    uint32_t apic_id;
+    uint node;
+} numa_apics[NUMA_MAX_APICS];
+static uint numa_apic_count;
+
+static bool numa_domain_to_node(uint32_t domain, bool add, uint* node) {
+    for (uint i = 0; i < numa_domain_count; i++) {
+        if (numa_domains[i] == domain) {
+            *node = i;
+            return true;
+        }
+    }
+    if (!add || numa_domain_count == PMM_MAX_NUMA_NODES) {
+        return false;
+    }
+    numa_domains[numa_domain_count] = domain;
+    *node = numa_domain_count++;
+    return true;
+}
+
+static void numa_add_apic(uint32_t apic_id, uint32_t domain) {
+    uint node;
+    if (numa_apic_count == NUMA_MAX_APICS || !numa_domain_to_node(domain, true, &node)) {
+        TRACEF("dropping NUMA affinity of apic id %#x\n", apic_id);
+        return;
+    }
+    numa_apics[numa_apic_count].apic_id = apic_id;
+    numa_apics[numa_apic_count].node = node;
+    numa_apic_count++;
+}
+
+/* @brief Describe the NUMA layout to the pmm from the SRAT and SLIT
+ *
+ * Does nothing if there is no SRAT or it only describes one proximity domain.
+ */
+void platform_init_numa(void) {
+    ACPI_TABLE_HEADER* table = NULL;
+    if (AcpiGetTable((char*)ACPI_SIG_SRAT, 1, &table) != AE_OK) {
+        LTRACEF("no SRAT\n");
+        return;
+    }
+
+    uintptr_t records_start = ((uintptr_t)table) + sizeof(ACPI_TABLE_SRAT);
+    uintptr_t records_end = ((uintptr_t)table) + table->Length;
+    const ACPI_SUBTABLE_HEADER* record_hdr;
+
+    // The cpus first, since they are listed in processor order, so that the
+    // boot processor's domain is node 0.
+    for (uintptr_t addr = records_start; addr + sizeof(*record_hdr) <= records_end;
+         addr += record_hdr->Length) {
+        record_hdr = (const ACPI_SUBTABLE_HEADER*)addr;
+        if (record_hdr->Length == 0 || addr + record_hdr->Length > records_end) {
+            TRACEF("malformed SRAT\n");
+            return;
+        }
+        switch (record_hdr->Type) {
+        case ACPI_SRAT_TYPE_CPU_AFFINITY: {
+            const ACPI_SRAT_CPU_AFFINITY* cpu = (const ACPI_SRAT_CPU_AFFINITY*)record_hdr;
+            if (!(cpu->Flags & ACPI_SRAT_CPU_ENABLED)) {
+                continue;
+            }
+            uint32_t domain = cpu->ProximityDomainLo |
+                              ((uint32_t)cpu->ProximityDomainHi[0] << 8) |
+                              ((uint32_t)cpu->ProximityDomainHi[1] << 16) |
+                              ((uint32_t)cpu->ProximityDomainHi[2] << 24);
+            numa_add_apic(cpu->ApicId, domain);
+            break;
+        }
+        case ACPI_SRAT_TYPE_X2APIC_CPU_AFFINITY: {
+            const ACPI_SRAT_X2APIC_CPU_AFFINITY* cpu =
+                (const ACPI_SRAT_X2APIC_CPU_AFFINITY*)record_hdr;
+            if (!(cpu->Flags & ACPI_SRAT_CPU_ENABLED)) {
+                continue;
+            }
+            numa_add_apic(cpu->ApicId, cpu->ProximityDomain);
+            break;
+        }
+        }
+    }
+
+    for (uintptr_t addr = records_start; addr + sizeof(*record_hdr) <= records_end;
+         addr += record_hdr->Length) {
+        record_hdr = (const ACPI_SUBTABLE_HEADER*)addr;
+        if (record_hdr->Type != ACPI_SRAT_TYPE_MEMORY_AFFINITY) {
+            continue;
+        }
+        const ACPI_SRAT_MEM_AFFINITY* mem = (const ACPI_SRAT_MEM_AFFINITY*)record_hdr;
+        uint node;
+        if (!(mem->Flags & ACPI_SRAT_MEM_ENABLED) ||
+            !numa_domain_to_node(mem->ProximityDomain, true, &node)) {
+            continue;
+        }
+        LTRACEF("memory [%#" PRIx64 ", %#" PRIx64 ") on node %u\n",
+                mem->BaseAddress, mem->BaseAddress + mem->Length, node);
+        // Arenas start out on node 0.
+        if (node != 0) {
+            pmm_numa_set_range_node(mem->BaseAddress, mem->Length, node);
+        }
+    }
+
+    if (numa_domain_count <= 1) {
+        return;
+    }
+    dprintf(INFO, "NUMA: %u nodes\n", numa_domain_count);
+
+    if (AcpiGetTable((char*)ACPI_SIG_SLIT, 1, &table) != AE_OK) {
+        LTRACEF("no SLIT\n");
+        return;
+    }
+    const ACPI_TABLE_SLIT* slit = (const ACPI_TABLE_SLIT*)table;
+    uint64_t count = slit->LocalityCount;
+    if (count > UINT32_MAX ||
+        sizeof(ACPI_TABLE_SLIT) - 1 + count * count > slit->Header.Length) {
+        TRACEF("malformed SLIT\n");
+        return;
+    }
+    for (uint32_t from = 0; from < count; from++) {
+        for (uint32_t to = 0; to < count; to++) {
+            uint from_node, to_node;
+            if (numa_domain_to_node(from, false, &from_node) &&
+                numa_domain_to_node(to, false, &to_node)) {
+                pmm_numa_set_distance(from_node, to_node, slit->Entry[from * count + to]);
+            }
+        }
+    }
+}
+
+/* @brief Return the pmm NUMA node of the cpu with the given APIC id, 0 if unknown */
+uint platform_numa_node_for_apic(uint32_t apic_id) {
+    for (uint i = 0; i < numa_apic_count; i++) {
+        if (numa_apics[i].apic_id == apic_id) {
+            return numa_apics[i].node;
+        }
+    }
+    return 0;
+}
@@ -11,7 +11,9 @@
 #include <kernel/cmdline.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
+#include <kernel/spinlock.h>
 #include <lib/cbuf.h>
+#include <lib/counters.h>
 #include <lk/init.h>
 #include <platform.h>
 #include <platform/console.h>
@@ -35,6 +37,18 @@ static uint32_t uart_irq = ISA_IRQ_SERIAL1;
 cbuf_t console_input_buf;
 static bool output_enabled = false;
 
+// Once the irq is set up, output goes through uart_tx_buf, and the transmit
+// holding register empty interrupt is enabled while there's anything in it.
+// uart_tx_lock also guards the interrupt enable register and its shadow.
+static constexpr size_t kTxBufSize = 8192;
+static cbuf_t uart_tx_buf;
+static bool uart_tx_buffered = false;
+static spin_lock_t uart_tx_lock = SPIN_LOCK_INITIAL_VALUE;
+static uint8_t uart_ier = 0;
+static int uart_fifo_depth = 1;
+
+KCOUNTER(uart_tx_dropped, "kernel.uart.tx_dropped");
+
 static uint8_t uart_read(uint8_t reg) {
     if (uart_mem_addr) {
         return (uint8_t)readl(uart_mem_addr + 4 * reg);
@@ -60,8 +74,37 @@ static void platform_drain_debug_uart_rx(void) {
     }
 }
 
+static void uart_set_ier(uint8_t ier) {
+    if (ier != uart_ier) {
+        uart_ier = ier;
+        uart_write(1, ier);
+    }
+}
+
+// Moves what fits from uart_tx_buf to the fifo. Called with uart_tx_lock held.
+static void uart_tx_pump(void) {
+    // The transmit holding register empty bit means the whole fifo is empty.
+    if (uart_read(5) & (1 << 5)) {
+        for (int i = 0; i < uart_fifo_depth; i++) {
+            char c;
+            if (cbuf_read_char(&uart_tx_buf, &c, false) == 0) {
+                uart_set_ier(static_cast<uint8_t>(uart_ier & ~0x2));
+                return;
+            }
+            uart_write(0, c);
+        }
+    }
+    uart_set_ier(uart_ier | 0x2); // enable transmit holding register empty interrupt
+}
+
 static enum handler_return uart_irq_handler(void* arg) {
     platform_drain_debug_uart_rx();
+
+    spin_lock(&uart_tx_lock);
+    if (uart_ier & 0x2)
+        uart_tx_pump();
+    spin_unlock(&uart_tx_lock);
+
     return INT_NO_RESCHEDULE;
 }
 
@@ -97,6 +140,9 @@ static void init_uart(void) {
     uart_write(1, static_cast<uint8_t>(divisor >> 8)); // msb
     uart_write(3, 3);                                  // 8N1
     uart_write(2, 0xc7);                               // enable FIFO, clear, 14-byte threshold
+
+    // a 16550A reports a working FIFO, older parts only hold a byte at a time
+    uart_fifo_depth = ((uart_read(2) & 0xc0) == 0xc0) ? 16 : 1;
 }
 
 void pc_init_debug_early(void) {
@@ -129,7 +175,13 @@ void pc_init_debug(void) {
         DEBUG_ASSERT(status == ZX_OK);
         unmask_interrupt(uart_irq);
 
-        uart_write(1, 0x1); // enable receive data available interrupt
+        cbuf_initialize(&uart_tx_buf, kTxBufSize);
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&uart_tx_lock, state);
+        uart_set_ier(0x1); // enable receive data available interrupt
+        uart_tx_buffered = true;
+        spin_unlock_irqrestore(&uart_tx_lock, state);
 
         // modem control register: Axiliary Output 2 is another IRQ enable bit
         const uint8_t mcr = uart_read(4);
@@ -143,9 +195,29 @@ void pc_suspend_debug(void) {
 
 void pc_resume_debug(void) {
     init_uart();
+    // init_uart() masked every interrupt, put back the ones we had
+    uart_write(1, uart_ier);
     output_enabled = true;
 }
 
+void pc_panic_debug(void) {
+    // The irq may never be taken again, so write out whatever is buffered and
+    // stop buffering. The lock isn't taken, since a cpu halted by the panic
+    // may be holding it.
+    if (!uart_tx_buffered)
+        return;
+    uart_tx_buffered = false;
+    uart_set_ier(static_cast<uint8_t>(uart_ier & ~0x2));
+
+    char c;
+    while (output_enabled && cbuf_read_char(&uart_tx_buf, &c, false) == 1) {
+        while ((uart_read(5) & (1 << 6)) == 0) {
+            arch_spinloop_pause();
+        }
+        uart_write(0, c);
+    }
+}
+
 static void debug_uart_putc(char c) {
 #if WITH_LEGACY_PC_CONSOLE
     cputc(c);
@@ -153,10 +225,22 @@ static void debug_uart_putc(char c) {
     if (unlikely(!output_enabled))
         return;
 
-    while ((uart_read(5) & (1 << 6)) == 0) {
-        arch_spinloop_pause();
+    if (!uart_tx_buffered) {
+        while ((uart_read(5) & (1 << 6)) == 0) {
+            arch_spinloop_pause();
+        }
+        uart_write(0, c);
+        return;
     }
-    uart_write(0, c);
+
+    // Queue the character behind anything already waiting, and never wait for
+    // the fifo to drain.
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&uart_tx_lock, state);
+    if (cbuf_write_char_nosignal(&uart_tx_buf, c) == 0)
+        kcounter_add(uart_tx_dropped, 1u);
+    uart_tx_pump();
+    spin_unlock_irqrestore(&uart_tx_lock, state);
 }
 
 void platform_dputs(const char* str, size_t len) {
@@ -10,6 +10,7 @@
 #include <arch/x86.h>
 #include <arch/x86/apic.h>
 #include <arch/x86/interrupts.h>
+#include <arch/x86/mp.h>
 #include <assert.h>
 #include <debug.h>
 #include <dev/interrupt.h>
@@ -49,6 +50,19 @@ static SpinLock lock;
 static struct int_handler_struct int_handler_table[X86_INT_COUNT];
 static p2ra_state_t x86_irq_vector_allocator;
 
+// Interrupts are delivered in physical destination mode, which names the
+// target by its local APIC id.
+static zx_status_t cpu_to_apic_id(cpu_num_t cpu, uint8_t* apic_id) {
+    if (cpu >= x86_num_cpus || !mp_is_cpu_online(cpu))
+        return ZX_ERR_INVALID_ARGS;
+
+    uint32_t id = (cpu == 0) ? bp_percpu.apic_id : ap_percpus[cpu - 1].apic_id;
+    if (id > 0xff)
+        return ZX_ERR_NOT_SUPPORTED;
+    *apic_id = static_cast<uint8_t>(id);
+    return ZX_OK;
+}
+
 static void platform_init_apic(uint level) {
     pic_map(PIC1_BASE, PIC2_BASE);
     pic_disable();
@@ -157,6 +171,20 @@ zx_status_t configure_interrupt(unsigned int vector,
     return ZX_OK;
 }
 
+zx_status_t set_interrupt_affinity(unsigned int vector, cpu_num_t cpu) {
+    if (!is_valid_interrupt(vector, 0))
+        return ZX_ERR_INVALID_ARGS;
+
+    uint8_t apic_id;
+    zx_status_t status = cpu_to_apic_id(cpu, &apic_id);
+    if (status != ZX_OK)
+        return status;
+
+    AutoSpinLockIrqSave guard(&lock);
+    apic_io_configure_irq_dst(vector, DST_MODE_PHYSICAL, apic_id);
+    return ZX_OK;
+}
+
 zx_status_t get_interrupt_config(unsigned int vector,
                                  enum interrupt_trigger_mode* tm,
                                  enum interrupt_polarity* pol) {
@@ -266,6 +294,17 @@ void shutdown_interrupts(void) {
 }
 
 #ifdef WITH_DEV_PCIE
+// Compute the target address.
+// See section 10.11.1 of the Intel 64 and IA-32 Architectures Software
+// Developer's Manual Volume 3A.
+static uint32_t msi_target_addr(uint8_t apic_id) {
+    uint32_t tgt_addr = 0xFEE00000;              // base addr
+    tgt_addr |= ((uint32_t)apic_id) << 12;       // Dest ID
+    tgt_addr |= 0x08;                            // Redir hint == 1
+    tgt_addr &= ~0x04;                           // Dest Mode == Physical
+    return tgt_addr;
+}
+
 zx_status_t x86_alloc_msi_block(uint requested_irqs,
                                 bool can_target_64bit,
                                 bool is_msix,
@@ -285,19 +324,8 @@ zx_status_t x86_alloc_msi_block(uint requested_irqs,
 
     res = p2ra_allocate_range(&x86_irq_vector_allocator, alloc_size, &alloc_start);
     if (res == ZX_OK) {
-        // Compute the target address.
-        // See section 10.11.1 of the Intel 64 and IA-32 Architectures Software
-        // Developer's Manual Volume 3A.
-        //
-        // TODO(johngro) : don't just bind this block to the Local APIC of the
-        // processor which is active when calling alloc_msi_block.  Instead,
-        // there should either be a system policy (like, always send to any
-        // processor, or just processor 0, or something), or the decision of
-        // which CPUs to bind to should be left to the caller.
-        uint32_t tgt_addr = 0xFEE00000;              // base addr
-        tgt_addr |= ((uint32_t)apic_bsp_id()) << 12; // Dest ID == the BSP APIC ID
-        tgt_addr |= 0x08;                            // Redir hint == 1
-        tgt_addr &= ~0x04;                           // Dest Mode == Physical
+        // Start out on the BSP; see x86_retarget_msi_block.
+        uint32_t tgt_addr = msi_target_addr(apic_bsp_id());
 
         // Compute the target data.
         // See section 10.11.2 of the Intel 64 and IA-32 Architectures Software
@@ -322,6 +350,18 @@ zx_status_t x86_alloc_msi_block(uint requested_irqs,
     return res;
 }
 
+zx_status_t x86_retarget_msi_block(pcie_msi_block_t* block, cpu_num_t cpu) {
+    DEBUG_ASSERT(block && block->allocated);
+
+    uint8_t apic_id;
+    zx_status_t status = cpu_to_apic_id(cpu, &apic_id);
+    if (status != ZX_OK)
+        return status;
+
+    block->tgt_addr = msi_target_addr(apic_id);
+    return ZX_OK;
+}
+
 void x86_free_msi_block(pcie_msi_block_t* block) {
     DEBUG_ASSERT(block);
     DEBUG_ASSERT(block->allocated);
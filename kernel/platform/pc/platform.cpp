@@ -872,6 +872,10 @@ static void platform_init_smp(void) {
 
     x86_init_smp(apic_ids.get(), num_cpus);
 
+    for (uint i = 0; i < num_cpus; ++i) {
+        pmm_numa_set_cpu_node(i, platform_numa_node_for_apic(x86_cpu_num_to_apic_id(i)));
+    }
+
     // trim the boot cpu out of the apic id list before passing to the AP booting routine
     for (uint i = 0; i < num_cpus - 1; ++i) {
         if (apic_ids[i] == bsp_apic_id) {
@@ -897,6 +901,7 @@ void platform_init(void) {
     platform_init_keyboard(&console_input_buf);
 #endif
 
+    platform_init_numa();
     platform_init_smp();
 }
 
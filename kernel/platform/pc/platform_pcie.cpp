@@ -33,6 +33,10 @@ public:
         return x86_alloc_msi_block(requested_irqs, can_target_64bit, is_msix, out_block);
     }
 
+    zx_status_t RetargetMsiBlock(pcie_msi_block_t* block, cpu_num_t cpu) override {
+        return x86_retarget_msi_block(block, cpu);
+    }
+
     void FreeMsiBlock(pcie_msi_block_t* block) override {
         x86_free_msi_block(block);
     }
@@ -22,6 +22,8 @@
 #include <lib/debuglog.h>
 #endif
 
+#include "platform_p.h"
+
 static void reboot(void) {
     // Try legacy reboot path first
     pc_keyboard_reboot();
@@ -54,6 +56,7 @@ void platform_halt_cpu(void) {
 
 void platform_panic_start(void) {
     arch_disable_ints();
+    pc_panic_debug();
 
     if (atomic_swap(&panic_started, 1) == 0) {
 #if WITH_LIB_DEBUGLOG
@@ -14,6 +14,9 @@
 #include <object/handle.h>
 #include <object/message_packet.h>
 #include <object/process_dispatcher.h>
+#include <vm/vm_address_region.h>
+#include <vm/vm_aspace.h>
+#include <vm/vm_object_paged.h>
 #include <zircon/syscalls/policy.h>
 #include <zircon/types.h>
 
@@ -74,6 +77,120 @@ static void msg_get_handles(ProcessDispatcher* up, MessagePacket* msg,
     }
 }
 
+// Finds the vmo behind a page aligned user range that lies within a single
+// mapping with at least |mmu_flags|, so pages can be moved in or out of it.
+static bool user_range_to_vmo(ProcessDispatcher* up, vaddr_t addr, size_t len, uint mmu_flags,
+                              fbl::RefPtr<VmObject>* vmo, uint64_t* offset) {
+    auto region = up->aspace()->FindRegion(addr);
+    if (!region)
+        return false;
+    auto mapping = region->as_vm_mapping();
+    if (!mapping)
+        return false;
+
+    if (addr < mapping->base() || len > mapping->size() ||
+        addr - mapping->base() > mapping->size() - len)
+        return false;
+    if ((mapping->arch_mmu_flags() & mmu_flags) != mmu_flags)
+        return false;
+
+    *offset = addr - mapping->base() + mapping->object_offset();
+    *vmo = mapping->vmo();
+    return true;
+}
+
+// The pages of a ZX_CHANNEL_WRITE_LOAN payload, along with where in the
+// writer's address space they came from in case the write fails.
+struct LoanedPayload {
+    fbl::RefPtr<VmObject> pages;
+    fbl::RefPtr<VmObject> source;
+    uint64_t source_offset = 0;
+};
+
+// Moves a large, page aligned payload out of the writer's buffer into a vmo
+// of its own. Returns ZX_ERR_NEXT if the payload has to be copied instead.
+static zx_status_t msg_take_payload(ProcessDispatcher* up, user_in_ptr<const void> bytes,
+                                    uint32_t num_bytes, LoanedPayload* loan) {
+    const vaddr_t addr = reinterpret_cast<vaddr_t>(bytes.get());
+    if (num_bytes < kMinLoanedMessageSize || !IS_PAGE_ALIGNED(addr) ||
+        !IS_PAGE_ALIGNED(num_bytes))
+        return ZX_ERR_NEXT;
+
+    const uint kFlags = ARCH_MMU_FLAG_PERM_USER | ARCH_MMU_FLAG_PERM_READ |
+                        ARCH_MMU_FLAG_PERM_WRITE;
+    if (!user_range_to_vmo(up, addr, num_bytes, kFlags, &loan->source, &loan->source_offset))
+        return ZX_ERR_NEXT;
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, num_bytes, &vmo);
+    if (status != ZX_OK)
+        return status;
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    if (loan->source->TakePages(loan->source_offset, num_bytes, &pages) != ZX_OK)
+        return ZX_ERR_NEXT;
+    status = vmo->SupplyPages(0, num_bytes, &pages);
+    if (status != ZX_OK) {
+        // out of memory for the page list of the new vmo. the pages are the
+        // writer's data, so they can't be quietly replaced with a copy.
+        pmm_free(&pages);
+        return status;
+    }
+    loan->pages = fbl::move(vmo);
+    return ZX_OK;
+}
+
+// Puts the pages of a payload that never made it into the channel back into
+// the writer's buffer.
+static void msg_return_payload(LoanedPayload* loan, uint32_t num_bytes) {
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    if (loan->pages->TakePages(0, num_bytes, &pages) == ZX_OK)
+        loan->source->SupplyPages(loan->source_offset, num_bytes, &pages);
+    pmm_free(&pages);
+}
+
+// Hands the pages of a loaned payload to the reader if its buffer is page
+// aligned and writable, rather than copying them. Returns ZX_ERR_NEXT if
+// the payload has to be copied instead.
+static zx_status_t msg_give_payload(ProcessDispatcher* up, MessagePacket* msg,
+                                    user_out_ptr<void> bytes) {
+    VmObject* loaned = msg->loaned_pages();
+    const vaddr_t addr = reinterpret_cast<vaddr_t>(bytes.get());
+    if (!loaned || !IS_PAGE_ALIGNED(addr))
+        return ZX_ERR_NEXT;
+
+    const uint32_t len = msg->data_size();
+    const uint kFlags = ARCH_MMU_FLAG_PERM_USER | ARCH_MMU_FLAG_PERM_WRITE;
+    fbl::RefPtr<VmObject> dest;
+    uint64_t dest_offset;
+    if (!user_range_to_vmo(up, addr, len, kFlags, &dest, &dest_offset))
+        return ZX_ERR_NEXT;
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    if (loaned->TakePages(0, len, &pages) != ZX_OK)
+        return ZX_ERR_NEXT;
+    zx_status_t status = dest->SupplyPages(dest_offset, len, &pages);
+    if (status == ZX_OK)
+        return ZX_OK;
+
+    // nothing was placed unless the reader's vmo ran out of memory part way,
+    // in which case the rest of the payload is gone
+    if (list_length(&pages) == len / PAGE_SIZE &&
+        loaned->SupplyPages(0, len, &pages) == ZX_OK)
+        return ZX_ERR_NEXT;
+    pmm_free(&pages);
+    return status;
+}
+
+// Copies or moves the payload of |msg| to the reader's buffer.
+static zx_status_t msg_get_payload(ProcessDispatcher* up, MessagePacket* msg,
+                                   user_out_ptr<void> bytes) {
+    zx_status_t status = msg_give_payload(up, msg, bytes);
+    if (status != ZX_ERR_NEXT)
+        return status;
+    return msg->CopyDataTo(bytes) == ZX_OK ? ZX_OK : ZX_ERR_INVALID_ARGS;
+}
+
 zx_status_t sys_channel_read(zx_handle_t handle_value, uint32_t options,
                              user_out_ptr<void> bytes, user_out_ptr<zx_handle_t> handles,
                              uint32_t num_bytes, uint32_t num_handles,
@@ -115,8 +232,9 @@ zx_status_t sys_channel_read(zx_handle_t handle_value, uint32_t options,
         return result;
 
     if (num_bytes > 0u) {
-        if (msg->CopyDataTo(bytes) != ZX_OK)
-            return ZX_ERR_INVALID_ARGS;
+        result = msg_get_payload(up, msg.get(), bytes);
+        if (result != ZX_OK)
+            return result;
     }
 
     // The documented public API states that that writing to the handles buffer
@@ -129,6 +247,68 @@ zx_status_t sys_channel_read(zx_handle_t handle_value, uint32_t options,
     return result;
 }
 
+zx_status_t sys_channel_read_many(zx_handle_t handle_value, uint32_t options,
+                                  user_inout_ptr<zx_channel_msg_t> user_msgs, uint32_t num_msgs,
+                                  user_out_ptr<uint32_t> actual_msgs) {
+    LTRACEF("handle %x msgs %p num_msgs %u\n", handle_value, user_msgs.get(), num_msgs);
+
+    if (options)
+        return ZX_ERR_NOT_SUPPORTED;
+    if (num_msgs == 0u || num_msgs > kMaxBatchMessages)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    zx_channel_msg_t descs[kMaxBatchMessages];
+    if (user_msgs.copy_array_from_user(descs, num_msgs) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<ChannelDispatcher> channel;
+    zx_status_t result = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_READ, &channel);
+    if (result != ZX_OK)
+        return result;
+
+    ChannelDispatcher::MessageList msgs;
+    uint32_t count = 0;
+    result = channel->ReadMany(descs, num_msgs, &msgs, &count);
+    if (result == ZX_ERR_BUFFER_TOO_SMALL) {
+        // report the size of the message that didn't fit, as zx_channel_read does
+        zx_status_t status = user_msgs.copy_array_to_user(descs, 1);
+        return status != ZX_OK ? status : result;
+    }
+    if (result != ZX_OK)
+        return result;
+
+    zx_status_t status = user_msgs.copy_array_to_user(descs, count);
+    if (status != ZX_OK)
+        return status;
+    if (actual_msgs) {
+        status = actual_msgs.copy_to_user(count);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    uint32_t total_bytes = 0;
+    uint32_t total_handles = 0;
+    for (uint32_t i = 0; !msgs.is_empty(); i++) {
+        auto msg = msgs.pop_front();
+        total_bytes += descs[i].num_bytes;
+        total_handles += descs[i].num_handles;
+        if (descs[i].num_bytes > 0u) {
+            status = msg_get_payload(up, msg.get(), make_user_out_ptr(descs[i].bytes));
+            if (status != ZX_OK)
+                return status;
+        }
+        if (descs[i].num_handles > 0u) {
+            msg_get_handles(up, msg.get(), make_user_out_ptr(descs[i].handles),
+                            descs[i].num_handles);
+        }
+    }
+
+    ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), total_bytes, total_handles, 0);
+    return ZX_OK;
+}
+
 static zx_status_t channel_read_out(ProcessDispatcher* up,
                                     fbl::unique_ptr<MessagePacket> reply,
                                     zx_channel_call_args_t* args,
@@ -149,9 +329,9 @@ static zx_status_t channel_read_out(ProcessDispatcher* up,
         return status;
 
     if (num_bytes > 0u) {
-        if (reply->CopyDataTo(make_user_out_ptr(args->rd_bytes)) != ZX_OK) {
-            return ZX_ERR_INVALID_ARGS;
-        }
+        status = msg_get_payload(up, reply.get(), make_user_out_ptr(args->rd_bytes));
+        if (status != ZX_OK)
+            return status;
     }
 
     if (num_handles > 0u) {
@@ -242,7 +422,7 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
     LTRACEF("handle %x bytes %p num_bytes %u handles %p num_handles %u options 0x%x\n",
             handle_value, user_bytes.get(), num_bytes, user_handles.get(), num_handles, options);
 
-    if (options)
+    if (options & ~ZX_CHANNEL_WRITE_LOAN)
         return ZX_ERR_INVALID_ARGS;
 
     auto up = ProcessDispatcher::GetCurrent();
@@ -252,27 +432,50 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
     if (result != ZX_OK)
         return result;
 
+    LoanedPayload loan;
+    if (options & ZX_CHANNEL_WRITE_LOAN) {
+        result = msg_take_payload(up, user_bytes, num_bytes, &loan);
+        if (result != ZX_OK && result != ZX_ERR_NEXT)
+            return result;
+    }
 
     fbl::unique_ptr<MessagePacket> msg;
-    result = MessagePacket::Create(user_bytes, num_bytes, num_handles, &msg);
-    if (result != ZX_OK)
-        return result;
+    if (loan.pages) {
+        result = MessagePacket::Create(loan.pages, num_bytes, num_handles, &msg);
+        if (result != ZX_OK) {
+            msg_return_payload(&loan, num_bytes);
+            return result;
+        }
+    } else {
+        result = MessagePacket::Create(user_bytes, num_bytes, num_handles, &msg);
+        if (result != ZX_OK)
+            return result;
+    }
 
     zx_handle_t handles[kMaxMessageHandles];
     if (num_handles > 0u) {
         result = msg_put_handles(up, msg.get(), handles, user_handles, num_handles,
                                  static_cast<Dispatcher*>(channel.get()));
-        if (result)
+        if (result) {
+            if (loan.pages)
+                msg_return_payload(&loan, num_bytes);
             return result;
+        }
     }
 
+    // Write() consumes the packet even when it fails, but |loan| still holds
+    // on to the pages of a loaned payload so they can be given back.
     result = channel->Write(fbl::move(msg));
     if (result != ZX_OK) {
         // Write failed, put back the handles into this process.
-        AutoLock lock(up->handle_table_lock());
-        for (size_t ix = 0; ix != num_handles; ++ix) {
-            up->UndoRemoveHandleLocked(handles[ix]);
+        {
+            AutoLock lock(up->handle_table_lock());
+            for (size_t ix = 0; ix != num_handles; ++ix) {
+                up->UndoRemoveHandleLocked(handles[ix]);
+            }
         }
+        if (loan.pages)
+            msg_return_payload(&loan, num_bytes);
         return result;
     }
 
@@ -280,6 +483,75 @@ zx_status_t sys_channel_write(zx_handle_t handle_value, uint32_t options,
     return ZX_OK;
 }
 
+// Puts the handles attached to messages that were never written back into
+// this process.
+static void msg_return_handles(ProcessDispatcher* up, ChannelDispatcher::MessageList* msgs) {
+    AutoLock lock(up->handle_table_lock());
+    for (auto& msg : *msgs) {
+        for (uint32_t ix = 0; ix != msg.num_handles(); ++ix)
+            up->AddHandleLocked(HandleOwner(msg.mutable_handles()[ix]));
+        msg.set_owns_handles(false);
+    }
+}
+
+zx_status_t sys_channel_write_many(zx_handle_t handle_value, uint32_t options,
+                                   user_in_ptr<const zx_channel_msg_t> user_msgs,
+                                   uint32_t num_msgs) {
+    LTRACEF("handle %x msgs %p num_msgs %u\n", handle_value, user_msgs.get(), num_msgs);
+
+    if (options)
+        return ZX_ERR_INVALID_ARGS;
+    if (num_msgs == 0u || num_msgs > kMaxBatchMessages)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    zx_channel_msg_t descs[kMaxBatchMessages];
+    if (user_msgs.copy_array_from_user(descs, num_msgs) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<ChannelDispatcher> channel;
+    zx_status_t result = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_WRITE, &channel);
+    if (result != ZX_OK)
+        return result;
+
+    // Build every packet before writing any of them, so the batch is either
+    // written whole or not at all.
+    ChannelDispatcher::MessageList msgs;
+    zx_handle_t handles[kMaxMessageHandles];
+    uint32_t total_bytes = 0;
+    uint32_t total_handles = 0;
+    for (uint32_t i = 0; i < num_msgs; i++) {
+        fbl::unique_ptr<MessagePacket> msg;
+        result = MessagePacket::Create(make_user_in_ptr<const void>(descs[i].bytes),
+                                       descs[i].num_bytes, descs[i].num_handles, &msg);
+        if (result != ZX_OK)
+            break;
+
+        if (descs[i].num_handles > 0u) {
+            result = msg_put_handles(up, msg.get(), handles,
+                                     make_user_in_ptr<const zx_handle_t>(descs[i].handles),
+                                     descs[i].num_handles,
+                                     static_cast<Dispatcher*>(channel.get()));
+            if (result != ZX_OK)
+                break;
+        }
+        msgs.push_back(fbl::move(msg));
+        total_bytes += descs[i].num_bytes;
+        total_handles += descs[i].num_handles;
+    }
+
+    if (result == ZX_OK)
+        result = channel->WriteMany(&msgs);
+    if (result != ZX_OK) {
+        msg_return_handles(up, &msgs);
+        return result;
+    }
+
+    ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), total_bytes, total_handles, 0);
+    return ZX_OK;
+}
+
 zx_status_t sys_channel_call_noretry(zx_handle_t handle_value, uint32_t options,
                                      zx_time_t deadline,
                                      user_in_ptr<const zx_channel_call_args_t> user_args,
@@ -12,6 +12,7 @@
 #include <string.h>
 #include <trace.h>
 
+#include <arch/ops.h>
 #include <dev/interrupt.h>
 #include <dev/udisplay.h>
 #include <vm/vm.h>
@@ -22,6 +23,7 @@
 #include <object/interrupt_dispatcher.h>
 #include <object/interrupt_event_dispatcher.h>
 #include <object/iommu_dispatcher.h>
+#include <object/port_dispatcher.h>
 #include <object/process_dispatcher.h>
 #include <object/resources.h>
 #include <object/vm_object_dispatcher.h>
@@ -136,6 +138,54 @@ zx_status_t sys_interrupt_signal(zx_handle_t handle, uint32_t slot, zx_time_t ti
     return interrupt->UserSignal(slot, timestamp);
 }
 
+zx_status_t sys_interrupt_set_affinity(zx_handle_t handle, uint32_t slot, uint32_t cpu) {
+    LTRACEF("handle %x slot %u cpu %u\n", handle, slot, cpu);
+
+    if (cpu >= arch_max_num_cpus())
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<InterruptDispatcher> interrupt;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_WRITE, &interrupt);
+    if (status != ZX_OK)
+        return status;
+
+    return interrupt->SetAffinity(slot, cpu);
+}
+
+zx_status_t sys_interrupt_bind_port(zx_handle_t handle, zx_handle_t port_handle, uint64_t key,
+                                    uint32_t options) {
+    LTRACEF("handle %x port %x\n", handle, port_handle);
+
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<InterruptDispatcher> interrupt;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &interrupt);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<PortDispatcher> port;
+    status = up->GetDispatcherWithRights(port_handle, ZX_RIGHT_WRITE, &port);
+    if (status != ZX_OK)
+        return status;
+
+    return interrupt->BindPort(fbl::move(port), key);
+}
+
+zx_status_t sys_interrupt_ack(zx_handle_t handle) {
+    LTRACEF("handle %x\n", handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<InterruptDispatcher> interrupt;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &interrupt);
+    if (status != ZX_OK)
+        return status;
+
+    return interrupt->Ack();
+}
+
 zx_status_t sys_vmo_create_contiguous(zx_handle_t hrsrc, size_t size,
                                       uint32_t alignment_log2,
                                       user_out_handle* out) {
@@ -379,6 +379,50 @@ zx_status_t sys_pci_config_read(zx_handle_t handle, uint16_t offset, size_t widt
     return ZX_ERR_INVALID_ARGS;
 }
 
+zx_status_t sys_pci_config_read_bulk(zx_handle_t handle, uint16_t offset,
+                                     user_out_ptr<void> buffer, size_t len) {
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<PciDeviceDispatcher> pci_device;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &pci_device);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    auto device = pci_device->device();
+    size_t cfg_size = device->is_pcie() ? PCIE_EXTENDED_CONFIG_SIZE : PCIE_BASE_CONFIG_SIZE;
+    if (!buffer || len > cfg_size || offset > cfg_size - len) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    // Read the range with the widest aligned accesses it allows, so that a
+    // whole header costs one syscall and a few dozen config cycles.
+    auto config = device->config();
+    uint8_t chunk[256];
+    for (size_t done = 0; done < len;) {
+        size_t n = fbl::min(len - done, sizeof(chunk));
+        for (size_t i = 0; i < n;) {
+            uint16_t addr = static_cast<uint16_t>(offset + done + i);
+            if (!(addr & 0x3) && n - i >= sizeof(uint32_t)) {
+                uint32_t val = config->Read(PciReg32(addr));
+                memcpy(&chunk[i], &val, sizeof(val));
+                i += sizeof(val);
+            } else if (!(addr & 0x1) && n - i >= sizeof(uint16_t)) {
+                uint16_t val = config->Read(PciReg16(addr));
+                memcpy(&chunk[i], &val, sizeof(val));
+                i += sizeof(val);
+            } else {
+                chunk[i++] = config->Read(PciReg8(addr));
+            }
+        }
+        status = buffer.byte_offset(done).copy_array_to_user(chunk, n);
+        if (status != ZX_OK) {
+            return status;
+        }
+        done += n;
+    }
+    return ZX_OK;
+}
+
 zx_status_t sys_pci_config_write(zx_handle_t handle, uint16_t offset, size_t width, uint32_t val) {
     fbl::RefPtr<PciDeviceDispatcher> pci_device;
     fbl::RefPtr<Dispatcher> dispatcher;
@@ -478,6 +522,58 @@ zx_status_t sys_pci_reset_device(zx_handle_t dev_handle) {
     return pci_device->ResetDevice();
 }
 
+zx_status_t sys_pci_get_config_vmo(zx_handle_t dev_handle, user_out_ptr<uint32_t> out_size,
+                                   user_out_handle* out_handle) {
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<PciDeviceDispatcher> pci_device;
+    zx_status_t status = up->GetDispatcherWithRights(dev_handle, ZX_RIGHT_READ, &pci_device);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Only ECAM can be handed out; PIO config space has to go through the
+    // kernel.
+    auto dev = pci_device->device();
+    if (dev->config()->addr_space() != PciAddrSpace::MMIO) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    fbl::RefPtr<VmObject> vmo;
+    status = VmObjectPhysical::Create(dev->config_phys(), PAGE_SIZE, &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+    status = vmo->SetMappingCachePolicy(ZX_CACHE_POLICY_UNCACHED_DEVICE);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "pci-%02x:%02x.%1x-config",
+             dev->bus_id(), dev->dev_id(), dev->func_id());
+    vmo->set_name(name, sizeof(name));
+
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    status = VmObjectDispatcher::Create(fbl::move(vmo), &dispatcher, &rights);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // The VMO is a whole page either way; tell the caller how much of it is
+    // the device's config space.
+    uint32_t cfg_size = dev->is_pcie() ? PCIE_EXTENDED_CONFIG_SIZE : PCIE_BASE_CONFIG_SIZE;
+    status = out_size.copy_to_user(cfg_size);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // The view is read-only: writes still go through zx_pci_config_write(),
+    // which keeps the standard header out of drivers' reach.
+    rights &= ~(ZX_RIGHT_WRITE | ZX_RIGHT_EXECUTE);
+    return out_handle->make(fbl::move(dispatcher), rights);
+}
+
 zx_status_t sys_pci_get_bar(zx_handle_t dev_handle,
                             uint32_t bar_num,
                             user_out_ptr<zx_pci_bar_t> out_bar,
@@ -656,6 +752,15 @@ zx_status_t sys_pci_config_write(zx_handle_t handle, uint16_t offset, size_t wid
     return ZX_ERR_NOT_SUPPORTED;
 }
 
+zx_status_t sys_pci_config_read_bulk(zx_handle_t handle, uint16_t offset,
+                                     user_out_ptr<void> buffer, size_t len) {
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
+zx_status_t sys_pci_get_config_vmo(zx_handle_t, user_out_ptr<uint32_t>, user_out_handle*) {
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
 zx_status_t sys_pci_cfg_pio_rw(zx_handle_t handle, uint8_t bus, uint8_t dev, uint8_t func,
                                uint8_t offset, user_inout_ptr<uint32_t> val, size_t width, bool write) {
     return ZX_ERR_NOT_SUPPORTED;
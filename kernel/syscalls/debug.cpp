@@ -128,6 +128,9 @@ zx_status_t sys_ktrace_control(
         name[sizeof(name) - 1] = 0;
         return ktrace_control(action, options, name);
     }
+    case KTRACE_ACTION_DRAIN:
+        // copied out directly, like ktrace_read
+        return ktrace_control(action, options, _ptr.get());
     default:
         return ktrace_control(action, options, nullptr);
     }
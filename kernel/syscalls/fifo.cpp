@@ -15,6 +15,7 @@
 #include <object/fifo_dispatcher.h>
 #include <object/handle.h>
 #include <object/process_dispatcher.h>
+#include <object/vm_object_dispatcher.h>
 
 #include <zircon/syscalls/policy.h>
 #include <fbl/ref_ptr.h>
@@ -84,3 +85,46 @@ zx_status_t sys_fifo_read(zx_handle_t handle, user_out_ptr<void> entries, size_t
 
     return ZX_OK;
 }
+
+// Ring vmos can be mapped and accessed, but are never executable.
+static zx_status_t make_ring_handle(fbl::RefPtr<VmObject> ring, user_out_handle* out) {
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    zx_status_t status = VmObjectDispatcher::Create(fbl::move(ring), &dispatcher, &rights);
+    if (status != ZX_OK)
+        return status;
+    return out->make(fbl::move(dispatcher), rights & ~ZX_RIGHT_EXECUTE);
+}
+
+zx_status_t sys_fifo_get_rings(zx_handle_t handle, user_out_handle* rx_out,
+                               user_out_handle* tx_out) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<FifoDispatcher> fifo;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ | ZX_RIGHT_WRITE,
+                                                     &fifo);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<VmObject> rx;
+    fbl::RefPtr<VmObject> tx;
+    status = fifo->GetRings(&rx, &tx);
+    if (status != ZX_OK)
+        return status;
+
+    status = make_ring_handle(fbl::move(rx), rx_out);
+    if (status == ZX_OK)
+        status = make_ring_handle(fbl::move(tx), tx_out);
+    return status;
+}
+
+zx_status_t sys_fifo_notify(zx_handle_t handle) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<FifoDispatcher> fifo;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_WRITE, &fifo);
+    if (status != ZX_OK)
+        return status;
+
+    return fifo->Notify();
+}
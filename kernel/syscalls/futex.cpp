@@ -7,6 +7,7 @@
 #include <trace.h>
 
 #include <object/process_dispatcher.h>
+#include <object/thread_dispatcher.h>
 #include <zircon/types.h>
 
 #include "priv.h"
@@ -20,6 +21,25 @@ zx_status_t sys_futex_wait(user_in_ptr<const zx_futex_t> value_ptr, int current_
         value_ptr, current_value, deadline);
 }
 
+zx_status_t sys_futex_wait_pi(user_in_ptr<const zx_futex_t> value_ptr, int current_value,
+                             zx_handle_t owner_handle, zx_time_t deadline) {
+    LTRACEF("futex %p current %d owner %x\n", value_ptr.get(), current_value, owner_handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<ThreadDispatcher> owner;
+    zx_status_t status = up->GetDispatcher(owner_handle, &owner);
+    if (status != ZX_OK)
+        return status;
+
+    // Futexes are private to a process, so the owner must be a different
+    // thread of the same one.
+    if (owner->process() != up || owner.get() == ThreadDispatcher::GetCurrent())
+        return ZX_ERR_INVALID_ARGS;
+
+    return up->futex_context()->FutexWaitPi(value_ptr, current_value, owner.get(), deadline);
+}
+
 zx_status_t sys_futex_wake(user_in_ptr<const zx_futex_t> value_ptr, uint32_t count) {
     LTRACEF("futex %p count %" PRIu32 "\n", value_ptr.get(), count);
 
@@ -37,3 +57,21 @@ zx_status_t sys_futex_requeue(user_in_ptr<const zx_futex_t> wake_ptr, uint32_t w
         wake_ptr, wake_count, current_value,
         requeue_ptr, requeue_count);
 }
+
+zx_status_t sys_futex_requeue_many(user_in_ptr<const uintptr_t> wake_ptrs, uint32_t count,
+                                   int current_value, uint32_t wake_count,
+                                   user_in_ptr<const zx_futex_t> requeue_ptr) {
+    LTRACEF("count %" PRIu32 " current_value %d wake_count %" PRIu32 " requeue_futex %p\n",
+            count, current_value, wake_count, requeue_ptr.get());
+
+    if (count == 0u || count > ZX_FUTEX_MAX_REQUEUE_MANY)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    uintptr_t wake_keys[ZX_FUTEX_MAX_REQUEUE_MANY];
+    zx_status_t status = wake_ptrs.copy_array_from_user(wake_keys, count);
+    if (status != ZX_OK)
+        return status;
+
+    return ProcessDispatcher::GetCurrent()->futex_context()->FutexRequeueMany(
+        wake_keys, count, current_value, wake_count, requeue_ptr);
+}
@@ -6,6 +6,7 @@
 
 #include <zircon/syscalls/hypervisor.h>
 
+#include <object/event_dispatcher.h>
 #include <object/guest_dispatcher.h>
 #include <object/handle.h>
 #include <object/port_dispatcher.h>
@@ -51,14 +52,28 @@ zx_status_t sys_guest_set_trap(zx_handle_t guest_handle, uint32_t kind, zx_vaddr
     if (status != ZX_OK)
         return status;
 
+    // Packets are delivered through a port, or an event is signaled in their
+    // place.
     fbl::RefPtr<PortDispatcher> port;
+    fbl::RefPtr<EventDispatcher> event;
     if (port_handle != ZX_HANDLE_INVALID) {
-        status = up->GetDispatcherWithRights(port_handle, ZX_RIGHT_WRITE, &port);
+        fbl::RefPtr<Dispatcher> dispatcher;
+        zx_rights_t rights;
+        status = up->GetDispatcherAndRights(port_handle, &dispatcher, &rights);
         if (status != ZX_OK)
             return status;
+        if ((port = DownCastDispatcher<PortDispatcher>(&dispatcher))) {
+            if ((rights & ZX_RIGHT_WRITE) == 0)
+                return ZX_ERR_ACCESS_DENIED;
+        } else if ((event = DownCastDispatcher<EventDispatcher>(&dispatcher))) {
+            if ((rights & ZX_RIGHT_SIGNAL) == 0)
+                return ZX_ERR_ACCESS_DENIED;
+        } else {
+            return ZX_ERR_WRONG_TYPE;
+        }
     }
 
-    return guest->SetTrap(kind, addr, len, fbl::move(port), key);
+    return guest->SetTrap(kind, addr, len, fbl::move(port), fbl::move(event), key);
 }
 
 zx_status_t sys_vcpu_create(zx_handle_t guest_handle, uint32_t options,
@@ -15,15 +15,20 @@
 #include <platform.h>
 #include <zircon/types.h>
 
+#include <object/channel_dispatcher.h>
 #include <object/diagnostics.h>
 #include <object/handle.h>
+#include <object/interrupt_dispatcher.h>
 #include <object/job_dispatcher.h>
+#include <object/object_cache.h>
 #include <object/process_dispatcher.h>
 #include <object/resource_dispatcher.h>
 #include <object/resources.h>
+#include <object/socket_dispatcher.h>
 #include <object/thread_dispatcher.h>
 #include <object/vm_address_region_dispatcher.h>
 
+#include <fbl/array.h>
 #include <fbl/ref_ptr.h>
 
 #include "priv.h"
@@ -78,6 +83,43 @@ private:
     size_t avail_ = 0;
 };
 
+// Gathers the stats of the threads of a job's descendant processes.
+class ThreadStatsJobEnumerator final : public JobEnumerator {
+public:
+    ThreadStatsJobEnumerator(user_out_ptr<zx_info_job_thread_t> ptr, size_t max)
+        : ptr_(ptr), max_(max) {}
+
+    size_t get_avail() const { return avail_; }
+    size_t get_count() const { return count_; }
+    zx_status_t get_status() const { return status_; }
+
+private:
+    bool OnProcess(ProcessDispatcher* proc) override {
+        fbl::Array<zx_info_job_thread_t> stats;
+        status_ = proc->GetThreadStats(&stats);
+        if (status_ != ZX_OK) {
+            return false;
+        }
+        avail_ += stats.size();
+        size_t num_to_copy = MIN(stats.size(), max_ - count_);
+        if (num_to_copy > 0) {
+            if (ptr_.copy_array_to_user(stats.get(), num_to_copy, count_) != ZX_OK) {
+                status_ = ZX_ERR_INVALID_ARGS;
+                return false;
+            }
+            count_ += num_to_copy;
+        }
+        return true;
+    }
+
+    const user_out_ptr<zx_info_job_thread_t> ptr_;
+    const size_t max_;
+
+    size_t count_ = 0;
+    size_t avail_ = 0;
+    zx_status_t status_ = ZX_OK;
+};
+
 zx_status_t single_record_result(user_out_ptr<void> _buffer, size_t buffer_size,
                                  user_out_ptr<size_t> _actual,
                                  user_out_ptr<size_t> _avail,
@@ -238,6 +280,32 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
             }
             return ZX_OK;
         }
+        case ZX_INFO_JOB_THREAD_STATS: {
+            fbl::RefPtr<JobDispatcher> job;
+            auto error = up->GetDispatcherWithRights(
+                handle, ZX_RIGHT_ENUMERATE | ZX_RIGHT_READ, &job);
+            if (error < 0)
+                return error;
+
+            // Like ZX_INFO_PROCESS_THREADS, this is a snapshot of each
+            // process in turn; threads may come and go during the walk.
+            size_t max = buffer_size / sizeof(zx_info_job_thread_t);
+            auto stats = _buffer.reinterpret<zx_info_job_thread_t>();
+            ThreadStatsJobEnumerator tje(stats, max);
+            if (!job->EnumerateChildren(&tje, /* recurse */ true))
+                return tje.get_status();
+            if (_actual) {
+                zx_status_t status = _actual.copy_to_user(tje.get_count());
+                if (status != ZX_OK)
+                    return status;
+            }
+            if (_avail) {
+                zx_status_t status = _avail.copy_to_user(tje.get_avail());
+                if (status != ZX_OK)
+                    return status;
+            }
+            return ZX_OK;
+        }
         case ZX_INFO_THREAD: {
             // TODO(ZX-458): Handle forward/backward compatibility issues
             // with changes to the struct.
@@ -513,6 +581,80 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
             return single_record_result(
                 _buffer, buffer_size, _actual, _avail, &stats, sizeof(stats));
         }
+        case ZX_INFO_KMEM_CACHES: {
+            auto status = validate_resource(handle, ZX_RSRC_KIND_ROOT);
+            if (status != ZX_OK)
+                return status;
+
+            size_t num_caches = ObjectCache::Count();
+            size_t num_to_copy = MIN(num_caches, buffer_size / sizeof(zx_info_kmem_cache_t));
+            user_out_ptr<zx_info_kmem_cache_t> cache_buf =
+                _buffer.reinterpret<zx_info_kmem_cache_t>();
+
+            for (size_t i = 0; i < num_to_copy; i++) {
+                zx_info_kmem_cache_t info;
+                ObjectCache::Get(i)->GetInfo(&info);
+                if (cache_buf.copy_array_to_user(&info, 1, i) != ZX_OK)
+                    return ZX_ERR_INVALID_ARGS;
+            }
+
+            if (_actual) {
+                zx_status_t status = _actual.copy_to_user(num_to_copy);
+                if (status != ZX_OK)
+                    return status;
+            }
+            if (_avail) {
+                zx_status_t status = _avail.copy_to_user(num_caches);
+                if (status != ZX_OK)
+                    return status;
+            }
+            return ZX_OK;
+        }
+        case ZX_INFO_KMEM_HEAP_SAMPLES: {
+            auto status = validate_resource(handle, ZX_RSRC_KIND_ROOT);
+            if (status != ZX_OK)
+                return status;
+
+            static_assert(ZX_INFO_KMEM_HEAP_SAMPLE_DEPTH == HEAP_PROFILE_DEPTH, "");
+
+            // take a snapshot, the samples can't be copied out under the
+            // heap's spinlock
+            size_t num_space_for = buffer_size / sizeof(zx_info_kmem_heap_sample_t);
+            size_t num_to_get = MIN(num_space_for, heap_profile_max_samples());
+            fbl::Array<heap_sample_t> samples;
+            if (num_to_get > 0) {
+                fbl::AllocChecker ac;
+                samples.reset(new (&ac) heap_sample_t[num_to_get], num_to_get);
+                if (!ac.check())
+                    return ZX_ERR_NO_MEMORY;
+            }
+            size_t num_samples = heap_profile_get_samples(samples.get(), num_to_get);
+            size_t num_to_copy = MIN(num_samples, num_to_get);
+
+            user_out_ptr<zx_info_kmem_heap_sample_t> sample_buf =
+                _buffer.reinterpret<zx_info_kmem_heap_sample_t>();
+            for (size_t i = 0; i < num_to_copy; i++) {
+                zx_info_kmem_heap_sample_t info = {};
+                info.size = samples[i].size;
+                info.weight = samples[i].weight;
+                for (size_t d = 0; d < HEAP_PROFILE_DEPTH; d++)
+                    info.pc[d] = reinterpret_cast<uintptr_t>(samples[i].pc[d]);
+                if (sample_buf.copy_array_to_user(&info, 1, i) != ZX_OK)
+                    return ZX_ERR_INVALID_ARGS;
+            }
+
+            if (_actual) {
+                zx_status_t status = _actual.copy_to_user(num_to_copy);
+                if (status != ZX_OK)
+                    return status;
+            }
+            if (_avail) {
+                zx_status_t status = _avail.copy_to_user(num_samples);
+                if (status != ZX_OK)
+                    return status;
+            }
+            return ZX_OK;
+        }
         case ZX_INFO_RESOURCE: {
             // grab a reference to the dispatcher
             fbl::RefPtr<ResourceDispatcher> resource;
@@ -541,6 +683,50 @@ zx_status_t sys_object_get_info(zx_handle_t handle, uint32_t topic,
             return single_record_result(
                 _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
         }
+        case ZX_INFO_CHANNEL: {
+            fbl::RefPtr<ChannelDispatcher> channel;
+            auto status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &channel);
+            if (status != ZX_OK)
+                return status;
+
+            zx_info_channel_t info = {};
+            channel->GetInfo(&info);
+
+            return single_record_result(
+                _buffer, buffer_size, _actual, _avail, &info, sizeof(info));
+        }
+        case ZX_INFO_INTERRUPT_SLOTS: {
+            fbl::RefPtr<InterruptDispatcher> interrupt;
+            auto status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &interrupt);
+            if (status != ZX_OK)
+                return status;
+
+            constexpr size_t kMaxSlots = ZX_INTERRUPT_MAX_SLOTS + 1;
+            fbl::AllocChecker ac;
+            fbl::Array<zx_info_interrupt_slot_t> slots(
+                new (&ac) zx_info_interrupt_slot_t[kMaxSlots], kMaxSlots);
+            if (!ac.check())
+                return ZX_ERR_NO_MEMORY;
+
+            size_t num_slots = interrupt->GetSlotInfo(slots.get(), kMaxSlots);
+            size_t num_to_copy = MIN(num_slots, buffer_size / sizeof(zx_info_interrupt_slot_t));
+
+            if (num_to_copy &&
+                _buffer.copy_array_to_user(slots.get(),
+                                           sizeof(zx_info_interrupt_slot_t) * num_to_copy) != ZX_OK)
+                return ZX_ERR_INVALID_ARGS;
+            if (_actual) {
+                zx_status_t status = _actual.copy_to_user(num_to_copy);
+                if (status != ZX_OK)
+                    return status;
+            }
+            if (_avail) {
+                zx_status_t status = _avail.copy_to_user(num_slots);
+                if (status != ZX_OK)
+                    return status;
+            }
+            return ZX_OK;
+        }
 
         default:
             return ZX_ERR_NOT_SUPPORTED;
@@ -619,6 +805,43 @@ zx_status_t sys_object_get_property(zx_handle_t handle_value, uint32_t property,
                 return status;
             return ZX_OK;
         }
+        case ZX_PROP_THREAD_SCHED_WEIGHT: {
+            if (size != sizeof(uint32_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return ZX_ERR_WRONG_TYPE;
+            uint32_t value = thread->sched_weight();
+            return _value.reinterpret<uint32_t>().copy_to_user(value);
+        }
+        case ZX_PROP_THREAD_SCHED_DEADLINE: {
+            if (size != sizeof(zx_sched_deadline_params_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return ZX_ERR_WRONG_TYPE;
+            zx_sched_deadline_params_t value;
+            thread->GetSchedDeadline(&value);
+            return _value.reinterpret<zx_sched_deadline_params_t>().copy_to_user(value);
+        }
+        case ZX_PROP_SOCKET_RX_CAPACITY: {
+            if (size != sizeof(size_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+            if (!socket)
+                return ZX_ERR_WRONG_TYPE;
+            size_t value = socket->GetReadCapacity();
+            return _value.reinterpret<size_t>().copy_to_user(value);
+        }
+        case ZX_PROP_INTERRUPT_POLL_WINDOW: {
+            if (size != sizeof(zx_duration_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto interrupt = DownCastDispatcher<InterruptDispatcher>(&dispatcher);
+            if (!interrupt)
+                return ZX_ERR_WRONG_TYPE;
+            zx_duration_t value = interrupt->get_poll_window();
+            return _value.reinterpret<zx_duration_t>().copy_to_user(value);
+        }
         default:
             return ZX_ERR_INVALID_ARGS;
     }
@@ -699,6 +922,55 @@ zx_status_t sys_object_set_property(zx_handle_t handle_value, uint32_t property,
             return job->set_importance(
                 static_cast<zx_job_importance_t>(value));
         }
+        case ZX_PROP_THREAD_SCHED_WEIGHT: {
+            if (size != sizeof(uint32_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return ZX_ERR_WRONG_TYPE;
+            uint32_t value = 0;
+            zx_status_t status = _value.reinterpret<const uint32_t>().copy_from_user(&value);
+            if (status != ZX_OK)
+                return status;
+            return thread->SetSchedWeight(value);
+        }
+        case ZX_PROP_THREAD_SCHED_DEADLINE: {
+            if (size != sizeof(zx_sched_deadline_params_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return ZX_ERR_WRONG_TYPE;
+            zx_sched_deadline_params_t value;
+            zx_status_t status = _value.reinterpret<const zx_sched_deadline_params_t>()
+                .copy_from_user(&value);
+            if (status != ZX_OK)
+                return status;
+            return thread->SetSchedDeadline(value);
+        }
+        case ZX_PROP_SOCKET_RX_CAPACITY: {
+            if (size != sizeof(size_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto socket = DownCastDispatcher<SocketDispatcher>(&dispatcher);
+            if (!socket)
+                return ZX_ERR_WRONG_TYPE;
+            size_t value = 0;
+            zx_status_t status = _value.reinterpret<const size_t>().copy_from_user(&value);
+            if (status != ZX_OK)
+                return status;
+            return socket->SetReadCapacity(value);
+        }
+        case ZX_PROP_INTERRUPT_POLL_WINDOW: {
+            if (size != sizeof(zx_duration_t))
+                return ZX_ERR_BUFFER_TOO_SMALL;
+            auto interrupt = DownCastDispatcher<InterruptDispatcher>(&dispatcher);
+            if (!interrupt)
+                return ZX_ERR_WRONG_TYPE;
+            zx_duration_t value = 0;
+            zx_status_t status = _value.reinterpret<const zx_duration_t>().copy_from_user(&value);
+            if (status != ZX_OK)
+                return status;
+            return interrupt->set_poll_window(value);
+        }
     }
 
     return ZX_ERR_INVALID_ARGS;
@@ -730,6 +1002,41 @@ zx_status_t sys_object_signal_peer(zx_handle_t handle_value, uint32_t clear_mask
     return dispatcher->user_signal(clear_mask, set_mask, true);
 }
 
+zx_status_t sys_object_signal_many(user_in_ptr<const zx_signal_item_t> user_items, uint32_t count) {
+    LTRACEF("count %u\n", count);
+
+    if (count == 0u || count > ZX_SIGNAL_MANY_MAX_ITEMS)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    zx_signal_item_t items[ZX_SIGNAL_MANY_MAX_ITEMS];
+    if (user_items.copy_array_from_user(items, count) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+
+    // Look up every handle before signaling anything, so that a bad handle
+    // leaves all of the objects alone.
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<Dispatcher> dispatchers[ZX_SIGNAL_MANY_MAX_ITEMS];
+    for (uint32_t i = 0; i < count; i++) {
+        if (items[i].options & ~ZX_SIGNAL_ITEM_PEER)
+            return ZX_ERR_INVALID_ARGS;
+        zx_rights_t rights = (items[i].options & ZX_SIGNAL_ITEM_PEER) ?
+            ZX_RIGHT_SIGNAL_PEER : ZX_RIGHT_SIGNAL;
+        auto status = up->GetDispatcherWithRights(items[i].handle, rights, &dispatchers[i]);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    // Apply them in order, and only reschedule once all of them are done.
+    Dispatcher::SignalBatch batch;
+    for (uint32_t i = 0; i < count; i++) {
+        auto status = dispatchers[i]->user_signal(items[i].clear_mask, items[i].set_mask,
+                                                  items[i].options & ZX_SIGNAL_ITEM_PEER);
+        if (status != ZX_OK)
+            return status;
+    }
+    return ZX_OK;
+}
+
 // Given a kernel object with children objects, obtain a handle to the
 // child specified by the provided kernel object id.
 //
@@ -42,6 +42,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/timer.cpp \
     $(LOCAL_DIR)/vmar.cpp \
     $(LOCAL_DIR)/vmo.cpp \
+    $(LOCAL_DIR)/wait_set.cpp \
 
 ifeq ($(ARCH),x86)
 MODULE_SRCS += $(LOCAL_DIR)/system_x86.cpp
@@ -19,6 +19,7 @@
 #include <object/socket_dispatcher.h>
 
 #include <zircon/syscalls/policy.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 
@@ -124,6 +125,112 @@ zx_status_t sys_socket_read(zx_handle_t handle, uint32_t options,
     return status;
 }
 
+// Copies in and checks the buffer descriptors of a vector read or write.
+static zx_status_t copy_iovecs_from_user(user_in_ptr<const zx_iovec_t> vec_in, size_t count,
+                                         zx_iovec_t* vec) {
+    if (count > ZX_SOCKET_MAX_IOVECS)
+        return ZX_ERR_OUT_OF_RANGE;
+    if (count > 0u && vec_in.copy_array_from_user(vec, count) != ZX_OK)
+        return ZX_ERR_INVALID_ARGS;
+    for (size_t i = 0; i < count; i++) {
+        if (vec[i].size > 0u && !vec[i].buffer)
+            return ZX_ERR_INVALID_ARGS;
+    }
+    return ZX_OK;
+}
+
+zx_status_t sys_socket_writev(zx_handle_t handle, uint32_t options,
+                              user_in_ptr<const zx_iovec_t> vec_in, size_t count,
+                              user_out_ptr<size_t> actual) {
+    LTRACEF("handle %x count %zu\n", handle, count);
+
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+    zx_status_t status = copy_iovecs_from_user(vec_in, count, vec);
+    if (status != ZX_OK)
+        return status;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    status = up->GetDispatcherWithRights(handle, ZX_RIGHT_WRITE, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    size_t nwritten;
+    status = socket->Writev(vec, count, &nwritten);
+
+    // Caller may ignore results if desired.
+    if (status == ZX_OK && actual)
+        status = actual.copy_to_user(nwritten);
+
+    return status;
+}
+
+zx_status_t sys_socket_readv(zx_handle_t handle, uint32_t options,
+                             user_in_ptr<const zx_iovec_t> vec_in, size_t count,
+                             user_out_ptr<size_t> actual) {
+    LTRACEF("handle %x count %zu\n", handle, count);
+
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+    zx_status_t status = copy_iovecs_from_user(vec_in, count, vec);
+    if (status != ZX_OK)
+        return status;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> socket;
+    status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &socket);
+    if (status != ZX_OK)
+        return status;
+
+    size_t nread;
+    status = socket->Readv(vec, count, &nread);
+
+    // Caller may ignore results if desired.
+    if (status == ZX_OK && actual)
+        status = actual.copy_to_user(nread);
+
+    return status;
+}
+
+zx_status_t sys_socket_splice(zx_handle_t handle, uint32_t options, zx_handle_t dst_handle,
+                              size_t size, user_out_ptr<size_t> actual) {
+    LTRACEF("handle %x dst %x size %zu\n", handle, dst_handle, size);
+
+    if (options != 0u)
+        return ZX_ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<SocketDispatcher> src;
+    zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &src);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<SocketDispatcher> dst;
+    status = up->GetDispatcherWithRights(dst_handle, ZX_RIGHT_WRITE, &dst);
+    if (status != ZX_OK)
+        return status;
+
+    // Bound how much is moved while both sockets are locked.
+    size = fbl::min(size, static_cast<size_t>(ZX_SOCKET_SPLICE_MAX_LEN));
+
+    size_t nmoved;
+    status = src->Splice(dst.get(), size, &nmoved);
+
+    // Caller may ignore results if desired.
+    if (status == ZX_OK && actual)
+        status = actual.copy_to_user(nmoved);
+
+    return status;
+}
+
 zx_status_t sys_socket_share(zx_handle_t handle, zx_handle_t other) {
     auto up = ProcessDispatcher::GetCurrent();
 
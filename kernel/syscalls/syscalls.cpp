@@ -56,6 +56,11 @@ inline syscall_result do_syscall(uint64_t syscall_num, uint64_t pc,
     uint64_t ret;
     if (unlikely(!valid_pc(pc - vdso_code_address))) {
         ret = sys_invalid_syscall(syscall_num, pc, vdso_code_address);
+    } else if (unlikely(current_process->has_syscall_stats())) {
+        uint64_t start = current_ticks();
+        ret = make_call(current_process);
+        current_process->AccountSyscall(static_cast<uint32_t>(syscall_num),
+                                        current_ticks() - start);
     } else {
         ret = make_call(current_process);
     }
@@ -8,6 +8,7 @@
 #include <arch/mp.h>
 #include <debug.h>
 #include <dev/interrupt.h>
+#include <inttypes.h>
 #include <kernel/cmdline.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
@@ -21,6 +22,8 @@
 #include <zircon/syscalls/system.h>
 #include <zircon/types.h>
 #include <mexec.h>
+#include <object/event_dispatcher.h>
+#include <object/job_dispatcher.h>
 #include <object/resources.h>
 #include <object/process_dispatcher.h>
 #include <object/vm_object_dispatcher.h>
@@ -28,6 +31,7 @@
 #include <string.h>
 #include <trace.h>
 
+#include "priv.h"
 #include "system_priv.h"
 
 #define LOCAL_TRACE 0
@@ -87,7 +91,7 @@ static zx_status_t identity_page_allocate(void** result_addr) {
  * TODO(gkalsi): Don't coalesce pages into a physically contiguous region and
  *               just pass a vectored I/O list to the mexec assembly.
  */
-static zx_status_t vmo_coalesce_pages(zx_handle_t vmo_hdl, const size_t extra_bytes,
+static zx_status_t vmo_coalesce_pages(const fbl::RefPtr<VmObject>& vmo, const size_t extra_bytes,
                                       paddr_t* addr, uint8_t** vaddr, size_t* size) {
     DEBUG_ASSERT(addr);
     if (!addr) return ZX_ERR_INVALID_ARGS;
@@ -95,15 +99,7 @@ static zx_status_t vmo_coalesce_pages(zx_handle_t vmo_hdl, const size_t extra_by
     DEBUG_ASSERT(size);
     if (!size) return ZX_ERR_INVALID_ARGS;
 
-    auto up = ProcessDispatcher::GetCurrent();
-    fbl::RefPtr<VmObjectDispatcher> vmo_dispatcher;
-    zx_status_t st =
-        up->GetDispatcherWithRights(vmo_hdl, ZX_RIGHT_READ, &vmo_dispatcher);
-    if (st != ZX_OK)
-        return st;
-
-    fbl::RefPtr<VmObject> vmo = vmo_dispatcher->vmo();
-
+    zx_status_t st;
     const size_t vmo_size = vmo->size();
 
     const size_t num_pages = ROUNDUP(vmo_size + extra_bytes, PAGE_SIZE) / PAGE_SIZE;
@@ -226,12 +222,102 @@ void mexec_stash_crashlog(fbl::RefPtr<VmObject> vmo) {
     stashed_crashlog = fbl::move(vmo);
 }
 
+static fbl::RefPtr<VmObject> stashed_bootdata;
+void mexec_stash_bootdata(fbl::RefPtr<VmObject> vmo) {
+    if (cmdline_get_bool("kernel.mexec-preserve-bootdata", false))
+        stashed_bootdata = fbl::move(vmo);
+}
+
+static zx_status_t get_vmo(zx_handle_t vmo_hdl, fbl::RefPtr<VmObject>* vmo) {
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<VmObjectDispatcher> vmo_dispatcher;
+    zx_status_t status =
+        up->GetDispatcherWithRights(vmo_hdl, ZX_RIGHT_READ, &vmo_dispatcher);
+    if (status != ZX_OK)
+        return status;
+    *vmo = vmo_dispatcher->vmo();
+    return ZX_OK;
+}
+
+/* Readies a copy of the bootdata this kernel was booted with to be handed to
+ * the next one.  Items that describe the state of the machine are dropped,
+ * since the platform and the crashlog code append fresh ones, and the command
+ * line this kernel ended up with replaces the one it was given. */
+static zx_status_t bootdata_prepare_preserved(uint8_t* bootdata_buf, size_t buflen) {
+    bootdata_t* hdr = (bootdata_t*)bootdata_buf;
+    if ((hdr->type != BOOTDATA_CONTAINER) || (hdr->extra != BOOTDATA_MAGIC) ||
+        (hdr->length > buflen - sizeof(bootdata_t))) {
+        return ZX_ERR_WRONG_TYPE;
+    }
+
+    uint8_t* item = bootdata_buf + sizeof(bootdata_t);
+    uint8_t* end = item + hdr->length;
+    while ((size_t)(end - item) >= sizeof(bootdata_t)) {
+        bootdata_t* section = (bootdata_t*)item;
+        size_t section_length = sizeof(bootdata_t) + BOOTDATA_ALIGN(section->length);
+        if (section_length > (size_t)(end - item))
+            return ZX_ERR_IO_DATA_INTEGRITY;
+
+        switch (section->type) {
+        case BOOTDATA_CMDLINE:
+        case BOOTDATA_LAST_CRASHLOG:
+        case BOOTDATA_E820_TABLE:
+        case BOOTDATA_EFI_MEMORY_MAP:
+        case BOOTDATA_EFI_SYSTEM_TABLE:
+        case BOOTDATA_FRAMEBUFFER:
+            section->type = BOOTDATA_IGNORE;
+            break;
+        }
+        item += section_length;
+    }
+
+    // The command line is stored as a run of NUL-terminated options.
+    uint8_t* cmdline;
+    uint32_t cmdline_len = static_cast<uint32_t>(__kernel_cmdline_size);
+    zx_status_t status = bootdata_append_section(bootdata_buf, buflen, cmdline_len,
+                                                 BOOTDATA_CMDLINE, 0, 0, &cmdline);
+    if (status != ZX_OK)
+        return status;
+    for (size_t i = 0; i < cmdline_len; i++)
+        cmdline[i] = __kernel_cmdline[i] ? __kernel_cmdline[i] : ' ';
+    if (cmdline_len)
+        cmdline[cmdline_len - 1] = '\0';
+    return ZX_OK;
+}
+
+static inline uint64_t mexec_elapsed_us(zx_time_t start, zx_time_t end) {
+    return (end - start) / ZX_USEC(1);
+}
+
 zx_status_t sys_system_mexec(zx_handle_t kernel_vmo, zx_handle_t bootimage_vmo) {
     zx_status_t result;
+    const zx_time_t start_time = current_time();
+
+    fbl::RefPtr<VmObject> kernel;
+    result = get_vmo(kernel_vmo, &kernel);
+    if (result != ZX_OK) {
+        return result;
+    }
+
+    // An invalid bootimage handle asks for the bootdata this kernel was
+    // booted with, which is only kept if the command line asked for it.
+    fbl::RefPtr<VmObject> bootimage;
+    const bool preserved = bootimage_vmo == ZX_HANDLE_INVALID;
+    if (preserved) {
+        if (!stashed_bootdata) {
+            return ZX_ERR_BAD_STATE;
+        }
+        bootimage = stashed_bootdata;
+    } else {
+        result = get_vmo(bootimage_vmo, &bootimage);
+        if (result != ZX_OK) {
+            return result;
+        }
+    }
 
     paddr_t new_kernel_addr;
     size_t new_kernel_len;
-    result = vmo_coalesce_pages(kernel_vmo, 0, &new_kernel_addr, NULL,
+    result = vmo_coalesce_pages(kernel, 0, &new_kernel_addr, NULL,
                                 &new_kernel_len);
     if (result != ZX_OK) {
         return result;
@@ -244,12 +330,23 @@ zx_status_t sys_system_mexec(zx_handle_t kernel_vmo, zx_handle_t bootimage_vmo)
     paddr_t new_bootimage_addr;
     uint8_t* bootimage_buffer;
     size_t new_bootimage_len;
-    result = vmo_coalesce_pages(bootimage_vmo, kBootdataPlatformExtraBytes,
+    const size_t extra_bytes = kBootdataPlatformExtraBytes +
+        (preserved ? sizeof(bootdata_t) + BOOTDATA_ALIGN(__kernel_cmdline_size) : 0);
+    result = vmo_coalesce_pages(bootimage, extra_bytes,
                                 &new_bootimage_addr, &bootimage_buffer,
                                 &new_bootimage_len);
     if (result != ZX_OK) {
         return result;
     }
+    const zx_time_t coalesce_time = current_time();
+
+    if (preserved) {
+        result = bootdata_prepare_preserved(bootimage_buffer, new_bootimage_len);
+        if (result != ZX_OK) {
+            printf("mexec: could not reuse the preserved bootdata\n");
+            return result;
+        }
+    }
 
     // Allow the platform to patch the bootdata with any platform specific
     // sections before mexecing.
@@ -286,6 +383,8 @@ zx_status_t sys_system_mexec(zx_handle_t kernel_vmo, zx_handle_t bootimage_vmo)
         }
     }
 
+    const zx_time_t patch_time = current_time();
+
     // WARNING
     // It is unsafe to return from this function beyond this point.
     // This is because we have swapped out the user address space and halted the
@@ -315,6 +414,15 @@ zx_status_t sys_system_mexec(zx_handle_t kernel_vmo, zx_handle_t bootimage_vmo)
     memcpy(id_page_addr, (const void*)mexec_asm, mexec_asm_length);
     arch_sync_cache_range((addr_t)id_page_addr, mexec_asm_length);
 
+    const zx_time_t halt_time = current_time();
+    printf("mexec: %s bootdata, %zu bytes; coalesce %" PRIu64 "us, patch %" PRIu64
+           "us, halt %" PRIu64 "us, total %" PRIu64 "us\n",
+           preserved ? "preserved" : "new", new_bootimage_len,
+           mexec_elapsed_us(start_time, coalesce_time),
+           mexec_elapsed_us(coalesce_time, patch_time),
+           mexec_elapsed_us(patch_time, halt_time),
+           mexec_elapsed_us(start_time, halt_time));
+
     arch_disable_ints();
 
     // We must pass in an arg that represents a list of memory regions to
@@ -391,3 +499,20 @@ zx_status_t sys_system_powerctl(zx_handle_t root_rsrc, uint32_t cmd,
         default: return ZX_ERR_INVALID_ARGS;
     }
 }
+
+zx_status_t sys_system_get_event(zx_handle_t job_handle, uint32_t kind, user_out_handle* out) {
+    LTRACEF("job %x kind %u\n", job_handle, kind);
+
+    auto up = ProcessDispatcher::GetCurrent();
+    fbl::RefPtr<JobDispatcher> job;
+    zx_status_t status = up->GetDispatcher(job_handle, &job);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<EventDispatcher> event = GetMemoryPressureEvent(kind);
+    if (!event)
+        return ZX_ERR_INVALID_ARGS;
+
+    // only the kernel gets to signal it
+    return out->make(fbl::move(event), ZX_RIGHTS_BASIC);
+}
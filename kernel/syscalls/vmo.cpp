@@ -27,7 +27,7 @@ zx_status_t sys_vmo_create(uint64_t size, uint32_t options,
                            user_out_handle* out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
-    if (options != 0u)
+    if (options & ~(ZX_VMO_LARGE_PAGES | ZX_VMO_DISCARDABLE))
         return ZX_ERR_INVALID_ARGS;
 
     auto up = ProcessDispatcher::GetCurrent();
@@ -37,7 +37,12 @@ zx_status_t sys_vmo_create(uint64_t size, uint32_t options,
 
     // create a vm object
     fbl::RefPtr<VmObject> vmo;
-    res = VmObjectPaged::Create(0, size, &vmo);
+    uint32_t vmo_options = 0;
+    if (options & ZX_VMO_LARGE_PAGES)
+        vmo_options |= VmObjectPaged::kLargePages;
+    if (options & ZX_VMO_DISCARDABLE)
+        vmo_options |= VmObjectPaged::kDiscardable;
+    res = VmObjectPaged::Create(0, vmo_options, size, &vmo);
     if (res != ZX_OK)
         return res;
 
@@ -136,6 +141,26 @@ zx_status_t sys_vmo_write(zx_handle_t handle, user_in_ptr<const void> _data,
     return status;
 }
 
+zx_status_t sys_vmo_copy_range(zx_handle_t dst_handle, uint64_t dst_offset,
+                               zx_handle_t src_handle, uint64_t src_offset, size_t len) {
+    LTRACEF("dst %x, dst_offset %#" PRIx64 ", src %x, src_offset %#" PRIx64 ", len %#zx\n",
+            dst_handle, dst_offset, src_handle, src_offset, len);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<VmObjectDispatcher> dst;
+    zx_status_t status = up->GetDispatcherWithRights(dst_handle, ZX_RIGHT_WRITE, &dst);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::RefPtr<VmObjectDispatcher> src;
+    status = up->GetDispatcherWithRights(src_handle, ZX_RIGHT_READ, &src);
+    if (status != ZX_OK)
+        return status;
+
+    return dst->vmo()->CopyFrom(src->vmo().get(), src_offset, dst_offset, len);
+}
+
 zx_status_t sys_vmo_get_size(zx_handle_t handle, user_out_ptr<uint64_t> _size) {
     LTRACEF("handle %x, sizep %p\n", handle, _size.get());
 
@@ -0,0 +1,97 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <inttypes.h>
+#include <trace.h>
+
+#include <lib/user_copy/user_ptr.h>
+#include <object/handle.h>
+#include <object/process_dispatcher.h>
+#include <object/wait_set_dispatcher.h>
+
+#include <fbl/auto_lock.h>
+#include <fbl/ref_ptr.h>
+
+#include <zircon/types.h>
+
+#include "priv.h"
+
+#define LOCAL_TRACE 0
+
+zx_status_t sys_waitset_create(uint32_t options, user_out_handle* out) {
+    LTRACEF("options %u\n", options);
+
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+    zx_status_t result = WaitSetDispatcher::Create(options, &dispatcher, &rights);
+    if (result != ZX_OK)
+        return result;
+
+    return out->make(fbl::move(dispatcher), rights);
+}
+
+zx_status_t sys_waitset_add(zx_handle_t waitset_handle, uint64_t cookie,
+                            zx_handle_t handle_value, zx_signals_t signals) {
+    LTRACEF("waitset %x cookie %" PRIu64 " handle %x\n", waitset_handle, cookie, handle_value);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<WaitSetDispatcher> wait_set;
+    zx_status_t status = up->GetDispatcherWithRights(waitset_handle, ZX_RIGHT_WRITE, &wait_set);
+    if (status != ZX_OK)
+        return status;
+
+    fbl::AutoLock lock(up->handle_table_lock());
+    Handle* handle = up->GetHandleLocked(handle_value);
+    if (!handle)
+        return ZX_ERR_BAD_HANDLE;
+    if (!handle->HasRights(ZX_RIGHT_WAIT))
+        return ZX_ERR_ACCESS_DENIED;
+
+    return wait_set->AddEntry(cookie, handle, signals);
+}
+
+zx_status_t sys_waitset_remove(zx_handle_t waitset_handle, uint64_t cookie) {
+    LTRACEF("waitset %x cookie %" PRIu64 "\n", waitset_handle, cookie);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<WaitSetDispatcher> wait_set;
+    zx_status_t status = up->GetDispatcherWithRights(waitset_handle, ZX_RIGHT_WRITE, &wait_set);
+    if (status != ZX_OK)
+        return status;
+
+    return wait_set->RemoveEntry(cookie);
+}
+
+zx_status_t sys_waitset_wait(zx_handle_t waitset_handle, zx_time_t deadline,
+                             user_out_ptr<zx_waitset_result_t> results_out, size_t count,
+                             user_out_ptr<size_t> actual) {
+    LTRACEF("waitset %x count %zu\n", waitset_handle, count);
+
+    if (count == 0u || count > ZX_WAITSET_MAX_RESULTS)
+        return ZX_ERR_OUT_OF_RANGE;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    fbl::RefPtr<WaitSetDispatcher> wait_set;
+    zx_status_t status = up->GetDispatcherWithRights(waitset_handle, ZX_RIGHT_READ, &wait_set);
+    if (status != ZX_OK)
+        return status;
+
+    zx_waitset_result_t results[ZX_WAITSET_MAX_RESULTS];
+    size_t n = 0;
+    status = wait_set->Wait(deadline, results, count, &n);
+    if (status != ZX_OK)
+        return status;
+
+    status = results_out.copy_array_to_user(results, n);
+    if (status != ZX_OK)
+        return status;
+
+    return actual.copy_to_user(n);
+}
@@ -18,6 +18,7 @@
 #include <kernel/thread.h>
 #include <lib/crypto/global_prng.h>
 #include <lib/user_copy/user_ptr.h>
+#include <lib/vdso.h>
 #include <object/event_dispatcher.h>
 #include <object/event_pair_dispatcher.h>
 #include <object/handle.h>
@@ -26,6 +27,7 @@
 #include <object/resources.h>
 #include <object/thread_dispatcher.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/atomic.h>
 #include <fbl/ref_ptr.h>
@@ -39,6 +41,7 @@
 #define LOCAL_TRACE 0
 
 constexpr size_t kMaxCPRNGDraw = ZX_CPRNG_DRAW_MAX_LEN;
+constexpr size_t kCPRNGDrawChunk = 256;
 constexpr size_t kMaxCPRNGSeed = ZX_CPRNG_ADD_ENTROPY_MAX_LEN;
 
 zx_status_t sys_nanosleep(zx_time_t deadline) {
@@ -83,6 +86,7 @@ zx_status_t sys_clock_adjust(zx_handle_t hrsrc, uint32_t clock_id, int64_t offse
         return ZX_ERR_ACCESS_DENIED;
     case ZX_CLOCK_UTC:
         utc_offset.store(offset);
+        VDso::SetUtcOffset(offset);
         return ZX_OK;
     default:
         return ZX_ERR_INVALID_ARGS;
@@ -222,17 +226,19 @@ zx_status_t sys_cprng_draw(user_out_ptr<void> buffer, size_t len, user_out_ptr<s
     if (len > kMaxCPRNGDraw)
         return ZX_ERR_INVALID_ARGS;
 
-    uint8_t kernel_buf[kMaxCPRNGDraw];
+    // Large draws are staged through the stack one chunk at a time.
+    uint8_t kernel_buf[kCPRNGDrawChunk];
     // Ensure we get rid of the stack copy of the random data as this function
     // returns.
     explicit_memory::ZeroDtor<uint8_t> zero_guard(kernel_buf, sizeof(kernel_buf));
 
-    auto prng = crypto::GlobalPRNG::GetInstance();
-    ASSERT(prng->is_thread_safe());
-    prng->Draw(kernel_buf, static_cast<int>(len));
-
-    if (buffer.copy_array_to_user(kernel_buf, len) != ZX_OK)
-        return ZX_ERR_INVALID_ARGS;
+    auto user_buf = buffer.reinterpret<uint8_t>();
+    for (size_t offset = 0; offset < len; offset += kCPRNGDrawChunk) {
+        const size_t chunk = fbl::min(len - offset, kCPRNGDrawChunk);
+        crypto::GlobalPRNG::DrawPerCpu(kernel_buf, chunk);
+        if (user_buf.copy_array_to_user(kernel_buf, chunk, offset) != ZX_OK)
+            return ZX_ERR_INVALID_ARGS;
+    }
     zx_status_t status = actual.copy_to_user(len);
     if (status != ZX_OK)
         return status;
@@ -9,17 +9,23 @@
 
 #include <arch/ops.h>
 #include <err.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/unique_ptr.h>
 #include <inttypes.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <lib/ktrace.h>
 #include <platform.h>
 #include <rand.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <vm/pmm.h>
+#include <vm/vm_page_list.h>
 
 const size_t BUFSIZE = (8 * 1024 * 1024);
 const size_t ITER = (1UL * 1024 * 1024 * 1024 / BUFSIZE); // enough iterations to have to copy/set 1GB of memory
@@ -235,6 +241,168 @@ __NO_INLINE static void bench_mutex() {
     printf("%" PRIu64 " cycles to acquire/release uncontended mutex %u times (%" PRIu64 " cycles per)\n", c, count, c / count);
 }
 
+// The page list layout VmPageList used before it became a radix tree, kept
+// as a baseline: a WAVL tree of fixed size nodes keyed by offset.
+struct WavlPageListNode : public fbl::WAVLTreeContainable<fbl::unique_ptr<WavlPageListNode>> {
+    explicit WavlPageListNode(uint64_t offset)
+        : offset(offset) {}
+    uint64_t GetKey() const { return offset; }
+
+    uint64_t offset;
+    vm_page_t* pages[VmPageListNode::kPageFanOut] = {};
+};
+using WavlPageList = fbl::WAVLTree<uint64_t, fbl::unique_ptr<WavlPageListNode>>;
+
+static const uint64_t WAVL_NODE_SPAN = VmPageListNode::kPageFanOut * PAGE_SIZE;
+
+static vm_page_t* wavl_page_list_get(WavlPageList& tree, uint64_t offset) {
+    auto node = tree.find(ROUNDDOWN(offset, WAVL_NODE_SPAN));
+    if (!node.IsValid()) {
+        return nullptr;
+    }
+    return node->pages[(offset % WAVL_NODE_SPAN) / PAGE_SIZE];
+}
+
+// Offset of the i'th page in the benchmark object: runs of 8 pages 16MB
+// apart, so the object spans 8GB with only 16MB of it populated.
+static uint64_t bench_page_list_offset(size_t i) {
+    return (i / 8) * (16 * 1024 * 1024) + (i % 8) * PAGE_SIZE;
+}
+
+__NO_INLINE static void bench_page_list() {
+    static const size_t page_count = 4096;
+    static const size_t lookups = 16 * 1024 * 1024;
+    static const size_t walks = 1024;
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (pmm_alloc_pages(page_count, 0, &list) != page_count) {
+        printf("failed to allocate pages for the page list benchmark\n");
+        pmm_free(&list);
+        return;
+    }
+
+    VmPageList radix;
+    WavlPageList wavl;
+    for (size_t i = 0; i < page_count; i++) {
+        vm_page_t* p = list_remove_head_type(&list, vm_page_t, free.node);
+        uint64_t offset = bench_page_list_offset(i);
+
+        if (radix.AddPage(p, offset) != ZX_OK) {
+            printf("failed to add page to the page list\n");
+            pmm_free_page(p);
+            goto done;
+        }
+
+        WavlPageListNode* node;
+        auto iter = wavl.find(ROUNDDOWN(offset, WAVL_NODE_SPAN));
+        if (iter.IsValid()) {
+            node = &*iter;
+        } else {
+            fbl::AllocChecker ac;
+            fbl::unique_ptr<WavlPageListNode> n(new (&ac) WavlPageListNode(
+                ROUNDDOWN(offset, WAVL_NODE_SPAN)));
+            if (!ac.check()) {
+                printf("failed to allocate a wavl page list node\n");
+                goto done;
+            }
+            node = n.get();
+            wavl.insert(fbl::move(n));
+        }
+        node->pages[(offset % WAVL_NODE_SPAN) / PAGE_SIZE] = p;
+    }
+
+    {
+        uint64_t found = 0;
+        uint64_t c = arch_cycle_count();
+        for (size_t i = 0; i < lookups; i++) {
+            // step through the pages in a scattered order
+            found += radix.GetPage(bench_page_list_offset((i * 2654435761u) % page_count)) != nullptr;
+        }
+        c = arch_cycle_count() - c;
+        printf("%" PRIu64 " cycles for %zu radix page list lookups (%" PRIu64 " cycles per, %" PRIu64 " found)\n",
+               c, lookups, c / lookups, found);
+
+        found = 0;
+        c = arch_cycle_count();
+        for (size_t i = 0; i < lookups; i++) {
+            found += wavl_page_list_get(wavl, bench_page_list_offset((i * 2654435761u) % page_count)) != nullptr;
+        }
+        c = arch_cycle_count() - c;
+        printf("%" PRIu64 " cycles for %zu wavl page list lookups (%" PRIu64 " cycles per, %" PRIu64 " found)\n",
+               c, lookups, c / lookups, found);
+
+        found = 0;
+        c = arch_cycle_count();
+        for (size_t i = 0; i < walks; i++) {
+            radix.ForEveryPage([&found](const auto p, uint64_t offset) {
+                found++;
+                return ZX_ERR_NEXT;
+            });
+        }
+        c = arch_cycle_count() - c;
+        printf("%" PRIu64 " cycles to walk the radix page list %zu times (%" PRIu64 " cycles per page)\n",
+               c, walks, c / found);
+
+        found = 0;
+        c = arch_cycle_count();
+        for (size_t i = 0; i < walks; i++) {
+            for (const auto& node : wavl) {
+                for (const auto p : node.pages) {
+                    found += p != nullptr;
+                }
+            }
+        }
+        c = arch_cycle_count() - c;
+        printf("%" PRIu64 " cycles to walk the wavl page list %zu times (%" PRIu64 " cycles per page)\n",
+               c, walks, c / found);
+    }
+
+done:
+    // the radix list owns the pages; the baseline only borrowed them
+    wavl.clear();
+    radix.FreeAllPages();
+    pmm_free(&list);
+}
+
+#if WITH_LIB_KTRACE
+// The probes only write records while the probe group is being traced, and
+// are otherwise just a check of the group mask, so run this both with and
+// without "ktrace start" to see the overhead of each.
+__NO_INLINE static void bench_ktrace() {
+    const size_t count = 1024 * 1024;
+
+    uint64_t c = arch_cycle_count();
+    zx_time_t t = current_time();
+    for (size_t i = 0; i < count; i++) {
+        ktrace_probe0("bench_probe0");
+    }
+    t = current_time() - t;
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles for %zu ktrace_probe0 (%" PRIu64 " cycles, %" PRIu64 " ns per)\n",
+           c, count, c / count, t / count);
+
+    c = arch_cycle_count();
+    t = current_time();
+    for (size_t i = 0; i < count; i++) {
+        ktrace_probe2("bench_probe2", static_cast<uint32_t>(i), 0u);
+    }
+    t = current_time() - t;
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles for %zu ktrace_probe2 (%" PRIu64 " cycles, %" PRIu64 " ns per)\n",
+           c, count, c / count, t / count);
+
+    c = arch_cycle_count();
+    t = current_time();
+    for (size_t i = 0; i < count; i++) {
+        ktrace_probe64("bench_probe64", i);
+    }
+    t = current_time() - t;
+    c = arch_cycle_count() - c;
+    printf("%" PRIu64 " cycles for %zu ktrace_probe64 (%" PRIu64 " cycles, %" PRIu64 " ns per)\n",
+           c, count, c / count, t / count);
+}
+#endif
+
 void benchmarks() {
     bench_set_overhead();
     bench_memcpy();
@@ -251,4 +419,10 @@ void benchmarks() {
 
     bench_spinlock();
     bench_mutex();
+
+    bench_page_list();
+
+#if WITH_LIB_KTRACE
+    bench_ktrace();
+#endif
 }
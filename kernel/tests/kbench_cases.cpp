@@ -0,0 +1,266 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+// Microbenchmarks of kernel hot paths, run with the "kbench" console command.
+
+#include <arch/ops.h>
+#include <err.h>
+#include <kernel/cpu.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <lib/kbench.h>
+#include <object/event_dispatcher.h>
+#include <object/handle.h>
+#include <vm/pmm.h>
+#include <vm/vm_object_paged.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/ref_ptr.h>
+
+namespace {
+
+// pmm
+
+void bench_pmm_alloc_free_page(void* context, size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        paddr_t pa;
+        vm_page_t* page = pmm_alloc_page(PMM_ALLOC_FLAG_ANY, &pa);
+        if (page)
+            pmm_free_page(page);
+    }
+}
+
+void bench_pmm_alloc_free_16_pages(void* context, size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        pmm_alloc_pages(16, PMM_ALLOC_FLAG_ANY, &list);
+        pmm_free(&list);
+    }
+}
+
+// locks
+
+// Shared by every cpu, so running on more than one measures contention.
+mutex_t shared_mutex = MUTEX_INITIAL_VALUE(shared_mutex);
+
+struct LockContext {
+    mutex_t mutex;
+    spin_lock_t spinlock;
+};
+
+zx_status_t init_lock_bench(void** context) {
+    fbl::AllocChecker ac;
+    LockContext* ctx = new (&ac) LockContext;
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    mutex_init(&ctx->mutex);
+    ctx->spinlock = SPIN_LOCK_INITIAL_VALUE;
+    *context = ctx;
+    return ZX_OK;
+}
+
+void cleanup_lock_bench(void* context) {
+    LockContext* ctx = static_cast<LockContext*>(context);
+    mutex_destroy(&ctx->mutex);
+    delete ctx;
+}
+
+void bench_mutex(void* context, size_t iterations) {
+    LockContext* ctx = static_cast<LockContext*>(context);
+    for (size_t i = 0; i < iterations; i++) {
+        mutex_acquire(&ctx->mutex);
+        mutex_release(&ctx->mutex);
+    }
+}
+
+void bench_mutex_shared(void* context, size_t iterations) {
+    for (size_t i = 0; i < iterations; i++) {
+        mutex_acquire(&shared_mutex);
+        mutex_release(&shared_mutex);
+    }
+}
+
+void bench_spinlock_irqsave(void* context, size_t iterations) {
+    LockContext* ctx = static_cast<LockContext*>(context);
+    for (size_t i = 0; i < iterations; i++) {
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&ctx->spinlock, state);
+        spin_unlock_irqrestore(&ctx->spinlock, state);
+    }
+}
+
+// vm
+
+struct VmoContext {
+    fbl::RefPtr<VmObject> vmo;
+};
+
+zx_status_t init_vmo_bench(void** context) {
+    fbl::AllocChecker ac;
+    VmoContext* ctx = new (&ac) VmoContext;
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, PAGE_SIZE, &ctx->vmo);
+    if (status != ZX_OK) {
+        delete ctx;
+        return status;
+    }
+    *context = ctx;
+    return ZX_OK;
+}
+
+void cleanup_vmo_bench(void* context) {
+    delete static_cast<VmoContext*>(context);
+}
+
+// Committing goes through VmObjectPaged::GetPageLocked().
+void bench_vmo_commit_decommit(void* context, size_t iterations) {
+    VmObject* vmo = static_cast<VmoContext*>(context)->vmo.get();
+    for (size_t i = 0; i < iterations; i++) {
+        uint64_t committed, decommitted;
+        vmo->CommitRange(0, PAGE_SIZE, &committed);
+        vmo->DecommitRange(0, PAGE_SIZE, &decommitted);
+    }
+}
+
+void bench_vmo_write(void* context, size_t iterations) {
+    VmObject* vmo = static_cast<VmoContext*>(context)->vmo.get();
+    uint64_t value = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        size_t written;
+        vmo->Write(&value, 0, sizeof(value), &written);
+    }
+}
+
+// sched
+
+// A thread on the same cpu that wakes the benchmark thread back up every
+// time it is woken, so every iteration is two unblocks and two switches.
+struct SchedContext {
+    event_t ping;
+    event_t pong;
+    volatile bool quit;
+    thread_t* thread;
+};
+
+int sched_partner(void* arg) {
+    SchedContext* ctx = static_cast<SchedContext*>(arg);
+    for (;;) {
+        event_wait(&ctx->ping);
+        if (ctx->quit)
+            return 0;
+        event_signal(&ctx->pong, true);
+    }
+}
+
+zx_status_t init_sched_bench(void** context) {
+    fbl::AllocChecker ac;
+    SchedContext* ctx = new (&ac) SchedContext;
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    event_init(&ctx->ping, false, EVENT_FLAG_AUTOUNSIGNAL);
+    event_init(&ctx->pong, false, EVENT_FLAG_AUTOUNSIGNAL);
+    ctx->quit = false;
+    ctx->thread = thread_create("kbench partner", sched_partner, ctx,
+                                get_current_thread()->base_priority, DEFAULT_STACK_SIZE);
+    if (!ctx->thread) {
+        delete ctx;
+        return ZX_ERR_NO_MEMORY;
+    }
+    thread_set_cpu_affinity(ctx->thread, cpu_num_to_mask(arch_curr_cpu_num()));
+    thread_resume(ctx->thread);
+    *context = ctx;
+    return ZX_OK;
+}
+
+void cleanup_sched_bench(void* context) {
+    SchedContext* ctx = static_cast<SchedContext*>(context);
+    ctx->quit = true;
+    event_signal(&ctx->ping, true);
+    thread_join(ctx->thread, nullptr, ZX_TIME_INFINITE);
+    event_destroy(&ctx->ping);
+    event_destroy(&ctx->pong);
+    delete ctx;
+}
+
+void bench_sched_ping_pong(void* context, size_t iterations) {
+    SchedContext* ctx = static_cast<SchedContext*>(context);
+    for (size_t i = 0; i < iterations; i++) {
+        event_signal(&ctx->ping, true);
+        event_wait(&ctx->pong);
+    }
+}
+
+void bench_thread_yield(void* context, size_t iterations) {
+    for (size_t i = 0; i < iterations; i++)
+        thread_yield();
+}
+
+// handles
+
+struct HandleContext {
+    fbl::RefPtr<Dispatcher> dispatcher;
+    zx_rights_t rights;
+};
+
+zx_status_t init_handle_bench(void** context) {
+    fbl::AllocChecker ac;
+    HandleContext* ctx = new (&ac) HandleContext;
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    zx_status_t status = EventDispatcher::Create(0u, &ctx->dispatcher, &ctx->rights);
+    if (status != ZX_OK) {
+        delete ctx;
+        return status;
+    }
+    *context = ctx;
+    return ZX_OK;
+}
+
+void cleanup_handle_bench(void* context) {
+    delete static_cast<HandleContext*>(context);
+}
+
+void bench_handle_make_destroy(void* context, size_t iterations) {
+    HandleContext* ctx = static_cast<HandleContext*>(context);
+    for (size_t i = 0; i < iterations; i++) {
+        HandleOwner handle = Handle::Make(ctx->dispatcher, ctx->rights);
+    }
+}
+
+}  // namespace
+
+KBENCH_START_CASE(pmm_benchmarks)
+KBENCH("alloc_free_page", bench_pmm_alloc_free_page)
+KBENCH("alloc_free_16_pages", bench_pmm_alloc_free_16_pages)
+KBENCH_END_CASE(pmm_benchmarks, "pmm", "Physical page allocator", nullptr, nullptr);
+
+KBENCH_START_CASE(lock_benchmarks)
+KBENCH("mutex", bench_mutex)
+KBENCH("mutex_shared", bench_mutex_shared)
+KBENCH("spinlock_irqsave", bench_spinlock_irqsave)
+KBENCH_END_CASE(lock_benchmarks, "lock", "Uncontended and shared locks",
+                init_lock_bench, cleanup_lock_bench);
+
+KBENCH_START_CASE(vmo_benchmarks)
+KBENCH("commit_decommit_page", bench_vmo_commit_decommit)
+KBENCH("write_8_bytes", bench_vmo_write)
+KBENCH_END_CASE(vmo_benchmarks, "vmo", "Paged VMO page lookup and commit",
+                init_vmo_bench, cleanup_vmo_bench);
+
+KBENCH_START_CASE(sched_benchmarks)
+KBENCH("ping_pong", bench_sched_ping_pong)
+KBENCH("yield", bench_thread_yield)
+KBENCH_END_CASE(sched_benchmarks, "sched", "Block, unblock and context switch",
+                init_sched_bench, cleanup_sched_bench);
+
+KBENCH_START_CASE(handle_benchmarks)
+KBENCH("make_destroy", bench_handle_make_destroy)
+KBENCH_END_CASE(handle_benchmarks, "handle", "Handle allocation",
+                init_handle_bench, cleanup_handle_bench);
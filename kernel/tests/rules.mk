@@ -15,6 +15,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/cache_tests.cpp \
     $(LOCAL_DIR)/clock_tests.cpp \
     $(LOCAL_DIR)/fibo.cpp \
+    $(LOCAL_DIR)/kbench_cases.cpp \
     $(LOCAL_DIR)/mem_tests.cpp \
     $(LOCAL_DIR)/printf_tests.cpp \
     $(LOCAL_DIR)/sleep_tests.cpp \
@@ -23,11 +24,13 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/tests.cpp \
     $(LOCAL_DIR)/thread_tests.cpp \
     $(LOCAL_DIR)/timer_tests.cpp \
+    $(LOCAL_DIR)/vm_fault_stress_tests.cpp \
 
 
 MODULE_DEPS += \
     kernel/lib/crypto \
     kernel/lib/header_tests \
+    kernel/lib/kbench \
     kernel/lib/fbl \
     third_party/lib/safeint \
     kernel/lib/unittest \
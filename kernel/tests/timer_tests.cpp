@@ -188,10 +188,99 @@ static void timer_far_deadline(void) {
     event_destroy(&event);
 }
 
+// Each benchmark thread sets and cancels a timer on its own cpu as fast as it
+// can. With a queue lock per cpu the throughput should grow with the number of
+// cpus instead of flattening out on a shared lock.
+static const int kTimerBenchIterations = 100000;
+
+struct timer_bench_args {
+    volatile int* ready;
+    volatile int* go;
+    zx_duration_t elapsed;
+};
+
+static int timer_bench_thread(void* arg) {
+    timer_bench_args* args = (timer_bench_args*)arg;
+    event_t event;
+    timer_t timer;
+
+    event_init(&event, false, 0);
+    timer_init(&timer);
+
+    atomic_add(args->ready, 1);
+    while (atomic_load(args->go) == 0) {
+        arch_spinloop_pause();
+    }
+
+    zx_time_t start = current_time();
+    for (int i = 0; i < kTimerBenchIterations; i++) {
+        timer_set(&timer, current_time() + ZX_SEC(10), TIMER_SLACK_CENTER, 0, timer_cb, &event);
+        timer_cancel(&timer);
+    }
+    args->elapsed = current_time() - start;
+
+    event_destroy(&event);
+    return 0;
+}
+
+static void timer_bench_cpus(uint num_cpus) {
+    thread_t* threads[SMP_MAX_CPUS];
+    timer_bench_args args[SMP_MAX_CPUS];
+    int ready = 0;
+    int go = 0;
+
+    for (uint i = 0; i < num_cpus; i++) {
+        args[i].ready = &ready;
+        args[i].go = &go;
+        args[i].elapsed = 0;
+
+        threads[i] = thread_create_etc(
+            NULL, "timer bench", timer_bench_thread, &args[i],
+            DEFAULT_PRIORITY, NULL, NULL, DEFAULT_STACK_SIZE, NULL);
+        if (threads[i] == NULL) {
+            printf("failed to create thread for cpu %u\n", i);
+            num_cpus = i;
+            break;
+        }
+        thread_set_cpu_affinity(threads[i], cpu_num_to_mask(i));
+        thread_resume(threads[i]);
+    }
+
+    while (atomic_load(&ready) != (int)num_cpus) {
+        thread_sleep(current_time() + ZX_MSEC(1));
+    }
+    atomic_store(&go, 1);
+
+    zx_duration_t slowest = 0;
+    for (uint i = 0; i < num_cpus; i++) {
+        thread_join(threads[i], NULL, ZX_TIME_INFINITE);
+        if (args[i].elapsed > slowest)
+            slowest = args[i].elapsed;
+    }
+
+    if (num_cpus == 0 || slowest == 0)
+        return;
+
+    uint64_t ops = (uint64_t)num_cpus * kTimerBenchIterations;
+    printf("%2u cpus: %" PRIu64 " timer set/cancel pairs in %" PRIu64 " us, %" PRIu64 " pairs/ms\n",
+           num_cpus, ops, slowest / ZX_USEC(1), ops * ZX_MSEC(1) / slowest);
+}
+
+static void timer_bench_scaling(void) {
+    printf("timer set/cancel scaling, %d pairs per cpu\n", kTimerBenchIterations);
+
+    uint max = arch_max_num_cpus();
+    for (uint num_cpus = 1; num_cpus < max; num_cpus *= 2) {
+        timer_bench_cpus(num_cpus);
+    }
+    timer_bench_cpus(max);
+}
+
 void timer_tests(void) {
     timer_test_coalescing_center();
     timer_test_coalescing_late();
     timer_test_coalescing_early();
     timer_test_all_cpus();
     timer_far_deadline();
+    timer_bench_scaling();
 }
@@ -0,0 +1,227 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <arch/mmu.h>
+#include <kernel/atomic.h>
+#include <kernel/event.h>
+#include <kernel/rwlock.h>
+#include <kernel/thread.h>
+#include <unittest.h>
+#include <vm/vm.h>
+#include <vm/vm_aspace.h>
+#include <vm/vm_object.h>
+#include <vm/vm_object_paged.h>
+#include <zircon/types.h>
+
+namespace {
+
+constexpr uint kStressThreads = 4;
+constexpr uint kStressIterations = 64;
+constexpr size_t kStressPages = 32;
+constexpr size_t kStressSize = kStressPages * PAGE_SIZE;
+
+constexpr uint kMmuFlags = ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE;
+
+struct StressState {
+    event_t start = EVENT_INITIAL_VALUE(start, false, 0);
+    volatile int stop = 0;
+    volatile int errors = 0;
+};
+
+// rwlock checks: writers must run alone, readers may overlap each other
+struct RwLockState {
+    StressState stress;
+    rwlock_t lock = RWLOCK_INITIAL_VALUE(lock);
+    volatile int readers_in = 0;
+    volatile int writers_in = 0;
+    volatile int max_readers = 0;
+};
+
+int rwlock_thread(void* arg) {
+    RwLockState* state = static_cast<RwLockState*>(arg);
+    event_wait(&state->stress.start);
+
+    for (uint i = 0; i < kStressIterations * 16; i++) {
+        if (i % 4 == 0) {
+            AutoWriteLock guard(&state->lock);
+            if (atomic_add(&state->writers_in, 1) != 0 || atomic_load(&state->readers_in) != 0)
+                atomic_add(&state->stress.errors, 1);
+            thread_yield();
+            atomic_add(&state->writers_in, -1);
+        } else {
+            AutoReadLock guard(&state->lock);
+            int readers = atomic_add(&state->readers_in, 1) + 1;
+            if (atomic_load(&state->writers_in) != 0)
+                atomic_add(&state->stress.errors, 1);
+            if (readers > atomic_load(&state->max_readers))
+                atomic_store(&state->max_readers, readers);
+            thread_yield();
+            atomic_add(&state->readers_in, -1);
+        }
+    }
+    return 0;
+}
+
+// Writes a pattern through every page of a fresh demand paged mapping, reads
+// it back and unmaps it again, so faults and unmaps race across threads.
+int map_fault_unmap_thread(void* arg) {
+    StressState* state = static_cast<StressState*>(arg);
+    event_wait(&state->start);
+
+    VmAspace* aspace = VmAspace::kernel_aspace();
+    for (uint i = 0; i < kStressIterations; i++) {
+        fbl::RefPtr<VmObject> vmo;
+        if (VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, kStressSize, &vmo) != ZX_OK) {
+            atomic_add(&state->errors, 1);
+            break;
+        }
+        void* ptr;
+        if (aspace->MapObjectInternal(vmo, "fault stress", 0, kStressSize, &ptr, 0, 0,
+                                      kMmuFlags) != ZX_OK) {
+            atomic_add(&state->errors, 1);
+            break;
+        }
+
+        volatile uint32_t* base = static_cast<volatile uint32_t*>(ptr);
+        const size_t stride = PAGE_SIZE / sizeof(uint32_t);
+        for (size_t page = 0; page < kStressPages; page++)
+            base[page * stride] = static_cast<uint32_t>(page + i);
+        for (size_t page = 0; page < kStressPages; page++) {
+            if (base[page * stride] != static_cast<uint32_t>(page + i))
+                atomic_add(&state->errors, 1);
+        }
+
+        if (aspace->FreeRegion(reinterpret_cast<vaddr_t>(ptr)) != ZX_OK)
+            atomic_add(&state->errors, 1);
+    }
+    return 0;
+}
+
+// Keeps faulting a long lived mapping back in after decommitting it, while
+// other threads change the layout of the same aspace.
+int refault_thread(void* arg) {
+    StressState* state = static_cast<StressState*>(arg);
+    event_wait(&state->start);
+
+    fbl::RefPtr<VmObject> vmo;
+    if (VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, kStressSize, &vmo) != ZX_OK) {
+        atomic_add(&state->errors, 1);
+        return 0;
+    }
+    VmAspace* aspace = VmAspace::kernel_aspace();
+    void* ptr;
+    if (aspace->MapObjectInternal(vmo, "refault stress", 0, kStressSize, &ptr, 0, 0,
+                                  kMmuFlags) != ZX_OK) {
+        atomic_add(&state->errors, 1);
+        return 0;
+    }
+
+    volatile uint32_t* base = static_cast<volatile uint32_t*>(ptr);
+    const size_t stride = PAGE_SIZE / sizeof(uint32_t);
+    for (uint i = 0; !atomic_load(&state->stop); i++) {
+        for (size_t page = 0; page < kStressPages; page++)
+            base[page * stride] = static_cast<uint32_t>(page ^ i);
+        for (size_t page = 0; page < kStressPages; page++) {
+            if (base[page * stride] != static_cast<uint32_t>(page ^ i))
+                atomic_add(&state->errors, 1);
+        }
+        if (vmo->DecommitRange(0, kStressSize, nullptr) != ZX_OK)
+            atomic_add(&state->errors, 1);
+    }
+
+    if (aspace->FreeRegion(reinterpret_cast<vaddr_t>(ptr)) != ZX_OK)
+        atomic_add(&state->errors, 1);
+    return 0;
+}
+
+} // namespace
+
+static bool rwlock_readers_writers(void* context) {
+    BEGIN_TEST;
+
+    RwLockState state;
+    thread_t* threads[kStressThreads];
+    for (auto& t : threads) {
+        t = thread_create("rwlock stress", rwlock_thread, &state, DEFAULT_PRIORITY,
+                          DEFAULT_STACK_SIZE);
+        REQUIRE_NONNULL(t, "thread_create");
+        thread_resume(t);
+    }
+    event_signal(&state.stress.start, true);
+    for (auto& t : threads)
+        thread_join(t, nullptr, ZX_TIME_INFINITE);
+
+    EXPECT_EQ(0, state.stress.errors, "readers and writers overlapped");
+    EXPECT_EQ(0, state.readers_in, "reader count");
+    EXPECT_FALSE(rwlock_is_held(&state.lock), "lock released");
+
+    rwlock_destroy(&state.lock);
+    event_destroy(&state.stress.start);
+    END_TEST;
+}
+
+static bool concurrent_fault_unmap(void* context) {
+    BEGIN_TEST;
+
+    StressState state;
+    thread_t* threads[kStressThreads];
+    for (auto& t : threads) {
+        t = thread_create("fault stress", map_fault_unmap_thread, &state, DEFAULT_PRIORITY,
+                          DEFAULT_STACK_SIZE);
+        REQUIRE_NONNULL(t, "thread_create");
+        thread_resume(t);
+    }
+    event_signal(&state.start, true);
+    for (auto& t : threads)
+        thread_join(t, nullptr, ZX_TIME_INFINITE);
+
+    EXPECT_EQ(0, state.errors, "map, fault or unmap failed");
+
+    event_destroy(&state.start);
+    END_TEST;
+}
+
+static bool fault_while_remapping(void* context) {
+    BEGIN_TEST;
+
+    StressState state;
+    thread_t* faulters[kStressThreads / 2];
+    thread_t* mappers[kStressThreads / 2];
+    for (auto& t : faulters) {
+        t = thread_create("refault stress", refault_thread, &state, DEFAULT_PRIORITY,
+                          DEFAULT_STACK_SIZE);
+        REQUIRE_NONNULL(t, "thread_create");
+        thread_resume(t);
+    }
+    for (auto& t : mappers) {
+        t = thread_create("remap stress", map_fault_unmap_thread, &state, DEFAULT_PRIORITY,
+                          DEFAULT_STACK_SIZE);
+        REQUIRE_NONNULL(t, "thread_create");
+        thread_resume(t);
+    }
+    event_signal(&state.start, true);
+
+    // the faulters run until the mappers have finished churning the aspace
+    for (auto& t : mappers)
+        thread_join(t, nullptr, ZX_TIME_INFINITE);
+    atomic_store(&state.stop, 1);
+    for (auto& t : faulters)
+        thread_join(t, nullptr, ZX_TIME_INFINITE);
+
+    EXPECT_EQ(0, state.errors, "fault, decommit or remap failed");
+
+    event_destroy(&state.start);
+    END_TEST;
+}
+
+UNITTEST_START_TESTCASE(vm_fault_stress)
+UNITTEST("rwlock readers and writers", rwlock_readers_writers)
+UNITTEST("concurrent fault and unmap", concurrent_fault_unmap)
+UNITTEST("fault while remapping", fault_while_remapping)
+UNITTEST_END_TESTCASE(vm_fault_stress, "vm_fault_stress", "Concurrent page fault and unmap stress tests",
+                      nullptr, nullptr);
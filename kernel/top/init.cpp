@@ -11,6 +11,7 @@
  * initialized.
  */
 #include <arch/ops.h>
+#include <lib/ktrace.h>
 #include <lk/init.h>
 
 #include <assert.h>
@@ -83,6 +84,10 @@ void lk_init_level(enum lk_init_flags required_flag, uint start_level, uint stop
         }
 
         found->hook(found->level);
+        if (required_flag == LK_INIT_FLAG_PRIMARY_CPU) {
+            // Mark each boot hook's end on the boot timeline.
+            ktrace_boot_mark("init", found->name);
+        }
         last_called_level = found->level;
         last = found;
     }
@@ -17,6 +17,7 @@
 #include <kernel/mutex.h>
 #include <kernel/thread.h>
 #include <lib/heap.h>
+#include <lib/ktrace.h>
 #include <lk/init.h>
 #include <platform.h>
 #include <string.h>
@@ -49,34 +50,41 @@ void lk_main() {
     // early arch stuff
     lk_primary_cpu_init_level(LK_INIT_LEVEL_EARLIEST, LK_INIT_LEVEL_ARCH_EARLY - 1);
     arch_early_init();
+    ktrace_boot_mark("boot", "arch_early");
 
     // do any super early platform initialization
     lk_primary_cpu_init_level(LK_INIT_LEVEL_ARCH_EARLY, LK_INIT_LEVEL_PLATFORM_EARLY - 1);
     platform_early_init();
+    ktrace_boot_mark("boot", "platform_early");
 
     // do any super early target initialization
     lk_primary_cpu_init_level(LK_INIT_LEVEL_PLATFORM_EARLY, LK_INIT_LEVEL_TARGET_EARLY - 1);
     target_early_init();
+    ktrace_boot_mark("boot", "target_early");
 
     dprintf(INFO, "\nwelcome to Zircon\n\n");
 
     lk_primary_cpu_init_level(LK_INIT_LEVEL_TARGET_EARLY, LK_INIT_LEVEL_VM_PREHEAP - 1);
     dprintf(SPEW, "initializing vm pre-heap\n");
     vm_init_preheap();
+    ktrace_boot_mark("boot", "vm_preheap");
 
     // bring up the kernel heap
     lk_primary_cpu_init_level(LK_INIT_LEVEL_VM_PREHEAP, LK_INIT_LEVEL_HEAP - 1);
     dprintf(SPEW, "initializing heap\n");
     heap_init();
+    ktrace_boot_mark("boot", "heap");
 
     lk_primary_cpu_init_level(LK_INIT_LEVEL_HEAP, LK_INIT_LEVEL_VM - 1);
     dprintf(SPEW, "initializing vm\n");
     vm_init();
+    ktrace_boot_mark("boot", "vm");
 
     // initialize the kernel
     lk_primary_cpu_init_level(LK_INIT_LEVEL_VM, LK_INIT_LEVEL_KERNEL - 1);
     dprintf(SPEW, "initializing kernel\n");
     kernel_init();
+    ktrace_boot_mark("boot", "kernel");
 
     lk_primary_cpu_init_level(LK_INIT_LEVEL_KERNEL, LK_INIT_LEVEL_THREADING - 1);
 
@@ -96,19 +104,23 @@ static int bootstrap2(void*) {
 
     lk_primary_cpu_init_level(LK_INIT_LEVEL_THREADING, LK_INIT_LEVEL_ARCH - 1);
     arch_init();
+    ktrace_boot_mark("boot", "arch");
 
     // initialize the rest of the platform
     dprintf(SPEW, "initializing platform\n");
     lk_primary_cpu_init_level(LK_INIT_LEVEL_ARCH, LK_INIT_LEVEL_PLATFORM - 1);
     platform_init();
+    ktrace_boot_mark("boot", "platform");
 
     // initialize the target
     dprintf(SPEW, "initializing target\n");
     lk_primary_cpu_init_level(LK_INIT_LEVEL_PLATFORM, LK_INIT_LEVEL_TARGET - 1);
     target_init();
+    ktrace_boot_mark("boot", "target");
 
     dprintf(SPEW, "moving to last init level\n");
     lk_primary_cpu_init_level(LK_INIT_LEVEL_TARGET, LK_INIT_LEVEL_LAST);
+    ktrace_boot_mark("boot", "done");
 
     return 0;
 }
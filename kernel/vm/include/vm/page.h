@@ -29,6 +29,10 @@ typedef struct vm_page {
         struct {
             // in allocated/just freed state, use a linked list to hold the page in a queue
             struct list_node node;
+
+            // in the free state, the order of the pmm buddy block this page heads,
+            // or VM_PAGE_NOT_BLOCK_HEAD if it is inside a larger free block
+            uint8_t order;
         } free;
         struct {
             // attached to a vm object
@@ -45,6 +49,8 @@ typedef struct vm_page {
     };
 } vm_page_t;
 
+#define VM_PAGE_NOT_BLOCK_HEAD UINT8_MAX
+
 // pmm will maintain pages of this size
 #define VM_PAGE_STRUCT_SIZE (sizeof(vm_page_t))
 static_assert(sizeof(vm_page_t) == 32, "");
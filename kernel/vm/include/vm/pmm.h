@@ -28,6 +28,24 @@ typedef struct pmm_arena_info {
 // Add a pre-filled memory arena to the physical allocator.
 zx_status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 
+// NUMA topology. Platforms that know it describe it once the firmware tables
+// are available, which is after the arenas have been added; until then, and
+// on platforms that never do, all memory and cpus are on node 0. Allocations
+// take pages from the arenas on the calling cpu's node first, then from the
+// other nodes in order of distance.
+#define PMM_MAX_NUMA_NODES 8
+
+// Marks the arenas starting in [base, base + size) as attached to |node|.
+void pmm_numa_set_range_node(paddr_t base, size_t size, uint node);
+
+// Sets the node of |cpu|.
+void pmm_numa_set_cpu_node(uint cpu, uint node);
+
+// Sets the relative distance from |from| to |to|, as in the ACPI SLIT: 10 for
+// a node to itself, larger for farther nodes. Nodes default to 10 to
+// themselves and 20 to everything else.
+void pmm_numa_set_distance(uint from, uint to, uint8_t distance);
+
 // flags for allocation routines below
 #define PMM_ALLOC_FLAG_ANY (0x0)  // no restrictions on which arena to allocate from
 #define PMM_ALLOC_FLAG_KMAP (0x1) // allocate only from arenas marked KMAP
@@ -40,6 +58,14 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) _
 // Allocate a single page of physical memory.
 vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa);
 
+// Allocate a single page filled with zeros, preferring the pool of pages that
+// are zeroed in the background.
+vm_page_t* pmm_alloc_zeroed_page(uint alloc_flags, paddr_t* pa);
+
+// Allocate a set of pages filled with zeros and add them to the tail of |list|,
+// preferring the background zeroed pool. Returns the number of pages allocated.
+size_t pmm_alloc_zeroed_pages(size_t count, uint alloc_flags, struct list_node* list) __NONNULL((3));
+
 // Allocate a specific range of physical pages, adding to the tail of the passed list.
 // Returns the number of pages allocated.
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list);
@@ -54,6 +80,11 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t align_log2,
 // Returns the number of pages freed.
 size_t pmm_free(struct list_node* list) __NONNULL((1));
 
+// Free a list of |count| physical pages some time later, from a background
+// thread, so that the caller doesn't have to wait for the pages to be handed
+// back to the arenas. The pages count as free straight away. Empties |list|.
+void pmm_free_deferred(struct list_node* list, size_t count) __NONNULL((1));
+
 // Helper routine for the above.
 size_t pmm_free_page(vm_page_t* page) __NONNULL((1));
 
@@ -59,7 +59,9 @@ class VmEnumerator {
 public:
     // VmAspace::EnumerateChildren() will call the On* methods in depth-first
     // pre-order. If any call returns false, the traversal will stop. The root
-    // VmAspace's lock will be held during the entire traversal.
+    // VmAspace's lock will be held for reading during each call, but it is
+    // dropped between batches of calls, so the tree may change part way
+    // through a traversal.
     // |depth| will be 0 for the root VmAddressRegion.
     virtual bool OnVmAddressRegion(const VmAddressRegion* vmar, uint depth) {
         return true;
@@ -76,6 +78,22 @@ protected:
     ~VmEnumerator() = default;
 };
 
+// Where a traversal started by VmAspace::EnumerateChildren() has got to.
+// Depth-first pre-order visits nodes in increasing (base, depth) order, so the
+// last node visited is enough to pick the traversal up again after the tree
+// has changed.
+struct VmEnumeratorCursor {
+    // The last node visited, if |started|.
+    vaddr_t base = 0;
+    uint depth = 0;
+    bool started = false;
+
+    // Nodes left to visit before the traversal pauses to drop the lock, and
+    // whether it paused.
+    size_t budget = 0;
+    bool paused = false;
+};
+
 // A VmAddressRegion represents a contiguous region of the virtual address
 // space.  It is partitioned by non-overlapping children of the following types:
 // 1) child VmAddressRegion
@@ -197,6 +215,34 @@ protected:
 
     // node for element in list of parent's children.
     fbl::WAVLTreeNodeState<fbl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
+
+    // Summary of the subtree rooted at this node in the parent's list of
+    // children, which lets the allocators skip over every part of the
+    // address space too crowded to hold a new region.
+    struct SubtreeState {
+        vaddr_t first_byte; // first byte of the lowest node in the subtree
+        vaddr_t last_byte;  // last byte of the highest node in the subtree
+        size_t max_gap;     // largest gap between two nodes in the subtree
+    };
+    SubtreeState subtree_state_ = {};
+
+    // Recompute |subtree_state_| from this node and its children.
+    void UpdateSubtreeStateLocked();
+
+    // Recompute |subtree_state_| for this node and all of its ancestors in
+    // the parent's list of children.  Must be called after changing the
+    // size of a node which is in the list.
+    void PropagateSubtreeStateLocked();
+
+    // WAVL tree observer which keeps |subtree_state_| up to date.
+    struct SubtreeObserver : public fbl::tests::intrusive_containers::DefaultWAVLTreeObserver {
+        static constexpr bool kTracksSubtrees = true;
+
+        template <typename TreeType>
+        static void RecordSubtreeChanged(VmAddressRegionOrMapping* node) {
+            node->UpdateSubtreeStateLocked();
+        }
+    };
 };
 
 // A representation of a contiguous range of virtual address space
@@ -246,9 +292,12 @@ protected:
     explicit VmAddressRegion(VmAspace& kernel_aspace);
     // Count the allocated pages, caller must be holding the aspace lock
     size_t AllocatedPagesLocked() const override;
-    // Used to implement VmAspace::EnumerateChildren.
+    // Used to implement VmAspace::EnumerateChildren.  Visits the nodes after
+    // |cursor| and returns false if |ve| stopped the traversal or the cursor's
+    // budget ran out, in which case |cursor->paused| is set.
     // |aspace_->lock()| must be held.
-    virtual bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth);
+    virtual bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth,
+                                         VmEnumeratorCursor* cursor);
 
     friend class VmMapping;
     // Remove *region* from the subregion list
@@ -259,7 +308,7 @@ protected:
 private:
     using ChildList = fbl::WAVLTree<vaddr_t, fbl::RefPtr<VmAddressRegionOrMapping>,
                                     fbl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                    WAVLTreeTraits>;
+                                    WAVLTreeTraits, SubtreeObserver>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -322,9 +371,19 @@ private:
     // Utility for allocators for iterating over gaps between allocations
     // F should have a signature of bool func(vaddr_t gap_base, size_t gap_size).
     // If func returns false, the iteration stops.  gap_base will be aligned in
-    // accordance with align_pow2.
+    // accordance with align_pow2.  Gaps smaller than min_size may be skipped.
+    template <typename F>
+    void ForEachGap(F func, uint8_t align_pow2, size_t min_size);
+
+    // Calls func(prev, next) for each pair of neighboring children, in
+    // address order, with at least min_size bytes between them, skipping
+    // whole subtrees which have no such gap.  If func returns false, the
+    // iteration stops and false is returned.  The gaps before the first
+    // child and after the last are not visited.
     template <typename F>
-    void ForEachGap(F func, uint8_t align_pow2);
+    bool ForEachChildGapLocked(size_t min_size, F func);
+    template <typename F>
+    bool ForEachChildGapLocked(VmAddressRegionOrMapping* node, size_t min_size, F func);
 
     // list of subregions, indexed by base address
     ChildList subregions_;
@@ -396,7 +455,8 @@ public:
         return;
     }
 
-    bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth) override {
+    bool EnumerateChildrenLocked(VmEnumerator* ve, uint depth,
+                                 VmEnumeratorCursor* cursor) override {
         return false;
     }
 };
@@ -444,6 +504,9 @@ protected:
     // unmap any pages that map the passed in vmo range. May not intersect with this range
     zx_status_t UnmapVmoRangeLocked(uint64_t start, uint64_t size) const;
 
+    // map any pages that map the passed in vmo range read-only, so writes fault
+    zx_status_t WriteProtectVmoRangeLocked(uint64_t start, uint64_t size) const;
+
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmMapping);
 
@@ -477,6 +540,11 @@ private:
     // in Clang around capability aliasing, we need to relax the analysis.
     void ActivateLocked();
 
+    // Called after a fault at |va| was resolved with |mmu_flags|. If faults are
+    // arriving sequentially, fault in and map the pages after |va| as well.
+    // Must be called with the object_ lock held.
+    void FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags) TA_NO_THREAD_SAFETY_ANALYSIS;
+
     // pointer and region of the object we are mapping
     fbl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
@@ -486,4 +554,12 @@ private:
 
     // used to detect recursions through the vmo fault path
     bool currently_faulting_ = false;
+
+    // sequential fault detection for fault-around. a fault at next_fault_va_
+    // grows the window, any other fault resets it. faults only hold the aspace
+    // lock shared, so these are guarded by the object lock.
+    static constexpr size_t kFaultAroundMinPages = 4;
+    static constexpr size_t kFaultAroundMaxPages = 16;
+    vaddr_t next_fault_va_ = 0;
+    size_t fault_around_pages_ = 0;
 };
@@ -15,7 +15,7 @@
 #include <fbl/macros.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
-#include <kernel/mutex.h>
+#include <kernel/rwlock.h>
 #include <lib/crypto/prng.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/vm.h>
@@ -76,7 +76,14 @@ public:
     // Traverses the VM tree rooted at this node, in depth-first pre-order. If
     // any methods of |ve| return false, the traversal stops and this method
     // returns false. Returns true otherwise.
+    //
+    // The aspace lock is only held for reading, and is dropped every
+    // kEnumerateBatch nodes so that diagnostics walking a large address space
+    // don't hold off the process's own mapping changes for the whole walk.
+    // Nodes added or removed while the lock was dropped may or may not be
+    // visited; every other node is visited exactly once.
     bool EnumerateChildren(VmEnumerator* ve);
+    static constexpr size_t kEnumerateBatch = 64;
 
     // A collection of memory usage counts.
     struct vm_usage_t {
@@ -147,11 +154,12 @@ public:
 
 protected:
     // Share the aspace lock with VmAddressRegion/VmMapping so they can serialize
-    // changes to the aspace.
+    // changes to the aspace. Page faults only hold it shared, anything that
+    // changes the region tree or a mapping's range or flags holds it exclusive.
     friend class VmAddressRegionOrMapping;
     friend class VmAddressRegion;
     friend class VmMapping;
-    mutex_t* lock() { return &lock_; }
+    rwlock_t* lock() { return &lock_; }
 
     // Expose the PRNG for ASLR to VmAddressRegion
     crypto::PRNG& AslrPrng() {
@@ -188,7 +196,7 @@ private:
     bool aspace_destroyed_ = false;
     bool aslr_enabled_ = false;
 
-    mutable mutex_t lock_ = MUTEX_INITIAL_VALUE(lock_);
+    mutable rwlock_t lock_ = RWLOCK_INITIAL_VALUE(lock_);
 
     // root of virtual address space
     // Access to this reference is guarded by lock_.
@@ -71,6 +71,20 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // move the pages backing a page aligned range out of the vmo and onto the
+    // tail of |pages| in offset order, committing any that are missing first.
+    // the range reads as zero afterwards.
+    virtual zx_status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    // replace the pages backing a page aligned range with the ones on |pages|,
+    // as handed out by TakePages(). on success the list is left empty, on
+    // failure it holds the pages that were not placed.
+    virtual zx_status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // Pin the given range of the vmo.  If any pages are not committed, this
     // returns a ZX_ERR_NO_MEMORY.
     virtual zx_status_t Pin(uint64_t offset, uint64_t len) {
@@ -84,6 +98,22 @@ public:
         panic("Unpin should only be called on a pinned range");
     }
 
+    // Lock or unlock the pages of a discardable vmo. While a discardable vmo
+    // is not locked its pages can be freed under memory pressure; locking it
+    // sets |was_discarded| if that happened since it was last locked.
+    virtual zx_status_t LockDiscardable(bool* was_discarded) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    virtual zx_status_t UnlockDiscardable() {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    // Free committed pages that hold nothing but zeroes, so that they read
+    // as the shared zero page again. Returns the number of pages freed.
+    virtual size_t DedupZeroPages() {
+        return 0;
+    }
+
     // read/write operators against kernel pointers only
     virtual zx_status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) {
         return ZX_ERR_NOT_SUPPORTED;
@@ -92,6 +122,14 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // copy |len| bytes at |src_offset| in |src| to |offset| in this vmo,
+    // without going through a user buffer; overlapping ranges of the same
+    // vmo are copied as if by memmove
+    virtual zx_status_t CopyFrom(VmObject* src, uint64_t src_offset, uint64_t offset,
+                                 size_t len) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // execute lookup_fn on a given range of physical addresses within the vmo
     virtual zx_status_t Lookup(uint64_t offset, uint64_t len, uint pf_flags,
                                vmo_lookup_fn_t lookup_fn, void* context) {
@@ -113,6 +151,20 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // Start or stop recording which pages are written. Starting again forgets
+    // what was recorded so far.
+    virtual zx_status_t TrackDirty(bool enable) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    // Store a bitmap of the pages in the range written since tracking started
+    // or since they were last queried, one bit per page and lowest offset in
+    // the lowest bit, then forget those writes.
+    virtual zx_status_t QueryDirtyUser(uint64_t offset, uint64_t len, user_inout_ptr<uint8_t> buffer,
+                                       size_t buffer_size) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     // Returns a null-terminated name, or the empty string if set_name() has not
     // been called.
     void get_name(char* out_name, size_t len) const;
@@ -163,6 +215,18 @@ public:
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // If an intermediate parent in this object's clone chain is reachable only
+    // through its single child, fold it into that child so lookups have one less
+    // level to walk. The folded parent's last reference is moved to |collapsed|,
+    // to be dropped by the caller once the lock is released.
+    virtual void CollapseChainLocked(fbl::RefPtr<VmObject>* collapsed) TA_REQ(lock_) {}
+
+    // Returns the number of ancestors above this VMO in its clone chain; zero
+    // if it is not a clone.
+    uint32_t chain_depth() const
+        // Walks the parents, which share our lock, confusing analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
     // Returns true if this VMO was created via CloneCOW().
     // TODO: If more types of clones appear, replace this with a method that
     // returns an enum rather than adding a new method for each clone type.
@@ -170,11 +234,21 @@ public:
 
     // get a pointer to the page structure and/or physical address at the specified offset.
     // valid flags are VMM_PF_FLAG_*
+    // pages needed to fault in the offset are taken from |free_list| first, if it is
+    // not null. they must already be zeroed.
     virtual zx_status_t GetPageLocked(uint64_t offset, uint pf_flags, list_node* free_list,
                                       vm_page_t** page, paddr_t* pa) TA_REQ(lock_) {
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    // get the physical address of a committed, naturally aligned run of physically
+    // contiguous pages of kLargePageSize starting at |offset|, which must be aligned
+    // to kLargePageSize. returns ZX_ERR_NOT_FOUND if the range is not backed by such a run.
+    static constexpr uint64_t kLargePageSize = 1ull << 21;
+    virtual zx_status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
     fbl::Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     fbl::Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
@@ -209,6 +283,33 @@ public:
         return ZX_OK;
     }
 
+    // Like ForEach(), but calls |func(const fbl::RefPtr<VmObject>&)| without
+    // the global lock held, so that |func| may take the object's lock. VMOs
+    // created or destroyed during the walk may or may not be visited.
+    template <typename T>
+    static void ForEachRef(T func) {
+        fbl::RefPtr<VmObject> vmo;
+        for (;;) {
+            fbl::RefPtr<VmObject> next;
+            {
+                fbl::AutoLock a(&all_vmos_lock_);
+                // holding |vmo| keeps it on the list to resume from
+                auto it = vmo ? ++all_vmos_.make_iterator(*vmo) : all_vmos_.begin();
+                for (; it.IsValid(); ++it) {
+                    // skip objects that are already being destroyed
+                    next = fbl::internal::MakeRefPtrUpgradeFromRaw(&*it, all_vmos_lock_);
+                    if (next)
+                        break;
+                }
+            }
+            // the old reference may be the last one, so drop it unlocked
+            vmo = fbl::move(next);
+            if (!vmo)
+                return;
+            func(vmo);
+        }
+    }
+
 protected:
     // private constructor (use Create())
     explicit VmObject(fbl::RefPtr<VmObject> parent);
@@ -224,6 +325,10 @@ protected:
     // inform all mappings and children that a range of this vmo's pages were added or removed.
     void RangeChangeUpdateLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
 
+    // drop write permission for the range from all of our mappings, so the
+    // next write to any of it faults
+    void WriteProtectMappingsLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
+
     // above call but called from a parent
     virtual void RangeChangeUpdateFromParentLocked(uint64_t offset, uint64_t len)
         // Called under the parent's lock, which confuses analysis.
@@ -11,6 +11,7 @@
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/macros.h>
+#include <fbl/mutex.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <kernel/mutex.h>
@@ -27,10 +28,25 @@
 // the main VM object type, holding a list of pages
 class VmObjectPaged final : public VmObject {
 public:
+    // |options| for Create()
+    // Commit memory in naturally aligned runs of kLargePageSize where possible, so
+    // mappings of the object can use large pages.
+    static constexpr uint32_t kLargePages = (1u << 0);
+    // Let the pages be freed under memory pressure while the object is not
+    // locked with LockDiscardable(). Discardable objects can't be cloned.
+    static constexpr uint32_t kDiscardable = (1u << 1);
+
     static zx_status_t Create(uint32_t pmm_alloc_flags, uint64_t size, fbl::RefPtr<VmObject>* vmo);
+    static zx_status_t Create(uint32_t pmm_alloc_flags, uint32_t options, uint64_t size,
+                              fbl::RefPtr<VmObject>* vmo);
 
     static zx_status_t CreateFromROData(const void* data, size_t size, fbl::RefPtr<VmObject>* vmo);
 
+    // Frees the pages of unlocked discardable objects, least recently
+    // unlocked first, until at least |target_pages| have been freed or there
+    // is nothing left to discard. Returns the number of pages freed.
+    static size_t DiscardUnlockedPages(size_t target_pages);
+
     zx_status_t Resize(uint64_t size) override;
     zx_status_t ResizeLocked(uint64_t size) override TA_REQ(lock_);
     uint64_t size() const override
@@ -45,12 +61,21 @@ public:
     zx_status_t CommitRangeContiguous(uint64_t offset, uint64_t len, uint64_t* committed,
                                       uint8_t alignment_log2) override;
     zx_status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) override;
+    zx_status_t TakePages(uint64_t offset, uint64_t len, list_node* pages) override;
+    zx_status_t SupplyPages(uint64_t offset, uint64_t len, list_node* pages) override;
 
     zx_status_t Pin(uint64_t offset, uint64_t len) override;
     void Unpin(uint64_t offset, uint64_t len) override;
 
+    zx_status_t LockDiscardable(bool* was_discarded) override;
+    zx_status_t UnlockDiscardable() override;
+
+    size_t DedupZeroPages() override;
+
     zx_status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) override;
     zx_status_t Write(const void* ptr, uint64_t offset, size_t len, size_t* bytes_written) override;
+    zx_status_t CopyFrom(VmObject* src, uint64_t src_offset, uint64_t offset,
+                         size_t len) override;
     zx_status_t Lookup(uint64_t offset, uint64_t len, uint pf_flags,
                        vmo_lookup_fn_t lookup_fn, void* context) override;
 
@@ -62,6 +87,10 @@ public:
     zx_status_t LookupUser(uint64_t offset, uint64_t len, user_inout_ptr<paddr_t> buffer,
                            size_t buffer_size) override;
 
+    zx_status_t TrackDirty(bool enable) override;
+    zx_status_t QueryDirtyUser(uint64_t offset, uint64_t len, user_inout_ptr<uint8_t> buffer,
+                               size_t buffer_size) override;
+
     void Dump(uint depth, bool verbose) override;
 
     zx_status_t InvalidateCache(const uint64_t offset, const uint64_t len) override;
@@ -74,18 +103,24 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    zx_status_t GetLargePageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
     zx_status_t CloneCOW(uint64_t offset, uint64_t size, bool copy_name,
                          fbl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    void CollapseChainLocked(fbl::RefPtr<VmObject>* collapsed) override
+        // Modifies the locked state of our ancestors, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
     void RangeChangeUpdateFromParentLocked(uint64_t offset, uint64_t len) override
         // Called under the parent's lock, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags, fbl::RefPtr<VmObject> parent);
+    VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options, fbl::RefPtr<VmObject> parent);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
@@ -110,9 +145,25 @@ private:
     zx_status_t PinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
     void UnpinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
 
+    // frees all of our pages if we are discardable and unlocked. returns the
+    // number of pages freed.
+    size_t Discard();
+
     // internal check if any pages in a range are pinned
     bool AnyPagesPinnedLocked(uint64_t offset, size_t len) TA_REQ(lock_);
 
+    // try to commit the empty, kLargePageSize aligned run containing |offset| with
+    // one contiguous allocation. returns false if the run can't be committed that way.
+    bool CommitLargePageLocked(uint64_t offset) TA_REQ(lock_);
+
+    // note that the page at |offset| may have been written, if dirty tracking is on
+    void MarkDirtyLocked(uint64_t offset) TA_REQ(lock_);
+
+    // move the dirty bits of the |pages| pages starting at |offset| into |bits|
+    // and write protect those pages again. RestoreDirtyLocked() puts them back.
+    void TakeDirtyLocked(uint64_t offset, size_t pages, uint64_t* bits) TA_REQ(lock_);
+    void RestoreDirtyLocked(uint64_t offset, size_t pages, const uint64_t* bits) TA_REQ(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     zx_status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
@@ -121,14 +172,48 @@ private:
     // set our offset within our parent
     zx_status_t SetParentOffsetLocked(uint64_t o) TA_REQ(lock_);
 
+    // take over the pages of our parent that we can see and replace it with our
+    // grandparent, if the parent is an intermediate clone only we refer to.
+    // returns false if the parent can't be collapsed.
+    bool CollapseParentLocked(fbl::RefPtr<VmObject>* collapsed)
+        // Modifies the locked state of our ancestors, which confuses analysis.
+        TA_NO_THREAD_SAFETY_ANALYSIS;
+
     // maximum size of a VMO is one page less than the full 64bit range
     static const uint64_t MAX_SIZE = ROUNDDOWN(UINT64_MAX, PAGE_SIZE);
 
     // members
     uint64_t size_ TA_GUARDED(lock_) = 0;
     uint64_t parent_offset_ TA_GUARDED(lock_) = 0;
+    // offsets at or past this are not backed by the parent. only set once an
+    // intermediate parent has been collapsed and its size no longer bounds us.
+    uint64_t parent_limit_ TA_GUARDED(lock_) = UINT64_MAX;
     uint32_t pmm_alloc_flags_ TA_GUARDED(lock_) = PMM_ALLOC_FLAG_ANY;
+    const uint32_t options_;
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
+
+    // for discardable objects: the number of LockDiscardable() calls not yet
+    // undone, and whether our pages were freed since the last one.
+    uint32_t discardable_lock_count_ TA_GUARDED(lock_) = 0;
+    bool discarded_ TA_GUARDED(lock_) = false;
+
+    // one bit per page, set for pages written since they were last queried.
+    // empty unless dirty tracking is on.
+    fbl::Array<uint64_t> dirty_bits_ TA_GUARDED(lock_);
+
+    // Unlocked discardable objects, least recently unlocked at the front.
+    // An object is on the list iff its lock count is zero; taken after the
+    // object's own lock.
+    fbl::DoublyLinkedListNodeState<VmObjectPaged*> discardable_node_;
+    struct DiscardableListTraits {
+        static fbl::DoublyLinkedListNodeState<VmObjectPaged*>& node_state(VmObjectPaged& obj) {
+            return obj.discardable_node_;
+        }
+    };
+    using DiscardableList = fbl::DoublyLinkedList<VmObjectPaged*, DiscardableListTraits>;
+
+    static fbl::Mutex discardable_lock_;
+    static DiscardableList discardable_list_ TA_GUARDED(discardable_lock_);
 };
@@ -7,16 +7,16 @@
 #pragma once
 
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/canary.h>
-#include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
-#include <fbl/unique_ptr.h>
 #include <vm/vm.h>
 #include <zircon/types.h>
 
 struct vm_page;
 
-class VmPageListNode final : public fbl::WAVLTreeContainable<fbl::unique_ptr<VmPageListNode>> {
+// Leaf of the page list radix tree, holding kPageFanOut consecutive pages.
+class VmPageListNode final {
 public:
     explicit VmPageListNode(uint64_t offset);
     ~VmPageListNode();
@@ -27,7 +27,6 @@ public:
 
     // accessors
     uint64_t offset() const { return obj_offset_; }
-    uint64_t GetKey() const { return obj_offset_; }
 
     // for every valid page in the node call the passed in function
     template <typename T>
@@ -100,6 +99,75 @@ private:
     vm_page* pages_[kPageFanOut] = {};
 };
 
+// Interior node of the page list radix tree. Each slot covers an aligned,
+// equally sized slice of the node's range and points at either another
+// interior node or, on the lowest level, a leaf. A bitmap of the populated
+// slots lets walks skip over holes without touching the slot array.
+class VmPageListInnerNode final {
+public:
+    VmPageListInnerNode();
+    ~VmPageListInnerNode();
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageListInnerNode);
+
+    static const size_t kFanOutShift = 6;
+    static const size_t kFanOut = 1u << kFanOutShift;
+
+    union Slot {
+        VmPageListInnerNode* inner;
+        VmPageListNode* leaf;
+    };
+
+    bool IsPresent(size_t index) const {
+        DEBUG_ASSERT(index < kFanOut);
+        return (present_ & (1ull << index)) != 0;
+    }
+    bool IsEmpty() const { return present_ == 0; }
+
+    // bitmap of the populated slots in [first, last)
+    uint64_t PresentInRange(size_t first, size_t last) const {
+        DEBUG_ASSERT(first < last && last <= kFanOut);
+        uint64_t mask = (last == kFanOut) ? ~0ull : (1ull << last) - 1;
+        return present_ & mask & ~((1ull << first) - 1);
+    }
+
+    Slot& slot(size_t index) {
+        DEBUG_ASSERT(IsPresent(index));
+        return slots_[index];
+    }
+    VmPageListInnerNode* inner(size_t index) { return slot(index).inner; }
+    const VmPageListInnerNode* inner(size_t index) const {
+        DEBUG_ASSERT(IsPresent(index));
+        return slots_[index].inner;
+    }
+    VmPageListNode* leaf(size_t index) { return slot(index).leaf; }
+    const VmPageListNode* leaf(size_t index) const {
+        DEBUG_ASSERT(IsPresent(index));
+        return slots_[index].leaf;
+    }
+
+    void SetSlot(size_t index, Slot s) {
+        DEBUG_ASSERT(!IsPresent(index));
+        slots_[index] = s;
+        present_ |= (1ull << index);
+    }
+    void ClearSlot(size_t index) {
+        DEBUG_ASSERT(IsPresent(index));
+        slots_[index].inner = nullptr;
+        present_ &= ~(1ull << index);
+    }
+
+private:
+    fbl::Canary<fbl::magic("PLIN")> canary_;
+
+    uint64_t present_ = 0;
+    Slot slots_[kFanOut] = {};
+};
+
+// Sparse map of object offsets to pages, kept as a radix tree. Leaves hold
+// runs of VmPageListNode::kPageFanOut pages and the tree only grows as tall
+// as the largest offset requires, so lookups cost a handful of indexed loads
+// rather than a balanced tree search.
 class VmPageList final {
 public:
     VmPageList();
@@ -107,91 +175,140 @@ public:
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmPageList);
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, kMaxEndOffset);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page
     template <typename T>
     zx_status_t ForEveryPage(T per_page_func) const {
-        for (auto& pl : list_) {
-            zx_status_t status = pl.ForEveryPage(per_page_func, pl.offset(),
-                                                 pl.offset() + pl.kPageFanOut * PAGE_SIZE);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
-        }
-        return ZX_OK;
+        return ForEveryPageInRange(per_page_func, 0, kMaxEndOffset);
     }
 
-    // walk the page tree, calling the passed in function on every tree node
+    // walk the page tree, calling the passed in function on every page in
+    // [start_offset, end_offset)
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset, uint64_t end_offset) {
         DEBUG_ASSERT(IS_PAGE_ALIGNED(start_offset) && IS_PAGE_ALIGNED(end_offset));
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
-        }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
+        if (IsEmpty()) {
+            return ZX_OK;
         }
-        return ZX_OK;
+        zx_status_t status;
+        if (height_ == 0) {
+            status = root_.leaf->ForEveryPage(per_page_func, start_offset, end_offset);
+        } else {
+            status = ForEveryPageInNode(root_.inner, height_, 0, per_page_func,
+                                        start_offset, end_offset);
+        }
+        return (status == ZX_ERR_NEXT || status == ZX_ERR_STOP) ? ZX_OK : status;
     }
 
     template <typename T>
     zx_status_t ForEveryPageInRange(T per_page_func, uint64_t start_offset,
                                     uint64_t end_offset) const {
         DEBUG_ASSERT(IS_PAGE_ALIGNED(start_offset) && IS_PAGE_ALIGNED(end_offset));
-        // Find the first node with a start after start_offset; if start_offset
-        // is in a node, it'll be in the one before it.
-        auto start = --list_.upper_bound(start_offset);
-        if (!start.IsValid()) {
-            start = list_.begin();
-        }
-        const auto end = list_.lower_bound(end_offset);
-        for (auto itr = start; itr != end; ++itr) {
-            auto& pl = *itr;
-            zx_status_t status = pl.ForEveryPage(per_page_func, start_offset, end_offset);
-            if (unlikely(status != ZX_ERR_NEXT)) {
-                if (status == ZX_ERR_STOP) {
-                    break;
-                }
-                return status;
-            }
+        if (IsEmpty()) {
+            return ZX_OK;
+        }
+        zx_status_t status;
+        if (height_ == 0) {
+            const VmPageListNode* leaf = root_.leaf;
+            status = leaf->ForEveryPage(per_page_func, start_offset, end_offset);
+        } else {
+            const VmPageListInnerNode* node = root_.inner;
+            status = ForEveryPageInNode(node, height_, 0, per_page_func,
+                                        start_offset, end_offset);
         }
-        return ZX_OK;
+        return (status == ZX_ERR_NEXT || status == ZX_ERR_STOP) ? ZX_OK : status;
     }
 
     zx_status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
+    // unlinks the page at |offset| from the list and returns it, or nullptr
+    // if there is none. the caller owns the page afterwards.
+    vm_page* RemovePage(uint64_t offset);
     zx_status_t FreePage(uint64_t offset);
     size_t FreeAllPages();
+    // unlinks every page and appends them to |list| instead of freeing them.
+    // returns the number of pages moved.
+    size_t TakeAllPages(list_node* list);
 
 private:
-    fbl::WAVLTree<uint64_t, fbl::unique_ptr<VmPageListNode>> list_;
+    using Slot = VmPageListInnerNode::Slot;
+
+    // log2 of the range of offsets covered by a leaf
+    static const uint kLeafShift = PAGE_SIZE_SHIFT + 4;
+    static_assert((1ull << kLeafShift) == VmPageListNode::kPageFanOut * PAGE_SIZE, "");
+
+    // tallest tree needed to span the full 64 bit offset space
+    static const uint kMaxHeight = (64 - kLeafShift + VmPageListInnerNode::kFanOutShift - 1) /
+                                   VmPageListInnerNode::kFanOutShift;
+
+    static const uint64_t kMaxEndOffset = ROUNDDOWN(UINT64_MAX, PAGE_SIZE);
+
+    // log2 of the range covered by one slot of a node at |height|; leaves are
+    // at height 0
+    static uint SlotShift(uint height) {
+        return kLeafShift + (height - 1) * static_cast<uint>(VmPageListInnerNode::kFanOutShift);
+    }
+    static size_t SlotIndex(uint64_t offset, uint height) {
+        return (offset >> SlotShift(height)) & (VmPageListInnerNode::kFanOut - 1);
+    }
+
+    // call |func| on every page under |node|, which sits at |height| and
+    // starts at |node_offset|, that falls in [start_offset, end_offset)
+    template <typename NodeT, typename T>
+    static zx_status_t ForEveryPageInNode(NodeT* node, uint height, uint64_t node_offset, T& func,
+                                          uint64_t start_offset, uint64_t end_offset) {
+        if (end_offset <= node_offset) {
+            return ZX_ERR_NEXT;
+        }
+        const uint shift = SlotShift(height);
+        size_t first = 0;
+        size_t last = VmPageListInnerNode::kFanOut;
+        if (start_offset > node_offset) {
+            first = static_cast<size_t>(fbl::min<uint64_t>((start_offset - node_offset) >> shift,
+                                                           last));
+        }
+        last = static_cast<size_t>(fbl::min<uint64_t>(((end_offset - node_offset - 1) >> shift) + 1,
+                                                      last));
+        if (first >= last) {
+            return ZX_ERR_NEXT;
+        }
+        uint64_t present = node->PresentInRange(first, last);
+        while (present) {
+            size_t i = __builtin_ctzll(present);
+            present &= present - 1;
+
+            zx_status_t status;
+            if (height == 1) {
+                status = node->leaf(i)->ForEveryPage(func, start_offset, end_offset);
+            } else {
+                status = ForEveryPageInNode(node->inner(i), height - 1,
+                                            node_offset + (static_cast<uint64_t>(i) << shift),
+                                            func, start_offset, end_offset);
+            }
+            if (unlikely(status != ZX_ERR_NEXT)) {
+                return status;
+            }
+        }
+        return ZX_ERR_NEXT;
+    }
+
+    bool IsEmpty() const { return height_ == 0 ? root_.leaf == nullptr : root_.inner == nullptr; }
+    bool RootCovers(uint64_t offset) const {
+        uint shift = SlotShift(height_ + 1);
+        return shift >= 64 || (offset >> shift) == 0;
+    }
+
+    static zx_status_t AllocSlot(Slot* slot, uint height, uint64_t offset);
+    static void FreeSlot(Slot slot, uint height);
+    static bool PruneSlot(Slot* slot, uint height, uint64_t offset);
+    void PruneEmptyNodes(uint64_t offset);
+
+    // number of levels of inner nodes above the leaves
+    uint height_ = 0;
+    Slot root_ = {};
 };
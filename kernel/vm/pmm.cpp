@@ -10,9 +10,14 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/align.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
 #include <kernel/mp.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <lk/init.h>
 #include <platform.h>
 #include <pow2.h>
@@ -42,6 +47,89 @@ static fbl::Mutex arena_lock;
 static fbl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+// set if every arena is KMAP, so any page can satisfy a PMM_ALLOC_FLAG_KMAP request
+static bool all_arenas_kmap = true;
+
+// NUMA placement, see pmm_numa_set_range_node(). numa_order[n] lists the nodes
+// by increasing distance from node n. These are only written by the platform
+// during boot, before the secondary cpus run, so they are read without a lock.
+static bool numa_enabled;
+static uint8_t numa_cpu_node[SMP_MAX_CPUS];
+static uint8_t numa_distance[PMM_MAX_NUMA_NODES][PMM_MAX_NUMA_NODES];
+static uint8_t numa_order[PMM_MAX_NUMA_NODES][PMM_MAX_NUMA_NODES];
+
+// Each cpu keeps a small cache of free pages in front of the arenas so that
+// single page allocations and frees usually don't touch arena_lock. A cache is
+// only ever touched by its own cpu with interrupts disabled, so it needs no
+// lock of its own. Empty caches are refilled and full ones drained in batches
+// through the arenas.
+//
+// Cached pages stay in the ALLOC state as far as the arenas are concerned.
+#define PMM_PAGE_CACHE_MAX 64
+#define PMM_PAGE_CACHE_BATCH (PMM_PAGE_CACHE_MAX / 2)
+
+namespace {
+struct pmm_page_cache {
+    list_node pages;
+    size_t count;
+} __CPU_ALIGN;
+} // namespace
+
+static pmm_page_cache page_cache[SMP_MAX_CPUS];
+static bool page_cache_enabled;
+
+KCOUNTER(pmm_cache_alloc_hit, "kernel.pmm.cache.alloc_hit");
+KCOUNTER(pmm_cache_alloc_miss, "kernel.pmm.cache.alloc_miss");
+KCOUNTER(pmm_cache_free_hit, "kernel.pmm.cache.free_hit");
+KCOUNTER(pmm_cache_free_drain, "kernel.pmm.cache.free_drain");
+
+static void pmm_page_cache_init(uint level) {
+    for (auto& c : page_cache) {
+        list_initialize(&c.pages);
+        c.count = 0;
+    }
+    // The fill checks in the arenas don't know about cached pages.
+    page_cache_enabled = !PMM_ENABLE_FREE_FILL;
+}
+LK_INIT_HOOK(pmm_page_cache, &pmm_page_cache_init, LK_INIT_LEVEL_VM);
+
+// Pool of free pages that have already been zeroed, so that zero-fill faults
+// don't have to pay for it. A lowest priority thread tops the pool back up to
+// the high watermark whenever it drops below the low one, which means it only
+// gets to run when the system is otherwise idle.
+//
+// Pooled pages are in the ALLOC state as far as the arenas are concerned, but
+// are counted as free and handed out before any allocation fails.
+static fbl::Mutex zero_pool_lock;
+static list_node zero_pool TA_GUARDED(zero_pool_lock) = LIST_INITIAL_VALUE(zero_pool);
+static size_t zero_pool_count TA_GUARDED(zero_pool_lock);
+static size_t zero_pool_low;
+static size_t zero_pool_high;
+static bool zero_pool_enabled;
+static event_t zero_pool_event = EVENT_INITIAL_VALUE(zero_pool_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+KCOUNTER(pmm_zero_pool_hit, "kernel.pmm.zero_pool.hit");
+KCOUNTER(pmm_zero_pool_miss, "kernel.pmm.zero_pool.miss");
+KCOUNTER(pmm_zero_pool_fill, "kernel.pmm.zero_pool.fill");
+
+// Pages handed to pmm_free_deferred(), waiting for the reaper thread to give
+// them back to the arenas. The reaper frees them a batch at a time so that it
+// never holds the arena lock for long, however big the VMO being torn down
+// was. Like the zero pool, pending pages count as free, and an allocation
+// that would otherwise fail frees them all on the spot.
+static fbl::Mutex reaper_lock;
+static list_node reaper_list TA_GUARDED(reaper_lock) = LIST_INITIAL_VALUE(reaper_list);
+static size_t reaper_count TA_GUARDED(reaper_lock);
+static bool reaper_enabled;
+static event_t reaper_event = EVENT_INITIAL_VALUE(reaper_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// Number of pages the reaper frees per trip through the arena lock.
+static constexpr size_t kReaperBatchPages = 256;
+
+KCOUNTER(pmm_reaper_deferred, "kernel.pmm.reaper.deferred");
+KCOUNTER(pmm_reaper_freed, "kernel.pmm.reaper.freed");
+KCOUNTER(pmm_reaper_reclaimed, "kernel.pmm.reaper.reclaimed");
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -115,29 +203,319 @@ zx_status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANAL
 
 done_add:
     arena_cumulative_size += info->size;
+    if ((info->flags & PMM_ARENA_FLAG_KMAP) == 0)
+        all_arenas_kmap = false;
 
     return ZX_OK;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(&arena_lock);
+static uint8_t numa_get_distance(uint from, uint to) {
+    if (numa_distance[from][to])
+        return numa_distance[from][to];
+    return (from == to) ? 10 : 20;
+}
 
-    /* walk the arenas in order until we find one with a free page */
+static void numa_update_order() {
+    for (uint from = 0; from < PMM_MAX_NUMA_NODES; from++) {
+        uint8_t* order = numa_order[from];
+        for (uint i = 0; i < PMM_MAX_NUMA_NODES; i++) {
+            // insertion sort, keeping equal distances in node order
+            uint j = i;
+            for (; j > 0 && numa_get_distance(from, order[j - 1]) > numa_get_distance(from, i); j--)
+                order[j] = order[j - 1];
+            order[j] = static_cast<uint8_t>(i);
+        }
+    }
+    numa_enabled = true;
+}
+
+void pmm_numa_set_range_node(paddr_t base, size_t size, uint node) {
+    DEBUG_ASSERT(node < PMM_MAX_NUMA_NODES);
+
+    AutoLock al(&arena_lock);
     for (auto& a : arena_list) {
+        if (a.base() >= base && a.base() - base < size)
+            a.set_node(node);
+    }
+    numa_update_order();
+}
+
+void pmm_numa_set_cpu_node(uint cpu, uint node) {
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
+    DEBUG_ASSERT(node < PMM_MAX_NUMA_NODES);
+
+    numa_cpu_node[cpu] = static_cast<uint8_t>(node);
+}
+
+void pmm_numa_set_distance(uint from, uint to, uint8_t distance) {
+    DEBUG_ASSERT(from < PMM_MAX_NUMA_NODES && to < PMM_MAX_NUMA_NODES);
+
+    numa_distance[from][to] = distance;
+    numa_update_order();
+}
+
+// Calls |func| on the arenas that |alloc_flags| allows, those on the current
+// cpu's node first and then the others by distance, until it returns true.
+// The thread may migrate, so the node is only a hint.
+template <typename F>
+static void pmm_for_each_alloc_arena(uint alloc_flags, F func) TA_REQ(arena_lock) {
+    auto usable = [alloc_flags](const PmmArena& a) {
         /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+        return (alloc_flags & PMM_ALLOC_FLAG_KMAP) == 0 || (a.flags() & PMM_ARENA_FLAG_KMAP) != 0;
+    };
+
+    if (!numa_enabled) {
+        for (auto& a : arena_list) {
+            if (usable(a) && func(a))
+                return;
+        }
+        return;
+    }
+
+    const uint8_t* order = numa_order[numa_cpu_node[arch_curr_cpu_num()]];
+    for (uint i = 0; i < PMM_MAX_NUMA_NODES; i++) {
+        for (auto& a : arena_list) {
+            if (a.node() == order[i] && usable(a) && func(a))
+                return;
+        }
+    }
+}
+
+// Take a page from the local cpu's page cache, refilling it first if it is
+// empty. Returns nullptr if the arenas are out of pages as well.
+static vm_page_t* pmm_page_cache_alloc() {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    pmm_page_cache* c = &page_cache[arch_curr_cpu_num()];
+    vm_page_t* page = list_remove_head_type(&c->pages, vm_page_t, free.node);
+    if (likely(page)) {
+        c->count--;
+        kcounter_add(pmm_cache_alloc_hit, 1);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return page;
+    }
+
+    kcounter_add(pmm_cache_alloc_miss, 1);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // The arenas are behind a mutex, so refill with interrupts enabled. The
+    // thread may migrate meanwhile, in which case the batch lands in whichever
+    // cpu's cache it ends up on.
+    list_node batch = LIST_INITIAL_VALUE(batch);
+    if (pmm_alloc_pages(PMM_PAGE_CACHE_BATCH, all_arenas_kmap ? PMM_ALLOC_FLAG_KMAP : 0, &batch) == 0)
+        return nullptr;
+    page = list_remove_head_type(&batch, vm_page_t, free.node);
+
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    c = &page_cache[arch_curr_cpu_num()];
+    vm_page_t* p;
+    while ((p = list_remove_head_type(&batch, vm_page_t, free.node)) != nullptr) {
+        list_add_head(&c->pages, &p->free.node);
+        c->count++;
+    }
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    return page;
+}
+
+// Put a page in the local cpu's page cache, draining a batch back to the
+// arenas if that makes the cache overflow.
+static void pmm_page_cache_free(vm_page_t* page) {
+    list_node drain = LIST_INITIAL_VALUE(drain);
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    pmm_page_cache* c = &page_cache[arch_curr_cpu_num()];
+    list_add_head(&c->pages, &page->free.node);
+    c->count++;
+
+    if (likely(c->count <= PMM_PAGE_CACHE_MAX)) {
+        kcounter_add(pmm_cache_free_hit, 1);
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return;
+    }
+
+    // drain the coldest pages, the ones at the tail
+    kcounter_add(pmm_cache_free_drain, 1);
+    while (c->count > PMM_PAGE_CACHE_MAX - PMM_PAGE_CACHE_BATCH) {
+        vm_page_t* p = list_remove_tail_type(&c->pages, vm_page_t, free.node);
+        list_add_head(&drain, &p->free.node);
+        c->count--;
+    }
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    pmm_free(&drain);
+}
+
+// Number of pages sitting in the per-cpu caches. The caches are read without
+// synchronization, so this is only approximate.
+static size_t pmm_page_cache_count() {
+    size_t count = 0;
+    for (const auto& c : page_cache) {
+        count += c.count;
+    }
+    return count;
+}
+
+// Pool pages come from any arena, so they can only satisfy KMAP requests if
+// every arena is KMAP.
+static bool zero_pool_usable(uint alloc_flags) {
+    return zero_pool_enabled && (all_arenas_kmap || (alloc_flags & PMM_ALLOC_FLAG_KMAP) == 0);
+}
+
+// Move up to |count| pages from the zero pool to |list|, poking the zeroing
+// thread if that leaves the pool low. Returns the number of pages moved.
+static size_t zero_pool_take(size_t count, list_node* list) {
+    size_t taken = 0;
+    bool low;
+    {
+        AutoLock al(&zero_pool_lock);
+        while (taken < count) {
+            vm_page_t* page = list_remove_head_type(&zero_pool, vm_page_t, free.node);
+            if (!page)
+                break;
+            list_add_tail(list, &page->free.node);
+            taken++;
         }
+        zero_pool_count -= taken;
+        low = zero_pool_count < zero_pool_low;
+    }
+
+    if (low)
+        event_signal(&zero_pool_event, false);
 
+    return taken;
+}
+
+static vm_page_t* zero_pool_take_page() {
+    list_node list = LIST_INITIAL_VALUE(list);
+    if (zero_pool_take(1, &list) == 0)
+        return nullptr;
+    return list_remove_head_type(&list, vm_page_t, free.node);
+}
+
+// Number of pages in the zero pool. Read without the lock, so that it can be
+// used from the dump timer, which means it is only approximate.
+static size_t zero_pool_count_pages() TA_NO_THREAD_SAFETY_ANALYSIS {
+    return zero_pool_count;
+}
+
+// Number of pages waiting for the reaper. Read without the lock, for the same
+// reason as zero_pool_count_pages().
+static size_t reaper_count_pages() TA_NO_THREAD_SAFETY_ANALYSIS {
+    return reaper_count;
+}
+
+// Free everything the reaper hasn't got to yet on the calling thread. Used when
+// an allocation is about to fail. Returns true if any pages were freed.
+static bool reaper_reclaim() {
+    list_node list = LIST_INITIAL_VALUE(list);
+    {
+        AutoLock al(&reaper_lock);
+        if (reaper_count == 0)
+            return false;
+        list_move(&reaper_list, &list);
+        reaper_count = 0;
+    }
+
+    kcounter_add(pmm_reaper_reclaimed, pmm_free(&list));
+    return true;
+}
+
+static vm_page_t* pmm_alloc_page_locked(uint alloc_flags, paddr_t* pa) TA_REQ(arena_lock) {
+    /* walk the arenas in order until we find one with a free page */
+    vm_page_t* page = nullptr;
+    pmm_for_each_alloc_arena(alloc_flags, [&page, pa](PmmArena& a) {
         // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
+        page = a.AllocPage(pa);
+        return page != nullptr;
+    });
+
+    if (!page)
+        LTRACEF("failed to allocate page\n");
+    return page;
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    if (likely(page_cache_enabled) &&
+        (all_arenas_kmap || (alloc_flags & PMM_ALLOC_FLAG_KMAP) == 0)) {
+        vm_page_t* page = pmm_page_cache_alloc();
+        if (page) {
+            if (pa)
+                *pa = vm_page_to_paddr(page);
             return page;
+        }
     }
 
-    LTRACEF("failed to allocate page\n");
-    return nullptr;
+    vm_page_t* page;
+    {
+        AutoLock al(&arena_lock);
+        page = pmm_alloc_page_locked(alloc_flags, pa);
+    }
+
+    // so are pages waiting for the reaper
+    if (unlikely(!page) && reaper_reclaim()) {
+        AutoLock al(&arena_lock);
+        page = pmm_alloc_page_locked(alloc_flags, pa);
+    }
+
+    // the zero pool is free memory too, use it before giving up
+    if (unlikely(!page) && zero_pool_usable(alloc_flags)) {
+        page = zero_pool_take_page();
+        if (page && pa)
+            *pa = vm_page_to_paddr(page);
+    }
+    return page;
+}
+
+vm_page_t* pmm_alloc_zeroed_page(uint alloc_flags, paddr_t* pa) {
+    if (zero_pool_usable(alloc_flags)) {
+        vm_page_t* page = zero_pool_take_page();
+        if (page) {
+            kcounter_add(pmm_zero_pool_hit, 1);
+            if (pa)
+                *pa = vm_page_to_paddr(page);
+            return page;
+        }
+        kcounter_add(pmm_zero_pool_miss, 1);
+    }
+
+    paddr_t page_pa;
+    vm_page_t* page = pmm_alloc_page(alloc_flags, &page_pa);
+    if (!page)
+        return nullptr;
+
+    arch_zero_page(paddr_to_physmap(page_pa));
+
+    if (pa)
+        *pa = page_pa;
+    return page;
+}
+
+size_t pmm_alloc_zeroed_pages(size_t count, uint alloc_flags, struct list_node* list) {
+    DEBUG_ASSERT(list);
+
+    size_t allocated = 0;
+    if (zero_pool_usable(alloc_flags)) {
+        allocated = zero_pool_take(count, list);
+        kcounter_add(pmm_zero_pool_hit, allocated);
+        if (allocated == count)
+            return allocated;
+        kcounter_add(pmm_zero_pool_miss, count - allocated);
+    }
+
+    list_node fresh = LIST_INITIAL_VALUE(fresh);
+    allocated += pmm_alloc_pages(count - allocated, alloc_flags, &fresh);
+
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&fresh, vm_page_t, free.node)) != nullptr) {
+        arch_zero_page(paddr_to_physmap(vm_page_to_paddr(page)));
+        list_add_tail(list, &page->free.node);
+    }
+
+    return allocated;
 }
 
 size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
@@ -149,25 +527,29 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     if (count == 0)
         return 0;
 
-    AutoLock al(&arena_lock);
-
     /* walk the arenas in order, allocating as many pages as we can from each */
     size_t allocated = 0;
-    for (auto& a : arena_list) {
-        DEBUG_ASSERT(count > allocated);
+    auto alloc_from_arenas = [count, alloc_flags, list, &allocated]() {
+        AutoLock al(&arena_lock);
 
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
-        }
+        pmm_for_each_alloc_arena(alloc_flags, [count, list, &allocated](PmmArena& a) {
+            DEBUG_ASSERT(count > allocated);
 
-        // ask the arena to allocate some pages
-        allocated += a.AllocPages(count - allocated, list);
-        DEBUG_ASSERT(allocated <= count);
-        if (allocated == count)
-            break;
-    }
+            // ask the arena to allocate some pages
+            allocated += a.AllocPages(count - allocated, list);
+            DEBUG_ASSERT(allocated <= count);
+            return allocated == count;
+        });
+    };
+    alloc_from_arenas();
+
+    // pages waiting for the reaper are free memory, use them before coming up short
+    if (unlikely(allocated < count) && reaper_reclaim())
+        alloc_from_arenas();
+
+    // the zero pool is free memory too, use it before coming up short
+    if (unlikely(allocated < count) && zero_pool_usable(alloc_flags))
+        allocated += zero_pool_take(count - allocated, list);
 
     return allocated;
 }
@@ -339,7 +721,43 @@ size_t pmm_free(struct list_node* list) {
     return count;
 }
 
+void pmm_free_deferred(struct list_node* list, size_t count) {
+    LTRACEF("list %p count %zu\n", list, count);
+
+    if (count == 0)
+        return;
+
+    // nothing to gain from a trip through the reaper for a handful of pages
+    if (!reaper_enabled || count < kReaperBatchPages) {
+        __UNUSED size_t freed = pmm_free(list);
+        DEBUG_ASSERT(freed == count);
+        return;
+    }
+
+    {
+        AutoLock al(&reaper_lock);
+        // splice the whole list onto the tail of the pending pages
+        list_node* first = list->next;
+        list_node* last = list->prev;
+        first->prev = reaper_list.prev;
+        reaper_list.prev->next = first;
+        last->next = &reaper_list;
+        reaper_list.prev = last;
+        list_initialize(list);
+        reaper_count += count;
+    }
+    kcounter_add(pmm_reaper_deferred, count);
+
+    event_signal(&reaper_event, false);
+}
+
 size_t pmm_free_page(vm_page_t* page) {
+    if (likely(page_cache_enabled)) {
+        DEBUG_ASSERT_MSG(!page_is_free(page), "page %p state %u\n", page, page->state);
+        pmm_page_cache_free(page);
+        return 1;
+    }
+
     struct list_node list;
     list_initialize(&list);
 
@@ -358,11 +776,14 @@ static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock) {
 
 size_t pmm_count_free_pages() {
     AutoLock al(&arena_lock);
-    return pmm_count_free_pages_locked();
+    return pmm_count_free_pages_locked() + pmm_page_cache_count() + zero_pool_count_pages() +
+           reaper_count_pages();
 }
 
 static void pmm_dump_free() TA_REQ(arena_lock) {
-    auto megabytes_free = pmm_count_free_pages_locked() / 256u;
+    auto megabytes_free =
+        (pmm_count_free_pages_locked() + pmm_page_cache_count() + zero_pool_count_pages() +
+         reaper_count_pages()) / 256u;
     printf(" %zu free MBs\n", megabytes_free);
 }
 
@@ -384,6 +805,111 @@ void pmm_count_total_states(size_t state_count[_VM_PAGE_STATE_COUNT]) {
     }
 }
 
+// Keep the zero pool filled. Pages are taken straight from the arenas so the
+// thread never takes back pages from the pool it is filling.
+static int zero_pool_thread(void*) {
+    for (;;) {
+        event_wait(&zero_pool_event);
+
+        for (;;) {
+            {
+                AutoLock al(&zero_pool_lock);
+                if (zero_pool_count >= zero_pool_high)
+                    break;
+            }
+
+            paddr_t pa;
+            vm_page_t* page;
+            {
+                AutoLock al(&arena_lock);
+                page = pmm_alloc_page_locked(0, &pa);
+            }
+            if (!page)
+                break;
+
+            arch_zero_page(paddr_to_physmap(pa));
+
+            {
+                AutoLock al(&zero_pool_lock);
+                list_add_tail(&zero_pool, &page->free.node);
+                zero_pool_count++;
+            }
+            kcounter_add(pmm_zero_pool_fill, 1);
+        }
+    }
+    return 0;
+}
+
+static void pmm_zero_pool_init(uint level) {
+    zero_pool_high = cmdline_get_uint64("kernel.pmm.zero-pool-high", 1024);
+    zero_pool_low = cmdline_get_uint64("kernel.pmm.zero-pool-low", zero_pool_high / 4);
+    if (zero_pool_high == 0)
+        return;
+    if (zero_pool_low > zero_pool_high)
+        zero_pool_low = zero_pool_high;
+
+    thread_t* t = thread_create("pmm-zero", &zero_pool_thread, nullptr,
+                                LOWEST_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("PMM: failed to create zero pool thread\n");
+        return;
+    }
+
+    zero_pool_enabled = true;
+    thread_resume(t);
+
+    // fill the pool for the first time
+    event_signal(&zero_pool_event, false);
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_zero_pool_init, LK_INIT_LEVEL_THREADING);
+
+// Give deferred pages back to the arenas a batch at a time, dropping the arena
+// lock between batches so that allocations on other cpus carry on meanwhile.
+static int reaper_thread(void*) {
+    for (;;) {
+        event_wait(&reaper_event);
+
+        for (;;) {
+            list_node batch = LIST_INITIAL_VALUE(batch);
+            size_t taken = 0;
+            {
+                AutoLock al(&reaper_lock);
+                while (taken < kReaperBatchPages) {
+                    vm_page_t* page = list_remove_head_type(&reaper_list, vm_page_t, free.node);
+                    if (!page)
+                        break;
+                    list_add_tail(&batch, &page->free.node);
+                    taken++;
+                }
+                reaper_count -= taken;
+            }
+            if (taken == 0)
+                break;
+
+            kcounter_add(pmm_reaper_freed, pmm_free(&batch));
+        }
+    }
+    return 0;
+}
+
+static void pmm_reaper_init(uint level) {
+    if (!cmdline_get_bool("kernel.pmm.deferred-free", true))
+        return;
+
+    // Above the zero pool thread, so that zeroing never holds up freeing, but
+    // below anything that is actually waiting on the cpu.
+    thread_t* t = thread_create("pmm-reaper", &reaper_thread, nullptr,
+                                LOW_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("PMM: failed to create reaper thread\n");
+        return;
+    }
+
+    reaper_enabled = true;
+    thread_resume(t);
+}
+LK_INIT_HOOK(pmm_reaper, &pmm_reaper_init, LK_INIT_LEVEL_THREADING);
+
 static void pmm_dump_timer(timer_t* t, zx_time_t now, void*) TA_REQ(arena_lock) {
     timer_set(t, now + ZX_SEC(1), TIMER_SLACK_CENTER, ZX_MSEC(20), &pmm_dump_timer, nullptr);
     pmm_dump_free();
@@ -9,6 +9,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <pow2.h>
 #include <pretty/sizes.h>
 #include <string.h>
 #include <trace.h>
@@ -23,9 +24,9 @@
 void PmmArena::EnforceFill() {
     DEBUG_ASSERT(!enforce_fill_);
 
-    vm_page_t* page;
-    list_for_every_entry (&free_list_, page, vm_page_t, free.node) {
-        FreeFill(page);
+    for (size_t i = 0; i < page_count(); i++) {
+        if (page_is_free(&page_array_[i]))
+            FreeFill(&page_array_[i]);
     }
 
     enforce_fill_ = true;
@@ -50,6 +51,10 @@ zx_status_t PmmArena::Init(const pmm_arena_info_t* info) {
     // TODO: validate that info is sane (page aligned, etc)
     info_ = *info;
 
+    for (auto& list : free_lists_) {
+        list_initialize(&list);
+    }
+
     /* allocate an array of pages to back this one */
     size_t page_count = size() / PAGE_SIZE;
     size_t page_array_size = ROUNDUP_PAGE_SIZE(page_count * VM_PAGE_STRUCT_SIZE);
@@ -87,39 +92,169 @@ zx_status_t PmmArena::Init(const pmm_arena_info_t* info) {
 
     DEBUG_ASSERT(array_start_index < page_count && array_end_index <= page_count);
 
-    /* add all pages that aren't part of the page array to the free list */
-    /* pages part of the free array go to the WIRED state */
-    for (size_t i = 0; i < page_count; i++) {
-        auto& p = page_array_[i];
+    /* pages part of the page array go to the WIRED state, the rest are free */
+    for (size_t i = array_start_index; i < array_end_index; i++) {
+        page_array_[i].state = VM_PAGE_STATE_WIRED;
+    }
+    FreeRange(0, array_start_index);
+    FreeRange(array_end_index, page_count - array_end_index);
+    free_count_ = page_count - (array_end_index - array_start_index);
+
+    return ZX_OK;
+}
+
+// whether a block of |order| can start at page |index|: it has to be naturally
+// aligned in physical memory and lie entirely within the arena
+bool PmmArena::BlockFits(size_t index, uint order) const {
+    size_t pfn = base() / PAGE_SIZE + index;
+    return (pfn & ((1ul << order) - 1)) == 0 && index + (1ul << order) <= page_count();
+}
+
+void PmmArena::AddFreeBlock(size_t index, uint order) {
+    DEBUG_ASSERT(order <= kMaxOrder && BlockFits(index, order));
+
+    vm_page_t* head = &page_array_[index];
+    DEBUG_ASSERT(page_is_free(head));
+    head->free.order = static_cast<uint8_t>(order);
+    list_add_head(&free_lists_[order], &head->free.node);
+}
+
+// pull a free block of at least |order| off the free lists, splitting it down
+// to |order| and returning the unused halves to the free lists
+bool PmmArena::AllocBlock(uint order, size_t* index) {
+    uint j = order;
+    while (j <= kMaxOrder && list_is_empty(&free_lists_[j])) {
+        j++;
+    }
+    if (j > kMaxOrder)
+        return false;
+
+    vm_page_t* head = list_remove_head_type(&free_lists_[j], vm_page_t, free.node);
+    DEBUG_ASSERT(page_is_free(head) && head->free.order == j);
+    size_t i = page_index(head);
+
+    while (j > order) {
+        j--;
+        AddFreeBlock(i + (1ul << j), j);
+    }
+    head->free.order = VM_PAGE_NOT_BLOCK_HEAD;
+
+    *index = i;
+    return true;
+}
+
+// return a block whose pages are already marked free to the free lists,
+// merging it with its buddy for as long as the buddy is free too
+void PmmArena::FreeBlock(size_t index, uint order) {
+    DEBUG_ASSERT(BlockFits(index, order));
+
+    while (order < kMaxOrder) {
+        size_t pfn = base() / PAGE_SIZE + index;
+        size_t buddy_pfn = pfn ^ (1ul << order);
+        if (buddy_pfn < base() / PAGE_SIZE)
+            break;
+        size_t buddy = buddy_pfn - base() / PAGE_SIZE;
+        if (buddy + (1ul << order) > page_count())
+            break;
+
+        vm_page_t* b = &page_array_[buddy];
+        if (!page_is_free(b) || b->free.order != order)
+            break;
+
+        list_delete(&b->free.node);
+
+        size_t merged = MIN(index, buddy);
+        page_array_[MAX(index, buddy)].free.order = VM_PAGE_NOT_BLOCK_HEAD;
+        index = merged;
+        order++;
+    }
+
+    AddFreeBlock(index, order);
+}
+
+// mark a run of pages free and hand it to the free lists as the largest
+// aligned blocks that tile it
+void PmmArena::FreeRange(size_t index, size_t count) {
+    for (size_t i = index; i < index + count; i++) {
+        page_array_[i].state = VM_PAGE_STATE_FREE;
+        page_array_[i].free.order = VM_PAGE_NOT_BLOCK_HEAD;
+    }
+
+    while (count > 0) {
+        uint order = kMaxOrder;
+        while ((1ul << order) > count || !BlockFits(index, order)) {
+            order--;
+        }
+        FreeBlock(index, order);
+        index += 1ul << order;
+        count -= 1ul << order;
+    }
+}
+
+// take the free page at |index| out of whatever free block it is part of,
+// returning the rest of the block to the free lists
+bool PmmArena::CarvePage(size_t index) {
+    if (!page_is_free(&page_array_[index]))
+        return false;
+
+    /* find the block containing the page */
+    size_t head = index;
+    uint order = 0;
+    for (;;) {
+        size_t pfn = base() / PAGE_SIZE + index;
+        head = index - (pfn & ((1ul << order) - 1));
+        if (page_array_[head].free.order == order && page_is_free(&page_array_[head]))
+            break;
+        order++;
+        DEBUG_ASSERT(order <= kMaxOrder);
+    }
+
+    list_delete(&page_array_[head].free.node);
+    page_array_[head].free.order = VM_PAGE_NOT_BLOCK_HEAD;
 
-        if (i >= array_start_index && i < array_end_index) {
-            p.state = VM_PAGE_STATE_WIRED;
+    /* split it in halves, keeping the half that holds the page */
+    while (order > 0) {
+        order--;
+        size_t half = 1ul << order;
+        if (index < head + half) {
+            AddFreeBlock(head + half, order);
         } else {
-            p.state = VM_PAGE_STATE_FREE;
-            list_add_tail(&free_list_, &p.free.node);
-            free_count_++;
+            page_array_[head + half].free.order = VM_PAGE_NOT_BLOCK_HEAD;
+            AddFreeBlock(head, order);
+            head += half;
         }
     }
 
-    return ZX_OK;
+    DEBUG_ASSERT(head == index);
+    return true;
 }
 
-vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
-    vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
-    if (!page)
-        return nullptr;
+// move a page that has been taken off the free lists to the allocated state
+void PmmArena::MarkAllocated(size_t index, list_node* list) {
+    vm_page_t* page = &page_array_[index];
 
+    DEBUG_ASSERT(page_is_free(page));
     DEBUG_ASSERT(free_count_ > 0);
 
     free_count_--;
 
-    DEBUG_ASSERT(page_is_free(page));
-
     page->state = VM_PAGE_STATE_ALLOC;
 #if PMM_ENABLE_FREE_FILL
     CheckFreeFill(page);
 #endif
 
+    if (list)
+        list_add_tail(list, &page->free.node);
+}
+
+vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
+    size_t index;
+    if (!AllocBlock(0, &index))
+        return nullptr;
+
+    MarkAllocated(index, nullptr);
+    vm_page_t* page = &page_array_[index];
+
     if (pa) {
         /* compute the physical address of the page based on its offset into the arena */
         *pa = page_address_from_arena(page);
@@ -139,45 +274,27 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
 
     DEBUG_ASSERT(index < size() / PAGE_SIZE);
 
-    vm_page_t* page = get_page(index);
-    if (!page_is_free(page)) {
+    if (!CarvePage(index)) {
         /* we hit an allocated page */
         return nullptr;
     }
 
-    list_delete(&page->free.node);
-
-    page->state = VM_PAGE_STATE_ALLOC;
-
-    DEBUG_ASSERT(free_count_ > 0);
-
-    free_count_--;
-
-    return page;
+    MarkAllocated(index, nullptr);
+    return get_page(index);
 }
 
 size_t PmmArena::AllocPages(size_t count, list_node* list) {
     size_t allocated = 0;
 
     while (allocated < count) {
-        vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
-        if (!page)
+        size_t index;
+        if (!AllocBlock(0, &index))
             return allocated;
 
-        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page_address_from_arena(page));
-
-        DEBUG_ASSERT(free_count_ > 0);
-
-        free_count_--;
-
-        DEBUG_ASSERT(page_is_free(page));
-#if PMM_ENABLE_FREE_FILL
-        CheckFreeFill(page);
-#endif
-
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->free.node);
+        LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", &page_array_[index],
+                page_address_from_arena(&page_array_[index]));
 
+        MarkAllocated(index, list);
         allocated++;
     }
 
@@ -185,17 +302,44 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
 }
 
 size_t PmmArena::AllocContiguous(size_t count, uint8_t alignment_log2, paddr_t* pa, struct list_node* list) {
-    /* walk the list starting at alignment boundaries.
-     * calculate the starting offset into this arena, based on the
-     * base address of the arena to handle the case where the arena
-     * is not aligned on the same boundary requested.
+    /* a buddy block of the right order satisfies both the size and the alignment,
+     * since blocks are naturally aligned in physical memory */
+    uint order = MAX(log2_ulong_ceil(count), (uint)alignment_log2 - PAGE_SIZE_SHIFT);
+    size_t start;
+    if (order <= kMaxOrder && AllocBlock(order, &start)) {
+        LTRACEF("found block of order %u at pn %zu\n", order, start);
+
+        /* give back the part of the block past the end of the run */
+        size_t block_size = 1ul << order;
+        if (block_size > count) {
+            for (size_t i = start + count; i < start + block_size; i++) {
+                page_array_[i].state = VM_PAGE_STATE_ALLOC;
+            }
+            FreeRange(start + count, block_size - count);
+        }
+
+        for (size_t i = start; i < start + count; i++) {
+            MarkAllocated(i, list);
+        }
+
+        if (pa)
+            *pa = base() + start * PAGE_SIZE;
+
+        return count;
+    }
+
+    /* no single block is big enough, but a run may still straddle several
+     * smaller blocks. fall back to walking the list starting at alignment
+     * boundaries. calculate the starting offset into this arena, based on
+     * the base address of the arena to handle the case where the arena is
+     * not aligned on the same boundary requested.
      */
     paddr_t rounded_base = ROUNDUP(base(), 1UL << alignment_log2);
     if (rounded_base < base() || rounded_base > base() + size() - 1)
         return 0;
 
     paddr_t aligned_offset = (rounded_base - base()) / PAGE_SIZE;
-    paddr_t start = aligned_offset;
+    start = aligned_offset;
     LTRACEF("starting search at aligned offset %#" PRIxPTR "\n", start);
     LTRACEF("arena base %#" PRIxPTR " size %zu\n", base(), size());
 
@@ -219,25 +363,11 @@ retry:
         /* we found a run */
         LTRACEF("found run from pn %" PRIuPTR " to %" PRIuPTR "\n", start, start + count);
 
-        /* remove the pages from the run out of the free list */
-        for (paddr_t i = start; i < start + count; i++) {
-            p = &page_array_[i];
-            DEBUG_ASSERT(page_is_free(p));
-            DEBUG_ASSERT(list_in_list(&p->free.node));
-
-            list_delete(&p->free.node);
-            p->state = VM_PAGE_STATE_ALLOC;
-
-            DEBUG_ASSERT(free_count_ > 0);
-
-            free_count_--;
-
-#if PMM_ENABLE_FREE_FILL
-            CheckFreeFill(p);
-#endif
-
-            if (list)
-                list_add_tail(list, &p->free.node);
+        /* carve the pages of the run out of their free blocks */
+        for (size_t i = start; i < start + count; i++) {
+            __UNUSED bool carved = CarvePage(i);
+            DEBUG_ASSERT(carved);
+            MarkAllocated(i, list);
         }
 
         if (pa)
@@ -261,8 +391,9 @@ zx_status_t PmmArena::FreePage(vm_page_t* page) {
 #endif
 
     page->state = VM_PAGE_STATE_FREE;
+    page->free.order = VM_PAGE_NOT_BLOCK_HEAD;
 
-    list_add_head(&free_list_, &page->free.node);
+    FreeBlock(page_index(page), 0);
     free_count_++;
     return ZX_OK;
 }
@@ -275,10 +406,17 @@ void PmmArena::CountStates(size_t state_count[_VM_PAGE_STATE_COUNT]) const {
 
 void PmmArena::Dump(bool dump_pages, bool dump_free_ranges) {
     char pbuf[16];
-    printf("arena %p: name '%s' base %#" PRIxPTR " size %s (0x%zx) priority %u flags 0x%x\n", this, name(), base(),
-           format_size(pbuf, sizeof(pbuf), size()), size(), priority(), flags());
+    printf("arena %p: name '%s' base %#" PRIxPTR " size %s (0x%zx) priority %u flags 0x%x node %u\n",
+           this, name(), base(), format_size(pbuf, sizeof(pbuf), size()), size(), priority(), flags(),
+           node());
     printf("\tpage_array %p, free_count %zu\n", page_array_, free_count_);
 
+    printf("\tfree blocks by order:");
+    for (uint order = 0; order <= kMaxOrder; order++) {
+        printf(" %zu", list_length(&free_lists_[order]));
+    }
+    printf("\n");
+
     /* dump all of the pages */
     if (dump_pages) {
         for (size_t i = 0; i < size() / PAGE_SIZE; i++) {
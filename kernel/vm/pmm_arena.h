@@ -40,6 +40,10 @@ public:
     unsigned int priority() const { return info_.priority; }
     size_t free_count() const { return free_count_; };
 
+    // NUMA node the arena's memory is attached to.
+    uint node() const { return node_; }
+    void set_node(uint node) { node_ = node; }
+
     // Counts the number of pages in every state. For each page in the arena,
     // increments the corresponding VM_PAGE_STATE_*-indexed entry of
     // |state_count|. Does not zero out the entries first.
@@ -80,11 +84,29 @@ private:
     void CheckFreeFill(vm_page_t* page);
 #endif
 
+    // Free pages are kept in a binary buddy allocator. A free block of order k
+    // is 2^k pages that start on a 2^k page aligned physical address. Only the
+    // first page of a block (its head) is on free_lists_[k]. The rest of its
+    // pages are marked VM_PAGE_NOT_BLOCK_HEAD.
+    static constexpr uint kMaxOrder = 18; // 1GB blocks with 4K pages
+
+    size_t page_count() const { return info_.size / PAGE_SIZE; }
+    size_t page_index(const vm_page_t* page) const { return page - page_array_; }
+    bool BlockFits(size_t index, uint order) const;
+
+    void AddFreeBlock(size_t index, uint order);
+    bool AllocBlock(uint order, size_t* index);
+    void FreeBlock(size_t index, uint order);
+    void FreeRange(size_t index, size_t count);
+    bool CarvePage(size_t index);
+    void MarkAllocated(size_t index, list_node* list);
+
     pmm_arena_info_t info_ = {};
+    uint node_ = 0;
     vm_page_t* page_array_ = nullptr;
 
     size_t free_count_ = 0;
-    list_node free_list_ = LIST_INITIAL_VALUE(free_list_);
+    list_node free_lists_[kMaxOrder + 1] = {};
 
 #if PMM_ENABLE_FREE_FILL
     bool enforce_fill_ = false;
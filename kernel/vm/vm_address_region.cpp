@@ -24,8 +24,6 @@
 #include <lib/vdso.h>
 #endif
 
-using fbl::AutoLock;
-
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 VmAddressRegion::VmAddressRegion(VmAspace& aspace, vaddr_t base, size_t size, uint32_t vmar_flags)
@@ -85,7 +83,7 @@ zx_status_t VmAddressRegion::CreateSubVmarInternal(size_t offset, size_t size, u
                                                    fbl::RefPtr<VmAddressRegionOrMapping>* out) {
     DEBUG_ASSERT(out);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -285,7 +283,7 @@ zx_status_t VmAddressRegion::OverwriteVmMapping(
     uint arch_mmu_flags, fbl::RefPtr<VmAddressRegionOrMapping>* out) {
 
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(vmo);
     DEBUG_ASSERT(vmar_flags & VMAR_FLAG_SPECIFIC_OVERWRITE);
 
@@ -310,7 +308,7 @@ zx_status_t VmAddressRegion::OverwriteVmMapping(
 
 zx_status_t VmAddressRegion::DestroyLocked() {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     LTRACEF("%p '%s'\n", this, name_);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -345,7 +343,7 @@ void VmAddressRegion::RemoveSubregion(VmAddressRegionOrMapping* region) {
 }
 
 fbl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegion(vaddr_t addr) {
-    AutoLock guard(aspace_->lock());
+    AutoReadLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return nullptr;
     }
@@ -367,7 +365,7 @@ fbl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegionLocked(vaddr_t
 
 size_t VmAddressRegion::AllocatedPagesLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
@@ -382,7 +380,7 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
 
 zx_status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_held(aspace_->lock()));
 
     for (auto vmar = WrapRefPtr(this);
          auto next = vmar->FindRegionLocked(va);
@@ -395,7 +393,7 @@ zx_status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
 }
 
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(size > 0);
 
     // Find the first region with base > *base*.  Since subregions_ has no
@@ -427,7 +425,7 @@ bool VmAddressRegion::CheckGapLocked(const ChildList::iterator& prev,
                                      const ChildList::iterator& next,
                                      vaddr_t* pva, vaddr_t search_base, vaddr_t align,
                                      size_t region_size, size_t min_gap, uint arch_mmu_flags) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     safeint::CheckedNumeric<vaddr_t> gap_beg; // first byte of a gap
     safeint::CheckedNumeric<vaddr_t> gap_end; // last byte of a gap
@@ -513,7 +511,7 @@ zx_status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, ui
                                              vaddr_t* spot) {
     canary_.Assert();
     DEBUG_ASSERT(size > 0 && IS_PAGE_ALIGNED(size));
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     LTRACEF_LEVEL(2, "aspace %p size 0x%zx align %hhu\n", this, size,
                   align_pow2);
@@ -529,25 +527,58 @@ zx_status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, ui
     return LinearRegionAllocatorLocked(size, align_pow2, arch_mmu_flags, spot);
 }
 
-bool VmAddressRegion::EnumerateChildrenLocked(VmEnumerator* ve, uint depth) {
+bool VmAddressRegion::EnumerateChildrenLocked(VmEnumerator* ve, uint depth,
+                                              VmEnumeratorCursor* cursor) {
     canary_.Assert();
     DEBUG_ASSERT(ve != nullptr);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
-    for (auto& child : subregions_) {
+    DEBUG_ASSERT(cursor != nullptr);
+    DEBUG_ASSERT(rwlock_is_held(aspace_->lock()));
+
+    // When resuming, children wholly before the cursor have been visited
+    // already; start at the one which might hold it.
+    auto itr = subregions_.begin();
+    if (cursor->started) {
+        itr = --subregions_.upper_bound(cursor->base);
+        if (!itr.IsValid()) {
+            itr = subregions_.begin();
+        }
+    }
+
+    for (; itr != subregions_.end(); ++itr) {
+        auto& child = *itr;
         DEBUG_ASSERT(child.IsAliveLocked());
-        if (child.is_mapping()) {
-            VmMapping* mapping = child.as_vm_mapping().get();
-            DEBUG_ASSERT(mapping != nullptr);
-            if (!ve->OnVmMapping(mapping, this, depth)) {
+        const bool visited = cursor->started &&
+                             (child.base() < cursor->base ||
+                              (child.base() == cursor->base && depth <= cursor->depth));
+        if (!visited) {
+            if (cursor->budget == 0) {
+                cursor->paused = true;
                 return false;
             }
-        } else {
-            VmAddressRegion* vmar = child.as_vm_address_region().get();
-            DEBUG_ASSERT(vmar != nullptr);
-            if (!ve->OnVmAddressRegion(vmar, depth)) {
+            bool keep_going;
+            if (child.is_mapping()) {
+                VmMapping* mapping = child.as_vm_mapping().get();
+                DEBUG_ASSERT(mapping != nullptr);
+                keep_going = ve->OnVmMapping(mapping, this, depth);
+            } else {
+                VmAddressRegion* vmar = child.as_vm_address_region().get();
+                DEBUG_ASSERT(vmar != nullptr);
+                keep_going = ve->OnVmAddressRegion(vmar, depth);
+            }
+            if (!keep_going) {
                 return false;
             }
-            if (!vmar->EnumerateChildrenLocked(ve, depth + 1)) {
+            cursor->base = child.base();
+            cursor->depth = depth;
+            cursor->started = true;
+            cursor->budget--;
+        }
+        // A region's children may still be to come even if it has been
+        // visited, unless it ends before the cursor.
+        if (!child.is_mapping() && child.base() + (child.size() - 1) >= cursor->base) {
+            VmAddressRegion* vmar = child.as_vm_address_region().get();
+            DEBUG_ASSERT(vmar != nullptr);
+            if (!vmar->EnumerateChildrenLocked(ve, depth + 1, cursor)) {
                 return false;
             }
         }
@@ -569,7 +600,7 @@ void VmAddressRegion::Dump(uint depth, bool verbose) const {
 
 void VmAddressRegion::Activate() {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     state_ = LifeCycleState::ALIVE;
     parent_->subregions_.insert(fbl::RefPtr<VmAddressRegionOrMapping>(this));
@@ -583,7 +614,7 @@ zx_status_t VmAddressRegion::Unmap(vaddr_t base, size_t size) {
         return ZX_ERR_INVALID_ARGS;
     }
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -592,7 +623,7 @@ zx_status_t VmAddressRegion::Unmap(vaddr_t base, size_t size) {
 }
 
 zx_status_t VmAddressRegion::UnmapInternalLocked(vaddr_t base, size_t size, bool can_destroy_regions) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     if (!is_in_range(base, size)) {
         return ZX_ERR_INVALID_ARGS;
@@ -681,7 +712,7 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
         return ZX_ERR_INVALID_ARGS;
     }
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -757,7 +788,7 @@ zx_status_t VmAddressRegion::Protect(vaddr_t base, size_t size, uint new_arch_mm
 
 zx_status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                          uint arch_mmu_flags, vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     const vaddr_t base = 0;
 
@@ -766,50 +797,113 @@ zx_status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t al
     const vaddr_t align = 1UL << align_pow2;
 
     // Find the first gap in the address space which can contain a region of the
-    // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
+    // requested size.  Past the gap before the first child, only the gaps the
+    // subtree state says are large enough are checked, and then the gap after
+    // the last child.
+    bool found = false;
+    auto check_gap = [&](const ChildList::iterator& prev, const ChildList::iterator& next) {
+        found = CheckGapLocked(prev, next, spot, base, align, size, 0, arch_mmu_flags);
+        return !found;
+    };
 
-    do {
-        if (CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0, arch_mmu_flags)) {
-            if (*spot != static_cast<vaddr_t>(-1)) {
-                return ZX_OK;
-            } else {
-                return ZX_ERR_NO_MEMORY;
-            }
-        }
+    if (check_gap(subregions_.end(), subregions_.begin()) && !subregions_.is_empty() &&
+        ForEachChildGapLocked(size, check_gap)) {
+        check_gap(--subregions_.end(), subregions_.end());
+    }
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+    if (found && *spot != static_cast<vaddr_t>(-1)) {
+        return ZX_OK;
+    }
 
     // couldn't find anything
     return ZX_ERR_NO_MEMORY;
 }
 
 template <typename F>
-void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2) {
-    const vaddr_t align = 1UL << align_pow2;
+bool VmAddressRegion::ForEachChildGapLocked(size_t min_size, F func) {
+    if (subregions_.is_empty()) {
+        return true;
+    }
 
-    // Scan the regions list to find the gap to the left of each region.  We
-    // round up the end of the previous region to the requested alignment, so
-    // all gaps reported will be for aligned ranges.
-    vaddr_t prev_region_end = ROUNDUP(base_, align);
-    for (const auto& region : subregions_) {
-        if (region.base() > prev_region_end) {
-            const size_t gap = region.base() - prev_region_end;
-            if (!func(prev_region_end, gap)) {
-                return;
+    // Climb from the first child to the root of the tree.
+    VmAddressRegionOrMapping* root = &subregions_.front();
+    while (ChildList::PtrTraits::IsValid(root->subregion_list_node_.parent_)) {
+        root = root->subregion_list_node_.parent_;
+    }
+    return ForEachChildGapLocked(root, min_size, func);
+}
+
+// The recursion is bounded by the height of the tree, which is logarithmic in
+// the number of children.
+template <typename F>
+bool VmAddressRegion::ForEachChildGapLocked(VmAddressRegionOrMapping* node, size_t min_size,
+                                            F func) {
+    if (node->subtree_state_.max_gap < min_size) {
+        return true;
+    }
+
+    const auto& ns = node->subregion_list_node_;
+    if (ChildList::PtrTraits::IsValid(ns.left_)) {
+        VmAddressRegionOrMapping* left = ns.left_.get();
+        if (!ForEachChildGapLocked(left, min_size, func)) {
+            return false;
+        }
+        if (node->base() - left->subtree_state_.last_byte - 1 >= min_size) {
+            auto next = subregions_.make_iterator(*node);
+            auto prev = next;
+            if (!func(--prev, next)) {
+                return false;
+            }
+        }
+    }
+    if (ChildList::PtrTraits::IsValid(ns.right_)) {
+        VmAddressRegionOrMapping* right = ns.right_.get();
+        if (right->subtree_state_.first_byte - (node->base() + node->size()) >= min_size) {
+            auto prev = subregions_.make_iterator(*node);
+            auto next = prev;
+            if (!func(prev, ++next)) {
+                return false;
             }
         }
-        prev_region_end = ROUNDUP(region.base() + region.size(), align);
+        return ForEachChildGapLocked(right, min_size, func);
     }
+    return true;
+}
+
+template <typename F>
+void VmAddressRegion::ForEachGap(F func, uint8_t align_pow2, size_t min_size) {
+    const vaddr_t align = 1UL << align_pow2;
+
+    // Report the gap between the end of one region and the start of the next.
+    // We round up the end of the previous region to the requested alignment,
+    // so all gaps reported will be for aligned ranges.
+    auto report = [&func, align](vaddr_t prev_region_end, vaddr_t next_base) -> bool {
+        prev_region_end = ROUNDUP(prev_region_end, align);
+        if (next_base > prev_region_end) {
+            return func(prev_region_end, next_base - prev_region_end);
+        }
+        return true;
+    };
 
-    // Grab the gap to the right of the last region (note that if there are no
-    // regions, this handles reporting the VMAR's whole span as a gap).
+    // If there are no regions, this reports the VMAR's whole span as a gap.
     const vaddr_t end = base_ + size_;
-    if (end > prev_region_end) {
-        const size_t gap = end - prev_region_end;
-        func(prev_region_end, gap);
+    if (subregions_.is_empty()) {
+        report(base_, end);
+        return;
+    }
+
+    // The gap to the left of the first region, then the ones between regions
+    // which are large enough, and finally the gap to the right of the last.
+    if (!report(base_, subregions_.front().base())) {
+        return;
+    }
+    bool keep_going = ForEachChildGapLocked(
+        min_size, [&report](const ChildList::iterator& prev, const ChildList::iterator& next) {
+            return report(prev->base() + prev->size(), next->base());
+        });
+    if (keep_going) {
+        const auto& last = *--subregions_.end();
+        report(last.base() + last.size(), end);
     }
 }
 
@@ -829,7 +923,7 @@ constexpr size_t AllocationSpotsInRange(size_t range_size, size_t alloc_size, ui
 zx_status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                                        uint arch_mmu_flags,
                                                                        vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(spot);
 
     align_pow2 = fbl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
@@ -844,7 +938,7 @@ zx_status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t si
         }
         return true;
     },
-               align_pow2);
+               align_pow2, size);
 
     if (candidate_spaces == 0) {
         return ZX_ERR_NO_MEMORY;
@@ -870,7 +964,7 @@ zx_status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t si
         selected_index -= spots;
         return true;
     },
-               align_pow2);
+               align_pow2, size);
     ASSERT(alloc_spot != static_cast<vaddr_t>(-1));
     ASSERT(IS_ALIGNED(alloc_spot, align));
 
@@ -900,7 +994,7 @@ zx_status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t si
 zx_status_t VmAddressRegion::CompactRandomizedRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                                     uint arch_mmu_flags,
                                                                     vaddr_t* spot) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     align_pow2 = fbl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
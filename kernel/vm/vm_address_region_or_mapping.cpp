@@ -9,6 +9,7 @@
 #include "vm_priv.h"
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
@@ -18,8 +19,6 @@
 #include <vm/vm_aspace.h>
 #include <zircon/types.h>
 
-using fbl::AutoLock;
-
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 VmAddressRegionOrMapping::VmAddressRegionOrMapping(
@@ -33,7 +32,7 @@ VmAddressRegionOrMapping::VmAddressRegionOrMapping(
 zx_status_t VmAddressRegionOrMapping::Destroy() {
     canary_.Assert();
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -51,9 +50,38 @@ VmAddressRegionOrMapping::~VmAddressRegionOrMapping() {
     DEBUG_ASSERT(!subregion_list_node_.InContainer());
 }
 
+void VmAddressRegionOrMapping::UpdateSubtreeStateLocked() {
+    using PtrTraits = fbl::internal::ContainerPtrTraits<fbl::RefPtr<VmAddressRegionOrMapping>>;
+    const auto& ns = subregion_list_node_;
+
+    SubtreeState state = {base_, base_ + size_ - 1, 0};
+    if (PtrTraits::IsValid(ns.left_)) {
+        const SubtreeState& left = ns.left_->subtree_state_;
+        state.first_byte = left.first_byte;
+        state.max_gap = fbl::max(left.max_gap, base_ - left.last_byte - 1);
+    }
+    if (PtrTraits::IsValid(ns.right_)) {
+        const SubtreeState& right = ns.right_->subtree_state_;
+        state.last_byte = right.last_byte;
+        state.max_gap = fbl::max(state.max_gap,
+                                 fbl::max(right.max_gap, right.first_byte - (base_ + size_)));
+    }
+    subtree_state_ = state;
+}
+
+void VmAddressRegionOrMapping::PropagateSubtreeStateLocked() {
+    using PtrTraits = fbl::internal::ContainerPtrTraits<fbl::RefPtr<VmAddressRegionOrMapping>>;
+    DEBUG_ASSERT(subregion_list_node_.InContainer());
+
+    for (VmAddressRegionOrMapping* node = this; PtrTraits::IsValid(node);
+         node = node->subregion_list_node_.parent_) {
+        node->UpdateSubtreeStateLocked();
+    }
+}
+
 bool VmAddressRegionOrMapping::IsAliveLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_held(aspace_->lock()));
     return state_ == LifeCycleState::ALIVE;
 }
 
@@ -87,7 +115,7 @@ bool VmAddressRegionOrMapping::is_valid_mapping_flags(uint arch_mmu_flags) {
 }
 
 size_t VmAddressRegionOrMapping::AllocatedPages() const {
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
     }
@@ -241,7 +241,7 @@ VmAspace::~VmAspace() {
 }
 
 fbl::RefPtr<VmAddressRegion> VmAspace::RootVmar() {
-    AutoLock guard(&lock_);
+    AutoReadLock guard(&lock_);
     fbl::RefPtr<VmAddressRegion> ref(root_vmar_);
     return fbl::move(ref);
 }
@@ -250,7 +250,7 @@ zx_status_t VmAspace::Destroy() {
     canary_.Assert();
     LTRACEF("%p '%s'\n", this, name_);
 
-    AutoLock guard(&lock_);
+    AutoWriteLock guard(&lock_);
 
 #if WITH_LIB_VDSO
     // Don't let a vDSO mapping prevent destroying a VMAR
@@ -274,7 +274,7 @@ zx_status_t VmAspace::Destroy() {
 }
 
 bool VmAspace::is_destroyed() const {
-    AutoLock guard(&lock_);
+    AutoReadLock guard(&lock_);
     return aspace_destroyed_;
 }
 
@@ -544,10 +544,11 @@ zx_status_t VmAspace::PageFault(vaddr_t va, uint flags) {
         flags |= VMM_PF_FLAG_GUEST;
     }
 
-    // for now, hold the aspace lock across the page fault operation,
-    // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(&lock_);
+    // hold the aspace lock shared across the page fault operation, which
+    // stops any other operations on the address space from moving the region
+    // out from underneath it. faults on the same mapping are serialized by
+    // the vmo lock, and the arch aspace does its own locking.
+    AutoReadLock a(&lock_);
 
     return root_vmar_->PageFault(va, flags);
 }
@@ -557,7 +558,7 @@ void VmAspace::Dump(bool verbose) const {
     printf("as %p [%#" PRIxPTR " %#" PRIxPTR "] sz %#zx fl %#x ref %d '%s'\n", this,
            base_, base_ + size_ - 1, size_, flags_, ref_count_debug(), name_);
 
-    AutoLock a(&lock_);
+    AutoWriteLock a(&lock_);
 
     if (verbose)
         root_vmar_->Dump(1, verbose);
@@ -566,16 +567,32 @@ void VmAspace::Dump(bool verbose) const {
 bool VmAspace::EnumerateChildren(VmEnumerator* ve) {
     canary_.Assert();
     DEBUG_ASSERT(ve != nullptr);
-    AutoLock a(&lock_);
-    if (root_vmar_ == nullptr || aspace_destroyed_) {
-        // Aspace hasn't been initialized or has already been destroyed.
-        return true;
-    }
-    DEBUG_ASSERT(root_vmar_->IsAliveLocked());
-    if (!ve->OnVmAddressRegion(root_vmar_.get(), 0)) {
-        return false;
+    VmEnumeratorCursor cursor;
+    for (;;) {
+        AutoReadLock a(&lock_);
+        if (root_vmar_ == nullptr || aspace_destroyed_) {
+            // Aspace hasn't been initialized or has already been destroyed.
+            return true;
+        }
+        DEBUG_ASSERT(root_vmar_->IsAliveLocked());
+        if (!cursor.started) {
+            if (!ve->OnVmAddressRegion(root_vmar_.get(), 0)) {
+                return false;
+            }
+            cursor.base = root_vmar_->base();
+            cursor.depth = 0;
+            cursor.started = true;
+        }
+        cursor.budget = kEnumerateBatch;
+        cursor.paused = false;
+        if (root_vmar_->EnumerateChildrenLocked(ve, 1, &cursor)) {
+            return true;
+        }
+        if (!cursor.paused) {
+            return false;
+        }
+        // Drop the lock to let anyone waiting for it in before carrying on.
     }
-    return root_vmar_->EnumerateChildrenLocked(ve, 1);
 }
 
 void DumpAllAspaces(bool verbose) {
@@ -599,7 +616,7 @@ VmAspace* VmAspace::vaddr_to_aspace(uintptr_t address) {
 size_t VmAspace::AllocatedPages() const {
     canary_.Assert();
 
-    AutoLock a(&lock_);
+    AutoWriteLock a(&lock_);
     return root_vmar_->AllocatedPagesLocked();
 }
 
@@ -612,12 +629,12 @@ void VmAspace::InitializeAslr() {
 
 #if WITH_LIB_VDSO
 uintptr_t VmAspace::vdso_base_address() const {
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
     return VDso::base_address(vdso_code_mapping_);
 }
 
 uintptr_t VmAspace::vdso_code_address() const {
-    AutoLock a(&lock_);
+    AutoReadLock a(&lock_);
     return vdso_code_mapping_ ? vdso_code_mapping_->base() : 0;
 }
 #endif
@@ -9,10 +9,12 @@
 #include "vm_priv.h"
 #include <assert.h>
 #include <err.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
+#include <lib/counters.h>
 #include <safeint/safe_math.h>
 #include <trace.h>
 #include <vm/fault.h>
@@ -25,6 +27,12 @@ using fbl::AutoLock;
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_map, "kernel.vm.large_page.map");
+KCOUNTER(vm_fault_around_pages, "kernel.vm.fault_around.pages");
+
+constexpr size_t VmMapping::kFaultAroundMinPages;
+constexpr size_t VmMapping::kFaultAroundMaxPages;
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags,
@@ -43,7 +51,7 @@ VmMapping::~VmMapping() {
 
 size_t VmMapping::AllocatedPagesLocked() const {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
 
     if (state_ != LifeCycleState::ALIVE) {
         return 0;
@@ -85,7 +93,7 @@ zx_status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flag
 
     size = ROUNDUP(size, PAGE_SIZE);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -112,7 +120,7 @@ zx_status_t ProtectOrUnmap(const fbl::RefPtr<VmAspace>& aspace, vaddr_t base, si
 } // namespace
 
 zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_flags) {
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(base) && IS_PAGE_ALIGNED(size));
 
     // Do not allow changing caching
@@ -125,9 +133,16 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
     }
 
     DEBUG_ASSERT(object_);
+    // an intermediate clone folded out of the vmo's chain below, released only
+    // once the vmo lock has been dropped
+    fbl::RefPtr<VmObject> collapsed;
+
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
+    // keep the parent chain the fault may have to walk short
+    object_->CollapseChainLocked(&collapsed);
+
     // Persist our current caching mode
     new_arch_mmu_flags |= (arch_mmu_flags_ & ARCH_MMU_FLAG_CACHE_MASK);
 
@@ -162,6 +177,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         arch_mmu_flags_ = new_arch_mmu_flags;
 
         size_ = size;
+        PropagateSubtreeStateLocked();
         mapping->ActivateLocked();
         return ZX_OK;
     }
@@ -183,6 +199,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
         size_ -= size;
+        PropagateSubtreeStateLocked();
         mapping->ActivateLocked();
         return ZX_OK;
     }
@@ -212,6 +229,7 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
 
     // Turn us into the left half
     size_ = left_size;
+    PropagateSubtreeStateLocked();
 
     center_mapping->ActivateLocked();
     right_mapping->ActivateLocked();
@@ -232,7 +250,7 @@ zx_status_t VmMapping::Unmap(vaddr_t base, size_t size) {
         return ZX_ERR_BAD_STATE;
     }
 
-    AutoLock guard(aspace->lock());
+    AutoWriteLock guard(aspace->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -251,7 +269,7 @@ zx_status_t VmMapping::Unmap(vaddr_t base, size_t size) {
 
 zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(size != 0 && IS_PAGE_ALIGNED(size) && IS_PAGE_ALIGNED(base));
     DEBUG_ASSERT(base >= base_ && base - base_ < size_);
     DEBUG_ASSERT(size_ - (base - base_) >= size);
@@ -287,6 +305,7 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
             parent_->subregions_.insert(fbl::move(ref));
         }
         size_ -= size;
+        PropagateSubtreeStateLocked();
 
         return ZX_OK;
     }
@@ -315,6 +334,7 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
     // Turn us into the left half
     size_ = base - base_;
+    PropagateSubtreeStateLocked();
     mapping->ActivateLocked();
     return ZX_OK;
 }
@@ -386,6 +406,43 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
     return ZX_OK;
 }
 
+zx_status_t VmMapping::WriteProtectVmoRangeLocked(uint64_t offset, uint64_t len) const {
+    canary_.Assert();
+
+    LTRACEF("region %p obj_offset %#" PRIx64 " size %zu, offset %#" PRIx64 " len %#" PRIx64 "\n",
+            this, object_offset_, size_, offset, len);
+
+    // same locking rules as UnmapVmoRangeLocked()
+    DEBUG_ASSERT(state_ == LifeCycleState::ALIVE);
+
+    DEBUG_ASSERT(object_);
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(len));
+
+    if (len == 0 || !(arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_WRITE))
+        return ZX_OK;
+
+    uint64_t offset_new;
+    uint64_t len_new;
+    if (!GetIntersect(object_offset_, static_cast<uint64_t>(size_), offset, len,
+                      &offset_new, &len_new))
+        return ZX_OK;
+
+    safeint::CheckedNumeric<vaddr_t> protect_base = base_;
+    protect_base += offset_new - object_offset_;
+
+    DEBUG_ASSERT(protect_base.ValueOrDie() >= base_ &&
+                 (protect_base.ValueOrDie() + len_new - 1) <= (base_ + size_ - 1));
+
+    // pages that aren't mapped are skipped, and the next write fault maps
+    // the page writable again
+    return aspace_->arch_aspace().Protect(protect_base.ValueOrDie(),
+                                          static_cast<size_t>(len_new) / PAGE_SIZE,
+                                          arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE);
+}
+
 namespace {
 
 class VmMappingCoalescer {
@@ -469,7 +526,7 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         return ZX_ERR_INVALID_ARGS;
     }
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -487,9 +544,16 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     if (commit)
         pf_flags |= VMM_PF_FLAG_SW_FAULT;
 
+    // an intermediate clone folded out of the vmo's chain below, released only
+    // once the vmo lock has been dropped
+    fbl::RefPtr<VmObject> collapsed;
+
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
+    // keep the parent chain the fault may have to walk short
+    object_->CollapseChainLocked(&collapsed);
+
     // set the currently faulting flag for any recursive calls the vmo may make back into us.
     DEBUG_ASSERT(!currently_faulting_);
     currently_faulting_ = true;
@@ -533,7 +597,7 @@ zx_status_t VmMapping::DecommitRange(size_t offset, size_t len,
     LTRACEF("%p [%#zx+%#zx], offset %#zx, len %#zx\n",
             this, base_, size_, offset, len);
 
-    AutoLock guard(aspace_->lock());
+    AutoWriteLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
         return ZX_ERR_BAD_STATE;
     }
@@ -547,7 +611,7 @@ zx_status_t VmMapping::DecommitRange(size_t offset, size_t len,
 
 zx_status_t VmMapping::DestroyLocked() {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     LTRACEF("%p\n", this);
 
     // Take a reference to ourself, so that we do not get destructed after
@@ -597,7 +661,7 @@ zx_status_t VmMapping::DestroyLocked() {
 
 zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_held(aspace_->lock()));
 
     DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
 
@@ -631,9 +695,16 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         return ZX_ERR_ACCESS_DENIED;
     }
 
+    // an intermediate clone folded out of the vmo's chain below, released only
+    // once the vmo lock has been dropped
+    fbl::RefPtr<VmObject> collapsed;
+
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
+    // keep the parent chain the fault may have to walk short
+    object_->CollapseChainLocked(&collapsed);
+
     // set the currently faulting flag for any recursive calls the vmo may make back into us
     // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
     // via UnmapVmoRangeLocked(). Since we're responsible for that page, signal to ourself to skip
@@ -652,6 +723,41 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         return status;
     }
 
+    // if the page is part of a large page run of the object and the whole run lines up
+    // with this mapping, map the run in one go with the region's full permissions so the
+    // arch layer can use a single large page entry for it
+    const uint64_t large_size = VmObject::kLargePageSize;
+    const vaddr_t run_va = ROUNDDOWN(va, large_size);
+    const uint64_t run_offset = ROUNDDOWN(vmo_offset, large_size);
+    paddr_t run_pa;
+    if (va - run_va == vmo_offset - run_offset && run_va >= base_ &&
+        run_va + large_size - 1 <= base_ + size_ - 1 &&
+        object_->GetLargePageLocked(run_offset, &run_pa) == ZX_OK) {
+        uint page_flags;
+        paddr_t pa;
+        if (aspace_->arch_aspace().Query(va, &pa, &page_flags) == ZX_OK &&
+            pa == new_pa && page_flags == arch_mmu_flags_) {
+            // someone beat us to it
+            return ZX_OK;
+        }
+
+        // clear out any small pages left over from before the run was committed
+        const size_t count = large_size / PAGE_SIZE;
+        status = aspace_->arch_aspace().Unmap(run_va, count, nullptr);
+        if (status == ZX_OK) {
+            status = aspace_->arch_aspace().MapContiguous(run_va, run_pa, count,
+                                                          arch_mmu_flags_, nullptr);
+        }
+        if (status != ZX_OK) {
+            TRACEF("failed to map large page at va %#" PRIxPTR "\n", run_va);
+            return ZX_ERR_NO_MEMORY;
+        }
+
+        kcounter_add(vm_large_page_map, 1);
+        LTRACEF("mapped large page va %#" PRIxPTR " pa %#" PRIxPTR "\n", run_va, run_pa);
+        return ZX_OK;
+    }
+
     // if we read faulted, make sure we map or modify the page without any write permissions
     // this ensures we will fault again if a write is attempted so we can potentially
     // replace this page with a copy or a new one
@@ -736,9 +842,78 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         arch_sync_cache_range(va, PAGE_SIZE);
     }
 #endif
+
+    if (!(pf_flags & VMM_PF_FLAG_GUEST))
+        FaultAroundLocked(va, pf_flags, mmu_flags);
+
     return ZX_OK;
 }
 
+void VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags) {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+    DEBUG_ASSERT(currently_faulting_);
+
+    if (va == next_fault_va_) {
+        fault_around_pages_ = fault_around_pages_ ?
+            fbl::min(fault_around_pages_ * 2, kFaultAroundMaxPages) : kFaultAroundMinPages;
+    } else {
+        fault_around_pages_ = 0;
+    }
+    next_fault_va_ = va + PAGE_SIZE;
+
+    if (fault_around_pages_ == 0)
+        return;
+
+    // large page objects already commit in large runs, and committing one here could
+    // leave stale zero page entries behind in our own range
+    paddr_t unused;
+    uint64_t vmo_offset = va - base_ + object_offset_;
+    if (object_->GetLargePageLocked(ROUNDDOWN(vmo_offset, VmObject::kLargePageSize),
+                                    &unused) != ZX_ERR_NOT_SUPPORTED) {
+        return;
+    }
+
+    const vaddr_t start = va + PAGE_SIZE;
+    const size_t count = fbl::min(fault_around_pages_, (base_ + size_ - start) / PAGE_SIZE);
+
+    // gather the following pages until one is already mapped or can't be faulted in
+    paddr_t pa[kFaultAroundMaxPages];
+    size_t n = 0;
+    for (; n < count; n++) {
+        const vaddr_t v = start + n * PAGE_SIZE;
+        paddr_t existing_pa;
+        uint existing_flags;
+        if (aspace_->arch_aspace().Query(v, &existing_pa, &existing_flags) == ZX_OK)
+            break;
+        if (object_->GetPageLocked(vmo_offset + (n + 1) * PAGE_SIZE, pf_flags, nullptr,
+                                   nullptr, &pa[n]) != ZX_OK)
+            break;
+
+        // assert that we're not accidentally mapping the zero page writable
+        DEBUG_ASSERT((pa[n] != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
+    }
+    if (n == 0)
+        return;
+
+    size_t mapped;
+    zx_status_t status = aspace_->arch_aspace().Map(start, pa, n, mmu_flags, &mapped);
+    if (status != ZX_OK) {
+        // the pages stay committed to the object and fault in normally later
+        LTRACEF("failed to map %zu fault-around pages at %#" PRIxPTR "\n", n, start);
+        return;
+    }
+    DEBUG_ASSERT(mapped == n);
+
+#if ARCH_ARM64
+    if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+        arch_sync_cache_range(start, n * PAGE_SIZE);
+    }
+#endif
+
+    kcounter_add(vm_fault_around_pages, n);
+    next_fault_va_ = start + n * PAGE_SIZE;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -749,7 +924,7 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
 // function.
 void VmMapping::ActivateLocked() TA_NO_THREAD_SAFETY_ANALYSIS {
     DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(rwlock_is_write_held(aspace_->lock()));
     DEBUG_ASSERT(object_->lock()->IsHeld());
     DEBUG_ASSERT(parent_);
 
@@ -15,6 +15,7 @@
 #include <fbl/ref_ptr.h>
 #include <inttypes.h>
 #include <lib/console.h>
+#include <lib/counters.h>
 #include <safeint/safe_math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,11 +28,14 @@ using fbl::AutoLock;
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+MUTEX_CLASS(vmo_lock_class, "vmo");
+
 fbl::Mutex VmObject::all_vmos_lock_ = {};
 VmObject::GlobalList VmObject::all_vmos_ = {};
 
 VmObject::VmObject(fbl::RefPtr<VmObject> parent)
-    : lock_(parent ? parent->lock_ref() : local_lock_),
+    : local_lock_(&vmo_lock_class),
+      lock_(parent ? parent->lock_ref() : local_lock_),
       parent_(fbl::move(parent)) {
     LTRACEF("%p\n", this);
 
@@ -116,6 +120,17 @@ bool VmObject::is_cow_clone() const {
     return parent_ != nullptr;
 }
 
+uint32_t VmObject::chain_depth() const {
+    canary_.Assert();
+    // clones share the lock of their parent, so this covers the whole chain
+    AutoLock a(&lock_);
+    uint32_t depth = 0;
+    for (const VmObject* o = parent_.get(); o; o = o->parent_.get()) {
+        depth++;
+    }
+    return depth;
+}
+
 void VmObject::AddMappingLocked(VmMapping* r) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -234,6 +249,17 @@ void VmObject::RangeChangeUpdateLocked(uint64_t offset, uint64_t len) {
     }
 }
 
+void VmObject::WriteProtectMappingsLocked(uint64_t offset, uint64_t len) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset) && IS_PAGE_ALIGNED(len));
+
+    // children that read our pages through already map them read-only
+    for (auto& m : mapping_list_) {
+        m.WriteProtectVmoRangeLocked(offset, len);
+    }
+}
+
 static int cmd_vm_object(int argc, const cmd_args* argv, uint32_t flags) {
     if (argc < 2) {
     notenoughargs:
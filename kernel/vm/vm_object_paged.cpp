@@ -11,10 +11,16 @@
 #include <arch/ops.h>
 #include <assert.h>
 #include <err.h>
+#include <lk/init.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
+#include <kernel/thread.h>
 #include <lib/console.h>
+#include <lib/counters.h>
+#include <pow2.h>
 #include <safeint/safe_math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,6 +35,21 @@ using fbl::AutoLock;
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+KCOUNTER(vm_large_page_commit, "kernel.vm.large_page.commit");
+KCOUNTER(vm_large_page_fallback, "kernel.vm.large_page.fallback");
+KCOUNTER(vm_cow_collapse, "kernel.vm.cow.collapse");
+KCOUNTER(vm_cow_collapse_pages, "kernel.vm.cow.collapse_pages");
+KCOUNTER(vm_discarded_objects, "kernel.vm.discardable.discarded_objects");
+KCOUNTER(vm_discarded_pages, "kernel.vm.discardable.discarded_pages");
+KCOUNTER(vm_zero_scan_pages, "kernel.vm.zero_scan.scanned_pages");
+KCOUNTER(vm_zero_scan_freed, "kernel.vm.zero_scan.freed_pages");
+
+// How many zero pages DedupZeroPages() collects per trip through the lock.
+constexpr size_t kZeroScanBatch = 32;
+
+// How many pages QueryDirtyUser() handles per trip through the lock.
+constexpr size_t kDirtyQueryBatch = 2048;
+
 namespace {
 
 void ZeroPage(paddr_t pa) {
@@ -43,6 +64,15 @@ void ZeroPage(vm_page_t* p) {
     ZeroPage(pa);
 }
 
+bool IsZeroPage(vm_page_t* p) {
+    const uint64_t* word = static_cast<const uint64_t*>(paddr_to_physmap(vm_page_to_paddr(p)));
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (word[i] != 0)
+            return false;
+    }
+    return true;
+}
+
 void InitializeVmPage(vm_page_t* p) {
     DEBUG_ASSERT(p->state == VM_PAGE_STATE_ALLOC);
     p->state = VM_PAGE_STATE_OBJECT;
@@ -50,10 +80,30 @@ void InitializeVmPage(vm_page_t* p) {
     p->object.contiguous_pin = 0;
 }
 
+// the number of words in a dirty bitmap for |pages| pages. never empty, so a
+// tracked object always has a bitmap.
+size_t DirtyBitmapWords(size_t pages) {
+    return fbl::max<size_t>(ROUNDUP(pages, 64) / 64, 1);
+}
+
+// sets bits [first, last) of |bits|.
+void SetBitRange(uint64_t* bits, size_t first, size_t last) {
+    while (first < last) {
+        const size_t shift = first % 64;
+        const size_t count = fbl::min<size_t>(64 - shift, last - first);
+        const uint64_t mask = (count == 64) ? ~0ull : ((1ull << count) - 1) << shift;
+        bits[first / 64] |= mask;
+        first += count;
+    }
+}
+
 } // namespace
 
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, fbl::RefPtr<VmObject> parent)
-    : VmObject(fbl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
+fbl::Mutex VmObjectPaged::discardable_lock_;
+VmObjectPaged::DiscardableList VmObjectPaged::discardable_list_;
+
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options, fbl::RefPtr<VmObject> parent)
+    : VmObject(fbl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags), options_(options) {
     LTRACEF("%p\n", this);
 }
 
@@ -62,6 +112,12 @@ VmObjectPaged::~VmObjectPaged() {
 
     LTRACEF("%p\n", this);
 
+    if (options_ & kDiscardable) {
+        AutoLock dl(&discardable_lock_);
+        if (discardable_node_.InContainer())
+            discardable_list_.erase(*this);
+    }
+
     page_list_.ForEveryPage(
         [](const auto p, uint64_t off) {
             if (p->object.contiguous_pin) {
@@ -71,17 +127,29 @@ VmObjectPaged::~VmObjectPaged() {
             return ZX_ERR_NEXT;
         });
 
-    // free all of the pages attached to us
-    page_list_.FreeAllPages();
+    // free all of the pages attached to us. this is usually the tail end of a
+    // process teardown, so let the pmm return them to the arenas in the
+    // background instead of making the exiting thread wait.
+    list_node list = LIST_INITIAL_VALUE(list);
+    size_t count = page_list_.TakeAllPages(&list);
+    pmm_free_deferred(&list, count);
 }
 
 zx_status_t VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size, fbl::RefPtr<VmObject>* obj) {
+    return Create(pmm_alloc_flags, 0u, size, obj);
+}
+
+zx_status_t VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint32_t options, uint64_t size,
+                                  fbl::RefPtr<VmObject>* obj) {
     // there's a max size to keep indexes within range
     if (size > MAX_SIZE)
         return ZX_ERR_INVALID_ARGS;
 
+    if (options & ~(kLargePages | kDiscardable))
+        return ZX_ERR_INVALID_ARGS;
+
     fbl::AllocChecker ac;
-    auto vmo = fbl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr));
+    auto vmo = fbl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags, options, nullptr));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
@@ -89,6 +157,12 @@ zx_status_t VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size, fbl::
     if (err != ZX_OK)
         return err;
 
+    // discardable objects start out unlocked
+    if (options & kDiscardable) {
+        AutoLock dl(&discardable_lock_);
+        discardable_list_.push_back(vmo.get());
+    }
+
     *obj = fbl::move(vmo);
 
     return ZX_OK;
@@ -99,13 +173,22 @@ zx_status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, bool copy_na
 
     canary_.Assert();
 
+    // a clone would see its parent's pages vanish
+    if (options_ & kDiscardable)
+        return ZX_ERR_NOT_SUPPORTED;
+
     fbl::AllocChecker ac;
-    auto vmo = fbl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, fbl::WrapRefPtr(this)));
+    auto vmo = fbl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, 0u, fbl::WrapRefPtr(this)));
     if (!ac.check())
         return ZX_ERR_NO_MEMORY;
 
+    // dropped after the lock, see CollapseChainLocked()
+    fbl::RefPtr<VmObject> collapsed;
     AutoLock a(&lock_);
 
+    // flatten our chain before the new clone makes it any deeper
+    CollapseChainLocked(&collapsed);
+
     // add it as a child to us
     AddChildLocked(vmo.get());
 
@@ -127,6 +210,101 @@ zx_status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, bool copy_na
     return ZX_OK;
 }
 
+void VmObjectPaged::CollapseChainLocked(fbl::RefPtr<VmObject>* collapsed) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(!*collapsed);
+
+    // fold in the first collapsible ancestor up the chain; one per call keeps the
+    // work done under the lock bounded
+    for (VmObjectPaged* o = this; o->parent_;) {
+        if (o->CollapseParentLocked(collapsed))
+            return;
+
+        DEBUG_ASSERT(o->parent_->is_paged());
+        o = static_cast<VmObjectPaged*>(o->parent_.get());
+    }
+}
+
+bool VmObjectPaged::CollapseParentLocked(fbl::RefPtr<VmObject>* collapsed) {
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(parent_ && parent_->is_paged());
+
+    auto parent = static_cast<VmObjectPaged*>(parent_.get());
+
+    // only an intermediate clone whose sole reference is ours can go: that rules
+    // out handles, mappings and pins, and nobody can take a new reference to it
+    // without going through our parent_ under the lock we hold
+    if (!parent->parent_ || parent->children_list_len_ != 1 || parent->mapping_list_len_ != 0 ||
+        parent->ref_count_debug() != 1) {
+        return false;
+    }
+
+    safeint::CheckedNumeric<uint64_t> new_offset = parent->parent_offset_;
+    new_offset += parent_offset_;
+    safeint::CheckedNumeric<uint64_t> end = new_offset;
+    end += size_;
+    if (!end.IsValid())
+        return false;
+
+    // the range of our offsets the parent showed us, and the part of that backed
+    // by the grandparent, which the parent's own size and limit cut short
+    const uint64_t visible = fbl::min(parent_limit_, ROUNDUP_PAGE_SIZE(size_));
+    uint64_t new_limit = parent_limit_;
+    new_limit = fbl::min(new_limit,
+                         parent->size_ > parent_offset_ ? parent->size_ - parent_offset_ : 0);
+    new_limit = fbl::min(new_limit, parent->parent_limit_ > parent_offset_
+                                        ? parent->parent_limit_ - parent_offset_
+                                        : 0);
+
+    // take the parent's pages we can see and haven't copied already. if we run out
+    // of memory part way the pages moved so far are still ours and the parent
+    // stays in place, which leaves the chain just as valid as before.
+    bool failed = false;
+    size_t migrated = 0;
+    const uint64_t parent_offset = parent_offset_;
+    parent->page_list_.ForEveryPage([&](auto& p, uint64_t off) {
+        if (off < parent_offset || off - parent_offset >= visible)
+            return ZX_ERR_NEXT;
+        if (page_list_.GetPage(off - parent_offset))
+            return ZX_ERR_NEXT;
+        if (page_list_.AddPage(p, off - parent_offset) != ZX_OK) {
+            failed = true;
+            return ZX_ERR_STOP;
+        }
+        p = nullptr;
+        migrated++;
+        return ZX_ERR_NEXT;
+    });
+    kcounter_add(vm_cow_collapse_pages, migrated);
+    if (failed)
+        return false;
+
+    LTRACEF("vmo %p collapsing parent %p, %zu pages migrated\n", this, parent, migrated);
+
+    // whatever is left was hidden from us or shadowed by our own copies
+    parent->page_list_.FreeAllPages();
+
+    // take the parent's place under the grandparent. the mappings of the pages we
+    // took over stay valid since they are the same pages with the same contents.
+    fbl::RefPtr<VmObject> grandparent = fbl::move(parent->parent_);
+    parent->RemoveChildLocked(this);
+    grandparent->RemoveChildLocked(parent);
+    grandparent->AddChildLocked(this);
+
+    parent_offset_ = new_offset.ValueOrDie();
+    parent_limit_ = new_limit;
+
+    // the old parent is detached and empty, but destroying it takes the global vmo
+    // list lock, which can't be acquired with ours held
+    *collapsed = fbl::move(parent_);
+    parent_ = fbl::move(grandparent);
+
+    kcounter_add(vm_cow_collapse, 1);
+
+    return true;
+}
+
 void VmObjectPaged::Dump(uint depth, bool verbose) {
     canary_.Assert();
 
@@ -170,13 +348,12 @@ size_t VmObjectPaged::AllocatedPagesInRange(uint64_t offset, uint64_t len) const
     size_t count = 0;
     // TODO: Figure out what to do with our parent's pages. If we're a clone,
     // page_list_ only contains pages that we've made copies of.
-    page_list_.ForEveryPage(
-        [&count, offset, new_len](const auto p, uint64_t off) {
-            if (off >= offset && off < offset + new_len) {
-                count++;
-            }
+    page_list_.ForEveryPageInRange(
+        [&count](const auto p, uint64_t off) {
+            count++;
             return ZX_ERR_NEXT;
-        });
+        },
+        ROUNDUP(offset, PAGE_SIZE), ROUNDUP(offset + new_len, PAGE_SIZE));
     return count;
 }
 
@@ -271,6 +448,10 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     if (offset >= size_)
         return ZX_ERR_OUT_OF_RANGE;
 
+    // whatever page we hand back for writing may be written through
+    if (pf_flags & VMM_PF_FLAG_WRITE)
+        MarkDirtyLocked(offset);
+
     vm_page_t* p;
     paddr_t pa;
 
@@ -289,7 +470,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
             vmm_pf_flags_to_string(pf_flags, pf_string));
 
     // if we have a parent see if they have a page for us
-    if (parent_) {
+    if (parent_ && offset < parent_limit_) {
         safeint::CheckedNumeric<uint64_t> parent_offset = parent_offset_;
         parent_offset += offset;
         DEBUG_ASSERT(parent_offset.IsValid());
@@ -359,6 +540,19 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
     if ((pf_flags & VMM_PF_FLAG_FAULT_MASK) == 0)
         return ZX_ERR_NOT_FOUND;
 
+    // large page objects commit the whole surrounding run on any fault, rather than
+    // handing out the zero page, so that it can be mapped as one large page
+    if ((options_ & kLargePages) && !free_list && CommitLargePageLocked(offset)) {
+        p = page_list_.GetPage(offset);
+        DEBUG_ASSERT(p);
+
+        if (page_out)
+            *page_out = p;
+        if (pa_out)
+            *pa_out = vm_page_to_paddr(p);
+        return ZX_OK;
+    }
+
     // if we're read faulting, we don't already have a page, and the parent doesn't have it,
     // return the single global zero page
     if ((pf_flags & VMM_PF_FLAG_WRITE) == 0) {
@@ -378,7 +572,7 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
         }
     }
     if (!p) {
-        p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+        p = pmm_alloc_zeroed_page(pmm_alloc_flags_, &pa);
     }
     if (!p) {
         return ZX_ERR_NO_MEMORY;
@@ -386,9 +580,6 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
 
     InitializeVmPage(p);
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
-
     zx_status_t status = AddPageLocked(p, offset);
     DEBUG_ASSERT(status == ZX_OK);
 
@@ -428,6 +619,16 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t*
     DEBUG_ASSERT(end > offset);
     offset = ROUNDDOWN(offset, PAGE_SIZE);
 
+    // commit the large page runs fully inside the range first, the rest is
+    // filled in with individual pages below
+    if (options_ & kLargePages) {
+        for (uint64_t o = ROUNDUP(offset, kLargePageSize); o + kLargePageSize <= end;
+             o += kLargePageSize) {
+            if (CommitLargePageLocked(o) && committed)
+                *committed += kLargePageSize;
+        }
+    }
+
     // make a pass through the list, counting the number of pages we need to allocate
     size_t count = 0;
     uint64_t expected_next_off = offset;
@@ -451,7 +652,7 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t*
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_zeroed_pages(count, pmm_alloc_flags_, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -483,9 +684,89 @@ zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t*
 
     DEBUG_ASSERT(list_is_empty(&page_list));
 
-    // for now we only support committing as much as we were asked for
-    DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
+    return ZX_OK;
+}
+
+bool VmObjectPaged::CommitLargePageLocked(uint64_t offset) {
+    DEBUG_ASSERT(options_ & kLargePages);
+
+    // clones share pages with their parent and can't promise contiguity
+    if (parent_)
+        return false;
+
+    uint64_t start = ROUNDDOWN(offset, kLargePageSize);
+    if (start + kLargePageSize > size_)
+        return false;
+
+    // only commit runs that are still completely empty
+    bool empty = true;
+    page_list_.ForEveryPageInRange(
+        [&empty](const auto p, uint64_t off) {
+            empty = false;
+            return ZX_ERR_STOP;
+        },
+        start, start + kLargePageSize);
+    if (!empty)
+        return false;
+
+    const size_t count = kLargePageSize / PAGE_SIZE;
+    list_node page_list = LIST_INITIAL_VALUE(page_list);
+    paddr_t pa;
+    if (pmm_alloc_contiguous(count, pmm_alloc_flags_, log2_uint_floor(kLargePageSize), &pa,
+                             &page_list) != count) {
+        LTRACEF("no contiguous run for offset %#" PRIx64 ", falling back to pages\n", start);
+        kcounter_add(vm_large_page_fallback, 1);
+        pmm_free(&page_list);
+        return false;
+    }
+
+    for (uint64_t o = start; o < start + kLargePageSize; o += PAGE_SIZE) {
+        vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, free.node);
+        ASSERT(p);
+
+        InitializeVmPage(p);
+
+        // TODO: remove once pmm returns zeroed pages
+        ZeroPage(p);
+
+        __UNUSED zx_status_t status = page_list_.AddPage(p, o);
+        DEBUG_ASSERT(status == ZX_OK);
+    }
+
+    // other mappings may have covered this range with the zero page, so unmap it
+    RangeChangeUpdateLocked(start, kLargePageSize);
+
+    kcounter_add(vm_large_page_commit, 1);
+    LTRACEF("committed large page at offset %#" PRIx64 ", pa %#" PRIxPTR "\n", start, pa);
+    return true;
+}
+
+zx_status_t VmObjectPaged::GetLargePageLocked(uint64_t offset, paddr_t* pa_out) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(IS_ALIGNED(offset, kLargePageSize));
+
+    if (!(options_ & kLargePages))
+        return ZX_ERR_NOT_SUPPORTED;
+    if (offset + kLargePageSize > size_)
+        return ZX_ERR_NOT_FOUND;
+
+    vm_page_t* first = page_list_.GetPage(offset);
+    if (!first)
+        return ZX_ERR_NOT_FOUND;
+
+    paddr_t base = vm_page_to_paddr(first);
+    if (!IS_ALIGNED(base, kLargePageSize))
+        return ZX_ERR_NOT_FOUND;
+
+    // the pages in the run must still be the contiguous ones committed together
+    for (uint64_t o = PAGE_SIZE; o < kLargePageSize; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(offset + o);
+        if (!p || vm_page_to_paddr(p) != base + o)
+            return ZX_ERR_NOT_FOUND;
+    }
 
+    *pa_out = base;
     return ZX_OK;
 }
 
@@ -614,8 +895,11 @@ zx_status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t
     // iterate through the pages, freeing them
     while (start < end) {
         auto status = page_list_.FreePage(start);
-        if (status == ZX_OK && decommitted) {
-            *decommitted += PAGE_SIZE;
+        if (status == ZX_OK) {
+            // the page reads as zero from now on
+            MarkDirtyLocked(start);
+            if (decommitted)
+                *decommitted += PAGE_SIZE;
         }
         start += PAGE_SIZE;
     }
@@ -623,6 +907,89 @@ zx_status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t
     return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, list_node* pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ZX_ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (!InRange(offset, len, size_))
+        return ZX_ERR_OUT_OF_RANGE;
+    const uint64_t end = offset + len;
+
+    // pages read through from a parent would show up again once ours are gone,
+    // and a child may still be reading ours. large page runs have to stay
+    // physically contiguous, so they can't give up single pages either.
+    if (parent_ || children_list_len_ != 0 || (options_ & kLargePages))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    if (AnyPagesPinnedLocked(offset, len))
+        return ZX_ERR_BAD_STATE;
+
+    // fill in the holes up front so the move below can't fail part way
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        zx_status_t status = GetPageLocked(o, VMM_PF_FLAG_WRITE | VMM_PF_FLAG_SW_FAULT,
+                                           nullptr, nullptr, nullptr);
+        if (status != ZX_OK)
+            return status;
+    }
+
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, len);
+
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.RemovePage(o);
+        DEBUG_ASSERT(p);
+        list_add_tail(pages, &p->free.node);
+    }
+
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, list_node* pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ZX_ERR_INVALID_ARGS;
+    if (list_length(pages) != len / PAGE_SIZE)
+        return ZX_ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (!InRange(offset, len, size_))
+        return ZX_ERR_OUT_OF_RANGE;
+    const uint64_t end = offset + len;
+
+    if (options_ & kLargePages)
+        return ZX_ERR_NOT_SUPPORTED;
+
+    if (AnyPagesPinnedLocked(offset, len))
+        return ZX_ERR_BAD_STATE;
+
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, len);
+
+    for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
+        page_list_.FreePage(o);
+        MarkDirtyLocked(o);
+
+        vm_page_t* p = list_remove_head_type(pages, vm_page_t, free.node);
+        zx_status_t status = page_list_.AddPage(p, o);
+        if (status != ZX_OK) {
+            // only a failed node allocation gets here. the pages already placed
+            // stay, the rest of the range reads as zero.
+            list_add_head(pages, &p->free.node);
+            return status;
+        }
+    }
+
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::Pin(uint64_t offset, uint64_t len) {
     canary_.Assert();
 
@@ -709,6 +1076,152 @@ void VmObjectPaged::UnpinLocked(uint64_t offset, uint64_t len) {
     return;
 }
 
+size_t VmObjectPaged::DedupZeroPages() {
+    canary_.Assert();
+
+    size_t freed = 0;
+    uint64_t start = 0;
+    // the lock is dropped between batches so faults aren't held up for long
+    for (;;) {
+        AutoLock a(&lock_);
+
+        // a clone's pages shadow its parent's, which needn't be zero, and
+        // large page objects would lose their runs
+        if (parent_ || (options_ & kLargePages))
+            return freed;
+        // the kernel doesn't expect its own mappings to fault
+        for (const auto& m : mapping_list_) {
+            if (!m.aspace()->is_user())
+                return freed;
+        }
+
+        const uint64_t end = ROUNDUP_PAGE_SIZE(size_);
+        if (start >= end)
+            return freed;
+
+        uint64_t candidates[kZeroScanBatch];
+        size_t count = 0;
+        uint64_t next = end;
+        page_list_.ForEveryPageInRange(
+            [&](const auto p, uint64_t off) {
+                if (count == kZeroScanBatch) {
+                    next = off;
+                    return ZX_ERR_STOP;
+                }
+                kcounter_add(vm_zero_scan_pages, 1);
+                if (p->object.pin_count == 0 && IsZeroPage(p))
+                    candidates[count++] = off;
+                return ZX_ERR_NEXT;
+            },
+            start, end);
+
+        for (size_t i = 0; i < count; i++) {
+            // writes through a mapping don't take our lock, so take the page
+            // away from the mappings before making sure it is still zero.
+            // anyone touching it now faults and waits for us.
+            RangeChangeUpdateLocked(candidates[i], PAGE_SIZE);
+            vm_page_t* p = page_list_.GetPage(candidates[i]);
+            if (p && p->object.pin_count == 0 && IsZeroPage(p)) {
+                page_list_.FreePage(candidates[i]);
+                kcounter_add(vm_zero_scan_freed, 1);
+                freed++;
+            }
+        }
+
+        start = next;
+    }
+}
+
+zx_status_t VmObjectPaged::LockDiscardable(bool* was_discarded) {
+    canary_.Assert();
+
+    if (!(options_ & kDiscardable))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    AutoLock a(&lock_);
+    if (discardable_lock_count_ == UINT32_MAX)
+        return ZX_ERR_OUT_OF_RANGE;
+    if (discardable_lock_count_++ == 0) {
+        AutoLock dl(&discardable_lock_);
+        discardable_list_.erase(*this);
+    }
+
+    *was_discarded = discarded_;
+    discarded_ = false;
+    return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::UnlockDiscardable() {
+    canary_.Assert();
+
+    if (!(options_ & kDiscardable))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    AutoLock a(&lock_);
+    if (discardable_lock_count_ == 0)
+        return ZX_ERR_BAD_STATE;
+    if (--discardable_lock_count_ == 0) {
+        AutoLock dl(&discardable_lock_);
+        discardable_list_.push_back(this);
+    }
+    return ZX_OK;
+}
+
+size_t VmObjectPaged::Discard() {
+    canary_.Assert();
+
+    AutoLock a(&lock_);
+    // someone may have locked us since we were picked off the list
+    if (discardable_lock_count_ != 0)
+        return 0;
+
+    const uint64_t len = ROUNDUP_PAGE_SIZE(size_);
+    if (len == 0 || AnyPagesPinnedLocked(0, len))
+        return 0;
+
+    // unmap everything before the pages go back to the pmm
+    RangeChangeUpdateLocked(0, len);
+    size_t count = page_list_.FreeAllPages();
+    if (count == 0)
+        return 0;
+    discarded_ = true;
+
+    kcounter_add(vm_discarded_objects, 1);
+    kcounter_add(vm_discarded_pages, count);
+    return count;
+}
+
+size_t VmObjectPaged::DiscardUnlockedPages(size_t target_pages) {
+    size_t freed = 0;
+
+    // visit each object at most once; the ones we look at move to the back
+    size_t remaining;
+    {
+        AutoLock dl(&discardable_lock_);
+        remaining = discardable_list_.size_slow();
+    }
+
+    while (freed < target_pages && remaining-- > 0) {
+        fbl::RefPtr<VmObjectPaged> vmo;
+        {
+            AutoLock dl(&discardable_lock_);
+            if (discardable_list_.is_empty())
+                break;
+            VmObjectPaged* raw = discardable_list_.pop_front();
+            discardable_list_.push_back(raw);
+            // the object may be on its way out, in which case its destructor
+            // is waiting for the lock to take it off the list
+            vmo = fbl::internal::MakeRefPtrUpgradeFromRaw(raw, discardable_lock_);
+        }
+        // the reference is dropped here, outside the list lock
+        if (vmo)
+            freed += vmo->Discard();
+    }
+
+    LTRACEF("freed %zu pages of %zu\n", freed, target_pages);
+    return freed;
+}
+
 bool VmObjectPaged::AnyPagesPinnedLocked(uint64_t offset, size_t len) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
@@ -743,6 +1256,26 @@ zx_status_t VmObjectPaged::ResizeLocked(uint64_t s) {
     if (s > MAX_SIZE)
         return ZX_ERR_OUT_OF_RANGE;
 
+    // resize the dirty bitmap first, since it's the only part that can fail.
+    // pages past the old end count as written, whatever was there before a
+    // shrink is gone.
+    if (dirty_bits_) {
+        const size_t old_pages = ROUNDUP_PAGE_SIZE(size_) / PAGE_SIZE;
+        const size_t new_pages = ROUNDUP_PAGE_SIZE(s) / PAGE_SIZE;
+        const size_t words = DirtyBitmapWords(new_pages);
+        if (words != dirty_bits_.size()) {
+            fbl::AllocChecker ac;
+            uint64_t* bits = new (&ac) uint64_t[words];
+            if (!ac.check())
+                return ZX_ERR_NO_MEMORY;
+            const size_t keep = fbl::min(words, dirty_bits_.size());
+            memcpy(bits, dirty_bits_.get(), keep * sizeof(uint64_t));
+            memset(bits + keep, 0, (words - keep) * sizeof(uint64_t));
+            dirty_bits_.reset(bits, words);
+        }
+        SetBitRange(dirty_bits_.get(), old_pages, new_pages);
+    }
+
     // see if we're shrinking or expanding the vmo
     if (s < size_) {
         // shrinking
@@ -900,6 +1433,44 @@ zx_status_t VmObjectPaged::Write(const void* _ptr, uint64_t offset, size_t len,
     return ReadWriteInternal(offset, len, bytes_written, true, write_routine);
 }
 
+zx_status_t VmObjectPaged::CopyFrom(VmObject* src, uint64_t src_offset, uint64_t offset,
+                                    size_t len) {
+    canary_.Assert();
+
+    if (!InRange(offset, len, size()) || !InRange(src_offset, len, src->size()))
+        return ZX_ERR_OUT_OF_RANGE;
+    if (len == 0)
+        return ZX_OK;
+
+    // Only one vmo's lock may be held at a time, since the two could be
+    // related by a clone, so each page goes through a kernel bounce page.
+    vm_page_t* bounce_page;
+    uint8_t* bounce = static_cast<uint8_t*>(pmm_alloc_kpage(nullptr, &bounce_page));
+    if (!bounce)
+        return ZX_ERR_NO_MEMORY;
+
+    // Copy back to front when the destination overlaps the end of the source.
+    const bool backward = (src == this) && (offset > src_offset) && (offset - src_offset < len);
+
+    zx_status_t status = ZX_OK;
+    size_t done = 0;
+    while (done < len) {
+        size_t chunk = MIN(PAGE_SIZE, len - done);
+        uint64_t pos = backward ? len - done - chunk : done;
+
+        status = src->Read(bounce, src_offset + pos, chunk, nullptr);
+        if (status != ZX_OK)
+            break;
+        status = Write(bounce, offset + pos, chunk, nullptr);
+        if (status != ZX_OK)
+            break;
+        done += chunk;
+    }
+
+    pmm_free_page(bounce_page);
+    return status;
+}
+
 zx_status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, uint pf_flags,
                                   vmo_lookup_fn_t lookup_fn, void* context) {
     canary_.Assert();
@@ -1018,6 +1589,169 @@ zx_status_t VmObjectPaged::LookupUser(uint64_t offset, uint64_t len, user_inout_
     return Lookup(offset, len, 0, copy_to_user, &buffer);
 }
 
+zx_status_t VmObjectPaged::TrackDirty(bool enable) {
+    canary_.Assert();
+
+    AutoLock a(&lock_);
+
+    // discarding frees pages without going through a write, and a large page
+    // run is mapped with one entry, so neither can be tracked page by page.
+    if (options_ & (kDiscardable | kLargePages))
+        return ZX_ERR_NOT_SUPPORTED;
+
+    if (!enable) {
+        dirty_bits_.reset();
+        return ZX_OK;
+    }
+
+    const size_t pages = ROUNDUP_PAGE_SIZE(size_) / PAGE_SIZE;
+    const size_t words = DirtyBitmapWords(pages);
+    fbl::AllocChecker ac;
+    uint64_t* bits = new (&ac) uint64_t[words];
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    memset(bits, 0, words * sizeof(uint64_t));
+    dirty_bits_.reset(bits, words);
+
+    // from here on the only way to get a writable mapping of a page is a
+    // write fault, which marks it
+    WriteProtectMappingsLocked(0, pages * PAGE_SIZE);
+    return ZX_OK;
+}
+
+void VmObjectPaged::MarkDirtyLocked(uint64_t offset) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (!dirty_bits_)
+        return;
+    const size_t page = offset / PAGE_SIZE;
+    dirty_bits_[page / 64] |= 1ull << (page % 64);
+}
+
+void VmObjectPaged::TakeDirtyLocked(uint64_t offset, size_t pages, uint64_t* bits) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+    DEBUG_ASSERT(dirty_bits_);
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset));
+
+    memset(bits, 0, ROUNDUP(pages, 64) / 64 * sizeof(uint64_t));
+    if (pages == 0)
+        return;
+
+    const size_t first = offset / PAGE_SIZE;
+    uint64_t* dirty = dirty_bits_.get();
+
+    // a pinned page may be written by a device at any time, so it always
+    // counts as dirty
+    page_list_.ForEveryPageInRange(
+        [dirty](const auto p, uint64_t off) {
+            if (p->object.pin_count > 0) {
+                const size_t page = off / PAGE_SIZE;
+                dirty[page / 64] |= 1ull << (page % 64);
+            }
+            return ZX_ERR_NEXT;
+        },
+        offset, offset + pages * PAGE_SIZE);
+
+    // move the bits over a run at a time, a run ending at a word boundary of
+    // either bitmap
+    for (size_t i = 0; i < pages;) {
+        const size_t src = first + i;
+        const size_t count = fbl::min(fbl::min<size_t>(64 - src % 64, 64 - i % 64), pages - i);
+        const uint64_t mask = (count == 64) ? ~0ull : (1ull << count) - 1;
+        const uint64_t v = (dirty[src / 64] >> (src % 64)) & mask;
+        if (v) {
+            dirty[src / 64] &= ~(mask << (src % 64));
+            bits[i / 64] |= v << (i % 64);
+        }
+        i += count;
+    }
+
+    // take write permission away again from the pages we're reporting. the
+    // others haven't been written through a mapping since their last report,
+    // so no mapping has them writable.
+    for (size_t i = 0; i < pages;) {
+        if (bits[i / 64] == 0 && i % 64 == 0) {
+            i += 64;
+            continue;
+        }
+        if (!(bits[i / 64] & (1ull << (i % 64)))) {
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        while (end < pages && (bits[end / 64] & (1ull << (end % 64))))
+            end++;
+        WriteProtectMappingsLocked(offset + i * PAGE_SIZE, (end - i) * PAGE_SIZE);
+        i = end;
+    }
+}
+
+void VmObjectPaged::RestoreDirtyLocked(uint64_t offset, size_t pages, const uint64_t* bits) {
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    // tracking may have been turned off or the object shrunk in the meantime
+    if (!dirty_bits_)
+        return;
+    const size_t first = offset / PAGE_SIZE;
+    const size_t limit = dirty_bits_.size() * 64;
+    for (size_t i = 0; i < pages && first + i < limit; i++) {
+        if (bits[i / 64] & (1ull << (i % 64)))
+            dirty_bits_[(first + i) / 64] |= 1ull << ((first + i) % 64);
+    }
+}
+
+zx_status_t VmObjectPaged::QueryDirtyUser(uint64_t offset, uint64_t len,
+                                          user_inout_ptr<uint8_t> buffer, size_t buffer_size) {
+    canary_.Assert();
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len))
+        return ZX_ERR_INVALID_ARGS;
+    const size_t pages = len / PAGE_SIZE;
+    if (unlikely(ROUNDUP(pages, 8) / 8 > buffer_size))
+        return ZX_ERR_BUFFER_TOO_SMALL;
+
+    static_assert(kDirtyQueryBatch % 64 == 0, "");
+    uint64_t bits[kDirtyQueryBatch / 64];
+    uint8_t bytes[kDirtyQueryBatch / 8];
+
+    // always go through the lock once, so a zero length query still checks
+    // the state of the object
+    size_t done = 0;
+    do {
+        const uint64_t batch_offset = offset + done * PAGE_SIZE;
+        const size_t count = fbl::min(pages - done, kDirtyQueryBatch);
+        {
+            AutoLock a(&lock_);
+
+            if (!dirty_bits_)
+                return ZX_ERR_BAD_STATE;
+            if (!InRange(batch_offset, static_cast<uint64_t>(count * PAGE_SIZE),
+                         ROUNDUP_PAGE_SIZE(size_)))
+                return ZX_ERR_OUT_OF_RANGE;
+
+            TakeDirtyLocked(batch_offset, count, bits);
+        }
+
+        // copy out without the lock held, any fault on the buffer could
+        // need it
+        const size_t nbytes = ROUNDUP(count, 8) / 8;
+        for (size_t b = 0; b < nbytes; b++)
+            bytes[b] = static_cast<uint8_t>(bits[b / 8] >> (8 * (b % 8)));
+        zx_status_t status = buffer.element_offset(done / 8).copy_array_to_user(bytes, nbytes);
+        if (status != ZX_OK) {
+            // don't lose the writes the caller never got to see
+            AutoLock a(&lock_);
+            RestoreDirtyLocked(batch_offset, count, bits);
+            return status;
+        }
+
+        done += count;
+    } while (done < pages);
+
+    return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::InvalidateCache(const uint64_t offset, const uint64_t len) {
     return CacheOp(offset, len, CacheOpType::Invalidate);
 }
@@ -1046,6 +1780,35 @@ zx_status_t VmObjectPaged::CacheOp(const uint64_t start_offset, const uint64_t l
     if (unlikely(!InRange(start_offset, len, size_)))
         return ZX_ERR_OUT_OF_RANGE;
 
+    // Pages which are next to each other in physical memory are next to each
+    // other in the physmap as well, so runs of them are handed to the arch
+    // layer as one range. That keeps the barriers the arch routines issue to
+    // one per run instead of one per page.
+    addr_t run_start = 0;
+    size_t run_len = 0;
+    auto flush_run = [type, &run_start, &run_len]() {
+        if (run_len == 0)
+            return;
+
+        LTRACEF("addr %#" PRIxPTR " len %#zx op %d\n", run_start, run_len, (int)type);
+
+        switch (type) {
+        case CacheOpType::Invalidate:
+            arch_invalidate_cache_range(run_start, run_len);
+            break;
+        case CacheOpType::Clean:
+            arch_clean_cache_range(run_start, run_len);
+            break;
+        case CacheOpType::CleanInvalidate:
+            arch_clean_invalidate_cache_range(run_start, run_len);
+            break;
+        case CacheOpType::Sync:
+            arch_sync_cache_range(run_start, run_len);
+            break;
+        }
+        run_len = 0;
+    };
+
     const size_t end_offset = static_cast<size_t>(start_offset + len);
     size_t op_start_offset = static_cast<size_t>(start_offset);
 
@@ -1070,27 +1833,18 @@ zx_status_t VmObjectPaged::CacheOp(const uint64_t start_offset, const uint64_t l
             const void* ptr = paddr_to_physmap(pa);
             const addr_t cache_op_addr = reinterpret_cast<addr_t>(ptr) + page_offset;
 
-            LTRACEF("ptr %p op %d\n", ptr, (int)type);
-
-            // Perform the necessary cache op against this page.
-            switch (type) {
-            case CacheOpType::Invalidate:
-                arch_invalidate_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::Clean:
-                arch_clean_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::CleanInvalidate:
-                arch_clean_invalidate_cache_range(cache_op_addr, cache_op_len);
-                break;
-            case CacheOpType::Sync:
-                arch_sync_cache_range(cache_op_addr, cache_op_len);
-                break;
-            }
+            if (run_len != 0 && run_start + run_len != cache_op_addr)
+                flush_run();
+            if (run_len == 0)
+                run_start = cache_op_addr;
+            run_len += cache_op_len;
+        } else {
+            flush_run();
         }
 
         op_start_offset += cache_op_len;
     }
+    flush_run();
 
     return ZX_OK;
 }
@@ -1125,3 +1879,36 @@ void VmObjectPaged::RangeChangeUpdateFromParentLocked(const uint64_t offset, con
     // TODO: optimize by not passing on ranges that are completely covered by pages local to this vmo
     RangeChangeUpdateLocked(offset_new, len_new);
 }
+
+// Periodically hands the zero-filled pages of user VMOs back to the pmm.
+static int zero_scan_thread(void* arg) {
+    const zx_duration_t period = *static_cast<zx_duration_t*>(arg);
+    for (;;) {
+        thread_sleep_relative(period);
+
+        size_t freed = 0;
+        VmObject::ForEachRef([&freed](const fbl::RefPtr<VmObject>& vmo) {
+            // kernel objects may be accessed through their physical pages
+            if (vmo->user_id() != 0)
+                freed += vmo->DedupZeroPages();
+        });
+        LTRACEF("freed %zu zero pages\n", freed);
+    }
+    return 0;
+}
+
+static void zero_scan_init(uint level) {
+    static zx_duration_t period;
+    period = ZX_SEC(cmdline_get_uint64("kernel.vm.zero-scan-sec", 0));
+    if (period == 0)
+        return;
+
+    thread_t* t = thread_create("vm-zero-scan", &zero_scan_thread, &period,
+                                LOWEST_PRIORITY, DEFAULT_STACK_SIZE);
+    if (!t) {
+        printf("VM: failed to create zero scan thread\n");
+        return;
+    }
+    thread_detach_and_resume(t);
+}
+LK_INIT_HOOK(vm_zero_scan, &zero_scan_init, LK_INIT_LEVEL_THREADING);
@@ -60,84 +60,213 @@ zx_status_t VmPageListNode::AddPage(vm_page* p, size_t index) {
     return ZX_OK;
 }
 
+VmPageListInnerNode::VmPageListInnerNode() {
+    LTRACEF("%p\n", this);
+}
+
+VmPageListInnerNode::~VmPageListInnerNode() {
+    LTRACEF("%p\n", this);
+    canary_.Assert();
+
+    DEBUG_ASSERT(IsEmpty());
+}
+
 VmPageList::VmPageList() {
     LTRACEF("%p\n", this);
 }
 
 VmPageList::~VmPageList() {
     LTRACEF("%p\n", this);
-    DEBUG_ASSERT(list_.is_empty());
+    DEBUG_ASSERT(IsEmpty());
+}
+
+// allocate a fresh node for |slot|: a leaf if |height| is 0, an inner node otherwise
+zx_status_t VmPageList::AllocSlot(Slot* slot, uint height, uint64_t offset) {
+    fbl::AllocChecker ac;
+    if (height == 0) {
+        uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+        slot->leaf = new (&ac) VmPageListNode(node_offset);
+    } else {
+        slot->inner = new (&ac) VmPageListInnerNode();
+    }
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    LTRACEF("allocating new node %p height %u\n", slot->inner, height);
+    return ZX_OK;
+}
+
+// free the node in |slot| and everything below it; the pages must have been
+// removed already
+void VmPageList::FreeSlot(Slot slot, uint height) {
+    if (height == 0) {
+        delete slot.leaf;
+        return;
+    }
+
+    VmPageListInnerNode* node = slot.inner;
+    for (size_t i = 0; i < VmPageListInnerNode::kFanOut; i++) {
+        if (node->IsPresent(i)) {
+            FreeSlot(node->slot(i), height - 1);
+            node->ClearSlot(i);
+        }
+    }
+    delete node;
+}
+
+// free any nodes on the path to |offset| below |slot| that no longer hold
+// pages; returns true if the node in |slot| itself was freed
+bool VmPageList::PruneSlot(Slot* slot, uint height, uint64_t offset) {
+    if (height == 0) {
+        if (!slot->leaf->IsEmpty()) {
+            return false;
+        }
+        LTRACEF_LEVEL(2, "freeing the list node %p\n", slot->leaf);
+        delete slot->leaf;
+        slot->leaf = nullptr;
+        return true;
+    }
+
+    VmPageListInnerNode* node = slot->inner;
+    size_t index = SlotIndex(offset, height);
+    if (node->IsPresent(index) && PruneSlot(&node->slot(index), height - 1, offset)) {
+        node->ClearSlot(index);
+    }
+    if (!node->IsEmpty()) {
+        return false;
+    }
+    LTRACEF_LEVEL(2, "freeing the inner node %p\n", node);
+    delete node;
+    slot->inner = nullptr;
+    return true;
+}
+
+void VmPageList::PruneEmptyNodes(uint64_t offset) {
+    if (IsEmpty() || !RootCovers(offset)) {
+        return;
+    }
+    PruneSlot(&root_, height_, offset);
 }
 
 zx_status_t VmPageList::AddPage(vm_page* p, uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
-    LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, p, offset,
-                  node_offset, index);
+    LTRACEF_LEVEL(2, "%p page %p, offset %#" PRIx64 " height %u index %zu\n", this, p, offset,
+                  height_, index);
+
+    // an empty tree can start over at whatever height this offset needs
+    if (IsEmpty()) {
+        height_ = 0;
+        root_.leaf = nullptr;
+    }
+
+    // grow the tree until the root spans the offset, pushing the old root
+    // down into the first slot of a new one
+    while (!RootCovers(offset)) {
+        if (IsEmpty()) {
+            height_++;
+            root_.inner = nullptr;
+            continue;
+        }
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
         fbl::AllocChecker ac;
-        fbl::unique_ptr<VmPageListNode> pl =
-            fbl::unique_ptr<VmPageListNode>(new (&ac) VmPageListNode(node_offset));
-        if (!ac.check())
+        VmPageListInnerNode* node = new (&ac) VmPageListInnerNode();
+        if (!ac.check()) {
             return ZX_ERR_NO_MEMORY;
+        }
+        node->SetSlot(0, root_);
+        root_.inner = node;
+        height_++;
+    }
+    DEBUG_ASSERT(height_ <= kMaxHeight);
 
-        LTRACEF("allocating new inner node %p\n", pl.get());
-        __UNUSED auto status = pl->AddPage(p, index);
-        DEBUG_ASSERT(status == ZX_OK);
+    if (IsEmpty()) {
+        zx_status_t status = AllocSlot(&root_, height_, offset);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
 
-        list_.insert(fbl::move(pl));
-    } else {
-        pln->AddPage(p, index);
+    // walk down to the leaf, filling in any missing nodes along the way
+    Slot* slot = &root_;
+    for (uint h = height_; h > 0; h--) {
+        VmPageListInnerNode* node = slot->inner;
+        size_t i = SlotIndex(offset, h);
+        if (!node->IsPresent(i)) {
+            Slot child;
+            zx_status_t status = AllocSlot(&child, h - 1, offset);
+            if (status != ZX_OK) {
+                PruneEmptyNodes(offset);
+                return status;
+            }
+            node->SetSlot(i, child);
+        }
+        slot = &node->slot(i);
     }
 
+    slot->leaf->AddPage(p, index);
+
     return ZX_OK;
 }
 
 vm_page* VmPageList::GetPage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " height %u index %zu\n", this, offset, height_, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
+    if (IsEmpty() || !RootCovers(offset)) {
         return nullptr;
     }
 
-    return pln->GetPage(index);
+    // walk down to the leaf that holds this page
+    Slot slot = root_;
+    for (uint h = height_; h > 0; h--) {
+        size_t i = SlotIndex(offset, h);
+        if (!slot.inner->IsPresent(i)) {
+            return nullptr;
+        }
+        slot = slot.inner->slot(i);
+    }
+
+    return slot.leaf->GetPage(index);
 }
 
-zx_status_t VmPageList::FreePage(uint64_t offset) {
-    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+vm_page* VmPageList::RemovePage(uint64_t offset) {
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
 
-    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
-                  index);
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " height %u index %zu\n", this, offset, height_, index);
 
-    // lookup the tree node that holds this page
-    auto pln = list_.find(node_offset);
-    if (!pln.IsValid()) {
-        return ZX_ERR_NOT_FOUND;
+    if (IsEmpty() || !RootCovers(offset)) {
+        return nullptr;
     }
 
-    // free this page
-    auto page = pln->RemovePage(index);
-    if (page) {
-        // if it was the last page in the node, remove the node from the tree
-        if (pln->IsEmpty()) {
-            LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
-            list_.erase(*pln);
+    // walk down to the leaf that holds this page
+    Slot slot = root_;
+    for (uint h = height_; h > 0; h--) {
+        size_t i = SlotIndex(offset, h);
+        if (!slot.inner->IsPresent(i)) {
+            return nullptr;
         }
+        slot = slot.inner->slot(i);
+    }
+
+    auto page = slot.leaf->RemovePage(index);
+    // if it was the last page in the leaf, drop the leaf and any inner
+    // nodes it leaves empty
+    if (page && slot.leaf->IsEmpty()) {
+        PruneEmptyNodes(offset);
+    }
+
+    return page;
+}
 
-        pmm_free_page(page);
+zx_status_t VmPageList::FreePage(uint64_t offset) {
+    auto page = RemovePage(offset);
+    if (!page) {
+        return ZX_ERR_NOT_FOUND;
     }
 
+    pmm_free_page(page);
     return ZX_OK;
 }
 
@@ -147,26 +276,38 @@ size_t VmPageList::FreeAllPages() {
     list_node list;
     list_initialize(&list);
 
+    size_t count = TakeAllPages(&list);
+
+    // return all the pages to the pmm at once
+    __UNUSED auto freed = pmm_free(&list);
+    DEBUG_ASSERT(freed == count);
+
+    return count;
+}
+
+size_t VmPageList::TakeAllPages(list_node* list) {
+    LTRACEF("%p\n", this);
+
     size_t count = 0;
 
     // per page get a reference to the page pointer inside the page list node
     auto per_page_func = [&](vm_page*& p, uint64_t offset) {
-        // add the page to our list and null out the inner node
-        list_add_tail(&list, &p->free.node);
+        // add the page to the list and null out the inner node
+        list_add_tail(list, &p->free.node);
         p = nullptr;
         count++;
         return ZX_ERR_NEXT;
     };
 
-    // walk the tree in order, freeing all the pages on every node
+    // walk the tree in order, collecting all the pages on every leaf
     ForEveryPage(per_page_func);
 
-    // return all the pages to the pmm at once
-    __UNUSED auto freed = pmm_free(&list);
-    DEBUG_ASSERT(freed == count);
-
     // empty the tree
-    list_.clear();
+    if (!IsEmpty()) {
+        FreeSlot(root_, height_);
+    }
+    height_ = 0;
+    root_.leaf = nullptr;
 
     return count;
 }
@@ -8,7 +8,9 @@
 #include <err.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <fbl/auto_lock.h>
 #include <unittest.h>
+#include <vm/physmap.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
 #include <vm/vm_aspace.h>
@@ -72,6 +74,95 @@ static bool pmm_oversized_alloc_test(void* context) {
     END_TEST;
 }
 
+// Allocates and frees single pages one at a time, enough to go through
+// the per-cpu page cache several times over.
+static bool pmm_single_page_churn_test(void* context) {
+    BEGIN_TEST;
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    static const size_t alloc_count = 512;
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        paddr_t pa;
+        vm_page_t* page = pmm_alloc_page(0, &pa);
+        REQUIRE_NE(nullptr, page, "pmm_alloc single page");
+        EXPECT_EQ(page, paddr_to_vm_page(pa), "paddr_to_vm_page on single page");
+        EXPECT_EQ(VM_PAGE_STATE_ALLOC, page->state, "allocated page state");
+        list_add_tail(&list, &page->free.node);
+    }
+
+    size_t freed = 0;
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&list, vm_page_t, free.node)) != nullptr) {
+        freed += pmm_free_page(page);
+    }
+    EXPECT_EQ(alloc_count, freed, "pmm_free_page on each page");
+    END_TEST;
+}
+
+static bool page_is_zero(paddr_t pa) {
+    const uint64_t* ptr = static_cast<const uint64_t*>(paddr_to_physmap(pa));
+    for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+        if (ptr[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// Allocates zeroed pages, both singly and in bulk, dirties them and frees them
+// again so that later allocations can't pass by accident.
+static bool pmm_alloc_zeroed_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_count = 64;
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        paddr_t pa;
+        vm_page_t* page = pmm_alloc_zeroed_page(0, &pa);
+        REQUIRE_NE(nullptr, page, "pmm_alloc_zeroed_page");
+        EXPECT_TRUE(page_is_zero(pa), "single page is zeroed");
+        memset(paddr_to_physmap(pa), 0xa5, PAGE_SIZE);
+        pmm_free_page(page);
+    }
+
+    list_node list = LIST_INITIAL_VALUE(list);
+    size_t count = pmm_alloc_zeroed_pages(alloc_count, 0, &list);
+    EXPECT_EQ(alloc_count, count, "pmm_alloc_zeroed_pages");
+    vm_page_t* page;
+    list_for_every_entry (&list, page, vm_page_t, free.node) {
+        EXPECT_TRUE(page_is_zero(vm_page_to_paddr(page)), "bulk page is zeroed");
+    }
+    pmm_free(&list);
+    END_TEST;
+}
+
+// Allocates naturally aligned contiguous runs of a few sizes and frees them.
+static bool pmm_alloc_contiguous_aligned_test(void* context) {
+    BEGIN_TEST;
+
+    static const size_t counts[] = {1, 3, 16, 100, 512};
+    static const uint8_t alignments[] = {PAGE_SIZE_SHIFT, 16, 21};
+
+    for (size_t count : counts) {
+        for (uint8_t alignment_log2 : alignments) {
+            list_node list = LIST_INITIAL_VALUE(list);
+            paddr_t pa;
+            auto allocated = pmm_alloc_contiguous(count, 0, alignment_log2, &pa, &list);
+            REQUIRE_EQ(count, allocated, "pmm_alloc_contiguous count");
+            EXPECT_EQ(0u, pa & ((1ul << alignment_log2) - 1), "pmm_alloc_contiguous alignment");
+
+            paddr_t expected = pa;
+            vm_page_t* page;
+            list_for_every_entry (&list, page, vm_page_t, free.node) {
+                EXPECT_EQ(expected, vm_page_to_paddr(page), "pmm_alloc_contiguous run");
+                expected += PAGE_SIZE;
+            }
+
+            EXPECT_EQ(count, pmm_free(&list), "pmm_free on a contiguous run");
+        }
+    }
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -305,6 +396,107 @@ static bool vmaspace_alloc_smoke_test(void* context) {
     END_TEST;
 }
 
+// Punches holes in a run of mappings and checks that allocations too large
+// for the holes land elsewhere, while ones that fit still succeed.
+static bool vmaspace_alloc_fragmented_test(void* context) {
+    BEGIN_TEST;
+    auto aspace = VmAspace::Create(0, "test aspace4");
+    REQUIRE_TRUE(aspace, "VmAspace::Create pointer");
+
+    constexpr size_t kCount = 64;
+    vaddr_t bases[kCount];
+    for (size_t i = 0; i < kCount; i++) {
+        void* ptr;
+        auto err = aspace->Alloc("test", PAGE_SIZE, &ptr, 0, 0, kArchRwFlags);
+        REQUIRE_EQ(ZX_OK, err, "allocating region\n");
+        bases[i] = reinterpret_cast<vaddr_t>(ptr);
+    }
+    for (size_t i = 0; i < kCount; i += 2) {
+        EXPECT_EQ(ZX_OK, aspace->FreeRegion(bases[i]), "freeing region\n");
+    }
+
+    // None of the remaining mappings may overlap the new ones.
+    for (size_t pages = 1; pages <= 4; pages++) {
+        void* ptr;
+        auto err = aspace->Alloc("test", pages * PAGE_SIZE, &ptr, 0, 0, kArchRwFlags);
+        REQUIRE_EQ(ZX_OK, err, "allocating region\n");
+        const vaddr_t va = reinterpret_cast<vaddr_t>(ptr);
+        for (size_t i = 1; i < kCount; i += 2) {
+            EXPECT_TRUE(va + pages * PAGE_SIZE <= bases[i] || bases[i] + PAGE_SIZE <= va,
+                        "new region overlaps an old one\n");
+        }
+    }
+
+    aspace->Destroy();
+    END_TEST;
+}
+
+namespace {
+// Checks that a traversal visits nodes in increasing (base, depth) order, and
+// stops it after |limit| mappings.
+class OrderCheckingEnumerator final : public VmEnumerator {
+public:
+    explicit OrderCheckingEnumerator(size_t limit) : limit_(limit) {}
+
+    bool OnVmAddressRegion(const VmAddressRegion* vmar, uint depth) override {
+        Visit(vmar->base(), depth);
+        return true;
+    }
+
+    bool OnVmMapping(const VmMapping* map, const VmAddressRegion* vmar,
+                     uint depth) override {
+        Visit(map->base(), depth);
+        return ++mappings_ < limit_;
+    }
+
+    size_t mappings() const { return mappings_; }
+    bool in_order() const { return in_order_; }
+
+private:
+    void Visit(vaddr_t base, uint depth) {
+        if (started_ && (base < base_ || (base == base_ && depth <= depth_)))
+            in_order_ = false;
+        base_ = base;
+        depth_ = depth;
+        started_ = true;
+    }
+
+    const size_t limit_;
+    size_t mappings_ = 0;
+    vaddr_t base_ = 0;
+    uint depth_ = 0;
+    bool started_ = false;
+    bool in_order_ = true;
+};
+} // namespace
+
+// Walks an aspace with several batches' worth of mappings, which has to drop
+// and retake the aspace lock along the way.
+static bool vmaspace_enumerate_test(void* context) {
+    BEGIN_TEST;
+    auto aspace = VmAspace::Create(0, "test aspace3");
+    REQUIRE_TRUE(aspace, "VmAspace::Create pointer");
+
+    const size_t count = VmAspace::kEnumerateBatch * 3 + 5;
+    for (size_t i = 0; i < count; i++) {
+        void* ptr;
+        auto err = aspace->Alloc("test", PAGE_SIZE, &ptr, 0, 0, kArchRwFlags);
+        REQUIRE_EQ(ZX_OK, err, "allocating region\n");
+    }
+
+    OrderCheckingEnumerator all(SIZE_MAX);
+    EXPECT_TRUE(aspace->EnumerateChildren(&all), "full traversal");
+    EXPECT_EQ(count, all.mappings(), "every mapping visited once");
+    EXPECT_TRUE(all.in_order(), "depth-first pre-order");
+
+    OrderCheckingEnumerator some(VmAspace::kEnumerateBatch + 1);
+    EXPECT_FALSE(aspace->EnumerateChildren(&some), "stopped traversal");
+    EXPECT_EQ(VmAspace::kEnumerateBatch + 1, some.mappings(), "stopped where asked");
+
+    aspace->Destroy();
+    END_TEST;
+}
+
 // Doesn't do anything, just prints all aspaces.
 // Should be run after all other tests so that people can manually comb
 // through the output for leaked test aspaces.
@@ -339,6 +531,12 @@ static bool vmo_commit_test(void* context) {
     EXPECT_EQ(0, ret, "committing vm object\n");
     EXPECT_EQ(ROUNDUP_PAGE_SIZE(alloc_size), committed,
               "committing vm object\n");
+
+    EXPECT_EQ(16u, vmo->AllocatedPages(), "all pages counted\n");
+    EXPECT_EQ(4u, vmo->AllocatedPagesInRange(PAGE_SIZE * 2, PAGE_SIZE * 4),
+              "pages in range counted\n");
+    EXPECT_EQ(3u, vmo->AllocatedPagesInRange(PAGE_SIZE * 2 + 1, PAGE_SIZE * 4 - 1),
+              "pages starting in range counted\n");
     END_TEST;
 }
 
@@ -489,6 +687,48 @@ static bool vmo_contiguous_commit_test(void* context) {
     END_TEST;
 }
 
+// Creates a large page vm object, commits it and checks the aligned runs are backed
+// by large pages while the unaligned tail is committed a page at a time.
+static bool vmo_large_page_commit_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = VmObject::kLargePageSize * 2 + PAGE_SIZE * 4;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, VmObjectPaged::kLargePages,
+                                               alloc_size, &vmo);
+    REQUIRE_EQ(status, ZX_OK, "vmobject creation\n");
+    REQUIRE_TRUE(vmo, "vmobject creation\n");
+
+    uint64_t committed;
+    auto ret = vmo->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(ZX_OK, ret, "committing vm object\n");
+    EXPECT_EQ(alloc_size, committed, "committing vm object\n");
+
+    {
+        fbl::AutoLock al(vmo->lock());
+        paddr_t pa;
+        // large runs may legitimately fall back if physical memory is fragmented
+        if (vmo->GetLargePageLocked(0, &pa) == ZX_OK) {
+            EXPECT_TRUE(IS_ALIGNED(pa, VmObject::kLargePageSize), "large page alignment\n");
+        }
+        EXPECT_EQ(ZX_ERR_NOT_FOUND, vmo->GetLargePageLocked(VmObject::kLargePageSize * 2, &pa),
+                  "partial run is not a large page\n");
+    }
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                0, 0, kArchRwFlags);
+    EXPECT_EQ(ZX_OK, ret, "mapping object");
+
+    // fill with known pattern and test
+    if (!fill_and_test(ptr, alloc_size))
+        all_ok = false;
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(ZX_OK, err, "unmapping object");
+    END_TEST;
+}
+
 // Creats a vm object, maps it, precommitted.
 static bool vmo_precommitted_map_test(void* context) {
     BEGIN_TEST;
@@ -537,6 +777,38 @@ static bool vmo_demand_paged_map_test(void* context) {
     END_TEST;
 }
 
+// Creates a vm object, maps it demand paged and touches the first pages in
+// order, which should make the fault path commit the following pages as well.
+static bool vmo_fault_around_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 64;
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, &vmo);
+    REQUIRE_EQ(status, ZX_OK, "vmobject creation\n");
+    REQUIRE_TRUE(vmo, "vmobject creation\n");
+
+    auto ka = VmAspace::kernel_aspace();
+    void* ptr;
+    auto ret = ka->MapObjectInternal(vmo, "test", 0, alloc_size, &ptr,
+                                     0, 0, kArchRwFlags);
+    REQUIRE_EQ(ZX_OK, ret, "mapping object");
+
+    // the first fault is not sequential, the second one is
+    volatile uint8_t* p = static_cast<volatile uint8_t*>(ptr);
+    p[0] = 1;
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "single fault commits one page\n");
+    p[PAGE_SIZE] = 1;
+    EXPECT_LT(2u, vmo->AllocatedPages(), "sequential fault commits ahead\n");
+    EXPECT_LT(vmo->AllocatedPages(), alloc_size / PAGE_SIZE, "fault-around is bounded\n");
+
+    if (!fill_and_test(ptr, alloc_size))
+        all_ok = false;
+
+    auto err = ka->FreeRegion((vaddr_t)ptr);
+    EXPECT_EQ(ZX_OK, err, "unmapping object");
+    END_TEST;
+}
+
 // Creates a vm object, maps it, drops ref before unmapping.
 static bool vmo_dropped_ref_test(void* context) {
     BEGIN_TEST;
@@ -887,6 +1159,214 @@ static bool vmo_lookup_test(void* context) {
     END_TEST;
 }
 
+// Reads the first byte of the page at |offset| of |vmo|.
+static uint8_t vmo_first_byte(const fbl::RefPtr<VmObject>& vmo, uint64_t offset) {
+    uint8_t b = 0xff;
+    vmo->Read(&b, offset, 1, nullptr);
+    return b;
+}
+
+// Checks that an intermediate clone nothing else refers to is folded into its
+// only child, and that the child's view of the pages is unchanged by it.
+static bool vmo_collapse_chain_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 8;
+
+    fbl::RefPtr<VmObject> root;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, &root);
+    REQUIRE_EQ(ZX_OK, status, "vmobject creation\n");
+    for (uint64_t off = 0; off < alloc_size; off += PAGE_SIZE) {
+        uint8_t v = 'r';
+        EXPECT_EQ(ZX_OK, root->Write(&v, off, 1, nullptr), "writing root\n");
+    }
+
+    // the middle clone covers only half of the root, and shadows one page of it
+    fbl::RefPtr<VmObject> middle;
+    status = root->CloneCOW(0, alloc_size / 2, false, &middle);
+    REQUIRE_EQ(ZX_OK, status, "cloning root\n");
+    uint8_t v = 'm';
+    EXPECT_EQ(ZX_OK, middle->Write(&v, PAGE_SIZE, 1, nullptr), "writing middle\n");
+
+    // the leaf starts one page into the middle and runs past its end
+    fbl::RefPtr<VmObject> leaf;
+    status = middle->CloneCOW(PAGE_SIZE, alloc_size / 2, false, &leaf);
+    REQUIRE_EQ(ZX_OK, status, "cloning middle\n");
+    EXPECT_EQ(2u, leaf->chain_depth(), "chain depth before collapse\n");
+
+    // the middle can't go while we still hold a reference to it
+    {
+        fbl::RefPtr<VmObject> collapsed;
+        fbl::AutoLock al(leaf->lock());
+        leaf->CollapseChainLocked(&collapsed);
+        EXPECT_FALSE(collapsed, "collapsed a referenced parent\n");
+    }
+    EXPECT_EQ(2u, leaf->chain_depth(), "chain depth with middle referenced\n");
+
+    middle.reset();
+    {
+        fbl::RefPtr<VmObject> collapsed;
+        fbl::AutoLock al(leaf->lock());
+        leaf->CollapseChainLocked(&collapsed);
+        EXPECT_TRUE(collapsed, "collapsing unreferenced parent\n");
+    }
+    EXPECT_EQ(1u, leaf->chain_depth(), "chain depth after collapse\n");
+    EXPECT_EQ(1u, leaf->AllocatedPages(), "migrated pages\n");
+
+    EXPECT_EQ('m', vmo_first_byte(leaf, 0), "page taken from middle\n");
+    EXPECT_EQ('r', vmo_first_byte(leaf, PAGE_SIZE), "page from root\n");
+    EXPECT_EQ('r', vmo_first_byte(leaf, 2 * PAGE_SIZE), "page from root\n");
+    EXPECT_EQ(0u, vmo_first_byte(leaf, 3 * PAGE_SIZE), "page past the end of middle\n");
+
+    END_TEST;
+}
+
+// Moves pages from one vmo to another and checks both sides see the move.
+static bool vmo_move_pages_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 4;
+
+    fbl::RefPtr<VmObject> src;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, &src);
+    REQUIRE_EQ(ZX_OK, status, "vmobject creation\n");
+    fbl::RefPtr<VmObject> dst;
+    status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, &dst);
+    REQUIRE_EQ(ZX_OK, status, "vmobject creation\n");
+
+    // leave the last page of the source uncommitted
+    for (uint64_t off = 0; off < alloc_size - PAGE_SIZE; off += PAGE_SIZE) {
+        uint8_t v = static_cast<uint8_t>('a' + off / PAGE_SIZE);
+        EXPECT_EQ(ZX_OK, src->Write(&v, off, 1, nullptr), "writing source\n");
+    }
+
+    list_node pages = LIST_INITIAL_VALUE(pages);
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, src->TakePages(1, PAGE_SIZE, &pages), "unaligned take\n");
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, src->TakePages(PAGE_SIZE, alloc_size, &pages),
+              "take past the end\n");
+    EXPECT_TRUE(list_is_empty(&pages), "failed take moved pages\n");
+
+    EXPECT_EQ(ZX_OK, src->TakePages(0, alloc_size, &pages), "taking pages\n");
+    EXPECT_EQ(alloc_size / PAGE_SIZE, list_length(&pages), "taken pages\n");
+    EXPECT_EQ(0u, src->AllocatedPages(), "source pages after take\n");
+    EXPECT_EQ(0u, vmo_first_byte(src, 0), "source reads zero\n");
+
+    EXPECT_EQ(ZX_OK, dst->SupplyPages(0, alloc_size, &pages), "supplying pages\n");
+    EXPECT_TRUE(list_is_empty(&pages), "pages left after supply\n");
+    EXPECT_EQ(alloc_size / PAGE_SIZE, dst->AllocatedPages(), "destination pages\n");
+    EXPECT_EQ('a', vmo_first_byte(dst, 0), "moved page\n");
+    EXPECT_EQ('c', vmo_first_byte(dst, 2 * PAGE_SIZE), "moved page\n");
+    EXPECT_EQ(0u, vmo_first_byte(dst, 3 * PAGE_SIZE), "committed hole\n");
+
+    // pages seen by a clone can't be taken away from it
+    fbl::RefPtr<VmObject> clone;
+    status = dst->CloneCOW(0, alloc_size, false, &clone);
+    REQUIRE_EQ(ZX_OK, status, "cloning\n");
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED, dst->TakePages(0, PAGE_SIZE, &pages), "take with a clone\n");
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED, clone->TakePages(0, PAGE_SIZE, &pages),
+              "take from a clone\n");
+    EXPECT_TRUE(list_is_empty(&pages), "failed take moved pages\n");
+
+    END_TEST;
+}
+
+// Commits pages, makes some zero again and checks only those are deduped.
+static bool vmo_dedup_zero_pages_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 4;
+
+    fbl::RefPtr<VmObject> vmo;
+    zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, alloc_size, &vmo);
+    REQUIRE_EQ(ZX_OK, status, "vmobject creation\n");
+
+    uint64_t committed;
+    EXPECT_EQ(ZX_OK, vmo->CommitRange(0, alloc_size, &committed), "committing\n");
+    uint8_t v = 'a';
+    EXPECT_EQ(ZX_OK, vmo->Write(&v, PAGE_SIZE, 1, nullptr), "writing page 1\n");
+    EXPECT_EQ(ZX_OK, vmo->Write(&v, 2 * PAGE_SIZE + 17, 1, nullptr), "writing page 2\n");
+    v = 0;
+    EXPECT_EQ(ZX_OK, vmo->Write(&v, 2 * PAGE_SIZE + 17, 1, nullptr), "clearing page 2\n");
+
+    EXPECT_EQ(3u, vmo->DedupZeroPages(), "deduped pages\n");
+    EXPECT_EQ(1u, vmo->AllocatedPages(), "pages left\n");
+    EXPECT_EQ('a', vmo_first_byte(vmo, PAGE_SIZE), "kept page\n");
+    EXPECT_EQ(0u, vmo_first_byte(vmo, 2 * PAGE_SIZE), "deduped page reads zero\n");
+    EXPECT_EQ(0u, vmo->DedupZeroPages(), "nothing left to dedup\n");
+
+    // pinned pages stay put
+    EXPECT_EQ(ZX_OK, vmo->CommitRange(0, PAGE_SIZE, &committed), "committing\n");
+    EXPECT_EQ(ZX_OK, vmo->Pin(0, PAGE_SIZE), "pinning\n");
+    EXPECT_EQ(0u, vmo->DedupZeroPages(), "pinned page\n");
+    vmo->Unpin(0, PAGE_SIZE);
+    EXPECT_EQ(1u, vmo->DedupZeroPages(), "unpinned page\n");
+
+    // a clone's zero pages hide its parent's contents
+    fbl::RefPtr<VmObject> clone;
+    status = vmo->CloneCOW(0, alloc_size, false, &clone);
+    REQUIRE_EQ(ZX_OK, status, "cloning\n");
+    EXPECT_EQ(ZX_OK, clone->Write(&v, PAGE_SIZE, 1, nullptr), "writing clone\n");
+    EXPECT_EQ(0u, clone->DedupZeroPages(), "clone dedup\n");
+    EXPECT_EQ('a', vmo_first_byte(vmo, PAGE_SIZE), "parent page\n");
+
+    END_TEST;
+}
+
+// Exercises the page list with offsets spread across the whole offset space,
+// which forces the tree to grow to its full height.
+static bool vm_page_list_sparse_test(void* context) {
+    BEGIN_TEST;
+
+    static const uint64_t offsets[] = {
+        0,
+        17 * PAGE_SIZE,
+        1ull << 30,
+        1ull << 40,
+        ROUNDDOWN(UINT64_MAX, PAGE_SIZE) - PAGE_SIZE,
+    };
+    static const size_t count = countof(offsets);
+
+    VmPageList pl;
+    vm_page_t* pages[count];
+    for (size_t i = 0; i < count; i++) {
+        pages[i] = pmm_alloc_page(0, nullptr);
+        REQUIRE_NE(nullptr, pages[i], "pmm_alloc_page");
+        EXPECT_EQ(ZX_OK, pl.AddPage(pages[i], offsets[i]), "AddPage");
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(pages[i], pl.GetPage(offsets[i]), "GetPage");
+    }
+    EXPECT_EQ(nullptr, pl.GetPage(PAGE_SIZE), "GetPage on a hole");
+    EXPECT_EQ(nullptr, pl.GetPage((1ull << 40) + (1ull << 30)), "GetPage on a hole");
+
+    // every page is visited once, in offset order
+    size_t visited = 0;
+    size_t in_order = 0;
+    pl.ForEveryPage([&](const auto p, uint64_t off) {
+        if (visited < count && offsets[visited] == off && pages[visited] == p) {
+            in_order++;
+        }
+        visited++;
+        return ZX_ERR_NEXT;
+    });
+    EXPECT_EQ(count, visited, "ForEveryPage count");
+    EXPECT_EQ(count, in_order, "ForEveryPage order");
+
+    visited = 0;
+    pl.ForEveryPageInRange([&visited](const auto p, uint64_t off) {
+        visited++;
+        return ZX_ERR_NEXT;
+    }, 1ull << 30, (1ull << 40) + PAGE_SIZE);
+    EXPECT_EQ(2u, visited, "ForEveryPageInRange count");
+
+    EXPECT_EQ(ZX_OK, pl.FreePage(1ull << 40), "FreePage");
+    EXPECT_EQ(nullptr, pl.GetPage(1ull << 40), "GetPage after FreePage");
+    EXPECT_EQ(pages[4], pl.GetPage(offsets[4]), "GetPage after FreePage");
+
+    EXPECT_EQ(count - 1, pl.FreeAllPages(), "FreeAllPages");
+    EXPECT_EQ(nullptr, pl.GetPage(0), "GetPage after FreeAllPages");
+
+    END_TEST;
+}
+
 // TODO(ZX-1431): The ARM code's error codes are always ZX_ERR_INTERNAL, so
 // special case that.
 #if ARCH_ARM64
@@ -971,6 +1451,9 @@ UNITTEST_START_TESTCASE(vm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_large_alloc_test)
 VM_UNITTEST(pmm_oversized_alloc_test)
+VM_UNITTEST(pmm_single_page_churn_test)
+VM_UNITTEST(pmm_alloc_zeroed_test)
+VM_UNITTEST(pmm_alloc_contiguous_aligned_test)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
 VM_UNITTEST(multiple_regions_test)
@@ -980,20 +1463,28 @@ VM_UNITTEST(vmm_alloc_contiguous_missing_flag_commit_fails)
 VM_UNITTEST(vmm_alloc_contiguous_zero_size_fails)
 VM_UNITTEST(vmaspace_create_smoke_test)
 VM_UNITTEST(vmaspace_alloc_smoke_test)
+VM_UNITTEST(vmaspace_enumerate_test)
+VM_UNITTEST(vmaspace_alloc_fragmented_test)
 VM_UNITTEST(vmo_create_test)
 VM_UNITTEST(vmo_pin_test)
 VM_UNITTEST(vmo_multiple_pin_test)
 VM_UNITTEST(vmo_commit_test)
 VM_UNITTEST(vmo_odd_size_commit_test)
 VM_UNITTEST(vmo_contiguous_commit_test)
+VM_UNITTEST(vmo_large_page_commit_test)
 VM_UNITTEST(vmo_precommitted_map_test)
 VM_UNITTEST(vmo_demand_paged_map_test)
+VM_UNITTEST(vmo_fault_around_test)
 VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
 VM_UNITTEST(vmo_cache_test)
 VM_UNITTEST(vmo_lookup_test)
+VM_UNITTEST(vmo_collapse_chain_test)
+VM_UNITTEST(vmo_move_pages_test)
+VM_UNITTEST(vmo_dedup_zero_pages_test)
+VM_UNITTEST(vm_page_list_sparse_test)
 VM_UNITTEST(arch_noncontiguous_map)
 // Uncomment for debugging
 // VM_UNITTEST(dump_all_aspaces)  // Run last
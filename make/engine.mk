@@ -25,6 +25,7 @@ ENABLE_BUILD_SYSROOT := $(call TOBOOL,$(ENABLE_BUILD_SYSROOT))
 ENABLE_NEW_BOOTDATA := true
 DISABLE_UTEST ?= false
 ENABLE_ULIB_ONLY ?= false
+ENABLE_SPINLOCK_STATS ?= false
 USE_ASAN ?= false
 USE_SANCOV ?= false
 USE_LTO ?= false
@@ -600,6 +601,11 @@ ifneq ($(EXTERNAL_MODULES),)
 $(info EXTERNAL_MODULES = $(EXTERNAL_MODULES))
 endif
 
+# spin lock contention by call site, see the "spinstats" console command
+ifeq ($(call TOBOOL,$(ENABLE_SPINLOCK_STATS)),true)
+KERNEL_DEFINES += WITH_SPINLOCK_STATS=1
+endif
+
 ifneq ($(EXTERNAL_KERNEL_DEFINES),)
 KERNEL_DEFINES += $(EXTERNAL_KERNEL_DEFINES)
 $(info EXTERNAL_KERNEL_DEFINES = $(EXTERNAL_KERNEL_DEFINES))
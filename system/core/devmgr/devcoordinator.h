@@ -8,6 +8,7 @@
 #include <ddk/binding.h>
 #include <ddk/device.h>
 #include <ddk/driver.h>
+#include <ddk/iotxn.h>
 #include <zircon/types.h>
 #include <zircon/listnode.h>
 
@@ -31,6 +32,8 @@ struct dc_pending {
     list_node_t node;
     void* ctx;
     uint32_t op;
+    // when the request was sent, for the bind timeline
+    zx_time_t started;
 };
 
 #define PENDING_BIND 1
@@ -45,6 +48,9 @@ struct dc_devhost {
     uint32_t flags;
     devhost_t* parent;
 
+    // the devhost's iotxn pool counters, mapped read-only
+    iotxn_pool_stats_t* iotxn_stats;
+
     // list of all devices on this devhost
     list_node_t devices;
 
@@ -144,6 +150,8 @@ struct dc_driver {
     uint32_t flags;
     struct list_node node;
     const char* libname;
+    // the driver's file, opened on first use and cloned for each devhost
+    zx_handle_t vmo;
 };
 
 #define DRIVER_NAME_LEN_MAX 64
@@ -214,6 +222,7 @@ typedef struct {
 #define DC_OP_DM_OPEN_VIRTCON       0x80000021
 #define DC_OP_DM_WATCH              0x80000022
 #define DC_OP_DM_MEXEC              0x80000023
+#define DC_OP_DM_WARM_REBOOT        0x80000024
 #define DC_PATH_MAX 1024
 
 zx_status_t dc_msg_pack(dc_msg_t* msg, uint32_t* len_out,
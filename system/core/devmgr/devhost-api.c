@@ -6,6 +6,7 @@
 
 #include <ddk/debug.h>
 #include <ddk/device.h>
+#include <ddk/iotxn.h>
 #include "devhost.h"
 
 #include <stdarg.h>
@@ -175,6 +176,11 @@ __EXPORT zx_status_t device_iotxn_queue(zx_device_t* dev, iotxn_t* txn) {
 // LibDriver Misc Interfaces
 
 extern zx_handle_t root_resource_handle;
+extern iotxn_pool_stats_t* iotxn_stats;
+
+__EXPORT iotxn_pool_stats_t* iotxn_pool_stats(void) {
+    return iotxn_stats;
+}
 
 __EXPORT zx_handle_t get_root_resource(void) {
     return root_resource_handle;
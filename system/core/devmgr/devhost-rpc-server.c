@@ -133,7 +133,11 @@ static void sync_io_complete(iotxn_t* txn, void* cookie) {
     completion_signal((completion_t*)cookie);
 }
 
-static ssize_t do_sync_io(zx_device_t* dev, uint32_t opcode, void* buf, size_t count, zx_off_t off) {
+// Reads or writes |count| bytes at |buf|. If |vmo| is valid, |buf| is its
+// mapping, and drivers which queue iotxns are handed the VMO itself rather
+// than a copy of the data.
+static ssize_t do_sync_io(zx_device_t* dev, uint32_t opcode, void* buf, size_t count, zx_off_t off,
+                          zx_handle_t vmo) {
     if (dev->ops->iotxn_queue == NULL) {
         size_t actual;
         zx_status_t r;
@@ -148,6 +152,24 @@ static ssize_t do_sync_io(zx_device_t* dev, uint32_t opcode, void* buf, size_t c
             return actual;
         }
     }
+    completion_t completion = COMPLETION_INIT;
+
+    if (vmo != ZX_HANDLE_INVALID) {
+        iotxn_t txn;
+        iotxn_init(&txn, vmo, 0, count);
+        txn.opcode = opcode;
+        txn.offset = off;
+        txn.complete_cb = sync_io_complete;
+        txn.cookie = &completion;
+
+        iotxn_queue(dev, &txn);
+        completion_wait(&completion, ZX_TIME_INFINITE);
+
+        ssize_t r = (txn.status != ZX_OK) ? txn.status : (ssize_t)txn.actual;
+        iotxn_release(&txn);
+        return r;
+    }
+
     iotxn_t* txn;
     zx_status_t status = iotxn_alloc(&txn, IOTXN_ALLOC_CONTIGUOUS | IOTXN_ALLOC_POOL, FDIO_CHUNK_SIZE);
     if (status != ZX_OK) {
@@ -156,8 +178,6 @@ static ssize_t do_sync_io(zx_device_t* dev, uint32_t opcode, void* buf, size_t c
 
     assert(count <= FDIO_CHUNK_SIZE);
 
-    completion_t completion = COMPLETION_INIT;
-
     txn->opcode = opcode;
     txn->offset = off;
     txn->length = count;
@@ -188,6 +208,60 @@ static ssize_t do_sync_io(zx_device_t* dev, uint32_t opcode, void* buf, size_t c
     return actual;
 }
 
+// Maps the VMO a client offers with IOCTL_DEVICE_SET_IO_BUFFER, through
+// which reads and writes flagged with ZXRIO_FLAG_IO_BUFFER move their data.
+static zx_status_t set_io_buffer(devhost_iostate_t* ios, zx_handle_t vmo) {
+    zx_status_t r;
+    uint64_t size;
+    if (ios->io_buf != NULL) {
+        r = ZX_ERR_ALREADY_BOUND;
+        goto fail;
+    }
+    if ((r = zx_vmo_get_size(vmo, &size)) != ZX_OK) {
+        goto fail;
+    }
+    if ((size == 0) || (size > DEVICE_IO_BUFFER_MAX)) {
+        r = ZX_ERR_INVALID_ARGS;
+        goto fail;
+    }
+    uintptr_t addr;
+    if ((r = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, size,
+                         ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr)) != ZX_OK) {
+        goto fail;
+    }
+    ios->io_buf = (void*)addr;
+    ios->io_buf_size = size;
+    ios->io_buf_vmo = vmo;
+    return ZX_OK;
+
+fail:
+    zx_handle_close(vmo);
+    return r;
+}
+
+static void release_io_buffer(devhost_iostate_t* ios) {
+    if (ios->io_buf != NULL) {
+        zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)ios->io_buf, ios->io_buf_size);
+        zx_handle_close(ios->io_buf_vmo);
+        ios->io_buf = NULL;
+        ios->io_buf_size = 0;
+        ios->io_buf_vmo = ZX_HANDLE_INVALID;
+    }
+}
+
+// Does a read or write for |msg|, whose data is either in the message or,
+// if the client flagged it so, in the connection's I/O buffer.
+static ssize_t do_rio_io(devhost_iostate_t* ios, zxrio_msg_t* msg, uint32_t opcode,
+                         size_t count, zx_off_t off) {
+    if (msg->op & ZXRIO_FLAG_IO_BUFFER) {
+        if ((ios->io_buf == NULL) || (count > ios->io_buf_size)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        return do_sync_io(ios->dev, opcode, ios->io_buf, count, off, ios->io_buf_vmo);
+    }
+    return do_sync_io(ios->dev, opcode, msg->data, count, off, ZX_HANDLE_INVALID);
+}
+
 static ssize_t do_ioctl(zx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len, void* out_buf, size_t out_len) {
     zx_status_t r;
     switch (op) {
@@ -305,6 +379,7 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
 
     switch (ZXRIO_OP(msg->op)) {
     case ZXRIO_CLOSE:
+        release_io_buffer(ios);
         device_close(dev, ios->flags);
         // The ios released its reference to this device by calling device_close()
         // Put an invalid pointer in its dev field to ensure any use-after-release
@@ -338,11 +413,13 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
         if (!CAN_READ(ios)) {
             return ZX_ERR_ACCESS_DENIED;
         }
-        zx_status_t r = do_sync_io(dev, IOTXN_OP_READ, msg->data, arg, ios->io_off);
+        zx_status_t r = do_rio_io(ios, msg, IOTXN_OP_READ, arg, ios->io_off);
         if (r >= 0) {
             ios->io_off += r;
             msg->arg2.off = ios->io_off;
-            msg->datalen = r;
+            if (!(msg->op & ZXRIO_FLAG_IO_BUFFER)) {
+                msg->datalen = r;
+            }
         }
         return r;
     }
@@ -350,8 +427,8 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
         if (!CAN_READ(ios)) {
             return ZX_ERR_ACCESS_DENIED;
         }
-        zx_status_t r = do_sync_io(dev, IOTXN_OP_READ, msg->data, arg, msg->arg2.off);
-        if (r >= 0) {
+        zx_status_t r = do_rio_io(ios, msg, IOTXN_OP_READ, arg, msg->arg2.off);
+        if ((r >= 0) && !(msg->op & ZXRIO_FLAG_IO_BUFFER)) {
             msg->datalen = r;
         }
         return r;
@@ -360,7 +437,10 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
         if (!CAN_WRITE(ios)) {
             return ZX_ERR_ACCESS_DENIED;
         }
-        zx_status_t r = do_sync_io(dev, IOTXN_OP_WRITE, msg->data, len, ios->io_off);
+        if (msg->op & ZXRIO_FLAG_IO_BUFFER) {
+            len = arg;
+        }
+        zx_status_t r = do_rio_io(ios, msg, IOTXN_OP_WRITE, len, ios->io_off);
         if (r >= 0) {
             ios->io_off += r;
             msg->arg2.off = ios->io_off;
@@ -371,7 +451,10 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
         if (!CAN_WRITE(ios)) {
             return ZX_ERR_ACCESS_DENIED;
         }
-        zx_status_t r = do_sync_io(dev, IOTXN_OP_WRITE, msg->data, len, msg->arg2.off);
+        if (msg->op & ZXRIO_FLAG_IO_BUFFER) {
+            len = arg;
+        }
+        zx_status_t r = do_rio_io(ios, msg, IOTXN_OP_WRITE, len, msg->arg2.off);
         return r;
     }
     case ZXRIO_SEEK: {
@@ -483,6 +566,9 @@ zx_status_t devhost_rio_handler(zxrio_msg_t* msg, void* cookie) {
         // so that it would be sent via channel_write().  Here we
         // copy the local version back into the space in the buffer
         // that the original occupied.
+        if (msg->arg2.op == IOCTL_DEVICE_SET_IO_BUFFER) {
+            return set_io_buffer(ios, msg->handle[0]);
+        }
         memcpy(in_buf, msg->handle, sizeof(zx_handle_t));
         memcpy(in_buf + sizeof(zx_handle_t), msg->data + sizeof(zx_handle_t),
                len - sizeof(zx_handle_t));
@@ -4,6 +4,7 @@
 
 #include <dlfcn.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -14,6 +15,7 @@
 #include <ddk/device.h>
 #include <ddk/driver.h>
 #include <ddk/binding.h>
+#include <ddk/iotxn.h>
 
 #include <zircon/dlfcn.h>
 #include <zircon/process.h>
@@ -849,6 +851,11 @@ zx_status_t devhost_device_bind(zx_device_t* dev, const char* drv_libname) {
 
 zx_handle_t root_resource_handle;
 
+// The coordinator reads these to report on this devhost's iotxn pools.
+// Until (or unless) it hands us a page for them they are kept here.
+static iotxn_pool_stats_t iotxn_stats_local;
+iotxn_pool_stats_t* iotxn_stats = &iotxn_stats_local;
+
 
 zx_status_t devhost_start_iostate(devhost_iostate_t* ios, zx_handle_t h) {
     ios->ph.handle = h;
@@ -873,6 +880,16 @@ __EXPORT int device_host_main(int argc, char** argv) {
         log(ERROR, "devhost: no root resource handle!\n");
     }
 
+    zx_handle_t hstats = zx_get_startup_handle(PA_HND(PA_USER0, ID_HIOTXNSTATS));
+    if (hstats != ZX_HANDLE_INVALID) {
+        uintptr_t addr;
+        if (zx_vmar_map(zx_vmar_root_self(), 0, hstats, 0, PAGE_SIZE,
+                        ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr) == ZX_OK) {
+            iotxn_stats = (iotxn_pool_stats_t*)addr;
+        }
+        zx_handle_close(hstats);
+    }
+
     zx_status_t r;
     if ((r = port_init(&dh_port)) < 0) {
         log(ERROR, "devhost: could not create port: %d\n", r);
@@ -21,6 +21,7 @@
 
 // Handle IDs for USER0 handles
 #define ID_HJOBROOT 4
+#define ID_HIOTXNSTATS 5
 
 // Nothing outside of devmgr/{devmgr,devhost,rpc-device}.c
 // should be calling devhost_*() APIs, as this could
@@ -68,6 +69,11 @@ typedef struct devhost_iostate {
     uint32_t flags;
     bool dead;
     port_handler_t ph;
+
+    // the client's I/O buffer, if it set one with IOCTL_DEVICE_SET_IO_BUFFER
+    void* io_buf;
+    size_t io_buf_size;
+    zx_handle_t io_buf_vmo;
 } devhost_iostate_t;
 
 devhost_iostate_t* create_devhost_iostate(zx_device_t* dev);
@@ -4,6 +4,8 @@
 
 #include <ctype.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +36,7 @@ bool dc_asan_drivers = false;
 static void dc_dump_state(void);
 static void dc_dump_devprops(void);
 static void dc_dump_drivers(void);
+static void dc_dump_binds(void);
 
 typedef struct {
     zx_status_t status;
@@ -49,7 +52,8 @@ typedef struct {
 
     // mexec arguments
     zx_handle_t kernel;
-    zx_handle_t bootdata;
+    zx_handle_t bootdata;   // ZX_HANDLE_INVALID to reuse the boot's bootdata
+    zx_time_t started;
 } suspend_context_t;
 static suspend_context_t suspend_ctx = {
     .devhosts = LIST_INITIAL_VALUE(suspend_ctx.devhosts),
@@ -115,6 +119,10 @@ static void dmprintf(const char* fmt, ...) {
 }
 
 static zx_status_t handle_dmctl_write(size_t len, const char* cmd) {
+    if ((len == 5) && !memcmp(cmd, "binds", 5)) {
+        dc_dump_binds();
+        return ZX_OK;
+    }
     if (len == 4) {
         if (!memcmp(cmd, "dump", 4)) {
             dc_dump_state();
@@ -131,6 +139,7 @@ static zx_status_t handle_dmctl_write(size_t len, const char* cmd) {
                      "ktraceon    - start kernel tracing\n"
                      "devprops    - dump published devices and their binding properties\n"
                      "drivers     - list discovered drivers and their properties\n"
+                     "binds       - show when each driver bound at boot and how long it took\n"
                      );
             return ZX_OK;
         }
@@ -191,6 +200,7 @@ static zx_status_t handle_dmctl_write(size_t len, const char* cmd) {
 
 //TODO: these are copied from devhost.h
 #define ID_HJOBROOT 4
+#define ID_HIOTXNSTATS 5
 zx_handle_t get_sysinfo_job_root(void);
 
 
@@ -235,15 +245,28 @@ static zx_status_t libname_to_vmo(const char* libname, zx_handle_t* out) {
         log(ERROR, "devcoord: cannot find driver '%s'\n", libname);
         return ZX_ERR_NOT_FOUND;
     }
-    int fd = open(libname, O_RDONLY);
-    if (fd < 0) {
-        log(ERROR, "devcoord: cannot open driver '%s'\n", libname);
-        return ZX_ERR_IO;
+    // Every devhost that loads the driver gets its own copy-on-write clone
+    // of one vmo, instead of the file being opened again each time.
+    if (drv->vmo == ZX_HANDLE_INVALID) {
+        int fd = open(libname, O_RDONLY);
+        if (fd < 0) {
+            log(ERROR, "devcoord: cannot open driver '%s'\n", libname);
+            return ZX_ERR_IO;
+        }
+        zx_status_t r = fdio_get_vmo(fd, &drv->vmo);
+        close(fd);
+        if (r < 0) {
+            log(ERROR, "devcoord: cannot get driver vmo '%s'\n", libname);
+            return r;
+        }
+    }
+    uint64_t size;
+    zx_status_t r = zx_vmo_get_size(drv->vmo, &size);
+    if (r == ZX_OK) {
+        r = zx_vmo_clone(drv->vmo, ZX_VMO_CLONE_COPY_ON_WRITE, 0, size, out);
     }
-    zx_status_t r = fdio_get_vmo(fd, out);
-    close(fd);
     if (r < 0) {
-        log(ERROR, "devcoord: cannot get driver vmo '%s'\n", libname);
+        log(ERROR, "devcoord: cannot clone driver vmo '%s'\n", libname);
     }
     return r;
 }
@@ -298,6 +321,17 @@ static void dc_dump_state(void) {
     dc_dump_device(&root_device, 0);
     dc_dump_device(&misc_device, 1);
     dc_dump_device(&sys_device, 1);
+
+    devhost_t* dh;
+    list_for_every_entry(&list_devhosts, dh, devhost_t, anode) {
+        if (dh->iotxn_stats == NULL) {
+            continue;
+        }
+        dmprintf("devhost pid=%zu iotxn pool: hits %" PRIu64 " misses %" PRIu64
+                 " pooled %" PRIu64 "\n", dh->koid,
+                 dh->iotxn_stats->hits, dh->iotxn_stats->misses,
+                 dh->iotxn_stats->pooled);
+    }
 }
 
 static void dc_dump_device_props(device_t* dev) {
@@ -534,13 +568,38 @@ static void dc_watch(zx_handle_t h) {
     }
 }
 
+// Devhosts are all launched from the same binary, so it is parsed once and
+// each launch just maps it.
+static launchpad_template_t* devhost_template;
+static const char* devhost_template_bin;
+
+static void dc_load_devhost(launchpad_t* lp, const char* devhost_bin) {
+    if (devhost_template_bin != devhost_bin) {
+        if (devhost_template != NULL) {
+            launchpad_template_destroy(devhost_template);
+            devhost_template = NULL;
+        }
+        zx_status_t r = launchpad_template_create_from_file(devhost_bin, &devhost_template);
+        if (r < 0) {
+            log(ERROR, "devcoord: cannot create devhost template: %d\n", r);
+            devhost_template = NULL;
+        }
+        devhost_template_bin = devhost_bin;
+    }
+    if (devhost_template != NULL) {
+        launchpad_load_from_template(lp, devhost_template);
+    } else {
+        launchpad_load_from_file(lp, devhost_bin);
+    }
+}
+
 static zx_status_t dc_launch_devhost(devhost_t* host,
                                      const char* name, zx_handle_t hrpc) {
     const char* devhost_bin = get_devhost_bin();
 
     launchpad_t* lp;
     launchpad_create_with_jobs(devhost_job, 0, name, &lp);
-    launchpad_load_from_file(lp, devhost_bin);
+    dc_load_devhost(lp, devhost_bin);
     launchpad_set_args(lp, 1, &devhost_bin);
 
     launchpad_add_handle(lp, hrpc, PA_HND(PA_USER0, 0));
@@ -571,11 +630,29 @@ static zx_status_t dc_launch_devhost(devhost_t* host,
     launchpad_add_handle(lp, get_sysinfo_job_root(),
                          PA_HND(PA_USER0, ID_HJOBROOT));
 
+    // A page for the devhost to keep its iotxn pool counters in, so that
+    // "dump" can report them without a round trip.
+    zx_handle_t hstats;
+    if (zx_vmo_create(PAGE_SIZE, 0, &hstats) == ZX_OK) {
+        uintptr_t addr;
+        if (zx_vmar_map(zx_vmar_root_self(), 0, hstats, 0, PAGE_SIZE,
+                        ZX_VM_FLAG_PERM_READ, &addr) == ZX_OK) {
+            host->iotxn_stats = (iotxn_pool_stats_t*)addr;
+            launchpad_add_handle(lp, hstats, PA_HND(PA_USER0, ID_HIOTXNSTATS));
+        } else {
+            zx_handle_close(hstats);
+        }
+    }
+
     const char* errmsg;
     zx_status_t status = launchpad_go(lp, &host->proc, &errmsg);
     if (status < 0) {
         log(ERROR, "devcoord: launch devhost '%s': failed: %d: %s\n",
             name, status, errmsg);
+        if (host->iotxn_stats != NULL) {
+            zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)host->iotxn_stats, PAGE_SIZE);
+            host->iotxn_stats = NULL;
+        }
         return status;
     }
     zx_info_handle_basic_t info;
@@ -641,6 +718,9 @@ static void dc_release_devhost(devhost_t* dh) {
     zx_handle_close(dh->hrpc);
     zx_task_kill(dh->proc);
     zx_handle_close(dh->proc);
+    if (dh->iotxn_stats != NULL) {
+        zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)dh->iotxn_stats, PAGE_SIZE);
+    }
     free(dh);
 }
 
@@ -958,6 +1038,61 @@ static zx_status_t dc_bind_device(device_t* dev, const char* drvlibname) {
     return ZX_OK;
 };
 
+// The first binds after boot, in the order they completed, for
+// "dm binds".  Later binds are only logged when they are slow.
+#define BIND_TIMELINE_MAX 256
+#define BIND_SLOW_MS 100
+
+typedef struct {
+    zx_time_t started;
+    zx_duration_t duration;
+    zx_status_t status;
+    const char* driver;
+    char device[ZX_DEVICE_NAME_MAX + 1];
+} bind_record_t;
+
+static bind_record_t bind_timeline[BIND_TIMELINE_MAX];
+static size_t bind_timeline_count;
+
+static void dc_record_bind(device_t* dev, driver_t* drv, zx_time_t started,
+                           zx_status_t status) {
+    zx_duration_t duration = zx_clock_get(ZX_CLOCK_MONOTONIC) - started;
+
+    // Mark the boot timeline with when the bind finished and how long it
+    // took, in microseconds.
+    char mark[ZX_MAX_NAME_LEN];
+    snprintf(mark, sizeof(mark), "bind:%s", drv->name);
+    devmgr_boot_mark(get_root_resource(), mark,
+                     (uint32_t)(duration / ZX_USEC(1)), (uint32_t)status);
+
+    if (duration >= ZX_MSEC(BIND_SLOW_MS)) {
+        log(INFO, "devcoord: bind '%s' to '%s' took %" PRIu64 "ms\n",
+            drv->name, dev->name, duration / ZX_MSEC(1));
+    }
+    if (bind_timeline_count == BIND_TIMELINE_MAX) {
+        return;
+    }
+    bind_record_t* rec = &bind_timeline[bind_timeline_count++];
+    rec->started = started;
+    rec->duration = duration;
+    rec->status = status;
+    rec->driver = drv->name;
+    strlcpy(rec->device, dev->name, sizeof(rec->device));
+}
+
+static void dc_dump_binds(void) {
+    dmprintf("   start(ms)     dur(ms)  status  device -> driver\n");
+    for (size_t n = 0; n < bind_timeline_count; n++) {
+        bind_record_t* rec = &bind_timeline[n];
+        dmprintf("%12" PRIu64 "%12" PRIu64 "%8d  %s -> %s\n",
+                 rec->started / ZX_MSEC(1), rec->duration / ZX_MSEC(1),
+                 rec->status, rec->device, rec->driver);
+    }
+    if (bind_timeline_count == BIND_TIMELINE_MAX) {
+        dmprintf("(timeline full, later binds not shown)\n");
+    }
+}
+
 static zx_status_t dc_handle_device_read(device_t* dev) {
     dc_msg_t msg;
     zx_handle_t hin[3];
@@ -1096,6 +1231,17 @@ static zx_status_t dc_handle_device_read(device_t* dev) {
         r = ZX_OK;
         break;
 
+    case DC_OP_DM_WARM_REBOOT: {
+        if (hcount != 1) {
+            log(ERROR, "devcoord: rpc: warm-reboot wrong hcount %d\n", hcount);
+            goto fail_wrong_hcount;
+        }
+        zx_handle_t h[2] = { hin[0], ZX_HANDLE_INVALID };
+        dc_mexec(h);
+        r = ZX_OK;
+        break;
+    }
+
     case DC_OP_GET_TOPO_PATH: {
         if (hcount != 0) {
             goto fail_wrong_hcount;
@@ -1120,13 +1266,15 @@ static zx_status_t dc_handle_device_read(device_t* dev) {
         }
         // all of these return directly and do not write a
         // reply, since this message is a reply itself
-        pending_t* pending = list_remove_tail_type(&dev->pending, pending_t, node);
+        // the devhost answers requests in the order they were sent
+        pending_t* pending = list_remove_head_type(&dev->pending, pending_t, node);
         if (pending == NULL) {
             log(ERROR, "devcoord: rpc: spurious status message\n");
             return ZX_OK;
         }
         switch (pending->op) {
         case PENDING_BIND:
+            dc_record_bind(dev, pending->ctx, pending->started, msg.status);
             if (msg.status != ZX_OK) {
                 log(ERROR, "devcoord: rpc: bind-driver '%s' status %d\n",
                     dev->name, msg.status);
@@ -1313,7 +1461,8 @@ static zx_status_t dc_create_proxy(device_t* parent) {
 }
 
 // send message to devhost, requesting the binding of a driver to a device
-static zx_status_t dh_bind_driver(device_t* dev, const char* libname) {
+static zx_status_t dh_bind_driver(device_t* dev, driver_t* drv) {
+    const char* libname = drv->libname;
     dc_msg_t msg;
     uint32_t mlen;
 
@@ -1344,7 +1493,8 @@ static zx_status_t dh_bind_driver(device_t* dev, const char* libname) {
 
     dev->flags |= DEV_CTX_BOUND;
     pending->op = PENDING_BIND;
-    pending->ctx = NULL;
+    pending->ctx = drv;
+    pending->started = zx_clock_get(ZX_CLOCK_MONOTONIC);
     list_add_tail(&dev->pending, &pending->node);
     return ZX_OK;
 }
@@ -1436,7 +1586,7 @@ static zx_status_t dc_attempt_bind(driver_t* drv, device_t* dev) {
             log(ERROR, "devcoord: can't bind to device without devhost\n");
             return ZX_ERR_BAD_STATE;
         }
-        return dh_bind_driver(dev, drv->libname);
+        return dh_bind_driver(dev, drv);
     }
 
     zx_status_t r;
@@ -1444,7 +1594,7 @@ static zx_status_t dc_attempt_bind(driver_t* drv, device_t* dev) {
         return r;
     }
 
-    r = dh_bind_driver(dev->proxy, drv->libname);
+    r = dh_bind_driver(dev->proxy, drv);
     //TODO(swetland): arrange to mark us unbound when the proxy (or its devhost) goes away
     if ((r == ZX_OK) && !(dev->flags & DEV_CTX_MULTI_BIND)) {
         dev->flags |= DEV_CTX_BOUND;
@@ -1618,6 +1768,7 @@ static void dc_mexec(zx_handle_t* h) {
 
     ctx->kernel = *h;
     ctx->bootdata = *(h + 1);
+    ctx->started = zx_clock_get(ZX_CLOCK_MONOTONIC);
 
     build_suspend_list(ctx);
 
@@ -1647,7 +1798,11 @@ static void dc_continue_suspend(suspend_context_t* ctx) {
         if (ctx->dh != NULL) {
             process_suspend_list(ctx);
         } else if (ctx->sflags == DEVICE_SUSPEND_FLAG_MEXEC) {
-            zx_system_mexec(ctx->kernel, ctx->bootdata);
+            zx_duration_t duration = zx_clock_get(ZX_CLOCK_MONOTONIC) - ctx->started;
+            log(INFO, "devcoord: suspended devices for mexec in %" PRIu64 "us\n",
+                duration / ZX_USEC(1));
+            zx_status_t status = zx_system_mexec(ctx->kernel, ctx->bootdata);
+            log(ERROR, "devcoord: mexec failed: %d\n", status);
         } else {
             // should never get here on x86
             // on arm, if the platform driver does not implement
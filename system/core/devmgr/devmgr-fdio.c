@@ -10,6 +10,7 @@
 #include <fdio/io.h>
 #include <fdio/util.h>
 
+#include <zircon/ktrace.h>
 #include <zircon/paths.h>
 #include <zircon/processargs.h>
 #include <zircon/syscalls.h>
@@ -151,3 +152,17 @@ fail:
     zx_handle_close(dest);
     return status;
 }
+
+void devmgr_boot_mark(zx_handle_t root_resource, const char* name,
+                      uint32_t arg0, uint32_t arg1) {
+    if (root_resource == ZX_HANDLE_INVALID) {
+        return;
+    }
+    // The kernel reads the name from a whole ZX_MAX_NAME_LEN buffer.
+    char probe[ZX_MAX_NAME_LEN] = {};
+    strlcpy(probe, name, sizeof(probe));
+    zx_status_t id = zx_ktrace_control(root_resource, KTRACE_ACTION_NEW_PROBE, 0, probe);
+    if (id >= 0) {
+        zx_ktrace_write(root_resource, id, arg0, arg1);
+    }
+}
@@ -409,6 +409,7 @@ int main(int argc, char** argv) {
     root_job_handle = zx_job_default();
 
     printf("devmgr: main()\n");
+    devmgr_boot_mark(root_resource_handle, "devmgr:main", 0, 0);
 
     devfs_init(root_job_handle);
 
@@ -446,6 +447,7 @@ int main(int argc, char** argv) {
         thrd_detach(t);
     }
 
+    devmgr_boot_mark(root_resource_handle, "devmgr:coordinator", 0, 0);
     coordinator();
     printf("devmgr: coordinator exited?!\n");
     return 0;
@@ -572,6 +574,12 @@ void fshost_start(void) {
     handles[n] = vmo;
     types[n++] = PA_HND(PA_VMO_BOOTFS, 0);
 
+    // pass the root resource to fshost for its boot timeline markers
+    //TODO: ktrace-only handle once resources are further along
+    if (zx_handle_duplicate(root_resource_handle, ZX_RIGHT_SAME_RIGHTS, &handles[n]) == ZX_OK) {
+        types[n++] = PA_HND(PA_RESOURCE, 0);
+    }
+
     // pass fuchsia start event to fshost
     if (zx_handle_duplicate(fuchsia_event, ZX_RIGHT_SAME_RIGHTS, &handles[n]) == ZX_OK) {
         types[n++] = PA_HND(PA_USER1, 0);
@@ -632,6 +640,7 @@ void fshost_start(void) {
 
     devmgr_launch(svcs_job_handle, "fshost", argc, argv,
                   envp, -1, handles, types, n, NULL);
+    devmgr_boot_mark(root_resource_handle, "devmgr:fshost-launched", 0, 0);
 
     // switch to system loader service provided by fshost
     zx_handle_close(dl_set_loader_service(svc));
@@ -34,6 +34,12 @@ bool secondary_bootfs_ready(void);
 void fshost_start(void);
 zx_status_t copy_vmo(zx_handle_t src, zx_off_t offset, size_t length, zx_handle_t* out_dest);
 
+// Marks the boot timeline in the kernel trace with a probe called |name|
+// (truncated to ZX_MAX_NAME_LEN - 1) carrying |arg0| and |arg1|.  Does
+// nothing without a root resource; bootprof prints the timeline.
+void devmgr_boot_mark(zx_handle_t root_resource, const char* name,
+                      uint32_t arg0, uint32_t arg1);
+
 void load_system_drivers(void);
 
 // The variable to set on the kernel command line to enable ld.so tracing
@@ -76,6 +76,11 @@ static zx_status_t dmctl_ioctl(void* ctx, uint32_t op,
             return ZX_ERR_INVALID_ARGS;
         }
         return dmctl_cmd(DC_OP_DM_MEXEC, NULL, 0, ((zx_handle_t*) in_buf), 2);
+    case IOCTL_DMCTL_WARM_REBOOT:
+        if (in_len != sizeof(zx_handle_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        return dmctl_cmd(DC_OP_DM_WARM_REBOOT, NULL, 0, ((zx_handle_t*) in_buf), 1);
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -328,6 +328,7 @@ zx_handle_t devmgr_load_file(const char* path) {
 static zx_handle_t devfs_root;
 static zx_handle_t svc_root;
 static zx_handle_t fuchsia_event;
+static zx_handle_t root_resource;
 
 zx_handle_t devfs_root_clone(void) {
     return fdio_service_clone(devfs_root);
@@ -338,6 +339,7 @@ zx_handle_t svc_root_clone(void) {
 }
 
 void fuchsia_start(void) {
+    devmgr_boot_mark(root_resource, "fshost:fuchsia-start", 0, 0);
     zx_object_signal(fuchsia_event, 0, ZX_USER_SIGNAL_0);
 }
 
@@ -362,8 +364,11 @@ int main(int argc, char** argv) {
     svc_root = zx_get_startup_handle(PA_HND(PA_USER0, 2));
     zx_handle_t devmgr_loader = zx_get_startup_handle(PA_HND(PA_USER0, 3));
     fuchsia_event = zx_get_startup_handle(PA_HND(PA_USER1, 0));
+    root_resource = zx_get_startup_handle(PA_HND(PA_RESOURCE, 0));
+    devmgr_boot_mark(root_resource, "fshost:main", 0, 0);
 
     fshost_start();
+    devmgr_boot_mark(root_resource, "fshost:bootfs", 0, 0);
 
     vfs_connect_global_root_handle(fs_root);
 
@@ -383,7 +388,8 @@ int main(int argc, char** argv) {
         printf("fshost: cannot install namespace: %d\n", r);
     }
 
-    if ((r = loader_service_create_fs("system-loader", &loader_service)) != ZX_OK) {
+    if ((r = loader_service_create_fs_cached("system-loader",
+                                             &loader_service)) != ZX_OK) {
         printf("fshost: failed to create loader service: %d\n", r);
     } else {
         loader_service_attach(loader_service, devmgr_loader);
@@ -19,6 +19,7 @@
 #include <fdio/debug.h>
 #include <fdio/io.h>
 #include <fdio/remoteio.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <fbl/unique_ptr.h>
@@ -31,6 +32,10 @@
 namespace memfs {
 namespace {
 
+// The most threads serving the root filesystems. Connections to different
+// vnodes are handled concurrently on them.
+constexpr uint32_t kMaxDispatchThreads = 4;
+
 Vfs root_vfs;
 Vfs system_vfs;
 fbl::unique_ptr<async::Loop> global_loop;
@@ -63,16 +68,14 @@ zx_status_t add_vmofile(fbl::RefPtr<VnodeDir> vnb, const char* path, zx_handle_t
                 return ZX_ERR_INVALID_ARGS;
             }
 
-            fbl::RefPtr<fs::Vnode> out;
-            r = vnb->Lookup(&out, fbl::StringPiece(path, nextpath - path));
-            if (r == ZX_ERR_NOT_FOUND) {
-                r = vnb->Create(&out, fbl::StringPiece(path, nextpath - path), S_IFDIR);
-            }
-
+            // The filesystem may already be served, so this takes its lock.
+            fbl::RefPtr<VnodeDir> dir;
+            r = vnb->vfs()->LookupOrCreateDir(vnb.get(), fbl::StringPiece(path, nextpath - path),
+                                              &dir);
             if (r < 0) {
                 return r;
             }
-            vnb = fbl::RefPtr<VnodeDir>::Downcast(fbl::move(out));
+            vnb = fbl::move(dir);
             path = nextpath + 1;
         }
     }
@@ -168,7 +171,13 @@ VnodeDir* vfs_create_global_root() {
                                        ZX_FS_RIGHT_READABLE | ZX_FS_FLAG_CREATE, S_IFDIR) == ZX_OK);
 
         memfs::global_loop.reset(new async::Loop());
-        memfs::global_loop->StartThread("root-dispatcher");
+        const uint32_t threads = fbl::min(zx_system_get_num_cpus(), memfs::kMaxDispatchThreads);
+        for (uint32_t i = 0; i < threads; i++) {
+            if (memfs::global_loop->StartThread("root-dispatcher") != ZX_OK) {
+                printf("devmgr: could not start root dispatcher thread %u\n", i);
+                break;
+            }
+        }
         memfs::root_vfs.set_async(memfs::global_loop->async());
         memfs::system_vfs.set_async(memfs::global_loop->async());
     }
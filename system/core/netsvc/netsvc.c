@@ -82,8 +82,8 @@ void udp6_recv(void* data, size_t len,
     }
 }
 
-void netifc_recv(void* data, size_t len) {
-    eth_recv(data, len);
+void netifc_recv(void* data, size_t len, bool csum_ok) {
+    eth_recv(data, len, csum_ok);
 }
 
 bool netifc_send_pending(void) {
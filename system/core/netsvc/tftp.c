@@ -26,6 +26,10 @@
 
 #define TFTP_TIMEOUT_SECS 1
 
+// Images are received into a ring of this size while the paver writes out what came before, so
+// memory use doesn't grow with the image and the disk is kept busy throughout the transfer.
+#define PAVER_BUFFER_SIZE (16 * 1024 * 1024)
+
 #define NB_IMAGE_PREFIX_LEN (strlen(NB_IMAGE_PREFIX))
 #define NB_FILENAME_PREFIX_LEN (strlen(NB_FILENAME_PREFIX))
 
@@ -40,6 +44,9 @@ typedef struct {
     bool is_write;
     char filename[PATH_MAX + 1];
     netfile_type_t type;
+    // For reporting the transfer rate
+    size_t xfer_size;
+    zx_time_t xfer_start;
     union {
         nbfile* netboot_file;
         struct {
@@ -47,13 +54,17 @@ typedef struct {
             size_t size;                // Total size of file
             zx_handle_t process;
 
-            // Buffer used for stashing data from tftp until it can be written out to the paver
+            // Ring used for stashing data from tftp until it can be written out to the paver.
+            // Offsets are from the start of the file; a byte lives at (offset % buffer_size).
             zx_handle_t buffer_handle;
             uint8_t* buffer;
+            size_t buffer_size;
             atomic_uint buf_refcount;
-            atomic_size_t offset;       // Buffer write offset (read offset is stored locally)
+            atomic_size_t offset;       // End of the data received so far
+            atomic_size_t read_offset;  // End of the data written out to the paver
             thrd_t buf_copy_thrd;
             completion_t data_ready;    // Allows read thread to block on buffer writes
+            completion_t space_ready;   // Allows tftp to block on the paver catching up
         } paver;
     };
 } file_info_t;
@@ -87,6 +98,8 @@ static ssize_t file_open_read(const char* filename, void* cookie) {
     file_info->netboot_file = NULL;
     size_t file_size;
     if (netfile_open(filename, O_RDONLY, &file_size) == 0) {
+        file_info->xfer_size = file_size;
+        file_info->xfer_start = zx_clock_get(ZX_CLOCK_MONOTONIC);
         return (ssize_t)file_size;
     }
     return TFTP_ERR_NOT_FOUND;
@@ -94,6 +107,9 @@ static ssize_t file_open_read(const char* filename, void* cookie) {
 
 static zx_status_t alloc_paver_buffer(file_info_t* file_info, size_t size) {
     zx_status_t status;
+    if (size > PAVER_BUFFER_SIZE) {
+        size = PAVER_BUFFER_SIZE;
+    }
     status = zx_vmo_create(size, 0, &file_info->paver.buffer_handle);
     if (status != ZX_OK) {
         printf("netsvc: unable to allocate buffer VMO\n");
@@ -108,12 +124,13 @@ static zx_status_t alloc_paver_buffer(file_info_t* file_info, size_t size) {
         return status;
     }
     file_info->paver.buffer = (uint8_t*)buffer;
+    file_info->paver.buffer_size = size;
     return ZX_OK;
 }
 
 static zx_status_t dealloc_paver_buffer(file_info_t* file_info) {
     zx_status_t status = zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)file_info->paver.buffer,
-                                       file_info->paver.size);
+                                       file_info->paver.buffer_size);
     if (status != ZX_OK) {
         printf("netsvc: failed to unmap paver buffer: %s\n", zx_status_get_string(status));
         goto done;
@@ -149,6 +166,7 @@ static int drain_pipe(void* arg) {
 static int paver_copy_buffer(void* arg) {
     file_info_t* file_info = arg;
     size_t read_ndx = 0;
+    size_t last_ndx = 0;
     int result = 0;
     zx_time_t last_reported = zx_clock_get(ZX_CLOCK_MONOTONIC);
     while (read_ndx < file_info->paver.size) {
@@ -166,24 +184,37 @@ static int paver_copy_buffer(void* arg) {
             goto done;
         }
         while(read_ndx < write_ndx) {
-            int r = write(file_info->paver.fd, &file_info->paver.buffer[read_ndx],
-                          write_ndx - read_ndx);
+            // Write up to the end of the ring at most, then carry on from its start
+            size_t ring_ndx = read_ndx % file_info->paver.buffer_size;
+            size_t len = write_ndx - read_ndx;
+            if (len > file_info->paver.buffer_size - ring_ndx) {
+                len = file_info->paver.buffer_size - ring_ndx;
+            }
+            int r = write(file_info->paver.fd, &file_info->paver.buffer[ring_ndx], len);
             if (r <= 0) {
                 printf("netsvc: couldn't write to paver fd: %d\n", r);
                 result = TFTP_ERR_IO;
                 goto done;
             }
             read_ndx += r;
+            // Let tftp reuse the space, if it is waiting for some
+            atomic_store(&file_info->paver.read_offset, read_ndx);
+            completion_signal(&file_info->paver.space_ready);
             zx_time_t curr_time = zx_clock_get(ZX_CLOCK_MONOTONIC);
             if ((curr_time - last_reported) >= ZX_SEC(1)) {
                 float complete = ((float)read_ndx / (float)file_info->paver.size) * 100.0;
-                printf("netsvc: paver write progress %0.1f%%\n", complete);
+                float rate = (float)(read_ndx - last_ndx) / 1048576.0 /
+                             ((float)(curr_time - last_reported) / (float)ZX_SEC(1));
+                printf("netsvc: paver write progress %0.1f%% (%0.1f MB/s)\n", complete, rate);
                 last_reported = curr_time;
+                last_ndx = read_ndx;
             }
         }
     }
 done:
     close(file_info->paver.fd);
+    // Wake tftp if it is waiting for space it will now never get
+    completion_signal(&file_info->paver.space_ready);
 
     unsigned int refcount = atomic_fetch_sub(&file_info->paver.buf_refcount, 1);
     if (refcount == 1) {
@@ -264,6 +295,8 @@ static tftp_status paver_open_write(const char* filename, size_t size, file_info
     // may be done with it first so we use a refcount to decide when to deallocate it
     atomic_store(&file_info->paver.buf_refcount, 2);
     atomic_store(&file_info->paver.offset, 0);
+    atomic_store(&file_info->paver.read_offset, 0);
+    completion_reset(&file_info->paver.space_ready);
     atomic_store(&paving_in_progress, true);
 
     if ((thrd_create(&file_info->paver.buf_copy_thrd, paver_copy_buffer, (void*)file_info))
@@ -295,6 +328,8 @@ static tftp_status file_open_write(const char* filename, size_t size,
     file_info->is_write = true;
     strncpy(file_info->filename, filename, PATH_MAX);
     file_info->filename[PATH_MAX] = '\0';
+    file_info->xfer_size = size;
+    file_info->xfer_start = zx_clock_get(ZX_CLOCK_MONOTONIC);
 
     if (netbootloader && !strncmp(filename, NB_FILENAME_PREFIX, NB_FILENAME_PREFIX_LEN)) {
         // netboot
@@ -354,8 +389,42 @@ static tftp_status file_write(const void* data, size_t* length, off_t offset, vo
             || (offset + *length) > file_info->paver.size) {
             return TFTP_ERR_INVALID_ARGS;
         }
-        memcpy(&file_info->paver.buffer[offset], data, *length);
-        size_t new_offset = offset + *length;
+        // Only data the paver has written out can be overwritten. Wait for it to catch up if
+        // there is no room -- the peer will retransmit if that takes longer than its timeout.
+        size_t buffer_size = file_info->paver.buffer_size;
+        size_t read_offset;
+        for (;;) {
+            completion_reset(&file_info->paver.space_ready);
+            read_offset = atomic_load(&file_info->paver.read_offset);
+            if ((size_t)offset < read_offset) {
+                return TFTP_ERR_INVALID_ARGS;
+            }
+            if ((size_t)offset < read_offset + buffer_size) {
+                break;
+            }
+            if (!atomic_load(&paving_in_progress)) {
+                printf("netsvc: paver exited prematurely\n");
+                return TFTP_ERR_IO;
+            }
+            if (completion_wait(&file_info->paver.space_ready,
+                                ZX_SEC(5 * TFTP_TIMEOUT_SECS)) != ZX_OK) {
+                printf("netsvc: timed out waiting for the paver to catch up\n");
+                return TFTP_ERR_TIMED_OUT;
+            }
+        }
+        // Copy what fits before the ring wraps, or before unwritten data; the caller will come
+        // back for the rest.
+        size_t ring_offset = offset % buffer_size;
+        size_t len = *length;
+        if (len > read_offset + buffer_size - offset) {
+            len = read_offset + buffer_size - offset;
+        }
+        if (len > buffer_size - ring_offset) {
+            len = buffer_size - ring_offset;
+        }
+        memcpy(&file_info->paver.buffer[ring_offset], data, len);
+        *length = len;
+        size_t new_offset = offset + len;
         atomic_store(&file_info->paver.offset, new_offset);
         // Wake the paver thread, if it is waiting for data
         completion_signal(&file_info->paver.data_ready);
@@ -489,11 +558,14 @@ void tftp_recv(void* data, size_t len,
     switch (status) {
     case TFTP_NO_ERROR:
         return;
-    case TFTP_TRANSFER_COMPLETED:
-        printf("netsvc: tftp %s of file %s completed\n",
-               file_info.is_write ? "write" : "read",
-               file_info.filename);
+    case TFTP_TRANSFER_COMPLETED: {
+        zx_time_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - file_info.xfer_start;
+        float secs = (float)elapsed / (float)ZX_SEC(1);
+        printf("netsvc: tftp %s of file %s completed: %zu bytes in %0.1fs (%0.1f MB/s)\n",
+               file_info.is_write ? "write" : "read", file_info.filename, file_info.xfer_size,
+               secs, (secs > 0) ? (float)file_info.xfer_size / 1048576.0 / secs : 0);
         break;
+    }
     case TFTP_ERR_SHOULD_WAIT:
         break;
     default:
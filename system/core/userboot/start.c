@@ -11,6 +11,7 @@
 
 #pragma GCC visibility push(hidden)
 
+#include <zircon/ktrace.h>
 #include <zircon/stack.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/log.h>
@@ -26,6 +27,18 @@
 #define SHUTDOWN_COMMAND "poweroff"
 #define STACK_VMO_NAME "userboot-child-initial-stack"
 
+// Marks the boot timeline in the kernel trace, as devmgr does.
+static void boot_mark(zx_handle_t rroot, const char* name) {
+    // The kernel reads the name from a whole ZX_MAX_NAME_LEN buffer.
+    char probe[ZX_MAX_NAME_LEN];
+    size_t len = MIN(strlen(name), sizeof(probe) - 1);
+    memcpy(probe, name, len);
+    memset(probe + len, 0, sizeof(probe) - len);
+    zx_status_t id = zx_ktrace_control(rroot, KTRACE_ACTION_NEW_PROBE, 0, probe);
+    if (id >= 0)
+        zx_ktrace_write(rroot, id, 0, 0);
+}
+
 static noreturn void do_shutdown(zx_handle_t log, zx_handle_t rroot) {
     printl(log, "Process exited.  Executing \"" SHUTDOWN_COMMAND "\".");
     zx_debug_send_command(rroot, SHUTDOWN_COMMAND, strlen(SHUTDOWN_COMMAND));
@@ -204,7 +217,9 @@ static noreturn void bootstrap(zx_handle_t log, zx_handle_t bootstrap_pipe) {
     // Locate the first bootfs bootdata section and decompress it.
     // We need it to load devmgr and libc from.
     // Later bootfs sections will be processed by devmgr.
+    boot_mark(root_resource_handle, "userboot:start");
     zx_handle_t bootfs_vmo = bootdata_get_bootfs(log, vmar_self, bootdata_vmo);
+    boot_mark(root_resource_handle, "userboot:bootfs");
 
     // Pass the decompressed bootfs VMO on.
     handles[nhandles + EXTRA_HANDLE_BOOTFS] = bootfs_vmo;
@@ -308,6 +323,7 @@ static noreturn void bootstrap(zx_handle_t log, zx_handle_t bootstrap_pipe) {
     check(log, status, "zx_handle_close failed on thread handle");
 
     printl(log, "process %s started.", o.value[OPTION_FILENAME]);
+    boot_mark(root_resource_handle, "userboot:started");
 
     // Now become the loader service for as long as that's needed.
     if (loader_service_channel != ZX_HANDLE_INVALID)
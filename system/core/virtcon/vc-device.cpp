@@ -141,20 +141,8 @@ static void vc_invalidate(void* cookie, int x0, int y0, int w, int h) {
 
 // implement tc callbacks:
 
-static inline void vc_invalidate_lines(vc_t* vc, int y, int h) {
-    if (y < vc->invy0) {
-        vc->invy0 = y;
-    }
-    y += h;
-    if (y > vc->invy1) {
-        vc->invy1 = y;
-    }
-}
-
 static void vc_tc_invalidate(void* cookie, int x0, int y0, int w, int h){
-    vc_t* vc = reinterpret_cast<vc_t*>(cookie);
     vc_invalidate(cookie, x0, y0, w, h);
-    vc_invalidate_lines(vc, y0, h);
 }
 
 static void vc_tc_movecursor(void* cookie, int x, int y) {
@@ -166,11 +154,9 @@ static void vc_tc_movecursor(void* cookie, int x, int y) {
     if (vc->active && !vc->hide_cursor) {
         // Clear the cursor from its old position.
         vc_invalidate(cookie, old_x, old_y, 1, 1);
-        vc_invalidate_lines(vc, old_y, 1);
 
         // Display the cursor in its new position.
         vc_invalidate(cookie, vc->cursor_x, vc->cursor_y, 1, 1);
-        vc_invalidate_lines(vc, vc->cursor_y, 1);
     }
 }
 
@@ -230,7 +216,6 @@ static void vc_set_cursor_hidden(vc_t* vc, bool hide) {
     vc->hide_cursor = hide;
     if (vc->active) {
         vc_invalidate(vc, vc->cursor_x, vc->cursor_y, 1, 1);
-        vc_invalidate_lines(vc, vc->cursor_y, 1);
     }
 }
 
@@ -244,7 +229,6 @@ static void vc_tc_copy_lines(void* cookie, int y_dest, int y_src, int line_count
         // redrawing all of the non-scrollback lines in this case.
         int rows = vc_rows(vc);
         vc_invalidate(vc, 0, 0, vc->columns, rows);
-        vc_invalidate_lines(vc, 0, rows);
         return;
     }
 
@@ -270,7 +254,6 @@ static void vc_tc_copy_lines(void* cookie, int y_dest, int y_src, int line_count
 
         vc_status_update();
         vc_gfx_invalidate_status();
-        vc_invalidate_lines(vc, 0, vc_rows(vc));
     }
 }
 
@@ -589,14 +572,11 @@ void vc_free(vc_t* vc) {
 }
 
 void vc_flush(vc_t* vc) {
-    if (vc_gfx && vc->invy1 >= 0) {
-        int rows = vc_rows(vc);
-        // Adjust for the current viewport position.  Convert
-        // console-relative row numbers to screen-relative row numbers.
-        int invalidate_y0 = MIN(vc->invy0 - vc->viewport_y, rows);
-        int invalidate_y1 = MIN(vc->invy1 - vc->viewport_y, rows);
-        vc_gfx_invalidate(vc, 0, invalidate_y0,
-                          vc->columns, invalidate_y1 - invalidate_y0);
+    // Only what has been drawn since the last flush needs to reach the display.
+    gfx_rect r;
+    if (vc_gfx && gfx_surface_get_dirty(vc_gfx, &r)) {
+        vc_gfx_invalidate_region(vc, r.x, r.y, r.width, r.height);
+        gfx_surface_clear_dirty(vc_gfx);
     }
 }
 
@@ -82,7 +82,7 @@ void vc_gfx_invalidate(vc_t* vc, unsigned x, unsigned y, unsigned w, unsigned h)
 
 void vc_gfx_invalidate_region(vc_t* vc, unsigned x, unsigned y, unsigned w, unsigned h) {
     unsigned desty = vc_tb_gfx->height + y;
-    if ((x == 0) && (w == vc->columns)) {
+    if ((x == 0) && (w == vc_gfx->width)) {
         gfx_copylines(vc_test_gfx, vc_gfx, y, desty, h);
     } else {
         gfx_blend(vc_test_gfx, vc_gfx, x, y, w, h, x, desty);
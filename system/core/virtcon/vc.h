@@ -69,9 +69,6 @@ typedef struct vc {
     unsigned charw, charh;
     // size of character cell
 
-    int invy0, invy1;
-    // offscreen invalid lines, tracked during textcon drawing
-
     unsigned cursor_x, cursor_y;
     // cursor
     bool hide_cursor;
@@ -29,6 +29,33 @@ static constexpr zx_time_t IHDA_SD_RESET_POLL_TIME_NSEC = 100000u;    // 100uSec
 static constexpr zx_time_t IHDA_SD_STOP_HOLD_TIME_NSEC  = 100000u;
 constexpr uint32_t DMA_ALIGN = 128;
 constexpr uint32_t DMA_ALIGN_MASK = DMA_ALIGN - 1;
+
+// The position page is only updated from the buffer completion IRQ, so when a
+// client has one, make sure there are at least this many IRQs per trip around
+// the ring, or as many as the BDL can hold if they asked for low latency.
+constexpr uint32_t POSITION_PAGE_IRQS_PER_RING = 4;
+
+// Streams are serviced by the controller's IRQ thread.  The reservation it
+// holds is sized for the shortest IRQ period of any low latency stream seen
+// so far, and is kept for the life of the thread.
+thread_local zx_duration_t irq_thread_deadline_period = 0;
+
+void EnsureIrqThreadDeadline(zx_duration_t period) {
+    if ((period == 0) ||
+        ((irq_thread_deadline_period != 0) && (irq_thread_deadline_period <= period)))
+        return;
+
+    zx_status_t res = utils::RequestLowLatencyDeadline(period);
+    if (res != ZX_OK) {
+        GLOBAL_LOG("Failed to reserve %" PRIu64 " nSec deadline for IRQ thread (res %d)\n",
+                   period, res);
+        // Don't keep retrying from IRQ context; settle for what we have.
+        if (irq_thread_deadline_period == 0)
+            irq_thread_deadline_period = period;
+        return;
+    }
+    irq_thread_deadline_period = period;
+}
 }  // namespace
 
 void IntelHDAStream::PrintDebugPrefix() const {
@@ -213,6 +240,7 @@ zx_status_t IntelHDAStream::ProcessClientRequest(dispatcher::Channel* channel) {
         audio_proto::RingBufGetBufferReq    get_buffer;
         audio_proto::RingBufStartReq        start;
         audio_proto::RingBufStopReq         stop;
+        audio_proto::RingBufGetPositionPageReq get_position_page;
     } req;
     // TODO(johngro) : How large is too large?
     static_assert(sizeof(req) <= 256, "Request buffer is too large to hold on the stack!");
@@ -255,6 +283,8 @@ zx_status_t IntelHDAStream::ProcessClientRequest(dispatcher::Channel* channel) {
     HANDLE_REQ(AUDIO_RB_CMD_GET_BUFFER,     get_buffer,     ProcessGetBufferLocked,    false);
     HANDLE_REQ(AUDIO_RB_CMD_START,          start,          ProcessStartLocked,        false);
     HANDLE_REQ(AUDIO_RB_CMD_STOP,           stop,           ProcessStopLocked,         false);
+    HANDLE_REQ(AUDIO_RB_CMD_GET_POSITION_PAGE, get_position_page,
+               ProcessGetPositionPageLocked, false);
     default:
         DEBUG_LOG("Unrecognized command ID 0x%04x\n", req.hdr.cmd);
         return ZX_ERR_INVALID_ARGS;
@@ -298,11 +328,20 @@ void IntelHDAStream::ProcessStreamIRQ() {
         return;
 
     if (sts & HDA_SD_REG_STS8_BCIS) {
-        audio_proto::RingBufPositionNotify msg;
-        msg.hdr.cmd = AUDIO_RB_POSITION_NOTIFY;
-        msg.hdr.transaction_id = AUDIO_INVALID_TRANSACTION_ID;
-        msg.ring_buffer_pos = REG_RD(&regs_->lpib);
-        irq_channel_->Write(&msg, sizeof(msg));
+        uint32_t pos = REG_RD(&regs_->lpib);
+
+        if (position_page_.is_valid()) {
+            position_page_.Publish(pos, zx_clock_get(ZX_CLOCK_MONOTONIC));
+            EnsureIrqThreadDeadline(irq_period_);
+        }
+
+        if (notify_client_) {
+            audio_proto::RingBufPositionNotify msg;
+            msg.hdr.cmd = AUDIO_RB_POSITION_NOTIFY;
+            msg.hdr.transaction_id = AUDIO_INVALID_TRANSACTION_ID;
+            msg.ring_buffer_pos = pos;
+            irq_channel_->Write(&msg, sizeof(msg));
+        }
     }
 }
 
@@ -312,7 +351,10 @@ void IntelHDAStream::DeactivateLocked() {
     {
         fbl::AutoLock notif_lock(&notif_lock_);
         irq_channel_ = nullptr;
+        position_page_.Release();
+        irq_period_ = 0;
     }
+    low_latency_ = false;
 
     // If we have a connection to a client, close it.
     if (channel_ != nullptr) {
@@ -456,12 +498,31 @@ zx_status_t IntelHDAStream::ProcessGetBufferLocked(const audio_proto::RingBufGet
         goto finished;
     }
 
+    // Figure out how many IRQs we want per trip around the ring.  A position
+    // page needs IRQs even if the user asked for no notifications.  Every IRQ
+    // ends a BDL entry, so leave room for the entries which region boundaries
+    // will need.
+    uint32_t irqs_per_ring;
+    bool has_position_page;
+    irqs_per_ring = req.notifications_per_ring;
+    {
+        fbl::AutoLock notif_lock(&notif_lock_);
+        has_position_page = position_page_.is_valid();
+    }
+    if (has_position_page) {
+        uint32_t wanted = low_latency_ ? static_cast<uint32_t>(MAX_BDL_LENGTH)
+                                       : POSITION_PAGE_IRQS_PER_RING;
+        uint32_t room = (num_regions < MAX_BDL_LENGTH)
+                      ? static_cast<uint32_t>(MAX_BDL_LENGTH) - num_regions
+                      : 1;
+        irqs_per_ring = fbl::max(irqs_per_ring, fbl::min(wanted, room));
+    }
+
     // Program the buffer descriptor list.  Mark BDL entries as needed to
-    // generate interrupts with the frequency requested by the user.
+    // generate interrupts with the frequency requested.
     uint32_t nominal_irq_spacing;
-    nominal_irq_spacing = req.notifications_per_ring
-                        ? (rb_size + req.notifications_per_ring - 1) /
-                           req.notifications_per_ring
+    nominal_irq_spacing = irqs_per_ring
+                        ? (rb_size + irqs_per_ring - 1) / irqs_per_ring
                         : 0;
 
     uint32_t next_irq_pos;
@@ -527,7 +588,7 @@ zx_status_t IntelHDAStream::ProcessGetBufferLocked(const audio_proto::RingBufGet
     }
 
     ZX_DEBUG_ASSERT(entry > 0);
-    if (irqs_inserted < req.notifications_per_ring) {
+    if (irqs_inserted < irqs_per_ring) {
         bdl_[entry - 1].flags = IntelHDABDLEntry::IOC_FLAG;
     }
 
@@ -562,6 +623,17 @@ zx_status_t IntelHDAStream::ProcessGetBufferLocked(const audio_proto::RingBufGet
     ZX_DEBUG_ASSERT((rb_size % bytes_per_frame_) == 0);
     resp.num_ring_buffer_frames = rb_size / bytes_per_frame_;
 
+    {
+        fbl::AutoLock notif_lock(&notif_lock_);
+        notify_client_ = (req.notifications_per_ring != 0);
+
+        // The period of IRQs, used to size the IRQ thread's reservation.
+        uint32_t frame_rate = StreamFormat(encoded_fmt_).sample_rate();
+        irq_period_ = (low_latency_ && irqs_per_ring && frame_rate)
+                    ? ZX_SEC(resp.num_ring_buffer_frames) / (frame_rate * irqs_per_ring)
+                    : 0;
+    }
+
 finished:
     if (resp.result == ZX_OK) {
         // Success.  DMA is set up and ready to go.  If we manage to send the
@@ -675,6 +747,36 @@ zx_status_t IntelHDAStream::ProcessStopLocked(const audio_proto::RingBufStopReq&
     return channel_->Write(&resp, sizeof(resp));
 }
 
+zx_status_t IntelHDAStream::ProcessGetPositionPageLocked(
+        const audio_proto::RingBufGetPositionPageReq& req) {
+    zx::vmo client_page_handle;
+    audio_proto::RingBufGetPositionPageResp resp = { };
+    resp.hdr = req.hdr;
+
+    // The IRQ spacing is chosen when the buffer is set up, so asking for a
+    // page is only allowed while we are stopped.
+    if (running_ || (bytes_per_frame_ == 0)) {
+        DEBUG_LOG("Bad state %s%s while getting position page.\n",
+                  running_ ? "(running)" : "",
+                  bytes_per_frame_ == 0 ? "(not configured)" : "");
+        resp.result = ZX_ERR_BAD_STATE;
+        return channel_->Write(&resp, sizeof(resp));
+    }
+
+    {
+        fbl::AutoLock notif_lock(&notif_lock_);
+        resp.result = position_page_.Create(&client_page_handle);
+    }
+
+    if (resp.result != ZX_OK) {
+        DEBUG_LOG("Failed to create position page (res %d)\n", resp.result);
+        return channel_->Write(&resp, sizeof(resp));
+    }
+
+    low_latency_ = (req.flags & AUDIO_RB_POSITION_FLAG_LOW_LATENCY) != 0;
+    return channel_->Write(&resp, sizeof(resp), fbl::move(client_page_handle));
+}
+
 void IntelHDAStream::ReleaseRingBufferLocked() {
     ring_buffer_vmo_.reset();
     ZX_DEBUG_ASSERT(bdl_);
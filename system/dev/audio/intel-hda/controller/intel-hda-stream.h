@@ -12,6 +12,7 @@
 #include <fbl/unique_ptr.h>
 
 #include <audio-proto/audio-proto.h>
+#include <audio-proto-utils/position-page.h>
 #include <dispatcher-pool/dispatcher-channel.h>
 #include <intel-hda/utils/intel-hda-registers.h>
 
@@ -85,6 +86,8 @@ private:
         TA_REQ(channel_lock_);
     zx_status_t ProcessStartLocked(const audio_proto::RingBufStartReq& req) TA_REQ(channel_lock_);
     zx_status_t ProcessStopLocked(const audio_proto::RingBufStopReq& req) TA_REQ(channel_lock_);
+    zx_status_t ProcessGetPositionPageLocked(const audio_proto::RingBufGetPositionPageReq& req)
+        TA_REQ(channel_lock_);
 
     // Release the client ring buffer (if one has been assigned)
     void ReleaseRingBufferLocked() TA_REQ(channel_lock_);
@@ -136,9 +139,16 @@ private:
     // Start/stop flag.
     bool running_ TA_GUARDED(channel_lock_) = false;
 
+    // Set by AUDIO_RB_CMD_GET_POSITION_PAGE.
+    bool low_latency_ TA_GUARDED(channel_lock_) = false;
+
     // State used by the IRQ thread to deliver position update notifications.
+    // The position page is only created or released with both locks held.
     fbl::Mutex notif_lock_ TA_ACQ_AFTER(channel_lock_);
     fbl::RefPtr<dispatcher::Channel> irq_channel_ TA_GUARDED(notif_lock_);
+    bool notify_client_ TA_GUARDED(notif_lock_) = false;
+    utils::PositionPage position_page_ TA_GUARDED(notif_lock_);
+    zx_duration_t irq_period_ TA_GUARDED(notif_lock_) = 0;
 };
 
 }  // namespace intel_hda
@@ -400,6 +400,7 @@ zx_status_t UsbAudioStream::ProcessRingBufferChannel(dispatcher::Channel* channe
         audio_proto::RingBufGetBufferReq    get_buffer;
         audio_proto::RingBufStartReq        rb_start;
         audio_proto::RingBufStopReq         rb_stop;
+        audio_proto::RingBufGetPositionPageReq get_position_page;
         // TODO(johngro) : add more commands here
     } req;
 
@@ -422,6 +423,7 @@ zx_status_t UsbAudioStream::ProcessRingBufferChannel(dispatcher::Channel* channe
     HREQ(AUDIO_RB_CMD_GET_BUFFER,     get_buffer,     OnGetBufferLocked,    false);
     HREQ(AUDIO_RB_CMD_START,          rb_start,       OnStartLocked,        false);
     HREQ(AUDIO_RB_CMD_STOP,           rb_stop,        OnStopLocked,         false);
+    HREQ(AUDIO_RB_CMD_GET_POSITION_PAGE, get_position_page, OnGetPositionPageLocked, false);
     default:
         DEBUG_LOG("Unrecognized ring buffer command 0x%04x\n", req.hdr.cmd);
         return ZX_ERR_NOT_SUPPORTED;
@@ -595,6 +597,13 @@ zx_status_t UsbAudioStream::OnSetStreamFormatLocked(dispatcher::Channel* channel
         }
     }
 
+    // Any position page belonged to the old ring buffer channel.
+    {
+        fbl::AutoLock req_lock(&req_lock_);
+        position_page_.Release();
+        low_latency_ = false;
+    }
+
     // Create a new ring buffer channel which can be used to move bulk data and
     // bind it to us.
     rb_channel_ = dispatcher::Channel::Create();
@@ -877,6 +886,33 @@ zx_status_t UsbAudioStream::OnStopLocked(dispatcher::Channel* channel,
     return ZX_OK;
 }
 
+zx_status_t UsbAudioStream::OnGetPositionPageLocked(
+        dispatcher::Channel* channel,
+        const audio_proto::RingBufGetPositionPageReq& req) {
+    audio_proto::RingBufGetPositionPageResp resp = { };
+    zx::vmo client_page_handle;
+
+    resp.hdr = req.hdr;
+
+    {
+        fbl::AutoLock req_lock(&req_lock_);
+        if (ring_buffer_state_ != RingBufferState::STOPPED) {
+            resp.result = ZX_ERR_BAD_STATE;
+        } else {
+            resp.result = position_page_.Create(&client_page_handle);
+            if (resp.result == ZX_OK)
+                low_latency_ = (req.flags & AUDIO_RB_POSITION_FLAG_LOW_LATENCY) != 0;
+        }
+    }
+
+    if (resp.result != ZX_OK) {
+        LOG("Failed to create position page (res %d)\n", resp.result);
+        return channel->Write(&resp, sizeof(resp));
+    }
+
+    return channel->Write(&resp, sizeof(resp), fbl::move(client_page_handle));
+}
+
 void UsbAudioStream::RequestComplete(usb_request_t* req) {
     enum class Action {
         NONE,
@@ -923,6 +959,21 @@ void UsbAudioStream::RequestComplete(usb_request_t* req) {
         // operation which goes away when we get to the zero copy world.
         CompleteRequestLocked(req);
 
+        if ((ring_buffer_state_ == RingBufferState::STARTED) && position_page_.is_valid()) {
+            position_page_.Publish(ring_buffer_pos_, complete_time);
+        }
+
+        // Low latency clients get this thread a deadline reservation covering
+        // one isochronous packet period.  Like the priority boost above, it is
+        // requested from here because this is the bus driver's thread.
+        if (low_latency_ && !req_complete_deadline_set_) {
+            zx_status_t res = utils::RequestLowLatencyDeadline(ZX_SEC(1) / iso_packet_rate_);
+            if (res != ZX_OK) {
+                LOG("Failed to reserve deadline for request completion (res %d)\n", res);
+            }
+            req_complete_deadline_set_ = true;
+        }
+
         // Did the transaction fail because the device was unplugged?  If so,
         // enter the stopping state and close the connections to our clients.
         if (req_status == ZX_ERR_IO_NOT_PRESENT) {
@@ -1153,6 +1204,8 @@ void UsbAudioStream::DeactivateRingBufferChannel(const dispatcher::Channel* chan
         if (ring_buffer_state_ != RingBufferState::STOPPED) {
             ring_buffer_state_ = RingBufferState::STOPPING;
         }
+        position_page_.Release();
+        low_latency_ = false;
     }
 
     rb_channel_.reset();
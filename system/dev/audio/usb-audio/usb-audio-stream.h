@@ -13,6 +13,7 @@
 #include <fbl/vector.h>
 
 #include <audio-proto/audio-proto.h>
+#include <audio-proto-utils/position-page.h>
 #include <dispatcher-pool/dispatcher-channel.h>
 #include <dispatcher-pool/dispatcher-execution-domain.h>
 
@@ -120,6 +121,8 @@ private:
         __TA_REQUIRES(lock_);
     zx_status_t OnStopLocked(dispatcher::Channel* channel, const audio_proto::RingBufStopReq& req)
         __TA_REQUIRES(lock_);
+    zx_status_t OnGetPositionPageLocked(dispatcher::Channel* channel,
+            const audio_proto::RingBufGetPositionPageReq& req) __TA_REQUIRES(lock_);
 
     void RequestComplete(usb_request_t* req);
     void QueueRequestLocked() __TA_REQUIRES(req_lock_);
@@ -152,6 +155,11 @@ private:
     uint32_t bytes_per_notification_ = 0;
     uint32_t notification_acc_ __TA_GUARDED(req_lock_);
 
+    // Updated on every request completion while started.
+    utils::PositionPage position_page_ __TA_GUARDED(req_lock_);
+    bool low_latency_ __TA_GUARDED(req_lock_) = false;
+    bool req_complete_deadline_set_ __TA_GUARDED(req_lock_) = false;
+
     zx::vmo  ring_buffer_vmo_;
     void*    ring_buffer_virt_  = nullptr;
     uint32_t ring_buffer_size_  = 0;
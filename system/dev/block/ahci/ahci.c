@@ -52,6 +52,7 @@ typedef struct ahci_port {
     uint32_t running;   // bitmask of running commands
     uint32_t completed; // bitmask of completed commands
     iotxn_t* commands[AHCI_MAX_COMMANDS]; // commands in flight
+    list_node_t merged[AHCI_MAX_COMMANDS]; // txns merged into each command in flight
 
     list_node_t txn_list;
     io_buffer_t buffer;
@@ -192,31 +193,87 @@ static bool cmd_is_queued(uint8_t cmd) {
 
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, zx_status_t status) {
     mtx_lock(&port->lock);
-    uint32_t sact = ahci_read(&port->regs->sact);
+    // queued commands stay set in sact until done, and others in ci, so every
+    // command which finished since the last interrupt is picked up at once
+    uint32_t active = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci);
     uint32_t running = port->running;
-    uint32_t done = sact ^ running;
+    uint32_t done = running & ~active;
     // assert if a channel without an outstanding transaction is active
-    ZX_DEBUG_ASSERT(!(done & sact));
+    ZX_DEBUG_ASSERT(!(active & ~running));
     port->completed |= done;
     mtx_unlock(&port->lock);
     // hit the worker thread to complete commands
     completion_signal(&dev->worker_completion);
 }
 
-static zx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
-    assert(slot < AHCI_MAX_COMMANDS);
-    assert(!ahci_port_cmd_busy(port, slot));
+// Moves the txns of the command in |slot| to |list| and frees the slot.
+static void ahci_port_take_slot(ahci_port_t* port, unsigned slot, list_node_t* list) {
+    iotxn_t* txn = port->commands[slot];
+    if (txn != NULL) {
+        list_add_tail(list, &txn->node);
+    }
+    while ((txn = list_remove_head_type(&port->merged[slot], iotxn_t, node)) != NULL) {
+        list_add_tail(list, &txn->node);
+    }
+    port->running &= ~(1 << slot);
+    port->commands[slot] = NULL;
+}
 
-    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+// Appends the PRDs of |txn| to the command in |slot|.
+static zx_status_t ahci_port_add_prds(ahci_port_t* port, int slot, iotxn_t* txn) {
     zx_status_t status = iotxn_physmap(txn);
     if (status != ZX_OK) {
-        iotxn_complete(txn, status, 0);
-        completion_signal(&dev->worker_completion);
         return status;
     }
     iotxn_phys_iter_t iter;
     iotxn_phys_iter_init(&iter, txn, AHCI_PRD_MAX_SIZE);
 
+    ahci_cl_t* cl = port->cl + slot;
+    ahci_prd_t* prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t)) + cl->prdtl;
+    size_t length;
+    zx_paddr_t paddr;
+    for (;;) {
+        length = iotxn_phys_iter_next(&iter, &paddr);
+        if (length == 0) {
+            return ZX_OK;
+        } else if ((length > AHCI_PRD_MAX_SIZE) || (cl->prdtl == AHCI_MAX_PRDS)) {
+            // chunks too large or too many for one command
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+
+        prd->dba = LO32(paddr);
+        prd->dbau = HI32(paddr);
+        prd->dbc = ((length - 1) & (AHCI_PRD_MAX_SIZE - 1)); // 0-based byte count
+        cl->prdtl += 1;
+        prd += 1;
+    }
+}
+
+// Whether |next| reads or writes the blocks right after those of |txn|.
+static bool ahci_txn_can_merge(iotxn_t* txn, iotxn_t* next) {
+    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+    sata_pdata_t* next_pdata = sata_iotxn_pdata(next);
+    if ((txn->flags | next->flags) & (IOTXN_SYNC_BEFORE | IOTXN_SYNC_AFTER)) {
+        return false;
+    }
+    if (cmd_is_write(pdata->cmd) != cmd_is_write(next_pdata->cmd) ||
+        cmd_is_read(pdata->cmd) != cmd_is_read(next_pdata->cmd) ||
+        pdata->device != next_pdata->device) {
+        return false;
+    }
+    return (pdata->lba + pdata->count == next_pdata->lba) &&
+           ((uint32_t)pdata->count + next_pdata->count < SATA_MAX_BLOCK_COUNT);
+}
+
+// Builds the command for |txn|, and any queued txns it can be merged with, in
+// |slot|. The caller starts it by setting the slot in sact and ci.
+static zx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot, iotxn_t* txn) {
+    assert(slot < AHCI_MAX_COMMANDS);
+    assert(!ahci_port_cmd_busy(port, slot));
+
+    sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+    zx_status_t status;
+
     if (dev->cap & AHCI_CAP_NCQ) {
         if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
             pdata->cmd = SATA_CMD_READ_FPDMA_QUEUED;
@@ -234,6 +291,31 @@ static zx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     cl->prdbc = 0;
     memset(port->ct[slot], 0, sizeof(ahci_ct_t));
 
+    cl->prdtl = 0;
+    if ((status = ahci_port_add_prds(port, slot, txn)) != ZX_OK) {
+        zxlogf(ERROR, "ahci.%d: error %d mapping txn %p\n", port->nr, status, txn);
+        iotxn_complete(txn, status, 0);
+        completion_signal(&dev->worker_completion);
+        return status;
+    }
+
+    // merge queued txns which carry on where this one ends into the same
+    // command; one which doesn't fit is left queued to be issued by itself
+    iotxn_t* next;
+    while ((next = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL) {
+        if (!ahci_txn_can_merge(txn, next)) {
+            break;
+        }
+        uint16_t prdtl = cl->prdtl;
+        if (ahci_port_add_prds(port, slot, next) != ZX_OK) {
+            cl->prdtl = prdtl;
+            break;
+        }
+        list_delete(&next->node);
+        list_add_tail(&port->merged[slot], &next->node);
+        pdata->count += sata_iotxn_pdata(next)->count;
+    }
+
     uint8_t* cfis = port->ct[slot]->cfis;
     cfis[0] = 0x27; // host-to-device
     cfis[1] = 0x80; // command
@@ -264,43 +346,13 @@ static zx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         cfis[13] = 0; // normal priority
     }
 
-    cl->prdtl = 0;
-    ahci_prd_t* prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
-    size_t length;
-    zx_paddr_t paddr;
-    for (;;) {
-        length = iotxn_phys_iter_next(&iter, &paddr);
-        if (length == 0) {
-            break;
-        } else if (length > AHCI_PRD_MAX_SIZE) {
-            zxlogf(ERROR, "ahci.%d: chunk size > %zu is unsupported\n", port->nr, length);
-            status = ZX_ERR_NOT_SUPPORTED;
-            iotxn_complete(txn, status, 0);
-            completion_signal(&dev->worker_completion);
-            return status;
-        } else if (cl->prdtl == AHCI_MAX_PRDS) {
-            zxlogf(ERROR, "ahci.%d: txn with more than %d chunks is unsupported\n",
-                    port->nr, cl->prdtl);
-            status = ZX_ERR_NOT_SUPPORTED;
-            iotxn_complete(txn, status, 0);
-            completion_signal(&dev->worker_completion);
-            return status;
-        }
-
-        prd->dba = LO32(paddr);
-        prd->dbau = HI32(paddr);
-        prd->dbc = ((length - 1) & (AHCI_PRD_MAX_SIZE - 1)); // 0-based byte count
-        cl->prdtl += 1;
-        prd += 1;
-    }
-
     port->running |= (1 << slot);
     port->commands[slot] = txn;
 
     zxlogf(SPEW, "ahci.%d: do_txn txn %p (%c) offset 0x%" PRIx64 " length 0x%" PRIx64
                   " slot %d prdtl %u\n",
             port->nr, txn, cl->w ? 'w' : 'r', txn->offset, txn->length, slot, cl->prdtl);
-    prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
+    ahci_prd_t* prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
     if (driver_get_log_flags() & DDK_LOG_SPEW) {
         for (uint i = 0; i < cl->prdtl; i++) {
             zxlogf(SPEW, "%04u: dbau=0x%08x dba=0x%08x dbc=0x%x\n",
@@ -309,12 +361,6 @@ static zx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         }
     }
 
-    // start command
-    if (cmd_is_queued(pdata->cmd)) {
-        ahci_write(&port->regs->sact, (1 << slot));
-    }
-    ahci_write(&port->regs->ci, (1 << slot));
-
     // set the watchdog
     // TODO: general timeout mechanism
     pdata->timeout = zx_clock_get(ZX_CLOCK_MONOTONIC) + ZX_SEC(1);
@@ -459,68 +505,81 @@ static int ahci_worker_thread(void* arg) {
         // iterate all the ports and run or complete commands
         for (int i = 0; i < AHCI_MAX_PORTS; i++) {
             port = &dev->ports[i];
+            list_node_t done = LIST_INITIAL_VALUE(done);
             mtx_lock(&port->lock);
             if (!(port->flags & (AHCI_PORT_FLAG_IMPLEMENTED | AHCI_PORT_FLAG_PRESENT))) {
                 goto next;
             }
 
-            // complete commands first
+            // collect every command which completed since the last pass, they
+            // are completed together once the port is unlocked
             while (port->completed) {
                 unsigned slot = 32 - __builtin_clz(port->completed) - 1;
-                txn = port->commands[slot];
-                if (txn == NULL) {
+                if (port->commands[slot] == NULL) {
                     zxlogf(ERROR, "ahci.%d: illegal state, completing slot %d but txn == NULL\n",
                             port->nr, slot);
-                } else {
-                    mtx_unlock(&port->lock);
-                    zxlogf(SPEW, "ahci.%d: complete txn %p\n", port->nr, txn);
-                    iotxn_complete(txn, ZX_OK, txn->length);
-                    mtx_lock(&port->lock);
                 }
+                ahci_port_take_slot(port, slot, &done);
                 port->completed &= ~(1 << slot);
-                port->running &= ~(1 << slot);
-                port->commands[slot] = NULL;
-                // resume the port if paused for sync and no outstanding transactions
-                if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
-                    port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
-                }
             }
-
-            if (port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) {
-                goto next;
+            // resume the port if paused for sync and no outstanding transactions
+            if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+                port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
             }
 
-            txn = list_peek_head_type(&port->txn_list, iotxn_t, node);
-            if (!txn) {
-                goto next;
-            }
+            // fill every free command slot the device takes, then start all
+            // the new commands with one write to sact and ci
+            uint32_t busy = ahci_read(&port->regs->sact) | ahci_read(&port->regs->ci) |
+                            port->running;
+            uint32_t sact = 0;
+            uint32_t ci = 0;
+            while (!(port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) &&
+                   ((txn = list_peek_head_type(&port->txn_list, iotxn_t, node)) != NULL)) {
+                // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
+                if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                    break;
+                }
 
-            // if IOTXN_SYNC_BEFORE, pause the port if there are transactions in flight
-            if ((txn->flags & IOTXN_SYNC_BEFORE) && port->running) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
-                goto next;
-            }
+                // find a free command tag
+                sata_pdata_t* pdata = sata_iotxn_pdata(txn);
+                int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
+                if (~busy == 0) {
+                    break;
+                }
+                int slot = __builtin_ctz(~busy);
+                if (slot > max) {
+                    break;
+                }
 
-            // find a free command tag
-            sata_pdata_t* pdata = sata_iotxn_pdata(txn);
-            int max = MIN(pdata->max_cmd, (int)((dev->cap >> 8) & 0x1f));
-            int i = 0;
-            for (i = 0; i <= max; i++) {
-                if (!ahci_port_cmd_busy(port, i)) break;
-            }
-            if (i > max) {
-                goto next;
+                list_delete(&txn->node);
+                // if IOTXN_SYNC_AFTER, pause the port until this command is complete
+                if (txn->flags & IOTXN_SYNC_AFTER) {
+                    port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+                }
+                // build the command
+                if (ahci_do_txn(dev, port, slot, txn) == ZX_OK) {
+                    if (cmd_is_queued(pdata->cmd)) {
+                        sact |= (1 << slot);
+                    }
+                    ci |= (1 << slot);
+                    busy |= (1 << slot);
+                }
             }
 
-            list_delete(&txn->node);
-            // if IOTXN_SYNC_AFTER, pause the port until this command is complete
-            if (txn->flags & IOTXN_SYNC_AFTER) {
-                port->flags |= AHCI_PORT_FLAG_SYNC_PAUSED;
+            // start the commands
+            if (sact) {
+                ahci_write(&port->regs->sact, sact);
+            }
+            if (ci) {
+                ahci_write(&port->regs->ci, ci);
             }
-            // run the command
-            ahci_do_txn(dev, port, i, txn);
 next:
             mtx_unlock(&port->lock);
+            while ((txn = list_remove_head_type(&done, iotxn_t, node)) != NULL) {
+                zxlogf(SPEW, "ahci.%d: complete txn %p\n", port->nr, txn);
+                iotxn_complete(txn, ZX_OK, txn->length);
+            }
         }
         // wait here until more commands are queued, or a port becomes idle
         completion_wait(&dev->worker_completion, ZX_TIME_INFINITE);
@@ -540,6 +599,7 @@ static int ahci_watchdog_thread(void* arg) {
                 continue;
             }
 
+            list_node_t timed_out = LIST_INITIAL_VALUE(timed_out);
             mtx_lock(&port->lock);
             uint32_t pending = port->running & ~port->completed;
             while (pending) {
@@ -553,16 +613,16 @@ static int ahci_watchdog_thread(void* arg) {
                     if (pdata->timeout < now) {
                         // time out
                         zxlogf(ERROR, "ahci: txn time out on port %d txn %p\n", port->nr, txn);
-                        port->running &= ~(1 << slot);
-                        port->commands[slot] = NULL;
-                        mtx_unlock(&port->lock);
-                        iotxn_complete(txn, ZX_ERR_TIMED_OUT, 0);
-                        mtx_lock(&port->lock);
+                        ahci_port_take_slot(port, slot, &timed_out);
                     }
                 }
                 pending &= ~(1 << slot);
             }
             mtx_unlock(&port->lock);
+            iotxn_t* txn;
+            while ((txn = list_remove_head_type(&timed_out, iotxn_t, node)) != NULL) {
+                iotxn_complete(txn, ZX_ERR_TIMED_OUT, 0);
+            }
         }
 
         // no need to run the watchdog if there are no active xfers
@@ -659,6 +719,9 @@ static int ahci_init_thread(void* arg) {
         port->flags = AHCI_PORT_FLAG_IMPLEMENTED;
         port->regs = &dev->regs->ports[i];
         list_initialize(&port->txn_list);
+        for (int j = 0; j < AHCI_MAX_COMMANDS; j++) {
+            list_initialize(&port->merged[j]);
+        }
 
         status = ahci_port_initialize(port);
         if (status) goto fail;
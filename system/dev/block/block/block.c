@@ -174,6 +174,27 @@ done:
     return status;
 }
 
+static zx_status_t blkdev_get_stats(blkdev_t* bdev, void* out_buf, size_t out_len,
+                                    size_t* out_actual) {
+    if (out_len < sizeof(block_stats_t)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    zx_status_t status;
+    mtx_lock(&bdev->lock);
+    if (bdev->bs == NULL) {
+        status = ZX_ERR_BAD_STATE;
+        goto done;
+    }
+
+    blockserver_get_stats(bdev->bs, out_buf);
+    *out_actual = sizeof(block_stats_t);
+    status = ZX_OK;
+done:
+    mtx_unlock(&bdev->lock);
+    return status;
+}
+
 static zx_status_t blkdev_fifo_close_locked(blkdev_t* bdev) {
     if (bdev->bs != NULL) {
         blockserver_shutdown(bdev->bs);
@@ -198,6 +219,8 @@ static zx_status_t blkdev_ioctl(void* ctx, uint32_t op, const void* cmd,
         return blkdev_alloc_txn(blkdev, cmd, cmdlen, reply, max, out_actual);
     case IOCTL_BLOCK_FREE_TXN:
         return blkdev_free_txn(blkdev, cmd, cmdlen);
+    case IOCTL_BLOCK_GET_STATS:
+        return blkdev_get_stats(blkdev, reply, max, out_actual);
     case IOCTL_BLOCK_FIFO_CLOSE: {
         mtx_lock(&blkdev->lock);
         zx_status_t status = blkdev_fifo_close_locked(blkdev);
@@ -10,6 +10,7 @@ MODULE_TYPE := driver
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/block.c \
+    $(LOCAL_DIR)/scheduler.cpp \
     $(LOCAL_DIR)/server.cpp \
 
 MODULE_STATIC_LIBS := \
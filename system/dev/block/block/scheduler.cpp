@@ -0,0 +1,157 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <ddk/iotxn.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/limits.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+
+#include "scheduler.h"
+
+namespace {
+
+// How many ops the deadline and fair schedulers let the driver hold; enough
+// to keep an NCQ disk busy, while leaving the rest to be ordered here.
+constexpr uint32_t kMaxInFlight = 32;
+
+// How soon after arriving reads and writes should be issued.
+constexpr zx_time_t kReadDeadline = ZX_MSEC(10);
+constexpr zx_time_t kWriteDeadline = ZX_MSEC(250);
+
+// Issues ops in the order they arrived, as soon as they arrive.
+class NoopScheduler : public BlockScheduler {
+public:
+    explicit NoopScheduler(uint64_t max_length) : BlockScheduler(max_length) {}
+
+private:
+    Client* Pick() final {
+        Client* pick = nullptr;
+        for (auto& client : active_) {
+            if (pick == nullptr || client.ops.front().seq < pick->ops.front().seq) {
+                pick = &client;
+            }
+        }
+        return pick;
+    }
+};
+
+// Issues the op due soonest first, where reads are due much sooner than
+// writes, so a read is not stuck behind another client's burst of writes.
+class DeadlineScheduler : public BlockScheduler {
+public:
+    explicit DeadlineScheduler(uint64_t max_length) : BlockScheduler(max_length) {}
+
+    uint32_t MaxInFlight() const final { return kMaxInFlight; }
+
+private:
+    zx_time_t Deadline(const BlockOp& op) const final {
+        return zx_clock_get(ZX_CLOCK_MONOTONIC) +
+               (op.opcode == BLOCKIO_READ ? kReadDeadline : kWriteDeadline);
+    }
+
+    Client* Pick() final {
+        Client* pick = nullptr;
+        for (auto& client : active_) {
+            const BlockOp& op = client.ops.front();
+            if (pick == nullptr || op.deadline < pick->ops.front().deadline ||
+                (op.deadline == pick->ops.front().deadline &&
+                 op.seq < pick->ops.front().seq)) {
+                pick = &client;
+            }
+        }
+        return pick;
+    }
+};
+
+// Takes one op from each client in turn.
+class FairScheduler : public BlockScheduler {
+public:
+    explicit FairScheduler(uint64_t max_length) : BlockScheduler(max_length) {}
+
+    uint32_t MaxInFlight() const final { return kMaxInFlight; }
+
+private:
+    Client* Pick() final {
+        if (active_.is_empty()) {
+            return nullptr;
+        }
+        Client* pick = active_.pop_front();
+        active_.push_back(pick);
+        return pick;
+    }
+};
+
+}  // namespace
+
+zx_status_t BlockScheduler::Create(const char* name, uint64_t max_length,
+                                   fbl::unique_ptr<BlockScheduler>* out) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<BlockScheduler> sched;
+    if (name == nullptr || !strcmp(name, "deadline")) {
+        sched.reset(new (&ac) DeadlineScheduler(max_length));
+    } else if (!strcmp(name, "noop")) {
+        sched.reset(new (&ac) NoopScheduler(max_length));
+    } else if (!strcmp(name, "fair")) {
+        sched.reset(new (&ac) FairScheduler(max_length));
+    } else {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    *out = fbl::move(sched);
+    return ZX_OK;
+}
+
+BlockScheduler::BlockScheduler(uint64_t max_length)
+    : max_length_(max_length != 0 ?
+                  fbl::min(max_length, static_cast<uint64_t>(fbl::numeric_limits<uint32_t>::max())) :
+                  fbl::numeric_limits<uint32_t>::max()),
+      seq_(0), queued_(0) {}
+
+void BlockScheduler::Push(fbl::unique_ptr<BlockOp> op) {
+    ZX_DEBUG_ASSERT(op->txnid < MAX_TXN_COUNT);
+    Client* client = &clients_[op->txnid];
+    op->seq = seq_++;
+    queued_++;
+    op->deadline = Deadline(*op);
+    if (client->ops.is_empty()) {
+        active_.push_back(client);
+    }
+    client->ops.push_back(fbl::move(op));
+}
+
+bool BlockScheduler::CanMerge(const BlockOp& op, const BlockOp& next) const {
+    // A client only has one txn outstanding per txnid, so its queued ops are
+    // never split by a barrier; checking the flags just keeps it that way.
+    return (op.vmo == next.vmo) && (op.opcode == next.opcode) &&
+           !(op.flags & IOTXN_SYNC_AFTER) && !(next.flags & IOTXN_SYNC_BEFORE) &&
+           (op.dev_offset + op.length == next.dev_offset) &&
+           (op.vmo_offset + op.length == next.vmo_offset) &&
+           (op.length + next.length <= max_length_);
+}
+
+fbl::unique_ptr<BlockOp> BlockScheduler::Pop() {
+    Client* client = Pick();
+    if (client == nullptr) {
+        return nullptr;
+    }
+    fbl::unique_ptr<BlockOp> op = client->ops.pop_front();
+    queued_--;
+    while (!client->ops.is_empty() && CanMerge(*op, client->ops.front())) {
+        fbl::unique_ptr<BlockOp> next = client->ops.pop_front();
+        queued_--;
+        op->length += next->length;
+        op->flags |= next->flags & IOTXN_SYNC_AFTER;
+        op->merged.push_back(fbl::move(next));
+    }
+    if (client->ops.is_empty()) {
+        active_.erase(*client);
+    }
+    return op;
+}
@@ -0,0 +1,68 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <zircon/device/block.h>
+#include <zircon/types.h>
+
+#include <fbl/intrusive_double_list.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+
+#include "server.h"
+
+// Decides the order in which the ops of a block server reach its driver.
+//
+// Each txnid is a client, whose ops are kept in the order they arrived; the
+// policy only chooses between clients. Contiguous ops of a client on the same
+// vmo are merged into one as they are taken.
+class BlockScheduler {
+public:
+    // Creates the scheduler named by |name| ("noop", "deadline" or "fair"),
+    // or the default one if |name| is null. Merged ops are kept to at most
+    // |max_length| blocks, if it is not zero.
+    static zx_status_t Create(const char* name, uint64_t max_length,
+                              fbl::unique_ptr<BlockScheduler>* out);
+    virtual ~BlockScheduler() {}
+
+    void Push(fbl::unique_ptr<BlockOp> op);
+
+    // Removes the next op to issue, with any merged into it, or returns
+    // nullptr if there are none.
+    fbl::unique_ptr<BlockOp> Pop();
+
+    // How many ops are queued.
+    uint32_t Queued() const { return queued_; }
+
+    // The most ops to keep in flight at the driver, or zero for no limit.
+    // Ops held back past this are the ones the policy can reorder.
+    virtual uint32_t MaxInFlight() const { return 0; }
+
+protected:
+    struct Client : public fbl::DoublyLinkedListable<Client*> {
+        fbl::DoublyLinkedList<fbl::unique_ptr<BlockOp>> ops;
+    };
+
+    explicit BlockScheduler(uint64_t max_length);
+
+    // The time by which |op| should be issued.
+    virtual zx_time_t Deadline(const BlockOp& op) const { return 0; }
+
+    // Chooses which of |active_| to take the next op from.
+    virtual Client* Pick() = 0;
+
+    // Clients with ops queued.
+    fbl::DoublyLinkedList<Client*> active_;
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(BlockScheduler);
+
+    bool CanMerge(const BlockOp& op, const BlockOp& next) const;
+
+    const uint64_t max_length_;
+    uint64_t seq_;
+    uint32_t queued_;
+    Client clients_[MAX_TXN_COUNT];
+};
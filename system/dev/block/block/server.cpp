@@ -5,6 +5,7 @@
 #include <unistd.h>
 
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <ddk/device.h>
@@ -19,6 +20,7 @@
 #include <zircon/syscalls.h>
 #include <zx/fifo.h>
 
+#include "scheduler.h"
 #include "server.h"
 
 // This signal is set on the FIFO when the server should be instructed
@@ -49,7 +51,7 @@ void BlockComplete(void* cookie, zx_status_t status) {
     block_msg_t* msg = static_cast<block_msg_t*>(cookie);
     // Since iobuf is a RefPtr, it lives at least as long as the txn,
     // and is not discarded underneath the block device driver.
-    ZX_DEBUG_ASSERT(msg->iobuf != nullptr);
+    ZX_DEBUG_ASSERT(msg->iobuf != nullptr || msg->opcode == BLOCKIO_TRIM);
     ZX_DEBUG_ASSERT(msg->txn != nullptr);
     // Hold an extra copy of the 'blktxn' refptr; if we don't, and 'msg->txn' is
     // the last copy, then when we nullify 'msg->txn' in Complete we end up
@@ -60,49 +62,164 @@ void BlockComplete(void* cookie, zx_status_t status) {
     blktxn->Complete(msg, status);
 }
 
+// Completes the msg of |op| and of each op merged into it.
+void BlockOpFinish(fbl::unique_ptr<BlockOp> op, zx_status_t status) {
+    while (!op->merged.is_empty()) {
+        BlockComplete(op->merged.pop_front()->msg, status);
+    }
+    BlockComplete(op->msg, status);
+}
+
+void BlockOpComplete(void* cookie, zx_status_t status) {
+    fbl::unique_ptr<BlockOp> op(static_cast<BlockOp*>(cookie));
+    BlockServer* server = op->server;
+    BlockOpFinish(fbl::move(op), status);
+    server->OpDone();
+}
+
 void BlockCompleteIotxn(iotxn_t* txn, void* cookie) {
-    BlockComplete(cookie, txn->status);
+    BlockOpComplete(cookie, txn->status);
     iotxn_release(txn);
 }
 
 void BlockCompleteCb(block_op_t* bop, zx_status_t status) {
-    BlockComplete(bop->cookie, status);
+    BlockOpComplete(bop->cookie, status);
     free(bop);
 }
 
+void RecordLatency(block_op_stats_t* stats, const block_msg_t* msg, zx_time_t now) {
+    const uint64_t latency = now - msg->start;
+    stats->count++;
+    stats->blocks += msg->blocks;
+    stats->total_ns += latency;
+    stats->queue_ns += msg->queue_ns;
+    size_t bucket = 0;
+    for (uint64_t us = latency / 1000; (us > 1) && (bucket < BLOCK_STATS_BUCKETS - 1); us >>= 1) {
+        bucket++;
+    }
+    stats->latency[bucket]++;
+}
+
 }  // namespace
 
-void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
-                        uint64_t vmo_offset, uint64_t dev_offset, block_msg_t* msg) {
+void BlockServer::Push(txnid_t txnid, uint32_t flags, zx_handle_t vmo, uint64_t length,
+                       uint64_t vmo_offset, uint64_t dev_offset, block_msg_t* msg) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<BlockOp> op(new (&ac) BlockOp());
+    if (!ac.check()) {
+        BlockComplete(msg, ZX_ERR_NO_MEMORY);
+        return;
+    }
+    op->server = this;
+    op->msg = msg;
+    op->txnid = txnid;
+    op->vmo = vmo;
+    op->opcode = msg->opcode;
+    op->flags = flags;
+    op->length = length;
+    op->vmo_offset = vmo_offset;
+    op->dev_offset = dev_offset;
+
+    fbl::AutoLock lock(&sched_lock_);
+    sched_->Push(fbl::move(op));
+}
+
+void BlockServer::Dispatch() {
+    bool idle = false;
+    for (;;) {
+        fbl::unique_ptr<BlockOp> op;
+        {
+            fbl::AutoLock lock(&sched_lock_);
+            ZX_DEBUG_ASSERT(dispatching_);
+            uint32_t max = sched_->MaxInFlight();
+            if (!shutdown_ && (max == 0 || in_flight_ < max)) {
+                op = sched_->Pop();
+            }
+            if (op == nullptr) {
+                dispatching_ = false;
+                idle = shutdown_ && (in_flight_ == 0);
+                break;
+            }
+            in_flight_++;
+            max_in_flight_ = fbl::max(max_in_flight_, in_flight_);
+        }
+        const zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        op->msg->queue_ns = fbl::max(op->msg->queue_ns, now - op->msg->start);
+        for (auto& merged : op->merged) {
+            merged.msg->queue_ns = fbl::max(merged.msg->queue_ns, now - merged.msg->start);
+        }
+        // The driver may complete |op| before this returns, in which case
+        // OpDone leaves the next one to this loop.
+        Queue(fbl::move(op));
+    }
+    if (idle) {
+        completion_signal(&idle_);
+    }
+}
+
+void BlockServer::OpDone() {
+    bool dispatch = false;
+    bool idle = false;
+    {
+        fbl::AutoLock lock(&sched_lock_);
+        ZX_DEBUG_ASSERT(in_flight_ > 0);
+        in_flight_--;
+        if (shutdown_) {
+            idle = (in_flight_ == 0) && !dispatching_;
+        } else if (!dispatching_) {
+            dispatching_ = true;
+            dispatch = true;
+        }
+    }
+    // Once idle, the server may be destroyed as soon as it is signalled.
+    if (idle) {
+        completion_signal(&idle_);
+    } else if (dispatch) {
+        Dispatch();
+    }
+}
+
+void BlockServer::Queue(fbl::unique_ptr<BlockOp> op) {
     if (bp_.ops == NULL) {
+        if (op->opcode == BLOCKIO_TRIM) {
+            // Iotxn devices have no way to express a trim.
+            BlockOpComplete(op.release(), ZX_ERR_NOT_SUPPORTED);
+            return;
+        }
         size_t bsz = info_.block_size;
         iotxn_t* txn;
         zx_status_t status;
-        if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, vmo,
-                                      vmo_offset * bsz, length * bsz)) != ZX_OK) {
-            BlockComplete(msg, status);
+        if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, op->vmo,
+                                      op->vmo_offset * bsz, op->length * bsz)) != ZX_OK) {
+            BlockOpComplete(op.release(), status);
             return;
         }
-        txn->flags = flags;
-        txn->opcode = msg->opcode;
-        txn->offset = dev_offset * bsz;
-        txn->cookie = msg;
+        txn->flags = op->flags;
+        txn->opcode = op->opcode;
+        txn->offset = op->dev_offset * bsz;
+        txn->cookie = op.release();
         txn->complete_cb = BlockCompleteIotxn;
         iotxn_queue(dev_, txn);
     } else {
         block_op_t* bop = (block_op_t*) malloc(block_op_size_);
         if (bop == nullptr) {
-            BlockComplete(msg, ZX_ERR_NO_MEMORY);
+            BlockOpComplete(op.release(), ZX_ERR_NO_MEMORY);
             return;
         }
-        bop->command = (msg->opcode == BLOCKIO_READ) ? BLOCK_OP_READ : BLOCK_OP_WRITE;
-        bop->rw.length = (uint32_t) length;
-        bop->rw.vmo = vmo;
-        bop->rw.offset_dev = dev_offset;
-        bop->rw.offset_vmo = vmo_offset;
-        bop->rw.pages = NULL;
+        if (op->opcode == BLOCKIO_TRIM) {
+            bop->command = BLOCK_OP_TRIM;
+            bop->trim.length = (uint32_t) op->length;
+            bop->trim.offset_dev = op->dev_offset;
+        } else {
+            bop->command = (op->opcode == BLOCKIO_READ) ? BLOCK_OP_READ : BLOCK_OP_WRITE;
+            bop->rw.length = (uint32_t) op->length;
+            bop->rw.vmo = op->vmo;
+            bop->rw.offset_dev = op->dev_offset;
+            bop->rw.offset_vmo = op->vmo_offset;
+            bop->rw.pages = NULL;
+        }
         bop->completion_cb = BlockCompleteCb;
-        bop->cookie = msg;
+        bop->cookie = op.release();
         bp_.ops->queue(bp_.ctx, bop);
     }
 }
@@ -110,6 +227,8 @@ void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
 BlockTransaction::BlockTransaction(zx_handle_t fifo, txnid_t txnid) :
     fifo_(fifo), flags_(0), ctr_(0) {
     memset(&response_, 0, sizeof(response_));
+    memset(&read_stats_, 0, sizeof(read_stats_));
+    memset(&write_stats_, 0, sizeof(write_stats_));
     response_.txnid = txnid;
 }
 
@@ -200,6 +319,10 @@ void BlockTransaction::Complete(block_msg_t* msg, zx_status_t status) {
         return;
     }
 
+    if (msg->opcode != BLOCKIO_TRIM) {
+        RecordLatency(msg->opcode == BLOCKIO_READ ? &read_stats_ : &write_stats_, msg,
+                      zx_clock_get(ZX_CLOCK_MONOTONIC));
+    }
     response_.count++;
     ZX_DEBUG_ASSERT(ctr_ != 0);
     ZX_DEBUG_ASSERT(response_.count <= ctr_);
@@ -211,6 +334,14 @@ void BlockTransaction::Complete(block_msg_t* msg, zx_status_t status) {
     msg->iobuf.reset();
 }
 
+void BlockTransaction::GetStats(block_client_stats_t* out) {
+    fbl::AutoLock lock(&lock_);
+    out->txnid = response_.txnid;
+    out->in_flight = ctr_ - response_.count;
+    out->read = read_stats_;
+    out->write = write_stats_;
+}
+
 IoBuffer::IoBuffer(zx::vmo vmo, vmoid_t id) : io_vmo_(fbl::move(vmo)), vmoid_(id) {}
 
 IoBuffer::~IoBuffer() {}
@@ -309,6 +440,26 @@ void BlockServer::FreeTxn(txnid_t txnid) {
     txns_[txnid] = nullptr;
 }
 
+void BlockServer::GetStats(block_stats_t* out) {
+    memset(out, 0, sizeof(*out));
+    {
+        fbl::AutoLock server_lock(&server_lock_);
+        for (size_t i = 0; i < fbl::count_of(txns_); i++) {
+            if (txns_[i] == nullptr) {
+                continue;
+            }
+            if (out->client_count < BLOCK_STATS_MAX_CLIENTS) {
+                txns_[i]->GetStats(&out->clients[out->client_count]);
+            }
+            out->client_count++;
+        }
+    }
+    fbl::AutoLock lock(&sched_lock_);
+    out->in_flight = in_flight_;
+    out->max_in_flight = max_in_flight_;
+    out->queued = sched_->Queued();
+}
+
 zx_status_t BlockServer::Create(zx_device_t* dev, block_protocol_t* bp,
                                 zx::fifo* fifo_out, BlockServer** out) {
     fbl::AllocChecker ac;
@@ -328,6 +479,14 @@ zx_status_t BlockServer::Create(zx_device_t* dev, block_protocol_t* bp,
         bp->ops->query(bp->ctx, &bs->info_, &bs->block_op_size_);
     }
 
+    const uint64_t max_xfer = (bs->info_.block_size != 0) ?
+                              bs->info_.max_transfer_size / bs->info_.block_size : 0;
+    if ((status = BlockScheduler::Create(getenv("driver.block.scheduler"), max_xfer,
+                                         &bs->sched_)) != ZX_OK) {
+        delete bs;
+        return status;
+    }
+
     *out = bs;
     return ZX_OK;
 }
@@ -340,6 +499,7 @@ zx_status_t BlockServer::Serve() {
         if ((status = Read(requests, &count) != ZX_OK)) {
             return status;
         }
+        const zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
 
         for (size_t i = 0; i < count; i++) {
             bool wants_reply = requests[i].opcode & BLOCKIO_TXN_END;
@@ -355,14 +515,16 @@ zx_status_t BlockServer::Serve() {
                 continue;
             }
 
+            // Trims carry no data, so they need no vmo.
+            const uint16_t opcode = requests[i].opcode & BLOCKIO_OP_MASK;
             auto iobuf = tree_.find(vmoid);
-            if (!iobuf.IsValid()) {
+            if (!iobuf.IsValid() && opcode != BLOCKIO_TRIM) {
                 // Operation which is not accessing a valid vmo
                 txns_[txnid]->SetResponse(ZX_ERR_IO, wants_reply);
                 continue;
             }
 
-            switch (requests[i].opcode & BLOCKIO_OP_MASK) {
+            switch (opcode) {
             case BLOCKIO_READ:
             case BLOCKIO_WRITE: {
                 if ((requests[i].length < 1) ||
@@ -381,6 +543,10 @@ zx_status_t BlockServer::Serve() {
                 msg->txn = txns_[txnid];
                 ZX_DEBUG_ASSERT(msg->iobuf == nullptr);
                 msg->iobuf = iobuf.CopyPointer();
+                msg->opcode = opcode;
+                msg->blocks = requests[i].length;
+                msg->start = now;
+                msg->queue_ns = 0;
 
                 // Hack to ensure that the vmo is valid.
                 // In the future, this code will be responsible for pinning VMO pages,
@@ -393,8 +559,6 @@ zx_status_t BlockServer::Serve() {
                     break;
                 }
 
-                msg->opcode = requests[i].opcode & BLOCKIO_OP_MASK;
-
                 const uint64_t max_xfer = info_.max_transfer_size / bsz;
                 if (max_xfer != 0 && max_xfer < requests[i].length) {
                     uint64_t len_remaining = requests[i].length;
@@ -412,19 +576,49 @@ zx_status_t BlockServer::Serve() {
                         flags &= ~(i == sub_txns - 1 ? 0 : IOTXN_SYNC_AFTER);
                         // Only allow IOTXN_SYNC_BEFORE to be set on the first sub-txn.
                         flags &= ~(i == 0 ? 0 : IOTXN_SYNC_BEFORE);
-                        Queue(flags, iobuf->vmo(), length,
-                              vmo_offset, dev_offset, msg);
+                        Push(txnid, flags, iobuf->vmo(), length,
+                             vmo_offset, dev_offset, msg);
                         vmo_offset += length;
                         dev_offset += length;
                     }
                     ZX_DEBUG_ASSERT(len_remaining == 0);
                 } else {
-                    Queue(msg->flags, iobuf->vmo(), requests[i].length,
-                          requests[i].vmo_offset, requests[i].dev_offset, msg);
+                    Push(txnid, msg->flags, iobuf->vmo(), requests[i].length,
+                         requests[i].vmo_offset, requests[i].dev_offset, msg);
                 }
 
                 break;
             }
+            case BLOCKIO_TRIM: {
+                if ((requests[i].length < 1) ||
+                    (requests[i].length > fbl::numeric_limits<uint32_t>::max())) {
+                    txns_[txnid]->SetResponse(ZX_ERR_INVALID_ARGS, wants_reply);
+                    continue;
+                }
+                if (!(info_.flags & BLOCK_FLAG_TRIM_SUPPORT)) {
+                    txns_[txnid]->SetResponse(ZX_ERR_NOT_SUPPORTED, wants_reply);
+                    continue;
+                }
+
+                block_msg_t* msg;
+                status = txns_[txnid]->Enqueue(wants_reply, &msg);
+                if (status != ZX_OK) {
+                    break;
+                }
+                ZX_DEBUG_ASSERT(msg->txn == nullptr);
+                msg->txn = txns_[txnid];
+                msg->opcode = opcode;
+                msg->blocks = requests[i].length;
+                msg->start = now;
+                msg->queue_ns = 0;
+
+                // Trims are not bounded by the transfer size.  With no vmo, the
+                // device offset stands in for the vmo offset, so the scheduler
+                // merges trims of adjacent ranges into one.
+                Push(txnid, msg->flags, ZX_HANDLE_INVALID, requests[i].length,
+                     requests[i].dev_offset, requests[i].dev_offset, msg);
+                break;
+            }
             case BLOCKIO_SYNC: {
                 // TODO(smklein): It might be more useful to have this on a per-vmo basis
                 fprintf(stderr, "Warning: BLOCKIO_SYNC is currently unimplemented\n");
@@ -443,17 +637,50 @@ zx_status_t BlockServer::Serve() {
             }
             }
         }
+
+        // Everything read from the fifo is queued, so the scheduler can
+        // order and merge it as a whole.
+        bool dispatch = false;
+        {
+            fbl::AutoLock lock(&sched_lock_);
+            if (!dispatching_) {
+                dispatching_ = true;
+                dispatch = true;
+            }
+        }
+        if (dispatch) {
+            Dispatch();
+        }
     }
 }
 
 BlockServer::BlockServer(zx_device_t* dev, block_protocol_t* bp) :
-    dev_(dev), bp_(*bp), block_op_size_(0), last_id_(VMOID_INVALID + 1) {
+    dev_(dev), bp_(*bp), block_op_size_(0), last_id_(VMOID_INVALID + 1), in_flight_(0),
+    max_in_flight_(0), dispatching_(false), shutdown_(false), idle_{} {
     size_t actual;
     device_ioctl(dev_, IOCTL_BLOCK_GET_INFO, nullptr, 0, &info_, sizeof(info_), &actual);
 }
 
 BlockServer::~BlockServer() {
     ShutDown();
+
+    // Ops still queued are failed, and those in flight waited for, since
+    // they complete through this server.
+    bool wait;
+    {
+        fbl::AutoLock lock(&sched_lock_);
+        shutdown_ = true;
+        if (sched_ != nullptr) {
+            fbl::unique_ptr<BlockOp> op;
+            while ((op = sched_->Pop()) != nullptr) {
+                BlockOpFinish(fbl::move(op), ZX_ERR_BAD_STATE);
+            }
+        }
+        wait = (in_flight_ != 0) || dispatching_;
+    }
+    if (wait) {
+        completion_wait(&idle_, ZX_TIME_INFINITE);
+    }
 }
 
 void BlockServer::ShutDown() {
@@ -489,3 +716,6 @@ zx_status_t blockserver_allocate_txn(BlockServer* bs, txnid_t* out) {
 void blockserver_free_txn(BlockServer* bs, txnid_t txnid) {
     return bs->FreeTxn(txnid);
 }
+void blockserver_get_stats(BlockServer* bs, block_stats_t* out) {
+    bs->GetStats(out);
+}
@@ -17,11 +17,13 @@
 
 #include <zx/fifo.h>
 #include <zx/vmo.h>
+#include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/mutex.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
+#include <sync/completion.h>
 
 // Represents the mapping of "vmoid --> VMO"
 class IoBuffer : public fbl::WAVLTreeContainable<fbl::RefPtr<IoBuffer>>,
@@ -58,8 +60,34 @@ typedef struct {
     uint32_t opcode;
     uint32_t flags;
     uint32_t sub_txns;
+    uint64_t blocks;
+    zx_time_t start;    // When the server read the request
+    zx_time_t queue_ns; // The longest any of its ops waited to be issued
 } block_msg_t;
 
+class BlockServer;
+
+// A read or write the server has validated, on its way to the driver.
+// The units of length, vmo_offset, and dev_offset are 'blocks'.
+struct BlockOp : public fbl::DoublyLinkedListable<fbl::unique_ptr<BlockOp>> {
+    BlockServer* server;
+    block_msg_t* msg;
+    txnid_t txnid;
+    zx_handle_t vmo;
+    uint32_t opcode;
+    uint32_t flags;
+    uint64_t length;
+    uint64_t vmo_offset;
+    uint64_t dev_offset;
+    // Set by the scheduler once queued.
+    uint64_t seq;
+    zx_time_t deadline;
+    // Ops issued as part of this one, each completing its own msg.
+    fbl::DoublyLinkedList<fbl::unique_ptr<BlockOp>> merged;
+};
+
+class BlockScheduler;
+
 class BlockTransaction : public fbl::RefCounted<BlockTransaction> {
 public:
     BlockTransaction(zx_handle_t fifo, txnid_t txnid);
@@ -84,6 +112,8 @@ public:
     // Called once the transaction has completed successfully.
     // This function may respond on the fifo, resetting |response_|.
     void Complete(block_msg_t* msg, zx_status_t status);
+
+    void GetStats(block_client_stats_t* out);
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockTransaction);
 
@@ -97,6 +127,8 @@ private:
     block_fifo_response_t response_ TA_GUARDED(lock_); // The response to be sent back to the client
     uint32_t flags_ TA_GUARDED(lock_);
     uint32_t ctr_ TA_GUARDED(lock_); // How many ops does the block device need to complete?
+    block_op_stats_t read_stats_ TA_GUARDED(lock_);
+    block_op_stats_t write_stats_ TA_GUARDED(lock_);
 };
 
 class BlockServer {
@@ -109,10 +141,14 @@ public:
     zx_status_t AttachVmo(zx::vmo vmo, vmoid_t* out);
     zx_status_t AllocateTxn(txnid_t* out);
     void FreeTxn(txnid_t txnid);
+    void GetStats(block_stats_t* out);
 
     void ShutDown();
 
     ~BlockServer();
+
+    // Called as each op issued to the driver completes.
+    void OpDone();
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockServer);
     BlockServer(zx_device_t* dev, block_protocol_t* bp);
@@ -120,9 +156,17 @@ private:
     zx_status_t Read(block_fifo_request_t* requests, uint32_t* count);
     zx_status_t FindVmoIDLocked(vmoid_t* out) TA_REQ(server_lock_);
 
-    // The units of length, vmo_offset, and dev_offset are 'blocks'.
-    void Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
-               uint64_t vmo_offset, uint64_t dev_offset, block_msg_t* msg);
+    // Hands an op to the scheduler. The units of length, vmo_offset, and
+    // dev_offset are 'blocks'.
+    void Push(txnid_t txnid, uint32_t flags, zx_handle_t vmo, uint64_t length,
+              uint64_t vmo_offset, uint64_t dev_offset, block_msg_t* msg);
+
+    // Issues ops from the scheduler while it allows more in flight. Only one
+    // thread dispatches at a time; it must have set |dispatching_|.
+    void Dispatch();
+
+    // Queues |op| to the driver.
+    void Queue(fbl::unique_ptr<BlockOp> op);
 
     zx::fifo fifo_;
     zx_device_t* dev_;
@@ -134,6 +178,15 @@ private:
     fbl::WAVLTree<vmoid_t, fbl::RefPtr<IoBuffer>> tree_ TA_GUARDED(server_lock_);
     fbl::RefPtr<BlockTransaction> txns_[MAX_TXN_COUNT] TA_GUARDED(server_lock_);
     vmoid_t last_id_ TA_GUARDED(server_lock_);
+
+    fbl::Mutex sched_lock_;
+    fbl::unique_ptr<BlockScheduler> sched_ TA_GUARDED(sched_lock_);
+    uint32_t in_flight_ TA_GUARDED(sched_lock_);
+    uint32_t max_in_flight_ TA_GUARDED(sched_lock_);
+    bool dispatching_ TA_GUARDED(sched_lock_);
+    bool shutdown_ TA_GUARDED(sched_lock_);
+    // Signalled once |shutdown_| is set and nothing is in flight.
+    completion_t idle_;
 };
 
 #else
@@ -164,4 +217,7 @@ zx_status_t blockserver_attach_vmo(BlockServer* bs, zx_handle_t vmo, vmoid_t* ou
 zx_status_t blockserver_allocate_txn(BlockServer* bs, txnid_t* out);
 void blockserver_free_txn(BlockServer* bs, txnid_t txnid);
 
+// Read the statistics of the Block Server
+void blockserver_get_stats(BlockServer* bs, block_stats_t* out);
+
 __END_CDECLS
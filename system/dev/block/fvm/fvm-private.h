@@ -16,10 +16,13 @@
 
 #ifdef __cplusplus
 
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
 #include <ddktl/device.h>
 #include <ddktl/protocol/block.h>
 #include <fs/mapped-vmo.h>
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/mutex.h>
 #include <fbl/unique_ptr.h>
@@ -89,6 +92,21 @@ private:
     const size_t vslice_start_;
 };
 
+// A txn split into sub-ops across noncontiguous slices. The sub-ops follow
+// it in memory, so a split needs no allocations of its own.
+struct SplitTxn {
+    VPartition* vp;
+    SplitTxn* next;
+    block_op_t* original;
+    fbl::atomic<uint32_t> remaining;
+    fbl::atomic<zx_status_t> status;
+
+    block_op_t* SubOp(size_t op_stride, size_t i) {
+        return reinterpret_cast<block_op_t*>(reinterpret_cast<uintptr_t>(this + 1) +
+                                             op_stride * i);
+    }
+};
+
 class VPartitionManager : public ManagerDeviceType {
 public:
     static zx_status_t Create(zx_device_t* dev, fbl::unique_ptr<VPartitionManager>* out);
@@ -169,6 +187,16 @@ private:
     zx_status_t FindFreeVPartEntryLocked(size_t* out) const TA_REQ(lock_);
     zx_status_t FindFreeSliceLocked(size_t* out, size_t hint) const TA_REQ(lock_);
 
+    // Update both the slice allocation table and |allocated_slices_|.
+    void SliceMarkAllocatedLocked(size_t pslice, size_t vpart, size_t vslice) TA_REQ(lock_);
+    void SliceMarkFreeLocked(size_t pslice) TA_REQ(lock_);
+
+    // Discards the contents of freed |pslices| on devices which support it,
+    // one trim per contiguous run. Must be called before the slices can be
+    // allocated again; failures are ignored, since the slices are already free.
+    void TrimSlicesLocked(const fbl::Vector<uint32_t>& pslices) TA_REQ(lock_);
+    zx_status_t TrimLocked(uint64_t pslice, uint64_t count) TA_REQ(lock_);
+
     fvm_t* GetFvmLocked() const TA_REQ(lock_) {
         return reinterpret_cast<fvm_t*>(metadata_->GetData());
     }
@@ -198,6 +226,9 @@ private:
     fbl::Mutex lock_;
     fbl::unique_ptr<MappedVmo> metadata_ TA_GUARDED(lock_);
     bool first_metadata_is_primary_ TA_GUARDED(lock_);
+    // One bit per pslice, set if the slice is allocated; mirrors the slice
+    // allocation table so free slices are found a word at a time.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> allocated_slices_ TA_GUARDED(lock_);
     size_t metadata_size_;
     size_t slice_size_;
 
@@ -263,6 +294,12 @@ public:
     void KillLocked() TA_REQ(lock_) { entry_index_ = 0; }
     bool IsKilledLocked() TA_REQ(lock_) { return entry_index_ == 0; }
 
+    // The most slices a single block op may span.
+    static constexpr size_t kMaxSlices = 32;
+
+    // Returns |split|, whose sub-ops have all completed, to the pool.
+    void SplitTxnPut(SplitTxn* split);
+
     VPartition(VPartitionManager* vpm, size_t entry_index, size_t block_op_size);
     ~VPartition();
     fbl::Mutex lock_;
@@ -270,6 +307,12 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(VPartition);
 
+    // Takes a SplitTxn with room for kMaxSlices sub-ops from the pool,
+    // allocating one only if the pool is empty.
+    SplitTxn* SplitTxnGet();
+    SplitTxn* SplitTxnAlloc();
+    size_t SplitOpStride() const { return fbl::round_up(mgr_->BlockOpSize(), 16ul); }
+
     zx_device_t* GetParent() const { return mgr_->parent(); }
 
     VPartitionManager* mgr_;
@@ -280,7 +323,26 @@ private:
     // indicates that the vpartition is completely unmapped, and uses no
     // physical slices.
     fbl::WAVLTree<size_t, fbl::unique_ptr<SliceExtent>> slice_map_ TA_GUARDED(lock_);
+
+    // Direct-mapped cache of slice_map_, indexed by vslice, so translating
+    // the slices of an IO rarely walks the tree. A pslice of zero marks an
+    // empty entry.
+    struct SliceCacheEntry {
+        size_t vslice;
+        uint32_t pslice;
+    };
+    static constexpr size_t kSliceCacheSize = 64;
+    void SliceCacheInvalidateLocked(size_t vslice_start, size_t vslice_end) TA_REQ(lock_);
+    mutable SliceCacheEntry slice_cache_[kSliceCacheSize] TA_GUARDED(lock_);
+
     block_info_t info_ TA_GUARDED(lock_);
+
+    // Enough splits for the common number in flight; more are allocated
+    // on demand and freed when they complete.
+    static constexpr size_t kSplitPoolSize = 4;
+    fbl::Mutex split_lock_;
+    SplitTxn* split_pool_ TA_GUARDED(split_lock_);
+    size_t split_pool_count_ TA_GUARDED(split_lock_);
 };
 
 } // namespace fvm
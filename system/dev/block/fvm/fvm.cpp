@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
@@ -12,10 +13,12 @@
 #include <zircon/device/block.h>
 #include <zircon/syscalls.h>
 #include <zircon/thread_annotations.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
 #include <fbl/limits.h>
 #include <fbl/new.h>
+#include <sync/completion.h>
 #include <threads.h>
 
 #include "fvm-private.h"
@@ -224,6 +227,14 @@ zx_status_t VPartitionManager::Load() {
         metadata_ = fbl::move(mvmo_backup);
     }
 
+    // Slice zero is reserved; the rest are marked below as they are found.
+    const size_t slice_count = UsableSlicesCount(DiskSize(), SliceSize());
+    if ((status = allocated_slices_.Reset(slice_count + 1)) != ZX_OK) {
+        fprintf(stderr, "fvm: Failed to create slice bitmap: %d\n", status);
+        return status;
+    }
+    allocated_slices_.Set(0, 1);
+
     // Begin initializing the underlying partitions
     DdkMakeVisible();
     auto_detach.cancel();
@@ -249,6 +260,9 @@ zx_status_t VPartitionManager::Load() {
         if (entry->vpart == FVM_SLICE_FREE) {
             continue;
         }
+        if (i <= slice_count) {
+            allocated_slices_.Set(i, i + 1);
+        }
         if (vpartitions[entry->vpart] == nullptr) {
             continue;
         }
@@ -322,21 +336,108 @@ zx_status_t VPartitionManager::FindFreeVPartEntryLocked(size_t* out) const {
 zx_status_t VPartitionManager::FindFreeSliceLocked(size_t* out, size_t hint) const {
     const size_t maxSlices = UsableSlicesCount(DiskSize(), SliceSize());
     hint = fbl::max(hint, 1lu);
-    for (size_t i = hint; i <= maxSlices; i++) {
-        if (GetSliceEntryLocked(i)->vpart == 0) {
-            *out = i;
-            return ZX_OK;
-        }
+    if (hint <= maxSlices &&
+        allocated_slices_.Find(false, hint, maxSlices + 1, 1, out) == ZX_OK) {
+        return ZX_OK;
     }
-    for (size_t i = 1; i < hint; i++) {
-        if (GetSliceEntryLocked(i)->vpart == 0) {
-            *out = i;
-            return ZX_OK;
-        }
+    if (hint > 1 && allocated_slices_.Find(false, 1, fbl::min(hint, maxSlices + 1), 1,
+                                           out) == ZX_OK) {
+        return ZX_OK;
     }
     return ZX_ERR_NO_SPACE;
 }
 
+void VPartitionManager::SliceMarkAllocatedLocked(size_t pslice, size_t vpart, size_t vslice) {
+    ZX_DEBUG_ASSERT(vpart <= VPART_MAX);
+    ZX_DEBUG_ASSERT(vslice <= VSLICE_MAX);
+    slice_entry_t* entry = GetSliceEntryLocked(pslice);
+    entry->vpart = vpart & VPART_MAX;
+    entry->vslice = vslice & VSLICE_MAX;
+    allocated_slices_.Set(pslice, pslice + 1);
+}
+
+void VPartitionManager::SliceMarkFreeLocked(size_t pslice) {
+    GetSliceEntryLocked(pslice)->vpart = PSLICE_UNALLOCATED;
+    allocated_slices_.Clear(pslice, pslice + 1);
+}
+
+namespace {
+
+struct TrimSync {
+    completion_t done;
+    zx_status_t status;
+};
+
+void trim_sync_completion(block_op_t* op, zx_status_t status) {
+    TrimSync* sync = static_cast<TrimSync*>(op->cookie);
+    sync->status = status;
+    completion_signal(&sync->done);
+}
+
+} // namespace
+
+zx_status_t VPartitionManager::TrimLocked(uint64_t pslice, uint64_t count) {
+    const uint64_t blocks_per_slice = SliceSize() / info_.block_size;
+    uint64_t offset = SliceStart(DiskSize(), SliceSize(), pslice) / info_.block_size;
+    uint64_t length = count * blocks_per_slice;
+
+    block_op_t* op = static_cast<block_op_t*>(calloc(1, BlockOpSize()));
+    if (op == nullptr) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    zx_status_t status = ZX_OK;
+    while (length > 0 && status == ZX_OK) {
+        uint32_t n = static_cast<uint32_t>(
+                fbl::min(length, static_cast<uint64_t>(fbl::numeric_limits<uint32_t>::max())));
+        TrimSync sync;
+        completion_reset(&sync.done);
+        sync.status = ZX_OK;
+        memset(op, 0, BlockOpSize());
+        op->command = BLOCK_OP_TRIM;
+        op->trim.length = n;
+        op->trim.offset_dev = offset;
+        op->completion_cb = trim_sync_completion;
+        op->cookie = &sync;
+        Queue(op);
+        completion_wait(&sync.done, ZX_TIME_INFINITE);
+        status = sync.status;
+        offset += n;
+        length -= n;
+    }
+    free(op);
+    return status;
+}
+
+void VPartitionManager::TrimSlicesLocked(const fbl::Vector<uint32_t>& pslices) {
+    if (!(info_.flags & BLOCK_FLAG_TRIM_SUPPORT) || pslices.is_empty()) {
+        return;
+    }
+    // Slices are freed in either direction, so runs may grow at either end.
+    uint64_t start = pslices[0];
+    uint64_t end = start + 1;
+    for (size_t i = 1; i <= pslices.size(); i++) {
+        if (i < pslices.size()) {
+            if (pslices[i] == end) {
+                end++;
+                continue;
+            } else if (pslices[i] + 1 == start) {
+                start--;
+                continue;
+            }
+        }
+        zx_status_t status = TrimLocked(start, end - start);
+        if (status != ZX_OK) {
+            fprintf(stderr, "FVM: Failed to trim slices [%" PRIu64 ", %" PRIu64 "): %d\n",
+                    start, end, status);
+            return;
+        }
+        if (i < pslices.size()) {
+            start = pslices[i];
+            end = start + 1;
+        }
+    }
+}
+
 zx_status_t VPartitionManager::AllocateSlices(VPartition* vp, size_t vslice_start,
                                               size_t count) {
     fbl::AutoLock lock(&lock_);
@@ -368,18 +469,13 @@ zx_status_t VPartitionManager::AllocateSlicesLocked(VPartition* vp, size_t vslic
                 ((status = vp->SliceSetLocked(vslice, static_cast<uint32_t>(pslice)) != ZX_OK))) {
                 for (int j = static_cast<int>(i - 1); j >= 0; j--) {
                     vslice = vslice_start + j;
-                    GetSliceEntryLocked(vp->SliceGetLocked(vslice))->vpart = PSLICE_UNALLOCATED;
+                    SliceMarkFreeLocked(vp->SliceGetLocked(vslice));
                     vp->SliceFreeLocked(vslice);
                 }
 
                 return status;
             }
-            slice_entry_t* alloc_entry = GetSliceEntryLocked(pslice);
-            auto vpart = vp->GetEntryIndex();
-            ZX_DEBUG_ASSERT(vpart <= VPART_MAX);
-            ZX_DEBUG_ASSERT(vslice <= VSLICE_MAX);
-            alloc_entry->vpart = vpart & VPART_MAX;
-            alloc_entry->vslice = vslice & VSLICE_MAX;
+            SliceMarkAllocatedLocked(pslice, vp->GetEntryIndex(), vslice);
             hint = pslice + 1;
         }
     }
@@ -390,7 +486,7 @@ zx_status_t VPartitionManager::AllocateSlicesLocked(VPartition* vp, size_t vslic
         fbl::AutoLock lock(&vp->lock_);
         for (int j = static_cast<int>(count - 1); j >= 0; j--) {
             auto vslice = vslice_start + j;
-            GetSliceEntryLocked(vp->SliceGetLocked(vslice))->vpart = PSLICE_UNALLOCATED;
+            SliceMarkFreeLocked(vp->SliceGetLocked(vslice));
             vp->SliceFreeLocked(vslice);
         }
     }
@@ -444,6 +540,18 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, size_t vslice_st
         return ZX_ERR_INVALID_ARGS;
     }
 
+    // The freed slices are trimmed once the metadata no longer refers to
+    // them. If they cannot all be recorded, none are trimmed.
+    fbl::Vector<uint32_t> freed;
+    bool trim = (info_.flags & BLOCK_FLAG_TRIM_SUPPORT) != 0;
+    auto record_freed = [&freed, &trim](size_t pslice) {
+        fbl::AllocChecker ac;
+        if (trim) {
+            freed.push_back(static_cast<uint32_t>(pslice), &ac);
+            trim = ac.check();
+        }
+    };
+
     bool freed_something = false;
     {
         fbl::AutoLock lock(&vp->lock_);
@@ -462,7 +570,8 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, size_t vslice_st
             // Special case: Freeing entire VPartition
             for (auto extent = vp->ExtentBegin(); extent.IsValid(); extent = vp->ExtentBegin()) {
                 for (size_t i = extent->start(); i < extent->end(); i++) {
-                    GetSliceEntryLocked(vp->SliceGetLocked(i))->vpart = PSLICE_UNALLOCATED;
+                    record_freed(vp->SliceGetLocked(i));
+                    SliceMarkFreeLocked(vp->SliceGetLocked(i));
                 }
                 vp->ExtentDestroyLocked(extent->start());
             }
@@ -488,7 +597,8 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, size_t vslice_st
                     } else {
                         ZX_ASSERT(vp->SliceFreeLocked(vslice));
                     }
-                    GetSliceEntryLocked(pslice)->vpart = 0;
+                    record_freed(pslice);
+                    SliceMarkFreeLocked(pslice);
                     freed_something = true;
                 }
             }
@@ -498,7 +608,11 @@ zx_status_t VPartitionManager::FreeSlicesLocked(VPartition* vp, size_t vslice_st
     if (!freed_something) {
         return ZX_ERR_INVALID_ARGS;
     }
-    return WriteFvmLocked();
+    zx_status_t status = WriteFvmLocked();
+    if (status == ZX_OK && trim) {
+        TrimSlicesLocked(freed);
+    }
+    return status;
 }
 
 // Device protocol (FVM)
@@ -580,7 +694,8 @@ void VPartitionManager::DdkRelease() {
 }
 
 VPartition::VPartition(VPartitionManager* vpm, size_t entry_index, size_t block_op_size)
-    : PartitionDeviceType(vpm->zxdev()), mgr_(vpm), entry_index_(entry_index) {
+    : PartitionDeviceType(vpm->zxdev()), mgr_(vpm), entry_index_(entry_index),
+      slice_cache_(), split_pool_(nullptr), split_pool_count_(0) {
 
     memcpy(&info_, &mgr_->info_, sizeof(block_info_t));
 #ifdef IOTXN_LEGACY_SUPPORT
@@ -594,7 +709,14 @@ VPartition::VPartition(VPartitionManager* vpm, size_t entry_index, size_t block_
     info_.block_count = 0;
 }
 
-VPartition::~VPartition() = default;
+VPartition::~VPartition() {
+    while (split_pool_ != nullptr) {
+        SplitTxn* split = split_pool_;
+        split_pool_ = split->next;
+        split->~SplitTxn();
+        free(split);
+    }
+}
 
 zx_status_t VPartition::Create(VPartitionManager* vpm, size_t entry_index,
                                fbl::unique_ptr<VPartition>* out) {
@@ -606,18 +728,55 @@ zx_status_t VPartition::Create(VPartitionManager* vpm, size_t entry_index,
         return ZX_ERR_NO_MEMORY;
     }
 
+    // Fill the split pool up front, so splitting an IO never allocates.
+    if (vpm->BlockOpSize() > 0) {
+        for (size_t i = 0; i < kSplitPoolSize; i++) {
+            SplitTxn* split = vp->SplitTxnAlloc();
+            if (split == nullptr) {
+                return ZX_ERR_NO_MEMORY;
+            }
+            vp->SplitTxnPut(split);
+        }
+    }
+
     *out = fbl::move(vp);
     return ZX_OK;
 }
 
 uint32_t VPartition::SliceGetLocked(size_t vslice) const {
     ZX_DEBUG_ASSERT(vslice < mgr_->VSliceMax());
+    SliceCacheEntry* cached = &slice_cache_[vslice % kSliceCacheSize];
+    if (cached->pslice != PSLICE_UNALLOCATED && cached->vslice == vslice) {
+        return cached->pslice;
+    }
     auto extent = --slice_map_.upper_bound(vslice);
     if (!extent.IsValid()) {
         return 0;
     }
     ZX_DEBUG_ASSERT(extent->start() <= vslice);
-    return extent->get(vslice);
+    uint32_t pslice = extent->get(vslice);
+    if (pslice != PSLICE_UNALLOCATED) {
+        cached->vslice = vslice;
+        cached->pslice = pslice;
+    }
+    return pslice;
+}
+
+void VPartition::SliceCacheInvalidateLocked(size_t vslice_start, size_t vslice_end) {
+    if (vslice_end - vslice_start < kSliceCacheSize) {
+        for (size_t vslice = vslice_start; vslice < vslice_end; vslice++) {
+            SliceCacheEntry* cached = &slice_cache_[vslice % kSliceCacheSize];
+            if (cached->vslice == vslice) {
+                cached->pslice = PSLICE_UNALLOCATED;
+            }
+        }
+        return;
+    }
+    for (size_t i = 0; i < kSliceCacheSize; i++) {
+        if (slice_cache_[i].vslice >= vslice_start && slice_cache_[i].vslice < vslice_end) {
+            slice_cache_[i].pslice = PSLICE_UNALLOCATED;
+        }
+    }
 }
 
 zx_status_t VPartition::CheckSlices(size_t vslice_start, size_t* count, bool* allocated) {
@@ -709,6 +868,7 @@ bool VPartition::SliceFreeLocked(size_t vslice) {
         slice_map_.insert(fbl::move(new_extent));
     }
     // Removing from end of extent
+    SliceCacheInvalidateLocked(vslice, vslice + 1);
     extent->pop_back();
     if (extent->is_empty()) {
         slice_map_.erase(*extent);
@@ -723,6 +883,7 @@ void VPartition::ExtentDestroyLocked(size_t vslice) TA_REQ(lock_) {
     ZX_DEBUG_ASSERT(SliceCanFree(vslice));
     auto extent = --slice_map_.upper_bound(vslice);
     size_t length = extent->size();
+    SliceCacheInvalidateLocked(extent->start(), extent->end());
     slice_map_.erase(*extent);
     AddBlocksLocked(-((length * mgr_->SliceSize()) / info_.block_size));
 }
@@ -864,36 +1025,18 @@ zx_status_t VPartition::DdkIoctl(uint32_t op, const void* cmd, size_t cmdlen,
     }
 }
 
-typedef struct multi_txn_state {
-    multi_txn_state(size_t total, block_op_t* txn)
-        : txns_completed(0), txns_total(total), status(ZX_OK), original(txn) {}
-
-    fbl::Mutex lock;
-    size_t txns_completed TA_GUARDED(lock);
-    size_t txns_total TA_GUARDED(lock);
-    zx_status_t status TA_GUARDED(lock);
-    block_op_t* original TA_GUARDED(lock);
-} multi_txn_state_t;
-
-static void multi_txn_completion(block_op_t* txn, zx_status_t status) {
-    multi_txn_state_t* state = static_cast<multi_txn_state_t*>(txn->cookie);
-    bool last_txn = false;
-    {
-        fbl::AutoLock lock(&state->lock);
-        state->txns_completed++;
-        if (state->status == ZX_OK && status != ZX_OK) {
-            state->status = status;
-        }
-        if (state->txns_completed == state->txns_total) {
-            last_txn = true;
-            state->original->completion_cb(state->original, state->status);
-        }
+static void split_txn_completion(block_op_t* txn, zx_status_t status) {
+    SplitTxn* split = static_cast<SplitTxn*>(txn->cookie);
+    zx_status_t expected = ZX_OK;
+    if (status != ZX_OK) {
+        split->status.compare_exchange_strong(&expected, status);
     }
-
-    if (last_txn) {
-        delete state;
+    if (split->remaining.fetch_sub(1) == 1) {
+        block_op_t* original = split->original;
+        zx_status_t result = split->status.load();
+        split->vp->SplitTxnPut(split);
+        original->completion_cb(original, result);
     }
-    free(txn);
 }
 
 void VPartition::BlockQueue(block_op_t* txn) {
@@ -901,6 +1044,8 @@ void VPartition::BlockQueue(block_op_t* txn) {
     switch (txn->command & BLOCK_OP_MASK) {
     case BLOCK_OP_READ:
     case BLOCK_OP_WRITE:
+    // The trim fields line up with rw, and a trim splits across slices the same way.
+    case BLOCK_OP_TRIM:
         break;
     // Pass-through operations
     case BLOCK_OP_FLUSH:
@@ -968,21 +1113,22 @@ void VPartition::BlockQueue(block_op_t* txn) {
     }
 
     // Harder case: Noncontiguous slices
-    constexpr size_t kMaxSlices = 32;
-    block_op_t* txns[kMaxSlices];
     const size_t txn_count = vslice_end - vslice_start + 1;
     if (kMaxSlices < txn_count) {
         txn->completion_cb(txn, ZX_ERR_OUT_OF_RANGE);
         return;
     }
 
-    fbl::AllocChecker ac;
-    fbl::unique_ptr<multi_txn_state_t> state(new (&ac) multi_txn_state_t(txn_count, txn));
-    if (!ac.check()) {
+    SplitTxn* split = SplitTxnGet();
+    if (split == nullptr) {
         txn->completion_cb(txn, ZX_ERR_NO_MEMORY);
         return;
     }
+    split->original = txn;
+    split->remaining.store(static_cast<uint32_t>(txn_count));
+    split->status.store(ZX_OK);
 
+    const size_t stride = SplitOpStride();
     uint32_t length_remaining = txn->rw.length;
     for (size_t i = 0; i < txn_count; i++) {
         size_t vslice = vslice_start + i;
@@ -997,36 +1143,67 @@ void VPartition::BlockQueue(block_op_t* txn) {
             offset_vmo += txn->rw.length - length_remaining;
         } else {
             length = blocks_per_slice;
-            offset_vmo += txns[0]->rw.length + blocks_per_slice * (i - 1);
+            offset_vmo += split->SubOp(stride, 0)->rw.length + blocks_per_slice * (i - 1);
         }
         ZX_DEBUG_ASSERT(length <= blocks_per_slice);
         ZX_DEBUG_ASSERT(length <= length_remaining);
 
-        txns[i] = static_cast<block_op_t*>(calloc(1, mgr_->BlockOpSize()));
-        if (txns[i] == nullptr) {
-            while (i-- > 0) {
-                free(txns[i]);
-            }
-            txn->completion_cb(txn, ZX_ERR_NO_MEMORY);
-            return;
-        }
-        memcpy(txns[i], txn, sizeof(*txn));
-        txns[i]->rw.offset_vmo = offset_vmo;
-        txns[i]->rw.length = static_cast<uint32_t>(length);
-        txns[i]->rw.offset_dev = SliceStart(disk_size, slice_size, pslice) / BlockSize();
+        block_op_t* sub = split->SubOp(stride, i);
+        memset(sub, 0, mgr_->BlockOpSize());
+        memcpy(sub, txn, sizeof(*txn));
+        sub->rw.offset_vmo = offset_vmo;
+        sub->rw.length = static_cast<uint32_t>(length);
+        sub->rw.offset_dev = SliceStart(disk_size, slice_size, pslice) / BlockSize();
         if (vslice == vslice_start) {
-            txns[i]->rw.offset_dev += (txn->rw.offset_dev % blocks_per_slice);
+            sub->rw.offset_dev += (txn->rw.offset_dev % blocks_per_slice);
         }
-        length_remaining -= txns[i]->rw.length;
-        txns[i]->completion_cb = multi_txn_completion;
-        txns[i]->cookie = state.get();
+        length_remaining -= sub->rw.length;
+        sub->completion_cb = split_txn_completion;
+        sub->cookie = split;
     }
     ZX_DEBUG_ASSERT(length_remaining == 0);
 
+    // All sub-ops are in flight at once; the last to complete finishes |txn|.
     for (size_t i = 0; i < txn_count; i++) {
-        mgr_->Queue(txns[i]);
+        mgr_->Queue(split->SubOp(stride, i));
     }
-    state.release();
+}
+
+SplitTxn* VPartition::SplitTxnGet() {
+    {
+        fbl::AutoLock lock(&split_lock_);
+        if (split_pool_ != nullptr) {
+            SplitTxn* split = split_pool_;
+            split_pool_ = split->next;
+            split_pool_count_--;
+            return split;
+        }
+    }
+    return SplitTxnAlloc();
+}
+
+SplitTxn* VPartition::SplitTxnAlloc() {
+    void* mem = malloc(sizeof(SplitTxn) + kMaxSlices * SplitOpStride());
+    if (mem == nullptr) {
+        return nullptr;
+    }
+    SplitTxn* split = new (mem) SplitTxn();
+    split->vp = this;
+    return split;
+}
+
+void VPartition::SplitTxnPut(SplitTxn* split) {
+    {
+        fbl::AutoLock lock(&split_lock_);
+        if (split_pool_count_ < kSplitPoolSize) {
+            split->next = split_pool_;
+            split_pool_ = split;
+            split_pool_count_++;
+            return;
+        }
+    }
+    split->~SplitTxn();
+    free(split);
 }
 
 #ifdef IOTXN_LEGACY_SUPPORT
@@ -15,6 +15,7 @@ MODULE_SRCS := \
 MODULE_STATIC_LIBS := \
     system/ulib/ddk \
     system/ulib/ddktl \
+    system/ulib/bitmap \
     system/ulib/fs \
     system/ulib/fvm \
     system/ulib/gpt \
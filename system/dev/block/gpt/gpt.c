@@ -174,7 +174,9 @@ static void gpt_queue(void* ctx, block_op_t* bop) {
 
     switch (bop->command & BLOCK_OP_MASK) {
     case BLOCK_OP_READ:
-    case BLOCK_OP_WRITE: {
+    case BLOCK_OP_WRITE:
+    case BLOCK_OP_TRIM: {
+        // The trim fields line up with these.
         size_t blocks = bop->rw.length;
         size_t max = get_lba_count(gpt);
 
@@ -148,10 +148,20 @@ static_assert(sizeof(nvme_cmd_t) == (1 << NVME_CMD_SHIFT), "");
 #define NVME_OP_FLUSH       0x00
 #define NVME_OP_WRITE       0x01
 #define NVME_OP_READ        0x02
+#define NVME_OP_DSM         0x09
 
 #define NVME_RW_FLAG_LR     (1 << 15)
 #define NVME_RW_FLAG_FUA    (1 << 14)
 
+// Dataset Management: cdw10 is the number of ranges (minus 1), cdw11 the attributes
+#define NVME_DSM_ATTR_DEALLOCATE (1 << 2)
+
+typedef struct {
+    uint32_t attrs;         // context attributes
+    uint32_t length;        // in blocks
+    uint64_t start_lba;
+} nvme_dsm_range_t;
+
 
 // Identify Page for Controllers
 typedef struct {
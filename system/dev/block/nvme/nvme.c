@@ -53,8 +53,6 @@ typedef struct {
     uint32_t reserved1;
 } nvme_utxn_t;
 
-#define UTXN_COUNT 63
-
 // There's no system constant for this.  Ensure it matches reality.
 #define PAGE_SHIFT 12
 static_assert(PAGE_SIZE == (1 << PAGE_SHIFT), "");
@@ -66,36 +64,52 @@ static_assert(PAGE_SIZE == (1 << PAGE_SHIFT), "");
 #define MAX_XFER (1024*1024)
 
 // Maximum submission and completion queue item counts, for
-// queues that are a single page in size.
+// the admin queues, which are a single page in size.
 #define SQMAX (PAGE_SIZE / sizeof(nvme_cmd_t))
 #define CQMAX (PAGE_SIZE / sizeof(nvme_cpl_t))
 
+// Most IO queue pairs to create, and the item count of each of their
+// queues, if the controller allows that many.  By default there is an
+// IO queue pair per CPU; driver.nvme.io-queues=<n> asks for fewer.
+#define IO_QUEUE_MAX 8
+#define IO_QUEUE_ENTRIES 128
+
+// Each IO queue pair has a utxn for each command its submission
+// queue can hold, which is one less than its item count.
+#define UTXN_MAX (IO_QUEUE_ENTRIES - 1)
+#define UTXN_WORDS ((UTXN_MAX + 63) / 64)
+
 // global driver state bits
 #define FLAG_IRQ_THREAD_STARTED  0x0001
-#define FLAG_IO_THREAD_STARTED   0x0002
 #define FLAG_SHUTDOWN            0x0004
+#define FLAG_SHARED_IRQ          0x0008 // IO queue pair 1 uses the admin irq
 
 #define FLAG_HAS_VWC             0x0100
 
+// io queue pair state bits
+#define IOQ_FLAG_IRQ_THREAD_STARTED 0x0001
+#define IOQ_FLAG_IO_THREAD_STARTED  0x0002
+
+typedef struct nvme_device nvme_device_t;
+
 typedef struct {
-    void* io;
-    zx_handle_t irqh;
+    nvme_device_t* nvme;
+    uint16_t qid;
+    uint16_t entries;
     uint32_t flags;
-    mtx_t lock;
 
-    // io queue doorbell registers
-    void* io_sq_tail_db;
-    void* io_cq_head_db;
+    // doorbell registers
+    void* sq_tail_db;
+    void* cq_head_db;
 
-    nvme_cpl_t* io_cq;
-    nvme_cmd_t* io_sq;
-    uint32_t io_nsid;
-    uint16_t io_cq_head;
-    uint16_t io_cq_toggle;
-    uint16_t io_sq_tail;
-    uint16_t io_sq_head;
+    nvme_cpl_t* cq;
+    nvme_cmd_t* sq;
+    uint16_t cq_head;
+    uint16_t cq_toggle;
+    uint16_t sq_tail;
+    uint16_t sq_head;
 
-    uint64_t utxn_avail;   // bitmask of available utxns
+    mtx_t lock;
 
     // The pending list is txns that have been received
     // via nvme_queue() and are waiting for io to start.
@@ -113,6 +127,39 @@ typedef struct {
     // it has work to do.
     completion_t io_signal;
 
+    // The queue pair's own irq, or ZX_HANDLE_INVALID if it
+    // shares the admin queue's.
+    zx_handle_t irqh;
+    thrd_t irqthread;
+    thrd_t iothread;
+
+    // the (physically contiguous) submission queue, followed by
+    // the completion queue at the next page
+    io_buffer_t qbuf;
+    // a page for each utxn
+    io_buffer_t utxnbuf;
+
+#if WITH_STATS
+    size_t stat_concur;
+    size_t stat_pending;
+    size_t stat_max_concur;
+    size_t stat_max_pending;
+    size_t stat_total_ops;
+    size_t stat_total_blocks;
+#endif
+
+    // pool of utxns
+    uint32_t utxn_count;
+    uint64_t utxn_avail[UTXN_WORDS];   // bitmask of available utxns
+    nvme_utxn_t utxn[UTXN_MAX];
+} nvme_ioq_t;
+
+struct nvme_device {
+    void* io;
+    zx_handle_t irqh;
+    uint32_t irq_count;
+    uint32_t flags;
+
     uint32_t max_xfer;
     block_info_t info;
 
@@ -140,33 +187,25 @@ typedef struct {
     size_t iosz;
     zx_handle_t ioh;
 
-    // source of physical pages for queues and admin commands
+    // source of physical pages for admin queues and commands
     io_buffer_t iob;
 
     thrd_t irqthread;
-    thrd_t iothread;
-
-#if WITH_STATS
-    size_t stat_concur;
-    size_t stat_pending;
-    size_t stat_max_concur;
-    size_t stat_max_pending;
-    size_t stat_total_ops;
-    size_t stat_total_blocks;
-#endif
 
-    // pool of utxns
-    nvme_utxn_t utxn[UTXN_COUNT];
-} nvme_device_t;
+    // IO queue pairs, with ids 1 to ioq_count
+    uint32_t ioq_max;
+    uint32_t ioq_count;
+    nvme_ioq_t ioq[IO_QUEUE_MAX];
+};
 
 #if WITH_STATS
-#define STAT_INC(name) do { nvme->stat_##name++; } while (0)
-#define STAT_DEC(name) do { nvme->stat_##name--; } while (0)
-#define STAT_DEC_IF(name, c) do { if (c) nvme->stat_##name--; } while (0)
-#define STAT_ADD(name, num) do { nvme->stat_##name += num; } while (0)
+#define STAT_INC(name) do { q->stat_##name++; } while (0)
+#define STAT_DEC(name) do { q->stat_##name--; } while (0)
+#define STAT_DEC_IF(name, c) do { if (c) q->stat_##name--; } while (0)
+#define STAT_ADD(name, num) do { q->stat_##name += num; } while (0)
 #define STAT_INC_MAX(name) do { \
-    if (++nvme->stat_##name > nvme->stat_max_##name) { \
-        nvme->stat_max_##name = nvme->stat_##name; \
+    if (++q->stat_##name > q->stat_max_##name) { \
+        q->stat_max_##name = q->stat_##name; \
     }} while (0)
 #else
 #define STAT_INC(name) do { } while (0)
@@ -183,28 +222,30 @@ typedef struct {
 // queued to the NVME device.  This id is the same as its index into the
 // pool of utxns and the bitmask of free txns, to simplify management.
 //
-// We maintain a pool of 63 of these, which is the number of commands
-// that can be submitted to NVME via a single page submit queue.
+// Each IO queue pair has its own pool, with as many utxns as commands
+// its submission queue can hold.
 //
 // The utxns are not protected by locks.  Instead, after initialization,
-// they may only be touched by the io thread, which is responsible for
-// queueing commands and dequeuing completion messages.
-
-static nvme_utxn_t* utxn_get(nvme_device_t* nvme) {
-    uint64_t n = __builtin_ffsll(nvme->utxn_avail);
-    if (n == 0) {
-        return NULL;
-    }
-    n--;
-    nvme->utxn_avail &= ~(1ULL << n);
-    STAT_INC_MAX(concur);
-    return nvme->utxn + n;
+// they may only be touched by the queue pair's io thread, which is
+// responsible for queueing commands and dequeuing completion messages.
+
+static nvme_utxn_t* utxn_get(nvme_ioq_t* q) {
+    for (unsigned w = 0; w < UTXN_WORDS; w++) {
+        uint64_t n = __builtin_ffsll(q->utxn_avail[w]);
+        if (n != 0) {
+            n--;
+            q->utxn_avail[w] &= ~(1ULL << n);
+            STAT_INC_MAX(concur);
+            return q->utxn + w * 64 + n;
+        }
+    }
+    return NULL;
 }
 
-static void utxn_put(nvme_device_t* nvme, nvme_utxn_t* utxn) {
+static void utxn_put(nvme_ioq_t* q, nvme_utxn_t* utxn) {
     uint64_t n = utxn->id;
     STAT_DEC(concur);
-    nvme->utxn_avail |= (1ULL << n);
+    q->utxn_avail[n / 64] |= (1ULL << (n % 64));
 }
 
 static zx_status_t nvme_admin_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
@@ -243,41 +284,46 @@ static zx_status_t nvme_admin_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
     return ZX_OK;
 }
 
-static zx_status_t nvme_io_cq_get(nvme_device_t* nvme, nvme_cpl_t* cpl) {
-    if ((readw(&nvme->io_cq[nvme->io_cq_head].status) & 1) != nvme->io_cq_toggle) {
+static zx_status_t nvme_io_cq_get(nvme_ioq_t* q, nvme_cpl_t* cpl) {
+    if ((readw(&q->cq[q->cq_head].status) & 1) != q->cq_toggle) {
         return ZX_ERR_SHOULD_WAIT;
     }
-    *cpl = nvme->io_cq[nvme->io_cq_head];
+    *cpl = q->cq[q->cq_head];
 
     // advance the head pointer, wrapping and inverting toggle at max
-    uint16_t next = (nvme->io_cq_head + 1) & (CQMAX - 1);
-    if ((nvme->io_cq_head = next) == 0) {
-        nvme->io_cq_toggle ^= 1;
+    uint16_t next = q->cq_head + 1;
+    if (next == q->entries) {
+        next = 0;
+        q->cq_toggle ^= 1;
     }
+    q->cq_head = next;
 
     // note the new sq head reported by hw
-    nvme->io_sq_head = cpl->sq_head;
+    q->sq_head = cpl->sq_head;
     return ZX_OK;
 }
 
-static void nvme_io_cq_ack(nvme_device_t* nvme) {
+static void nvme_io_cq_ack(nvme_ioq_t* q) {
     // ring the doorbell
-    writel(nvme->io_cq_head, nvme->io_cq_head_db);
+    writel(q->cq_head, q->cq_head_db);
 }
 
-static zx_status_t nvme_io_sq_put(nvme_device_t* nvme, nvme_cmd_t* cmd) {
-    uint16_t next = (nvme->io_sq_tail + 1) & (SQMAX - 1);
+static zx_status_t nvme_io_sq_put(nvme_ioq_t* q, nvme_cmd_t* cmd) {
+    uint16_t next = q->sq_tail + 1;
+    if (next == q->entries) {
+        next = 0;
+    }
 
     // if head+1 == tail: queue is full
-    if (next == nvme->io_sq_head) {
+    if (next == q->sq_head) {
         return ZX_ERR_SHOULD_WAIT;
     }
 
-    nvme->io_sq[nvme->io_sq_tail] = *cmd;
-    nvme->io_sq_tail = next;
+    q->sq[q->sq_tail] = *cmd;
+    q->sq_tail = next;
 
     // ring the doorbell
-    writel(next, nvme->io_sq_tail_db);
+    writel(next, q->sq_tail_db);
     return ZX_OK;
 }
 
@@ -297,7 +343,24 @@ static int irq_thread(void* arg) {
             completion_signal(&nvme->admin_signal);
         }
 
-        completion_signal(&nvme->io_signal);
+        if (nvme->flags & FLAG_SHARED_IRQ) {
+            completion_signal(&nvme->ioq[0].io_signal);
+        }
+    }
+    return 0;
+}
+
+// Serves the irq of an IO queue pair which has its own.
+static int ioq_irq_thread(void* arg) {
+    nvme_ioq_t* q = arg;
+    for (;;) {
+        zx_status_t r;
+        uint64_t slots;
+        if ((r = zx_interrupt_wait(q->irqh, &slots)) != ZX_OK) {
+            zxlogf(ERROR, "nvme: ioq %u: irq wait failed: %d\n", q->qid, r);
+            break;
+        }
+        completion_signal(&q->io_signal);
     }
     return 0;
 }
@@ -331,10 +394,54 @@ static inline void txn_complete(nvme_txn_t* txn, zx_status_t status) {
     txn->op.completion_cb(&txn->op, status);
 }
 
+// Queue a deallocate for a trim txn, as a single range held
+// in the utxn's page.  Returns as io_process_txn() does.
+static bool io_process_trim(nvme_ioq_t* q, nvme_txn_t* txn) {
+    nvme_utxn_t* utxn;
+    if ((utxn = utxn_get(q)) == NULL) {
+        return true;
+    }
+
+    nvme_dsm_range_t* range = utxn->virt;
+    memset(range, 0, sizeof(*range));
+    range->length = txn->op.trim.length;
+    range->start_lba = txn->op.trim.offset_dev;
+
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(utxn->id) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_OP_DSM);
+    cmd.nsid = 1;
+    cmd.dptr.prp[0] = utxn->phys;
+    cmd.u.raw[0] = 0; // one range
+    cmd.u.raw[1] = NVME_DSM_ATTR_DEALLOCATE;
+
+    zxlogf(TRACE, "nvme: txn=%p utxn id=%u op=TRIM\n", txn, utxn->id);
+
+    if (nvme_io_sq_put(q, &cmd) != ZX_OK) {
+        zxlogf(ERROR, "nvme: could not submit cmd (txn=%p id=%u)\n", txn, utxn->id);
+        utxn_put(q, utxn);
+        txn_complete(txn, ZX_ERR_INTERNAL);
+        return false;
+    }
+
+    utxn->txn = txn;
+    txn->op.trim.length = 0;
+    txn->pending_utxns++;
+
+    mtx_lock(&q->lock);
+    list_add_tail(&q->active_txns, &txn->node);
+    mtx_unlock(&q->lock);
+    return false;
+}
+
 // Attempt to generate utxns and queue nvme commands for a txn
 // Returns true if this could not be completed due to temporary
 // lack of resources or false if either it succeeded or errored out.
-static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
+static bool io_process_txn(nvme_ioq_t* q, nvme_txn_t* txn) {
+    if (txn->opcode == NVME_OP_DSM) {
+        return io_process_trim(q, txn);
+    }
+
     zx_handle_t vmo = txn->op.rw.vmo;
     nvme_utxn_t* utxn;
     zx_status_t r;
@@ -342,16 +449,16 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     for (;;) {
         // If there are no available utxns, we can't proceed
         // and we tell the caller to retain the txn (true)
-        if ((utxn = utxn_get(nvme)) == NULL) {
+        if ((utxn = utxn_get(q)) == NULL) {
             return true;
         }
 
         uint32_t blocks = txn->op.rw.length;
-        if (blocks > nvme->max_xfer) {
-            blocks = nvme->max_xfer;
+        if (blocks > q->nvme->max_xfer) {
+            blocks = q->nvme->max_xfer;
         }
 
-        size_t bytes = ((size_t) blocks) * ((size_t) nvme->info.block_size);
+        size_t bytes = ((size_t) blocks) * ((size_t) q->nvme->info.block_size);
 
         if ((r = zx_vmo_op_range(vmo, ZX_VMO_OP_COMMIT,
                                  txn->op.rw.offset_vmo, bytes, NULL, 0)) != ZX_OK) {
@@ -393,7 +500,7 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
         zxlogf(SPEW, "nvme: pages[] = { %016zx, %016zx, %016zx, %016zx, ... }\n",
                pages[0], pages[1], pages[2], pages[3]);
 
-        if ((r = nvme_io_sq_put(nvme, &cmd)) != ZX_OK) {
+        if ((r = nvme_io_sq_put(q, &cmd)) != ZX_OK) {
             zxlogf(ERROR, "nvme: could not submit cmd (txn=%p id=%u)\n", txn, utxn->id);
             break;
         }
@@ -410,25 +517,25 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
         // move this txn to the active list and tell the
         // caller not to retain the txn (false)
         if (txn->op.rw.length == 0) {
-            mtx_lock(&nvme->lock);
-            list_add_tail(&nvme->active_txns, &txn->node);
-            mtx_unlock(&nvme->lock);
+            mtx_lock(&q->lock);
+            list_add_tail(&q->active_txns, &txn->node);
+            mtx_unlock(&q->lock);
             return false;
         }
     }
 
     // failure
-    utxn_put(nvme, utxn);
+    utxn_put(q, utxn);
 
-    mtx_lock(&nvme->lock);
+    mtx_lock(&q->lock);
     txn->flags |= TXN_FLAG_FAILED;
     if (txn->pending_utxns) {
         // if there are earlier uncompleted IOs we become active now
         // and will finish erroring out when they complete
-        list_add_tail(&nvme->active_txns, &txn->node);
+        list_add_tail(&q->active_txns, &txn->node);
         txn = NULL;
     }
-    mtx_unlock(&nvme->lock);
+    mtx_unlock(&q->lock);
 
     if (txn != NULL) {
         txn_complete(txn, ZX_ERR_INTERNAL);
@@ -438,42 +545,42 @@ static bool io_process_txn(nvme_device_t* nvme, nvme_txn_t* txn) {
     return false;
 }
 
-static void io_process_txns(nvme_device_t* nvme) {
+static void io_process_txns(nvme_ioq_t* q) {
     nvme_txn_t* txn;
 
     for (;;) {
-        mtx_lock(&nvme->lock);
-        txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node);
+        mtx_lock(&q->lock);
+        txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node);
         STAT_DEC_IF(pending, txn != NULL);
-        mtx_unlock(&nvme->lock);
+        mtx_unlock(&q->lock);
 
         if (txn == NULL) {
             return;
         }
 
-        if (io_process_txn(nvme, txn)) {
+        if (io_process_txn(q, txn)) {
             // put txn back at front of queue for further processing later
-            mtx_lock(&nvme->lock);
-            list_add_head(&nvme->pending_txns, &txn->node);
+            mtx_lock(&q->lock);
+            list_add_head(&q->pending_txns, &txn->node);
             STAT_INC_MAX(pending);
-            mtx_unlock(&nvme->lock);
+            mtx_unlock(&q->lock);
             return;
         }
     }
 }
 
-static void io_process_cpls(nvme_device_t* nvme) {
+static void io_process_cpls(nvme_ioq_t* q) {
     bool ring_doorbell = false;
     nvme_cpl_t cpl;
 
-    while (nvme_io_cq_get(nvme, &cpl) == ZX_OK) {
+    while (nvme_io_cq_get(q, &cpl) == ZX_OK) {
         ring_doorbell = true;
 
-        if (cpl.cmd_id >= UTXN_COUNT) {
+        if (cpl.cmd_id >= q->utxn_count) {
             zxlogf(ERROR, "nvme: unexpected cmd id %u\n", cpl.cmd_id);
             continue;
         }
-        nvme_utxn_t* utxn = nvme->utxn + cpl.cmd_id;
+        nvme_utxn_t* utxn = q->utxn + cpl.cmd_id;
         nvme_txn_t* txn = utxn->txn;
 
         if (txn == NULL) {
@@ -495,48 +602,57 @@ static void io_process_cpls(nvme_device_t* nvme) {
 
         // release the microtransaction
         utxn->txn = NULL;
-        utxn_put(nvme, utxn);
+        utxn_put(q, utxn);
 
         txn->pending_utxns--;
         if ((txn->pending_utxns == 0) && (txn->op.rw.length == 0)) {
             // remove from either pending or active list
-            mtx_lock(&nvme->lock);
+            mtx_lock(&q->lock);
             list_delete(&txn->node);
-            mtx_unlock(&nvme->lock);
+            mtx_unlock(&q->lock);
             zxlogf(TRACE, "nvme: txn %p %s\n", txn, txn->flags & TXN_FLAG_FAILED ? "error" : "okay");
             txn_complete(txn, txn->flags & TXN_FLAG_FAILED ? ZX_ERR_IO : ZX_OK);
         }
     }
 
     if (ring_doorbell) {
-        nvme_io_cq_ack(nvme);
+        nvme_io_cq_ack(q);
     }
 }
 
 static int io_thread(void* arg) {
-    nvme_device_t* nvme = arg;
+    nvme_ioq_t* q = arg;
     for (;;) {
-        if (completion_wait(&nvme->io_signal, ZX_TIME_INFINITE)) {
+        if (completion_wait(&q->io_signal, ZX_TIME_INFINITE)) {
             break;
         }
-        if (nvme->flags & FLAG_SHUTDOWN) {
+        if (q->nvme->flags & FLAG_SHUTDOWN) {
             //TODO: cancel out pending IO
-            zxlogf(INFO, "nvme: io thread exiting\n");
+            zxlogf(INFO, "nvme: ioq %u: io thread exiting\n", q->qid);
             break;
         }
 
-        completion_reset(&nvme->io_signal);
+        completion_reset(&q->io_signal);
 
         // process completion messages
-        io_process_cpls(nvme);
+        io_process_cpls(q);
 
         // process work queue
-        io_process_txns(nvme);
+        io_process_txns(q);
 
     }
     return 0;
 }
 
+// Picks the IO queue pair for a txn.  User space can't tell which CPU it
+// is on, so each calling thread is given a queue pair instead, and
+// threads on different queue pairs don't contend with one another.
+static nvme_ioq_t* nvme_pick_ioq(nvme_device_t* nvme) {
+    uint64_t t = (uintptr_t) thrd_current();
+    t = (t ^ (t >> 29)) * 0x9E3779B97F4A7C15ULL;
+    return nvme->ioq + ((t >> 32) % nvme->ioq_count);
+}
+
 static void nvme_queue(void* ctx, block_op_t* op) {
     nvme_device_t* nvme = ctx;
     nvme_txn_t* txn = containerof(op, nvme_txn_t, op);
@@ -548,6 +664,13 @@ static void nvme_queue(void* ctx, block_op_t* op) {
     case BLOCK_OP_WRITE:
         txn->opcode = NVME_OP_WRITE;
         break;
+    case BLOCK_OP_TRIM:
+        if (!(nvme->info.flags & BLOCK_FLAG_TRIM_SUPPORT)) {
+            txn_complete(txn, ZX_ERR_NOT_SUPPORTED);
+            return;
+        }
+        txn->opcode = NVME_OP_DSM;
+        break;
     case BLOCK_OP_FLUSH:
         // TODO
         txn_complete(txn, ZX_OK);
@@ -557,30 +680,33 @@ static void nvme_queue(void* ctx, block_op_t* op) {
         return;
     }
 
+    // trim.length aliases rw.length
     if (txn->op.rw.length == 0) {
         txn_complete(txn, ZX_ERR_INVALID_ARGS);
         return;
     }
 
     // convert vmo offset to a byte offset
-    txn->op.rw.offset_vmo *= nvme->info.block_size;
+    if (txn->opcode != NVME_OP_DSM) {
+        txn->op.rw.offset_vmo *= nvme->info.block_size;
+    }
 
     txn->pending_utxns = 0;
     txn->flags = 0;
 
     zxlogf(SPEW, "nvme: io: %s: %ublks @ blk#%zu\n",
-           txn->opcode == NVME_OP_WRITE ? "wr" : "rd",
+           txn->opcode == NVME_OP_WRITE ? "wr" : (txn->opcode == NVME_OP_DSM ? "trim" : "rd"),
            txn->op.rw.length + 1U, txn->op.rw.offset_dev);
 
+    nvme_ioq_t* q = nvme_pick_ioq(nvme);
+    mtx_lock(&q->lock);
+    list_add_tail(&q->pending_txns, &txn->node);
     STAT_INC(total_ops);
     STAT_ADD(total_blocks, txn->op.rw.length);
-
-    mtx_lock(&nvme->lock);
-    list_add_tail(&nvme->pending_txns, &txn->node);
     STAT_INC_MAX(pending);
-    mtx_unlock(&nvme->lock);
+    mtx_unlock(&q->lock);
 
-    completion_signal(&nvme->io_signal);
+    completion_signal(&q->io_signal);
 }
 
 static void nvme_query(void* ctx, block_info_t* info_out, size_t* block_op_size_out) {
@@ -588,10 +714,17 @@ static void nvme_query(void* ctx, block_info_t* info_out, size_t* block_op_size_
     *info_out = nvme->info;
     *block_op_size_out = sizeof(nvme_txn_t);
 #if WITH_STATS
-    zxlogf(INFO, "nvme: stats: max concurrent utxns:   %zu\n", nvme->stat_max_concur);
-    zxlogf(INFO, "nvme: stats: max pending txns:       %zu\n", nvme->stat_max_pending);
-    zxlogf(INFO, "nvme: stats: total submitted txns:   %zu\n", nvme->stat_total_ops);
-    zxlogf(INFO, "nvme: stats: total submitted blocks:  %zu\n", nvme->stat_total_blocks);
+    for (uint32_t n = 0; n < nvme->ioq_count; n++) {
+        nvme_ioq_t* q = nvme->ioq + n;
+        zxlogf(INFO, "nvme: stats: ioq %u: max concurrent utxns:   %zu\n", q->qid,
+               q->stat_max_concur);
+        zxlogf(INFO, "nvme: stats: ioq %u: max pending txns:       %zu\n", q->qid,
+               q->stat_max_pending);
+        zxlogf(INFO, "nvme: stats: ioq %u: total submitted txns:   %zu\n", q->qid,
+               q->stat_total_ops);
+        zxlogf(INFO, "nvme: stats: ioq %u: total submitted blocks:  %zu\n", q->qid,
+               q->stat_total_blocks);
+    }
 #endif
 }
 
@@ -649,21 +782,33 @@ static void nvme_release(void* ctx) {
     if (nvme->flags & FLAG_IRQ_THREAD_STARTED) {
         thrd_join(nvme->irqthread, &r);
     }
-    if (nvme->flags & FLAG_IO_THREAD_STARTED) {
-        completion_signal(&nvme->io_signal);
-        thrd_join(nvme->iothread, &r);
-    }
+    for (uint32_t n = 0; n < nvme->ioq_max; n++) {
+        nvme_ioq_t* q = nvme->ioq + n;
+        if (q->irqh != ZX_HANDLE_INVALID) {
+            zx_handle_close(q->irqh);
+        }
+        if (q->flags & IOQ_FLAG_IRQ_THREAD_STARTED) {
+            thrd_join(q->irqthread, &r);
+        }
+        if (q->flags & IOQ_FLAG_IO_THREAD_STARTED) {
+            completion_signal(&q->io_signal);
+            thrd_join(q->iothread, &r);
+        }
 
-    // error out any pending txns
-    mtx_lock(&nvme->lock);
-    nvme_txn_t* txn;
-    while ((txn = list_remove_head_type(&nvme->active_txns, nvme_txn_t, node)) != NULL) {
-        txn_complete(txn, ZX_ERR_PEER_CLOSED);
-    }
-    while ((txn = list_remove_head_type(&nvme->pending_txns, nvme_txn_t, node)) != NULL) {
-        txn_complete(txn, ZX_ERR_PEER_CLOSED);
+        // error out any pending txns
+        mtx_lock(&q->lock);
+        nvme_txn_t* txn;
+        while ((txn = list_remove_head_type(&q->active_txns, nvme_txn_t, node)) != NULL) {
+            txn_complete(txn, ZX_ERR_PEER_CLOSED);
+        }
+        while ((txn = list_remove_head_type(&q->pending_txns, nvme_txn_t, node)) != NULL) {
+            txn_complete(txn, ZX_ERR_PEER_CLOSED);
+        }
+        mtx_unlock(&q->lock);
+
+        io_buffer_release(&q->qbuf);
+        io_buffer_release(&q->utxnbuf);
     }
-    mtx_unlock(&nvme->lock);
 
     io_buffer_release(&nvme->iob);
     free(nvme);
@@ -714,12 +859,9 @@ static void infostring(const char* prefix, uint8_t* str, size_t len) {
 // dedicated pages from the page pool
 #define IDX_ADMIN_SQ   0
 #define IDX_ADMIN_CQ   1
-#define IDX_IO_SQ      2
-#define IDX_IO_CQ      3
-#define IDX_SCRATCH    4
-#define IDX_UTXN_POOL  5 // this must always be last
+#define IDX_SCRATCH    2
 
-#define IO_PAGE_COUNT  (IDX_UTXN_POOL + UTXN_COUNT)
+#define IO_PAGE_COUNT  3
 
 static inline uint64_t U64(uint8_t* x) {
     return *((uint64_t*) (void*) x);
@@ -733,6 +875,96 @@ static inline uint32_t U16(uint8_t* x) {
 
 #define WAIT_MS 5000
 
+// Sets up IO queue pair |q| with id |qid| and |entries| items in each of
+// its queues, starts its threads and has the controller create it.
+static zx_status_t nvme_ioq_init(nvme_device_t* nvme, nvme_ioq_t* q, uint16_t qid,
+                                 uint16_t entries, uint64_t cap) {
+    q->nvme = nvme;
+    q->qid = qid;
+    q->entries = entries;
+    q->utxn_count = entries - 1;
+
+    // The queues are physically contiguous, so they may span pages.
+    size_t sq_bytes = ROUNDUP(entries * sizeof(nvme_cmd_t), PAGE_SIZE);
+    size_t cq_bytes = ROUNDUP(entries * sizeof(nvme_cpl_t), PAGE_SIZE);
+    if (io_buffer_init(&q->qbuf, sq_bytes + cq_bytes, IO_BUFFER_RW | IO_BUFFER_CONTIG) ||
+        io_buffer_init(&q->utxnbuf, PAGE_SIZE * q->utxn_count, IO_BUFFER_RW) ||
+        io_buffer_physmap(&q->utxnbuf)) {
+        zxlogf(ERROR, "nvme: ioq %u: could not allocate io buffers\n", qid);
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    // initialize the microtransaction pool
+    for (unsigned n = 0; n < q->utxn_count; n++) {
+        q->utxn[n].id = n;
+        q->utxn[n].phys = q->utxnbuf.phys_list[n];
+        q->utxn[n].virt = q->utxnbuf.virt + n * PAGE_SIZE;
+        q->utxn_avail[n / 64] |= (1ULL << (n % 64));
+    }
+
+    // registers and buffers for the queues
+    q->sq_tail_db = nvme->io + NVME_REG_SQnTDBL(qid, cap);
+    q->cq_head_db = nvme->io + NVME_REG_CQnHDBL(qid, cap);
+
+    q->sq = io_buffer_virt(&q->qbuf);
+    q->sq_head = 0;
+    q->sq_tail = 0;
+
+    q->cq = io_buffer_virt(&q->qbuf) + sq_bytes;
+    q->cq_head = 0;
+    q->cq_toggle = 1;
+
+    // Vector 0 is the admin queue's.  Without a vector for each queue
+    // pair, there is only the one queue pair, and it shares that.
+    uint16_t vector = 0;
+    if (nvme->irq_count > qid) {
+        vector = qid;
+        if (pci_map_interrupt(&nvme->pci, vector, &q->irqh) != ZX_OK) {
+            zxlogf(ERROR, "nvme: ioq %u: could not map irq\n", qid);
+            return ZX_ERR_INTERNAL;
+        }
+        if (thrd_create_with_name(&q->irqthread, ioq_irq_thread, q, "nvme-ioq-irq-thread")) {
+            zxlogf(ERROR, "nvme: ioq %u: cannot create irq thread\n", qid);
+            return ZX_ERR_INTERNAL;
+        }
+        q->flags |= IOQ_FLAG_IRQ_THREAD_STARTED;
+    } else {
+        nvme->flags |= FLAG_SHARED_IRQ;
+    }
+
+    if (thrd_create_with_name(&q->iothread, io_thread, q, "nvme-io-thread")) {
+        zxlogf(ERROR, "nvme: ioq %u: cannot create io thread\n", qid);
+        return ZX_ERR_INTERNAL;
+    }
+    q->flags |= IOQ_FLAG_IO_THREAD_STARTED;
+
+    // create the IO completion queue
+    nvme_cmd_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
+    cmd.dptr.prp[0] = io_buffer_phys(&q->qbuf) + sq_bytes;
+    cmd.u.raw[0] = ((entries - 1) << 16) | qid; // queue size, queue id
+    cmd.u.raw[1] = (vector << 16) | 2 | 1; // irq vector, irq enable, phys contig
+
+    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+        zxlogf(ERROR, "nvme: ioq %u: completion queue creation op failed\n", qid);
+        return ZX_ERR_INTERNAL;
+    }
+
+    // create the IO submit queue
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
+    cmd.dptr.prp[0] = io_buffer_phys(&q->qbuf);
+    cmd.u.raw[0] = ((entries - 1) << 16) | qid; // queue size, queue id
+    cmd.u.raw[1] = (qid << 16) | 0 | 1; // cqid, qprio, phys contig
+
+    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
+        zxlogf(ERROR, "nvme: ioq %u: submit queue creation op failed\n", qid);
+        return ZX_ERR_INTERNAL;
+    }
+    return ZX_OK;
+}
+
 static zx_status_t nvme_init(nvme_device_t* nvme) {
     uint32_t n = rd32(VS);
     uint64_t cap = rd64(CAP);
@@ -755,21 +987,13 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
         zxlogf(ERROR, "nvme: minimum page size larger than platform page size\n");
         return ZX_ERR_NOT_SUPPORTED;
     }
-    // allocate pages for various queues and the utxn scatter lists
+    // allocate pages for the admin queues and commands
     if (io_buffer_init(&nvme->iob, PAGE_SIZE * IO_PAGE_COUNT, IO_BUFFER_RW) ||
         io_buffer_physmap(&nvme->iob)) {
         zxlogf(ERROR, "nvme: could not allocate io buffers\n");
         return ZX_ERR_NO_MEMORY;
     }
 
-    // initialize the microtransaction pool
-    nvme->utxn_avail = 0x7FFFFFFFFFFFFFFFULL;
-    for (unsigned n = 0; n < UTXN_COUNT; n++) {
-        nvme->utxn[n].id = n;
-        nvme->utxn[n].phys = nvme->iob.phys_list[IDX_UTXN_POOL + n];
-        nvme->utxn[n].virt = nvme->iob.virt + (IDX_UTXN_POOL + n) * PAGE_SIZE;
-    }
-
     if (rd32(CSTS) & NVME_CSTS_RDY) {
         zxlogf(INFO, "nvme: controller is active. resetting...\n");
         wr32(rd32(CC) & ~NVME_CC_EN, CC); // disable
@@ -819,18 +1043,6 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     nvme->admin_cq_head = 0;
     nvme->admin_cq_toggle = 1;
 
-    // registers and buffers for IO queues
-    nvme->io_sq_tail_db = nvme->io + NVME_REG_SQnTDBL(1, cap);
-    nvme->io_cq_head_db = nvme->io + NVME_REG_CQnHDBL(1, cap);
-
-    nvme->io_sq = nvme->iob.virt + PAGE_SIZE * IDX_IO_SQ;
-    nvme->io_sq_head = 0;
-    nvme->io_sq_tail = 0;
-
-    nvme->io_cq = nvme->iob.virt + PAGE_SIZE * IDX_IO_CQ;
-    nvme->io_cq_head = 0;
-    nvme->io_cq_toggle = 1;
-
     // scratch page for admin ops
     void* scratch = nvme->iob.virt + PAGE_SIZE * IDX_SCRATCH;
 
@@ -840,12 +1052,6 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     }
     nvme->flags |= FLAG_IRQ_THREAD_STARTED;
 
-    if (thrd_create_with_name(&nvme->iothread, io_thread, nvme, "nvme-io-thread")) {
-        zxlogf(ERROR, "nvme; cannot create io thread\n");
-        return ZX_ERR_INTERNAL;
-    }
-    nvme->flags |= FLAG_IO_THREAD_STARTED;
-
     nvme_cmd_t cmd;
 
     // identify device
@@ -903,6 +1109,7 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     }
     uint32_t awun = ci->AWUN + 1;
     uint32_t awupf = ci->AWUPF + 1;
+    uint16_t oncs = ci->ONCS;
     zxlogf(INFO, "nvme: volatile write cache (VWC): %s\n", nvme->flags & FLAG_HAS_VWC ? "Y" : "N");
     zxlogf(INFO, "nvme: atomic write unit (AWUN)/(AWUPF): %u/%u blks\n", awun, awupf);
 
@@ -921,42 +1128,51 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     FEATURE(ONCS, SAVE_SELECT_NONZERO);
     FEATURE(ONCS, WRITE_UNCORRECTABLE);
     FEATURE(ONCS, COMPARE);
+    FEATURE(ONCS, DATASET_MANAGEMENT);
+
+    // Ask for an IO queue pair for each irq vector beyond the admin
+    // queue's, up to one per CPU.  With a single vector, there is a
+    // single queue pair.
+    uint32_t nq = nvme->ioq_max;
+    if (nvme->irq_count <= nq) {
+        nq = (nvme->irq_count > 1) ? nvme->irq_count - 1 : 1;
+    }
 
-    // set feature (number of queues) to 1 iosq and 1 iocq
+    // set feature (number of queues) to nq iosqs and nq iocqs
     memset(&cmd, 0, sizeof(cmd));
     cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_SET_FEATURE);
     cmd.u.raw[0] = NVME_FEATURE_NUMBER_OF_QUEUES;
-    cmd.u.raw[1] = 0;
+    cmd.u.raw[1] = ((nq - 1) << 16) | (nq - 1);
 
     nvme_cpl_t cpl;
     if (nvme_admin_txn(nvme, &cmd, &cpl) != ZX_OK) {
         zxlogf(ERROR, "nvme: set feature (number queues) op failed\n");
         return ZX_ERR_INTERNAL;
     }
-    zxlogf(INFO,"cpl.cmd %08x\n", cpl.cmd);
-
-    // create the IO completion queue
-    memset(&cmd, 0, sizeof(cmd));
-    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOCQ);
-    cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_CQ];
-    cmd.u.raw[0] = ((CQMAX - 1) << 16) | 1; // queue size, queue id
-    cmd.u.raw[1] = (0 << 16) | 2 | 1; // irq vector, irq enable, phys contig
 
-    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-        zxlogf(ERROR, "nvme: completion queue creation op failed\n");
-        return ZX_ERR_INTERNAL;
+    // The controller may allocate fewer (the counts are zero based).
+    uint32_t nsqa = (cpl.cmd & 0xFFFF) + 1;
+    uint32_t ncqa = (cpl.cmd >> 16) + 1;
+    if (nq > nsqa) {
+        nq = nsqa;
+    }
+    if (nq > ncqa) {
+        nq = ncqa;
     }
 
-    // create the IO submit queue
-    memset(&cmd, 0, sizeof(cmd));
-    cmd.cmd = NVME_CMD_CID(0) | NVME_CMD_PRP | NVME_CMD_NORMAL | NVME_CMD_OPC(NVME_ADMIN_OP_CREATE_IOSQ);
-    cmd.dptr.prp[0] = nvme->iob.phys_list[IDX_IO_SQ];
-    cmd.u.raw[0] = ((SQMAX - 1) << 16) | 1; // queue size, queue id
-    cmd.u.raw[1] = (1 << 16) | 0 | 1; // cqid, qprio, phys contig
+    uint32_t entries = ((uint32_t) NVME_CAP_MQES(cap)) + 1;
+    if (entries > IO_QUEUE_ENTRIES) {
+        entries = IO_QUEUE_ENTRIES;
+    }
+    zxlogf(INFO, "nvme: io queue pairs: %u of %u entries (allocated: %u sq, %u cq)\n",
+           nq, entries, nsqa, ncqa);
 
-    if (nvme_admin_txn(nvme, &cmd, NULL) != ZX_OK) {
-        zxlogf(ERROR, "nvme: submit queue creation op failed\n");
-        return ZX_ERR_INTERNAL;
+    for (uint32_t n = 0; n < nq; n++) {
+        zx_status_t r;
+        if ((r = nvme_ioq_init(nvme, nvme->ioq + n, n + 1, entries, cap)) != ZX_OK) {
+            return r;
+        }
+        nvme->ioq_count++;
     }
 
     // identify namespace 1
@@ -998,6 +1214,9 @@ static zx_status_t nvme_init(nvme_device_t* nvme) {
     nvme->info.block_count = ni->NSSZ;
     nvme->info.block_size = 1 << NVME_LBAFMT_LBADS(fmt);
     nvme->info.max_transfer_size = 0xFFFFFFFF;
+    if (oncs & ONCS_DATASET_MANAGEMENT) {
+        nvme->info.flags |= BLOCK_FLAG_TRIM_SUPPORT;
+    }
 
     if (NVME_LBAFMT_MS(fmt)) {
         zxlogf(ERROR, "nvme: cannot handle LBA format with metadata\n");
@@ -1040,11 +1259,24 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
     if ((nvme = calloc(1, sizeof(nvme_device_t))) == NULL) {
         return ZX_ERR_NO_MEMORY;
     }
-    list_initialize(&nvme->pending_txns);
-    list_initialize(&nvme->active_txns);
-    mtx_init(&nvme->lock, mtx_plain);
     mtx_init(&nvme->admin_lock, mtx_plain);
 
+    // An IO queue pair per CPU, unless asked for fewer.
+    nvme->ioq_max = zx_system_get_num_cpus();
+    const char* ioqs = getenv("driver.nvme.io-queues");
+    if ((ioqs != NULL) && (strtoul(ioqs, NULL, 10) > 0) &&
+        (strtoul(ioqs, NULL, 10) < nvme->ioq_max)) {
+        nvme->ioq_max = strtoul(ioqs, NULL, 10);
+    }
+    if (nvme->ioq_max > IO_QUEUE_MAX) {
+        nvme->ioq_max = IO_QUEUE_MAX;
+    }
+    for (uint32_t n = 0; n < nvme->ioq_max; n++) {
+        list_initialize(&nvme->ioq[n].pending_txns);
+        list_initialize(&nvme->ioq[n].active_txns);
+        mtx_init(&nvme->ioq[n].lock, mtx_plain);
+    }
+
     if (device_get_protocol(dev, ZX_PROTOCOL_PCI, &nvme->pci)) {
         goto fail;
     }
@@ -1060,8 +1292,23 @@ static zx_status_t nvme_bind(void* ctx, zx_device_t* dev) {
     };
     uint32_t nirq = 0;
     for (unsigned n = 0; n < countof(modes); n++) {
-        if ((pci_query_irq_mode(&nvme->pci, modes[n], &nirq) == ZX_OK) &&
-            (pci_set_irq_mode(&nvme->pci, modes[n], 1) == ZX_OK)) {
+        if (pci_query_irq_mode(&nvme->pci, modes[n], &nirq) != ZX_OK) {
+            continue;
+        }
+        // With MSI-X, try for a vector for the admin queue and for
+        // each IO queue pair.
+        uint32_t want = 1 + nvme->ioq_max;
+        if ((modes[n] == ZX_PCIE_IRQ_MODE_MSI_X) && (nirq > 1)) {
+            want = (nirq < want) ? nirq : want;
+            if (pci_set_irq_mode(&nvme->pci, modes[n], want) == ZX_OK) {
+                nvme->irq_count = want;
+                zxlogf(INFO, "nvme: irq mode %u, irq count %u of %u (#%u)\n",
+                       modes[n], want, nirq, n);
+                goto irq_configured;
+            }
+        }
+        if (pci_set_irq_mode(&nvme->pci, modes[n], 1) == ZX_OK) {
+            nvme->irq_count = 1;
             zxlogf(INFO, "nvme: irq mode %u, irq count %u (#%u)\n", modes[n], nirq, n);
             goto irq_configured;
         }
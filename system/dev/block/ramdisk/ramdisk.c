@@ -8,11 +8,11 @@
 #include <ddk/protocol/block.h>
 
 #include <zircon/device/ramdisk.h>
-#include <sync/completion.h>
 
 #include <assert.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,13 +35,15 @@ typedef struct ramdisk_device {
     uint64_t blk_count;
 
     mtx_t lock;
-    completion_t signal;
+    cnd_t cnd;
     list_node_t txn_list;
-    bool dead;
+    atomic_bool dead;
 
     uint32_t flags;
+    uint32_t options;
     zx_handle_t vmo;
-    thrd_t worker;
+    uint32_t num_workers;
+    thrd_t workers[RAMDISK_MAX_WORKERS];
     char name[NAME_MAX];
 } ramdisk_device_t;
 
@@ -50,61 +52,88 @@ typedef struct {
     list_node_t node;
 } ramdisk_txn_t;
 
-// The worker thread processes messages from iotxns in the background
+// Carries out a read, write or trim against the mapped VMO.
+static zx_status_t ramdisk_process(ramdisk_device_t* dev, block_op_t* op) {
+    void* addr = (void*) dev->mapped_addr + op->rw.offset_dev;
+    size_t len = op->rw.length * dev->blk_size;
+    size_t actual;
+
+    if (op->command == BLOCK_OP_TRIM) {
+        // Return whole pages to the system, and zero what is left at either end.
+        // A prefaulted disk keeps its pages, so that later transfers still never fault.
+        size_t off = op->trim.offset_dev;
+        size_t start = ROUNDUP(off, PAGE_SIZE);
+        size_t end = ROUNDDOWN(off + len, PAGE_SIZE);
+        if (start < end && !(dev->options & RAMDISK_OPT_PREFAULT)) {
+            memset(addr, 0, start - off);
+            memset((void*) dev->mapped_addr + end, 0, off + len - end);
+            if (zx_vmo_op_range(dev->vmo, ZX_VMO_OP_DECOMMIT, start, end - start,
+                                NULL, 0) != ZX_OK) {
+                memset((void*) dev->mapped_addr + start, 0, end - start);
+            }
+        } else {
+            memset(addr, 0, len);
+        }
+    } else if (op->command == BLOCK_OP_READ) {
+        if ((zx_vmo_write(op->rw.vmo, addr, op->rw.offset_vmo, len, &actual) != ZX_OK) ||
+            (actual != len)) {
+            return ZX_ERR_IO;
+        }
+    } else {
+        if ((zx_vmo_read(op->rw.vmo, addr, op->rw.offset_vmo, len, &actual) != ZX_OK) ||
+            (actual != len)) {
+            return ZX_ERR_IO;
+        }
+    }
+    return ZX_OK;
+}
+
+// The worker threads process messages from iotxns in the background
 static int worker_thread(void* arg) {
     ramdisk_device_t* dev = (ramdisk_device_t*)arg;
     ramdisk_txn_t* txn;
-    bool dead;
 
+    mtx_lock(&dev->lock);
     for (;;) {
-        for (;;) {
-            mtx_lock(&dev->lock);
-            dead = dev->dead;
-            txn = list_remove_head_type(&dev->txn_list, ramdisk_txn_t, node);
-            mtx_unlock(&dev->lock);
-            if (dead) {
-                goto goodbye;
-            }
-            if (txn == NULL) {
-                completion_wait(&dev->signal, ZX_TIME_INFINITE);
-            } else {
-                completion_reset(&dev->signal);
-                break;
-            }
+        while (!dev->dead && list_is_empty(&dev->txn_list)) {
+            cnd_wait(&dev->cnd, &dev->lock);
         }
-
-        zx_status_t status = ZX_OK;
-        void* addr = (void*) dev->mapped_addr + txn->op.rw.offset_dev;
-        size_t len = txn->op.rw.length * dev->blk_size;
-        size_t actual;
-
-        if (txn->op.command == BLOCK_OP_READ) {
-            if ((zx_vmo_write(txn->op.rw.vmo, addr, txn->op.rw.offset_vmo,
-                              len, &actual) != ZX_OK) ||
-                (actual != len)) {
-                status = ZX_ERR_IO;
-            }
-        } else {
-            if ((zx_vmo_read(txn->op.rw.vmo, addr, txn->op.rw.offset_vmo,
-                             len, &actual) != ZX_OK) ||
-                (actual != len)) {
-                status = ZX_ERR_IO;
-            }
+        txn = list_remove_head_type(&dev->txn_list, ramdisk_txn_t, node);
+        if (dev->dead) {
+            break;
         }
+        mtx_unlock(&dev->lock);
 
+        zx_status_t status = ramdisk_process(dev, &txn->op);
         txn->op.completion_cb(&txn->op, status);
+
+        mtx_lock(&dev->lock);
     }
 
-goodbye:
     while (txn != NULL) {
+        mtx_unlock(&dev->lock);
         txn->op.completion_cb(&txn->op, ZX_ERR_BAD_STATE);
         mtx_lock(&dev->lock);
         txn = list_remove_head_type(&dev->txn_list, ramdisk_txn_t, node);
-        mtx_unlock(&dev->lock);
     }
+    mtx_unlock(&dev->lock);
     return 0;
 }
 
+// Wakes the workers, which fail anything still queued, and waits for them to exit.
+static void ramdisk_stop_workers(ramdisk_device_t* ramdev) {
+    mtx_lock(&ramdev->lock);
+    ramdev->dead = true;
+    cnd_broadcast(&ramdev->cnd);
+    mtx_unlock(&ramdev->lock);
+
+    for (uint32_t i = 0; i < ramdev->num_workers; i++) {
+        int r;
+        thrd_join(ramdev->workers[i], &r);
+    }
+    ramdev->num_workers = 0;
+}
+
 static uint64_t sizebytes(ramdisk_device_t* rdev) {
     return rdev->blk_size * rdev->blk_count;
 }
@@ -116,7 +145,7 @@ static void ramdisk_get_info(void* ctx, block_info_t* info) {
     info->block_count = ramdev->blk_count;
     // Arbitrarily set, but matches the SATA driver for testing
     info->max_transfer_size = (1 << 25);
-    info->flags = ramdev->flags;
+    info->flags = ramdev->flags | BLOCK_FLAG_TRIM_SUPPORT;
 }
 
 // implement device protocol:
@@ -125,8 +154,8 @@ static void ramdisk_unbind(void* ctx) {
     ramdisk_device_t* ramdev = ctx;
     mtx_lock(&ramdev->lock);
     ramdev->dead = true;
+    cnd_broadcast(&ramdev->cnd);
     mtx_unlock(&ramdev->lock);
-    completion_signal(&ramdev->signal);
     device_remove(ramdev->zxdev);
 }
 
@@ -186,23 +215,36 @@ static void ramdisk_queue(void* ctx, block_op_t* bop) {
     switch ((txn->op.command &= BLOCK_OP_MASK)) {
     case BLOCK_OP_READ:
     case BLOCK_OP_WRITE:
+    case BLOCK_OP_TRIM:
+        // The trim fields line up with these.
         if ((txn->op.rw.offset_dev >= ramdev->blk_count) ||
             ((ramdev->blk_count - txn->op.rw.offset_dev) < txn->op.rw.length)) {
             bop->completion_cb(bop, ZX_ERR_OUT_OF_RANGE);
             return;
         }
         txn->op.rw.offset_dev *= ramdev->blk_size;
-        txn->op.rw.offset_vmo *= ramdev->blk_size;
+        if (txn->op.command != BLOCK_OP_TRIM) {
+            txn->op.rw.offset_vmo *= ramdev->blk_size;
+        }
+
+        if (ramdev->options & RAMDISK_OPT_INLINE) {
+            // Nothing here is shared between requests, so no lock is needed.
+            if (ramdev->dead) {
+                bop->completion_cb(bop, ZX_ERR_BAD_STATE);
+            } else {
+                bop->completion_cb(bop, ramdisk_process(ramdev, bop));
+            }
+            break;
+        }
 
         mtx_lock(&ramdev->lock);
         if (!(dead = ramdev->dead)) {
             list_add_tail(&ramdev->txn_list, &txn->node);
+            cnd_signal(&ramdev->cnd);
         }
         mtx_unlock(&ramdev->lock);
         if (dead) {
             bop->completion_cb(bop, ZX_ERR_BAD_STATE);
-        } else {
-            completion_signal(&ramdev->signal);
         }
         break;
     case BLOCK_OP_FLUSH:
@@ -226,18 +268,13 @@ static zx_off_t ramdisk_getsize(void* ctx) {
 static void ramdisk_release(void* ctx) {
     ramdisk_device_t* ramdev = ctx;
 
-    // Wake up the worker thread, in case it is sleeping
-    mtx_lock(&ramdev->lock);
-    ramdev->dead = true;
-    mtx_unlock(&ramdev->lock);
-    completion_signal(&ramdev->signal);
-
-    int r;
-    thrd_join(ramdev->worker, &r);
+    ramdisk_stop_workers(ramdev);
     if (ramdev->vmo != ZX_HANDLE_INVALID) {
         zx_vmar_unmap(zx_vmar_root_self(), ramdev->mapped_addr, sizebytes(ramdev));
         zx_handle_close(ramdev->vmo);
     }
+    cnd_destroy(&ramdev->cnd);
+    mtx_destroy(&ramdev->lock);
     free(ramdev);
 }
 
@@ -258,9 +295,11 @@ static zx_protocol_device_t ramdisk_instance_proto = {
 
 static uint64_t ramdisk_count = 0;
 
-// This always consumes the VMO handle.
+// This always consumes the VMO handle. |options| are RAMDISK_OPT_* flags, and
+// |num_workers| is how many threads handle requests unless they are handled inline.
 static zx_status_t ramctl_config(ramctl_device_t* ramctl, zx_handle_t vmo,
                                  uint64_t blk_size, uint64_t blk_count,
+                                 uint32_t options, uint32_t num_workers,
                                  void* reply, size_t max, size_t* out_actual) {
     zx_status_t status = ZX_ERR_INVALID_ARGS;
     if (max < 32) {
@@ -275,21 +314,43 @@ static zx_status_t ramctl_config(ramctl_device_t* ramctl, zx_handle_t vmo,
     if (mtx_init(&ramdev->lock, mtx_plain) != thrd_success) {
         goto fail_free;
     }
+    if (cnd_init(&ramdev->cnd) != thrd_success) {
+        goto fail_mtx;
+    }
     ramdev->vmo = vmo;
     ramdev->blk_size = blk_size;
     ramdev->blk_count = blk_count;
+    ramdev->options = options;
     snprintf(ramdev->name, sizeof(ramdev->name),
              "ramdisk-%" PRIu64, ramdisk_count++);
 
+    uint32_t map_flags = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE;
+    if (options & RAMDISK_OPT_PREFAULT) {
+        // Commit every page now and populate the page tables as it is mapped.
+        status = zx_vmo_op_range(ramdev->vmo, ZX_VMO_OP_COMMIT, 0, sizebytes(ramdev),
+                                 NULL, 0);
+        if (status != ZX_OK) {
+            goto fail_cnd;
+        }
+        map_flags |= ZX_VM_FLAG_MAP_RANGE;
+    }
     status = zx_vmar_map(zx_vmar_root_self(), 0, ramdev->vmo, 0, sizebytes(ramdev),
-                         ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE,
-                         &ramdev->mapped_addr);
+                         map_flags, &ramdev->mapped_addr);
     if (status != ZX_OK) {
-        goto fail_mtx;
+        goto fail_cnd;
     }
     list_initialize(&ramdev->txn_list);
-    if (thrd_create(&ramdev->worker, worker_thread, ramdev) != thrd_success) {
-        goto fail_unmap;
+    if (!(options & RAMDISK_OPT_INLINE)) {
+        if (num_workers == 0) {
+            num_workers = 1;
+        }
+        for (; ramdev->num_workers < num_workers; ramdev->num_workers++) {
+            if (thrd_create_with_name(&ramdev->workers[ramdev->num_workers], worker_thread,
+                                      ramdev, "ramdisk-worker") != thrd_success) {
+                status = ZX_ERR_NO_RESOURCES;
+                goto fail_workers;
+            }
+        }
     }
 
     device_add_args_t args = {
@@ -309,8 +370,11 @@ static zx_status_t ramctl_config(ramctl_device_t* ramctl, zx_handle_t vmo,
     *out_actual = strlen(reply);
     return ZX_OK;
 
-fail_unmap:
+fail_workers:
+    ramdisk_stop_workers(ramdev);
     zx_vmar_unmap(zx_vmar_root_self(), ramdev->mapped_addr, sizebytes(ramdev));
+fail_cnd:
+    cnd_destroy(&ramdev->cnd);
 fail_mtx:
     mtx_destroy(&ramdev->lock);
 fail_free:
@@ -332,11 +396,31 @@ static zx_status_t ramctl_ioctl(void* ctx, uint32_t op, const void* cmd,
         }
         ramdisk_ioctl_config_t* config = (ramdisk_ioctl_config_t*)cmd;
         zx_handle_t vmo;
+        zx_status_t status = zx_vmo_create(
+            config->blk_size * config->blk_count, 0, &vmo);
+        if (status == ZX_OK) {
+            status = ramctl_config(ramctl, vmo,
+                                   config->blk_size, config->blk_count, 0, 1,
+                                   reply, max, out_actual);
+        }
+        return status;
+    }
+    case IOCTL_RAMDISK_CONFIG_EX: {
+        if (cmdlen != sizeof(ramdisk_ioctl_config_ex_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        const ramdisk_ioctl_config_ex_t* config = cmd;
+        if ((config->options & ~RAMDISK_OPT_MASK) ||
+            (config->num_workers > RAMDISK_MAX_WORKERS)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        zx_handle_t vmo;
         zx_status_t status = zx_vmo_create(
             config->blk_size * config->blk_count, 0, &vmo);
         if (status == ZX_OK) {
             status = ramctl_config(ramctl, vmo,
                                    config->blk_size, config->blk_count,
+                                   config->options, config->num_workers,
                                    reply, max, out_actual);
         }
         return status;
@@ -366,7 +450,7 @@ static zx_status_t ramctl_ioctl(void* ctx, uint32_t op, const void* cmd,
         }
 
         return ramctl_config(ramctl, vmo,
-                             PAGE_SIZE, (vmo_size + PAGE_SIZE - 1) / PAGE_SIZE,
+                             PAGE_SIZE, (vmo_size + PAGE_SIZE - 1) / PAGE_SIZE, 0, 1,
                              reply, max, out_actual);
     }
     default:
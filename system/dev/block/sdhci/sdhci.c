@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
 #include <threads.h>
 
 // DDK Includes
@@ -465,7 +466,13 @@ static zx_status_t sdhci_start_txn_locked(sdhci_device_t* dev, iotxn_t* txn) {
         }
 
         if (cmd & SDMMC_CMD_MULTI_BLK) {
-            cmd |= SDMMC_CMD_AUTO12;
+            if ((cmd & SDMMC_CMD_AUTO23) && use_dma) {
+                // The controller sends SET_BLOCK_COUNT ahead of the command
+                // using the count in arg2, which ADMA2 leaves free.
+                regs->arg2 = blkcnt;
+            } else {
+                cmd = (cmd & ~SDMMC_CMD_AUTO23) | SDMMC_CMD_AUTO12;
+            }
         }
     } else if (cmd == MMC_SEND_TUNING_BLOCK) {
         cmd |= SDMMC_RESP_DATA_PRESENT | SDMMC_CMD_READ;
@@ -775,7 +782,9 @@ static zx_status_t sdhci_ioctl(void* ctx, uint32_t op,
         if (out_len != sizeof(uint32_t)) {
             return ZX_ERR_INVALID_ARGS;
         }
-        uint32_t max_transfer_size = DMA_DESC_COUNT * PAGE_SIZE;
+        // Bounded by the descriptor pool and by the 16 bit block count.
+        uint32_t max_transfer_size = MIN(DMA_DESC_COUNT * PAGE_SIZE,
+                                         UINT16_MAX * SDHC_BLOCK_SIZE);
         memcpy(out_buf, &max_transfer_size, sizeof(max_transfer_size));
         if (out_actual) {
             *out_actual = sizeof(max_transfer_size);
@@ -27,7 +27,7 @@
 #include "sdmmc.h"
 
 // TODO:
-// * close ended transfers
+// * close ended transfers on SD cards that support CMD23
 // * HS200/HS400
 
 // Various transfer states that the card can be in.
@@ -197,6 +197,33 @@ static zx_protocol_device_t sdmmc_device_proto = {
     .get_size = sdmmc_get_size,
 };
 
+// Waits for the card to return to the transfer state, stopping any open
+// ended transfer it is still receiving. |txn| is only used for commands.
+static zx_status_t sdmmc_wait_for_tran(sdmmc_t* sdmmc, iotxn_t* txn) {
+    sdmmc_protocol_data_t* pdata = iotxn_pdata(txn, sdmmc_protocol_data_t);
+    const size_t max_attempts = 10;
+    for (size_t attempt = 0; attempt <= max_attempts; attempt++) {
+        zx_status_t st = sdmmc_do_command(sdmmc->host_zxdev, SDMMC_SEND_STATUS,
+                                          sdmmc->rca << 16, txn);
+        if (st != ZX_OK) {
+            zxlogf(SPEW, "sdmmc: SDMMC_SEND_STATUS failed, retcode = %d\n", st);
+            return st;
+        }
+
+        uint8_t current_state = (pdata->response[0] >> 9) & 0xf;
+        if (current_state == SDMMC_STATE_RECV) {
+            sdmmc_do_command(sdmmc->host_zxdev, SDMMC_STOP_TRANSMISSION, 0, txn);
+            continue;
+        } else if (current_state == SDMMC_STATE_TRAN) {
+            return ZX_OK;
+        }
+
+        zx_nanosleep(zx_deadline_after(ZX_MSEC(10)));
+    }
+    // Too many retries, fail.
+    return ZX_ERR_BAD_STATE;
+}
+
 static void sdmmc_do_txn(sdmmc_t* sdmmc, iotxn_t* txn) {
     zxlogf(SPEW, "sdmmc: do_txn txn %p offset 0x%" PRIx64
                    " length 0x%" PRIx64 "\n", txn, txn->offset, txn->length);
@@ -238,38 +265,17 @@ static void sdmmc_do_txn(sdmmc_t* sdmmc, iotxn_t* txn) {
     clone->protocol = ZX_PROTOCOL_SDMMC;
     sdmmc_protocol_data_t* pdata = iotxn_pdata(clone, sdmmc_protocol_data_t);
 
-    // Following commands do not use the data buffer and
-    // it is safe to use the cloned iotxn
-
-    uint8_t current_state;
-    const size_t max_attempts = 10;
-    size_t attempt = 0;
-    for (; attempt <= max_attempts; attempt++) {
-        st = sdmmc_do_command(sdmmc_zxdev, SDMMC_SEND_STATUS, sdmmc->rca << 16, clone);
+    // A transfer that completed cleanly leaves the card back in TRAN, since
+    // it was either close-ended or stopped by the host. Only poll the card
+    // state after a failure, when it may still be sending or receiving.
+    if (sdmmc->check_card_state) {
+        st = sdmmc_wait_for_tran(sdmmc, clone);
         if (st != ZX_OK) {
-            zxlogf(SPEW, "sdmmc: iotxn_complete txn %p status %d (SDMMC_SEND_STATUS)\n",
-                    txn, st);
+            zxlogf(SPEW, "sdmmc: iotxn_complete txn %p status %d\n", txn, st);
             iotxn_complete(txn, st, 0);
             goto out;
         }
-
-        current_state = (pdata->response[0] >> 9) & 0xf;
-
-        if (current_state == SDMMC_STATE_RECV) {
-            st = sdmmc_do_command(sdmmc_zxdev, SDMMC_STOP_TRANSMISSION, 0, clone);
-            continue;
-        } else if (current_state == SDMMC_STATE_TRAN) {
-            break;
-        }
-
-        zx_nanosleep(zx_deadline_after(ZX_MSEC(10)));
-    }
-
-    if (attempt == max_attempts) {
-        // Too many retries, fail.
-        zxlogf(SPEW, "sdmmc: iotxn_complete txn %p status %d\n", txn, ZX_ERR_BAD_STATE);
-        iotxn_complete(txn, ZX_ERR_BAD_STATE, 0);
-        goto out;
+        sdmmc->check_card_state = false;
     }
 
     // Issue the data transfer
@@ -278,8 +284,15 @@ static void sdmmc_do_txn(sdmmc_t* sdmmc, iotxn_t* txn) {
     pdata->blockcount = clone->length / SDHC_BLOCK_SIZE;
     pdata->blocksize = SDHC_BLOCK_SIZE;
 
+    // eMMC always supports SET_BLOCK_COUNT, so make its multi-block
+    // transfers close-ended and skip the trailing STOP_TRANSMISSION.
+    if ((cmd & SDMMC_CMD_MULTI_BLK) && sdmmc->type == SDMMC_TYPE_MMC) {
+        cmd |= SDMMC_CMD_AUTO23;
+    }
+
     st = sdmmc_do_command(sdmmc_zxdev, cmd, blkid, clone);
     if (st != ZX_OK) {
+        sdmmc->check_card_state = true;
         zxlogf(SPEW, "sdmmc: iotxn_complete txn %p status %d (cmd 0x%x)\n", txn, st, cmd);
         iotxn_complete(txn, st, 0);
         goto out;
@@ -384,6 +397,7 @@ static zx_status_t sdmmc_bind(void* ctx, zx_device_t* dev) {
     }
 
     sdmmc->host_zxdev = dev;
+    sdmmc->check_card_state = true;
     mtx_init(&sdmmc->lock, mtx_plain);
     list_initialize(&sdmmc->txn_list);
 
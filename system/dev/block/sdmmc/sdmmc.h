@@ -49,6 +49,9 @@ typedef struct sdmmc {
     bool worker_thread_running;
 
     uint32_t max_transfer_size;
+
+    // The last data transfer failed, so the card state is unknown.
+    bool check_card_state;
 } sdmmc_t;
 
 // Issue a command to the host controller
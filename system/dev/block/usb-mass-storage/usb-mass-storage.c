@@ -50,14 +50,20 @@ static void ums_req_complete(usb_request_t* req, void* cookie) {
     }
 }
 
-static void ums_send_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint8_t flags,
-                         uint8_t command_len, void* command) {
+// Queues a CBW. If |completion| is NULL this waits for it to be sent;
+// otherwise |completion| is signaled when it has been, so that the caller can
+// queue the data stage behind it without waiting a round trip in between.
+static void ums_queue_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint8_t flags,
+                          uint8_t command_len, void* command, completion_t* completion) {
     usb_request_t* req = ums->cbw_req;
 
     ums_cbw_t* cbw;
     zx_status_t status = usb_request_mmap(req, (void **)&cbw);
     if (status != ZX_OK) {
         DEBUG_PRINT(("UMS: usb request mmap failed: %d\n", status));
+        if (completion) {
+            completion_signal(completion);
+        }
         return;
     }
 
@@ -72,10 +78,17 @@ static void ums_send_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint
     // copy command_len bytes from the command passed in into the command_len
     memcpy(cbw->CBWCB, command, command_len);
 
-    completion_t completion = COMPLETION_INIT;
-    req->cookie = &completion;
+    completion_t sync_completion = COMPLETION_INIT;
+    req->cookie = completion ? completion : &sync_completion;
     usb_request_queue(&ums->usb, req);
-    completion_wait(&completion, ZX_TIME_INFINITE);
+    if (!completion) {
+        completion_wait(&sync_completion, ZX_TIME_INFINITE);
+    }
+}
+
+static void ums_send_cbw(ums_t* ums, uint8_t lun, uint32_t transfer_length, uint8_t flags,
+                         uint8_t command_len, void* command) {
+    ums_queue_cbw(ums, lun, transfer_length, flags, command_len, command, NULL);
 }
 
 static zx_status_t ums_read_csw(ums_t* ums, uint32_t* out_residue) {
@@ -293,6 +306,7 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
             blocks = max_blocks;
         }
         size_t length = blocks * dev->block_size;
+        completion_t cbw_completion = COMPLETION_INIT;
 
         // CBW Configuration
         // Need to use UMS_READ16 if block addresses are greater than 32 bit
@@ -302,7 +316,8 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
             command.opcode = UMS_READ16;
             command.lba = htobe64(lba + blocks_transferred);
             command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command,
+                          &cbw_completion);
         } else if (blocks <= UINT16_MAX) {
             scsi_command10_t command;
             memset(&command, 0, sizeof(command));
@@ -310,18 +325,21 @@ static ssize_t ums_read(ums_block_t* dev, iotxn_t* txn) {
             command.lba = htobe32(lba + blocks_transferred);
             command.length_hi = blocks >> 8;
             command.length_lo = blocks & 0xFF;
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command,
+                          &cbw_completion);
         } else {
             scsi_command12_t command;
             memset(&command, 0, sizeof(command));
             command.opcode = UMS_READ12;
             command.lba = htobe32(lba + blocks_transferred);
             command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_IN, sizeof(command), &command,
+                          &cbw_completion);
         }
 
         status = ums_data_transfer(ums, txn, blocks_transferred * dev->block_size, length,
                                    ums->bulk_in_addr);
+        completion_wait(&cbw_completion, ZX_TIME_INFINITE);
         blocks_transferred += blocks;
 
         // receive CSW
@@ -365,6 +383,7 @@ static ssize_t ums_write(ums_block_t* dev, iotxn_t* txn) {
             blocks = max_blocks;
         }
         size_t length = blocks * dev->block_size;
+        completion_t cbw_completion = COMPLETION_INIT;
 
         // Need to use UMS_WRITE16 if block addresses are greater than 32 bit
         if (dev->total_blocks > UINT32_MAX) {
@@ -373,7 +392,8 @@ static ssize_t ums_write(ums_block_t* dev, iotxn_t* txn) {
             command.opcode = UMS_WRITE16;
             command.lba = htobe64(lba + blocks_transferred);
             command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command,
+                          &cbw_completion);
         } else if (blocks <= UINT16_MAX) {
             scsi_command10_t command;
             memset(&command, 0, sizeof(command));
@@ -381,18 +401,21 @@ static ssize_t ums_write(ums_block_t* dev, iotxn_t* txn) {
             command.lba = htobe32(lba + blocks_transferred);
             command.length_hi = blocks >> 8;
             command.length_lo = blocks & 0xFF;
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command,
+                          &cbw_completion);
         } else {
             scsi_command12_t command;
             memset(&command, 0, sizeof(command));
             command.opcode = UMS_WRITE12;
             command.lba = htobe32(lba + blocks_transferred);
             command.length = htobe32(blocks);
-            ums_send_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command);
+            ums_queue_cbw(ums, dev->lun, length, USB_DIR_OUT, sizeof(command), &command,
+                          &cbw_completion);
         }
 
         status = ums_data_transfer(ums, txn, blocks_transferred * dev->block_size, length,
                                    ums->bulk_out_addr);
+        completion_wait(&cbw_completion, ZX_TIME_INFINITE);
         blocks_transferred += blocks;
 
         // receive CSW
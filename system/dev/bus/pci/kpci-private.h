@@ -20,6 +20,11 @@ typedef struct kpci_device {
     // kernel pci handle, only set for shadow devices
     zx_handle_t handle;
 
+    // read-only mapping of the device's ECAM, only set for proxy devices
+    // whose config space is memory mapped
+    const volatile uint8_t* cfg;
+    uint32_t cfg_size;
+
     // nth device index
     uint32_t index;
 
@@ -38,6 +43,8 @@ typedef enum {
     PCI_OP_MAP_INTERRUPT,
     PCI_OP_GET_DEVICE_INFO,
     PCI_OP_GET_AUXDATA,
+    PCI_OP_CONFIG_READ_BULK,
+    PCI_OP_GET_CONFIG_VMO,
     PCI_OP_MAX,
 } pci_op_t;
 
@@ -79,6 +79,34 @@ static zx_status_t kpci_config_write(pci_msg_t* req, kpci_device_t* device, zx_h
     return pci_rpc_reply(ch, st, NULL, req, &resp);
 }
 
+// Reads |outlen| bytes of config space starting at |cfg.offset| in one syscall.
+static zx_status_t kpci_config_read_bulk(pci_msg_t* req, kpci_device_t* device, zx_handle_t ch) {
+    pci_msg_t resp = {};
+    if (req->outlen > sizeof(resp.data)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    zx_status_t st = zx_pci_config_read_bulk(device->handle, req->cfg.offset, resp.data,
+                                             req->outlen);
+    if (st == ZX_OK) {
+        resp.datalen = req->outlen;
+    }
+    return pci_rpc_reply(ch, st, NULL, req, &resp);
+}
+
+// Hands the proxy a read-only VMO of the device's ECAM so that it can serve
+// config reads without coming back here.
+static zx_status_t kpci_get_config_vmo(pci_msg_t* req, kpci_device_t* device, zx_handle_t ch) {
+    pci_msg_t resp = {};
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    uint32_t size;
+    zx_status_t st = zx_pci_get_config_vmo(device->handle, &size, &handle);
+    if (st == ZX_OK) {
+        resp.datalen = size;
+    }
+    return pci_rpc_reply(ch, st, &handle, req, &resp);
+}
+
 static zx_status_t kpci_get_auxdata(pci_msg_t* req, kpci_device_t* device, zx_handle_t ch) {
     char args[32];
     snprintf(args, sizeof(args), "%s,%02x:%02x:%02x", req->data,
@@ -128,10 +156,27 @@ static zx_status_t kpci_set_irq_mode(pci_msg_t* req, kpci_device_t* device, zx_h
     return pci_rpc_reply(ch, st, NULL, req, &resp);
 }
 
+// Interrupts are handed out round robin over the cpus, so a device with a
+// vector per queue gets its queues spread out and busy devices don't all end
+// up on the boot cpu. Interrupts that can't be moved stay where they are.
+static uint32_t next_irq_cpu;
+
+static void kpci_spread_interrupt(zx_handle_t handle) {
+    uint32_t cpu = __atomic_fetch_add(&next_irq_cpu, 1, __ATOMIC_RELAXED) %
+                   zx_system_get_num_cpus();
+    zx_status_t st = zx_interrupt_set_affinity(handle, ZX_PCI_INTERRUPT_SLOT, cpu);
+    if (st != ZX_OK && st != ZX_ERR_NOT_SUPPORTED) {
+        KPCIDBG("failed to steer interrupt to cpu %u: %d\n", cpu, st);
+    }
+}
+
 static zx_status_t kpci_map_interrupt(pci_msg_t* req, kpci_device_t* device, zx_handle_t ch) {
     pci_msg_t resp = {};
     zx_handle_t handle = ZX_HANDLE_INVALID;
     zx_status_t st = zx_pci_map_interrupt(device->handle, req->irq.which_irq, &handle);
+    if (st == ZX_OK) {
+        kpci_spread_interrupt(handle);
+    }
     return pci_rpc_reply(ch, st, &handle, req, &resp);
 }
 
@@ -161,6 +206,8 @@ const rxrpc_cbk_t rxrpc_cbk_tbl[] = {
     [PCI_OP_MAP_INTERRUPT] = kpci_map_interrupt,
     [PCI_OP_GET_DEVICE_INFO] = kpci_get_device_info,
     [PCI_OP_GET_AUXDATA] = kpci_get_auxdata,
+    [PCI_OP_CONFIG_READ_BULK] = kpci_config_read_bulk,
+    [PCI_OP_GET_CONFIG_VMO] = kpci_get_config_vmo,
     [PCI_OP_MAX] = NULL,
 };
 
@@ -176,6 +223,8 @@ const char* const rxrpc_string_tbl[] = {
     LABEL(PCI_OP_MAP_INTERRUPT),
     LABEL(PCI_OP_GET_DEVICE_INFO),
     LABEL(PCI_OP_GET_AUXDATA),
+    LABEL(PCI_OP_CONFIG_READ_BULK),
+    LABEL(PCI_OP_GET_CONFIG_VMO),
 };
 #undef LABEL
 static_assert(countof(rxrpc_string_tbl) == PCI_OP_MAX, "rpc string table is not contiguous!");
@@ -91,6 +91,22 @@ static zx_status_t pci_op_config_read(void* ctx, uint16_t offset, size_t width,
         return ZX_ERR_INVALID_ARGS;
     }
 
+    // Aligned reads inside config space come straight from the mapped ECAM.
+    // Anything else is left to the kernel to validate.
+    if (dev->cfg && (offset & (width - 1)) == 0 && offset + width <= dev->cfg_size) {
+        switch (width) {
+        case sizeof(uint8_t):
+            *val = *(const volatile uint8_t*)(dev->cfg + offset);
+            return ZX_OK;
+        case sizeof(uint16_t):
+            *val = *(const volatile uint16_t*)(dev->cfg + offset);
+            return ZX_OK;
+        case sizeof(uint32_t):
+            *val = *(const volatile uint32_t*)(dev->cfg + offset);
+            return ZX_OK;
+        }
+    }
+
     pci_msg_t req = {
         .cfg = {
             .offset = offset,
@@ -125,24 +141,65 @@ static zx_status_t pci_op_config_write(void* ctx, uint16_t offset, size_t width,
     return pci_rpc_request(dev, PCI_OP_CONFIG_WRITE, NULL, &req, &resp);
 }
 
+// Copies |len| bytes of config space starting at |offset| into |buf|, from the
+// mapped ECAM if there is one and otherwise with a single rpc.
+static zx_status_t pci_config_read_range(kpci_device_t* dev, uint16_t offset,
+                                         uint8_t* buf, size_t len) {
+    if (dev->cfg) {
+        if (offset + len > dev->cfg_size) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        for (size_t i = 0; i < len;) {
+            if (((offset + i) & 0x3) == 0 && len - i >= sizeof(uint32_t)) {
+                uint32_t val = *(const volatile uint32_t*)(dev->cfg + offset + i);
+                memcpy(buf + i, &val, sizeof(val));
+                i += sizeof(val);
+            } else {
+                buf[i] = dev->cfg[offset + i];
+                i++;
+            }
+        }
+        return ZX_OK;
+    }
+
+    pci_msg_t req = {
+        .cfg.offset = offset,
+        .outlen = len,
+    };
+    pci_msg_t resp = {};
+    zx_status_t st = pci_rpc_request(dev, PCI_OP_CONFIG_READ_BULK, NULL, &req, &resp);
+    if (st != ZX_OK) {
+        return st;
+    }
+    if (resp.datalen != len) {
+        return ZX_ERR_INTERNAL;
+    }
+    memcpy(buf, resp.data, len);
+    return ZX_OK;
+}
+
 static uint8_t pci_op_get_next_capability(void* ctx, uint8_t offset, uint8_t type) {
-    uint32_t cap_offset = 0;
-    pci_op_config_read(ctx, offset + 1, sizeof(uint8_t), &cap_offset);
+    // The capability list lives in the standard header, so walk a snapshot of
+    // it rather than reading it a byte at a time.
+    uint8_t cfg[ZX_PCI_BASE_CONFIG_SIZE];
+    zx_status_t st = pci_config_read_range(ctx, 0, cfg, sizeof(cfg));
+    if (st != ZX_OK) {
+        zxlogf(ERROR, "%s: error reading config header: %d\n", __func__, st);
+        return 0;
+    }
+
+    if (offset >= UINT8_MAX) {
+        zxlogf(ERROR, "%s: %#x is an invalid capability offset!\n", __func__, offset);
+        return 0;
+    }
+    uint32_t cap_offset = cfg[offset + 1];
     uint8_t limit = 64;
-    zx_status_t st;
 
     // Walk the capability list looking for the type requested, starting at the offset
     // passed in. limit acts as a barrier in case of an invalid capability pointer list
     // that causes us to iterate forever otherwise.
     while (cap_offset != 0 && limit--) {
-        uint32_t type_id = 0;
-        if ((st = pci_op_config_read(ctx, cap_offset, sizeof(uint8_t), &type_id)) != ZX_OK) {
-            zxlogf(ERROR, "%s: error reading type from cap offset %#x: %d\n",
-                   __func__, cap_offset, st);
-            return 0;
-        }
-
-        if (type_id == type) {
+        if (cfg[cap_offset] == type) {
             return cap_offset;
         }
 
@@ -152,11 +209,7 @@ static uint8_t pci_op_get_next_capability(void* ctx, uint8_t offset, uint8_t typ
             zxlogf(ERROR, "%s: %#x is an invalid capability offset!\n", __func__, cap_offset);
             return 0;
         }
-        if ((st = pci_op_config_read(ctx, cap_offset + 1, sizeof(uint8_t), &cap_offset)) != ZX_OK) {
-            zxlogf(ERROR, "%s: error reading next cap from cap offset %#x: %d\n",
-                   __func__, cap_offset + 1, st);
-            return 0;
-        }
+        cap_offset = cfg[cap_offset + 1];
     }
 
     // No more entries are in the list
@@ -349,6 +402,30 @@ static zx_protocol_device_t device_ops = {
     .version = DEVICE_OPS_VERSION,
 };
 
+// Config reads are served from a read-only mapping of the device's ECAM when
+// the kernel hands one out, instead of a round trip to the top devhost and a
+// syscall for every register. Without one they keep going over rpc.
+static void pci_proxy_map_config(kpci_device_t* dev) {
+    pci_msg_t req = {};
+    pci_msg_t resp = {};
+    zx_handle_t vmo = ZX_HANDLE_INVALID;
+    zx_status_t st = pci_rpc_request(dev, PCI_OP_GET_CONFIG_VMO, &vmo, &req, &resp);
+    if (st != ZX_OK) {
+        return;
+    }
+
+    uintptr_t vaddr;
+    st = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, PAGE_SIZE,
+                     ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_MAP_RANGE, &vaddr);
+    zx_handle_close(vmo);
+    if (st != ZX_OK) {
+        zxlogf(ERROR, "%s: failed to map config space: %d\n", __func__, st);
+        return;
+    }
+    dev->cfg = (const volatile uint8_t*)vaddr;
+    dev->cfg_size = resp.datalen;
+}
+
 static zx_status_t pci_proxy_create(void* ctx, zx_device_t* parent,
                                     const char* name, const char* args,
                                     zx_handle_t rpcch) {
@@ -373,6 +450,7 @@ static zx_status_t pci_proxy_create(void* ctx, zx_device_t* parent,
         free(device);
         return st;
     }
+    pci_proxy_map_config(device);
 
     char devname[20];
     snprintf(devname, sizeof(devname), "%02x:%02x.%1x", info.bus_id, info.dev_id, info.func_id);
@@ -144,9 +144,12 @@ bool PciLegacyBackend::ReadFeature(uint32_t feature) {
     fbl::AutoLock lock(&lock_);
     uint32_t val;
 
-    ZX_DEBUG_ASSERT((feature & (feature-1)) == 0);
+    // The legacy interface only has the first 32 feature bits.
+    if (feature >= 32) {
+        return false;
+    }
     IoReadLocked(VIRTIO_PCI_DEVICE_FEATURES, &val);
-    bool is_set = (val & feature) > 0;
+    bool is_set = (val & (1u << feature)) > 0;
     zxlogf(SPEW, "%s: read feature bit %u = %u\n", tag(), feature, is_set);
     return is_set;
 }
@@ -155,9 +158,9 @@ void PciLegacyBackend::SetFeature(uint32_t feature) {
     fbl::AutoLock lock(&lock_);
     uint32_t val;
 
-    ZX_DEBUG_ASSERT((feature & (feature-1)) == 0);
+    ZX_DEBUG_ASSERT(feature < 32);
     IoReadLocked(VIRTIO_PCI_DRIVER_FEATURES, &val);
-    IoWriteLocked(VIRTIO_PCI_DRIVER_FEATURES, val | feature);
+    IoWriteLocked(VIRTIO_PCI_DRIVER_FEATURES, val | (1u << feature));
     zxlogf(SPEW, "%s: feature bit %u now set\n", tag(), feature);
 }
 
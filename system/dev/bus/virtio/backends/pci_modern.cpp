@@ -258,8 +258,8 @@ void PciModernBackend::RingKick(uint16_t ring_index) {
 
 bool PciModernBackend::ReadFeature(uint32_t feature) {
     fbl::AutoLock lock(&lock_);
-    uint32_t select = static_cast<uint32_t>(feature / sizeof(uint32_t));
-    uint32_t bit = feature % sizeof(uint32_t);
+    uint32_t select = feature / 32;
+    uint32_t bit = 1u << (feature % 32);
     uint32_t val;
 
     MmioWrite(&common_cfg_->device_feature_select, select);
@@ -271,8 +271,8 @@ bool PciModernBackend::ReadFeature(uint32_t feature) {
 
 void PciModernBackend::SetFeature(uint32_t feature) {
     fbl::AutoLock lock(&lock_);
-    uint32_t select = static_cast<uint32_t>(feature / sizeof(uint32_t));
-    uint32_t bit = feature % sizeof(uint32_t);
+    uint32_t select = feature / 32;
+    uint32_t bit = 1u << (feature % 32);
     uint32_t val;
 
     MmioWrite(&common_cfg_->driver_feature_select, select);
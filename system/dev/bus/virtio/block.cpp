@@ -6,6 +6,7 @@
 
 #include <ddk/debug.h>
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <inttypes.h>
 #include <pretty/hexdump.h>
@@ -14,6 +15,7 @@
 #include <string.h>
 #include <sys/param.h>
 #include <zircon/compiler.h>
+#include <zircon/syscalls.h>
 
 #include "trace.h"
 #include "utils.h"
@@ -60,7 +62,8 @@ void BlockDevice::GetInfo(block_info_t* info) {
     memset(info, 0, sizeof(*info));
     info->block_size = GetBlockSize();
     info->block_count = GetSize() / GetBlockSize();
-    info->max_transfer_size = (uint32_t)(PAGE_SIZE * (ring_size - 2));
+    // a transfer takes a descriptor for each page, and one each for the header and status
+    info->max_transfer_size = (uint32_t)(PAGE_SIZE * (queues_[0]->size - 2));
 }
 
 zx_status_t BlockDevice::virtio_block_ioctl(void* ctx, uint32_t op, const void* in_buf, size_t in_len,
@@ -119,31 +122,48 @@ zx_status_t BlockDevice::Init() {
     // ack and set the driver status bit
     DriverStatusAck();
 
-    // XXX check features bits and ack/nak them
-
-    // allocate the main vring
-    auto err = vring_.Init(0, ring_size);
-    if (err < 0) {
-        zxlogf(ERROR, "failed to allocate vring\n");
-        return err;
+    // Indirect descriptors let a request take a single ring descriptor however many runs it
+    // has, and the event index lets us skip kicks while the device is still working. With
+    // several queues, requests from different threads don't contend for a single ring.
+    bool indirect = DeviceFeatureSupported(VIRTIO_RING_F_INDIRECT_DESC);
+    bool event_idx = DeviceFeatureSupported(VIRTIO_RING_F_EVENT_IDX);
+    bool mq = DeviceFeatureSupported(VIRTIO_BLK_F_MQ);
+    if (indirect)
+        DriverFeatureAck(VIRTIO_RING_F_INDIRECT_DESC);
+    if (event_idx)
+        DriverFeatureAck(VIRTIO_RING_F_EVENT_IDX);
+    if (mq)
+        DriverFeatureAck(VIRTIO_BLK_F_MQ);
+    if ((indirect || event_idx || mq) && DeviceStatusFeaturesOk() != ZX_OK) {
+        // start over without them
+        zxlogf(ERROR, "%s: ring features rejected\n", tag());
+        indirect = event_idx = mq = false;
+        DeviceReset();
+        DriverStatusAck();
     }
 
-    // allocate a queue of block requests
-    size_t size = sizeof(virtio_blk_req_t) * blk_req_count + sizeof(uint8_t) * blk_req_count;
-
-    zx_status_t r = map_contiguous_memory(size, (uintptr_t*)&blk_req_, &blk_req_pa_);
-    if (r < 0) {
-        zxlogf(ERROR, "cannot alloc blk_req buffers %d\n", r);
-        return r;
+    // a queue per cpu, as far as the device has them
+    num_queues_ = 1;
+    if (mq && config_.num_queues > 1) {
+        num_queues_ = fbl::min(static_cast<size_t>(config_.num_queues),
+                               fbl::min(static_cast<size_t>(zx_system_get_num_cpus()),
+                                        static_cast<size_t>(max_queues)));
+    }
+    LTRACEF("num_queues %zu\n", num_queues_);
+
+    for (size_t i = 0; i < num_queues_; i++) {
+        fbl::AllocChecker ac;
+        queues_[i].reset(new (&ac) Queue(this));
+        if (!ac.check()) {
+            zxlogf(ERROR, "%s: cannot allocate queue %zu\n", tag(), i);
+            return ZX_ERR_NO_MEMORY;
+        }
+        zx_status_t status = InitQueue(queues_[i].get(), static_cast<uint16_t>(i), indirect,
+                                       event_idx);
+        if (status != ZX_OK) {
+            return status;
+        }
     }
-
-    LTRACEF("allocated blk request at %p, physical address %#" PRIxPTR "\n", blk_req_, blk_req_pa_);
-
-    // responses are 32 words at the end of the allocated block
-    blk_res_pa_ = blk_req_pa_ + sizeof(virtio_blk_req_t) * blk_req_count;
-    blk_res_ = (uint8_t*)((uintptr_t)blk_req_ + sizeof(virtio_blk_req_t) * blk_req_count);
-
-    LTRACEF("allocated blk responses at %p, physical address %#" PRIxPTR "\n", blk_res_, blk_res_pa_);
 
     // start the interrupt thread
     StartIrqThread();
@@ -173,14 +193,57 @@ zx_status_t BlockDevice::Init() {
     return ZX_OK;
 }
 
-void BlockDevice::IrqRingUpdate() {
-    LTRACE_ENTRY;
+zx_status_t BlockDevice::InitQueue(Queue* queue, uint16_t index, bool indirect,
+                                   bool event_idx) {
+    // as deep as the device allows, so that it always has work queued
+    queue->size = fbl::min(GetRingSize(index), static_cast<uint16_t>(max_ring_size));
+    if (queue->size < 3) {
+        zxlogf(ERROR, "%s: queue %u is too small (%u)\n", tag(), index, queue->size);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    zx_status_t status = queue->ring.Init(index, queue->size);
+    if (status != ZX_OK) {
+        zxlogf(ERROR, "failed to allocate vring\n");
+        return status;
+    }
+    if (event_idx)
+        queue->ring.EnableEventIndex();
+    if (indirect && queue->ring.InitIndirect(max_indirect_descs) != ZX_OK)
+        zxlogf(ERROR, "%s: no indirect descriptors, using plain chains\n", tag());
+
+    // a block request and response for each descriptor that can head a chain
+    queue->mem_size = (sizeof(virtio_blk_req_t) + sizeof(uint8_t)) * queue->size;
+    status = map_contiguous_memory(queue->mem_size, (uintptr_t*)&queue->req, &queue->req_pa);
+    if (status != ZX_OK) {
+        zxlogf(ERROR, "cannot alloc blk_req buffers %d\n", status);
+        return status;
+    }
+
+    LTRACEF("allocated blk requests at %p, physical address %#" PRIxPTR "\n", queue->req,
+            queue->req_pa);
 
+    // responses are at the end of the allocated block
+    queue->res_pa = queue->req_pa + sizeof(virtio_blk_req_t) * queue->size;
+    queue->res = (uint8_t*)((uintptr_t)queue->req + sizeof(virtio_blk_req_t) * queue->size);
+
+    fbl::AllocChecker ac;
+    queue->inflight.reset(new (&ac) list_node[queue->size]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    for (uint16_t i = 0; i < queue->size; i++) {
+        list_initialize(&queue->inflight[i]);
+    }
+    return ZX_OK;
+}
+
+void BlockDevice::ReapLocked(Queue* queue, list_node* done) {
     // parse our descriptor chain, add back to the free queue
-    auto free_chain = [this](vring_used_elem* used_elem) {
-        uint32_t i = (uint16_t)used_elem->id;
-        struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
-        auto head_desc = desc; // save the first element
+    auto free_chain = [queue, done](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        uint32_t i = head;
+        struct vring_desc* desc = queue->ring.DescFromIndex(head);
         for (;;) {
             int next;
             LTRACE_DO(virtio_dump_desc(desc));
@@ -191,29 +254,46 @@ void BlockDevice::IrqRingUpdate() {
                 next = -1;
             }
 
-            vring_.FreeDesc((uint16_t)i);
+            queue->ring.FreeDesc((uint16_t)i);
 
             if (next < 0)
                 break;
             i = next;
-            desc = vring_.DescFromIndex((uint16_t)i);
+            desc = queue->ring.DescFromIndex((uint16_t)i);
         }
 
-        // search our pending txn list to see if this completes it
+        // every iotxn merged into the chain shares its status
+        zx_status_t status = (queue->res[head] == VIRTIO_BLK_S_OK) ? ZX_OK : ZX_ERR_IO;
         iotxn_t* txn;
-        list_for_every_entry (&iotxn_list, txn, iotxn_t, node) {
-            if (txn->context == head_desc) {
-                LTRACEF("completes txn %p\n", txn);
-                free_blk_req((unsigned int)txn->extra[1]);
-                list_delete(&txn->node);
-                iotxn_complete(txn, ZX_OK, txn->length);
-                break;
-            }
+        while ((txn = list_remove_head_type(&queue->inflight[head], iotxn_t, node)) != nullptr) {
+            LTRACEF("completes txn %p, status %d\n", txn, status);
+            txn->status = status;
+            list_add_tail(done, &txn->node);
         }
     };
 
     // tell the ring to find free chains and hand it back to our lambda
-    vring_.IrqRingUpdate(free_chain);
+    queue->ring.IrqRingUpdate(free_chain);
+}
+
+void BlockDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
+
+    for (size_t i = 0; i < num_queues_; i++) {
+        Queue* queue = queues_[i].get();
+        list_node done = LIST_INITIAL_VALUE(done);
+        {
+            fbl::AutoLock lock(&queue->lock);
+            ReapLocked(queue, &done);
+            // the freed descriptors make room for requests that were waiting
+            DrainLocked(queue);
+        }
+
+        iotxn_t* txn;
+        while ((txn = list_remove_head_type(&done, iotxn_t, node)) != nullptr) {
+            iotxn_complete(txn, txn->status, (txn->status == ZX_OK) ? txn->length : 0);
+        }
+    }
 }
 
 void BlockDevice::IrqConfigChange() {
@@ -256,13 +336,14 @@ static void ScatterGatherHelper(const iotxn_t* txn, callback callback_new_run) {
         callback_new_run(run_start, run_len);
 }
 
+// the number of physical runs of an iotxn, stashed in its context while it is pending
+static size_t RunCount(const iotxn_t* txn) {
+    return reinterpret_cast<uintptr_t>(txn->context);
+}
+
 void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     LTRACEF("txn %p, pflags %#x\n", txn, txn->pflags);
 
-    fbl::AutoLock lock(&lock_);
-
-    bool write = (txn->opcode == IOTXN_OP_WRITE);
-
     // offset must be aligned to block size
     if (txn->offset % config_.blk_size) {
         LTRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
@@ -288,27 +369,13 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
         return;
     }
 
-    // allocate and start filling out a block request
-    auto index = alloc_blk_req();
-    if (index >= blk_req_count) {
-        TRACEF("too many block requests queued (%zu)!\n", index);
-        iotxn_complete(txn, ZX_ERR_NO_RESOURCES, 0);
-        return;
-    }
-
-    auto req = &blk_req_[index];
-    req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
-    req->ioprio = 0;
-    req->sector = txn->offset / 512;
-    LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
-            req->type, req->ioprio, req->sector);
-
-    // save the req index into the txn->extra[1] slot so we can free it when we complete the transfer
-    txn->extra[1] = index;
-
     // get the physical map for the transfer
     auto status = iotxn_physmap(txn);
     LTRACEF("status %d, pflags %#x\n", status, txn->pflags);
+    if (status != ZX_OK) {
+        iotxn_complete(txn, status, 0);
+        return;
+    }
 #if LOCAL_TRACE
     LTRACEF("phys %p, phys_count %#lx\n", txn->phys, txn->phys_count);
     for (uint64_t i = 0; i < txn->phys_count; i++) {
@@ -331,30 +398,101 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     LTRACEF("run count %lu\n", run_count);
     assert(run_count > 0);
 
-    /* put together a transfer */
-    uint16_t i;
-    auto desc = vring_.AllocDescChain((uint16_t)(2u + run_count), &i);
-    if (!desc) {
-        TRACEF("failed to allocate descriptor chain of length %zu\n", 2u + run_count);
-        // TODO: handle this scenario by requeing the transfer in smaller runs
-        iotxn_complete(txn, ZX_ERR_NO_RESOURCES, 0);
+    // Nearby requests go to the same queue, where they can be merged; others are spread across
+    // the queues.
+    Queue* queue = queues_[(txn->offset / queue_stripe_size) % num_queues_].get();
+    if (2u + run_count > queue->size) {
+        TRACEF("transfer of %zu runs does not fit in the ring\n", run_count);
+        iotxn_complete(txn, ZX_ERR_OUT_OF_RANGE, 0);
         return;
     }
+    txn->context = reinterpret_cast<void*>(run_count);
 
-    LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
+    fbl::AutoLock lock(&queue->lock);
 
-    /* point the iotxn at this head descriptor */
-    txn->context = desc;
+    // keep the pending list sorted by offset
+    iotxn_t* next;
+    list_for_every_entry (&queue->pending, next, iotxn_t, node) {
+        if (next->offset > txn->offset) {
+            break;
+        }
+    }
+    // adding to the tail of an entry's node puts the txn just before it, or at the very end of
+    // the list if there was no such entry
+    list_add_tail(&next->node, &txn->node);
 
-    /* set up the descriptor pointing to the head */
-    desc->addr = blk_req_pa_ + index * sizeof(virtio_blk_req_t);
-    desc->len = sizeof(virtio_blk_req_t);
-    desc->flags = VRING_DESC_F_NEXT;
-    LTRACE_DO(virtio_dump_desc(desc));
-    {
-        auto new_run_callback = [this, write, &desc](uint64_t start, uint64_t len) {
+    DrainLocked(queue);
+}
+
+void BlockDevice::DrainLocked(Queue* queue) {
+    while (!list_is_empty(&queue->pending)) {
+        // Sweep up through the offsets from where the last request ended, then start again from
+        // the lowest, so that requests in sorted order reach the device and none waits forever.
+        iotxn_t* first;
+        list_for_every_entry (&queue->pending, first, iotxn_t, node) {
+            if (first->offset >= queue->last_offset) {
+                break;
+            }
+        }
+        if (&first->node == &queue->pending) {
+            first = list_peek_head_type(&queue->pending, iotxn_t, node);
+        }
+
+        // take in the requests that carry on where the previous one ended, while the chain
+        // still fits in an indirect table
+        bool write = (first->opcode == IOTXN_OP_WRITE);
+        size_t count = 2u + RunCount(first);
+        uint64_t end = first->offset + first->length;
+        iotxn_t* last = first;
+        iotxn_t* txn;
+        while ((txn = list_next_type(&queue->pending, &last->node, iotxn_t, node)) != nullptr) {
+            if (txn->opcode != first->opcode || txn->offset != end ||
+                end + txn->length - first->offset > max_merge_size ||
+                count + RunCount(txn) > max_indirect_descs) {
+                break;
+            }
+            count += RunCount(txn);
+            end += txn->length;
+            last = txn;
+        }
+
+        /* put together a transfer, in an indirect table if it fits */
+        uint16_t head;
+        bool indirect = true;
+        auto desc = queue->ring.AllocIndirectChain((uint16_t)count, &head);
+        if (!desc) {
+            indirect = false;
+            desc = queue->ring.AllocDescChain((uint16_t)count, &head);
+        }
+        if (!desc) {
+            // the ring is full; what's left goes out as chains complete
+            LTRACEF("no room for a descriptor chain of length %zu\n", count);
+            break;
+        }
+
+        LTRACEF("after alloc chain desc %p, head %u\n", desc, head);
+
+        auto next_desc = [queue, indirect, head](vring_desc* desc) {
+            return indirect ? queue->ring.IndirectFromIndex(head, desc->next)
+                            : queue->ring.DescFromIndex(desc->next);
+        };
+
+        auto req = &queue->req[head];
+        req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+        req->ioprio = 0;
+        req->sector = first->offset / 512;
+        LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
+                req->type, req->ioprio, req->sector);
+
+        /* set up the descriptor pointing to the head */
+        desc->addr = queue->req_pa + head * sizeof(virtio_blk_req_t);
+        desc->len = sizeof(virtio_blk_req_t);
+        desc->flags = VRING_DESC_F_NEXT;
+        LTRACE_DO(virtio_dump_desc(desc));
+
+        auto new_run_callback = [write, &desc, &next_desc](uint64_t start, uint64_t len) {
             /* set up the descriptor pointing to the buffer */
-            desc = vring_.DescFromIndex(desc->next);
+            desc = next_desc(desc);
 
             desc->addr = start;
             desc->len = (uint32_t)len;
@@ -365,25 +503,30 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
                 desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
         };
 
-        ScatterGatherHelper(txn, new_run_callback);
+        /* the runs of each merged iotxn, in order, which now belong to this chain */
+        do {
+            txn = first;
+            first = list_next_type(&queue->pending, &txn->node, iotxn_t, node);
+            ScatterGatherHelper(txn, new_run_callback);
+            list_delete(&txn->node);
+            list_add_tail(&queue->inflight[head], &txn->node);
+        } while (txn != last);
+        LTRACE_DO(virtio_dump_desc(desc));
+
+        /* set up the descriptor pointing to the response */
+        desc = next_desc(desc);
+        desc->addr = queue->res_pa + head;
+        desc->len = 1;
+        desc->flags = VRING_DESC_F_WRITE;
+        LTRACE_DO(virtio_dump_desc(desc));
+
+        /* submit the transfer */
+        queue->ring.SubmitChain(head);
+        queue->last_offset = end;
     }
-    LTRACE_DO(virtio_dump_desc(desc));
-
-    /* set up the descriptor pointing to the response */
-    desc = vring_.DescFromIndex(desc->next);
-    desc->addr = blk_res_pa_ + index;
-    desc->len = 1;
-    desc->flags = VRING_DESC_F_WRITE;
-    LTRACE_DO(virtio_dump_desc(desc));
-
-    // save the iotxn in a list
-    list_add_tail(&iotxn_list, &txn->node);
-
-    /* submit the transfer */
-    vring_.SubmitChain(i);
 
-    /* kick it off */
-    vring_.Kick();
+    /* kick it all off at once, unless the device is still busy with earlier ones */
+    queue->ring.Kick();
 }
 
 } // namespace virtio
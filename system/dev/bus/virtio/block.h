@@ -6,8 +6,12 @@
 #include "device.h"
 #include "ring.h"
 
+#include <fbl/mutex.h>
+#include <fbl/unique_ptr.h>
 #include <stdlib.h>
 #include <zircon/compiler.h>
+#include <zircon/listnode.h>
+#include <zircon/thread_annotations.h>
 
 #include "backends/backend.h"
 #include <virtio/block.h>
@@ -43,40 +47,60 @@ private:
 
     void QueueReadWriteTxn(iotxn_t* txn);
 
-    // the main virtio ring
-    Ring vring_ = {this};
+    // the most queues used, however many the device has
+    static const size_t max_queues = 16;
 
-    static const uint16_t ring_size = 128; // 128 matches legacy pci
+    // Rings are as deep as the device allows, up to this; beyond it the contiguous memory for the
+    // ring and its indirect tables buys little.
+    static const uint16_t max_ring_size = 1024;
 
-    // saved block device configuration out of the pci config BAR
-    virtio_blk_config_t config_ = {};
+    // the longest chain that fits in an indirect table, when they are negotiated
+    static const uint16_t max_indirect_descs = 32;
+
+    // contiguous requests are merged up to this size
+    static const uint64_t max_merge_size = 1024 * 1024;
+
+    // requests are spread over the queues in stripes of this size, so that a sequential stream
+    // stays on one queue and can be merged there
+    static const uint64_t queue_stripe_size = 1024 * 1024;
+
+    struct Queue {
+        explicit Queue(Device* device) : ring(device) {}
 
-    // a queue of block request/responses
-    static const size_t blk_req_count = 32;
+        fbl::Mutex lock;
+        Ring ring;
+        uint16_t size = 0;
 
-    zx_paddr_t blk_req_pa_ = 0;
-    virtio_blk_req_t* blk_req_ = nullptr;
+        // a request header and status byte for each chain, indexed by its head descriptor
+        zx_paddr_t req_pa = 0;
+        virtio_blk_req_t* req = nullptr;
+        zx_paddr_t res_pa = 0;
+        uint8_t* res = nullptr;
+        size_t mem_size = 0;
 
-    zx_paddr_t blk_res_pa_ = 0;
-    uint8_t* blk_res_ = nullptr;
+        // the iotxns carried by each chain, indexed by its head descriptor
+        fbl::unique_ptr<list_node[]> inflight;
 
-    uint32_t blk_req_bitmap_ = 0;
-    static_assert(blk_req_count <= sizeof(blk_req_bitmap_) * CHAR_BIT, "");
+        // iotxns waiting for room in the ring, sorted by offset, and where the last submission
+        // ended, so that the next one is taken from after it
+        list_node pending = LIST_INITIAL_VALUE(pending);
+        uint64_t last_offset = 0;
+    };
 
-    size_t alloc_blk_req() {
-        size_t i = 0;
-        if (blk_req_bitmap_ != 0)
-            i = sizeof(blk_req_bitmap_) * CHAR_BIT - __builtin_clz(blk_req_bitmap_);
-        blk_req_bitmap_ |= (1 << i);
-        return i;
-    }
+    zx_status_t InitQueue(Queue* queue, uint16_t index, bool indirect, bool event_idx);
 
-    void free_blk_req(size_t i) {
-        blk_req_bitmap_ &= ~(1 << i);
-    }
+    // Submits as many pending iotxns as fit in the ring, merging contiguous ones, and kicks the
+    // device once at the end.
+    void DrainLocked(Queue* queue) TA_REQ(queue->lock);
+
+    // Moves the iotxns of completed chains to |done|.
+    void ReapLocked(Queue* queue, list_node* done) TA_REQ(queue->lock);
+
+    // saved block device configuration out of the pci config BAR
+    virtio_blk_config_t config_ = {};
 
-    // pending iotxns
-    list_node iotxn_list = LIST_INITIAL_VALUE(iotxn_list);
+    fbl::unique_ptr<Queue> queues_[max_queues];
+    size_t num_queues_ = 0;
 };
 
 } // namespace virtio
@@ -59,7 +59,7 @@ protected:
     // Methods for checking / acknowledging features
     bool DeviceFeatureSupported(uint32_t feature) { return backend_->ReadFeature(feature); }
     void DriverFeatureAck(uint32_t feature) { backend_->SetFeature(feature); }
-    bool DeviceStatusFeaturesOk() { return backend_->ConfirmFeatures(); }
+    zx_status_t DeviceStatusFeaturesOk() { return backend_->ConfirmFeatures(); }
 
     // Devie lifecycle methods
     void DeviceReset() { backend_->DeviceReset(); }
@@ -175,11 +175,37 @@ uint8_t* GetFrameData(io_buffer_t* bufs, uint16_t ring_id, uint16_t desc_id) {
     return reinterpret_cast<uint8_t*>(vaddr + sizeof(virtio_net_hdr_t));
 }
 
+// Completes the partial checksum of a received frame which the device has marked as needing it,
+// as another guest on the same host may leave it to be done.  Returns false if the header does
+// not describe a checksum within the frame.
+bool FillChecksum(uint8_t* data, size_t len, const virtio_net_hdr_t* hdr) {
+    size_t start = hdr->csum_start;
+    size_t field = start + hdr->csum_offset;
+    if (field + sizeof(uint16_t) > len) {
+        return false;
+    }
+    // The field already holds the sum of the pseudo-header.
+    uint32_t sum = 0;
+    for (size_t i = start; i + 1 < len; i += 2) {
+        sum += static_cast<uint32_t>((data[i] << 8) | data[i + 1]);
+    }
+    if ((len - start) % 2) {
+        sum += static_cast<uint32_t>(data[len - 1] << 8);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    uint16_t csum = static_cast<uint16_t>(~sum);
+    data[field] = static_cast<uint8_t>(csum >> 8);
+    data[field + 1] = static_cast<uint8_t>(csum & 0xff);
+    return true;
+}
+
 } // namespace
 
 EthernetDevice::EthernetDevice(zx_device_t* bus_device, fbl::unique_ptr<Backend> backend)
     : Device(bus_device, fbl::move(backend)), rx_(this), tx_(this), bufs_(nullptr), unkicked_(0),
-      ifc_(nullptr), cookie_(nullptr) {
+      features_(0), ifc_(nullptr), cookie_(nullptr) {
 }
 
 EthernetDevice::~EthernetDevice() {
@@ -206,7 +232,30 @@ zx_status_t EthernetDevice::Init() {
     // Ack and set the driver status bit
     DriverStatusAck();
 
-    // TODO(aarongreen): Check features bits and ack/nak them
+    // Negotiate the checksum offloads.  Segmentation and coalescing are not offered, since each
+    // frame is copied through a single buffer of kFrameSize bytes.
+    if (DeviceFeatureSupported(VIRTIO_NET_F_CSUM)) {
+        DriverFeatureAck(VIRTIO_NET_F_CSUM);
+        features_ |= ETHMAC_FEATURE_TX_CSUM;
+    }
+    if (DeviceFeatureSupported(VIRTIO_NET_F_GUEST_CSUM)) {
+        DriverFeatureAck(VIRTIO_NET_F_GUEST_CSUM);
+        features_ |= ETHMAC_FEATURE_RX_CSUM;
+    }
+    // The event index lets the device skip interrupts, and us kicks, while the other side is
+    // still busy.
+    bool event_idx = DeviceFeatureSupported(VIRTIO_RING_F_EVENT_IDX);
+    if (event_idx) {
+        DriverFeatureAck(VIRTIO_RING_F_EVENT_IDX);
+    }
+    if ((features_ != 0 || event_idx) && (rc = DeviceStatusFeaturesOk()) != ZX_OK) {
+        // Start over without them.
+        zxlogf(ERROR, "%s: features rejected: %s\n", tag(), zx_status_get_string(rc));
+        features_ = 0;
+        event_idx = false;
+        DeviceReset();
+        DriverStatusAck();
+    }
 
     // Plan to clean up unless everything goes right.
     auto cleanup = fbl::MakeAutoCall([this]() { Release(); });
@@ -218,6 +267,10 @@ zx_status_t EthernetDevice::Init() {
         zxlogf(ERROR, "failed to allocate virtqueue: %s\n", zx_status_get_string(rc));
         return rc;
     }
+    if (event_idx) {
+        rx_.EnableEventIndex();
+        tx_.EnableEventIndex();
+    }
 
     // Associate the I/O buffers with the virtqueue descriptors
     desc_t* desc = nullptr;
@@ -298,13 +351,25 @@ void EthernetDevice::IrqRingUpdate() {
 
             // Transitional driver does not merge rx buffers.
             assert(used_elem->len < desc->len);
+            virtio_net_hdr_t* hdr = GetFrameHdr(bufs_.get(), kRxId, id);
             uint8_t* data = GetFrameData(bufs_.get(), kRxId, id);
             size_t len = used_elem->len - sizeof(virtio_net_hdr_t);
             LTRACEF("Receiving %zu bytes:\n", len);
             LTRACE_DO(hexdump8_ex(data, len, 0));
 
+            // With GUEST_CSUM, the device marks frames whose checksums it has either checked or
+            // left for us to fill in.
+            uint32_t flags = 0;
+            if (features_ & ETHMAC_FEATURE_RX_CSUM) {
+                if (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+                    flags = FillChecksum(data, len, hdr) ? ETHMAC_RX_CSUM_OK : 0;
+                } else if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID) {
+                    flags = ETHMAC_RX_CSUM_OK;
+                }
+            }
+
             // Pass the data up the stack to the generic Ethernet driver
-            ifc_->recv(cookie_, data, len, 0);
+            ifc_->recv(cookie_, data, len, flags);
             assert((desc->flags & VRING_DESC_F_NEXT) == 0);
             LTRACE_DO(virtio_dump_desc(desc));
             rx_.FreeDesc(id);
@@ -347,7 +412,7 @@ zx_status_t EthernetDevice::Query(uint32_t options, ethmac_info_t* info) {
     }
     fbl::AutoLock lock(&state_lock_);
     if (info) {
-        // TODO(aarongreen): Add info->features = GetFeatures();
+        info->features = features_;
         info->mtu = kVirtioMtu;
         memcpy(info->mac, config_.mac, sizeof(info->mac));
     }
@@ -384,6 +449,10 @@ zx_status_t EthernetDevice::QueueTx(uint32_t options, ethmac_netbuf_t* netbuf) {
         LTRACEF("dropping packet; invalid packet\n");
         return ZX_ERR_INVALID_ARGS;
     }
+    if (netbuf->flags & ~ETHMAC_TX_CSUM) {
+        LTRACEF("dropping packet; unsupported offload\n");
+        return ZX_ERR_NOT_SUPPORTED;
+    }
 
     fbl::AutoLock lock(&tx_lock_);
 
@@ -410,8 +479,13 @@ zx_status_t EthernetDevice::QueueTx(uint32_t options, ethmac_netbuf_t* netbuf) {
     }
 
     // Add the data to be sent
-    void* tx_hdr = GetFrameHdr(bufs_.get(), kTxId, id);
+    virtio_net_hdr_t* tx_hdr = GetFrameHdr(bufs_.get(), kTxId, id);
     memset(tx_hdr, 0, sizeof(virtio_net_hdr_t));
+    if (netbuf->flags & ETHMAC_TX_CSUM) {
+        tx_hdr->flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        tx_hdr->csum_start = netbuf->csum_start;
+        tx_hdr->csum_offset = netbuf->csum_offset;
+    }
     void* tx_buf = GetFrameData(bufs_.get(), kTxId, id);
     memcpy(tx_buf, data, length);
     desc->len = static_cast<uint32_t>(sizeof(virtio_net_hdr_t) + length);
@@ -62,6 +62,9 @@ private:
     fbl::unique_ptr<io_buffer_t[]> bufs_;
     size_t unkicked_ TA_GUARDED(tx_lock_);
 
+    // The ETHMAC_FEATURE_ offloads negotiated with the device in Init(), fixed after that.
+    uint32_t features_;
+
     // Saved net device configuration out of the pci config BAR
     virtio_net_config_t config_ TA_GUARDED(state_lock_);
 
@@ -34,6 +34,9 @@ Ring::Ring(Device* device)
 
 Ring::~Ring() {
     zx::vmar::root_self().unmap(ring_va_, ring_va_len_);
+    if (indirect_) {
+        zx::vmar::root_self().unmap(reinterpret_cast<uintptr_t>(indirect_), indirect_len_);
+    }
 }
 
 zx_status_t Ring::Init(uint16_t index, uint16_t count) {
@@ -82,6 +85,25 @@ zx_status_t Ring::Init(uint16_t index, uint16_t count) {
     return ZX_OK;
 }
 
+zx_status_t Ring::InitIndirect(uint16_t max_descs) {
+    LTRACEF("max_descs %u\n", max_descs);
+
+    if (indirect_ || max_descs == 0) {
+        return ZX_ERR_BAD_STATE;
+    }
+    size_t size = sizeof(struct vring_desc) * ring_.num * max_descs;
+    uintptr_t va;
+    zx_status_t r = map_contiguous_memory(size, &va, &indirect_pa_);
+    if (r) {
+        zxlogf(ERROR, "map_contiguous_memory failed %d\n", r);
+        return r;
+    }
+    indirect_ = reinterpret_cast<struct vring_desc*>(va);
+    indirect_len_ = size;
+    indirect_max_ = max_descs;
+    return ZX_OK;
+}
+
 void Ring::FreeDesc(uint16_t desc_index) {
     LTRACEF("index %u free_count %u\n", desc_index, ring_.free_count);
     ring_.desc[desc_index].next = ring_.free_list;
@@ -122,6 +144,32 @@ struct vring_desc* Ring::AllocDescChain(uint16_t count, uint16_t* start_index) {
     return last;
 }
 
+struct vring_desc* Ring::AllocIndirectChain(uint16_t count, uint16_t* start_index) {
+    if (count == 0 || count > indirect_max_)
+        return NULL;
+
+    uint16_t index;
+    struct vring_desc* head = AllocDescChain(1, &index);
+    if (!head)
+        return NULL;
+
+    /* the ring descriptor covers the chain in its table */
+    head->addr = indirect_pa_ + sizeof(struct vring_desc) * index * indirect_max_;
+    head->len = static_cast<uint32_t>(sizeof(struct vring_desc) * count);
+    head->flags = VRING_DESC_F_INDIRECT;
+
+    struct vring_desc* table = IndirectFromIndex(index, 0);
+    for (uint16_t i = 0; i < count; i++) {
+        table[i].flags = (i + 1 < count) ? VRING_DESC_F_NEXT : 0;
+        table[i].next = (i + 1 < count) ? static_cast<uint16_t>(i + 1) : 0;
+    }
+
+    if (start_index)
+        *start_index = index;
+
+    return table;
+}
+
 void Ring::SubmitChain(uint16_t desc_index) {
     LTRACEF("desc %u\n", desc_index);
 
@@ -129,14 +177,32 @@ void Ring::SubmitChain(uint16_t desc_index) {
     struct vring_avail* avail = ring_.avail;
 
     avail->ring[avail->idx & ring_.num_mask] = desc_index;
-    //mb();
+    /* the device may see the new index as soon as it is written */
+    hw_wmb();
     avail->idx++;
 }
 
 void Ring::Kick() {
     LTRACE_ENTRY;
 
-    device_->RingKick(index_);
+    uint16_t old_idx = kicked_idx_;
+    uint16_t new_idx = ring_.avail->idx;
+    if (old_idx == new_idx) {
+        return;
+    }
+    kicked_idx_ = new_idx;
+
+    /* publish the avail index before reading whether the device wants to hear of it */
+    hw_mb();
+    bool notify;
+    if (event_idx_) {
+        notify = vring_need_event(vring_avail_event(&ring_), new_idx, old_idx);
+    } else {
+        notify = !(ring_.used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify) {
+        device_->RingKick(index_);
+    }
 }
 
 } // namespace virtio
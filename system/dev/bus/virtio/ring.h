@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 #pragma once
 
+#include <hw/arch_ops.h>
 #include <virtio/virtio_ring.h>
 #include <zircon/types.h>
 
@@ -19,15 +20,36 @@ public:
 
     zx_status_t Init(uint16_t index, uint16_t count);
 
+    // Suppresses kicks the device has not asked for, and asks for interrupts only once the used
+    // entries seen so far have been handled. Only once VIRTIO_RING_F_EVENT_IDX is negotiated.
+    void EnableEventIndex() { event_idx_ = true; }
+
+    // Gives each descriptor of the ring a table of |max_descs| indirect descriptors, for use
+    // by AllocIndirectChain(). Only once VIRTIO_RING_F_INDIRECT_DESC is negotiated.
+    zx_status_t InitIndirect(uint16_t max_descs);
+
     void FreeDesc(uint16_t desc_index);
     struct vring_desc* AllocDescChain(uint16_t count, uint16_t* start_index);
+    // Takes a single descriptor of the ring, pointing at a chain of |count| descriptors in its
+    // indirect table, and returns the first of those. Their |next| fields index the same table.
+    // Returns NULL if the ring is full or the chain does not fit in a table.
+    struct vring_desc* AllocIndirectChain(uint16_t count, uint16_t* start_index);
+    // Makes the chain at |desc_index| available to the device. Several chains may be submitted
+    // before a single Kick().
     void SubmitChain(uint16_t desc_index);
+    // Notifies the device of the chains submitted since the last Kick(), unless it has said it
+    // does not need to be.
     void Kick();
 
     struct vring_desc* DescFromIndex(uint16_t index) {
         return &ring_.desc[index];
     }
 
+    // The |i|th descriptor of the indirect table of ring descriptor |index|.
+    struct vring_desc* IndirectFromIndex(uint16_t index, uint16_t i) {
+        return &indirect_[index * indirect_max_ + i];
+    }
+
     template <typename T>
     void IrqRingUpdate(T free_chain);
 
@@ -41,6 +63,16 @@ private:
     uint16_t index_ = 0;
 
     vring ring_ = {};
+
+    bool event_idx_ = false;
+    // The avail index as of the last Kick().
+    uint16_t kicked_idx_ = 0;
+
+    // Indirect descriptor tables, indirect_max_ entries for each descriptor of the ring.
+    struct vring_desc* indirect_ = nullptr;
+    zx_paddr_t indirect_pa_ = 0;
+    size_t indirect_len_ = 0;
+    uint16_t indirect_max_ = 0;
 };
 
 // perform the main loop of finding free descriptor chains and passing it to a passed in function
@@ -50,16 +82,33 @@ inline void Ring::IrqRingUpdate(T free_chain) {
     //         ring_.used->flags, ring_.used->idx, ring_.last_used);
 
     // find a new free chain of descriptors
-    uint16_t cur_idx = ring_.used->idx;
     uint16_t i = ring_.last_used;
-    for (; i != cur_idx; ++i) {
-        // TRACEF("looking at idx %u\n", i);
-
-        struct vring_used_elem* used_elem = &ring_.used->ring[i & ring_.num_mask];
-        // TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
-
-        // free the chain
-        free_chain(used_elem);
+    for (;;) {
+        uint16_t cur_idx = ring_.used->idx;
+        if (i == cur_idx) {
+            if (!event_idx_) {
+                break;
+            }
+            // Ask to be interrupted for the next used entry, then make sure none arrived
+            // before the device could see that.
+            vring_used_event(&ring_) = i;
+            hw_mb();
+            if (ring_.used->idx == i) {
+                break;
+            }
+            continue;
+        }
+        // Read the entries only after their index.
+        hw_rmb();
+        for (; i != cur_idx; ++i) {
+            // TRACEF("looking at idx %u\n", i);
+
+            struct vring_used_elem* used_elem = &ring_.used->ring[i & ring_.num_mask];
+            // TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
+
+            // free the chain
+            free_chain(used_elem);
+        }
     }
     ring_.last_used = i;
 }
@@ -51,6 +51,13 @@ static inline void FB_FLUSH(fb_t* fb) {
         fb->dpy.ops->flush(fb->dpy.ctx);
     }
 }
+static inline void FB_FLUSH_REGION(fb_t* fb, const ioctl_display_region_t* r) {
+    if (fb->dpy.ops->flush_region) {
+        fb->dpy.ops->flush_region(fb->dpy.ctx, r);
+    } else {
+        FB_FLUSH(fb);
+    }
+}
 
 struct fbi {
     fb_t* fb;
@@ -127,6 +134,15 @@ static zx_status_t fbi_ioctl(void* ctx, uint32_t op,
             (h > (fb->info.height - y))) {
             return ZX_ERR_OUT_OF_RANGE;
         }
+        // Only the damaged columns are copied and flushed; a region wider
+        // than the display is taken to mean whole lines, as it always was.
+        uint32_t x = r->x;
+        uint32_t w = r->width;
+        if ((x >= fb->info.width) || (w > (fb->info.width - x))) {
+            x = 0;
+            w = fb->info.width;
+        }
+        ioctl_display_region_t damage = { .x = x, .y = y, .width = w, .height = h };
         uint32_t linesize = fb->info.stride * fb->info.pixelsize;
         mtx_lock(&fb->lock);
         if (!fb->zxdev) {
@@ -134,8 +150,15 @@ static zx_status_t fbi_ioctl(void* ctx, uint32_t op,
             return ZX_ERR_PEER_CLOSED;
         }
         if ((fb->active == fbi->group) && (fbi->buffer != NULL)) {
-            memcpy(fb->buffer + y * linesize, fbi->buffer + y * linesize, h * linesize);
-            FB_FLUSH(fb);
+            if (w == fb->info.width) {
+                memcpy(fb->buffer + y * linesize, fbi->buffer + y * linesize, h * linesize);
+            } else {
+                size_t off = y * linesize + x * fb->info.pixelsize;
+                for (uint32_t i = 0; i < h; i++, off += linesize) {
+                    memcpy(fb->buffer + off, fbi->buffer + off, w * fb->info.pixelsize);
+                }
+            }
+            FB_FLUSH_REGION(fb, &damage);
         }
         mtx_unlock(&fb->lock);
         return ZX_OK;
@@ -63,20 +63,37 @@ zx_status_t DisplayDevice::GetFramebuffer(void** framebuffer) {
     return ZX_OK;
 }
 
-void DisplayDevice::Flush() {
+void DisplayDevice::FlushRange(uintptr_t start, uintptr_t end) {
     // TODO(ZX-1413): Use uncacheable memory for fb or use some zx cache primitive when available
-    unsigned int a, b, c, d;
-    if (!__get_cpuid(1, &a, &b, &c, &d)) {
+    if (cacheline_size_ == 0) {
         return;
     }
-    uint64_t cacheline_size = 8 * ((b >> 8) & 0xff);
 
-    uint8_t* p = reinterpret_cast<uint8_t*>(framebuffer_ & ~(cacheline_size - 1));
-    uint8_t* end = reinterpret_cast<uint8_t*>(framebuffer_ + framebuffer_size_);
+    uint8_t* p = reinterpret_cast<uint8_t*>(start & ~(cacheline_size_ - 1));
+    uint8_t* e = reinterpret_cast<uint8_t*>(end);
 
-    while (p < end) {
+    while (p < e) {
         __builtin_ia32_clflush(p);
-        p += cacheline_size;
+        p += cacheline_size_;
+    }
+}
+
+void DisplayDevice::Flush() {
+    FlushRange(framebuffer_, framebuffer_ + framebuffer_size_);
+}
+
+void DisplayDevice::FlushRegion(const ioctl_display_region_t* region) {
+    // Flushing only the damaged part of each line keeps small updates, like
+    // the console's, from cleaning the cache over the whole framebuffer.
+    uintptr_t linesize = info_.stride * info_.pixelsize;
+    uintptr_t line = framebuffer_ + region->y * linesize + region->x * info_.pixelsize;
+    uintptr_t width = region->width * info_.pixelsize;
+    if (region->width == info_.width) {
+        FlushRange(line, line + region->height * linesize);
+        return;
+    }
+    for (uint32_t i = 0; i < region->height; i++, line += linesize) {
+        FlushRange(line, line + width);
     }
 }
 
@@ -115,6 +132,11 @@ bool DisplayDevice::Init() {
     }
     inited_ = true;
 
+    unsigned int a, b, c, d;
+    if (__get_cpuid(1, &a, &b, &c, &d)) {
+        cacheline_size_ = 8 * ((b >> 8) & 0xff);
+    }
+
     framebuffer_size_ = info_.stride * info_.height * info_.pixelsize;
     zx_status_t status = zx::vmo::create(framebuffer_size_, 0, &framebuffer_vmo_);
     if (status != ZX_OK) {
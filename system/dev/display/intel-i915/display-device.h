@@ -33,6 +33,7 @@ public:
     zx_status_t GetMode(zx_display_info_t* info);
     zx_status_t GetFramebuffer(void** framebuffer);
     void Flush();
+    void FlushRegion(const ioctl_display_region_t* region);
 
     bool Init();
 
@@ -57,6 +58,8 @@ protected:
     bool ResetDdi();
 
 private:
+    void FlushRange(uintptr_t start, uintptr_t end);
+
     // Borrowed reference to Controller instance
     Controller* controller_;
 
@@ -66,6 +69,8 @@ private:
     uintptr_t framebuffer_;
     uint32_t framebuffer_size_;
     zx::vmo framebuffer_vmo_;
+    // zero if unknown, in which case the framebuffer is never flushed
+    uintptr_t cacheline_size_ = 0;
     fbl::unique_ptr<const GttRegion> fb_gfx_addr_;
 
     bool inited_;
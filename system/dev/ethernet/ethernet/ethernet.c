@@ -30,6 +30,9 @@
 // This is used for signaling that eth_tx_thread() should exit.
 static const zx_signals_t kSignalFifoTerminate = ZX_USER_SIGNAL_0;
 
+// This is used for signaling eth_tx_thread() that there are tx completions to return.
+static const zx_signals_t kSignalTxComplete = ZX_USER_SIGNAL_1;
+
 // ensure that we will not exceed fifo capacity
 static_assert((FIFO_DEPTH * FIFO_ESIZE) <= 4096, "");
 
@@ -51,14 +54,37 @@ typedef struct ethdev0 {
     ethmac_info_t info;
     uint32_t status;
     zx_device_t* zxdev;
+
+    // The active instance whose buffers are posted to the ethmac with queue_rx(), if any.
+    // Frames received into them are copied from there to the other active instances.
+    struct ethdev* rx_owner;
+
+    // Whether the ethmac has been asked to coalesce received frames.
+    bool rx_coalesce;
+
+    // The capture ring, while an instance has one running. |capture_flags| is checked without
+    // the lock, so that frames pass straight by when nothing is capturing them; the rest is
+    // guarded by |capture_lock|.
+    mtx_t capture_lock;
+    uint32_t capture_flags;
+    struct ethdev* capture_owner;
+    eth_capture_ring_t* capture_ring;
+    size_t capture_map_size;
+    eth_capture_config_t capture_config;
 } ethdev0_t;
 
 typedef struct tx_info {
     struct ethdev* edev;
     void* fifo_cookie;
+    // The client's offset and length, which include any eth_tx_offload_t before the netbuf data.
+    uint32_t fifo_offset;
+    uint16_t fifo_length;
     ethmac_netbuf_t netbuf;
 } tx_info_t;
 
+// Receive buffers posted to the ethmac are tracked the same way.
+typedef tx_info_t rx_info_t;
+
 // transmit thread has been created
 #define ETHDEV_TX_THREAD (1u)
 
@@ -77,6 +103,9 @@ typedef struct tx_info {
 // This client has requested promisc mode
 #define ETHDEV_PROMISC (0x20u)
 
+// receive thread has been created, to post this client's rx buffers to the ethmac
+#define ETHDEV_RX_THREAD (0x40u)
+
 // indicates the device is busy although its lock is released
 #define ETHDEV0_BUSY (1u)
 
@@ -97,6 +126,14 @@ typedef struct ethdev {
     zx_handle_t rx_fifo;
     uint32_t rx_depth;
 
+    // fifos of the additional rx queues, by queue index (0 is rx_fifo), and how received
+    // packets are spread over them. Guarded by edev0->lock, like the rest of the rx path.
+    zx_handle_t rx_queue_fifos[ETH_MAX_RX_QUEUES];
+    eth_rss_config_t rss;
+
+    // ETH_FEATURE_ offloads enabled with IOCTL_ETHERNET_SET_OFFLOADS.
+    uint32_t offloads;
+
     // io buffer
     zx_handle_t io_vmo;
     void* io_buf;
@@ -104,11 +141,20 @@ typedef struct ethdev {
     zx_paddr_t* paddr_map;
 
     tx_info_t all_tx_bufs[FIFO_DEPTH];
-    mtx_t lock;  // Protects free_tx_bufs
+    rx_info_t all_rx_bufs[FIFO_DEPTH];
+    mtx_t lock;  // Protects free_tx_bufs, free_rx_bufs, tx_done and stats
     list_node_t free_tx_bufs;  // tx_info_t elements
+    list_node_t free_rx_bufs;  // rx_info_t elements
+
+    // Entries completed by the ethmac, which the tx thread returns to the client together.
+    eth_fifo_entry_t tx_done[FIFO_DEPTH];
+    uint32_t tx_done_count;
+
+    eth_stats_t stats;
 
-    // fifo thread
+    // fifo threads
     thrd_t tx_thr;
+    thrd_t rx_thr;
 
     zx_device_t* zxdev;
 
@@ -149,13 +195,203 @@ static inline ssize_t eth_set_promisc_locked(ethdev_t* edev, bool req_on) {
     return status;
 }
 
+// Turns coalescing of received frames on while every active client can receive them, and off
+// otherwise.
+static void eth_update_rx_coalesce_locked(ethdev0_t* edev0) {
+    bool coalesce = (edev0->info.features & ETHMAC_FEATURE_LRO) &&
+                    !list_is_empty(&edev0->list_active);
+    ethdev_t* edev;
+    list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+        if (!(edev->offloads & ETH_FEATURE_LRO)) {
+            coalesce = false;
+        }
+    }
+    if (coalesce != edev0->rx_coalesce &&
+        edev0->mac.ops->set_param(edev0->mac.ctx, ETHMAC_SETPARAM_RX_COALESCE, coalesce,
+                                  NULL) == ZX_OK) {
+        edev0->rx_coalesce = coalesce;
+    }
+}
+
+// The ETH_FEATURE_ offloads the ethmac is able to do.
+static uint32_t eth_offload_features(ethdev0_t* edev0) {
+    uint32_t features = 0;
+    if (edev0->info.features & ETHMAC_FEATURE_TX_CSUM) {
+        features |= ETH_FEATURE_TX_CSUM;
+        if (edev0->info.features & ETHMAC_FEATURE_TSO) {
+            features |= ETH_FEATURE_TSO;
+        }
+    }
+    if (edev0->info.features & ETHMAC_FEATURE_RX_CSUM) {
+        features |= ETH_FEATURE_RX_CSUM;
+    }
+    if (edev0->info.features & ETHMAC_FEATURE_LRO) {
+        features |= ETH_FEATURE_LRO;
+    }
+    return features;
+}
+
+static zx_status_t eth_set_offloads_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    if (in_len != sizeof(uint32_t) || in_buf == NULL) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    uint32_t offloads = *(const uint32_t*)in_buf;
+    if (offloads & ~eth_offload_features(edev->edev0)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    edev->offloads = offloads;
+    eth_update_rx_coalesce_locked(edev->edev0);
+    return ZX_OK;
+}
+
+static zx_status_t eth_set_irq_moderation_locked(ethdev_t* edev, const void* in_buf,
+                                                 size_t in_len) {
+    if (in_len != sizeof(eth_irq_moderation_t) || in_buf == NULL) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    const eth_irq_moderation_t* moderation = in_buf;
+    if (moderation->mode > ETH_IRQ_MODERATION_POLL) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    ethdev0_t* edev0 = edev->edev0;
+    return edev0->mac.ops->set_param(edev0->mac.ctx, ETHMAC_SETPARAM_IRQ_MODERATION, 0,
+                                     (void*)moderation);
+}
+
+// The fifo flags for a frame received with the ETHMAC_RX_ |flags|, as far as |edev| asked for them.
+static uint32_t eth_rx_flags(ethdev_t* edev, uint32_t flags) {
+    uint32_t extra = 0;
+    if ((flags & ETHMAC_RX_CSUM_OK) && (edev->offloads & ETH_FEATURE_RX_CSUM)) {
+        extra |= ETH_FIFO_RX_CSUM_OK;
+    }
+    if (flags & ETHMAC_RX_COALESCED) {
+        extra |= ETH_FIFO_RX_COALESCED;
+    }
+    return extra;
+}
+
+// Counts a write of |count| entries to the tx or rx fifo, of which |actual| went in.
+static void eth_count_write(ethdev_t* edev, bool tx, uint32_t count, uint32_t actual) {
+    mtx_lock(&edev->lock);
+    if (tx) {
+        edev->stats.tx_batches++;
+        edev->stats.tx_entries += actual;
+        edev->stats.tx_fifo_full += count - actual;
+        if (actual > edev->stats.tx_batch_max) {
+            edev->stats.tx_batch_max = actual;
+        }
+    } else {
+        edev->stats.rx_batches++;
+        edev->stats.rx_entries += actual;
+        edev->stats.rx_fifo_full += count - actual;
+        if (actual > edev->stats.rx_batch_max) {
+            edev->stats.rx_batch_max = actual;
+        }
+    }
+    mtx_unlock(&edev->lock);
+}
+
+// The Toeplitz hash of |len| bytes of |data|, which may be at most ETH_RSS_KEY_SIZE - 4.
+static uint32_t eth_toeplitz(const uint8_t* key, const uint8_t* data, size_t len) {
+    uint32_t hash = 0;
+    uint32_t window = ((uint32_t)key[0] << 24) | ((uint32_t)key[1] << 16) |
+                      ((uint32_t)key[2] << 8) | key[3];
+    for (size_t i = 0; i < len; i++) {
+        for (int bit = 7; bit >= 0; bit--) {
+            if (data[i] & (1u << bit)) {
+                hash ^= window;
+            }
+            window = (window << 1) | ((key[i + 4] >> bit) & 1u);
+        }
+    }
+    return hash;
+}
+
+#define ETH_TYPE_IPV4 0x0800
+#define ETH_TYPE_IPV6 0x86dd
+#define ETH_TYPE_VLAN 0x8100
+#define IP_PROTO_TCP 6
+#define IP_PROTO_UDP 17
+
+// Picks the rx fifo for the packet in |data|, as configured by IOCTL_ETHERNET_SET_RSS.
+static zx_handle_t eth_rx_queue_locked(ethdev_t* edev, const uint8_t* data, size_t len) {
+    uint32_t types = edev->rss.hash_types;
+    if (types == 0 || len < 14) {
+        return edev->rx_fifo;
+    }
+    size_t off = 12;
+    uint16_t ethertype = (uint16_t)((data[off] << 8) | data[off + 1]);
+    if (ethertype == ETH_TYPE_VLAN && len >= 18) {
+        off += 4;
+        ethertype = (uint16_t)((data[off] << 8) | data[off + 1]);
+    }
+    const uint8_t* ip = data + off + 2;
+    size_t ip_len = len - (off + 2);
+
+    // Addresses, then ports if the protocol is selected, as the hash input.
+    uint8_t input[36];
+    size_t input_len = 0;
+    const uint8_t* l4 = NULL;
+    uint8_t proto = 0;
+    uint32_t tcp_type = 0, udp_type = 0;
+    if (ethertype == ETH_TYPE_IPV4 && (types & (ETH_RSS_HASH_IPV4 | ETH_RSS_HASH_TCP_IPV4 |
+                                                ETH_RSS_HASH_UDP_IPV4)) && ip_len >= 20) {
+        size_t ihl = (ip[0] & 0xf) * 4u;
+        memcpy(input, ip + 12, 8);
+        input_len = 8;
+        proto = ip[9];
+        // Only the first fragment has ports, so none of them are hashed on ports.
+        bool fragment = ((ip[6] & 0x3f) | ip[7]) != 0;
+        if (!fragment && ihl >= 20 && ip_len >= ihl + 4) {
+            l4 = ip + ihl;
+        }
+        tcp_type = ETH_RSS_HASH_TCP_IPV4;
+        udp_type = ETH_RSS_HASH_UDP_IPV4;
+        if (!(types & ETH_RSS_HASH_IPV4) && !(types & (proto == IP_PROTO_TCP ? tcp_type :
+                                                       proto == IP_PROTO_UDP ? udp_type : 0))) {
+            return edev->rx_fifo;
+        }
+    } else if (ethertype == ETH_TYPE_IPV6 && (types & (ETH_RSS_HASH_IPV6 |
+                                                       ETH_RSS_HASH_TCP_IPV6 |
+                                                       ETH_RSS_HASH_UDP_IPV6)) && ip_len >= 40) {
+        memcpy(input, ip + 8, 32);
+        input_len = 32;
+        proto = ip[6];
+        if (ip_len >= 44) {
+            l4 = ip + 40;
+        }
+        tcp_type = ETH_RSS_HASH_TCP_IPV6;
+        udp_type = ETH_RSS_HASH_UDP_IPV6;
+        if (!(types & ETH_RSS_HASH_IPV6) && !(types & (proto == IP_PROTO_TCP ? tcp_type :
+                                                       proto == IP_PROTO_UDP ? udp_type : 0))) {
+            return edev->rx_fifo;
+        }
+    } else {
+        return edev->rx_fifo;
+    }
+    if (l4 != NULL && ((proto == IP_PROTO_TCP && (types & tcp_type)) ||
+                       (proto == IP_PROTO_UDP && (types & udp_type)))) {
+        memcpy(input + input_len, l4, 4);
+        input_len += 4;
+    }
+
+    uint32_t hash = eth_toeplitz(edev->rss.key, input, input_len);
+    uint8_t queue = edev->rss.indirection[hash % ETH_RSS_TABLE_SIZE];
+    if (queue == 0 || queue >= ETH_MAX_RX_QUEUES ||
+        edev->rx_queue_fifos[queue] == ZX_HANDLE_INVALID) {
+        return edev->rx_fifo;
+    }
+    return edev->rx_queue_fifos[queue];
+}
+
 static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
     eth_fifo_entry_t e;
     zx_status_t status;
     uint32_t count;
+    zx_handle_t fifo = eth_rx_queue_locked(edev, data, len);
 
     // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = zx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    if ((status = zx_fifo_read(fifo, &e, sizeof(e), &count)) < 0) {
         if (status == ZX_ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
                 zxlogf(ERROR, "eth [%s]: no rx buffers available (%u times)\n",
@@ -182,7 +418,9 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         e.flags = ETH_FIFO_RX_OK | extra;
     }
 
-    if ((status = zx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    status = zx_fifo_write(fifo, &e, sizeof(e), &count);
+    eth_count_write(edev, false, 1, status < 0 ? 0 : count);
+    if (status < 0) {
         if (status == ZX_ERR_SHOULD_WAIT) {
             if ((edev->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
                 zxlogf(ERROR, "eth [%s]: no rx_fifo space available (%u times)\n",
@@ -215,6 +453,7 @@ static int tx_fifo_write(ethdev_t* edev, eth_fifo_entry_t* entries, uint32_t cou
     uint32_t actual;
     // Writing should never fail, or fail to write all entries
     status = zx_fifo_write(edev->tx_fifo, entries, sizeof(eth_fifo_entry_t) * count, &actual);
+    eth_count_write(edev, true, count, status < 0 ? 0 : actual);
     if (status < 0) {
         zxlogf(ERROR, "eth [%s]: tx_fifo write failed %d\n", edev->name, status);
         return -1;
@@ -226,15 +465,84 @@ static int tx_fifo_write(ethdev_t* edev, eth_fifo_entry_t* entries, uint32_t cou
     return 0;
 }
 
+static bool eth_capture_match(const eth_capture_config_t* config, const uint8_t* data,
+                              size_t len) {
+    for (uint32_t i = 0; i < config->filter_count; i++) {
+        const eth_capture_filter_t* filter = &config->filters[i];
+        if ((size_t)filter->offset + filter->size > len) {
+            return false;
+        }
+        uint32_t field = 0;
+        for (uint32_t j = 0; j < filter->size; j++) {
+            field = (field << 8) | data[filter->offset + j];
+        }
+        bool equal = (field & filter->mask) == filter->value;
+        if (equal == !!(filter->flags & ETH_CAPTURE_FILTER_NE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Copies a frame going in the direction |dir| into the capture ring, if one is running and
+// wants it. Nothing here waits on the reader: a frame that doesn't fit is only counted.
+static void eth_capture(ethdev0_t* edev0, uint32_t dir, const void* data, size_t len) {
+    if (!(__atomic_load_n(&edev0->capture_flags, __ATOMIC_RELAXED) & dir)) {
+        return;
+    }
+    mtx_lock(&edev0->capture_lock);
+    eth_capture_ring_t* ring = edev0->capture_ring;
+    const eth_capture_config_t* config = &edev0->capture_config;
+    if (ring == NULL || !(config->flags & dir) || !eth_capture_match(config, data, len)) {
+        mtx_unlock(&edev0->capture_lock);
+        return;
+    }
+
+    size_t cap_len = len;
+    if (config->snaplen && cap_len > config->snaplen) {
+        cap_len = config->snaplen;
+    }
+    uint32_t record_len = (uint32_t)ROUNDUP(sizeof(eth_capture_record_t) + cap_len, 8);
+    uint8_t* base = (uint8_t*)ring + ETH_CAPTURE_DATA_OFFSET;
+    uint64_t head = ring->head;
+    uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    uint32_t offset = (uint32_t)(head & (ring->size - 1));
+    uint32_t to_end = ring->size - offset;
+    uint32_t pad = (to_end < record_len) ? to_end : 0;
+    if (head - tail > ring->size || (uint64_t)record_len + pad > ring->size - (head - tail)) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        mtx_unlock(&edev0->capture_lock);
+        return;
+    }
+    if (pad) {
+        eth_capture_record_t* filler = (eth_capture_record_t*)(base + offset);
+        filler->record_len = pad;
+        filler->flags = ETH_CAPTURE_PAD;
+        head += pad;
+        offset = 0;
+    }
+    eth_capture_record_t* record = (eth_capture_record_t*)(base + offset);
+    record->record_len = record_len;
+    record->flags = dir;
+    record->frame_len = (uint32_t)len;
+    record->cap_len = (uint32_t)cap_len;
+    record->ticks = zx_ticks_get();
+    memcpy(record->data, data, cap_len);
+    __atomic_store_n(&ring->head, head + record_len, __ATOMIC_RELEASE);
+    mtx_unlock(&edev0->capture_lock);
+}
+
 // TODO: I think if this arrives at the wrong time during teardown we
 // can deadlock with the ethermac device
 static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
     ethdev0_t* edev0 = cookie;
 
+    eth_capture(edev0, ETH_CAPTURE_RX, data, len);
+
     ethdev_t* edev;
     mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_handle_rx(edev, data, len, 0);
+        eth_handle_rx(edev, data, len, eth_rx_flags(edev, flags));
     }
     mtx_unlock(&edev0->lock);
 }
@@ -242,25 +550,98 @@ static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
 static void eth0_complete_tx(void* cookie, ethmac_netbuf_t* netbuf, zx_status_t status) {
     tx_info_t* tx_info = containerof(netbuf, tx_info_t, netbuf);
     ethdev_t* edev = tx_info->edev;
-    eth_fifo_entry_t entry = {.offset = netbuf->data - edev->io_buf,
-                              .length = netbuf->len,
+    eth_fifo_entry_t entry = {.offset = tx_info->fifo_offset,
+                              .length = tx_info->fifo_length,
                               .flags = status == ZX_OK ? ETH_FIFO_TX_OK : 0,
                               .cookie = tx_info->fifo_cookie};
 
     // Now that we've copied all pertinent data from the netbuf, return it to the free list so
-    // it is avaialble immediately for the next request.
+    // it is avaialble immediately for the next request. The entry goes back to the client along
+    // with any others completed before the tx thread gets to it.
     mtx_lock(&edev->lock);
     list_add_head(&edev->free_tx_bufs, &tx_info->netbuf.node);
+    edev->tx_done[edev->tx_done_count++] = entry;
+    if (edev->tx_done_count == 1) {
+        zx_object_signal(edev->tx_fifo, 0, kSignalTxComplete);
+    }
     mtx_unlock(&edev->lock);
+}
 
-    // Send the eth_fifo_entry back to the client
-    tx_fifo_write(edev, &entry, 1);
+// Returns the entries completed by the ethmac since the last call to the client.
+static int eth_tx_flush(ethdev_t* edev) {
+    eth_fifo_entry_t entries[FIFO_DEPTH];
+    mtx_lock(&edev->lock);
+    uint32_t count = edev->tx_done_count;
+    memcpy(entries, edev->tx_done, count * sizeof(eth_fifo_entry_t));
+    edev->tx_done_count = 0;
+    zx_object_signal(edev->tx_fifo, kSignalTxComplete, 0);
+    mtx_unlock(&edev->lock);
+    return count ? tx_fifo_write(edev, entries, count) : 0;
+}
+
+static void eth0_complete_rx(void* cookie, ethmac_netbuf_t** netbufs, size_t count) {
+    ethdev0_t* edev0 = cookie;
+    eth_fifo_entry_t entries[FIFO_DEPTH];
+    uint32_t flags[FIFO_DEPTH];
+    ethdev_t* owner = NULL;
+
+    while (count > 0) {
+        size_t n = count < FIFO_DEPTH ? count : FIFO_DEPTH;
+        for (size_t i = 0; i < n; i++) {
+            rx_info_t* rx_info = containerof(netbufs[i], rx_info_t, netbuf);
+            owner = rx_info->edev;
+            entries[i].offset = netbufs[i]->data - owner->io_buf;
+            entries[i].length = netbufs[i]->len;
+            flags[i] = netbufs[i]->flags;
+            entries[i].flags = netbufs[i]->len ? ETH_FIFO_RX_OK | eth_rx_flags(owner, flags[i]) : 0;
+            entries[i].cookie = rx_info->fifo_cookie;
+            if (entries[i].length) {
+                eth_capture(edev0, ETH_CAPTURE_RX, netbufs[i]->data, entries[i].length);
+            }
+        }
+
+        // Other clients get their copies before the buffers go back to their owner.
+        mtx_lock(&edev0->lock);
+        ethdev_t* edev;
+        list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
+            if (edev == owner) {
+                continue;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (entries[i].length) {
+                    eth_handle_rx(edev, owner->io_buf + entries[i].offset, entries[i].length,
+                                  eth_rx_flags(edev, flags[i]));
+                }
+            }
+        }
+        mtx_unlock(&edev0->lock);
+
+        mtx_lock(&owner->lock);
+        for (size_t i = 0; i < n; i++) {
+            list_add_head(&owner->free_rx_bufs, &netbufs[i]->node);
+        }
+        mtx_unlock(&owner->lock);
+
+        zx_status_t status;
+        uint32_t actual;
+        status = zx_fifo_write(owner->rx_fifo, entries, sizeof(eth_fifo_entry_t) * n, &actual);
+        eth_count_write(owner, false, (uint32_t)n, status < 0 ? 0 : actual);
+        if (status < 0 || actual != n) {
+            if ((owner->fail_rx_write++ % FAIL_REPORT_RATE) == 0) {
+                zxlogf(ERROR, "eth [%s]: rx_fifo write failed %d (%u times)\n",
+                       owner->name, status, owner->fail_rx_write);
+            }
+        }
+        netbufs += n;
+        count -= n;
+    }
 }
 
 static ethmac_ifc_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
     .complete_tx = eth0_complete_tx,
+    .complete_rx = eth0_complete_rx,
 };
 
 static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
@@ -304,12 +685,51 @@ static zx_status_t eth_tx_listen_locked(ethdev_t* edev, bool yes) {
     return ZX_OK;
 }
 
+// Fills in the offloads of |netbuf| from the eth_tx_offload_t at the start of the client's
+// packet, and moves its data past it. Returns false if the client may not ask for them.
+static bool eth_tx_offload(ethdev_t* edev, ethmac_netbuf_t* netbuf) {
+    eth_tx_offload_t offload;
+    if (netbuf->len < sizeof(offload)) {
+        return false;
+    }
+    memcpy(&offload, netbuf->data, sizeof(offload));
+    netbuf->data += sizeof(offload);
+    netbuf->phys += sizeof(offload);
+    netbuf->len = (uint16_t)(netbuf->len - sizeof(offload));
+
+    uint32_t tso = offload.flags & (ETH_TX_OFFLOAD_TSO_V4 | ETH_TX_OFFLOAD_TSO_V6);
+    if ((offload.flags & ~(ETH_TX_OFFLOAD_CSUM | ETH_TX_OFFLOAD_TSO_V4 | ETH_TX_OFFLOAD_TSO_V6)) ||
+        ((offload.flags & ETH_TX_OFFLOAD_CSUM) && !(edev->offloads & ETH_FEATURE_TX_CSUM))) {
+        return false;
+    }
+    if (tso && (!(offload.flags & ETH_TX_OFFLOAD_CSUM) || !(edev->offloads & ETH_FEATURE_TSO) ||
+                (tso == (ETH_TX_OFFLOAD_TSO_V4 | ETH_TX_OFFLOAD_TSO_V6)) || offload.mss == 0 ||
+                offload.hdr_len > netbuf->len)) {
+        return false;
+    }
+    if ((offload.flags & ETH_TX_OFFLOAD_CSUM) &&
+        ((size_t)offload.csum_start + offload.csum_offset + 2 > netbuf->len)) {
+        return false;
+    }
+    netbuf->flags = ((offload.flags & ETH_TX_OFFLOAD_CSUM) ? ETHMAC_TX_CSUM : 0) |
+                    ((tso & ETH_TX_OFFLOAD_TSO_V4) ? ETHMAC_TX_TSO_V4 : 0) |
+                    ((tso & ETH_TX_OFFLOAD_TSO_V6) ? ETHMAC_TX_TSO_V6 : 0);
+    netbuf->csum_start = offload.csum_start;
+    netbuf->csum_offset = offload.csum_offset;
+    netbuf->hdr_len = offload.hdr_len;
+    netbuf->mss = offload.mss;
+    return true;
+}
+
+// Queues |count| entries from the client with the ethmac. Those completed straight away are
+// returned to the client together at the end.
 static int eth_send(ethdev_t* edev, eth_fifo_entry_t* entries, uint32_t count) {
     ethdev0_t* edev0 = edev->edev0;
+    uint32_t done = 0;
     for (eth_fifo_entry_t* e = entries; count > 0; e++) {
         if ((e->offset > edev->io_size) || ((e->length > (edev->io_size - e->offset)))) {
             e->flags = ETH_FIFO_INVALID;
-            tx_fifo_write(edev, e, 1);
+            entries[done++] = *e;
         } else {
             zx_status_t status;
             mtx_lock(&edev->lock);
@@ -329,24 +749,34 @@ static int eth_send(ethdev_t* edev, eth_fifo_entry_t* entries, uint32_t count) {
                                        (e->offset & PAGE_MASK);
             }
             tx_info->netbuf.len = e->length;
+            tx_info->netbuf.flags = 0;
             tx_info->fifo_cookie = e->cookie;
-            status = edev0->mac.ops->queue_tx(edev0->mac.ctx, opts, &tx_info->netbuf);
-            if (edev->state & ETHDEV_TX_LOOPBACK) {
-                eth_tx_echo(edev0, edev->io_buf + e->offset, e->length);
+            tx_info->fifo_offset = e->offset;
+            tx_info->fifo_length = e->length;
+            if ((e->flags & ETH_FIFO_TX_OFFLOAD) && !eth_tx_offload(edev, &tx_info->netbuf)) {
+                status = ZX_ERR_INVALID_ARGS;
+                e->flags = ETH_FIFO_INVALID;
+            } else {
+                // Captured before the ethmac has it, as the client may reuse the buffer as
+                // soon as it completes.
+                eth_capture(edev0, ETH_CAPTURE_TX, tx_info->netbuf.data, tx_info->netbuf.len);
+                status = edev0->mac.ops->queue_tx(edev0->mac.ctx, opts, &tx_info->netbuf);
+                e->flags = status == ZX_OK ? ETH_FIFO_TX_OK : 0;
+                if (edev->state & ETHDEV_TX_LOOPBACK) {
+                    eth_tx_echo(edev0, tx_info->netbuf.data, tx_info->netbuf.len);
+                }
             }
             if (status != ZX_ERR_SHOULD_WAIT) {
                 // transaction completed, add buffer to free list and return fifo entry
-                // TODO: batch these so we can do a single fifo write
-                e->flags = status == ZX_OK ? ETH_FIFO_TX_OK : 0;
                 mtx_lock(&edev->lock);
                 list_add_head(&edev->free_tx_bufs, &tx_info->netbuf.node);
                 mtx_unlock(&edev->lock);
-                tx_fifo_write(edev, e, 1);
+                entries[done++] = *e;
             }
         }
         count--;
     }
-    return 0;
+    return done ? tx_fifo_write(edev, entries, done) : 0;
 }
 
 static int eth_tx_thread(void* arg) {
@@ -362,7 +792,8 @@ static int eth_tx_thread(void* arg) {
                 if ((status = zx_object_wait_one(edev->tx_fifo,
                                                  ZX_FIFO_READABLE |
                                                  ZX_FIFO_PEER_CLOSED |
-                                                 kSignalFifoTerminate,
+                                                 kSignalFifoTerminate |
+                                                 kSignalTxComplete,
                                                  ZX_TIME_INFINITE,
                                                  &observed)) < 0) {
                     zxlogf(ERROR, "eth [%s]: tx_fifo: error waiting: %d\n", edev->name, status);
@@ -370,6 +801,9 @@ static int eth_tx_thread(void* arg) {
                 }
                 if (observed & kSignalFifoTerminate)
                     break;
+                if ((observed & kSignalTxComplete) && eth_tx_flush(edev)) {
+                    break;
+                }
                 continue;
             } else {
                 zxlogf(ERROR, "eth [%s]: tx_fifo: cannot read: %d\n", edev->name, status);
@@ -377,7 +811,7 @@ static int eth_tx_thread(void* arg) {
             }
         }
 
-        if (eth_send(edev, entries, count)) {
+        if (eth_send(edev, entries, count) || eth_tx_flush(edev)) {
             break;
         }
     }
@@ -386,6 +820,116 @@ static int eth_tx_thread(void* arg) {
     return 0;
 }
 
+// Posts the rx buffer described by |e| to the ethmac. Returns false, with |e| updated to be
+// handed back to the client, if it could not be.
+static bool eth_post_rx(ethdev_t* edev, eth_fifo_entry_t* e) {
+    ethdev0_t* edev0 = edev->edev0;
+    if ((e->length == 0) || (e->offset >= edev->io_size) ||
+        (e->length > (edev->io_size - e->offset))) {
+        e->length = 0;
+        e->flags = ETH_FIFO_INVALID;
+        return false;
+    }
+    // The ethmac gets a single physical address, so the buffer may not straddle pages which are
+    // not physically adjacent.
+    size_t first = e->offset / PAGE_SIZE;
+    size_t last = (e->offset + e->length - 1) / PAGE_SIZE;
+    for (size_t page = first; page < last; page++) {
+        if (edev->paddr_map[page] + PAGE_SIZE != edev->paddr_map[page + 1]) {
+            e->length = 0;
+            e->flags = ETH_FIFO_INVALID;
+            return false;
+        }
+    }
+
+    mtx_lock(&edev->lock);
+    rx_info_t* rx_info = list_remove_head_type(&edev->free_rx_bufs, rx_info_t, netbuf.node);
+    mtx_unlock(&edev->lock);
+    if (rx_info != NULL) {
+        rx_info->netbuf.data = edev->io_buf + e->offset;
+        rx_info->netbuf.phys = edev->paddr_map[first] + (e->offset & PAGE_MASK);
+        rx_info->netbuf.len = e->length;
+        rx_info->netbuf.flags = 0;
+        rx_info->fifo_cookie = e->cookie;
+        if (edev0->mac.ops->queue_rx(edev0->mac.ctx, 0, &rx_info->netbuf) == ZX_OK) {
+            return true;
+        }
+        mtx_lock(&edev->lock);
+        list_add_head(&edev->free_rx_bufs, &rx_info->netbuf.node);
+        mtx_unlock(&edev->lock);
+    }
+    // The ethmac has no room for it; give it back unused.
+    if ((edev->fail_rx_read++ % FAIL_REPORT_RATE) == 0) {
+        zxlogf(ERROR, "eth [%s]: ethmac rx queue full (%u times)\n",
+               edev->name, edev->fail_rx_read);
+    }
+    e->length = 0;
+    e->flags = 0;
+    return false;
+}
+
+// Moves the buffers the rx_owner client posts to its rx fifo on to the ethmac.
+static int eth_rx_thread(void* arg) {
+    ethdev_t* edev = (ethdev_t*)arg;
+    eth_fifo_entry_t entries[FIFO_DEPTH / 2];
+    zx_status_t status;
+    uint32_t count;
+
+    for (;;) {
+        if ((status = zx_fifo_read(edev->rx_fifo, entries, sizeof(entries), &count)) < 0) {
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                zx_signals_t observed;
+                if ((status = zx_object_wait_one(edev->rx_fifo,
+                                                 ZX_FIFO_READABLE |
+                                                 ZX_FIFO_PEER_CLOSED |
+                                                 kSignalFifoTerminate,
+                                                 ZX_TIME_INFINITE,
+                                                 &observed)) < 0) {
+                    zxlogf(ERROR, "eth [%s]: rx_fifo: error waiting: %d\n", edev->name, status);
+                    break;
+                }
+                if (observed & kSignalFifoTerminate)
+                    break;
+                continue;
+            } else {
+                zxlogf(ERROR, "eth [%s]: rx_fifo: cannot read: %d\n", edev->name, status);
+                break;
+            }
+        }
+
+        // Entries which could not be posted go straight back, together.
+        uint32_t returned = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (!eth_post_rx(edev, &entries[i])) {
+                entries[returned++] = entries[i];
+            }
+        }
+        if (returned > 0) {
+            uint32_t actual;
+            zx_fifo_write(edev->rx_fifo, entries, sizeof(eth_fifo_entry_t) * returned, &actual);
+        }
+    }
+
+    zxlogf(INFO, "eth [%s]: rx_thread: exit: %d\n", edev->name, status);
+    return 0;
+}
+
+// Stops posting |edev|'s buffers to the ethmac. Those already posted are returned by the
+// ethmac's stop().
+static void eth_rx_thread_stop_locked(ethdev_t* edev) {
+    if (!(edev->state & ETHDEV_RX_THREAD)) {
+        return;
+    }
+    edev->state &= (~ETHDEV_RX_THREAD);
+    zx_object_signal(edev->rx_fifo, 0, kSignalFifoTerminate);
+    int ret;
+    thrd_join(edev->rx_thr, &ret);
+    zx_object_signal(edev->rx_fifo, kSignalFifoTerminate, 0);
+    if (edev->edev0->rx_owner == edev) {
+        edev->edev0->rx_owner = NULL;
+    }
+}
+
 static zx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t out_len,
                                         size_t* out_actual) {
     if (out_len < sizeof(eth_fifos_t)) {
@@ -419,6 +963,124 @@ static zx_status_t eth_get_fifos_locked(ethdev_t* edev, void* out_buf, size_t ou
     return ZX_OK;
 }
 
+static zx_status_t eth_get_rx_queue_locked(ethdev_t* edev, const void* in_buf, size_t in_len,
+                                           void* out_buf, size_t out_len, size_t* out_actual) {
+    if (in_len < sizeof(uint32_t) || out_len < sizeof(zx_handle_t)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    uint32_t queue = *((const uint32_t*)in_buf);
+    if (queue == 0 || queue >= ETH_MAX_RX_QUEUES) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    if (edev->rx_fifo == ZX_HANDLE_INVALID) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (edev->rx_queue_fifos[queue] != ZX_HANDLE_INVALID) {
+        return ZX_ERR_ALREADY_BOUND;
+    }
+    zx_status_t status;
+    if ((status = zx_fifo_create(FIFO_DEPTH, FIFO_ESIZE, 0, (zx_handle_t*)out_buf,
+                                 &edev->rx_queue_fifos[queue])) < 0) {
+        zxlogf(ERROR, "eth [%s]: failed to create rx queue %u fifo: %d\n", edev->name, queue,
+               status);
+        return status;
+    }
+    *out_actual = sizeof(zx_handle_t);
+    return ZX_OK;
+}
+
+// Ends the capture started by |edev|, if any. Frames already in the ring stay readable by the
+// capture tool until it drops its mapping.
+static zx_status_t eth_capture_stop_locked(ethdev_t* edev) {
+    ethdev0_t* edev0 = edev->edev0;
+    mtx_lock(&edev0->capture_lock);
+    if (edev0->capture_owner != edev) {
+        mtx_unlock(&edev0->capture_lock);
+        return ZX_ERR_BAD_STATE;
+    }
+    __atomic_store_n(&edev0->capture_flags, 0, __ATOMIC_RELAXED);
+    zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)edev0->capture_ring, edev0->capture_map_size);
+    edev0->capture_ring = NULL;
+    edev0->capture_owner = NULL;
+    mtx_unlock(&edev0->capture_lock);
+    return ZX_OK;
+}
+
+static zx_status_t eth_capture_start_locked(ethdev_t* edev, const void* in_buf, size_t in_len,
+                                            void* out_buf, size_t out_len, size_t* out_actual) {
+    ethdev0_t* edev0 = edev->edev0;
+    if (in_len < sizeof(eth_capture_config_t) || out_len < sizeof(zx_handle_t)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    const eth_capture_config_t* config = in_buf;
+    if (!(config->flags & (ETH_CAPTURE_RX | ETH_CAPTURE_TX)) ||
+        (config->flags & ~(ETH_CAPTURE_RX | ETH_CAPTURE_TX)) ||
+        config->ring_size < ETH_CAPTURE_MIN_RING_SIZE ||
+        config->ring_size > ETH_CAPTURE_MAX_RING_SIZE ||
+        (config->ring_size & (config->ring_size - 1)) ||
+        config->filter_count > ETH_CAPTURE_MAX_FILTERS) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    for (uint32_t i = 0; i < config->filter_count; i++) {
+        uint8_t size = config->filters[i].size;
+        if ((size != 1 && size != 2 && size != 4) ||
+            (config->filters[i].flags & ~ETH_CAPTURE_FILTER_NE)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+    }
+
+    mtx_lock(&edev0->capture_lock);
+    if (edev0->capture_owner != NULL) {
+        mtx_unlock(&edev0->capture_lock);
+        return ZX_ERR_ALREADY_BOUND;
+    }
+    size_t map_size = ROUNDUP(ETH_CAPTURE_DATA_OFFSET + config->ring_size, PAGE_SIZE);
+    zx_handle_t vmo;
+    zx_status_t status;
+    if ((status = zx_vmo_create(map_size, 0, &vmo)) != ZX_OK) {
+        mtx_unlock(&edev0->capture_lock);
+        return status;
+    }
+    uintptr_t addr;
+    if ((status = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, map_size,
+                              ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr)) != ZX_OK) {
+        zxlogf(ERROR, "eth [%s]: could not map capture ring: %d\n", edev->name, status);
+        zx_handle_close(vmo);
+        mtx_unlock(&edev0->capture_lock);
+        return status;
+    }
+    // The mapping keeps the vmo alive; the capture tool gets the only handle to it.
+    *(zx_handle_t*)out_buf = vmo;
+    *out_actual = sizeof(zx_handle_t);
+
+    eth_capture_ring_t* ring = (eth_capture_ring_t*)addr;
+    ring->size = config->ring_size;
+    ring->ticks_per_second = zx_ticks_per_second();
+    edev0->capture_ring = ring;
+    edev0->capture_map_size = map_size;
+    edev0->capture_config = *config;
+    edev0->capture_owner = edev;
+    __atomic_store_n(&edev0->capture_flags, config->flags, __ATOMIC_RELAXED);
+    mtx_unlock(&edev0->capture_lock);
+    zxlogf(INFO, "eth [%s]: capture started, %u byte ring, snaplen %u, %u filters\n",
+           edev->name, config->ring_size, config->snaplen, config->filter_count);
+    return ZX_OK;
+}
+
+static zx_status_t eth_set_rss_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    if (in_len < sizeof(eth_rss_config_t)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    const eth_rss_config_t* config = in_buf;
+    for (size_t i = 0; i < ETH_RSS_TABLE_SIZE; i++) {
+        if (config->indirection[i] >= ETH_MAX_RX_QUEUES) {
+            return ZX_ERR_OUT_OF_RANGE;
+        }
+    }
+    memcpy(&edev->rss, config, sizeof(edev->rss));
+    return ZX_OK;
+}
+
 static ssize_t eth_set_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
     if (in_len < sizeof(zx_handle_t)) {
         return ZX_ERR_INVALID_ARGS;
@@ -451,8 +1113,13 @@ static ssize_t eth_set_iobuf_locked(ethdev_t* edev, const void* in_buf, size_t i
             status = ZX_ERR_NO_MEMORY;
             goto fail;
         }
-        // TODO: pin memory
-        if ((status = zx_vmo_op_range(edev->io_vmo, ZX_VMO_OP_LOOKUP, 0, size, &edev->paddr_map,
+        // The pages are committed and looked up once; the ethmac is handed their physical
+        // addresses for as long as the buffer is set.
+        if ((status = zx_vmo_op_range(vmo, ZX_VMO_OP_COMMIT, 0, size, NULL, 0)) != ZX_OK) {
+            zxlogf(ERROR, "eth [%s]: could not commit io_buf: %d\n", edev->name, status);
+            goto fail;
+        }
+        if ((status = zx_vmo_op_range(vmo, ZX_VMO_OP_LOOKUP, 0, size, edev->paddr_map,
                                       paddr_map_size)) != ZX_OK) {
             zxlogf(ERROR, "eth [%s]: vmo_op_range failed, can't determine phys addr\n", edev->name);
             goto fail;
@@ -515,9 +1182,22 @@ static zx_status_t eth_start_locked(ethdev_t* edev) TA_NO_THREAD_SAFETY_ANALYSIS
     }
 
     if (status == ZX_OK) {
+        // The first client to start receives frames directly, if the ethmac can do that.
+        if ((edev0->info.features & ETHMAC_FEATURE_RX_QUEUE) &&
+            (edev0->info.features & ETHMAC_FEATURE_DMA) && (edev0->mac.ops->queue_rx != NULL) &&
+            list_is_empty(&edev0->list_active) && (edev0->rx_owner == NULL)) {
+            if (thrd_create_with_name(&edev->rx_thr, eth_rx_thread, edev,
+                                      "eth-rx-thread") == thrd_success) {
+                edev->state |= ETHDEV_RX_THREAD;
+                edev0->rx_owner = edev;
+            } else {
+                zxlogf(ERROR, "eth [%s]: failed to start rx thread, copying rx\n", edev->name);
+            }
+        }
         edev->state |= ETHDEV_RUNNING;
         list_delete(&edev->node);
         list_add_tail(&edev0->list_active, &edev->node);
+        eth_update_rx_coalesce_locked(edev0);
     } else {
         zxlogf(ERROR, "eth [%s]: failed to start mac: %d\n", edev->name, status);
     }
@@ -531,20 +1211,30 @@ static zx_status_t eth_stop_locked(ethdev_t* edev) TA_NO_THREAD_SAFETY_ANALYSIS
     ethdev0_t* edev0 = edev->edev0;
 
     if (edev->state & ETHDEV_RUNNING) {
+        bool rx_owner = (edev0->rx_owner == edev);
+        eth_rx_thread_stop_locked(edev);
         edev->state &= (~ETHDEV_RUNNING);
         list_delete(&edev->node);
         list_add_tail(&edev0->list_idle, &edev->node);
-        if (list_is_empty(&edev0->list_active)) {
-            if (!(edev->state & ETHDEV_DEAD)) {
-                // Release the lock to allow other device operations in callback routine.
-                // Re-acquire lock afterwards. Set busy to prevent problems with other ioctls.
-                edev0->state |= ETHDEV0_BUSY;
-                mtx_unlock(&edev0->lock);
-                edev0->mac.ops->stop(edev0->mac.ctx);
-                mtx_lock(&edev0->lock);
-                edev0->state &= ~ETHDEV0_BUSY;
+        bool idle = list_is_empty(&edev0->list_active);
+        if ((idle || rx_owner) && !(edev->state & ETHDEV_DEAD)) {
+            // Release the lock to allow other device operations in callback routine.
+            // Re-acquire lock afterwards. Set busy to prevent problems with other ioctls.
+            edev0->state |= ETHDEV0_BUSY;
+            mtx_unlock(&edev0->lock);
+            edev0->mac.ops->stop(edev0->mac.ctx);
+            if (!idle) {
+                // Stopping was only to get this client's buffers back from the ethmac. The
+                // remaining clients go on receiving copies.
+                zx_status_t status = edev0->mac.ops->start(edev0->mac.ctx, &ethmac_ifc, edev0);
+                if (status != ZX_OK) {
+                    zxlogf(ERROR, "eth [%s]: failed to restart mac: %d\n", edev->name, status);
+                }
             }
+            mtx_lock(&edev0->lock);
+            edev0->state &= ~ETHDEV0_BUSY;
         }
+        eth_update_rx_coalesce_locked(edev0);
     }
 
     return ZX_OK;
@@ -577,6 +1267,18 @@ static zx_status_t eth_get_status_locked(ethdev_t* edev, void* out_buf, size_t o
     return ZX_OK;
 }
 
+static zx_status_t eth_get_stats(ethdev_t* edev, void* out_buf, size_t out_len,
+                                 size_t* out_actual) {
+    if (out_len < sizeof(eth_stats_t)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    mtx_lock(&edev->lock);
+    memcpy(out_buf, &edev->stats, sizeof(eth_stats_t));
+    mtx_unlock(&edev->lock);
+    *out_actual = sizeof(eth_stats_t);
+    return ZX_OK;
+}
+
 static zx_status_t eth_ioctl(void* ctx, uint32_t op,
                              const void* in_buf, size_t in_len,
                              void* out_buf, size_t out_len, size_t* out_actual) {
@@ -610,7 +1312,9 @@ static zx_status_t eth_ioctl(void* ctx, uint32_t op,
             if (edev->edev0->info.features & ETHMAC_FEATURE_SYNTH) {
                 info->features |= ETH_FEATURE_SYNTH;
             }
+            info->features |= eth_offload_features(edev->edev0);
             info->mtu = edev->edev0->info.mtu;
+            info->rx_queues = ETH_MAX_RX_QUEUES;
             *out_actual = sizeof(*info);
             status = ZX_OK;
         }
@@ -640,6 +1344,27 @@ static zx_status_t eth_ioctl(void* ctx, uint32_t op,
     case IOCTL_ETHERNET_GET_STATUS:
         status = eth_get_status_locked(edev, out_buf, out_len, out_actual);
         break;
+    case IOCTL_ETHERNET_GET_RX_QUEUE:
+        status = eth_get_rx_queue_locked(edev, in_buf, in_len, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_SET_RSS:
+        status = eth_set_rss_locked(edev, in_buf, in_len);
+        break;
+    case IOCTL_ETHERNET_GET_STATS:
+        status = eth_get_stats(edev, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_SET_OFFLOADS:
+        status = eth_set_offloads_locked(edev, in_buf, in_len);
+        break;
+    case IOCTL_ETHERNET_CAPTURE_START:
+        status = eth_capture_start_locked(edev, in_buf, in_len, out_buf, out_len, out_actual);
+        break;
+    case IOCTL_ETHERNET_CAPTURE_STOP:
+        status = eth_capture_stop_locked(edev);
+        break;
+    case IOCTL_ETHERNET_SET_IRQ_MODERATION:
+        status = eth_set_irq_moderation_locked(edev, in_buf, in_len);
+        break;
     case IOCTL_ETHERNET_SET_PROMISC:
         if (in_len != sizeof(bool) || in_buf == NULL) {
             status = ZX_ERR_INVALID_ARGS;
@@ -669,15 +1394,25 @@ static void eth_kill_locked(ethdev_t* edev) {
     zxlogf(TRACE, "eth [%s]: kill: tearing down%s\n",
             edev->name, (edev->state & ETHDEV_TX_THREAD) ? " tx thread" : "");
     eth_set_promisc_locked(edev, false);
+    eth_capture_stop_locked(edev);
 
     // make sure any future ioctls or other ops will fail
     edev->state |= ETHDEV_DEAD;
 
+    eth_rx_thread_stop_locked(edev);
+
     // try to convince clients to close us
     if (edev->rx_fifo) {
         zx_handle_close(edev->rx_fifo);
         edev->rx_fifo = ZX_HANDLE_INVALID;
     }
+    for (size_t i = 1; i < ETH_MAX_RX_QUEUES; i++) {
+        if (edev->rx_queue_fifos[i]) {
+            zx_handle_close(edev->rx_queue_fifos[i]);
+            edev->rx_queue_fifos[i] = ZX_HANDLE_INVALID;
+        }
+    }
+    edev->rss.hash_types = 0;
     if (edev->tx_fifo) {
         // Ask the TX thread to exit.
         zx_object_signal(edev->tx_fifo, 0, kSignalFifoTerminate);
@@ -745,9 +1480,12 @@ static zx_status_t eth0_open(void* ctx, zx_device_t** out, uint32_t flags) {
     edev->edev0 = edev0;
 
     list_initialize(&edev->free_tx_bufs);
+    list_initialize(&edev->free_rx_bufs);
     for (size_t ndx = 0; ndx < FIFO_DEPTH; ndx++) {
         edev->all_tx_bufs[ndx].edev = edev;
         list_add_tail(&edev->free_tx_bufs, &edev->all_tx_bufs[ndx].netbuf.node);
+        edev->all_rx_bufs[ndx].edev = edev;
+        list_add_tail(&edev->free_rx_bufs, &edev->all_rx_bufs[ndx].netbuf.node);
     }
     mtx_init(&edev->lock, mtx_plain);
 
@@ -834,6 +1572,7 @@ static zx_status_t eth_bind(void* ctx, zx_device_t* dev) {
     }
 
     mtx_init(&edev0->lock, mtx_plain);
+    mtx_init(&edev0->capture_lock, mtx_plain);
     list_initialize(&edev0->list_active);
     list_initialize(&edev0->list_idle);
 
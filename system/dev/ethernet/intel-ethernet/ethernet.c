@@ -43,11 +43,118 @@ typedef struct ethernet_device {
     // callback interface to attached ethernet layer
     ethmac_ifc_t* ifc;
     void* cookie;
+
+    // how interrupts are paced, set with ETHMAC_SETPARAM_IRQ_MODERATION
+    eth_irq_moderation_t moderation;
+    // for adaptive moderation: the interval in use, and the packets received since the
+    // rate was last measured
+    uint32_t irq_level;
+    uint32_t window_packets;
+    zx_time_t window_start;
 } ethernet_device_t;
 
+// Interrupt intervals for adaptive moderation, from the lowest latency to bulk traffic, and the
+// packet rates above which each next one is used. The rate has to fall below half of that to
+// step back, so the interval doesn't flap around a boundary.
+#define IRQ_LEVELS 3
+static const uint32_t irq_level_interval_ns[IRQ_LEVELS] = {10000, 50000, 250000};
+static const uint32_t irq_level_max_pps[IRQ_LEVELS - 1] = {20000, 100000};
+
+// How long the packet rate is measured over.
+#define IRQ_RATE_WINDOW ZX_MSEC(10)
+
+static void eth_set_irq_level_locked(ethernet_device_t* edev, uint32_t level) {
+    edev->irq_level = level;
+    edev->window_packets = 0;
+    edev->window_start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    eth_set_irq_interval(&edev->eth, irq_level_interval_ns[level]);
+}
+
+static void eth_adapt_irq_interval_locked(ethernet_device_t* edev, uint32_t packets) {
+    edev->window_packets += packets;
+    zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    zx_duration_t elapsed = now - edev->window_start;
+    if (elapsed < IRQ_RATE_WINDOW) {
+        return;
+    }
+    uint64_t pps = (uint64_t)edev->window_packets * ZX_SEC(1) / elapsed;
+    uint32_t level = edev->irq_level;
+    while (level < IRQ_LEVELS - 1 && pps > irq_level_max_pps[level]) {
+        level++;
+    }
+    while (level > 0 && pps < irq_level_max_pps[level - 1] / 2) {
+        level--;
+    }
+    if (level != edev->irq_level) {
+        eth_set_irq_level_locked(edev, level);
+    } else {
+        edev->window_packets = 0;
+        edev->window_start = now;
+    }
+}
+
+// Handles whatever the device has to report, and returns how many frames were received. When
+// |polling|, the rx ring is checked whether or not the device asked for it.
+static uint32_t eth_service_locked(ethernet_device_t* edev, bool polling) {
+    uint32_t packets = 0;
+    unsigned irq = eth_handle_irq(&edev->eth);
+    if (polling || (irq & ETH_IRQ_RX)) {
+        void* data;
+        size_t len;
+        bool csum_ok;
+
+        while (eth_rx(&edev->eth, &data, &len, &csum_ok) == ZX_OK) {
+            if (edev->ifc && (edev->state == ETH_RUNNING)) {
+                edev->ifc->recv(edev->cookie, data, len, csum_ok ? ETHMAC_RX_CSUM_OK : 0);
+            }
+            eth_rx_ack(&edev->eth);
+            packets++;
+        }
+    }
+    if (irq & ETH_IRQ_LSC) {
+        bool was_online = edev->online;
+        bool online = eth_status_online(&edev->eth);
+        if (online != was_online) {
+            edev->online = online;
+            if (edev->ifc) {
+                edev->ifc->status(edev->cookie, online ? ETH_STATUS_ONLINE : 0);
+            }
+        }
+    }
+    return packets;
+}
+
 static int irq_thread(void* arg) {
     ethernet_device_t* edev = arg;
+    bool polling = false;
     for (;;) {
+        // The device's interrupts are turned off and on here, as the mode changes, so that
+        // they stay off for as long as this thread is polling.
+        mtx_lock(&edev->lock);
+        bool poll = (edev->moderation.mode == ETH_IRQ_MODERATION_POLL);
+        zx_duration_t idle = ZX_USEC(edev->moderation.interval_us);
+        if (poll != polling) {
+            if (poll) {
+                eth_disable_irqs(&edev->eth);
+            } else {
+                eth_enable_irqs(&edev->eth);
+            }
+            polling = poll;
+        }
+        if (polling) {
+            uint32_t packets = eth_service_locked(edev, true);
+            mtx_unlock(&edev->lock);
+            if (packets == 0) {
+                if (idle) {
+                    zx_nanosleep(zx_deadline_after(idle));
+                } else {
+                    thrd_yield();
+                }
+            }
+            continue;
+        }
+        mtx_unlock(&edev->lock);
+
         zx_status_t r;
         uint64_t slots;
         if ((r = zx_interrupt_wait(edev->irqh, &slots)) < 0) {
@@ -56,27 +163,9 @@ static int irq_thread(void* arg) {
         }
 
         mtx_lock(&edev->lock);
-        unsigned irq = eth_handle_irq(&edev->eth);
-        if (irq & ETH_IRQ_RX) {
-            void* data;
-            size_t len;
-
-            while (eth_rx(&edev->eth, &data, &len) == ZX_OK) {
-                if (edev->ifc && (edev->state == ETH_RUNNING)) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
-                }
-                eth_rx_ack(&edev->eth);
-            }
-        }
-        if (irq & ETH_IRQ_LSC) {
-            bool was_online = edev->online;
-            bool online = eth_status_online(&edev->eth);
-            if (online != was_online) {
-                edev->online = online;
-                if (edev->ifc) {
-                    edev->ifc->status(edev->cookie, online ? ETH_STATUS_ONLINE : 0);
-                }
-            }
+        uint32_t packets = eth_service_locked(edev, false);
+        if (edev->moderation.mode == ETH_IRQ_MODERATION_ADAPTIVE) {
+            eth_adapt_irq_interval_locked(edev, packets);
         }
         mtx_unlock(&edev->lock);
     }
@@ -92,6 +181,8 @@ static zx_status_t eth_query(void* ctx, uint32_t options, ethmac_info_t* info) {
 
     memset(info, 0, sizeof(*info));
     ZX_DEBUG_ASSERT(ETH_TXBUF_SIZE >= ETH_MTU);
+    // Frames are copied into single tx buffers, so there is no segmentation offload.
+    info->features = ETHMAC_FEATURE_TX_CSUM | ETHMAC_FEATURE_RX_CSUM;
     info->mtu = ETH_MTU;
     memcpy(info->mac, edev->eth.mac, sizeof(edev->eth.mac));
 
@@ -127,8 +218,45 @@ static zx_status_t eth_queue_tx(void* ctx, uint32_t options, ethmac_netbuf_t* ne
     if (edev->state != ETH_RUNNING) {
         return ZX_ERR_BAD_STATE;
     }
+    if (netbuf->flags & ~ETHMAC_TX_CSUM) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    size_t csum_field = 0;
+    if (netbuf->flags & ETHMAC_TX_CSUM) {
+        csum_field = (size_t)netbuf->csum_start + netbuf->csum_offset;
+    }
     // TODO: Add support for DMA directly from netbuf
-    return eth_tx(&edev->eth, netbuf->data, netbuf->len);
+    return eth_tx(&edev->eth, netbuf->data, netbuf->len, netbuf->csum_start, csum_field);
+}
+
+static zx_status_t eth_set_irq_moderation_locked(ethernet_device_t* edev,
+                                                 const eth_irq_moderation_t* moderation) {
+    if (moderation == NULL) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    switch (moderation->mode) {
+    case ETH_IRQ_MODERATION_FIXED:
+        if (moderation->interval_us > ETH_IRQ_INTERVAL_MAX_NS / 1000) {
+            return ZX_ERR_OUT_OF_RANGE;
+        }
+        eth_set_irq_interval(&edev->eth, moderation->interval_us * 1000);
+        break;
+    case ETH_IRQ_MODERATION_ADAPTIVE:
+        eth_set_irq_level_locked(edev, 0);
+        break;
+    case ETH_IRQ_MODERATION_POLL:
+        eth_set_irq_interval(&edev->eth, 0);
+        break;
+    default:
+        return ZX_ERR_INVALID_ARGS;
+    }
+    bool was_polling = (edev->moderation.mode == ETH_IRQ_MODERATION_POLL);
+    edev->moderation = *moderation;
+    if (moderation->mode == ETH_IRQ_MODERATION_POLL && !was_polling) {
+        // Wake the irq thread, so it sees it is to poll.
+        eth_raise_irq(&edev->eth);
+    }
+    return ZX_OK;
 }
 
 static zx_status_t eth_set_param(void *ctx, uint32_t param, int32_t value, void* data) {
@@ -146,6 +274,9 @@ static zx_status_t eth_set_param(void *ctx, uint32_t param, int32_t value, void*
         }
         status = ZX_OK;
         break;
+    case ETHMAC_SETPARAM_IRQ_MODERATION:
+        status = eth_set_irq_moderation_locked(edev, data);
+        break;
     default:
         status = ZX_ERR_NOT_SUPPORTED;
     }
@@ -283,6 +414,8 @@ static zx_status_t eth_bind(void* ctx, zx_device_t* dev) {
 
     eth_setup_buffers(&edev->eth, io_buffer_virt(&edev->buffer), io_buffer_phys(&edev->buffer));
     eth_init_hw(&edev->eth);
+    edev->moderation.mode = ETH_IRQ_MODERATION_ADAPTIVE;
+    eth_set_irq_level_locked(edev, 0);
 
     device_add_args_t args = {
         .version = DEVICE_ADD_ARGS_VERSION,
@@ -45,11 +45,33 @@ unsigned eth_handle_irq(ethdev_t* eth) {
     return readl(IE_ICR);
 }
 
+void eth_enable_irqs(ethdev_t* eth) {
+    // write to "set" mask
+    writel(IE_INT_RXT0 | IE_INT_LSC, IE_IMS);
+}
+
+void eth_disable_irqs(ethdev_t* eth) {
+    // write to "clear" mask
+    writel(0xFFFF, IE_IMC);
+}
+
+void eth_raise_irq(ethdev_t* eth) {
+    writel(IE_INT_LSC, IE_ICS);
+}
+
+void eth_set_irq_interval(ethdev_t* eth, uint32_t interval_ns) {
+    // ITR counts in units of 256ns.
+    if (interval_ns > ETH_IRQ_INTERVAL_MAX_NS) {
+        interval_ns = ETH_IRQ_INTERVAL_MAX_NS;
+    }
+    writel(interval_ns / 256, IE_ITR);
+}
+
 bool eth_status_online(ethdev_t* eth) {
     return readl(IE_STATUS) & IE_STATUS_LU;
 }
 
-status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
+status_t eth_rx(ethdev_t* eth, void** data, size_t* len, bool* csum_ok) {
     uint32_t n = eth->rx_rd_ptr;
     uint64_t info = eth->rxd[n].info;
 
@@ -62,6 +84,8 @@ status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
 
     *data = eth->rxb + ETH_RXBUF_SIZE * n;
     *len = r;
+    // TCPCS covers UDP as well; IPCS is only set for IPv4.
+    *csum_ok = (info & IE_RXD_TCPCS) && !(info & (IE_RXD_IXSM | IE_RXD_IPE | IE_RXD_TCPE));
 
     return ZX_OK;
 }
@@ -105,11 +129,31 @@ static void reap_tx_buffers(ethdev_t* eth) {
     eth->tx_rd_ptr = n;
 }
 
-status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
+// Adds the checksum from |start| to the end of |data| into the field at |field|.
+static void fill_checksum(uint8_t* data, size_t len, size_t start, size_t field) {
+    uint32_t sum = 0;
+    for (size_t i = start; i + 1 < len; i += 2) {
+        sum += (uint32_t)((data[i] << 8) | data[i + 1]);
+    }
+    if ((len - start) % 2) {
+        sum += (uint32_t)(data[len - 1] << 8);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    uint16_t csum = (uint16_t)~sum;
+    data[field] = (uint8_t)(csum >> 8);
+    data[field + 1] = (uint8_t)(csum & 0xff);
+}
+
+status_t eth_tx(ethdev_t* eth, const void* data, size_t len, size_t csum_start, size_t csum_field) {
     if ((len < 60) || (len > ETH_TXBUF_DSIZE)) {
         printf("intel-eth: unsupported packet length %zu\n", len);
         return ZX_ERR_INVALID_ARGS;
     }
+    if (csum_field != 0 && ((csum_start > csum_field) || (csum_field + 2 > len))) {
+        return ZX_ERR_INVALID_ARGS;
+    }
 
     zx_status_t status = ZX_OK;
 
@@ -126,8 +170,17 @@ status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
 
     uint32_t n = eth->tx_wr_ptr;
     memcpy(frame->data, data, len);
+    uint64_t csum = 0;
+    if (csum_field != 0) {
+        if (csum_field <= 0xff) {
+            csum = IE_TXD_IC | IE_TXD_CSS(csum_start) | IE_TXD_CSO(csum_field);
+        } else {
+            // Beyond the reach of the descriptor's offsets.
+            fill_checksum(frame->data, len, csum_start, csum_field);
+        }
+    }
     eth->txd[n].addr = frame->phys;
-    eth->txd[n].info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS;
+    eth->txd[n].info = IE_TXD_LEN(len) | IE_TXD_EOP | IE_TXD_IFCS | IE_TXD_RS | csum;
     list_add_tail(&eth->busy_frames, &frame->node);
 
     // inform hw of buffer availability
@@ -290,7 +343,7 @@ void eth_init_hw(ethdev_t* eth) {
 
     // setup rx ring
     eth->rx_rd_ptr = 0;
-    writel(0, IE_RXCSUM);
+    writel(IE_RXCSUM_IPOFL | IE_RXCSUM_TUOFL, IE_RXCSUM);
     writel((4 << 0) | (1 << 8) | (1 << 16) | (1 << 24), IE_RXDCTL);
     writel(eth->rxd_phys, IE_RDBAL);
     writel(eth->rxd_phys >> 32, IE_RDBAH);
@@ -308,12 +361,9 @@ void eth_init_hw(ethdev_t* eth) {
     uint32_t tctl_rsvd = readl(IE_TCTL) & IE_TCTL_RESERVED;
     writel(tctl_rsvd | IE_TCTL_CT(15) | IE_TCTL_COLD_FD | IE_TCTL_EN, IE_TCTL);
 
-    // disable all irqs (write to "clear" mask)
-    writel(0xFFFF, IE_IMC);
-    // enable rx irq (write to "set" mask)
-    writel(IE_INT_RXT0, IE_IMS);
-    // enable link status change irq
-    writel(IE_INT_LSC, IE_IMS);
+    // enable only the rx and link status change irqs
+    eth_disable_irqs(eth);
+    eth_enable_irqs(eth);
 }
 
 void eth_setup_buffers(ethdev_t* eth, void* iomem, zx_paddr_t iophys) {
@@ -68,12 +68,14 @@ void eth_init_hw(ethdev_t* eth);
 
 void eth_dump_regs(ethdev_t* eth);
 
-status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
+status_t eth_rx(ethdev_t* eth, void** data, size_t* len, bool* csum_ok);
 void eth_rx_ack(ethdev_t* eth);
 void eth_enable_rx(ethdev_t* eth);
 void eth_disable_rx(ethdev_t* eth);
 
-status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
+// If |csum_field| is not zero, the checksum from byte |csum_start| to the end of the frame is
+// added to the 16-bit field at |csum_field|.
+status_t eth_tx(ethdev_t* eth, const void* data, size_t len, size_t csum_start, size_t csum_field);
 size_t eth_tx_queued(ethdev_t* eth);
 void eth_enable_tx(ethdev_t* eth);
 void eth_disable_tx(ethdev_t* eth);
@@ -89,3 +91,14 @@ bool eth_status_online(ethdev_t* eth);
 #define ETH_IRQ_RX IE_INT_RXT0
 #define ETH_IRQ_LSC IE_INT_LSC
 unsigned eth_handle_irq(ethdev_t* eth);
+
+void eth_enable_irqs(ethdev_t* eth);
+void eth_disable_irqs(ethdev_t* eth);
+// Raises an interrupt as if the link status had changed, to wake whoever waits for one.
+void eth_raise_irq(ethdev_t* eth);
+
+// The most the device can hold back an interrupt.
+#define ETH_IRQ_INTERVAL_MAX_NS (0xFFFFu * 256)
+
+// Holds interrupts back to at most one per |interval_ns|, or not at all if it is zero.
+void eth_set_irq_interval(ethdev_t* eth, uint32_t interval_ns);
@@ -143,6 +143,8 @@ static bool ipt_config_lip = false;
 #define BIT(x, b) ((x) & (1u << (b)))
 
 static zx_status_t x86_pt_free(ipt_device_t* ipt_dev);
+static bool is_buffer_in_use(ipt_device_t* ipt_dev, const ipt_per_trace_state_t* per_trace);
+static zx_status_t fetch_buffer_state(ipt_device_t* ipt_dev, uint32_t index);
 
 
 // The userspace side of the driver
@@ -529,16 +531,90 @@ static zx_status_t x86_pt_alloc_buffer(ipt_device_t* ipt_dev,
     return ZX_OK;
 }
 
+static zx_status_t get_koid(zx_handle_t handle, zx_koid_t* out_koid) {
+    zx_info_handle_basic_t info;
+    zx_status_t status = zx_object_get_info(handle, ZX_INFO_HANDLE_BASIC,
+                                            &info, sizeof(info), NULL, NULL);
+    if (status != ZX_OK)
+        return status;
+    *out_koid = info.koid;
+    return ZX_OK;
+}
+
+// The driver keeps its handle of an assigned thread until it is released,
+// the kernel keeps its own reference.
 static zx_status_t x86_pt_assign_buffer_thread(ipt_device_t* ipt_dev, uint32_t index, zx_handle_t thread) {
+    zx_status_t status;
+    if (ipt_dev->mode != IPT_TRACE_THREADS) {
+        status = ZX_ERR_BAD_STATE;
+        goto fail;
+    }
+    if (ipt_dev->active) {
+        status = ZX_ERR_BAD_STATE;
+        goto fail;
+    }
+    if (index >= ipt_dev->num_traces) {
+        status = ZX_ERR_INVALID_ARGS;
+        goto fail;
+    }
+    ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[index];
+    if (!per_trace->allocated) {
+        status = ZX_ERR_INVALID_ARGS;
+        goto fail;
+    }
+    if (per_trace->owner.thread != ZX_HANDLE_INVALID) {
+        status = ZX_ERR_BAD_STATE;
+        goto fail;
+    }
+
+    zx_handle_t resource = get_root_resource();
+    status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_ASSIGN_THREAD,
+                               MTRACE_IPT_OPTIONS(index), &thread, sizeof(thread));
+    if (status != ZX_OK)
+        goto fail;
+    per_trace->owner.thread = thread;
+    return ZX_OK;
+
+fail:
     zx_handle_close(thread);
-    // TODO(dje): Thread support is still work-in-progress.
-    return ZX_ERR_NOT_SUPPORTED;
+    return status;
+}
+
+static zx_status_t x86_pt_release_buffer_thread1(ipt_device_t* ipt_dev, ipt_per_trace_state_t* per_trace) {
+    uint32_t index = (uint32_t)(per_trace - ipt_dev->per_trace_state);
+    zx_handle_t resource = get_root_resource();
+    zx_status_t status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_RELEASE_THREAD,
+                                           MTRACE_IPT_OPTIONS(index), NULL, 0);
+    if (status != ZX_OK)
+        return status;
+    zx_handle_close(per_trace->owner.thread);
+    per_trace->owner.thread = ZX_HANDLE_INVALID;
+    return ZX_OK;
 }
 
 static zx_status_t x86_pt_release_buffer_thread(ipt_device_t* ipt_dev, uint32_t index, zx_handle_t thread) {
+    zx_koid_t koid, owner_koid;
+    zx_status_t status = get_koid(thread, &koid);
     zx_handle_close(thread);
-    // TODO(dje): Thread support is still work-in-progress.
-    return ZX_ERR_NOT_SUPPORTED;
+    if (status != ZX_OK)
+        return status;
+
+    if (ipt_dev->mode != IPT_TRACE_THREADS)
+        return ZX_ERR_BAD_STATE;
+    if (ipt_dev->active)
+        return ZX_ERR_BAD_STATE;
+    if (index >= ipt_dev->num_traces)
+        return ZX_ERR_INVALID_ARGS;
+    ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[index];
+    if (!per_trace->allocated || per_trace->owner.thread == ZX_HANDLE_INVALID)
+        return ZX_ERR_INVALID_ARGS;
+    status = get_koid(per_trace->owner.thread, &owner_koid);
+    if (status != ZX_OK)
+        return status;
+    if (koid != owner_koid)
+        return ZX_ERR_INVALID_ARGS;
+
+    return x86_pt_release_buffer_thread1(ipt_dev, per_trace);
 }
 
 static zx_status_t x86_pt_free_buffer(ipt_device_t* ipt_dev, uint32_t index) {
@@ -550,6 +626,12 @@ static zx_status_t x86_pt_free_buffer(ipt_device_t* ipt_dev, uint32_t index) {
     ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[index];
     if (!per_trace->allocated)
         return ZX_ERR_INVALID_ARGS;
+    if (ipt_dev->mode == IPT_TRACE_THREADS &&
+        per_trace->owner.thread != ZX_HANDLE_INVALID) {
+        zx_status_t status = x86_pt_release_buffer_thread1(ipt_dev, per_trace);
+        if (status != ZX_OK)
+            return status;
+    }
     x86_pt_free_buffer1(ipt_dev, per_trace);
     return ZX_OK;
 }
@@ -570,10 +652,6 @@ static zx_status_t ipt_alloc_trace(cpu_trace_device_t* dev,
         return ZX_ERR_INVALID_ARGS;
     memcpy(&config, cmd, sizeof(config));
 
-    // TODO(dje): Until thread tracing is supported.
-    if (config.mode == IPT_MODE_THREADS)
-        return ZX_ERR_NOT_SUPPORTED;
-
     uint32_t internal_mode;
     switch (config.mode) {
     case IPT_MODE_CPUS:
@@ -593,7 +671,11 @@ static zx_status_t ipt_alloc_trace(cpu_trace_device_t* dev,
     if (!ipt_dev)
         return ZX_ERR_NO_MEMORY;
 
-    ipt_dev->num_traces = zx_system_get_num_cpus();
+    if (internal_mode == IPT_TRACE_CPUS) {
+        ipt_dev->num_traces = zx_system_get_num_cpus();
+    } else {
+        ipt_dev->num_traces = IPT_MAX_NUM_THREADS;
+    }
 
     ipt_dev->per_trace_state = calloc(ipt_dev->num_traces, sizeof(ipt_dev->per_trace_state[0]));
     if (!ipt_dev->per_trace_state) {
@@ -621,12 +703,6 @@ static zx_status_t ipt_free_trace(cpu_trace_device_t* dev) {
     if (ipt_dev->active)
         return ZX_ERR_BAD_STATE;
 
-    for (uint32_t i = 0; i < ipt_dev->num_traces; ++i) {
-        ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[i];
-        if (per_trace->allocated)
-            x86_pt_free_buffer1(ipt_dev, per_trace);
-    }
-
     zx_handle_t resource = get_root_resource();
     zx_status_t status =
         zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_FREE_TRACE, 0, NULL, 0);
@@ -635,6 +711,19 @@ static zx_status_t ipt_free_trace(cpu_trace_device_t* dev) {
     if (status != ZX_OK)
         return ZX_OK;
 
+    // The kernel has let go of any assigned threads, so the buffers are no
+    // longer in use.
+    for (uint32_t i = 0; i < ipt_dev->num_traces; ++i) {
+        ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[i];
+        if (ipt_dev->mode == IPT_TRACE_THREADS &&
+            per_trace->owner.thread != ZX_HANDLE_INVALID) {
+            zx_handle_close(per_trace->owner.thread);
+            per_trace->owner.thread = ZX_HANDLE_INVALID;
+        }
+        if (per_trace->allocated)
+            x86_pt_free_buffer1(ipt_dev, per_trace);
+    }
+
     free(ipt_dev->per_trace_state);
     free(ipt_dev);
     dev->ipt = NULL;
@@ -747,9 +836,6 @@ static zx_status_t ipt_get_buffer_info(ipt_device_t* ipt_dev,
     if (replymax < sizeof(data))
         return ZX_ERR_BUFFER_TOO_SMALL;
 
-    if (ipt_dev->active)
-        return ZX_ERR_BAD_STATE;
-
     memcpy(&index, cmd, sizeof(index));
     if (index >= ipt_dev->num_traces)
         return ZX_ERR_INVALID_ARGS;
@@ -757,6 +843,14 @@ static zx_status_t ipt_get_buffer_info(ipt_device_t* ipt_dev,
     if (!per_trace->allocated)
         return ZX_ERR_INVALID_ARGS;
 
+    // While tracing, ask the kernel where the trace has got to so that
+    // circular buffers can be drained as they fill.
+    if (ipt_dev->active && is_buffer_in_use(ipt_dev, per_trace)) {
+        zx_status_t status = fetch_buffer_state(ipt_dev, index);
+        if (status != ZX_OK)
+            return status;
+    }
+
     // Note: If this is a circular buffer this is just where tracing stopped.
     data.capture_end = compute_capture_size(ipt_dev, per_trace);
     memcpy(reply, &data, sizeof(data));
@@ -804,46 +898,95 @@ static zx_status_t ipt_free_buffer(ipt_device_t* ipt_dev,
     return 0;
 }
 
+// Only buffers that are used in the current mode are loaded into the kernel:
+// in cpu mode that is all of them, in thread mode those assigned a thread.
+static bool is_buffer_in_use(ipt_device_t* ipt_dev, const ipt_per_trace_state_t* per_trace) {
+    if (!per_trace->allocated)
+        return false;
+    return ipt_dev->mode == IPT_TRACE_CPUS ||
+        per_trace->owner.thread != ZX_HANDLE_INVALID;
+}
+
+static zx_status_t stage_buffer(ipt_device_t* ipt_dev, uint32_t index) {
+    const ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[index];
+
+    zx_x86_pt_regs_t regs;
+    regs.ctl = per_trace->ctl;
+    regs.ctl |= IPT_CTL_TOPA_MASK | IPT_CTL_TRACE_EN_MASK;
+    regs.status = per_trace->status;
+    regs.output_base = per_trace->output_base;
+    regs.output_mask_ptrs = per_trace->output_mask_ptrs;
+    regs.cr3_match = per_trace->cr3_match;
+    static_assert(sizeof(regs.addr_ranges) == sizeof(per_trace->addr_ranges),
+                  "addr range size mismatch");
+    memcpy(regs.addr_ranges, per_trace->addr_ranges, sizeof(per_trace->addr_ranges));
+
+    uint32_t action = ipt_dev->mode == IPT_TRACE_CPUS ?
+        MTRACE_IPT_STAGE_CPU_DATA : MTRACE_IPT_STAGE_THREAD_DATA;
+    zx_handle_t resource = get_root_resource();
+    return zx_mtrace_control(resource, MTRACE_KIND_IPT, action,
+                             MTRACE_IPT_OPTIONS(index), &regs, sizeof(regs));
+}
+
+// Fetch the output position and status of buffer |index|.
+// This may be done while tracing: the kernel flushes and reports where the
+// trace has got to.
+static zx_status_t fetch_buffer_state(ipt_device_t* ipt_dev, uint32_t index) {
+    ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[index];
+
+    uint32_t action = ipt_dev->mode == IPT_TRACE_CPUS ?
+        MTRACE_IPT_GET_CPU_DATA : MTRACE_IPT_GET_THREAD_DATA;
+    zx_handle_t resource = get_root_resource();
+    zx_x86_pt_regs_t regs;
+    zx_status_t status = zx_mtrace_control(resource, MTRACE_KIND_IPT, action,
+                                           MTRACE_IPT_OPTIONS(index), &regs, sizeof(regs));
+    if (status != ZX_OK)
+        return status;
+    // Keep our own copy of |ctl|: the kernel clears TraceEn when stopping.
+    per_trace->status = regs.status;
+    per_trace->output_base = regs.output_base;
+    per_trace->output_mask_ptrs = regs.output_mask_ptrs;
+    return ZX_OK;
+}
+
 // Begin tracing.
 static zx_status_t ipt_start(ipt_device_t* ipt_dev) {
     if (ipt_dev->active)
         return ZX_ERR_BAD_STATE;
-    if (ipt_dev->mode != IPT_TRACE_CPUS)
-        return ZX_ERR_BAD_STATE;
     assert(ipt_dev->per_trace_state);
 
     zx_handle_t resource = get_root_resource();
     zx_status_t status;
 
-    // First verify a buffer has been allocated for each cpu.
-    for (uint32_t cpu = 0; cpu < ipt_dev->num_traces; ++cpu) {
-        const ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[cpu];
-        if (!per_trace->allocated)
+    if (ipt_dev->mode == IPT_TRACE_CPUS) {
+        // First verify a buffer has been allocated for each cpu.
+        for (uint32_t cpu = 0; cpu < ipt_dev->num_traces; ++cpu) {
+            const ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[cpu];
+            if (!per_trace->allocated)
+                return ZX_ERR_BAD_STATE;
+        }
+    } else {
+        // There must be something to trace.
+        uint32_t i;
+        for (i = 0; i < ipt_dev->num_traces; ++i) {
+            if (is_buffer_in_use(ipt_dev, &ipt_dev->per_trace_state[i]))
+                break;
+        }
+        if (i == ipt_dev->num_traces)
             return ZX_ERR_BAD_STATE;
     }
 
-    for (uint32_t cpu = 0; cpu < ipt_dev->num_traces; ++cpu) {
-        const ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[cpu];
-
-        zx_x86_pt_regs_t regs;
-        regs.ctl = per_trace->ctl;
-        regs.ctl |= IPT_CTL_TOPA_MASK | IPT_CTL_TRACE_EN_MASK;
-        regs.status = per_trace->status;
-        regs.output_base = per_trace->output_base;
-        regs.output_mask_ptrs = per_trace->output_mask_ptrs;
-        regs.cr3_match = per_trace->cr3_match;
-        static_assert(sizeof(regs.addr_ranges) == sizeof(per_trace->addr_ranges),
-                      "addr range size mismatch");
-        memcpy(regs.addr_ranges, per_trace->addr_ranges, sizeof(per_trace->addr_ranges));
-
-        status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_STAGE_CPU_DATA,
-                                   cpu, &regs, sizeof(regs));
+    for (uint32_t i = 0; i < ipt_dev->num_traces; ++i) {
+        if (!is_buffer_in_use(ipt_dev, &ipt_dev->per_trace_state[i]))
+            continue;
+        status = stage_buffer(ipt_dev, i);
         if (status != ZX_OK)
             return status;
     }
 
-    status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_CPU_MODE_START,
-                               0, NULL, 0);
+    uint32_t action = ipt_dev->mode == IPT_TRACE_CPUS ?
+        MTRACE_IPT_CPU_MODE_START : MTRACE_IPT_THREAD_MODE_START;
+    status = zx_mtrace_control(resource, MTRACE_KIND_IPT, action, 0, NULL, 0);
     if (status != ZX_OK)
         return status;
     ipt_dev->active = true;
@@ -858,33 +1001,27 @@ static zx_status_t ipt_stop(ipt_device_t* ipt_dev) {
 
     zx_handle_t resource = get_root_resource();
 
-    zx_status_t status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_CPU_MODE_STOP,
+    uint32_t action = ipt_dev->mode == IPT_TRACE_CPUS ?
+        MTRACE_IPT_CPU_MODE_STOP : MTRACE_IPT_THREAD_MODE_STOP;
+    zx_status_t status = zx_mtrace_control(resource, MTRACE_KIND_IPT, action,
                                            0, NULL, 0);
     if (status != ZX_OK)
         return status;
     ipt_dev->active = false;
 
-    for (uint32_t cpu = 0; cpu < ipt_dev->num_traces; ++cpu) {
-        ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[cpu];
+    for (uint32_t i = 0; i < ipt_dev->num_traces; ++i) {
+        ipt_per_trace_state_t* per_trace = &ipt_dev->per_trace_state[i];
+        if (!is_buffer_in_use(ipt_dev, per_trace))
+            continue;
 
-        zx_x86_pt_regs_t regs;
-        status = zx_mtrace_control(resource, MTRACE_KIND_IPT, MTRACE_IPT_GET_CPU_DATA,
-                                   cpu, &regs, sizeof(regs));
+        status = fetch_buffer_state(ipt_dev, i);
         if (status != ZX_OK)
             return status;
-        per_trace->ctl = regs.ctl;
-        per_trace->status = regs.status;
-        per_trace->output_base = regs.output_base;
-        per_trace->output_mask_ptrs = regs.output_mask_ptrs;
-        per_trace->cr3_match = regs.cr3_match;
-        static_assert(sizeof(per_trace->addr_ranges) == sizeof(regs.addr_ranges),
-                      "addr range size mismatch");
-        memcpy(per_trace->addr_ranges, regs.addr_ranges, sizeof(regs.addr_ranges));
 
         // If there was an operational error, report it.
         if (per_trace->status & IPT_STATUS_ERROR_MASK) {
-            printf("%s: WARNING: operational error detected on cpu %u\n",
-                   __func__, cpu);
+            printf("%s: WARNING: operational error detected on trace %u\n",
+                   __func__, i);
         }
     }
 
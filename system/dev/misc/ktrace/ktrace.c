@@ -12,12 +12,29 @@
 
 #include <zircon/device/ktrace.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
 
+static uint32_t ktrace_mode = KTRACE_MODE_LINEAR;
+
 static zx_status_t ktrace_read(void* ctx, void* buf, size_t count, zx_off_t off, size_t* actual) {
+    if (ktrace_mode == KTRACE_MODE_STREAMING) {
+        // streaming reads hand out whatever was collected since the last one
+        if (count > INT32_MAX) {
+            count = INT32_MAX;
+        }
+        zx_status_t status = zx_ktrace_control(get_root_resource(), KTRACE_ACTION_DRAIN,
+                                               (uint32_t)count, buf);
+        if (status < 0) {
+            return status;
+        }
+        *actual = status;
+        return ZX_OK;
+    }
+
     uint32_t length;
     zx_status_t status = zx_ktrace_read(get_root_resource(), buf, off, count, &length);
     if (status == ZX_OK) {
@@ -77,6 +94,18 @@ static zx_status_t ktrace_ioctl(void* ctx, uint32_t op,
         zx_ktrace_control(get_root_resource(), KTRACE_ACTION_REWIND, 0, NULL);
         return ZX_OK;
     }
+    case IOCTL_KTRACE_SET_MODE: {
+        if (cmdlen != sizeof(uint32_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        uint32_t mode = *(uint32_t *)cmd;
+        zx_status_t status = zx_ktrace_control(get_root_resource(), KTRACE_ACTION_SET_MODE,
+                                               mode, NULL);
+        if (status == ZX_OK) {
+            ktrace_mode = mode;
+        }
+        return status;
+    }
     default:
         return ZX_ERR_INVALID_ARGS;
     }
@@ -12,7 +12,9 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <atomic>
 #include <future>
+#include <thread>
 #include <vector>
 
 #include <blobstore/fsck.h>
@@ -32,18 +34,19 @@ namespace {
 
 typedef struct {
     bool readonly = false;
+    bool compress = false;
     uint64_t data_blocks = blobstore::kStartBlockMinimum; // Account for reserved blocks
     fbl::Vector<fbl::String> blob_list;
 } blob_options_t;
 
-int do_blobstore_add_blob(blobstore::Blobstore* bs, const char* blob_name) {
+int do_blobstore_add_blob(blobstore::Blobstore* bs, const char* blob_name, bool compress) {
     fbl::unique_fd data_fd(open(blob_name, O_RDONLY, 0644));
     if (!data_fd) {
         fprintf(stderr, "error: cannot open '%s'\n", blob_name);
         return -1;
     }
     int r;
-    if ((r = blobstore::blobstore_add_blob(bs, data_fd.get())) != 0) {
+    if ((r = blobstore::blobstore_add_blob(bs, data_fd.get(), compress)) != 0) {
         if (r != ZX_ERR_ALREADY_EXISTS) {
             fprintf(stderr, "blobstore: Failed to add blob '%s': %d\n", blob_name, r);
             return -1;
@@ -80,22 +83,36 @@ int do_blobstore_add_blobs(fbl::unique_fd fd, const blob_options_t& options) {
         }
     }
 
-    std::vector<std::future<int>> futures;
+    // One worker per core pulls blobs off the list; a thread per blob
+    // oversubscribes the machine and keeps every blob mapped at once.
+    unsigned workers = std::thread::hardware_concurrency();
+    if (workers == 0) {
+        workers = 1;
+    }
+    if (workers > options.blob_list.size()) {
+        workers = static_cast<unsigned>(options.blob_list.size());
+    }
 
-    for (unsigned i = 0; i < options.blob_list.size(); i++) {
-        const char *filename = options.blob_list[i].c_str();
-        futures.push_back(std::async(std::launch::async, [bs, filename] {
-            return do_blobstore_add_blob(bs.get(), filename);
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::vector<std::future<void>> futures;
+    for (unsigned i = 0; i < workers; i++) {
+        futures.push_back(std::async(std::launch::async, [&] {
+            size_t index;
+            while (!failed && (index = next++) < options.blob_list.size()) {
+                if (do_blobstore_add_blob(bs.get(), options.blob_list[index].c_str(),
+                                          options.compress) < 0) {
+                    failed = true;
+                }
+            }
         }));
     }
 
-    for (unsigned i = 0; i < options.blob_list.size(); i++) {
-        if (futures[i].get() < 0) {
-            return -1;
-        }
+    for (auto& future : futures) {
+        future.get();
     }
 
-    return 0;
+    return failed ? -1 : 0;
 }
 
 int do_blobstore_mkfs(fbl::unique_fd fd, const blob_options_t& options) {
@@ -228,13 +245,15 @@ struct {
 
 int usage() {
     fprintf(stderr,
-            "usage: blobstore <file-or-device>[@<size>] <command> [ <arg>* ]\n"
+            "usage: blobstore [ <option>* ] <file-or-device>[@<size>] <command> [ <arg>* ]\n"
             "\n");
     for (unsigned n = 0; n < (sizeof(CMDS) / sizeof(CMDS[0])); n++) {
         fprintf(stderr, "%9s %-10s %s\n", n ? "" : "commands:",
                 CMDS[n].name, CMDS[n].help);
     }
     fprintf(stderr, "\n");
+    fprintf(stderr, "options:\n"
+                    "\t--compress  Store blobs LZ4 compressed where it saves space\n\n");
     fprintf(stderr, "arguments (valid for create, one or more required for add):\n"
                     "\t--blob <path-to-file>\n"
                     "\t--manifest <path-to-manifest>\n");
@@ -255,6 +274,8 @@ int process_args(int argc, char** argv, CommandFunction* func, blob_options_t* o
     while (argc > 1) {
         if (!strcmp(argv[0], "--readonly")) {
             options->readonly = true;
+        } else if (!strcmp(argv[0], "--compress")) {
+            options->compress = true;
         } else {
             break;
         }
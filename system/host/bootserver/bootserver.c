@@ -123,7 +123,14 @@ void update_status(size_t bytes_so_far) {
     if (is_redirected) {
         int percent_sent = (bytes_so_far * 100 / (total_file_size));
         if (percent_sent - progress_reported >= 5) {
-            fprintf(stderr, "\t%d%%...", percent_sent);
+            struct timeval now;
+            gettimeofday(&now, NULL);
+            int64_t elapsed_usec = (int64_t)(now.tv_sec - start_time.tv_sec) * 1000000 +
+                                   (int64_t)(now.tv_usec - start_time.tv_usec);
+            float bw = (elapsed_usec > 0)
+                ? (float)bytes_so_far * 1000000 / (1024.0 * 1024.0 * ((float)elapsed_usec))
+                : 0;
+            fprintf(stderr, "\t%d%% (%.01fMB/s)...", percent_sent, bw);
             progress_reported = percent_sent;
         }
     } else {
@@ -181,6 +188,15 @@ static int xfer(struct sockaddr_in6* addr, const char* local_name, const char* r
         end_time.tv_usec += 1000000;
     }
     fprintf(stderr, "\n");
+    if (result == 0 && total_file_size > 0) {
+        int64_t elapsed_usec = (int64_t)(end_time.tv_sec - start_time.tv_sec) * 1000000 +
+                               (int64_t)(end_time.tv_usec - start_time.tv_usec);
+        log("Transfer ends     [%5.1f MB]   %.1f sec, %.1f MB/s",
+            (float)total_file_size / 1024.0 / 1024.0, (float)elapsed_usec / 1000000.0,
+            (elapsed_usec > 0)
+                ? (float)total_file_size * 1000000 / (1024.0 * 1024.0 * (float)elapsed_usec)
+                : 0);
+    }
     return result;
 }
 
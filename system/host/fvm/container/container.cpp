@@ -49,7 +49,8 @@ zx_status_t Container::Create(const char* path, off_t offset, off_t length,
 
         // Found sparse container
         fbl::unique_ptr<Container> sparseContainer(new (&ac) SparseContainer(path,
-                                                                             image->slice_size));
+                                                                             image->slice_size,
+                                                                             image->flags));
         if (!ac.check()) {
             return ZX_ERR_NO_MEMORY;
         }
@@ -590,12 +590,9 @@ zx_status_t FvmContainer::WriteData(uint32_t pslice, uint32_t block_offset, size
         return ZX_ERR_OUT_OF_RANGE;
     }
 
-    if (lseek(fd_.get(), disk_offset_ + fvm::SliceStart(disk_size_, slice_size_, pslice) +
-                block_offset * block_size, SEEK_SET) < 0) {
-        return ZX_ERR_BAD_STATE;
-    }
-
-    ssize_t r = write(fd_.get(), data, block_size);
+    off_t offset = disk_offset_ + fvm::SliceStart(disk_size_, slice_size_, pslice) +
+                   block_offset * block_size;
+    ssize_t r = pwrite(fd_.get(), data, block_size, offset);
     if (r != block_size) {
         fprintf(stderr, "Failed to write data to FVM\n");
         return ZX_ERR_BAD_STATE;
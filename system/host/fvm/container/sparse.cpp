@@ -6,10 +6,15 @@
 
 #include "fvm/container.h"
 
-zx_status_t SparseContainer::Create(const char* path, size_t slice_size,
+// Data is handed to the compressor one format block at a time; this is the
+// largest block size of any Format.
+static constexpr size_t kMaxBlockSize = 8192;
+
+zx_status_t SparseContainer::Create(const char* path, size_t slice_size, uint64_t flags,
                                     fbl::unique_ptr<SparseContainer>* out) {
     fbl::AllocChecker ac;
-    fbl::unique_ptr<SparseContainer> sparseContainer(new (&ac) SparseContainer(path, slice_size));
+    fbl::unique_ptr<SparseContainer> sparseContainer(new (&ac) SparseContainer(path, slice_size,
+                                                                               flags));
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
     }
@@ -23,8 +28,8 @@ zx_status_t SparseContainer::Create(const char* path, size_t slice_size,
     return ZX_OK;
 }
 
-SparseContainer::SparseContainer(const char* path, uint64_t slice_size)
-    : Container(slice_size), disk_size_(0) {
+SparseContainer::SparseContainer(const char* path, uint64_t slice_size, uint64_t flags)
+    : Container(slice_size), disk_size_(0), flags_(flags), cctx_(nullptr), out_buf_size_(0) {
     fd_.reset(open(path, O_CREAT | O_RDWR, 0666));
 
     if (!fd_) {
@@ -45,6 +50,7 @@ SparseContainer::SparseContainer(const char* path, uint64_t slice_size)
             fprintf(stderr, "SparseContainer: Failed to read the sparse header\n");
             exit(-1);
         }
+        flags_ = image_.flags;
 
         for (unsigned i = 0; i < image_.partition_count; i++) {
             partition_info_t partition;
@@ -70,7 +76,11 @@ SparseContainer::SparseContainer(const char* path, uint64_t slice_size)
     }
 }
 
-SparseContainer::~SparseContainer() = default;
+SparseContainer::~SparseContainer() {
+    if (cctx_ != nullptr) {
+        LZ4F_freeCompressionContext(cctx_);
+    }
+}
 
 zx_status_t SparseContainer::Init() {
     image_.magic = fvm::kSparseFormatMagic;
@@ -78,6 +88,7 @@ zx_status_t SparseContainer::Init() {
     image_.slice_size = slice_size_;
     image_.partition_count = 0;
     image_.header_length = sizeof(fvm::sparse_image_t);
+    image_.flags = flags_;
     partitions_.reset();
     dirty_ = true;
     xprintf("Initialized new sparse data container.\n");
@@ -93,6 +104,13 @@ zx_status_t SparseContainer::Verify() const {
     xprintf("Slice size is %" PRIu64 "\n", image_.slice_size);
     xprintf("Found %" PRIu64 " partitions\n", image_.partition_count);
 
+    if (image_.flags & fvm::kSparseFlagLz4) {
+        // The partitions can't be checked in place; fsck them before they
+        // are compressed instead.
+        printf("Sparse image is compressed; not checking partitions\n");
+        return ZX_OK;
+    }
+
     off_t start = 0;
     off_t end = image_.header_length;
     for (unsigned i = 0; i < image_.partition_count; i++) {
@@ -186,6 +204,11 @@ zx_status_t SparseContainer::Commit() {
         return ZX_ERR_INTERNAL;
     }
 
+    zx_status_t status;
+    if ((image_.flags & fvm::kSparseFlagLz4) && (status = CompressBegin()) != ZX_OK) {
+        return status;
+    }
+
     // Write each partition out to sparse file
     for (unsigned i = 0; i < image_.partition_count; i++) {
         fvm::partition_descriptor_t partition = partitions_[i].descriptor;
@@ -206,15 +229,17 @@ zx_status_t SparseContainer::Commit() {
                     return ZX_ERR_IO;
                 }
 
-                if (write(fd_.get(), format->Data(), format->BlockSize()) !=
-                    format->BlockSize()) {
-                    fprintf(stderr, "Failed to write data to sparse file\n");
-                    return ZX_ERR_IO;
+                if ((status = WriteData(format->Data(), format->BlockSize())) != ZX_OK) {
+                    return status;
                 }
             }
         }
     }
 
+    if ((image_.flags & fvm::kSparseFlagLz4) && (status = CompressEnd()) != ZX_OK) {
+        return status;
+    }
+
     struct stat s;
     if (fstat(fd_.get(), &s) < 0) {
         fprintf(stderr, "Failed to stat container\n");
@@ -227,6 +252,74 @@ zx_status_t SparseContainer::Commit() {
     return ZX_OK;
 }
 
+zx_status_t SparseContainer::CompressBegin() {
+    LZ4F_errorCode_t err;
+    if (cctx_ == nullptr &&
+        LZ4F_isError(err = LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION))) {
+        fprintf(stderr, "Failed to create compression context: %s\n", LZ4F_getErrorName(err));
+        return ZX_ERR_INTERNAL;
+    }
+
+    // The bound for a single block also covers the frame header and the end
+    // mark, so one buffer serves every call.
+    out_buf_size_ = LZ4F_compressBound(kMaxBlockSize, nullptr);
+    fbl::AllocChecker ac;
+    out_buf_.reset(new (&ac) uint8_t[out_buf_size_]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    size_t r = LZ4F_compressBegin(cctx_, out_buf_.get(), out_buf_size_, nullptr);
+    if (LZ4F_isError(r)) {
+        fprintf(stderr, "Failed to begin compression: %s\n", LZ4F_getErrorName(r));
+        return ZX_ERR_INTERNAL;
+    }
+    if (write(fd_.get(), out_buf_.get(), r) != static_cast<ssize_t>(r)) {
+        fprintf(stderr, "Failed to write data to sparse file\n");
+        return ZX_ERR_IO;
+    }
+    return ZX_OK;
+}
+
+zx_status_t SparseContainer::WriteData(const void* data, size_t length) {
+    if (!(image_.flags & fvm::kSparseFlagLz4)) {
+        if (write(fd_.get(), data, length) != static_cast<ssize_t>(length)) {
+            fprintf(stderr, "Failed to write data to sparse file\n");
+            return ZX_ERR_IO;
+        }
+        return ZX_OK;
+    }
+
+    if (length > kMaxBlockSize) {
+        fprintf(stderr, "Block too large to compress\n");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    size_t r = LZ4F_compressUpdate(cctx_, out_buf_.get(), out_buf_size_, data, length, nullptr);
+    if (LZ4F_isError(r)) {
+        fprintf(stderr, "Failed to compress data: %s\n", LZ4F_getErrorName(r));
+        return ZX_ERR_INTERNAL;
+    }
+    if (r > 0 && write(fd_.get(), out_buf_.get(), r) != static_cast<ssize_t>(r)) {
+        fprintf(stderr, "Failed to write data to sparse file\n");
+        return ZX_ERR_IO;
+    }
+    return ZX_OK;
+}
+
+zx_status_t SparseContainer::CompressEnd() {
+    size_t r = LZ4F_compressEnd(cctx_, out_buf_.get(), out_buf_size_, nullptr);
+    if (LZ4F_isError(r)) {
+        fprintf(stderr, "Failed to finish compression: %s\n", LZ4F_getErrorName(r));
+        return ZX_ERR_INTERNAL;
+    }
+    if (write(fd_.get(), out_buf_.get(), r) != static_cast<ssize_t>(r)) {
+        fprintf(stderr, "Failed to write data to sparse file\n");
+        return ZX_ERR_IO;
+    }
+    out_buf_.reset();
+    return ZX_OK;
+}
+
 size_t SparseContainer::SliceSize() const {
     return image_.slice_size;
 }
@@ -7,6 +7,7 @@
 #include <fbl/vector.h>
 #include <fbl/unique_fd.h>
 #include <fvm/fvm-sparse.h>
+#include <lz4/lz4frame.h>
 
 #include "format.h"
 
@@ -115,9 +116,11 @@ class SparseContainer final : public Container {
     } partition_info_t;
 
 public:
-    static zx_status_t Create(const char* path, size_t slice_size,
+    // Creates a sparse container at |path|. |flags| are the fvm::kSparseFlag
+    // values for a new image; an existing image keeps its own.
+    static zx_status_t Create(const char* path, size_t slice_size, uint64_t flags,
                               fbl::unique_ptr<SparseContainer>* out);
-    SparseContainer(const char* path, uint64_t slice_size);
+    SparseContainer(const char* path, uint64_t slice_size, uint64_t flags);
     ~SparseContainer();
     zx_status_t Init() final;
     zx_status_t Verify() const final;
@@ -127,10 +130,24 @@ public:
 
 private:
     size_t disk_size_;
+    uint64_t flags_;
     fvm::sparse_image_t image_;
     fbl::Vector<partition_info_t> partitions_;
 
+    // LZ4 frame state while writing out the data of an image with
+    // fvm::kSparseFlagLz4 set.
+    LZ4F_compressionContext_t cctx_;
+    fbl::unique_ptr<uint8_t[]> out_buf_;
+    size_t out_buf_size_;
+
     zx_status_t AllocatePartition(fbl::unique_ptr<Format> format);
+
+    // Write |length| bytes of the data section, compressing them if need be.
+    // Compressed data must be bracketed by CompressBegin and CompressEnd.
+    zx_status_t CompressBegin();
+    zx_status_t WriteData(const void* data, size_t length);
+    zx_status_t CompressEnd();
+
     zx_status_t AllocateExtent(uint32_t part_index, uint64_t slice_start, uint64_t slice_count,
                                uint64_t extent_length);
 };
@@ -19,6 +19,7 @@ int usage(void) {
     fprintf(stderr, "Flags (neither or both must be specified):\n");
     fprintf(stderr, " --offset [bytes] - offset at which container begins (fvm only)\n");
     fprintf(stderr, " --length [bytes] - length of container within file (fvm only)\n");
+    fprintf(stderr, " --compress lz4 - LZ4 compress the data of the image (sparse only)\n");
     fprintf(stderr, "Input options:\n");
     fprintf(stderr, " --blobstore [path] - Add path as blobstore type (must be blobstore)\n");
     fprintf(stderr, " --data [path] - Add path as data type (must be minfs)\n");
@@ -137,8 +138,18 @@ int main(int argc, char** argv) {
             return -1;
         }
 
+        uint64_t flags = 0;
+        if (i + 1 < argc && !strcmp(argv[i], "--compress")) {
+            if (strcmp(argv[i + 1], "lz4")) {
+                fprintf(stderr, "Unsupported compression type: %s\n", argv[i + 1]);
+                return -1;
+            }
+            flags |= fvm::kSparseFlagLz4;
+            i += 2;
+        }
+
         fbl::unique_ptr<SparseContainer> sparseContainer;
-        if (SparseContainer::Create(path, slice_size, &sparseContainer) != ZX_OK) {
+        if (SparseContainer::Create(path, slice_size, flags, &sparseContainer) != ZX_OK) {
             return -1;
         }
 
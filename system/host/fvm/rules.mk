@@ -18,6 +18,10 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/format/minfs.cpp \
     system/ulib/fs/vfs.cpp \
     system/ulib/fs/vnode.cpp \
+    third_party/ulib/lz4/lz4.c \
+    third_party/ulib/lz4/lz4frame.c \
+    third_party/ulib/lz4/lz4hc.c \
+    third_party/ulib/lz4/xxhash.c \
 
 MODULE_COMPILEFLAGS := \
     -Werror-implicit-function-declaration \
@@ -35,6 +39,8 @@ MODULE_COMPILEFLAGS := \
     -Isystem/ulib/fs-management/include \
     -Isystem/ulib/blobstore/include \
     -Isystem/ulib/fbl/include \
+    -Ithird_party/ulib/lz4/include \
+    -Ithird_party/ulib/lz4/include/lz4 \
 
 MODULE_HOST_LIBS := \
     third_party/ulib/uboringssl.hostlib \
@@ -44,6 +50,6 @@ MODULE_HOST_LIBS := \
     system/ulib/digest.hostlib \
     system/ulib/minfs.hostlib \
 
-MODULE_DEFINES += DISABLE_THREAD_ANNOTATIONS
+MODULE_DEFINES += DISABLE_THREAD_ANNOTATIONS XXH_NAMESPACE=LZ4_
 
 include make/module.mk
@@ -36,6 +36,7 @@ typedef enum audio_cmd {
     AUDIO_RB_CMD_GET_BUFFER         = 0x3001,
     AUDIO_RB_CMD_START              = 0x3002,
     AUDIO_RB_CMD_STOP               = 0x3003,
+    AUDIO_RB_CMD_GET_POSITION_PAGE  = 0x3004,
 
     // Async notifications sent on the ring buffer channel.
     AUDIO_RB_POSITION_NOTIFY        = 0x4000,
@@ -348,4 +349,59 @@ typedef struct audio_rb_position_notify {
     uint32_t ring_buffer_pos;
 } audio_rb_position_notify_t;
 
+// AUDIO_RB_CMD_GET_POSITION_PAGE
+//
+// Asks the driver to publish the ring buffer position into a shared page, so
+// that clients can poll it without waiting on position notifications.  Must
+// be sent while the ring buffer is stopped, and before AUDIO_RB_CMD_GET_BUFFER
+// so the driver can arrange for the position to be sampled often enough.  The
+// page remains valid for as long as the ring buffer channel is open.
+//
+// AUDIO_RB_POSITION_FLAG_LOW_LATENCY asks the driver to update the page as
+// often as its hardware allows, and to run its position updates with a
+// deadline cpu reservation.  Drivers which have nothing finer to offer treat
+// it as a hint.
+//
+// May be not used with the NO_ACK flag.
+#define AUDIO_RB_POSITION_FLAG_LOW_LATENCY ((uint32_t)1u << 0)
+
+typedef struct audio_rb_cmd_get_position_page_req {
+    audio_cmd_hdr_t hdr;
+    uint32_t        flags;
+} audio_rb_cmd_get_position_page_req_t;
+
+typedef struct audio_rb_cmd_get_position_page_resp {
+    audio_cmd_hdr_t hdr;
+    zx_status_t     result;
+
+    // NOTE: If result == ZX_OK, a read-only VMO handle is returned as well.
+    // It holds an audio_rb_position_page_t at offset 0.
+} audio_rb_cmd_get_position_page_resp_t;
+
+// The contents of the position page.  The driver bumps |seq| to an odd value
+// before it changes the other fields and back to an even value afterwards, so
+// a reader must retry if it sees an odd |seq| or if |seq| changed while it
+// was reading.  audio_rb_read_position() does this.
+typedef struct audio_rb_position_page {
+    uint32_t seq;
+
+    // Same meaning as in audio_rb_position_notify_t.
+    uint32_t ring_buffer_pos;
+
+    // ZX_CLOCK_MONOTONIC time at which |ring_buffer_pos| was sampled.
+    zx_time_t timestamp;
+} audio_rb_position_page_t;
+
+static inline void audio_rb_read_position(const audio_rb_position_page_t* page,
+                                          uint32_t* ring_buffer_pos,
+                                          zx_time_t* timestamp) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        *ring_buffer_pos = __atomic_load_n(&page->ring_buffer_pos, __ATOMIC_RELAXED);
+        *timestamp = __atomic_load_n(&page->timestamp, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1u) || (seq != __atomic_load_n(&page->seq, __ATOMIC_RELAXED)));
+}
+
 __END_CDECLS
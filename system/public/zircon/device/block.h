@@ -78,11 +78,17 @@
 // since it will allow "activating" updated partitions.
 #define IOCTL_BLOCK_FVM_UPGRADE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 17)
+// Get request latency and queue depth statistics from the currently running
+// FIFO server
+#define IOCTL_BLOCK_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 18)
 
 // Block Core ioctls (specific to each block device):
 
 #define BLOCK_FLAG_READONLY 0x00000001
 #define BLOCK_FLAG_REMOVABLE 0x00000002
+// The device can discard unused blocks with BLOCKIO_TRIM.
+#define BLOCK_FLAG_TRIM_SUPPORT 0x00000004
 
 typedef struct {
     uint64_t block_count;       // The number of blocks in this block device
@@ -142,6 +148,42 @@ IOCTL_WRAPPER_IN(ioctl_block_free_txn, IOCTL_BLOCK_FREE_TXN, txnid_t);
 // ssize_t ioctl_block_fifo_close(int fd);
 IOCTL_WRAPPER(ioctl_block_fifo_close, IOCTL_BLOCK_FIFO_CLOSE);
 
+#define BLOCK_STATS_BUCKETS 20
+#define BLOCK_STATS_MAX_CLIENTS 32
+
+typedef struct {
+    uint64_t count;      // Requests completed
+    uint64_t blocks;     // Blocks they transferred
+    uint64_t total_ns;   // Summed from arrival at the server to completion
+    uint64_t queue_ns;   // The part of total_ns spent queued in the server
+    // Bucket i counts requests which took [2^i, 2^(i+1)) microseconds; the
+    // first also counts faster ones and the last slower ones.
+    uint32_t latency[BLOCK_STATS_BUCKETS];
+} block_op_stats_t;
+
+// The requests of one txn of the FIFO server, which is usually one client.
+typedef struct {
+    txnid_t txnid;
+    uint16_t reserved;
+    uint32_t in_flight;  // Requests queued or at the device
+    block_op_stats_t read;
+    block_op_stats_t write;
+} block_client_stats_t;
+
+typedef struct {
+    // Counted in device operations, of which the server may split one
+    // request into several, or merge several into one
+    uint32_t in_flight;      // At the device
+    uint32_t max_in_flight;  // The most ever at the device at once
+    uint32_t queued;         // Queued in the server
+    uint32_t client_count;   // Allocated txns; the first BLOCK_STATS_MAX_CLIENTS are listed
+    block_client_stats_t clients[BLOCK_STATS_MAX_CLIENTS];
+} block_stats_t;
+
+// Statistics are kept from when a txn is allocated until it is freed.
+// ssize_t ioctl_block_get_stats(int fd, block_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_block_get_stats, IOCTL_BLOCK_GET_STATS, block_stats_t);
+
 #define GUID_LEN 16
 #define NAME_LEN 24
 #define MAX_FVM_VSLICE_REQUESTS 16
@@ -253,11 +295,16 @@ IOCTL_WRAPPER_IN(ioctl_block_fvm_upgrade, IOCTL_BLOCK_FVM_UPGRADE, upgrade_req_t
 // blocks, into the VMO associated with 'vmoid', starting at 'vmo_offset' blocks.  If the
 // transaction is out of range, for example if 'length' is too large or if 'dev_offset' is beyond
 // the end of the device, ZX_ERR_OUT_OF_RANGE is returned.
+//
+// A BLOCKIO_TRIM transaction discards 'length' blocks starting at 'dev_offset'; it needs no VMO,
+// so 'vmoid' and 'vmo_offset' are ignored.  Devices without BLOCK_FLAG_TRIM_SUPPORT fail it with
+// ZX_ERR_NOT_SUPPORTED.
 
 #define BLOCKIO_READ 0x0001      // Reads from the Block device into the VMO
 #define BLOCKIO_WRITE 0x0002     // Writes to the Block device from the VMO
 #define BLOCKIO_SYNC 0x0003      // Unimplemented
 #define BLOCKIO_CLOSE_VMO 0x0004 // Detaches the VMO from the block device; closes the handle to it.
+#define BLOCKIO_TRIM 0x0005      // Discards blocks which no longer hold data
 #define BLOCKIO_OP_MASK 0x00FF
 
 #define BLOCKIO_TXN_END 0x0100 // Expects response after request (and all previous) have completed
@@ -67,8 +67,10 @@ typedef enum {
   CPUPERF_RECORD_VALUE = 4,
   // The record is a |cpuperf_pc_record_t|.
   CPUPERF_RECORD_PC = 5,
+  // The record is a |cpuperf_sample_record_t|.
+  CPUPERF_RECORD_SAMPLE = 6,
   // non-ABI
-  CPUPERF_NUM_RECORD_TYPES = 6,
+  CPUPERF_NUM_RECORD_TYPES = 7,
 } cpuperf_record_type_t;
 
 // Trace buffer space is expensive, we want to keep records small.
@@ -174,6 +176,31 @@ typedef struct {
     uint64_t pc;
 } __PACKED cpuperf_pc_record_t;
 
+// The number of return addresses in a |cpuperf_sample_record_t|.
+#define CPUPERF_SAMPLE_CALLCHAIN_DEPTH 4
+
+// Set in |header.reserved_flags| of a |cpuperf_sample_record_t| if the
+// sample was taken while running in the kernel.
+#define CPUPERF_SAMPLE_FLAG_KERNEL (1u << 0)
+
+// Like |cpuperf_pc_record_t|, but also identifies the thread and the
+// innermost callers, for attributing samples in a profile.
+// It is expected that this record follows a TIME record.
+typedef struct {
+    cpuperf_record_header_t header;
+    // The koids of the interrupted thread and its process, or zero if it
+    // was a kernel thread.
+    uint64_t tid;
+    uint64_t pid;
+    // As in |cpuperf_pc_record_t|.
+    uint64_t aspace;
+    uint64_t pc;
+    // The return addresses of the innermost frames, followed by zeroes.
+    // These are only collected for kernel samples: the user stack can't be
+    // read safely from the overflow interrupt.
+    uint64_t callchain[CPUPERF_SAMPLE_CALLCHAIN_DEPTH];
+} __PACKED cpuperf_sample_record_t;
+
 // The properties of this system.
 typedef struct {
     // S/W API version = CPUPERF_API_VERSION.
@@ -229,6 +256,9 @@ typedef struct {
 // record (depending on what the event is).
 // It is an error to have this bit set for an event and have rate[0] be zero.
 #define CPUPERF_CONFIG_FLAG_TIMEBASE0 (1u << 3)
+// With CPUPERF_CONFIG_FLAG_PC, emit CPUPERF_RECORD_SAMPLE records, which
+// also identify the thread and its innermost callers.
+#define CPUPERF_CONFIG_FLAG_CALLCHAIN (1u << 4)
 } cpuperf_config_t;
 
 ///////////////////////////////////////////////////////////////////////////////
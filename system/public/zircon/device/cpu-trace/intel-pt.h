@@ -185,6 +185,10 @@ typedef struct {
 // trace specific threads
 #define IPT_MODE_THREADS 1
 
+// The maximum number of threads that can be traced at once in
+// IPT_MODE_THREADS. Trace buffer descriptors are in [0, this).
+#define IPT_MAX_NUM_THREADS 32
+
 ///////////////////////////////////////////////////////////////////////////////
 
 #ifdef __Fuchsia__
@@ -270,13 +274,15 @@ IOCTL_WRAPPER_INOUT(ioctl_ipt_get_buffer_config, IOCTL_IPT_GET_BUFFER_CONFIG,
 // Not the trace data itself, just info about the data.
 typedef struct {
     // N.B. This is the offset in the buffer where tracing stopped (treating
-    // all buffers as one large one). If using a circular buffer then all of
-    // the buffer may contain data, there's no current way to know if tracing
-    // wrapped.
+    // all buffers as one large one), or where it has got to if tracing is
+    // still active. A circular buffer wraps back to offset zero when full, so
+    // a reader draining one while tracing must poll at least once per buffer
+    // fill: a value smaller than the last one read means the trace wrapped.
     uint64_t capture_end;
 } ioctl_ipt_buffer_info_t;
 
 // get trace data associated with the buffer
+// This may be called while tracing is active.
 // Input: trace buffer descriptor
 // Output: ioctl_ipt_buffer_info_t
 #define IOCTL_IPT_GET_BUFFER_INFO \
@@ -77,6 +77,16 @@ typedef struct {
 #define IOCTL_DEVICE_SET_DRIVER_LOG_FLAGS \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_DEVICE, 10)
 
+// Sets a VMO through which reads and writes on this connection may move
+// their data instead of in the messages themselves; see
+// ZXRIO_FLAG_IO_BUFFER. fdio sets one up itself for large transfers.
+//   in: handle (VMO, at most DEVICE_IO_BUFFER_MAX bytes)
+//   out: none
+#define IOCTL_DEVICE_SET_IO_BUFFER \
+    IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DEVICE, 11)
+
+#define DEVICE_IO_BUFFER_MAX (1024 * 1024)
+
 // Indicates if there's data available to read,
 // or room to write, or an error condition.
 #define DEVICE_SIGNAL_READABLE ZX_USER_SIGNAL_0
@@ -85,6 +95,9 @@ typedef struct {
 #define DEVICE_SIGNAL_ERROR    ZX_USER_SIGNAL_3
 #define DEVICE_SIGNAL_HANGUP   ZX_USER_SIGNAL_4
 
+// ssize_t ioctl_device_set_io_buffer(int fd, const zx_handle_t* in);
+IOCTL_WRAPPER_IN(ioctl_device_set_io_buffer, IOCTL_DEVICE_SET_IO_BUFFER, zx_handle_t);
+
 // ssize_t ioctl_device_bind(int fd, const char* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_device_bind, IOCTL_DEVICE_BIND, char);
 
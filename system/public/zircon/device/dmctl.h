@@ -44,6 +44,14 @@ typedef struct {
 #define IOCTL_DMCTL_MEXEC \
     IOCTL(IOCTL_KIND_SET_TWO_HANDLES, IOCTL_FAMILY_DMCTL, 4)
 
+// Soft reboot the system with a new kernel and the bootdata the running
+// kernel was booted with, which it only keeps if booted with
+// kernel.mexec-preserve-bootdata=true.
+// Passes a handle to the kernel vmo.
+// If successful, this ioctl does not return.
+#define IOCTL_DMCTL_WARM_REBOOT \
+    IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DMCTL, 5)
+
 typedef struct {
     uint32_t opcode;
     uint32_t flags;
@@ -84,3 +92,6 @@ IOCTL_WRAPPER_IN(ioctl_dmctl_watch_devmgr, IOCTL_DMCTL_WATCH_DEVMGR, zx_handle_t
 
 // ssize_t ioctl_dmctl_mexec(int fd, dmctl_mexec_args_t* args);
 IOCTL_WRAPPER_IN(ioctl_dmctl_mexec, IOCTL_DMCTL_MEXEC, dmctl_mexec_args_t);
+
+// ssize_t ioctl_dmctl_warm_reboot(int fd, zx_handle_t* kernel);
+IOCTL_WRAPPER_IN(ioctl_dmctl_warm_reboot, IOCTL_DMCTL_WARM_REBOOT, zx_handle_t);
@@ -22,7 +22,9 @@ typedef struct eth_info_t {
     uint32_t mtu;
     uint8_t mac[6];
     uint8_t pad[2];
-    uint32_t reserved[12];
+    // The most rx queues a client may have, counting the one from GET_FIFOS.
+    uint32_t rx_queues;
+    uint32_t reserved[11];
 } eth_info_t;
 
 #define ETH_SIGNAL_STATUS ZX_USER_SIGNAL_0
@@ -33,6 +35,14 @@ typedef struct eth_info_t {
 #define ETH_FEATURE_WLAN  1
 // Device is a synthetic network device
 #define ETH_FEATURE_SYNTH 2
+// Device can fill in checksums of transmitted packets (ETH_TX_OFFLOAD_CSUM)
+#define ETH_FEATURE_TX_CSUM 4
+// Device can split transmitted TCP packets into segments (ETH_TX_OFFLOAD_TSO_*)
+#define ETH_FEATURE_TSO 8
+// Device can verify checksums of received packets (ETH_FIFO_RX_CSUM_OK)
+#define ETH_FEATURE_RX_CSUM 16
+// Device can coalesce received TCP segments into larger packets (ETH_FIFO_RX_COALESCED)
+#define ETH_FEATURE_LRO 32
 
 // Get the fifos to submit tx and rx operations
 //   in: none
@@ -84,6 +94,200 @@ typedef struct eth_fifos_t {
 #define IOCTL_ETHERNET_SET_PROMISC \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 9)
 
+// Returns: eth_stats_t
+// Counters for the entries this instance has returned through its fifos.
+#define IOCTL_ETHERNET_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 10)
+
+typedef struct eth_stats {
+    // Writes of completed entries to the tx fifo, the entries they carried, and the most
+    // carried by any one of them.
+    uint64_t tx_batches;
+    uint64_t tx_entries;
+    uint64_t tx_batch_max;
+    // Completed entries lost because the tx fifo was full.
+    uint64_t tx_fifo_full;
+    // The same, for received packets and the rx fifo.
+    uint64_t rx_batches;
+    uint64_t rx_entries;
+    uint64_t rx_batch_max;
+    uint64_t rx_fifo_full;
+} eth_stats_t;
+
+// Get the fifo of an additional rx queue, for receive-side scaling. The fifo
+// works just like the rx fifo from GET_FIFOS, with the same depth.
+//   in: uint32_t queue index, from 1 to rx_queues - 1
+//  out: zx_handle_t (fifo)
+#define IOCTL_ETHERNET_GET_RX_QUEUE \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 11)
+
+// Spread received packets over the client's rx queues. Each packet is hashed
+// with the Toeplitz function, keyed by |key|, over its source and destination
+// addresses, and ports for the protocols selected in |hash_types|. The low bits
+// of the hash then pick an entry of |indirection|, which names the queue. Packets
+// which are not hashed, or whose queue does not exist, go to queue 0.
+//   in: eth_rss_config_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_RSS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 12)
+
+#define ETH_MAX_RX_QUEUES 8
+#define ETH_RSS_KEY_SIZE 40
+#define ETH_RSS_TABLE_SIZE 128
+
+#define ETH_RSS_HASH_IPV4     (1u)
+#define ETH_RSS_HASH_TCP_IPV4 (2u)
+#define ETH_RSS_HASH_UDP_IPV4 (4u)
+#define ETH_RSS_HASH_IPV6     (8u)
+#define ETH_RSS_HASH_TCP_IPV6 (16u)
+#define ETH_RSS_HASH_UDP_IPV6 (32u)
+
+typedef struct eth_rss_config {
+    // ETH_RSS_HASH_ flags; zero turns steering off.
+    uint32_t hash_types;
+    uint8_t key[ETH_RSS_KEY_SIZE];
+    uint8_t indirection[ETH_RSS_TABLE_SIZE];
+} eth_rss_config_t;
+
+// Enable the offloads in the ETH_FEATURE_ bits of |in|, and disable the rest.
+// Fails with ZX_ERR_NOT_SUPPORTED, changing nothing, if the device lacks any of
+// them. All are off until enabled. Received packets are coalesced only while
+// every started client has enabled ETH_FEATURE_LRO, since they may be longer
+// than the mtu.
+//   in: uint32_t
+//  out: none
+#define IOCTL_ETHERNET_SET_OFFLOADS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 13)
+
+// Start capturing the frames sent and received by every client of the device
+// into a ring in shared memory, whose vmo is returned for the capture tool to
+// map. Frames are copied in as they pass through the driver, and left out of
+// the capture (not the network) when the ring is full, so capturing never holds
+// up the datapath. One capture runs per device at a time (ZX_ERR_ALREADY_BOUND
+// otherwise); it ends with CAPTURE_STOP or when its instance is closed.
+//   in: eth_capture_config_t*
+//  out: zx_handle_t (vmo)
+#define IOCTL_ETHERNET_CAPTURE_START \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_ETH, 14)
+#define IOCTL_ETHERNET_CAPTURE_STOP \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 15)
+
+#define ETH_CAPTURE_RX  (1u)
+#define ETH_CAPTURE_TX  (2u)
+// In a record's flags: the rest of the ring up to its end is unused.
+#define ETH_CAPTURE_PAD (4u)
+
+#define ETH_CAPTURE_MIN_RING_SIZE (4096u)
+#define ETH_CAPTURE_MAX_RING_SIZE (64u * 1024 * 1024)
+#define ETH_CAPTURE_MAX_FILTERS 8
+
+#define ETH_CAPTURE_FILTER_NE (1u)
+
+// A frame is captured only if it passes every filter: the |size|-byte
+// big-endian field at |offset| in the frame, ANDed with |mask|, must equal
+// |value|, or differ from it with ETH_CAPTURE_FILTER_NE. A frame too short to
+// hold the field fails.
+typedef struct eth_capture_filter {
+    uint16_t offset;
+    // 1, 2 or 4
+    uint8_t size;
+    uint8_t flags;
+    uint32_t mask;
+    uint32_t value;
+} eth_capture_filter_t;
+
+typedef struct eth_capture_config {
+    // ETH_CAPTURE_RX and/or ETH_CAPTURE_TX
+    uint32_t flags;
+    // The most bytes of each frame captured, or 0 for all of them.
+    uint32_t snaplen;
+    // Bytes in the ring for records, a power of two between
+    // ETH_CAPTURE_MIN_RING_SIZE and ETH_CAPTURE_MAX_RING_SIZE.
+    uint32_t ring_size;
+    uint32_t filter_count;
+    eth_capture_filter_t filters[ETH_CAPTURE_MAX_FILTERS];
+} eth_capture_config_t;
+
+// The capture vmo starts with this header, and the records follow it at
+// ETH_CAPTURE_DATA_OFFSET. The driver advances |head| with a release store once
+// a record is complete; the reader advances |tail| the same way once it is done
+// with the records before it, and the driver never overwrites those it has not.
+// Both count bytes since the start of the capture, so a record is at
+// (offset % size).
+typedef struct eth_capture_ring {
+    uint64_t head;
+    uint64_t tail;
+    uint32_t size;
+    uint32_t reserved;
+    // Frames left out because the ring was full.
+    uint64_t dropped;
+    // The rate of the records' timestamps.
+    uint64_t ticks_per_second;
+} eth_capture_ring_t;
+
+#define ETH_CAPTURE_DATA_OFFSET 64
+
+// Records are 8-byte aligned and never wrap around the end of the ring. If the
+// next one would, an ETH_CAPTURE_PAD record fills the space to the end first;
+// only its |record_len| and |flags| are valid, as that space may be just 8 bytes.
+typedef struct eth_capture_record {
+    // Including this header and the padding after the data.
+    uint32_t record_len;
+    // ETH_CAPTURE_RX, ETH_CAPTURE_TX or ETH_CAPTURE_PAD
+    uint32_t flags;
+    // The length of the frame, and how much of it follows.
+    uint32_t frame_len;
+    uint32_t cap_len;
+    // zx_ticks_get() when the frame was captured.
+    uint64_t ticks;
+    uint8_t data[];
+} eth_capture_record_t;
+
+// Set how the device paces its interrupts, for devices that can. This is shared
+// by all clients of the device, and lasts until changed.
+//   in: eth_irq_moderation_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_IRQ_MODERATION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 16)
+
+// At most one interrupt every |interval_us|, or no limit if it is zero.
+#define ETH_IRQ_MODERATION_FIXED    (0u)
+// The interval follows the packet rate: short while it is low, for latency, and
+// longer under load, so that a flood of small packets can't livelock the CPU.
+// |interval_us| is unused. The default.
+#define ETH_IRQ_MODERATION_ADAPTIVE (1u)
+// No interrupts; the driver polls the device instead, sleeping |interval_us|
+// between polls that find nothing, or just yielding if it is zero. This trades a
+// CPU for the lowest latency.
+#define ETH_IRQ_MODERATION_POLL     (2u)
+
+typedef struct eth_irq_moderation {
+    uint32_t mode;
+    uint32_t interval_us;
+} eth_irq_moderation_t;
+
+#define ETH_TX_OFFLOAD_CSUM    (1u)
+#define ETH_TX_OFFLOAD_TSO_V4  (2u)
+#define ETH_TX_OFFLOAD_TSO_V6  (4u)
+
+// Describes the offloads for a transmitted packet. It is at the start of the
+// packet's buffer when its fifo entry has ETH_FIFO_TX_OFFLOAD set, the packet
+// follows it, and the entry's length counts both.
+typedef struct eth_tx_offload {
+    // ETH_TX_OFFLOAD_ flags. TSO also needs CSUM.
+    uint16_t flags;
+    // The checksum over the packet from byte |csum_start| to its end is stored
+    // |csum_offset| bytes past |csum_start|, in a field which the client has set
+    // to the sum of the pseudo-header.
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    // The payload after the first |hdr_len| bytes of the packet is sent in
+    // segments of |mss| bytes, each with a copy of the headers.
+    uint16_t hdr_len;
+    uint16_t mss;
+    uint16_t reserved[3];
+} eth_tx_offload_t;
+
 // Link status bits:
 #define ETH_STATUS_ONLINE (1u)
 
@@ -109,13 +313,15 @@ typedef struct eth_fifos_t {
 // are returned along with the fifo handles in the eth_fifos_t.
 
 // flags values for request messages
-// - none -
+#define ETH_FIFO_TX_OFFLOAD (8u)  // packet starts with an eth_tx_offload_t
 
 // flags values for response messages
 #define ETH_FIFO_RX_OK   (1u)   // packet received okay
 #define ETH_FIFO_TX_OK   (1u)   // packet transmitted okay
 #define ETH_FIFO_INVALID (2u)   // offset+length not within io_vmo bounds
 #define ETH_FIFO_RX_TX   (4u)   // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_CSUM_OK   (8u)   // checksums verified by the device (when RX_CSUM)
+#define ETH_FIFO_RX_COALESCED (16u)  // several TCP segments in one packet (when LRO)
 
 typedef struct eth_fifo_entry {
     // offset from start of io_vmo to packet data
@@ -156,3 +362,28 @@ IOCTL_WRAPPER_OUT(ioctl_ethernet_get_status, IOCTL_ETHERNET_GET_STATUS, uint32_t
 
 // ssize_t ioctl_ethernet_set_promisc(int fd, bool*);
 IOCTL_WRAPPER_IN(ioctl_ethernet_set_promisc, IOCTL_ETHERNET_SET_PROMISC, bool);
+
+// ssize_t ioctl_ethernet_get_stats(int fd, eth_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_get_stats, IOCTL_ETHERNET_GET_STATS, eth_stats_t);
+
+// ssize_t ioctl_ethernet_get_rx_queue(int fd, const uint32_t* queue, zx_handle_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_get_rx_queue, IOCTL_ETHERNET_GET_RX_QUEUE, uint32_t,
+                    zx_handle_t);
+
+// ssize_t ioctl_ethernet_set_rss(int fd, const eth_rss_config_t* config);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_rss, IOCTL_ETHERNET_SET_RSS, eth_rss_config_t);
+
+// ssize_t ioctl_ethernet_set_offloads(int fd, const uint32_t* features);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_offloads, IOCTL_ETHERNET_SET_OFFLOADS, uint32_t);
+
+// ssize_t ioctl_ethernet_capture_start(int fd, const eth_capture_config_t* config,
+//                                      zx_handle_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ethernet_capture_start, IOCTL_ETHERNET_CAPTURE_START,
+                    eth_capture_config_t, zx_handle_t);
+
+// ssize_t ioctl_ethernet_capture_stop(int fd);
+IOCTL_WRAPPER(ioctl_ethernet_capture_stop, IOCTL_ETHERNET_CAPTURE_STOP);
+
+// ssize_t ioctl_ethernet_set_irq_moderation(int fd, const eth_irq_moderation_t* moderation);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_irq_moderation, IOCTL_ETHERNET_SET_IRQ_MODERATION,
+                 eth_irq_moderation_t);
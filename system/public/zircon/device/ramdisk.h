@@ -16,12 +16,33 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_RAMDISK, 2)
 #define IOCTL_RAMDISK_SET_FLAGS \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_RAMDISK, 3)
+#define IOCTL_RAMDISK_CONFIG_EX \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_RAMDISK, 5)
+
+// Complete each request on the thread that queues it, rather than handing it to a worker.
+#define RAMDISK_OPT_INLINE   0x00000001
+// Commit the whole VMO and populate its mapping when the ramdisk is created, so that
+// requests never fault. Trims then zero the range instead of decommitting it.
+#define RAMDISK_OPT_PREFAULT 0x00000002
+#define RAMDISK_OPT_MASK     (RAMDISK_OPT_INLINE | RAMDISK_OPT_PREFAULT)
+
+// The most worker threads a ramdisk may have.
+#define RAMDISK_MAX_WORKERS 16
 
 typedef struct ramdisk_ioctl_config {
     uint64_t blk_size;
     uint64_t blk_count;
 } ramdisk_ioctl_config_t;
 
+typedef struct ramdisk_ioctl_config_ex {
+    uint64_t blk_size;
+    uint64_t blk_count;
+    // RAMDISK_OPT_* flags.
+    uint32_t options;
+    // How many threads handle requests, unless RAMDISK_OPT_INLINE is set. Zero means one.
+    uint32_t num_workers;
+} ramdisk_ioctl_config_ex_t;
+
 typedef struct ramdisk_ioctl_config_response {
     char name[NAME_MAX + 1];
 } ramdisk_ioctl_config_response_t;
@@ -31,6 +52,11 @@ typedef struct ramdisk_ioctl_config_response {
 IOCTL_WRAPPER_INOUT(ioctl_ramdisk_config, IOCTL_RAMDISK_CONFIG, ramdisk_ioctl_config_t,
                     ramdisk_ioctl_config_response_t);
 
+// ssize_t ioctl_ramdisk_config_ex(int fd, const ramdisk_ioctl_config_ex_t* in,
+//                                 ramdisk_ioctl_config_response_t* out);
+IOCTL_WRAPPER_INOUT(ioctl_ramdisk_config_ex, IOCTL_RAMDISK_CONFIG_EX, ramdisk_ioctl_config_ex_t,
+                    ramdisk_ioctl_config_response_t);
+
 // ssize_t ioctl_ramdisk_config_vmo(int fd, const zx_handle_t* in,
 //                                  ramdisk_ioctl_config_response_t* out);
 IOCTL_WRAPPER_INOUT(ioctl_ramdisk_config_vmo, IOCTL_RAMDISK_CONFIG_VMO,
@@ -88,6 +88,15 @@
 #define IOCTL_VFS_GET_DEVICE_PATH \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_VFS, 9)
 
+// Return the counters of the filesystem's file data cache.
+#define IOCTL_VFS_QUERY_CACHE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_VFS, 10)
+
+// Trim all of the filesystem's free blocks on the underlying block device,
+// returning the number of bytes trimmed. Requires O_ADMIN.
+#define IOCTL_VFS_TRIM_FS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_VFS, 11)
+
 typedef struct {
     zx_handle_t channel; // Channel to which watch events will be sent
     uint32_t mask;       // Bitmask of desired events (1 << WATCH_EVT_*)
@@ -173,6 +182,22 @@ IOCTL_WRAPPER_IN(ioctl_vfs_watch_dir, IOCTL_VFS_WATCH_DIR, vfs_watch_dir_t);
 // ssize_t ioctl_vfs_get_device_path(int fd, char* out, size_t out_len);
 IOCTL_WRAPPER_VAROUT(ioctl_vfs_get_device_path, IOCTL_VFS_GET_DEVICE_PATH, char);
 
+typedef struct vfs_cache_info {
+    // These counts are in filesystem blocks.
+    uint64_t hits;      // Blocks read which were already cached.
+    uint64_t misses;    // Blocks read which had to be fetched first.
+    uint64_t readahead; // Blocks fetched ahead of a sequential reader.
+    // These count files and directories opened again after their last close.
+    uint64_t vnode_hits;   // Those whose cached state was still kept.
+    uint64_t vnode_misses; // Those which had to start from disk.
+} vfs_cache_info_t;
+
+// ssize_t ioctl_vfs_query_cache(int fd, vfs_cache_info_t* out);
+IOCTL_WRAPPER_OUT(ioctl_vfs_query_cache, IOCTL_VFS_QUERY_CACHE, vfs_cache_info_t);
+
+// ssize_t ioctl_vfs_trim_fs(int fd, uint64_t* out_bytes);
+IOCTL_WRAPPER_OUT(ioctl_vfs_trim_fs, IOCTL_VFS_TRIM_FS, uint64_t);
+
 typedef struct {
     zx_handle_t vmo;
     char name[]; // Null-terminator required
@@ -27,6 +27,8 @@ KTRACE_DEF(0x034,32B,PAGE_FAULT,IRQ) // virtual_address_hi, virtual_address_lo,
 KTRACE_DEF(0x035,32B,PAGE_FAULT_EXIT,IRQ) // virtual_address_hi, virtual_address_lo, flags, cpu
 
 KTRACE_DEF(0x040,32B,CONTEXT_SWITCH,SCHEDULER) // to-tid, (state<<16|cpu), from-kt, to-kt
+KTRACE_DEF(0x041,32B,DEADLINE_OVERRUN,SCHEDULER) // tid, overrun_lo, overrun_hi, cpu
+KTRACE_DEF(0x042,32B,DPC_LATENCY,SCHEDULER) // latency_lo, latency_hi, priority, cpu
 
 // events from 0x100 on all share the tag/tid/ts common header
 
@@ -39,6 +41,7 @@ KTRACE_DEF(0x112,32B,THREAD_EXIT,TASKS)
 KTRACE_DEF(0x120,32B,PROC_CREATE,TASKS) // pid
 KTRACE_DEF(0x121,32B,PROC_START,TASKS) // tid, pid
 KTRACE_DEF(0x122,32B,PROC_EXIT,TASKS) // pid
+KTRACE_DEF(0x123,32B,PROC_SYSCALLS,TASKS) // pid, num, count, usec
 
 KTRACE_DEF(0x130,32B,CHANNEL_CREATE,IPC) // id0, id1, flags
 KTRACE_DEF(0x131,32B,CHANNEL_WRITE,IPC) // id0, bytes, handles
@@ -88,5 +88,12 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, only while stopped
+#define KTRACE_ACTION_DRAIN     6 // options = buffer size, ptr = buffer
+
+// Buffer modes for KTRACE_ACTION_SET_MODE
+#define KTRACE_MODE_LINEAR      0 // stop tracing once a cpu's buffer is full
+#define KTRACE_MODE_CIRCULAR    1 // overwrite the oldest records
+#define KTRACE_MODE_STREAMING   2 // drop new records until the buffer is drained
 
 __END_CDECLS
@@ -39,6 +39,21 @@ __BEGIN_CDECLS
 #define MTRACE_IPT_CPU_MODE_START 4
 #define MTRACE_IPT_CPU_MODE_STOP 5
 
+// Assign a trace buffer descriptor to a thread.
+// The argument is the thread's handle.
+#define MTRACE_IPT_ASSIGN_THREAD 6
+
+// Undo MTRACE_IPT_ASSIGN_THREAD.
+#define MTRACE_IPT_RELEASE_THREAD 7
+
+// Stage/fetch trace buffer data (MSRs) for a thread.
+// As with cpus, fetching may be done while tracing.
+#define MTRACE_IPT_STAGE_THREAD_DATA 8
+#define MTRACE_IPT_GET_THREAD_DATA 9
+
+#define MTRACE_IPT_THREAD_MODE_START 10
+#define MTRACE_IPT_THREAD_MODE_STOP 11
+
 // Encode/decode options values for mtrace_control().
 // At present we just encode the cpu number here.
 // We only support 32 cpus at the moment, the extra bit is for magic values.
@@ -49,6 +64,9 @@ __BEGIN_CDECLS
 
 #define MTRACE_IPT_OPTIONS_CPU(options) ((options) & MTRACE_IPT_OPTIONS_CPU_MASK)
 
+// The thread actions encode the trace buffer descriptor the same way.
+#define MTRACE_IPT_OPTIONS_DESCRIPTOR(options) ((options) & MTRACE_IPT_OPTIONS_CPU_MASK)
+
 // Actions for Intel Performance Monitoring control
 
 // Get performonce monitoring system properties
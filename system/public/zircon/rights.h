@@ -22,11 +22,14 @@
     (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO |\
      ZX_RIGHT_SIGNAL | ZX_RIGHT_SIGNAL_PEER)
 
+#define ZX_DEFAULT_WAIT_SET_RIGHTS \
+    (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO)
+
 #define ZX_DEFAULT_GUEST_RIGHTS \
     (ZX_RIGHTS_BASIC | ZX_RIGHT_WRITE)
 
 #define ZX_DEFAULT_INTERRUPT_RIGHTS \
-    (ZX_RIGHT_TRANSFER | ZX_RIGHT_WAIT | ZX_RIGHTS_IO)
+    (ZX_RIGHT_TRANSFER | ZX_RIGHT_WAIT | ZX_RIGHTS_IO | ZX_RIGHTS_PROPERTY)
 
 #define ZX_DEFAULT_IO_MAPPING_RIGHTS \
     (ZX_RIGHT_READ)
@@ -43,7 +46,7 @@
     (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO)
 
 #define ZX_DEFAULT_PCI_INTERRUPT_RIGHTS \
-    (ZX_RIGHT_TRANSFER | ZX_RIGHT_WAIT | ZX_RIGHTS_IO)
+    (ZX_RIGHT_TRANSFER | ZX_RIGHT_WAIT | ZX_RIGHTS_IO | ZX_RIGHTS_PROPERTY)
 
 #define ZX_DEFAULT_PORT_RIGHTS \
     (ZX_RIGHT_DUPLICATE | ZX_RIGHT_TRANSFER | ZX_RIGHTS_IO)
@@ -56,7 +59,8 @@
     (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHT_SIGNAL)
 
 #define ZX_DEFAULT_SOCKET_RIGHTS \
-    (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHT_SIGNAL | ZX_RIGHT_SIGNAL_PEER)
+    (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHTS_PROPERTY |\
+     ZX_RIGHT_SIGNAL | ZX_RIGHT_SIGNAL_PEER)
 
 #define ZX_DEFAULT_THREAD_RIGHTS \
     (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO | ZX_RIGHTS_PROPERTY |\
@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include <zircon/compiler.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 __BEGIN_CDECLS
@@ -18,4 +19,43 @@ typedef struct zx_iommu_desc_dummy {
     uint8_t reserved;
 } zx_iommu_desc_dummy_t;
 
+#define ZX_IOMMU_TYPE_INTEL 1
+
+#define ZX_IOMMU_INTEL_SCOPE_ENDPOINT 0
+#define ZX_IOMMU_INTEL_SCOPE_BRIDGE   1
+
+// A device scope from the DMAR table: the path of |num_hops| device/functions,
+// each encoded as (dev << 3) | func, that leads from |start_bus| to the device.
+typedef struct zx_iommu_desc_intel_scope {
+    uint8_t type;
+    uint8_t start_bus;
+    uint8_t num_hops;
+    uint8_t dev_func[5];
+} zx_iommu_desc_intel_scope_t;
+
+// A reserved memory region (RMRR) that the devices in its scope must keep
+// reaching, at the same address, once translation is turned on.
+typedef struct zx_iommu_desc_intel_reserved_memory {
+    uint64_t base_addr;
+    uint64_t len;
+    uint8_t scope_bytes;
+    uint8_t _reserved[7];
+    // followed by |scope_bytes| bytes of zx_iommu_desc_intel_scope_t
+} zx_iommu_desc_intel_reserved_memory_t;
+
+// One DMA remapping hardware unit (DRHD).  If |whole_segment| is set, the
+// unit covers every device in |pci_segment| and the scopes are ignored;
+// otherwise it covers just the devices in the scopes.
+typedef struct zx_iommu_desc_intel {
+    uint64_t register_base;
+    uint16_t pci_segment;
+    bool whole_segment;
+    uint8_t scope_bytes;
+    uint16_t reserved_memory_bytes;
+    uint8_t _reserved[2];
+    // followed by |scope_bytes| bytes of zx_iommu_desc_intel_scope_t, then
+    // |reserved_memory_bytes| bytes of zx_iommu_desc_intel_reserved_memory_t
+    // (each with its scopes)
+} zx_iommu_desc_intel_t;
+
 __END_CDECLS
@@ -31,6 +31,11 @@ typedef enum {
     ZX_INFO_KMEM_STATS                 = 17, // zx_info_kmem_stats_t[1]
     ZX_INFO_RESOURCE                   = 18, // zx_info_resource_t[1]
     ZX_INFO_HANDLE_COUNT               = 19, // zx_info_handle_count_t[1]
+    ZX_INFO_CHANNEL                    = 20, // zx_info_channel_t[1]
+    ZX_INFO_KMEM_CACHES                = 21, // zx_info_kmem_cache_t[n]
+    ZX_INFO_INTERRUPT_SLOTS            = 22, // zx_info_interrupt_slot_t[n]
+    ZX_INFO_JOB_THREAD_STATS           = 23, // zx_info_job_thread_t[n]
+    ZX_INFO_KMEM_HEAP_SAMPLES          = 24, // zx_info_kmem_heap_sample_t[n]
     ZX_INFO_LAST
 } zx_object_info_topic_t;
 
@@ -55,6 +60,7 @@ typedef enum {
     ZX_OBJ_TYPE_VCPU                = 21,
     ZX_OBJ_TYPE_TIMER               = 22,
     ZX_OBJ_TYPE_IOMMU               = 23,
+    ZX_OBJ_TYPE_WAIT_SET            = 24,
     ZX_OBJ_TYPE_LAST
 } zx_obj_type_t;
 
@@ -90,6 +96,21 @@ typedef struct zx_info_handle_count {
     uint32_t handle_count;
 } zx_info_handle_count_t;
 
+typedef struct zx_info_channel {
+    // The number of messages waiting to be read from this endpoint.
+    uint64_t message_count;
+
+    // The payload bytes of those messages.
+    uint64_t message_bytes;
+
+    // The kernel memory held by those messages, including their headers
+    // and handle arrays.
+    uint64_t memory_bytes;
+
+    // The largest |memory_bytes| this endpoint has seen.
+    uint64_t peak_memory_bytes;
+} zx_info_channel_t;
+
 typedef struct zx_info_process {
     // The process's return code; only valid if |exited| is true.
     // Guaranteed to be non-zero if the process was killed by |zx_task_kill|.
@@ -123,6 +144,23 @@ typedef struct zx_info_thread_stats {
     zx_time_t total_runtime;
 } zx_info_thread_stats_t;
 
+// One record per thread in a job and all of its descendants, so that the
+// runtime of every thread can be sampled with a single call.
+typedef struct zx_info_job_thread {
+    zx_koid_t koid;
+    zx_koid_t process_koid;
+
+    // Total accumulated running time of the thread.
+    zx_time_t total_runtime;
+
+    // As in zx_info_thread_t.
+    uint32_t state;
+    uint32_t wait_exception_port_type;
+
+    char name[ZX_MAX_NAME_LEN];
+    char process_name[ZX_MAX_NAME_LEN];
+} zx_info_job_thread_t;
+
 // Statistics about resources (e.g., memory) used by a task. Can be relatively
 // expensive to gather.
 typedef struct zx_info_task_stats {
@@ -344,6 +382,58 @@ typedef struct zx_info_kmem_stats {
     uint64_t other_bytes;
 } zx_info_kmem_stats_t;
 
+// Occupancy of one of the kernel's per-type object caches.
+typedef struct zx_info_kmem_cache {
+    // The kind of object held, such as "event".
+    char name[ZX_MAX_NAME_LEN];
+
+    // The size of each object.
+    uint64_t object_size;
+
+    // The memory taken from the kernel heap for the cache's slabs.
+    uint64_t slab_bytes;
+
+    // The number of live objects.
+    uint64_t objects_in_use;
+
+    // The number of objects ready to be handed out without growing.
+    uint64_t objects_free;
+} zx_info_kmem_cache_t;
+
+#define ZX_INFO_KMEM_HEAP_SAMPLE_DEPTH 5
+
+// A sampled kernel heap allocation that hasn't been freed yet.
+typedef struct zx_info_kmem_heap_sample {
+    // The size of the allocation.
+    uint64_t size;
+
+    // The number of bytes allocated that the sample stands for. Summing it
+    // over the samples with the same backtrace estimates the live heap
+    // memory allocated from there.
+    uint64_t weight;
+
+    // Kernel code addresses, starting with the allocation's caller and
+    // followed by its callers. Zero past the end of the backtrace.
+    uint64_t pc[ZX_INFO_KMEM_HEAP_SAMPLE_DEPTH];
+} zx_info_kmem_heap_sample_t;
+
+#define ZX_INFO_INTERRUPT_SLOT_VIRTUAL      (1u<<0)
+
+// One slot bound on an interrupt object.
+typedef struct zx_info_interrupt_slot {
+    uint32_t slot;
+
+    // The interrupt vector bound to the slot; zero for virtual slots.
+    uint32_t vector;
+
+    // ZX_INFO_INTERRUPT_SLOT_VIRTUAL if bound with ZX_INTERRUPT_VIRTUAL.
+    uint32_t flags;
+    uint32_t reserved;
+
+    // The number of times the interrupt has fired or been signaled.
+    uint64_t count;
+} zx_info_interrupt_slot_t;
+
 typedef struct zx_info_resource {
     // The resource kind, one of:
     // {ZX_RSRC_KIND_ROOT, ZX_RSRC_KIND_MMIO, ZX_RSRC_KIND_IOPORT, ZX_RSRC_KIND_IRQ}
@@ -377,6 +467,38 @@ typedef struct zx_info_resource {
 // Argument is an zx_job_importance_t value.
 #define ZX_PROP_JOB_IMPORTANCE             7u
 
+// Argument is a uint32_t fair-share scheduling weight for a thread.
+#define ZX_PROP_THREAD_SCHED_WEIGHT        8u
+
+// Valid ZX_PROP_THREAD_SCHED_WEIGHT values. A thread with a nonzero weight is
+// ordered by weighted virtual runtime against the other weighted threads at its
+// priority, instead of round robin. Weight 0 opts the thread back out.
+#define ZX_THREAD_SCHED_WEIGHT_NONE         ((uint32_t)0)
+#define ZX_THREAD_SCHED_WEIGHT_DEFAULT      ((uint32_t)1024)
+#define ZX_THREAD_SCHED_WEIGHT_MAX          ((uint32_t)65536)
+
+// Argument is a zx_sched_deadline_params_t, giving a thread a guaranteed cpu
+// reservation scheduled earliest deadline first ahead of priority based
+// threads. A zero capacity ends the reservation.
+#define ZX_PROP_THREAD_SCHED_DEADLINE      9u
+
+// Argument is a size_t: the number of bytes of data a socket endpoint
+// buffers for reading before its peer stops being writable.
+#define ZX_PROP_SOCKET_RX_CAPACITY         10u
+
+// Argument is a zx_duration_t: how long zx_interrupt_wait() polls for the
+// next interrupt before blocking, at most ZX_MSEC(1). Zero turns polling off.
+#define ZX_PROP_INTERRUPT_POLL_WINDOW      11u
+
+typedef struct zx_sched_deadline_params {
+    // Cpu time the thread is guaranteed in each period.
+    zx_duration_t capacity;
+    // Time from the start of each period by which the capacity is delivered.
+    zx_duration_t relative_deadline;
+    // Reservation period.
+    zx_duration_t period;
+} zx_sched_deadline_params_t;
+
 // Describes how important a job is.
 typedef int32_t zx_job_importance_t;
 
@@ -11,6 +11,22 @@ __BEGIN_CDECLS
 // zx_object_wait_async() options
 #define ZX_WAIT_ASYNC_ONCE          0u
 #define ZX_WAIT_ASYNC_REPEATING     1u
+// Merge the packet into a queued signal packet that has the same key and
+// was also queued with this option, rather than queueing another one.
+#define ZX_WAIT_ASYNC_COALESCE      (1u << 8)
+// The priority of the packets the wait queues, one of ZX_PORT_PRIORITY_*.
+#define ZX_WAIT_ASYNC_PRIORITY(p)   (((uint32_t)(p) & 0x3u) << 16)
+#define ZX_WAIT_ASYNC_PRIORITY_MASK ZX_WAIT_ASYNC_PRIORITY(0x3u)
+
+// Packet priorities. A port hands out every queued packet of a higher
+// priority before any of a lower one, and packets of the same priority in
+// the order they were queued.
+#define ZX_PORT_PRIORITY_DEFAULT    0u
+#define ZX_PORT_PRIORITY_HIGH       1u
+#define ZX_PORT_PRIORITY_URGENT     2u
+
+// zx_port_wait_many() limits
+#define ZX_PORT_MAX_BATCH_PACKETS   16u
 
 // packet types.
 #define ZX_PKT_TYPE_USER            0x00u
@@ -21,9 +37,15 @@ __BEGIN_CDECLS
 #define ZX_PKT_TYPE_GUEST_IO        0x05u
 #define ZX_PKT_TYPE_GUEST_VCPU      0x06u
 #define ZX_PKT_TYPE_EXCEPTION(n)    (0x07u | (((n) & 0xFFu) << 8))
+#define ZX_PKT_TYPE_INTERRUPT       0x08u
 
 #define ZX_PKT_TYPE_MASK            0xFFu
 
+// The priority of a packet given to zx_port_queue(), or'ed into its type.
+// Dequeued packets don't carry it.
+#define ZX_PKT_PRIORITY(p)          (((uint32_t)(p) & 0x3u) << 24)
+#define ZX_PKT_PRIORITY_MASK        ZX_PKT_PRIORITY(0x3u)
+
 #define ZX_PKT_IS_USER(type)        ((type) == ZX_PKT_TYPE_USER)
 #define ZX_PKT_IS_SIGNAL_ONE(type)  ((type) == ZX_PKT_TYPE_SIGNAL_ONE)
 #define ZX_PKT_IS_SIGNAL_REP(type)  ((type) == ZX_PKT_TYPE_SIGNAL_REP)
@@ -32,6 +54,7 @@ __BEGIN_CDECLS
 #define ZX_PKT_IS_GUEST_IO(type)    ((type) == ZX_PKT_TYPE_GUEST_IO)
 #define ZX_PKT_IS_GUEST_VCPU(type)  ((type) == ZX_PKT_TYPE_GUEST_VCPU)
 #define ZX_PKT_IS_EXCEPTION(type)   (((type) & ZX_PKT_TYPE_MASK) == ZX_PKT_TYPE_EXCEPTION(0))
+#define ZX_PKT_IS_INTERRUPT(type)   ((type) == ZX_PKT_TYPE_INTERRUPT)
 
 // port_packet_t::type ZX_PKT_TYPE_USER.
 typedef union zx_packet_user {
@@ -103,6 +126,15 @@ typedef struct zx_packet_guest_vcpu {
     uint64_t reserved1;
 } zx_packet_guest_vcpu_t;
 
+// port_packet_t::type ZX_PKT_TYPE_INTERRUPT.
+typedef struct zx_packet_interrupt {
+    // the slots that fired, as zx_interrupt_wait() would report them
+    uint64_t slots;
+    uint64_t reserved0;
+    uint64_t reserved1;
+    uint64_t reserved2;
+} zx_packet_interrupt_t;
+
 typedef struct zx_port_packet {
     uint64_t key;
     uint32_t type;
@@ -115,6 +147,7 @@ typedef struct zx_port_packet {
         zx_packet_guest_mem_t guest_mem;
         zx_packet_guest_io_t guest_io;
         zx_packet_guest_vcpu_t guest_vcpu;
+        zx_packet_interrupt_t interrupt;
     };
 } zx_port_packet_t;
 
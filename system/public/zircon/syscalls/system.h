@@ -14,6 +14,13 @@ __BEGIN_CDECLS
 #define ZX_SYSTEM_POWERCTL_ACPI_TRANSITION_S_STATE      3u
 #define ZX_SYSTEM_POWERCTL_X86_SET_PKG_PL1              4u
 
+// Kinds of event for zx_system_get_event(). Exactly one of the memory
+// pressure events is signaled at any time.
+#define ZX_SYSTEM_EVENT_MEMORY_PRESSURE_NORMAL   0u
+#define ZX_SYSTEM_EVENT_MEMORY_PRESSURE_WARNING  1u
+#define ZX_SYSTEM_EVENT_MEMORY_PRESSURE_CRITICAL 2u
+#define ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT    3u
+
 typedef struct zx_system_powerctl_arg {
     union {
         struct {
@@ -170,6 +170,16 @@ typedef struct {
     uint32_t rd_num_handles;
 } zx_channel_call_args_t;
 
+// Message descriptor for zx_channel_write_many and zx_channel_read_many.
+// When reading, |num_bytes| and |num_handles| give the size of the buffers
+// on input and the size of the message read on output.
+typedef struct {
+    void* bytes;
+    zx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+} zx_channel_msg_t;
+
 // Maximum number of wait items allowed for zx_object_wait_many()
 // TODO(ZX-1349) Re-lower this.
 #define ZX_WAIT_MANY_MAX_ITEMS 16
@@ -181,6 +191,30 @@ typedef struct {
     zx_signals_t pending;
 } zx_wait_item_t;
 
+// Maximum number of items allowed for zx_object_signal_many()
+#define ZX_SIGNAL_MANY_MAX_ITEMS 64
+
+// Options for a zx_signal_item_t.
+#define ZX_SIGNAL_ITEM_PEER 1u  // signal the peer, as zx_object_signal_peer() does
+
+// Structure for zx_object_signal_many():
+typedef struct {
+    zx_handle_t handle;
+    uint32_t options;
+    zx_signals_t clear_mask;
+    zx_signals_t set_mask;
+} zx_signal_item_t;
+
+// Maximum number of results returned by one zx_waitset_wait()
+#define ZX_WAITSET_MAX_RESULTS 32
+
+// Structure for zx_waitset_wait():
+typedef struct {
+    uint64_t cookie;
+    zx_signals_t observed;
+    uint32_t reserved;
+} zx_waitset_result_t;
+
 typedef uint32_t zx_rights_t;
 #define ZX_RIGHT_NONE             ((zx_rights_t)0u)
 #define ZX_RIGHT_DUPLICATE        ((zx_rights_t)1u << 0)
@@ -215,6 +249,10 @@ typedef uint32_t zx_rights_t;
     (ZX_RIGHT_GET_POLICY | ZX_RIGHT_SET_POLICY)
 
 
+// VM Object creation options
+#define ZX_VMO_LARGE_PAGES               1u
+#define ZX_VMO_DISCARDABLE               2u
+
 // VM Object opcodes
 #define ZX_VMO_OP_COMMIT                 1u
 #define ZX_VMO_OP_DECOMMIT               2u
@@ -225,6 +263,15 @@ typedef uint32_t zx_rights_t;
 #define ZX_VMO_OP_CACHE_INVALIDATE       7u
 #define ZX_VMO_OP_CACHE_CLEAN            8u
 #define ZX_VMO_OP_CACHE_CLEAN_INVALIDATE 9u
+#define ZX_VMO_OP_TRACK_DIRTY            10u
+#define ZX_VMO_OP_QUERY_DIRTY            11u
+#define ZX_VMO_OP_UNTRACK_DIRTY          12u
+
+// A range of a VM Object, for applying one cache op to many ranges at once.
+typedef struct zx_vmo_range {
+    uint64_t offset;
+    uint64_t size;
+} zx_vmo_range_t;
 
 // VM Object clone flags
 #define ZX_VMO_CLONE_COPY_ON_WRITE       1u
@@ -260,7 +307,7 @@ typedef uint64_t zx_off_t;
 #define ZX_MAX_NAME_LEN           (32)
 
 // Buffer size limits on the cprng syscalls
-#define ZX_CPRNG_DRAW_MAX_LEN        256
+#define ZX_CPRNG_DRAW_MAX_LEN        4096
 #define ZX_CPRNG_ADD_ENTROPY_MAX_LEN 256
 
 // interrupt bind flags
@@ -283,9 +330,11 @@ typedef uint64_t zx_off_t;
 
 // Channel options and limits.
 #define ZX_CHANNEL_READ_MAY_DISCARD         1u
+#define ZX_CHANNEL_WRITE_LOAN               1u
 
 #define ZX_CHANNEL_MAX_MSG_BYTES            65536u
 #define ZX_CHANNEL_MAX_MSG_HANDLES          64u
+#define ZX_CHANNEL_MAX_BATCH_MSGS           32u
 
 // Socket options and limits.
 // These options can be passed to zx_socket_write()
@@ -303,6 +352,36 @@ typedef uint64_t zx_off_t;
 // These can be passed to zx_socket_read() and zx_socket_write().
 #define ZX_SOCKET_CONTROL                   (1u << 2)
 
+// One buffer of a zx_socket_writev() or zx_socket_readv() call.
+typedef struct zx_iovec {
+    void* buffer;
+    size_t size;
+} zx_iovec_t;
+
+#define ZX_SOCKET_MAX_IOVECS                16u
+
+// The most bytes one zx_socket_splice() call moves.
+#define ZX_SOCKET_SPLICE_MAX_LEN            (1u << 20)
+
+// Fifo options.
+// This option can be passed to zx_fifo_create()
+#define ZX_FIFO_SHARED_RING                 1u
+
+// Header at the start of each ring vmo returned by zx_fifo_get_rings().
+// The producer owns |head| and |producer_waiting|, the consumer owns
+// |tail| and |consumer_waiting|; each half sits on its own cache line.
+// Entries follow the header, at ZX_FIFO_RING_ENTRIES_OFFSET.
+typedef struct zx_fifo_ring_header {
+    uint32_t head;
+    uint32_t producer_waiting;
+    uint8_t reserved0[56];
+    uint32_t tail;
+    uint32_t consumer_waiting;
+    uint8_t reserved1[56];
+} zx_fifo_ring_header_t;
+
+#define ZX_FIFO_RING_ENTRIES_OFFSET         128u
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
     ZX_CACHE_POLICY_CACHED          = 0,
@@ -341,4 +420,7 @@ typedef atomic_int zx_futex_t;
 #endif
 #endif
 
+// Maximum number of futexes zx_futex_requeue_many() takes in one call.
+#define ZX_FUTEX_MAX_REQUEUE_MANY 64u
+
 __END_CDECLS
@@ -15,6 +15,7 @@
 #include <async/loop.h>
 #include <blobstore/blobstore.h>
 #include <blobstore/fsck.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/string.h>
@@ -24,11 +25,16 @@
 #include <trace-provider/provider.h>
 #include <zircon/process.h>
 #include <zircon/processargs.h>
+#include <zircon/syscalls.h>
 
 namespace {
 
 #define MIN_ARGS 2
 
+// The most threads serving filesystem requests. Writes of different blobs
+// copy and hash their data on them concurrently.
+constexpr uint32_t kMaxDispatchThreads = 4;
+
 typedef struct {
     bool readonly = false;
     uint64_t data_blocks = blobstore::kStartBlockMinimum; // Account for reserved blocks
@@ -66,6 +72,15 @@ int do_blobstore_mount(fbl::unique_fd fd, const blob_options_t& options) {
         return status;
     }
     trace::TraceProvider provider(loop.async());
+
+    // The main thread serves requests too.
+    const uint32_t threads = fbl::min(zx_system_get_num_cpus(), kMaxDispatchThreads);
+    for (uint32_t i = 1; i < threads; i++) {
+        if (loop.StartThread("blobstore-dispatch") != ZX_OK) {
+            FS_TRACE_WARN("blobstore: Could not start dispatch thread %u\n", i);
+            break;
+        }
+    }
     loop.Run();
     return ZX_OK;
 }
@@ -0,0 +1,226 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zircon/ktrace.h>
+#include <zircon/types.h>
+
+// Prints the boot timeline from the kernel trace.
+//
+// The kernel marks the end of each boot phase and init hook ("boot:*" and
+// "init:*" probes), userboot, devmgr and fshost mark their own milestones,
+// and devmgr marks every driver bind ("bind:<driver>", with the bind's
+// duration in microseconds and its status).  Everything but the binds
+// happens one step after another, so the time between two markers is the
+// time the step ending at the later one added to boot.  The binds run in
+// parallel in many devhosts and are listed separately.
+//
+// Usage: bootprof [trace file]
+// Reads /dev/misc/ktrace by default.  Boot with ktrace.grpmask including
+// the probe group (the default does) so the markers are kept.
+
+#define MAX_PROBES 2048
+#define MAX_MARKS 4096
+#define TOP_STEPS 10
+
+typedef struct {
+    uint64_t ts;
+    uint32_t probe;
+    uint32_t arg0;
+    uint32_t arg1;
+    uint64_t gap;
+} mark_t;
+
+static char probe_names[MAX_PROBES][ZX_MAX_NAME_LEN];
+static mark_t marks[MAX_MARKS];
+static size_t mark_count;
+
+static uint8_t* read_all(int fd, size_t* out_len) {
+    size_t cap = 1 << 20;
+    size_t len = 0;
+    uint8_t* buf = malloc(cap);
+    for (;;) {
+        if (buf == NULL) {
+            return NULL;
+        }
+        ssize_t r = read(fd, buf + len, cap - len);
+        if (r < 0) {
+            free(buf);
+            return NULL;
+        }
+        if (r == 0) {
+            break;
+        }
+        len += r;
+        if (len == cap) {
+            cap *= 2;
+            uint8_t* grown = realloc(buf, cap);
+            if (grown == NULL) {
+                free(buf);
+            }
+            buf = grown;
+        }
+    }
+    *out_len = len;
+    return buf;
+}
+
+// Gathers the probe names and probe events which are boot markers.
+static uint64_t parse(const uint8_t* data, size_t len) {
+    uint64_t ticks_per_ms = 0;
+    size_t off = 0;
+    while (len - off >= KTRACE_HDRSIZE) {
+        ktrace_header_t hdr;
+        memcpy(&hdr, data + off, sizeof(hdr));
+        size_t rec_len = KTRACE_LEN(hdr.tag);
+        if (rec_len == 0 || rec_len > len - off) {
+            break;
+        }
+        uint32_t event = KTRACE_EVENT(hdr.tag);
+
+        if (event == KTRACE_EVENT(TAG_TICKS_PER_MS) && rec_len >= KTRACE_RECSIZE) {
+            ktrace_rec_32b_t rec;
+            memcpy(&rec, data + off, sizeof(rec));
+            ticks_per_ms = ((uint64_t)rec.b << 32) | rec.a;
+        } else if (event == KTRACE_EVENT(TAG_PROBE_NAME) && rec_len > KTRACE_NAMEOFF) {
+            const ktrace_rec_name_t* rec = (const ktrace_rec_name_t*)(data + off);
+            if (rec->id < MAX_PROBES) {
+                size_t n = rec_len - KTRACE_NAMESIZE;
+                if (n > ZX_MAX_NAME_LEN - 1) {
+                    n = ZX_MAX_NAME_LEN - 1;
+                }
+                memcpy(probe_names[rec->id], rec->name, n);
+                probe_names[rec->id][n] = 0;
+            }
+        } else if ((event & 0x800) && (KTRACE_GROUP(hdr.tag) & KTRACE_GRP_PROBE) &&
+                   mark_count < MAX_MARKS) {
+            mark_t* m = &marks[mark_count++];
+            m->ts = hdr.ts;
+            m->probe = event & 0x7FF;
+            m->arg0 = m->arg1 = 0;
+            if (rec_len >= KTRACE_HDRSIZE + 2 * sizeof(uint32_t)) {
+                memcpy(&m->arg0, data + off + KTRACE_HDRSIZE, sizeof(uint32_t));
+                memcpy(&m->arg1, data + off + KTRACE_HDRSIZE + sizeof(uint32_t),
+                       sizeof(uint32_t));
+            }
+        }
+        off += rec_len;
+    }
+    return ticks_per_ms;
+}
+
+static const char* mark_name(const mark_t* m) {
+    return probe_names[m->probe];
+}
+
+static bool is_bind(const mark_t* m) {
+    return strncmp(mark_name(m), "bind:", 5) == 0;
+}
+
+// Markers are probes named "group:name"; other probes are not ours.
+static bool is_mark(const mark_t* m) {
+    return strchr(mark_name(m), ':') != NULL;
+}
+
+static int by_time(const void* a, const void* b) {
+    const mark_t* x = a;
+    const mark_t* y = b;
+    return (x->ts > y->ts) - (x->ts < y->ts);
+}
+
+static int by_gap(const void* a, const void* b) {
+    const mark_t* x = a;
+    const mark_t* y = b;
+    return (x->gap < y->gap) - (x->gap > y->gap);
+}
+
+static int by_duration(const void* a, const void* b) {
+    const mark_t* x = a;
+    const mark_t* y = b;
+    return (x->arg0 < y->arg0) - (x->arg0 > y->arg0);
+}
+
+static double ms(uint64_t ticks, uint64_t ticks_per_ms) {
+    return (double)ticks / (double)ticks_per_ms;
+}
+
+int main(int argc, char** argv) {
+    const char* path = (argc > 1) ? argv[1] : "/dev/misc/ktrace";
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "bootprof: cannot open '%s'\n", path);
+        return -1;
+    }
+    size_t len;
+    uint8_t* data = read_all(fd, &len);
+    close(fd);
+    if (data == NULL) {
+        fprintf(stderr, "bootprof: cannot read '%s'\n", path);
+        return -1;
+    }
+
+    uint64_t ticks_per_ms = parse(data, len);
+    free(data);
+    if (ticks_per_ms == 0) {
+        fprintf(stderr, "bootprof: '%s' is not a kernel trace\n", path);
+        return -1;
+    }
+
+    // Split the markers into the boot path and the binds.
+    size_t steps = 0;
+    size_t binds = 0;
+    static mark_t path_marks[MAX_MARKS];
+    static mark_t bind_marks[MAX_MARKS];
+    for (size_t i = 0; i < mark_count; i++) {
+        if (!is_mark(&marks[i])) {
+            continue;
+        }
+        if (is_bind(&marks[i])) {
+            bind_marks[binds++] = marks[i];
+        } else {
+            path_marks[steps++] = marks[i];
+        }
+    }
+    if (steps == 0) {
+        fprintf(stderr, "bootprof: no boot markers in '%s'\n", path);
+        return -1;
+    }
+
+    qsort(path_marks, steps, sizeof(mark_t), by_time);
+    uint64_t start = path_marks[0].ts;
+    printf("boot timeline (ms from the first marker)\n");
+    printf("%10s %10s  %s\n", "time", "step", "marker");
+    for (size_t i = 0; i < steps; i++) {
+        path_marks[i].gap = (i == 0) ? 0 : path_marks[i].ts - path_marks[i - 1].ts;
+        printf("%10.3f %+10.3f  %s\n", ms(path_marks[i].ts - start, ticks_per_ms),
+               ms(path_marks[i].gap, ticks_per_ms), mark_name(&path_marks[i]));
+    }
+
+    if (binds > 0) {
+        qsort(bind_marks, binds, sizeof(mark_t), by_duration);
+        printf("\ndriver binds, slowest first (ms)\n");
+        printf("%10s %10s %8s  %s\n", "finished", "took", "status", "driver");
+        for (size_t i = 0; i < binds; i++) {
+            const mark_t* m = &bind_marks[i];
+            printf("%10.3f %10.3f %8d  %s\n",
+                   (m->ts >= start) ? ms(m->ts - start, ticks_per_ms) : 0.0,
+                   m->arg0 / 1000.0, (int32_t)m->arg1, mark_name(m) + 5);
+        }
+    }
+
+    qsort(path_marks, steps, sizeof(mark_t), by_gap);
+    printf("\nlongest steps on the boot path (ms)\n");
+    for (size_t i = 0; i < steps && i < TOP_STEPS; i++) {
+        printf("%10.3f  %s\n", ms(path_marks[i].gap, ticks_per_ms),
+               mark_name(&path_marks[i]));
+    }
+    return 0;
+}
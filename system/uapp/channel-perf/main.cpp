@@ -6,11 +6,13 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include <zircon/compiler.h>
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <fbl/algorithm.h>
 #include <fbl/unique_ptr.h>
@@ -32,8 +34,20 @@ struct TestArgs {
     uint32_t size;
     uint32_t handles;
     uint32_t queue;
+    bool loan;
 };
 
+// Messages are written from and read into a buffer mapped from a vmo of its
+// own, which keeps it page aligned so ZX_CHANNEL_WRITE_LOAN can move it.
+uint8_t* map_buffer(uint32_t size, zx_handle_t* vmo) {
+    size_t len = fbl::round_up(size, static_cast<uint32_t>(PAGE_SIZE));
+    uintptr_t addr;
+    assert(zx_vmo_create(len, 0u, vmo) == ZX_OK);
+    assert(zx_vmar_map(zx_vmar_root_self(), 0, *vmo, 0, len,
+                       ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr) == ZX_OK);
+    return reinterpret_cast<uint8_t*>(addr);
+}
+
 void do_test(uint32_t duration, const TestArgs& test_args) {
     __UNUSED zx_status_t status;
 
@@ -49,12 +63,14 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     assert(zx_event_create(0u, &event) == ZX_OK);
 
     // Storage space for our messages' stuff.
-    fbl::unique_ptr<uint8_t[]> data;
+    zx_handle_t data_vmo = ZX_HANDLE_INVALID;
+    uint8_t* data = nullptr;
     if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
+        data = map_buffer(test_args.size, &data_vmo);
         for (uint32_t i = 0; i < test_args.size; i++)
             data[i] = static_cast<uint8_t>(i);
     }
+    uint32_t write_options = test_args.loan ? ZX_CHANNEL_WRITE_LOAN : 0u;
     fbl::unique_ptr<zx_handle_t[]> handles;
     if (test_args.handles)
         handles.reset(new zx_handle_t[test_args.handles]);
@@ -62,7 +78,7 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
         duplicate_handles(test_args.handles, event, handles.get());
-        status = zx_channel_write(mp[0], 0u, data.get(), test_args.size,
+        status = zx_channel_write(mp[0], write_options, data, test_args.size,
                                   handles.get(), test_args.handles);
         assert(status == ZX_OK);
     }
@@ -76,13 +92,13 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
-            status = zx_channel_write(mp[0], 0, data.get(), test_args.size,
+            status = zx_channel_write(mp[0], write_options, data, test_args.size,
                                       handles.get(), test_args.handles);
             assert(status == ZX_OK);
 
             uint32_t r_size = test_args.size;
             uint32_t r_handles = test_args.handles;
-            status = zx_channel_read(mp[1], 0u, data.get(), handles.get(), r_size,
+            status = zx_channel_read(mp[1], 0u, data, handles.get(), r_size,
                                      r_handles, &r_size, &r_handles);
             assert(status == ZX_OK);
             assert(r_size == test_args.size);
@@ -100,6 +116,13 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     }
     status = zx_handle_close(event);
     assert(status == ZX_OK);
+    if (data) {
+        status = zx_vmar_unmap(zx_vmar_root_self(), reinterpret_cast<uintptr_t>(data),
+                               fbl::round_up(test_args.size, static_cast<uint32_t>(PAGE_SIZE)));
+        assert(status == ZX_OK);
+        status = zx_handle_close(data_vmo);
+        assert(status == ZX_OK);
+    }
     status = zx_handle_close(mp[0]);
     assert(status == ZX_OK);
     status = zx_handle_close(mp[1]);
@@ -107,9 +130,10 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
 
     double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
     double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
+    printf("write/read %" PRIu32 " bytes%s, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
                "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+           test_args.size, test_args.loan ? " loaned" : "", test_args.handles, test_args.queue,
+           its_per_second);
 }
 
 }  // namespace
@@ -121,12 +145,13 @@ int main(int argc, char** argv) {
         "Options:\n"
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
-        "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -s    run suite (ignores -S/-H/-Q/-L)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -L    write messages with ZX_CHANNEL_WRITE_LOAN\n";
 
     bool run_suite = false;  // -o/-s
     uint32_t duration = 5;   // -d
@@ -135,11 +160,12 @@ int main(int argc, char** argv) {
     TestArgs test_args = {
         10,                  // -S (size)
         0,                   // -H (handles)
-        0                    // -Q (queue)
+        0,                   // -Q (queue)
+        false                // -L (loan)
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:L")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -181,6 +207,9 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'L':
+                test_args.loan = true;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -214,6 +243,10 @@ int main(int argc, char** argv) {
                 {10, 0, 1},
                 {100, 0, 1},
                 {1000, 0, 1},
+                {16384, 0, 0},
+                {16384, 0, 0, true},
+                {65536, 0, 0},
+                {65536, 0, 0, true},
             };
             for (size_t i = 0; i < fbl::count_of(suite); i++)
                 do_test(duration, suite[i]);
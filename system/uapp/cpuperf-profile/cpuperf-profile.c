@@ -0,0 +1,262 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Samples one hardware event on every cpu for a while and prints a flat
+// profile: the (process, pc) pairs that took the most samples.
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zircon/device/cpu-trace/cpu-perf.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#define DEVICE_PATH "/dev/misc/cpu-trace"
+
+#define DEFAULT_RATE 100000
+#define DEFAULT_DURATION_SECS 5
+#define DEFAULT_TOP 20
+#define BUFFER_SIZE (4u * 1024 * 1024)
+
+// Must be a power of two.
+#define MAX_ENTRIES 16384
+
+typedef struct {
+    const char* name;
+    cpuperf_event_id_t id;
+} event_t;
+
+static const event_t events[] = {
+    // The fixed counter, so the programmable ones stay free.
+    {"cycles", CPUPERF_MAKE_EVENT_ID(CPUPERF_UNIT_FIXED, 2)},
+    {"llc-misses", CPUPERF_MAKE_EVENT_ID(CPUPERF_UNIT_ARCH, 4)},
+    {"branch-misses", CPUPERF_MAKE_EVENT_ID(CPUPERF_UNIT_ARCH, 6)},
+};
+
+typedef struct {
+    uint64_t pid;
+    uint64_t pc;
+    uint64_t caller;
+    uint64_t count;
+    bool kernel;
+} entry_t;
+
+static entry_t table[MAX_ENTRIES];
+static size_t num_entries;
+static uint64_t total_samples;
+static uint64_t dropped_samples;
+
+static void add_sample(const cpuperf_sample_record_t* rec) {
+    ++total_samples;
+    uint64_t hash = (rec->pid * 0x9e3779b97f4a7c15ull) ^ rec->pc;
+    for (size_t probe = 0; probe < MAX_ENTRIES; ++probe) {
+        entry_t* e = &table[(hash + probe) & (MAX_ENTRIES - 1)];
+        if (e->count == 0) {
+            if (num_entries == MAX_ENTRIES / 2)
+                break;
+            ++num_entries;
+            e->pid = rec->pid;
+            e->pc = rec->pc;
+            e->caller = rec->callchain[0];
+            e->kernel = rec->header.reserved_flags & CPUPERF_SAMPLE_FLAG_KERNEL;
+        } else if (e->pid != rec->pid || e->pc != rec->pc) {
+            continue;
+        }
+        ++e->count;
+        return;
+    }
+    ++dropped_samples;
+}
+
+static size_t record_size(const cpuperf_record_header_t* hdr) {
+    switch (hdr->type) {
+    case CPUPERF_RECORD_TIME:
+        return sizeof(cpuperf_time_record_t);
+    case CPUPERF_RECORD_TICK:
+        return sizeof(cpuperf_tick_record_t);
+    case CPUPERF_RECORD_COUNT:
+        return sizeof(cpuperf_count_record_t);
+    case CPUPERF_RECORD_VALUE:
+        return sizeof(cpuperf_value_record_t);
+    case CPUPERF_RECORD_PC:
+        return sizeof(cpuperf_pc_record_t);
+    case CPUPERF_RECORD_SAMPLE:
+        return sizeof(cpuperf_sample_record_t);
+    default:
+        return 0;
+    }
+}
+
+static zx_status_t read_buffer(int fd, uint32_t cpu) {
+    ioctl_cpuperf_buffer_handle_req_t req = {.descriptor = cpu};
+    zx_handle_t vmo;
+    ssize_t ret = ioctl_cpuperf_get_buffer_handle(fd, &req, &vmo);
+    if (ret < 0) {
+        fprintf(stderr, "cpuperf-profile: cannot get buffer %u: %s\n",
+                cpu, zx_status_get_string((zx_status_t)ret));
+        return (zx_status_t)ret;
+    }
+
+    uintptr_t addr;
+    zx_status_t status = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, BUFFER_SIZE,
+                                     ZX_VM_FLAG_PERM_READ, &addr);
+    zx_handle_close(vmo);
+    if (status != ZX_OK) {
+        fprintf(stderr, "cpuperf-profile: cannot map buffer %u: %s\n",
+                cpu, zx_status_get_string(status));
+        return status;
+    }
+
+    const cpuperf_buffer_header_t* header = (const cpuperf_buffer_header_t*)addr;
+    if (header->flags & CPUPERF_BUFFER_FLAG_FULL)
+        fprintf(stderr, "cpuperf-profile: buffer %u filled up, try a lower rate\n", cpu);
+    uint64_t end = header->capture_end < BUFFER_SIZE ? header->capture_end : BUFFER_SIZE;
+    uint64_t offset = sizeof(*header);
+    while (offset + sizeof(cpuperf_record_header_t) <= end) {
+        const cpuperf_record_header_t* hdr =
+            (const cpuperf_record_header_t*)(addr + offset);
+        size_t size = record_size(hdr);
+        if (size == 0 || offset + size > end) {
+            fprintf(stderr, "cpuperf-profile: bad record in buffer %u\n", cpu);
+            break;
+        }
+        if (hdr->type == CPUPERF_RECORD_SAMPLE)
+            add_sample((const cpuperf_sample_record_t*)hdr);
+        offset += size;
+    }
+
+    zx_vmar_unmap(zx_vmar_root_self(), addr, BUFFER_SIZE);
+    return ZX_OK;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    uint64_t ca = ((const entry_t*)a)->count;
+    uint64_t cb = ((const entry_t*)b)->count;
+    return ca < cb ? 1 : ca > cb ? -1 : 0;
+}
+
+static void print_profile(size_t top) {
+    size_t n = 0;
+    for (size_t i = 0; i < MAX_ENTRIES; ++i) {
+        if (table[i].count != 0)
+            table[n++] = table[i];
+    }
+    qsort(table, n, sizeof(table[0]), compare_entries);
+
+    printf("%" PRIu64 " samples, %zu distinct pcs", total_samples, n);
+    if (dropped_samples != 0)
+        printf(", %" PRIu64 " not counted (table full)", dropped_samples);
+    printf("\n%7s %8s %18s %18s\n", "%", "pid", "pc", "caller");
+    for (size_t i = 0; i < n && i < top; ++i) {
+        const entry_t* e = &table[i];
+        printf("%6.2f%% %8" PRIu64 " %#18" PRIx64 " ",
+               100.0 * e->count / total_samples, e->pid, e->pc);
+        if (e->kernel) {
+            printf("%#18" PRIx64 " [kernel]\n", e->caller);
+        } else {
+            printf("%18s\n", "-");
+        }
+    }
+}
+
+static void usage(const char* myname) {
+    fprintf(stderr,
+            "usage: %s [-e event] [-r rate] [-d seconds] [-n count]\n"
+            "  -e   cycles (default), llc-misses or branch-misses\n"
+            "  -r   take a sample every |rate| events (default %u)\n"
+            "  -d   how long to sample for (default %u)\n"
+            "  -n   how many entries to print (default %u)\n",
+            myname, DEFAULT_RATE, DEFAULT_DURATION_SECS, DEFAULT_TOP);
+}
+
+int main(int argc, char** argv) {
+    const event_t* event = &events[0];
+    uint32_t rate = DEFAULT_RATE;
+    unsigned duration = DEFAULT_DURATION_SECS;
+    size_t top = DEFAULT_TOP;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "e:r:d:n:")) != -1) {
+        switch (opt) {
+        case 'e':
+            event = NULL;
+            for (size_t i = 0; i < countof(events); ++i) {
+                if (!strcmp(optarg, events[i].name))
+                    event = &events[i];
+            }
+            if (!event) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'r':
+            rate = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'd':
+            duration = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            top = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (rate == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        fprintf(stderr, "cpuperf-profile: cannot open %s\n", DEVICE_PATH);
+        return 1;
+    }
+
+    uint32_t num_cpus = zx_system_get_num_cpus();
+    ioctl_cpuperf_alloc_t alloc = {
+        .num_buffers = num_cpus,
+        .buffer_size = BUFFER_SIZE,
+    };
+    cpuperf_config_t config;
+    memset(&config, 0, sizeof(config));
+    config.events[0] = event->id;
+    config.rate[0] = rate;
+    config.flags[0] = CPUPERF_CONFIG_FLAG_OS | CPUPERF_CONFIG_FLAG_USER |
+                      CPUPERF_CONFIG_FLAG_PC | CPUPERF_CONFIG_FLAG_CALLCHAIN;
+
+    ssize_t ret = ioctl_cpuperf_alloc_trace(fd, &alloc);
+    if (ret >= 0)
+        ret = ioctl_cpuperf_stage_config(fd, &config);
+    if (ret >= 0)
+        ret = ioctl_cpuperf_start(fd);
+    if (ret < 0) {
+        fprintf(stderr, "cpuperf-profile: cannot start sampling: %s\n",
+                zx_status_get_string((zx_status_t)ret));
+        close(fd);
+        return 1;
+    }
+
+    zx_nanosleep(zx_deadline_after(ZX_SEC(duration)));
+    ioctl_cpuperf_stop(fd);
+
+    int result = 0;
+    for (uint32_t cpu = 0; cpu < num_cpus; ++cpu) {
+        if (read_buffer(fd, cpu) != ZX_OK)
+            result = 1;
+    }
+    ioctl_cpuperf_free_trace(fd);
+    close(fd);
+
+    printf("%s, one sample per %u events\n", event->name, rate);
+    print_profile(top);
+    return result;
+}
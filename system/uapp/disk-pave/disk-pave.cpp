@@ -4,18 +4,23 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <block-client/client.h>
 #include <chromeos-disk-setup/chromeos-disk-setup.h>
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/array.h>
 #include <fbl/auto_call.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
 #include <fbl/unique_fd.h>
 #include <fbl/unique_ptr.h>
 #include <fdio/watcher.h>
@@ -24,6 +29,7 @@
 #include <fs/mapped-vmo.h>
 #include <gpt/cros.h>
 #include <gpt/gpt.h>
+#include <lz4/lz4frame.h>
 #include <zircon/device/block.h>
 #include <zircon/device/device.h>
 #include <zircon/syscalls.h>
@@ -70,6 +76,234 @@ struct partition_info {
     fvm::partition_descriptor_t* pd;
     fbl::unique_fd new_part;
     fbl::unique_fd old_part; // Or '-1' if this is a new partition
+    fifo_client_t* client = nullptr;
+    block_fifo_request_t request;
+};
+
+// Reads the data section of a sparse FVM image, decompressing it if the
+// image has fvm::kSparseFlagLz4 set.
+class StreamReader {
+public:
+    static zx_status_t Create(fbl::unique_fd fd, uint64_t flags,
+                              fbl::unique_ptr<StreamReader>* out) {
+        fbl::AllocChecker ac;
+        fbl::unique_ptr<StreamReader> reader(new (&ac) StreamReader(fbl::move(fd)));
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        if (flags & fvm::kSparseFlagLz4) {
+            LZ4F_errorCode_t err = LZ4F_createDecompressionContext(&reader->dctx_,
+                                                                   LZ4F_VERSION);
+            if (LZ4F_isError(err)) {
+                ERROR("Couldn't create decompression context: %s\n", LZ4F_getErrorName(err));
+                return ZX_ERR_INTERNAL;
+            }
+            reader->in_buf_.reset(new (&ac) uint8_t[kInBufSize]);
+            if (!ac.check()) {
+                return ZX_ERR_NO_MEMORY;
+            }
+        }
+        *out = fbl::move(reader);
+        return ZX_OK;
+    }
+
+    ~StreamReader() {
+        if (dctx_ != nullptr) {
+            LZ4F_freeDecompressionContext(dctx_);
+        }
+    }
+
+    // Reads up to |len| bytes of data into |buf|. |*actual| is zero at the
+    // end of the stream.
+    zx_status_t Read(void* buf, size_t len, size_t* actual) {
+        if (dctx_ == nullptr) {
+            ssize_t r = read(fd_.get(), buf, len);
+            if (r < 0) {
+                return ZX_ERR_IO;
+            }
+            *actual = r;
+            return ZX_OK;
+        }
+
+        // Decompress whatever has arrived; only block on the source when
+        // there is nothing at all to hand back yet.
+        uint8_t* out = static_cast<uint8_t*>(buf);
+        size_t produced = 0;
+        while (produced < len) {
+            if (in_off_ == in_len_) {
+                if (produced > 0) {
+                    break;
+                }
+                ssize_t r = read(fd_.get(), in_buf_.get(), kInBufSize);
+                if (r < 0) {
+                    return ZX_ERR_IO;
+                } else if (r == 0) {
+                    break;
+                }
+                in_off_ = 0;
+                in_len_ = r;
+            }
+
+            size_t dst_size = len - produced;
+            size_t src_size = in_len_ - in_off_;
+            size_t ret = LZ4F_decompress(dctx_, out + produced, &dst_size,
+                                         in_buf_.get() + in_off_, &src_size, nullptr);
+            if (LZ4F_isError(ret)) {
+                ERROR("Failed to decompress stream: %s\n", LZ4F_getErrorName(ret));
+                return ZX_ERR_IO_DATA_INTEGRITY;
+            }
+            in_off_ += src_size;
+            produced += dst_size;
+        }
+        *actual = produced;
+        return ZX_OK;
+    }
+
+private:
+    static constexpr size_t kInBufSize = 1 << 16;
+
+    explicit StreamReader(fbl::unique_fd fd) : fd_(fbl::move(fd)) {}
+
+    fbl::unique_fd fd_;
+    LZ4F_decompressionContext_t dctx_ = nullptr;
+    fbl::unique_ptr<uint8_t[]> in_buf_;
+    size_t in_off_ = 0;
+    size_t in_len_ = 0;
+};
+
+// Issues block writes from a background thread, so that the next chunk of
+// the stream is read and decompressed while the previous ones are written.
+//
+// The VMO is split into |kBuffers| buffers which are handed out and written
+// in turn. Each write goes through the fifo client of its own partition,
+// so the tail of one partition can still be in flight as the next starts.
+class StreamWriter {
+public:
+    static constexpr size_t kBuffers = 4;
+    static constexpr size_t kBufferSize = 1 << 20;
+
+    StreamWriter() {
+        cnd_init(&cnd_);
+    }
+
+    ~StreamWriter() {
+        if (thread_started_) {
+            {
+                fbl::AutoLock lock(&lock_);
+                stop_ = true;
+                cnd_broadcast(&cnd_);
+            }
+            thrd_join(thread_, nullptr);
+        }
+        cnd_destroy(&cnd_);
+    }
+
+    zx_status_t Init() {
+        zx_status_t status = MappedVmo::Create(kBuffers * kBufferSize, "fvm-stream", &mvmo_);
+        if (status != ZX_OK) {
+            return status;
+        }
+        auto thread_func = [](void* arg) { return static_cast<StreamWriter*>(arg)->Thread(); };
+        if (thrd_create_with_name(&thread_, thread_func, this, "fvm-stream-writer") !=
+            thrd_success) {
+            return ZX_ERR_NO_RESOURCES;
+        }
+        thread_started_ = true;
+        return ZX_OK;
+    }
+
+    zx_handle_t vmo() const { return mvmo_->GetVmo(); }
+
+    // Waits for the next buffer to be free. Its byte offset into the VMO is
+    // returned in |*offset|, and its |kBufferSize| bytes in |*data|.
+    zx_status_t Acquire(size_t* offset, uint8_t** data) {
+        fbl::AutoLock lock(&lock_);
+        while (slots_[next_acquire_].busy && status_ == ZX_OK) {
+            cnd_wait(&cnd_, lock_.GetInternal());
+        }
+        if (status_ != ZX_OK) {
+            return status_;
+        }
+        *offset = next_acquire_ * kBufferSize;
+        *data = static_cast<uint8_t*>(mvmo_->GetData()) + *offset;
+        next_acquire_ = (next_acquire_ + 1) % kBuffers;
+        return ZX_OK;
+    }
+
+    // Queues |request|, which refers to the buffer most recently acquired,
+    // for writing through |client|.
+    void Submit(fifo_client_t* client, const block_fifo_request_t& request) {
+        fbl::AutoLock lock(&lock_);
+        Slot* slot = &slots_[(next_acquire_ + kBuffers - 1) % kBuffers];
+        slot->client = client;
+        slot->request = request;
+        slot->busy = true;
+        cnd_broadcast(&cnd_);
+    }
+
+    // Waits for every queued write, returning the first error encountered.
+    zx_status_t Flush() {
+        fbl::AutoLock lock(&lock_);
+        for (size_t i = 0; i < kBuffers; i++) {
+            while (slots_[i].busy) {
+                cnd_wait(&cnd_, lock_.GetInternal());
+            }
+        }
+        return status_;
+    }
+
+private:
+    struct Slot {
+        fifo_client_t* client;
+        block_fifo_request_t request;
+        bool busy = false;
+    };
+
+    int Thread() {
+        while (true) {
+            fifo_client_t* client;
+            block_fifo_request_t request;
+            bool skip;
+            {
+                fbl::AutoLock lock(&lock_);
+                Slot* slot = &slots_[next_write_];
+                while (!slot->busy && !stop_) {
+                    cnd_wait(&cnd_, lock_.GetInternal());
+                }
+                if (!slot->busy) {
+                    return 0;
+                }
+                client = slot->client;
+                request = slot->request;
+                // Once a write has failed the rest are dropped; the failure
+                // is reported by the next Acquire or Flush.
+                skip = status_ != ZX_OK;
+            }
+
+            zx_status_t status = skip ? ZX_OK : block_fifo_txn(client, &request, 1);
+
+            fbl::AutoLock lock(&lock_);
+            if (status != ZX_OK) {
+                ERROR("Error writing partition data\n");
+                status_ = status;
+            }
+            slots_[next_write_].busy = false;
+            next_write_ = (next_write_ + 1) % kBuffers;
+            cnd_broadcast(&cnd_);
+        }
+    }
+
+    fbl::unique_ptr<MappedVmo> mvmo_;
+    thrd_t thread_;
+    bool thread_started_ = false;
+
+    fbl::Mutex lock_;
+    cnd_t cnd_;
+    Slot slots_[kBuffers] __TA_GUARDED(lock_);
+    size_t next_acquire_ __TA_GUARDED(lock_) = 0;
+    size_t next_write_ __TA_GUARDED(lock_) = 0;
+    bool stop_ __TA_GUARDED(lock_) = false;
+    zx_status_t status_ __TA_GUARDED(lock_) = ZX_OK;
 };
 
 inline fvm::extent_descriptor_t* get_extent(fvm::partition_descriptor_t* pd, size_t extent) {
@@ -109,10 +343,8 @@ zx_status_t register_fast_block_io(const fbl::unique_fd& fd, zx_handle_t vmo,
 }
 
 // Stream an FVM partition to disk.
-zx_status_t stream_fvm_partition(partition_info* part, MappedVmo* mvmo,
-                                 fifo_client_t* client, size_t slice_size, size_t block_size,
-                                 block_fifo_request_t* request, const fbl::unique_fd& src_fd) {
-    const size_t vmo_cap = mvmo->GetSize();
+zx_status_t stream_fvm_partition(partition_info* part, StreamWriter* writer,
+                                 size_t slice_size, size_t block_size, StreamReader* reader) {
     for (size_t e = 0; e < part->pd->extent_count; e++) {
         LOG("Writing extent %zu... \n", e);
         fvm::extent_descriptor_t* ext = get_extent(part->pd, e);
@@ -121,35 +353,40 @@ zx_status_t stream_fvm_partition(partition_info* part, MappedVmo* mvmo,
 
         // Write real data
         while (bytes_left > 0) {
-            ssize_t r;
+            size_t vmo_offset;
+            uint8_t* data;
+            zx_status_t status;
+            if ((status = writer->Acquire(&vmo_offset, &data)) != ZX_OK) {
+                return status;
+            }
+
             size_t vmo_sz = 0;
-            while ((r = read(src_fd.get(), &reinterpret_cast<uint8_t*>(mvmo->GetData())[vmo_sz],
-                             fbl::min(bytes_left, vmo_cap - vmo_sz))) > 0) {
-                vmo_sz += r;
-                bytes_left -= r;
-                if (bytes_left == 0) {
+            size_t actual = 0;
+            while ((status = reader->Read(&data[vmo_sz],
+                                          fbl::min(bytes_left, StreamWriter::kBufferSize - vmo_sz),
+                                          &actual)) == ZX_OK && actual > 0) {
+                vmo_sz += actual;
+                bytes_left -= actual;
+                if (bytes_left == 0 || vmo_sz == StreamWriter::kBufferSize) {
                     break;
                 }
             }
-            if (vmo_sz == 0) {
+            if (status != ZX_OK) {
+                ERROR("Error reading partition data\n");
+                return status;
+            } else if (vmo_sz == 0) {
                 ERROR("Read nothing from src_fd; %zu bytes left\n", bytes_left);
                 return ZX_ERR_IO;
             } else if (vmo_sz % block_size != 0) {
                 ERROR("Cannot write non-block size multiple: %zu\n", vmo_sz);
                 return ZX_ERR_IO;
-            } else if (r < 0) {
-                ERROR("Error reading partition data\n");
-                return static_cast<zx_status_t>(r);
             }
 
-            request->length = vmo_sz / block_size;
-            request->vmo_offset = 0;
-            request->dev_offset = offset / block_size;
-
-            if ((r = block_fifo_txn(client, request, 1)) != ZX_OK) {
-                ERROR("Error writing partition data\n");
-                return static_cast<zx_status_t>(r);
-            }
+            block_fifo_request_t request = part->request;
+            request.length = vmo_sz / block_size;
+            request.vmo_offset = vmo_offset / block_size;
+            request.dev_offset = offset / block_size;
+            writer->Submit(part->client, request);
 
             offset += vmo_sz;
         }
@@ -159,21 +396,24 @@ zx_status_t stream_fvm_partition(partition_info* part, MappedVmo* mvmo,
         bytes_left = (ext->slice_count * slice_size) - ext->extent_length;
         if (bytes_left > 0) {
             LOG("%zu bytes written, %zu zeroes left\n", ext->extent_length, bytes_left);
-            memset(mvmo->GetData(), 0, vmo_cap);
         }
         while (bytes_left > 0) {
-            request->length = fbl::min(bytes_left, vmo_cap) / block_size;
-            request->vmo_offset = 0;
-            request->dev_offset = offset / block_size;
-
+            size_t vmo_offset;
+            uint8_t* data;
             zx_status_t status;
-            if ((status = block_fifo_txn(client, request, 1)) != ZX_OK) {
-                ERROR("Error writing trailing zeroes\n");
+            if ((status = writer->Acquire(&vmo_offset, &data)) != ZX_OK) {
                 return status;
             }
 
-            offset += request->length * block_size;
-            bytes_left -= request->length * block_size;
+            block_fifo_request_t request = part->request;
+            request.length = fbl::min(bytes_left, StreamWriter::kBufferSize) / block_size;
+            request.vmo_offset = vmo_offset / block_size;
+            request.dev_offset = offset / block_size;
+            memset(data, 0, request.length * block_size);
+            writer->Submit(part->client, request);
+
+            offset += request.length * block_size;
+            bytes_left -= request.length * block_size;
         }
     }
     return ZX_OK;
@@ -317,6 +557,9 @@ zx_status_t fvm_parse_sparse_header(const fbl::unique_fd& src_fd, fvm::sparse_im
     } else if (hdr->version != fvm::kSparseFormatVersion) {
         ERROR("Unexpected sparse file version\n");
         return ZX_ERR_IO;
+    } else if (hdr->flags & ~fvm::kSparseFlagAllValid) {
+        ERROR("Unsupported sparse file flags %#" PRIx64 "\n", hdr->flags);
+        return ZX_ERR_NOT_SUPPORTED;
     }
 
     return ZX_OK;
@@ -474,43 +717,60 @@ zx_status_t fvm_stream_partitions(fbl::unique_fd src_fd) {
 
     LOG("Partition space pre-allocated\n");
 
-    const size_t vmo_sz = 1 << 20;
-
-    fbl::unique_ptr<MappedVmo> mvmo;
-    if ((status = MappedVmo::Create(vmo_sz, "fvm-stream", &mvmo)) != ZX_OK) {
+    StreamWriter writer;
+    if ((status = writer.Init()) != ZX_OK) {
         ERROR("Failed to create stream VMO\n");
         return ZX_ERR_NO_MEMORY;
     }
 
-    // Now that all partitions are preallocated, begin streaming data to them.
+    fbl::unique_ptr<StreamReader> reader;
+    if ((status = StreamReader::Create(fbl::move(src_fd), hdr.flags, &reader)) != ZX_OK) {
+        return status;
+    }
+
+    // Every partition is registered up front, since writes to one may still
+    // be in flight when the stream moves on to the next. The clients are
+    // only released once the writer is idle.
+    auto release_clients = fbl::MakeAutoCall([&writer, &parts, &hdr]() {
+        writer.Flush();
+        for (size_t p = 0; p < hdr.partition_count; p++) {
+            if (parts[p].client != nullptr) {
+                block_fifo_release_client(parts[p].client);
+            }
+        }
+    });
     for (size_t p = 0; p < hdr.partition_count; p++) {
         txnid_t txnid;
         vmoid_t vmoid;
-        fifo_client_t* client;
-        zx_status_t status = register_fast_block_io(parts[p].new_part,
-                                                    mvmo->GetVmo(), &txnid,
-                                                    &vmoid, &client);
+        zx_status_t status = register_fast_block_io(parts[p].new_part, writer.vmo(), &txnid,
+                                                    &vmoid, &parts[p].client);
         if (status != ZX_OK) {
             ERROR("Failed to register fast block IO\n");
             return status;
         }
 
-        block_fifo_request_t request;
-        request.txnid = txnid;
-        request.vmoid = vmoid;
-        request.opcode = BLOCKIO_WRITE;
+        parts[p].request.txnid = txnid;
+        parts[p].request.vmoid = vmoid;
+        parts[p].request.opcode = BLOCKIO_WRITE;
+    }
 
+    // Now that all partitions are preallocated, begin streaming data to them.
+    for (size_t p = 0; p < hdr.partition_count; p++) {
         LOG("Streaming partition %zu\n", p);
-        status = stream_fvm_partition(&parts[p], mvmo.get(), client,
-                                      hdr.slice_size, block_size, &request, src_fd);
+        status = stream_fvm_partition(&parts[p], &writer, hdr.slice_size, block_size,
+                                      reader.get());
         LOG("Done streaming partition %zu\n", p);
-        block_fifo_release_client(client);
         if (status != ZX_OK) {
             ERROR("Failed to stream partition\n");
             return status;
         }
     }
 
+    if ((status = writer.Flush()) != ZX_OK) {
+        ERROR("Failed to stream partition\n");
+        return status;
+    }
+
     for (size_t p = 0; p < hdr.partition_count; p++) {
         // Upgrade the old partition (currently active) to the new partition (currently
         // inactive), so when the new partition becomes active, the old
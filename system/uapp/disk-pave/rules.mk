@@ -29,6 +29,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/digest \
     system/ulib/zxcpp \
     third_party/ulib/cksum \
+    third_party/ulib/lz4 \
     third_party/ulib/uboringssl \
 
 MODULE_LIBS := \
@@ -0,0 +1,59 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <zircon/device/vfs.h>
+#include <zircon/status.h>
+
+int usage(void) {
+    fprintf(stderr, "usage: fstrim [ <option>* ] path [ path* ]\n");
+    fprintf(stderr, "fstrim discards the free blocks of the filesystems mounted at each path\n");
+    fprintf(stderr, "   -v: Verbose mode\n");
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    while (argc > 1) {
+        if (!strcmp(argv[1], "-v")) {
+            verbose = true;
+        } else if (!strcmp(argv[1], "--help")) {
+            return usage();
+        } else {
+            break;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc < 2) {
+        return usage();
+    }
+
+    int rc = 0;
+    for (int i = 1; i < argc; i++) {
+        int fd;
+        if ((fd = open(argv[i], O_RDONLY | O_ADMIN)) < 0) {
+            fprintf(stderr, "fstrim: Could not open target: %s\n", argv[i]);
+            rc = -1;
+            continue;
+        }
+        uint64_t bytes;
+        ssize_t r = ioctl_vfs_trim_fs(fd, &bytes);
+        close(fd);
+        if (r < 0) {
+            fprintf(stderr, "fstrim: %s: %s\n", argv[i], zx_status_get_string((zx_status_t)r));
+            rc = -1;
+        } else if (verbose) {
+            printf("%s: %" PRIu64 " bytes trimmed\n", argv[i], bytes);
+        }
+    }
+    return rc;
+}
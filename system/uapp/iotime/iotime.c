@@ -4,9 +4,12 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <fs-management/ramdisk.h>
@@ -52,6 +55,11 @@ static void bytes_per_second(uint64_t bytes, uint64_t nanos) {
     fprintf(stderr, "%g %s/s\n", rate, unit);
 }
 
+static void ops_per_second(uint64_t ops, uint64_t nanos) {
+    double s = ((double)nanos) / ((double)1000000000);
+    fprintf(stderr, "%zu ops: %g IOPS\n", ops, ((double)ops) / s);
+}
+
 static zx_time_t iotime_posix(int is_read, int fd, size_t total, size_t bufsz) {
     void* buffer = malloc(bufsz);
     if (buffer == NULL) {
@@ -99,16 +107,115 @@ static zx_time_t iotime_block(int is_read, int fd, size_t total, size_t bufsz) {
     return iotime_posix(is_read, fd, total, bufsz);
 }
 
-static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_t bufsz) {
+// The IO of fifo mode, shared by its threads: each takes the next |depth|
+// buffers' worth of the device at a time, and has them in flight at once.
+typedef struct {
+    int fd;
+    int is_read;
+    block_info_t info;
+    fifo_client_t* client;
+    vmoid_t vmoid;
+    size_t bufsz;
+    size_t depth;
+    size_t nbufs;
+    atomic_size_t next;
+    zx_status_t status;
+} fifo_work_t;
+
+typedef struct {
+    fifo_work_t* work;
+    txnid_t txnid;
+} fifo_thread_t;
+
+static int fifo_thread(void* arg) {
+    fifo_work_t* work = ((fifo_thread_t*)arg)->work;
+    txnid_t txnid = ((fifo_thread_t*)arg)->txnid;
+
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    for (;;) {
+        size_t first = atomic_fetch_add(&work->next, work->depth);
+        if (first >= work->nbufs) {
+            break;
+        }
+        size_t count = work->nbufs - first;
+        count = (count > work->depth) ? work->depth : count;
+        for (size_t i = 0; i < count; i++) {
+            requests[i].txnid = txnid;
+            requests[i].vmoid = work->vmoid;
+            requests[i].opcode = work->is_read ? BLOCKIO_READ : BLOCKIO_WRITE;
+            requests[i].length = work->bufsz / work->info.block_size;
+            requests[i].vmo_offset = (i * work->bufsz) / work->info.block_size;
+            requests[i].dev_offset = ((first + i) * work->bufsz) / work->info.block_size;
+        }
+        zx_status_t r;
+        if ((r = block_fifo_txn(work->client, requests, count)) != ZX_OK) {
+            fprintf(stderr, "error: block_fifo_txn error %d\n", r);
+            work->status = r;
+            break;
+        }
+    }
+    return 0;
+}
+
+static void print_op_stats(const block_op_stats_t* stats) {
+    if (stats->count == 0) {
+        return;
+    }
+    fprintf(stderr, "  %" PRIu64 " ops: avg %" PRIu64 "us, of which %" PRIu64 "us queued\n",
+            stats->count, stats->total_ns / stats->count / 1000,
+            stats->queue_ns / stats->count / 1000);
+    for (int i = 0; i < BLOCK_STATS_BUCKETS; i++) {
+        if (stats->latency[i] != 0) {
+            fprintf(stderr, "    %s%8lluus: %u\n", (i == BLOCK_STATS_BUCKETS - 1) ? ">=" : "< ",
+                    (i == BLOCK_STATS_BUCKETS - 1) ? 1ull << i : 2ull << i, stats->latency[i]);
+        }
+    }
+}
+
+// Prints what the block server saw of the txns of this run.
+static void print_fifo_stats(int fd, const fifo_thread_t* threads, size_t nthreads) {
+    block_stats_t stats;
+    if (ioctl_block_get_stats(fd, &stats) < 0) {
+        return;
+    }
+    fprintf(stderr, "device: at most %u ops in flight\n", stats.max_in_flight);
+    for (uint32_t i = 0; (i < stats.client_count) && (i < BLOCK_STATS_MAX_CLIENTS); i++) {
+        const block_client_stats_t* client = &stats.clients[i];
+        for (size_t t = 0; t < nthreads; t++) {
+            if (threads[t].txnid == client->txnid) {
+                fprintf(stderr, "thread %zu:\n", t);
+                print_op_stats(&client->read);
+                print_op_stats(&client->write);
+            }
+        }
+    }
+}
+
+static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_t bufsz,
+                             size_t nthreads, size_t depth) {
     zx_status_t r;
+    fifo_work_t work = {
+        .fd = fd,
+        .is_read = is_read,
+        .bufsz = bufsz,
+        .depth = depth,
+        .nbufs = total / bufsz,
+        .status = ZX_OK,
+    };
+    atomic_init(&work.next, 0);
+
+    if ((total % bufsz) != 0) {
+        fprintf(stderr, "error: total must be a multiple of the buffer size\n");
+        return ZX_TIME_INFINITE;
+    }
+
     zx_handle_t vmo;
-    if ((r = zx_vmo_create(bufsz, 0, &vmo)) != ZX_OK) {
+    if ((r = zx_vmo_create(bufsz * depth, 0, &vmo)) != ZX_OK) {
         fprintf(stderr, "error: out of memory %d\n", r);
         return ZX_TIME_INFINITE;
     }
 
-    block_info_t info;
-    if (ioctl_block_get_info(fd, &info) < 0) {
+    if (ioctl_block_get_info(fd, &work.info) < 0) {
         fprintf(stderr, "error: cannot get info for '%s'\n", dev);
         return ZX_TIME_INFINITE;
     }
@@ -119,63 +226,90 @@ static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_
         return ZX_TIME_INFINITE;
     }
 
-    txnid_t txnid;
-    if (ioctl_block_alloc_txn(fd, &txnid) != sizeof(txnid)) {
-        fprintf(stderr, "error: cannot allocate txn for '%s'\n", dev);
-        return ZX_TIME_INFINITE;
-    }
-
     zx_handle_t dup;
     if ((r = zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &dup)) != ZX_OK) {
         fprintf(stderr, "error: cannot duplicate handle %d\n", r);
         return ZX_TIME_INFINITE;
     }
 
-    vmoid_t vmoid;
-    if (ioctl_block_attach_vmo(fd, &dup, &vmoid) != sizeof(vmoid)) {
+    if (ioctl_block_attach_vmo(fd, &dup, &work.vmoid) != sizeof(work.vmoid)) {
         fprintf(stderr, "error: cannot attach vmo for '%s'\n", dev);
         return ZX_TIME_INFINITE;
     }
 
-    fifo_client_t* client;
-    if ((r = block_fifo_create_client(fifo, &client)) != ZX_OK) {
+    if ((r = block_fifo_create_client(fifo, &work.client)) != ZX_OK) {
         fprintf(stderr, "error: cannot create block client for '%s' %d\n", dev, r);
         return ZX_TIME_INFINITE;
     }
 
+    // The txns are freed only once the run is over, since their stats go
+    // with them.
+    thrd_t threads[nthreads];
+    fifo_thread_t args[nthreads];
+    size_t allocated = 0;
+    for (; allocated < nthreads; allocated++) {
+        args[allocated].work = &work;
+        if (ioctl_block_alloc_txn(fd, &args[allocated].txnid) != sizeof(txnid_t)) {
+            fprintf(stderr, "error: cannot allocate txn\n");
+            work.status = ZX_ERR_INTERNAL;
+            break;
+        }
+    }
+
     zx_time_t t0 = zx_clock_get(ZX_CLOCK_MONOTONIC);
-    size_t n = total;
-    while (n > 0) {
-        size_t xfer = (n > bufsz) ? bufsz : n;
-        block_fifo_request_t request = {
-            .txnid = txnid,
-            .vmoid = vmoid,
-            .opcode = is_read ? BLOCKIO_READ : BLOCKIO_WRITE,
-            .length = xfer / info.block_size,
-            .vmo_offset = 0,
-            .dev_offset = (total - n) / info.block_size,
-        };
-        if ((r = block_fifo_txn(client, &request, 1)) != ZX_OK) {
-            fprintf(stderr, "error: block_fifo_txn error %d\n", r);
-            return ZX_TIME_INFINITE;
+    size_t started = 0;
+    for (; (work.status == ZX_OK) && (started < nthreads); started++) {
+        if (thrd_create(&threads[started], fifo_thread, &args[started]) != thrd_success) {
+            fprintf(stderr, "error: cannot create thread\n");
+            work.status = ZX_ERR_NO_RESOURCES;
+            break;
         }
-        n -= xfer;
+    }
+    for (size_t i = 0; i < started; i++) {
+        thrd_join(threads[i], NULL);
     }
     zx_time_t t1 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    if (work.status == ZX_OK) {
+        print_fifo_stats(fd, args, nthreads);
+    }
+    for (size_t i = 0; i < allocated; i++) {
+        ioctl_block_free_txn(fd, &args[i].txnid);
+    }
+    if (work.status != ZX_OK) {
+        return ZX_TIME_INFINITE;
+    }
     return t1 - t0;
 }
 
 static int usage(void) {
     fprintf(stderr,
-            "usage: iotime <read|write> <posix|block|fifo> <device|--ramdisk> <bytes> <bufsize>\n\n"
+            "usage: iotime [-t <threads>] [-q <depth>] <read|write> <posix|block|fifo>\n"
+            "              <device|--ramdisk> <bytes> <bufsize>\n\n"
             "        <bytes> and <bufsize> must be a multiple of 4k for block mode\n"
-            "        --ramdisk only supported for block mode\n");
+            "        --ramdisk only supported for block mode\n"
+            "        -t and -q are only supported for fifo mode: <threads> threads\n"
+            "        each keep <depth> (at most %d) requests of <bufsize> in flight\n",
+            MAX_TXN_MESSAGES);
     return -1;
 }
 
 
 int main(int argc, char** argv) {
-    if (argc != 6) {
+    size_t nthreads = 1;
+    size_t depth = 1;
+    while ((argc > 2) && (argv[1][0] == '-') && (argv[1][1] != '-')) {
+        if (!strcmp(argv[1], "-t")) {
+            nthreads = number(argv[2]);
+        } else if (!strcmp(argv[1], "-q")) {
+            depth = number(argv[2]);
+        } else {
+            return usage();
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if ((argc != 6) || (nthreads == 0) || (depth == 0) || (depth > MAX_TXN_MESSAGES)) {
         return usage();
     }
 
@@ -200,13 +334,18 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (((nthreads != 1) || (depth != 1)) && strcmp(argv[2], "fifo")) {
+        fprintf(stderr, "error: -t and -q only supported for fifo\n");
+        return -1;
+    }
+
     zx_time_t res;
     if (!strcmp(argv[2], "posix")) {
         res = iotime_posix(is_read, fd, total, bufsz);
     } else if (!strcmp(argv[2], "block")) {
         res = iotime_block(is_read, fd, total, bufsz);
     } else if (!strcmp(argv[2], "fifo")) {
-        res = iotime_fifo(argv[3], is_read, fd, total, bufsz);
+        res = iotime_fifo(argv[3], is_read, fd, total, bufsz, nthreads, depth);
     } else {
         fprintf(stderr, "error: unknown mode '%s'\n", argv[2]);
         return -1;
@@ -215,6 +354,9 @@ int main(int argc, char** argv) {
     if (res != ZX_TIME_INFINITE) {
         fprintf(stderr, "%s %zu bytes in %zu ns: ", is_read ? "read" : "write", total, res);
         bytes_per_second(total, res);
+        if (!strcmp(argv[2], "fifo")) {
+            ops_per_second(total / bufsz, res);
+        }
         return 0;
     } else {
         return -1;
@@ -0,0 +1,594 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Round trip latency and throughput of the kernel's IPC primitives.
+//
+// Every benchmark bounces a message between the two ends of an object and
+// back.  With the "thread" placement each end is served by its own thread,
+// so a round trip includes two wakeups.  With "inline" a single thread does
+// both halves, which leaves only the cost of the syscalls themselves.
+// Running several pairs at once shows how the paths scale.
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/port.h>
+#include <zircon/types.h>
+#include <fbl/algorithm.h>
+#include <fbl/unique_ptr.h>
+
+namespace {
+
+constexpr uint32_t kDefaultIterations = 10000;
+constexpr uint32_t kWarmupIterations = 100;
+constexpr size_t kMaxListLength = 16;
+constexpr uint32_t kDefaultSizes[] = {64, 4096};
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+void check(zx_status_t status, const char* what) {
+    if (status != ZX_OK) {
+        fprintf(stderr, "%s failed: %d\n", what, status);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void wait_for(zx_handle_t handle, zx_signals_t signals) {
+    zx_signals_t observed;
+    check(zx_object_wait_one(handle, signals, ZX_TIME_INFINITE, &observed), "wait");
+    if (!(observed & signals)) {
+        fprintf(stderr, "peer went away\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+struct Params {
+    uint32_t size;
+    uint32_t handles;
+    bool inline_;
+};
+
+// A pair of endpoints a message can be passed between.  Send() on one end
+// makes Receive() on the other end return, blocking until it does.
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual void Send(int end) = 0;
+    virtual void Receive(int end) = 0;
+
+    // One request and reply from end 0.  Only used with the thread placement.
+    virtual void RoundTrip() {
+        Send(0);
+        Receive(0);
+    }
+};
+
+class ChannelTransport : public Transport {
+public:
+    explicit ChannelTransport(const Params& params) : params_(params) {
+        check(zx_channel_create(0u, &ch_[0], &ch_[1]), "zx_channel_create");
+        for (int end = 0; end < 2; end++) {
+            buf_[end].reset(new uint8_t[fbl::max(params.size, 1u)]());
+            handles_[end].reset(new zx_handle_t[fbl::max(params.handles, 1u)]);
+        }
+        for (uint32_t i = 0; i < params.handles; i++)
+            check(zx_event_create(0u, &handles_[0][i]), "zx_event_create");
+    }
+
+    ~ChannelTransport() override {
+        // The handles are back at end 0 once the last round trip is done.
+        for (uint32_t i = 0; i < params_.handles; i++)
+            zx_handle_close(handles_[0][i]);
+        zx_handle_close(ch_[0]);
+        zx_handle_close(ch_[1]);
+    }
+
+    void Send(int end) override {
+        check(zx_channel_write(ch_[end], 0u, buf_[end].get(), params_.size,
+                               handles_[end].get(), params_.handles),
+              "zx_channel_write");
+    }
+
+    void Receive(int end) override {
+        wait_for(ch_[end], ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED);
+        uint32_t actual_bytes, actual_handles;
+        check(zx_channel_read(ch_[end], 0u, buf_[end].get(), handles_[end].get(),
+                              params_.size, params_.handles,
+                              &actual_bytes, &actual_handles),
+              "zx_channel_read");
+    }
+
+protected:
+    Params params_;
+    zx_handle_t ch_[2];
+    fbl::unique_ptr<uint8_t[]> buf_[2];
+    fbl::unique_ptr<zx_handle_t[]> handles_[2];
+};
+
+// The reply to a zx_channel_call() needs the request's txid, which the
+// server end echoes back with the rest of the bytes.
+class ChannelCallTransport : public ChannelTransport {
+public:
+    explicit ChannelCallTransport(const Params& params) : ChannelTransport(params) {}
+
+    void RoundTrip() override {
+        zx_channel_call_args_t args = {
+            buf_[0].get(), handles_[0].get(), buf_[0].get(), handles_[0].get(),
+            params_.size, params_.handles, params_.size, params_.handles,
+        };
+        uint32_t actual_bytes, actual_handles;
+        zx_status_t read_status;
+        zx_status_t status = zx_channel_call(ch_[0], 0u, ZX_TIME_INFINITE, &args,
+                                             &actual_bytes, &actual_handles, &read_status);
+        check(status == ZX_ERR_CALL_FAILED ? read_status : status, "zx_channel_call");
+    }
+};
+
+class SocketTransport : public Transport {
+public:
+    explicit SocketTransport(const Params& params) : size_(params.size) {
+        check(zx_socket_create(0u, &socket_[0], &socket_[1]), "zx_socket_create");
+        for (int end = 0; end < 2; end++)
+            buf_[end].reset(new uint8_t[size_]());
+    }
+
+    ~SocketTransport() override {
+        zx_handle_close(socket_[0]);
+        zx_handle_close(socket_[1]);
+    }
+
+    void Send(int end) override {
+        for (size_t done = 0; done < size_;) {
+            size_t actual;
+            zx_status_t status = zx_socket_write(socket_[end], 0u, buf_[end].get() + done,
+                                                 size_ - done, &actual);
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                wait_for(socket_[end], ZX_SOCKET_WRITABLE | ZX_SOCKET_PEER_CLOSED);
+                continue;
+            }
+            check(status, "zx_socket_write");
+            done += actual;
+        }
+    }
+
+    void Receive(int end) override {
+        for (size_t done = 0; done < size_;) {
+            size_t actual;
+            zx_status_t status = zx_socket_read(socket_[end], 0u, buf_[end].get() + done,
+                                                size_ - done, &actual);
+            if (status == ZX_ERR_SHOULD_WAIT) {
+                wait_for(socket_[end], ZX_SOCKET_READABLE | ZX_SOCKET_PEER_CLOSED);
+                continue;
+            }
+            check(status, "zx_socket_read");
+            done += actual;
+        }
+    }
+
+private:
+    size_t size_;
+    zx_handle_t socket_[2];
+    fbl::unique_ptr<uint8_t[]> buf_[2];
+};
+
+// A message is a single fifo element.
+class FifoTransport : public Transport {
+public:
+    explicit FifoTransport(const Params& params) : size_(params.size) {
+        check(zx_fifo_create(1u, size_, 0u, &fifo_[0], &fifo_[1]), "zx_fifo_create");
+        for (int end = 0; end < 2; end++)
+            buf_[end].reset(new uint8_t[size_]());
+    }
+
+    ~FifoTransport() override {
+        zx_handle_close(fifo_[0]);
+        zx_handle_close(fifo_[1]);
+    }
+
+    void Send(int end) override {
+        uint32_t actual;
+        check(zx_fifo_write(fifo_[end], buf_[end].get(), size_, &actual), "zx_fifo_write");
+    }
+
+    void Receive(int end) override {
+        wait_for(fifo_[end], ZX_FIFO_READABLE | ZX_FIFO_PEER_CLOSED);
+        uint32_t actual;
+        check(zx_fifo_read(fifo_[end], buf_[end].get(), size_, &actual), "zx_fifo_read");
+    }
+
+private:
+    uint32_t size_;
+    zx_handle_t fifo_[2];
+    fbl::unique_ptr<uint8_t[]> buf_[2];
+};
+
+// Each end waits on a port of its own for user packets queued by the other.
+class PortTransport : public Transport {
+public:
+    explicit PortTransport(const Params&) {
+        for (int end = 0; end < 2; end++)
+            check(zx_port_create(0u, &port_[end]), "zx_port_create");
+    }
+
+    ~PortTransport() override {
+        zx_handle_close(port_[0]);
+        zx_handle_close(port_[1]);
+    }
+
+    void Send(int end) override {
+        zx_port_packet_t packet = {};
+        packet.type = ZX_PKT_TYPE_USER;
+        check(zx_port_queue(port_[1 - end], &packet, 0u), "zx_port_queue");
+    }
+
+    void Receive(int end) override {
+        zx_port_packet_t packet;
+        check(zx_port_wait(port_[end], ZX_TIME_INFINITE, &packet, 0u), "zx_port_wait");
+    }
+
+private:
+    zx_handle_t port_[2];
+};
+
+class EventPairTransport : public Transport {
+public:
+    explicit EventPairTransport(const Params&) {
+        check(zx_eventpair_create(0u, &ep_[0], &ep_[1]), "zx_eventpair_create");
+    }
+
+    ~EventPairTransport() override {
+        zx_handle_close(ep_[0]);
+        zx_handle_close(ep_[1]);
+    }
+
+    void Send(int end) override {
+        check(zx_object_signal_peer(ep_[end], 0u, ZX_USER_SIGNAL_0), "zx_object_signal_peer");
+    }
+
+    void Receive(int end) override {
+        wait_for(ep_[end], ZX_USER_SIGNAL_0 | ZX_EPAIR_PEER_CLOSED);
+        check(zx_object_signal(ep_[end], ZX_USER_SIGNAL_0, 0u), "zx_object_signal");
+    }
+
+private:
+    zx_handle_t ep_[2];
+};
+
+// Each end owns a futex word that the other sets and wakes.
+class FutexTransport : public Transport {
+public:
+    explicit FutexTransport(const Params&) {}
+
+    void Send(int end) override {
+        __atomic_store_n(&word_[1 - end], 1, __ATOMIC_RELEASE);
+        check(zx_futex_wake(&word_[1 - end], 1u), "zx_futex_wake");
+    }
+
+    void Receive(int end) override {
+        while (__atomic_load_n(&word_[end], __ATOMIC_ACQUIRE) == 0) {
+            zx_status_t status = zx_futex_wait(&word_[end], 0, ZX_TIME_INFINITE);
+            if (status != ZX_ERR_BAD_STATE)
+                check(status, "zx_futex_wait");
+        }
+        __atomic_store_n(&word_[end], 0, __ATOMIC_RELAXED);
+    }
+
+private:
+    zx_futex_t word_[2] = {};
+};
+
+struct Benchmark {
+    const char* name;
+    uint32_t min_size;
+    // Zero if the benchmark can't carry a payload; then it runs once, for
+    // the first size only.
+    uint32_t max_size;
+    uint32_t max_handles;
+    bool supports_inline;
+    Transport* (*create)(const Params& params);
+};
+
+template <typename T>
+Transport* create(const Params& params) {
+    return new T(params);
+}
+
+// zx_channel_call() blocks for the reply, so it can't run inline, and
+// needs room for the txid at the start of the message.  The
+// socket is capped at what fits in its buffer, so an inline send never
+// has to wait for the receiver.
+const Benchmark kBenchmarks[] = {
+    {"channel", 0, ZX_CHANNEL_MAX_MSG_BYTES, ZX_CHANNEL_MAX_MSG_HANDLES, true,
+     create<ChannelTransport>},
+    {"channel_call", sizeof(zx_txid_t), ZX_CHANNEL_MAX_MSG_BYTES, ZX_CHANNEL_MAX_MSG_HANDLES, false,
+     create<ChannelCallTransport>},
+    {"socket", 1, 65536, 0, true, create<SocketTransport>},
+    {"fifo", 1, 4096, 0, true, create<FifoTransport>},
+    {"port", 0, 0, 0, true, create<PortTransport>},
+    {"eventpair", 0, 0, 0, true, create<EventPairTransport>},
+    {"futex", 0, 0, 0, true, create<FutexTransport>},
+};
+
+struct Pair {
+    fbl::unique_ptr<Transport> transport;
+    const Params* params;
+    uint32_t iterations;
+    zx_handle_t start;
+    fbl::unique_ptr<uint64_t[]> samples;
+    thrd_t client;
+    thrd_t server;
+};
+
+int server_thread(void* arg) {
+    Pair* pair = static_cast<Pair*>(arg);
+    for (uint32_t i = 0; i < kWarmupIterations + pair->iterations; i++) {
+        pair->transport->Receive(1);
+        pair->transport->Send(1);
+    }
+    return 0;
+}
+
+int client_thread(void* arg) {
+    Pair* pair = static_cast<Pair*>(arg);
+    Transport* t = pair->transport.get();
+    bool inline_ = pair->params->inline_;
+
+    for (uint32_t i = 0; i < kWarmupIterations; i++) {
+        if (inline_) {
+            t->Send(0);
+            t->Receive(1);
+            t->Send(1);
+            t->Receive(0);
+        } else {
+            t->RoundTrip();
+        }
+    }
+
+    // Line all the pairs up, so that they really run at the same time.
+    wait_for(pair->start, ZX_USER_SIGNAL_0);
+
+    for (uint32_t i = 0; i < pair->iterations; i++) {
+        uint64_t start = zx_ticks_get();
+        if (inline_) {
+            t->Send(0);
+            t->Receive(1);
+            t->Send(1);
+            t->Receive(0);
+        } else {
+            t->RoundTrip();
+        }
+        pair->samples[i] = zx_ticks_get() - start;
+    }
+    return 0;
+}
+
+int compare_samples(const void* a, const void* b) {
+    uint64_t sa = *static_cast<const uint64_t*>(a);
+    uint64_t sb = *static_cast<const uint64_t*>(b);
+    return sa < sb ? -1 : sa > sb;
+}
+
+void run(const Benchmark& benchmark, const Params& params, uint32_t num_pairs,
+         uint32_t iterations, bool csv) {
+    zx_handle_t start;
+    check(zx_event_create(0u, &start), "zx_event_create");
+
+    fbl::unique_ptr<Pair[]> pairs(new Pair[num_pairs]);
+    for (uint32_t i = 0; i < num_pairs; i++) {
+        Pair& pair = pairs[i];
+        pair.transport.reset(benchmark.create(params));
+        pair.params = &params;
+        pair.iterations = iterations;
+        pair.start = start;
+        pair.samples.reset(new uint64_t[iterations]);
+        if (!params.inline_ &&
+            thrd_create_with_name(&pair.server, server_thread, &pair, "server") != thrd_success)
+            check(ZX_ERR_NO_RESOURCES, "thrd_create");
+        if (thrd_create_with_name(&pair.client, client_thread, &pair, "client") != thrd_success)
+            check(ZX_ERR_NO_RESOURCES, "thrd_create");
+    }
+
+    uint64_t start_ticks = zx_ticks_get();
+    check(zx_object_signal(start, 0u, ZX_USER_SIGNAL_0), "zx_object_signal");
+    for (uint32_t i = 0; i < num_pairs; i++) {
+        thrd_join(pairs[i].client, nullptr);
+        if (!params.inline_)
+            thrd_join(pairs[i].server, nullptr);
+    }
+    uint64_t elapsed_ticks = zx_ticks_get() - start_ticks;
+    zx_handle_close(start);
+
+    size_t count = static_cast<size_t>(num_pairs) * iterations;
+    fbl::unique_ptr<uint64_t[]> all(new uint64_t[count]);
+    for (uint32_t i = 0; i < num_pairs; i++) {
+        memcpy(&all[static_cast<size_t>(i) * iterations], pairs[i].samples.get(),
+               iterations * sizeof(uint64_t));
+    }
+    qsort(all.get(), count, sizeof(uint64_t), compare_samples);
+
+    double ns_per_tick = 1e9 / static_cast<double>(zx_ticks_per_second());
+    auto percentile = [&](uint32_t p) -> uint64_t {
+        size_t index = fbl::min(count - 1, (count * p) / 100);
+        return static_cast<uint64_t>(static_cast<double>(all[index]) * ns_per_tick);
+    };
+    double seconds = static_cast<double>(elapsed_ticks) * ns_per_tick / 1e9;
+    double rate = static_cast<double>(count) / seconds;
+    uint64_t p50 = percentile(50), p90 = percentile(90), p99 = percentile(99);
+    uint64_t max = static_cast<uint64_t>(static_cast<double>(all[count - 1]) * ns_per_tick);
+    uint32_t size = benchmark.max_size ? params.size : 0;
+    const char* placement = params.inline_ ? "inline" : "thread";
+
+    if (csv) {
+        printf("%s,%s,%u,%u,%u,%zu,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%.0f\n",
+               benchmark.name, placement, size, params.handles, num_pairs, count,
+               p50, p90, p99, max, rate);
+    } else {
+        printf("%-12s %-6s %6u %3u %3u %9.2f %9.2f %9.2f %9.2f %11.0f\n",
+               benchmark.name, placement, size, params.handles, num_pairs,
+               p50 / 1000.0, p90 / 1000.0, p99 / 1000.0, max / 1000.0, rate);
+    }
+}
+
+// Parses a comma separated list of numbers.
+size_t parse_list(const char* argv0, const char* arg, uint32_t* out) {
+    size_t n = 0;
+    const char* p = arg;
+    for (;;) {
+        if (n == kMaxListLength)
+            argument_error(argv0, "too many values in list");
+        errno = 0;
+        char* endptr = nullptr;
+        unsigned long long v = strtoull(p, &endptr, 10);
+        if (errno != 0 || endptr == p || v > UINT32_MAX)
+            argument_error(argv0, "invalid numeric value");
+        out[n++] = static_cast<uint32_t>(v);
+        if (*endptr == '\0')
+            return n;
+        if (*endptr != ',')
+            argument_error(argv0, "invalid numeric value");
+        p = endptr + 1;
+    }
+}
+
+bool selected(const char* list, const char* name) {
+    if (!list)
+        return true;
+    size_t len = strlen(name);
+    for (const char* p = list; *p;) {
+        const char* comma = strchr(p, ',');
+        size_t n = comma ? static_cast<size_t>(comma - p) : strlen(p);
+        if (n == len && !strncmp(p, name, len))
+            return true;
+        p += comma ? n + 1 : n;
+    }
+    return false;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h       show help (this)\n"
+        "  -b LIST  run only the listed benchmarks (default: all of\n"
+        "           channel,channel_call,socket,fifo,port,eventpair,futex)\n"
+        "  -S LIST  message sizes in bytes (default: 64,4096)\n"
+        "  -H LIST  handles per channel message (default: 0)\n"
+        "  -T LIST  numbers of pairs to run at once (default: 1)\n"
+        "  -p MODE  run only the 'inline' or 'thread' placement (default: both)\n"
+        "  -n N     round trips per pair (default: %u)\n"
+        "  -c       print comma separated values\n"
+        "\n"
+        "Latencies are for one round trip, in usec.  Rate is round trips per\n"
+        "second over all pairs.  Benchmarks that can't carry a payload run for\n"
+        "the first size only and report a size of 0.\n";
+
+    const char* benchmarks = nullptr;
+    uint32_t sizes[kMaxListLength];
+    size_t num_sizes = fbl::count_of(kDefaultSizes);
+    memcpy(sizes, kDefaultSizes, sizeof(kDefaultSizes));
+    uint32_t handles[kMaxListLength] = {0};
+    size_t num_handles = 1;
+    uint32_t pairs[kMaxListLength] = {1};
+    size_t num_pairs = 1;
+    bool placements[2] = {true, true};  // inline, thread
+    uint32_t iterations = kDefaultIterations;
+    bool csv = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hb:S:H:T:p:n:c")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0], kDefaultIterations);
+                return EXIT_SUCCESS;
+            case 'b':
+                benchmarks = optarg;
+                break;
+            case 'S':
+                num_sizes = parse_list(argv[0], optarg, sizes);
+                break;
+            case 'H':
+                num_handles = parse_list(argv[0], optarg, handles);
+                break;
+            case 'T':
+                num_pairs = parse_list(argv[0], optarg, pairs);
+                for (size_t i = 0; i < num_pairs; i++) {
+                    if (pairs[i] == 0)
+                        argument_error(argv[0], "need at least one pair");
+                }
+                break;
+            case 'p':
+                if (!strcmp(optarg, "inline")) {
+                    placements[1] = false;
+                } else if (!strcmp(optarg, "thread")) {
+                    placements[0] = false;
+                } else {
+                    argument_error(argv[0], "placement must be 'inline' or 'thread'");
+                }
+                break;
+            case 'n': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long long v = strtoull(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], "invalid number of round trips");
+                iterations = static_cast<uint32_t>(v);
+                break;
+            }
+            case 'c':
+                csv = true;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    if (csv) {
+        printf("benchmark,placement,size,handles,pairs,samples,"
+               "p50_ns,p90_ns,p99_ns,max_ns,round_trips_per_sec\n");
+    } else {
+        printf("%-12s %-6s %6s %3s %3s %9s %9s %9s %9s %11s\n",
+               "benchmark", "place", "size", "hnd", "prs",
+               "p50", "p90", "p99", "max", "rate");
+    }
+
+    for (const Benchmark& benchmark : kBenchmarks) {
+        if (!selected(benchmarks, benchmark.name))
+            continue;
+        for (int place = 0; place < 2; place++) {
+            if (!placements[place] || (place == 0 && !benchmark.supports_inline))
+                continue;
+            for (size_t s = 0; s < num_sizes; s++) {
+                if (benchmark.max_size == 0 ? s > 0 :
+                    sizes[s] < benchmark.min_size || sizes[s] > benchmark.max_size)
+                    continue;
+                for (size_t h = 0; h < num_handles; h++) {
+                    if (handles[h] > benchmark.max_handles)
+                        continue;
+                    Params params = {sizes[s], handles[h], place == 0};
+                    for (size_t p = 0; p < num_pairs; p++)
+                        run(benchmark, params, pairs[p], iterations, csv);
+                }
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
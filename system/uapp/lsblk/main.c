@@ -192,6 +192,49 @@ out:
     return rc;
 }
 
+static void print_op_stats(const char* name, const block_op_stats_t* stats) {
+    if (stats->count == 0) {
+        return;
+    }
+    printf("  %-5s %8" PRIu64 " ops %10" PRIu64 " blocks  avg %" PRIu64 "us (queued %" PRIu64
+           "us)\n", name, stats->count, stats->blocks, stats->total_ns / stats->count / 1000,
+           stats->queue_ns / stats->count / 1000);
+    for (int i = 0; i < BLOCK_STATS_BUCKETS; i++) {
+        if (stats->latency[i] != 0) {
+            printf("        %s%8lluus: %u\n", (i == BLOCK_STATS_BUCKETS - 1) ? ">=" : "< ",
+                   (i == BLOCK_STATS_BUCKETS - 1) ? 1ull << i : 2ull << i, stats->latency[i]);
+        }
+    }
+}
+
+static int cmd_stats_blk(const char* dev) {
+    int fd = open(dev, O_RDONLY);
+    if (fd < 0) {
+        printf("Error opening %s\n", dev);
+        return fd;
+    }
+
+    block_stats_t stats;
+    ssize_t rc = ioctl_block_get_stats(fd, &stats);
+    close(fd);
+    if (rc < 0) {
+        printf("Error %zd getting stats for %s (is it in use?)\n", rc, dev);
+        return -1;
+    }
+
+    printf("%u in flight (at most %u), %u queued, %u clients\n",
+           stats.in_flight, stats.max_in_flight, stats.queued, stats.client_count);
+    uint32_t count = stats.client_count < BLOCK_STATS_MAX_CLIENTS ?
+                     stats.client_count : BLOCK_STATS_MAX_CLIENTS;
+    for (uint32_t i = 0; i < count; i++) {
+        const block_client_stats_t* client = &stats.clients[i];
+        printf("txn %u: %u in flight\n", client->txnid, client->in_flight);
+        print_op_stats("read", &client->read);
+        print_op_stats("write", &client->write);
+    }
+    return 0;
+}
+
 int main(int argc, const char** argv) {
     int rc = 0;
     const char *cmd = argc > 1 ? argv[1] : NULL;
@@ -201,6 +244,9 @@ int main(int argc, const char** argv) {
         } else if (!strcmp(cmd, "read")) {
             if (argc < 5) goto usage;
             rc = cmd_read_blk(argv[2], strtoul(argv[3], NULL, 10), strtoull(argv[4], NULL, 10));
+        } else if (!strcmp(cmd, "stats")) {
+            if (argc < 3) goto usage;
+            rc = cmd_stats_blk(argv[2]);
         } else {
             printf("Unrecognized command %s!\n", cmd);
             goto usage;
@@ -213,5 +259,6 @@ usage:
     printf("Usage:\n");
     printf("%s\n", argv[0]);
     printf("%s read <blkdev> <offset> <count>\n", argv[0]);
+    printf("%s stats <blkdev>\n", argv[0]);
     return 0;
 }
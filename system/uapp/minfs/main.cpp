@@ -14,6 +14,7 @@
 #include <unistd.h>
 
 #include <async/loop.h>
+#include <fbl/algorithm.h>
 #include <fbl/unique_free_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fs/trace.h>
@@ -23,9 +24,14 @@
 #include <zircon/compiler.h>
 #include <zircon/process.h>
 #include <zircon/processargs.h>
+#include <zircon/syscalls.h>
 
 namespace {
 
+// The most threads serving filesystem requests. Operations which only read
+// the filesystem run on them concurrently; see minfs::ReadOpLock.
+constexpr uint32_t kMaxDispatchThreads = 4;
+
 int do_minfs_check(fbl::unique_ptr<minfs::Bcache> bc, int argc, char** argv) {
     return minfs_check(fbl::move(bc));
 }
@@ -46,6 +52,14 @@ int do_minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, bool readonly) {
         return -1;
     }
 
+    // The main thread serves requests too.
+    const uint32_t threads = fbl::min(zx_system_get_num_cpus(), kMaxDispatchThreads);
+    for (uint32_t i = 1; i < threads; i++) {
+        if (loop.StartThread("minfs-dispatch") != ZX_OK) {
+            FS_TRACE_WARN("minfs: Could not start dispatch thread %u\n", i);
+            break;
+        }
+    }
     loop.Run();
     return 0;
 }
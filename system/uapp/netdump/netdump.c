@@ -12,17 +12,20 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <netinet/if_ether.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 #include <netinet/ip.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
 #define BUFSIZE 2048
+#define CAPTURE_RING_SIZE (4u * 1024 * 1024)
 #define ROUNDUP(a, b)   (((a) + ((b)-1)) & ~((b)-1))
 
 typedef struct {
@@ -33,6 +36,10 @@ typedef struct {
     size_t packet_count;
     size_t verbose_level;
     int dumpfile;
+    // The most bytes of each packet kept, or 0 for all of them.
+    uint32_t snaplen;
+    // Only packets of this ethertype are kept, if nonzero.
+    uint16_t ethertype;
 } netdump_options_t;
 
 typedef struct {
@@ -210,7 +217,7 @@ int write_shb(int fd) {
     return 0;
 }
 
-int write_idb(int fd) {
+int write_idb(int fd, uint32_t snaplen) {
     if (fd == -1) {
         return 0;
     }
@@ -221,7 +228,7 @@ int write_idb(int fd) {
         .reserved = 0,
         // We can't use a zero here, but tcpdump also rejects 2^32 - 1. Try 2^16 - 1.
         // See http://seclists.org/tcpdump/2012/q2/8.
-        .snaplen = 0xFFFF,
+        .snaplen = snaplen ? snaplen : 0xFFFF,
         .blk_tot_len2 = sizeof(pcap_idb_t),
     };
 
@@ -233,7 +240,9 @@ int write_idb(int fd) {
     return 0;
 }
 
-int write_packet(int fd, void* data, size_t len) {
+// Writes the first |len| bytes of a packet that was |orig_len| long. Readers take the length of
+// the data in a simple packet block from the snaplen in the interface description.
+int write_packet(int fd, void* data, size_t len, size_t orig_len) {
     if (fd == -1) {
         return 0;
     }
@@ -242,7 +251,7 @@ int write_packet(int fd, void* data, size_t len) {
     simple_pkt_t pkt = {
         .type = 0x00000003,
         .blk_tot_len = SIMPLE_PKT_MIN_SIZE + padded_len,
-        .pkt_len = len,
+        .pkt_len = orig_len,
     };
 
     // TODO(tkilbourn): rewrite this to offload writing to another thread, and also deal with
@@ -272,15 +281,70 @@ int write_packet(int fd, void* data, size_t len) {
     return 0;
 }
 
-void handle_rx(zx_handle_t rx_fifo, char* iobuf, unsigned count, netdump_options_t* options) {
-    eth_fifo_entry_t entries[count];
+// Prints and saves the first |len| bytes of a packet that was |orig_len| long. Returns nonzero
+// once netdump should stop.
+int dump_packet(void* data, size_t len, size_t orig_len, netdump_options_t* options) {
+    if (options->raw) {
+        printf("---\n");
+        hexdump8_ex(data, len, 0);
+    } else {
+        parse_packet(data, len, options);
+    }
 
-    if (write_shb(options->dumpfile)) {
-        return;
+    if (write_packet(options->dumpfile, data, len, orig_len)) {
+        return -1;
     }
-    if (write_idb(options->dumpfile)) {
+
+    options->packet_count--;
+    return options->packet_count == 0;
+}
+
+// Reads packets from a capture ring filled by the ethernet driver, which filters and truncates
+// them already, without having to take part in the datapath.
+void handle_capture(zx_handle_t vmo, netdump_options_t* options) {
+    size_t map_size = ROUNDUP(ETH_CAPTURE_DATA_OFFSET + CAPTURE_RING_SIZE, PAGE_SIZE);
+    uintptr_t addr;
+    zx_status_t status;
+    if ((status = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, map_size,
+                              ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr)) < 0) {
+        fprintf(stderr, "netdump: failed to map capture ring: %d\n", status);
         return;
     }
+    eth_capture_ring_t* ring = (eth_capture_ring_t*)addr;
+    uint8_t* base = (uint8_t*)addr + ETH_CAPTURE_DATA_OFFSET;
+    uint64_t tail = ring->tail;
+    uint64_t dropped = 0;
+
+    for (;;) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            uint64_t now_dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+            if (now_dropped != dropped) {
+                fprintf(stderr, "netdump: %" PRIu64 " packets dropped from the capture\n",
+                        now_dropped - dropped);
+                dropped = now_dropped;
+            }
+            zx_nanosleep(zx_deadline_after(ZX_MSEC(10)));
+            continue;
+        }
+        while (tail != head) {
+            eth_capture_record_t* record =
+                (eth_capture_record_t*)(base + (tail & (ring->size - 1)));
+            uint32_t record_len = record->record_len;
+            if (!(record->flags & ETH_CAPTURE_PAD)) {
+                if (dump_packet(record->data, record->cap_len, record->frame_len, options)) {
+                    return;
+                }
+            }
+            tail += record_len;
+        }
+        // Hand the space back to the driver once the whole batch is done with.
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+}
+
+void handle_rx(zx_handle_t rx_fifo, char* iobuf, unsigned count, netdump_options_t* options) {
+    eth_fifo_entry_t entries[count];
 
     for (;;) {
         uint32_t n;
@@ -296,20 +360,15 @@ void handle_rx(zx_handle_t rx_fifo, char* iobuf, unsigned count, netdump_options
 
         eth_fifo_entry_t* e = entries;
         for (uint32_t i = 0; i < n; i++, e++) {
-            if (e->flags & ETH_FIFO_RX_OK) {
-                if (options->raw) {
-                    printf("---\n");
-                    hexdump8_ex(iobuf + e->offset, e->length, 0);
-                } else {
-                    parse_packet(iobuf + e->offset, e->length, options);
+            struct ethhdr* frame = (struct ethhdr*)(iobuf + e->offset);
+            if ((e->flags & ETH_FIFO_RX_OK) &&
+                (!options->ethertype ||
+                 (e->length >= sizeof(*frame) && ntohs(frame->h_proto) == options->ethertype))) {
+                size_t len = e->length;
+                if (options->snaplen && len > options->snaplen) {
+                    len = options->snaplen;
                 }
-
-                if (write_packet(options->dumpfile, iobuf + e->offset, e->length)) {
-                    return;
-                }
-
-                options->packet_count--;
-                if (options->packet_count == 0) {
+                if (dump_packet(iobuf + e->offset, len, e->length, options)) {
                     return;
                 }
             }
@@ -331,6 +390,8 @@ int usage(void) {
     fprintf(stderr, " -c count: Exit after receiving count packets\n");
     fprintf(stderr, " -e      : Print link-level header information\n");
     fprintf(stderr, " -p      : Use promiscuous mode\n");
+    fprintf(stderr, " -s len  : Keep only the first len bytes of each packet\n");
+    fprintf(stderr, " -t type : Keep only packets of the given ethertype\n");
     fprintf(stderr, " -v      : Print verbose output\n");
     fprintf(stderr, " -vv     : Print extra verbose output\n");
     fprintf(stderr, " --raw   : Print raw bytes of all incoming packets\n");
@@ -361,6 +422,25 @@ int parse_args(int argc, const char** argv, netdump_options_t* options) {
             argv++;
             argc--;
             options->promisc = true;
+        } else if (!strcmp(argv[0], "-s") || !strcmp(argv[0], "-t")) {
+            bool snaplen = !strcmp(argv[0], "-s");
+            argv++;
+            argc--;
+            if (argc < 1) {
+                return usage();
+            }
+            char* endptr;
+            unsigned long value = strtoul(argv[0], &endptr, 0);
+            if (*endptr != '\0' || value == 0 || value > (snaplen ? UINT32_MAX : UINT16_MAX)) {
+                return usage();
+            }
+            if (snaplen) {
+                options->snaplen = (uint32_t)value;
+            } else {
+                options->ethertype = (uint16_t)value;
+            }
+            argv++;
+            argc--;
         } else if (!strcmp(argv[0], "-w")) {
             argv++;
             argc--;
@@ -416,10 +496,55 @@ int main(int argc, const char** argv) {
         return -1;
     }
 
+    if (write_shb(options.dumpfile) || write_idb(options.dumpfile, options.snaplen)) {
+        return -1;
+    }
+
+    ssize_t r;
+    if ((r = ioctl_ethernet_set_client_name(fd, "netdump", 7)) < 0) {
+        fprintf(stderr, "netdump: failed to set client name %zd\n", r);
+    }
+
+    if (options.promisc) {
+        bool yes = true;
+        if ((r = ioctl_ethernet_set_promisc(fd, &yes)) < 0) {
+            fprintf(stderr, "netdump: failed to set promisc mode: %zd\n", r);
+        }
+    }
+
+    // Prefer the driver's capture ring, which sees both directions without this client having
+    // fifos in the datapath. Older drivers, or one already capturing, need the fifos instead.
+    eth_capture_config_t config = {
+        .flags = ETH_CAPTURE_RX | ETH_CAPTURE_TX,
+        .snaplen = options.snaplen,
+        .ring_size = CAPTURE_RING_SIZE,
+    };
+    if (options.ethertype) {
+        config.filters[0] = (eth_capture_filter_t){
+            .offset = offsetof(struct ethhdr, h_proto),
+            .size = 2,
+            .mask = 0xFFFF,
+            .value = options.ethertype,
+        };
+        config.filter_count = 1;
+    }
+    zx_handle_t capture_vmo;
+    if ((r = ioctl_ethernet_capture_start(fd, &config, &capture_vmo)) >= 0) {
+        handle_capture(capture_vmo, &options);
+        ioctl_ethernet_capture_stop(fd);
+        zx_handle_close(capture_vmo);
+        if (options.dumpfile != -1) {
+            close(options.dumpfile);
+        }
+        return 0;
+    }
+    if (options.verbose_level) {
+        fprintf(stderr, "netdump: capture ring unavailable (%zd), using fifos\n", r);
+    }
+
     eth_fifos_t fifos;
     zx_status_t status;
 
-    ssize_t r;
     if ((r = ioctl_ethernet_get_fifos(fd, &fifos)) < 0) {
         fprintf(stderr, "netdump: failed to get fifos: %zd\n", r);
         return r;
@@ -444,17 +569,6 @@ int main(int argc, const char** argv) {
         return -1;
     }
 
-    if ((r = ioctl_ethernet_set_client_name(fd, "netdump", 7)) < 0) {
-        fprintf(stderr, "netdump: failed to set client name %zd\n", r);
-    }
-
-    if (options.promisc) {
-        bool yes = true;
-        if ((r = ioctl_ethernet_set_promisc(fd, &yes)) < 0) {
-            fprintf(stderr, "netdump: failed to set promisc mode: %zd\n", r);
-        }
-    }
-
     // assign data chunks to ethbufs
     for (unsigned n = 0; n < count; n++) {
         eth_fifo_entry_t entry = {
@@ -0,0 +1,125 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fdio/io.h>
+#include <lib/counter-vmo-abi.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DESC_PATH "/boot/kernel/" COUNTERS_VMO_DESC_NAME
+#define ARENA_PATH "/boot/kernel/" COUNTERS_VMO_ARENA_NAME
+
+// Maps the whole VMO behind |path| read-only.
+static zx_status_t map_file(const char* path, const void** data, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "kcounter: cannot open %s\n", path);
+        return ZX_ERR_NOT_FOUND;
+    }
+    zx_handle_t vmo;
+    zx_status_t status = fdio_get_exact_vmo(fd, &vmo);
+    close(fd);
+    if (status != ZX_OK) {
+        fprintf(stderr, "kcounter: cannot get VMO of %s: %s\n",
+                path, zx_status_get_string(status));
+        return status;
+    }
+
+    uint64_t vmo_size;
+    status = zx_vmo_get_size(vmo, &vmo_size);
+    uintptr_t addr = 0;
+    if (status == ZX_OK && vmo_size > 0) {
+        status = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, vmo_size,
+                             ZX_VM_FLAG_PERM_READ, &addr);
+    }
+    zx_handle_close(vmo);
+    if (status != ZX_OK) {
+        fprintf(stderr, "kcounter: cannot map %s: %s\n",
+                path, zx_status_get_string(status));
+        return status;
+    }
+
+    *data = (const void*)addr;
+    *size = vmo_size;
+    return ZX_OK;
+}
+
+static bool matches(const char* name, int prefixc, char** prefixv) {
+    if (prefixc == 0)
+        return true;
+    for (int i = 0; i < prefixc; i++) {
+        if (strncmp(name, prefixv[i], strlen(prefixv[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void usage(const char* myname) {
+    fprintf(stderr,
+            "usage: %s [-v] [prefix...]\n"
+            "Prints the kernel counters whose names start with any of the\n"
+            "prefixes, or all of them if none are given.\n"
+            "  -v   also print the nonzero per-cpu values\n",
+            myname);
+}
+
+int main(int argc, char** argv) {
+    bool verbose = false;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (!strcmp(argv[argi], "-v")) {
+            verbose = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const void* desc_data;
+    size_t desc_size;
+    const void* arena_data;
+    size_t arena_size;
+    if (map_file(DESC_PATH, &desc_data, &desc_size) != ZX_OK ||
+        map_file(ARENA_PATH, &arena_data, &arena_size) != ZX_OK)
+        return 1;
+
+    const struct counter_descriptor_vmo* desc = desc_data;
+    if (desc_size < sizeof(*desc) || desc->magic != COUNTER_DESC_VMO_MAGIC ||
+        desc_size < sizeof(*desc) + desc->num_counters * sizeof(desc->descriptor_table[0]) ||
+        arena_size < desc->max_cpus * desc->num_counters * sizeof(uint64_t)) {
+        fprintf(stderr, "kcounter: %s does not match the counter arena\n", DESC_PATH);
+        return 1;
+    }
+
+    const volatile uint64_t* arena = arena_data;
+    for (uint64_t i = 0; i < desc->num_counters; i++) {
+        const char* name = desc->descriptor_table[i].name;
+        if (!matches(name, argc - argi, argv + argi))
+            continue;
+
+        uint64_t sum = 0;
+        for (uint64_t cpu = 0; cpu < desc->max_cpus; cpu++)
+            sum += arena[cpu * desc->num_counters + i];
+        printf("%s = %" PRIu64 "\n", name, sum);
+
+        if (verbose && sum != 0) {
+            printf("    ");
+            for (uint64_t cpu = 0; cpu < desc->max_cpus; cpu++) {
+                uint64_t value = arena[cpu * desc->num_counters + i];
+                if (value != 0)
+                    printf("[%" PRIu64 ":%" PRIu64 "]", cpu, value);
+            }
+            printf("\n");
+        }
+    }
+
+    return 0;
+}
@@ -227,3 +227,23 @@ MODULE_STATIC_LIBS := \
     system/ulib/zxcpp
 
 include make/module.mk
+
+
+MODULE := $(LOCAL_DIR).kcounter
+
+MODULE_TYPE := userapp
+MODULE_GROUP := core
+
+MODULE_SRCS += $(LOCAL_DIR)/kcounter.c
+
+MODULE_NAME := kcounter
+
+# For <lib/counter-vmo-abi.h>.
+MODULE_HEADER_DEPS := kernel/lib/counters
+
+MODULE_LIBS := \
+    system/ulib/fdio \
+    system/ulib/zircon \
+    system/ulib/c
+
+include make/module.mk
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <zircon/device/sysinfo.h>
 #include <zircon/listnode.h>
 #include <zircon/status.h>
 #include <zircon/syscalls.h>
@@ -45,6 +46,7 @@ static zx_time_t delay = ZX_SEC(1);
 static int count = -1;
 static bool print_all = false;
 static bool raw_time = false;
+static bool fast = false;
 static enum sort_order sort_order = SORT_TIME_DELTA;
 
 // active locals
@@ -52,6 +54,11 @@ static struct list_node thread_list = LIST_INITIAL_VALUE(thread_list);
 static char last_process_name[ZX_MAX_NAME_LEN];
 static zx_koid_t last_process_scanned;
 
+// for fast mode, the root job and a buffer for its threads' stats
+static zx_handle_t root_job = ZX_HANDLE_INVALID;
+static zx_info_job_thread_t* job_threads;
+static size_t job_threads_capacity;
+
 // Return text representation of thread state.
 static const char* state_string(const zx_info_thread_t* info) {
     if (info->wait_exception_port_type != ZX_EXCEPTION_PORT_TYPE_NONE) {
@@ -86,6 +93,31 @@ static zx_status_t process_callback(void* unused_ctx, int depth,
     return status;
 }
 
+// Adds a thread's information to the thread_list, or updates the entry
+// left by the last pass
+static void update_thread(const thread_info_t* e) {
+    // see if this thread is in the list
+    thread_info_t* temp;
+    list_for_every_entry (&thread_list, temp, thread_info_t, node) {
+        if (e->koid == temp->koid) {
+            // mark it scanned, compute the delta time,
+            // and copy the new state over
+            temp->scanned = true;
+            temp->delta_time =
+                e->stats.total_runtime - temp->stats.total_runtime;
+            temp->info = e->info;
+            temp->stats = e->stats;
+            return;
+        }
+    }
+
+    // it wasn't in the list, add it
+    thread_info_t* new_entry = malloc(sizeof(thread_info_t));
+    *new_entry = *e;
+
+    list_add_tail(&thread_list, &new_entry->node);
+}
+
 // Adds a thread's information to the thread_list
 static zx_status_t thread_callback(void* unused_ctx, int depth,
                                    zx_handle_t thread,
@@ -114,27 +146,58 @@ static zx_status_t thread_callback(void* unused_ctx, int depth,
         return status;
     }
 
-    // see if this thread is in the list
-    thread_info_t* temp;
-    list_for_every_entry (&thread_list, temp, thread_info_t, node) {
-        if (e.koid == temp->koid) {
-            // mark it scanned, compute the delta time,
-            // and copy the new state over
-            temp->scanned = true;
-            temp->delta_time =
-                e.stats.total_runtime - temp->stats.total_runtime;
-            temp->info = e.info;
-            temp->stats = e.stats;
-            return ZX_OK;
-        }
-    }
+    update_thread(&e);
+    return ZX_OK;
+}
 
-    // it wasn't in the list, add it
-    thread_info_t* new_entry = malloc(sizeof(thread_info_t));
-    *new_entry = e;
+static zx_status_t get_root_job(zx_handle_t* out) {
+    int fd = open("/dev/misc/sysinfo", O_RDWR);
+    if (fd < 0) {
+        return ZX_ERR_NOT_FOUND;
+    }
+    ssize_t n = ioctl_sysinfo_get_root_job(fd, out);
+    close(fd);
+    return n == sizeof(*out) ? ZX_OK : ZX_ERR_NOT_FOUND;
+}
 
-    list_add_tail(&thread_list, &new_entry->node);
+// Scans every thread in the system with one call, rather than one walk of
+// the job tree and three calls per thread.
+static zx_status_t scan_job_threads(void) {
+    size_t actual, avail;
+    for (;;) {
+        zx_status_t status = zx_object_get_info(
+            root_job, ZX_INFO_JOB_THREAD_STATS, job_threads,
+            job_threads_capacity * sizeof(*job_threads), &actual, &avail);
+        if (status != ZX_OK) {
+            return status;
+        }
+        if (actual == avail) {
+            break;
+        }
+        // leave some room for threads created before the next pass
+        size_t capacity = avail + avail / 8 + 16;
+        zx_info_job_thread_t* p =
+            realloc(job_threads, capacity * sizeof(*job_threads));
+        if (p == NULL) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        job_threads = p;
+        job_threads_capacity = capacity;
+    }
 
+    for (size_t i = 0; i < actual; ++i) {
+        const zx_info_job_thread_t* t = &job_threads[i];
+        thread_info_t e = {};
+        e.koid = t->koid;
+        e.scanned = true;
+        e.proc_koid = t->process_koid;
+        e.info.state = t->state;
+        e.info.wait_exception_port_type = t->wait_exception_port_type;
+        e.stats.total_runtime = t->total_runtime;
+        strlcpy(e.name, t->name, sizeof(e.name));
+        strlcpy(e.proc_name, t->process_name, sizeof(e.proc_name));
+        update_thread(&e);
+    }
     return ZX_OK;
 }
 
@@ -204,7 +267,8 @@ static void print_help(FILE* f) {
     fprintf(f, "Options:\n");
     fprintf(f, " -a              Print all threads, even if inactive\n");
     fprintf(f, " -c <count>      Print the first count threads (default infinity)\n");
-    fprintf(f, " -d <delay>      Delay in seconds (default 1 second)\n");
+    fprintf(f, " -d <delay>      Delay in seconds, may be fractional (default 1 second)\n");
+    fprintf(f, " -f              Sample all threads with one call per pass, for short delays\n");
     fprintf(f, " -n <times>      Run this many times and then exit\n");
     fprintf(f, " -o <sort field> Sort by different fields (default is time)\n");
     fprintf(f, " -r              Print raw time in nanoseconds\n");
@@ -226,14 +290,16 @@ int main(int argc, char** argv) {
         } else if (!strcmp(arg, "-d")) {
             delay = 0;
             if (i + 1 < argc) {
-                delay = ZX_SEC(atoi(argv[i + 1]));
+                delay = (zx_time_t)(atof(argv[i + 1]) * ZX_SEC(1));
             }
-            if (delay == 0) {
+            if (delay <= 0) {
                 fprintf(stderr, "Bad -d value '%s'\n", argv[i + 1]);
                 print_help(stderr);
                 return 1;
             }
             i++;
+        } else if (!strcmp(arg, "-f")) {
+            fast = true;
         } else if (!strcmp(arg, "-n")) {
             num_loops = 0;
             if (i + 1 < argc) {
@@ -280,6 +346,15 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (fast) {
+        zx_status_t status = get_root_job(&root_job);
+        if (status != ZX_OK) {
+            fprintf(stderr, "cannot obtain root job: %s (%d)\n",
+                    zx_status_get_string(status), status);
+            return 1;
+        }
+    }
+
     // set stdin to non blocking
     fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK);
 
@@ -295,12 +370,21 @@ int main(int argc, char** argv) {
         }
 
         // iterate the entire job tree
-        zx_status_t status =
-            walk_root_job_tree(NULL, process_callback, thread_callback, NULL);
-        if (status != ZX_OK) {
-            fprintf(stderr, "WARNING: walk_root_job_tree failed: %s (%d)\n",
-                    zx_status_get_string(status), status);
-            ret = 1;
+        zx_status_t status;
+        if (fast) {
+            status = scan_job_threads();
+            if (status != ZX_OK) {
+                fprintf(stderr, "WARNING: scan_job_threads failed: %s (%d)\n",
+                        zx_status_get_string(status), status);
+                ret = 1;
+            }
+        } else {
+            status = walk_root_job_tree(NULL, process_callback, thread_callback, NULL);
+            if (status != ZX_OK) {
+                fprintf(stderr, "WARNING: walk_root_job_tree failed: %s (%d)\n",
+                        zx_status_get_string(status), status);
+                ret = 1;
+            }
         }
 
         // remove every entry that hasn't been scanned this pass
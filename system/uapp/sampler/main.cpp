@@ -0,0 +1,408 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// A sampling cpu profiler for the processes of a job.
+//
+// At a fixed rate every thread of the target that is running is suspended,
+// its stack unwound and the thread resumed.  Blocked threads aren't
+// sampled, so the profile shows where cpu time goes.  The threads of each
+// process, the process's DSO list and the unwind state of each thread are
+// kept from one sample to the next, so a sample costs little more than the
+// suspend and the reads of the stack.  Every process that was sampled gets
+// its own profile, in the legacy cpu profile format that pprof reads, for
+// example "pprof -svg <binary> <profile>".
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <inspector/inspector.h>
+#include <task-utils/get.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
+#include <zircon/types.h>
+
+namespace {
+
+constexpr uint32_t kDefaultRate = 100;
+constexpr uint32_t kDefaultSeconds = 10;
+constexpr size_t kMaxFrames = 64;
+// New processes and threads are looked for this often.
+constexpr zx_duration_t kRescanInterval = ZX_MSEC(100);
+// A thread that takes longer than this to stop is skipped this time around.
+constexpr zx_duration_t kSuspendTimeout = ZX_MSEC(1);
+constexpr size_t kMaxKoids = 1024;
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+struct Thread {
+    ~Thread() {
+        inspector_unwinder_destroy(unwinder);
+        zx_handle_close(handle);
+    }
+
+    zx_koid_t koid;
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    inspector_unwinder_t* unwinder = nullptr;
+    bool seen;
+};
+
+struct Process {
+    ~Process() {
+        threads.reset();
+        inspector_dso_free_list(dso_list);
+        zx_handle_close(handle);
+    }
+
+    zx_koid_t koid;
+    char name[ZX_MAX_NAME_LEN];
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    inspector_dsoinfo_t* dso_list = nullptr;
+    zx_time_t dso_list_time = 0;
+    fbl::Vector<fbl::unique_ptr<Thread>> threads;
+    bool seen;
+
+    // Samples in the legacy profile's format: a count of one, the number of
+    // frames and then the frames.
+    fbl::Vector<uintptr_t> samples;
+    size_t sample_count = 0;
+};
+
+class Sampler {
+public:
+    Sampler(zx_handle_t target, zx_obj_type_t type, zx_koid_t self_koid, bool use_libunwind)
+        : target_(target), type_(type), self_koid_(self_koid), use_libunwind_(use_libunwind) {}
+
+    // Collects samples until |deadline|, |period| apart.
+    void Run(zx_time_t deadline, zx_duration_t period);
+
+    // Writes a profile for each process to "<prefix>.<koid>".
+    void Write(const char* prefix, zx_duration_t period);
+
+private:
+    void Rescan();
+    void ScanJob(zx_handle_t job);
+    void ScanProcess(zx_handle_t parent, zx_koid_t koid);
+    void ScanThreads(Process* process);
+    void Sample(Process* process, Thread* thread);
+
+    const zx_handle_t target_;
+    const zx_obj_type_t type_;
+    const zx_koid_t self_koid_;
+    const bool use_libunwind_;
+    fbl::Vector<fbl::unique_ptr<Process>> processes_;
+
+    size_t samples_ = 0;
+    size_t skipped_ = 0;
+    zx_duration_t sampling_time_ = 0;
+};
+
+// Drops the entries of |list| that weren't seen by the last scan, and clears
+// the mark of the rest.
+template <typename T>
+void sweep(fbl::Vector<fbl::unique_ptr<T>>* list) {
+    for (size_t i = list->size(); i-- > 0;) {
+        if (!(*list)[i]->seen) {
+            list->erase(i);
+        } else {
+            (*list)[i]->seen = false;
+        }
+    }
+}
+
+size_t get_koids(zx_handle_t task, uint32_t topic, zx_koid_t* koids) {
+    size_t actual = 0;
+    if (zx_object_get_info(task, topic, koids, kMaxKoids * sizeof(zx_koid_t),
+                           &actual, nullptr) != ZX_OK)
+        return 0;
+    return actual;
+}
+
+void Sampler::Rescan() {
+    if (type_ == ZX_OBJ_TYPE_JOB) {
+        ScanJob(target_);
+    } else {
+        ScanProcess(ZX_HANDLE_INVALID, 0);
+    }
+    sweep(&processes_);
+}
+
+void Sampler::ScanJob(zx_handle_t job) {
+    fbl::unique_ptr<zx_koid_t[]> koids(new zx_koid_t[kMaxKoids]);
+    size_t count = get_koids(job, ZX_INFO_JOB_PROCESSES, koids.get());
+    for (size_t i = 0; i < count; i++) {
+        // Suspending our own threads would never end.
+        if (koids[i] != self_koid_)
+            ScanProcess(job, koids[i]);
+    }
+
+    count = get_koids(job, ZX_INFO_JOB_CHILDREN, koids.get());
+    for (size_t i = 0; i < count; i++) {
+        zx_handle_t child;
+        if (zx_object_get_child(job, koids[i], ZX_RIGHT_SAME_RIGHTS, &child) == ZX_OK) {
+            ScanJob(child);
+            zx_handle_close(child);
+        }
+    }
+}
+
+// A |parent| of ZX_HANDLE_INVALID means the target itself.
+void Sampler::ScanProcess(zx_handle_t parent, zx_koid_t koid) {
+    for (auto& process : processes_) {
+        if (parent == ZX_HANDLE_INVALID || process->koid == koid) {
+            process->seen = true;
+            ScanThreads(process.get());
+            return;
+        }
+    }
+
+    fbl::unique_ptr<Process> process(new Process);
+    if (parent == ZX_HANDLE_INVALID) {
+        if (zx_handle_duplicate(target_, ZX_RIGHT_SAME_RIGHTS, &process->handle) != ZX_OK)
+            return;
+        zx_info_handle_basic_t info;
+        if (zx_object_get_info(target_, ZX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                               nullptr, nullptr) != ZX_OK) {
+            zx_handle_close(process->handle);
+            return;
+        }
+        koid = info.koid;
+    } else if (zx_object_get_child(parent, koid, ZX_RIGHT_SAME_RIGHTS,
+                                   &process->handle) != ZX_OK) {
+        return;
+    }
+    process->koid = koid;
+    if (zx_object_get_property(process->handle, ZX_PROP_NAME, process->name,
+                               sizeof(process->name)) != ZX_OK)
+        strcpy(process->name, "unknown");
+    process->seen = true;
+    ScanThreads(process.get());
+    processes_.push_back(fbl::move(process));
+}
+
+void Sampler::ScanThreads(Process* process) {
+    fbl::unique_ptr<zx_koid_t[]> koids(new zx_koid_t[kMaxKoids]);
+    size_t count = get_koids(process->handle, ZX_INFO_PROCESS_THREADS, koids.get());
+    for (size_t i = 0; i < count; i++) {
+        bool found = false;
+        for (auto& thread : process->threads) {
+            if (thread->koid == koids[i]) {
+                thread->seen = found = true;
+                break;
+            }
+        }
+        if (found)
+            continue;
+
+        fbl::unique_ptr<Thread> thread(new Thread);
+        if (zx_object_get_child(process->handle, koids[i], ZX_RIGHT_SAME_RIGHTS,
+                                &thread->handle) != ZX_OK)
+            continue;
+        thread->koid = koids[i];
+        thread->seen = true;
+        process->threads.push_back(fbl::move(thread));
+    }
+    sweep(&process->threads);
+}
+
+void Sampler::Sample(Process* process, Thread* thread) {
+    zx_info_thread_t info;
+    if (zx_object_get_info(thread->handle, ZX_INFO_THREAD, &info, sizeof(info),
+                           nullptr, nullptr) != ZX_OK ||
+        info.state != ZX_THREAD_STATE_RUNNING)
+        return;
+
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    if (zx_task_suspend(thread->handle) != ZX_OK)
+        return;
+    if (zx_object_wait_one(thread->handle, ZX_THREAD_SUSPENDED | ZX_THREAD_TERMINATED,
+                           zx_deadline_after(kSuspendTimeout), nullptr) != ZX_OK) {
+        zx_task_resume(thread->handle, 0);
+        skipped_++;
+        return;
+    }
+
+    inspector_general_regs_t regs;
+    uintptr_t pcs[kMaxFrames];
+    size_t frames = 0;
+    if (inspector_read_general_regs(thread->handle, &regs) == ZX_OK) {
+#if defined(__x86_64__)
+        uintptr_t pc = regs.rip, sp = regs.rsp, fp = regs.rbp;
+#elif defined(__aarch64__)
+        uintptr_t pc = regs.pc, sp = regs.sp, fp = regs.r[29];
+#endif
+        // The list is fetched when it's first needed, and again only if a
+        // pc turns up outside of it, e.g. because the process was still
+        // being loaded the first time.  DSOs loaded later above the lowest
+        // one aren't noticed.
+        if (process->dso_list_time == 0 ||
+            (inspector_dso_lookup(process->dso_list, pc) == nullptr &&
+             start - process->dso_list_time >= kRescanInterval)) {
+            for (auto& t : process->threads) {
+                inspector_unwinder_destroy(t->unwinder);
+                t->unwinder = nullptr;
+            }
+            inspector_dso_free_list(process->dso_list);
+            process->dso_list = inspector_dso_fetch_list(process->handle);
+            process->dso_list_time = start;
+        }
+        if (thread->unwinder == nullptr) {
+            thread->unwinder = inspector_unwinder_create(process->handle, thread->handle,
+                                                         process->dso_list, use_libunwind_);
+        }
+        if (thread->unwinder != nullptr)
+            frames = inspector_unwind(thread->unwinder, pc, sp, fp, pcs, kMaxFrames);
+    }
+    zx_task_resume(thread->handle, 0);
+    sampling_time_ += zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    if (frames == 0) {
+        skipped_++;
+        return;
+    }
+    process->samples.push_back(1);
+    process->samples.push_back(frames);
+    for (size_t i = 0; i < frames; i++)
+        process->samples.push_back(pcs[i]);
+    process->sample_count++;
+    samples_++;
+}
+
+void Sampler::Run(zx_time_t deadline, zx_duration_t period) {
+    zx_time_t next_rescan = 0;
+    for (zx_time_t next = zx_clock_get(ZX_CLOCK_MONOTONIC); next < deadline; next += period) {
+        zx_nanosleep(next);
+        if (next >= next_rescan) {
+            Rescan();
+            next_rescan = next + kRescanInterval;
+        }
+        for (auto& process : processes_) {
+            for (size_t i = 0; i < process->threads.size(); i++)
+                Sample(process.get(), process->threads[i].get());
+        }
+    }
+}
+
+void Sampler::Write(const char* prefix, zx_duration_t period) {
+    for (auto& process : processes_) {
+        if (process->sample_count == 0)
+            continue;
+
+        char path[256];
+        snprintf(path, sizeof(path), "%s.%" PRIu64, prefix, process->koid);
+        FILE* f = fopen(path, "w");
+        if (f == nullptr) {
+            fprintf(stderr, "could not create %s: %s\n", path, strerror(errno));
+            continue;
+        }
+        const uintptr_t header[] = {0, 3, 0, static_cast<uintptr_t>(period / ZX_USEC(1)), 0};
+        const uintptr_t trailer[] = {0, 1, 0};
+        fwrite(header, sizeof(header), 1, f);
+        fwrite(process->samples.get(), sizeof(uintptr_t), process->samples.size(), f);
+        fwrite(trailer, sizeof(trailer), 1, f);
+        inspector_dso_print_maps(f, process->dso_list);
+        fclose(f);
+        printf("%s[%" PRIu64 "]: %zu samples in %s\n",
+               process->name, process->koid, process->sample_count, path);
+    }
+    printf("%zu samples, %zu skipped, %" PRIu64 " us per sample\n",
+           samples_, skipped_,
+           samples_ ? sampling_time_ / ZX_USEC(1) / samples_ : 0);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...] <koid>\n"
+        "\n"
+        "Samples the threads of the process or job with the given koid.\n"
+        "\n"
+        "Options:\n"
+        "  -h       show help (this)\n"
+        "  -r HZ    samples per second (default: %u)\n"
+        "  -d SECS  how long to sample for (default: %u)\n"
+        "  -o PATH  write profiles to PATH.<process koid> (default: /tmp/profile)\n"
+        "  -f       follow frame pointers instead of using libunwind\n";
+
+    uint32_t rate = kDefaultRate;
+    uint32_t seconds = kDefaultSeconds;
+    const char* prefix = "/tmp/profile";
+    bool use_libunwind = true;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hr:d:o:f")) != -1) {
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0], kDefaultRate, kDefaultSeconds);
+                return EXIT_SUCCESS;
+            case 'r':
+            case 'd': {
+                errno = 0;
+                char* endptr = nullptr;
+                unsigned long v = strtoul(optarg, &endptr, 10);
+                if (errno != 0 || *endptr != '\0' || v == 0 || v > UINT32_MAX)
+                    argument_error(argv[0], opt == 'r' ? "invalid rate" : "invalid duration");
+                (opt == 'r' ? rate : seconds) = static_cast<uint32_t>(v);
+                break;
+            }
+            case 'o':
+                prefix = optarg;
+                break;
+            case 'f':
+                use_libunwind = false;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind != argc - 1)
+        argument_error(argv[0], "expected a koid");
+
+    char* endptr = nullptr;
+    zx_koid_t koid = strtoull(argv[optind], &endptr, 0);
+    if (*endptr != '\0')
+        argument_error(argv[0], "invalid koid");
+
+    zx_obj_type_t type;
+    zx_handle_t target;
+    zx_status_t status = get_task_by_koid(koid, &type, &target);
+    if (status != ZX_OK) {
+        fprintf(stderr, "could not find task %" PRIu64 ": %d\n", koid, status);
+        return EXIT_FAILURE;
+    }
+    if (type != ZX_OBJ_TYPE_JOB && type != ZX_OBJ_TYPE_PROCESS) {
+        fprintf(stderr, "task %" PRIu64 " is not a job or a process\n", koid);
+        return EXIT_FAILURE;
+    }
+
+    zx_info_handle_basic_t self;
+    status = zx_object_get_info(zx_process_self(), ZX_INFO_HANDLE_BASIC, &self, sizeof(self),
+                                nullptr, nullptr);
+    if (status != ZX_OK) {
+        fprintf(stderr, "could not get our own koid: %d\n", status);
+        return EXIT_FAILURE;
+    }
+    if (self.koid == koid) {
+        fprintf(stderr, "can't sample ourselves\n");
+        return EXIT_FAILURE;
+    }
+
+    const zx_duration_t period = ZX_SEC(1) / rate;
+    Sampler sampler(target, type, self.koid, use_libunwind);
+    sampler.Run(zx_deadline_after(ZX_SEC(seconds)), period);
+    sampler.Write(prefix, period);
+    zx_handle_close(target);
+    return EXIT_SUCCESS;
+}
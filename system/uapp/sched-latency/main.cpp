@@ -0,0 +1,420 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how late threads run after they become runnable, in the style of
+// cyclictest.
+//
+// In timer mode every thread sleeps until an absolute deadline, once per
+// interval, and records how long after the deadline it got to run.  In ping
+// mode threads are paired up; one signals an event at each interval and the
+// other records how long after the signal it woke up.  That path goes
+// through a reschedule IPI whenever the two threads sit on different cpus.
+//
+// Background load threads keep the cpus busy so that the measured threads
+// have to preempt someone to run, which is what a loaded system sees.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <zircon/device/ktrace.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
+#include <fbl/unique_ptr.h>
+
+namespace {
+
+constexpr uint32_t kDefaultIntervalUsec = 1000;
+constexpr uint32_t kDefaultLoops = 10000;
+constexpr uint32_t kDefaultLoadPercent = 100;
+constexpr zx_time_t kLoadPeriod = ZX_MSEC(10);
+
+void argument_error(const char* argv0, const char* message) {
+    fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
+    exit(EXIT_FAILURE);
+}
+
+// Latencies in 1 usec buckets.  Anything past the last bucket is only
+// counted, but still shows up in |max|.
+class Histogram {
+public:
+    static constexpr size_t kBuckets = 10000;
+
+    void Add(zx_time_t latency) {
+        if (latency < 0)
+            latency = 0;
+        uint64_t usec = latency / 1000;
+        if (usec < kBuckets) {
+            buckets_[usec]++;
+        } else {
+            overflow_++;
+        }
+        count_++;
+        sum_ += latency;
+        min_ = fbl::min(min_, latency);
+        max_ = fbl::max(max_, latency);
+    }
+
+    void Merge(const Histogram& other) {
+        for (size_t i = 0; i < kBuckets; i++)
+            buckets_[i] += other.buckets_[i];
+        overflow_ += other.overflow_;
+        count_ += other.count_;
+        sum_ += other.sum_;
+        min_ = fbl::min(min_, other.min_);
+        max_ = fbl::max(max_, other.max_);
+    }
+
+    // Returns the bucket, in usec, below which |percent| of the samples lie.
+    // Samples in the overflow count as |max|.
+    uint64_t Percentile(uint32_t percent) const {
+        uint64_t target = (count_ * percent + 99) / 100;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            seen += buckets_[i];
+            if (seen >= target)
+                return i;
+        }
+        return max_ / 1000;
+    }
+
+    void Print(const char* label) const {
+        if (count_ == 0) {
+            printf("%-10s no samples\n", label);
+            return;
+        }
+        printf("%-10s %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+               " %8" PRIu64 " %8" PRIu64 "\n",
+               label, count_, min_ / 1000, sum_ / count_ / 1000,
+               Percentile(50), Percentile(99), max_ / 1000, overflow_);
+    }
+
+    static void PrintHeader() {
+        printf("%-10s %8s %8s %8s %8s %8s %8s %8s\n", "(usec)",
+               "samples", "min", "avg", "p50", "p99", "max", "over");
+    }
+
+private:
+    uint32_t buckets_[kBuckets] = {};
+    uint64_t overflow_ = 0;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    zx_time_t min_ = INT64_MAX;
+    zx_time_t max_ = 0;
+};
+
+// Optionally puts every sample into the kernel trace, so that late wakeups
+// can be lined up against what the scheduler was doing at the time.
+struct Tracer {
+    zx_handle_t handle = ZX_HANDLE_INVALID;
+    uint32_t probe = 0;
+
+    bool Open(const char* name) {
+        int fd = open("/dev/misc/ktrace", O_RDWR);
+        if (fd < 0) {
+            fprintf(stderr, "cannot open trace device\n");
+            return false;
+        }
+        bool ok = ioctl_ktrace_get_handle(fd, &handle) >= 0 &&
+                  ioctl_ktrace_add_probe(fd, name, &probe) >= 0;
+        close(fd);
+        if (!ok)
+            fprintf(stderr, "cannot register ktrace probe\n");
+        return ok;
+    }
+
+    // arg0 is the thread index and arg1 the latency in nsec.
+    void Record(uint32_t index, zx_time_t latency) const {
+        if (handle == ZX_HANDLE_INVALID)
+            return;
+        uint32_t ns = static_cast<uint32_t>(fbl::clamp<zx_time_t>(latency, 0, UINT32_MAX));
+        zx_ktrace_write(handle, probe, index, ns);
+    }
+};
+
+struct Config {
+    bool ping = false;
+    uint32_t threads = 0;
+    zx_time_t interval = ZX_USEC(kDefaultIntervalUsec);
+    uint32_t loops = kDefaultLoops;
+    uint32_t load_threads = 0;
+    uint32_t load_percent = kDefaultLoadPercent;
+    Tracer tracer;
+};
+
+fbl::atomic<bool> quit_load(false);
+
+// Spins for |load_percent| of every 10 msec period.
+int load_thread(void* arg) {
+    const Config* config = static_cast<const Config*>(arg);
+    zx_time_t busy = kLoadPeriod * config->load_percent / 100;
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    while (!quit_load.load()) {
+        while (zx_clock_get(ZX_CLOCK_MONOTONIC) < start + busy) {
+            if (quit_load.load())
+                return 0;
+        }
+        start += kLoadPeriod;
+        if (busy < kLoadPeriod)
+            zx_nanosleep(start);
+    }
+    return 0;
+}
+
+struct Measurer {
+    const Config* config;
+    uint32_t index;
+    Histogram histogram;
+    thrd_t thread;
+
+    // Used in ping mode only, where the even numbered measurer of a pair
+    // does the signaling and the odd numbered one records.
+    Measurer* peer = nullptr;
+    zx_handle_t wake = ZX_HANDLE_INVALID;
+    zx_handle_t ack = ZX_HANDLE_INVALID;
+    fbl::atomic<zx_time_t> signal_time{0};
+};
+
+int timer_thread(void* arg) {
+    Measurer* m = static_cast<Measurer*>(arg);
+    const Config* config = m->config;
+
+    zx_time_t deadline = zx_clock_get(ZX_CLOCK_MONOTONIC) + config->interval;
+    for (uint32_t i = 0; i < config->loops; i++) {
+        zx_nanosleep(deadline);
+        zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        zx_time_t latency = now - deadline;
+        m->histogram.Add(latency);
+        config->tracer.Record(m->index, latency);
+
+        // Skip the periods we slept through rather than firing back to back
+        // to catch up, which would report several small latencies for one
+        // large one.
+        do {
+            deadline += config->interval;
+        } while (deadline <= now);
+    }
+    return 0;
+}
+
+int ping_sender(void* arg) {
+    Measurer* m = static_cast<Measurer*>(arg);
+    Measurer* r = m->peer;
+    const Config* config = m->config;
+
+    zx_time_t deadline = zx_clock_get(ZX_CLOCK_MONOTONIC) + config->interval;
+    for (uint32_t i = 0; i < config->loops; i++) {
+        zx_nanosleep(deadline);
+        r->signal_time.store(zx_clock_get(ZX_CLOCK_MONOTONIC));
+        zx_object_signal(r->wake, 0, ZX_USER_SIGNAL_0);
+
+        zx_object_wait_one(r->ack, ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, nullptr);
+        zx_object_signal(r->ack, ZX_USER_SIGNAL_0, 0);
+
+        zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        do {
+            deadline += config->interval;
+        } while (deadline <= now);
+    }
+    return 0;
+}
+
+int ping_receiver(void* arg) {
+    Measurer* m = static_cast<Measurer*>(arg);
+    const Config* config = m->config;
+
+    for (uint32_t i = 0; i < config->loops; i++) {
+        zx_object_wait_one(m->wake, ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, nullptr);
+        zx_time_t latency = zx_clock_get(ZX_CLOCK_MONOTONIC) - m->signal_time.load();
+        zx_object_signal(m->wake, ZX_USER_SIGNAL_0, 0);
+        m->histogram.Add(latency);
+        config->tracer.Record(m->index, latency);
+
+        zx_object_signal(m->ack, 0, ZX_USER_SIGNAL_0);
+    }
+    return 0;
+}
+
+int run(const Config& config) {
+    uint32_t num_measurers = config.ping ? config.threads * 2 : config.threads;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Measurer[]> measurers(new (&ac) Measurer[num_measurers]);
+    if (!ac.check()) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t i = 0; i < num_measurers; i++) {
+        measurers[i].config = &config;
+        measurers[i].index = i;
+    }
+    if (config.ping) {
+        for (uint32_t i = 0; i < num_measurers; i += 2) {
+            Measurer& r = measurers[i + 1];
+            measurers[i].peer = &r;
+            if (zx_event_create(0u, &r.wake) != ZX_OK ||
+                zx_event_create(0u, &r.ack) != ZX_OK) {
+                fprintf(stderr, "cannot create events\n");
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    fbl::unique_ptr<thrd_t[]> load(new (&ac) thrd_t[config.load_threads]);
+    if (!ac.check()) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    uint32_t load_started = 0;
+    for (; load_started < config.load_threads; load_started++) {
+        if (thrd_create_with_name(&load[load_started], load_thread,
+                                  const_cast<Config*>(&config), "load") != thrd_success)
+            break;
+    }
+
+    printf("%s mode, %u thread%s, %" PRIu64 " usec interval, %u loops, "
+           "%u load thread%s at %u%%\n",
+           config.ping ? "ping" : "timer", config.threads, config.threads == 1 ? "" : "s",
+           config.interval / 1000, config.loops,
+           load_started, load_started == 1 ? "" : "s", config.load_percent);
+
+    uint32_t started = 0;
+    for (; started < num_measurers; started++) {
+        Measurer& m = measurers[started];
+        thrd_start_t entry = !config.ping ? timer_thread :
+                             (m.peer ? ping_sender : ping_receiver);
+        if (thrd_create_with_name(&m.thread, entry, &m, "measure") != thrd_success)
+            break;
+    }
+    // A receiver without its sender would wait forever, and vice versa.
+    bool failed = started < num_measurers;
+    if (failed && config.ping && (started & 1)) {
+        quit_load.store(true);
+        fprintf(stderr, "cannot create threads\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < started; i++)
+        thrd_join(measurers[i].thread, nullptr);
+
+    quit_load.store(true);
+    for (uint32_t i = 0; i < load_started; i++)
+        thrd_join(load[i], nullptr);
+
+    if (failed) {
+        fprintf(stderr, "cannot create threads\n");
+        return EXIT_FAILURE;
+    }
+
+    Histogram::PrintHeader();
+    fbl::unique_ptr<Histogram> total(new (&ac) Histogram());
+    if (!ac.check()) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t i = 0; i < num_measurers; i++) {
+        if (config.ping && measurers[i].peer)
+            continue;
+        char label[16];
+        snprintf(label, sizeof(label), "T%u", i);
+        measurers[i].histogram.Print(label);
+        total->Merge(measurers[i].histogram);
+    }
+    total->Print("all");
+
+    for (uint32_t i = 0; i < num_measurers; i++) {
+        zx_handle_close(measurers[i].wake);
+        zx_handle_close(measurers[i].ack);
+    }
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    static constexpr char help[] =
+        "Usage: %s [options ...]\n"
+        "\n"
+        "Options:\n"
+        "  -h    show help (this)\n"
+        "  -p    measure wakeups by another thread, rather than by a timer\n"
+        "  -c N  run N measuring threads, or N pairs with -p (default: one per cpu)\n"
+        "  -i N  wake up every N usec (default: %u)\n"
+        "  -n N  take N samples per thread (default: %u)\n"
+        "  -l N  run N background load threads (default: 0)\n"
+        "  -u N  keep each load thread busy N%% of the time (default: %u)\n"
+        "  -t    write every sample to ktrace; start tracing with 'dm ktraceon'\n";
+
+    Config config;
+    config.threads = zx_system_get_num_cpus();
+    bool trace = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "hpc:i:n:l:u:t")) != -1) {
+        uint32_t value = 0;
+        if (optarg) {
+            errno = 0;
+            char* endptr = nullptr;
+            unsigned long long v = strtoull(optarg, &endptr, 10);
+            if (errno != 0 || *endptr != '\0' || v > UINT32_MAX)
+                argument_error(argv[0], "invalid numeric optional value");
+            value = static_cast<uint32_t>(v);
+        }
+
+        switch (opt) {
+            case 'h':
+                printf(help, argv[0], kDefaultIntervalUsec, kDefaultLoops,
+                       kDefaultLoadPercent);
+                return EXIT_SUCCESS;
+            case 'p':
+                config.ping = true;
+                break;
+            case 'c':
+                if (value == 0)
+                    argument_error(argv[0], "need at least one thread");
+                config.threads = value;
+                break;
+            case 'i':
+                if (value == 0)
+                    argument_error(argv[0], "interval can't be zero");
+                config.interval = ZX_USEC(value);
+                break;
+            case 'n':
+                config.loops = value;
+                break;
+            case 'l':
+                config.load_threads = value;
+                break;
+            case 'u':
+                if (value == 0 || value > 100)
+                    argument_error(argv[0], "load must be between 1 and 100 percent");
+                config.load_percent = value;
+                break;
+            case 't':
+                trace = true;
+                break;
+            default:  // '?'
+                argument_error(argv[0], "invalid option");
+                break;
+        }
+    }
+    if (optind < argc)
+        argument_error(argv[0], "unexpected positional argument");
+
+    if (trace && !config.tracer.Open(config.ping ? "sched-latency:ping" : "sched-latency:timer"))
+        return EXIT_FAILURE;
+
+    return run(config);
+}
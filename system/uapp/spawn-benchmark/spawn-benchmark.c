@@ -0,0 +1,142 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long it takes to launch a program and wait for it to exit,
+// loading it from its file each time and stamping it from a template.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <launchpad/launchpad.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
+
+#define DEFAULT_ITERATIONS 100
+
+static const char* const default_argv[] = {"/boot/bin/sh", "-c", ":"};
+
+typedef struct {
+    zx_duration_t total;
+    zx_duration_t min;
+    zx_duration_t max;
+} stats_t;
+
+static zx_status_t spawn_one(int argc, const char* const* argv,
+                             const launchpad_template_t* tmpl,
+                             zx_duration_t* elapsed) {
+    const char* path = argv[0];
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    launchpad_t* lp;
+    launchpad_create(ZX_HANDLE_INVALID, path, &lp);
+    launchpad_set_args(lp, argc, argv);
+    if (tmpl != NULL) {
+        launchpad_load_from_template(lp, tmpl);
+    } else {
+        launchpad_load_from_file(lp, path);
+    }
+    zx_handle_t proc;
+    const char* errmsg;
+    zx_status_t status = launchpad_go(lp, &proc, &errmsg);
+    if (status != ZX_OK) {
+        fprintf(stderr, "spawn-benchmark: cannot launch %s: %s: %s\n",
+                path, errmsg, zx_status_get_string(status));
+        return status;
+    }
+    status = zx_object_wait_one(proc, ZX_PROCESS_TERMINATED,
+                                ZX_TIME_INFINITE, NULL);
+    *elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+    zx_handle_close(proc);
+    return status;
+}
+
+static zx_status_t run(int argc, const char* const* argv,
+                       const launchpad_template_t* tmpl,
+                       unsigned iterations, stats_t* stats) {
+    stats->total = 0;
+    stats->min = UINT64_MAX;
+    stats->max = 0;
+    for (unsigned i = 0; i < iterations; ++i) {
+        zx_duration_t elapsed;
+        zx_status_t status = spawn_one(argc, argv, tmpl, &elapsed);
+        if (status != ZX_OK)
+            return status;
+        stats->total += elapsed;
+        if (elapsed < stats->min)
+            stats->min = elapsed;
+        if (elapsed > stats->max)
+            stats->max = elapsed;
+    }
+    return ZX_OK;
+}
+
+static void print_stats(const char* what, const stats_t* stats, unsigned iterations) {
+    printf("%-10s avg %8" PRIu64 " us  min %8" PRIu64 " us  max %8" PRIu64 " us\n",
+           what, stats->total / iterations / 1000,
+           stats->min / 1000, stats->max / 1000);
+}
+
+static void usage(const char* myname) {
+    fprintf(stderr,
+            "usage: %s [-n iterations] [program [args...]]\n"
+            "Launches |program| (default \"sh -c :\") |iterations| times\n"
+            "(default %u) each way and prints the time from launchpad_create\n"
+            "to its exit.\n",
+            myname, DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char** argv) {
+    unsigned iterations = DEFAULT_ITERATIONS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    int child_argc = (int)countof(default_argv);
+    const char* const* child_argv = default_argv;
+    if (optind < argc) {
+        child_argc = argc - optind;
+        child_argv = (const char* const*)&argv[optind];
+    }
+    const char* path = child_argv[0];
+
+    launchpad_template_t* tmpl;
+    zx_status_t status = launchpad_template_create_from_file(path, &tmpl);
+    if (status != ZX_OK) {
+        fprintf(stderr, "spawn-benchmark: cannot make template of %s: %s\n",
+                path, zx_status_get_string(status));
+        return 1;
+    }
+
+    // Warm up the filesystem and the template's library cache first.
+    zx_duration_t elapsed;
+    if (spawn_one(child_argc, child_argv, NULL, &elapsed) != ZX_OK ||
+        spawn_one(child_argc, child_argv, tmpl, &elapsed) != ZX_OK)
+        return 1;
+
+    stats_t file_stats, template_stats;
+    if (run(child_argc, child_argv, NULL, iterations, &file_stats) != ZX_OK ||
+        run(child_argc, child_argv, tmpl, iterations, &template_stats) != ZX_OK)
+        return 1;
+    launchpad_template_destroy(tmpl);
+
+    printf("%s, %u launches each\n", path, iterations);
+    print_stats("file", &file_stats, iterations);
+    print_stats("template", &template_stats, iterations);
+    return 0;
+}
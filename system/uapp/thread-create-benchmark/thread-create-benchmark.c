@@ -0,0 +1,180 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long it takes to create, start and tear down a thread, both
+// with the raw syscalls and through C11 threads.
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <zircon/compiler.h>
+#include <zircon/process.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+
+#define DEFAULT_ITERATIONS 1000
+
+typedef struct {
+    zx_duration_t total;
+    zx_duration_t min;
+    zx_duration_t max;
+} stats_t;
+
+typedef struct {
+    stats_t create;  // zx_thread_create
+    stats_t start;   // zx_thread_start until the thread is running
+    stats_t exit;    // from running until ZX_THREAD_TERMINATED
+    stats_t close;   // closing the last handle
+    stats_t thrd;    // thrd_create through thrd_join
+} results_t;
+
+// Only ever used by one raw thread at a time.
+static uint8_t raw_stack[4096] __ALIGNED(16);
+
+static void stats_init(stats_t* stats) {
+    stats->total = 0;
+    stats->min = UINT64_MAX;
+    stats->max = 0;
+}
+
+static void stats_add(stats_t* stats, zx_duration_t elapsed) {
+    stats->total += elapsed;
+    if (elapsed < stats->min)
+        stats->min = elapsed;
+    if (elapsed > stats->max)
+        stats->max = elapsed;
+}
+
+// Runs without a thread pointer, so it can't touch the unsafe stack.
+__NO_SAFESTACK static void raw_thread_entry(uintptr_t arg1, uintptr_t arg2) {
+    zx_object_signal((zx_handle_t)arg1, 0, ZX_EVENT_SIGNALED);
+    zx_thread_exit();
+}
+
+static zx_status_t raw_one(zx_handle_t event, results_t* results) {
+    zx_time_t t0 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    zx_handle_t thread;
+    zx_status_t status = zx_thread_create(zx_process_self(), "bench", 5, 0, &thread);
+    if (status != ZX_OK) {
+        fprintf(stderr, "thread-create-benchmark: zx_thread_create: %s\n",
+                zx_status_get_string(status));
+        return status;
+    }
+    zx_time_t t1 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    status = zx_thread_start(thread, (uintptr_t)raw_thread_entry,
+                             (uintptr_t)raw_stack + sizeof(raw_stack), event, 0);
+    if (status != ZX_OK) {
+        fprintf(stderr, "thread-create-benchmark: zx_thread_start: %s\n",
+                zx_status_get_string(status));
+        zx_handle_close(thread);
+        return status;
+    }
+    zx_object_wait_one(event, ZX_EVENT_SIGNALED, ZX_TIME_INFINITE, NULL);
+    zx_time_t t2 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    zx_object_wait_one(thread, ZX_THREAD_TERMINATED, ZX_TIME_INFINITE, NULL);
+    zx_time_t t3 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    zx_handle_close(thread);
+    zx_time_t t4 = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    zx_object_signal(event, ZX_EVENT_SIGNALED, 0);
+
+    stats_add(&results->create, t1 - t0);
+    stats_add(&results->start, t2 - t1);
+    stats_add(&results->exit, t3 - t2);
+    stats_add(&results->close, t4 - t3);
+    return ZX_OK;
+}
+
+static int thrd_entry(void* arg) {
+    return 0;
+}
+
+static zx_status_t thrd_one(results_t* results) {
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    thrd_t t;
+    if (thrd_create(&t, thrd_entry, NULL) != thrd_success) {
+        fprintf(stderr, "thread-create-benchmark: thrd_create failed\n");
+        return ZX_ERR_NO_MEMORY;
+    }
+    thrd_join(t, NULL);
+    stats_add(&results->thrd, zx_clock_get(ZX_CLOCK_MONOTONIC) - start);
+    return ZX_OK;
+}
+
+static zx_status_t run(unsigned iterations, results_t* results) {
+    stats_init(&results->create);
+    stats_init(&results->start);
+    stats_init(&results->exit);
+    stats_init(&results->close);
+    stats_init(&results->thrd);
+
+    zx_handle_t event;
+    zx_status_t status = zx_event_create(0, &event);
+    if (status != ZX_OK)
+        return status;
+
+    for (unsigned i = 0; i < iterations && status == ZX_OK; ++i)
+        status = raw_one(event, results);
+    for (unsigned i = 0; i < iterations && status == ZX_OK; ++i)
+        status = thrd_one(results);
+
+    zx_handle_close(event);
+    return status;
+}
+
+static void print_stats(const char* what, const stats_t* stats, unsigned iterations) {
+    printf("%-10s avg %8" PRIu64 " ns  min %8" PRIu64 " ns  max %8" PRIu64 " ns\n",
+           what, stats->total / iterations, stats->min, stats->max);
+}
+
+static void usage(const char* myname) {
+    fprintf(stderr,
+            "usage: %s [-n iterations]\n"
+            "Creates, starts and tears down a thread |iterations| times\n"
+            "(default %u) with the raw syscalls, then as many times with\n"
+            "thrd_create and thrd_join, and prints the time each step took.\n",
+            myname, DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char** argv) {
+    unsigned iterations = DEFAULT_ITERATIONS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iterations = (unsigned)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Warm up, which also fills the kernel's stack caches.
+    results_t results;
+    if (run(1, &results) != ZX_OK)
+        return 1;
+
+    if (run(iterations, &results) != ZX_OK)
+        return 1;
+
+    printf("%u threads each way\n", iterations);
+    print_stats("create", &results.create, iterations);
+    print_stats("start", &results.start, iterations);
+    print_stats("exit", &results.exit, iterations);
+    print_stats("close", &results.close, iterations);
+    print_stats("thrd", &results.thrd, iterations);
+    return 0;
+}
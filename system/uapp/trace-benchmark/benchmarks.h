@@ -10,6 +10,7 @@
 
 static constexpr unsigned kWarmUpIterations = 100;
 static constexpr unsigned kRunIterations = 1000000;
+static constexpr unsigned kMaxWriterThreads = 16;
 
 // Measures how long it takes to run some number of iterations of a closure.
 // Returns a value in microseconds.
@@ -44,5 +45,14 @@ void RunTracingDisabledBenchmarks();
 // Runs benchmarks which need tracing enabled.
 void RunTracingEnabledBenchmarks();
 
+// Runs the hot path suite: each kind of event, with 0 to 8 arguments, for
+// enabled and disabled categories, written by 1, 2, 4 and so on up to
+// |max_threads| threads at once.  Prints the time per event, so that it can
+// be compared from one build to the next.
+void RunHotPathBenchmarks(bool tracing_enabled, unsigned max_threads);
+
 // Runs benchmarks with NTRACE macro defined.
 void RunNoTraceBenchmarks();
+
+// Runs benchmarks which decode the trace which the others wrote.
+void RunReaderBenchmarks(const void* buffer, size_t num_bytes);
@@ -0,0 +1,140 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmarks.h"
+
+#include <stdio.h>
+#include <threads.h>
+
+#include <fbl/atomic.h>
+#include <trace/event.h>
+
+namespace {
+
+struct Writer {
+    void (*function)();
+    fbl::atomic<unsigned>* ready;
+    const fbl::atomic<bool>* go;
+    uint64_t ticks;
+};
+
+int RunWriter(void* arg) {
+    auto writer = static_cast<Writer*>(arg);
+    for (unsigned i = 0; i < kWarmUpIterations; i++) {
+        writer->function();
+    }
+
+    // Wait for the other writers, so that they all run at the same time.
+    writer->ready->fetch_add(1u);
+    while (!writer->go->load()) {
+    }
+
+    uint64_t start = zx_ticks_get();
+    for (unsigned i = 0; i < kRunIterations; i++) {
+        writer->function();
+    }
+    writer->ticks = zx_ticks_get() - start;
+    return 0;
+}
+
+// Runs a function repeatedly on |num_threads| threads at once and prints how
+// long each call took on average, including the cost of an indirect call.
+void RunOnThreads(unsigned num_threads, void (*function)()) {
+    Writer writers[kMaxWriterThreads];
+    thrd_t threads[kMaxWriterThreads];
+    fbl::atomic<unsigned> ready(0u);
+    fbl::atomic<bool> go(false);
+
+    unsigned started = 0u;
+    for (; started < num_threads; started++) {
+        writers[started] = Writer{function, &ready, &go, 0u};
+        if (thrd_create(&threads[started], RunWriter, &writers[started]) != thrd_success)
+            break;
+    }
+    while (ready.load() < started) {
+    }
+    go.store(true);
+
+    uint64_t ticks = 0u;
+    for (unsigned i = 0; i < started; i++) {
+        thrd_join(threads[i], nullptr);
+        ticks += writers[i].ticks;
+    }
+    if (!started) {
+        puts("  - failed to start any threads\n");
+        return;
+    }
+
+    double ns = static_cast<double>(ticks) * 1e9 /
+                static_cast<double>(zx_ticks_per_second()) /
+                (static_cast<double>(kRunIterations) * started);
+    printf("  - %u thread%s: %.1f ns per event\n", started, started == 1u ? "" : "s", ns);
+}
+
+struct Case {
+    const char* name;
+    void (*function)();
+};
+
+// Defines a case for an enabled category and another for a disabled one.
+#define ENABLED_AND_DISABLED(description, macro, args...)                     \
+    {description, [] { macro("+enabled", args); }},                           \
+    {description " for disabled category", [] { macro("-disabled", args); }}
+
+const Case kCases[] = {
+    ENABLED_AND_DISABLED("TRACE_DURATION with 0 arguments", TRACE_DURATION, "name"),
+    ENABLED_AND_DISABLED("TRACE_DURATION with 1 int32 argument", TRACE_DURATION, "name",
+                         "k1", 1),
+    ENABLED_AND_DISABLED("TRACE_DURATION with 4 int32 arguments", TRACE_DURATION, "name",
+                         "k1", 1, "k2", 2, "k3", 3, "k4", 4),
+    ENABLED_AND_DISABLED("TRACE_DURATION with 8 int32 arguments", TRACE_DURATION, "name",
+                         "k1", 1, "k2", 2, "k3", 3, "k4", 4,
+                         "k5", 5, "k6", 6, "k7", 7, "k8", 8),
+
+    ENABLED_AND_DISABLED("TRACE_INSTANT with 0 arguments", TRACE_INSTANT, "name",
+                         TRACE_SCOPE_THREAD),
+    ENABLED_AND_DISABLED("TRACE_INSTANT with 1 int32 argument", TRACE_INSTANT, "name",
+                         TRACE_SCOPE_THREAD, "k1", 1),
+    ENABLED_AND_DISABLED("TRACE_INSTANT with 4 int32 arguments", TRACE_INSTANT, "name",
+                         TRACE_SCOPE_THREAD, "k1", 1, "k2", 2, "k3", 3, "k4", 4),
+    ENABLED_AND_DISABLED("TRACE_INSTANT with 8 int32 arguments", TRACE_INSTANT, "name",
+                         TRACE_SCOPE_THREAD, "k1", 1, "k2", 2, "k3", 3, "k4", 4,
+                         "k5", 5, "k6", 6, "k7", 7, "k8", 8),
+
+    // Counters need at least one argument.
+    ENABLED_AND_DISABLED("TRACE_COUNTER with 1 int32 argument", TRACE_COUNTER, "name", 1u,
+                         "k1", 1),
+    ENABLED_AND_DISABLED("TRACE_COUNTER with 4 int32 arguments", TRACE_COUNTER, "name", 1u,
+                         "k1", 1, "k2", 2, "k3", 3, "k4", 4),
+    ENABLED_AND_DISABLED("TRACE_COUNTER with 8 int32 arguments", TRACE_COUNTER, "name", 1u,
+                         "k1", 1, "k2", 2, "k3", 3, "k4", 4,
+                         "k5", 5, "k6", 6, "k7", 7, "k8", 8),
+
+    ENABLED_AND_DISABLED("TRACE_FLOW_BEGIN with 0 arguments", TRACE_FLOW_BEGIN, "name", 1u),
+    ENABLED_AND_DISABLED("TRACE_FLOW_BEGIN with 4 int32 arguments", TRACE_FLOW_BEGIN, "name",
+                         1u, "k1", 1, "k2", 2, "k3", 3, "k4", 4),
+    ENABLED_AND_DISABLED("TRACE_FLOW_STEP with 0 arguments", TRACE_FLOW_STEP, "name", 1u),
+    ENABLED_AND_DISABLED("TRACE_FLOW_END with 0 arguments", TRACE_FLOW_END, "name", 1u),
+};
+
+#undef ENABLED_AND_DISABLED
+
+} // namespace
+
+void RunHotPathBenchmarks(bool tracing_enabled, unsigned max_threads) {
+    printf("Running hot path benchmarks with tracing %s...\n\n",
+           tracing_enabled ? "enabled" : "disabled");
+
+    // Contention only matters while records are being written.
+    if (!tracing_enabled)
+        max_threads = 1u;
+
+    for (const Case& c : kCases) {
+        printf("* %s...\n", c.name);
+        for (unsigned num_threads = 1u; num_threads <= max_threads; num_threads *= 2u) {
+            RunOnThreads(num_threads, c.function);
+        }
+        puts("");
+    }
+}
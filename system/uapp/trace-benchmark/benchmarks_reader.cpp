@@ -0,0 +1,53 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "benchmarks.h"
+
+#include <stdio.h>
+
+#include <trace-reader/reader.h>
+
+namespace {
+
+static constexpr unsigned kDecodeIterations = 10;
+static constexpr size_t kDecodeThreads = 4u;
+
+// Decodes the trace repeatedly and prints its throughput.
+template <typename T>
+void RunDecode(const char* test_name, size_t num_bytes, const T& closure) {
+    printf("* %s...\n", test_name);
+
+    float run_time = Measure(kDecodeIterations, closure);
+    printf("  - run: %u iterations in %.1f us, %.1f MB/s\n\n",
+           kDecodeIterations, run_time,
+           static_cast<float>(num_bytes) * kDecodeIterations / run_time);
+}
+
+} // namespace
+
+void RunReaderBenchmarks(const void* buffer, size_t num_bytes) {
+    printf("Running reader benchmarks on %zu bytes of trace...\n\n", num_bytes);
+
+    const uint64_t* words = static_cast<const uint64_t*>(buffer);
+    const size_t num_words = num_bytes / sizeof(uint64_t);
+
+    RunDecode("Decode records", num_bytes, [words, num_words] {
+        trace::TraceReader reader([](trace::Record record) {}, nullptr);
+        trace::Chunk chunk(words, num_words);
+        reader.ReadRecords(chunk);
+    });
+
+    RunDecode("Decode event views", num_bytes, [words, num_words] {
+        trace::TraceReader reader([](const trace::EventView& event) {},
+                                  [](trace::Record record) {}, nullptr);
+        trace::Chunk chunk(words, num_words);
+        reader.ReadRecords(chunk);
+    });
+
+    RunDecode("Decode event views in parallel", num_bytes, [buffer, num_bytes] {
+        trace::TraceReader reader([](const trace::EventView& event) {},
+                                  [](trace::Record record) {}, nullptr);
+        reader.ReadBufferInParallel(buffer, num_bytes, kDecodeThreads);
+    });
+}
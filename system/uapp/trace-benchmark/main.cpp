@@ -5,6 +5,8 @@
 #include <zircon/syscalls.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <zircon/assert.h>
 
@@ -18,9 +20,13 @@
 namespace {
 
 // Trace buffer size.
-// Should be sized so it does not overflow during the test.
+// Tracing is done in circular mode, so that the buffer never fills up and
+// every benchmark writes its records in full, however many it writes.
 static constexpr size_t kBufferSizeBytes = 16 * 1024 * 1024;
 
+// The most writer threads for the hot path benchmarks, by default.
+static constexpr unsigned kDefaultMaxThreads = 4;
+
 class BenchmarkHandler : public trace::TraceHandler {
 public:
     BenchmarkHandler(async::Loop* loop)
@@ -28,8 +34,9 @@ public:
     }
 
     void Start() {
-        zx_status_t status = trace_start_engine(loop_->async(), this,
-                                                buffer_.get(), buffer_.size());
+        zx_status_t status = trace_start_engine_etc(loop_->async(), this,
+                                                    buffer_.get(), buffer_.size(),
+                                                    TRACE_BUFFERING_MODE_CIRCULAR);
         ZX_DEBUG_ASSERT(status == ZX_OK);
 
         puts("\nTrace started\n");
@@ -47,6 +54,7 @@ private:
         puts("\nTrace stopped");
 
         ZX_DEBUG_ASSERT(disposition == ZX_OK);
+        RunReaderBenchmarks(buffer_.get(), buffer_bytes_written);
         loop_->Quit();
     }
 
@@ -57,15 +65,31 @@ private:
 } // namespace
 
 int main(int argc, char** argv) {
+    unsigned max_threads = kDefaultMaxThreads;
+    for (int i = 1; i < argc; i++) {
+        if (!strncmp(argv[i], "--threads=", 10)) {
+            max_threads = static_cast<unsigned>(atoi(argv[i] + 10));
+        } else {
+            fprintf(stderr, "usage: trace-benchmark [--threads=N]\n");
+            return 1;
+        }
+    }
+    if (max_threads < 1 || max_threads > kMaxWriterThreads) {
+        fprintf(stderr, "--threads must be from 1 to %u\n", kMaxWriterThreads);
+        return 1;
+    }
+
     async::Loop loop;
     BenchmarkHandler handler(&loop);
 
     RunTracingDisabledBenchmarks();
+    RunHotPathBenchmarks(false, max_threads);
     handler.Start();
 
     async::Task task(0u);
-    task.set_handler([](async_t* async, zx_status_t status) {
+    task.set_handler([max_threads](async_t* async, zx_status_t status) {
         RunTracingEnabledBenchmarks();
+        RunHotPathBenchmarks(true, max_threads);
         RunNoTraceBenchmarks();
 
         trace_stop_engine(ZX_OK);
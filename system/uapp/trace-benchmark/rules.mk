@@ -11,13 +11,16 @@ MODULE_GROUP := misc
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/benchmarks.cpp \
+    $(LOCAL_DIR)/benchmarks_hot_path.cpp \
     $(LOCAL_DIR)/benchmarks_ntrace.cpp \
+    $(LOCAL_DIR)/benchmarks_reader.cpp \
     $(LOCAL_DIR)/main.cpp
 
 MODULE_NAME := trace-benchmark
 
 MODULE_STATIC_LIBS := \
     system/ulib/trace \
+    system/ulib/trace-reader \
     system/ulib/async \
     system/ulib/async.loop \
     system/ulib/zxcpp \
@@ -0,0 +1,69 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Reboots into a new kernel without going back through the firmware, handing
+// it the bootdata the running kernel was booted with.  That bootdata is only
+// kept if the running kernel was booted with
+// kernel.mexec-preserve-bootdata=true.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fdio/io.h>
+#include <zircon/device/dmctl.h>
+#include <zircon/syscalls.h>
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <kernel image>\n", argv[0]);
+        return -1;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "could not open %s\n", argv[1]);
+        return -1;
+    }
+    zx_handle_t kernel;
+    zx_status_t status = fdio_get_vmo(fd, &kernel);
+    close(fd);
+    if (status != ZX_OK) {
+        fprintf(stderr, "could not read %s: %d\n", argv[1], status);
+        return -1;
+    }
+
+    // The coordinator signals the kernel vmo if it gives up on rebooting.
+    zx_handle_t wait_handle;
+    status = zx_handle_duplicate(kernel, ZX_RIGHT_SAME_RIGHTS, &wait_handle);
+    if (status != ZX_OK) {
+        fprintf(stderr, "could not duplicate kernel vmo: %d\n", status);
+        zx_handle_close(kernel);
+        return -1;
+    }
+
+    fd = open("/dev/misc/dmctl", O_WRONLY);
+    if (fd < 0) {
+        fprintf(stderr, "could not open dmctl\n");
+        zx_handle_close(kernel);
+        zx_handle_close(wait_handle);
+        return -1;
+    }
+
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    ssize_t r = ioctl_dmctl_warm_reboot(fd, &kernel);
+    close(fd);
+    if (r < 0) {
+        fprintf(stderr, "warm reboot failed: %zd\n", r);
+        zx_handle_close(wait_handle);
+        return -1;
+    }
+
+    status = zx_object_wait_one(wait_handle, ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, NULL);
+    zx_handle_close(wait_handle);
+    fprintf(stderr, "warm reboot failed after %" PRIu64 "ms: %d\n",
+            (zx_clock_get(ZX_CLOCK_MONOTONIC) - start) / ZX_MSEC(1), status);
+    return -1;
+}
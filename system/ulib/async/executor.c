@@ -0,0 +1,650 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <async/executor.h>
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <zircon/assert.h>
+#include <zircon/listnode.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/port.h>
+
+#include <async/receiver.h>
+#include <async/task.h>
+#include <async/wait.h>
+
+// The port wait key associated with the executor's timer and shutdown.
+#define KEY_CONTROL (0u)
+
+// The port key of the packet which wakes an idle thread to look for work.
+// Wait and receiver keys are pointers, so they can't collide with it.
+#define KEY_WAKE (1u)
+
+// The most tasks a thread runs in a row before it lets waits and packets
+// from the port have a turn.
+#define TASK_BUDGET (16u)
+
+static zx_status_t async_executor_begin_wait(async_t* async, async_wait_t* wait);
+static zx_status_t async_executor_cancel_wait(async_t* async, async_wait_t* wait);
+static zx_status_t async_executor_post_task(async_t* async, async_task_t* task);
+static zx_status_t async_executor_cancel_task(async_t* async, async_task_t* task);
+static zx_status_t async_executor_queue_packet(async_t* async, async_receiver_t* receiver,
+                                               const zx_packet_user_t* data);
+static const async_ops_t async_executor_ops = {
+    .begin_wait = async_executor_begin_wait,
+    .cancel_wait = async_executor_cancel_wait,
+    .post_task = async_executor_post_task,
+    .cancel_task = async_executor_cancel_task,
+    .queue_packet = async_executor_queue_packet,
+};
+
+struct async_executor;
+
+typedef struct worker {
+    struct async_executor* executor; // immutable
+    uint32_t index; // immutable
+    thrd_t thread;
+    bool started;
+
+    mtx_t lock; // guards the queue
+    list_node_t tasks; // due tasks, oldest first
+    atomic_size_t count; // length of |tasks|, may be read without the lock as a hint
+} worker_t;
+
+typedef struct async_executor {
+    async_t async; // must be first
+    zx_handle_t port; // immutable
+    zx_handle_t timer; // immutable
+    uint32_t num_workers; // immutable
+    worker_t* workers; // immutable
+
+    atomic_bool shutting_down;
+    atomic_uint idle_workers; // number of threads blocked, or about to block, on the port
+    atomic_bool wake_pending; // a KEY_WAKE packet is on its way
+
+    // Guards the lists below and the timer.  Taken before any worker's lock,
+    // and those are taken in order of their index.
+    mtx_t lock;
+    list_node_t wait_list; // most recently added first
+    list_node_t global_tasks; // due tasks posted from other threads, oldest first
+    atomic_size_t global_count; // length of |global_tasks|, may be read without the lock
+    list_node_t timer_list; // pending tasks, earliest deadline first
+    zx_time_t timer_deadline; // what the timer is set to, ZX_TIME_INFINITE if unknown
+} async_executor_t;
+
+// The worker running on this thread, if any.
+static thread_local worker_t* g_worker;
+
+static int async_executor_run_worker(void* data);
+static async_task_t* async_executor_find_task(worker_t* worker);
+static void async_executor_notify(async_executor_t* executor);
+static void async_executor_dispatch_port_packet(worker_t* worker,
+                                                const zx_port_packet_t* packet);
+static void async_executor_dispatch_timer(worker_t* worker);
+static void async_executor_dispatch_task(async_executor_t* executor, async_task_t* task);
+static void async_executor_dispatch_wait(async_executor_t* executor, async_wait_t* wait,
+                                         zx_status_t status, const zx_packet_signal_t* signal);
+static void async_executor_insert_task(async_executor_t* executor, async_task_t* task);
+static void async_executor_restart_timer_locked(async_executor_t* executor);
+static zx_status_t async_executor_wait_async(async_executor_t* executor, async_wait_t* wait);
+static void async_executor_notify_task_list(async_executor_t* executor, list_node_t* list);
+
+static_assert(sizeof(list_node_t) <= sizeof(async_state_t),
+              "async_state_t too small");
+
+#define TO_NODE(type, ptr) ((list_node_t*)&ptr->state)
+#define FROM_NODE(type, ptr) ((type*)((char*)(ptr)-offsetof(type, state)))
+
+static inline list_node_t* wait_to_node(async_wait_t* wait) {
+    return TO_NODE(async_wait_t, wait);
+}
+
+static inline async_wait_t* node_to_wait(list_node_t* node) {
+    return FROM_NODE(async_wait_t, node);
+}
+
+static inline list_node_t* task_to_node(async_task_t* task) {
+    return TO_NODE(async_task_t, task);
+}
+
+static inline async_task_t* node_to_task(list_node_t* node) {
+    return FROM_NODE(async_task_t, node);
+}
+
+zx_status_t async_executor_create(const async_executor_config_t* config, async_t** out_async) {
+    ZX_DEBUG_ASSERT(out_async);
+
+    uint32_t num_workers = config ? config->num_threads : 0u;
+    if (num_workers == 0u)
+        num_workers = zx_system_get_num_cpus();
+    const char* name = config ? config->name : NULL;
+
+    async_executor_t* executor = calloc(1u, sizeof(async_executor_t));
+    if (!executor)
+        return ZX_ERR_NO_MEMORY;
+    executor->workers = calloc(num_workers, sizeof(worker_t));
+    if (!executor->workers) {
+        free(executor);
+        return ZX_ERR_NO_MEMORY;
+    }
+    executor->async.ops = &async_executor_ops;
+    executor->num_workers = num_workers;
+    atomic_init(&executor->shutting_down, false);
+    atomic_init(&executor->idle_workers, 0u);
+    atomic_init(&executor->wake_pending, false);
+    mtx_init(&executor->lock, mtx_plain);
+    list_initialize(&executor->wait_list);
+    list_initialize(&executor->global_tasks);
+    atomic_init(&executor->global_count, 0u);
+    list_initialize(&executor->timer_list);
+    executor->timer_deadline = ZX_TIME_INFINITE;
+    for (uint32_t i = 0u; i < num_workers; i++) {
+        worker_t* worker = &executor->workers[i];
+        worker->executor = executor;
+        worker->index = i;
+        mtx_init(&worker->lock, mtx_plain);
+        list_initialize(&worker->tasks);
+        atomic_init(&worker->count, 0u);
+    }
+
+    zx_status_t status = zx_port_create(0u, &executor->port);
+    if (status == ZX_OK)
+        status = zx_timer_create(0u, ZX_CLOCK_MONOTONIC, &executor->timer);
+    if (status == ZX_OK) {
+        status = zx_object_wait_async(executor->timer, executor->port, KEY_CONTROL,
+                                      ZX_TIMER_SIGNALED,
+                                      ZX_WAIT_ASYNC_REPEATING);
+    }
+    for (uint32_t i = 0u; status == ZX_OK && i < num_workers; i++) {
+        worker_t* worker = &executor->workers[i];
+        if (thrd_create_with_name(&worker->thread, async_executor_run_worker,
+                                  worker, name) != thrd_success) {
+            status = ZX_ERR_NO_MEMORY;
+            break;
+        }
+        worker->started = true;
+    }
+    if (status != ZX_OK) {
+        async_executor_destroy(&executor->async);
+        return status;
+    }
+    *out_async = &executor->async;
+    return ZX_OK;
+}
+
+void async_executor_destroy(async_t* async) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+
+    async_executor_shutdown(async);
+
+    zx_handle_close(executor->port);
+    zx_handle_close(executor->timer);
+    for (uint32_t i = 0u; i < executor->num_workers; i++)
+        mtx_destroy(&executor->workers[i].lock);
+    mtx_destroy(&executor->lock);
+    free(executor->workers);
+    free(executor);
+}
+
+void async_executor_shutdown(async_t* async) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(!g_worker || g_worker->executor != executor);
+
+    if (atomic_exchange_explicit(&executor->shutting_down, true, memory_order_acq_rel))
+        return;
+
+    // Each thread exits after the first packet it takes, so one apiece
+    // wakes them all.
+    for (uint32_t i = 0u; i < executor->num_workers; i++) {
+        zx_port_packet_t packet = {
+            .key = KEY_CONTROL,
+            .type = ZX_PKT_TYPE_USER,
+            .status = ZX_OK};
+        zx_status_t status = zx_port_queue(executor->port, &packet, 0u);
+        ZX_DEBUG_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+    }
+    for (uint32_t i = 0u; i < executor->num_workers; i++) {
+        worker_t* worker = &executor->workers[i];
+        if (worker->started) {
+            int result = thrd_join(worker->thread, NULL);
+            ZX_DEBUG_ASSERT(result == thrd_success);
+            worker->started = false;
+        }
+    }
+
+    // No handlers are running anymore, so the lists can be emptied without
+    // taking their locks.
+    list_node_t* node;
+    while ((node = list_remove_head(&executor->wait_list))) {
+        async_wait_t* wait = node_to_wait(node);
+        ZX_DEBUG_ASSERT(wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN);
+        wait->handler(async, wait, ZX_ERR_CANCELED, NULL);
+    }
+    for (uint32_t i = 0u; i < executor->num_workers; i++)
+        async_executor_notify_task_list(executor, &executor->workers[i].tasks);
+    async_executor_notify_task_list(executor, &executor->global_tasks);
+    async_executor_notify_task_list(executor, &executor->timer_list);
+}
+
+static void async_executor_notify_task_list(async_executor_t* executor, list_node_t* list) {
+    list_node_t* node;
+    while ((node = list_remove_head(list))) {
+        async_task_t* task = node_to_task(node);
+        if (task->flags & ASYNC_FLAG_HANDLE_SHUTDOWN)
+            task->handler(&executor->async, task, ZX_ERR_CANCELED);
+    }
+}
+
+static int async_executor_run_worker(void* data) {
+    worker_t* worker = data;
+    async_executor_t* executor = worker->executor;
+    g_worker = worker;
+    async_set_default(&executor->async);
+
+    uint32_t budget = TASK_BUDGET;
+    zx_port_packet_t packet;
+    while (!atomic_load_explicit(&executor->shutting_down, memory_order_acquire)) {
+        async_task_t* task = async_executor_find_task(worker);
+        if (task) {
+            async_executor_dispatch_task(executor, task);
+            if (--budget > 0u)
+                continue;
+            budget = TASK_BUDGET;
+            if (zx_port_wait(executor->port, 0u, &packet, 0u) == ZX_OK)
+                async_executor_dispatch_port_packet(worker, &packet);
+            continue;
+        }
+
+        // Out of work.  Announce this before looking one last time, so that a
+        // task posted meanwhile either turns up here or wakes a thread.
+        atomic_fetch_add_explicit(&executor->idle_workers, 1u, memory_order_seq_cst);
+        task = async_executor_find_task(worker);
+        if (task) {
+            atomic_fetch_sub_explicit(&executor->idle_workers, 1u, memory_order_seq_cst);
+            async_executor_dispatch_task(executor, task);
+            continue;
+        }
+        zx_status_t status = zx_port_wait(executor->port, ZX_TIME_INFINITE, &packet, 0u);
+        atomic_fetch_sub_explicit(&executor->idle_workers, 1u, memory_order_seq_cst);
+        ZX_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+        async_executor_dispatch_port_packet(worker, &packet);
+        budget = TASK_BUDGET;
+    }
+    return 0;
+}
+
+// Takes up to half of the tasks of |victim|, the most recently queued ones,
+// and returns the oldest of them, queuing the rest on |worker|.
+static async_task_t* async_executor_steal(worker_t* worker, worker_t* victim) {
+    worker_t* first = worker->index < victim->index ? worker : victim;
+    worker_t* second = first == worker ? victim : worker;
+    mtx_lock(&first->lock);
+    mtx_lock(&second->lock);
+
+    async_task_t* task = NULL;
+    size_t count = atomic_load_explicit(&victim->count, memory_order_relaxed);
+    size_t n = (count + 1u) / 2u;
+    if (n > 0u) {
+        list_node_t* node = &victim->tasks;
+        for (size_t i = 0u; i < n; i++)
+            node = node->prev;
+        task = node_to_task(node);
+        node = node->next;
+        list_delete(task_to_node(task));
+        while (node != &victim->tasks) {
+            list_node_t* next = node->next;
+            list_delete(node);
+            list_add_tail(&worker->tasks, node);
+            node = next;
+        }
+        atomic_store_explicit(&victim->count, count - n, memory_order_relaxed);
+        atomic_fetch_add_explicit(&worker->count, n - 1u, memory_order_relaxed);
+    }
+
+    mtx_unlock(&second->lock);
+    mtx_unlock(&first->lock);
+    return task;
+}
+
+// Returns the next task for |worker| to run, from its own queue first, then
+// from those posted by other threads, and then from the other workers.
+static async_task_t* async_executor_find_task(worker_t* worker) {
+    async_executor_t* executor = worker->executor;
+    list_node_t* node = NULL;
+
+    if (atomic_load_explicit(&worker->count, memory_order_relaxed) > 0u) {
+        mtx_lock(&worker->lock);
+        if ((node = list_remove_head(&worker->tasks)))
+            atomic_fetch_sub_explicit(&worker->count, 1u, memory_order_relaxed);
+        mtx_unlock(&worker->lock);
+        if (node)
+            return node_to_task(node);
+    }
+
+    if (atomic_load_explicit(&executor->global_count, memory_order_seq_cst) > 0u) {
+        mtx_lock(&executor->lock);
+        if ((node = list_remove_head(&executor->global_tasks)))
+            atomic_fetch_sub_explicit(&executor->global_count, 1u, memory_order_relaxed);
+        bool more = !list_is_empty(&executor->global_tasks);
+        mtx_unlock(&executor->lock);
+        if (node) {
+            if (more)
+                async_executor_notify(executor);
+            return node_to_task(node);
+        }
+    }
+
+    for (uint32_t i = 1u; i < executor->num_workers; i++) {
+        worker_t* victim = &executor->workers[(worker->index + i) % executor->num_workers];
+        if (atomic_load_explicit(&victim->count, memory_order_seq_cst) == 0u)
+            continue;
+        async_task_t* task = async_executor_steal(worker, victim);
+        if (task) {
+            // Pass the work on if there is more of it than this thread takes.
+            if (atomic_load_explicit(&worker->count, memory_order_relaxed) > 0u ||
+                atomic_load_explicit(&victim->count, memory_order_relaxed) > 0u)
+                async_executor_notify(executor);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+// Wakes an idle thread, if there is one, to look for work.
+static void async_executor_notify(async_executor_t* executor) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&executor->idle_workers, memory_order_seq_cst) == 0u)
+        return;
+    if (atomic_load_explicit(&executor->wake_pending, memory_order_acquire) ||
+        atomic_exchange_explicit(&executor->wake_pending, true, memory_order_acq_rel))
+        return;
+
+    zx_port_packet_t packet = {
+        .key = KEY_WAKE,
+        .type = ZX_PKT_TYPE_USER,
+        .status = ZX_OK};
+    zx_status_t status = zx_port_queue(executor->port, &packet, 0u);
+    ZX_DEBUG_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+}
+
+static void async_executor_dispatch_port_packet(worker_t* worker,
+                                                const zx_port_packet_t* packet) {
+    async_executor_t* executor = worker->executor;
+    if (packet->key == KEY_CONTROL) {
+        // Handle task timer expirations.  Shutdown packets need nothing more
+        // than to have woken the thread.
+        if (packet->type == ZX_PKT_TYPE_SIGNAL_REP &&
+            packet->signal.observed & ZX_TIMER_SIGNALED) {
+            async_executor_dispatch_timer(worker);
+        }
+        return;
+    }
+    if (packet->key == KEY_WAKE) {
+        // The thread goes looking for work once it returns from here.  Work
+        // which turns up from now on needs another packet.
+        if (packet->type == ZX_PKT_TYPE_USER)
+            atomic_store_explicit(&executor->wake_pending, false, memory_order_release);
+        return;
+    }
+
+    // Handle wait completion packets.
+    if (packet->type == ZX_PKT_TYPE_SIGNAL_ONE) {
+        async_wait_t* wait = (void*)(uintptr_t)packet->key;
+        async_executor_dispatch_wait(executor, wait, packet->status, &packet->signal);
+        return;
+    }
+
+    // Handle queued user packets.
+    if (packet->type == ZX_PKT_TYPE_USER) {
+        async_receiver_t* receiver = (void*)(uintptr_t)packet->key;
+        receiver->handler(&executor->async, receiver, packet->status, &packet->user);
+        return;
+    }
+
+    ZX_DEBUG_ASSERT(false);
+}
+
+// Moves the tasks which have come due onto the queue of |worker|, where the
+// other threads can steal them.
+static void async_executor_dispatch_timer(worker_t* worker) {
+    async_executor_t* executor = worker->executor;
+    size_t moved = 0u;
+
+    mtx_lock(&executor->lock);
+    // The timer has to be set again before it can fire again.
+    executor->timer_deadline = ZX_TIME_INFINITE;
+    zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    mtx_lock(&worker->lock);
+    list_node_t* node;
+    while ((node = list_peek_head(&executor->timer_list)) &&
+           node_to_task(node)->deadline <= now) {
+        list_delete(node);
+        list_add_tail(&worker->tasks, node);
+        moved++;
+    }
+    atomic_fetch_add_explicit(&worker->count, moved, memory_order_relaxed);
+    mtx_unlock(&worker->lock);
+    async_executor_restart_timer_locked(executor);
+    mtx_unlock(&executor->lock);
+
+    if (moved > 1u)
+        async_executor_notify(executor);
+}
+
+static void async_executor_dispatch_task(async_executor_t* executor, async_task_t* task) {
+    // Invoke the handler.  Note that it might destroy itself.
+    async_task_result_t result = task->handler(&executor->async, task, ZX_OK);
+    ZX_ASSERT_MSG(result == ASYNC_TASK_FINISHED || result == ASYNC_TASK_REPEAT,
+                  "result=%d", result);
+    if (result == ASYNC_TASK_REPEAT) {
+        // Requeued even if shutting down, so that it is notified.
+        async_executor_insert_task(executor, task);
+    }
+}
+
+static void async_executor_dispatch_wait(async_executor_t* executor, async_wait_t* wait,
+                                         zx_status_t status, const zx_packet_signal_t* signal) {
+    // We must dequeue the handler before invoking it since it might destroy itself.
+    if (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
+        mtx_lock(&executor->lock);
+        list_delete(wait_to_node(wait));
+        mtx_unlock(&executor->lock);
+    }
+
+    // Invoke the handler.  Note that it might destroy itself.
+    async_wait_result_t result = wait->handler(&executor->async, wait, status, signal);
+    ZX_ASSERT_MSG(result == ASYNC_WAIT_FINISHED ||
+                      (result == ASYNC_WAIT_AGAIN && status == ZX_OK),
+                  "result=%d, status=%d", result, status);
+    if (result == ASYNC_WAIT_AGAIN) {
+        // Requeue the handler first if it still wants to observe shutdown,
+        // since another thread may dispatch it as soon as it is armed.
+        if (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
+            mtx_lock(&executor->lock);
+            list_add_head(&executor->wait_list, wait_to_node(wait));
+            mtx_unlock(&executor->lock);
+        }
+        status = async_executor_wait_async(executor, wait);
+        if (status != ZX_OK) {
+            if (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
+                mtx_lock(&executor->lock);
+                list_delete(wait_to_node(wait));
+                mtx_unlock(&executor->lock);
+            }
+            wait->handler(&executor->async, wait, status, NULL);
+        }
+    }
+}
+
+static zx_status_t async_executor_begin_wait(async_t* async, async_wait_t* wait) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(wait);
+
+    if (atomic_load_explicit(&executor->shutting_down, memory_order_acquire))
+        return ZX_ERR_BAD_STATE;
+
+    if (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
+        // Add the wait object to the wait_list before we begin waiting, so
+        // a dispatcher can safely remove the waiter from the list if the
+        // handler is invoked.
+        mtx_lock(&executor->lock);
+        list_add_head(&executor->wait_list, wait_to_node(wait));
+        mtx_unlock(&executor->lock);
+    }
+
+    zx_status_t status = async_executor_wait_async(executor, wait);
+
+    if (status != ZX_OK && (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN)) {
+        mtx_lock(&executor->lock);
+        list_delete(wait_to_node(wait));
+        mtx_unlock(&executor->lock);
+    }
+    return status;
+}
+
+static zx_status_t async_executor_cancel_wait(async_t* async, async_wait_t* wait) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(wait);
+
+    zx_status_t status = zx_port_cancel(executor->port, wait->object, (uintptr_t)wait);
+    if (status == ZX_OK && (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN)) {
+        mtx_lock(&executor->lock);
+        list_delete(wait_to_node(wait));
+        mtx_unlock(&executor->lock);
+    }
+    return status;
+}
+
+static zx_status_t async_executor_post_task(async_t* async, async_task_t* task) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(task);
+
+    if (atomic_load_explicit(&executor->shutting_down, memory_order_acquire))
+        return ZX_ERR_BAD_STATE;
+
+    async_executor_insert_task(executor, task);
+    return ZX_OK;
+}
+
+static void async_executor_insert_task(async_executor_t* executor, async_task_t* task) {
+    if (task->deadline > zx_clock_get(ZX_CLOCK_MONOTONIC)) {
+        mtx_lock(&executor->lock);
+        list_node_t* node;
+        for (node = executor->timer_list.prev; node != &executor->timer_list; node = node->prev) {
+            if (task->deadline >= node_to_task(node)->deadline)
+                break;
+        }
+        list_add_after(node, task_to_node(task));
+        async_executor_restart_timer_locked(executor);
+        mtx_unlock(&executor->lock);
+        return;
+    }
+
+    // Tasks posted by handlers stay on their thread, where they are likely
+    // to find what those handlers touched still in the cache.
+    worker_t* worker = g_worker;
+    if (worker && worker->executor == executor) {
+        mtx_lock(&worker->lock);
+        list_add_tail(&worker->tasks, task_to_node(task));
+        atomic_fetch_add_explicit(&worker->count, 1u, memory_order_relaxed);
+        mtx_unlock(&worker->lock);
+    } else {
+        mtx_lock(&executor->lock);
+        list_add_tail(&executor->global_tasks, task_to_node(task));
+        atomic_fetch_add_explicit(&executor->global_count, 1u, memory_order_relaxed);
+        mtx_unlock(&executor->lock);
+    }
+    async_executor_notify(executor);
+}
+
+static zx_status_t async_executor_cancel_task(async_t* async, async_task_t* task) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(task);
+
+    // A task may be on any of the queues, and may be stolen from one to
+    // another at any time, so canceling takes all of their locks.  Once a
+    // thread has taken a task to run it, it is on none of them.
+    mtx_lock(&executor->lock);
+    for (uint32_t i = 0u; i < executor->num_workers; i++)
+        mtx_lock(&executor->workers[i].lock);
+
+    zx_status_t status = ZX_ERR_NOT_FOUND;
+    list_node_t* node = task_to_node(task);
+    if (list_in_list(node)) {
+        // Find out whose queue it is on, so as to keep the count right.
+        atomic_size_t* count = NULL;
+        for (list_node_t* n = node->next; !count && n != node; n = n->next) {
+            if (n == &executor->global_tasks) {
+                count = &executor->global_count;
+            } else if (n == &executor->timer_list) {
+                break;
+            } else {
+                for (uint32_t i = 0u; i < executor->num_workers; i++) {
+                    if (n == &executor->workers[i].tasks) {
+                        count = &executor->workers[i].count;
+                        break;
+                    }
+                }
+            }
+        }
+        list_delete(node);
+        if (count)
+            atomic_fetch_sub_explicit(count, 1u, memory_order_relaxed);
+        else
+            async_executor_restart_timer_locked(executor);
+        status = ZX_OK;
+    }
+
+    for (uint32_t i = executor->num_workers; i > 0u; i--)
+        mtx_unlock(&executor->workers[i - 1u].lock);
+    mtx_unlock(&executor->lock);
+    return status;
+}
+
+static zx_status_t async_executor_queue_packet(async_t* async, async_receiver_t* receiver,
+                                               const zx_packet_user_t* data) {
+    async_executor_t* executor = (async_executor_t*)async;
+    ZX_DEBUG_ASSERT(executor);
+    ZX_DEBUG_ASSERT(receiver);
+    ZX_DEBUG_ASSERT(!(receiver->flags & ASYNC_FLAG_HANDLE_SHUTDOWN));
+
+    if (atomic_load_explicit(&executor->shutting_down, memory_order_acquire))
+        return ZX_ERR_BAD_STATE;
+
+    zx_port_packet_t packet = {
+        .key = (uintptr_t)receiver,
+        .type = ZX_PKT_TYPE_USER,
+        .status = ZX_OK};
+    if (data)
+        packet.user = *data;
+    return zx_port_queue(executor->port, &packet, 0u);
+}
+
+static zx_status_t async_executor_wait_async(async_executor_t* executor, async_wait_t* wait) {
+    return zx_object_wait_async(wait->object, executor->port, (uintptr_t)wait, wait->trigger,
+                                ZX_WAIT_ASYNC_ONCE);
+}
+
+static void async_executor_restart_timer_locked(async_executor_t* executor) {
+    list_node_t* head = list_peek_head(&executor->timer_list);
+    if (!head)
+        return;
+    zx_time_t deadline = node_to_task(head)->deadline;
+    if (deadline == ZX_TIME_INFINITE || deadline == executor->timer_deadline)
+        return;
+
+    zx_status_t status = zx_timer_set(executor->timer, deadline, 0);
+    ZX_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+    executor->timer_deadline = deadline;
+}
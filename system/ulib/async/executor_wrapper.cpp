@@ -0,0 +1,24 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <async/executor.h>
+
+#include <zircon/assert.h>
+
+namespace async {
+
+Executor::Executor(const async_executor_config_t* config) {
+    zx_status_t status = async_executor_create(config, &async_);
+    ZX_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+}
+
+Executor::~Executor() {
+    async_executor_destroy(async_);
+}
+
+void Executor::Shutdown() {
+    async_executor_shutdown(async_);
+}
+
+} // namespace async
@@ -0,0 +1,101 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+//
+// Provides a multi-threaded asynchronous dispatcher which spreads its work
+// across a fixed pool of threads.  Each thread keeps a queue of the tasks
+// posted by the handlers it runs, and threads which run out of work steal
+// from the others.  Waits and packets are dispatched by whichever thread
+// takes them from the shared completion port.
+//
+// Unlike |async_loop_t|, tasks are not dispatched one at a time: any number
+// of handlers of any kind may run concurrently, and tasks which are due run
+// in no particular order.  Clients which need their handlers serialized
+// should use a loop instead.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zircon/compiler.h>
+
+#include <async/default.h>
+#include <async/dispatcher.h>
+
+__BEGIN_CDECLS
+
+// Executor configuration structure.
+typedef struct async_executor_config {
+    // The number of threads to start, or zero for one per CPU.
+    uint32_t num_threads;
+
+    // The name to give each of the threads, may be NULL.
+    const char* name;
+} async_executor_config_t;
+
+// Creates an executor, starts its threads and returns its asynchronous
+// dispatcher.  Each thread has the dispatcher as its default.
+// All operations on the executor are thread-safe (except destroy).
+//
+// |config| provides configuration for the executor, may be NULL for
+// default behavior.
+//
+// Returns |ZX_OK| on success.
+// Returns |ZX_ERR_NO_MEMORY| if allocation or thread creation failed.
+// May return other errors if the necessary internal handles could not be created.
+zx_status_t async_executor_create(const async_executor_config_t* config,
+                                  async_t** out_async);
+
+// Shuts down the executor, joins its threads, and notifies handlers which
+// asked to handle shutdown.  Must not be called from one of its own threads.
+//
+// Does nothing if already shutting down.
+void async_executor_shutdown(async_t* async);
+
+// Destroys the executor.
+// Implicitly calls |async_executor_shutdown()|.
+void async_executor_destroy(async_t* async);
+
+__END_CDECLS
+
+#ifdef __cplusplus
+
+#include <fbl/macros.h>
+
+namespace async {
+
+// C++ wrapper for a work-stealing executor.
+//
+// This class is thread-safe.
+class Executor {
+public:
+    // Creates an executor and starts its threads.
+    //
+    // |config| provides configuration for the executor, may be NULL for
+    // default behavior.
+    explicit Executor(const async_executor_config_t* config = nullptr);
+
+    // Destroys the executor.
+    // Implicitly calls |Shutdown()|.
+    ~Executor();
+
+    // Gets the underlying dispatcher for this executor.
+    async_t* async() const { return async_; }
+
+    // Shuts down the executor, joins its threads, and notifies handlers
+    // which asked to handle shutdown.
+    //
+    // Does nothing if already shutting down.
+    void Shutdown();
+
+private:
+    async_t* async_;
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Executor);
+};
+
+} // namespace async
+
+#endif // __cplusplus
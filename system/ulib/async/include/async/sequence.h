@@ -0,0 +1,175 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <async/dispatcher.h>
+#include <async/task.h>
+#include <async/wait.h>
+
+#ifdef __cplusplus
+
+#include <fbl/function.h>
+#include <fbl/macros.h>
+
+namespace async {
+
+// Runs an asynchronous flow, such as the path of one request, as a chain of
+// steps: each step waits for something and then calls a continuation, which
+// may begin the next step.
+//
+// A sequence reuses the same wait and task for all of its steps, and stores
+// each continuation inline, so that taking a step never allocates.  A flow
+// which needs more state than its continuations can capture should keep it
+// in an object of its own, alongside the sequence; a server can draw those
+// objects from an |fbl::SlabAllocator| kept with its dispatcher.
+//
+// Only one step may be pending at a time.  The continuation runs on the
+// dispatcher with the step already finished, so it may begin another one or
+// destroy the sequence.
+//
+// Example usage:
+//
+//   struct Request {
+//       async::Sequence seq;
+//       uint8_t buf[64];
+//
+//       void Start(zx_handle_t channel) {
+//           seq.AwaitRead(channel, buf, sizeof(buf), nullptr, 0u,
+//                         [this](zx_status_t status, uint32_t bytes, uint32_t handles) {
+//               if (status == ZX_OK)
+//                   seq.AwaitDeadline(zx_deadline_after(ZX_MSEC(10)),
+//                                     [this](zx_status_t status) { Reply(status); });
+//           });
+//       }
+//   };
+//
+// This class is not thread-safe; steps must be taken one after another.
+class Sequence final {
+public:
+    // The most a continuation may capture, which is enough for a pointer to
+    // its owner and a few values.
+    static constexpr size_t kContinuationSize = 4u * sizeof(void*);
+
+    // Called when the object has received some of the signals waited for, with
+    // the signals it had then, or when the wait failed.
+    using SignalsContinuation =
+        fbl::InlineFunction<void(zx_status_t status, zx_signals_t observed), kContinuationSize>;
+
+    // Called on or after the deadline, or with |ZX_ERR_CANCELED| if the
+    // dispatcher shut down first.
+    using DeadlineContinuation =
+        fbl::InlineFunction<void(zx_status_t status), kContinuationSize>;
+
+    // Called once a message has been read into the buffers, with its size,
+    // or when the read failed.
+    using ReadContinuation =
+        fbl::InlineFunction<void(zx_status_t status, uint32_t actual_bytes,
+                                 uint32_t actual_handles),
+                            kContinuationSize>;
+
+    explicit Sequence(async_t* async);
+
+    // Destroys the sequence.
+    //
+    // No step may be pending.
+    ~Sequence();
+
+    // The dispatcher the steps run on.
+    async_t* async() const { return async_; }
+
+    // Returns true if a step has begun and its continuation has not run yet.
+    bool is_pending() const { return step_ != Step::kNone; }
+
+    // Waits for |object| to receive any of the |trigger| signals.
+    //
+    // Returns |ZX_OK| if the step has begun.
+    // Returns |ZX_ERR_BAD_STATE| if another step is pending.
+    // May return the errors of |async_begin_wait()|.
+    zx_status_t AwaitSignals(zx_handle_t object, zx_signals_t trigger, SignalsContinuation k);
+
+    // Waits until |deadline|.
+    //
+    // Returns |ZX_OK| if the step has begun.
+    // Returns |ZX_ERR_BAD_STATE| if another step is pending.
+    // May return the errors of |async_post_task()|.
+    zx_status_t AwaitDeadline(zx_time_t deadline, DeadlineContinuation k);
+
+    // Waits for a message on |channel| and reads it into |bytes| and
+    // |handles|, which must stay valid until the continuation runs.
+    // The continuation gets |ZX_ERR_PEER_CLOSED| if the peer closed with
+    // nothing left to read.
+    //
+    // Returns |ZX_OK| if the step has begun.
+    // Returns |ZX_ERR_BAD_STATE| if another step is pending.
+    // May return the errors of |async_begin_wait()|.
+    zx_status_t AwaitRead(zx_handle_t channel, void* bytes, uint32_t num_bytes,
+                          zx_handle_t* handles, uint32_t num_handles, ReadContinuation k);
+
+    // Writes a request to |channel| and reads its reply, like |zx_channel_call()|
+    // but without blocking the thread.  The first four bytes of the request
+    // are its transaction id, which the reply must carry too; nothing else may
+    // read from the channel meanwhile.  The read buffers in |args| must stay
+    // valid until the continuation runs.
+    // The continuation gets |ZX_ERR_IO| if some other message arrived first.
+    //
+    // Returns |ZX_OK| if the step has begun.
+    // Returns |ZX_ERR_BAD_STATE| if another step is pending.
+    // Returns |ZX_ERR_INVALID_ARGS| if the request is too short to have an id.
+    // May return the errors of |zx_channel_write()| and |async_begin_wait()|.
+    zx_status_t AwaitCall(zx_handle_t channel, const zx_channel_call_args_t& args,
+                          ReadContinuation k);
+
+    // Cancels the pending step, whose continuation will not run.
+    //
+    // Returns |ZX_OK| if the step was canceled.
+    // Returns |ZX_ERR_NOT_FOUND| if no step was pending, or the dispatcher is
+    // about to run its continuation.
+    zx_status_t Cancel();
+
+private:
+    enum class Step {
+        kNone,
+        kSignals,
+        kDeadline,
+        kRead,
+    };
+
+    struct WaitOp : async_wait_t {
+        Sequence* seq;
+    };
+    struct TaskOp : async_task_t {
+        Sequence* seq;
+    };
+
+    zx_status_t BeginRead(zx_handle_t channel);
+    static async_wait_result_t HandleWait(async_t* async, async_wait_t* wait,
+                                          zx_status_t status, const zx_packet_signal_t* signal);
+    static async_task_result_t HandleTask(async_t* async, async_task_t* task,
+                                          zx_status_t status);
+
+    async_t* const async_;
+    Step step_ = Step::kNone;
+    WaitOp wait_;
+    TaskOp task_;
+
+    SignalsContinuation signals_k_;
+    DeadlineContinuation deadline_k_;
+    ReadContinuation read_k_;
+
+    // Where the pending read puts its message, and the id it must carry
+    // if it is the reply to a call.
+    void* rd_bytes_ = nullptr;
+    zx_handle_t* rd_handles_ = nullptr;
+    uint32_t rd_num_bytes_ = 0u;
+    uint32_t rd_num_handles_ = 0u;
+    bool call_ = false;
+    zx_txid_t txid_ = 0u;
+
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Sequence);
+};
+
+} // namespace async
+
+#endif // __cplusplus
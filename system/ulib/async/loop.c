@@ -7,10 +7,12 @@
 #include <assert.h>
 #include <stdatomic.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #include <zircon/assert.h>
 #include <zircon/listnode.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/port.h>
 
 #include <async/receiver.h>
 #include <async/task.h>
@@ -19,6 +21,24 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The port key of the packet which announces tasks posted to the inbox.
+// Wait and receiver keys are pointers, so they can't collide with it.
+#define KEY_TASKS (1u)
+
+// Pending tasks are kept in a hierarchical timing wheel.  Level 0 has slots
+// 2^20ns (about 1ms) wide; each level above has slots as wide as a whole
+// rotation of the one below, so four levels reach about 4.9 hours ahead of the
+// wheel's time, and tasks beyond that wait in a sorted overflow list.
+#define WHEEL_LEVELS (4u)
+#define WHEEL_SLOT_BITS (6u)
+#define WHEEL_SLOTS (1u << WHEEL_SLOT_BITS)
+#define WHEEL_SHIFT (20u)
+#define WHEEL_LEVEL_SHIFT(level) (WHEEL_SHIFT + (level)*WHEEL_SLOT_BITS)
+
+// The most packets a single dispatch thread takes from the port at once.
+#define BATCH_PACKETS (8u)
+static_assert(BATCH_PACKETS <= ZX_PORT_MAX_BATCH_PACKETS, "batch too large");
+
 static zx_status_t async_loop_begin_wait(async_t* async, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_t* async, async_wait_t* wait);
 static zx_status_t async_loop_post_task(async_t* async, async_task_t* task);
@@ -47,23 +67,57 @@ typedef struct async_loop {
     _Atomic async_loop_state_t state;
     atomic_uint active_threads; // number of active dispatch threads
 
-    mtx_t lock; // guards the lists and the dispatching tasks flag
+    mtx_t lock; // guards the lists, the wheel and the dispatching tasks flag
     bool dispatching_tasks; // true while the loop is busy dispatching tasks
     list_node_t wait_list; // most recently added first
-    list_node_t task_list; // pending tasks, earliest deadline first
     list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
+
+    // Pending tasks.  Each slot lists its tasks earliest deadline first, and in
+    // posting order for equal deadlines.  A task goes in the lowest level whose
+    // current rotation covers its deadline, so the slots of a level, and then
+    // the levels, are in deadline order too.  Overdue tasks go in the first
+    // slot of level 0.
+    list_node_t wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t wheel_occupied[WHEEL_LEVELS]; // slots which may have tasks, cleared lazily
+    list_node_t overflow; // tasks beyond the top level, earliest deadline first
+    zx_time_t wheel_time; // advanced as tasks are dispatched
+    zx_time_t timer_deadline; // what the timer is set to, ZX_TIME_INFINITE if unknown
+
+    // Tasks which were already due when posted, most recently posted first.
+    // They are pushed without taking the lock, and moved into the wheel by
+    // whoever takes it next.  Their first word of state links them together.
+    _Atomic(async_task_t*) inbox;
+    atomic_bool inbox_signaled; // a KEY_TASKS packet is on its way
 } async_loop_t;
 
-static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+// Packets this thread has taken from the port but not dispatched yet.
+// Canceling a wait must also drop its packet from here, otherwise the
+// handler would still run after a successful cancelation.
+typedef struct packet_batch {
+    async_loop_t* loop;
+    zx_port_packet_t packets[BATCH_PACKETS];
+    size_t next;
+    size_t count;
+} packet_batch_t;
+
+static thread_local packet_batch_t* g_batch;
+
+static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline, bool once);
+static zx_status_t async_loop_dispatch_port_packet(async_loop_t* loop,
+                                                   const zx_port_packet_t* packet);
+static bool async_loop_cancel_batched(async_loop_t* loop, uint64_t key);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
-static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop);
+static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop, bool timer_fired);
 static zx_status_t async_loop_dispatch_packet(async_loop_t* loop, async_receiver_t* receiver,
                                               zx_status_t status, const zx_packet_user_t* data);
 static void async_loop_wake_threads(async_loop_t* loop);
 static zx_status_t async_loop_wait_async(async_loop_t* loop, async_wait_t* wait);
 static void async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task);
+static void async_loop_drain_inbox_locked(async_loop_t* loop);
+static async_task_t* async_loop_first_task_locked(async_loop_t* loop);
+static void async_loop_advance_wheel_locked(async_loop_t* loop, zx_time_t now);
 static void async_loop_restart_timer_locked(async_loop_t* loop);
 static void async_loop_invoke_prologue(async_loop_t* loop);
 static void async_loop_invoke_epilogue(async_loop_t* loop);
@@ -96,6 +150,10 @@ static inline async_task_t* node_to_task(list_node_t* node) {
     return FROM_NODE(async_task_t, node);
 }
 
+static inline async_task_t** task_to_inbox_next(async_task_t* task) {
+    return (async_task_t**)&task->state.reserved[0];
+}
+
 zx_status_t async_loop_create(const async_loop_config_t* config, async_t** out_async) {
     ZX_DEBUG_ASSERT(out_async);
 
@@ -110,9 +168,17 @@ zx_status_t async_loop_create(const async_loop_config_t* config, async_t** out_a
         loop->config = *config;
     mtx_init(&loop->lock, mtx_plain);
     list_initialize(&loop->wait_list);
-    list_initialize(&loop->task_list);
     list_initialize(&loop->due_list);
     list_initialize(&loop->thread_list);
+    for (uint32_t level = 0u; level < WHEEL_LEVELS; level++) {
+        for (uint32_t slot = 0u; slot < WHEEL_SLOTS; slot++)
+            list_initialize(&loop->wheel[level][slot]);
+    }
+    list_initialize(&loop->overflow);
+    loop->wheel_time = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    loop->timer_deadline = ZX_TIME_INFINITE;
+    atomic_init(&loop->inbox, NULL);
+    atomic_init(&loop->inbox_signaled, false);
 
     zx_status_t status = zx_port_create(0u, &loop->port);
     if (status == ZX_OK)
@@ -168,6 +234,7 @@ void async_loop_shutdown(async_t* async) {
         async_loop_invoke_wait_handler(loop, wait, ZX_ERR_CANCELED, NULL);
         async_loop_invoke_epilogue(loop);
     }
+    async_loop_drain_inbox_locked(loop);
     while ((node = list_remove_head(&loop->due_list))) {
         async_task_t* task = node_to_task(node);
         if (task->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
@@ -176,8 +243,9 @@ void async_loop_shutdown(async_t* async) {
             async_loop_invoke_epilogue(loop);
         }
     }
-    while ((node = list_remove_head(&loop->task_list))) {
-        async_task_t* task = node_to_task(node);
+    async_task_t* task;
+    while ((task = async_loop_first_task_locked(loop))) {
+        list_delete(task_to_node(task));
         if (task->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
             async_loop_invoke_prologue(loop);
             async_loop_invoke_task_handler(loop, task, ZX_ERR_CANCELED);
@@ -198,7 +266,7 @@ zx_status_t async_loop_run(async_t* async, zx_time_t deadline, bool once) {
     zx_status_t status;
     atomic_fetch_add_explicit(&loop->active_threads, 1u, memory_order_acq_rel);
     do {
-        status = async_loop_run_once(loop, deadline);
+        status = async_loop_run_once(loop, deadline, once);
     } while (status == ZX_OK && !once);
     atomic_fetch_sub_explicit(&loop->active_threads, 1u, memory_order_acq_rel);
     return status;
@@ -212,39 +280,79 @@ zx_status_t async_loop_run_until_idle(async_t* async) {
     return status;
 }
 
-static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
+static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline, bool once) {
     async_loop_state_t state = atomic_load_explicit(&loop->state, memory_order_acquire);
     if (state == ASYNC_LOOP_SHUTDOWN)
         return ZX_ERR_BAD_STATE;
     if (state != ASYNC_LOOP_RUNNABLE)
         return ZX_ERR_CANCELED;
 
-    zx_port_packet_t packet;
-    zx_status_t status = zx_port_wait(loop->port, deadline, &packet, 0);
+    // Threads in a pool share the work better one packet at a time, so only
+    // a lone dispatch thread drains several packets per wait.  Running once
+    // still means a single unit of work.
+    uint32_t threads = atomic_load_explicit(&loop->active_threads, memory_order_acquire);
+    size_t max_packets = (once || threads > 1u) ? 1u : BATCH_PACKETS;
+
+    packet_batch_t batch = {.loop = loop};
+    zx_status_t status = zx_port_wait_many(loop->port, deadline, batch.packets,
+                                           max_packets, &batch.count);
     if (status != ZX_OK)
         return status;
 
-    if (packet.key == KEY_CONTROL) {
-        // Handle wake-up packets.
-        if (packet.type == ZX_PKT_TYPE_USER)
-            return ZX_OK;
+    packet_batch_t* prior_batch = g_batch;
+    g_batch = &batch;
+    bool woken = false;
+    // Packets already taken from the port are dispatched even if the loop
+    // quits part way through, since signal packets cannot be put back.
+    while (batch.next < batch.count) {
+        const zx_port_packet_t packet = batch.packets[batch.next++];
+
+        // Each wake-up packet is meant for a different thread, so pass on
+        // any beyond the first instead of swallowing them here.
+        if (packet.key == KEY_CONTROL && packet.type == ZX_PKT_TYPE_USER) {
+            if (woken) {
+                zx_status_t st = zx_port_queue(loop->port, &packet, 0u);
+                ZX_DEBUG_ASSERT_MSG(st == ZX_OK, "status=%d", st);
+            }
+            woken = true;
+            continue;
+        }
+
+        zx_status_t st = async_loop_dispatch_port_packet(loop, &packet);
+        if (status == ZX_OK)
+            status = st;
+    }
+    g_batch = prior_batch;
+    return status;
+}
 
+static zx_status_t async_loop_dispatch_port_packet(async_loop_t* loop,
+                                                   const zx_port_packet_t* packet) {
+    if (packet->key == KEY_CONTROL) {
         // Handle task timer expirations.
-        if (packet.type == ZX_PKT_TYPE_SIGNAL_REP &&
-            packet.signal.observed & ZX_TIMER_SIGNALED) {
-            return async_loop_dispatch_tasks(loop);
+        if (packet->type == ZX_PKT_TYPE_SIGNAL_REP &&
+            packet->signal.observed & ZX_TIMER_SIGNALED) {
+            return async_loop_dispatch_tasks(loop, true);
+        }
+    } else if (packet->key == KEY_TASKS) {
+        // Handle tasks which were due when posted.
+        if (packet->type == ZX_PKT_TYPE_USER) {
+            // Tasks posted from here on need another packet, since they may
+            // miss those about to be dispatched.
+            atomic_store_explicit(&loop->inbox_signaled, false, memory_order_release);
+            return async_loop_dispatch_tasks(loop, false);
         }
     } else {
         // Handle wait completion packets.
-        if (packet.type == ZX_PKT_TYPE_SIGNAL_ONE) {
-            async_wait_t* wait = (void*)(uintptr_t)packet.key;
-            return async_loop_dispatch_wait(loop, wait, packet.status, &packet.signal);
+        if (packet->type == ZX_PKT_TYPE_SIGNAL_ONE) {
+            async_wait_t* wait = (void*)(uintptr_t)packet->key;
+            return async_loop_dispatch_wait(loop, wait, packet->status, &packet->signal);
         }
 
         // Handle queued user packets.
-        if (packet.type == ZX_PKT_TYPE_USER) {
-            async_receiver_t* receiver = (void*)(uintptr_t)packet.key;
-            return async_loop_dispatch_packet(loop, receiver, packet.status, &packet.user);
+        if (packet->type == ZX_PKT_TYPE_USER) {
+            async_receiver_t* receiver = (void*)(uintptr_t)packet->key;
+            return async_loop_dispatch_packet(loop, receiver, packet->status, &packet->user);
         }
     }
 
@@ -252,6 +360,22 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
     return ZX_ERR_INTERNAL;
 }
 
+static bool async_loop_cancel_batched(async_loop_t* loop, uint64_t key) {
+    packet_batch_t* batch = g_batch;
+    if (!batch || batch->loop != loop)
+        return false;
+
+    for (size_t i = batch->next; i < batch->count; i++) {
+        if (batch->packets[i].key == key) {
+            for (size_t j = i + 1; j < batch->count; j++)
+                batch->packets[j - 1] = batch->packets[j];
+            batch->count--;
+            return true;
+        }
+    }
+    return false;
+}
+
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal) {
     async_loop_invoke_prologue(loop);
@@ -284,35 +408,32 @@ static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wa
     return ZX_OK;
 }
 
-static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop) {
+static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop, bool timer_fired) {
     // Dequeue and dispatch one task at a time in case an earlier task wants
     // to cancel a later task which has also come due.  At most one thread
     // can dispatch tasks at any given moment (to preserve serial ordering).
     // Timer restarts are suppressed until we run out of tasks to dispatch.
     mtx_lock(&loop->lock);
+    if (timer_fired) {
+        // The timer has to be set again before it can fire again.
+        loop->timer_deadline = ZX_TIME_INFINITE;
+    }
     if (!loop->dispatching_tasks) {
         loop->dispatching_tasks = true;
 
         // Extract all of the tasks that are due into |due_list| for dispatch
         // unless we already have some waiting from a previous iteration which
-        // we would like to process in order.
+        // we would like to process in order.  Once the wheel has caught up
+        // with the time, they are all at the front of level 0.
         list_node_t* node;
         if (list_is_empty(&loop->due_list)) {
             zx_time_t due_time = zx_clock_get(ZX_CLOCK_MONOTONIC);
-            list_node_t* tail = NULL;
-            list_for_every(&loop->task_list, node) {
-                if (node_to_task(node)->deadline > due_time)
-                    break;
-                tail = node;
-            }
-            if (tail) {
-                list_node_t* head = loop->task_list.next;
-                loop->task_list.next = tail->next;
-                tail->next->prev = &loop->task_list;
-                loop->due_list.next = head;
-                head->prev = &loop->due_list;
-                loop->due_list.prev = tail;
-                tail->next = &loop->due_list;
+            async_loop_drain_inbox_locked(loop);
+            async_loop_advance_wheel_locked(loop, due_time);
+            async_task_t* task;
+            while ((task = async_loop_first_task_locked(loop)) && task->deadline <= due_time) {
+                list_delete(task_to_node(task));
+                list_add_tail(&loop->due_list, task_to_node(task));
             }
         }
 
@@ -328,8 +449,11 @@ static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop) {
             async_task_result_t result = async_loop_invoke_task_handler(loop, task, ZX_OK);
 
             mtx_lock(&loop->lock);
-            if (result == ASYNC_TASK_REPEAT)
+            if (result == ASYNC_TASK_REPEAT) {
+                // Tasks posted earlier go first if their deadlines are the same.
+                async_loop_drain_inbox_locked(loop);
                 async_loop_insert_task_locked(loop, task);
+            }
             mtx_unlock(&loop->lock);
 
             async_loop_invoke_epilogue(loop);
@@ -458,6 +582,9 @@ static zx_status_t async_loop_cancel_wait(async_t* async, async_wait_t* wait) {
     // invoked again past this point.
     zx_status_t status = zx_port_cancel(loop->port, wait->object,
                                         (uintptr_t)wait);
+    bool batched = async_loop_cancel_batched(loop, (uintptr_t)wait);
+    if (status == ZX_ERR_NOT_FOUND && batched)
+        status = ZX_OK;
     if (status == ZX_OK && (wait->flags & ASYNC_FLAG_HANDLE_SHUTDOWN)) {
         mtx_lock(&loop->lock);
         list_delete(wait_to_node(wait));
@@ -474,15 +601,34 @@ static zx_status_t async_loop_post_task(async_t* async, async_task_t* task) {
     if (atomic_load_explicit(&loop->state, memory_order_acquire) == ASYNC_LOOP_SHUTDOWN)
         return ZX_ERR_BAD_STATE;
 
-    mtx_lock(&loop->lock);
+    if (task->deadline <= zx_clock_get(ZX_CLOCK_MONOTONIC)) {
+        // The task is already due, so it goes after everything posted before
+        // it whatever its deadline, and nothing needs sorting yet.  Push it on
+        // the inbox, and wake a dispatcher unless one is already on its way.
+        // Its deadline can't equal that of any later task which goes through
+        // the lock, since those are still in the future.
+        async_task_t* head = atomic_load_explicit(&loop->inbox, memory_order_relaxed);
+        do {
+            *task_to_inbox_next(task) = head;
+        } while (!atomic_compare_exchange_weak_explicit(&loop->inbox, &head, task,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+        if (!atomic_load_explicit(&loop->inbox_signaled, memory_order_acquire) &&
+            !atomic_exchange_explicit(&loop->inbox_signaled, true, memory_order_acq_rel)) {
+            zx_port_packet_t packet = {
+                .key = KEY_TASKS,
+                .type = ZX_PKT_TYPE_USER,
+                .status = ZX_OK};
+            zx_status_t status = zx_port_queue(loop->port, &packet, 0u);
+            ZX_DEBUG_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+        }
+        return ZX_OK;
+    }
 
+    mtx_lock(&loop->lock);
     async_loop_insert_task_locked(loop, task);
-    if (!loop->dispatching_tasks &&
-        task_to_node(task)->prev == &loop->task_list) {
-        // Task inserted at head.  Earliest deadline changed.
+    if (!loop->dispatching_tasks)
         async_loop_restart_timer_locked(loop);
-    }
-
     mtx_unlock(&loop->lock);
     return ZX_OK;
 }
@@ -496,24 +642,21 @@ static zx_status_t async_loop_cancel_task(async_t* async, async_task_t* task) {
     // destroyed in case the client is counting on the handler not being
     // invoked again past this point.  Also, the task we're removing here
     // might be present in the dispatcher's |due_list| if it is pending
-    // dispatch instead of in the loop's |task_list| as usual.  The same
-    // logic works in both cases.
+    // dispatch instead of in the wheel as usual, or still in the inbox.
+    // Once the inbox is emptied into the wheel, the same logic works in
+    // every case.
 
     mtx_lock(&loop->lock);
+    async_loop_drain_inbox_locked(loop);
     list_node_t* node = task_to_node(task);
     if (!list_in_list(node)) {
         mtx_unlock(&loop->lock);
         return ZX_ERR_NOT_FOUND;
     }
 
-    if (!loop->dispatching_tasks &&
-        node->prev == &loop->task_list &&
-        node->next != &loop->task_list &&
-        node_to_task(node->next)->deadline > task->deadline) {
-        // The head task was canceled and following task has a later deadline.
-        async_loop_restart_timer_locked(loop);
-    }
     list_delete(node);
+    if (!loop->dispatching_tasks)
+        async_loop_restart_timer_locked(loop);
     mtx_unlock(&loop->lock);
     return ZX_OK;
 }
@@ -542,26 +685,138 @@ static zx_status_t async_loop_wait_async(async_loop_t* loop, async_wait_t* wait)
                                 ZX_WAIT_ASYNC_ONCE);
 }
 
+// Returns the level of the wheel for |deadline| when the wheel's time is
+// |now|, or WHEEL_LEVELS for the overflow list.
+static uint32_t async_loop_wheel_level(zx_time_t now, zx_time_t deadline) {
+    for (uint32_t level = 0u; level < WHEEL_LEVELS; level++) {
+        uint32_t shift = WHEEL_LEVEL_SHIFT(level + 1u);
+        if ((deadline >> shift) <= (now >> shift))
+            return level;
+    }
+    return WHEEL_LEVELS;
+}
+
 static void async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task) {
-    // TODO(ZX-976): We assume that tasks are inserted in quasi-monotonic order and
-    // that insertion into the task queue will typically take no more than a few steps.
-    // If this assumption proves false and the cost of insertion becomes a problem, we
-    // should consider using a more efficient representation for maintaining order.
+    list_node_t* list;
+    uint32_t level = async_loop_wheel_level(loop->wheel_time, task->deadline);
+    if (level == WHEEL_LEVELS) {
+        list = &loop->overflow;
+    } else {
+        uint32_t slot = 0u;
+        if (level > 0u || (task->deadline >> WHEEL_LEVEL_SHIFT(1u)) ==
+                              (loop->wheel_time >> WHEEL_LEVEL_SHIFT(1u))) {
+            slot = (task->deadline >> WHEEL_LEVEL_SHIFT(level)) & (WHEEL_SLOTS - 1u);
+        }
+        loop->wheel_occupied[level] |= 1ull << slot;
+        list = &loop->wheel[level][slot];
+    }
+
+    // Slots hold few tasks, mostly posted in order of their deadlines, so
+    // this typically stops at the first step.
     list_node_t* node;
-    for (node = loop->task_list.prev; node != &loop->task_list; node = node->prev) {
+    for (node = list->prev; node != list; node = node->prev) {
         if (task->deadline >= node_to_task(node)->deadline)
             break;
     }
     list_add_after(node, task_to_node(task));
 }
 
+static void async_loop_drain_inbox_locked(async_loop_t* loop) {
+    async_task_t* task = atomic_exchange_explicit(&loop->inbox, NULL, memory_order_acquire);
+
+    // Reverse the inbox into posting order.
+    async_task_t* posted = NULL;
+    while (task) {
+        async_task_t* next = *task_to_inbox_next(task);
+        *task_to_inbox_next(task) = posted;
+        posted = task;
+        task = next;
+    }
+    while (posted) {
+        async_task_t* next = *task_to_inbox_next(posted);
+        async_loop_insert_task_locked(loop, posted);
+        posted = next;
+    }
+}
+
+static async_task_t* async_loop_first_task_locked(async_loop_t* loop) {
+    for (uint32_t level = 0u; level < WHEEL_LEVELS; level++) {
+        while (loop->wheel_occupied[level]) {
+            uint32_t slot = (uint32_t)__builtin_ctzll(loop->wheel_occupied[level]);
+            list_node_t* head = list_peek_head(&loop->wheel[level][slot]);
+            if (head)
+                return node_to_task(head);
+            loop->wheel_occupied[level] &= ~(1ull << slot);
+        }
+    }
+    list_node_t* head = list_peek_head(&loop->overflow);
+    return head ? node_to_task(head) : NULL;
+}
+
+static void async_loop_move_tasks(list_node_t* from, list_node_t* to) {
+    list_node_t* node;
+    while ((node = list_remove_head(from)))
+        list_add_tail(to, node);
+}
+
+// Moves the wheel's time on to |now|, and brings the tasks whose deadlines
+// come within reach of a lower level down to it.
+static void async_loop_advance_wheel_locked(async_loop_t* loop, zx_time_t now) {
+    zx_time_t then = loop->wheel_time;
+    if (now <= then)
+        return;
+    loop->wheel_time = now;
+    if ((now >> WHEEL_LEVEL_SHIFT(1u)) == (then >> WHEEL_LEVEL_SHIFT(1u)))
+        return;
+
+    // Level 0 has started a new rotation, so what is left of the old one is
+    // overdue.  It goes back in ahead of everything else, in order.
+    list_node_t overdue = LIST_INITIAL_VALUE(overdue);
+    for (uint32_t slot = 0u; slot < WHEEL_SLOTS; slot++)
+        async_loop_move_tasks(&loop->wheel[0][slot], &overdue);
+    loop->wheel_occupied[0] = 0u;
+
+    // Tasks come down from the top first, so that each is inserted once, at
+    // the level it ends up in.  Those from one slot, which may have equal
+    // deadlines, stay in order; those from different slots can't.
+    list_node_t moving = LIST_INITIAL_VALUE(moving);
+    list_node_t* node;
+    while ((node = list_peek_head(&loop->overflow)) &&
+           async_loop_wheel_level(now, node_to_task(node)->deadline) < WHEEL_LEVELS) {
+        list_delete(node);
+        list_add_tail(&moving, node);
+    }
+    for (uint32_t level = WHEEL_LEVELS - 1u; level > 0u; level--) {
+        // The slots up to the current one, or all of them if the level has
+        // started a new rotation too.
+        uint32_t shift = WHEEL_LEVEL_SHIFT(level + 1u);
+        uint32_t last = WHEEL_SLOTS - 1u;
+        if ((now >> shift) == (then >> shift))
+            last = (now >> WHEEL_LEVEL_SHIFT(level)) & (WHEEL_SLOTS - 1u);
+        for (uint32_t slot = 0u; slot <= last; slot++) {
+            if (loop->wheel_occupied[level] & (1ull << slot)) {
+                async_loop_move_tasks(&loop->wheel[level][slot], &moving);
+                loop->wheel_occupied[level] &= ~(1ull << slot);
+            }
+        }
+    }
+    while ((node = list_remove_head(&moving)))
+        async_loop_insert_task_locked(loop, node_to_task(node));
+
+    while ((node = list_remove_tail(&overdue)))
+        list_add_head(&loop->wheel[0][0], node);
+    if (!list_is_empty(&loop->wheel[0][0]))
+        loop->wheel_occupied[0] |= 1u;
+}
+
 static void async_loop_restart_timer_locked(async_loop_t* loop) {
+    async_loop_drain_inbox_locked(loop);
+
     zx_time_t deadline;
     if (list_is_empty(&loop->due_list)) {
-        list_node_t* head = list_peek_head(&loop->task_list);
-        if (!head)
+        async_task_t* task = async_loop_first_task_locked(loop);
+        if (!task)
             return;
-        async_task_t* task = node_to_task(head);
         deadline = task->deadline;
         if (deadline == ZX_TIME_INFINITE)
             return;
@@ -570,8 +825,12 @@ static void async_loop_restart_timer_locked(async_loop_t* loop) {
         deadline = 0ULL;
     }
 
+    // Only reprogram the timer if the earliest deadline has changed.
+    if (deadline == loop->timer_deadline)
+        return;
     zx_status_t status = zx_timer_set(loop->timer, deadline, 0);
     ZX_ASSERT_MSG(status == ZX_OK, "status=%d", status);
+    loop->timer_deadline = deadline;
 }
 
 static void async_loop_invoke_prologue(async_loop_t* loop) {
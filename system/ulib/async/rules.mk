@@ -18,6 +18,7 @@ MODULE_SRCS = \
     $(LOCAL_DIR)/auto_task.cpp \
     $(LOCAL_DIR)/auto_wait.cpp \
     $(LOCAL_DIR)/receiver.cpp \
+    $(LOCAL_DIR)/sequence.cpp \
     $(LOCAL_DIR)/task.cpp \
     $(LOCAL_DIR)/wait.cpp \
     $(LOCAL_DIR)/wait_with_timeout.cpp
@@ -28,6 +29,7 @@ MODULE_PACKAGE_INCS := \
     $(LOCAL_INC)/auto_wait.h \
     $(LOCAL_INC)/dispatcher.h \
     $(LOCAL_INC)/receiver.h \
+    $(LOCAL_INC)/sequence.h \
     $(LOCAL_INC)/task.h \
     $(LOCAL_INC)/wait.h \
     $(LOCAL_INC)/wait_with_timeout.h
@@ -53,11 +55,15 @@ MODULE_NAME := async-loop
 MODULE_TYPE := userlib
 
 MODULE_SRCS = \
+    $(LOCAL_DIR)/executor.c \
+    $(LOCAL_DIR)/executor_wrapper.cpp \
     $(LOCAL_DIR)/loop.c \
     $(LOCAL_DIR)/loop_wrapper.cpp
 
 MODULE_PACKAGE_SRCS := $(MODULE_SRCS)
-MODULE_PACKAGE_INCS := $(LOCAL_INC)/loop.h
+MODULE_PACKAGE_INCS := \
+    $(LOCAL_INC)/executor.h \
+    $(LOCAL_INC)/loop.h
 
 MODULE_STATIC_LIBS := \
     system/ulib/async \
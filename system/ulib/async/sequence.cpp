@@ -0,0 +1,187 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <async/sequence.h>
+
+#include <string.h>
+
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+
+namespace async {
+
+Sequence::Sequence(async_t* async)
+    : async_(async) {
+    wait_.state = ASYNC_STATE_INIT;
+    wait_.handler = &Sequence::HandleWait;
+    wait_.object = ZX_HANDLE_INVALID;
+    wait_.trigger = ZX_SIGNAL_NONE;
+    wait_.flags = 0u;
+    wait_.reserved = 0u;
+    wait_.seq = this;
+    task_.state = ASYNC_STATE_INIT;
+    task_.handler = &Sequence::HandleTask;
+    task_.deadline = ZX_TIME_INFINITE;
+    task_.flags = ASYNC_FLAG_HANDLE_SHUTDOWN;
+    task_.reserved = 0u;
+    task_.seq = this;
+}
+
+Sequence::~Sequence() {
+    ZX_DEBUG_ASSERT(!is_pending());
+}
+
+zx_status_t Sequence::AwaitSignals(zx_handle_t object, zx_signals_t trigger,
+                                   SignalsContinuation k) {
+    if (is_pending())
+        return ZX_ERR_BAD_STATE;
+
+    wait_.object = object;
+    wait_.trigger = trigger;
+    signals_k_ = fbl::move(k);
+    step_ = Step::kSignals;
+    zx_status_t status = async_begin_wait(async_, &wait_);
+    if (status != ZX_OK) {
+        step_ = Step::kNone;
+        signals_k_ = nullptr;
+    }
+    return status;
+}
+
+zx_status_t Sequence::AwaitDeadline(zx_time_t deadline, DeadlineContinuation k) {
+    if (is_pending())
+        return ZX_ERR_BAD_STATE;
+
+    task_.deadline = deadline;
+    deadline_k_ = fbl::move(k);
+    step_ = Step::kDeadline;
+    zx_status_t status = async_post_task(async_, &task_);
+    if (status != ZX_OK) {
+        step_ = Step::kNone;
+        deadline_k_ = nullptr;
+    }
+    return status;
+}
+
+zx_status_t Sequence::AwaitRead(zx_handle_t channel, void* bytes, uint32_t num_bytes,
+                                zx_handle_t* handles, uint32_t num_handles,
+                                ReadContinuation k) {
+    if (is_pending())
+        return ZX_ERR_BAD_STATE;
+
+    rd_bytes_ = bytes;
+    rd_num_bytes_ = num_bytes;
+    rd_handles_ = handles;
+    rd_num_handles_ = num_handles;
+    call_ = false;
+    read_k_ = fbl::move(k);
+    return BeginRead(channel);
+}
+
+zx_status_t Sequence::AwaitCall(zx_handle_t channel, const zx_channel_call_args_t& args,
+                                ReadContinuation k) {
+    if (is_pending())
+        return ZX_ERR_BAD_STATE;
+    if (args.wr_num_bytes < sizeof(zx_txid_t))
+        return ZX_ERR_INVALID_ARGS;
+
+    zx_status_t status = zx_channel_write(channel, 0u, args.wr_bytes, args.wr_num_bytes,
+                                          args.wr_handles, args.wr_num_handles);
+    if (status != ZX_OK)
+        return status;
+
+    memcpy(&txid_, args.wr_bytes, sizeof(txid_));
+    rd_bytes_ = args.rd_bytes;
+    rd_num_bytes_ = args.rd_num_bytes;
+    rd_handles_ = args.rd_handles;
+    rd_num_handles_ = args.rd_num_handles;
+    call_ = true;
+    read_k_ = fbl::move(k);
+    return BeginRead(channel);
+}
+
+zx_status_t Sequence::BeginRead(zx_handle_t channel) {
+    wait_.object = channel;
+    wait_.trigger = ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED;
+    step_ = Step::kRead;
+    zx_status_t status = async_begin_wait(async_, &wait_);
+    if (status != ZX_OK) {
+        step_ = Step::kNone;
+        read_k_ = nullptr;
+    }
+    return status;
+}
+
+zx_status_t Sequence::Cancel() {
+    zx_status_t status;
+    switch (step_) {
+    case Step::kNone:
+        return ZX_ERR_NOT_FOUND;
+    case Step::kDeadline:
+        status = async_cancel_task(async_, &task_);
+        break;
+    default:
+        status = async_cancel_wait(async_, &wait_);
+        break;
+    }
+    if (status == ZX_OK) {
+        step_ = Step::kNone;
+        signals_k_ = nullptr;
+        deadline_k_ = nullptr;
+        read_k_ = nullptr;
+    }
+    return status;
+}
+
+async_wait_result_t Sequence::HandleWait(async_t* async, async_wait_t* wait,
+                                         zx_status_t status, const zx_packet_signal_t* signal) {
+    Sequence* seq = static_cast<WaitOp*>(wait)->seq;
+    Step step = seq->step_;
+    seq->step_ = Step::kNone;
+
+    // The continuation may begin another step, or destroy the sequence, so
+    // it is taken out of the sequence before it runs.
+    if (step == Step::kSignals) {
+        SignalsContinuation k = fbl::move(seq->signals_k_);
+        k(status, signal ? signal->observed : ZX_SIGNAL_NONE);
+        return ASYNC_WAIT_FINISHED;
+    }
+
+    ZX_DEBUG_ASSERT(step == Step::kRead);
+    uint32_t actual_bytes = 0u;
+    uint32_t actual_handles = 0u;
+    if (status == ZX_OK) {
+        if (signal->observed & ZX_CHANNEL_READABLE) {
+            status = zx_channel_read(wait->object, 0u, seq->rd_bytes_, seq->rd_handles_,
+                                     seq->rd_num_bytes_, seq->rd_num_handles_,
+                                     &actual_bytes, &actual_handles);
+        } else {
+            status = ZX_ERR_PEER_CLOSED;
+        }
+    }
+    if (status == ZX_OK && seq->call_) {
+        zx_txid_t txid;
+        if (actual_bytes < sizeof(txid)) {
+            status = ZX_ERR_IO;
+        } else {
+            memcpy(&txid, seq->rd_bytes_, sizeof(txid));
+            if (txid != seq->txid_)
+                status = ZX_ERR_IO;
+        }
+    }
+    ReadContinuation k = fbl::move(seq->read_k_);
+    k(status, actual_bytes, actual_handles);
+    return ASYNC_WAIT_FINISHED;
+}
+
+async_task_result_t Sequence::HandleTask(async_t* async, async_task_t* task,
+                                         zx_status_t status) {
+    Sequence* seq = static_cast<TaskOp*>(task)->seq;
+    seq->step_ = Step::kNone;
+    DeadlineContinuation k = fbl::move(seq->deadline_k_);
+    k(status);
+    return ASYNC_TASK_FINISHED;
+}
+
+} // namespace async
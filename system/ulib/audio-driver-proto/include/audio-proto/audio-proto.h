@@ -56,6 +56,11 @@ using RingBufStartResp = audio_rb_cmd_start_resp_t;
 using RingBufStopReq  = audio_rb_cmd_stop_req_t;
 using RingBufStopResp = audio_rb_cmd_stop_resp_t;
 
+// AUDIO_RB_CMD_GET_POSITION_PAGE
+using RingBufGetPositionPageReq  = audio_rb_cmd_get_position_page_req_t;
+using RingBufGetPositionPageResp = audio_rb_cmd_get_position_page_resp_t;
+using RingBufPositionPage        = audio_rb_position_page_t;
+
 // AUDIO_RB_POSITION_NOTIFY
 using RingBufPositionNotify = audio_rb_position_notify_t;
 
@@ -0,0 +1,44 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <zircon/device/audio.h>
+#include <zircon/types.h>
+#include <zx/vmo.h>
+
+namespace audio {
+namespace utils {
+
+// The driver side of the page handed out by AUDIO_RB_CMD_GET_POSITION_PAGE.
+// The page is mapped into the driver for writing; clients get a read-only
+// handle.  Publish() may only be called by one thread at a time, and is
+// intended to be called directly from the driver's position IRQ or USB
+// completion path.
+class PositionPage {
+public:
+    PositionPage() = default;
+    ~PositionPage() { Release(); }
+
+    // Creates and maps the page, returning the handle to give to the client
+    // in |client_vmo_out|.
+    zx_status_t Create(zx::vmo* client_vmo_out);
+    void Release();
+
+    bool is_valid() const { return page_ != nullptr; }
+
+    void Publish(uint32_t ring_buffer_pos, zx_time_t timestamp);
+
+private:
+    zx::vmo vmo_;
+    audio_rb_position_page_t* page_ = nullptr;
+};
+
+// Gives the calling thread a deadline cpu reservation sized for servicing
+// position updates which arrive every |period|.  Used by drivers when a
+// client asks for AUDIO_RB_POSITION_FLAG_LOW_LATENCY.
+zx_status_t RequestLowLatencyDeadline(zx_duration_t period);
+
+}  // namespace utils
+}  // namespace audio
@@ -0,0 +1,78 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <audio-proto-utils/position-page.h>
+
+#include <fbl/type_support.h>
+#include <limits.h>
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
+#include <zx/vmar.h>
+
+namespace audio {
+namespace utils {
+
+zx_status_t PositionPage::Create(zx::vmo* client_vmo_out) {
+    ZX_DEBUG_ASSERT(client_vmo_out != nullptr);
+    Release();
+
+    zx::vmo vmo;
+    zx_status_t res = zx::vmo::create(PAGE_SIZE, 0, &vmo);
+    if (res != ZX_OK)
+        return res;
+
+    uintptr_t virt;
+    res = zx::vmar::root_self().map(0, vmo, 0, PAGE_SIZE,
+                                   ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &virt);
+    if (res != ZX_OK)
+        return res;
+
+    res = vmo.duplicate(ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP | ZX_RIGHT_READ, client_vmo_out);
+    if (res != ZX_OK) {
+        zx::vmar::root_self().unmap(virt, PAGE_SIZE);
+        return res;
+    }
+
+    vmo_ = fbl::move(vmo);
+    page_ = reinterpret_cast<audio_rb_position_page_t*>(virt);
+    return ZX_OK;
+}
+
+void PositionPage::Release() {
+    if (page_ != nullptr) {
+        zx::vmar::root_self().unmap(reinterpret_cast<uintptr_t>(page_), PAGE_SIZE);
+        page_ = nullptr;
+    }
+    vmo_.reset();
+}
+
+void PositionPage::Publish(uint32_t ring_buffer_pos, zx_time_t timestamp) {
+    ZX_DEBUG_ASSERT(page_ != nullptr);
+
+    // We are the only writer, so |seq| cannot change underneath us.
+    uint32_t seq = page_->seq;
+    __atomic_store_n(&page_->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&page_->ring_buffer_pos, ring_buffer_pos, __ATOMIC_RELAXED);
+    __atomic_store_n(&page_->timestamp, timestamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&page_->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+zx_status_t RequestLowLatencyDeadline(zx_duration_t period) {
+    // A position update is only a few register reads and a channel write, so
+    // a quarter of each period is generous.  Ask for it to be delivered
+    // within the first half, leaving the rest of the period as slack for the
+    // client's own processing.
+    zx_sched_deadline_params_t params = {
+        .capacity = period / 4,
+        .relative_deadline = period / 2,
+        .period = period,
+    };
+    return zx_object_set_property(zx_thread_self(), ZX_PROP_THREAD_SCHED_DEADLINE,
+                                  &params, sizeof(params));
+}
+
+}  // namespace utils
+}  // namespace audio
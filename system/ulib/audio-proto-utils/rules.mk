@@ -9,10 +9,12 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userlib
 
 MODULE_SRCS += \
-    $(LOCAL_DIR)/format-utils.cpp
+    $(LOCAL_DIR)/format-utils.cpp \
+    $(LOCAL_DIR)/position-page.cpp
 
 MODULE_STATIC_LIBS := \
-    system/ulib/fbl
+    system/ulib/fbl \
+    system/ulib/zx
 
 MODULE_PACKAGE := src
 
@@ -0,0 +1,38 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio {
+namespace utils {
+
+// Kernels for moving PCM between a client's format and a ring buffer's.
+//
+// Float samples are nominally in [-1.0, 1.0).  Conversions to integer
+// formats scale, round to nearest and saturate.  24 bit samples are carried
+// in the upper 24 bits of an int32_t, as in AUDIO_SAMPLE_FORMAT_24BIT_IN32.
+//
+// On x86-64 the work is done with AVX2 when the cpu has it and SSE2
+// otherwise; on arm64 with NEON.  Every version gives the same results as
+// the scalar code which handles the tail.  Buffers need not be aligned, but
+// must not overlap unless noted.
+
+void ConvertS16ToFloat(const int16_t* src, float* dst, size_t count);
+void ConvertFloatToS16(const float* src, int16_t* dst, size_t count);
+void ConvertS24In32ToFloat(const int32_t* src, float* dst, size_t count);
+void ConvertFloatToS24In32(const float* src, int32_t* dst, size_t count);
+
+// Multiplies |count| samples by |gain| in place.
+void ApplyGain(float* samples, size_t count, float gain);
+
+// Interleaves |frames| frames from |channels| planes into |dst|, or splits
+// them back out.  Stereo has a vector fast path.
+void Interleave(const float* const* planes, uint32_t channels, size_t frames, float* dst);
+void Deinterleave(const float* src, uint32_t channels, size_t frames, float* const* planes);
+
+}  // namespace utils
+}  // namespace audio
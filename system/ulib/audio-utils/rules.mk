@@ -11,7 +11,8 @@ MODULE_TYPE := userlib
 MODULE_SRCS += \
     $(LOCAL_DIR)/audio-device-stream.cpp \
     $(LOCAL_DIR)/audio-input.cpp \
-    $(LOCAL_DIR)/audio-output.cpp
+    $(LOCAL_DIR)/audio-output.cpp \
+    $(LOCAL_DIR)/sample-convert.cpp
 
 MODULE_STATIC_LIBS := \
     system/ulib/zx \
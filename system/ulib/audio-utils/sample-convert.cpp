@@ -0,0 +1,390 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <audio-utils/sample-convert.h>
+
+#include <math.h>
+#include <zircon/assert.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace audio {
+namespace utils {
+
+namespace {
+
+constexpr float kS16Scale = 32768.0f;
+constexpr float kS24Scale = 8388608.0f;
+
+// The scalar versions define the results; the vector versions below must
+// match them exactly, which is why rounding is done with lrintf (round to
+// nearest even, like cvtps2dq and fcvtns) and clamping happens before it.
+inline float S16ToFloat(int16_t v) {
+    return static_cast<float>(v) * (1.0f / kS16Scale);
+}
+
+inline int16_t FloatToS16(float v) {
+    v = fminf(fmaxf(v * kS16Scale, -kS16Scale), kS16Scale - 1.0f);
+    return static_cast<int16_t>(lrintf(v));
+}
+
+inline float S24In32ToFloat(int32_t v) {
+    return static_cast<float>(v >> 8) * (1.0f / kS24Scale);
+}
+
+inline int32_t FloatToS24In32(float v) {
+    v = fminf(fmaxf(v * kS24Scale, -kS24Scale), kS24Scale - 1.0f);
+    return static_cast<int32_t>(static_cast<uint32_t>(lrintf(v)) << 8);
+}
+
+// Each vector kernel returns how many samples (or frames) it handled,
+// always a multiple of its vector width, leaving the rest to scalar code.
+
+#if defined(__x86_64__)
+
+bool DetectAvx2() {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0), "c"(0));
+    if (eax < 7)
+        return false;
+
+    // The OS has to be saving the ymm state for AVX to be usable.
+    __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    constexpr uint32_t kOsxsave = 1u << 27;
+    constexpr uint32_t kAvx = 1u << 28;
+    if ((ecx & (kOsxsave | kAvx)) != (kOsxsave | kAvx))
+        return false;
+
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6)
+        return false;
+
+    __asm__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(7), "c"(0));
+    constexpr uint32_t kAvx2 = 1u << 5;
+    return (ebx & kAvx2) != 0;
+}
+
+bool HasAvx2() {
+    static const bool has_avx2 = DetectAvx2();
+    return has_avx2;
+}
+
+size_t S16ToFloatSse2(const int16_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / kS16Scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        // Sign extend by putting each sample in the top half and shifting down.
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t S16ToFloatAvx2(const int16_t* src, float* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / kS16Scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(v));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+    }
+    return i;
+}
+
+size_t FloatToS16Sse2(const float* src, int16_t* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(kS16Scale);
+    const __m128 min = _mm_set1_ps(-kS16Scale);
+    const __m128 max = _mm_set1_ps(kS16Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(src + i + 4), scale);
+        a = _mm_min_ps(_mm_max_ps(a, min), max);
+        b = _mm_min_ps(_mm_max_ps(b, min), max);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t FloatToS16Avx2(const float* src, int16_t* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(kS16Scale);
+    const __m256 min = _mm256_set1_ps(-kS16Scale);
+    const __m256 max = _mm256_set1_ps(kS16Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale);
+        a = _mm256_min_ps(_mm256_max_ps(a, min), max);
+        b = _mm256_min_ps(_mm256_max_ps(b, min), max);
+        // packs works within each 128 bit lane, so put the quadwords back in
+        // order afterwards.
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+    }
+    return i;
+}
+
+size_t S24In32ToFloatSse2(const int32_t* src, float* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(1.0f / kS24Scale);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128 f = _mm_cvtepi32_ps(_mm_srai_epi32(v, 8));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(f, scale));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t S24In32ToFloatAvx2(const int32_t* src, float* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(1.0f / kS24Scale);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256 f = _mm256_cvtepi32_ps(_mm256_srai_epi32(v, 8));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(f, scale));
+    }
+    return i;
+}
+
+size_t FloatToS24In32Sse2(const float* src, int32_t* dst, size_t count) {
+    const __m128 scale = _mm_set1_ps(kS24Scale);
+    const __m128 min = _mm_set1_ps(-kS24Scale);
+    const __m128 max = _mm_set1_ps(kS24Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 f = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+        f = _mm_min_ps(_mm_max_ps(f, min), max);
+        __m128i v = _mm_slli_epi32(_mm_cvtps_epi32(f), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t FloatToS24In32Avx2(const float* src, int32_t* dst, size_t count) {
+    const __m256 scale = _mm256_set1_ps(kS24Scale);
+    const __m256 min = _mm256_set1_ps(-kS24Scale);
+    const __m256 max = _mm256_set1_ps(kS24Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 f = _mm256_mul_ps(_mm256_loadu_ps(src + i), scale);
+        f = _mm256_min_ps(_mm256_max_ps(f, min), max);
+        __m256i v = _mm256_slli_epi32(_mm256_cvtps_epi32(f), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+    return i;
+}
+
+size_t ApplyGainSse2(float* samples, size_t count, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        _mm_storeu_ps(samples + i, _mm_mul_ps(_mm_loadu_ps(samples + i), g));
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t ApplyGainAvx2(float* samples, size_t count, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+        _mm256_storeu_ps(samples + i, _mm256_mul_ps(_mm256_loadu_ps(samples + i), g));
+    return i;
+}
+
+size_t InterleaveStereo(const float* left, const float* right, size_t frames, float* dst) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 l = _mm_loadu_ps(left + i);
+        __m128 r = _mm_loadu_ps(right + i);
+        _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+    return i;
+}
+
+size_t DeinterleaveStereo(const float* src, size_t frames, float* left, float* right) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(src + 2 * i);
+        __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+        _mm_storeu_ps(left + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(right + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+    return i;
+}
+
+size_t S16ToFloatVector(const int16_t* src, float* dst, size_t count) {
+    return HasAvx2() ? S16ToFloatAvx2(src, dst, count) : S16ToFloatSse2(src, dst, count);
+}
+
+size_t FloatToS16Vector(const float* src, int16_t* dst, size_t count) {
+    return HasAvx2() ? FloatToS16Avx2(src, dst, count) : FloatToS16Sse2(src, dst, count);
+}
+
+size_t S24In32ToFloatVector(const int32_t* src, float* dst, size_t count) {
+    return HasAvx2() ? S24In32ToFloatAvx2(src, dst, count)
+                     : S24In32ToFloatSse2(src, dst, count);
+}
+
+size_t FloatToS24In32Vector(const float* src, int32_t* dst, size_t count) {
+    return HasAvx2() ? FloatToS24In32Avx2(src, dst, count)
+                     : FloatToS24In32Sse2(src, dst, count);
+}
+
+size_t ApplyGainVector(float* samples, size_t count, float gain) {
+    return HasAvx2() ? ApplyGainAvx2(samples, count, gain) : ApplyGainSse2(samples, count, gain);
+}
+
+#elif defined(__aarch64__)
+
+size_t S16ToFloatVector(const int16_t* src, float* dst, size_t count) {
+    const float scale = 1.0f / kS16Scale;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        float32x4_t hi = vcvtq_f32_s32(vmovl_high_s16(v));
+        vst1q_f32(dst + i, vmulq_n_f32(lo, scale));
+        vst1q_f32(dst + i + 4, vmulq_n_f32(hi, scale));
+    }
+    return i;
+}
+
+size_t FloatToS16Vector(const float* src, int16_t* dst, size_t count) {
+    const float32x4_t min = vdupq_n_f32(-kS16Scale);
+    const float32x4_t max = vdupq_n_f32(kS16Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        float32x4_t a = vmulq_n_f32(vld1q_f32(src + i), kS16Scale);
+        float32x4_t b = vmulq_n_f32(vld1q_f32(src + i + 4), kS16Scale);
+        a = vminq_f32(vmaxq_f32(a, min), max);
+        b = vminq_f32(vmaxq_f32(b, min), max);
+        int16x4_t lo = vqmovn_s32(vcvtnq_s32_f32(a));
+        int16x4_t hi = vqmovn_s32(vcvtnq_s32_f32(b));
+        vst1q_s16(dst + i, vcombine_s16(lo, hi));
+    }
+    return i;
+}
+
+size_t S24In32ToFloatVector(const int32_t* src, float* dst, size_t count) {
+    const float scale = 1.0f / kS24Scale;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t f = vcvtq_f32_s32(vshrq_n_s32(vld1q_s32(src + i), 8));
+        vst1q_f32(dst + i, vmulq_n_f32(f, scale));
+    }
+    return i;
+}
+
+size_t FloatToS24In32Vector(const float* src, int32_t* dst, size_t count) {
+    const float32x4_t min = vdupq_n_f32(-kS24Scale);
+    const float32x4_t max = vdupq_n_f32(kS24Scale - 1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        float32x4_t f = vmulq_n_f32(vld1q_f32(src + i), kS24Scale);
+        f = vminq_f32(vmaxq_f32(f, min), max);
+        vst1q_s32(dst + i, vshlq_n_s32(vcvtnq_s32_f32(f), 8));
+    }
+    return i;
+}
+
+size_t ApplyGainVector(float* samples, size_t count, float gain) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+        vst1q_f32(samples + i, vmulq_n_f32(vld1q_f32(samples + i), gain));
+    return i;
+}
+
+size_t InterleaveStereo(const float* left, const float* right, size_t frames, float* dst) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t v = {{ vld1q_f32(left + i), vld1q_f32(right + i) }};
+        vst2q_f32(dst + 2 * i, v);
+    }
+    return i;
+}
+
+size_t DeinterleaveStereo(const float* src, size_t frames, float* left, float* right) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t v = vld2q_f32(src + 2 * i);
+        vst1q_f32(left + i, v.val[0]);
+        vst1q_f32(right + i, v.val[1]);
+    }
+    return i;
+}
+
+#else
+
+size_t S16ToFloatVector(const int16_t*, float*, size_t) { return 0; }
+size_t FloatToS16Vector(const float*, int16_t*, size_t) { return 0; }
+size_t S24In32ToFloatVector(const int32_t*, float*, size_t) { return 0; }
+size_t FloatToS24In32Vector(const float*, int32_t*, size_t) { return 0; }
+size_t ApplyGainVector(float*, size_t, float) { return 0; }
+size_t InterleaveStereo(const float*, const float*, size_t, float*) { return 0; }
+size_t DeinterleaveStereo(const float*, size_t, float*, float*) { return 0; }
+
+#endif
+
+}  // namespace
+
+void ConvertS16ToFloat(const int16_t* src, float* dst, size_t count) {
+    for (size_t i = S16ToFloatVector(src, dst, count); i < count; ++i)
+        dst[i] = S16ToFloat(src[i]);
+}
+
+void ConvertFloatToS16(const float* src, int16_t* dst, size_t count) {
+    for (size_t i = FloatToS16Vector(src, dst, count); i < count; ++i)
+        dst[i] = FloatToS16(src[i]);
+}
+
+void ConvertS24In32ToFloat(const int32_t* src, float* dst, size_t count) {
+    for (size_t i = S24In32ToFloatVector(src, dst, count); i < count; ++i)
+        dst[i] = S24In32ToFloat(src[i]);
+}
+
+void ConvertFloatToS24In32(const float* src, int32_t* dst, size_t count) {
+    for (size_t i = FloatToS24In32Vector(src, dst, count); i < count; ++i)
+        dst[i] = FloatToS24In32(src[i]);
+}
+
+void ApplyGain(float* samples, size_t count, float gain) {
+    for (size_t i = ApplyGainVector(samples, count, gain); i < count; ++i)
+        samples[i] *= gain;
+}
+
+void Interleave(const float* const* planes, uint32_t channels, size_t frames, float* dst) {
+    ZX_DEBUG_ASSERT(channels > 0);
+    size_t i = (channels == 2) ? InterleaveStereo(planes[0], planes[1], frames, dst) : 0;
+    for (; i < frames; ++i) {
+        for (uint32_t c = 0; c < channels; ++c)
+            dst[i * channels + c] = planes[c][i];
+    }
+}
+
+void Deinterleave(const float* src, uint32_t channels, size_t frames, float* const* planes) {
+    ZX_DEBUG_ASSERT(channels > 0);
+    size_t i = (channels == 2) ? DeinterleaveStereo(src, frames, planes[0], planes[1]) : 0;
+    for (; i < frames; ++i) {
+        for (uint32_t c = 0; c < channels; ++c)
+            planes[c][i] = src[i * channels + c];
+    }
+}
+
+}  // namespace utils
+}  // namespace audio
@@ -14,6 +14,7 @@
 #include <zircon/assert.h>
 #include <zircon/types.h>
 #include <fbl/algorithm.h>
+#include <fbl/array.h>
 #include <fbl/macros.h>
 #include <fbl/type_support.h>
 
@@ -72,11 +73,36 @@ public:
     // Clear all bits in the bitmap.
     void ClearAll() override;
 
+    // Bitmaps of at least kBits * kBits words keep a two-level summary of
+    // which words are entirely set, which lets Scan (and so Find) skip over
+    // full regions without reading them.  Set and Clear keep the summary up to
+    // date; anyone who modifies the underlying storage directly (see
+    // StorageUnsafe) must call RebuildSummary afterwards.
+    void RebuildSummary();
+
 protected:
+    // Reallocates the summary to fit size_ and rebuilds it from the bitmap.
+    // If memory for the summary cannot be allocated the bitmap works without
+    // one.
+    void ResetSummary();
+
     // The size of this bitmap, in bits.
     size_t size_ = 0;
     // Owned by bits_, cached
     size_t* data_ = nullptr;
+
+private:
+    void MarkFull(size_t idx);
+    void MarkNotFull(size_t idx);
+
+    // Returns the index of the first word at or after |idx| which the summary
+    // does not know to be full, or |limit| if there is none before it.
+    size_t NextNonFullIdx(size_t idx, size_t limit) const;
+
+    // One bit per word of the bitmap, set if the word is full, followed by
+    // one bit per word of that, set if all of its bits are.
+    fbl::Array<size_t> summary_;
+    size_t summary_l1_words_ = 0;
 };
 
 // A simple bitmap backed by generic storage.
@@ -122,6 +148,7 @@ public:
         size_t old_size = size_;
         data_ = static_cast<size_t*>(bits_.GetData());
         size_ = size;
+        ResetSummary();
 
         // Clear the partial bits not included in the new "size_t"s.
         Clear(old_size, fbl::min(old_len * kBits, size_));
@@ -140,6 +167,7 @@ public:
         size_ = size;
         if (size_ == 0) {
             data_ = nullptr;
+            ResetSummary();
             return ZX_OK;
         }
         size_t last_idx = LastIdx(size);
@@ -149,6 +177,7 @@ public:
         }
         data_ = static_cast<size_t*>(bits_.GetData());
         ClearAll();
+        ResetSummary();
         return ZX_OK;
     }
 
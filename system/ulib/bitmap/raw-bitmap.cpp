@@ -10,6 +10,7 @@
 
 #include <zircon/types.h>
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/macros.h>
 
 namespace {
@@ -41,21 +42,36 @@ size_t GetMask(bool first, bool last, size_t off, size_t max) {
     return mask;
 }
 
-// Counts the number of zeros.  It assumes everything in the array up to
-// bits_[idx] is zero.
+// Counts the trailing zeros of a non-zero word.
 #if (SIZE_MAX == UINT_MAX)
-#define CTZ(x) (x == 0 ? bitmap::kBits : __builtin_ctz(x))
+#define CTZ(x) __builtin_ctz(x)
 #elif (SIZE_MAX == ULONG_MAX)
-#define CTZ(x) (x == 0 ? bitmap::kBits : __builtin_ctzl(x))
+#define CTZ(x) __builtin_ctzl(x)
 #elif (SIZE_MAX == ULLONG_MAX)
-#define CTZ(x) (x == 0 ? bitmap::kBits : __builtin_ctzll(x))
+#define CTZ(x) __builtin_ctzll(x)
 #else
 #error "Unsupported size_t length"
 #endif
+
+// Returns the index of the lowest set bit in |value|, offset by the |idx|th
+// word, or kBits past the word if |value| is zero.
 size_t CountZeros(size_t idx, size_t value) {
-    return idx * bitmap::kBits + CTZ(value);
+    return idx * bitmap::kBits + (value == 0 ? bitmap::kBits : CTZ(value));
+}
+
+constexpr size_t kAllOnes = ~static_cast<size_t>(0);
+
+// Bitmaps with fewer words than this (256K bits on 64-bit targets) do not keep
+// a summary; scanning them whole is cheap, and this keeps small fixed-size
+// bitmaps, such as the kernel's, from ever allocating.
+constexpr size_t kSummaryMinWords = bitmap::kBits * bitmap::kBits;
+
+// Words whose bits are interesting when scanning for a bit which does not
+// match |is_set|: the word itself when looking for set bits, or its
+// complement when looking for clear bits.
+inline size_t Mismatch(size_t word, bool is_set) {
+    return is_set ? ~word : word;
 }
-#undef CTZ
 
 } // namespace
 
@@ -76,24 +92,37 @@ size_t RawBitmapBase::Scan(size_t bitoff, size_t bitmax, bool is_set) const {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
-    size_t i = first_idx;
-    size_t value = 0;
-    for (i = first_idx; i <= last_idx; ++i) {
-        value = GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
-        if (is_set) {
-            // If is_set=true, invert the mask, OR it with the value, and invert
-            // it again to hopefully get all zeros.
-            value = ~(~value | data_[i]);
-        } else {
-            // If is_set=false, just AND the mask with the value to hopefully
-            // get all zeros.
-            value &= data_[i];
+
+    // The first word only counts from |bitoff|.
+    size_t value = Mismatch(data_[first_idx], is_set) &
+                   GetMask(true, first_idx == last_idx, bitoff, bitmax);
+    if (value != 0 || first_idx == last_idx) {
+        return fbl::min(bitmax, CountZeros(first_idx, value));
+    }
+
+    // The words between the first and last are compared whole.  Once a word
+    // turns out to be skippable, the rest are skipped with the summary when
+    // looking for a clear bit, and otherwise four at a time.
+    size_t i = first_idx + 1;
+    const size_t skip = is_set ? kAllOnes : 0;
+    while (i < last_idx) {
+        if (data_[i] != skip) {
+            return CountZeros(i, Mismatch(data_[i], is_set));
         }
-        if (value != 0) {
-            break;
+        ++i;
+        if (is_set && summary_) {
+            i = NextNonFullIdx(i, last_idx);
+            continue;
+        }
+        while (i + 4 <= last_idx && data_[i] == skip && data_[i + 1] == skip &&
+               data_[i + 2] == skip && data_[i + 3] == skip) {
+            i += 4;
         }
     }
-    return fbl::min(bitmax, CountZeros(i, value));
+
+    // The last word only counts up to |bitmax|.
+    value = Mismatch(data_[last_idx], is_set) & GetMask(false, true, bitoff, bitmax);
+    return fbl::min(bitmax, CountZeros(last_idx, value));
 }
 
 zx_status_t RawBitmapBase::Find(bool is_set, size_t bitoff, size_t bitmax,
@@ -132,9 +161,21 @@ zx_status_t RawBitmapBase::Set(size_t bitoff, size_t bitmax) {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
-    for (size_t i = first_idx; i <= last_idx; ++i) {
-        data_[i] |=
-                GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
+    if (first_idx == last_idx) {
+        data_[first_idx] |= GetMask(true, true, bitoff, bitmax);
+    } else {
+        data_[first_idx] |= GetMask(true, false, bitoff, bitmax);
+        for (size_t i = first_idx + 1; i < last_idx; ++i) {
+            data_[i] = kAllOnes;
+        }
+        data_[last_idx] |= GetMask(false, true, bitoff, bitmax);
+    }
+    if (summary_) {
+        for (size_t i = first_idx; i <= last_idx; ++i) {
+            if (data_[i] == kAllOnes) {
+                MarkFull(i);
+            }
+        }
     }
     return ZX_OK;
 }
@@ -148,9 +189,19 @@ zx_status_t RawBitmapBase::Clear(size_t bitoff, size_t bitmax) {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
-    for (size_t i = first_idx; i <= last_idx; ++i) {
-        data_[i] &=
-                ~(GetMask(i == first_idx, i == last_idx, bitoff, bitmax));
+    if (first_idx == last_idx) {
+        data_[first_idx] &= ~GetMask(true, true, bitoff, bitmax);
+    } else {
+        data_[first_idx] &= ~GetMask(true, false, bitoff, bitmax);
+        for (size_t i = first_idx + 1; i < last_idx; ++i) {
+            data_[i] = 0;
+        }
+        data_[last_idx] &= ~GetMask(false, true, bitoff, bitmax);
+    }
+    if (summary_) {
+        for (size_t i = first_idx; i <= last_idx; ++i) {
+            MarkNotFull(i);
+        }
     }
     return ZX_OK;
 }
@@ -163,6 +214,98 @@ void RawBitmapBase::ClearAll() {
     for (size_t i = 0; i <= last_idx; ++i) {
         data_[i] = 0;
     }
+    for (size_t i = 0; i < summary_.size(); ++i) {
+        summary_[i] = 0;
+    }
+}
+
+void RawBitmapBase::RebuildSummary() {
+    for (size_t i = 0; i < summary_.size(); ++i) {
+        summary_[i] = 0;
+    }
+    if (!summary_) {
+        return;
+    }
+    size_t last_idx = LastIdx(size_);
+    for (size_t i = 0; i <= last_idx; ++i) {
+        if (data_[i] == kAllOnes) {
+            MarkFull(i);
+        }
+    }
+}
+
+void RawBitmapBase::ResetSummary() {
+    size_t words = (size_ == 0) ? 0 : LastIdx(size_) + 1;
+    if (words < kSummaryMinWords) {
+        summary_.reset();
+        summary_l1_words_ = 0;
+        return;
+    }
+
+    size_t l1_words = (words + kBits - 1) / kBits;
+    size_t l2_words = (l1_words + kBits - 1) / kBits;
+    if (summary_.size() != l1_words + l2_words) {
+        // The summary only speeds up scanning; without memory for one the
+        // bitmap carries on without it.
+        fbl::AllocChecker ac;
+        size_t* summary = new (&ac) size_t[l1_words + l2_words];
+        if (!ac.check()) {
+            summary_.reset();
+            summary_l1_words_ = 0;
+            return;
+        }
+        summary_.reset(summary, l1_words + l2_words);
+    }
+    summary_l1_words_ = l1_words;
+    RebuildSummary();
+}
+
+void RawBitmapBase::MarkFull(size_t idx) {
+    size_t& l1 = summary_[idx / kBits];
+    l1 |= static_cast<size_t>(1) << (idx % kBits);
+    if (l1 == kAllOnes) {
+        size_t l1_idx = idx / kBits;
+        summary_[summary_l1_words_ + l1_idx / kBits] |=
+                static_cast<size_t>(1) << (l1_idx % kBits);
+    }
+}
+
+void RawBitmapBase::MarkNotFull(size_t idx) {
+    size_t l1_idx = idx / kBits;
+    summary_[l1_idx] &= ~(static_cast<size_t>(1) << (idx % kBits));
+    summary_[summary_l1_words_ + l1_idx / kBits] &=
+            ~(static_cast<size_t>(1) << (l1_idx % kBits));
+}
+
+size_t RawBitmapBase::NextNonFullIdx(size_t idx, size_t limit) const {
+    const size_t l2_words = summary_.size() - summary_l1_words_;
+    while (idx < limit) {
+        // Look for a word not known to be full in this word's summary.
+        size_t l1_idx = idx / kBits;
+        size_t candidates = ~summary_[l1_idx] & (kAllOnes << (idx % kBits));
+        if (candidates != 0) {
+            return fbl::min(limit, l1_idx * kBits + CTZ(candidates));
+        }
+
+        // Every remaining word it covers is full; use the second level to
+        // find the next run of words which is not.
+        ++l1_idx;
+        size_t l2_idx = l1_idx / kBits;
+        if (l2_idx >= l2_words) {
+            return limit;
+        }
+        candidates = ~summary_[summary_l1_words_ + l2_idx] & (kAllOnes << (l1_idx % kBits));
+        while (candidates == 0) {
+            if (++l2_idx >= l2_words) {
+                return limit;
+            }
+            candidates = ~summary_[summary_l1_words_ + l2_idx];
+        }
+        idx = (l2_idx * kBits + CTZ(candidates)) * kBits;
+    }
+    return limit;
 }
 
+#undef CTZ
+
 } // namespace bitmap
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +25,7 @@
 #define MXDEBUG 0
 
 #include <blobstore/blobstore.h>
+#include <blobstore/compression.h>
 
 using digest::Digest;
 using digest::MerkleTree;
@@ -113,52 +115,198 @@ blobstore_inode_t* Blobstore::GetNode(size_t index) const {
     return &reinterpret_cast<blobstore_inode_t*>(node_map_->GetData())[index];
 }
 
-zx_status_t VnodeBlob::Verify() const {
-    TRACE_DURATION("blobstore", "Blobstore::Verify");
+// Data is verified a Merkle node at a time, which LoadData() takes to be a block.
+static_assert(kBlobstoreBlockSize == MerkleTree::kNodeSize,
+              "Blobstore blocks must be Merkle tree nodes");
+
+zx_status_t VnodeBlob::Verify(size_t offset, size_t length) const {
+    TRACE_DURATION("blobstore", "Blobstore::Verify", "offset", offset, "length", length);
     ZX_DEBUG_ASSERT(blob_ != nullptr);
 
     const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
-    // TODO(smklein): We could lazily verify more of the VMO if
-    // we could fault in pages on-demand.
-    //
-    // For now, we aggressively verify the entire VMO up front.
     Digest d;
     d = reinterpret_cast<const uint8_t*>(&digest_[0]);
     return MerkleTree::Verify(GetData(), inode->blob_size, GetMerkle(),
-                              MerkleTree::GetTreeLength(inode->blob_size), 0,
-                              inode->blob_size, d);
+                              MerkleTree::GetTreeLength(inode->blob_size), offset,
+                              length, d);
 }
 
 zx_status_t VnodeBlob::InitVmos() {
     TRACE_DURATION("blobstore", "Blobstore::InitVmos");
 
-    if (blob_ != nullptr) {
+    zx_status_t status;
+    const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    if (blob_ == nullptr) {
+        uint64_t num_blocks = BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode);
+        if ((status = MappedVmo::Create(num_blocks * kBlobstoreBlockSize, "blob",
+                                        &blob_)) != ZX_OK) {
+            FS_TRACE_ERROR("Failed to initialize vmo; error: %d\n", status);
+            BlobCloseHandles();
+            return status;
+        }
+        if ((status = blobstore_->AttachVmo(blob_->GetVmo(), &vmoid_)) != ZX_OK) {
+            FS_TRACE_ERROR("Failed to attach VMO to block device; error: %d\n", status);
+            BlobCloseHandles();
+            return status;
+        }
+    }
+    if (verified_.size() != 0) {
         return ZX_OK;
     }
 
-    zx_status_t status;
+    // The tree is small next to the data, so all of it is read at once; each
+    // LoadData() only checks the nodes of it covering the data it loads.
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    const uint64_t dev_start = inode->start_block + DataStartBlock(blobstore_->info_);
+    ReadTxn txn(blobstore_.get());
+    if (merkle_blocks != 0) {
+        txn.Enqueue(vmoid_, 0, dev_start, merkle_blocks);
+    }
+
+    // So is the frame table of a compressed blob.
+    if (inode->flags & kBlobstoreInodeFlagLZ4) {
+        const uint64_t table_blocks = fbl::round_up(LZ4TableSize(*inode), kBlobstoreBlockSize) /
+                                      kBlobstoreBlockSize;
+        if ((inode->num_blocks < merkle_blocks) ||
+            (inode->num_blocks - merkle_blocks < table_blocks)) {
+            FS_TRACE_ERROR("blobstore: Compressed blob is too small for its frame table\n");
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        if (compressed_ == nullptr) {
+            const uint64_t stored_blocks = inode->num_blocks - merkle_blocks;
+            if ((status = MappedVmo::Create(stored_blocks * kBlobstoreBlockSize,
+                                            "blob-compressed", &compressed_)) != ZX_OK) {
+                return status;
+            } else if ((status = blobstore_->AttachVmo(compressed_->GetVmo(),
+                                                       &compressed_vmoid_)) != ZX_OK) {
+                compressed_ = nullptr;
+                return status;
+            }
+        }
+        txn.Enqueue(compressed_vmoid_, 0, dev_start + merkle_blocks, table_blocks);
+    }
+
+    if ((status = txn.Flush()) != ZX_OK) {
+        return status;
+    }
+    return verified_.Reset(BlobDataBlocks(*inode));
+}
+
+zx_status_t VnodeBlob::LoadData(size_t offset, size_t length) {
     const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    ZX_DEBUG_ASSERT(offset + length <= inode->blob_size);
+    if (length == 0) {
+        return ZX_OK;
+    }
+    const uint64_t first = offset / kBlobstoreBlockSize;
+    const uint64_t last = fbl::round_up(offset + length, kBlobstoreBlockSize) /
+                          kBlobstoreBlockSize;
+    if (verified_.Scan(first, last, true) == last) {
+        return ZX_OK;
+    } else if (inode->flags & kBlobstoreInodeFlagLZ4) {
+        return LoadCompressedData(first, last);
+    }
+    TRACE_DURATION("blobstore", "Blobstore::LoadData", "offset", offset, "length", length);
+
+    // Read in every missing run of blocks in the chunks around the range, then
+    // verify from the first of them to the end of the last.
+    const uint64_t end = fbl::min(fbl::round_up(last, kBlobLoadChunkBlocks),
+                                  BlobDataBlocks(*inode));
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    const uint64_t dev_start = inode->start_block + DataStartBlock(blobstore_->info_) +
+                               merkle_blocks;
+    ReadTxn txn(blobstore_.get());
+    uint64_t lo = verified_.Scan(fbl::round_down(first, kBlobLoadChunkBlocks), end, true);
+    uint64_t hi = lo;
+    while (hi < end) {
+        uint64_t missing = verified_.Scan(hi, end, true);
+        if (missing == end) {
+            break;
+        }
+        hi = verified_.Scan(missing, end, false);
+        txn.Enqueue(vmoid_, merkle_blocks + missing, dev_start + missing, hi - missing);
+    }
 
-    uint64_t num_blocks = BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode);
-    if ((status = MappedVmo::Create(num_blocks * kBlobstoreBlockSize, "blob", &blob_)) != ZX_OK) {
-        FS_TRACE_ERROR("Failed to initialize vmo; error: %d\n", status);
-        BlobCloseHandles();
+    zx_status_t status;
+    if ((status = txn.Flush()) != ZX_OK) {
         return status;
     }
-    if ((status = blobstore_->AttachVmo(blob_->GetVmo(), &vmoid_)) != ZX_OK) {
-        FS_TRACE_ERROR("Failed to attach VMO to block device; error: %d\n", status);
-        BlobCloseHandles();
+    const size_t verify_start = lo * kBlobstoreBlockSize;
+    const size_t verify_end = fbl::min(hi * kBlobstoreBlockSize, inode->blob_size);
+    if ((status = Verify(verify_start, verify_end - verify_start)) != ZX_OK) {
+        FS_TRACE_ERROR("blobstore: Blob failed verification at [%zu, %zu)\n",
+                       verify_start, verify_end);
         return status;
     }
+    return verified_.Set(lo, hi);
+}
 
+zx_status_t VnodeBlob::LoadCompressedData(uint64_t first, uint64_t last) {
+    TRACE_DURATION("blobstore", "Blobstore::LoadCompressedData", "first", first, "last", last);
+    const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    const uint64_t data_blocks = BlobDataBlocks(*inode);
+
+    // Frames are verified whole, so the range is narrowed to run from the first
+    // frame of it which isn't verified to the last.
+    uint64_t end = fbl::min(fbl::round_up(last, kBlobstoreLZ4FrameBlocks), data_blocks);
+    uint64_t start = verified_.Scan(fbl::round_down(first, kBlobstoreLZ4FrameBlocks), end, true);
+    const uint64_t frame_lo = start / kBlobstoreLZ4FrameBlocks;
+    uint64_t frame_hi = frame_lo + 1;
+    for (uint64_t f = frame_hi; f * kBlobstoreLZ4FrameBlocks < end; f++) {
+        const uint64_t b = f * kBlobstoreLZ4FrameBlocks;
+        if (!verified_.Get(b, b + 1)) {
+            frame_hi = f + 1;
+        }
+    }
+
+    // Read in the compressed bytes of those frames, at their offsets within
+    // the compressed data, after the frame table.
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    const uint64_t stored_size = (inode->num_blocks - merkle_blocks) * kBlobstoreBlockSize;
+    const uint64_t* table = static_cast<const uint64_t*>(compressed_->GetData());
+    uint64_t byte_lo, byte_hi, unused;
+    zx_status_t status;
+    if ((status = LZ4FrameExtent(*inode, table, stored_size, frame_lo, &byte_lo,
+                                 &unused)) != ZX_OK) {
+        return status;
+    } else if ((status = LZ4FrameExtent(*inode, table, stored_size, frame_hi - 1, &unused,
+                                        &byte_hi)) != ZX_OK) {
+        return status;
+    }
+    const uint64_t block_lo = byte_lo / kBlobstoreBlockSize;
+    const uint64_t block_hi = fbl::round_up(byte_hi, kBlobstoreBlockSize) / kBlobstoreBlockSize;
     ReadTxn txn(blobstore_.get());
-    txn.Enqueue(vmoid_, 0, inode->start_block + DataStartBlock(blobstore_->info_),
-                BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode));
+    txn.Enqueue(compressed_vmoid_, block_lo,
+                inode->start_block + DataStartBlock(blobstore_->info_) + merkle_blocks + block_lo,
+                block_hi - block_lo);
     if ((status = txn.Flush()) != ZX_OK) {
         return status;
     }
 
-    return Verify();
+    // Decompress them into place, and verify them as any other data.
+    const uint8_t* src = static_cast<const uint8_t*>(compressed_->GetData());
+    uint8_t* dst = static_cast<uint8_t*>(GetData());
+    for (uint64_t f = frame_lo; f < frame_hi; f++) {
+        uint64_t frame_start, frame_end;
+        if ((status = LZ4FrameExtent(*inode, table, stored_size, f, &frame_start,
+                                     &frame_end)) != ZX_OK) {
+            return status;
+        } else if ((status = LZ4DecompressFrame(*inode, f, src + frame_start,
+                                                frame_end - frame_start,
+                                                dst + f * kBlobstoreLZ4FrameSize)) != ZX_OK) {
+            FS_TRACE_ERROR("blobstore: Blob frame %" PRIu64 " failed to decompress\n", f);
+            return status;
+        }
+    }
+    const size_t verify_start = frame_lo * kBlobstoreLZ4FrameSize;
+    const size_t verify_end = fbl::min(frame_hi * kBlobstoreLZ4FrameSize, inode->blob_size);
+    if ((status = Verify(verify_start, verify_end - verify_start)) != ZX_OK) {
+        FS_TRACE_ERROR("blobstore: Blob failed verification at [%zu, %zu)\n",
+                       verify_start, verify_end);
+        return status;
+    }
+    return verified_.Set(frame_lo * kBlobstoreLZ4FrameBlocks,
+                         fbl::min(frame_hi * kBlobstoreLZ4FrameBlocks, data_blocks));
 }
 
 uint64_t VnodeBlob::SizeData() const {
@@ -196,6 +344,7 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
 
     // Find a free node, mark it as reserved.
     zx_status_t status;
+    fbl::AllocChecker ac;
     if ((status = blobstore_->AllocateNode(&map_index_)) != ZX_OK) {
         return status;
     }
@@ -204,6 +353,7 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
     memset(inode->merkle_root_hash, 0, Digest::kLength);
     inode->blob_size = size_data;
+    inode->flags = 0;
     inode->num_blocks = MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode);
 
     // Open VMOs, so we can begin writing after allocate succeeds.
@@ -212,6 +362,18 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     }
     if ((status = blobstore_->AttachVmo(blob_->GetVmo(), &vmoid_)) != ZX_OK) {
         goto fail;
+    } else if ((status = verified_.Reset(BlobDataBlocks(*inode))) != ZX_OK) {
+        goto fail;
+    }
+
+    // The tree is built as the data is written.
+    merkle_.reset(new (&ac) MerkleTree());
+    if (!ac.check()) {
+        status = ZX_ERR_NO_MEMORY;
+        goto fail;
+    } else if ((status = merkle_->CreateInit(size_data,
+                                             MerkleTree::GetTreeLength(size_data))) != ZX_OK) {
+        goto fail;
     }
 
     // Allocate space for the blob
@@ -223,24 +385,12 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     return ZX_OK;
 
 fail:
+    merkle_.reset();
     BlobCloseHandles();
     blobstore_->FreeNode(map_index_);
     return status;
 }
 
-// A helper function for dumping either the Merkle Tree or the actual blob data
-// to both (1) The containing VMO, and (2) disk.
-zx_status_t VnodeBlob::WriteShared(WriteTxn* txn, size_t start, size_t len, uint64_t start_block) {
-    TRACE_DURATION("blobstore", "Blobstore::WriteShared", "txn", txn, "start", start, "len", len,
-                   "start_block", start_block);
-
-    // Write as many 'entire blocks' as possible
-    uint64_t n = start / kBlobstoreBlockSize;
-    uint64_t n_end = (start + len + kBlobstoreBlockSize - 1) / kBlobstoreBlockSize;
-    txn->Enqueue(vmoid_, n, n + start_block + DataStartBlock(blobstore_->info_), n_end - n);
-    return txn->Flush();
-}
-
 void* VnodeBlob::GetData() const {
     auto inode = blobstore_->GetNode(map_index_);
     return fs::GetBlock<kBlobstoreBlockSize>(blob_->GetData(),
@@ -298,79 +448,109 @@ zx_status_t VnodeBlob::WriteMetadata() {
     return ZX_OK;
 }
 
-zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actual) {
-    TRACE_DURATION("blobstore", "Blobstore::WriteInternal", "data", data, "len", len);
+zx_status_t VnodeBlob::WriteData(const void* data, size_t len, uint64_t blob_size,
+                                 uint64_t merkle_blocks, uint64_t dev_start, size_t* actual) {
+    TRACE_DURATION("blobstore", "Blobstore::WriteData", "len", len);
 
-    *actual = 0;
-    if (len == 0) {
-        return ZX_OK;
+    const size_t to_write = fbl::min(len, blob_size - bytes_written_);
+    const size_t data_start = merkle_blocks * kBlobstoreBlockSize;
+    zx_status_t status;
+    if ((status = vmo_write_exact(blob_->GetVmo(), data, data_start + bytes_written_,
+                                  to_write)) != ZX_OK) {
+        return status;
+    }
+    const uint8_t* blob_data = static_cast<const uint8_t*>(blob_->GetData()) + data_start;
+    if ((status = merkle_->CreateUpdate(blob_data + bytes_written_, to_write,
+                                        GetMerkle())) != ZX_OK) {
+        return status;
     }
+    *actual = to_write;
+    bytes_written_ += to_write;
 
-    WriteTxn txn(blobstore_.get());
-    auto inode = blobstore_->GetNode(map_index_);
-    const size_t data_start = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
-    if (GetState() == kBlobStateDataWrite) {
-        size_t to_write = fbl::min(len, inode->blob_size - bytes_written_);
-        size_t offset = bytes_written_ + data_start;
-        zx_status_t status = vmo_write_exact(blob_->GetVmo(), data, offset, to_write);
-        if (status != ZX_OK) {
-            return status;
-        }
+    // Complete blocks go out once a batch of them has built up. The last,
+    // partial one waits for the end, and goes out along with the tree.
+    const bool done = (bytes_written_ == blob_size);
+    const uint64_t ready = done ? fbl::round_up(blob_size, kBlobstoreBlockSize) /
+                                  kBlobstoreBlockSize
+                                : bytes_written_ / kBlobstoreBlockSize;
+    if (!done && (ready - blocks_written_ < kBlobWriteBatchBlocks)) {
+        return ZX_OK;
+    }
 
-        status = WriteShared(&txn, offset, len, inode->start_block);
+    if (done) {
+        Digest digest;
+        status = merkle_->CreateFinal(GetMerkle(), &digest);
+        merkle_.reset();
         if (status != ZX_OK) {
-            SetState(kBlobStateError);
             return status;
+        } else if (digest != digest_) {
+            // Downloaded blob did not match provided digest
+            return ZX_ERR_IO_DATA_INTEGRITY;
         }
+    }
 
-        *actual = to_write;
-        bytes_written_ += to_write;
+    WriteTxn txn(blobstore_.get());
+    if (ready > blocks_written_) {
+        txn.Enqueue(vmoid_, merkle_blocks + blocks_written_,
+                    dev_start + merkle_blocks + blocks_written_, ready - blocks_written_);
+    }
+    if (done && merkle_blocks != 0) {
+        txn.Enqueue(vmoid_, 0, dev_start, merkle_blocks);
+    }
+    if ((status = txn.Flush()) != ZX_OK) {
+        return status;
+    }
+    blocks_written_ = ready;
+    return ZX_OK;
+}
 
-        // More data to write.
-        if (bytes_written_ < inode->blob_size) {
-            return ZX_OK;
-        }
+zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actual) {
+    TRACE_DURATION("blobstore", "Blobstore::WriteInternal", "data", data, "len", len);
 
-        // TODO(smklein): As an optimization, use the CreateInit/Update/Final
-        // methods to create the merkle tree as we write data, rather than
-        // waiting until the data is fully downloaded to create the tree.
-        size_t merkle_size = MerkleTree::GetTreeLength(inode->blob_size);
-        if (merkle_size > 0) {
-            Digest digest;
-            void* merkle_data = GetMerkle();
-            const void* blob_data = GetData();
-            if (MerkleTree::Create(blob_data, inode->blob_size, merkle_data,
-                                   merkle_size, &digest) != ZX_OK) {
-                SetState(kBlobStateError);
-                return status;
-            } else if (digest != digest_) {
-                // Downloaded blob did not match provided digest
-                SetState(kBlobStateError);
-                return status;
-            }
+    *actual = 0;
+    if (len == 0) {
+        return ZX_OK;
+    }
 
-            status = WriteShared(&txn, 0, merkle_size, inode->start_block);
-            if (status != ZX_OK) {
-                SetState(kBlobStateError);
-                return status;
-            }
-        } else if ((status = Verify()) != ZX_OK) {
-            // Small blobs may not have associated Merkle Trees, and will
-            // require validation, since we are not regenerating and checking
-            // the digest.
-            SetState(kBlobStateError);
-            return status;
+    // Nothing else touches the blob's VMO until it is readable, so the data
+    // is copied, hashed and written out without the filesystem lock, letting
+    // writes of other blobs go on meanwhile.
+    uint64_t blob_size;
+    uint64_t merkle_blocks;
+    uint64_t dev_start;
+    {
+        fbl::AutoLock lock(&blobstore_->lock_);
+        if (GetState() != kBlobStateDataWrite) {
+            return ZX_ERR_BAD_STATE;
         }
+        const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+        blob_size = inode->blob_size;
+        merkle_blocks = MerkleTreeBlocks(*inode);
+        dev_start = inode->start_block + DataStartBlock(blobstore_->info_);
+    }
+    zx_status_t status = WriteData(data, len, blob_size, merkle_blocks, dev_start, actual);
 
-        // No more data to write. Flush to disk.
-        if ((status = WriteMetadata()) != ZX_OK) {
-            SetState(kBlobStateError);
-            return status;
-        }
+    fbl::AutoLock lock(&blobstore_->lock_);
+    if (status != ZX_OK) {
+        SetState(kBlobStateError);
+        return status;
+    }
+
+    // More data to write.
+    if (bytes_written_ < blob_size) {
         return ZX_OK;
     }
 
-    return ZX_ERR_BAD_STATE;
+    // All of the data was just checked against the digest.
+    verified_.Set(0, verified_.size());
+
+    // No more data to write. Flush to disk.
+    if ((status = WriteMetadata()) != ZX_OK) {
+        SetState(kBlobStateError);
+        return status;
+    }
+    UpdateLoaded();
+    return ZX_OK;
 }
 
 zx_status_t VnodeBlob::GetReadableEvent(zx_handle_t* out) {
@@ -397,14 +577,17 @@ zx_status_t VnodeBlob::CopyVmo(zx_rights_t rights, zx_handle_t* out) {
     if (GetState() != kBlobStateReadable) {
         return ZX_ERR_BAD_STATE;
     }
-    zx_status_t status = InitVmos();
-    if (status != ZX_OK) {
-        return status;
-    }
-
     auto inode = blobstore_->GetNode(map_index_);
     // TODO(smklein): Only clone / verify the part of the vmo that
     // was requested.
+    zx_status_t status;
+    if ((status = InitVmos()) != ZX_OK) {
+        return status;
+    } else if ((status = LoadData(0, inode->blob_size)) != ZX_OK) {
+        return status;
+    }
+    UpdateLoaded();
+
     const size_t data_start = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
     zx_handle_t clone;
     if ((status = zx_vmo_clone(blob_->GetVmo(), ZX_VMO_CLONE_COPY_ON_WRITE,
@@ -442,10 +625,37 @@ zx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
         len = inode->blob_size - off;
     }
 
+    if ((status = LoadData(off, len)) != ZX_OK) {
+        return status;
+    }
+    UpdateLoaded();
     const size_t data_start = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
     return zx_vmo_read(blob_->GetVmo(), data, data_start + off, len, actual);
 }
 
+zx_status_t VnodeBlob::ReadLoaded(void* data, size_t len, size_t off, size_t* actual) {
+    TRACE_DURATION("blobstore", "Blobstore::ReadLoaded", "len", len, "off", off);
+    if (off >= loaded_size_) {
+        *actual = 0;
+        return ZX_OK;
+    }
+    if (len > (loaded_size_ - off)) {
+        len = loaded_size_ - off;
+    }
+    return zx_vmo_read(blob_->GetVmo(), data, loaded_data_start_ + off, len, actual);
+}
+
+void VnodeBlob::UpdateLoaded() {
+    if (loaded_.load(fbl::memory_order_relaxed) || (GetState() != kBlobStateReadable) ||
+        (blob_ == nullptr) || (verified_.Scan(0, verified_.size(), true) != verified_.size())) {
+        return;
+    }
+    const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    loaded_data_start_ = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
+    loaded_size_ = inode->blob_size;
+    loaded_.store(true, fbl::memory_order_release);
+}
+
 void VnodeBlob::QueueUnlink() {
     flags_ |= kBlobFlagDeletable;
 }
@@ -479,6 +689,66 @@ void Blobstore::FreeBlocks(size_t nblocks, size_t blkno) {
     assert(status == ZX_OK);
 }
 
+void Blobstore::TrimRequest(size_t nblocks, size_t blkno, block_fifo_request_t* out) const {
+    const uint64_t kDiskBlocksPerBlobstoreBlock = kBlobstoreBlockSize / BlockSize();
+    out->txnid = TxnId();
+    out->vmoid = VMOID_INVALID;
+    out->opcode = BLOCKIO_TRIM;
+    out->vmo_offset = 0;
+    out->dev_offset = (DataStartBlock(info_) + blkno) * kDiskBlocksPerBlobstoreBlock;
+    out->length = static_cast<uint32_t>(nblocks * kDiskBlocksPerBlobstoreBlock);
+}
+
+void Blobstore::TrimBlocks(size_t nblocks, size_t blkno) {
+    if (nblocks == 0 || !TrimSupported()) {
+        return;
+    }
+    TRACE_DURATION("blobstore", "Blobstore::TrimBlocks", "nblocks", nblocks, "blkno", blkno);
+    block_fifo_request_t request;
+    TrimRequest(nblocks, blkno, &request);
+    zx_status_t status = Txn(&request, 1);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("blobstore: trim failed: %d\n", status);
+    }
+}
+
+zx_status_t Blobstore::TrimFree(uint64_t* out_bytes) {
+    TRACE_DURATION("blobstore", "Blobstore::TrimFree");
+    if (!TrimSupported()) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    fbl::AutoLock lock(&lock_);
+    block_fifo_request_t requests[MAX_TXN_MESSAGES];
+    size_t count = 0;
+    uint64_t blocks = 0;
+    size_t start = 0;
+    while (block_map_.Find(false, start, block_map_.size(), 1, &start) == ZX_OK) {
+        size_t end;
+        if (block_map_.Find(true, start, block_map_.size(), 1, &end) != ZX_OK) {
+            end = block_map_.size();
+        }
+        TrimRequest(end - start, start, &requests[count++]);
+        blocks += end - start;
+        start = end;
+
+        if (count == MAX_TXN_MESSAGES) {
+            zx_status_t status;
+            if ((status = Txn(requests, count)) != ZX_OK) {
+                return status;
+            }
+            count = 0;
+        }
+    }
+    if (count != 0) {
+        zx_status_t status;
+        if ((status = Txn(requests, count)) != ZX_OK) {
+            return status;
+        }
+    }
+    *out_bytes = blocks * kBlobstoreBlockSize;
+    return ZX_OK;
+}
+
 // Allocates a node IN MEMORY
 zx_status_t Blobstore::AllocateNode(size_t* node_index_out) {
     TRACE_DURATION("blobstore", "Blobstore::AllocateNode");
@@ -553,13 +823,6 @@ zx_status_t Blobstore::WriteNode(WriteTxn* txn, size_t map_index) {
 
 zx_status_t Blobstore::NewBlob(const Digest& digest, fbl::RefPtr<VnodeBlob>* out) {
     TRACE_DURATION("blobstore", "Blobstore::NewBlob");
-    zx_status_t status;
-    // If the blob already exists (or we're having trouble looking up the blob),
-    // return an error.
-    if ((status = LookupBlob(digest, nullptr)) != ZX_ERR_NOT_FOUND) {
-        return (status == ZX_OK) ? ZX_ERR_ALREADY_EXISTS : status;
-    }
-
     fbl::AllocChecker ac;
     *out = fbl::AdoptRef(new (&ac) VnodeBlob(fbl::RefPtr<Blobstore>(this), digest));
     if (!ac.check()) {
@@ -578,16 +841,20 @@ zx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
     // Ex: open, alloc, disk write async start, unlink, release, disk write async end.
     // FWIW, this isn't a problem right now with synchronous writes, but it
     // would become a problem with asynchronous writes.
+
+    // LookupBlob() drops a blob from the map itself if it finds it being
+    // destroyed, and may have put another vnode for it there since.
+    if (VnodeBlob::TypeWavlTraits::node_state(*vn).InContainer()) {
+        hash_.erase(*vn);
+    }
     switch (vn->GetState()) {
     case kBlobStateEmpty: {
         // There are no in-memory or on-disk structures allocated.
-        hash_.erase(*vn);
         return ZX_OK;
     }
     case kBlobStateReadable: {
         if (!vn->DeletionQueued()) {
             // We want in-memory and on-disk data to persist.
-            hash_.erase(*vn);
             return ZX_OK;
         }
         // Fall-through
@@ -604,7 +871,7 @@ zx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
         WriteNode(&txn, node_index);
         WriteBitmap(&txn, nblocks, start_block);
         CountUpdate(&txn);
-        hash_.erase(*vn);
+        TrimBlocks(nblocks, start_block);
         return ZX_OK;
     }
     default: {
@@ -647,42 +914,64 @@ typedef struct dircookie {
 static_assert(sizeof(dircookie_t) <= sizeof(fs::vdircookie_t),
               "Blobstore dircookie too large to fit in IO state");
 
-zx_status_t Blobstore::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
-                               size_t* out_actual) {
-    TRACE_DURATION("blobstore", "Blobstore::Readdir", "len", len);
-    fs::DirentFiller df(dirents, len);
+zx_status_t Blobstore::Readdir(fs::vdircookie_t* cookie, fs::DirentFiller* df) {
+    TRACE_DURATION("blobstore", "Blobstore::Readdir");
     dircookie_t* c = reinterpret_cast<dircookie_t*>(cookie);
 
     for (size_t i = c->index; i < info_.inode_count; ++i) {
-        if (GetNode(i)->start_block >= kStartBlockMinimum) {
-            Digest digest(GetNode(i)->merkle_root_hash);
+        const blobstore_inode_t* inode = GetNode(i);
+        if (inode->start_block >= kStartBlockMinimum) {
+            Digest digest(inode->merkle_root_hash);
             char name[Digest::kLength * 2 + 1];
             zx_status_t r = digest.ToString(name, sizeof(name));
             if (r < 0) {
                 return r;
             }
-            if ((r = df.Next(fbl::StringPiece(name, Digest::kLength * 2),
-                             VTYPE_TO_DTYPE(V_TYPE_FILE))) != ZX_OK) {
+            fbl::StringPiece entry(name, Digest::kLength * 2);
+            if (df->WithAttrs()) {
+                // As VnodeBlob::Getattr, once the blob is readable.
+                vnattr_t attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.mode = V_TYPE_FILE | V_IRUSR;
+                attr.size = inode->blob_size;
+                attr.blksize = kBlobstoreBlockSize;
+                attr.blkcount = inode->num_blocks * (kBlobstoreBlockSize / VNATTR_BLKSIZE);
+                attr.nlink = 1;
+                r = df->Next(entry, VTYPE_TO_DTYPE(V_TYPE_FILE), attr);
+            } else {
+                r = df->Next(entry, VTYPE_TO_DTYPE(V_TYPE_FILE));
+            }
+            if (r != ZX_OK) {
                 break;
             }
             c->index = i + 1;
         }
     }
-
-    *out_actual = df.BytesFilled();
     return ZX_OK;
 }
 
 zx_status_t Blobstore::LookupBlob(const Digest& digest, fbl::RefPtr<VnodeBlob>* out) {
     TRACE_DURATION("blobstore", "Blobstore::LookupBlob");
     // Look up blob in the fast map (is the blob open elsewhere?)
-    fbl::RefPtr<VnodeBlob> vn = fbl::RefPtr<VnodeBlob>(hash_.find(digest.AcquireBytes()).CopyPointer());
+    auto iter = hash_.find(digest.AcquireBytes());
     digest.ReleaseBytes();
-    if (vn != nullptr) {
-        if (out != nullptr) {
-            *out = fbl::move(vn);
+    if (iter.IsValid()) {
+        // The last reference to the blob may have just gone, leaving it
+        // waiting on lock_ to be released.
+        VnodeBlob* raw = iter.CopyPointer();
+        fbl::RefPtr<VnodeBlob> vn = fbl::internal::MakeRefPtrUpgradeFromRaw(raw, lock_);
+        if (vn != nullptr) {
+            if (out != nullptr) {
+                *out = fbl::move(vn);
+            }
+            return ZX_OK;
+        }
+        // Unless it stays on disk, it is as good as gone. If it does, it
+        // is looked up again below, into a new vnode.
+        hash_.erase(*raw);
+        if ((raw->GetState() != kBlobStateReadable) || raw->DeletionQueued()) {
+            return ZX_ERR_NOT_FOUND;
         }
-        return ZX_OK;
     }
 
     // Look up blob in the slow map
@@ -930,7 +1219,11 @@ zx_status_t Blobstore::LoadBitmaps() {
     ReadTxn txn(this);
     txn.Enqueue(block_map_vmoid_, 0, BlockMapStartBlock(info_), BlockMapBlocks(info_));
     txn.Enqueue(node_map_vmoid_, 0, NodeMapStartBlock(info_), NodeMapBlocks(info_));
-    return txn.Flush();
+    zx_status_t status = txn.Flush();
+    if (status == ZX_OK) {
+        block_map_.RebuildSummary();
+    }
+    return status;
 }
 
 zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd) {
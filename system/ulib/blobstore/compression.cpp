@@ -0,0 +1,79 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <lz4/lz4.h>
+
+#include <blobstore/compression.h>
+
+namespace blobstore {
+namespace {
+
+size_t FrameLength(const blobstore_inode_t& inode, uint64_t frame) {
+    return fbl::min(kBlobstoreLZ4FrameSize, inode.blob_size - frame * kBlobstoreLZ4FrameSize);
+}
+
+} // namespace
+
+static_assert(kBlobstoreLZ4FrameSize <= LZ4_MAX_INPUT_SIZE, "LZ4 frames are too large");
+
+zx_status_t LZ4CompressBlob(const blobstore_inode_t& inode, const void* data,
+                            fbl::unique_ptr<uint8_t[]>* out, uint64_t* out_size) {
+    const uint64_t frames = LZ4FrameCount(inode);
+    const uint64_t bound = LZ4TableSize(inode) +
+                           frames * LZ4_COMPRESSBOUND(kBlobstoreLZ4FrameSize);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[bound]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    uint64_t* table = reinterpret_cast<uint64_t*>(buf.get());
+    uint64_t size = LZ4TableSize(inode);
+    for (uint64_t i = 0; i < frames; i++) {
+        const char* src = static_cast<const char*>(data) + i * kBlobstoreLZ4FrameSize;
+        int len = LZ4_compress_default(src, reinterpret_cast<char*>(buf.get() + size),
+                                       static_cast<int>(FrameLength(inode, i)),
+                                       static_cast<int>(bound - size));
+        if (len <= 0) {
+            return ZX_ERR_INTERNAL;
+        }
+        size += len;
+        table[i] = size;
+    }
+
+    *out = fbl::move(buf);
+    *out_size = size;
+    return ZX_OK;
+}
+
+zx_status_t LZ4FrameExtent(const blobstore_inode_t& inode, const uint64_t* table,
+                           uint64_t stored_size, uint64_t frame, uint64_t* start,
+                           uint64_t* end) {
+    if (frame >= LZ4FrameCount(inode)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+    *start = (frame == 0) ? LZ4TableSize(inode) : table[frame - 1];
+    *end = table[frame];
+    if ((*start > *end) || (*end > stored_size) ||
+        (*end - *start > static_cast<uint64_t>(LZ4_COMPRESSBOUND(kBlobstoreLZ4FrameSize)))) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    return ZX_OK;
+}
+
+zx_status_t LZ4DecompressFrame(const blobstore_inode_t& inode, uint64_t frame,
+                               const void* src, size_t src_len, void* dst) {
+    const size_t len = FrameLength(inode, frame);
+    int r = LZ4_decompress_safe(static_cast<const char*>(src), static_cast<char*>(dst),
+                                static_cast<int>(src_len), static_cast<int>(len));
+    if ((r < 0) || (static_cast<size_t>(r) != len)) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    return ZX_OK;
+}
+
+} // namespace blobstore
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -23,6 +24,7 @@
 
 #define MXDEBUG 0
 
+#include <blobstore/compression.h>
 #include <blobstore/format.h>
 #include <blobstore/fsck.h>
 #include <blobstore/host.h>
@@ -60,6 +62,30 @@ zx_status_t writeblk_offset(int fd, uint64_t bno, off_t offset, const void* data
     return ZX_OK;
 }
 
+// Writes |nblocks| consecutive blocks from |data| starting at block |bno|.
+// Positioned writes leave the file offset alone, so threads writing to
+// distinct blocks don't need to serialize.
+static zx_status_t writeblks_offset(int fd, uint64_t bno, off_t offset, const void* data,
+                                    uint64_t nblocks) {
+    off_t off = offset + bno * kBlobstoreBlockSize;
+    const uint8_t* buf = static_cast<const uint8_t*>(data);
+    size_t len = nblocks * kBlobstoreBlockSize;
+    while (len > 0) {
+        ssize_t r = pwrite(fd, buf, len, off);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        } else if (r <= 0) {
+            fprintf(stderr, "blobstore: cannot write block %" PRIu64 "\n",
+                    (off - offset) / kBlobstoreBlockSize);
+            return ZX_ERR_IO;
+        }
+        buf += r;
+        off += r;
+        len -= r;
+    }
+    return ZX_OK;
+}
+
 zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd fd) {
     info_block_t info_block;
 
@@ -149,7 +175,7 @@ zx_status_t blobstore_create_sparse(fbl::RefPtr<Blobstore>* out, fbl::unique_fd
 
 std::mutex add_blob_mutex_;
 
-zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd) {
+zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd, bool compress) {
     // Mmap user-provided file, create the corresponding merkle tree
     struct stat s;
     if (fstat(data_fd, &s) < 0) {
@@ -176,34 +202,69 @@ zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd) {
         return status;
     }
 
-    std::lock_guard<std::mutex> lock(add_blob_mutex_);
-    fbl::unique_ptr<InodeBlock> inode_block;
-    if ((status = bs->NewBlob(digest, &inode_block)) < 0) {
-        return status;
-    }
-    if (inode_block == nullptr) {
-        fprintf(stderr, "error: No nodes available on blobstore image\n");
-        return ZX_ERR_NO_RESOURCES;
+    // The blob is only stored compressed if that saves any blocks.
+    fbl::unique_ptr<uint8_t[]> compressed;
+    uint64_t compressed_size = 0;
+    if (compress) {
+        blobstore_inode_t sizing = {};
+        sizing.blob_size = s.st_size;
+        if ((status = LZ4CompressBlob(sizing, blob_data, &compressed,
+                                      &compressed_size)) != ZX_OK) {
+            return status;
+        } else if (fbl::round_up(compressed_size, kBlobstoreBlockSize) >=
+                   fbl::round_up(sizing.blob_size, kBlobstoreBlockSize)) {
+            compressed.reset();
+        }
     }
 
-    inode_block->SetSize(s.st_size);
-    blobstore_inode_t* inode = inode_block->GetInode();
+    // Only the allocation of the node and its blocks is serialized; the
+    // blocks themselves are written outside the lock, concurrently with
+    // other blobs.
+    blobstore_inode_t inode;
+    const void* stored_data = blob_data;
+    uint64_t stored_size = s.st_size;
+    {
+        std::lock_guard<std::mutex> lock(add_blob_mutex_);
+        fbl::unique_ptr<InodeBlock> inode_block;
+        if ((status = bs->NewBlob(digest, &inode_block)) < 0) {
+            return status;
+        }
+        if (inode_block == nullptr) {
+            fprintf(stderr, "error: No nodes available on blobstore image\n");
+            return ZX_ERR_NO_RESOURCES;
+        }
 
-    if ((status = bs->AllocateBlocks(inode->num_blocks,
-                                     reinterpret_cast<size_t*>(&inode->start_block))) != ZX_OK) {
-        fprintf(stderr, "error: No blocks available\n");
-        return status;
-    } else if ((status = bs->WriteData(inode, merkle_tree.get(), blob_data)) != ZX_OK) {
-        return status;
-    } else if ((status = bs->WriteBitmap(inode->num_blocks, inode->start_block)) != ZX_OK) {
-        return status;
-    } else if ((status = bs->WriteNode(fbl::move(inode_block))) != ZX_OK) {
-        return status;
-    } else if ((status = bs->WriteInfo()) != ZX_OK) {
-        return status;
+        inode_block->SetSize(s.st_size);
+        blobstore_inode_t* node = inode_block->GetInode();
+        if (compressed != nullptr) {
+            node->flags |= kBlobstoreInodeFlagLZ4;
+            node->num_blocks = MerkleTreeBlocks(*node) +
+                               fbl::round_up(compressed_size, kBlobstoreBlockSize) /
+                               kBlobstoreBlockSize;
+            stored_data = compressed.get();
+            stored_size = compressed_size;
+        }
+
+        if ((status = bs->AllocateBlocks(node->num_blocks,
+                                         reinterpret_cast<size_t*>(&node->start_block)))
+            != ZX_OK) {
+            fprintf(stderr, "error: No blocks available\n");
+            return status;
+        }
+
+        // |node| points into the block cache, which is reused once the lock
+        // is dropped.
+        inode = *node;
+        if ((status = bs->WriteBitmap(inode.num_blocks, inode.start_block)) != ZX_OK) {
+            return status;
+        } else if ((status = bs->WriteNode(fbl::move(inode_block))) != ZX_OK) {
+            return status;
+        } else if ((status = bs->WriteInfo()) != ZX_OK) {
+            return status;
+        }
     }
 
-    return ZX_OK;
+    return bs->WriteData(&inode, merkle_tree.get(), stored_data, stored_size);
 }
 
 zx_status_t blobstore_fsck(fbl::unique_fd fd, off_t start, off_t end,
@@ -221,6 +282,7 @@ zx_status_t blobstore_fsck(fbl::unique_fd fd, off_t start, off_t end,
 
 void InodeBlock::SetSize(size_t size) {
     inode_->blob_size = size;
+    inode_->flags = 0;
     inode_->num_blocks = MerkleTreeBlocks(*inode_) + BlobDataBlocks(*inode_);
 }
 
@@ -292,6 +354,7 @@ zx_status_t Blobstore::LoadBitmap() {
             memcpy(bmdata, cache_.blk, kBlobstoreBlockSize);
         }
     }
+    block_map_.RebuildSummary();
     return ZX_OK;
 }
 
@@ -384,33 +447,32 @@ zx_status_t Blobstore::WriteNode(fbl::unique_ptr<InodeBlock> ino_block) {
     return WriteBlock(cache_.bno, cache_.blk);
 }
 
-zx_status_t Blobstore::WriteData(blobstore_inode_t* inode, void* merkle_data, void* blob_data) {
-    for (size_t n = 0; n < MerkleTreeBlocks(*inode); n++) {
-        const void* data = fs::GetBlock<kBlobstoreBlockSize>(merkle_data, n);
-        uint64_t bno = data_start_block_ + inode->start_block + n;
-        zx_status_t status;
-        if ((status = WriteBlock(bno, data)) != ZX_OK) {
-            return status;
-        }
+zx_status_t Blobstore::WriteData(blobstore_inode_t* inode, const void* merkle_data,
+                                 const void* blob_data, uint64_t blob_size) {
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    const uint64_t start = data_start_block_ + inode->start_block;
+    zx_status_t status;
+    if ((status = writeblks_offset(blockfd_.get(), start, offset_, merkle_data,
+                                   merkle_blocks)) != ZX_OK) {
+        return status;
     }
 
-    for (size_t n = 0; n < BlobDataBlocks(*inode); n++) {
-        const void* data = fs::GetBlock<kBlobstoreBlockSize>(blob_data, n);
+    // Full blocks are written straight from |blob_data|. A partial last
+    // block would reach beyond the end of a mapped file, so it goes through
+    // a zero-padded buffer instead.
+    const uint64_t full_blocks = blob_size / kBlobstoreBlockSize;
+    if ((status = writeblks_offset(blockfd_.get(), start + merkle_blocks, offset_, blob_data,
+                                   full_blocks)) != ZX_OK) {
+        return status;
+    }
 
-        // If we try to write a block, will it be reaching beyond the end of the
-        // mapped file?
-        size_t off = n * kBlobstoreBlockSize;
+    const size_t tail = blob_size % kBlobstoreBlockSize;
+    if (tail != 0) {
         uint8_t last_data[kBlobstoreBlockSize];
-        if (inode->blob_size < off + kBlobstoreBlockSize) {
-            // Read the partial block from a block-sized buffer which zero-pads the data.
-            memset(last_data, 0, kBlobstoreBlockSize);
-            memcpy(last_data, data, inode->blob_size - off);
-            data = last_data;
-        }
-
-        uint64_t bno = data_start_block_ + inode->start_block + MerkleTreeBlocks(*inode) + n;
-        zx_status_t status;
-        if ((status = WriteBlock(bno, data)) != ZX_OK) {
+        memset(last_data, 0, kBlobstoreBlockSize);
+        memcpy(last_data, fs::GetBlock<kBlobstoreBlockSize>(blob_data, full_blocks), tail);
+        if ((status = writeblks_offset(blockfd_.get(), start + merkle_blocks + full_blocks,
+                                       offset_, last_data, 1)) != ZX_OK) {
             return status;
         }
     }
@@ -438,7 +500,7 @@ zx_status_t Blobstore::ReadBlock(size_t bno) {
 }
 
 zx_status_t Blobstore::WriteBlock(size_t bno, const void* data) {
-    return writeblk_offset(blockfd_.get(), bno, offset_, data);
+    return writeblks_offset(blockfd_.get(), bno, offset_, data, 1);
 }
 
 zx_status_t Blobstore::ResetCache() {
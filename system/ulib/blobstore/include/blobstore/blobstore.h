@@ -13,10 +13,14 @@
 
 #include <bitmap/raw-bitmap.h>
 #include <digest/digest.h>
+#include <digest/merkle-tree.h>
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
+#include <fbl/mutex.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_fd.h>
@@ -69,6 +73,14 @@ constexpr BlobFlags kBlobOtherMask        = 0x0000FF00;
 
 // clang-format on
 
+// Reads of a blob read and verify its data in aligned chunks of this many
+// blocks, so that a sequential reader doesn't go to disk for every read.
+constexpr uint64_t kBlobLoadChunkBlocks = 32;
+
+// Writes of a blob send its data to disk in batches of at least this many
+// complete blocks, rather than a block device transaction per write.
+constexpr uint64_t kBlobWriteBatchBlocks = 32;
+
 class VnodeBlob final : public fs::Vnode {
 public:
     // Intrusive methods and structures
@@ -135,20 +147,31 @@ private:
     // kBlobStateEmpty --> kBlobStateDataWrite
     zx_status_t SpaceAllocate(uint64_t size_data);
 
-    // Writes to either the Merkle Tree or the Data section,
-    // depending on the state.
+    // Writes the next part of the blob's data, hashing it as it arrives.
+    // Once all of it is written and matches the digest, writes out the
+    // Merkle tree and the metadata.
+    // Requires: kBlobStateDataWrite, and lock_ held.
     zx_status_t WriteInternal(const void* data, size_t len, size_t* actual);
 
     // Reads from a blob.
     // Requires: kBlobStateReadable
     zx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
 
+    // Reads from a blob once |loaded_| is set, without Blobstore::lock_.
+    zx_status_t ReadLoaded(void* data, size_t len, size_t off, size_t* actual);
+
+    // Sets |loaded_| if the blob is readable and all of its data is in the
+    // VMO and verified. Called with Blobstore::lock_ held.
+    void UpdateLoaded();
+
     // Vnode I/O operations
     zx_status_t GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* type,
                            zxrio_object_info_t* extra) final;
     zx_status_t ValidateFlags(uint32_t flags) final;
     zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
                         size_t* out_actual) final;
+    zx_status_t ReaddirAttr(fs::vdircookie_t* cookie, void* dirents, size_t len,
+                            size_t* out_actual) final;
     zx_status_t Read(void* data, size_t len, size_t off, size_t* out_actual) final;
     zx_status_t Write(const void* data, size_t len, size_t offset,
                       size_t* out_actual) final;
@@ -163,19 +186,33 @@ private:
     zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) final;
     zx_status_t Sync() final;
 
-    // Read both VMOs into memory, if we haven't already.
+    // Creates the blob's VMO and reads the Merkle tree into it, if we haven't
+    // already. The data is read in as it is accessed, by LoadData().
     //
     // TODO(ZX-1481): When we have can register the Blob Store as a pager
     // service, and it can properly handle pages faults on a vnode's contents,
-    // then we can avoid reading the entire blob up-front. Until then, read
-    // the contents of a VMO into memory when it is opened.
+    // LoadData() can be called from the fault instead.
     zx_status_t InitVmos();
 
-    // Verify the integrity of the in-memory Blob.
-    // InitVmos() must have already been called for this blob.
-    zx_status_t Verify() const;
-
-    zx_status_t WriteShared(WriteTxn* txn, size_t start, size_t len, uint64_t start_block);
+    // Makes [offset, offset + length) of the blob's data readable from the
+    // VMO: reads in the blocks of it which aren't yet, and verifies them
+    // against the Merkle tree. InitVmos() must have already been called.
+    zx_status_t LoadData(size_t offset, size_t length);
+
+    // LoadData() for compressed blobs: reads in, decompresses and verifies
+    // the frames holding data blocks [first, last).
+    zx_status_t LoadCompressedData(uint64_t first, uint64_t last);
+
+    // Verify the integrity of [offset, offset + length) of the in-memory blob,
+    // or of all of it.
+    zx_status_t Verify(size_t offset, size_t length) const;
+
+    // The part of WriteInternal() done without the filesystem lock: copies
+    // the data into the VMO, hashes it, and writes out whatever complete
+    // blocks are due. The blob's layout is passed in, since the node map
+    // may move meanwhile.
+    zx_status_t WriteData(const void* data, size_t len, uint64_t blob_size,
+                          uint64_t merkle_blocks, uint64_t dev_start, size_t* actual);
     // Called by Blob once the last write has completed, updating the
     // on-disk metadata.
     zx_status_t WriteMetadata();
@@ -184,6 +221,10 @@ private:
     void* GetData() const;
     void* GetMerkle() const;
 
+    // Held across writes and allocation of the blob, whose data is written
+    // without Blobstore::lock_. Taken before Blobstore::lock_.
+    fbl::Mutex lock_;
+
     WAVLTreeNodeState type_wavl_state_{};
 
     const fbl::RefPtr<Blobstore> blobstore_;
@@ -194,9 +235,26 @@ private:
     // 2) The Blob itself, aligned to the nearest kBlobstoreBlockSize
     fbl::unique_ptr<MappedVmo> blob_{};
     vmoid_t vmoid_{};
+    // The data blocks of blob_ which have been read in and verified. Sized
+    // once the Merkle tree has been read in.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> verified_{};
+    // Set once all of blob_'s data is read in and verified. Neither blob_ nor
+    // its contents change after that, so reads skip Blobstore::lock_ and use
+    // the data's layout saved below.
+    fbl::atomic_bool loaded_{false};
+    size_t loaded_data_start_{};
+    uint64_t loaded_size_{};
+    // For compressed blobs, the data as stored on disk, read in as it is
+    // needed.
+    fbl::unique_ptr<MappedVmo> compressed_{};
+    vmoid_t compressed_vmoid_{};
 
     zx::event readable_event_{};
     uint64_t bytes_written_{};
+    // While the blob is written: the tree built from the data so far, and
+    // how many of its data blocks are on disk.
+    fbl::unique_ptr<digest::MerkleTree> merkle_{};
+    uint64_t blocks_written_{};
     uint8_t digest_[Digest::kLength]{};
 
     size_t map_index_{};
@@ -242,7 +300,7 @@ public:
     zx_status_t LookupBlob(const Digest& digest, fbl::RefPtr<VnodeBlob>* out);
 
     // Creates a new blob in-memory, with no backing disk storage (yet).
-    // If a blob with the name already exists, this function fails.
+    // The caller must have checked that no blob with the name exists.
     //
     // Adds Blob to the "quick lookup" map.
     zx_status_t NewBlob(const Digest& digest, fbl::RefPtr<VnodeBlob>* out);
@@ -250,14 +308,21 @@ public:
     // Removes blob from 'active' hashmap.
     zx_status_t ReleaseBlob(VnodeBlob* blob);
 
-    zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len, size_t* out_actual);
+    // Lists the blobs into |df|, with the attributes a readable blob reports
+    // if it wants them.
+    zx_status_t Readdir(fs::vdircookie_t* cookie, fs::DirentFiller* df);
 
     zx_status_t AttachVmo(zx_handle_t vmo, vmoid_t* out);
     zx_status_t Txn(block_fifo_request_t* requests, size_t count) {
         TRACE_DURATION("blobstore", "Blobstore::Txn", "count", count);
+        fbl::AutoLock lock(&txn_lock_);
         return block_fifo_txn(fifo_client_, requests, count);
     }
     uint32_t BlockSize() const { return block_info_.block_size; }
+    bool TrimSupported() const { return (block_info_.flags & BLOCK_FLAG_TRIM_SUPPORT) != 0; }
+
+    // Trims every free block, returning the number of bytes trimmed.
+    zx_status_t TrimFree(uint64_t* out_bytes);
 
     txnid_t TxnId() const { return txnid_; }
 
@@ -276,6 +341,11 @@ public:
 
     blobstore_info_t info_;
 
+    // Guards the in-memory state of the filesystem and its blobs: the blob
+    // map, the bitmaps, the node map, info_ and each blob's state. Held by
+    // every vnode operation, except while a write copies and hashes data.
+    fbl::Mutex lock_;
+
 private:
     friend class BlobstoreChecker;
 
@@ -286,6 +356,12 @@ private:
     zx_status_t AllocateBlocks(size_t nblocks, size_t* blkno_out);
     void FreeBlocks(size_t nblocks, size_t blkno);
 
+    // Discards the contents of freed blocks, if the device can. Called once
+    // the bitmap freeing them is on disk, with lock_ held so they are not
+    // allocated again in the meantime.
+    void TrimBlocks(size_t nblocks, size_t blkno);
+    void TrimRequest(size_t nblocks, size_t blkno, block_fifo_request_t* out) const;
+
     // Finds space for a blob node in memory. Does not update disk.
     zx_status_t AllocateNode(size_t* node_index_out);
     void FreeNode(size_t node_index);
@@ -319,6 +395,8 @@ private:
     block_info_t block_info_{};
     fifo_client_t* fifo_client_{};
     txnid_t txnid_{};
+    // Every transaction shares txnid_, so only one may be in flight.
+    fbl::Mutex txn_lock_;
     RawBitmap block_map_{};
     vmoid_t block_map_vmoid_{};
     fbl::unique_ptr<MappedVmo> node_map_{};
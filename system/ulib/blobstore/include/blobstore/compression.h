@@ -0,0 +1,36 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file contains the LZ4 compression of blob data, shared between host
+// and target implementations of Blobstore.
+
+#pragma once
+
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <blobstore/format.h>
+
+namespace blobstore {
+
+// Compresses the |inode->blob_size| bytes of |data| into |*out|, laid out as
+// described in format.h, and sets |*out_size| to the number of bytes of it.
+zx_status_t LZ4CompressBlob(const blobstore_inode_t& inode, const void* data,
+                            fbl::unique_ptr<uint8_t[]>* out, uint64_t* out_size);
+
+// Finds the bytes [*start, *end) of a compressed blob's data which hold frame
+// |frame|, from its table |table|. |stored_size| bounds the compressed data.
+zx_status_t LZ4FrameExtent(const blobstore_inode_t& inode, const uint64_t* table,
+                           uint64_t stored_size, uint64_t frame, uint64_t* start,
+                           uint64_t* end);
+
+// Decompresses |frame| of a compressed blob, whose bytes are |src|, into
+// |dst|, which points at the frame's offset within the blob's data.
+zx_status_t LZ4DecompressFrame(const blobstore_inode_t& inode, uint64_t frame,
+                               const void* src, size_t src_len, void* dst);
+
+} // namespace blobstore
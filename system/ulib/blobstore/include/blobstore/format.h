@@ -108,13 +108,22 @@ constexpr uint64_t kStartBlockFree     = 0;
 constexpr uint64_t kStartBlockReserved = 1;
 constexpr uint64_t kStartBlockMinimum  = 2; // Smallest 'data' block possible
 
+// Flags of a blob's inode.
+constexpr uint32_t kBlobstoreInodeFlagLZ4 = 1; // Data is stored LZ4 compressed
+
+// A compressed blob's data is split into frames of this many blocks, each
+// compressed on its own, so that any of them may be read alone.
+constexpr uint64_t kBlobstoreLZ4FrameBlocks = 32;
+constexpr uint64_t kBlobstoreLZ4FrameSize   = kBlobstoreLZ4FrameBlocks * kBlobstoreBlockSize;
+
 using digest::Digest;
 typedef struct {
     uint8_t  merkle_root_hash[Digest::kLength];
     uint64_t start_block;
     uint64_t num_blocks;
     uint64_t blob_size;
-    uint64_t reserved;
+    uint32_t flags;
+    uint32_t reserved;
 } blobstore_inode_t;
 
 static_assert(sizeof(blobstore_inode_t) == kBlobstoreInodeSize,
@@ -122,9 +131,20 @@ static_assert(sizeof(blobstore_inode_t) == kBlobstoreInodeSize,
 static_assert(kBlobstoreBlockSize % kBlobstoreInodeSize == 0,
               "Blobstore Inodes should fit cleanly within a blobstore block");
 
-// Number of blocks reserved for the blob itself
+// Number of blocks of the blob's uncompressed data
 constexpr uint64_t BlobDataBlocks(const blobstore_inode_t& blobNode) {
     return fbl::round_up(blobNode.blob_size, kBlobstoreBlockSize) / kBlobstoreBlockSize;
 }
 
+// Compressed blobs store their data as a table of the uint64_t end offsets of
+// each frame, relative to the start of the table, followed by the frames
+// themselves, packed one after another.
+constexpr uint64_t LZ4FrameCount(const blobstore_inode_t& blobNode) {
+    return fbl::round_up(blobNode.blob_size, kBlobstoreLZ4FrameSize) / kBlobstoreLZ4FrameSize;
+}
+
+constexpr uint64_t LZ4TableSize(const blobstore_inode_t& blobNode) {
+    return LZ4FrameCount(blobNode) * sizeof(uint64_t);
+}
+
 } // namespace blobstore
@@ -80,7 +80,11 @@ public:
     // Allocate |nblocks| starting at |*blkno_out| in memory
     zx_status_t AllocateBlocks(size_t nblocks, size_t* blkno_out);
 
-    zx_status_t WriteData(blobstore_inode_t* inode, void* merkle_data, void* blob_data);
+    // Writes the Merkle tree of |inode| and the |blob_size| bytes of its data,
+    // as stored on disk, to its blocks. May be called concurrently for
+    // distinct inodes.
+    zx_status_t WriteData(blobstore_inode_t* inode, const void* merkle_data,
+                          const void* blob_data, uint64_t blob_size);
     zx_status_t WriteBitmap(size_t nblocks, size_t start_block);
     zx_status_t WriteNode(fbl::unique_ptr<InodeBlock> ino_block);
     zx_status_t WriteInfo();
@@ -136,8 +140,10 @@ private:
 zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd);
 
 // blobstore_add_blob may be called by multiple threads to gain concurrent
-// merkle tree generation. No other methods are thread safe.
-zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd);
+// merkle tree generation, compression and data writes. No other methods are
+// thread safe.
+// If |compress| is set, the blob is stored LZ4 compressed when that saves space.
+zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd, bool compress);
 zx_status_t blobstore_fsck(fbl::unique_fd fd, off_t start, off_t end,
                            const fbl::Vector<size_t>& extent_lengths);
 
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <threads.h>
 
+#include <fbl/auto_lock.h>
 #include <fs/vfs.h>
 
 #include <fdio/io.h>
@@ -29,6 +30,7 @@ zx_status_t VnodeBlob::GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* ty
     if (IsDirectory()) {
         return ZX_OK;
     }
+    fbl::AutoLock lock(&blobstore_->lock_);
     zx_status_t r = GetReadableEvent(hnd);
     if (r < 0) {
         return r;
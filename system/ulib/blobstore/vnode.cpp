@@ -18,6 +18,7 @@
 #include <zircon/syscalls.h>
 #include <fdio/debug.h>
 #include <fdio/vfs.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 
 #define MXDEBUG 0
@@ -29,6 +30,7 @@ using digest::Digest;
 namespace blobstore {
 
 VnodeBlob::~VnodeBlob() {
+    fbl::AutoLock lock(&blobstore_->lock_);
     blobstore_->ReleaseBlob(this);
     if (blob_ != nullptr) {
         block_fifo_request_t request;
@@ -37,9 +39,17 @@ VnodeBlob::~VnodeBlob() {
         request.opcode = BLOCKIO_CLOSE_VMO;
         blobstore_->Txn(&request, 1);
     }
+    if (compressed_ != nullptr) {
+        block_fifo_request_t request;
+        request.txnid = blobstore_->TxnId();
+        request.vmoid = compressed_vmoid_;
+        request.opcode = BLOCKIO_CLOSE_VMO;
+        blobstore_->Txn(&request, 1);
+    }
 }
 
 zx_status_t VnodeBlob::ValidateFlags(uint32_t flags) {
+    fbl::AutoLock lock(&blobstore_->lock_);
     if ((flags & ZX_FS_FLAG_DIRECTORY) && !IsDirectory()) {
         return ZX_ERR_NOT_DIR;
     }
@@ -60,7 +70,24 @@ zx_status_t VnodeBlob::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t l
         return ZX_ERR_NOT_DIR;
     }
 
-    return blobstore_->Readdir(cookie, dirents, len, out_actual);
+    fbl::AutoLock lock(&blobstore_->lock_);
+    fs::DirentFiller df(dirents, len);
+    zx_status_t r = blobstore_->Readdir(cookie, &df);
+    *out_actual = df.BytesFilled();
+    return r;
+}
+
+zx_status_t VnodeBlob::ReaddirAttr(fs::vdircookie_t* cookie, void* dirents, size_t len,
+                                   size_t* out_actual) {
+    if (!IsDirectory()) {
+        return ZX_ERR_NOT_DIR;
+    }
+
+    fbl::AutoLock lock(&blobstore_->lock_);
+    fs::DirentFiller df(dirents, len, true);
+    zx_status_t r = blobstore_->Readdir(cookie, &df);
+    *out_actual = df.BytesFilled();
+    return r;
 }
 
 zx_status_t VnodeBlob::Read(void* data, size_t len, size_t off, size_t* out_actual) {
@@ -70,6 +97,10 @@ zx_status_t VnodeBlob::Read(void* data, size_t len, size_t off, size_t* out_actu
         return ZX_ERR_NOT_FILE;
     }
 
+    if (loaded_.load(fbl::memory_order_acquire)) {
+        return ReadLoaded(data, len, off, out_actual);
+    }
+    fbl::AutoLock lock(&blobstore_->lock_);
     return ReadInternal(data, len, off, out_actual);
 }
 
@@ -79,13 +110,17 @@ zx_status_t VnodeBlob::Write(const void* data, size_t len, size_t offset,
     if (IsDirectory()) {
         return ZX_ERR_NOT_FILE;
     }
-    zx_status_t status = WriteInternal(data, len, out_actual);
-    return status;
+    fbl::AutoLock lock(&lock_);
+    return WriteInternal(data, len, out_actual);
 }
 
 zx_status_t VnodeBlob::Append(const void* data, size_t len, size_t* out_end,
                               size_t* out_actual) {
-    zx_status_t status = Write(data, len, bytes_written_, out_actual);
+    if (IsDirectory()) {
+        return ZX_ERR_NOT_FILE;
+    }
+    fbl::AutoLock lock(&lock_);
+    zx_status_t status = WriteInternal(data, len, out_actual);
     *out_actual = bytes_written_;
     return status;
 }
@@ -108,7 +143,9 @@ zx_status_t VnodeBlob::Lookup(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
     if ((status = digest.Parse(name.data(), name.length())) != ZX_OK) {
         return status;
     }
+    // Declared before the lock, so that it is released after it.
     fbl::RefPtr<VnodeBlob> vn;
+    fbl::AutoLock lock(&blobstore_->lock_);
     if ((status = blobstore_->LookupBlob(digest, &vn)) < 0) {
         return status;
     }
@@ -117,6 +154,7 @@ zx_status_t VnodeBlob::Lookup(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
 }
 
 zx_status_t VnodeBlob::Getattr(vnattr_t* a) {
+    fbl::AutoLock lock(&blobstore_->lock_);
     memset(a, 0, sizeof(vnattr_t));
     a->mode = (IsDirectory() ? V_TYPE_DIR : V_TYPE_FILE) | V_IRUSR;
     a->inode = 0;
@@ -143,6 +181,12 @@ zx_status_t VnodeBlob::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
     if ((status = digest.Parse(name.data(), name.length())) != ZX_OK) {
         return status;
     }
+    // Declared before the lock, so that it is released after it.
+    fbl::RefPtr<VnodeBlob> existing;
+    fbl::AutoLock lock(&blobstore_->lock_);
+    if ((status = blobstore_->LookupBlob(digest, &existing)) != ZX_ERR_NOT_FOUND) {
+        return (status == ZX_OK) ? ZX_ERR_ALREADY_EXISTS : status;
+    }
     fbl::RefPtr<VnodeBlob> vn;
     if ((status = blobstore_->NewBlob(digest, &vn)) != ZX_OK) {
         return status;
@@ -161,6 +205,7 @@ zx_status_t VnodeBlob::Ioctl(uint32_t op, const void* in_buf, size_t in_len, voi
             return ZX_ERR_INVALID_ARGS;
         }
         vfs_query_info_t* info = static_cast<vfs_query_info_t*>(out_buf);
+        fbl::AutoLock lock(&blobstore_->lock_);
         memset(info, 0, sizeof(*info));
         info->block_size = kBlobstoreBlockSize;
         info->max_filename_size = Digest::kLength * 2;
@@ -195,6 +240,16 @@ zx_status_t VnodeBlob::Ioctl(uint32_t op, const void* in_buf, size_t in_len, voi
         }
         return len > 0 ? ZX_OK : static_cast<zx_status_t>(len);
     }
+    case IOCTL_VFS_TRIM_FS: {
+        if (out_len < sizeof(uint64_t)) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        zx_status_t status = blobstore_->TrimFree(static_cast<uint64_t*>(out_buf));
+        if (status == ZX_OK) {
+            *out_actual = sizeof(uint64_t);
+        }
+        return status;
+    }
 #endif
     default: {
         return ZX_ERR_NOT_SUPPORTED;
@@ -209,6 +264,8 @@ zx_status_t VnodeBlob::Truncate(size_t len) {
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+    fbl::AutoLock lock(&lock_);
+    fbl::AutoLock bs_lock(&blobstore_->lock_);
     return SpaceAllocate(len);
 }
 
@@ -222,7 +279,9 @@ zx_status_t VnodeBlob::Unlink(fbl::StringPiece name, bool must_be_dir) {
 
     zx_status_t status;
     Digest digest;
+    // Declared before the lock, so that it is released after it.
     fbl::RefPtr<VnodeBlob> out;
+    fbl::AutoLock lock(&blobstore_->lock_);
     if ((status = digest.Parse(name.data(), name.length())) != ZX_OK) {
         return status;
     } else if ((status = blobstore_->LookupBlob(digest, &out)) < 0) {
@@ -241,10 +300,12 @@ zx_status_t VnodeBlob::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out
     if (flags & FDIO_MMAP_FLAG_WRITE) {
         return ZX_ERR_NOT_SUPPORTED;
     }
+    // Blobs never change once readable, so FDIO_MMAP_FLAG_STABLE always holds.
 
     zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP;
     rights |= (flags & FDIO_MMAP_FLAG_READ) ? ZX_RIGHT_READ : 0;
     rights |= (flags & FDIO_MMAP_FLAG_EXEC) ? ZX_RIGHT_EXECUTE : 0;
+    fbl::AutoLock lock(&blobstore_->lock_);
     return CopyVmo(rights, out);
 }
 
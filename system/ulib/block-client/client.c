@@ -3,10 +3,14 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
 #include <unistd.h>
 
+#include <async/wait.h>
 #include <zircon/compiler.h>
 #include <zircon/device/block.h>
+#include <zircon/listnode.h>
 #include <zircon/syscalls.h>
 #include <sync/completion.h>
 
@@ -64,10 +68,16 @@ static zx_status_t do_read(zx_handle_t fifo, block_fifo_response_t* response) {
 typedef struct block_completion {
     completion_t completion;
     zx_status_t status;
+    // Only used once responses are read by an async_t.
+    atomic_bool pending;
+    block_fifo_callback_t callback; // NULL for block_fifo_txn
+    void* cookie;
 } block_completion_t;
 
 typedef struct fifo_client {
     zx_handle_t fifo;
+    async_t* async;
+    async_wait_t wait;
     block_completion_t txns[MAX_TXN_COUNT];
 } fifo_client_t;
 
@@ -86,43 +96,145 @@ void block_fifo_release_client(fifo_client_t* client) {
         return;
     }
 
+    if (client->async != NULL) {
+        async_cancel_wait(client->async, &client->wait);
+    }
     zx_handle_close(client->fifo);
     free(client);
 }
 
-zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count) {
-    if (count == 0) {
-        return ZX_OK;
-    } else if (count > MAX_TXN_MESSAGES) {
-        return ZX_ERR_INVALID_ARGS;
-    }
-
+// Marks the requests as one txn, and notes that it is outstanding if an
+// async_t reads the responses.
+static void txn_begin(fifo_client_t* client, block_fifo_request_t* requests, size_t count,
+                      block_fifo_callback_t callback, void* cookie) {
     txnid_t txnid = requests[0].txnid;
     assert(txnid < MAX_TXN_COUNT);
-    completion_reset(&client->txns[txnid].completion);
-    client->txns[txnid].status = ZX_ERR_IO;
+    block_completion_t* txn = &client->txns[txnid];
+    completion_reset(&txn->completion);
+    txn->status = ZX_ERR_IO;
+    txn->callback = callback;
+    txn->cookie = cookie;
 
-    zx_status_t status;
     for (size_t i = 0; i < count; i++) {
         assert(requests[i].txnid == txnid);
         requests[i].opcode = (requests[i].opcode & BLOCKIO_OP_MASK) |
                              (i == count - 1 ? BLOCKIO_TXN_END : 0);
     }
-    if ((status = do_write(client->fifo, &requests[0], count)) != ZX_OK) {
-        return status;
+    if (client->async != NULL) {
+        atomic_store(&txn->pending, true);
     }
+}
 
-    // As expected by the protocol, when we send one "BLOCKIO_TXN_END" message, we
-    // must read a reply message.
-    block_fifo_response_t response;
-    if ((status = do_read(client->fifo, &response)) != ZX_OK) {
+// Completes the outstanding txn |txnid| with |status|, unless it already was.
+static void txn_complete(fifo_client_t* client, txnid_t txnid, zx_status_t status) {
+    if (txnid >= MAX_TXN_COUNT) {
+        return;
+    }
+    block_completion_t* txn = &client->txns[txnid];
+    if ((client->async != NULL) && !atomic_exchange(&txn->pending, false)) {
+        return;
+    }
+    if (txn->callback != NULL) {
+        // Cleared first, since the callback may reuse the txnid.
+        block_fifo_callback_t callback = txn->callback;
+        txn->callback = NULL;
+        callback(txn->cookie, status);
+    } else {
+        txn->status = status;
+        completion_signal(&txn->completion);
+    }
+}
+
+static async_wait_result_t fifo_readable(async_t* async, async_wait_t* wait, zx_status_t status,
+                                         const zx_packet_signal_t* signal) {
+    fifo_client_t* client = containerof(wait, fifo_client_t, wait);
+    if ((status == ZX_OK) && (signal->observed & ZX_FIFO_READABLE)) {
+        block_fifo_response_t responses[BLOCK_FIFO_MAX_DEPTH];
+        uint32_t count;
+        if ((status = zx_fifo_read(client->fifo, responses, sizeof(responses),
+                                   &count)) == ZX_OK) {
+            for (uint32_t i = 0; i < count; i++) {
+                txn_complete(client, responses[i].txnid, responses[i].status);
+            }
+            return ASYNC_WAIT_AGAIN;
+        } else if (status == ZX_ERR_SHOULD_WAIT) {
+            return ASYNC_WAIT_AGAIN;
+        }
+    } else if (status == ZX_OK) {
+        status = ZX_ERR_PEER_CLOSED;
+    }
+
+    // No more responses will come, so nothing outstanding will complete
+    // otherwise.
+    for (txnid_t txnid = 0; txnid < MAX_TXN_COUNT; txnid++) {
+        txn_complete(client, txnid, status);
+    }
+    return ASYNC_WAIT_FINISHED;
+}
+
+zx_status_t block_fifo_set_async(fifo_client_t* client, async_t* async) {
+    if (client->async != NULL) {
+        return ZX_ERR_BAD_STATE;
+    }
+    // The wait's state was zeroed by calloc.
+    client->wait.handler = fifo_readable;
+    client->wait.object = client->fifo;
+    client->wait.trigger = ZX_FIFO_READABLE | ZX_FIFO_PEER_CLOSED;
+    client->wait.flags = 0;
+    zx_status_t status = async_begin_wait(async, &client->wait);
+    if (status != ZX_OK) {
         return status;
     }
+    client->async = async;
+    return ZX_OK;
+}
+
+zx_status_t block_fifo_txn_async(fifo_client_t* client, block_fifo_request_t* requests,
+                                 size_t count, block_fifo_callback_t callback, void* cookie) {
+    if ((count == 0) || (count > MAX_TXN_MESSAGES) || (callback == NULL)) {
+        return ZX_ERR_INVALID_ARGS;
+    } else if (client->async == NULL) {
+        return ZX_ERR_BAD_STATE;
+    }
 
-    // Wake up someone who is waiting (it might be ourselves)
-    txnid_t response_txnid = response.txnid;
-    client->txns[response_txnid].status = response.status;
-    completion_signal(&client->txns[response_txnid].completion);
+    txn_begin(client, requests, count, callback, cookie);
+    zx_status_t status;
+    if ((status = do_write(client->fifo, &requests[0], count)) != ZX_OK) {
+        // Unless the fifo closing already completed it.
+        if (atomic_exchange(&client->txns[requests[0].txnid].pending, false)) {
+            client->txns[requests[0].txnid].callback = NULL;
+            return status;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count) {
+    if (count == 0) {
+        return ZX_OK;
+    } else if (count > MAX_TXN_MESSAGES) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    txnid_t txnid = requests[0].txnid;
+    txn_begin(client, requests, count, NULL, NULL);
+
+    zx_status_t status;
+    if ((status = do_write(client->fifo, &requests[0], count)) != ZX_OK) {
+        if ((client->async == NULL) || atomic_exchange(&client->txns[txnid].pending, false)) {
+            return status;
+        }
+    } else if (client->async == NULL) {
+        // As expected by the protocol, when we send one "BLOCKIO_TXN_END" message, we
+        // must read a reply message.
+        block_fifo_response_t response;
+        if ((status = do_read(client->fifo, &response)) != ZX_OK) {
+            return status;
+        }
+
+        // Wake up someone who is waiting (it might be ourselves)
+        txn_complete(client, response.txnid, response.status);
+    }
 
     // Wait for someone to signal us
     completion_wait(&client->txns[txnid].completion, ZX_TIME_INFINITE);
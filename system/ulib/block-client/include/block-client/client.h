@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <async/dispatcher.h>
 #include <zircon/device/block.h>
 #include <zircon/types.h>
 
@@ -37,4 +38,23 @@ void block_fifo_release_client(fifo_client_t* client);
 // dev_offset                               read, write
 zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count);
 
+// Has |async| read every response of the client from now on, completing
+// each txn from its dispatch thread. Must be called before any txns are
+// sent, and only once. block_fifo_txn keeps working, waiting for |async| to
+// read its response. The wait is cancelled by block_fifo_release_client.
+zx_status_t block_fifo_set_async(fifo_client_t* client, async_t* async);
+
+typedef void (*block_fifo_callback_t)(void* cookie, zx_status_t status);
+
+// Sends 'count' block device requests, as block_fifo_txn does, but returns
+// once they are written. |callback| is called with the status of the txn
+// from the dispatch thread of the client's async_t, which must have been set.
+// If an error is returned, |callback| is not called.
+//
+// Only one txn may be outstanding per txnid, so a caller keeps several in
+// flight by allocating several txnids. |callback| may send the next txn on
+// its txnid.
+zx_status_t block_fifo_txn_async(fifo_client_t* client, block_fifo_request_t* requests,
+                                 size_t count, block_fifo_callback_t callback, void* cookie);
+
 __END_CDECLS
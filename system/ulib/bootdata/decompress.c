@@ -5,6 +5,7 @@
 #include <bootdata/decompress.h>
 
 #include <limits.h>
+#include <stdbool.h>
 #include <string.h>
 
 #include <zircon/boot/bootdata.h>
@@ -85,16 +86,215 @@ static zx_status_t check_lz4_frame(const lz4_frame_desc* fd,
     return ZX_OK;
 }
 
+#define ZX_LZ4_BLOCK_SIZE         65536
+
+// Blocks are independent, and mkbootfs fills every block but the last, so
+// block N starts N * ZX_LZ4_BLOCK_SIZE bytes into the output and runs of
+// blocks can be decompressed at the same time.  Frames which don't fill
+// their blocks are decompressed in one go instead.
+#define ZX_LZ4_MAX_THREADS        8
+
+// Runs of at least this many blocks are worth a thread of their own.
+#define ZX_LZ4_MIN_THREAD_BLOCKS  16
+
+// Block size words are not necessarily aligned.
+static uint32_t read_blocksize(const uint8_t* p) {
+    uint32_t blocksize;
+    memcpy(&blocksize, p, sizeof(blocksize));
+    return blocksize;
+}
+
+typedef struct {
+    // The size word of the first block to decompress, within |end|.
+    const uint8_t* src;
+    const uint8_t* end;
+    // Where the first block goes, and the space left from there.
+    uint8_t* dst;
+    size_t dst_len;
+    // The number of blocks to decompress, or SIZE_MAX to go up to the
+    // end mark.
+    size_t nblocks;
+    // Whether every block must be full, except the last if |has_last|.
+    bool need_full;
+    bool has_last;
+    // Outputs.
+    size_t actual;
+    zx_status_t status;
+    const char* err;
+} lz4_chunk_t;
+
+static zx_status_t decompress_blocks(lz4_chunk_t* c) {
+    const uint8_t* data = c->src;
+    uint8_t* dst = c->dst;
+    size_t remaining = c->dst_len;
+
+    // Read each LZ4 block and decompress it. Block sizes are 32 bits.
+    for (size_t n = 0; n < c->nblocks; ++n) {
+        if ((size_t)(c->end - data) < sizeof(uint32_t)) {
+            c->err = "lz4 data truncated";
+            return c->status = ZX_ERR_INVALID_ARGS;
+        }
+        uint32_t blocksize = read_blocksize(data);
+        data += sizeof(uint32_t);
+        if (blocksize == 0) {
+            break;
+        }
+
+        uint32_t actual = blocksize & 0x7fffffff;
+        if ((size_t)(c->end - data) < actual) {
+            c->err = "lz4 data truncated";
+            return c->status = ZX_ERR_INVALID_ARGS;
+        }
+        // If the data is uncompressed, the high bit is 1.
+        size_t out;
+        if (blocksize >> 31) {
+            if (actual > remaining) {
+                c->err = "bootdata outsize too small for lz4 decompression";
+                return c->status = ZX_ERR_INVALID_ARGS;
+            }
+            memcpy(dst, data, actual);
+            out = actual;
+        } else {
+            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, actual,
+                                           remaining > INT_MAX ? INT_MAX : (int)remaining);
+            if (dcmp < 0) {
+                c->err = "lz4 decompression failed";
+                return c->status = ZX_ERR_BAD_STATE;
+            }
+            out = dcmp;
+        }
+        if (c->need_full && out != ZX_LZ4_BLOCK_SIZE &&
+            (n + 1 < c->nblocks || !c->has_last)) {
+            c->err = "lz4 block is not full";
+            return c->status = ZX_ERR_OUT_OF_RANGE;
+        }
+        dst += out;
+        data += actual;
+        remaining -= out;
+    }
+
+    c->actual = c->dst_len - remaining;
+    return c->status = ZX_OK;
+}
+
+#if BOOTDATA_DECOMPRESS_THREADS
+#include <threads.h>
+
+static int decompress_thread(void* arg) {
+    decompress_blocks(arg);
+    return 0;
+}
+
+// Decompresses the blocks at |data| into |dst| with up to
+// ZX_LZ4_MAX_THREADS threads.  Fails with ZX_ERR_OUT_OF_RANGE if the frame
+// does not fill its blocks and so has to be decompressed in one go.
+static zx_status_t decompress_blocks_parallel(const uint8_t* data, const uint8_t* end,
+                                              uint8_t* dst, size_t dst_len,
+                                              size_t* actual, const char** err) {
+    // Count the blocks up to the end mark.
+    size_t nblocks = 0;
+    for (const uint8_t* p = data;; ++nblocks) {
+        if ((size_t)(end - p) < sizeof(uint32_t)) {
+            *err = "lz4 data truncated";
+            return ZX_ERR_INVALID_ARGS;
+        }
+        uint32_t blocksize = read_blocksize(p) & 0x7fffffff;
+        if (blocksize == 0) {
+            break;
+        }
+        p += sizeof(uint32_t);
+        if ((size_t)(end - p) < blocksize) {
+            *err = "lz4 data truncated";
+            return ZX_ERR_INVALID_ARGS;
+        }
+        p += blocksize;
+    }
+    if (nblocks > dst_len / ZX_LZ4_BLOCK_SIZE + 1) {
+        // They can't all be full.
+        *err = "lz4 block is not full";
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    size_t nchunks = zx_system_get_num_cpus();
+    if (nchunks > ZX_LZ4_MAX_THREADS) {
+        nchunks = ZX_LZ4_MAX_THREADS;
+    }
+    if (nchunks > nblocks / ZX_LZ4_MIN_THREAD_BLOCKS) {
+        nchunks = nblocks / ZX_LZ4_MIN_THREAD_BLOCKS;
+    }
+    if (nchunks < 1) {
+        nchunks = 1;
+    }
+
+    // Split the blocks into even runs, one per thread.
+    lz4_chunk_t chunks[ZX_LZ4_MAX_THREADS];
+    const uint8_t* p = data;
+    size_t block = 0;
+    for (size_t i = 0; i < nchunks; ++i) {
+        size_t first = nblocks * i / nchunks;
+        while (block < first) {
+            p += sizeof(uint32_t) + (read_blocksize(p) & 0x7fffffff);
+            ++block;
+        }
+        size_t off = first * ZX_LZ4_BLOCK_SIZE;
+        chunks[i] = (lz4_chunk_t){
+            .src = p,
+            .end = end,
+            .dst = dst + off,
+            .dst_len = dst_len - off,
+            .nblocks = nblocks * (i + 1) / nchunks - first,
+            .need_full = true,
+            .has_last = (i + 1 == nchunks),
+        };
+    }
+
+    // This thread takes the first run itself.  If a thread can't be
+    // started, its run is done here too.
+    thrd_t threads[ZX_LZ4_MAX_THREADS];
+    bool started[ZX_LZ4_MAX_THREADS] = {};
+    for (size_t i = 1; i < nchunks; ++i) {
+        started[i] = thrd_create_with_name(&threads[i], decompress_thread,
+                                           &chunks[i], "bootdata-lz4") == thrd_success;
+    }
+    decompress_blocks(&chunks[0]);
+    for (size_t i = 1; i < nchunks; ++i) {
+        if (started[i]) {
+            thrd_join(threads[i], NULL);
+        } else {
+            decompress_blocks(&chunks[i]);
+        }
+    }
+
+    for (size_t i = 0; i < nchunks; ++i) {
+        if (chunks[i].status != ZX_OK) {
+            *err = chunks[i].err;
+            return chunks[i].status;
+        }
+    }
+    // The runs are back to back, and all but the last are full.
+    *actual = dst_len - chunks[nchunks - 1].dst_len + chunks[nchunks - 1].actual;
+    return ZX_OK;
+}
+#endif
+
 static zx_status_t decompress_bootfs_vmo(zx_handle_t vmar, const uint8_t* data,
-                                         size_t _outsize, zx_handle_t* out,
-                                         const char** err) {
+                                         size_t insize, size_t _outsize,
+                                         zx_handle_t* out, const char** err) {
+    const uint8_t* end = data + insize;
+    if (insize < sizeof(uint32_t) + sizeof(lz4_frame_desc)) {
+        *err = "compressed bootfs too small";
+        return ZX_ERR_INVALID_ARGS;
+    }
     if (*(const uint32_t*)data != ZX_LZ4_MAGIC) {
         *err = "bad magic number for compressed bootfs";
         return ZX_ERR_INVALID_ARGS;
     }
     data += sizeof(uint32_t);
 
-    check_lz4_frame((const lz4_frame_desc*)data, _outsize, err);
+    zx_status_t status = check_lz4_frame((const lz4_frame_desc*)data, _outsize, err);
+    if (status != ZX_OK) {
+        return status;
+    }
     data += sizeof(lz4_frame_desc);
 
     size_t outsize = (_outsize + 4095) & ~4095;
@@ -104,7 +304,7 @@ static zx_status_t decompress_bootfs_vmo(zx_handle_t vmar, const uint8_t* data,
         return ZX_ERR_NO_MEMORY;
     }
     zx_handle_t dst_vmo;
-    zx_status_t status = zx_vmo_create((uint64_t)outsize, 0, &dst_vmo);
+    status = zx_vmo_create((uint64_t)outsize, 0, &dst_vmo);
     if (status < 0) {
         *err = "zx_vmo_create failed for decompressing bootfs";
         return status;
@@ -116,59 +316,45 @@ static zx_status_t decompress_bootfs_vmo(zx_handle_t vmar, const uint8_t* data,
             ZX_VM_FLAG_PERM_READ|ZX_VM_FLAG_PERM_WRITE, &dst_addr);
     if (status < 0) {
         *err = "zx_vmar_map failed on bootfs vmo during decompression";
+        zx_handle_close(dst_vmo);
         return status;
     }
 
-    size_t remaining = outsize;
-    uint8_t* dst = (uint8_t*)dst_addr;
-
-    // Read each LZ4 block and decompress it. Block sizes are 32 bits.
-    uint32_t blocksize = *(const uint32_t*)data;
-    data += sizeof(uint32_t);
-    while (blocksize) {
-        // If the data is uncompressed, the high bit is 1.
-        if (blocksize >> 31) {
-            uint32_t actual = blocksize & 0x7fffffff;
-            memcpy(dst, data, actual);
-            dst += actual;
-            data += actual;
-            if (remaining - actual > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ZX_ERR_INVALID_ARGS;
-            }
-            remaining -= actual;
-        } else {
-            int dcmp = LZ4_decompress_safe((const char*)data, (char*)dst, blocksize, remaining);
-            if (dcmp < 0) {
-                *err = "lz4 decompression failed";
-                return ZX_ERR_BAD_STATE;
-            }
-            dst += dcmp;
-            data += blocksize;
-            if (remaining - dcmp > remaining) {
-                // Remaining wrapped around (would be negative if signed)
-                *err = "bootdata outsize too small for lz4 decompression";
-                return ZX_ERR_INVALID_ARGS;
-            }
-            remaining -= dcmp;
-        }
-
-        blocksize = *(uint32_t*)data;
-        data += sizeof(uint32_t);
+    size_t actual = 0;
+#if BOOTDATA_DECOMPRESS_THREADS
+    status = decompress_blocks_parallel(data, end, (uint8_t*)dst_addr, outsize,
+                                        &actual, err);
+    if (status == ZX_ERR_OUT_OF_RANGE)
+#endif
+    {
+        lz4_chunk_t chunk = {
+            .src = data,
+            .end = end,
+            .dst = (uint8_t*)dst_addr,
+            .dst_len = outsize,
+            .nblocks = SIZE_MAX,
+            .has_last = true,
+        };
+        status = decompress_blocks(&chunk);
+        actual = chunk.actual;
+        *err = chunk.err;
     }
 
     // Sanity check: verify that we didn't have more than one page leftover.
     // The bootdata header should have specified the exact outsize needed, which
     // we rounded up to the next full page.
-    if (remaining > 4095) {
+    if (status == ZX_OK && outsize - actual > 4095) {
         *err = "bootdata size error; outsize does not match decompressed size";
-        return ZX_ERR_INVALID_ARGS;
+        status = ZX_ERR_INVALID_ARGS;
     }
 
-    status = zx_vmar_unmap(vmar, dst_addr, outsize);
-    if (status < 0) {
+    zx_status_t s = zx_vmar_unmap(vmar, dst_addr, outsize);
+    if (status == ZX_OK && s < 0) {
         *err = "zx_vmar_unmap after decompress failed";
+        status = s;
+    }
+    if (status != ZX_OK) {
+        zx_handle_close(dst_vmo);
         return status;
     }
     *out = dst_vmo;
@@ -184,6 +370,10 @@ zx_status_t decompress_bootdata(zx_handle_t vmar, zx_handle_t vmo,
         *err = "bootfs VMO too large to map";
         return ZX_ERR_BUFFER_TOO_SMALL;
     }
+    if (length < sizeof(bootdata_t)) {
+        *err = "bootdata item too small";
+        return ZX_ERR_INVALID_ARGS;
+    }
 
     uintptr_t addr = 0;
     size_t aligned_offset = offset & ~(PAGE_SIZE - 1);
@@ -204,7 +394,9 @@ zx_status_t decompress_bootdata(zx_handle_t vmar, zx_handle_t vmo,
     case BOOTDATA_BOOTFS_SYSTEM:
     case BOOTDATA_RAMDISK:
         if (hdr->flags & BOOTDATA_BOOTFS_FLAG_COMPRESSED) {
-            status = decompress_bootfs_vmo(vmar, (const uint8_t*)bootdata_addr, hdr->extra, out, err);
+            status = decompress_bootfs_vmo(vmar, (const uint8_t*)bootdata_addr,
+                                           length - align_shift - sizeof(bootdata_t),
+                                           hdr->extra, out, err);
         }
         break;
     default:
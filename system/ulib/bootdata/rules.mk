@@ -10,6 +10,10 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += $(LOCAL_DIR)/decompress.c
 
+# userboot compiles decompress.c itself and has no threads to spread the
+# work over; everyone else gets parallel decompression.
+MODULE_DEFINES += BOOTDATA_DECOMPRESS_THREADS=1
+
 MODULE_LIBS := \
     third_party/ulib/lz4 \
     system/ulib/zircon \
@@ -153,6 +153,26 @@ typedef phys_iter_t iotxn_phys_iter_t;
 // create a new iotxn with payload space of data_size
 zx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size);
 
+// Allocates |count| iotxns as iotxn_alloc(|alloc_flags|, |data_size|) would,
+// looks up their physical pages, and leaves them in the pool, so that later
+// pooled allocations of that size neither allocate nor call physmap again.
+// Drivers call this when they start, for the request sizes they use most.
+zx_status_t iotxn_pool_reserve(uint32_t alloc_flags, uint64_t data_size, size_t count);
+
+// Counts of pooled allocations, shared by every driver in a devhost and
+// reported by the coordinator's "dump" command.
+typedef struct iotxn_pool_stats {
+    // allocations served from the pool
+    uint64_t hits;
+    // allocations which found nothing suitable in the pool
+    uint64_t misses;
+    // iotxns sitting in the pool
+    uint64_t pooled;
+} iotxn_pool_stats_t;
+
+// Returns the devhost's pool counters.
+iotxn_pool_stats_t* iotxn_pool_stats(void);
+
 // create a new iotxn based on provided VMO.
 zx_status_t iotxn_alloc_vmo(iotxn_t** out, uint32_t alloc_flags, zx_handle_t vmo_handle,
                             uint64_t vmo_offset, uint64_t length);
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <zircon/device/block.h>
 
@@ -45,7 +46,10 @@ struct block_op {
         // BLOCK_OP_TRIM
         struct {
             uint32_t command;            // command and flags
-            // ???
+            uint32_t extra;              // available for temporary use
+            zx_handle_t reserved;        // unused; lines the fields up with rw
+            uint32_t length;             // length in blocks (0 is invalid)
+            uint64_t offset_dev;         // device offset in blocks
         } trim;
     };
 
@@ -57,6 +61,9 @@ struct block_op {
 };
 
 static_assert(sizeof(block_op_t) == 56, "");
+// Drivers which only adjust offsets may treat a trim as an rw op.
+static_assert(offsetof(block_op_t, trim.length) == offsetof(block_op_t, rw.length), "");
+static_assert(offsetof(block_op_t, trim.offset_dev) == offsetof(block_op_t, rw.offset_dev), "");
 
 typedef struct block_protocol_ops {
     // Obtain the parameters of the block device (block_info_t) and
@@ -93,7 +100,10 @@ typedef struct block_protocol {
 // and later operations will not start until it is done.
 #define BLOCK_OP_FLUSH               0x00000003
 
-// TBD
+// Tell the device that the data in u.trim's range is no longer needed, so
+// it may reclaim the space (an NVMe deallocate or an ATA TRIM).  Reads of
+// the range afterwards return unspecified data.  Only queued to devices
+// reporting BLOCK_FLAG_TRIM_SUPPORT.
 #define BLOCK_OP_TRIM                0x00000004
 
 #define BLOCK_OP_MASK                0x000000FF
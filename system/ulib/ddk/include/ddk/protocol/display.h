@@ -44,6 +44,10 @@ typedef struct display_protocol_ops {
     // The provided callback will be invoked with a value of true if the display
     // has been acquired, false if it has been released.
     void (*set_ownership_change_callback)(void* ctx, zx_display_cb_t callback, void* cookie);
+
+    // Flushes only the given region of the framebuffer, which has been
+    // clipped to the display. Optional; flush is used when this is NULL.
+    void (*flush_region)(void* ctx, const ioctl_display_region_t* region);
 } display_protocol_ops_t;
 
 typedef struct zx_display_protocol {
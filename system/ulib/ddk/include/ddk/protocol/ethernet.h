@@ -16,9 +16,10 @@ __BEGIN_CDECLS;
 // The ethermac interface supports both synchronous and asynchronous transmissions using the
 // proto->queue_tx() and ifc->complete_tx() methods.
 //
-// Receive operations are supported with the ifc->recv() interface.
-// TODO: implement netbuf-based receive operations by implementing proto->queue_rx() and
-// ifc->complete_rx()
+// Receive operations are supported with the ifc->recv() interface, which copies each frame into
+// every client's buffers. Devices with the FEATURE_RX_QUEUE flag can instead receive frames
+// directly into a client's buffers, posted as netbufs with proto->queue_rx() and returned with
+// ifc->complete_rx(). They still deliver frames through recv() while no netbufs are posted.
 //
 // The FEATURE_WLAN flag indicates a device that supports wlan operations.
 //
@@ -26,10 +27,27 @@ __BEGIN_CDECLS;
 //
 // The FEATURE_DMA flag indicates that the device can copy the buffer data using DMA and will ensure
 // that physical addresses are provided in netbufs.
+//
+// The FEATURE_RX_QUEUE flag indicates that the device implements queue_rx(). It requires
+// FEATURE_DMA.
+//
+// The FEATURE_TX_CSUM and FEATURE_TSO flags indicate that the device honors the ETHMAC_TX_CSUM
+// and ETHMAC_TX_TSO_ flags of transmitted netbufs. TSO netbufs may be longer than the mtu.
+//
+// The FEATURE_RX_CSUM flag indicates that the device sets ETHMAC_RX_CSUM_OK on received frames
+// whose checksums it has verified.
+//
+// The FEATURE_LRO flag indicates that, while enabled with SETPARAM_RX_COALESCE, the device may
+// deliver several TCP segments as one frame longer than the mtu, flagged ETHMAC_RX_COALESCED.
 
 #define ETHMAC_FEATURE_WLAN     (1u)
 #define ETHMAC_FEATURE_SYNTH    (2u)
 #define ETHMAC_FEATURE_DMA      (4u)
+#define ETHMAC_FEATURE_RX_QUEUE (8u)
+#define ETHMAC_FEATURE_TX_CSUM  (0x10u)
+#define ETHMAC_FEATURE_TSO      (0x20u)
+#define ETHMAC_FEATURE_RX_CSUM  (0x40u)
+#define ETHMAC_FEATURE_LRO      (0x80u)
 
 typedef struct ethmac_info {
     uint32_t features;
@@ -45,7 +63,13 @@ typedef struct ethmac_netbuf {
     zx_paddr_t phys;  // Only used if ETHMAC_FEATURE_DMA is available
     uint16_t len;
     uint16_t reserved;
-    uint32_t flags;
+    uint32_t flags;  // ETHMAC_TX_ flags for queue_tx(), ETHMAC_RX_ flags for complete_rx()
+
+    // Offloads requested by the ETHMAC_TX_ flags; see eth_tx_offload_t
+    uint16_t csum_start;
+    uint16_t csum_offset;
+    uint16_t hdr_len;
+    uint16_t mss;
 
     // Shared between the generic ethernet and ethmac drivers
     list_node_t node;
@@ -60,16 +84,32 @@ typedef struct ethmac_netbuf {
 typedef struct ethmac_ifc_virt {
     void (*status)(void* cookie, uint32_t status);
 
+    // recv() is called with the frame's ETHMAC_RX_ |flags|.
     void (*recv)(void* cookie, void* data, size_t length, uint32_t flags);
 
     // complete_tx() is called to return ownership of a netbuf to the generic ethernet driver.
     void (*complete_tx)(void* cookie, ethmac_netbuf_t* netbuf, zx_status_t status);
+
+    // complete_rx() is called to return ownership of |count| netbufs posted with queue_rx() to
+    // the generic ethernet driver, each with |len| set to the length of the frame received into
+    // it, or to zero if it is being returned unused. Returning several netbufs at once lets them
+    // be reported to the client together.
+    void (*complete_rx)(void* cookie, ethmac_netbuf_t** netbufs, size_t count);
 } ethmac_ifc_t;
 
 // Indicates that additional data is available to be sent after this call finishes. Allows a ethmac
 // driver to batch tx to hardware if possible.
 #define ETHMAC_TX_OPT_MORE (1u)
 
+// Flags of a transmitted netbuf, only set if the matching feature is.
+#define ETHMAC_TX_CSUM     (1u)  // fill in the checksum at csum_start + csum_offset
+#define ETHMAC_TX_TSO_V4   (2u)  // segment a TCP over IPv4 frame into mss byte payloads
+#define ETHMAC_TX_TSO_V6   (4u)  // segment a TCP over IPv6 frame into mss byte payloads
+
+// Flags of a received frame.
+#define ETHMAC_RX_CSUM_OK   (1u)  // the device has verified its IP and TCP or UDP checksums
+#define ETHMAC_RX_COALESCED (2u)  // several TCP segments have been coalesced into it
+
 // SETPARAM_ values identify the parameter to set. Each call to set_param()
 // takes an int32_t |value| and void* |data| which have meaning specific to
 // the parameter being set.
@@ -77,6 +117,12 @@ typedef struct ethmac_ifc_virt {
 // |value| param = bool. |data| param = unused.
 #define ETHMAC_SETPARAM_PROMISC (1u)
 
+// |value| param = bool. |data| param = unused. Only used if FEATURE_LRO is set. Off until enabled.
+#define ETHMAC_SETPARAM_RX_COALESCE (2u)
+
+// |value| param = unused. |data| param = const eth_irq_moderation_t*.
+#define ETHMAC_SETPARAM_IRQ_MODERATION (3u)
+
 // The ethernet midlayer will never call ethermac_protocol
 // methods from multiple threads simultaneously, but it
 // can call send() methods at the same time as non-send
@@ -117,6 +163,16 @@ typedef struct ethmac_protocol_ops {
     // set_param() may be called at any time after start() is called including from multiple threads
     // simultaneously.
     zx_status_t (*set_param)(void* ctx, uint32_t param, int32_t value, void* data);
+
+    // Post the buffer described by netbuf, at physical address |phys| and |len| bytes long, to
+    // receive a single frame into. Frames longer than the buffer are dropped. Return status
+    // indicates disposition:
+    //   ZX_OK: The driver owns the netbuf until it passes it to complete_rx()
+    //   Other: The netbuf could not be posted, and still belongs to the caller
+    //
+    // Only called if FEATURE_RX_QUEUE is set, from a single thread at a time, between start()
+    // and stop(). Every posted netbuf must have been returned by the time stop() returns.
+    zx_status_t (*queue_rx)(void* ctx, uint32_t options, ethmac_netbuf_t* netbuf);
 } ethmac_protocol_ops_t;
 
 typedef struct ethmac_protocol {
@@ -26,9 +26,6 @@
     } while (0)
 #endif
 
-// Warn if free list length exceeds a multiple of FREE_LIST_MONITOR_LIMIT
-#define FREE_LIST_MONITOR_LIMIT 100
-
 #define IOTXN_PFLAG_CONTIGUOUS (1 << 0)   // the vmo is contiguous
 #define IOTXN_PFLAG_ALLOC      (1 << 1)   // the vmo is allocated by us
 #define IOTXN_PFLAG_PHYSMAP    (1 << 2)   // we performed physmap() on this vmo and allocated memory
@@ -38,12 +35,49 @@
 
 #define IOTXN_STATE_MASK       (IOTXN_PFLAG_FREE | IOTXN_PFLAG_QUEUED)
 
-static list_node_t free_list = LIST_INITIAL_VALUE(free_list);
+// Released iotxns wait in one free list per power-of-two buffer size class
+// (from a page to POOL_ORDERS - 1 pages' worth of doublings, the last class
+// taking everything larger) and kind of buffer, plus one for iotxns without a
+// buffer of their own, such as clones. Allocations of the common sizes then
+// find a match at the head of their list.
+#define POOL_ORDERS 9
+#define POOL_BUCKETS (1 + 2 * POOL_ORDERS)
+
+// Iotxns with buffers beyond this many in one list are freed on release.
+#define POOL_BUCKET_MAX 64
+
+static struct {
+    list_node_t list;
+    size_t length;
+} free_lists[POOL_BUCKETS];
 static mtx_t free_list_mutex = MTX_INIT;
-#if FREE_LIST_MONITOR_LIMIT
-static size_t free_list_length = 0;
-static size_t free_list_monitor_warned = 0;
-#endif
+static once_flag free_lists_once = ONCE_FLAG_INIT;
+
+static iotxn_pool_stats_t* pool_stats;
+
+static void free_lists_init(void) {
+    for (size_t i = 0; i < POOL_BUCKETS; i++) {
+        list_initialize(&free_lists[i].list);
+    }
+    pool_stats = iotxn_pool_stats();
+}
+
+static size_t pool_bucket(uint32_t pflags, uint64_t data_size) {
+    if (data_size == 0) {
+        return 0;
+    }
+    size_t order = 0;
+    while ((order < POOL_ORDERS - 1) && (((uint64_t)PAGE_SIZE << order) < data_size)) {
+        order++;
+    }
+    return 1 + 2 * order + ((pflags & IOTXN_PFLAG_CONTIGUOUS) ? 1 : 0);
+}
+
+static void pool_count(uint64_t* counter, uint64_t delta) {
+    if (pool_stats != NULL) {
+        __atomic_fetch_add(counter, delta, __ATOMIC_RELAXED);
+    }
+}
 
 // This assert will fail if we attempt to access the buffer of a cloned txn after it has been completed
 #define ASSERT_BUFFER_VALID(priv) ZX_DEBUG_ASSERT(!(priv->flags & IOTXN_FLAG_DEAD))
@@ -64,8 +98,10 @@ static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
     bool found = false;
     iotxn_t* txn = NULL;
     //xprintf("find_in_free_list pflags 0x%x data_size 0x%" PRIx64 "\n", pflags, data_size);
+    call_once(&free_lists_once, free_lists_init);
+    size_t bucket = pool_bucket(pflags, data_size);
     mtx_lock(&free_list_mutex);
-    list_for_every_entry (&free_list, txn, iotxn_t, node) {
+    list_for_every_entry (&free_lists[bucket].list, txn, iotxn_t, node) {
         // txn->pflags has IOTXN_ALLOC_CONTIGUOUS set if the txn has a contiguous VMO we allocated,
         // or zero otherwise. And the pflags passed into this function is either zero or
         // IOTXN_ALLOC_CONTIGUOUS. So here we mask txn->pflags with IOTXN_ALLOC_CONTIGUOUS
@@ -78,17 +114,38 @@ static iotxn_t* find_in_free_list(uint32_t pflags, uint64_t data_size) {
     if (found) {
         txn->pflags &= ~IOTXN_PFLAG_FREE;
         list_delete(&txn->node);
-#if FREE_LIST_MONITOR_LIMIT
-        free_list_length--;
-#endif
+        free_lists[bucket].length--;
     }
     mtx_unlock(&free_list_mutex);
+    if (pool_stats != NULL) {
+        pool_count(found ? &pool_stats->hits : &pool_stats->misses, 1);
+        if (found) {
+            pool_count(&pool_stats->pooled, -1);
+        }
+    }
     //xprintf("find_in_free_list found %d txn %p\n", found, txn);
     return found ? txn : NULL;
 }
 
+static void iotxn_release_free(iotxn_t* txn);
+
 // return the iotxn into the free list
 static void iotxn_release_free_list(iotxn_t* txn) {
+    call_once(&free_lists_once, free_lists_init);
+    size_t bucket = 0;
+    if (txn->pflags & IOTXN_PFLAG_ALLOC) {
+        bucket = pool_bucket(txn->pflags, txn->vmo_length);
+        // Don't let one size hoard buffers. Only iotxns which own their
+        // buffer are ever freed here; others may live in their user's memory.
+        mtx_lock(&free_list_mutex);
+        bool full = free_lists[bucket].length >= POOL_BUCKET_MAX;
+        mtx_unlock(&free_list_mutex);
+        if (full) {
+            iotxn_release_free(txn);
+            return;
+        }
+    }
+
     zx_handle_t vmo_handle = txn->vmo_handle;
     uint64_t vmo_offset = txn->vmo_offset;
     uint64_t vmo_length = txn->vmo_length;
@@ -129,16 +186,12 @@ static void iotxn_release_free_list(iotxn_t* txn) {
     txn->release_cb = iotxn_release_free_list;
 
     mtx_lock(&free_list_mutex);
-    list_add_head(&free_list, &txn->node);
-#if FREE_LIST_MONITOR_LIMIT
-    free_list_length++;
-    if (free_list_length % FREE_LIST_MONITOR_LIMIT == 0
-        && free_list_length > free_list_monitor_warned) {
-        printf("WARNING: iotxn free_list_length is %zu\n", free_list_length);
-        free_list_monitor_warned = free_list_length;
-    }
-#endif
+    list_add_head(&free_lists[bucket].list, &txn->node);
+    free_lists[bucket].length++;
     mtx_unlock(&free_list_mutex);
+    if (pool_stats != NULL) {
+        pool_count(&pool_stats->pooled, 1);
+    }
 
     xprintf("iotxn_release_free_list released txn %p\n", txn);
 }
@@ -420,18 +473,8 @@ zx_status_t iotxn_cache_flush_invalidate(iotxn_t* txn, zx_off_t offset, size_t l
                           ZX_CACHE_FLUSH_DATA | ZX_CACHE_FLUSH_INVALIDATE);
 }
 
-zx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size) {
-    //xprintf("iotxn_alloc: alloc_flags 0x%x data_size 0x%" PRIx64 "\n", alloc_flags, data_size);
-
-    // look in free list first for a iotxn with data_size
-    iotxn_t* txn = find_in_free_list(alloc_flags_to_pflags(alloc_flags), data_size);
-    if (txn != NULL) {
-        //xprintf("iotxn_alloc: found iotxn with size 0x%" PRIx64 " in free list\n", data_size);
-        goto out;
-    }
-
-    // didn't find one that fits, allocate a new one
-    txn = calloc(1, sizeof(iotxn_t));
+static zx_status_t iotxn_alloc_new(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size) {
+    iotxn_t* txn = calloc(1, sizeof(iotxn_t));
     if (!txn) {
         return ZX_ERR_NO_MEMORY;
     }
@@ -453,8 +496,23 @@ zx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size)
         txn->vmo_length = data_size;
         txn->pflags |= IOTXN_PFLAG_ALLOC;
     }
+    *out = txn;
+    return ZX_OK;
+}
+
+zx_status_t iotxn_alloc(iotxn_t** out, uint32_t alloc_flags, uint64_t data_size) {
+    //xprintf("iotxn_alloc: alloc_flags 0x%x data_size 0x%" PRIx64 "\n", alloc_flags, data_size);
+
+    // look in free list first for a iotxn with data_size
+    iotxn_t* txn = find_in_free_list(alloc_flags_to_pflags(alloc_flags), data_size);
+    if (txn == NULL) {
+        // didn't find one that fits, allocate a new one
+        zx_status_t status = iotxn_alloc_new(&txn, alloc_flags, data_size);
+        if (status != ZX_OK) {
+            return status;
+        }
+    }
 
-out:
     ZX_DEBUG_ASSERT(txn != NULL);
     ZX_DEBUG_ASSERT(!(txn->pflags & IOTXN_PFLAG_FREE));
     if (alloc_flags & IOTXN_ALLOC_POOL) {
@@ -466,6 +524,25 @@ out:
     return ZX_OK;
 }
 
+zx_status_t iotxn_pool_reserve(uint32_t alloc_flags, uint64_t data_size, size_t count) {
+    if (data_size == 0) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    for (size_t i = 0; i < count; i++) {
+        iotxn_t* txn;
+        zx_status_t status = iotxn_alloc_new(&txn, alloc_flags, data_size);
+        if (status != ZX_OK) {
+            return status;
+        }
+        if ((status = iotxn_physmap(txn)) != ZX_OK) {
+            iotxn_release_free(txn);
+            return status;
+        }
+        iotxn_release_free_list(txn);
+    }
+    return ZX_OK;
+}
+
 void iotxn_queue(zx_device_t* dev, iotxn_t* txn) {
     // don't assert not queued here, since iotxns are allowed to be requeued
     txn->pflags |= IOTXN_PFLAG_QUEUED;
@@ -437,6 +437,51 @@ static bool test_phys_iter_tiny_unaligned(void) {
     END_TEST;
 }
 
+static bool test_pool_reuse(void) {
+    BEGIN_TEST;
+    iotxn_pool_stats_t* stats = iotxn_pool_stats();
+    ASSERT_NONNULL(stats, "");
+
+    iotxn_t* txn;
+    ASSERT_EQ(iotxn_alloc(&txn, IOTXN_ALLOC_POOL, PAGE_SIZE * 5), ZX_OK, "");
+    ASSERT_EQ(iotxn_physmap(txn), ZX_OK, "");
+    ASSERT_EQ(txn->phys_count, 5u, "unexpected phys_count");
+    iotxn_release(txn);
+
+    // The same size comes back from the pool, already physmapped.
+    uint64_t hits = stats->hits;
+    iotxn_t* again;
+    ASSERT_EQ(iotxn_alloc(&again, IOTXN_ALLOC_POOL, PAGE_SIZE * 5), ZX_OK, "");
+    ASSERT_EQ(again, txn, "expected the pooled iotxn");
+    // Other drivers in this devhost count into the same stats.
+    ASSERT_GE(stats->hits, hits + 1, "expected a pool hit");
+    ASSERT_EQ(again->phys_count, 5u, "expected phys to be kept");
+    ASSERT_EQ(again->length, 0u, "expected a fresh iotxn");
+    iotxn_release(again);
+    END_TEST;
+}
+
+static bool test_pool_reserve(void) {
+    BEGIN_TEST;
+    iotxn_pool_stats_t* stats = iotxn_pool_stats();
+    ASSERT_NONNULL(stats, "");
+
+    ASSERT_EQ(iotxn_pool_reserve(0, PAGE_SIZE * 7, 2), ZX_OK, "");
+
+    uint64_t hits = stats->hits;
+    iotxn_t* txn[2];
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(iotxn_alloc(&txn[i], IOTXN_ALLOC_POOL, PAGE_SIZE * 7), ZX_OK, "");
+        ASSERT_EQ(txn[i]->phys_count, 7u, "expected reserved iotxns to be physmapped");
+    }
+    ASSERT_GE(stats->hits, hits + 2, "expected pool hits");
+    iotxn_release(txn[0]);
+    iotxn_release(txn[1]);
+
+    ASSERT_EQ(iotxn_pool_reserve(0, 0, 1), ZX_ERR_INVALID_ARGS, "");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(iotxn_tests)
 RUN_TEST(test_physmap_simple)
 RUN_TEST(test_physmap_contiguous)
@@ -451,6 +496,8 @@ RUN_TEST(test_phys_iter_unaligned_contig)
 RUN_TEST(test_phys_iter_unaligned_noncontig)
 RUN_TEST(test_phys_iter_tiny_aligned)
 RUN_TEST(test_phys_iter_tiny_unaligned)
+RUN_TEST(test_pool_reuse)
+RUN_TEST(test_pool_reserve)
 END_TEST_CASE(iotxn_tests)
 
 struct test_case_element* test_case_ddk_iotxn = TEST_CASE_ELEMENT(iotxn_tests);
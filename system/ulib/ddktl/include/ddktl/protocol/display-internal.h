@@ -19,6 +19,7 @@ DECLARE_HAS_MEMBER_FN(has_set_mode, SetMode);
 DECLARE_HAS_MEMBER_FN(has_get_mode, GetMode);
 DECLARE_HAS_MEMBER_FN(has_get_framebuffer, GetFramebuffer);
 DECLARE_HAS_MEMBER_FN(has_flush, Flush);
+DECLARE_HAS_MEMBER_FN(has_flush_region, FlushRegion);
 DECLARE_HAS_MEMBER_FN(has_acquire_or_release_display, AcquireOrReleaseDisplay);
 DECLARE_HAS_MEMBER_FN(has_set_ownership_change_callback, SetOwnershipChangeCallback);
 
@@ -56,6 +57,14 @@ constexpr void CheckDisplayProtocolSubclass() {
                   "'void Flush()', and be visible to "
                   "ddk::DisplayProtocol<D> (either because they are public, or because of "
                   "friendship).");
+    static_assert(internal::has_flush_region<D>::value,
+                  "DisplayProtocol subclasses must implement FlushRegion");
+    static_assert(fbl::is_same<decltype(&D::FlushRegion),
+                                void (D::*)(const ioctl_display_region_t*)>::value,
+                  "FlushRegion must be a non-static member function with signature "
+                  "'void FlushRegion(const ioctl_display_region_t* region)', and be visible to "
+                  "ddk::DisplayProtocol<D> (either because they are public, or because of "
+                  "friendship).");
 }
 
 }  // namespace internal
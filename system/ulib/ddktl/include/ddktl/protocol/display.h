@@ -20,6 +20,7 @@ class DisplayProtocol : public internal::base_protocol {
         ops_.get_mode = GetMode;
         ops_.get_framebuffer = GetFramebuffer;
         ops_.flush = FlushThunk;
+        ops_.flush_region = FlushRegionThunk;
 
         // Can only inherit from one base_protocol implemenation
         ZX_ASSERT(ddk_proto_id_ == 0);
@@ -44,6 +45,10 @@ class DisplayProtocol : public internal::base_protocol {
         static_cast<D*>(ctx)->Flush();
     }
 
+    static void FlushRegionThunk(void* ctx, const ioctl_display_region_t* region) {
+        static_cast<D*>(ctx)->FlushRegion(region);
+    }
+
     display_protocol_ops_t ops_ = {};
 };
 
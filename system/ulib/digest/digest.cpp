@@ -42,10 +42,14 @@ Digest& Digest::operator=(const uint8_t* rhs) {
 
 zx_status_t Digest::Init() {
     ZX_DEBUG_ASSERT(ref_count_ == 0);
-    fbl::AllocChecker ac;
-    ctx_.reset(new (&ac) Context());
-    if (!ac.check()) {
-        return ZX_ERR_NO_MEMORY;
+    // A Merkle tree initializes its digests once per node, so the context
+    // is kept for reuse rather than reallocated each time.
+    if (ctx_ == nullptr) {
+        fbl::AllocChecker ac;
+        ctx_.reset(new (&ac) Context());
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
     }
     SHA256_Init(&ctx_->impl);
     return ZX_OK;
@@ -58,6 +58,11 @@ public:
     static zx_status_t Create(const void* data, size_t data_len, void* tree,
                               size_t tree_len, Digest* digest);
 
+    // Like Create(), but hashes the data nodes on up to |num_threads| threads,
+    // when |data_len| is large enough for that to pay off.
+    static zx_status_t CreateParallel(const void* data, size_t data_len, void* tree,
+                                      size_t tree_len, Digest* digest, size_t num_threads);
+
     // Checks the integrity of a the region of data given by the offset and
     // length.  It checks integrity using the given Merkle tree and trusted root
     // digest. |tree_len| must be at least as much as returned by
@@ -4,6 +4,7 @@
 
 #include <digest/merkle-tree.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -94,6 +95,40 @@ size_t NextAligned(size_t length) {
     return fbl::round_up(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helpers for hashing the data nodes in parallel.
+
+// Fewer data nodes than this per thread aren't worth starting a thread for.
+constexpr size_t kMinNodesPerThread = 128;
+constexpr size_t kMaxThreads = 16;
+
+// The data nodes [start, end) for one thread to hash, out of |data_len| bytes
+// of |data|, writing their digests to |out|.
+struct LeafRange {
+    const uint8_t* data;
+    size_t data_len;
+    size_t start;
+    size_t end;
+    uint8_t* out;
+    zx_status_t rc;
+};
+
+void* HashLeaves(void* arg) {
+    LeafRange* range = static_cast<LeafRange*>(arg);
+    Digest digest;
+    range->rc = ZX_OK;
+    for (size_t offset = range->start; offset < range->end; offset += MerkleTree::kNodeSize) {
+        if ((range->rc = DigestInit(&digest, offset, range->data_len - offset)) != ZX_OK) {
+            break;
+        }
+        size_t chunk = DigestUpdate(&digest, range->data + offset, offset,
+                                    range->data_len - offset);
+        DigestFinal(&digest, offset + chunk);
+        digest.CopyTo(range->out + offset / kDigestsPerNode, Digest::kLength);
+    }
+    return nullptr;
+}
+
 } // namespace
 
 ////////
@@ -116,6 +151,70 @@ zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, si
     return ZX_OK;
 }
 
+zx_status_t MerkleTree::CreateParallel(const void* data, size_t data_len, void* tree,
+                                       size_t tree_len, Digest* digest, size_t num_threads) {
+    const size_t nodes = fbl::round_up(data_len, kNodeSize) / kNodeSize;
+    num_threads = fbl::min(fbl::min(num_threads, kMaxThreads), nodes / kMinNodesPerThread);
+    if (num_threads < 2) {
+        return Create(data, data_len, tree, tree_len, digest);
+    }
+    // Must have data to read, a tree to fill, and a root to write.
+    if (!data || !tree || !digest) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    const size_t level_len = NextAligned(data_len);
+    if (tree_len < level_len) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    // The digests of the data nodes make up the bottom level of the tree.
+    // Each thread hashes a run of them, with this one taking the first.
+    uint8_t* out = static_cast<uint8_t*>(tree);
+    memset(out, 0, level_len);
+    const size_t per_thread = fbl::round_up(nodes, num_threads) / num_threads * kNodeSize;
+    LeafRange ranges[kMaxThreads];
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads] = {};
+    for (size_t i = 0; i < num_threads; i++) {
+        ranges[i].data = static_cast<const uint8_t*>(data);
+        ranges[i].data_len = data_len;
+        ranges[i].start = fbl::min(i * per_thread, data_len);
+        ranges[i].end = fbl::min(ranges[i].start + per_thread, data_len);
+        ranges[i].out = out;
+        if (i != 0) {
+            // If a thread can't be started, its run is hashed here instead.
+            started[i] = pthread_create(&threads[i], nullptr, HashLeaves, &ranges[i]) == 0;
+        }
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        if (!started[i]) {
+            HashLeaves(&ranges[i]);
+        }
+    }
+    zx_status_t rc = ZX_OK;
+    for (size_t i = 0; i < num_threads; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], nullptr);
+        }
+        if (rc == ZX_OK) {
+            rc = ranges[i].rc;
+        }
+    }
+    if (rc != ZX_OK) {
+        return rc;
+    }
+
+    // The levels above are small enough to build as usual.
+    MerkleTree mt;
+    mt.level_ = 1;
+    if ((rc = mt.CreateInit(level_len, tree_len - level_len)) != ZX_OK ||
+        (rc = mt.CreateUpdate(out, level_len, out + level_len)) != ZX_OK ||
+        (rc = mt.CreateFinal(out + level_len, digest)) != ZX_OK) {
+        return rc;
+    }
+    return ZX_OK;
+}
+
 MerkleTree::MerkleTree() : initialized_(false), next_(nullptr), level_(0), offset_(0), length_(0) {}
 
 MerkleTree::~MerkleTree() {}
@@ -254,7 +353,9 @@ zx_status_t MerkleTree::Verify(const void* data, size_t data_len, const void* tr
         if ((rc = VerifyLevel(data, data_len, tree, offset, length, level)) != ZX_OK) {
             return rc;
         }
-        // Ascend to the next level up.
+        // Ascend to the next level up, where the range is the digests of the
+        // nodes just checked. Scaling |length| down on its own would lose
+        // those of a short range, leaving their node above unchecked.
         data = tree;
         root_len = NextLength(data_len);
         data_len = NextAligned(data_len);
@@ -263,8 +364,9 @@ zx_status_t MerkleTree::Verify(const void* data, size_t data_len, const void* tr
             return ZX_ERR_BUFFER_TOO_SMALL;
         }
         tree_len -= data_len;
-        offset /= kDigestsPerNode;
-        length /= kDigestsPerNode;
+        size_t end = fbl::round_up(offset + length, kNodeSize) / kDigestsPerNode;
+        offset = (offset - offset % kNodeSize) / kDigestsPerNode;
+        length = end - offset;
         ++level;
     }
     return VerifyRoot(data, root_len, level, root);
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <zircon/syscalls.h>
 #include <zx/event.h>
 
 #include <dispatcher-pool/dispatcher-execution-domain.h>
@@ -10,7 +11,7 @@
 namespace dispatcher {
 
 // static
-fbl::RefPtr<ExecutionDomain> ExecutionDomain::Create(uint32_t priority) {
+fbl::RefPtr<ExecutionDomain> ExecutionDomain::Create(uint32_t priority, uint32_t sched_weight) {
     zx::event evt;
     if (zx::event::create(0, &evt) != ZX_OK)
         return nullptr;
@@ -19,7 +20,7 @@ fbl::RefPtr<ExecutionDomain> ExecutionDomain::Create(uint32_t priority) {
         return nullptr;
 
     fbl::RefPtr<ThreadPool> thread_pool;
-    zx_status_t res = ThreadPool::Get(&thread_pool, priority);
+    zx_status_t res = ThreadPool::Get(&thread_pool, priority, sched_weight);
     if (res != ZX_OK)
         return nullptr;
     ZX_DEBUG_ASSERT(thread_pool != nullptr);
@@ -114,6 +115,11 @@ void ExecutionDomain::Deactivate(bool sync_dispatch) {
         pool->RemoveDomainFromPool(this);
 }
 
+ExecutionDomain::Stats ExecutionDomain::GetStats() {
+    fbl::AutoLock sources_lock(&sources_lock_);
+    return stats_;
+}
+
 fbl::RefPtr<ThreadPool> ExecutionDomain::GetThreadPool() {
     fbl::AutoLock sources_lock(&sources_lock_);
     return fbl::RefPtr<ThreadPool>(thread_pool_);
@@ -186,6 +192,7 @@ bool ExecutionDomain::AddPendingWork(EventSource* event_source) {
     }
 
     event_source->dispatch_state_ = DispatchState::DispatchPending;
+    event_source->pending_time_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
     pending_work_.push_back(fbl::WrapRefPtr(event_source));
 
     return ret;
@@ -235,6 +242,12 @@ void ExecutionDomain::DispatchPendingWork() {
             }
 
             source = pending_work_.begin().CopyPointer();
+
+            zx_duration_t delay = zx_clock_get(ZX_CLOCK_MONOTONIC) - source->pending_time_;
+            ++stats_.dispatch_count;
+            stats_.total_queue_delay += delay;
+            if (stats_.max_queue_delay < delay)
+                stats_.max_queue_delay = delay;
         }
 
         // Attempt to transition to the Dispatching state.  If this fails, it
@@ -2,11 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/syscalls/port.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <fbl/algorithm.h>
+
 #include <dispatcher-pool/dispatcher-execution-domain.h>
 #include <dispatcher-pool/dispatcher-thread-pool.h>
 
@@ -15,14 +19,19 @@
 namespace dispatcher {
 
 fbl::Mutex ThreadPool::active_pools_lock_;
-fbl::WAVLTree<uint32_t, fbl::RefPtr<ThreadPool>> ThreadPool::active_pools_;
+fbl::WAVLTree<uint64_t, fbl::RefPtr<ThreadPool>> ThreadPool::active_pools_;
 bool ThreadPool::system_shutdown_ = false;
+constexpr zx_duration_t ThreadPool::kIdleTimeout;
 
 static constexpr uint32_t MAX_THREAD_PRIORITY = 31;
 
 // static
-zx_status_t ThreadPool::Get(fbl::RefPtr<ThreadPool>* pool_out, uint32_t priority) {
-    if ((pool_out == nullptr) || (priority > MAX_THREAD_PRIORITY))
+zx_status_t ThreadPool::Get(fbl::RefPtr<ThreadPool>* pool_out,
+                            uint32_t priority,
+                            uint32_t sched_weight) {
+    if ((pool_out == nullptr) ||
+        (priority > MAX_THREAD_PRIORITY) ||
+        (sched_weight > ZX_THREAD_SCHED_WEIGHT_MAX))
         return ZX_ERR_INVALID_ARGS;
 
     // From here on out, we need to be inside of the active pools lock.
@@ -33,9 +42,9 @@ zx_status_t ThreadPool::Get(fbl::RefPtr<ThreadPool>* pool_out, uint32_t priority
     if (system_shutdown_)
         return ZX_ERR_BAD_STATE;
 
-    // Do we already have a pool running at the desired priority?  If so, just
-    // return a reference to it.
-    auto iter = active_pools_.find(priority);
+    // Do we already have a pool running with the desired priority and weight?
+    // If so, just return a reference to it.
+    auto iter = active_pools_.find(MakeKey(priority, sched_weight));
     if (iter.IsValid()) {
         *pool_out = iter.CopyPointer();
         return ZX_OK;
@@ -44,15 +53,17 @@ zx_status_t ThreadPool::Get(fbl::RefPtr<ThreadPool>* pool_out, uint32_t priority
     // Looks like we don't have an appropriate pool just yet.  Try to create one
     // and add it to the active set of pools.
     fbl::AllocChecker ac;
-    auto new_pool = fbl::AdoptRef(new (&ac) ThreadPool(priority));
+    auto new_pool = fbl::AdoptRef(new (&ac) ThreadPool(priority, sched_weight));
     if (!ac.check()) {
-        printf("Failed to allocate new thread pool (prio %u)\n", priority);
+        printf("Failed to allocate new thread pool (prio %u, weight %u)\n",
+               priority, sched_weight);
         return ZX_ERR_NO_MEMORY;
     }
 
     zx_status_t res = new_pool->Init();
     if (res != ZX_OK) {
-        printf("Failed to initialize new thread pool (prio %u, res %d)\n", priority, res);
+        printf("Failed to initialize new thread pool (prio %u, weight %u, res %d)\n",
+               priority, sched_weight, res);
         return res;
     }
 
@@ -63,7 +74,7 @@ zx_status_t ThreadPool::Get(fbl::RefPtr<ThreadPool>* pool_out, uint32_t priority
 
 // static
 void ThreadPool::ShutdownAll() {
-    fbl::WAVLTree<uint32_t, fbl::RefPtr<ThreadPool>> shutdown_targets;
+    decltype(active_pools_) shutdown_targets;
 
     {
         fbl::AutoLock lock(&active_pools_lock_);
@@ -104,23 +115,9 @@ zx_status_t ThreadPool::AddDomainToPool(fbl::RefPtr<ExecutionDomain> domain) {
     active_domains_.push_back(fbl::move(domain));
     ++active_domain_count_;
 
-    while ((active_thread_count_ < active_domain_count_) &&
-           (active_thread_count_ < zx_system_get_num_cpus())) {
-        auto thread = Thread::Create(fbl::WrapRefPtr(this), active_thread_count_);
-        if (thread == nullptr) {
-            LOG("Failed to create new thread\n");
-            break;
-        }
-
-        active_threads_.push_front(fbl::move(thread));
-        if (active_threads_.front().Start() != ZX_OK) {
-            LOG("Failed to start new thread\n");
-            thread = active_threads_.pop_front();
-            break;
-        }
-
-        active_thread_count_++;
-    }
+    // The rest of the threads are started as the work shows up.
+    if (active_thread_count_ == 0)
+        StartThreadLocked();
 
     return ZX_OK;
 }
@@ -128,7 +125,84 @@ zx_status_t ThreadPool::AddDomainToPool(fbl::RefPtr<ExecutionDomain> domain) {
 void ThreadPool::RemoveDomainFromPool(ExecutionDomain* domain) {
     ZX_DEBUG_ASSERT(domain != nullptr);
     fbl::AutoLock pool_lock(&pool_lock_);
+
+    // Once shutdown has begun, the domains have already been taken off of our
+    // list.
+    if (pool_shutting_down_)
+        return;
+
     active_domains_.erase(*domain);
+    ZX_DEBUG_ASSERT(active_domain_count_ > 0);
+    --active_domain_count_;
+}
+
+void ThreadPool::StartThreadLocked() {
+    // A domain never dispatches on more than one thread at a time, so there is
+    // no use for more threads than domains.
+    uint32_t max_threads = fbl::min(fbl::max(active_domain_count_, 1u),
+                                    zx_system_get_num_cpus());
+    if (pool_shutting_down_ || (active_thread_count_ >= max_threads))
+        return;
+
+    auto thread = Thread::Create(fbl::WrapRefPtr(this), next_thread_id_);
+    if (thread == nullptr) {
+        LOG("Failed to create new thread\n");
+        return;
+    }
+
+    // The new thread counts as idle from the start, so that no one else tries
+    // to start another one for the same work while it gets going.
+    idle_thread_count_.fetch_add(1u);
+    active_threads_.push_front(fbl::move(thread));
+    if (active_threads_.front().Start() != ZX_OK) {
+        LOG("Failed to start new thread\n");
+        idle_thread_count_.fetch_sub(1u);
+        thread = active_threads_.pop_front();
+        return;
+    }
+
+    ++active_thread_count_;
+    ++next_thread_id_;
+}
+
+void ThreadPool::MaybeGrow() {
+    fbl::AutoLock pool_lock(&pool_lock_);
+
+    // Another thread may have gone idle, or started one, while we waited for
+    // the lock.
+    if (idle_thread_count_.load() != 0)
+        return;
+
+    StartThreadLocked();
+}
+
+bool ThreadPool::RetireThread(Thread* thread) {
+    decltype(retired_threads_) to_join;
+    {
+        fbl::AutoLock pool_lock(&pool_lock_);
+
+        // Keep at least one thread, and keep this one unless another is idle
+        // to take its place on the port.  During shutdown, every thread waits
+        // for its quit message instead.
+        if (pool_shutting_down_ ||
+            (active_thread_count_ <= 1) ||
+            (idle_thread_count_.load() <= 1))
+            return false;
+
+        idle_thread_count_.fetch_sub(1u);
+        --active_thread_count_;
+
+        // Whoever retired before us has already left the lock, and so is done
+        // with the pool.  Take them with us to join, and leave ourselves for
+        // the next one.
+        to_join.swap(retired_threads_);
+        retired_threads_.push_front(active_threads_.erase(*thread));
+    }
+
+    for (auto& retired : to_join)
+        retired.Join();
+
+    return true;
 }
 
 zx_status_t ThreadPool::WaitOnPort(const zx::handle& handle,
@@ -216,15 +290,19 @@ void ThreadPool::InternalShutdown() {
         }
     }
 
-    // Synchronize with the threads as they exit.
+    // Synchronize with the threads as they exit, and with any which retired
+    // before we began.
     while (true) {
         fbl::unique_ptr<Thread> thread;
         {
             fbl::AutoLock lock(&pool_lock_);
-            if (active_threads_.is_empty())
+            if (!active_threads_.is_empty()) {
+                thread = active_threads_.pop_front();
+            } else if (!retired_threads_.is_empty()) {
+                thread = retired_threads_.pop_front();
+            } else {
                 break;
-
-            thread = active_threads_.pop_front();
+            }
         }
 
         thread->Join();
@@ -272,7 +350,7 @@ void ThreadPool::Thread::Join() {
 }
 
 void ThreadPool::Thread::PrintDebugPrefix() const {
-    printf("[Thread %03u-%02u] ", id_, pool_->priority());
+    printf("[Thread %03u-%02u-%u] ", id_, pool_->priority(), pool_->sched_weight());
 }
 
 int ThreadPool::Thread::Main() {
@@ -286,15 +364,27 @@ int ThreadPool::Thread::Main() {
         DEBUG_LOG("WARNING - Failed to set thread priority (res %d)\n", res);
     }
 
+    uint32_t sched_weight = pool_->sched_weight();
+    if (sched_weight != ZX_THREAD_SCHED_WEIGHT_NONE) {
+        res = zx_object_set_property(zx_thread_self(), ZX_PROP_THREAD_SCHED_WEIGHT,
+                                     &sched_weight, sizeof(sched_weight));
+        if (res != ZX_OK) {
+            DEBUG_LOG("WARNING - Failed to set thread sched weight (res %d)\n", res);
+        }
+    }
+
     while (true) {
         zx_port_packet_t pkt;
 
-        // TODO(johngro) : consider automatically shutting down if we have more
-        // threads than clients.
-
-        // Wait for there to be work to dispatch.  We should never encounter an
-        // error, but if we do, shut down.
-        res = pool_->port().wait(zx::time::infinite(), &pkt, 0);
+        // Wait for there to be work to dispatch.  If there has been none for
+        // a while, see whether the pool can do without us.  We should never
+        // encounter any other error, but if we do, shut down.
+        res = pool_->port().wait(zx::deadline_after(zx::duration(kIdleTimeout)), &pkt, 0);
+        if (res == ZX_ERR_TIMED_OUT) {
+            if (pool_->RetireThread(this))
+                break;
+            continue;
+        }
         ZX_DEBUG_ASSERT(res == ZX_OK);
 
         // Is it time to exit?
@@ -302,6 +392,11 @@ int ThreadPool::Thread::Main() {
             break;
         }
 
+        // If we were the last thread waiting on the port, start another one to
+        // take our place while we dispatch.
+        if (pool_->idle_thread_count_.fetch_sub(1u) == 1u)
+            pool_->MaybeGrow();
+
         if (pkt.type != ZX_PKT_TYPE_SIGNAL_ONE) {
             LOG("Unexpected packet type (%u) in Thread pool!\n", pkt.type);
             continue;
@@ -322,6 +417,8 @@ int ThreadPool::Thread::Main() {
 
         if (domain != nullptr)
             domain->DispatchPendingWork();
+
+        pool_->idle_thread_count_.fetch_add(1u);
     }
 
     DEBUG_LOG("Client work thread shutting down\n");
@@ -109,6 +109,10 @@ private:
 
     const zx_signals_t process_signal_mask_;
 
+    // When we were last added to the domain's pending_work_ list.  Guarded by
+    // the domain's sources_lock_.
+    zx_time_t pending_time_ = 0;
+
     // Node state for existing on the domain's sources_ list.
     fbl::DoublyLinkedListNodeState<fbl::RefPtr<EventSource>> sources_node_state_;
 
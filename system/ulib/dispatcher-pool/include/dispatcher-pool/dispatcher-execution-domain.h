@@ -6,6 +6,7 @@
 
 #include <zircon/assert.h>
 #include <zircon/compiler.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/types.h>
 #include <zx/event.h>
 #include <fbl/intrusive_double_list.h>
@@ -95,8 +96,25 @@ public:
         ~ScopedToken() __TA_RELEASE() { }
     };
 
+    // Statistics about how long work waits in a domain for its turn to be
+    // dispatched, from the moment a thread in the pool picks it up off of the
+    // port.  Long delays mean the domain's handlers are keeping each other
+    // waiting; the pool adds threads for work waiting on the port by itself.
+    struct Stats {
+        uint64_t dispatch_count;
+        zx_duration_t total_queue_delay;
+        zx_duration_t max_queue_delay;
+    };
+
     static constexpr uint32_t DEFAULT_PRIORITY = 16;
-    static fbl::RefPtr<ExecutionDomain> Create(uint32_t priority = DEFAULT_PRIORITY);
+
+    // Creates a domain whose work is dispatched by threads running at
+    // |priority| and, unless it is ZX_THREAD_SCHED_WEIGHT_NONE, with the
+    // fair-share |sched_weight|.  Domains with the same priority and weight
+    // share a thread pool.
+    static fbl::RefPtr<ExecutionDomain> Create(
+            uint32_t priority = DEFAULT_PRIORITY,
+            uint32_t sched_weight = ZX_THREAD_SCHED_WEIGHT_NONE);
 
     void Deactivate() __TA_EXCLUDES(domain_token_) { Deactivate(true); }
     void DeactivateFromWithinDomain() __TA_REQUIRES(domain_token_) { Deactivate(false); }
@@ -107,6 +125,8 @@ public:
 
     const Token& token() __TA_RETURN_CAPABILITY(domain_token_) { return domain_token_; }
 
+    Stats GetStats() __TA_EXCLUDES(sources_lock_);
+
 private:
     friend class fbl::RefPtr<ExecutionDomain>;
     friend class Channel;
@@ -158,6 +178,7 @@ private:
     bool dispatch_sync_in_progress_ __TA_GUARDED(sources_lock_) = false;
     fbl::RefPtr<ThreadPool> thread_pool_ __TA_GUARDED(sources_lock_);
     zx::event dispatch_idle_evt_;
+    Stats stats_ __TA_GUARDED(sources_lock_) = {};
 
     // The list of all sources bound to us, as well as the sources which are
     // currently waiting to be dispatched.
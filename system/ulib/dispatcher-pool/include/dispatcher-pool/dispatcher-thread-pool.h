@@ -5,8 +5,10 @@
 #pragma once
 
 #include <zircon/compiler.h>
+#include <zircon/syscalls/object.h>
 #include <zircon/types.h>
 #include <zx/port.h>
+#include <fbl/atomic.h>
 #include <fbl/auto_lock.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_single_list.h>
@@ -21,10 +23,28 @@
 
 namespace dispatcher {
 
+// class ThreadPool
+//
+// A ThreadPool is a set of threads, all running with the same scheduling
+// profile, which wait on a single port and dispatch the work which shows up
+// in the ExecutionDomains assigned to the pool.
+//
+// The pool sizes itself as it goes.  It begins with a single thread.  Any
+// time the last idle thread picks up work, it starts another one, so that
+// there is always a thread waiting on the port, up to one thread for each
+// domain in the pool (a domain never runs on two threads at once) or one for
+// each CPU, whichever is fewer.  Threads which find no work at all for
+// |kIdleTimeout| exit again, as long as another idle thread is left.
 class ThreadPool : public fbl::RefCounted<ThreadPool>,
                    public fbl::WAVLTreeContainable<fbl::RefPtr<ThreadPool>> {
 public:
-    static zx_status_t Get(fbl::RefPtr<ThreadPool>* pool_out, uint32_t priority);
+    static constexpr zx_duration_t kIdleTimeout = ZX_SEC(5);
+
+    // Returns the pool whose threads run at |priority| and, if it is not
+    // ZX_THREAD_SCHED_WEIGHT_NONE, with the fair-share |sched_weight|.
+    static zx_status_t Get(fbl::RefPtr<ThreadPool>* pool_out,
+                           uint32_t priority,
+                           uint32_t sched_weight = ZX_THREAD_SCHED_WEIGHT_NONE);
     static void ShutdownAll();
 
     void Shutdown();
@@ -37,7 +57,7 @@ public:
                            uint32_t options);
     zx_status_t CancelWaitOnPort(const zx::handle& handle, uint64_t key);
 
-    uint32_t GetKey() const { return priority_; }
+    uint64_t GetKey() const { return MakeKey(priority_, sched_weight_); }
 
 private:
     friend class fbl::RefPtr<ThreadPool>;
@@ -64,35 +84,65 @@ private:
         const uint32_t id_;
     };
 
-    explicit ThreadPool(uint32_t priority) : priority_(priority) { }
+    ThreadPool(uint32_t priority, uint32_t sched_weight)
+        : priority_(priority), sched_weight_(sched_weight) { }
     ~ThreadPool() { }
 
+    static uint64_t MakeKey(uint32_t priority, uint32_t sched_weight) {
+        return (static_cast<uint64_t>(sched_weight) << 32) | priority;
+    }
+
     uint32_t priority() const { return priority_; }
+    uint32_t sched_weight() const { return sched_weight_; }
     const zx::port& port() const { return port_; }
 
     void PrintDebugPrefix();
     zx_status_t Init();
     void InternalShutdown();
 
+    // Starts another thread, unless the pool already has as many as it can
+    // use.
+    void StartThreadLocked() __TA_REQUIRES(pool_lock_);
+
+    // Called by a thread which has just picked up work, leaving no idle
+    // threads behind it to wait on the port.
+    void MaybeGrow() __TA_EXCLUDES(pool_lock_);
+
+    // Called by a thread which has been idle for |kIdleTimeout|.  Returns true
+    // if the thread should exit, in which case it has been moved to the
+    // retired_threads_ list to be joined.
+    bool RetireThread(Thread* thread) __TA_EXCLUDES(pool_lock_);
+
     static fbl::Mutex active_pools_lock_;
-    static fbl::WAVLTree<uint32_t, fbl::RefPtr<ThreadPool>> active_pools_
+    static fbl::WAVLTree<uint64_t, fbl::RefPtr<ThreadPool>> active_pools_
         __TA_GUARDED(active_pools_lock_);
     static bool system_shutdown_ __TA_GUARDED(active_pools_lock_);
 
     const uint32_t priority_;
+    const uint32_t sched_weight_;
 
     fbl::Mutex pool_lock_ __TA_ACQUIRED_AFTER(active_pools_lock_);
     zx::port port_;
     uint32_t active_domain_count_ __TA_GUARDED(pool_lock_) = 0;
     uint32_t active_thread_count_ __TA_GUARDED(pool_lock_) = 0;
+    uint32_t next_thread_id_ __TA_GUARDED(pool_lock_) = 0;
     bool pool_shutting_down_ __TA_GUARDED(pool_lock_) = false;
 
+    // The number of threads waiting on the port, or about to.  Updated
+    // without the lock as threads pick up work and finish it.
+    fbl::atomic<uint32_t> idle_thread_count_{0u};
+
     fbl::DoublyLinkedList<fbl::RefPtr<ExecutionDomain>,
                            ExecutionDomain::ThreadPoolListTraits> active_domains_
         __TA_GUARDED(pool_lock_);
 
     fbl::DoublyLinkedList<fbl::unique_ptr<Thread>> active_threads_
         __TA_GUARDED(pool_lock_);
+
+    // Threads which have exited, or are about to, because they were idle.
+    // They are joined by the next thread to retire, or at shutdown.
+    fbl::DoublyLinkedList<fbl::unique_ptr<Thread>> retired_threads_
+        __TA_GUARDED(pool_lock_);
 };
 
 }  // namespace dispatcher
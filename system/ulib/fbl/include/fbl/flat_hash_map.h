@@ -0,0 +1,504 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/macros.h>
+#include <fbl/new.h>
+#include <fbl/type_support.h>
+#include <fbl/vector.h>
+#include <zircon/assert.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace fbl {
+
+// DefaultFlatHashTraits defines the hash function and key comparison of a
+// FlatHashMap whose keys are integers or pointers.  Maps with other kinds of
+// keys must supply traits with the same two static methods.
+//
+// GetHash does not need to spread its result over all of the bits of a
+// size_t; the map mixes it before use.
+template <typename Key>
+struct DefaultFlatHashTraits {
+    static size_t GetHash(const Key& key) { return (size_t)(key); }
+    static bool EqualTo(const Key& a, const Key& b) { return a == b; }
+};
+
+namespace internal {
+
+// The control byte of each slot of a FlatHashMap says whether the slot is
+// empty, was emptied by an erase, or is full.  Full slots hold seven bits of
+// their key's hash, so most of the time a lookup only compares the key of the
+// entry it is looking for.
+using FlatHashCtrl = uint8_t;
+constexpr FlatHashCtrl kFlatHashEmpty   = 0x80;
+constexpr FlatHashCtrl kFlatHashDeleted = 0xfe;
+
+// A group of control bytes which a FlatHashMap probes at once.  The masks this
+// returns have one bit set for each matching slot, which NextMatch() pops off
+// lowest first.
+#if defined(__SSE2__)
+
+// Sixteen slots at a time, with SSE2.
+class FlatHashGroup {
+public:
+    static constexpr size_t kWidth = 16;
+    using Mask = uint32_t;
+
+    explicit FlatHashGroup(const FlatHashCtrl* ctrl)
+        : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+
+    Mask Match(FlatHashCtrl h2) const {
+        return static_cast<Mask>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(h2)), ctrl_)));
+    }
+
+    Mask MatchEmpty() const { return Match(kFlatHashEmpty); }
+
+    // Empty and deleted slots are the ones with their top bit set.
+    Mask MatchEmptyOrDeleted() const { return static_cast<Mask>(_mm_movemask_epi8(ctrl_)); }
+
+    static size_t NextMatch(Mask* mask) {
+        size_t ndx = __builtin_ctz(*mask);
+        *mask &= *mask - 1;
+        return ndx;
+    }
+
+private:
+    __m128i ctrl_;
+};
+
+#else
+
+// Eight slots at a time, in a 64 bit word.  This is what the kernel uses,
+// since it is built without SIMD.
+class FlatHashGroup {
+public:
+    static constexpr size_t kWidth = 8;
+    using Mask = uint64_t;
+
+    explicit FlatHashGroup(const FlatHashCtrl* ctrl) { memcpy(&ctrl_, ctrl, sizeof(ctrl_)); }
+
+    // This may also report a slot which holds h2 + 1 next to one which holds
+    // h2.  That only costs an extra key comparison.
+    Mask Match(FlatHashCtrl h2) const {
+        uint64_t x = ctrl_ ^ (kLsbs * h2);
+        return (x - kLsbs) & ~x & kMsbs;
+    }
+
+    // kFlatHashEmpty is the only control byte with its top bit set and its
+    // second lowest bit clear, and kFlatHashDeleted the only other one with its
+    // top bit set.
+    Mask MatchEmpty() const { return ctrl_ & (~ctrl_ << 6) & kMsbs; }
+    Mask MatchEmptyOrDeleted() const { return ctrl_ & (~ctrl_ << 7) & kMsbs; }
+
+    static size_t NextMatch(Mask* mask) {
+        size_t ndx = __builtin_ctzll(*mask) >> 3;
+        *mask &= *mask - 1;
+        return ndx;
+    }
+
+private:
+    static constexpr uint64_t kLsbs = 0x0101010101010101ull;
+    static constexpr uint64_t kMsbs = 0x8080808080808080ull;
+
+    uint64_t ctrl_;
+};
+
+#endif
+
+} // namespace internal
+
+// FlatHashMap<> is a hash map which stores its entries by value, in a single
+// array, rather than linking them together.  Lookups probe a group of slots
+// at a time (see internal::FlatHashGroup), comparing a byte of each slot's
+// hash before touching any entries, so it suits maps with small keys and
+// values, like handles or koids to state.
+//
+// Like Vector<>, FlatHashMap<> reports allocation failures instead of
+// throwing exceptions, and may be moved but not copied.  The map grows when
+// an insert would fill more than 7/8 of its slots.  Pointers to values and
+// iterators are invalidated by any insert or erase.
+template <typename Key,
+          typename Value,
+          typename HashTraits = DefaultFlatHashTraits<Key>,
+          typename AllocatorTraits = DefaultAllocatorTraits>
+class FlatHashMap {
+private:
+    template <typename EntryType, typename MapType> class iterator_impl;
+
+public:
+    // An entry of the map.  Do not modify the key of an entry in place.
+    struct Entry {
+        Key key;
+        Value value;
+    };
+
+    using iterator = iterator_impl<Entry, FlatHashMap>;
+    using const_iterator = iterator_impl<const Entry, const FlatHashMap>;
+
+    // The number of slots in each group, and so the smallest capacity a map
+    // which holds anything has.
+    static constexpr size_t kGroupWidth = internal::FlatHashGroup::kWidth;
+
+    // move semantics only
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(FlatHashMap);
+
+    constexpr FlatHashMap() {}
+
+    FlatHashMap(FlatHashMap&& other) { swap(other); }
+
+    FlatHashMap& operator=(FlatHashMap&& other) {
+        reset();
+        swap(other);
+        return *this;
+    }
+
+    ~FlatHashMap() { reset(); }
+
+    size_t size() const { return size_; }
+    bool is_empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+
+    void swap(FlatHashMap& other) {
+        Swap(&entries_, &other.entries_);
+        Swap(&ctrl_, &other.ctrl_);
+        Swap(&group_mask_, &other.group_mask_);
+        Swap(&capacity_, &other.capacity_);
+        Swap(&size_, &other.size_);
+        Swap(&growth_left_, &other.growth_left_);
+    }
+
+    // Destroy every entry and free the map's storage.
+    void reset() {
+        clear();
+        AllocatorTraits::Deallocate(entries_);
+        entries_ = nullptr;
+        ctrl_ = nullptr;
+        group_mask_ = 0;
+        capacity_ = 0;
+        growth_left_ = 0;
+    }
+
+    // Destroy every entry, but keep the map's storage for reuse.
+    void clear() {
+        for (size_t i = 0; i < capacity_; ++i) {
+            if (IsFull(ctrl_[i]))
+                entries_[i].~Entry();
+        }
+        if (capacity_ != 0)
+            memset(ctrl_, internal::kFlatHashEmpty, capacity_);
+        size_ = 0;
+        growth_left_ = MaxLoad(capacity_);
+    }
+
+    // Make room for at least |count| entries without growing again.
+    void reserve(size_t count, AllocChecker* ac) {
+        if (count <= size_ + growth_left_) {
+            ac->arm(0u, true);
+            return;
+        }
+        Resize(CapacityFor(count), ac);
+    }
+
+    Value* find(const Key& key) {
+        size_t ndx = FindIndex(key);
+        return (ndx == kNotFound) ? nullptr : &entries_[ndx].value;
+    }
+
+    const Value* find(const Key& key) const {
+        return const_cast<FlatHashMap*>(this)->find(key);
+    }
+
+    bool contains(const Key& key) const { return FindIndex(key) != kNotFound; }
+
+    // Add |value| under |key| if the map doesn't hold |key| already.  Returns
+    // true if it did, and otherwise false, leaving the map unchanged; in that
+    // case ac->check() is false if the map needed to grow and couldn't.
+    bool insert(const Key& key, Value&& value, AllocChecker* ac) {
+        return InsertInternal(key, fbl::move(value), false, ac);
+    }
+
+    bool insert(const Key& key, const Value& value, AllocChecker* ac) {
+        return InsertInternal(key, value, false, ac);
+    }
+
+    // Like insert(), but replaces the value of an entry which already has
+    // |key|.
+    void insert_or_assign(const Key& key, Value&& value, AllocChecker* ac) {
+        InsertInternal(key, fbl::move(value), true, ac);
+    }
+
+    void insert_or_assign(const Key& key, const Value& value, AllocChecker* ac) {
+        InsertInternal(key, value, true, ac);
+    }
+
+#ifndef _KERNEL
+    bool insert(const Key& key, Value&& value) {
+        AllocChecker ac;
+        bool inserted = insert(key, fbl::move(value), &ac);
+        ZX_ASSERT(ac.check());
+        return inserted;
+    }
+
+    bool insert(const Key& key, const Value& value) {
+        AllocChecker ac;
+        bool inserted = insert(key, value, &ac);
+        ZX_ASSERT(ac.check());
+        return inserted;
+    }
+
+    void insert_or_assign(const Key& key, Value&& value) {
+        AllocChecker ac;
+        insert_or_assign(key, fbl::move(value), &ac);
+        ZX_ASSERT(ac.check());
+    }
+
+    void insert_or_assign(const Key& key, const Value& value) {
+        AllocChecker ac;
+        insert_or_assign(key, value, &ac);
+        ZX_ASSERT(ac.check());
+    }
+#endif // _KERNEL
+
+    // Erase the entry with |key|.  Returns false if there was none.
+    bool erase(const Key& key) {
+        size_t ndx = FindIndex(key);
+        if (ndx == kNotFound)
+            return false;
+        EraseIndex(ndx);
+        return true;
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, capacity_); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, capacity_); }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
+
+private:
+    template <typename EntryType, typename MapType>
+    class iterator_impl {
+    public:
+        iterator_impl() {}
+
+        bool operator==(const iterator_impl& other) const { return ndx_ == other.ndx_; }
+        bool operator!=(const iterator_impl& other) const { return ndx_ != other.ndx_; }
+
+        iterator_impl& operator++() {
+            ++ndx_;
+            SkipToFull();
+            return *this;
+        }
+
+        iterator_impl operator++(int) {
+            iterator_impl ret(*this);
+            ++(*this);
+            return ret;
+        }
+
+        EntryType& operator*() const { return map_->entries_[ndx_]; }
+        EntryType* operator->() const { return &map_->entries_[ndx_]; }
+
+    private:
+        friend FlatHashMap;
+
+        iterator_impl(MapType* map, size_t ndx) : map_(map), ndx_(ndx) { SkipToFull(); }
+
+        void SkipToFull() {
+            while (ndx_ < map_->capacity_ && !IsFull(map_->ctrl_[ndx_]))
+                ++ndx_;
+        }
+
+        MapType* map_ = nullptr;
+        size_t ndx_ = 0;
+    };
+
+    static constexpr size_t kNotFound = static_cast<size_t>(-1);
+
+    template <typename T>
+    static void Swap(T* a, T* b) {
+        T t = *a;
+        *a = *b;
+        *b = t;
+    }
+
+    static bool IsFull(internal::FlatHashCtrl ctrl) { return (ctrl & 0x80) == 0; }
+
+    // The number of entries a map with |capacity| slots may hold.
+    static size_t MaxLoad(size_t capacity) { return capacity - capacity / 8; }
+
+    // The smallest whole number of groups, rounded up to a power of two, which
+    // holds |count| entries.
+    static size_t CapacityFor(size_t count) {
+        size_t capacity = kGroupWidth;
+        while (MaxLoad(capacity) < count)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    // The 64 bit finalizer from MurmurHash3.  The low seven bits of the result
+    // go into the control byte and the rest pick the first group to probe.
+    static uint64_t Hash(const Key& key) {
+        uint64_t h = static_cast<uint64_t>(HashTraits::GetHash(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    static internal::FlatHashCtrl H2(uint64_t hash) {
+        return static_cast<internal::FlatHashCtrl>(hash & 0x7f);
+    }
+
+    // Groups are probed in triangular order, which visits every group once
+    // since their number is a power of two.  A lookup ends at the first group
+    // with an empty slot, since the key would have been put there had it not
+    // gone earlier.
+    size_t FindIndex(const Key& key) const {
+        if (size_ == 0)
+            return kNotFound;
+
+        uint64_t hash = Hash(key);
+        size_t group = static_cast<size_t>(hash >> 7) & group_mask_;
+        for (size_t step = 1;; ++step) {
+            internal::FlatHashGroup g(&ctrl_[group * kGroupWidth]);
+            auto match = g.Match(H2(hash));
+            while (match) {
+                size_t ndx = group * kGroupWidth + internal::FlatHashGroup::NextMatch(&match);
+                if (HashTraits::EqualTo(entries_[ndx].key, key))
+                    return ndx;
+            }
+            if (g.MatchEmpty() || step > group_mask_)
+                return kNotFound;
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    // The first empty or deleted slot on |hash|'s probe sequence.  There is
+    // always one, since the map never fills up.
+    size_t FindSlot(uint64_t hash) const {
+        size_t group = static_cast<size_t>(hash >> 7) & group_mask_;
+        for (size_t step = 1;; ++step) {
+            auto mask = internal::FlatHashGroup(&ctrl_[group * kGroupWidth]).MatchEmptyOrDeleted();
+            if (mask)
+                return group * kGroupWidth + internal::FlatHashGroup::NextMatch(&mask);
+            ZX_DEBUG_ASSERT(step <= group_mask_);
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    template <typename U>
+    bool InsertInternal(const Key& key, U&& value, bool assign, AllocChecker* ac) {
+        size_t ndx = FindIndex(key);
+        if (ndx != kNotFound) {
+            ac->arm(0u, true);
+            if (assign)
+                entries_[ndx].value = fbl::forward<U>(value);
+            return false;
+        }
+
+        // Out of room.  If erases have left the map mostly deleted slots,
+        // clean them out rather than growing.
+        if (growth_left_ == 0) {
+            size_t capacity = (size_ < MaxLoad(capacity_) / 2) ? capacity_
+                                                              : CapacityFor(size_ + 1);
+            if (!Resize(capacity, ac))
+                return false;
+        } else {
+            ac->arm(0u, true);
+        }
+
+        uint64_t hash = Hash(key);
+        ndx = FindSlot(hash);
+        if (ctrl_[ndx] == internal::kFlatHashEmpty)
+            --growth_left_;
+        ctrl_[ndx] = H2(hash);
+        new (&entries_[ndx]) Entry{key, Value(fbl::forward<U>(value))};
+        ++size_;
+        return true;
+    }
+
+    // A slot whose group still has an empty slot can go back to being empty,
+    // since no lookup goes past that group.  Otherwise it must stay marked as
+    // deleted, so that lookups carry on probing past it.
+    void EraseIndex(size_t ndx) {
+        entries_[ndx].~Entry();
+        --size_;
+
+        size_t group_start = ndx & ~(kGroupWidth - 1);
+        if (internal::FlatHashGroup(&ctrl_[group_start]).MatchEmpty()) {
+            ctrl_[ndx] = internal::kFlatHashEmpty;
+            ++growth_left_;
+        } else {
+            ctrl_[ndx] = internal::kFlatHashDeleted;
+        }
+    }
+
+    // Move every entry into newly allocated storage with |capacity| slots.
+    // The entries and the control bytes share one allocation.
+    bool Resize(size_t capacity, AllocChecker* ac) {
+        ZX_DEBUG_ASSERT(capacity >= kGroupWidth && (capacity & (capacity - 1)) == 0);
+        ZX_DEBUG_ASSERT(MaxLoad(capacity) > size_);
+
+        void* storage = AllocatorTraits::Allocate(capacity * (sizeof(Entry) + 1));
+        ac->arm(capacity * (sizeof(Entry) + 1), storage != nullptr);
+        if (storage == nullptr)
+            return false;
+
+        Entry* old_entries = entries_;
+        internal::FlatHashCtrl* old_ctrl = ctrl_;
+        size_t old_capacity = capacity_;
+
+        entries_ = reinterpret_cast<Entry*>(storage);
+        ctrl_ = reinterpret_cast<internal::FlatHashCtrl*>(&entries_[capacity]);
+        memset(ctrl_, internal::kFlatHashEmpty, capacity);
+        capacity_ = capacity;
+        group_mask_ = capacity / kGroupWidth - 1;
+
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (!IsFull(old_ctrl[i]))
+                continue;
+            Entry& entry = old_entries[i];
+            uint64_t hash = Hash(entry.key);
+            size_t ndx = FindSlot(hash);
+            ctrl_[ndx] = H2(hash);
+            new (&entries_[ndx]) Entry{fbl::move(entry.key), fbl::move(entry.value)};
+            entry.~Entry();
+        }
+        growth_left_ = MaxLoad(capacity) - size_;
+
+        AllocatorTraits::Deallocate(old_entries);
+        return true;
+    }
+
+    Entry* entries_ = nullptr;
+    internal::FlatHashCtrl* ctrl_ = nullptr;
+    size_t group_mask_ = 0;
+    size_t capacity_ = 0;
+    size_t size_ = 0;
+
+    // The number of empty slots which may still be filled before the map has
+    // to grow.
+    size_t growth_left_ = 0;
+};
+
+// Explicit declaration of constexpr storage.
+template <typename Key, typename Value, typename HashTraits, typename AllocatorTraits>
+constexpr size_t FlatHashMap<Key, Value, HashTraits, AllocatorTraits>::kGroupWidth;
+
+template <typename Key, typename Value, typename HashTraits, typename AllocatorTraits>
+constexpr size_t FlatHashMap<Key, Value, HashTraits, AllocatorTraits>::kNotFound;
+
+} // namespace fbl
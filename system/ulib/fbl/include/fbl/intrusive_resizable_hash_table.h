@@ -0,0 +1,748 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zircon/assert.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/intrusive_container_utils.h>
+#include <fbl/intrusive_pointer_traits.h>
+#include <fbl/intrusive_single_list.h>
+#include <fbl/macros.h>
+
+namespace fbl {
+
+// Fwd decl of sanity checker class used by tests.
+namespace tests {
+namespace intrusive_containers {
+class ResizableHashTableChecker;
+}  // namespace tests
+}  // namespace intrusive_containers
+
+// DefaultResizableHashTraits defines a default implementation of the traits
+// used to define the hash function for a resizable hash table.
+//
+// The rules are the same as for DefaultHashTraits (see
+// fbl/intrusive_hash_table.h), except that GetHash returns the full hash of
+// the key rather than a bucket number.  The table picks buckets itself as it
+// grows, after mixing the hash, so the hash does not need good low bits; it
+// only needs to be the same for equal keys and to spread distinct keys out.
+template <typename KeyType,
+          typename ObjType,
+          typename HashType>
+struct DefaultResizableHashTraits {
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+    static HashType GetHash(const KeyType& key) {
+        return static_cast<HashType>(ObjType::GetHash(key));
+    }
+};
+
+// ResizableHashTable
+//
+// An intrusive hash table with the same interface as HashTable, whose number
+// of buckets follows the number of elements instead of being fixed at compile
+// time.  Use it for tables which may grow large, where a fixed number of
+// buckets would degrade into long chains.
+//
+// The table uses linear hashing.  It grows by splitting one bucket in two
+// when an insert pushes the average chain length past
+// kMaxAverageChainLength, and shrinks by merging the last bucket back into
+// its buddy when erases bring it below one element for every two buckets.
+// Each of these steps only touches the elements of a single bucket, so no
+// operation ever rehashes the whole table.
+//
+// Buckets live in segments of kSegmentBuckets each.  The first segment is
+// part of the table itself, so a table never has fewer buckets than that and
+// an empty table allocates nothing.  Further segments are allocated as the
+// table grows and freed as it shrinks.  The table never fails an operation
+// for lack of memory: if a segment cannot be allocated, it keeps its current
+// buckets and tries again on a later insert.
+//
+// Inserting, and erasing by key, by object or with erase_if, may move
+// elements between buckets, which invalidates all iterators.  Erasing through
+// an iterator never does, so a loop may erase elements as it iterates over
+// the table.
+template <typename  _KeyType,
+          typename  _PtrType,
+          typename  _BucketType     = SinglyLinkedList<_PtrType>,
+          typename  _HashType       = size_t,
+          size_t    _SegmentBuckets = 32,
+          typename  _KeyTraits      = DefaultKeyedObjectTraits<
+                                        _KeyType,
+                                        typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
+          typename  _HashTraits     = DefaultResizableHashTraits<
+                                        _KeyType,
+                                        typename internal::ContainerPtrTraits<_PtrType>::ValueType,
+                                        _HashType>>
+class ResizableHashTable {
+private:
+    // Private fwd decls of the iterator implementation.
+    template <typename IterTraits> class iterator_impl;
+    struct iterator_traits;
+    struct const_iterator_traits;
+
+public:
+    // Pointer types/traits
+    using PtrType      = _PtrType;
+    using PtrTraits    = internal::ContainerPtrTraits<PtrType>;
+    using ValueType    = typename PtrTraits::ValueType;
+
+    // Key types/traits
+    using KeyType      = _KeyType;
+    using KeyTraits    = _KeyTraits;
+
+    // Hash types/traits
+    using HashType     = _HashType;
+    using HashTraits   = _HashTraits;
+
+    // Bucket types/traits
+    using BucketType   = _BucketType;
+    using NodeTraits   = typename BucketType::NodeTraits;
+
+    // Declarations of the standard iterator types.
+    using iterator       = iterator_impl<iterator_traits>;
+    using const_iterator = iterator_impl<const_iterator_traits>;
+
+    // An alias for the type of this specific ResizableHashTable<...> and its
+    // test sanity checker.
+    using ContainerType = ResizableHashTable<_KeyType, _PtrType, _BucketType, _HashType,
+                                             _SegmentBuckets, _KeyTraits, _HashTraits>;
+    using CheckerType   = ::fbl::tests::intrusive_containers::ResizableHashTableChecker;
+
+    // The number of buckets in each segment, which is also the smallest
+    // number of buckets the table has.
+    static constexpr size_t kSegmentBuckets = _SegmentBuckets;
+
+    // The average number of elements per bucket beyond which the table grows.
+    static constexpr size_t kMaxAverageChainLength = 2;
+
+    // Hash tables only support constant order erase if their underlying bucket
+    // type does.
+    static constexpr bool SupportsConstantOrderErase = BucketType::SupportsConstantOrderErase;
+    static constexpr bool SupportsConstantOrderSize = true;
+    static constexpr bool IsAssociative = true;
+    static constexpr bool IsSequenced = false;
+
+    static_assert((kSegmentBuckets > 0) && ((kSegmentBuckets & (kSegmentBuckets - 1)) == 0),
+                  "The number of buckets per segment must be a power of two");
+    static_assert(is_unsigned_integer<HashType>::value, "HashTypes must be unsigned integers");
+
+    constexpr ResizableHashTable() {}
+    ~ResizableHashTable() {
+        ZX_DEBUG_ASSERT(PtrTraits::IsManaged || is_empty());
+        FreeSegments();
+    }
+
+    // Standard begin/end, cbegin/cend iterator accessors.
+    iterator begin()              { return       iterator(this,       iterator::BEGIN); }
+    const_iterator begin()  const { return const_iterator(this, const_iterator::BEGIN); }
+    const_iterator cbegin() const { return const_iterator(this, const_iterator::BEGIN); }
+
+    iterator end()              { return       iterator(this,       iterator::END); }
+    const_iterator end()  const { return const_iterator(this, const_iterator::END); }
+    const_iterator cend() const { return const_iterator(this, const_iterator::END); }
+
+    // make_iterator : construct an iterator out of a reference to an object.
+    iterator make_iterator(ValueType& obj) {
+        size_t ndx = GetBucketIndex(KeyTraits::GetKey(obj));
+        return iterator(this, ndx, GetBucket(ndx).make_iterator(obj));
+    }
+
+    void insert(const PtrType& ptr) { insert(PtrType(ptr)); }
+    void insert(PtrType&& ptr) {
+        ZX_DEBUG_ASSERT(ptr != nullptr);
+        MaybeGrow();
+
+        KeyType key = KeyTraits::GetKey(*ptr);
+        BucketType& bucket = GetBucket(GetBucketIndex(key));
+
+        // Duplicate keys are disallowed.  Debug assert if someone tries to to
+        // insert an element with a duplicate key.  If the user thought that
+        // there might be a duplicate key in the table already, he/she should
+        // have used insert_or_find() instead.
+        ZX_DEBUG_ASSERT(FindInBucket(bucket, key).IsValid() == false);
+
+        bucket.push_front(fbl::move(ptr));
+        ++count_;
+    }
+
+    // insert_or_find
+    //
+    // Insert the element pointed to by ptr if it is not already in the
+    // table, or find the element that the ptr collided with instead.
+    //
+    // 'iter' is an optional out parameter pointer to an iterator which
+    // will reference either the newly inserted item, or the item whose key
+    // collided with ptr.
+    //
+    // insert_or_find returns true if there was no collision and the item was
+    // successfully inserted, otherwise it returns false.
+    //
+    bool insert_or_find(const PtrType& ptr, iterator* iter = nullptr) {
+        return insert_or_find(PtrType(ptr), iter);
+    }
+
+    bool insert_or_find(PtrType&& ptr, iterator* iter = nullptr) {
+        ZX_DEBUG_ASSERT(ptr != nullptr);
+        MaybeGrow();
+
+        KeyType key         = KeyTraits::GetKey(*ptr);
+        size_t  ndx         = GetBucketIndex(key);
+        auto&   bucket      = GetBucket(ndx);
+        auto    bucket_iter = FindInBucket(bucket, key);
+
+        if (bucket_iter.IsValid()) {
+            if (iter) *iter = iterator(this, ndx, bucket_iter);
+            return false;
+        }
+
+        bucket.push_front(fbl::move(ptr));
+        ++count_;
+        if (iter) *iter = iterator(this, ndx, bucket.begin());
+        return true;
+    }
+
+    // insert_or_replace
+    //
+    // Find the element in the table with the same key as *ptr and replace
+    // it with ptr, then return the pointer to the element which was replaced.
+    // If no element in the table shares a key with *ptr, simply add ptr to
+    // the table and return nullptr.
+    //
+    PtrType insert_or_replace(const PtrType& ptr) {
+        return insert_or_replace(PtrType(ptr));
+    }
+
+    PtrType insert_or_replace(PtrType&& ptr) {
+        ZX_DEBUG_ASSERT(ptr != nullptr);
+        MaybeGrow();
+
+        KeyType key    = KeyTraits::GetKey(*ptr);
+        auto&   bucket = GetBucket(GetBucketIndex(key));
+        auto    orig   = PtrTraits::GetRaw(ptr);
+
+        PtrType replaced = bucket.replace_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            },
+            fbl::move(ptr));
+
+        if (orig == PtrTraits::GetRaw(replaced)) {
+            bucket.push_front(PtrTraits::Take(replaced));
+            count_++;
+        }
+
+        return fbl::move(replaced);
+    }
+
+    iterator find(const KeyType& key) {
+        size_t ndx         = GetBucketIndex(key);
+        auto&  bucket      = GetBucket(ndx);
+        auto   bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? iterator(this, ndx, bucket_iter)
+                                     : iterator(this, iterator::END);
+    }
+
+    const_iterator find(const KeyType& key) const {
+        size_t      ndx         = GetBucketIndex(key);
+        const auto& bucket      = GetBucket(ndx);
+        auto        bucket_iter = FindInBucket(bucket, key);
+
+        return bucket_iter.IsValid() ? const_iterator(this, ndx, bucket_iter)
+                                     : const_iterator(this, const_iterator::END);
+    }
+
+    PtrType erase(const KeyType& key) {
+        BucketType& bucket = GetBucket(GetBucketIndex(key));
+
+        PtrType ret = internal::KeyEraseUtils<BucketType, KeyTraits>::erase(bucket, key);
+        if (ret != nullptr) {
+            --count_;
+            MaybeShrink();
+        }
+
+        return ret;
+    }
+
+    // Erasing through an iterator leaves the buckets alone, so that other
+    // iterators stay valid.
+    PtrType erase(const iterator& iter) {
+        if (!iter.IsValid())
+            return PtrType(nullptr);
+
+        return direct_erase(GetBucket(iter.bucket_ndx_), *iter);
+    }
+
+    PtrType erase(ValueType& obj) {
+        PtrType ret = direct_erase(GetBucket(GetBucketIndex(KeyTraits::GetKey(obj))), obj);
+        if (ret != nullptr)
+            MaybeShrink();
+
+        return ret;
+    }
+
+    // clear
+    //
+    // Clear out the all of the table's buckets and shrink it back to its
+    // first segment.  For managed pointer types, this will release all
+    // references held by the table to the objects which were in it.
+    void clear() {
+        for (size_t i = 0; i < bucket_count_; ++i)
+            GetBucket(i).clear();
+        FreeSegments();
+        Reset();
+    }
+
+    // clear_unsafe
+    //
+    // Perform a clear_unsafe on all buckets, shrink the table back to its
+    // first segment and reset the internal count to zero.  See comments in
+    // fbl/intrusive_single_list.h
+    // Think carefully before calling this!
+    void clear_unsafe() {
+        static_assert(PtrTraits::IsManaged == false,
+                     "clear_unsafe is not allowed for containers of managed pointers");
+
+        for (size_t i = 0; i < bucket_count_; ++i)
+            GetBucket(i).clear_unsafe();
+        FreeSegments();
+        Reset();
+    }
+
+    size_t size()         const { return count_; }
+    bool   is_empty()     const { return count_ == 0; }
+    size_t bucket_count() const { return bucket_count_; }
+
+    // erase_if
+    //
+    // Find the first member of the hash table which satisfies the predicate
+    // given by 'fn' and erase it from the list, returning a referenced pointer
+    // to the removed element.  Return nullptr if no member satisfies the
+    // predicate.
+    template <typename UnaryFn>
+    PtrType erase_if(UnaryFn fn) {
+        if (is_empty())
+            return PtrType(nullptr);
+
+        for (size_t i = 0; i < bucket_count_; ++i) {
+            auto& bucket = GetBucket(i);
+            if (!bucket.is_empty()) {
+                PtrType ret = bucket.erase_if(fn);
+                if (ret != nullptr) {
+                    --count_;
+                    MaybeShrink();
+                    return ret;
+                }
+            }
+        }
+
+        return PtrType(nullptr);
+    }
+
+    // find_if
+    //
+    // Find the first member of the hash table which satisfies the predicate
+    // given by 'fn' and return an iterator to it.  Return end() if no member
+    // satisfies the predicate.
+    template <typename UnaryFn>
+    const_iterator find_if(UnaryFn fn) const {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+    template <typename UnaryFn>
+    iterator find_if(UnaryFn fn) {
+        for (auto iter = begin(); iter.IsValid(); ++iter)
+            if (fn(*iter))
+                return iter;
+
+        return end();
+    }
+
+private:
+    // The traits of a non-const iterator
+    struct iterator_traits {
+        using RefType    = typename PtrTraits::RefType;
+        using RawPtrType = typename PtrTraits::RawPtrType;
+        using IterType   = typename BucketType::iterator;
+
+        static IterType BucketBegin(BucketType& bucket) { return bucket.begin(); }
+        static IterType BucketEnd  (BucketType& bucket) { return bucket.end(); }
+    };
+
+    // The traits of a const iterator
+    struct const_iterator_traits {
+        using RefType    = typename PtrTraits::ConstRefType;
+        using RawPtrType = typename PtrTraits::ConstRawPtrType;
+        using IterType   = typename BucketType::const_iterator;
+
+        static IterType BucketBegin(const BucketType& bucket) { return bucket.cbegin(); }
+        static IterType BucketEnd  (const BucketType& bucket) { return bucket.cend(); }
+    };
+
+    // The shared implementation of the iterator
+    template <class IterTraits>
+    class iterator_impl {
+    public:
+        iterator_impl() { }
+        iterator_impl(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+        }
+
+        iterator_impl& operator=(const iterator_impl& other) {
+            hash_table_ = other.hash_table_;
+            bucket_ndx_ = other.bucket_ndx_;
+            iter_       = other.iter_;
+            return *this;
+        }
+
+        bool IsValid() const { return iter_.IsValid(); }
+        bool operator==(const iterator_impl& other) const { return iter_ == other.iter_; }
+        bool operator!=(const iterator_impl& other) const { return iter_ != other.iter_; }
+
+        // Prefix
+        iterator_impl& operator++() {
+            if (!IsValid()) return *this;
+            ZX_DEBUG_ASSERT(hash_table_);
+
+            // Bump the bucket iterator and go looking for a new bucket if the
+            // iterator has become invalid.
+            ++iter_;
+            advance_if_invalid_iter();
+
+            return *this;
+        }
+
+        iterator_impl& operator--() {
+            // If we have never been bound to a table instance, the we had
+            // better be invalid.
+            if (!hash_table_) {
+                ZX_DEBUG_ASSERT(!IsValid());
+                return *this;
+            }
+
+            // Back up the bucket iterator.  If it is still valid, then we are done.
+            --iter_;
+            if (iter_.IsValid())
+                return *this;
+
+            // If the iterator is invalid after backing up, check previous
+            // buckets to see if they contain any nodes.
+            while (bucket_ndx_) {
+                --bucket_ndx_;
+                auto& bucket = GetBucket(bucket_ndx_);
+                if (!bucket.is_empty()) {
+                    iter_ = --IterTraits::BucketEnd(bucket);
+                    ZX_DEBUG_ASSERT(iter_.IsValid());
+                    return *this;
+                }
+            }
+
+            // Looks like we have backed up past the beginning.  Update the
+            // bookkeeping to point at the end of the last bucket.
+            bucket_ndx_ = last_bucket_ndx();
+            iter_ = IterTraits::BucketEnd(GetBucket(bucket_ndx_));
+
+            return *this;
+        }
+
+        // Postfix
+        iterator_impl operator++(int) {
+            iterator_impl ret(*this);
+            ++(*this);
+            return ret;
+        }
+
+        iterator_impl operator--(int) {
+            iterator_impl ret(*this);
+            --(*this);
+            return ret;
+        }
+
+        typename PtrTraits::PtrType CopyPointer()          { return iter_.CopyPointer(); }
+        typename IterTraits::RefType operator*()     const { return iter_.operator*(); }
+        typename IterTraits::RawPtrType operator->() const { return iter_.operator->(); }
+
+    private:
+        friend ContainerType;
+        using IterType = typename IterTraits::IterType;
+
+        enum BeginTag { BEGIN };
+        enum EndTag { END };
+
+        iterator_impl(const ContainerType* hash_table, BeginTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(0),
+              iter_(IterTraits::BucketBegin(GetBucket(0))) {
+            advance_if_invalid_iter();
+        }
+
+        iterator_impl(const ContainerType* hash_table, EndTag)
+            : hash_table_(hash_table),
+              bucket_ndx_(last_bucket_ndx()),
+              iter_(IterTraits::BucketEnd(GetBucket(bucket_ndx_))) { }
+
+        iterator_impl(const ContainerType* hash_table, size_t bucket_ndx, const IterType& iter)
+            : hash_table_(hash_table),
+              bucket_ndx_(bucket_ndx),
+              iter_(iter) { }
+
+        BucketType& GetBucket(size_t ndx) {
+            return const_cast<ContainerType*>(hash_table_)->GetBucket(ndx);
+        }
+
+        size_t last_bucket_ndx() const { return hash_table_->bucket_count_ - 1; }
+
+        void advance_if_invalid_iter() {
+            // If the iterator has run off the end of it's current bucket, then
+            // check to see if there are nodes in any of the remaining buckets.
+            if (!iter_.IsValid()) {
+                while (bucket_ndx_ < last_bucket_ndx()) {
+                    ++bucket_ndx_;
+                    auto& bucket = GetBucket(bucket_ndx_);
+
+                    if (!bucket.is_empty()) {
+                        iter_ = IterTraits::BucketBegin(bucket);
+                        ZX_DEBUG_ASSERT(iter_.IsValid());
+                        break;
+                    } else if (bucket_ndx_ == last_bucket_ndx()) {
+                        iter_ = IterTraits::BucketEnd(bucket);
+                    }
+                }
+            }
+        }
+
+        const ContainerType* hash_table_ = nullptr;
+        size_t bucket_ndx_ = 0;
+        IterType iter_;
+    };
+
+    PtrType direct_erase(BucketType& bucket, ValueType& obj) {
+        PtrType ret = internal::DirectEraseUtils<BucketType>::erase(bucket, obj);
+
+        if (ret != nullptr)
+            --count_;
+
+        return ret;
+    }
+
+    static typename BucketType::iterator FindInBucket(BucketType& bucket,
+                                                      const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    static typename BucketType::const_iterator FindInBucket(const BucketType& bucket,
+                                                            const KeyType& key) {
+        return bucket.find_if(
+            [key](const ValueType& other) -> bool {
+                return KeyTraits::EqualTo(key, KeyTraits::GetKey(other));
+            });
+    }
+
+    // The test framework's 'checker' class is our friend.
+    friend CheckerType;
+
+    // Iterators need to access our buckets in order to iterate.
+    friend iterator;
+    friend const_iterator;
+
+    // Hash tables may not currently be copied, assigned or moved.
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ResizableHashTable);
+
+    // The number of segment pointers allocated when the table first grows
+    // past its first segment.
+    static constexpr size_t kInitialSegmentCapacity = 8;
+
+    BucketType& GetBucket(size_t ndx) {
+        ZX_DEBUG_ASSERT(ndx < bucket_count_);
+        return (ndx < kSegmentBuckets)
+            ? first_segment_[ndx]
+            : segments_[ndx / kSegmentBuckets][ndx % kSegmentBuckets];
+    }
+
+    const BucketType& GetBucket(size_t ndx) const {
+        return const_cast<ContainerType*>(this)->GetBucket(ndx);
+    }
+
+    // Spread the bits of the user's hash over all of the bits we might use to
+    // pick a bucket.  This is the 64 bit finalizer from MurmurHash3.
+    static uint64_t Mix(HashType hash) {
+        uint64_t h = static_cast<uint64_t>(hash);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // Buckets before split_ have already been split for this level, so pick
+    // among twice as many for them.
+    size_t BucketIndexForHash(uint64_t mixed) const {
+        size_t ndx = static_cast<size_t>(mixed & (level_buckets_ - 1));
+        if (ndx < split_)
+            ndx = static_cast<size_t>(mixed & ((level_buckets_ << 1) - 1));
+        return ndx;
+    }
+
+    size_t GetBucketIndex(const KeyType& key) const {
+        return BucketIndexForHash(Mix(HashTraits::GetHash(key)));
+    }
+
+    void MaybeGrow() {
+        if (count_ >= bucket_count_ * kMaxAverageChainLength)
+            Split();
+    }
+
+    // Merge up to two buckets per erase, so that a table which is emptied one
+    // element at a time shrinks all of the way back down.
+    void MaybeShrink() {
+        for (int i = 0; i < 2; ++i) {
+            if ((bucket_count_ <= kSegmentBuckets) || ((count_ << 1) >= bucket_count_))
+                return;
+            Merge();
+        }
+    }
+
+    // Split bucket split_ in two, moving the elements which belong in the new
+    // bucket at the end of the table over to it.
+    void Split() {
+        size_t new_ndx = bucket_count_;
+        ZX_DEBUG_ASSERT(new_ndx == split_ + level_buckets_);
+
+        if (((new_ndx % kSegmentBuckets) == 0) && !AllocSegment(new_ndx / kSegmentBuckets))
+            return;
+        ++bucket_count_;
+
+        BucketType& src = GetBucket(split_);
+        BucketType& dst = GetBucket(new_ndx);
+        BucketType keep;
+        uint64_t mask = (level_buckets_ << 1) - 1;
+        while (!src.is_empty()) {
+            PtrType ptr = src.pop_front();
+            if ((Mix(HashTraits::GetHash(KeyTraits::GetKey(*ptr))) & mask) == split_) {
+                keep.push_front(fbl::move(ptr));
+            } else {
+                dst.push_front(fbl::move(ptr));
+            }
+        }
+        src.swap(keep);
+
+        if (++split_ == level_buckets_) {
+            level_buckets_ <<= 1;
+            split_ = 0;
+        }
+    }
+
+    // Undo the last split, moving the last bucket's elements back into its
+    // buddy and freeing the last segment if it has become empty.
+    void Merge() {
+        ZX_DEBUG_ASSERT(bucket_count_ > kSegmentBuckets);
+        if (split_ == 0) {
+            level_buckets_ >>= 1;
+            split_ = level_buckets_;
+        }
+        --split_;
+
+        size_t old_ndx = bucket_count_ - 1;
+        ZX_DEBUG_ASSERT(old_ndx == split_ + level_buckets_);
+
+        BucketType& src = GetBucket(old_ndx);
+        BucketType& dst = GetBucket(split_);
+        while (!src.is_empty())
+            dst.push_front(src.pop_front());
+        --bucket_count_;
+
+        if ((old_ndx % kSegmentBuckets) == 0)
+            FreeSegment(old_ndx / kSegmentBuckets);
+    }
+
+    bool AllocSegment(size_t segment) {
+        ZX_DEBUG_ASSERT(segment > 0);
+        AllocChecker ac;
+
+        if (segment >= segment_capacity_) {
+            size_t capacity = segment_capacity_ ? (segment_capacity_ << 1)
+                                                : kInitialSegmentCapacity;
+            BucketType** segments = new (&ac) BucketType*[capacity];
+            if (!ac.check())
+                return false;
+
+            for (size_t i = 0; i < capacity; ++i)
+                segments[i] = (i < segment_capacity_) ? segments_[i] : nullptr;
+            delete[] segments_;
+            segments_ = segments;
+            segment_capacity_ = capacity;
+        }
+
+        ZX_DEBUG_ASSERT(segments_[segment] == nullptr);
+        segments_[segment] = new (&ac) BucketType[kSegmentBuckets];
+        return ac.check();
+    }
+
+    void FreeSegment(size_t segment) {
+        ZX_DEBUG_ASSERT((segment > 0) && (segment < segment_capacity_));
+        delete[] segments_[segment];
+        segments_[segment] = nullptr;
+    }
+
+    void FreeSegments() {
+        for (size_t i = 1; i < segment_capacity_; ++i)
+            delete[] segments_[i];
+        delete[] segments_;
+        segments_ = nullptr;
+        segment_capacity_ = 0;
+    }
+
+    void Reset() {
+        count_ = 0;
+        bucket_count_ = kSegmentBuckets;
+        level_buckets_ = kSegmentBuckets;
+        split_ = 0;
+    }
+
+    size_t count_ = 0UL;
+
+    // The table currently has bucket_count_ == level_buckets_ + split_
+    // buckets, and level_buckets_ is always a power of two.
+    size_t bucket_count_ = kSegmentBuckets;
+    size_t level_buckets_ = kSegmentBuckets;
+    size_t split_ = 0;
+
+    // Segment i holds buckets [i * kSegmentBuckets, (i + 1) * kSegmentBuckets).
+    // The first segment is first_segment_; segments_[0] is unused.
+    BucketType first_segment_[kSegmentBuckets];
+    BucketType** segments_ = nullptr;
+    size_t segment_capacity_ = 0;
+};
+
+// Explicit declaration of constexpr storage.
+#define RESIZABLE_HASH_TABLE_PROP(_type, _name) \
+template <typename KeyType, typename PtrType, typename BucketType, typename HashType, \
+          size_t SegmentBuckets, typename KeyTraits, typename HashTraits> \
+constexpr _type ResizableHashTable<KeyType, PtrType, BucketType, HashType, \
+                                   SegmentBuckets, KeyTraits, HashTraits>::_name
+
+RESIZABLE_HASH_TABLE_PROP(size_t, kSegmentBuckets);
+RESIZABLE_HASH_TABLE_PROP(size_t, kMaxAverageChainLength);
+RESIZABLE_HASH_TABLE_PROP(size_t, kInitialSegmentCapacity);
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderErase);
+RESIZABLE_HASH_TABLE_PROP(bool, SupportsConstantOrderSize);
+RESIZABLE_HASH_TABLE_PROP(bool, IsAssociative);
+RESIZABLE_HASH_TABLE_PROP(bool, IsSequenced);
+
+#undef RESIZABLE_HASH_TABLE_PROP
+
+}  // namespace fbl
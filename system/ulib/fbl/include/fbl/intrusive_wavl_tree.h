@@ -694,6 +694,7 @@ private:
 
             ++count_;
             Observer::RecordInsert();
+            RecordSubtreeChangedToRoot(PtrTraits::GetRaw(root_));
             return;
         }
 
@@ -770,8 +771,13 @@ private:
         ++count_;
         Observer::RecordInsert();
 
+        // Bring the observer's subtree state up to date before rebalancing;
+        // the rotations below rely on it being correct everywhere else.
+        RawPtrType inserted = PtrTraits::GetRaw(*owner);
+        RecordSubtreeChangedToRoot(inserted);
+
         // Finally, perform post-insert balance operations.
-        BalancePostInsert(PtrTraits::GetRaw(*owner));
+        BalancePostInsert(inserted);
     }
 
     PtrType internal_erase(RawPtrType ptr) {
@@ -913,6 +919,10 @@ private:
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
         if (!PtrTraits::IsSentinel(parent)) {
+            // As with insert, the subtree state of every ancestor of the
+            // removed node needs updating before any rotations happen.
+            RecordSubtreeChangedToRoot(parent);
+
             if (was_one_child) {
                 // If the node we removed was a 1-child, then we may have just
                 // turned its parent into a 2,2 leaf node.  If so, we have a
@@ -990,6 +1000,7 @@ private:
         // caller.
         PtrTraits::Swap(GetLinkPtrToNode(old_node), new_node);
         pod_swap(old_ns.parent_, new_ns.parent_);
+        RecordSubtreeChangedToRoot(new_raw);
         return fbl::move(new_node);
     }
 
@@ -1348,6 +1359,26 @@ private:
         Z_ns.parent_ = X;
         if (Y)
             NodeTraits::node_state(*Y).parent_ = Z;
+
+        // Z is now X's child, so it must be updated first.  The set of nodes
+        // under X is the set which used to be under Z, so nothing above X
+        // needs to change.
+        Observer::template RecordSubtreeChanged<ContainerType>(Z);
+        Observer::template RecordSubtreeChanged<ContainerType>(X);
+    }
+
+    // RecordSubtreeChangedToRoot
+    //
+    // Let the observer refresh its per-subtree state for |node| and each of
+    // its ancestors, in that order.
+    void RecordSubtreeChangedToRoot(RawPtrType node) {
+        if (!Observer::kTracksSubtrees)
+            return;
+
+        while (PtrTraits::IsValid(node)) {
+            Observer::template RecordSubtreeChanged<ContainerType>(node);
+            node = NodeTraits::node_state(*node).parent_;
+        }
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -26,7 +26,17 @@ class WAVLTreeChecker;
 // phase of rebalancing are considered to be part of the cost of rotation and
 // are not tallied in the overall promote/demote accounting.
 //
+// Observers may also keep state in each node which summarizes the node's
+// subtree (for example, the largest gap between neighboring keys), which
+// lets users of the tree answer range questions in O(log) time.  Such
+// observers set kTracksSubtrees and implement RecordSubtreeChanged, which
+// the tree calls, bottom up, for every node whose children or descendants
+// have changed.  By the time it is called for a node, the state of the
+// node's children is already up to date.
+//
 struct DefaultWAVLTreeObserver {
+    static constexpr bool kTracksSubtrees = false;
+
     static void RecordInsert()               { }
     static void RecordInsertPromote()        { }
     static void RecordInsertRotation()       { }
@@ -37,6 +47,9 @@ struct DefaultWAVLTreeObserver {
     static void RecordEraseRotation()        { }
     static void RecordEraseDoubleRotation()  { }
 
+    template <typename TreeType>
+    static void RecordSubtreeChanged(typename TreeType::RawPtrType node) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         return true;
@@ -24,6 +24,9 @@ namespace fbl {
 class __TA_CAPABILITY("mutex") Mutex {
 public:
     constexpr Mutex() : mutex_(MUTEX_INITIAL_VALUE(mutex_)) { }
+    // Contention on this mutex is also counted against |cls|.
+    constexpr explicit Mutex(const mutex_class_t* cls)
+        : mutex_(MUTEX_INITIAL_VALUE_CLASS(mutex_, cls)) { }
     ~Mutex() { mutex_destroy(&mutex_); }
     void Acquire() __TA_ACQUIRE() { mutex_acquire(&mutex_); }
     void Release() __TA_RELEASE() { mutex_release(&mutex_); }
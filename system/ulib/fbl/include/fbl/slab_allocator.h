@@ -4,8 +4,11 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <zircon/compiler.h>
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
 #include <fbl/auto_lock.h>
 #include <fbl/deleter.h>
 #include <fbl/intrusive_single_list.h>
@@ -82,6 +85,17 @@
 // UnlockedInstancedSlabAllocatorTraits or UnlockedStaticSlabAllocatorTraits may
 // be used as a shorthand for this.
 //
+// Allocators which are shared between many threads may instead keep their free
+// list lock-free by setting the LockFreeFreeList parameter of the
+// SlabAllocatorTraits<> struct to true (see LockFreeInstancedSlabAllocatorTraits
+// and LockFreeStaticSlabAllocatorTraits).  Allocating from and returning to the
+// free list then never takes the lock.  The lock is only taken when the free
+// list is empty and a block must be carved out of a slab (or a new slab
+// allocated), so LockType should still be a real lock if the allocator is to
+// be shared.  The free list head packs a pointer together with a 16-bit tag to
+// guard against ABA, and so lock-free free lists are only available on 64-bit
+// targets, where the upper bits of a pointer are not needed.
+//
 // ** Example **
 //
 // using MyAllocatorTraits =
@@ -283,7 +297,8 @@ enum class SlabAllocatorFlavor {
 template <typename T,
           size_t   SLAB_SIZE,
           typename LockType,
-          SlabAllocatorFlavor AllocatorFlavor> struct SlabAllocatorTraits;
+          SlabAllocatorFlavor AllocatorFlavor,
+          bool     LockFreeFreeList> struct SlabAllocatorTraits;
 template <typename SATraits, typename = void> class SlabAllocator;
 template <typename SATraits, typename = void> class SlabAllocated;
 
@@ -355,6 +370,14 @@ class SlabAllocatorBase {
 protected:
     struct FreeListEntry : public SinglyLinkedListable<FreeListEntry*> { };
 
+    // Entries on the lock-free free list.  |next| is read by threads racing to
+    // pop this entry, some of which will lose and see the memory reused as an
+    // object; they discard what they read when their compare-exchange of the
+    // (tagged) list head fails.
+    struct LockFreeEntry {
+        atomic<uintptr_t> next;
+    };
+
     struct Slab {
         explicit Slab(size_t initial_bytes_used) : bytes_used_(initial_bytes_used) { }
 
@@ -407,6 +430,11 @@ public:
 #if ZX_DEBUG_ASSERT_IMPLEMENTED
         size_t allocated_count = 0;
         size_t free_list_size = this->free_list_.size_slow();
+        for (LockFreeEntry* entry = UnpackLockFreeHead(lock_free_head_.load());
+             entry != nullptr;
+             entry = reinterpret_cast<LockFreeEntry*>(entry->next.load())) {
+            ++free_list_size;
+        }
 #endif
         // null out the free list so that it does not assert that we left
         // unmanaged pointers on it as we destruct, and so that the free list
@@ -469,7 +497,59 @@ protected:
         free_list_.push_front(free_obj);
     }
 
+    // Pops an entry off of the lock-free free list, or returns nullptr if it
+    // is empty.  Never takes the lock.
+    void* AllocateLockFree() {
+        uint64_t head = lock_free_head_.load(memory_order_acquire);
+        while (true) {
+            LockFreeEntry* entry = UnpackLockFreeHead(head);
+            if (entry == nullptr)
+                return nullptr;
+
+            // Slab memory is never returned to the system while the allocator
+            // is alive, so reading |next| is safe even if another thread has
+            // popped |entry| out from under us; the tag in the head will have
+            // changed and the compare-exchange below will fail.
+            auto next = reinterpret_cast<LockFreeEntry*>(
+                    entry->next.load(memory_order_relaxed));
+            if (lock_free_head_.compare_exchange_weak(&head, PackLockFreeHead(next, head),
+                                                      memory_order_acquire,
+                                                      memory_order_acquire)) {
+                return entry;
+            }
+        }
+    }
+
+    void ReturnToFreeListLockFree(void* ptr) {
+        LockFreeEntry* entry = new (ptr) LockFreeEntry;
+        uint64_t head = lock_free_head_.load(memory_order_relaxed);
+        do {
+            entry->next.store(reinterpret_cast<uintptr_t>(UnpackLockFreeHead(head)),
+                              memory_order_relaxed);
+        } while (!lock_free_head_.compare_exchange_weak(&head, PackLockFreeHead(entry, head),
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+    }
+
 private:
+    // The lock-free free list head is a pointer in the low 48 bits and a tag,
+    // bumped on every update, in the high 16.
+    static constexpr uint64_t kLockFreeTagShift = 48;
+    static constexpr uint64_t kLockFreePtrMask  = (1ull << kLockFreeTagShift) - 1;
+
+    static uint64_t PackLockFreeHead(LockFreeEntry* entry, uint64_t old_head) {
+        uint64_t tag = (old_head >> kLockFreeTagShift) + 1;
+        return (tag << kLockFreeTagShift) |
+               (static_cast<uint64_t>(reinterpret_cast<uintptr_t>(entry)) & kLockFreePtrMask);
+    }
+
+    static LockFreeEntry* UnpackLockFreeHead(uint64_t head) {
+        // Sign extend from bit 47 so that kernel addresses survive the trip.
+        int64_t ptr = static_cast<int64_t>(head << (64 - kLockFreeTagShift)) >>
+                      (64 - kLockFreeTagShift);
+        return reinterpret_cast<LockFreeEntry*>(static_cast<intptr_t>(ptr));
+    }
+
     // Constant properties of the allocator passed to us by our templated
     // wrapper during construction.
     const size_t slab_size_;
@@ -482,6 +562,7 @@ private:
     SinglyLinkedList<FreeListEntry*> free_list_;
     SinglyLinkedList<Slab*>          slab_list_;
     size_t                           slab_count_ = 0;
+    atomic<uint64_t>                 lock_free_head_{0};
 };
 
 template <typename SATraits>
@@ -514,6 +595,9 @@ public:
 
     static_assert(AllocsPerSlab > 0, "SLAB_SIZE too small to hold even 1 allocation");
 
+    static_assert(!SATraits::LockFreeFreeList || (sizeof(uintptr_t) == sizeof(uint64_t)),
+                  "Lock-free slab allocator free lists are only supported on 64-bit targets");
+
     // Slab allocated objects must derive from SlabAllocated<SATraits>.
     static_assert(is_base_of<SlabAllocated<SATraits>, ObjType>::value,
                   "Objects which are slab allocated from an allocator of type "
@@ -564,11 +648,22 @@ protected:
     friend class ::fbl::SlabAllocated<SATraits>;
 
     void* Allocate() {
+        if (SATraits::LockFreeFreeList) {
+            void* mem = AllocateLockFree();
+            if (mem != nullptr)
+                return mem;
+        }
+
         AutoLock alloc_lock(&this->alloc_lock_);
         return AllocateLocked();
     }
 
     void ReturnToFreeList(void* ptr) {
+        if (SATraits::LockFreeFreeList) {
+            ReturnToFreeListLockFree(ptr);
+            return;
+        }
+
         FreeListEntry* free_obj = new (ptr) FreeListEntry;
         {
             AutoLock alloc_lock(&alloc_lock_);
@@ -618,11 +713,16 @@ protected:
 //     the object to the allocator it came from.  MANUAL_DELETE allocators are
 //     only permitted for unmanaged pointer types.
 //
+// ++ LockFreeFreeList
+//  When true, the free list is a lock-free stack and LockType is only taken
+//  when memory must come from a slab.  Defaults to false.
+//
 ////////////////////////////////////////////////////////////////////////////////
 template <typename T,
           size_t   _SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
           typename _LockType  = ::fbl::Mutex,
-          SlabAllocatorFlavor _AllocatorFlavor = SlabAllocatorFlavor::INSTANCED>
+          SlabAllocatorFlavor _AllocatorFlavor = SlabAllocatorFlavor::INSTANCED,
+          bool     _LockFreeFreeList = false>
 struct SlabAllocatorTraits {
     using PtrTraits     = internal::SlabAllocatorPtrTraits<T>;
     using PtrType       = typename PtrTraits::PtrType;
@@ -631,6 +731,7 @@ struct SlabAllocatorTraits {
 
     static constexpr size_t SLAB_SIZE = _SLAB_SIZE;
     static constexpr SlabAllocatorFlavor AllocatorFlavor = _AllocatorFlavor;
+    static constexpr bool LockFreeFreeList = _LockFreeFreeList;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -751,6 +852,14 @@ template <typename T,
 using UnlockedSlabAllocatorTraits =
     SlabAllocatorTraits<T, SLAB_SIZE, ::fbl::NullLock>;
 
+// Shorthand for declaring the properties of an instanced allocator with a
+// lock-free free list.
+template <typename T,
+          size_t   SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
+          typename LockType  = ::fbl::Mutex>
+using LockFreeInstancedSlabAllocatorTraits =
+    SlabAllocatorTraits<T, SLAB_SIZE, LockType, SlabAllocatorFlavor::INSTANCED, true>;
+
 // Shorthand for declaring the properties of a MANUAL_DELETE slab allocator.
 template <typename T,
           size_t   SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
@@ -834,6 +943,12 @@ template <typename T,
 using UnlockedStaticSlabAllocatorTraits =
     SlabAllocatorTraits<T, SLAB_SIZE, ::fbl::NullLock, SlabAllocatorFlavor::STATIC>;
 
+template <typename T,
+          size_t   SLAB_SIZE = DEFAULT_SLAB_ALLOCATOR_SLAB_SIZE,
+          typename LockType  = ::fbl::Mutex>
+using LockFreeStaticSlabAllocatorTraits =
+    SlabAllocatorTraits<T, SLAB_SIZE, LockType, SlabAllocatorFlavor::STATIC, true>;
+
 // Shorthand for declaring the global storage required for a static allocator
 #define DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(ALLOC_TRAITS, ...) \
 template<> ::fbl::SlabAllocator<ALLOC_TRAITS>::InternalAllocatorType \
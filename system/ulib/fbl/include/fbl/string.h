@@ -22,8 +22,10 @@ struct StringTestHelper;
 // is immutable.  This makes it easy to share string buffers so that copying
 // strings does not incur any allocation cost.
 //
-// Empty string objects do not incur any allocation.  Non-empty strings are
-// stored on the heap.  Note that fbl::String does not have a null state
+// Strings of up to |kInlineCapacity| characters, including the empty string,
+// are stored within the string object itself and do not incur any allocation;
+// copying them copies their characters.  Longer strings are stored in shared
+// buffers on the heap.  Note that fbl::String does not have a null state
 // distinct from the empty state.
 //
 // The content of a fbl::String object is always stored with a null terminator
@@ -31,79 +33,76 @@ struct StringTestHelper;
 // embedded null characters (this is not checked by the implementation).
 class String {
 public:
+    // The longest string which is stored inline, without allocating.
+    static constexpr size_t kInlineCapacity = 2u * sizeof(char*) - 1u;
+
     // Creates an empty string.
     // Does not allocate heap memory.
     String() { InitWithEmpty(); }
 
     // Creates a copy of another string.
     // Does not allocate heap memory.
-    String(const String& other)
-        : data_(other.data_) {
-        AcquireRef(data_);
-    }
+    String(const String& other) { InitWithCopy(other); }
 
     // Move constructs from another string.
     // The other string is set to empty.
     // Does not allocate heap memory.
-    String(String&& other)
-        : data_(other.data_) {
-        other.InitWithEmpty();
-    }
+    String(String&& other) { InitWithMove(&other); }
 
     // Creates a string from the contents of a null-terminated C string.
-    // Allocates heap memory only if |data| is non-empty.
+    // Allocates heap memory only if |data| is longer than |kInlineCapacity|.
     // |data| must not be null.
     String(const char* data) {
         Init(data, constexpr_strlen(data));
     }
 
     // Creates a string from the contents of a null-terminated C string.
-    // Allocates heap memory only if |data| is non-empty.
+    // Allocates heap memory only if |data| is longer than |kInlineCapacity|.
     // |data| and |ac| must not be null.
     String(const char* data, AllocChecker* ac) {
         Init(data, constexpr_strlen(data), ac);
     }
 
     // Creates a string from the contents of a character array of given length.
-    // Allocates heap memory only if |length| is non-zero.
+    // Allocates heap memory only if |length| is greater than |kInlineCapacity|.
     // |data| must not be null.
     String(const char* data, size_t length) {
         Init(data, length);
     }
 
     // Creates a string from the contents of a character array of given length.
-    // Allocates heap memory only if |length| is non-zero.
+    // Allocates heap memory only if |length| is greater than |kInlineCapacity|.
     // |data| and |ac| must not be null.
     String(const char* data, size_t length, AllocChecker* ac) {
         Init(data, length, ac);
     }
 
     // Creates a string with |count| copies of |ch|.
-    // Allocates heap memory only if |count| is non-zero.
+    // Allocates heap memory only if |count| is greater than |kInlineCapacity|.
     String(size_t count, char ch) {
         Init(count, ch);
     }
 
     // Creates a string with |count| copies of |ch|.
-    // Allocates heap memory only if |count| is non-zero.
+    // Allocates heap memory only if |count| is greater than |kInlineCapacity|.
     // |ac| must not be null.
     String(size_t count, char ch, AllocChecker* ac) {
         Init(count, ch, ac);
     }
 
     // Creates a string from the contents of a string piece.
-    // Allocates heap memory only if |piece.length()| is non-zero.
+    // Allocates heap memory only if |piece.length()| is greater than |kInlineCapacity|.
     String(const StringPiece& piece)
         : String(piece.data(), piece.length()) {}
 
     // Creates a string from the contents of a string piece.
-    // Allocates heap memory only if |piece.length()| is non-zero.
+    // Allocates heap memory only if |piece.length()| is greater than |kInlineCapacity|.
     // |ac| must not be null.
     String(const StringPiece& piece, AllocChecker* ac)
         : String(piece.data(), piece.length(), ac) {}
 
     // Creates a string from a string-like object.
-    // Allocates heap memory only if the length of |value| is non-zero.
+    // Allocates heap memory only if the length of |value| is greater than |kInlineCapacity|.
     //
     // Works with various string types including fbl::String, fbl::StringView,
     // std::string, and std::string_view.
@@ -112,14 +111,17 @@ public:
         : String(GetStringData(value), GetStringLength(value)) {}
 
     // Destroys the string.
-    ~String() { ReleaseRef(data_); }
+    ~String() { Release(); }
 
     // Returns a pointer to the null-terminated contents of the string.
     const char* data() const { return data_; }
     const char* c_str() const { return data(); }
 
     // Returns the length of the string, excluding its null terminator.
-    size_t length() const { return *length_field_of(data_); }
+    size_t length() const {
+        return is_inline() ? kInlineCapacity - inline_[kInlineCapacity]
+                           : *length_field_of(data_);
+    }
     size_t size() const { return length(); }
 
     // Returns true if the string's length is zero.
@@ -159,7 +161,7 @@ public:
     String& operator=(String&& other);
 
     // Assigns this string from the contents of a null-terminated C string.
-    // Allocates heap memory only if |data| is non-empty.
+    // Allocates heap memory only if |data| is longer than |kInlineCapacity|.
     // |data| must not be null.
     String& operator=(const char* data) {
         Set(data);
@@ -167,14 +169,14 @@ public:
     }
 
     // Assigns this string from the contents of a string piece.
-    // Allocates heap memory only if |piece.length()| is non-zero.
+    // Allocates heap memory only if |piece.length()| is greater than |kInlineCapacity|.
     String& operator=(const StringPiece& piece) {
         Set(piece);
         return *this;
     }
 
     // Assigns this string from the contents of a string-like object.
-    // Allocates heap memory only if the length of |value| is non-zero.
+    // Allocates heap memory only if the length of |value| is greater than |kInlineCapacity|.
     //
     // Works with various string types including fbl::String, fbl::StringView,
     // std::string, and std::string_view.
@@ -185,52 +187,52 @@ public:
     }
 
     // Assigns this string from the contents of a null-terminated C string.
-    // Allocates heap memory only if |data| is non-empty.
+    // Allocates heap memory only if |data| is longer than |kInlineCapacity|.
     // |data| must not be null.
     void Set(const char* data) {
         Set(data, constexpr_strlen(data));
     }
 
     // Assigns this string from the contents of a null-terminated C string.
-    // Allocates heap memory only if |data| is non-empty.
+    // Allocates heap memory only if |data| is longer than |kInlineCapacity|.
     // |data| and |ac| must not be null.
     void Set(const char* data, AllocChecker* ac) {
         Set(data, constexpr_strlen(data), ac);
     }
 
     // Assigns this string from the contents of a character array of given length.
-    // Allocates heap memory only if |length| is non-zero.
+    // Allocates heap memory only if |length| is greater than |kInlineCapacity|.
     // |data| must not be null.
     void Set(const char* data, size_t length);
 
     // Assigns this string from the contents of a character array of given length.
-    // Allocates heap memory only if |length| is non-zero.
+    // Allocates heap memory only if |length| is greater than |kInlineCapacity|.
     // |data| and |ac| must not be null.
     void Set(const char* data, size_t length, AllocChecker* ac);
 
     // Assigns this string with |count| copies of |ch|.
-    // Allocates heap memory only if |count| is non-zero.
+    // Allocates heap memory only if |count| is greater than |kInlineCapacity|.
     void Set(size_t count, char ch) {
-        ReleaseRef(data_);
+        Release();
         Init(count, ch);
     }
 
     // Assigns this string with |count| copies of |ch|.
-    // Allocates heap memory only if |count| is non-zero.
+    // Allocates heap memory only if |count| is greater than |kInlineCapacity|.
     // |ac| must not be null.
     void Set(size_t count, char ch, AllocChecker* ac) {
-        ReleaseRef(data_);
+        Release();
         Init(count, ch, ac);
     }
 
     // Assigns this string from the contents of a string piece.
-    // Allocates heap memory only if |piece.length()| is non-zero.
+    // Allocates heap memory only if |piece.length()| is greater than |kInlineCapacity|.
     void Set(const StringPiece& piece) {
         Set(piece.data(), piece.length());
     }
 
     // Assigns this string from the contents of a string piece.
-    // Allocates heap memory only if |piece.length()| is non-zero.
+    // Allocates heap memory only if |piece.length()| is greater than |kInlineCapacity|.
     // |ac| must not be null.
     void Set(const StringPiece& piece, AllocChecker* ac) {
         Set(piece.data(), piece.length(), ac);
@@ -253,9 +255,6 @@ public:
 private:
     friend struct fbl::tests::StringTestHelper;
 
-    explicit String(char* data, decltype(nullptr) /*overload disambiguation*/)
-        : data_(data) {}
-
     // A string buffer consists of a length followed by a reference count
     // followed by a null-terminated string.  To make access faster, we offset
     // the |data_| pointer to point at the first byte of the content instead of
@@ -275,27 +274,30 @@ private:
     }
 
     // For use by test code only.
+    // Inline strings have no reference count, so this returns zero for them.
     unsigned int ref_count() const {
-        return ref_count_field_of(data_)->load(memory_order_relaxed);
+        return is_inline() ? 0u : ref_count_field_of(data_)->load(memory_order_relaxed);
     }
 
-    // Storage for an empty string.
-    struct EmptyBuffer {
-        size_t length{0u};
-        atomic_uint ref_count{1u};
-        char nul{0};
-    };
-    static_assert(offsetof(EmptyBuffer, length) == kLengthFieldOffset, "");
-    static_assert(offsetof(EmptyBuffer, ref_count) == kRefCountFieldOffset, "");
-    static_assert(offsetof(EmptyBuffer, nul) == kDataFieldOffset, "");
-
-    static EmptyBuffer gEmpty;
+    // An inline string keeps |kInlineCapacity| minus its length in the last
+    // byte of |inline_|, which doubles as the null terminator of a string of
+    // exactly |kInlineCapacity| characters.
+    bool is_inline() const { return data_ == inline_; }
 
     void Init(const char* data, size_t length);
     void Init(const char* data, size_t length, AllocChecker* ac);
     void Init(size_t count, char ch);
     void Init(size_t count, char ch, AllocChecker* ac);
     void InitWithEmpty();
+    void InitWithCopy(const String& other);
+    void InitWithMove(String* other);
+    void Release();
+
+    // Points |data_| at room for |length| characters and a null terminator,
+    // inline or in a newly allocated buffer, and records the length.  The
+    // caller fills in the characters and the terminator.
+    char* InitStorage(size_t length);
+    char* InitStorage(size_t length, AllocChecker* ac);
 
     static char* AllocData(size_t length);
     static char* AllocData(size_t length, AllocChecker* ac);
@@ -303,7 +305,9 @@ private:
     static void AcquireRef(char* data);
     static void ReleaseRef(char* data);
 
+    // Points at |inline_| or at the contents of a heap buffer.
     char* data_;
+    char inline_[kInlineCapacity + 1u];
 };
 
 bool operator==(const String& lhs, const String& rhs);
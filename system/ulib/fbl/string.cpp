@@ -11,6 +11,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/atomic.h>
 #include <fbl/new.h>
+#include <fbl/type_support.h>
 
 namespace fbl {
 namespace {
@@ -37,10 +38,10 @@ void Concat(char* data, const String* begin, const String* end) {
 
 } // namespace
 
-String::EmptyBuffer String::gEmpty;
+constexpr size_t String::kInlineCapacity;
 
 void String::clear() {
-    ReleaseRef(data_);
+    Release();
     InitWithEmpty();
 }
 
@@ -57,35 +58,35 @@ int String::compare(const String& other) const {
 }
 
 void String::swap(String& other) {
-    char* temp_data = data_;
-    data_ = other.data_;
-    other.data_ = temp_data;
+    String temp(fbl::move(other));
+    other = fbl::move(*this);
+    *this = fbl::move(temp);
 }
 
 String& String::operator=(const String& other) {
-    AcquireRef(other.data_);
-    ReleaseRef(data_); // release after acquire in case other == *this
-    data_ = other.data_;
+    if (this != &other) {
+        Release();
+        InitWithCopy(other);
+    }
     return *this;
 }
 
 String& String::operator=(String&& other) {
-    ReleaseRef(data_);
-    data_ = other.data_;
-    other.InitWithEmpty();
+    if (this != &other) {
+        Release();
+        InitWithMove(&other);
+    }
     return *this;
 }
 
 void String::Set(const char* data, size_t length) {
-    char* temp_data = data_;
-    Init(data, length);
-    ReleaseRef(temp_data); // release after init in case data is within data_
+    String temp(data, length); // copy first in case data is within data_
+    *this = fbl::move(temp);
 }
 
 void String::Set(const char* data, size_t length, fbl::AllocChecker* ac) {
-    char* temp_data = data_;
-    Init(data, length, ac);
-    ReleaseRef(temp_data); // release after init in case data is within data_
+    String temp(data, length, ac); // copy first in case data is within data_
+    *this = fbl::move(temp);
 }
 
 String String::Concat(initializer_list<String> strings) {
@@ -99,10 +100,11 @@ String String::Concat(initializer_list<String> strings) {
         return *last_non_empty_string;
     }
 
-    char* data = AllocData(total_length);
+    String result;
+    char* data = result.InitStorage(total_length);
 
     fbl::Concat(data, strings.begin(), last_non_empty_string + 1);
-    return String(data, nullptr);
+    return result;
 }
 
 String String::Concat(initializer_list<String> strings, AllocChecker* ac) {
@@ -118,13 +120,14 @@ String String::Concat(initializer_list<String> strings, AllocChecker* ac) {
         return *last_non_empty_string;
     }
 
-    char* data = AllocData(total_length, ac);
+    String result;
+    char* data = result.InitStorage(total_length, ac);
     if (!data) {
         return String();
     }
 
     fbl::Concat(data, strings.begin(), last_non_empty_string + 1);
-    return String(data, nullptr);
+    return result;
 }
 
 void String::Init(const char* data, size_t length) {
@@ -133,8 +136,7 @@ void String::Init(const char* data, size_t length) {
         return;
     }
 
-    data_ = AllocData(length);
-    memcpy(data_, data, length);
+    memcpy(InitStorage(length), data, length);
     data_[length] = 0u;
 }
 
@@ -145,9 +147,7 @@ void String::Init(const char* data, size_t length, AllocChecker* ac) {
         return;
     }
 
-    data_ = AllocData(length, ac);
-    if (!data_) {
-        InitWithEmpty();
+    if (!InitStorage(length, ac)) {
         return;
     }
     memcpy(data_, data, length);
@@ -155,35 +155,73 @@ void String::Init(const char* data, size_t length, AllocChecker* ac) {
 }
 
 void String::Init(size_t count, char ch) {
-    if (count == 0u) {
-        InitWithEmpty();
+    memset(InitStorage(count), ch, count);
+    data_[count] = 0u;
+}
+
+void String::Init(size_t count, char ch, AllocChecker* ac) {
+    if (!InitStorage(count, ac)) {
         return;
     }
-
-    data_ = AllocData(count);
     memset(data_, ch, count);
     data_[count] = 0u;
 }
 
-void String::Init(size_t count, char ch, AllocChecker* ac) {
-    if (count == 0u) {
+void String::InitWithEmpty() {
+    data_ = inline_;
+    inline_[0] = 0;
+    inline_[kInlineCapacity] = static_cast<char>(kInlineCapacity);
+}
+
+void String::InitWithCopy(const String& other) {
+    if (other.is_inline()) {
+        memcpy(inline_, other.inline_, sizeof(inline_));
+        data_ = inline_;
+    } else {
+        AcquireRef(other.data_);
+        data_ = other.data_;
+    }
+}
+
+void String::InitWithMove(String* other) {
+    if (other->is_inline()) {
+        memcpy(inline_, other->inline_, sizeof(inline_));
+        data_ = inline_;
+    } else {
+        data_ = other->data_;
+    }
+    other->InitWithEmpty();
+}
+
+void String::Release() {
+    if (!is_inline()) {
+        ReleaseRef(data_);
+    }
+}
+
+char* String::InitStorage(size_t length) {
+    if (length <= kInlineCapacity) {
+        data_ = inline_;
+        inline_[kInlineCapacity] = static_cast<char>(kInlineCapacity - length);
+    } else {
+        data_ = AllocData(length);
+    }
+    return data_;
+}
+
+// On failure, leaves the string empty and returns null.
+char* String::InitStorage(size_t length, AllocChecker* ac) {
+    if (length <= kInlineCapacity) {
         ac->arm(0u, true);
-        InitWithEmpty();
-        return;
+        return InitStorage(length);
     }
 
-    data_ = AllocData(count, ac);
+    data_ = AllocData(length, ac);
     if (!data_) {
         InitWithEmpty();
-        return;
+        return nullptr;
     }
-    memset(data_, ch, count);
-    data_[count] = 0u;
-}
-
-void String::InitWithEmpty() {
-    gEmpty.ref_count.fetch_add(1u, memory_order_relaxed);
-    data_ = &gEmpty.nul;
+    return data_;
 }
 
 char* String::AllocData(size_t length) {
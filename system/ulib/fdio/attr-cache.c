@@ -0,0 +1,323 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include <zircon/device/vfs.h>
+#include <zircon/listnode.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+
+#include <fdio/io.h>
+#include <fdio/vfs.h>
+
+#include "private.h"
+#include "unistd.h"
+
+// A cache of stat() results by path, so that repeated lookups skip the round
+// trips of opening, stating and closing a file on its server.
+//
+// Entries are kept per directory, each of which has a watcher on its server:
+// any entry added to or removed from the directory drops everything cached
+// for it, which also covers lookups that found nothing. Changes this process
+// makes through fdio drop the whole cache, by moving it to a new generation.
+// Other changes to a file's attributes aren't reported by watchers, so no
+// entry outlives its lease.
+
+#define MAX_DIRS 32
+#define MAX_ENTRIES_PER_DIR 128
+
+typedef struct attr_entry {
+    list_node_t node;
+    uint64_t gen;
+    zx_time_t expiry;
+    // ZX_OK if |attr| is valid, or why the lookup failed.
+    zx_status_t status;
+    vnattr_t attr;
+    char name[];
+} attr_entry_t;
+
+typedef struct attr_dir {
+    list_node_t node;
+    // Channel on which the directory's watch events arrive.
+    zx_handle_t watcher;
+    list_node_t entries;
+    size_t count;
+    char path[];
+} attr_dir_t;
+
+static mtx_t cache_lock = MTX_INIT;
+static zx_duration_t cache_lease;
+// Most recently used first.
+static list_node_t cache_dirs = LIST_INITIAL_VALUE(cache_dirs);
+static size_t cache_dir_count;
+static atomic_uint_fast64_t cache_gen;
+
+static void free_entries(attr_dir_t* dir) {
+    attr_entry_t* entry;
+    while ((entry = list_remove_head_type(&dir->entries, attr_entry_t, node)) != NULL) {
+        free(entry);
+    }
+    dir->count = 0;
+}
+
+static void free_dir(attr_dir_t* dir) {
+    free_entries(dir);
+    zx_handle_close(dir->watcher);
+    free(dir);
+}
+
+// Drops the entries of |dir| if its watcher has reported a change, or the
+// whole of |dir| if it can no longer report them. Returns false in the latter
+// case. Called with |cache_lock| held.
+static bool check_dir(attr_dir_t* dir) {
+    zx_signals_t pending;
+    zx_status_t r = zx_object_wait_one(dir->watcher, ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                                       0, &pending);
+    if (r == ZX_ERR_TIMED_OUT) {
+        return true;
+    }
+    if ((r == ZX_OK) && !(pending & ZX_CHANNEL_PEER_CLOSED)) {
+        uint8_t msg[VFS_WATCH_MSG_MAX];
+        uint32_t sz;
+        while ((r = zx_channel_read(dir->watcher, 0, msg, NULL, sizeof(msg), 0,
+                                    &sz, NULL)) == ZX_OK) {
+        }
+        if (r == ZX_ERR_SHOULD_WAIT) {
+            free_entries(dir);
+            return true;
+        }
+    }
+    list_delete(&dir->node);
+    cache_dir_count--;
+    free_dir(dir);
+    return false;
+}
+
+// Finds the directory |path| in the cache, moving it to the front.
+// Called with |cache_lock| held.
+static attr_dir_t* find_dir(const char* path, size_t len) {
+    attr_dir_t* dir;
+    list_for_every_entry (&cache_dirs, dir, attr_dir_t, node) {
+        if ((strlen(dir->path) == len) && !memcmp(dir->path, path, len)) {
+            if (!check_dir(dir)) {
+                return NULL;
+            }
+            list_delete(&dir->node);
+            list_add_head(&cache_dirs, &dir->node);
+            return dir;
+        }
+    }
+    return NULL;
+}
+
+// Starts watching the directory |path| for entries being added or removed.
+static attr_dir_t* watch_dir(const char* path, size_t len) {
+    attr_dir_t* dir = calloc(1, sizeof(*dir) + len + 1);
+    if (dir == NULL) {
+        return NULL;
+    }
+    memcpy(dir->path, path, len);
+    dir->path[len] = 0;
+    list_initialize(&dir->entries);
+
+    fdio_t* io;
+    if (__fdio_open(&io, dir->path, O_RDONLY | O_DIRECTORY, 0) < 0) {
+        free(dir);
+        return NULL;
+    }
+    vfs_watch_dir_t wd = {
+        .mask = VFS_WATCH_MASK_DELETED | VFS_WATCH_MASK_ADDED | VFS_WATCH_MASK_REMOVED,
+        .options = 0,
+    };
+    ssize_t r = ZX_ERR_NO_RESOURCES;
+    if (zx_channel_create(0, &wd.channel, &dir->watcher) == ZX_OK) {
+        if ((r = io->ops->ioctl(io, IOCTL_VFS_WATCH_DIR, &wd, sizeof(wd), NULL, 0)) < 0) {
+            zx_handle_close(dir->watcher);
+        }
+    }
+    io->ops->close(io);
+    fdio_release(io);
+    if (r < 0) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+bool __fdio_attr_cache_key(const char* fn, char* key) {
+    if (atomic_load(&cache_gen) == 0 || fn == NULL || fn[0] == 0) {
+        // Not enabled.
+        return false;
+    }
+
+    size_t len = 0;
+    if (fn[0] != '/') {
+        mtx_lock(&fdio_cwd_lock);
+        len = strlen(fdio_cwd_path);
+        if ((fdio_cwd_path[0] != '/') || (len + 1 >= PATH_MAX)) {
+            mtx_unlock(&fdio_cwd_lock);
+            return false;
+        }
+        memcpy(key, fdio_cwd_path, len);
+        mtx_unlock(&fdio_cwd_lock);
+        if (len > 1) {
+            key[len++] = '/';
+        }
+    }
+    size_t fn_len = strlen(fn);
+    if (len + fn_len >= PATH_MAX) {
+        return false;
+    }
+    memcpy(key + len, fn, fn_len + 1);
+
+    // Only paths spelled one way are cached, so that a change drops them all.
+    for (const char* p = key + 1; *p != 0; p++) {
+        if (p[-1] != '/') {
+            continue;
+        }
+        if ((p[0] == '/') || (p[0] == '.' && (p[1] == '/' || p[1] == 0)) ||
+            (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == 0))) {
+            return false;
+        }
+    }
+    len += fn_len;
+    return (len > 1) && (key[len - 1] != '/');
+}
+
+uint64_t __fdio_attr_cache_gen(void) {
+    return atomic_load(&cache_gen);
+}
+
+void __fdio_attr_cache_invalidate(void) {
+    uint64_t gen = atomic_load(&cache_gen);
+    while ((gen != 0) && !atomic_compare_exchange_weak(&cache_gen, &gen, gen + 1)) {
+    }
+}
+
+bool __fdio_attr_cache_get(const char* key, vnattr_t* attr, zx_status_t* status) {
+    const char* name = strrchr(key, '/') + 1;
+    bool hit = false;
+    mtx_lock(&cache_lock);
+    attr_dir_t* dir = find_dir(key, (name - key > 1) ? (size_t)(name - key - 1) : 1);
+    if (dir != NULL) {
+        uint64_t gen = atomic_load(&cache_gen);
+        zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        attr_entry_t* entry;
+        list_for_every_entry (&dir->entries, entry, attr_entry_t, node) {
+            if (strcmp(entry->name, name)) {
+                continue;
+            }
+            if ((entry->gen == gen) && (now < entry->expiry)) {
+                *status = entry->status;
+                if (entry->status == ZX_OK) {
+                    *attr = entry->attr;
+                }
+                hit = true;
+            }
+            break;
+        }
+    }
+    mtx_unlock(&cache_lock);
+    return hit;
+}
+
+void __fdio_attr_cache_put(const char* key, uint64_t gen, zx_status_t status,
+                           const vnattr_t* attr) {
+    const char* name = strrchr(key, '/') + 1;
+    size_t dir_len = (name - key > 1) ? (size_t)(name - key - 1) : 1;
+    size_t name_len = strlen(name);
+
+    mtx_lock(&cache_lock);
+    attr_dir_t* dir = find_dir(key, dir_len);
+    mtx_unlock(&cache_lock);
+    attr_dir_t* watched = NULL;
+    if (dir == NULL && (watched = watch_dir(key, dir_len)) == NULL) {
+        return;
+    }
+    attr_entry_t* entry = calloc(1, sizeof(*entry) + name_len + 1);
+    if (entry == NULL) {
+        if (watched != NULL) {
+            free_dir(watched);
+        }
+        return;
+    }
+    entry->status = status;
+    if (status == ZX_OK) {
+        entry->attr = *attr;
+    }
+    memcpy(entry->name, name, name_len + 1);
+
+    mtx_lock(&cache_lock);
+    if ((cache_lease == 0) || (gen != atomic_load(&cache_gen))) {
+        // Something changed, or the cache was turned off, while |key| was
+        // being looked up.
+        mtx_unlock(&cache_lock);
+        free(entry);
+        if (watched != NULL) {
+            free_dir(watched);
+        }
+        return;
+    }
+    entry->gen = gen;
+    entry->expiry = zx_clock_get(ZX_CLOCK_MONOTONIC) + cache_lease;
+
+    // Another thread may have raced to watch the same directory.
+    if ((dir = find_dir(key, dir_len)) == NULL) {
+        if (watched == NULL) {
+            mtx_unlock(&cache_lock);
+            free(entry);
+            return;
+        }
+        dir = watched;
+        watched = NULL;
+        if (cache_dir_count == MAX_DIRS) {
+            free_dir(list_remove_tail_type(&cache_dirs, attr_dir_t, node));
+            cache_dir_count--;
+        }
+        list_add_head(&cache_dirs, &dir->node);
+        cache_dir_count++;
+    }
+
+    attr_entry_t* old;
+    list_for_every_entry (&dir->entries, old, attr_entry_t, node) {
+        if (!strcmp(old->name, name)) {
+            list_delete(&old->node);
+            free(old);
+            dir->count--;
+            break;
+        }
+    }
+    if (dir->count == MAX_ENTRIES_PER_DIR) {
+        free(list_remove_tail_type(&dir->entries, attr_entry_t, node));
+        dir->count--;
+    }
+    list_add_head(&dir->entries, &entry->node);
+    dir->count++;
+    mtx_unlock(&cache_lock);
+
+    if (watched != NULL) {
+        free_dir(watched);
+    }
+}
+
+void fdio_set_attr_cache(zx_duration_t lease) {
+    attr_dir_t* dir;
+    mtx_lock(&cache_lock);
+    cache_lease = lease;
+    // Generation zero means the cache is off; any other value starts afresh.
+    uint64_t gen = atomic_load(&cache_gen);
+    atomic_store(&cache_gen, (lease == 0) ? 0 : gen + 1);
+    while ((dir = list_remove_head_type(&cache_dirs, attr_dir_t, node)) != NULL) {
+        free_dir(dir);
+    }
+    cache_dir_count = 0;
+    mtx_unlock(&cache_lock);
+}
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <dirent.h>
 #include <limits.h>
 #include <poll.h>
 #include <stdbool.h>
@@ -65,6 +66,32 @@ zx_status_t fdio_get_vmo(int fd, zx_handle_t* out_vmo);
 // data into a new VMO).
 zx_status_t fdio_get_exact_vmo(int fd, zx_handle_t* out_vmo);
 
+// The most writes fdio_set_write_behind() lets a fd have in flight.
+#define FDIO_MAX_WRITE_BEHIND 32
+
+// Let writes to a remote file return as soon as they are sent, keeping up to
+// |max_in_flight| unanswered at a time, or stop doing so if it is zero.
+// An error from a write which has already returned is reported, once, by the
+// next write, fsync or close of the fd.
+zx_status_t fdio_set_write_behind(int fd, uint32_t max_in_flight);
+
+// Cache what stat() finds by path, including missing files, for up to |lease|,
+// or stop caching if it is zero. An entry is dropped early when this process
+// changes any file, or when a watcher on its directory reports an entry being
+// added or removed. Other processes' changes to a file's attributes may go
+// unseen until its lease runs out.
+void fdio_set_attr_cache(zx_duration_t lease);
+
+// Has readdir() on |dir| read the attributes of each entry along with it,
+// where the filesystem can, for fdio_dirent_stat() to return. Takes effect
+// from the next batch of entries read from the filesystem.
+void fdio_dir_read_attrs(DIR* dir);
+
+// Fills |s| for |de|, the entry last returned by readdir() on |dir|, as
+// fstatat(dirfd(dir), de->d_name, s, 0) would. Uses the attributes read
+// along with the entry if there are any, and fstatat() otherwise.
+int fdio_dirent_stat(DIR* dir, const struct dirent* de, struct stat* s);
+
 // create a fd that is backed by the given range of the vmo.
 // This function takes ownership of the vmo and will close the vmo when the fd
 // is closed.
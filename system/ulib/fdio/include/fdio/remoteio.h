@@ -58,7 +58,13 @@ __BEGIN_CDECLS
 #define ZXRIO_LINK        (0x0000001a | ZXRIO_ONE_HANDLE)
 #define ZXRIO_MMAP         0x0000001b
 #define ZXRIO_FCNTL        0x0000001c
-#define ZXRIO_NUM_OPS      29
+#define ZXRIO_READDIR_ATTR 0x0000001d
+#define ZXRIO_NUM_OPS      30
+
+// Flag for READ, READ_AT, WRITE and WRITE_AT, on connections to devices
+// which accepted IOCTL_DEVICE_SET_IO_BUFFER: the data is in the buffer,
+// at its start, rather than in the message, and |arg| is its length.
+#define ZXRIO_FLAG_IO_BUFFER 0x00000400
 
 #define ZXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define ZXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -71,7 +77,7 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link", "mmap", "fcntl" }
+    "setattr", "sync", "link", "mmap", "fcntl", "readdir_attr" }
 
 // dispatcher callback return code that there were no messages to read
 #define ERR_DISPATCHER_NO_WORK ZX_ERR_SHOULD_WAIT
@@ -110,6 +116,19 @@ zx_status_t zxrio_handler(zx_handle_t h, zxrio_cb_t cb, void* cookie);
 // should be callaed again after handle_close().
 zx_status_t zxrio_handle_rpc(zx_handle_t h, zxrio_msg_t* msg, zxrio_cb_t cb, void* cookie);
 
+// like zxrio_handle_rpc(), but reads up to |count| messages into |msgs| with
+// one zx_channel_read_many() and sends their replies back with one
+// zx_channel_write_many().  messages after a close or an invalid message
+// are dropped.
+zx_status_t zxrio_handle_rpc_many(zx_handle_t h, zxrio_msg_t* msgs, uint32_t count,
+                                  zxrio_cb_t cb, void* cookie);
+
+// number of messages zxrio_handler_many() handles per call
+#define ZXRIO_BATCH_MSGS 4
+
+// a version of zxrio_handler() that handles a batch of queued messages
+zx_status_t zxrio_handler_many(zx_handle_t h, zxrio_cb_t cb, void* cookie);
+
 // Invokes the callback with a "fake" close message. Useful when the
 // client abruptly closes a handle without an explicit close message;
 // this function allows the server to react the same way as a "clean" close.
@@ -178,6 +197,10 @@ struct zxrio_msg {
 #define FDIO_MMAP_FLAG_WRITE   (1u << 1)
 #define FDIO_MMAP_FLAG_EXEC    (1u << 2)
 #define FDIO_MMAP_FLAG_PRIVATE (1u << 16)
+// The contents behind the returned VMO never change, so the client may read
+// the file from it instead of the server. Servers which can't promise this
+// must fail the request.
+#define FDIO_MMAP_FLAG_STABLE  (1u << 17)
 
 static_assert(FDIO_MMAP_FLAG_READ == ZX_VM_FLAG_PERM_READ, "Vmar / Mmap flags should be aligned");
 static_assert(FDIO_MMAP_FLAG_WRITE == ZX_VM_FLAG_PERM_WRITE, "Vmar / Mmap flags should be aligned");
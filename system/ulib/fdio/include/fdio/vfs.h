@@ -80,4 +80,13 @@ typedef struct vdirent {
     char name[0];
 } vdirent_t;
 
+// The entries returned by ZXRIO_READDIR_ATTR: a vdirent_t with the
+// attributes of the node it names, and padded to keep them aligned.
+typedef struct vdirent_attr {
+    uint32_t size;
+    uint32_t type;
+    vnattr_t attr;
+    char name[0];
+} vdirent_attr_t;
+
 __END_CDECLS
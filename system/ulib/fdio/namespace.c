@@ -25,11 +25,15 @@
 // of a tree of vnodes, each of which may contain child vnodes
 // and a handle for a remote filesystem.
 //
-// They are expected to be relatively small (perhaps 10-50 total
-// local vnodes, acting as roots for the remote filesystems that
-// contain the actual items of interest) and as such have a simple
-// locking model -- one namespace-wide lock that is held while
-// doing the local directory walk part of an OPEN operation.
+// Path lookups (the local directory walk part of an OPEN or a
+// fdio_ns_connect()) take no lock.  Each vnode is found through a
+// namespace-wide hash table keyed by its parent and name, so a walk
+// costs one hash probe per path segment however many paths are bound.
+// Vnodes are never modified or freed once published, until the
+// namespace is destroyed, so readers only need the acquire load of a
+// bucket head to see a fully built vnode.  fdio_ns_bind() builds any
+// new vnodes privately and publishes them under the namespace lock,
+// which only serializes writers.
 //
 // If an OPEN path matches one of the local vnodes exactly, a
 // fdio_directory object is created and returned.  This object
@@ -42,20 +46,28 @@
 typedef struct fdio_directory mxdir_t;
 typedef struct fdio_vnode mxvn_t;
 
+// |child| and |next| link the vnodes for readdir and export, under
+// the namespace lock.  |hnext| chains the vnodes of one hash bucket.
+// |remote| is atomic because the root may gain one after it has been
+// published.
 struct fdio_vnode {
     mxvn_t* child;
     mxvn_t* parent;
     mxvn_t* next;
-    zx_handle_t remote;
+    mxvn_t* hnext;
+    _Atomic(zx_handle_t) remote;
     uint32_t namelen;
     char name[];
 };
 
+#define NS_HASH_BUCKETS 128
+
 // refcount is incremented when a fdio_dir references any of its vnodes
 // when refcount is nonzero it may not be modified or destroyed
 struct fdio_namespace {
     mtx_t lock;
     int32_t refcount;
+    _Atomic(mxvn_t*) hash[NS_HASH_BUCKETS];
     mxvn_t root;
 };
 
@@ -72,19 +84,36 @@ struct fdio_directory {
     atomic_int_fast32_t seq;
 };
 
-static fdio_t* fdio_dir_create_locked(fdio_ns_t* fs, mxvn_t* vn, zx_handle_t h);
+static fdio_t* fdio_dir_create(fdio_ns_t* fs, mxvn_t* vn, zx_handle_t h);
 
-static mxvn_t* vn_lookup_locked(mxvn_t* dir, const char* name, size_t len) {
-    for (mxvn_t* vn = dir->child; vn; vn = vn->next) {
-        if ((vn->namelen == len) && (!memcmp(vn->name, name, len))) {
+// FNV-1a over the parent's address and the name.
+static uint32_t vn_hash(const mxvn_t* dir, const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+    uintptr_t p = (uintptr_t)dir;
+    for (size_t i = 0; i < sizeof(p); i++) {
+        h = (h ^ (uint8_t)(p >> (8 * i))) * 16777619u;
+    }
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
+    }
+    return h & (NS_HASH_BUCKETS - 1);
+}
+
+// Safe to call without the namespace lock.
+static mxvn_t* vn_lookup(fdio_ns_t* ns, mxvn_t* dir, const char* name, size_t len) {
+    uint32_t b = vn_hash(dir, name, len);
+    for (mxvn_t* vn = atomic_load_explicit(&ns->hash[b], memory_order_acquire);
+         vn; vn = vn->hnext) {
+        if ((vn->parent == dir) && (vn->namelen == len) && (!memcmp(vn->name, name, len))) {
             return vn;
         }
     }
     return NULL;
 }
 
-static zx_status_t vn_create_locked(mxvn_t* dir, const char* name, size_t len,
-                                    zx_handle_t remote, mxvn_t** out) {
+// Allocates a vnode that no other thread can see yet.
+static zx_status_t vn_create(mxvn_t* dir, const char* name, size_t len,
+                             zx_handle_t remote, mxvn_t** out) {
     if ((len == 0) || (len > NAME_MAX)) {
         return ZX_ERR_INVALID_ARGS;
     }
@@ -94,16 +123,7 @@ static zx_status_t vn_create_locked(mxvn_t* dir, const char* name, size_t len,
     if ((len == 2) && (name[0] == '.') && (name[1] == '.')) {
         return ZX_ERR_INVALID_ARGS;
     }
-    mxvn_t* vn = vn_lookup_locked(dir, name, len);
-    if (vn != NULL) {
-        // if there's already a vnode, that's okay as long
-        // as we don't want to override its remote
-        if (remote != ZX_HANDLE_INVALID) {
-            return ZX_ERR_ALREADY_EXISTS;
-        }
-        *out = vn;
-        return ZX_OK;
-    }
+    mxvn_t* vn;
     if ((vn = calloc(1, sizeof(*vn) + len + 1)) == NULL) {
         return ZX_ERR_NO_MEMORY;
     }
@@ -111,44 +131,21 @@ static zx_status_t vn_create_locked(mxvn_t* dir, const char* name, size_t len,
     vn->name[len] = 0;
     vn->namelen = len;
     vn->parent = dir;
-    vn->remote = remote;
-    vn->next = dir->child;
-    dir->child = vn;
+    atomic_init(&vn->remote, remote);
     *out = vn;
     return ZX_OK;
 }
 
-// vn_destroy *only* safe to be called on vnodes that have never been
-// wrapped in a directory object, because we don't refcount vnodes
-// (they're expected to live for the duration of the namespace).
-//
-// It's used by fdio_ns_bind() to delete intermediate vnodes that
-// were created while the ns lock is held, to "undo" a partial mkdir
-// operation that failed partway down the pat.  Since the lock is not
-// released until the full operation completes, this is safe.
-static zx_status_t vn_destroy_locked(mxvn_t* child) {
-    // can't destroy a live node
-    if (child->remote != ZX_HANDLE_INVALID) {
-        return ZX_ERR_BAD_STATE;
-    }
-    // can't destroy the root
-    if (child->parent == NULL) {
-        return ZX_ERR_NOT_SUPPORTED;
-    }
-    mxvn_t* dir = child->parent;
-
-    if (dir->child == child) {
-        dir->child = child->next;
-    } else {
-        for (mxvn_t* vn = dir->child; vn; vn = vn->next) {
-            if (vn->next == child) {
-                vn->next = child->next;
-                break;
-            }
-        }
-    }
-    free(child);
-    return ZX_OK;
+// Links a fully built vnode into its parent and the hash table.  The
+// release store of the bucket head is what makes it visible to
+// lock-free lookups.
+static void vn_publish_locked(fdio_ns_t* ns, mxvn_t* vn) {
+    mxvn_t* dir = vn->parent;
+    vn->next = dir->child;
+    dir->child = vn;
+    uint32_t b = vn_hash(dir, vn->name, vn->namelen);
+    vn->hnext = atomic_load_explicit(&ns->hash[b], memory_order_relaxed);
+    atomic_store_explicit(&ns->hash[b], vn, memory_order_release);
 }
 
 static void vn_destroy_children_locked(mxvn_t* parent) {
@@ -198,7 +195,6 @@ zx_status_t fdio_ns_connect(fdio_ns_t* ns, const char* path, zx_handle_t h) {
     mxvn_t* vn = &ns->root;
     zx_status_t r = ZX_OK;
 
-    mtx_lock(&ns->lock);
     if (path[0] != '/') {
         r = ZX_ERR_NOT_FOUND;
         goto done;
@@ -225,7 +221,7 @@ zx_status_t fdio_ns_connect(fdio_ns_t* ns, const char* path, zx_handle_t h) {
         }
 
         // is there a local match?
-        mxvn_t* child = vn_lookup_locked(vn, name, len);
+        mxvn_t* child = vn_lookup(ns, vn, name, len);
         if (child != NULL) {
             vn = child;
             if (next) {
@@ -263,7 +259,6 @@ zx_status_t fdio_ns_connect(fdio_ns_t* ns, const char* path, zx_handle_t h) {
     }
     zx_handle_close(h);
 done:
-    mtx_unlock(&ns->lock);
     return r;
 }
 
@@ -276,7 +271,6 @@ static zx_status_t mxdir_open(fdio_t* io, const char* path,
     mxvn_t* vn = dir->vn;
     zx_status_t r = ZX_OK;
 
-    mtx_lock(&dir->ns->lock);
     if ((path[0] == '.') && (path[1] == 0)) {
         goto open_dot;
     }
@@ -301,7 +295,7 @@ static zx_status_t mxdir_open(fdio_t* io, const char* path,
         }
 
         // is there a local match?
-        mxvn_t* child = vn_lookup_locked(vn, name, len);
+        mxvn_t* child = vn_lookup(dir->ns, vn, name, len);
         if (child != NULL) {
             vn = child;
             if (next) {
@@ -329,7 +323,6 @@ static zx_status_t mxdir_open(fdio_t* io, const char* path,
         }
 
         // hand off to remote filesystem
-        mtx_unlock(&dir->ns->lock);
         return zxrio_open_handle(vn->remote, path, flags, mode, out);
     }
     if (r == ZX_OK) {
@@ -339,7 +332,7 @@ static zx_status_t mxdir_open(fdio_t* io, const char* path,
             // relative to that directory for our remote fs
             zx_handle_t h;
             if (zxrio_open_handle_raw(save_vn->remote, save_path, flags, mode, &h) == ZX_OK) {
-                if ((*out = fdio_dir_create_locked(dir->ns, vn, h)) == NULL) {
+                if ((*out = fdio_dir_create(dir->ns, vn, h)) == NULL) {
                     r = ZX_ERR_NO_MEMORY;
                 } else {
                     r = ZX_OK;
@@ -348,12 +341,11 @@ static zx_status_t mxdir_open(fdio_t* io, const char* path,
 
         } else {
 open_dot:
-            if ((*out = fdio_dir_create_locked(dir->ns, vn, 0)) == NULL) {
+            if ((*out = fdio_dir_create(dir->ns, vn, 0)) == NULL) {
                 r = ZX_ERR_NO_MEMORY;
             }
         }
     }
-    mtx_unlock(&dir->ns->lock);
     return r;
 }
 
@@ -393,7 +385,6 @@ static zx_status_t mxdir_readdir_locked(mxdir_t* dir, void* buf, size_t len) {
 // our children, by setting their names to ""
 static zx_status_t mxdir_filter(mxdir_t* dir, void* ptr, size_t len) {
     size_t r = len;
-    mtx_lock(&dir->ns->lock);
     for (;;) {
         if (len < sizeof(vdirent_t)) {
             break;
@@ -405,15 +396,10 @@ static zx_status_t mxdir_filter(mxdir_t* dir, void* ptr, size_t len) {
         ptr += vde->size;
         len -= vde->size;
         size_t namelen = strlen(vde->name);
-        for (mxvn_t* vn = dir->vn->child; vn; vn = vn->next) {
-            if ((namelen == vn->namelen) &&
-                !strcmp(vn->name, vde->name)) {
-                vde->name[0] = 0;
-                break;
-            }
+        if (vn_lookup(dir->ns, dir->vn, vde->name, namelen) != NULL) {
+            vde->name[0] = 0;
         }
     }
-    mtx_unlock(&dir->ns->lock);
     return r;
 }
 
@@ -450,6 +436,10 @@ static zx_status_t mxdir_misc(fdio_t* io, uint32_t op, int64_t off,
         }
         mtx_unlock(&dir->ns->lock);
         return r;
+    case ZXRIO_READDIR_ATTR:
+        // Local children would have to be merged in, with no attributes to
+        // give them; readdir() falls back to ZXRIO_READDIR.
+        return ZX_ERR_NOT_SUPPORTED;
     case ZXRIO_STAT:
         if (maxreply < sizeof(vnattr_t)) {
             return ZX_ERR_INVALID_ARGS;
@@ -488,7 +478,7 @@ static fdio_ops_t dir_ops = {
     .get_vmo = fdio_default_get_vmo,
 };
 
-static fdio_t* fdio_dir_create_locked(fdio_ns_t* ns, mxvn_t* vn, zx_handle_t h) {
+static fdio_t* fdio_dir_create(fdio_ns_t* ns, mxvn_t* vn, zx_handle_t h) {
     mxdir_t* dir = calloc(1, sizeof(*dir));
     if (dir == NULL) {
         if (h != ZX_HANDLE_INVALID) {
@@ -555,43 +545,62 @@ zx_status_t fdio_ns_bind(fdio_ns_t* ns, const char* path, zx_handle_t remote) {
     mxvn_t* vn = &ns->root;
     if (path[0] == 0) {
         // the path was "/" so we're trying to bind to the root vnode
-        if (vn->remote == ZX_HANDLE_INVALID) {
-            vn->remote = remote;
-        } else {
+        zx_handle_t expected = ZX_HANDLE_INVALID;
+        if (!atomic_compare_exchange_strong(&vn->remote, &expected, remote)) {
             r = ZX_ERR_ALREADY_EXISTS;
         }
         mtx_unlock(&ns->lock);
         return r;
     }
+
+    // descend through the vnodes that already exist
+    const char* next;
+    mxvn_t* child;
     for (;;) {
-        const char* next = strchr(path, '/');
-        if (next) {
-            // not the final segment, create an intermediate vnode
-            r = vn_create_locked(vn, path, next - path, ZX_HANDLE_INVALID, &vn);
-            if (r < 0) {
-                break;
-            }
-            path = next + 1;
-        } else {
-            // final segment. create leaf vnode and stop
-            r = vn_create_locked(vn, path, strlen(path), remote, &vn);
+        next = strchr(path, '/');
+        size_t len = next ? (size_t)(next - path) : strlen(path);
+        if ((child = vn_lookup(ns, vn, path, len)) == NULL) {
             break;
         }
+        if (next == NULL) {
+            // the leaf already exists; we can't override it
+            r = ZX_ERR_ALREADY_EXISTS;
+            goto done;
+        }
+        vn = child;
+        path = next + 1;
     }
 
-    if (r < 0) {
-        // we failed, so unwind, removing any intermediate vnodes
-        // we created.  vn_destroy_locked() will error out on any
-        // vnode that has a remote, or on the root vnode, so we
-        // it will stop us before we remove anything that already
-        // existed.  (we never create leaf vnodes with no remote)
-        for (;;) {
-            mxvn_t* parent = vn->parent;
-            if (vn_destroy_locked(vn) < 0) {
-                break;
+    // Build the rest of the path off to the side, where lock-free
+    // lookups can't see it, so a failure partway down can simply free
+    // what was made.  Only the leaf has a remote.
+    mxvn_t* bottom = vn;
+    for (;;) {
+        next = strchr(path, '/');
+        size_t len = next ? (size_t)(next - path) : strlen(path);
+        r = vn_create(bottom, path, len, next ? ZX_HANDLE_INVALID : remote, &child);
+        if (r < 0) {
+            // the caller keeps the remote handle on failure
+            while (bottom != vn) {
+                mxvn_t* parent = bottom->parent;
+                free(bottom);
+                bottom = parent;
             }
-            vn = parent;
+            goto done;
         }
+        bottom = child;
+        if (next == NULL) {
+            break;
+        }
+        path = next + 1;
+    }
+
+    // publish from the leaf up, so that by the time the first new
+    // vnode can be found everything below it can be too
+    while (bottom != vn) {
+        mxvn_t* parent = bottom->parent;
+        vn_publish_locked(ns, bottom);
+        bottom = parent;
     }
 done:
     mtx_unlock(&ns->lock);
@@ -630,7 +639,7 @@ zx_status_t fdio_ns_bind_fd(fdio_ns_t* ns, const char* path, int fd) {
 
 fdio_t* fdio_ns_open_root(fdio_ns_t* ns) {
     mtx_lock(&ns->lock);
-    fdio_t* io = fdio_dir_create_locked(ns, &ns->root, 0);
+    fdio_t* io = fdio_dir_create(ns, &ns->root, 0);
     if (io != NULL) {
         ns->refcount++;
     }
@@ -19,6 +19,28 @@ struct zxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic zx_txid_t txid;
+
+    // the file's contents, if the server offered a VMO of them which never
+    // changes; reads and seeks are then served locally
+    _Atomic(struct zxrio_vmo*) vmo;
+
+    // set once the server has declined to offer such a VMO
+    atomic_bool vmo_declined;
+
+    // a buffer shared with a device's server for reads and writes; see
+    // IOCTL_DEVICE_SET_IO_BUFFER
+    _Atomic(struct zxrio_iobuf*) iobuf;
+
+    // set once the server has declined such a buffer
+    atomic_bool iobuf_declined;
+
+    // writes sent without waiting for their replies; see fdio_set_write_behind()
+    _Atomic(struct zxrio_wb*) wb;
+
+    // set while the reply to a pipelined open is yet to be read from |h|,
+    // and the status it carried once it has been
+    atomic_bool describe_pending;
+    _Atomic zx_status_t open_status;
 };
 
 // These are for the benefit of namespace.c
@@ -7,6 +7,7 @@
 #include <zircon/types.h>
 #include <fdio/limits.h>
 #include <fdio/remoteio.h>
+#include <fdio/vfs.h>
 #include <stdarg.h>
 #include <stdatomic.h>
 #include <stdbool.h>
@@ -144,6 +145,11 @@ fdio_t* fdio_socket_create(zx_handle_t h, zx_handle_t s, int flags);
 // creates a message port and pair of simple io fdio_t's
 int fdio_pipe_pair(fdio_t** a, fdio_t** b);
 
+// Passed along with ZX_FS_FLAG_DESCRIBE to open a node known to speak
+// remoteio without waiting: the describe reply is read by the first
+// operation on the connection, which fails with its status. Never sent.
+#define FDIO_FLAG_LAZY_DESCRIBE 0x80000000
+
 // create a fdio (if possible) from type, handles and extradata
 zx_status_t fdio_from_handles(uint32_t type, zx_handle_t* handles, int hcount,
                               const zxrio_object_info_t* extra, fdio_t** out);
@@ -165,6 +171,20 @@ fdio_t* fdio_ns_open_root(fdio_ns_t* ns);
 // io will be consumed by this and must not be shared
 void fdio_chdir(fdio_t* io, const char* path);
 
+// The stat() cache; see attr-cache.c.
+// Fills |key| (PATH_MAX long) with the path under which |fn| is cached,
+// returning false if the cache is off or |fn| can't be cached.
+bool __fdio_attr_cache_key(const char* fn, char* key);
+// Looks |key| up, returning false on a miss.
+bool __fdio_attr_cache_get(const char* key, vnattr_t* attr, zx_status_t* status);
+// The generation to pass to __fdio_attr_cache_put() for a lookup starting now.
+uint64_t __fdio_attr_cache_gen(void);
+// Records the result of a lookup of |key|; |attr| is only used on ZX_OK.
+void __fdio_attr_cache_put(const char* key, uint64_t gen, zx_status_t status,
+                           const vnattr_t* attr);
+// Drops everything cached, after this process changes a file.
+void __fdio_attr_cache_invalidate(void);
+
 // Wraps an arbitrary handle with a fdio_t that works with wait hooks.
 // Takes ownership of handle unless shared_handle is true.
 fdio_t* fdio_waitable_create(zx_handle_t h, zx_signals_t signals_in, zx_signals_t signals_out, bool shared_handle);
@@ -25,8 +25,10 @@
 #include <fdio/namespace.h>
 #include <fdio/remoteio.h>
 #include <fdio/util.h>
+#include <fdio/vfs.h>
 
 #include "private-remoteio.h"
+#include "unistd.h"
 
 #define MXDEBUG 0
 
@@ -135,7 +137,7 @@ zx_status_t zxrio_handle_rpc(zx_handle_t h, zxrio_msg_t* msg, zxrio_cb_t cb, voi
     }
 }
 
-zx_status_t zxrio_respond(zx_handle_t h, zxrio_msg_t* msg) {
+static void zxrio_prepare_reply(zxrio_msg_t* msg) {
     if ((msg->arg < 0) || !is_message_valid(msg)) {
         // in the event of an error response or bad message
         // release all the handles and data payload
@@ -148,8 +150,12 @@ zx_status_t zxrio_respond(zx_handle_t h, zxrio_msg_t* msg) {
         // TODO(ZX-974): consider a better error code
         msg->arg = (msg->arg < 0) ? msg->arg : ZX_ERR_INTERNAL;
     }
-    zx_status_t s;
     msg->op = ZXRIO_STATUS;
+}
+
+zx_status_t zxrio_respond(zx_handle_t h, zxrio_msg_t* msg) {
+    zxrio_prepare_reply(msg);
+    zx_status_t s;
     if ((s = zx_channel_write(h, 0, msg, ZXRIO_HDR_SZ + msg->datalen,
                               msg->handle, msg->hcount)) != ZX_OK) {
         discard_handles(msg->handle, msg->hcount);
@@ -157,6 +163,79 @@ zx_status_t zxrio_respond(zx_handle_t h, zxrio_msg_t* msg) {
     return s;
 }
 
+zx_status_t zxrio_handle_rpc_many(zx_handle_t h, zxrio_msg_t* msgs, uint32_t count,
+                                  zxrio_cb_t cb, void* cookie) {
+    zx_channel_msg_t descs[ZX_CHANNEL_MAX_BATCH_MSGS];
+    if (count > ZX_CHANNEL_MAX_BATCH_MSGS) {
+        count = ZX_CHANNEL_MAX_BATCH_MSGS;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        descs[i].bytes = &msgs[i];
+        descs[i].handles = msgs[i].handle;
+        descs[i].num_bytes = sizeof(zxrio_msg_t);
+        descs[i].num_handles = FDIO_MAX_HANDLES;
+    }
+    uint32_t actual = 0;
+    zx_status_t r;
+    if ((r = zx_channel_read_many(h, 0, descs, count, &actual)) != ZX_OK) {
+        return r;
+    }
+
+    // run every request first, then send all of the replies in one go
+    zx_channel_msg_t replies[ZX_CHANNEL_MAX_BATCH_MSGS];
+    uint32_t nreplies = 0;
+    r = ZX_OK;
+    for (uint32_t i = 0; i < actual; i++) {
+        zxrio_msg_t* msg = &msgs[i];
+        // as in zxrio_read_msg, only trust the kernel's handle count
+        msg->hcount = descs[i].num_handles;
+        if ((r != ZX_OK) || !is_message_reply_valid(msg, descs[i].num_bytes)) {
+            // nothing after a close or a bad message gets handled
+            discard_handles(msg->handle, msg->hcount);
+            if (r == ZX_OK) {
+                r = ZX_ERR_INVALID_ARGS;
+            }
+            continue;
+        }
+        bool is_close = (ZXRIO_OP(msg->op) == ZXRIO_CLOSE);
+
+        if ((msg->arg = cb(msg, cookie)) != ERR_DISPATCHER_INDIRECT) {
+            zxrio_prepare_reply(msg);
+            replies[nreplies].bytes = msg;
+            replies[nreplies].handles = msg->handle;
+            replies[nreplies].num_bytes = ZXRIO_HDR_SZ + msg->datalen;
+            replies[nreplies].num_handles = msg->hcount;
+            nreplies++;
+        }
+        if (is_close) {
+            // signals to not perform a close callback
+            r = ERR_DISPATCHER_DONE;
+        }
+    }
+
+    if (nreplies > 0) {
+        zx_status_t s = zx_channel_write_many(h, 0, replies, nreplies);
+        if (s != ZX_OK) {
+            for (uint32_t i = 0; i < nreplies; i++) {
+                discard_handles(replies[i].handles, replies[i].num_handles);
+            }
+            if (r == ZX_OK) {
+                r = s;
+            }
+        }
+    }
+    return r;
+}
+
+zx_status_t zxrio_handler_many(zx_handle_t h, zxrio_cb_t cb, void* cookie) {
+    if (h == ZX_HANDLE_INVALID) {
+        return zxrio_handle_close(cb, cookie);
+    } else {
+        zxrio_msg_t msgs[ZXRIO_BATCH_MSGS];
+        return zxrio_handle_rpc_many(h, msgs, ZXRIO_BATCH_MSGS, cb, cookie);
+    }
+}
+
 zx_status_t zxrio_handle_close(zxrio_cb_t cb, void* cookie) {
     zxrio_msg_t msg;
 
@@ -197,6 +276,39 @@ zx_status_t zxrio_txn_handoff(zx_handle_t srv, zx_handle_t reply, zxrio_msg_t* m
     return r;
 }
 
+// Reads the reply to a pipelined open, if it is yet to be, and returns the
+// status it carried. The server sends it ahead of anything else on the
+// channel, so once any other reply has arrived (or the server has hung up)
+// this doesn't block.
+static zx_status_t zxrio_take_describe(zxrio_t* rio) {
+    if (!atomic_load(&rio->describe_pending) ||
+        !atomic_exchange(&rio->describe_pending, false)) {
+        return atomic_load(&rio->open_status);
+    }
+
+    zxrio_describe_t info;
+    uint32_t dsize = sizeof(info);
+    uint32_t actual_handles = 0;
+    zx_status_t r = zx_object_wait_one(rio->h, ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                                       ZX_TIME_INFINITE, NULL);
+    if (r == ZX_OK) {
+        r = zx_channel_read(rio->h, 0, &info, &info.handle, dsize, 1, &dsize, &actual_handles);
+    }
+    if (r == ZX_OK) {
+        if (actual_handles > 0) {
+            // Path-only connections have no use for an event.
+            zx_handle_close(info.handle);
+        }
+        if (dsize != sizeof(zxrio_describe_t) || info.op != ZXRIO_ON_OPEN) {
+            r = ZX_ERR_IO;
+        } else {
+            r = info.status;
+        }
+    }
+    atomic_store(&rio->open_status, r);
+    return r;
+}
+
 // on success, msg->hcount indicates number of valid handles in msg->handle
 // on error there are never any handles
 static zx_status_t zxrio_txn(zxrio_t* rio, zxrio_msg_t* msg) {
@@ -222,6 +334,18 @@ static zx_status_t zxrio_txn(zxrio_t* rio, zxrio_msg_t* msg) {
     args.rd_num_handles = FDIO_MAX_HANDLES;
 
     r = zx_channel_call(rio->h, 0, ZX_TIME_INFINITE, &args, &dsize, &msg->hcount, &rs);
+
+    // If the open this connection came from failed, that is what to report.
+    zx_status_t open_status = zxrio_take_describe(rio);
+    if (open_status != ZX_OK) {
+        if (r == ZX_ERR_CALL_FAILED) {
+            msg->hcount = 0;
+            return open_status;
+        }
+        r = open_status;
+        goto fail_discard_handles;
+    }
+
     if (r < 0) {
         if (r == ZX_ERR_CALL_FAILED) {
             // read phase failed, true status is in rs
@@ -392,12 +516,306 @@ static ssize_t write_common(uint32_t op, fdio_t* io, const void* _data, size_t l
     return count ? count : r;
 }
 
+// Write-behind state of a remote file.
+typedef struct zxrio_wb {
+    mtx_t lock;
+    uint32_t max_in_flight;
+
+    // the writes awaiting replies, oldest first, as a ring
+    uint32_t head;
+    uint32_t in_flight;
+    struct {
+        zx_txid_t txid;
+        uint32_t len;
+    } sent[FDIO_MAX_WRITE_BEHIND];
+
+    // the first error from a write which has already returned
+    zx_status_t error;
+} zxrio_wb_t;
+
+// Waits for the reply to the oldest write in flight, and records any error
+// it carries. Called with |wb->lock| held.
+static void zxrio_wb_reap(zxrio_t* rio, zxrio_wb_t* wb) {
+    zx_txid_t txid = wb->sent[wb->head].txid;
+    uint32_t len = wb->sent[wb->head].len;
+    wb->head = (wb->head + 1) % FDIO_MAX_WRITE_BEHIND;
+    wb->in_flight--;
+
+    zxrio_msg_t msg;
+    zx_signals_t pending;
+    zx_status_t r = zxrio_take_describe(rio);
+    if (r == ZX_OK) {
+        r = zx_object_wait_one(rio->h, ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                               ZX_TIME_INFINITE, &pending);
+    }
+    if (r == ZX_OK && !(pending & ZX_CHANNEL_READABLE)) {
+        r = ZX_ERR_PEER_CLOSED;
+    }
+    if (r == ZX_OK && (r = zxrio_read_msg(rio->h, &msg)) == ZX_OK) {
+        discard_handles(msg.handle, msg.hcount);
+        if ((msg.txid != txid) || (ZXRIO_OP(msg.op) != ZXRIO_STATUS)) {
+            r = ZX_ERR_IO;
+        } else if (msg.arg < 0) {
+            r = msg.arg;
+        } else if ((uint32_t)msg.arg != len) {
+            // A short write leaves a hole behind the writes which followed it.
+            r = ZX_ERR_IO;
+        }
+    }
+    if (r != ZX_OK && wb->error == ZX_OK) {
+        wb->error = r;
+    }
+}
+
+// Waits for every write in flight. Called with |wb->lock| held.
+static void zxrio_wb_drain(zxrio_t* rio, zxrio_wb_t* wb) {
+    while (wb->in_flight > 0) {
+        zxrio_wb_reap(rio, wb);
+    }
+}
+
+// Waits for every write in flight, and returns (and forgets) the error
+// which is yet to be reported, if any.
+static zx_status_t zxrio_wb_flush(zxrio_t* rio) {
+    zxrio_wb_t* wb = atomic_load(&rio->wb);
+    if (wb == NULL) {
+        return ZX_OK;
+    }
+    mtx_lock(&wb->lock);
+    zxrio_wb_drain(rio, wb);
+    zx_status_t r = wb->error;
+    wb->error = ZX_OK;
+    mtx_unlock(&wb->lock);
+    return r;
+}
+
+static void zxrio_wb_release(zxrio_t* rio) {
+    zxrio_wb_t* wb = atomic_exchange(&rio->wb, NULL);
+    if (wb != NULL) {
+        mtx_lock(&wb->lock);
+        zxrio_wb_drain(rio, wb);
+        mtx_unlock(&wb->lock);
+        mtx_destroy(&wb->lock);
+        free(wb);
+    }
+}
+
+static ssize_t write_behind(zxrio_t* rio, zxrio_wb_t* wb, uint32_t op, const uint8_t* data,
+                            size_t len, off_t offset) {
+    ssize_t count = 0;
+    zx_status_t r = ZX_OK;
+    zxrio_msg_t msg;
+    uint32_t xfer;
+
+    while (len > 0 && wb->error == ZX_OK) {
+        if (wb->in_flight == wb->max_in_flight) {
+            zxrio_wb_reap(rio, wb);
+            continue;
+        }
+        xfer = (len > FDIO_CHUNK_SIZE) ? FDIO_CHUNK_SIZE : len;
+
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.txid = atomic_fetch_add(&rio->txid, 1);
+        msg.op = op;
+        msg.datalen = xfer;
+        if (op == ZXRIO_WRITE_AT)
+            msg.arg2.off = offset;
+        memcpy(msg.data, data, xfer);
+
+        if ((r = zx_channel_write(rio->h, 0, &msg, ZXRIO_HDR_SZ + xfer, NULL, 0)) != ZX_OK) {
+            break;
+        }
+        uint32_t tail = (wb->head + wb->in_flight) % FDIO_MAX_WRITE_BEHIND;
+        wb->sent[tail].txid = msg.txid;
+        wb->sent[tail].len = xfer;
+        wb->in_flight++;
+
+        count += xfer;
+        data += xfer;
+        len -= xfer;
+        if (op == ZXRIO_WRITE_AT)
+            offset += xfer;
+    }
+    if (count > 0) {
+        // Anything which went wrong is left for the next call to report.
+        if (r != ZX_OK && wb->error == ZX_OK) {
+            wb->error = r;
+        }
+        return count;
+    }
+    if (r == ZX_OK) {
+        r = wb->error;
+        wb->error = ZX_OK;
+    }
+    return r;
+}
+
+// A buffer shared with a device's server, which reads and writes move their
+// data through instead of in the messages; see IOCTL_DEVICE_SET_IO_BUFFER.
+typedef struct zxrio_iobuf {
+    // guards the buffer, which holds one transfer at a time
+    mtx_t lock;
+    uint8_t* data;
+    size_t size;
+} zxrio_iobuf_t;
+
+#define ZXRIO_IOBUF_SIZE (16 * FDIO_CHUNK_SIZE)
+
+static void zxrio_iobuf_release(zxrio_t* rio) {
+    zxrio_iobuf_t* iob = atomic_exchange(&rio->iobuf, NULL);
+    if (iob != NULL) {
+        zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)iob->data, iob->size);
+        mtx_destroy(&iob->lock);
+        free(iob);
+    }
+}
+
+static zx_status_t zxrio_iobuf_attach(zxrio_t* rio, zxrio_iobuf_t** out) {
+    zxrio_iobuf_t* iob = calloc(1, sizeof(*iob));
+    if (iob == NULL) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    zx_handle_t vmo;
+    zx_status_t r;
+    if ((r = zx_vmo_create(ZXRIO_IOBUF_SIZE, 0, &vmo)) != ZX_OK) {
+        free(iob);
+        return r;
+    }
+    uintptr_t addr;
+    if ((r = zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, ZXRIO_IOBUF_SIZE,
+                         ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr)) != ZX_OK) {
+        zx_handle_close(vmo);
+        free(iob);
+        return r;
+    }
+    iob->data = (uint8_t*)addr;
+    iob->size = ZXRIO_IOBUF_SIZE;
+    mtx_init(&iob->lock, mtx_plain);
+
+    // The server takes the VMO whether or not it accepts it; the mapping
+    // keeps the pages alive on this side.
+    if ((r = zxrio_ioctl(&rio->io, IOCTL_DEVICE_SET_IO_BUFFER,
+                         &vmo, sizeof(vmo), NULL, 0)) < 0) {
+        zx_vmar_unmap(zx_vmar_root_self(), addr, ZXRIO_IOBUF_SIZE);
+        mtx_destroy(&iob->lock);
+        free(iob);
+        return r;
+    }
+
+    zxrio_iobuf_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&rio->iobuf, &expected, iob)) {
+        // Another thread got there first; the server refused this one.
+        zx_vmar_unmap(zx_vmar_root_self(), addr, ZXRIO_IOBUF_SIZE);
+        mtx_destroy(&iob->lock);
+        free(iob);
+        iob = expected;
+    }
+    *out = iob;
+    return ZX_OK;
+}
+
+// Returns the connection's I/O buffer, if the server accepted one. It is
+// offered the first time a transfer would take more than a single round trip,
+// and then carries transfers of every size.
+static zxrio_iobuf_t* zxrio_iobuf_get(zxrio_t* rio, size_t len) {
+    zxrio_iobuf_t* iob = atomic_load(&rio->iobuf);
+    if ((iob != NULL) || (len <= FDIO_CHUNK_SIZE) || atomic_load(&rio->iobuf_declined)) {
+        return iob;
+    }
+    if (zxrio_iobuf_attach(rio, &iob) != ZX_OK) {
+        atomic_store(&rio->iobuf_declined, true);
+        return NULL;
+    }
+    return iob;
+}
+
+// Like read_common() and write_common(), but with the data in |iob|.
+static ssize_t zxrio_iobuf_io(zxrio_t* rio, zxrio_iobuf_t* iob, uint32_t op,
+                              uint8_t* data, size_t len, off_t offset) {
+    bool is_read = (op == ZXRIO_READ) || (op == ZXRIO_READ_AT);
+    bool is_at = (op == ZXRIO_READ_AT) || (op == ZXRIO_WRITE_AT);
+    ssize_t count = 0;
+    zx_status_t r = 0;
+    zxrio_msg_t msg;
+
+    mtx_lock(&iob->lock);
+    while (len > 0) {
+        size_t xfer = (len > iob->size) ? iob->size : len;
+        if (!is_read) {
+            memcpy(iob->data, data, xfer);
+        }
+
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.op = op | ZXRIO_FLAG_IO_BUFFER;
+        msg.arg = xfer;
+        if (is_at)
+            msg.arg2.off = offset;
+
+        if ((r = zxrio_txn(rio, &msg)) < 0) {
+            break;
+        }
+        discard_handles(msg.handle, msg.hcount);
+
+        if ((size_t)r > xfer) {
+            r = ZX_ERR_IO;
+            break;
+        }
+        if (is_read) {
+            memcpy(data, iob->data, r);
+        }
+        count += r;
+        data += r;
+        len -= r;
+        if (is_at)
+            offset += r;
+
+        // stop at short read or write
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    mtx_unlock(&iob->lock);
+    return count ? count : r;
+}
+
+static ssize_t zxrio_write_wb(uint32_t op, fdio_t* io, const void* _data, size_t len,
+                              off_t offset) {
+    zxrio_t* rio = (zxrio_t*)io;
+    zxrio_wb_t* wb = atomic_load(&rio->wb);
+    if (wb == NULL) {
+        zxrio_iobuf_t* iob = zxrio_iobuf_get(rio, len);
+        ssize_t r;
+        if (iob != NULL) {
+            r = zxrio_iobuf_io(rio, iob, op, (uint8_t*)_data, len, offset);
+        } else {
+            r = write_common(op, io, _data, len, offset);
+        }
+        __fdio_attr_cache_invalidate();
+        return r;
+    }
+
+    mtx_lock(&wb->lock);
+    ssize_t r;
+    if (wb->error != ZX_OK) {
+        // An earlier write failed after returning; report it now.
+        r = wb->error;
+        wb->error = ZX_OK;
+    } else if (wb->max_in_flight == 0) {
+        r = write_common(op, io, _data, len, offset);
+    } else {
+        r = write_behind(rio, wb, op, _data, len, offset);
+    }
+    mtx_unlock(&wb->lock);
+    __fdio_attr_cache_invalidate();
+    return r;
+}
+
 static ssize_t zxrio_write(fdio_t* io, const void* _data, size_t len) {
-    return write_common(ZXRIO_WRITE, io, _data, len, 0);
+    return zxrio_write_wb(ZXRIO_WRITE, io, _data, len, 0);
 }
 
 static ssize_t zxrio_write_at(fdio_t* io, const void* _data, size_t len, off_t offset) {
-    return write_common(ZXRIO_WRITE_AT, io, _data, len, offset);
+    return zxrio_write_wb(ZXRIO_WRITE_AT, io, _data, len, offset);
 }
 
 static ssize_t read_common(uint32_t op, fdio_t* io, void* _data, size_t len, off_t offset) {
@@ -441,19 +859,178 @@ static ssize_t read_common(uint32_t op, fdio_t* io, void* _data, size_t len, off
     return count ? count : r;
 }
 
+// A file's contents, as a VMO offered by its server with FDIO_MMAP_FLAG_STABLE.
+// As in vmofile.c, reads are served from it with zx_vmo_read.
+typedef struct zxrio_vmo {
+    zx_handle_t vmo;
+    // where the file starts within |vmo|
+    zx_off_t off;
+    zx_off_t size;
+
+    // guards the seek pointer, which moves from the server to here
+    mtx_t lock;
+    zx_off_t ptr;
+} zxrio_vmo_t;
+
+static off_t zxrio_seek(fdio_t* io, off_t offset, int whence);
+
+static void zxrio_vmo_release(zxrio_t* rio) {
+    zxrio_vmo_t* vf = atomic_exchange(&rio->vmo, NULL);
+    if (vf != NULL) {
+        zx_handle_close(vf->vmo);
+        mtx_destroy(&vf->lock);
+        free(vf);
+    }
+}
+
+static zx_status_t zxrio_vmo_attach(zxrio_t* rio, zxrio_vmo_t** out) {
+    zxrio_mmap_data_t data;
+    data.offset = 0;
+    data.length = 0;
+    data.flags = FDIO_MMAP_FLAG_READ | FDIO_MMAP_FLAG_STABLE;
+    zx_status_t r = zxrio_misc(&rio->io, ZXRIO_MMAP, 0, sizeof(data), &data, sizeof(data));
+    if (r < 0) {
+        return r;
+    }
+    zx_handle_t vmo = r;
+
+    vnattr_t attr;
+    off_t ptr;
+    zxrio_vmo_t* vf;
+    if ((r = zxrio_misc(&rio->io, ZXRIO_STAT, 0, sizeof(attr), &attr, 0)) < 0) {
+        goto fail;
+    }
+    // Taken last, so that the server's pointer is current.
+    if ((ptr = zxrio_seek(&rio->io, 0, SEEK_CUR)) < 0) {
+        r = (zx_status_t)ptr;
+        goto fail;
+    }
+    if ((vf = calloc(1, sizeof(*vf))) == NULL) {
+        r = ZX_ERR_NO_MEMORY;
+        goto fail;
+    }
+    vf->vmo = vmo;
+    vf->off = data.offset;
+    vf->size = attr.size;
+    vf->ptr = ptr;
+    mtx_init(&vf->lock, mtx_plain);
+
+    zxrio_vmo_t* expected = NULL;
+    if (!atomic_compare_exchange_strong(&rio->vmo, &expected, vf)) {
+        // Another thread got there first.
+        zx_handle_close(vf->vmo);
+        mtx_destroy(&vf->lock);
+        free(vf);
+        vf = expected;
+    }
+    *out = vf;
+    return ZX_OK;
+
+fail:
+    zx_handle_close(vmo);
+    return r;
+}
+
+// Returns the file's stable VMO, if it has one. The server is asked for it the
+// first time a read would take more than a single round trip.
+static zxrio_vmo_t* zxrio_vmo_get(zxrio_t* rio, size_t len) {
+    zxrio_vmo_t* vf = atomic_load(&rio->vmo);
+    if ((vf != NULL) || (len <= FDIO_CHUNK_SIZE) || atomic_load(&rio->vmo_declined)) {
+        return vf;
+    }
+    if (zxrio_vmo_attach(rio, &vf) != ZX_OK) {
+        atomic_store(&rio->vmo_declined, true);
+        return NULL;
+    }
+    return vf;
+}
+
+static ssize_t zxrio_vmo_read_at(zxrio_vmo_t* vf, void* data, size_t len, zx_off_t at) {
+    if (at >= vf->size) {
+        return 0;
+    }
+    if (len > vf->size - at) {
+        len = vf->size - at;
+    }
+    zx_status_t status = zx_vmo_read(vf->vmo, data, vf->off + at, len, &len);
+    if (status < 0) {
+        return status;
+    }
+    return len;
+}
+
 static ssize_t zxrio_read(fdio_t* io, void* _data, size_t len) {
+    zxrio_vmo_t* vf = zxrio_vmo_get((zxrio_t*)io, len);
+    if (vf != NULL) {
+        mtx_lock(&vf->lock);
+        ssize_t r = zxrio_vmo_read_at(vf, _data, len, vf->ptr);
+        if (r > 0) {
+            vf->ptr += r;
+        }
+        mtx_unlock(&vf->lock);
+        return r;
+    }
+    zxrio_iobuf_t* iob = zxrio_iobuf_get((zxrio_t*)io, len);
+    if (iob != NULL) {
+        return zxrio_iobuf_io((zxrio_t*)io, iob, ZXRIO_READ, _data, len, 0);
+    }
     return read_common(ZXRIO_READ, io, _data, len, 0);
 }
 
 static ssize_t zxrio_read_at(fdio_t* io, void* _data, size_t len, off_t offset) {
+    zxrio_vmo_t* vf = zxrio_vmo_get((zxrio_t*)io, len);
+    if (vf != NULL) {
+        if (offset < 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        return zxrio_vmo_read_at(vf, _data, len, offset);
+    }
+    zxrio_iobuf_t* iob = zxrio_iobuf_get((zxrio_t*)io, len);
+    if (iob != NULL) {
+        return zxrio_iobuf_io((zxrio_t*)io, iob, ZXRIO_READ_AT, _data, len, offset);
+    }
     return read_common(ZXRIO_READ_AT, io, _data, len, offset);
 }
 
+// Moves the local seek pointer with the same checks as the server would make.
+static off_t zxrio_vmo_seek(zxrio_vmo_t* vf, off_t offset, int whence) {
+    mtx_lock(&vf->lock);
+    zx_off_t at;
+    switch (whence) {
+    case SEEK_SET:
+        at = 0;
+        break;
+    case SEEK_CUR:
+        at = vf->ptr;
+        break;
+    case SEEK_END:
+        at = vf->size;
+        break;
+    default:
+        mtx_unlock(&vf->lock);
+        return ZX_ERR_INVALID_ARGS;
+    }
+    zx_off_t n = at + offset;
+    if ((offset < 0) ? (n > at) : (n < at)) {
+        // wrapped around, or before the start
+        mtx_unlock(&vf->lock);
+        return ZX_ERR_INVALID_ARGS;
+    }
+    vf->ptr = n;
+    mtx_unlock(&vf->lock);
+    return n;
+}
+
 static off_t zxrio_seek(fdio_t* io, off_t offset, int whence) {
     zxrio_t* rio = (zxrio_t*)io;
     zxrio_msg_t msg;
     zx_status_t r;
 
+    zxrio_vmo_t* vf = atomic_load(&rio->vmo);
+    if (vf != NULL) {
+        return zxrio_vmo_seek(vf, offset, whence);
+    }
+
     memset(&msg, 0, ZXRIO_HDR_SZ);
     msg.op = ZXRIO_SEEK;
     msg.arg2.off = offset;
@@ -472,6 +1049,10 @@ zx_status_t zxrio_close(fdio_t* io) {
     zxrio_msg_t msg;
     zx_status_t r;
 
+    // The last chance to report a failed write.
+    zx_status_t wb_status = zxrio_wb_flush(rio);
+    zxrio_wb_release(rio);
+
     memset(&msg, 0, ZXRIO_HDR_SZ);
     msg.op = ZXRIO_CLOSE;
 
@@ -479,6 +1060,8 @@ zx_status_t zxrio_close(fdio_t* io) {
         discard_handles(msg.handle, msg.hcount);
     }
 
+    zxrio_vmo_release(rio);
+    zxrio_iobuf_release(rio);
     zx_handle_t h = rio->h;
     rio->h = 0;
     zx_handle_close(h);
@@ -488,7 +1071,7 @@ zx_status_t zxrio_close(fdio_t* io) {
         zx_handle_close(h);
     }
 
-    return r;
+    return (wb_status != ZX_OK) ? wb_status : r;
 }
 
 // Synchronously (non-pipelined) open an object
@@ -657,8 +1240,24 @@ zx_status_t zxrio_misc(fdio_t* io, uint32_t op, int64_t off,
         msg.hcount = 1;
     }
 
-    if ((r = zxrio_txn(rio, &msg)) < 0) {
-        return r;
+    // fsync reports writes which failed after returning, having synced the rest.
+    zx_status_t wb_status = (op == ZXRIO_SYNC) ? zxrio_wb_flush(rio) : ZX_OK;
+
+    r = zxrio_txn(rio, &msg);
+    switch (op) {
+    case ZXRIO_TRUNCATE:
+    case ZXRIO_RENAME:
+    case ZXRIO_LINK:
+    case ZXRIO_UNLINK:
+    case ZXRIO_SETATTR:
+        __fdio_attr_cache_invalidate();
+    }
+    if (r < 0) {
+        return (wb_status != ZX_OK) ? wb_status : r;
+    }
+    if (wb_status != ZX_OK) {
+        discard_handles(msg.handle, msg.hcount);
+        return wb_status;
     }
 
     switch (op) {
@@ -845,6 +1444,9 @@ zx_status_t zxrio_getobject(zx_handle_t rio_h, uint32_t op, const char* name,
     if (len >= PATH_MAX) {
         return ZX_ERR_BAD_PATH;
     }
+    if (flags & (ZX_FS_FLAG_CREATE | ZX_FS_FLAG_TRUNCATE)) {
+        __fdio_attr_cache_invalidate();
+    }
 
     if (flags & ZX_FS_FLAG_DESCRIBE) {
         zxrio_msg_t msg;
@@ -874,8 +1476,50 @@ zx_status_t zxrio_getobject(zx_handle_t rio_h, uint32_t op, const char* name,
     }
 }
 
+// Sends an open which asks to be described, and returns a remoteio object
+// for the new connection without waiting for the reply.
+static zx_status_t zxrio_open_lazy(zx_handle_t h, const char* path, uint32_t flags,
+                                   uint32_t mode, fdio_t** out) {
+    size_t len = strlen(path);
+    if (len >= PATH_MAX) {
+        return ZX_ERR_BAD_PATH;
+    }
+
+    zxrio_msg_t msg;
+    memset(&msg, 0, ZXRIO_HDR_SZ);
+    msg.op = ZXRIO_OPEN;
+    msg.datalen = len;
+    msg.arg = flags;
+    msg.arg2.mode = mode;
+    memcpy(msg.data, path, len);
+
+    zx_handle_t cnxn;
+    zx_status_t r;
+    if ((r = zx_channel_create(0, &cnxn, &msg.handle[0])) < 0) {
+        return r;
+    }
+    msg.hcount = 1;
+    if ((r = zx_channel_write(h, 0, &msg, ZXRIO_HDR_SZ + msg.datalen,
+                              msg.handle, msg.hcount)) < 0) {
+        zx_handle_close(msg.handle[0]);
+        zx_handle_close(cnxn);
+        return r;
+    }
+
+    fdio_t* io = fdio_remote_create(cnxn, ZX_HANDLE_INVALID);
+    if (io == NULL) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+    atomic_store(&((zxrio_t*)io)->describe_pending, true);
+    *out = io;
+    return ZX_OK;
+}
+
 zx_status_t zxrio_open_handle(zx_handle_t h, const char* path, uint32_t flags,
                               uint32_t mode, fdio_t** out) {
+    if (flags & FDIO_FLAG_LAZY_DESCRIBE) {
+        return zxrio_open_lazy(h, path, flags & ~FDIO_FLAG_LAZY_DESCRIBE, mode, out);
+    }
     zx_handle_t control_channel;
     zxrio_describe_t info;
     zx_status_t r = zxrio_getobject(h, ZXRIO_OPEN, path, flags, mode, &info, &control_channel);
@@ -891,6 +1535,8 @@ zx_status_t zxrio_open_handle(zx_handle_t h, const char* path, uint32_t flags,
 
 zx_status_t zxrio_open_handle_raw(zx_handle_t h, const char* path, uint32_t flags,
                                   uint32_t mode, zx_handle_t *out) {
+    // The caller wants the bare channel, with nothing left to read on it.
+    flags &= ~FDIO_FLAG_LAZY_DESCRIBE;
     zx_handle_t control_channel;
     zxrio_describe_t info;
     zx_status_t r = zxrio_getobject(h, ZXRIO_OPEN, path, flags, mode, &info, &control_channel);
@@ -942,6 +1588,8 @@ zx_status_t __zxrio_clone(zx_handle_t h, zx_handle_t* handles, uint32_t* types)
 static zx_status_t zxrio_unwrap(fdio_t* io, zx_handle_t* handles, uint32_t* types) {
     zxrio_t* rio = (void*)io;
     zx_status_t r;
+    // Whoever takes the channel won't expect the reply to its open on it.
+    zxrio_take_describe(rio);
     handles[0] = rio->h;
     types[0] = PA_FDIO_REMOTE;
     if (rio->h2 != 0) {
@@ -951,6 +1599,9 @@ static zx_status_t zxrio_unwrap(fdio_t* io, zx_handle_t* handles, uint32_t* type
     } else {
         r = 1;
     }
+    zxrio_vmo_release(rio);
+    zxrio_iobuf_release(rio);
+    zxrio_wb_release(rio);
     free(io);
     return r;
 }
@@ -978,6 +1629,30 @@ static void zxrio_wait_end(fdio_t* io, zx_signals_t signals, uint32_t* _events)
     *_events = ((signals >> POLL_SHIFT) & POLL_MASK) | events;
 }
 
+// Asks the server for a copy-on-write clone of the file, so that its contents
+// reach the caller without being read through the channel.
+static zx_status_t zxrio_get_vmo(fdio_t* io, zx_handle_t* out, size_t* off, size_t* len) {
+    zxrio_mmap_data_t data;
+    data.offset = 0;
+    data.length = 0;
+    data.flags = FDIO_MMAP_FLAG_READ | FDIO_MMAP_FLAG_EXEC | FDIO_MMAP_FLAG_PRIVATE;
+    zx_status_t r = zxrio_misc(io, ZXRIO_MMAP, 0, sizeof(data), &data, sizeof(data));
+    if (r < 0) {
+        return r;
+    }
+    zx_handle_t vmo = r;
+
+    vnattr_t attr;
+    if ((r = zxrio_misc(io, ZXRIO_STAT, 0, sizeof(attr), &attr, 0)) < 0) {
+        zx_handle_close(vmo);
+        return r;
+    }
+    *out = vmo;
+    *off = data.offset;
+    *len = attr.size;
+    return ZX_OK;
+}
+
 static fdio_ops_t zx_remote_ops = {
     .read = zxrio_read,
     .read_at = zxrio_read_at,
@@ -998,7 +1673,7 @@ static fdio_ops_t zx_remote_ops = {
     .unwrap = zxrio_unwrap,
     .shutdown = fdio_default_shutdown,
     .posix_ioctl = fdio_default_posix_ioctl,
-    .get_vmo = fdio_default_get_vmo,
+    .get_vmo = zxrio_get_vmo,
 };
 
 fdio_t* fdio_remote_create(zx_handle_t h, zx_handle_t e) {
@@ -1014,5 +1689,50 @@ fdio_t* fdio_remote_create(zx_handle_t h, zx_handle_t e) {
     rio->h = h;
     rio->h2 = e;
     atomic_init(&rio->txid, 1);
+    atomic_init(&rio->vmo, NULL);
+    atomic_init(&rio->vmo_declined, false);
+    atomic_init(&rio->iobuf, NULL);
+    atomic_init(&rio->iobuf_declined, false);
+    atomic_init(&rio->wb, NULL);
+    atomic_init(&rio->describe_pending, false);
+    atomic_init(&rio->open_status, ZX_OK);
     return &rio->io;
 }
+
+zx_status_t fdio_set_write_behind(int fd, uint32_t max_in_flight) {
+    if (max_in_flight > FDIO_MAX_WRITE_BEHIND) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    fdio_t* io = fd_to_io(fd);
+    if (io == NULL) {
+        return ZX_ERR_BAD_HANDLE;
+    }
+    if (io->ops != &zx_remote_ops) {
+        fdio_release(io);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    zxrio_t* rio = (zxrio_t*)io;
+    zxrio_wb_t* wb = atomic_load(&rio->wb);
+    if (wb == NULL) {
+        if ((wb = calloc(1, sizeof(*wb))) == NULL) {
+            fdio_release(io);
+            return ZX_ERR_NO_MEMORY;
+        }
+        mtx_init(&wb->lock, mtx_plain);
+        zxrio_wb_t* expected = NULL;
+        if (!atomic_compare_exchange_strong(&rio->wb, &expected, wb)) {
+            mtx_destroy(&wb->lock);
+            free(wb);
+            wb = expected;
+        }
+    }
+
+    // Any error from the writes in flight stays pending.
+    mtx_lock(&wb->lock);
+    zxrio_wb_drain(rio, wb);
+    wb->max_in_flight = max_in_flight;
+    mtx_unlock(&wb->lock);
+    fdio_release(io);
+    return ZX_OK;
+}
@@ -20,7 +20,7 @@
 #include "private-remoteio.h"
 
 
-static ssize_t zxsio_read_stream(fdio_t* io, void* data, size_t len) {
+static ssize_t zxsio_readv_stream(fdio_t* io, const zx_iovec_t* vec, size_t count) {
     zxrio_t* rio = (zxrio_t*)io;
     int nonblock = rio->io.flags & FDIO_FLAG_NONBLOCK;
 
@@ -28,14 +28,8 @@ static ssize_t zxsio_read_stream(fdio_t* io, void* data, size_t len) {
     for (;;) {
         ssize_t r;
         size_t bytes_read;
-        if ((r = zx_socket_read(rio->h2, 0, data, len, &bytes_read)) == ZX_OK) {
-            // zx_socket_read() sets *actual to the number of bytes in the buffer when data is NULL
-            // and len is 0. read() should return 0 in that case.
-            if (len == 0) {
-                return 0;
-            } else {
-                return (ssize_t)bytes_read;
-            }
+        if ((r = zx_socket_readv(rio->h2, 0, vec, count, &bytes_read)) == ZX_OK) {
+            return (ssize_t)bytes_read;
         }
         if (r == ZX_ERR_PEER_CLOSED || r == ZX_ERR_BAD_STATE) {
             return 0;
@@ -60,6 +54,14 @@ static ssize_t zxsio_read_stream(fdio_t* io, void* data, size_t len) {
     }
 }
 
+static ssize_t zxsio_read_stream(fdio_t* io, void* data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    zx_iovec_t vec = { data, len };
+    return zxsio_readv_stream(io, &vec, 1);
+}
+
 static ssize_t zxsio_recvfrom(fdio_t* io, void* data, size_t len, int flags, struct sockaddr* restrict addr, socklen_t* restrict addrlen) {
     struct iovec iov;
     iov.iov_base = data;
@@ -82,14 +84,15 @@ static ssize_t zxsio_recvfrom(fdio_t* io, void* data, size_t len, int flags, str
     return r;
 }
 
-static ssize_t zxsio_write_stream(fdio_t* io, const void* data, size_t len) {
+static ssize_t zxsio_writev_stream(fdio_t* io, const zx_iovec_t* vec, size_t count) {
     zxrio_t* rio = (zxrio_t*)io;
     int nonblock = rio->io.flags & FDIO_FLAG_NONBLOCK;
 
     // TODO: let the generic write() to do this loop
     for (;;) {
         ssize_t r;
-        if ((r = zx_socket_write(rio->h2, 0, data, len, &len)) == ZX_OK) {
+        size_t len;
+        if ((r = zx_socket_writev(rio->h2, 0, vec, count, &len)) == ZX_OK) {
             return (ssize_t) len;
         }
         if (r == ZX_ERR_SHOULD_WAIT && !nonblock) {
@@ -113,6 +116,11 @@ static ssize_t zxsio_write_stream(fdio_t* io, const void* data, size_t len) {
     }
 }
 
+static ssize_t zxsio_write_stream(fdio_t* io, const void* data, size_t len) {
+    zx_iovec_t vec = { (void*)data, len };
+    return zxsio_writev_stream(io, &vec, 1);
+}
+
 static ssize_t zxsio_sendto(fdio_t* io, const void* data, size_t len, int flags, const struct sockaddr* addr, socklen_t addrlen) {
     struct iovec iov;
     iov.iov_base = (void*)data;
@@ -142,14 +150,25 @@ static ssize_t zxsio_recvmsg_stream(fdio_t* io, struct msghdr* msg, int flags) {
     // we ignore msg_name and msg_namelen members.
     // (this is a consistent behavior with other OS implementations for TCP protocol)
     ssize_t total = 0;
-    for (int i = 0; i < msg->msg_iovlen; i++) {
-        struct iovec *iov = &msg->msg_iov[i];
-        ssize_t n = zxsio_read_stream(io, iov->iov_base, iov->iov_len);
+    for (int i = 0; i < msg->msg_iovlen;) {
+        // Read straight into as many of the buffers as one syscall takes.
+        zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+        size_t count = 0;
+        size_t len = 0;
+        for (; i < msg->msg_iovlen && count < ZX_SOCKET_MAX_IOVECS; i++, count++) {
+            vec[count].buffer = msg->msg_iov[i].iov_base;
+            vec[count].size = msg->msg_iov[i].iov_len;
+            len += vec[count].size;
+        }
+        if (len == 0) {
+            continue;
+        }
+        ssize_t n = zxsio_readv_stream(io, vec, count);
         if (n < 0) {
             return n;
         }
         total += n;
-        if ((size_t)n != iov->iov_len) {
+        if ((size_t)n != len) {
             break;
         }
     }
@@ -170,18 +189,29 @@ static ssize_t zxsio_sendmsg_stream(fdio_t* io, const struct msghdr* msg, int fl
     } else {
         return ZX_ERR_BAD_STATE;
     }
-    ssize_t total = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
-        struct iovec *iov = &msg->msg_iov[i];
-        if (iov->iov_len <= 0) {
+        if (msg->msg_iov[i].iov_len <= 0) {
             return ZX_ERR_INVALID_ARGS;
         }
-        ssize_t n = zxsio_write_stream(io, iov->iov_base, iov->iov_len);
+    }
+    ssize_t total = 0;
+    for (int i = 0; i < msg->msg_iovlen;) {
+        // Write as many of the buffers as one syscall takes, rather than
+        // one syscall per buffer.
+        zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+        size_t count = 0;
+        size_t len = 0;
+        for (; i < msg->msg_iovlen && count < ZX_SOCKET_MAX_IOVECS; i++, count++) {
+            vec[count].buffer = msg->msg_iov[i].iov_base;
+            vec[count].size = msg->msg_iov[i].iov_len;
+            len += vec[count].size;
+        }
+        ssize_t n = zxsio_writev_stream(io, vec, count);
         if (n < 0) {
             return n;
         }
         total += n;
-        if ((size_t)n != iov->iov_len) {
+        if ((size_t)n != len) {
             break;
         }
     }
@@ -328,15 +358,6 @@ static ssize_t zxsio_posix_ioctl_stream(fdio_t* io, int req, va_list va) {
     }
 }
 
-static ssize_t zxsio_rx_dgram(fdio_t* io, void* buf, size_t buflen) {
-    return zxsio_read_stream(io, buf, buflen);
-}
-
-static ssize_t zxsio_tx_dgram(fdio_t* io, const void* buf, size_t buflen) {
-    zx_status_t r = zxsio_write_stream(io, buf, buflen);
-    return (r < 0) ? r : ZX_OK;
-}
-
 static ssize_t zxsio_recvmsg_dgram(fdio_t* io, struct msghdr* msg, int flags);
 static ssize_t zxsio_sendmsg_dgram(fdio_t* io, const struct msghdr* msg, int flags);
 
@@ -379,36 +400,59 @@ static ssize_t zxsio_recvmsg_dgram(fdio_t* io, struct msghdr* msg, int flags) {
         // TODO: support MSG_OOB
         return ZX_ERR_NOT_SUPPORTED;
     }
-    // Read 1 extra byte to detect if the buffer is too small to fit the whole
-    // packet, so we can set MSG_TRUNC flag if necessary.
-    size_t mlen = FDIO_SOCKET_MSG_HEADER_SIZE + 1;
     for (int i = 0; i < msg->msg_iovlen; i++) {
-        struct iovec *iov = &msg->msg_iov[i];
-        if (iov->iov_len <= 0) {
+        if (msg->msg_iov[i].iov_len <= 0) {
             return ZX_ERR_INVALID_ARGS;
         }
-        mlen += iov->iov_len;
     }
 
-    // TODO: avoid malloc
-    fdio_socket_msg_t* m = malloc(mlen);
-    ssize_t n = zxsio_rx_dgram(io, m, mlen);
+    // The header and the leading buffers are read into directly. Any
+    // buffers past what one read takes, and 1 extra byte to detect if the
+    // buffers are too small to fit the whole packet (so we can set
+    // MSG_TRUNC), go through a tail buffer.
+    fdio_socket_msg_t m;
+    zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+    size_t count = 0;
+    vec[count].buffer = &m;
+    vec[count++].size = FDIO_SOCKET_MSG_HEADER_SIZE;
+    int direct = msg->msg_iovlen;
+    if (direct > (int)ZX_SOCKET_MAX_IOVECS - 2) {
+        direct = ZX_SOCKET_MAX_IOVECS - 2;
+    }
+    size_t tail_len = 1;
+    for (int i = 0; i < msg->msg_iovlen; i++) {
+        if (i < direct) {
+            vec[count].buffer = msg->msg_iov[i].iov_base;
+            vec[count++].size = msg->msg_iov[i].iov_len;
+        } else {
+            tail_len += msg->msg_iov[i].iov_len;
+        }
+    }
+    char extra;
+    char* tail = (tail_len == 1) ? &extra : malloc(tail_len);
+    if (tail == NULL) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    vec[count].buffer = tail;
+    vec[count++].size = tail_len;
+
+    ssize_t n = zxsio_readv_stream(io, vec, count);
+    if (n >= 0 && (size_t)n < FDIO_SOCKET_MSG_HEADER_SIZE) {
+        n = ZX_ERR_INTERNAL;
+    }
     if (n < 0) {
-        free(m);
+        if (tail != &extra)
+            free(tail);
         return n;
     }
-    if ((size_t)n < FDIO_SOCKET_MSG_HEADER_SIZE) {
-        free(m);
-        return ZX_ERR_INTERNAL;
-    }
     n -= FDIO_SOCKET_MSG_HEADER_SIZE;
     if (msg->msg_name != NULL) {
-        int bytes_to_copy = (msg->msg_namelen < m->addrlen) ? msg->msg_namelen : m->addrlen;
-        memcpy(msg->msg_name, &m->addr, bytes_to_copy);
+        int bytes_to_copy = (msg->msg_namelen < m.addrlen) ? msg->msg_namelen : m.addrlen;
+        memcpy(msg->msg_name, &m.addr, bytes_to_copy);
     }
-    msg->msg_namelen = m->addrlen;
-    msg->msg_flags = m->flags;
-    char* data = m->data;
+    msg->msg_namelen = m.addrlen;
+    msg->msg_flags = m.flags;
+    char* data = tail;
     size_t resid = n;
     for (int i = 0; i < msg->msg_iovlen; i++) {
         struct iovec *iov = &msg->msg_iov[i];
@@ -417,8 +461,10 @@ static ssize_t zxsio_recvmsg_dgram(fdio_t* io, struct msghdr* msg, int flags) {
         } else {
             if (resid < iov->iov_len)
                 iov->iov_len = resid;
-            memcpy(iov->iov_base, data, iov->iov_len);
-            data += iov->iov_len;
+            if (i >= direct) {
+                memcpy(iov->iov_base, data, iov->iov_len);
+                data += iov->iov_len;
+            }
             resid -= iov->iov_len;
         }
     }
@@ -428,7 +474,8 @@ static ssize_t zxsio_recvmsg_dgram(fdio_t* io, struct msghdr* msg, int flags) {
         n -= resid;
     }
 
-    free(m);
+    if (tail != &extra)
+        free(tail);
     return n;
 }
 
@@ -444,6 +491,10 @@ static ssize_t zxsio_sendmsg_dgram(fdio_t* io, const struct msghdr* msg, int fla
             return ZX_ERR_ALREADY_EXISTS;
         }
     }
+    fdio_socket_msg_t m;
+    if (msg->msg_namelen > sizeof(m.addr)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
     ssize_t n = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
         struct iovec *iov = &msg->msg_iov[i];
@@ -452,24 +503,48 @@ static ssize_t zxsio_sendmsg_dgram(fdio_t* io, const struct msghdr* msg, int fla
         }
         n += iov->iov_len;
     }
-    size_t mlen = n + FDIO_SOCKET_MSG_HEADER_SIZE;
 
-    // TODO: avoid malloc m
-    fdio_socket_msg_t* m = malloc(mlen);
     if (msg->msg_name != NULL) {
-        memcpy(&m->addr, msg->msg_name, msg->msg_namelen);
-    }
-    m->addrlen = msg->msg_namelen;
-    m->flags = flags;
-    char* data = m->data;
+        memcpy(&m.addr, msg->msg_name, msg->msg_namelen);
+    }
+    m.addrlen = msg->msg_namelen;
+    m.flags = flags;
+
+    // The socket gathers the header and the buffers into one packet. Only
+    // buffers past what one write takes are copied together first.
+    zx_iovec_t vec[ZX_SOCKET_MAX_IOVECS];
+    size_t count = 0;
+    vec[count].buffer = &m;
+    vec[count++].size = FDIO_SOCKET_MSG_HEADER_SIZE;
+    int direct = msg->msg_iovlen;
+    if (direct > (int)ZX_SOCKET_MAX_IOVECS - 1) {
+        direct = ZX_SOCKET_MAX_IOVECS - 2;
+    }
+    size_t tail_len = 0;
     for (int i = 0; i < msg->msg_iovlen; i++) {
-        struct iovec *iov = &msg->msg_iov[i];
-        memcpy(data, iov->iov_base, iov->iov_len);
-        data += iov->iov_len;
+        if (i < direct) {
+            vec[count].buffer = msg->msg_iov[i].iov_base;
+            vec[count++].size = msg->msg_iov[i].iov_len;
+        } else {
+            tail_len += msg->msg_iov[i].iov_len;
+        }
+    }
+    char* tail = NULL;
+    if (tail_len > 0) {
+        if ((tail = malloc(tail_len)) == NULL) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        char* data = tail;
+        for (int i = direct; i < msg->msg_iovlen; i++) {
+            memcpy(data, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+            data += msg->msg_iov[i].iov_len;
+        }
+        vec[count].buffer = tail;
+        vec[count++].size = tail_len;
     }
-    ssize_t r = zxsio_tx_dgram(io, m, mlen);
-    free(m);
-    return r == ZX_OK ? n : r;
+    ssize_t r = zxsio_writev_stream(io, vec, count);
+    free(tail);
+    return r < 0 ? r : n;
 }
 
 static void zxsio_wait_begin_dgram(fdio_t* io, uint32_t events, zx_handle_t* handle, zx_signals_t* _signals) {
@@ -11,6 +11,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userlib
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/attr-cache.c \
     $(LOCAL_DIR)/bootfs.c \
     $(LOCAL_DIR)/dispatcher.c \
     $(LOCAL_DIR)/get-vmo.c \
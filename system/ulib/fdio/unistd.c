@@ -199,6 +199,10 @@ static uint32_t fdio_flags_to_zxio(uint32_t flags) {
 
     if (!(flags & O_PIPELINE)) {
         result |= ZX_FS_FLAG_DESCRIBE;
+    } else if (flags & O_PATH) {
+        // A path-only connection always speaks remoteio, so the describe
+        // reply can be left for the first operation rather than dropped.
+        result |= ZX_FS_FLAG_DESCRIBE | FDIO_FLAG_LAZY_DESCRIBE;
     }
 
     result |= (flags & ZXIO_FS_MASK);
@@ -775,26 +779,38 @@ zx_status_t fdio_wait_fd(int fd, uint32_t events, uint32_t* _pending, zx_time_t
     return status;
 }
 
-int fdio_stat(fdio_t* io, struct stat* s) {
-    vnattr_t attr;
-    int r = io->ops->misc(io, ZXRIO_STAT, 0, sizeof(attr), &attr, 0);
+static void vnattr_to_stat(const vnattr_t* attr, struct stat* s) {
+    memset(s, 0, sizeof(struct stat));
+    s->st_mode = attr->mode;
+    s->st_ino = attr->inode;
+    s->st_size = attr->size;
+    s->st_blksize = attr->blksize;
+    s->st_blocks = attr->blkcount;
+    s->st_nlink = attr->nlink;
+    s->st_ctim.tv_sec = attr->create_time / ZX_SEC(1);
+    s->st_ctim.tv_nsec = attr->create_time % ZX_SEC(1);
+    s->st_mtim.tv_sec = attr->modify_time / ZX_SEC(1);
+    s->st_mtim.tv_nsec = attr->modify_time % ZX_SEC(1);
+}
+
+static zx_status_t fdio_getattr(fdio_t* io, vnattr_t* attr) {
+    int r = io->ops->misc(io, ZXRIO_STAT, 0, sizeof(*attr), attr, 0);
     if (r < 0) {
-        return ZX_ERR_BAD_HANDLE;
+        return r;
     }
-    if (r < (int)sizeof(attr)) {
+    if (r < (int)sizeof(*attr)) {
         return ZX_ERR_IO;
     }
-    memset(s, 0, sizeof(struct stat));
-    s->st_mode = attr.mode;
-    s->st_ino = attr.inode;
-    s->st_size = attr.size;
-    s->st_blksize = attr.blksize;
-    s->st_blocks = attr.blkcount;
-    s->st_nlink = attr.nlink;
-    s->st_ctim.tv_sec = attr.create_time / ZX_SEC(1);
-    s->st_ctim.tv_nsec = attr.create_time % ZX_SEC(1);
-    s->st_mtim.tv_sec = attr.modify_time / ZX_SEC(1);
-    s->st_mtim.tv_nsec = attr.modify_time % ZX_SEC(1);
+    return ZX_OK;
+}
+
+int fdio_stat(fdio_t* io, struct stat* s) {
+    vnattr_t attr;
+    zx_status_t r = fdio_getattr(io, &attr);
+    if (r != ZX_OK) {
+        return (r == ZX_ERR_IO) ? r : ZX_ERR_BAD_HANDLE;
+    }
+    vnattr_to_stat(&attr, s);
     return 0;
 }
 
@@ -1254,14 +1270,25 @@ off_t lseek(int fd, off_t offset, int whence) {
     return r;
 }
 
-static int getdirents(int fd, void* ptr, size_t len, long cmd) {
+// Reads vdirent_attr_t entries if |*attrs| is set and the filesystem can,
+// clearing it if it can't, and vdirent_t entries otherwise.
+static int getdirents(int fd, void* ptr, size_t len, long cmd, bool* attrs) {
     fdio_t* io = fd_to_io(fd);
     if (io == NULL) {
         return ERRNO(EBADF);
     }
-    int r = STATUS(io->ops->misc(io, ZXRIO_READDIR, cmd, len, ptr, 0));
+    zx_status_t r = ZX_ERR_NOT_SUPPORTED;
+    if (*attrs) {
+        r = io->ops->misc(io, ZXRIO_READDIR_ATTR, cmd, len, ptr, 0);
+        if (r == ZX_ERR_NOT_SUPPORTED) {
+            *attrs = false;
+        }
+    }
+    if (!*attrs) {
+        r = io->ops->misc(io, ZXRIO_READDIR, cmd, len, ptr, 0);
+    }
     fdio_release(io);
-    return r;
+    return STATUS(r);
 }
 
 static int truncateat(int dirfd, const char* path, off_t len) {
@@ -1466,14 +1493,36 @@ int fstat(int fd, struct stat* s) {
 int fstatat(int dirfd, const char* fn, struct stat* s, int flags) {
     fdio_t* io;
     zx_status_t r;
+    vnattr_t attr;
+    char key[PATH_MAX];
 
-    if ((r = __fdio_open_at(&io, dirfd, fn, O_PATH, 0)) < 0) {
+    bool cached = (dirfd == AT_FDCWD) && __fdio_attr_cache_key(fn, key);
+    if (cached && __fdio_attr_cache_get(key, &attr, &r)) {
+        if (r != ZX_OK) {
+            return ERROR(r);
+        }
+        vnattr_to_stat(&attr, s);
+        return 0;
+    }
+    uint64_t gen = cached ? __fdio_attr_cache_gen() : 0;
+
+    // Pipelined, so that a failure to open is only seen by the stat.
+    if ((r = __fdio_open_at(&io, dirfd, fn, O_PATH | O_PIPELINE, 0)) == ZX_OK) {
+        r = fdio_getattr(io, &attr);
+        fdio_close(io);
+        fdio_release(io);
+    }
+    if (r != ZX_OK) {
+        if (cached && r == ZX_ERR_NOT_FOUND) {
+            __fdio_attr_cache_put(key, gen, r, NULL);
+        }
         return ERROR(r);
     }
-    r = fdio_stat(io, s);
-    fdio_close(io);
-    fdio_release(io);
-    return STATUS(r);
+    if (cached) {
+        __fdio_attr_cache_put(key, gen, ZX_OK, &attr);
+    }
+    vnattr_to_stat(&attr, s);
+    return 0;
 }
 
 int stat(const char* fn, struct stat* s) {
@@ -1710,6 +1759,13 @@ struct __dirstream {
     uint8_t data[DIR_BUFSIZE];
     // Buffer returned to user
     struct dirent de;
+    // Whether to read vdirent_attr_t rather than vdirent_t entries, and
+    // whether |data| holds them; see fdio_dir_read_attrs()
+    bool want_attrs;
+    bool attrs;
+    // The attributes of |de|, if |de_has_attr|
+    bool de_has_attr;
+    vnattr_t de_attr;
 };
 
 static DIR* internal_opendir(int fd) {
@@ -1757,17 +1813,25 @@ struct dirent* readdir(DIR* dir) {
     mtx_lock(&dir->lock);
     struct dirent* de = &dir->de;
     for (;;) {
-        if (dir->size >= sizeof(vdirent_t)) {
+        size_t hdr = dir->attrs ? sizeof(vdirent_attr_t) : sizeof(vdirent_t);
+        if (dir->size >= hdr) {
             vdirent_t* vde = (void*)dir->ptr;
             if (dir->size >= vde->size) {
                 dir->ptr += vde->size;
                 dir->size -= vde->size;
-                if (vde->name[0]) {
+                const char* name = vde->name;
+                if (dir->attrs) {
+                    vdirent_attr_t* vade = (void*)vde;
+                    dir->de_attr = vade->attr;
+                    name = vade->name;
+                }
+                if (name[0]) {
                     de->d_ino = 0;
                     de->d_off = 0;
                     de->d_reclen = 0;
                     de->d_type = vde->type;
-                    strcpy(de->d_name, vde->name);
+                    strcpy(de->d_name, name);
+                    dir->de_has_attr = dir->attrs;
                     break;
                 } else {
                     // skip nameless entries.
@@ -1778,19 +1842,40 @@ struct dirent* readdir(DIR* dir) {
             dir->size = 0;
         }
         int64_t cmd = (dir->ptr == NULL) ? READDIR_CMD_RESET : READDIR_CMD_NONE;
-        int r = getdirents(dir->fd, dir->data, DIR_BUFSIZE, cmd);
+        int r = getdirents(dir->fd, dir->data, DIR_BUFSIZE, cmd, &dir->want_attrs);
         if (r > 0) {
             dir->ptr = dir->data;
             dir->size = r;
+            dir->attrs = dir->want_attrs;
             continue;
         }
         de = NULL;
         break;
     }
+    if (de == NULL) {
+        dir->de_has_attr = false;
+    }
     mtx_unlock(&dir->lock);
     return de;
 }
 
+void fdio_dir_read_attrs(DIR* dir) {
+    mtx_lock(&dir->lock);
+    dir->want_attrs = true;
+    mtx_unlock(&dir->lock);
+}
+
+int fdio_dirent_stat(DIR* dir, const struct dirent* de, struct stat* s) {
+    mtx_lock(&dir->lock);
+    if ((de == &dir->de) && dir->de_has_attr) {
+        vnattr_to_stat(&dir->de_attr, s);
+        mtx_unlock(&dir->lock);
+        return 0;
+    }
+    mtx_unlock(&dir->lock);
+    return fstatat(dir->fd, de->d_name, s, 0);
+}
+
 void rewinddir(DIR* dir) {
     mtx_lock(&dir->lock);
     dir->size = 0;
@@ -1861,6 +1946,151 @@ void __fdio_release(fdio_t* io) {
 }
 
 
+// poll() and select() wait through a wait set that each thread keeps
+// between calls. Entry |i| of the set uses cookie |i| and is only registered
+// again when the handle or signals at that position change, so a loop
+// polling the same descriptors pays for registration once and each wait
+// costs only as much as the number of ready descriptors.
+typedef struct poll_waitset {
+    zx_handle_t handle;
+    size_t count;
+    size_t capacity;
+    zx_wait_item_t* items;
+} poll_waitset_t;
+
+static tss_t poll_waitset_key;
+static once_flag poll_waitset_once = ONCE_FLAG_INIT;
+
+static void poll_waitset_free(void* arg) {
+    poll_waitset_t* ws = arg;
+    zx_handle_close(ws->handle);
+    free(ws->items);
+    free(ws);
+}
+
+static void poll_waitset_key_init(void) {
+    tss_create(&poll_waitset_key, poll_waitset_free);
+}
+
+static poll_waitset_t* poll_waitset_get(void) {
+    call_once(&poll_waitset_once, poll_waitset_key_init);
+    poll_waitset_t* ws = tss_get(poll_waitset_key);
+    if (ws != NULL) {
+        return ws;
+    }
+    if ((ws = calloc(1, sizeof(*ws))) == NULL) {
+        return NULL;
+    }
+    if (zx_waitset_create(0, &ws->handle) != ZX_OK) {
+        free(ws);
+        return NULL;
+    }
+    if (tss_set(poll_waitset_key, ws) != thrd_success) {
+        poll_waitset_free(ws);
+        return NULL;
+    }
+    return ws;
+}
+
+static void poll_waitset_clear(poll_waitset_t* ws, size_t i) {
+    if (ws->items[i].handle != ZX_HANDLE_INVALID) {
+        zx_waitset_remove(ws->handle, i);
+        ws->items[i].handle = ZX_HANDLE_INVALID;
+    }
+}
+
+static zx_status_t poll_waitset_set(poll_waitset_t* ws, size_t i, const zx_wait_item_t* item) {
+    poll_waitset_clear(ws, i);
+    zx_status_t r = zx_waitset_add(ws->handle, i, item->handle, item->waitfor);
+    if (r == ZX_OK) {
+        ws->items[i] = *item;
+    }
+    return r;
+}
+
+// Makes the wait set watch exactly |items|.
+static zx_status_t poll_waitset_sync(poll_waitset_t* ws, const zx_wait_item_t* items,
+                                     size_t count) {
+    if (count > ws->capacity) {
+        zx_wait_item_t* grown = realloc(ws->items, count * sizeof(*grown));
+        if (grown == NULL) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        ws->items = grown;
+        ws->capacity = count;
+    }
+    for (size_t i = count; i < ws->count; i++) {
+        poll_waitset_clear(ws, i);
+    }
+    for (size_t i = ws->count; i < count; i++) {
+        ws->items[i].handle = ZX_HANDLE_INVALID;
+    }
+    ws->count = count;
+
+    for (size_t i = 0; i < count; i++) {
+        if (ws->items[i].handle == items[i].handle &&
+            ws->items[i].waitfor == items[i].waitfor) {
+            continue;
+        }
+        zx_status_t r = poll_waitset_set(ws, i, &items[i]);
+        if (r != ZX_OK) {
+            return r;
+        }
+    }
+    return ZX_OK;
+}
+
+// Same contract as zx_object_wait_many(), without its limit on |count|.
+static zx_status_t poll_wait_many(zx_wait_item_t* items, size_t count, zx_time_t deadline) {
+    poll_waitset_t* ws = poll_waitset_get();
+    if (ws == NULL) {
+        return zx_object_wait_many(items, count, deadline);
+    }
+    zx_status_t r = poll_waitset_sync(ws, items, count);
+    if (r != ZX_OK) {
+        return r;
+    }
+
+    bool found = false;
+    for (;;) {
+        zx_waitset_result_t results[ZX_WAITSET_MAX_RESULTS];
+        size_t n;
+        r = zx_waitset_wait(ws->handle, deadline, results, ZX_WAITSET_MAX_RESULTS, &n);
+        if (r != ZX_OK) {
+            return found ? ZX_OK : r;
+        }
+
+        bool more = (n == ZX_WAITSET_MAX_RESULTS);
+        for (size_t j = 0; j < n; j++) {
+            size_t i = results[j].cookie;
+            if (i >= count) {
+                continue;
+            }
+            if (results[j].observed & ZX_SIGNAL_HANDLE_CLOSED) {
+                // A cached entry outlived its handle and the value got
+                // reused; watch the object the handle refers to now.
+                if ((r = poll_waitset_set(ws, i, &items[i])) != ZX_OK) {
+                    return r;
+                }
+                continue;
+            }
+            if (items[i].pending != 0) {
+                // the wait set came back around to entries already seen
+                more = false;
+            }
+            items[i].pending = results[j].observed;
+            found = true;
+        }
+        if (found && !more) {
+            return ZX_OK;
+        }
+        if (found) {
+            // pick up the remaining ready entries without blocking
+            deadline = 0;
+        }
+    }
+}
+
 // TODO: getrlimit(RLIMIT_NOFILE, ...)
 #define MAX_POLL_NFDS 1024
 
@@ -1925,7 +2155,7 @@ int ppoll(struct pollfd* fds, nfds_t n,
                 tmo = zx_deadline_after(duration);
             }
         }
-        r = zx_object_wait_many(items, nvalid, tmo);
+        r = poll_wait_many(items, nvalid, tmo);
         // pending signals could be reported on ZX_ERR_TIMED_OUT case as well
         if (r == ZX_OK || r == ZX_ERR_TIMED_OUT) {
             nfds_t j = 0; // j counts up on a valid entry
@@ -2020,7 +2250,7 @@ int select(int n, fd_set* restrict rfds, fd_set* restrict wfds, fd_set* restrict
     if (r == ZX_OK && nvalid > 0) {
         zx_time_t tmo = (tv == NULL) ? ZX_TIME_INFINITE :
             zx_deadline_after(ZX_SEC(tv->tv_sec) + ZX_USEC(tv->tv_usec));
-        r = zx_object_wait_many(items, nvalid, tmo);
+        r = poll_wait_many(items, nvalid, tmo);
         // pending signals could be reported on ZX_ERR_TIMED_OUT case as well
         if (r == ZX_OK || r == ZX_ERR_TIMED_OUT) {
             int j = 0; // j counts up on a valid entry
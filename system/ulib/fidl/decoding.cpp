@@ -460,7 +460,7 @@ zx_status_t FidlDecoder::DecodeMessage() {
             vector_ptr->data = TypedAt<void>(frame->offset);
             // Continue by decoding the vector elements as an array.
             *frame = Frame(frame->vector_state.element, size,
-                           static_cast<uint32_t>(vector_ptr->count), frame->offset);
+                           frame->vector_state.element_size, frame->offset);
             continue;
         }
         case Frame::kStateDone: {
@@ -437,7 +437,7 @@ zx_status_t FidlEncoder::EncodeMessage() {
             vector_ptr->data = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
             // Continue to encoding the vector elements as an array.
             *frame = Frame(frame->vector_state.element, size,
-                           static_cast<uint32_t>(vector_ptr->count), frame->offset);
+                           frame->vector_state.element_size, frame->offset);
             continue;
         }
         case Frame::kStateDone: {
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <fidl/cpp/message_part.h>
+#include <fidl/cpp/static_coding.h>
 #include <fidl/coding.h>
 #include <fidl/types.h>
 
@@ -91,6 +92,35 @@ public:
     // |Encode| method.
     zx_status_t Decode(const fidl_type_t* type, const char** error_msg_out);
 
+    // Encodes the message in-place, as a message of type |T|.
+    //
+    // Like |Encode| above, but specialized at compile time for |T|, a
+    // |fidl::coded::Struct|.  See <fidl/cpp/static_coding.h>.
+    template <typename T>
+    zx_status_t Encode(const char** error_msg_out) {
+        uint32_t actual_handles = 0u;
+        zx_status_t status = EncodeInPlace<T>(bytes_.data(), bytes_.actual(),
+                                              handles_.data(), handles_.capacity(),
+                                              &actual_handles, error_msg_out);
+        if (status == ZX_OK)
+            handles_.set_actual(actual_handles);
+        return status;
+    }
+
+    // Decodes the message in-place, as a message of type |T|.
+    //
+    // Like |Decode| above, but specialized at compile time for |T|, a
+    // |fidl::coded::Struct|.  See <fidl/cpp/static_coding.h>.
+    template <typename T>
+    zx_status_t Decode(const char** error_msg_out) {
+        zx_status_t status = DecodeInPlace<T>(bytes_.data(), bytes_.actual(),
+                                              handles_.data(), handles_.actual(),
+                                              error_msg_out);
+        if (status == ZX_OK)
+            ClearHandles();
+        return status;
+    }
+
     // Read a message from the given channel.
     //
     // The bytes read from the channel are stored in bytes() and the handles
@@ -12,6 +12,7 @@
 #include <zircon/types.h>
 
 namespace fidl {
+class MessageBufferPool;
 
 class MessageBuffer {
 public:
@@ -23,9 +24,20 @@ public:
         uint32_t bytes_capacity = ZX_CHANNEL_MAX_MSG_BYTES,
         uint32_t handles_capacity = ZX_CHANNEL_MAX_MSG_HANDLES);
 
-    // The memory that backs the message is freed by this destructor.
+    // Creates a |MessageBuffer| whose memory comes from |pool|, with the
+    // pool's capacities.
+    //
+    // The memory goes back to |pool| when the |MessageBuffer| is destructed,
+    // so |pool| must outlive it.
+    explicit MessageBuffer(MessageBufferPool* pool);
+
+    // The memory that backs the message is freed by this destructor, or
+    // returned to the pool it came from.
     ~MessageBuffer();
 
+    MessageBuffer(const MessageBuffer& other) = delete;
+    MessageBuffer& operator=(const MessageBuffer& other) = delete;
+
     // The memory in which bytes can be stored in this buffer.
     uint8_t* bytes() const { return buffer_; }
 
@@ -44,9 +56,65 @@ public:
     Message CreateEmptyMessage();
 
 private:
+    MessageBufferPool* const pool_;
     uint8_t* const buffer_;
     const uint32_t bytes_capacity_;
     const uint32_t handles_capacity_;
 };
 
+// A cache of the memory behind |MessageBuffer|s.
+//
+// A server which creates a |MessageBuffer| or a |MessageBuilder| for each
+// request allocates and frees a buffer big enough for the largest message
+// each time.  Creating them from a |MessageBufferPool| bound to the
+// connection, or to the thread serving it, reuses the same few buffers
+// instead, so once the pool is warm, handling a request does not touch the
+// heap at all.
+//
+// A |MessageBufferPool| is not thread-safe.  Use one for each thread.
+class MessageBufferPool {
+public:
+    // Creates a pool of buffers for messages of the given capacities, which
+    // keeps up to |max_cached| of them for reuse.
+    explicit MessageBufferPool(
+        uint32_t bytes_capacity = ZX_CHANNEL_MAX_MSG_BYTES,
+        uint32_t handles_capacity = ZX_CHANNEL_MAX_MSG_HANDLES,
+        uint32_t max_cached = 4u);
+
+    // Frees the cached buffers.
+    //
+    // Every |MessageBuffer| created from the pool must have been destructed.
+    ~MessageBufferPool();
+
+    MessageBufferPool(const MessageBufferPool& other) = delete;
+    MessageBufferPool& operator=(const MessageBufferPool& other) = delete;
+
+    // The capacities of the buffers in this pool.
+    uint32_t bytes_capacity() const { return bytes_capacity_; }
+    uint32_t handles_capacity() const { return handles_capacity_; }
+
+    // The number of buffers waiting to be reused.
+    uint32_t cached_count() const { return cached_count_; }
+
+    // Frees the buffers waiting to be reused.
+    void Trim();
+
+private:
+    friend class MessageBuffer;
+
+    // While a buffer is in the pool, its first bytes link it to the next one.
+    struct FreeBuffer {
+        FreeBuffer* next;
+    };
+
+    uint8_t* Take();
+    void Give(uint8_t* buffer);
+
+    const uint32_t bytes_capacity_;
+    const uint32_t handles_capacity_;
+    const uint32_t max_cached_;
+    uint32_t cached_count_ = 0u;
+    FreeBuffer* free_ = nullptr;
+};
+
 } // namespace fidl
@@ -16,9 +16,9 @@ namespace fidl {
 
 // A builder for FIDL messages that owns the memory for the message.
 //
-// A |MessageBuilder| is a |Builder| that uses the heap to back the memory for
-// the message. If you wish to manage the memory yourself, you can use |Builder|
-// and |Message| directly.
+// A |MessageBuilder| is a |Builder| that uses the heap, or a
+// |MessageBufferPool|, to back the memory for the message. If you wish to
+// manage the memory yourself, you can use |Builder| and |Message| directly.
 //
 // Upon creation, the |MessageBuilder| creates a FIDL message header, which you
 // can modify using |header()|.
@@ -36,9 +36,26 @@ public:
         uint32_t bytes_capacity = ZX_CHANNEL_MAX_MSG_BYTES,
         uint32_t handles_capacity = ZX_CHANNEL_MAX_MSG_HANDLES);
 
+    // Creates a |MessageBuilder| for the given |type| whose buffers come from
+    // |pool|.
+    //
+    // The bytes buffer is initialied by adding a |fidl_message_header_t|
+    // header.
+    //
+    // The buffers are returned to |pool| when the |MessageBuilder| is
+    // destructed.
+    MessageBuilder(const fidl_type_t* type, MessageBufferPool* pool);
+
     // The memory that backs the message is freed by this destructor.
     ~MessageBuilder();
 
+    // Discards the message built so far and begins a new one in the same
+    // memory, with a fresh |fidl_message_header_t| header.
+    //
+    // Any |Message| previously returned by |Encode| is no longer valid.
+    void Reset();
+    using Builder::Reset;
+
     // The type of the message payload this object is building.
     const fidl_type_t* type() const { return type_; }
 
@@ -0,0 +1,619 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fidl/coding.h>
+#include <fidl/internal.h>
+#include <fidl/types.h>
+#include <zircon/types.h>
+
+// Encoding and decoding specialized for a message type at compile time.
+//
+// |fidl_encode()| and |fidl_decode()| interpret a coding table, keeping a
+// stack of frames as they walk the message.  Instead, a message type can be
+// described with the templates in |fidl::coded|, the same way as with a
+// coding table, and |fidl::EncodeInPlace()| and |fidl::DecodeInPlace()| then
+// unroll the walk over it at compile time.  The result validates and
+// converts the message in one pass, in the same order and with the same
+// errors as the interpreter, but without looking anything up as it goes and
+// without ever visiting a field which needs no coding.
+//
+// Example usage:
+//
+//   // struct Request { fidl_message_header_t header; zx_handle_t h; fidl_string_t s; };
+//   using RequestType = fidl::coded::Struct<
+//       32u,
+//       fidl::coded::Field<16u, fidl::coded::Handle<>>,
+//       fidl::coded::Field<24u, fidl::coded::String<64u>>>;
+//
+//   zx_status_t status = fidl::DecodeInPlace<RequestType>(
+//       bytes, num_bytes, handles, num_handles, &error_msg);
+
+namespace fidl {
+namespace coded {
+
+// The element type of arrays and vectors of numbers, enums and the like,
+// which need no coding.  Fields of those types are left out of structs
+// altogether, as in coding tables.
+struct Primitive {};
+
+// A field of a struct which needs coding, at |offset| bytes from its start.
+template <uint32_t offset, typename Type>
+struct Field {};
+
+// A struct of |size| bytes, with one |Field| for each of its fields which
+// needs coding, in order of their offsets.
+template <uint32_t size, typename... Fields>
+struct Struct {};
+
+// A nullable struct, stored out of line.
+template <typename StructType>
+struct StructPointer {};
+
+// A union of |size| bytes including its tag, with one member type for each
+// tag value, in order.
+template <uint32_t size, typename... Members>
+struct Union {};
+
+// A nullable union, stored out of line.
+template <typename UnionType>
+struct UnionPointer {};
+
+// An array of |count| elements of |element_size| bytes each.
+template <typename Element, uint32_t element_size, uint32_t count>
+struct Array {};
+
+template <uint32_t max_size = FIDL_MAX_SIZE, FidlNullability nullable = kNonnullable>
+struct String {};
+
+template <FidlNullability nullable = kNonnullable>
+struct Handle {};
+
+template <typename Element, uint32_t element_size, uint32_t max_count = FIDL_MAX_SIZE,
+          FidlNullability nullable = kNonnullable>
+struct Vector {};
+
+} // namespace coded
+
+namespace internal {
+
+// The state of a message being decoded or encoded, apart from the walk over
+// its type.
+class StaticCoder {
+public:
+    StaticCoder(uint8_t* bytes, uint32_t num_bytes, zx_handle_t* handles, uint32_t num_handles,
+                const char** error_msg_out)
+        : bytes_(bytes), num_bytes_(num_bytes), handles_(handles), num_handles_(num_handles),
+          error_msg_out_(error_msg_out) {}
+
+    template <typename T> T* TypedAt(uint32_t offset) const {
+        return reinterpret_cast<T*>(bytes_ + offset);
+    }
+
+    uint8_t* bytes() const { return bytes_; }
+    uint32_t num_bytes() const { return num_bytes_; }
+    uint32_t handle_count() const { return handle_idx_; }
+    uint32_t out_of_line_offset() const { return out_of_line_offset_; }
+    void set_out_of_line_offset(uint32_t offset) { out_of_line_offset_ = offset; }
+
+    bool WithError(const char* error_msg) {
+        if (error_msg_out_ != nullptr) {
+            *error_msg_out_ = error_msg;
+        }
+        return false;
+    }
+
+    // Returns true when a handle was claimed, and false when the
+    // handles are exhausted.
+    bool DecodeHandle(zx_handle_t* out_handle) {
+        if (handle_idx_ == num_handles_) {
+            return false;
+        }
+        *out_handle = handles_[handle_idx_];
+        ++handle_idx_;
+        return true;
+    }
+
+    bool EncodeHandle(zx_handle_t* handle) {
+        if (handle_idx_ == num_handles_) {
+            return false;
+        }
+        handles_[handle_idx_] = *handle;
+        *handle = FIDL_HANDLE_PRESENT;
+        ++handle_idx_;
+        return true;
+    }
+
+    // Returns true when the buffer space is claimed, and false when the
+    // requested claim is too large for the buffer or, when encoding, the
+    // object is not where it would go.
+    bool ClaimOutOfLineStorage(uint32_t size, uint32_t* out_offset) {
+        uint64_t aligned_offset = FidlAlign(out_of_line_offset_ + size);
+        if (aligned_offset > static_cast<uint64_t>(num_bytes_)) {
+            return false;
+        }
+        *out_offset = out_of_line_offset_;
+        out_of_line_offset_ = static_cast<uint32_t>(aligned_offset);
+        return true;
+    }
+
+    bool ClaimOutOfLineStorage(uint32_t size, const void* storage, uint32_t* out_offset) {
+        if (&bytes_[out_of_line_offset_] != static_cast<const uint8_t*>(storage)) {
+            return false;
+        }
+        return ClaimOutOfLineStorage(size, out_offset);
+    }
+
+private:
+    uint8_t* const bytes_;
+    const uint32_t num_bytes_;
+    zx_handle_t* const handles_;
+    const uint32_t num_handles_;
+    const char** const error_msg_out_;
+
+    uint32_t handle_idx_ = 0u;
+    uint32_t out_of_line_offset_ = 0u;
+};
+
+template <uint32_t a, uint32_t b>
+struct Max {
+    static constexpr uint32_t value = a > b ? a : b;
+};
+
+// Decodes and encodes the object of type |T| at |offset|.  Returns false,
+// having set the error message, if the message is invalid.
+//
+// |kDepth| is the number of frames the interpreter would need for the type,
+// and |kNeedsCoding| is false for types which need nothing done to them.
+template <typename T>
+struct Coder;
+
+template <>
+struct Coder<coded::Primitive> {
+    static constexpr uint32_t kDepth = 0u;
+    static constexpr bool kNeedsCoding = false;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) { return true; }
+    static bool Encode(StaticCoder* coder, uint32_t offset) { return true; }
+};
+
+template <typename... Fields>
+struct FieldList;
+
+template <>
+struct FieldList<> {
+    static constexpr uint32_t kDepth = 0u;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) { return true; }
+    static bool Encode(StaticCoder* coder, uint32_t offset) { return true; }
+};
+
+template <uint32_t field_offset, typename Type, typename... Rest>
+struct FieldList<coded::Field<field_offset, Type>, Rest...> {
+    static constexpr uint32_t kDepth =
+        Max<Coder<Type>::kDepth, FieldList<Rest...>::kDepth>::value;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        return Coder<Type>::Decode(coder, offset + field_offset) &&
+               FieldList<Rest...>::Decode(coder, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        return Coder<Type>::Encode(coder, offset + field_offset) &&
+               FieldList<Rest...>::Encode(coder, offset);
+    }
+};
+
+template <uint32_t size, typename... Fields>
+struct Coder<coded::Struct<size, Fields...>> {
+    static constexpr uint32_t kSize = size;
+    static constexpr uint32_t kDepth = 1u + FieldList<Fields...>::kDepth;
+    static constexpr bool kNeedsCoding = sizeof...(Fields) != 0u;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        return FieldList<Fields...>::Decode(coder, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        return FieldList<Fields...>::Encode(coder, offset);
+    }
+};
+
+template <typename StructType>
+struct Coder<coded::StructPointer<StructType>> {
+    static constexpr uint32_t kDepth = Coder<StructType>::kDepth;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        void** struct_ptr_ptr = coder->TypedAt<void*>(offset);
+        switch (reinterpret_cast<uintptr_t>(*struct_ptr_ptr)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            return true;
+        default:
+            return coder->WithError("Tried to decode a bad struct pointer");
+        }
+        if (!coder->ClaimOutOfLineStorage(Coder<StructType>::kSize, &offset)) {
+            return coder->WithError("message wanted to store too large of a nullable struct");
+        }
+        *struct_ptr_ptr = coder->TypedAt<void>(offset);
+        return Coder<StructType>::Decode(coder, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        void** struct_ptr_ptr = coder->TypedAt<void*>(offset);
+        if (*struct_ptr_ptr == nullptr) {
+            return true;
+        }
+        if (!coder->ClaimOutOfLineStorage(Coder<StructType>::kSize, *struct_ptr_ptr, &offset)) {
+            return coder->WithError("message wanted to store too large of a nullable struct");
+        }
+        *struct_ptr_ptr = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
+        return Coder<StructType>::Encode(coder, offset);
+    }
+};
+
+// Picks the member of a union by its tag.
+template <uint32_t index, typename... Members>
+struct MemberList;
+
+template <uint32_t index>
+struct MemberList<index> {
+    static constexpr uint32_t kDepth = 0u;
+
+    static bool Decode(StaticCoder* coder, fidl_union_tag_t tag, uint32_t offset) {
+        return true;
+    }
+    static bool Encode(StaticCoder* coder, fidl_union_tag_t tag, uint32_t offset) {
+        return true;
+    }
+};
+
+template <uint32_t index, typename Member, typename... Rest>
+struct MemberList<index, Member, Rest...> {
+    static constexpr uint32_t kDepth =
+        Max<Coder<Member>::kDepth, MemberList<index + 1u, Rest...>::kDepth>::value;
+
+    static bool Decode(StaticCoder* coder, fidl_union_tag_t tag, uint32_t offset) {
+        return tag == index ? Coder<Member>::Decode(coder, offset)
+                            : MemberList<index + 1u, Rest...>::Decode(coder, tag, offset);
+    }
+    static bool Encode(StaticCoder* coder, fidl_union_tag_t tag, uint32_t offset) {
+        return tag == index ? Coder<Member>::Encode(coder, offset)
+                            : MemberList<index + 1u, Rest...>::Encode(coder, tag, offset);
+    }
+};
+
+template <uint32_t size, typename... Members>
+struct Coder<coded::Union<size, Members...>> {
+    static constexpr uint32_t kSize = size;
+    static constexpr uint32_t kDepth = Max<1u, MemberList<0u, Members...>::kDepth>::value;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        fidl_union_tag_t union_tag = *coder->TypedAt<fidl_union_tag_t>(offset);
+        if (union_tag >= sizeof...(Members)) {
+            return coder->WithError("Tried to decode a bad union discriminant");
+        }
+        return MemberList<0u, Members...>::Decode(
+            coder, union_tag, offset + static_cast<uint32_t>(sizeof(union_tag)));
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        fidl_union_tag_t union_tag = *coder->TypedAt<fidl_union_tag_t>(offset);
+        if (union_tag >= sizeof...(Members)) {
+            return coder->WithError("Tried to encode a bad union discriminant");
+        }
+        return MemberList<0u, Members...>::Encode(
+            coder, union_tag, offset + static_cast<uint32_t>(sizeof(union_tag)));
+    }
+};
+
+template <typename UnionType>
+struct Coder<coded::UnionPointer<UnionType>> {
+    static constexpr uint32_t kDepth = Coder<UnionType>::kDepth;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        fidl_union_tag_t** union_ptr_ptr = coder->TypedAt<fidl_union_tag_t*>(offset);
+        switch (reinterpret_cast<uintptr_t>(*union_ptr_ptr)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            return true;
+        default:
+            return coder->WithError("Tried to decode a bad union pointer");
+        }
+        if (!coder->ClaimOutOfLineStorage(Coder<UnionType>::kSize, &offset)) {
+            return coder->WithError("messange wanted to store too large of a nullable union");
+        }
+        *union_ptr_ptr = coder->TypedAt<fidl_union_tag_t>(offset);
+        return Coder<UnionType>::Decode(coder, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        fidl_union_tag_t** union_ptr_ptr = coder->TypedAt<fidl_union_tag_t*>(offset);
+        if (*union_ptr_ptr == nullptr) {
+            return true;
+        }
+        if (!coder->ClaimOutOfLineStorage(Coder<UnionType>::kSize, *union_ptr_ptr, &offset)) {
+            return coder->WithError("messange wanted to store too large of a nullable union");
+        }
+        *union_ptr_ptr = reinterpret_cast<fidl_union_tag_t*>(FIDL_ALLOC_PRESENT);
+        return Coder<UnionType>::Encode(coder, offset);
+    }
+};
+
+// Decodes and encodes |count| elements, unless they need no coding.
+template <typename Element, uint32_t element_size>
+struct Elements {
+    static bool Decode(StaticCoder* coder, uint64_t count, uint32_t offset) {
+        if (!Coder<Element>::kNeedsCoding) {
+            return true;
+        }
+        for (uint64_t i = 0u; i < count; i++) {
+            if (!Coder<Element>::Decode(coder, offset + static_cast<uint32_t>(i) * element_size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    static bool Encode(StaticCoder* coder, uint64_t count, uint32_t offset) {
+        if (!Coder<Element>::kNeedsCoding) {
+            return true;
+        }
+        for (uint64_t i = 0u; i < count; i++) {
+            if (!Coder<Element>::Encode(coder, offset + static_cast<uint32_t>(i) * element_size)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename Element, uint32_t element_size, uint32_t count>
+struct Coder<coded::Array<Element, element_size, count>> {
+    static constexpr uint32_t kDepth = 1u + Coder<Element>::kDepth;
+    static constexpr bool kNeedsCoding = Coder<Element>::kNeedsCoding;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        return Elements<Element, element_size>::Decode(coder, count, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        return Elements<Element, element_size>::Encode(coder, count, offset);
+    }
+};
+
+template <uint32_t max_size, FidlNullability nullable>
+struct Coder<coded::String<max_size, nullable>> {
+    static constexpr uint32_t kDepth = 1u;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        fidl_string_t* string_ptr = coder->TypedAt<fidl_string_t>(offset);
+        // The string storage may be Absent for nullable strings and must
+        // otherwise be Present. No other values are allowed.
+        switch (reinterpret_cast<uintptr_t>(string_ptr->data)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            if (!nullable) {
+                return coder->WithError("message tried to decode an absent non-nullable string");
+            }
+            if (string_ptr->size != 0u) {
+                return coder->WithError(
+                    "message tried to decode an absent string of non-zero length");
+            }
+            return true;
+        default:
+            return coder->WithError("message tried to decode a non-present string");
+        }
+        uint64_t size = string_ptr->size;
+        if (size > max_size) {
+            return coder->WithError("message tried to decode too large of a bounded string");
+        }
+        uint32_t string_data_offset = 0u;
+        if (!coder->ClaimOutOfLineStorage(static_cast<uint32_t>(size), &string_data_offset)) {
+            return coder->WithError("decoding a  string overflowed buffer");
+        }
+        string_ptr->data = coder->TypedAt<char>(string_data_offset);
+        return true;
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        fidl_string_t* string_ptr = coder->TypedAt<fidl_string_t>(offset);
+        // The string storage may be nullptr for nullable strings.
+        if (string_ptr->data == nullptr) {
+            if (!nullable) {
+                return coder->WithError("message tried to encode an absent non-nullable string");
+            }
+            return true;
+        }
+        uint64_t size = string_ptr->size;
+        if (size > max_size) {
+            return coder->WithError("message tried to encode too large of a bounded string");
+        }
+        if (!coder->ClaimOutOfLineStorage(static_cast<uint32_t>(size), string_ptr->data,
+                                          &offset)) {
+            return coder->WithError("encoding a string with incorrectly placed data");
+        }
+        string_ptr->data = reinterpret_cast<char*>(FIDL_ALLOC_PRESENT);
+        return true;
+    }
+};
+
+template <FidlNullability nullable>
+struct Coder<coded::Handle<nullable>> {
+    static constexpr uint32_t kDepth = 1u;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        zx_handle_t* handle_ptr = coder->TypedAt<zx_handle_t>(offset);
+        // The handle storage may be Absent for nullable handles and must
+        // otherwise be Present. No other values are allowed.
+        switch (*handle_ptr) {
+        case FIDL_HANDLE_ABSENT:
+            if (nullable) {
+                return true;
+            }
+            break;
+        case FIDL_HANDLE_PRESENT:
+            if (!coder->DecodeHandle(handle_ptr)) {
+                return coder->WithError("message decoded too many handles");
+            }
+            return true;
+        }
+        // Either the value at the handle was garbage, or was
+        // ABSENT for a nonnullable handle.
+        return coder->WithError("message tried to decode a non-present handle");
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        zx_handle_t* handle_ptr = coder->TypedAt<zx_handle_t>(offset);
+        // The handle storage may be ZX_HANDLE_INVALID for nullable
+        // handles, which will be encoded as FIDL_HANDLE_ABSENT.
+        if (nullable && *handle_ptr == ZX_HANDLE_INVALID) {
+            return true;
+        }
+        if (!coder->EncodeHandle(handle_ptr)) {
+            return coder->WithError("message encoded too many handles");
+        }
+        return true;
+    }
+};
+
+template <typename Element, uint32_t element_size, uint32_t max_count, FidlNullability nullable>
+struct Coder<coded::Vector<Element, element_size, max_count, nullable>> {
+    static constexpr uint32_t kDepth = 1u + Coder<Element>::kDepth;
+    static constexpr bool kNeedsCoding = true;
+
+    static bool Decode(StaticCoder* coder, uint32_t offset) {
+        fidl_vector_t* vector_ptr = coder->TypedAt<fidl_vector_t>(offset);
+        // The vector storage may be Absent for nullable vectors and must
+        // otherwise be Present. No other values are allowed.
+        switch (reinterpret_cast<uintptr_t>(vector_ptr->data)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            if (!nullable) {
+                return coder->WithError("message tried to decode an absent non-nullable vector");
+            }
+            if (vector_ptr->count != 0u) {
+                return coder->WithError(
+                    "message tried to decode an absent vector of non-zero elements");
+            }
+            return true;
+        default:
+            return coder->WithError("message tried to decode a non-present vector");
+        }
+        if (vector_ptr->count > max_count) {
+            return coder->WithError("message tried to decode too large of a bounded vector");
+        }
+        uint32_t size = static_cast<uint32_t>(vector_ptr->count * element_size);
+        if (!coder->ClaimOutOfLineStorage(size, &offset)) {
+            return coder->WithError("message wanted to store too large of a vector");
+        }
+        vector_ptr->data = coder->TypedAt<void>(offset);
+        return Elements<Element, element_size>::Decode(coder, vector_ptr->count, offset);
+    }
+    static bool Encode(StaticCoder* coder, uint32_t offset) {
+        fidl_vector_t* vector_ptr = coder->TypedAt<fidl_vector_t>(offset);
+        // The vector storage may be nullptr for nullable vectors.
+        if (vector_ptr->data == nullptr) {
+            if (!nullable) {
+                return coder->WithError("message tried to encode an absent non-nullable vector");
+            }
+            return true;
+        }
+        if (vector_ptr->count > max_count) {
+            return coder->WithError("message tried to encode too large of a bounded vector");
+        }
+        uint32_t size = static_cast<uint32_t>(vector_ptr->count * element_size);
+        if (!coder->ClaimOutOfLineStorage(size, vector_ptr->data, &offset)) {
+            return coder->WithError("message wanted to store too large of a vector");
+        }
+        vector_ptr->data = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
+        return Elements<Element, element_size>::Encode(coder, vector_ptr->count, offset);
+    }
+};
+
+} // namespace internal
+
+// Decodes a message of type |T|, a |coded::Struct|, in place.
+//
+// Behaves exactly like |fidl_decode()| with the corresponding coding table.
+template <typename T>
+zx_status_t DecodeInPlace(void* bytes, uint32_t num_bytes,
+                          const zx_handle_t* handles, uint32_t num_handles,
+                          const char** error_msg_out) {
+    using Coder = internal::Coder<T>;
+    // The sentinel frame takes up one more.
+    static_assert(Coder::kDepth < FIDL_RECURSION_DEPTH, "type is nested too deeply");
+
+    internal::StaticCoder coder(static_cast<uint8_t*>(bytes), num_bytes,
+                                const_cast<zx_handle_t*>(handles), num_handles, error_msg_out);
+    if (bytes == nullptr) {
+        coder.WithError("Cannot decode null bytes");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (handles == nullptr && num_handles != 0u) {
+        coder.WithError("Cannot provide non-zero handle count and null handle pointer");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (Coder::kSize > num_bytes) {
+        coder.WithError("Message size is smaller than expected");
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    // See |fidl_decode()| for why this is not rounded up.
+    coder.set_out_of_line_offset(Coder::kSize);
+    if (!Coder::Decode(&coder, 0u)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (coder.out_of_line_offset() != num_bytes) {
+        coder.WithError("message did not decode all provided bytes");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    return ZX_OK;
+}
+
+// Encodes a message of type |T|, a |coded::Struct|, in place.
+//
+// Behaves exactly like |fidl_encode()| with the corresponding coding table.
+template <typename T>
+zx_status_t EncodeInPlace(void* bytes, uint32_t num_bytes,
+                          zx_handle_t* handles, uint32_t max_handles,
+                          uint32_t* actual_handles_out, const char** error_msg_out) {
+    using Coder = internal::Coder<T>;
+    static_assert(Coder::kDepth < FIDL_RECURSION_DEPTH, "type is nested too deeply");
+
+    internal::StaticCoder coder(static_cast<uint8_t*>(bytes), num_bytes,
+                                handles, max_handles, error_msg_out);
+    if (bytes == nullptr) {
+        coder.WithError("Cannot encode null bytes");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (actual_handles_out == nullptr) {
+        coder.WithError("Cannot encode with null actual_handles_out");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (handles == nullptr && max_handles != 0u) {
+        coder.WithError("Cannot provide non-zero handle count and null handle pointer");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (Coder::kSize > num_bytes) {
+        coder.WithError("Message size is smaller than expected");
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    coder.set_out_of_line_offset(Coder::kSize);
+    if (!Coder::Encode(&coder, 0u)) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (coder.out_of_line_offset() != num_bytes) {
+        coder.WithError("did not encode the entire provided buffer");
+        return ZX_ERR_INVALID_ARGS;
+    }
+    *actual_handles_out = coder.handle_count();
+    return ZX_OK;
+}
+
+} // namespace fidl
@@ -23,14 +23,25 @@ size_t GetAllocSize(uint32_t bytes_capacity, uint32_t handles_capacity) {
 
 MessageBuffer::MessageBuffer(uint32_t bytes_capacity,
                              uint32_t handles_capacity)
-    : buffer_(static_cast<uint8_t*>(
+    : pool_(nullptr),
+      buffer_(static_cast<uint8_t*>(
           malloc(GetAllocSize(bytes_capacity, handles_capacity)))),
       bytes_capacity_(bytes_capacity),
       handles_capacity_(handles_capacity) {
 }
 
+MessageBuffer::MessageBuffer(MessageBufferPool* pool)
+    : pool_(pool),
+      buffer_(pool->Take()),
+      bytes_capacity_(pool->bytes_capacity()),
+      handles_capacity_(pool->handles_capacity()) {
+}
+
 MessageBuffer::~MessageBuffer() {
-    free(buffer_);
+    if (pool_)
+        pool_->Give(buffer_);
+    else
+        free(buffer_);
 }
 
 zx_handle_t* MessageBuffer::handles() const {
@@ -43,4 +54,52 @@ Message MessageBuffer::CreateEmptyMessage() {
                    HandlePart(handles(), handles_capacity()));
 }
 
+MessageBufferPool::MessageBufferPool(uint32_t bytes_capacity,
+                                     uint32_t handles_capacity,
+                                     uint32_t max_cached)
+    : bytes_capacity_(bytes_capacity),
+      handles_capacity_(handles_capacity),
+      max_cached_(max_cached) {
+}
+
+MessageBufferPool::~MessageBufferPool() {
+    Trim();
+}
+
+void MessageBufferPool::Trim() {
+    while (free_) {
+        FreeBuffer* buffer = free_;
+        free_ = buffer->next;
+        free(buffer);
+    }
+    cached_count_ = 0u;
+}
+
+uint8_t* MessageBufferPool::Take() {
+    if (!free_) {
+        // A buffer must be able to hold the link while it is cached.
+        size_t size = GetAllocSize(bytes_capacity_, handles_capacity_);
+        if (size < sizeof(FreeBuffer))
+            size = sizeof(FreeBuffer);
+        return static_cast<uint8_t*>(malloc(size));
+    }
+    FreeBuffer* buffer = free_;
+    free_ = buffer->next;
+    --cached_count_;
+    return reinterpret_cast<uint8_t*>(buffer);
+}
+
+void MessageBufferPool::Give(uint8_t* buffer) {
+    if (!buffer)
+        return;
+    if (cached_count_ == max_cached_) {
+        free(buffer);
+        return;
+    }
+    FreeBuffer* free_buffer = reinterpret_cast<FreeBuffer*>(buffer);
+    free_buffer->next = free_;
+    free_ = free_buffer;
+    ++cached_count_;
+}
+
 } // namespace fidl
@@ -14,12 +14,23 @@ MessageBuilder::MessageBuilder(const fidl_type_t* type,
                                uint32_t handles_capacity)
     : type_(type),
       buffer_(bytes_capacity, handles_capacity) {
-    Reset(buffer_.bytes(), buffer_.bytes_capacity());
-    New<fidl_message_header_t>();
+    Reset();
+}
+
+MessageBuilder::MessageBuilder(const fidl_type_t* type,
+                               MessageBufferPool* pool)
+    : type_(type),
+      buffer_(pool) {
+    Reset();
 }
 
 MessageBuilder::~MessageBuilder() = default;
 
+void MessageBuilder::Reset() {
+    Reset(buffer_.bytes(), buffer_.bytes_capacity());
+    New<fidl_message_header_t>();
+}
+
 zx_status_t MessageBuilder::Encode(Message* message_out,
                                    const char** error_msg_out) {
     *message_out = Message(Finalize(),
@@ -23,6 +23,11 @@ int wait_for_driver_bind(const char* parent, const char* driver);
 // Return 0 on success, -1 on error.
 int create_ramdisk(uint64_t blk_size, uint64_t blk_count, char* out_path);
 
+// Same but with RAMDISK_OPT_* |options| and |num_workers| threads, as described in
+// <zircon/device/ramdisk.h>.
+int create_ramdisk_ex(uint64_t blk_size, uint64_t blk_count, uint32_t options,
+                      uint32_t num_workers, char* out_path);
+
 // Same but uses an existing VMO as the ramdisk.
 // The handle is always consumed, and must be the only handle to this VMO.
 int create_ramdisk_from_vmo(zx_handle_t vmo, char* out_path);
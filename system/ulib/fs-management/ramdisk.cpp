@@ -99,6 +99,21 @@ int create_ramdisk(uint64_t blk_size, uint64_t blk_count, char* out_path) {
                          ioctl_ramdisk_config(fd, &config, &response));
 }
 
+int create_ramdisk_ex(uint64_t blk_size, uint64_t blk_count, uint32_t options,
+                      uint32_t num_workers, char* out_path) {
+    int fd = open_ramctl();
+    if (fd < 0)
+        return fd;
+    ramdisk_ioctl_config_ex_t config;
+    config.blk_size = blk_size;
+    config.blk_count = blk_count;
+    config.options = options;
+    config.num_workers = num_workers;
+    ramdisk_ioctl_config_response_t response;
+    return finish_create(&response, out_path,
+                         ioctl_ramdisk_config_ex(fd, &config, &response));
+}
+
 int create_ramdisk_from_vmo(zx_handle_t vmo, char* out_path) {
     int fd = open_ramctl();
     if (fd < 0)
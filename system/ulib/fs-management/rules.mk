@@ -18,6 +18,7 @@ MODULE_SRCS += \
 MODULE_STATIC_LIBS := \
     system/ulib/fbl \
     system/ulib/fs \
+    system/ulib/sync \
     system/ulib/zx \
     system/ulib/zxcpp \
 
@@ -166,7 +166,7 @@ zx_status_t Connection::Serve() {
 }
 
 zx_status_t Connection::CallHandler() {
-    return zxrio_handler(channel_.get(), &Connection::HandleMessageThunk, this);
+    return zxrio_handler_many(channel_.get(), &Connection::HandleMessageThunk, this);
 }
 
 zx_status_t Connection::HandleMessageThunk(zxrio_msg_t* msg, void* cookie) {
@@ -414,6 +414,24 @@ zx_status_t Connection::HandleMessage(zxrio_msg_t* msg) {
         }
         return r < 0 ? r : msg->datalen;
     }
+    case ZXRIO_READDIR_ATTR: {
+        TRACE_DURATION("vfs", "ZXRIO_READDIR_ATTR");
+        if (IsPathOnly(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        if (arg > FDIO_CHUNK_SIZE) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        if (msg->arg2.off == READDIR_CMD_RESET) {
+            dircookie_.Reset();
+        }
+        size_t actual;
+        zx_status_t r = vfs_->ReaddirAttr(vnode_.get(), &dircookie_, msg->data, arg, &actual);
+        if (r == ZX_OK) {
+            msg->datalen = static_cast<uint32_t>(actual);
+        }
+        return r < 0 ? r : msg->datalen;
+    }
     case ZXRIO_IOCTL_1H: {
         if (IsPathOnly(flags_)) {
             zx_handle_close(msg->handle[0]);
@@ -490,6 +508,7 @@ zx_status_t Connection::HandleMessage(zxrio_msg_t* msg) {
         case IOCTL_VFS_UNMOUNT_NODE:
         case IOCTL_VFS_UNMOUNT_FS:
         case IOCTL_VFS_GET_DEVICE_PATH:
+        case IOCTL_VFS_TRIM_FS:
             // Unmounting ioctls require Connection privileges
             if (!(flags_ & ZX_FS_RIGHT_ADMIN)) {
                 return ZX_ERR_ACCESS_DENIED;
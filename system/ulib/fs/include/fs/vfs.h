@@ -24,6 +24,7 @@
 #include <zx/event.h>
 #include <zx/vmo.h>
 #include <fbl/mutex.h>
+#include <sync/rwlock.h>
 #endif // __Fuchsia__
 
 #include <fbl/intrusive_double_list.h>
@@ -97,6 +98,32 @@ private:
     zx::channel channel_;
 };
 
+// Holds a reader-writer lock shared for as long as it is in scope.
+class __TA_SCOPED_CAPABILITY SharedLock {
+public:
+    explicit SharedLock(sync_rwlock_t* lock) __TA_ACQUIRE_SHARED(lock) : lock_(lock) {
+        sync_rwlock_read_lock(lock_);
+    }
+    ~SharedLock() __TA_RELEASE() { sync_rwlock_read_unlock(lock_); }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(SharedLock);
+    sync_rwlock_t* const lock_;
+};
+
+// Holds a reader-writer lock exclusively for as long as it is in scope.
+class __TA_SCOPED_CAPABILITY ExclusiveLock {
+public:
+    explicit ExclusiveLock(sync_rwlock_t* lock) __TA_ACQUIRE(lock) : lock_(lock) {
+        sync_rwlock_write_lock(lock_);
+    }
+    ~ExclusiveLock() __TA_RELEASE() { sync_rwlock_write_unlock(lock_); }
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ExclusiveLock);
+    sync_rwlock_t* const lock_;
+};
+
 #endif // __Fuchsia__
 
 // The Vfs object contains global per-filesystem state, which
@@ -104,7 +131,15 @@ private:
 //
 // The Vfs object must outlive the Vnodes which it serves.
 //
-// This class is thread-safe.
+// This class is thread-safe, and its connections may be served by an async
+// dispatcher running on several threads. Each connection's messages are
+// handled one at a time, but different connections' run concurrently; the
+// Vnodes they reach must lock their own state.
+//
+// Operations which only resolve names, such as path walks, lookups and
+// readdir, hold the namespace lock shared and so run alongside each other.
+// Those which change names, such as create, unlink, rename, link and
+// mounting, hold it exclusively.
 class Vfs {
 public:
     Vfs();
@@ -135,10 +170,13 @@ public:
                      fbl::StringPiece oldStr, fbl::StringPiece newStr) __TA_EXCLUDES(vfs_lock_);
     zx_status_t Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
                        fbl::StringPiece oldStr, fbl::StringPiece newStr) __TA_EXCLUDES(vfs_lock_);
-    // Calls readdir on the Vnode while holding the vfs_lock, preventing path
-    // modification operations for the duration of the operation.
+    // Calls readdir on the Vnode while holding the vfs_lock shared, preventing
+    // path modification operations for the duration of the operation.
     zx_status_t Readdir(Vnode* vn, vdircookie_t* cookie,
                         void* dirents, size_t len, size_t* out_actual) __TA_EXCLUDES(vfs_lock_);
+    // As Readdir, but with the attributes of each entry; see Vnode::ReaddirAttr.
+    zx_status_t ReaddirAttr(Vnode* vn, vdircookie_t* cookie,
+                            void* dirents, size_t len, size_t* out_actual) __TA_EXCLUDES(vfs_lock_);
 
     Vfs(async_t* async);
 
@@ -178,7 +216,7 @@ public:
 
 protected:
     // Whether this file system is read-only.
-    bool ReadonlyLocked() const __TA_REQUIRES(vfs_lock_) { return readonly_; }
+    bool ReadonlyLocked() const __TA_REQUIRES_SHARED(vfs_lock_) { return readonly_; }
 
 private:
     // Starting at vnode |vn|, walk the tree described by the path string,
@@ -189,11 +227,14 @@ private:
     // |out| is the vnode at which we stopped searching
     // |pathout| is the reaminer of the path to search
     zx_status_t Walk(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
-                     fbl::StringPiece path, fbl::StringPiece* pathout) __TA_REQUIRES(vfs_lock_);
+                     fbl::StringPiece path, fbl::StringPiece* pathout)
+        __TA_REQUIRES_SHARED(vfs_lock_);
 
+    // Open, with vfs_lock_ held: exclusively if |flags| include
+    // ZX_FS_FLAG_CREATE, and otherwise at least shared.
     zx_status_t OpenLocked(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
                            fbl::StringPiece path, fbl::StringPiece* pathout,
-                           uint32_t flags, uint32_t mode) __TA_REQUIRES(vfs_lock_);
+                           uint32_t flags, uint32_t mode) __TA_REQUIRES_SHARED(vfs_lock_);
 
     bool readonly_{};
 
@@ -227,8 +268,9 @@ private:
     async_t* async_{};
 
 protected:
-    // A lock which should be used to protect lookup and walk operations
-    mtx_t vfs_lock_{};
+    // Protects the namespace: held shared by lookup and walk operations, and
+    // exclusively by those which add, remove or mount names.
+    sync_rwlock_t vfs_lock_;
 
     // Starts tracking the lifetime of the connection.
     virtual void RegisterConnection(fbl::unique_ptr<Connection> connection);
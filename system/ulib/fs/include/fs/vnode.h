@@ -139,10 +139,9 @@ public:
 
     // Acquire a vmo from a vnode.
     //
-    // At the moment, mmap can only map files from read-only filesystems,
-    // since (without paging) there is no mechanism to update either
-    // 1) The file by writing to the mapping, or
-    // 2) The mapping by writing to the underlying file.
+    // Without paging, a shared mapping only stays coherent with the file if
+    // the filesystem keeps the file's contents in the VMO it hands out, and
+    // writes them back itself.
     virtual zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out);
 
     // Syncs the vnode with its underlying storage
@@ -156,6 +155,11 @@ public:
     virtual zx_status_t Readdir(vdircookie_t* cookie, void* dirents, size_t len,
                                 size_t* out_actual);
 
+    // As Readdir, but fills |dirents| with vdirent_attr_t entries, which
+    // also carry what Getattr would return for each node.
+    virtual zx_status_t ReaddirAttr(vdircookie_t* cookie, void* dirents, size_t len,
+                                    size_t* out_actual);
+
     // METHODS FOR OPENED OR UNOPENED NODES
     //
     // The following operations may be invoked on a Vnode, even if it has
@@ -227,12 +231,21 @@ class DirentFiller {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(DirentFiller);
 
-    DirentFiller(void* ptr, size_t len);
+    // Fills vdirent_attr_t entries if |with_attrs|, for ReaddirAttr, and
+    // vdirent_t ones otherwise.
+    DirentFiller(void* ptr, size_t len, bool with_attrs = false);
+
+    // Whether entries should be added with their attributes.
+    bool WithAttrs() const { return with_attrs_; }
 
     // Attempts to add the name to the end of the dirent buffer
     // which is returned by readdir.
     zx_status_t Next(fbl::StringPiece name, uint32_t type);
 
+    // As above, with the attributes of the node named; they are only kept
+    // if WithAttrs().
+    zx_status_t Next(fbl::StringPiece name, uint32_t type, const vnattr_t& attr);
+
     zx_status_t BytesFilled() const {
         return static_cast<zx_status_t>(pos_);
     }
@@ -241,6 +254,7 @@ private:
     char* ptr_;
     size_t pos_;
     const size_t len_;
+    const bool with_attrs_;
 };
 
 } // namespace fs
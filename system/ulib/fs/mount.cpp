@@ -13,7 +13,6 @@
 #include <fdio/remoteio.h>
 #include <fdio/vfs.h>
 #include <fbl/alloc_checker.h>
-#include <fbl/auto_lock.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/type_support.h>
@@ -46,25 +45,9 @@ bool Vfs::MountNode::VnodeMatch(fbl::RefPtr<Vnode> vn) const {
 
 // Installs a remote filesystem on vn and adds it to the remote_list_.
 zx_status_t Vfs::InstallRemote(fbl::RefPtr<Vnode> vn, MountChannel h) {
-    if (vn == nullptr) {
-        return ZX_ERR_ACCESS_DENIED;
-    }
-
-    // Allocate a node to track the remote handle
-    fbl::AllocChecker ac;
-    fbl::unique_ptr<MountNode> mount_point(new (&ac) MountNode());
-    if (!ac.check()) {
-        return ZX_ERR_NO_MEMORY;
-    }
-    zx_status_t status = vn->AttachRemote(fbl::move(h));
-    if (status != ZX_OK) {
-        return status;
-    }
-    // Save this node in the list of mounted vnodes
-    mount_point->SetNode(fbl::move(vn));
-    fbl::AutoLock lock(&vfs_lock_);
-    remote_list_.push_front(fbl::move(mount_point));
-    return ZX_OK;
+    // Walks may be looking at |vn| on other threads.
+    ExclusiveLock lock(&vfs_lock_);
+    return InstallRemoteLocked(fbl::move(vn), fbl::move(h));
 }
 
 // Installs a remote filesystem on vn and adds it to the remote_list_.
@@ -91,7 +74,7 @@ zx_status_t Vfs::InstallRemoteLocked(fbl::RefPtr<Vnode> vn, MountChannel h) {
 
 zx_status_t Vfs::MountMkdir(fbl::RefPtr<Vnode> vn, fbl::StringPiece name, MountChannel h,
                             uint32_t flags) {
-    fbl::AutoLock lock(&vfs_lock_);
+    ExclusiveLock lock(&vfs_lock_);
     zx_status_t r = OpenLocked(vn, &vn, name, &name, ZX_FS_FLAG_CREATE |
                                ZX_FS_RIGHT_READABLE | ZX_FS_FLAG_DIRECTORY |
                                ZX_FS_FLAG_NOREMOTE, S_IFDIR);
@@ -114,19 +97,24 @@ zx_status_t Vfs::MountMkdir(fbl::RefPtr<Vnode> vn, fbl::StringPiece name, MountC
 }
 
 zx_status_t Vfs::UninstallRemote(fbl::RefPtr<Vnode> vn, zx::channel* h) {
-    fbl::AutoLock lock(&vfs_lock_);
+    ExclusiveLock lock(&vfs_lock_);
     return UninstallRemoteLocked(fbl::move(vn), h);
 }
 
 zx_status_t Vfs::ForwardMessageRemote(fbl::RefPtr<Vnode> vn, zx::channel channel,
                                       zxrio_msg_t* msg) {
-    fbl::AutoLock lock(&vfs_lock_);
-    zx_handle_t h = vn->GetRemote();
-    if (h == ZX_HANDLE_INVALID) {
-        return ZX_ERR_NOT_FOUND;
+    zx_status_t r;
+    {
+        SharedLock lock(&vfs_lock_);
+        zx_handle_t h = vn->GetRemote();
+        if (h == ZX_HANDLE_INVALID) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        r = zxrio_txn_handoff(h, channel.release(), msg);
     }
-    zx_status_t r = zxrio_txn_handoff(h, channel.release(), msg);
     if (r == ZX_ERR_PEER_CLOSED) {
+        // Another thread may have unmounted it meanwhile, which is fine.
+        ExclusiveLock lock(&vfs_lock_);
         zx::channel c;
         UninstallRemoteLocked(fbl::move(vn), &c);
     }
@@ -152,17 +140,17 @@ zx_status_t Vfs::UninstallRemoteLocked(fbl::RefPtr<Vnode> vn, zx::channel* h) {
 // Uninstall all remote filesystems. Acts like 'UninstallRemote' for all
 // known remotes.
 zx_status_t Vfs::UninstallAll(zx_time_t deadline) {
-    fbl::unique_ptr<MountNode> mount_point;
     for (;;) {
+        zx::channel remote;
         {
-            fbl::AutoLock lock(&vfs_lock_);
-            mount_point = remote_list_.pop_front();
-        }
-        if (mount_point) {
-            vfs_unmount_handle(mount_point->ReleaseRemote().release(), deadline);
-        } else {
-            return ZX_OK;
+            ExclusiveLock lock(&vfs_lock_);
+            fbl::unique_ptr<MountNode> mount_point = remote_list_.pop_front();
+            if (!mount_point) {
+                return ZX_OK;
+            }
+            remote = mount_point->ReleaseRemote();
         }
+        vfs_unmount_handle(remote.release(), deadline);
     }
 }
 
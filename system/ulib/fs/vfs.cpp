@@ -11,7 +11,6 @@
 #include <unistd.h>
 
 #ifdef __Fuchsia__
-#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fs/connection.h>
 #include <fs/remote.h>
@@ -120,7 +119,11 @@ zx_status_t Vfs::Open(fbl::RefPtr<Vnode> vndir, fbl::RefPtr<Vnode>* out,
                       fbl::StringPiece path, fbl::StringPiece* pathout, uint32_t flags,
                       uint32_t mode) {
 #ifdef __Fuchsia__
-    fbl::AutoLock lock(&vfs_lock_);
+    if (flags & ZX_FS_FLAG_CREATE) {
+        ExclusiveLock lock(&vfs_lock_);
+        return OpenLocked(fbl::move(vndir), out, path, pathout, flags, mode);
+    }
+    SharedLock lock(&vfs_lock_);
 #endif
     return OpenLocked(fbl::move(vndir), out, path, pathout, flags, mode);
 }
@@ -227,7 +230,7 @@ zx_status_t Vfs::Unlink(fbl::RefPtr<Vnode> vndir, fbl::StringPiece path) {
 
     {
 #ifdef __Fuchsia__
-        fbl::AutoLock lock(&vfs_lock_);
+        ExclusiveLock lock(&vfs_lock_);
 #endif
         if (ReadonlyLocked()) {
             r = ZX_ERR_ACCESS_DENIED;
@@ -247,7 +250,8 @@ zx_status_t Vfs::Unlink(fbl::RefPtr<Vnode> vndir, fbl::StringPiece path) {
 #define TOKEN_RIGHTS (ZX_RIGHTS_BASIC)
 
 void Vfs::TokenDiscard(zx::event ios_token) {
-    fbl::AutoLock lock(&vfs_lock_);
+    // Tokens are only resolved with the lock held exclusively.
+    SharedLock lock(&vfs_lock_);
     if (ios_token) {
         // The token is cleared here to prevent the following race condition:
         // 1) Open
@@ -267,7 +271,7 @@ zx_status_t Vfs::VnodeToToken(fbl::RefPtr<Vnode> vn, zx::event* ios_token,
     uint64_t vnode_cookie = reinterpret_cast<uint64_t>(vn.get());
     zx_status_t r;
 
-    fbl::AutoLock lock(&vfs_lock_);
+    SharedLock lock(&vfs_lock_);
     if (ios_token->is_valid()) {
         // Token has already been set for this iostate
         if ((r = ios_token->duplicate(TOKEN_RIGHTS, out) != ZX_OK)) {
@@ -329,7 +333,7 @@ zx_status_t Vfs::Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
 
     fbl::RefPtr<fs::Vnode> newparent;
     {
-        fbl::AutoLock lock(&vfs_lock_);
+        ExclusiveLock lock(&vfs_lock_);
         if (ReadonlyLocked()) {
             return ZX_ERR_ACCESS_DENIED;
         }
@@ -350,13 +354,19 @@ zx_status_t Vfs::Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
 
 zx_status_t Vfs::Readdir(Vnode* vn, vdircookie_t* cookie,
                          void* dirents, size_t len, size_t* out_actual) {
-    fbl::AutoLock lock(&vfs_lock_);
+    SharedLock lock(&vfs_lock_);
     return vn->Readdir(cookie, dirents, len, out_actual);
 }
 
+zx_status_t Vfs::ReaddirAttr(Vnode* vn, vdircookie_t* cookie,
+                             void* dirents, size_t len, size_t* out_actual) {
+    SharedLock lock(&vfs_lock_);
+    return vn->ReaddirAttr(cookie, dirents, len, out_actual);
+}
+
 zx_status_t Vfs::Link(zx::event token, fbl::RefPtr<Vnode> oldparent,
                       fbl::StringPiece oldStr, fbl::StringPiece newStr) {
-    fbl::AutoLock lock(&vfs_lock_);
+    ExclusiveLock lock(&vfs_lock_);
     fbl::RefPtr<fs::Vnode> newparent;
     zx_status_t r;
     if ((r = TokenToVnode(fbl::move(token), &newparent)) != ZX_OK) {
@@ -503,7 +513,7 @@ zx_status_t Vfs::Ioctl(fbl::RefPtr<Vnode> vn, uint32_t op, const void* in_buf, s
 
 void Vfs::SetReadonly(bool value) {
 #ifdef __Fuchsia__
-    fbl::AutoLock lock(&vfs_lock_);
+    ExclusiveLock lock(&vfs_lock_);
 #endif
     readonly_ = value;
 }
@@ -143,6 +143,10 @@ zx_status_t VmoFile::GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* type
 
 zx_status_t VmoFile::Mmap(int flags, size_t length, size_t* off, zx_handle_t* out) {
     ZX_DEBUG_ASSERT(!(flags & FDIO_MMAP_FLAG_WRITE) || writable_); // checked by the VFS
+    if (flags & FDIO_MMAP_FLAG_STABLE) {
+        // Whoever owns the VMO may change it at any time.
+        return ZX_ERR_NOT_SUPPORTED;
+    }
 
     // |length| is ignored, the VMO is fully populated with whatever data we have
     zx::vmo vmo;
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <fbl/algorithm.h>
 #include <fs/vnode.h>
 
 #ifdef __Fuchsia__
@@ -73,6 +74,11 @@ zx_status_t Vnode::Readdir(vdircookie_t* cookie, void* dirents, size_t len, size
     return ZX_ERR_NOT_SUPPORTED;
 }
 
+zx_status_t Vnode::ReaddirAttr(vdircookie_t* cookie, void* dirents, size_t len,
+                               size_t* out_actual) {
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
 zx_status_t Vnode::Create(fbl::RefPtr<Vnode>* out, fbl::StringPiece name, uint32_t mode) {
     return ZX_ERR_NOT_SUPPORTED;
 }
@@ -130,10 +136,17 @@ void Vnode::SetRemote(zx::channel remote) {
 }
 #endif
 
-DirentFiller::DirentFiller(void* ptr, size_t len)
-    : ptr_(static_cast<char*>(ptr)), pos_(0), len_(len) {}
+DirentFiller::DirentFiller(void* ptr, size_t len, bool with_attrs)
+    : ptr_(static_cast<char*>(ptr)), pos_(0), len_(len), with_attrs_(with_attrs) {}
 
 zx_status_t DirentFiller::Next(fbl::StringPiece name, uint32_t type) {
+    if (with_attrs_) {
+        // Only the type is known.
+        vnattr_t attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.mode = DTYPE_TO_VTYPE(type);
+        return Next(name, type, attr);
+    }
     vdirent_t* de = reinterpret_cast<vdirent_t*>(ptr_ + pos_);
     size_t sz = sizeof(vdirent_t) + name.length() + 1;
 
@@ -152,4 +165,23 @@ zx_status_t DirentFiller::Next(fbl::StringPiece name, uint32_t type) {
     return ZX_OK;
 }
 
+zx_status_t DirentFiller::Next(fbl::StringPiece name, uint32_t type, const vnattr_t& attr) {
+    if (!with_attrs_) {
+        return Next(name, type);
+    }
+    vdirent_attr_t* de = reinterpret_cast<vdirent_attr_t*>(ptr_ + pos_);
+    size_t sz = fbl::round_up(sizeof(vdirent_attr_t) + name.length() + 1,
+                              alignof(vdirent_attr_t));
+    if (sz > len_ - pos_) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    de->size = static_cast<uint32_t>(sz);
+    de->type = type;
+    de->attr = attr;
+    memcpy(de->name, name.data(), name.length());
+    de->name[name.length()] = 0;
+    pos_ += sz;
+    return ZX_OK;
+}
+
 } // namespace fs
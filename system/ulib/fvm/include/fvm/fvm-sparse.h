@@ -41,9 +41,18 @@ namespace fvm {
 //   P0, Extent 2
 //   P1, Extent 0
 //   P2, Extent 0
+//
+// If |flags| has kSparseFlagLz4 set, everything following the header is a
+// stream of LZ4 frames (as defined by lz4frame.h) which decompresses to the
+// DATA section above. The header itself is never compressed, so a reader
+// can allocate partitions before any data arrives, and then decompress and
+// write the data as it is received.
 
 constexpr uint64_t kSparseFormatMagic = (0x53525053204d5646ull); // 'FVM SPRS'
-constexpr uint64_t kSparseFormatVersion = 0x1;
+constexpr uint64_t kSparseFormatVersion = 0x2;
+
+constexpr uint64_t kSparseFlagLz4 = 0x1;
+constexpr uint64_t kSparseFlagAllValid = kSparseFlagLz4;
 
 typedef struct sparse_image {
     uint64_t magic;
@@ -51,6 +60,7 @@ typedef struct sparse_image {
     uint64_t header_length;
     uint64_t slice_size; // Unit: Bytes
     uint64_t partition_count;
+    uint64_t flags;
 } __attribute__((packed)) sparse_image_t;
 
 constexpr uint64_t kPartitionDescriptorMagic = (0x0bde4df7cf5c4c5dull);
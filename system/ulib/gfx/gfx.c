@@ -76,6 +76,42 @@ static uint32_t ARGB8888_to_RGB2220(uint32_t in) {
     return out;
 }
 
+// Grows the surface's dirty bounds to cover a rect, which has been clipped.
+static void mark_dirty(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height) {
+    if (surface->dirty_x1 <= surface->dirty_x0) {
+        surface->dirty_x0 = x;
+        surface->dirty_y0 = y;
+        surface->dirty_x1 = x + width;
+        surface->dirty_y1 = y + height;
+        return;
+    }
+    if (x < surface->dirty_x0)
+        surface->dirty_x0 = x;
+    if (y < surface->dirty_y0)
+        surface->dirty_y0 = y;
+    if (x + width > surface->dirty_x1)
+        surface->dirty_x1 = x + width;
+    if (y + height > surface->dirty_y1)
+        surface->dirty_y1 = y + height;
+}
+
+bool gfx_surface_get_dirty(gfx_surface* surface, gfx_rect* out) {
+    if (surface->dirty_x1 <= surface->dirty_x0)
+        return false;
+    out->x = surface->dirty_x0;
+    out->y = surface->dirty_y0;
+    out->width = surface->dirty_x1 - surface->dirty_x0;
+    out->height = surface->dirty_y1 - surface->dirty_y0;
+    return true;
+}
+
+void gfx_surface_clear_dirty(gfx_surface* surface) {
+    surface->dirty_x0 = 0;
+    surface->dirty_y0 = 0;
+    surface->dirty_x1 = 0;
+    surface->dirty_y1 = 0;
+}
+
 /**
  * @brief  Copy a rectangle of pixels from one part of the display to another.
  */
@@ -105,6 +141,7 @@ void gfx_copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width,
         height = surface->height - y2;
 
     surface->copyrect(surface, x, y, width, height, x2, y2);
+    mark_dirty(surface, x2, y2, width, height);
 }
 
 void gfx_copylines(gfx_surface* dst, gfx_surface* src, unsigned srcy, unsigned dsty, unsigned height) {
@@ -120,6 +157,9 @@ void gfx_copylines(gfx_surface* dst, gfx_surface* src, unsigned srcy, unsigned d
     memcpy(dst->ptr + dsty * dst->stride * dst->pixelsize,
            src->ptr + srcy * src->stride * src->pixelsize,
            height * src->stride * src->pixelsize);
+    if (height > 0) {
+        mark_dirty(dst, 0, dsty, dst->width, height);
+    }
 }
 
 /**
@@ -144,6 +184,7 @@ void gfx_fillrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width,
         height = surface->height - y;
 
     surface->fillrect(surface, x, y, width, height, color);
+    mark_dirty(surface, x, y, width, height);
 }
 
 /**
@@ -156,6 +197,7 @@ void gfx_putpixel(gfx_surface* surface, unsigned x, unsigned y, unsigned color)
         return;
 
     surface->putpixel(surface, x, y, color);
+    mark_dirty(surface, x, y, 1, 1);
 }
 
 static void putpixel16(gfx_surface* surface, unsigned x, unsigned y, unsigned color) {
@@ -212,157 +254,74 @@ void gfx_putchar(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
         bg = surface->translate_color(bg);
     }
     surface->putchar(surface, font, ch, x, y, fg, bg);
+    mark_dirty(surface, x, y, font->width, font->height);
 }
 
-static void copyrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint8_t* src = &((const uint8_t*)surface->ptr)[x + y * surface->stride];
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
+// Copies are done a row at a time with memmove, which is optimized for each
+// architecture and copes with the rows overlapping. Rows are visited in the
+// order that keeps the source rows from being overwritten before they are
+// copied.
+static void copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
+    size_t row_bytes = surface->stride * surface->pixelsize;
+    size_t len = width * surface->pixelsize;
+    const uint8_t* src = (const uint8_t*)surface->ptr + (x + y * surface->stride) * surface->pixelsize;
+    uint8_t* dest = (uint8_t*)surface->ptr + (x2 + y2 * surface->stride) * surface->pixelsize;
+
+    if (y2 <= y) {
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest += row_bytes;
+            src += row_bytes;
         }
     } else {
         // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
+        src += (height - 1) * row_bytes;
+        dest += (height - 1) * row_bytes;
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest -= row_bytes;
+            src -= row_bytes;
         }
     }
 }
 
-static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    uint8_t color8 = (uint8_t)(surface->translate_color(color));
-
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color8;
-            dest++;
-        }
-        dest += stride_diff;
+// Fills write the first row of the rect a pixel at a time, then copy that
+// row into the rest.
+static void fillrect_copy_rows(gfx_surface* surface, uint8_t* first, unsigned width, unsigned height) {
+    size_t row_bytes = surface->stride * surface->pixelsize;
+    size_t len = width * surface->pixelsize;
+    uint8_t* dest = first + row_bytes;
+    for (unsigned i = 1; i < height; i++) {
+        memcpy(dest, first, len);
+        dest += row_bytes;
     }
 }
 
-static void copyrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint16_t* src = &((const uint16_t*)surface->ptr)[x + y * surface->stride];
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
+static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
+    uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
+    uint8_t color8 = (uint8_t)(surface->translate_color(color));
 
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
-    }
+    memset(dest, color8, width);
+    fillrect_copy_rows(surface, dest, width, height);
 }
 
 static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint16_t* dest = &((uint16_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
     uint16_t color16 = (uint16_t)(surface->translate_color(color));
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color16;
-            dest++;
-        }
-        dest += stride_diff;
-    }
-}
-
-static void copyrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint32_t* src = &((const uint32_t*)surface->ptr)[x + y * surface->stride];
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
+    for (unsigned j = 0; j < width; j++) {
+        dest[j] = color16;
     }
+    fillrect_copy_rows(surface, (uint8_t*)dest, width, height);
 }
 
 static void fillrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint32_t* dest = &((uint32_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color;
-            dest++;
-        }
-        dest += stride_diff;
+    for (unsigned j = 0; j < width; j++) {
+        dest[j] = color;
     }
+    fillrect_copy_rows(surface, (uint8_t*)dest, width, height);
 }
 
 void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsigned y2, unsigned color) {
@@ -391,6 +350,8 @@ void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsig
     unsigned px = x1;
     unsigned py = y1;
 
+    mark_dirty(surface, (x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2, dxabs + 1, dyabs + 1);
+
     if (dxabs >= dyabs) {
         // mostly horizontal line.
         for (unsigned i = 0; i < dxabs; i++) {
@@ -452,6 +413,19 @@ uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src) {
     return (srca << 24) | (cres[0] << 16) | (cres[1] << 8) | (cres[2]);
 }
 
+// Copies a rect between surfaces of the same format a row at a time.
+static void blit_rows(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned srcy, unsigned width, unsigned height, unsigned destx, unsigned desty) {
+    size_t pixelsize = source->pixelsize;
+    const uint8_t* src = (const uint8_t*)source->ptr + (srcx + srcy * source->stride) * pixelsize;
+    uint8_t* dest = (uint8_t*)target->ptr + (destx + desty * target->stride) * pixelsize;
+
+    for (unsigned i = 0; i < height; i++) {
+        memmove(dest, src, width * pixelsize);
+        dest += target->stride * pixelsize;
+        src += source->stride * pixelsize;
+    }
+}
+
 /**
  * @brief  Copy pixels from source to dest.
  *
@@ -489,26 +463,14 @@ void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned
     if (srcy + height > source->height)
         height = source->height - srcy;
 
+    if (width == 0 || height == 0)
+        return;
+    mark_dirty(target, destx, desty, width, height);
+
     // XXX total hack to deal with various blends
     if (source->format == ZX_PIXEL_FORMAT_RGB_565 && target->format == ZX_PIXEL_FORMAT_RGB_565) {
         // 16 bit to 16 bit
-        const uint16_t* src = &((const uint16_t*)source->ptr)[srcx + srcy * source->stride];
-        uint16_t* dest = &((uint16_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
+        blit_rows(target, source, srcx, srcy, width, height, destx, desty);
     } else if (source->format == ZX_PIXEL_FORMAT_ARGB_8888 && target->format == ZX_PIXEL_FORMAT_ARGB_8888) {
         // both are 32 bit modes, both alpha
         const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
@@ -529,44 +491,10 @@ void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned
             dest += dest_stride_diff;
             src += source_stride_diff;
         }
-    } else if (source->format == ZX_PIXEL_FORMAT_RGB_x888 && target->format == ZX_PIXEL_FORMAT_RGB_x888) {
-        // both are 32 bit modes, no alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == ZX_PIXEL_FORMAT_MONO_8 && target->format == ZX_PIXEL_FORMAT_MONO_8) {
-        // both are 8 bit modes, no alpha
-        const uint8_t* src = &((const uint8_t*)source->ptr)[srcx + srcy * source->stride];
-        uint8_t* dest = &((uint8_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
+    } else if ((source->format == ZX_PIXEL_FORMAT_RGB_x888 && target->format == ZX_PIXEL_FORMAT_RGB_x888) ||
+               (source->format == ZX_PIXEL_FORMAT_MONO_8 && target->format == ZX_PIXEL_FORMAT_MONO_8)) {
+        // both are 32 or 8 bit modes, no alpha
+        blit_rows(target, source, srcx, srcy, width, height, destx, desty);
     } else {
         xprintf("gfx_surface_blend: unimplemented colorspace combination (source %d target %d)\n", source->format, target->format);
         assert(0);
@@ -639,12 +567,13 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     surface->height = height;
     surface->stride = stride;
     surface->alpha = MAX_ALPHA;
+    gfx_surface_clear_dirty(surface);
 
     // set up some function pointers
     switch (format) {
     case ZX_PIXEL_FORMAT_RGB_565:
         surface->translate_color = &ARGB8888_to_RGB565;
-        surface->copyrect = &copyrect16;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect16;
         surface->putpixel = &putpixel16;
         surface->putchar = &putchar16;
@@ -654,7 +583,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     case ZX_PIXEL_FORMAT_RGB_x888:
     case ZX_PIXEL_FORMAT_ARGB_8888:
         surface->translate_color = NULL;
-        surface->copyrect = &copyrect32;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect32;
         surface->putpixel = &putpixel32;
         surface->putchar = &putchar32;
@@ -663,7 +592,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case ZX_PIXEL_FORMAT_MONO_8:
         surface->translate_color = &ARGB8888_to_Luma;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -672,7 +601,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case ZX_PIXEL_FORMAT_RGB_332:
         surface->translate_color = &ARGB8888_to_RGB332;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -681,7 +610,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case ZX_PIXEL_FORMAT_RGB_2220:
         surface->translate_color = &ARGB8888_to_RGB2220;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
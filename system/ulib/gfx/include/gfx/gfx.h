@@ -53,8 +53,22 @@ struct gfx_surface {
     void (*putpixel)(gfx_surface*, unsigned x, unsigned y, unsigned color);
     void (*putchar)(gfx_surface*, const gfx_font*, unsigned ch, unsigned x, unsigned y, unsigned fg, unsigned bg);
     void (*flush)(unsigned starty, unsigned endy);
+
+    // bounds of everything drawn through the gfx_* calls since the last
+    // gfx_surface_clear_dirty(), empty when dirty_x1 <= dirty_x0
+    unsigned dirty_x0;
+    unsigned dirty_y0;
+    unsigned dirty_x1;
+    unsigned dirty_y1;
 };
 
+typedef struct gfx_rect {
+    unsigned x;
+    unsigned y;
+    unsigned width;
+    unsigned height;
+} gfx_rect;
+
 struct gfx_font {
     const uint16_t* data;
     unsigned width;
@@ -93,10 +107,18 @@ void gfx_flush_rows(struct gfx_surface* surface, unsigned start, unsigned end);
 
 // clear the entire surface with a color
 static inline void gfx_clear(gfx_surface* surface, unsigned color) {
-    surface->fillrect(surface, 0, 0, surface->width, surface->height, color);
+    gfx_fillrect(surface, 0, 0, surface->width, surface->height, color);
     gfx_flush(surface);
 }
 
+// returns whether anything has been drawn into the surface since the last
+// gfx_surface_clear_dirty() and if so, the smallest rect holding all of it,
+// so that only that much needs to be flushed to the display
+bool gfx_surface_get_dirty(gfx_surface* surface, gfx_rect* out);
+
+// forget what has been drawn so far
+void gfx_surface_clear_dirty(gfx_surface* surface);
+
 // surface setup
 gfx_surface* gfx_create_surface(void* ptr, unsigned width, unsigned height, unsigned stride, unsigned format, uint32_t flags);
 zx_status_t gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned height, unsigned stride, unsigned format, uint32_t flags);
@@ -0,0 +1,107 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <hid-parser/decoder.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/new.h>
+
+namespace {
+
+int64_t physical_scale(const hid::Attributes& attr) {
+    int64_t logc_range = static_cast<int64_t>(attr.logc_mm.max) - attr.logc_mm.min;
+    int64_t phys_range = static_cast<int64_t>(attr.phys_mm.max) - attr.phys_mm.min;
+    if (logc_range == 0 || phys_range == 0)
+        return 1 << 16;
+    return (phys_range << 16) / logc_range;
+}
+
+}  // namespace
+
+namespace hid {
+
+ParseResult MakeReportDecoder(
+    const ReportDescriptor& report, NodeType type,
+    ReportDecoder** decoder) {
+
+    // First pass counts the data fields so the decoder can be allocated
+    // in one go.
+    size_t count = 0;
+    for (size_t ix = 0; ix != report.count; ++ix) {
+        const auto& f = report.first_field[ix];
+        if (f.type != type || (f.flags & kConstant))
+            continue;
+        if (f.attr.bit_sz == 0 || f.attr.bit_sz > 32)
+            return kParseUnsuported;
+        ++count;
+    }
+
+    fbl::AllocChecker ac;
+    auto mem = new (&ac) char[sizeof(ReportDecoder) + count * sizeof(FieldDecoder)];
+    if (!ac.check())
+        return kParseNoMemory;
+
+    auto dec = new (mem) ReportDecoder;
+    dec->report_id = report.report_id;
+    dec->type = type;
+    dec->count = count;
+
+    uint32_t bit_offset = (report.report_id != 0) ? 8u : 0u;
+    size_t ifd = 0;
+    for (size_t ix = 0; ix != report.count; ++ix) {
+        const auto& f = report.first_field[ix];
+        if (f.type != type)
+            continue;
+        if (!(f.flags & kConstant)) {
+            auto& fd = dec->field[ifd++];
+            fd.bit_offset = bit_offset;
+            fd.bit_sz = f.attr.bit_sz;
+            fd.is_signed = f.attr.logc_mm.min < 0;
+            fd.mask = (f.attr.bit_sz == 32) ? ~0u : (1u << f.attr.bit_sz) - 1;
+            fd.usage = f.attr.usage;
+            fd.flags = f.flags;
+            fd.logc_mm = f.attr.logc_mm;
+            bool has_phys = (f.attr.phys_mm.min != 0) || (f.attr.phys_mm.max != 0);
+            fd.phys_base = has_phys ? f.attr.phys_mm.min : f.attr.logc_mm.min;
+            fd.scale = has_phys ? physical_scale(f.attr) : (1 << 16);
+            fd.field = &f;
+        }
+        bit_offset += f.attr.bit_sz;
+    }
+
+    dec->byte_sz = (bit_offset + 7) / 8;
+    *decoder = dec;
+    return kParseOk;
+}
+
+bool DecodeReport(
+    const ReportDecoder& decoder, const uint8_t* report, size_t len,
+    int32_t* values) {
+
+    // Checking the length once up front keeps the loop below free of
+    // bounds checks.
+    if (len < decoder.byte_sz)
+        return false;
+    if ((decoder.report_id != 0) && (report[0] != decoder.report_id))
+        return false;
+
+    for (size_t ix = 0; ix != decoder.count; ++ix) {
+        const auto& fd = decoder.field[ix];
+        const uint8_t* src = report + (fd.bit_offset >> 3);
+        uint32_t shift = fd.bit_offset & 7;
+        uint32_t last = (shift + fd.bit_sz - 1) >> 3;
+
+        uint64_t raw = 0;
+        for (uint32_t ib = 0; ib <= last; ++ib)
+            raw |= static_cast<uint64_t>(src[ib]) << (8 * ib);
+
+        uint32_t value = static_cast<uint32_t>(raw >> shift) & fd.mask;
+        if (fd.is_signed && (value & (1u << (fd.bit_sz - 1))))
+            value |= ~fd.mask;
+        values[ix] = static_cast<int32_t>(value);
+    }
+    return true;
+}
+
+}  // namespace hid
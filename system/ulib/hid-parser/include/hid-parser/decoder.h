@@ -0,0 +1,79 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <hid-parser/parser.h>
+
+namespace hid {
+
+// Walking the ReportField array for every report means recomputing the
+// bit position of each field from the sizes of all the fields before it.
+// For devices that send reports at a high rate, such as touchscreens and
+// mice, MakeReportDecoder() does that walk once and produces a flat list
+// with one entry per data field of a given report, in report order:
+//
+//   ReportDecoder
+//     +report_id, type, byte_sz
+//     +field[0]  bit_offset, bit_sz, usage, ...
+//     +field[1]  ...
+//
+// Constant fields are padding; they only advance the bit offset and do
+// not get an entry. Decoding a report with DecodeReport() is then a single
+// pass over |field| with no lookups.
+//
+// The decoder is a single heap allocation and is freed by standard C++
+// delete. It refers back to the DeviceDescriptor it was made from through
+// FieldDecoder::field, so it must not outlive it.
+
+struct FieldDecoder {
+    // Position of the field in the report, counting the report id byte.
+    uint32_t bit_offset;
+    uint8_t bit_sz;
+    // The logical minimum is negative, so the value must be sign extended.
+    bool is_signed;
+    uint32_t mask;
+    Usage usage;
+    uint32_t flags;
+    MinMax logc_mm;
+    // Physical value = phys_base + ((logical - logc_mm.min) * scale >> 16).
+    int32_t phys_base;
+    int64_t scale;
+    const ReportField* field;
+};
+
+struct ReportDecoder {
+    uint8_t report_id;
+    NodeType type;
+    // Length in bytes of a full report, including the report id if any.
+    size_t byte_sz;
+    size_t count;
+    FieldDecoder field[];
+};
+
+// Builds the decoder for the fields of |type| in |report|. Data fields
+// wider than 32 bits are not supported.
+ParseResult MakeReportDecoder(
+    const ReportDescriptor& report, NodeType type,
+    ReportDecoder** decoder);
+
+// Extracts the logical value of every field of the |len| byte |report|
+// into |values|, which must have room for |decoder.count| entries. Returns
+// false if the report is too short or carries a different report id.
+bool DecodeReport(
+    const ReportDecoder& decoder, const uint8_t* report, size_t len,
+    int32_t* values);
+
+// Converts a logical value extracted by DecodeReport() into physical
+// units. Fields without a physical range report their logical value.
+inline int32_t ToPhysical(const FieldDecoder& field, int32_t value) {
+    return field.phys_base +
+        static_cast<int32_t>((static_cast<int64_t>(value) - field.logc_mm.min) *
+                             field.scale >> 16);
+}
+
+}  // namespace hid
@@ -9,6 +9,7 @@ MODULE := $(LOCAL_DIR)
 MODULE_TYPE := userlib
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/decoder.cpp \
     $(LOCAL_DIR)/item.cpp \
     $(LOCAL_DIR)/parser.cpp
 
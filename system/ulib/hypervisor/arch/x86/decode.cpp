@@ -4,6 +4,7 @@
 
 #include <hypervisor/x86/decode.h>
 
+#include <stddef.h>
 #include <string.h>
 
 #include <zircon/syscalls/hypervisor.h>
@@ -301,3 +302,56 @@ zx_status_t inst_decode(const uint8_t* inst_buf, uint32_t inst_len, zx_vcpu_stat
         return ZX_ERR_NOT_SUPPORTED;
     }
 }
+
+static uint32_t inst_hash(const uint8_t* inst_buf, uint32_t inst_len) {
+    // FNV-1a.
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < inst_len; i++) {
+        hash ^= inst_buf[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int16_t state_offset(const zx_vcpu_state_t* vcpu_state, const uint64_t* field) {
+    if (field == NULL)
+        return -1;
+    return static_cast<int16_t>(reinterpret_cast<const uint8_t*>(field) -
+                                reinterpret_cast<const uint8_t*>(vcpu_state));
+}
+
+static uint64_t* state_field(zx_vcpu_state_t* vcpu_state, int16_t offset) {
+    if (offset < 0)
+        return NULL;
+    return reinterpret_cast<uint64_t*>(reinterpret_cast<uint8_t*>(vcpu_state) + offset);
+}
+
+zx_status_t inst_decode_cached(inst_cache_t* cache, const uint8_t* inst_buf, uint32_t inst_len,
+                               zx_vcpu_state_t* vcpu_state, instruction_t* inst) {
+    if (inst_len == 0 || inst_len > X86_MAX_INST_LEN)
+        return inst_decode(inst_buf, inst_len, vcpu_state, inst);
+
+    inst_cache_entry_t* entry =
+        &cache->entries[inst_hash(inst_buf, inst_len) % INST_CACHE_SIZE];
+    if (entry->inst_len == inst_len && memcmp(entry->inst_buf, inst_buf, inst_len) == 0) {
+        inst->type = entry->type;
+        inst->access_size = entry->access_size;
+        inst->imm = entry->imm;
+        inst->reg = state_field(vcpu_state, entry->reg);
+        inst->flags = state_field(vcpu_state, entry->flags);
+        return ZX_OK;
+    }
+
+    zx_status_t status = inst_decode(inst_buf, inst_len, vcpu_state, inst);
+    if (status != ZX_OK)
+        return status;
+
+    entry->inst_len = static_cast<uint8_t>(inst_len);
+    memcpy(entry->inst_buf, inst_buf, inst_len);
+    entry->type = inst->type;
+    entry->access_size = inst->access_size;
+    entry->imm = inst->imm;
+    entry->reg = state_offset(vcpu_state, inst->reg);
+    entry->flags = state_offset(vcpu_state, inst->flags);
+    return ZX_OK;
+}
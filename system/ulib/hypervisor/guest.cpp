@@ -20,9 +20,6 @@
 
 static const char kResourcePath[] = "/dev/misc/sysinfo";
 
-// Number of threads reading from the async device port.
-static const size_t kNumAsyncWorkers = 1;
-
 static zx_status_t guest_get_resource(zx_handle_t* resource) {
     int fd = open(kResourcePath, O_RDWR);
     if (fd < 0)
@@ -53,39 +50,58 @@ zx_status_t Guest::Init(size_t mem_size) {
     }
     zx_handle_close(resource);
 
-    status = zx::port::create(0, &port_);
+    return ZX_OK;
+}
+
+Guest::~Guest() {
+    zx_handle_close(guest_);
+}
+
+zx_status_t Guest::GetIoPort(IoHandler* handler, zx_handle_t* port) {
+    for (const auto& io_port : io_ports_) {
+        if (io_port.handler == handler) {
+            *port = io_port.port.get();
+            return ZX_OK;
+        }
+    }
+
+    fbl::AllocChecker ac;
+    auto io_port = fbl::make_unique_checked<IoPort>(&ac);
+    if (!ac.check())
+        return ZX_ERR_NO_MEMORY;
+    io_port->handler = handler;
+
+    zx_status_t status = zx::port::create(0, &io_port->port);
     if (status != ZX_OK) {
         fprintf(stderr, "Failed to create port.\n");
         return status;
     }
 
-    for (size_t i = 0; i < kNumAsyncWorkers; ++i) {
-        thrd_t thread;
-        auto thread_func = +[](void* arg) { return static_cast<Guest*>(arg)->IoThread(); };
-        int ret = thrd_create_with_name(&thread, thread_func, this, "io-handler");
-        if (ret != thrd_success) {
-            fprintf(stderr, "Failed to create io handler thread: %d\n", ret);
-            return ZX_ERR_INTERNAL;
-        }
+    // As with the VCPUs, the thread refers to the port for the lifetime of
+    // the guest.
+    thrd_t thread;
+    auto thread_func = +[](void* arg) { return IoThread(static_cast<IoPort*>(arg)->port); };
+    int ret = thrd_create_with_name(&thread, thread_func, io_port.get(), "io-handler");
+    if (ret != thrd_success) {
+        fprintf(stderr, "Failed to create io handler thread: %d\n", ret);
+        return ZX_ERR_INTERNAL;
+    }
 
-        ret = thrd_detach(thread);
-        if (ret != thrd_success) {
-            fprintf(stderr, "Failed to detach io handler thread: %d\n", ret);
-            return ZX_ERR_INTERNAL;
-        }
+    ret = thrd_detach(thread);
+    if (ret != thrd_success) {
+        fprintf(stderr, "Failed to detach io handler thread: %d\n", ret);
+        return ZX_ERR_INTERNAL;
     }
 
+    *port = io_port->port.get();
+    io_ports_.push_front(fbl::move(io_port));
     return ZX_OK;
 }
 
-Guest::~Guest() {
-    zx_handle_close(guest_);
-}
-
-zx_status_t Guest::IoThread() {
+zx_status_t Guest::IoThread(const zx::port& port) {
     while (true) {
         zx_port_packet_t packet;
-        zx_status_t status = port_.wait(zx::time::infinite(), &packet, 0);
+        zx_status_t status = port.wait(zx::time::infinite(), &packet, 0);
         if (status != ZX_OK) {
             fprintf(stderr, "Failed to wait for device port %d\n", status);
             break;
@@ -136,18 +152,18 @@ static constexpr uint32_t trap_kind(TrapType type) {
     }
 }
 
-static constexpr zx_handle_t get_trap_port(TrapType type, zx_handle_t port) {
+static constexpr bool is_async_trap(TrapType type) {
     switch (type) {
     case TrapType::PIO_ASYNC:
     case TrapType::MMIO_BELL:
-        return port;
+        return true;
     case TrapType::PIO_SYNC:
     case TrapType::MMIO_SYNC:
-        return ZX_HANDLE_INVALID;
+        return false;
     default:
         ZX_PANIC("Unhandled TrapType %d.\n",
                  static_cast<fbl::underlying_type<TrapType>::type>(type));
-        return ZX_HANDLE_INVALID;
+        return false;
     }
 }
 
@@ -161,7 +177,12 @@ zx_status_t Guest::CreateMapping(TrapType type, uint64_t addr, size_t size, uint
     // Set a trap for the IO region. We set the 'key' to be the address of the
     // mapping so that we get the pointer to the mapping provided to us in port
     // packets.
-    zx_handle_t port = get_trap_port(type, port_.get());
+    zx_handle_t port = ZX_HANDLE_INVALID;
+    if (is_async_trap(type)) {
+        zx_status_t status = GetIoPort(handler, &port);
+        if (status != ZX_OK)
+            return status;
+    }
     uint32_t kind = trap_kind(type);
     uint64_t key = reinterpret_cast<uintptr_t>(mapping.get());
     zx_status_t status = zx_guest_set_trap(guest_, kind, addr, size, port, key);
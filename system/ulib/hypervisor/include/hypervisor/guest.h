@@ -33,15 +33,27 @@ public:
     zx_handle_t handle() const { return guest_; }
 
     // Setup a trap to delegate accesses to an IO region to |handler|.
+    //
+    // Asynchronous traps are delivered to a port and thread owned by
+    // |handler|, shared by all of its mappings, so that a slow device does
+    // not hold up the VCPUs or any other device.
     zx_status_t CreateMapping(TrapType type, uint64_t addr, size_t size, uint64_t offset,
                               IoHandler* handler);
 
 private:
-    zx_status_t IoThread();
+    // A port, and the thread reading from it, for the asynchronous traps of
+    // a single handler.
+    struct IoPort : public fbl::SinglyLinkedListable<fbl::unique_ptr<IoPort>> {
+        IoHandler* handler;
+        zx::port port;
+    };
+
+    zx_status_t GetIoPort(IoHandler* handler, zx_handle_t* port);
+    static zx_status_t IoThread(const zx::port& port);
 
     zx_handle_t guest_ = ZX_HANDLE_INVALID;
     PhysMem phys_mem_;
 
-    zx::port port_;
+    fbl::SinglyLinkedList<fbl::unique_ptr<IoPort>> io_ports_;
     fbl::SinglyLinkedList<fbl::unique_ptr<IoMapping>> mappings_;
 };
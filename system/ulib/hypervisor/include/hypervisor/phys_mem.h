@@ -7,10 +7,21 @@
 #include <zircon/types.h>
 #include <zx/vmo.h>
 
+// Guest physical memory, backed by a single VMO.
+//
+// The VMO is created with ZX_VMO_LARGE_PAGES and nothing is committed up
+// front: the first EPT violation within each 2MB region commits a
+// physically contiguous run for it, which the guest physical address space
+// then maps with a single large page.
 class PhysMem {
 public:
     zx_status_t Init(size_t mem_size);
 
+    // Returns the pages backing |size| bytes at |guest_paddr| to the host,
+    // for use when the guest inflates its balloon. Both must be page
+    // aligned. The guest reads zeroes if it touches the range again.
+    zx_status_t Reclaim(zx_vaddr_t guest_paddr, size_t size);
+
     ~PhysMem();
 
     zx_handle_t vmo() const { return vmo_.get(); }
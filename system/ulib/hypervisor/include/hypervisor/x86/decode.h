@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <zircon/syscalls/port.h>
 #include <zircon/types.h>
 
 // clang-format off
@@ -35,6 +36,32 @@ typedef struct instruction {
 zx_status_t inst_decode(const uint8_t* inst_buf, uint32_t inst_len, zx_vcpu_state_t* vcpu_state,
                         instruction_t* inst);
 
+#define INST_CACHE_SIZE     16u
+
+/* A decoded instruction, with its operands as offsets into zx_vcpu_state_t. */
+typedef struct inst_cache_entry {
+    uint8_t inst_len;
+    uint8_t inst_buf[X86_MAX_INST_LEN];
+    uint8_t type;
+    uint8_t access_size;
+    uint32_t imm;
+    int16_t reg;
+    int16_t flags;
+} inst_cache_entry_t;
+
+/* Direct-mapped cache of decoded instructions, keyed by instruction bytes.
+ *
+ * Drivers reach their device registers from a handful of instructions, so
+ * most MMIO exits hit the cache and skip decoding. A zeroed cache is empty.
+ */
+typedef struct inst_cache {
+    inst_cache_entry_t entries[INST_CACHE_SIZE];
+} inst_cache_t;
+
+/* As inst_decode, but looks in |cache| first and adds to it on a miss. */
+zx_status_t inst_decode_cached(inst_cache_t* cache, const uint8_t* inst_buf, uint32_t inst_len,
+                               zx_vcpu_state_t* vcpu_state, instruction_t* inst);
+
 #define DEFINE_INST_VAL(size)                                                \
     static inline uint##size##_t inst_val##size(const instruction_t* inst) { \
         return (uint##size##_t)(inst->reg != NULL ? *inst->reg : inst->imm); \
@@ -4,13 +4,15 @@
 
 #include <hypervisor/phys_mem.h>
 
+#include <limits.h>
+
 #include <zircon/process.h>
 #include <zx/vmar.h>
 
 static const uint32_t kMapFlags = ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE;
 
 zx_status_t PhysMem::Init(size_t size) {
-    zx_status_t status = zx::vmo::create(size, 0, &vmo_);
+    zx_status_t status = zx::vmo::create(size, ZX_VMO_LARGE_PAGES, &vmo_);
     if (status != ZX_OK)
         return status;
 
@@ -24,6 +26,14 @@ zx_status_t PhysMem::Init(size_t size) {
     return ZX_OK;
 }
 
+zx_status_t PhysMem::Reclaim(zx_vaddr_t guest_paddr, size_t size) {
+    if (guest_paddr % PAGE_SIZE != 0 || size % PAGE_SIZE != 0)
+        return ZX_ERR_INVALID_ARGS;
+    if (guest_paddr > vmo_size_ || size > vmo_size_ - guest_paddr)
+        return ZX_ERR_OUT_OF_RANGE;
+    return vmo_.op_range(ZX_VMO_OP_DECOMMIT, guest_paddr, size, nullptr, 0);
+}
+
 PhysMem::~PhysMem() {
     if (addr_ != 0) {
         zx::vmar::root_self().unmap(addr_, vmo_size_);
@@ -109,8 +109,10 @@ static zx_status_t handle_mem(Vcpu* vcpu, const zx_packet_guest_mem_t* mem, uint
     do_write = mem->read;
     status = handle_mmio_arm(mem, trap_key, &vcpu_state.x[mem->xt]);
 #elif __x86_64__
+    // Each VCPU has its own thread, and so its own cache.
+    static thread_local inst_cache_t inst_cache;
     instruction_t inst;
-    status = inst_decode(mem->inst_buf, mem->inst_len, &vcpu_state, &inst);
+    status = inst_decode_cached(&inst_cache, mem->inst_buf, mem->inst_len, &vcpu_state, &inst);
     if (status != ZX_OK) {
         fprintf(stderr, "Unsupported instruction:");
         for (uint8_t i = 0; i < mem->inst_len; i++)
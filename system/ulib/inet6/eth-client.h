@@ -16,25 +16,40 @@ typedef struct eth_client {
     uint32_t tx_size;
     uint32_t rx_size;
     void* iobuf;
+
+    // Entries queued but not yet written to the fifos
+    eth_fifo_entry_t* tx_pending;
+    eth_fifo_entry_t* rx_pending;
+    uint32_t tx_pending_count;
+    uint32_t rx_pending_count;
 } eth_client_t;
 
 zx_status_t eth_create(int fd, zx_handle_t io_vmo, void* io_mem, eth_client_t** out);
 
 void eth_destroy(eth_client_t* eth);
 
-// Enqueue a packet for transmit
+// Enqueue a packet for transmit. Packets are written to the fifo in batches, once
+// the batch is full or eth_flush_tx() is called.
 zx_status_t eth_queue_tx(eth_client_t* eth, void* cookie,
                          void* data, size_t len, uint32_t options);
 
+// Write all of the enqueued transmit packets to the fifo
+zx_status_t eth_flush_tx(eth_client_t* eth);
+
 // Process all transmitted buffers
 zx_status_t eth_complete_tx(eth_client_t* eth, void* ctx,
                             void (*func)(void* ctx, void* cookie));
 
-// Enqueue a packet for reception.
+// Enqueue a packet for reception. Buffers are written to the fifo in batches, once
+// the batch is full or eth_flush_rx() is called.
 zx_status_t eth_queue_rx(eth_client_t* eth, void* cookie,
                          void* data, size_t len, uint32_t options);
 
-// Process all received buffers
+// Write all of the enqueued receive buffers to the fifo
+zx_status_t eth_flush_rx(eth_client_t* eth);
+
+// Process all received buffers. Buffers that |func| enqueues for reception again
+// are written back to the fifo together once all have been processed.
 zx_status_t eth_complete_rx(eth_client_t* eth, void* ctx,
                             void (*func)(void* ctx, void* cookie, size_t len, uint32_t flags));
 
@@ -133,7 +133,8 @@ char* ip6toa(char* _out, void* ip6addr);
 
 // provided by inet6.c
 void ip6_init(void* macaddr);
-void eth_recv(void* data, size_t len);
+// |csum_ok| is set if the device has verified the packet's checksums.
+void eth_recv(void* data, size_t len, bool csum_ok);
 
 typedef struct eth_buffer eth_buffer_t;
 
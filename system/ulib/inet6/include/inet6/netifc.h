@@ -22,7 +22,8 @@ void netifc_set_timer(uint32_t ms);
 // returns true once the timer has expired
 int netifc_timer_expired(void);
 
-void netifc_recv(void* data, size_t len);
+// handle an inbound packet; |csum_ok| is set if the device verified its checksums
+void netifc_recv(void* data, size_t len, bool csum_ok);
 
 // send out next pending packet, and return value indicating if more are available to send
 bool netifc_send_pending(void);
@@ -94,6 +94,10 @@ void multicast_from_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip6) {
 // ip6 stack configuration
 static mac_addr_t ll_mac_addr;
 static ip6_addr_t ll_ip6_addr;
+// Our address's part of the checksum of every packet we send
+static uint16_t ll_ip6_sum;
+
+static uint16_t checksum(const void* _data, size_t len, uint16_t _sum);
 static mac_addr_t snm_mac_addr;
 static ip6_addr_t snm_ip6_addr;
 
@@ -131,6 +135,7 @@ void ip6_init(void* macaddr) {
     // save our ethernet MAC and synthesize link layer addresses
     memcpy(&ll_mac_addr, macaddr, 6);
     ll6addr_from_mac(&ll_ip6_addr, &ll_mac_addr);
+    ll_ip6_sum = checksum(&ll_ip6_addr, sizeof(ll_ip6_addr), 0);
     snmaddr_from_mac(&snm_ip6_addr, &ll_mac_addr);
     multicast_from_ip6(&snm_mac_addr, &snm_ip6_addr);
 
@@ -189,20 +194,55 @@ static int resolve_ip6(mac_addr_t* _mac, const ip6_addr_t* _ip) {
     return mac_cache_lookup(_mac, _ip);
 }
 
+static uint16_t checksum_fold(uint64_t sum) {
+    while (sum > 0xFFFF) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+// Since 2^16 is 1 in ones' complement arithmetic, summing 32-bit words and
+// folding at the end gives the same result as summing 16-bit ones.
 static uint16_t checksum(const void* _data, size_t len, uint16_t _sum) {
-    uint32_t sum = _sum;
-    const uint16_t* data = _data;
-    while (len > 1) {
-        sum += *data++;
+    uint64_t sum = _sum;
+    const uint8_t* data = _data;
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, data, 4);
+        sum += w;
+        data += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        uint16_t w;
+        memcpy(&w, data, 2);
+        sum += w;
+        data += 2;
         len -= 2;
     }
     if (len) {
-        sum += (*data & 0xFF);
-    }
-    while (sum > 0xFFFF) {
-        sum = (sum & 0xFFFF) + (sum >> 16);
+        sum += *data;
     }
-    return sum;
+    return checksum_fold(sum);
+}
+
+// checksum(), copying |src| to |dst| in the same pass.
+static uint16_t checksum_copy(void* _dst, const void* _src, size_t len, uint16_t _sum) {
+    uint64_t sum = _sum;
+    uint8_t* dst = _dst;
+    const uint8_t* src = _src;
+    while (len >= 4) {
+        uint32_t w;
+        memcpy(&w, src, 4);
+        memcpy(dst, &w, 4);
+        sum += w;
+        src += 4;
+        dst += 4;
+        len -= 4;
+    }
+    // the last few bytes are summed as checksum() does
+    memcpy(dst, src, len);
+    return checksum(dst, len, checksum_fold(sum));
 }
 
 typedef struct {
@@ -281,8 +321,14 @@ zx_status_t udp6_send(const void* data, size_t dlen, const ip6_addr_t* daddr, ui
     p->udp.length = htons(length);
     p->udp.checksum = 0;
 
-    memcpy(p->data, data, dlen);
-    p->udp.checksum = ip6_checksum(&p->ip6, HDR_UDP, length);
+    // Checksum the payload as it is copied in, and start from the precomputed sum
+    // of our address rather than going over the headers again.
+    uint16_t sum = checksum(&p->ip6.length, 2, htons(HDR_UDP));
+    sum = checksum(&p->ip6.dst, sizeof(p->ip6.dst), checksum_fold((uint64_t)sum + ll_ip6_sum));
+    sum = checksum(&p->udp, UDP_HDR_LEN, sum);
+    sum = checksum_copy(p->data, data, dlen, sum);
+    // 0 is illegal, so 0xffff remains 0xffff
+    p->udp.checksum = (sum != 0xffff) ? ~sum : sum;
     return eth_send(ethbuf, 2, ETH_HDR_LEN + IP6_HDR_LEN + length);
 }
 
@@ -323,7 +369,7 @@ static void report_bad_packet(ip6_addr_t* ip6_addr, const char* msg) {
 }
 #endif
 
-void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
+void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len, bool csum_ok) {
     udp_hdr_t* udp = _data;
     uint16_t sum, n;
 
@@ -335,14 +381,18 @@ void _udp6_recv(ip6_hdr_t* ip, void* _data, size_t len) {
         BAD_PACKET_FROM(&ip->src, "missing checksum in UDP packet");
         return;
     }
-    if (udp->checksum == 0xFFFF)
-        udp->checksum = 0;
 
-    sum = checksum(&ip->length, 2, htons(HDR_UDP));
-    sum = checksum(&ip->src, 32 + len, sum);
-    if (unlikely(sum != 0xFFFF)) {
-        BAD_PACKET_FROM(&ip->src, "incorrect checksum in UDP packet");
-        return;
+    // the device has already done this, when it can
+    if (!csum_ok) {
+        if (udp->checksum == 0xFFFF)
+            udp->checksum = 0;
+
+        sum = checksum(&ip->length, 2, htons(HDR_UDP));
+        sum = checksum(&ip->src, 32 + len, sum);
+        if (unlikely(sum != 0xFFFF)) {
+            BAD_PACKET_FROM(&ip->src, "incorrect checksum in UDP packet");
+            return;
+        }
     }
 
     n = ntohs(udp->length);
@@ -472,7 +522,7 @@ done:
     mtx_unlock(&mac_cache_lock);
 }
 
-void eth_recv(void* _data, size_t len) {
+void eth_recv(void* _data, size_t len, bool csum_ok) {
     uint8_t* data = _data;
     ip6_hdr_t* ip;
     uint32_t n;
@@ -521,7 +571,7 @@ void eth_recv(void* _data, size_t len) {
         icmp6_recv(ip, data, len);
         break;
     case HDR_UDP:
-        _udp6_recv(ip, data, len);
+        _udp6_recv(ip, data, len, csum_ok);
         break;
     default:
         // do nothing
@@ -64,6 +64,10 @@ static size_t netmtu;
 static zx_handle_t iovmo;
 static void* iobuf;
 
+// While set, transmitted packets are left for netifc_poll() to write to the fifo
+// all at once, rather than one at a time.
+static bool tx_batching __TA_GUARDED(eth_lock);
+
 #define NET_BUFFERS 256
 #define NET_BUFFERSZ 2048
 
@@ -147,6 +151,8 @@ static zx_status_t eth_get_buffer_locked(size_t sz, void** data, eth_buffer_t**
             if (eth_buffers != NULL) {
                 break;
             }
+            // the buffers may be waiting in a batch that was never sent
+            eth_flush_tx(eth);
             if (!block) {
                 return ZX_ERR_SHOULD_WAIT;
             }
@@ -213,6 +219,11 @@ zx_status_t eth_send(eth_buffer_t* ethbuf, size_t skip, size_t len) {
         eth_put_buffer_locked(ethbuf, ETH_BUFFER_TX);
         goto fail;
     }
+    if (!tx_batching && (status = eth_flush_tx(eth)) < 0) {
+        // the packet stays queued, and goes out with the next one
+        printf("eth_fifo_send: flush tx failed: %d\n", status);
+        goto fail;
+    }
 
     mtx_unlock(&eth_lock);
     return ZX_OK;
@@ -273,6 +284,12 @@ static zx_status_t netifc_open_cb(int dirfd, int event, const char* fn, void* co
     memcpy(netmac, info.mac, sizeof(netmac));
     netmtu = info.mtu;
 
+    // let the device verify received checksums, so we don't have to
+    uint32_t offloads = info.features & ETH_FEATURE_RX_CSUM;
+    if (offloads && ioctl_ethernet_set_offloads(netfd, &offloads) < 0) {
+        printf("netifc: cannot enable rx checksum offload\n");
+    }
+
     mtx_lock(&eth_lock);
     zx_status_t status;
 
@@ -333,6 +350,7 @@ static zx_status_t netifc_open_cb(int dirfd, int event, const char* fn, void* co
         }
         eth_queue_rx(eth, ethbuf, ethbuf->data, NET_BUFFERSZ, 0);
     }
+    eth_flush_rx(eth);
 
     mtx_unlock(&eth_lock);
 
@@ -401,25 +419,41 @@ void netifc_close(void) {
 static void rx_complete(void* ctx, void* cookie, size_t len, uint32_t flags) {
     eth_buffer_t* ethbuf = cookie;
     check_ethbuf(ethbuf, ETH_BUFFER_RX);
-    netifc_recv(ethbuf->data, len);
+    netifc_recv(ethbuf->data, len, flags & ETH_FIFO_RX_CSUM_OK);
     eth_queue_rx(eth, ethbuf, ethbuf->data, NET_BUFFERSZ, 0);
 }
 
+// Starts or ends a batch of transmitted packets, writing them to the fifo at the end.
+static void netifc_tx_batch(bool start) {
+    mtx_lock(&eth_lock);
+    tx_batching = start;
+    if (!start) {
+        eth_flush_tx(eth);
+    }
+    mtx_unlock(&eth_lock);
+}
+
 int netifc_poll(void) {
     for (;;) {
-        // Handle any completed rx packets
+        // Handle any completed rx packets, sending their replies together
         zx_status_t status;
-        if ((status = eth_complete_rx(eth, NULL, rx_complete)) < 0) {
+        netifc_tx_batch(true);
+        status = eth_complete_rx(eth, NULL, rx_complete);
+        if (status < 0) {
+            netifc_tx_batch(false);
             printf("netifc: eth rx failed: %d\n", status);
             return -1;
         }
 
         // Timeout passed
         if (net_timer && zx_clock_get(ZX_CLOCK_MONOTONIC) > net_timer) {
+            netifc_tx_batch(false);
             return 0;
         }
 
-        if (netifc_send_pending()) {
+        bool more = netifc_send_pending();
+        netifc_tx_batch(false);
+        if (more) {
             continue;
         }
 
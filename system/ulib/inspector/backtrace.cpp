@@ -371,3 +371,88 @@ void inspector_print_backtrace(FILE* f,
 }
 
 }  // namespace inspector
+
+struct inspector_unwinder {
+    zx_handle_t process;
+    inspector_dsoinfo_t* dso_list;
+    // Both null if we're following frame pointers.
+    unw_fuchsia_info_t* fuchsia;
+    unw_addr_space_t remote_as;
+};
+
+extern "C"
+inspector_unwinder_t* inspector_unwinder_create(zx_handle_t process,
+                                                zx_handle_t thread,
+                                                inspector_dsoinfo_t* dso_list,
+                                                bool use_libunwind) {
+    fbl::AllocChecker ac;
+    auto unwinder = new (&ac) inspector_unwinder_t{process, dso_list, nullptr, nullptr};
+    if (!ac.check())
+        return nullptr;
+
+    if (use_libunwind) {
+        unwinder->fuchsia = unw_create_fuchsia(process, thread, dso_list,
+                                               inspector::dso_lookup_for_unw);
+        if (unwinder->fuchsia != nullptr) {
+            unwinder->remote_as =
+                unw_create_addr_space((unw_accessors_t*) &_UFuchsia_accessors, 0);
+        }
+        if (unwinder->remote_as == nullptr) {
+            debugf(1, "unable to set up libunwind, following frame pointers\n");
+            unw_destroy_fuchsia(unwinder->fuchsia);
+            unwinder->fuchsia = nullptr;
+        } else {
+            // The thread is stopped at a different place each time, but the
+            // unwind info of the DSOs it runs in stays the same.
+            unw_set_caching_policy(unwinder->remote_as, UNW_CACHE_GLOBAL);
+        }
+    }
+    return unwinder;
+}
+
+extern "C"
+void inspector_unwinder_destroy(inspector_unwinder_t* unwinder) {
+    if (unwinder == nullptr)
+        return;
+    if (unwinder->remote_as != nullptr)
+        unw_destroy_addr_space(unwinder->remote_as);
+    unw_destroy_fuchsia(unwinder->fuchsia);
+    delete unwinder;
+}
+
+extern "C"
+size_t inspector_unwind(inspector_unwinder_t* unwinder,
+                        uintptr_t pc, uintptr_t sp, uintptr_t fp,
+                        uintptr_t* pcs, size_t max_frames) {
+    if (max_frames == 0)
+        return 0;
+
+    unw_cursor_t cursor;
+    bool libunwind_ok = unwinder->remote_as != nullptr &&
+        unw_init_remote(&cursor, unwinder->remote_as, unwinder->fuchsia) >= 0;
+
+    // Same as inspector_print_backtrace(), but without the printing.
+    size_t n = 0;
+    pcs[n++] = pc;
+    while (sp >= 0x1000000 && n < max_frames) {
+        if (libunwind_ok) {
+            if (unw_step(&cursor) <= 0)
+                break;
+            unw_word_t val;
+            unw_get_reg(&cursor, UNW_REG_IP, &val);
+            pc = val;
+            unw_get_reg(&cursor, UNW_REG_SP, &val);
+            sp = val;
+        } else {
+            sp = fp;
+            if (inspector::read_mem(unwinder->process, fp + 8, &pc, sizeof(pc)))
+                break;
+            if (inspector::read_mem(unwinder->process, fp, &fp, sizeof(fp)))
+                break;
+        }
+        if (pc == 0)
+            break;
+        pcs[n++] = pc;
+    }
+    return n;
+}
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <inttypes.h>
 #include <link.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -149,6 +150,18 @@ void inspector_dso_print_list(FILE* f, inspector_dsoinfo_t* dso_list) {
     }
 }
 
+void inspector_dso_print_maps(FILE* f, inspector_dsoinfo_t* dso_list) {
+    // The list is sorted by decreasing base address.
+    uintptr_t end = UINTPTR_MAX;
+    for (inspector_dsoinfo_t* dso = dso_list; dso != nullptr; dso = dso->next) {
+        const char* path = dso->name;
+        inspector_dso_find_debug_file(dso, &path);
+        fprintf(f, "%" PRIxPTR "-%" PRIxPTR " r-xp 00000000 00:00 0 %s\n",
+                dso->base, end, path);
+        end = dso->base;
+    }
+}
+
 zx_status_t inspector_dso_find_debug_file(inspector_dsoinfo_t* dso,
                                           const char** out_debug_file) {
     // Have we already tried?
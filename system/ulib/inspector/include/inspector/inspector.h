@@ -45,6 +45,31 @@ extern void inspector_print_backtrace(FILE* f,
                                       uintptr_t pc, uintptr_t sp, uintptr_t fp,
                                       bool use_libunwind);
 
+// Opaque state for unwinding the stack of one thread over and over, as a
+// sampling profiler does. What libunwind learns about the unwind tables of
+// the process's DSOs is kept from one unwind to the next.
+typedef struct inspector_unwinder inspector_unwinder_t;
+
+// Create an unwinder for |thread| of |process|.
+// |dso_list| is not copied and must outlive the unwinder.
+// If |use_libunwind| is false, or libunwind can't be set up, frame pointers
+// are followed instead.
+// Returns NULL if out of memory.
+extern inspector_unwinder_t* inspector_unwinder_create(zx_handle_t process,
+                                                       zx_handle_t thread,
+                                                       inspector_dsoinfo_t* dso_list,
+                                                       bool use_libunwind);
+
+// Free the value returned by inspector_unwinder_create().
+extern void inspector_unwinder_destroy(inspector_unwinder_t* unwinder);
+
+// Store the pcs of up to |max_frames| frames of the unwinder's thread in
+// |pcs|, innermost first, and return how many were stored.
+// The thread must currently be stopped, with registers |pc|, |sp| and |fp|.
+extern size_t inspector_unwind(inspector_unwinder_t* unwinder,
+                               uintptr_t pc, uintptr_t sp, uintptr_t fp,
+                               uintptr_t* pcs, size_t max_frames);
+
 // Fetch the list of the DSOs of |process|.
 // |name| is the name of the application binary.
 extern inspector_dsoinfo_t* inspector_dso_fetch_list(zx_handle_t process);
@@ -62,6 +87,12 @@ extern inspector_dsoinfo_t* inspector_dso_lookup (inspector_dsoinfo_t* dso_list,
 // zircon/scripts/symbolize in order to add source location to the output.
 extern void inspector_dso_print_list(FILE* f, inspector_dsoinfo_t* dso_list);
 
+// Print |dso_list| to |f| in the format of Linux's /proc/<pid>/maps, as
+// read by pprof. Each DSO is named by its debug file if there is one.
+// A DSO is taken to extend up to the next one, and the last to the end of
+// the address space.
+extern void inspector_dso_print_maps(FILE* f, inspector_dsoinfo_t* dso_list);
+
 // Try to find the copy of |dso| that contains debug information.
 // On success returns ZX_OK with the path of the file stored in
 // |out_debug_file|. On failure returns an error code.
@@ -132,6 +132,34 @@ zx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd);
 // Load an ELF PIE binary from vmo
 zx_status_t launchpad_load_from_vmo(launchpad_t* lp, zx_handle_t vmo);
 
+// TEMPLATES
+// A template holds an ELF PIE binary that has already been parsed, along
+// with its dynamic linker and the vDSO, so that launching the same binary
+// many times does not repeat that work.  A template may be shared by
+// several threads; the launchpads made from it may not.
+// -------------------------------------------------------------------
+
+typedef struct launchpad_template launchpad_template_t;
+
+// Create a template from an ELF PIE binary in vmo, which is consumed on
+// success and failure.  #! scripts are not supported: ZX_ERR_NOT_SUPPORTED.
+zx_status_t launchpad_template_create(zx_handle_t vmo,
+                                      launchpad_template_t** out);
+
+// Create a template from an ELF PIE binary at path.
+zx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** out);
+
+void launchpad_template_destroy(launchpad_template_t* tmpl);
+
+// Load the binary of tmpl and the vDSO, like launchpad_load_from_vmo.
+// Unless launchpad_use_loader_service was called first, the new process
+// gets its shared libraries from a loader service that is shared by all
+// templates and keeps each library it has loaded (see
+// loader_service_create_fs_cached).
+zx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl);
+
 
 // ADDING ARGUMENTS, ENVIRONMENT, AND HANDLES
 // These functions setup arguments, environment, or handles to be
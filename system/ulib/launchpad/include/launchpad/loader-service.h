@@ -50,6 +50,12 @@ typedef struct loader_service loader_service_t;
 // any number of clients.
 zx_status_t loader_service_create_fs(const char* name, loader_service_t** out);
 
+// Like loader_service_create_fs, but each file is read only the first time
+// it is asked for; later requests get a copy-on-write clone of the same VMO.
+// A file is read again if its inode, size or modification time changed.
+// The in-process fallback of loader_service_get_default works this way.
+zx_status_t loader_service_create_fs_cached(const char* name, loader_service_t** out);
+
 // Returns a new dl_set_loader_service-compatible loader service channel.
 zx_status_t loader_service_connect(loader_service_t* svc, zx_handle_t* out);
 
@@ -1311,3 +1311,189 @@ zx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd) {
 zx_status_t launchpad_load_from_vmo(launchpad_t* lp, zx_handle_t vmo) {
     return launchpad_file_load_with_vdso(lp, vmo);
 }
+
+struct launchpad_template {
+    zx_handle_t exec_vmo;
+    elf_load_info_t* exec_elf;
+    // Invalid and NULL when the binary has no PT_INTERP.
+    zx_handle_t interp_vmo;
+    elf_load_info_t* interp_elf;
+    // The vDSO as of launchpad_template_create, regardless of later
+    // launchpad_set_vdso_vmo calls.
+    zx_handle_t vdso_vmo;
+    elf_load_info_t* vdso_elf;
+};
+
+static mtx_t template_svc_mutex = MTX_INIT;
+static loader_service_t* template_svc;
+
+static zx_status_t template_loader_svc_connect(zx_handle_t* out) {
+    mtx_lock(&template_svc_mutex);
+    zx_status_t status = ZX_OK;
+    if (template_svc == NULL)
+        status = loader_service_create_fs_cached("launchpad-template-svc",
+                                                 &template_svc);
+    if (status == ZX_OK)
+        status = loader_service_connect(template_svc, out);
+    mtx_unlock(&template_svc_mutex);
+    return status;
+}
+
+void launchpad_template_destroy(launchpad_template_t* tmpl) {
+    if (tmpl == NULL)
+        return;
+    zx_handle_close(tmpl->exec_vmo);
+    zx_handle_close(tmpl->interp_vmo);
+    zx_handle_close(tmpl->vdso_vmo);
+    if (tmpl->exec_elf != NULL)
+        elf_load_destroy(tmpl->exec_elf);
+    if (tmpl->interp_elf != NULL)
+        elf_load_destroy(tmpl->interp_elf);
+    if (tmpl->vdso_elf != NULL)
+        elf_load_destroy(tmpl->vdso_elf);
+    free(tmpl);
+}
+
+static zx_status_t template_load_interp(launchpad_template_t* tmpl,
+                                        const char* interp, size_t interp_len) {
+    zx_handle_t svc;
+    zx_status_t status = template_loader_svc_connect(&svc);
+    if (status != ZX_OK)
+        return status;
+    status = loader_svc_rpc(svc, LOADER_SVC_OP_LOAD_OBJECT,
+                            interp, interp_len, &tmpl->interp_vmo);
+    zx_handle_close(svc);
+    if (status != ZX_OK)
+        return status;
+    return elf_load_start(tmpl->interp_vmo, NULL, 0, &tmpl->interp_elf);
+}
+
+zx_status_t launchpad_template_create(zx_handle_t vmo,
+                                      launchpad_template_t** out) {
+    if (vmo == ZX_HANDLE_INVALID)
+        return ZX_ERR_INVALID_ARGS;
+
+    char magic[2];
+    size_t n;
+    zx_status_t status = zx_vmo_read(vmo, magic, 0, sizeof(magic), &n);
+    if (status != ZX_OK) {
+        zx_handle_close(vmo);
+        return status;
+    }
+    if (n == sizeof(magic) && magic[0] == '#' && magic[1] == '!') {
+        zx_handle_close(vmo);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    launchpad_template_t* tmpl = calloc(1, sizeof(*tmpl));
+    if (tmpl == NULL) {
+        zx_handle_close(vmo);
+        return ZX_ERR_NO_MEMORY;
+    }
+    tmpl->exec_vmo = vmo;
+
+    if ((status = elf_load_start(vmo, NULL, 0, &tmpl->exec_elf)) != ZX_OK)
+        goto fail;
+
+    char* interp;
+    size_t interp_len;
+    if ((status = elf_load_get_interp(tmpl->exec_elf, vmo,
+                                      &interp, &interp_len)) != ZX_OK)
+        goto fail;
+    if (interp != NULL) {
+        status = template_load_interp(tmpl, interp, interp_len);
+        free(interp);
+        if (status != ZX_OK)
+            goto fail;
+    }
+
+    if ((status = launchpad_get_vdso_vmo(&tmpl->vdso_vmo)) != ZX_OK)
+        goto fail;
+    if ((status = elf_load_start(tmpl->vdso_vmo, NULL, 0,
+                                 &tmpl->vdso_elf)) != ZX_OK)
+        goto fail;
+
+    *out = tmpl;
+    return ZX_OK;
+
+fail:
+    launchpad_template_destroy(tmpl);
+    return status;
+}
+
+zx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** out) {
+    zx_handle_t vmo;
+    zx_status_t status = launchpad_vmo_from_file(path, &vmo);
+    if (status != ZX_OK)
+        return status;
+    return launchpad_template_create(vmo, out);
+}
+
+// Does the same as launchpad_elf_load_body and handle_interp, but with the
+// headers, the dynamic linker and the vDSO already in hand.
+zx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl) {
+    if (lp->error)
+        return lp->error;
+
+    if (lp->script_args != NULL) {
+        free(lp->script_args);
+        lp->script_args = NULL;
+    }
+    lp->script_args_len = 0;
+    lp->num_script_args = 0;
+
+    zx_status_t status;
+    zx_handle_t segments_vmar;
+    if (tmpl->interp_elf == NULL) {
+        status = elf_load_finish(lp_vmar(lp), tmpl->exec_elf, tmpl->exec_vmo,
+                                 &segments_vmar, &lp->base, &lp->entry);
+        if (status != ZX_OK)
+            return lp_error(lp, status, "load_from_template: elf_load_finish() failed");
+        check_elf_stack_size(lp, tmpl->exec_elf);
+        lp->loader_message = false;
+        launchpad_add_handle(lp, segments_vmar, PA_HND(PA_VMAR_LOADED, 0));
+    } else {
+        if (lp->special_handles[HND_LOADER_SVC] == ZX_HANDLE_INVALID) {
+            status = template_loader_svc_connect(
+                &lp->special_handles[HND_LOADER_SVC]);
+            if (status != ZX_OK)
+                return lp_error(lp, status,
+                                "load_from_template: no loader service");
+        }
+        if (lp->fresh_process) {
+            // See handle_interp.
+            status = reserve_low_address_space(lp);
+            if (status != ZX_OK)
+                return status;
+        }
+
+        zx_handle_t exec_vmo;
+        status = zx_handle_duplicate(tmpl->exec_vmo, ZX_RIGHT_SAME_RIGHTS,
+                                     &exec_vmo);
+        if (status != ZX_OK)
+            return lp_error(lp, status, "load_from_template: cannot duplicate vmo");
+        status = elf_load_finish(lp_vmar(lp), tmpl->interp_elf, tmpl->interp_vmo,
+                                 &segments_vmar, &lp->base, &lp->entry);
+        if (status != ZX_OK) {
+            zx_handle_close(exec_vmo);
+            return lp_error(lp, status, "load_from_template: elf_load_finish() failed");
+        }
+        zx_handle_close(lp->special_handles[HND_EXEC_VMO]);
+        lp->special_handles[HND_EXEC_VMO] = exec_vmo;
+        zx_handle_close(lp->special_handles[HND_SEGMENTS_VMAR]);
+        lp->special_handles[HND_SEGMENTS_VMAR] = segments_vmar;
+        lp->loader_message = true;
+    }
+
+    status = elf_load_finish(lp_vmar(lp), tmpl->vdso_elf, tmpl->vdso_vmo,
+                             NULL, &lp->vdso_base, NULL);
+    if (status != ZX_OK)
+        return lp_error(lp, status, "load_from_template: cannot load vDSO");
+    zx_handle_t vdso;
+    status = zx_handle_duplicate(tmpl->vdso_vmo, ZX_RIGHT_SAME_RIGHTS, &vdso);
+    if (status != ZX_OK)
+        return lp_error(lp, status, "load_from_template: cannot duplicate vDSO");
+    return launchpad_add_handle(lp, vdso, PA_HND(PA_VMO_VDSO, 0));
+}
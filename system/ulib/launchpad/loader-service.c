@@ -134,11 +134,11 @@ zx_status_t loader_service_publish_data_sink_fs(const char* sink_name, zx_handle
 
 
 // When loading a library object, search in the hard-coded locations.
-static int open_from_libpath(const char* fn) {
+// |path| gets the path that was opened.
+static int open_from_libpath(const char* fn, char* path, size_t len) {
     int fd = -1;
     for (size_t n = 0; fd < 0 && n < countof(libpaths); ++n) {
-        char path[PATH_MAX];
-        snprintf(path, sizeof(path), "%s/%s", libpaths[n], fn);
+        snprintf(path, len, "%s/%s", libpaths[n], fn);
         fd = open(path, O_RDONLY);
     }
     return fd;
@@ -154,7 +154,8 @@ static zx_handle_t load_object_fd(int fd, const char* fn, zx_handle_t* out) {
 }
 
 static zx_status_t fs_load_object(void *ctx, const char* name, zx_handle_t* out) {
-    int fd = open_from_libpath(name);
+    char path[PATH_MAX];
+    int fd = open_from_libpath(name, path, sizeof(path));
     if (fd >= 0)
         return load_object_fd(fd, name, out);
     return ZX_ERR_NOT_FOUND;
@@ -392,6 +393,117 @@ zx_status_t loader_service_create_fs(const char* name,
     return loader_service_create(name, &fs_ops, NULL, out);
 }
 
+// A file loaded by a cached loader service, keyed by the path it was
+// opened at. The attributes it had then tell whether it has changed since.
+typedef struct cached_vmo {
+    struct cached_vmo* next;
+    uint64_t ino;
+    off_t size;
+    struct timespec mtime;
+    zx_handle_t vmo;
+    char path[];
+} cached_vmo_t;
+
+typedef struct vmo_cache {
+    mtx_t lock;
+    cached_vmo_t* entries;
+} vmo_cache_t;
+
+static zx_status_t clone_vmo(zx_handle_t vmo, const char* fn, zx_handle_t* out) {
+    uint64_t size;
+    zx_status_t status = zx_vmo_get_size(vmo, &size);
+    if (status != ZX_OK)
+        return status;
+    status = zx_vmo_clone(vmo, ZX_VMO_CLONE_COPY_ON_WRITE, 0, size, out);
+    if (status == ZX_OK)
+        zx_object_set_property(*out, ZX_PROP_NAME, fn, strlen(fn));
+    return status;
+}
+
+// Always consumes the fd. Each client gets a copy-on-write clone of the
+// one VMO read from the file, so only the first load costs file I/O.
+static zx_status_t cached_load_fd(vmo_cache_t* cache, int fd, const char* path,
+                                  const char* fn, zx_handle_t* out) {
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return load_object_fd(fd, fn, out);
+
+    mtx_lock(&cache->lock);
+    cached_vmo_t* e;
+    for (e = cache->entries; e != NULL; e = e->next) {
+        if (!strcmp(e->path, path))
+            break;
+    }
+    zx_status_t status;
+    if (e != NULL && e->ino == st.st_ino && e->size == st.st_size &&
+        e->mtime.tv_sec == st.st_mtim.tv_sec &&
+        e->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        close(fd);
+        status = clone_vmo(e->vmo, fn, out);
+        goto done;
+    }
+
+    zx_handle_t vmo;
+    if ((status = load_object_fd(fd, fn, &vmo)) != ZX_OK)
+        goto done;
+    if (e == NULL) {
+        size_t len = strlen(path);
+        e = malloc(sizeof(*e) + len + 1);
+        if (e == NULL) {
+            *out = vmo;
+            goto done;
+        }
+        memcpy(e->path, path, len + 1);
+        e->next = cache->entries;
+        cache->entries = e;
+    } else {
+        zx_handle_close(e->vmo);
+    }
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime = st.st_mtim;
+    e->vmo = vmo;
+    status = clone_vmo(vmo, fn, out);
+
+done:
+    mtx_unlock(&cache->lock);
+    return status;
+}
+
+static zx_status_t cached_load_object(void* ctx, const char* name, zx_handle_t* out) {
+    char path[PATH_MAX];
+    int fd = open_from_libpath(name, path, sizeof(path));
+    if (fd >= 0)
+        return cached_load_fd(ctx, fd, path, name, out);
+    return ZX_ERR_NOT_FOUND;
+}
+
+static zx_status_t cached_load_abspath(void* ctx, const char* path, zx_handle_t* out) {
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0)
+        return cached_load_fd(ctx, fd, path, path, out);
+    return ZX_ERR_NOT_FOUND;
+}
+
+static const loader_service_ops_t cached_fs_ops = {
+    .load_object = cached_load_object,
+    .load_abspath = cached_load_abspath,
+    .publish_data_sink = fs_publish_data_sink,
+};
+
+zx_status_t loader_service_create_fs_cached(const char* name,
+                                            loader_service_t** out) {
+    vmo_cache_t* cache = calloc(1, sizeof(*cache));
+    if (cache == NULL)
+        return ZX_ERR_NO_MEMORY;
+    mtx_init(&cache->lock, mtx_plain);
+    // Like the service itself, the cache is never freed.
+    zx_status_t status = loader_service_create(name, &cached_fs_ops, cache, out);
+    if (status != ZX_OK)
+        free(cache);
+    return status;
+}
+
 static zx_status_t multiloader_cb(zx_handle_t h, void* cb, void* cookie) {
     if (h == 0) {
         // close notification, which we can ignore
@@ -454,9 +566,13 @@ zx_status_t loader_service_connect(loader_service_t* svc, zx_handle_t* out) {
 }
 
 // In-process multiloader
+static vmo_cache_t local_loader_cache = {
+    .lock = MTX_INIT,
+};
 static loader_service_t local_loader_svc = {
     .name = "local-loader-svc",
-    .ops = &fs_ops,
+    .ops = &cached_fs_ops,
+    .ctx = &local_loader_cache,
 };
 
 zx_status_t loader_service_get_default(zx_handle_t* out) {
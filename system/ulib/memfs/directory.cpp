@@ -12,6 +12,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fdio/vfs.h>
@@ -78,20 +79,32 @@ zx_status_t VnodeDir::Getattr(vnattr_t* attr) {
     attr->blkcount = fbl::round_up(attr->size, kMemfsBlksize) / VNATTR_BLKSIZE;
     attr->nlink = link_count_;
     attr->create_time = create_time_;
+    fbl::AutoLock lock(&lock_);
     attr->modify_time = modify_time_;
     return ZX_OK;
 }
 
 zx_status_t VnodeDir::Readdir(fs::vdircookie_t* cookie, void* data, size_t len, size_t* out_actual) {
     fs::DirentFiller df(data, len);
+    return ReaddirInternal(&df, cookie, out_actual);
+}
+
+zx_status_t VnodeDir::ReaddirAttr(fs::vdircookie_t* cookie, void* data, size_t len,
+                                  size_t* out_actual) {
+    fs::DirentFiller df(data, len, true);
+    return ReaddirInternal(&df, cookie, out_actual);
+}
+
+zx_status_t VnodeDir::ReaddirInternal(fs::DirentFiller* df, fs::vdircookie_t* cookie,
+                                      size_t* out_actual) {
     if (!IsDirectory()) {
         // This WAS a directory, but it has been deleted.
-        Dnode::ReaddirStart(&df, cookie);
-        *out_actual = df.BytesFilled();
+        Dnode::ReaddirStart(df, cookie, this);
+        *out_actual = df->BytesFilled();
         return ZX_OK;
     }
-    dnode_->Readdir(&df, cookie);
-    *out_actual = df.BytesFilled();
+    dnode_->Readdir(df, cookie);
+    *out_actual = df->BytesFilled();
     return ZX_OK;
 }
 
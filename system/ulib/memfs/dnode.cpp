@@ -125,14 +125,28 @@ struct dircookie_t {
 static_assert(sizeof(dircookie_t) <= sizeof(fs::vdircookie_t),
               "MemFS dircookie too large to fit in IO state");
 
+// Adds an entry for |vn| to |df|, with its attributes if they are wanted.
+static zx_status_t NextDirent(fs::DirentFiller* df, fbl::StringPiece name, uint32_t type,
+                              VnodeMemfs* vn) {
+    if (!df->WithAttrs()) {
+        return df->Next(name, type);
+    }
+    vnattr_t attr;
+    zx_status_t r;
+    if ((r = vn->Getattr(&attr)) != ZX_OK) {
+        return r;
+    }
+    return df->Next(name, type, attr);
+}
+
 // Read the canned "." and ".." entries that should
 // appear at the beginning of a directory.
-zx_status_t Dnode::ReaddirStart(fs::DirentFiller* df, void* cookie) {
+zx_status_t Dnode::ReaddirStart(fs::DirentFiller* df, void* cookie, VnodeMemfs* self) {
     dircookie_t* c = static_cast<dircookie_t*>(cookie);
     zx_status_t r;
 
     if (c->order == 0) {
-        if ((r = df->Next(".", VTYPE_TO_DTYPE(V_TYPE_DIR))) != ZX_OK) {
+        if ((r = NextDirent(df, ".", VTYPE_TO_DTYPE(V_TYPE_DIR), self)) != ZX_OK) {
             return r;
         }
         c->order++;
@@ -145,7 +159,7 @@ void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
     zx_status_t r = 0;
 
     if (c->order < 1) {
-        if ((r = Dnode::ReaddirStart(df, cookie)) != ZX_OK) {
+        if ((r = Dnode::ReaddirStart(df, cookie, vnode_.get())) != ZX_OK) {
             return;
         }
     }
@@ -155,8 +169,8 @@ void Dnode::Readdir(fs::DirentFiller* df, void* cookie) const {
             continue;
         }
         uint32_t vtype = dn.IsDirectory() ? V_TYPE_DIR : V_TYPE_FILE;
-        if ((r = df->Next(fbl::StringPiece(dn.name_.get(), dn.NameLen()),
-                          VTYPE_TO_DTYPE(vtype))) != ZX_OK) {
+        if ((r = NextDirent(df, fbl::StringPiece(dn.name_.get(), dn.NameLen()),
+                            VTYPE_TO_DTYPE(vtype), dn.vnode_.get())) != ZX_OK) {
             return;
         }
         c->order = dn.ordering_token_ + 1;
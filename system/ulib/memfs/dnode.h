@@ -80,9 +80,9 @@ public:
 
     // Read dirents (up to len bytes worth) into data.
     // ReaddirStart reads the canned "." and ".." entries that should appear
-    // at the beginning of a directory.
+    // at the beginning of a directory, which is |self|.
     // On success, return the number of bytes read.
-    static zx_status_t ReaddirStart(fs::DirentFiller* df, void* cookie);
+    static zx_status_t ReaddirStart(fs::DirentFiller* df, void* cookie, VnodeMemfs* self);
     void Readdir(fs::DirentFiller* df, void* cookie) const;
 
     // Answers the question: "Is dn a subdirectory of this?"
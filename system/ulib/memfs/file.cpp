@@ -12,6 +12,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fdio/vfs.h>
@@ -26,11 +27,17 @@ namespace memfs {
 // Artificially cap the maximum in-memory file size to 512MB.
 constexpr size_t kMemfsMaxFileSize = 512 * 1024 * 1024;
 
+// A growing file's VMO is doubled up to this much at a time. Pages past the
+// end of the file are never committed, so growing early only saves resizing
+// the VMO on every write.
+constexpr size_t kMemfsMaxGrowth = 8 * 1024 * 1024;
+
 VnodeFile::VnodeFile(Vfs* vfs)
-    : VnodeMemfs(vfs), vmo_(ZX_HANDLE_INVALID), length_(0) {}
+    : VnodeMemfs(vfs), vmo_(ZX_HANDLE_INVALID), vmo_size_(0), length_(0) {}
 
 VnodeFile::VnodeFile(Vfs* vfs, zx_handle_t vmo, zx_off_t length)
-    : VnodeMemfs(vfs), vmo_(vmo), length_(length) {}
+    : VnodeMemfs(vfs), vmo_(vmo),
+      vmo_size_(fbl::round_up(length, static_cast<zx_off_t>(PAGE_SIZE))), length_(length) {}
 
 VnodeFile::~VnodeFile() {
     if (vmo_ != ZX_HANDLE_INVALID) {
@@ -46,6 +53,7 @@ zx_status_t VnodeFile::ValidateFlags(uint32_t flags) {
 }
 
 zx_status_t VnodeFile::Read(void* data, size_t len, size_t off, size_t* out_actual) {
+    fbl::AutoLock lock(&lock_);
     if ((off >= length_) || (vmo_ == ZX_HANDLE_INVALID)) {
         *out_actual = 0;
         return ZX_OK;
@@ -58,6 +66,12 @@ zx_status_t VnodeFile::Read(void* data, size_t len, size_t off, size_t* out_actu
 
 zx_status_t VnodeFile::Write(const void* data, size_t len, size_t offset,
                              size_t* out_actual) {
+    fbl::AutoLock lock(&lock_);
+    return WriteLocked(data, len, offset, out_actual);
+}
+
+zx_status_t VnodeFile::WriteLocked(const void* data, size_t len, size_t offset,
+                                   size_t* out_actual) {
     zx_status_t status;
     size_t newlen = offset + len;
     newlen = newlen > kMemfsMaxFileSize ? kMemfsMaxFileSize : newlen;
@@ -68,11 +82,17 @@ zx_status_t VnodeFile::Write(const void* data, size_t len, size_t offset,
         if ((status = zx_vmo_create(alignedLen, 0, &vmo_)) != ZX_OK) {
             return status;
         }
-    } else if (newlen > fbl::round_up(length_, static_cast<size_t>(PAGE_SIZE))) {
-        // Accessing beyond the end of the file? Extend it.
-        if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
+        vmo_size_ = alignedLen;
+    } else if (alignedLen > vmo_size_) {
+        // Accessing beyond the end of the VMO? Extend it, leaving room for
+        // the writes after this one.
+        size_t grown = vmo_size_ + fbl::min(vmo_size_, kMemfsMaxGrowth);
+        grown = fbl::min(fbl::max(grown, alignedLen),
+                         fbl::round_up(kMemfsMaxFileSize, static_cast<size_t>(PAGE_SIZE)));
+        if ((status = zx_vmo_set_size(vmo_, grown)) != ZX_OK) {
             return status;
         }
+        vmo_size_ = grown;
     }
 
     if ((status = zx_vmo_write(vmo_, data, offset, len, out_actual)) != ZX_OK) {
@@ -86,24 +106,31 @@ zx_status_t VnodeFile::Write(const void* data, size_t len, size_t offset,
         // short write because we're beyond the end of the permissible length
         return ZX_ERR_FILE_BIG;
     }
-    UpdateModified();
+    modify_time_ = zx_clock_get(ZX_CLOCK_UTC);
     return ZX_OK;
 }
 
 zx_status_t VnodeFile::Append(const void* data, size_t len, size_t* out_end,
                               size_t* out_actual) {
-    zx_status_t status = Write(data, len, length_, out_actual);
+    fbl::AutoLock lock(&lock_);
+    zx_status_t status = WriteLocked(data, len, length_, out_actual);
     *out_end = length_;
     return status;
 }
 
 zx_status_t VnodeFile::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) {
+    if (flags & FDIO_MMAP_FLAG_STABLE) {
+        // The file may be written at any time.
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    fbl::AutoLock lock(&lock_);
     if (vmo_ == ZX_HANDLE_INVALID) {
         // First access to the file? Allocate it.
         zx_status_t status;
         if ((status = zx_vmo_create(0, 0, &vmo_)) != ZX_OK) {
             return status;
         }
+        vmo_size_ = 0;
     }
 
     zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP;
@@ -119,6 +146,7 @@ zx_status_t VnodeFile::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out
 
 zx_status_t VnodeFile::Getattr(vnattr_t* attr) {
     memset(attr, 0, sizeof(vnattr_t));
+    fbl::AutoLock lock(&lock_);
     attr->inode = ino_;
     attr->mode = V_TYPE_FILE | V_IRUSR | V_IWUSR | V_IRGRP | V_IROTH;
     attr->size = length_;
@@ -138,11 +166,13 @@ zx_status_t VnodeFile::Truncate(size_t len) {
 
     size_t alignedLen = fbl::round_up(len, static_cast<size_t>(PAGE_SIZE));
 
+    fbl::AutoLock lock(&lock_);
     if (vmo_ == ZX_HANDLE_INVALID) {
         // First access to the file? Allocate it.
         if ((status = zx_vmo_create(alignedLen, 0, &vmo_)) != ZX_OK) {
             return status;
         }
+        vmo_size_ = alignedLen;
     } else if ((len < length_) && (len % PAGE_SIZE != 0)) {
         // Currently, if the file is truncated to a 'partial page', an later re-expanded, then the
         // partial page is *not necessarily* filled with zeroes. As a consequence, we manually must
@@ -159,8 +189,14 @@ zx_status_t VnodeFile::Truncate(size_t len) {
         } else if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
             return status;
         }
-    } else if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
-        return status;
+        vmo_size_ = alignedLen;
+    } else if ((len < length_) || (alignedLen > vmo_size_)) {
+        // Shrinking frees the pages past the new end; growing needs only
+        // as much as asked for, since the file is rarely written past it.
+        if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
+            return status;
+        }
+        vmo_size_ = alignedLen;
     }
 
     length_ = len;
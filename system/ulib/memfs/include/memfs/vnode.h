@@ -17,7 +17,9 @@
 #include <fs/vfs.h>
 #include <fs/vnode.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/intrusive_double_list.h>
+#include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fs/remote.h>
@@ -41,12 +43,17 @@ public:
     // To be more specific: Is this vnode connected into the directory hierarchy?
     // VnodeDirs can be unlinked, and this method will subsequently return false.
     bool IsDirectory() const { return dnode_ != nullptr; }
-    void UpdateModified() { modify_time_ = zx_clock_get(ZX_CLOCK_UTC); }
+    void UpdateModified() __TA_EXCLUDES(lock_) {
+        fbl::AutoLock lock(&lock_);
+        modify_time_ = zx_clock_get(ZX_CLOCK_UTC);
+    }
 
     virtual ~VnodeMemfs();
 
     Vfs* vfs() const { return vfs_; }
 
+    // These only change with the Vfs's lock held exclusively, by operations
+    // which add or remove names.
     fbl::RefPtr<Dnode> dnode_;
     uint32_t link_count_;
 
@@ -56,7 +63,11 @@ protected:
     Vfs* vfs_;
     uint64_t ino_;
     uint64_t create_time_;
-    uint64_t modify_time_;
+
+    // Connections to different vnodes are served concurrently, so each
+    // vnode locks the state which its operations change.
+    fbl::Mutex lock_;
+    uint64_t modify_time_ __TA_GUARDED(lock_);
 
 private:
     static fbl::atomic<uint64_t> ino_ctr_;
@@ -80,8 +91,14 @@ private:
     zx_status_t Getattr(vnattr_t* a) final;
     zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) final;
 
-    zx_handle_t vmo_;
-    zx_off_t length_;
+    zx_status_t WriteLocked(const void* data, size_t len, size_t offset,
+                            size_t* out_actual) __TA_REQUIRES(lock_);
+
+    zx_handle_t vmo_ __TA_GUARDED(lock_);
+    // The size of |vmo_|, which grows ahead of |length_|. Everything past
+    // |length_| reads as zero.
+    zx_off_t vmo_size_ __TA_GUARDED(lock_);
+    zx_off_t length_ __TA_GUARDED(lock_);
 };
 
 class VnodeDir final : public VnodeMemfs {
@@ -115,6 +132,10 @@ public:
 private:
     zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
                         size_t* out_actual) final;
+    zx_status_t ReaddirAttr(fs::vdircookie_t* cookie, void* dirents, size_t len,
+                            size_t* out_actual) final;
+    zx_status_t ReaddirInternal(fs::DirentFiller* df, fs::vdircookie_t* cookie,
+                                size_t* out_actual);
 
     // Resolves the question, "Can this directory create a child node with the name?"
     // Returns "ZX_OK" on success; otherwise explains failure with error message.
@@ -153,10 +174,14 @@ private:
     zx_status_t GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* type,
                            zxrio_object_info_t* extra) final;
 
-    zx_handle_t vmo_;
-    zx_off_t offset_;
-    zx_off_t length_;
-    bool have_local_clone_;
+    // The file's contents never change, so reads need no lock.
+    zx_handle_t const vmo_;
+    zx_off_t const offset_;
+    zx_off_t const length_;
+
+    // Clone of just the file's window of |vmo_|, made the first time it is
+    // handed out, if the window is not all of |vmo_|.
+    zx_handle_t local_clone_ __TA_GUARDED(lock_);
 };
 
 class Vfs : public fs::Vfs {
@@ -166,6 +191,11 @@ public:
                               zx_off_t len);
 
     void MountSubtree(VnodeDir* parent, fbl::RefPtr<VnodeDir> subtree);
+
+    // Looks up the directory |name| in |parent|, creating it if it doesn't
+    // exist yet.
+    zx_status_t LookupOrCreateDir(VnodeDir* parent, fbl::StringPiece name,
+                                  fbl::RefPtr<VnodeDir>* out);
 };
 
 zx_status_t createFilesystem(const char* name, memfs::Vfs* vfs, fbl::RefPtr<VnodeDir>* out);
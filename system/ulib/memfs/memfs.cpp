@@ -29,15 +29,34 @@ namespace memfs {
 zx_status_t Vfs::CreateFromVmo(VnodeDir* parent, bool vmofile, fbl::StringPiece name,
                              zx_handle_t vmo, zx_off_t off,
                              zx_off_t len) {
-    fbl::AutoLock lock(&vfs_lock_);
+    fs::ExclusiveLock lock(&vfs_lock_);
     return parent->CreateFromVmo(vmofile, name, vmo, off, len);
 }
 
 void Vfs::MountSubtree(VnodeDir* parent, fbl::RefPtr<VnodeDir> subtree) {
-    fbl::AutoLock lock(&vfs_lock_);
+    fs::ExclusiveLock lock(&vfs_lock_);
     parent->MountSubtree(fbl::move(subtree));
 }
 
+zx_status_t Vfs::LookupOrCreateDir(VnodeDir* parent, fbl::StringPiece name,
+                                   fbl::RefPtr<VnodeDir>* out) {
+    fs::ExclusiveLock lock(&vfs_lock_);
+    fbl::RefPtr<fs::Vnode> vn;
+    zx_status_t status = parent->Lookup(&vn, name);
+    if (status == ZX_ERR_NOT_FOUND) {
+        status = parent->Create(&vn, name, S_IFDIR);
+    }
+    if (status != ZX_OK) {
+        return status;
+    }
+    auto dir = fbl::RefPtr<VnodeMemfs>::Downcast(fbl::move(vn));
+    if (!dir->IsDirectory()) {
+        return ZX_ERR_NOT_DIR;
+    }
+    *out = fbl::RefPtr<VnodeDir>::Downcast(fbl::move(dir));
+    return ZX_OK;
+}
+
 fbl::atomic<uint64_t> VnodeMemfs::ino_ctr_(0);
 
 VnodeMemfs::VnodeMemfs(Vfs* vfs) : dnode_(nullptr), link_count_(0), vfs_(vfs),
@@ -53,6 +72,7 @@ zx_status_t VnodeMemfs::Setattr(const vnattr_t* attr) {
         return ZX_ERR_INVALID_ARGS;
     }
     if (attr->valid & ATTR_MTIME) {
+        fbl::AutoLock lock(&lock_);
         modify_time_ = attr->modify_time;
     }
     return ZX_OK;
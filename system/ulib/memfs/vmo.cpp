@@ -12,6 +12,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
 #include <fdio/vfs.h>
@@ -36,11 +37,12 @@ bool WindowMatchesVMO(zx_handle_t vmo, zx_off_t offset, zx_off_t length) {
 }  // namespace
 
 VnodeVmo::VnodeVmo(Vfs* vfs, zx_handle_t vmo, zx_off_t offset, zx_off_t length)
-    : VnodeMemfs(vfs), vmo_(vmo), offset_(offset), length_(length), have_local_clone_(false) {}
+    : VnodeMemfs(vfs), vmo_(vmo), offset_(offset), length_(length),
+      local_clone_(ZX_HANDLE_INVALID) {}
 
 VnodeVmo::~VnodeVmo() {
-    if (have_local_clone_) {
-        zx_handle_close(vmo_);
+    if (local_clone_ != ZX_HANDLE_INVALID) {
+        zx_handle_close(local_clone_);
     }
 }
 
@@ -64,22 +66,23 @@ zx_status_t VnodeVmo::GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* typ
     zx_off_t* len = off + 1;
     zx_handle_t vmo;
     zx_status_t status;
-    if (!have_local_clone_ && !WindowMatchesVMO(vmo_, offset_, length_)) {
-        status = zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, offset_, length_, &vmo_);
+    fbl::AutoLock lock(&lock_);
+    if (local_clone_ == ZX_HANDLE_INVALID && !WindowMatchesVMO(vmo_, offset_, length_)) {
+        status = zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, offset_, length_,
+                              &local_clone_);
         if (status < 0)
             return status;
-        offset_ = 0;
-        have_local_clone_ = true;
     }
+    bool cloned = local_clone_ != ZX_HANDLE_INVALID;
     status = zx_handle_duplicate(
-        vmo_,
+        cloned ? local_clone_ : vmo_,
         ZX_RIGHT_READ | ZX_RIGHT_EXECUTE | ZX_RIGHT_MAP |
         ZX_RIGHTS_BASIC | ZX_RIGHT_GET_PROPERTY,
         &vmo);
     if (status < 0)
         return status;
 
-    *off = offset_;
+    *off = cloned ? 0 : offset_;
     *len = length_;
     *hnd = vmo;
     *type = FDIO_PROTOCOL_VMOFILE;
@@ -106,6 +109,7 @@ zx_status_t VnodeVmo::Getattr(vnattr_t* attr) {
     attr->blkcount = fbl::round_up(attr->size, kMemfsBlksize) / VNATTR_BLKSIZE;
     attr->nlink = link_count_;
     attr->create_time = create_time_;
+    fbl::AutoLock lock(&lock_);
     attr->modify_time = modify_time_;
     return ZX_OK;
 }
@@ -25,11 +25,9 @@ zx_status_t Bcache::Readblk(blk_t bno, void* data) {
 #ifndef __Fuchsia__
     off += offset_;
 #endif
-    if (lseek(fd_.get(), off, SEEK_SET) < 0) {
-        FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
-        return ZX_ERR_IO;
-    }
-    if (read(fd_.get(), data, kMinfsBlockSize) != kMinfsBlockSize) {
+    // Vnode operations may run on several threads at once, so the offset goes
+    // with the read rather than through the shared file position.
+    if (pread(fd_.get(), data, kMinfsBlockSize, off) != kMinfsBlockSize) {
         FS_TRACE_ERROR("minfs: cannot read block %u\n", bno);
         return ZX_ERR_IO;
     }
@@ -42,11 +40,7 @@ zx_status_t Bcache::Writeblk(blk_t bno, const void* data) {
 #ifndef __Fuchsia__
     off += offset_;
 #endif
-    if (lseek(fd_.get(), off, SEEK_SET) < 0) {
-        FS_TRACE_ERROR("minfs: cannot seek to block %u\n", bno);
-        return ZX_ERR_IO;
-    }
-    if (write(fd_.get(), data, kMinfsBlockSize) != kMinfsBlockSize) {
+    if (pwrite(fd_.get(), data, kMinfsBlockSize, off) != kMinfsBlockSize) {
         FS_TRACE_ERROR("minfs: cannot write block %u\n", bno);
         return ZX_ERR_IO;
     }
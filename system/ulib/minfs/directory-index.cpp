@@ -0,0 +1,93 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/alloc_checker.h>
+#include <zircon/assert.h>
+#include <zircon/misc/fnv1hash.h>
+
+#include "directory-index.h"
+
+namespace minfs {
+
+DirectoryIndex::~DirectoryIndex() {
+    by_space_.clear();
+    by_name_.clear();
+    by_offset_.clear();
+}
+
+uint32_t DirectoryIndex::HashName(fbl::StringPiece name) {
+    return fnv1a32(name.data(), name.length());
+}
+
+zx_status_t DirectoryIndex::Add(uint32_t off, uint32_t reclen, uint32_t used,
+                                fbl::StringPiece name) {
+    ZX_DEBUG_ASSERT(used <= reclen);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Record> record(new (&ac) Record());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    record->off = off;
+    record->slack = reclen - used;
+    record->used = used != 0;
+    record->hash = record->used ? HashName(name) : 0;
+
+    by_space_.insert(record.get());
+    if (record->used) {
+        by_name_.insert(record.get());
+    }
+    by_offset_.insert(fbl::move(record));
+    return ZX_OK;
+}
+
+void DirectoryIndex::Remove(uint32_t off) {
+    auto iter = by_offset_.find(off);
+    ZX_DEBUG_ASSERT(iter.IsValid());
+    if (!iter.IsValid()) {
+        return;
+    }
+    by_space_.erase(*iter);
+    if (iter->used) {
+        by_name_.erase(*iter);
+    }
+    by_offset_.erase(iter);
+}
+
+bool DirectoryIndex::FindName(uint32_t hash, uint32_t* off) const {
+    auto iter = by_name_.lower_bound(Key(hash, *off));
+    if (!iter.IsValid() || iter->hash != hash) {
+        return false;
+    }
+    *off = iter->off;
+    return true;
+}
+
+bool DirectoryIndex::FindSpace(uint32_t reclen, uint32_t* off) const {
+    auto iter = by_space_.lower_bound(Key(reclen, 0));
+    if (!iter.IsValid()) {
+        return false;
+    }
+    *off = iter->off;
+    return true;
+}
+
+bool DirectoryIndex::Seek(uint32_t* off) const {
+    auto iter = by_offset_.lower_bound(*off);
+    if (!iter.IsValid()) {
+        return false;
+    }
+    *off = iter->off;
+    return true;
+}
+
+uint32_t DirectoryIndex::Prev(uint32_t off) const {
+    auto iter = by_offset_.find(off);
+    if (!iter.IsValid()) {
+        return off;
+    }
+    --iter;
+    return iter.IsValid() ? iter->off : off;
+}
+
+} // namespace minfs
@@ -0,0 +1,99 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <fbl/string_piece.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+namespace minfs {
+
+// An in-memory index of the records of one directory, so that lookups, creates
+// and unlinks need not scan it. Every record, used or free, is kept by offset
+// and by the space left over in it; used records are also kept by the hash of
+// their name.
+//
+// The on-disk format is unchanged, so readdir order is still the order of the
+// records in the directory. The index is built from a scan of the directory
+// (which, like any access, reads the whole directory into its VMO anyway), and
+// whoever changes a record is responsible for updating it.
+class DirectoryIndex {
+public:
+    DirectoryIndex() = default;
+    ~DirectoryIndex();
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DirectoryIndex);
+
+    static uint32_t HashName(fbl::StringPiece name);
+
+    // Records the |reclen| byte record at |off|. |used| is the DirentSize of
+    // the dirent named |name| held in it, or zero for a free record.
+    zx_status_t Add(uint32_t off, uint32_t reclen, uint32_t used, fbl::StringPiece name);
+
+    // Forgets the record at |off|.
+    void Remove(uint32_t off);
+
+    // Finds the first used record at or after |*off| whose name hashes to
+    // |hash|.
+    bool FindName(uint32_t hash, uint32_t* off) const;
+
+    // Finds the record with the least space left over which still has at
+    // least |reclen| bytes of it, the first such record on ties.
+    bool FindSpace(uint32_t reclen, uint32_t* off) const;
+
+    // Finds the first record at or after |*off|.
+    bool Seek(uint32_t* off) const;
+
+    // Returns the offset of the record before the one at |off|, or |off| if it
+    // is the first.
+    uint32_t Prev(uint32_t off) const;
+
+private:
+    struct Record {
+        uint32_t off;
+        uint32_t slack;
+        uint32_t hash;
+        bool used;
+
+        fbl::WAVLTreeNodeState<fbl::unique_ptr<Record>> by_offset_node;
+        fbl::WAVLTreeNodeState<Record*> by_space_node;
+        fbl::WAVLTreeNodeState<Record*> by_name_node;
+    };
+
+    // Composite keys sort on the high word, and on the offset in the low word.
+    static uint64_t Key(uint32_t hi, uint32_t off) {
+        return (static_cast<uint64_t>(hi) << 32) | off;
+    }
+
+    struct ByOffsetTraits {
+        static uint32_t GetKey(const Record& r) { return r.off; }
+        static bool LessThan(uint32_t a, uint32_t b) { return a < b; }
+        static bool EqualTo(uint32_t a, uint32_t b) { return a == b; }
+        static fbl::WAVLTreeNodeState<fbl::unique_ptr<Record>>& node_state(Record& r) {
+            return r.by_offset_node;
+        }
+    };
+    struct BySpaceTraits {
+        static uint64_t GetKey(const Record& r) { return Key(r.slack, r.off); }
+        static bool LessThan(uint64_t a, uint64_t b) { return a < b; }
+        static bool EqualTo(uint64_t a, uint64_t b) { return a == b; }
+        static fbl::WAVLTreeNodeState<Record*>& node_state(Record& r) { return r.by_space_node; }
+    };
+    struct ByNameTraits {
+        static uint64_t GetKey(const Record& r) { return Key(r.hash, r.off); }
+        static bool LessThan(uint64_t a, uint64_t b) { return a < b; }
+        static bool EqualTo(uint64_t a, uint64_t b) { return a == b; }
+        static fbl::WAVLTreeNodeState<Record*>& node_state(Record& r) { return r.by_name_node; }
+    };
+
+    fbl::WAVLTree<uint32_t, fbl::unique_ptr<Record>, ByOffsetTraits, ByOffsetTraits> by_offset_;
+    fbl::WAVLTree<uint64_t, Record*, BySpaceTraits, BySpaceTraits> by_space_;
+    fbl::WAVLTree<uint64_t, Record*, ByNameTraits, ByNameTraits> by_name_;
+};
+
+} // namespace minfs
@@ -9,6 +9,7 @@
 
 #include <minfs/format.h>
 #include <minfs/fsck.h>
+#include "journal.h"
 #include "minfs-private.h"
 
 // #define DEBUG_PRINTF
@@ -25,6 +26,7 @@ public:
     MinfsChecker();
     zx_status_t Init(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info);
     zx_status_t CheckInode(ino_t ino, ino_t parent, bool dot_or_dotdot);
+    zx_status_t CheckJournal();
     zx_status_t CheckForUnusedBlocks() const;
     zx_status_t CheckForUnusedInodes() const;
     zx_status_t CheckLinkCounts() const;
@@ -50,6 +52,7 @@ private:
                                ino_t parent, uint32_t flags);
     const char* CheckDataBlock(blk_t bno);
     zx_status_t CheckFile(minfs_inode_t* inode, ino_t ino);
+    zx_status_t CheckExtents(minfs_inode_t* inode, ino_t ino);
 
     fbl::RefPtr<Minfs> fs_;
     RawBitmap checked_inodes_;
@@ -308,7 +311,82 @@ const char* MinfsChecker::CheckDataBlock(blk_t bno) {
     return nullptr;
 }
 
+zx_status_t MinfsChecker::CheckExtents(minfs_inode_t* inode, ino_t ino) {
+    uint32_t block_count = 0;
+    // File blocks before this one are mapped by earlier extents.
+    blk_t next_file_block = 0;
+    uint32_t index = 0;
+
+    const minfs_extent_t* extents = inode->extents;
+    uint32_t in_block = fbl::min(inode->extent_count, kMinfsInlineExtents);
+    blk_t xbno = inode->xnum;
+    minfs_extent_block_t xblock;
+    while (true) {
+        for (uint32_t i = 0; i < in_block; i++, index++) {
+            const minfs_extent_t& extent = extents[i];
+            if (extent.count == 0 || extent.file_block < next_file_block) {
+                FS_TRACE_WARN("check: ino#%u: extent %u (%u@%u) empty or out of order\n",
+                              ino, index, extent.count, extent.file_block);
+                conforming_ = false;
+            }
+            for (uint32_t n = 0; n < extent.count; n++) {
+                const char* msg;
+                if ((msg = CheckDataBlock(extent.start + n)) != nullptr) {
+                    FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n", ino,
+                                  extent.file_block + n, extent.start + n, msg);
+                    conforming_ = false;
+                }
+            }
+            block_count += extent.count;
+            next_file_block = fbl::max(next_file_block, extent.file_block + extent.count);
+        }
+        if (index == inode->extent_count) {
+            break;
+        }
+
+        const char* msg;
+        if ((msg = CheckDataBlock(xbno)) != nullptr) {
+            FS_TRACE_ERROR("check: ino#%u: extent block @%u: %s\n", ino, xbno, msg);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        block_count++;
+
+        zx_status_t status;
+        if ((status = fs_->ReadDat(xbno, &xblock)) != ZX_OK) {
+            return status;
+        }
+        in_block = fbl::min(inode->extent_count - index, kMinfsExtentsPerBlock);
+        if (xblock.count != in_block) {
+            FS_TRACE_WARN("check: ino#%u: extent block @%u holds %u extents, expected %u\n",
+                          ino, xbno, xblock.count, in_block);
+            conforming_ = false;
+        }
+        extents = xblock.extents;
+        xbno = xblock.next;
+    }
+    if (xbno != 0) {
+        FS_TRACE_WARN("check: ino#%u: extent chain continues past the last extent\n", ino);
+        conforming_ = false;
+    }
+
+    unsigned max_blocks = fbl::round_up(inode->size, kMinfsBlockSize) / kMinfsBlockSize;
+    if (next_file_block > max_blocks) {
+        FS_TRACE_WARN("check: ino#%u: filesize too small\n", ino);
+        conforming_ = false;
+    }
+    if (block_count != inode->block_count) {
+        FS_TRACE_WARN("check: ino#%u: block count %u, actual blocks %u\n",
+             ino, inode->block_count, block_count);
+        conforming_ = false;
+    }
+    return ZX_OK;
+}
+
 zx_status_t MinfsChecker::CheckFile(minfs_inode_t* inode, ino_t ino) {
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        return CheckExtents(inode, ino);
+    }
+
     xprintf("Direct blocks: \n");
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         xprintf(" %d,", inode->dnum[n]);
@@ -461,6 +539,18 @@ zx_status_t MinfsChecker::CheckInode(ino_t ino, ino_t parent, bool dot_or_dotdot
     return ZX_OK;
 }
 
+zx_status_t MinfsChecker::CheckJournal() {
+    for (blk_t n = 0; n < fs_->info_.journal_blocks; n++) {
+        const blk_t bno = fs_->info_.journal_start + n;
+        const char* msg;
+        if ((msg = CheckDataBlock(bno)) != nullptr) {
+            FS_TRACE_WARN("check: journal block %u(@%u): %s\n", n, bno, msg);
+            conforming_ = false;
+        }
+    }
+    return ZX_OK;
+}
+
 zx_status_t MinfsChecker::CheckForUnusedBlocks() const {
     unsigned missing = 0;
     for (unsigned n = fs_->info_.dat_block; n < fs_->info_.block_count; n++) {
@@ -563,7 +653,11 @@ zx_status_t minfs_check(fbl::unique_ptr<Bcache> bc) {
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return ZX_ERR_IO;
     }
-    const minfs_info_t* info = reinterpret_cast<const minfs_info_t*>(data);
+    minfs_info_t* info = reinterpret_cast<minfs_info_t*>(data);
+    if ((status = ReplayJournal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs_check: could not replay journal: %d\n", status);
+        return status;
+    }
     minfs_dump_info(info);
     if ((status = minfs_check_info(info, bc.get())) != ZX_OK) {
         FS_TRACE_ERROR("minfs_check: check_info failure: %d\n", status);
@@ -586,6 +680,8 @@ zx_status_t minfs_check(fbl::unique_ptr<Bcache> bc) {
 
     // Save an error if it occurs, but check for subsequent errors
     // anyway.
+    r = chk.CheckJournal();
+    status |= (status != ZX_OK) ? 0 : r;
     r = chk.CheckForUnusedBlocks();
     status |= (status != ZX_OK) ? 0 : r;
     r = chk.CheckForUnusedInodes();
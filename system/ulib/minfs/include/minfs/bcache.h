@@ -49,6 +49,8 @@ public:
 #ifdef __Fuchsia__
     // Return the block size of the underlying block device.
     uint32_t BlockSize() const { return info_.block_size; }
+    // Whether the underlying block device can discard freed blocks.
+    bool TrimSupported() const { return (info_.flags & BLOCK_FLAG_TRIM_SUPPORT) != 0; }
 
     ssize_t GetDevicePath(char* out, size_t out_len);
     zx_status_t AttachVmo(zx_handle_t vmo, vmoid_t* out);
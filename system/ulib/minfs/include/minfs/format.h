@@ -35,7 +35,11 @@ typedef uint32_t ino_t;
 
 constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion        = 0x00000005;
+constexpr uint32_t kMinfsVersion        = 0x00000007;
+// The last versions without extent-mapped inodes and without a metadata
+// journal; still mounted, and upgraded to kMinfsVersion when they are.
+constexpr uint32_t kMinfsVersionBlockMap = 0x00000005;
+constexpr uint32_t kMinfsVersionNoJournal = 0x00000006;
 
 constexpr ino_t kMinfsRootIno           = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
@@ -50,6 +54,27 @@ constexpr uint32_t kMinfsIndirect       = 31;
 constexpr uint32_t kMinfsDoublyIndirect = 1;
 
 constexpr uint32_t kMinfsDirectPerIndirect = (kMinfsBlockSize / sizeof(blk_t));
+
+// A run of |count| data blocks starting at |start|, mapping the file blocks
+// starting at |file_block|.
+typedef struct {
+    blk_t start;
+    uint32_t count;
+    blk_t file_block;
+} minfs_extent_t;
+
+constexpr uint32_t kMinfsInlineExtents   = 15;
+constexpr uint32_t kMinfsExtentsPerBlock = ((kMinfsBlockSize - 8) / sizeof(minfs_extent_t));
+
+// Extents past the inline ones, kMinfsExtentsPerBlock to a block.
+typedef struct {
+    blk_t next;                     // next extent block, or 0
+    uint32_t count;                 // extents used in this block
+    minfs_extent_t extents[kMinfsExtentsPerBlock];
+} minfs_extent_block_t;
+
+static_assert(sizeof(minfs_extent_block_t) == kMinfsBlockSize,
+              "minfs extent block size is wrong");
 // not possible to have a block at or past this one
 // due to the limitations of the inode and indirect blocks
 // constexpr uint64_t kMinfsMaxFileBlock = (kMinfsDirect + (kMinfsIndirect * kMinfsDirectPerIndirect)
@@ -96,8 +121,32 @@ typedef struct {
     uint32_t abm_slices;    // Slices allocated to block bitmap
     uint32_t ino_slices;    // Slices allocated to inode table
     uint32_t dat_slices;    // Slices allocated to file data section
+    blk_t journal_start;    // first data block of the journal
+    uint32_t journal_blocks; // length of the journal, or 0 if there is none
 } minfs_info_t;
 
+// The journal is a run of allocated data blocks holding at most one entry: a
+// header block, followed by copies of the metadata blocks it lists. Entries
+// are written before the blocks they hold are written in place, and every
+// entry overwrites the previous one, which by then is entirely in place; so
+// replaying the entry, if its checksum holds, recovers any metadata update
+// which was torn by a crash. File data is not journaled.
+constexpr uint64_t kMinfsJournalMagic    = (0x6c6e724a53466e4dULL);
+constexpr uint32_t kMinfsJournalBlocks   = 128;
+constexpr uint32_t kMinfsJournalMinBlocks = 8;
+constexpr uint32_t kMinfsJournalTargets  = ((kMinfsBlockSize - 24) / sizeof(blk_t));
+
+typedef struct {
+    uint64_t magic;
+    uint64_t sequence;      // bumped for each entry
+    uint32_t count;         // blocks which follow the header
+    uint32_t checksum;      // crc32 of the header (with this zero) and blocks
+    blk_t targets[kMinfsJournalTargets]; // where each block belongs on disk
+} minfs_journal_header_t;
+
+static_assert(sizeof(minfs_journal_header_t) == kMinfsBlockSize,
+              "minfs journal header size is wrong");
+
 // Notes:
 // - the ibm, abm, ino, and dat regions must be in that order
 //   and may not overlap
@@ -111,6 +160,9 @@ typedef struct {
 //     ino_block + ino / kMinfsInodesPerBlock
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
+// - inodes without kMinfsInodeFlagExtents are block-mapped (version 5);
+//   they become extent-mapped when truncated to zero
+// - the journal's blocks are allocated in the abm, but belong to no inode
 
 typedef struct {
     uint32_t magic;
@@ -122,12 +174,27 @@ typedef struct {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
-    blk_t dnum[kMinfsDirect];    // direct blocks
-    blk_t inum[kMinfsIndirect];  // indirect blocks
-    blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
+    uint32_t flags;                 // kMinfsInodeFlag*
+    uint32_t rsvd[4];
+    union {
+        struct {
+            blk_t dnum[kMinfsDirect];    // direct blocks
+            blk_t inum[kMinfsIndirect];  // indirect blocks
+            blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
+        };
+        // With kMinfsInodeFlagExtents:
+        struct {
+            minfs_extent_t extents[kMinfsInlineExtents]; // sorted by file_block
+            uint32_t extent_count;       // total, inline and in extent blocks
+            blk_t xnum;                  // first extent block, or 0
+            uint32_t rsvd_extents;
+        };
+    };
 } minfs_inode_t;
 
+// The inode maps its blocks with extents rather than block pointers.
+constexpr uint32_t kMinfsInodeFlagExtents = 0x00000001;
+
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
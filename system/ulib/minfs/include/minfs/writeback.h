@@ -39,8 +39,10 @@ typedef struct {
     size_t vmo_offset;
     size_t dev_offset;
     size_t length;
+    bool data;  // File data, which is written in place rather than journaled.
 } write_request_t;
 
+class Journal;
 class WritebackBuffer;
 
 // A transaction consisting of enqueued VMOs to be written
@@ -59,23 +61,35 @@ public:
 
     // Identify that a block should be written to disk
     // as a later point in time.
-    void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
+    void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks) {
+        EnqueueInternal(vmo, vmo_offset, dev_offset, nblocks, false);
+    }
+    // As Enqueue, for the contents of regular files.
+    void EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                     uint64_t nblocks) {
+        EnqueueInternal(vmo, vmo_offset, dev_offset, nblocks, true);
+    }
+    // Identify that blocks freed by this transaction may be trimmed once
+    // it is on disk. Trims are advisory: they are dropped if the device
+    // can't trim, or if too many runs of blocks are freed at once.
+    void EnqueueTrim(uint64_t dev_offset, uint64_t nblocks);
     size_t Count() const { return count_; }
     write_request_t* Requests() { return &requests_[0]; }
-
-    // Activate the transaction, writing it out to disk.
-    //
-    // Each transaction uses the |vmo| / |vmoid| pair supplied, since the
-    // transactions should be all reading from a single in-memory buffer.
-    zx_status_t Flush(zx_handle_t vmo, vmoid_t vmoid);
+    size_t TrimCount() const { return trim_count_; }
+    const write_request_t* Trims() const { return &trims_[0]; }
 
     size_t BlkCount() const;
 
 private:
     friend class WritebackBuffer;
+    void EnqueueInternal(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                         uint64_t nblocks, bool data);
+
     Bcache* bc_;
     size_t count_ = 0;
     write_request_t requests_[MAX_TXN_MESSAGES];
+    size_t trim_count_ = 0;
+    write_request_t trims_[MAX_TXN_MESSAGES];
 };
 
 #else
@@ -99,12 +113,10 @@ public:
     void Reset();
 
 #ifdef __Fuchsia__
-    // Actually transacts the enqueued work, and resets the WritebackWork to
-    // its initial state.
-    //
-    // Returns the number of blocks of the writeback buffer that have been
-    // consumed.
-    size_t Complete(zx_handle_t vmo, vmoid_t vmoid);
+    // Signals the completion, if any, and resets the WritebackWork to its
+    // initial state. Called by the WritebackBuffer once it has written out
+    // the enqueued work.
+    void Complete();
 
     // Adds a completion to the WritebackWork, such that it will be signalled
     // when the WritebackWork is flushed to disk.
@@ -112,6 +124,7 @@ public:
     //
     // Only one completion may be set for each WritebackWork unit.
     void SetCompletion(completion_t* completion);
+    bool HasCompletion() const { return completion_ != nullptr; }
 #else
     void Complete();
 #endif
@@ -135,6 +148,13 @@ private:
 
 #ifdef __Fuchsia__
 
+// Queued work is written out once the oldest of it has waited this long, or
+// once this many blocks of it are queued, so that runs of small operations
+// reach the disk as a few large transactions. Work which carries a completion
+// is written out right away.
+constexpr zx_duration_t kWritebackDelay = ZX_MSEC(20);
+constexpr size_t kWritebackFlushBlocks = 256;
+
 // WritebackBuffer which manages a writeback buffer (and background thread,
 // which flushes this buffer out to disk).
 class WritebackBuffer {
@@ -154,6 +174,10 @@ public:
     // enqueued, preventing them from closing while the writeback is pending.
     void Enqueue(fbl::unique_ptr<WritebackWork> work) __TA_EXCLUDES(writeback_lock_);
 
+    // Starts sending the metadata of all work enqueued from now on through
+    // the journal described by |info|.
+    zx_status_t EnableJournal(const minfs_info_t* info) __TA_EXCLUDES(writeback_lock_);
+
 private:
     WritebackBuffer(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer);
 
@@ -174,6 +198,10 @@ private:
     // safely guarantee that space exists within the buffer.
     void CopyToBufferLocked(WriteTxn* txn) __TA_REQUIRES(writeback_lock_);
 
+    // Whether the queued work should be written out now, rather than waiting
+    // for more to join it.
+    bool FlushDueLocked() const __TA_REQUIRES(writeback_lock_);
+
     static int WritebackThread(void* arg);
 
     // The waiter struct may be used as a stack-allocated queue for producers.
@@ -183,6 +211,41 @@ private:
     using WorkQueue = Queue<fbl::unique_ptr<WritebackWork>>;
     using ProducerQueue = Queue<Waiter*>;
 
+    // The requests of writeback work which is committed together: file
+    // data, which is written in place first, and metadata, which goes
+    // through the journal (if there is one) before it is written in place.
+    struct Group {
+        write_request_t data[MAX_TXN_MESSAGES];
+        size_t data_count;
+        write_request_t meta[MAX_TXN_MESSAGES];
+        size_t meta_count;
+        size_t meta_blocks;
+        // Blocks freed by the work in the group, trimmed once it is written.
+        write_request_t trim[MAX_TXN_MESSAGES];
+        size_t trim_count;
+    };
+
+    // Adds |req| to |group|, merging it with a request it continues (in the
+    // buffer and on disk) or replacing one it rewrites, so long as the order
+    // of writes to every block is kept. Returns false if it must wait for a
+    // new group instead. |capacity| is the most metadata blocks a group may
+    // journal.
+    static bool AddRequest(Group* group, const write_request_t& req, size_t capacity);
+    static bool AddWork(Group* group, WriteTxn* txn, size_t capacity);
+    // Adds the trims of |txn| to |group|, dropping those there is no room for.
+    static void AddTrims(Group* group, const WriteTxn* txn);
+
+    // Writes out all the work in |batch|, each unit whole within one group
+    // where it fits, then completes each unit of work. Returns the number of
+    // blocks of the writeback buffer consumed.
+    size_t WriteBatch(WorkQueue* batch, Journal* journal);
+    // Writes out |group|, completing the work in |done| once it is durable.
+    void WriteGroup(Group* group, WorkQueue* done, Journal* journal);
+    void WriteRequests(const write_request_t* reqs, size_t count);
+    // Trims the freed blocks of |group|, except any the group itself writes,
+    // since they may have been allocated again.
+    void TrimRequests(const Group* group);
+
     // Signalled when the writeback buffer can be consumed by the background
     // thread.
     cnd_t consumer_cvar_;
@@ -203,8 +266,13 @@ private:
     // writeback buffer and are ready to be sent to disk.
     WorkQueue work_queue_ __TA_GUARDED(writeback_lock_){};
     bool unmounting_ __TA_GUARDED(writeback_lock_){false};
+    // Set when some producer can't wait for the flush delay.
+    bool flush_now_ __TA_GUARDED(writeback_lock_){false};
+    // When the oldest unit in |work_queue_| was enqueued.
+    zx_time_t batch_start_ __TA_GUARDED(writeback_lock_){};
     fbl::unique_ptr<MappedVmo> buffer_{};
     vmoid_t buffer_vmoid_ = VMOID_INVALID;
+    fbl::unique_ptr<Journal> journal_ __TA_GUARDED(writeback_lock_){};
     // The units of all the following are "MinFS blocks".
     size_t start_ __TA_GUARDED(writeback_lock_){};
     size_t len_ __TA_GUARDED(writeback_lock_){};
@@ -0,0 +1,228 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fs/trace.h>
+#include <lib/cksum.h>
+#include <zircon/assert.h>
+
+#include "journal.h"
+#include "minfs-private.h"
+
+namespace minfs {
+
+blk_t JournalBlocks(uint32_t block_count) {
+    blk_t blocks = fbl::min(kMinfsJournalBlocks, block_count / 16);
+    return blocks < kMinfsJournalMinBlocks ? 0 : blocks;
+}
+
+uint32_t JournalChecksumHeader(const minfs_journal_header_t* header) {
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(header);
+    const size_t checksum_off = offsetof(minfs_journal_header_t, checksum);
+    const size_t targets_off = checksum_off + sizeof(header->checksum);
+    const uint32_t zero = 0;
+    uint32_t crc = crc32(0, data, checksum_off);
+    crc = crc32(crc, reinterpret_cast<const uint8_t*>(&zero), sizeof(zero));
+    return crc32(crc, data + targets_off, sizeof(*header) - targets_off);
+}
+
+uint32_t JournalChecksumBlock(uint32_t crc, const void* block) {
+    return crc32(crc, static_cast<const uint8_t*>(block), kMinfsBlockSize);
+}
+
+zx_status_t ReplayJournal(Bcache* bc, minfs_info_t* info) {
+    // Anything wrong with the superblock itself is left to minfs_check_info.
+    if ((info->magic0 != kMinfsMagic0) || (info->magic1 != kMinfsMagic1) ||
+        (info->version != kMinfsVersion) || (info->journal_blocks == 0) ||
+        (info->journal_start == 0) || (info->journal_start >= info->block_count) ||
+        (info->journal_blocks > info->block_count - info->journal_start)) {
+        return ZX_OK;
+    }
+#ifndef __Fuchsia__
+    // Sparse images are only ever written by host tools, which don't journal,
+    // and their blocks don't lie where an entry's targets would say.
+    if (bc->extent_lengths_.size() != 0) {
+        return ZX_OK;
+    }
+#endif
+
+    const blk_t start = info->dat_block + info->journal_start;
+    const blk_t end = start + info->journal_blocks;
+    minfs_journal_header_t header;
+    uint8_t blk[kMinfsBlockSize];
+    zx_status_t status;
+    if ((status = bc->Readblk(start, &header)) != ZX_OK) {
+        return status;
+    }
+
+    // An entry which was torn by a crash is simply dropped: none of its
+    // blocks were written in place yet.
+    bool complete = (header.magic == kMinfsJournalMagic) &&
+                    (header.count < info->journal_blocks) &&
+                    (header.count <= kMinfsJournalTargets);
+    if (complete) {
+        uint32_t crc = JournalChecksumHeader(&header);
+        for (uint32_t i = 0; i < header.count; i++) {
+            if ((status = bc->Readblk(start + 1 + i, blk)) != ZX_OK) {
+                return status;
+            }
+            crc = JournalChecksumBlock(crc, blk);
+            if ((header.targets[i] >= start) && (header.targets[i] < end)) {
+                complete = false;
+            }
+        }
+        complete = complete && (crc == header.checksum);
+    }
+    if (complete) {
+        for (uint32_t i = 0; i < header.count; i++) {
+            if ((status = bc->Readblk(start + 1 + i, blk)) != ZX_OK) {
+                return status;
+            } else if ((status = bc->Writeblk(header.targets[i], blk)) != ZX_OK) {
+                return status;
+            }
+        }
+        if (bc->Sync() != 0) {
+            return ZX_ERR_IO;
+        }
+    }
+
+    if (header.magic != 0) {
+        // Clear the entry, but keep its sequence for the next one.
+        header.magic = 0;
+        header.count = 0;
+        if ((status = bc->Writeblk(start, &header)) != ZX_OK) {
+            return status;
+        } else if (bc->Sync() != 0) {
+            return ZX_ERR_IO;
+        }
+    }
+
+    if (complete) {
+        if ((status = bc->Readblk(0, blk)) != ZX_OK) {
+            return status;
+        }
+        memcpy(info, blk, sizeof(*info));
+    }
+    return ZX_OK;
+}
+
+#ifdef __Fuchsia__
+
+Journal::Journal(Bcache* bc, const minfs_info_t* info, const MappedVmo* buffer,
+                 vmoid_t buffer_vmoid)
+    : bc_(bc), buffer_(buffer), buffer_vmoid_(buffer_vmoid),
+      start_(info->dat_block + info->journal_start), blocks_(info->journal_blocks) {}
+
+Journal::~Journal() {
+    if (header_vmoid_ != VMOID_INVALID) {
+        block_fifo_request_t request;
+        request.txnid = bc_->TxnId();
+        request.vmoid = header_vmoid_;
+        request.opcode = BLOCKIO_CLOSE_VMO;
+        bc_->Txn(&request, 1);
+    }
+}
+
+zx_status_t Journal::Create(Bcache* bc, const minfs_info_t* info, const MappedVmo* buffer,
+                            vmoid_t buffer_vmoid, fbl::unique_ptr<Journal>* out) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Journal> journal(new (&ac) Journal(bc, info, buffer, buffer_vmoid));
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    zx_status_t status;
+    if ((status = MappedVmo::Create(kMinfsBlockSize, "minfs-journal",
+                                    &journal->header_)) != ZX_OK) {
+        return status;
+    } else if ((status = bc->AttachVmo(journal->header_->GetVmo(),
+                                       &journal->header_vmoid_)) != ZX_OK) {
+        return status;
+    }
+
+    // Carry on from the sequence of the last entry.
+    auto header = static_cast<minfs_journal_header_t*>(journal->header_->GetData());
+    if ((status = bc->Readblk(journal->start_, header)) != ZX_OK) {
+        return status;
+    }
+    journal->sequence_ = header->sequence + 1;
+
+    *out = fbl::move(journal);
+    return ZX_OK;
+}
+
+size_t Journal::Capacity() const {
+    return fbl::min(static_cast<size_t>(blocks_ - 1), static_cast<size_t>(kMinfsJournalTargets));
+}
+
+zx_status_t Journal::Commit(const write_request_t* reqs, size_t count) {
+    TRACE_DURATION("minfs", "Journal::Commit", "count", count);
+    // This entry overwrites the last one, so what that held must be in place
+    // first.
+    if (checkpoint_pending_ && bc_->Sync() != 0) {
+        return ZX_ERR_IO;
+    }
+    // The caller writes these blocks in place next, whether or not the commit
+    // succeeds.
+    checkpoint_pending_ = true;
+
+    auto header = static_cast<minfs_journal_header_t*>(header_->GetData());
+    memset(header, 0, sizeof(*header));
+    header->magic = kMinfsJournalMagic;
+    header->sequence = sequence_++;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < reqs[i].length; b++) {
+            ZX_DEBUG_ASSERT(header->count < Capacity());
+            header->targets[header->count++] = static_cast<blk_t>(reqs[i].dev_offset + b);
+        }
+    }
+    uint32_t crc = JournalChecksumHeader(header);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t b = 0; b < reqs[i].length; b++) {
+            crc = JournalChecksumBlock(crc, reinterpret_cast<const void*>(
+                    reinterpret_cast<uintptr_t>(buffer_->GetData()) +
+                    (reqs[i].vmo_offset + b) * kMinfsBlockSize));
+        }
+    }
+    header->checksum = crc;
+
+    // The header goes first, and the blocks of each request after it, in
+    // as few block device transactions as they fit in.
+    block_fifo_request_t blk_reqs[MAX_TXN_MESSAGES];
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->BlockSize();
+    size_t dev_offset = start_;
+    size_t n = 0;
+    for (size_t i = 0; i <= count; i++) {
+        const bool is_header = (i == 0);
+        const size_t length = is_header ? 1 : reqs[i - 1].length;
+        blk_reqs[n].txnid = bc_->TxnId();
+        blk_reqs[n].vmoid = is_header ? header_vmoid_ : buffer_vmoid_;
+        blk_reqs[n].opcode = BLOCKIO_WRITE;
+        blk_reqs[n].vmo_offset = (is_header ? 0 : reqs[i - 1].vmo_offset) *
+                                 kDiskBlocksPerMinfsBlock;
+        blk_reqs[n].dev_offset = dev_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[n].length = static_cast<uint32_t>(length * kDiskBlocksPerMinfsBlock);
+        dev_offset += length;
+        if (++n == MAX_TXN_MESSAGES || i == count) {
+            zx_status_t status = bc_->Txn(blk_reqs, n);
+            if (status != ZX_OK) {
+                return status;
+            }
+            n = 0;
+        }
+    }
+
+    if (bc_->Sync() != 0) {
+        return ZX_ERR_IO;
+    }
+    return ZX_OK;
+}
+
+#endif  // __Fuchsia__
+
+} // namespace minfs
@@ -0,0 +1,78 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __Fuchsia__
+#include <fs/mapped-vmo.h>
+#endif
+
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+#include <minfs/bcache.h>
+#include <minfs/format.h>
+#include <minfs/writeback.h>
+
+namespace minfs {
+
+// Returns the number of blocks to give the journal of a filesystem with
+// |block_count| data blocks, or zero if it is too small for one.
+blk_t JournalBlocks(uint32_t block_count);
+
+// The checksum of a journal entry covers its header, with the checksum taken
+// as zero, and then each of its blocks in turn.
+uint32_t JournalChecksumHeader(const minfs_journal_header_t* header);
+uint32_t JournalChecksumBlock(uint32_t crc, const void* block);
+
+// If the journal of the filesystem described by |info| holds a complete
+// entry, writes its blocks in place and clears it. |info| is read again
+// afterwards, since the entry may have held it.
+zx_status_t ReplayJournal(Bcache* bc, minfs_info_t* info);
+
+#ifdef __Fuchsia__
+
+// Makes the metadata written by each group of writeback work durable in the
+// journal, before the writeback buffer writes it in place.
+class Journal {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Journal);
+    ~Journal();
+
+    // |buffer| is the writeback buffer, attached to |bc| as |buffer_vmoid|,
+    // from which committed blocks are written.
+    static zx_status_t Create(Bcache* bc, const minfs_info_t* info, const MappedVmo* buffer,
+                              vmoid_t buffer_vmoid, fbl::unique_ptr<Journal>* out);
+
+    // The most blocks one commit may hold.
+    size_t Capacity() const;
+
+    // Writes the blocks of the writeback buffer that |reqs| write in place
+    // to the journal, and waits for them to be durable. The caller then
+    // writes them in place, which the next commit waits for in turn.
+    zx_status_t Commit(const write_request_t* reqs, size_t count);
+
+private:
+    Journal(Bcache* bc, const minfs_info_t* info, const MappedVmo* buffer,
+            vmoid_t buffer_vmoid);
+
+    Bcache* bc_;
+    const MappedVmo* buffer_;
+    vmoid_t buffer_vmoid_;
+    fbl::unique_ptr<MappedVmo> header_{};
+    vmoid_t header_vmoid_ = VMOID_INVALID;
+    // The journal's location on disk, header included.
+    blk_t start_;
+    blk_t blocks_;
+    uint64_t sequence_{};
+    // Whether blocks of the last commit may not yet be durable in place.
+    bool checkpoint_pending_{true};
+};
+
+#endif
+
+} // namespace minfs
@@ -14,15 +14,20 @@
 #include <fs/remote.h>
 #include <fs/watcher.h>
 #include <sync/completion.h>
+#include <sync/rwlock.h>
+#include <zircon/device/vfs.h>
+#include <zx/event.h>
 #include <zx/vmo.h>
 #endif
 
 #include <fbl/algorithm.h>
+#include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/intrusive_single_list.h>
 #include <fbl/macros.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
 
 #include <fs/block-txn.h>
 #include <fs/mapped-vmo.h>
@@ -35,6 +40,8 @@
 #include <minfs/format.h>
 #include <minfs/writeback.h>
 
+#include "directory-index.h"
+
 #define EXTENT_COUNT 5
 
 #define panic(fmt...)         \
@@ -78,10 +85,53 @@ constexpr uint32_t kMxFsSyncCtime = (1 << 1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
 
+// Bounds on how many blocks past a sequential read of a file are read with it.
+// The window starts at the minimum and doubles on each sequential read.
+constexpr uint32_t kMinfsReadaheadMin = 4;
+constexpr uint32_t kMinfsReadaheadMax = 128;
+
+// How many written blocks of a file may wait for their disk blocks to be
+// allocated, and the blocks reserved on top of those for the metadata that
+// allocating them may dirty.
+constexpr uint32_t kMinfsMaxPendingBlocks = 256;
+constexpr uint32_t kMinfsPendingMetadataBlocks = 2;
+
 // Used by fsck
 class MinfsChecker;
 class VnodeMinfs;
 
+#ifdef __Fuchsia__
+struct PendingListTraits {
+    static fbl::DoublyLinkedListNodeState<VnodeMinfs*>& node_state(VnodeMinfs& vn);
+};
+
+// What a vnode had read in from disk, kept by its filesystem after the vnode
+// itself is released so that opening the inode again can start from it. Only
+// vnodes with nothing left to write back are kept.
+struct CachedVnode : public fbl::SinglyLinkedListable<CachedVnode*>,
+                     public fbl::DoublyLinkedListable<fbl::unique_ptr<CachedVnode>> {
+    explicit CachedVnode(Bcache* bc) : bc(bc) {}
+    // Detaches the VMOs from the block device.
+    ~CachedVnode();
+
+    ino_t GetKey() const { return ino; }
+    static size_t GetHash(ino_t key) { return fnv1a_tiny(key, kMinfsHashBits); }
+
+    Bcache* bc;
+    ino_t ino{};
+    // Bytes of memory held by the VMOs below.
+    size_t bytes{};
+    zx::vmo vmo{};
+    vmoid_t vmoid{};
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> vmo_populated{};
+    fbl::unique_ptr<MappedVmo> vmo_indirect{};
+    vmoid_t vmoid_indirect{};
+    fbl::Vector<minfs_extent_t> extents{};
+    fbl::Vector<blk_t> extent_blocks{};
+    fbl::unique_ptr<DirectoryIndex> dir_index{};
+};
+#endif
+
 class Minfs : public fbl::RefCounted<Minfs> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Minfs);
@@ -104,6 +154,8 @@ public:
     void VnodeInsert(VnodeMinfs* vn) __TA_EXCLUDES(hash_lock_);
     fbl::RefPtr<VnodeMinfs> VnodeLookup(uint32_t ino) __TA_EXCLUDES(hash_lock_);
     void VnodeReleaseLocked(VnodeMinfs* vn) __TA_REQUIRES(hash_lock_);
+    void VnodeInsertLocked(VnodeMinfs* vn) __TA_REQUIRES(hash_lock_);
+    fbl::RefPtr<VnodeMinfs> VnodeLookupLocked(uint32_t ino) __TA_REQUIRES(hash_lock_);
 
     // Allocate a new data block.
     zx_status_t BlockNew(WriteTxn* txn, blk_t hint, blk_t* out_bno);
@@ -111,6 +163,10 @@ public:
     // free block in block bitmap
     zx_status_t BlockFree(WriteTxn* txn, blk_t bno);
 
+    // Marks an older filesystem as kMinfsVersion, since once mounted it may
+    // get extent-mapped inodes, and gives it a journal if there is room.
+    zx_status_t UpgradeVersion();
+
     // free ino in inode bitmap, release all blocks held by inode
     zx_status_t InoFree(VnodeMinfs* vn, WriteTxn* txn);
 
@@ -139,6 +195,33 @@ public:
     // (1) A sync probe has entered and exited the writeback queue, and
     // (2) The block cache has sync'd with the underlying block device.
     zx_status_t Sync(completion_t* completion);
+
+    // Queues trims of every free block behind the writeback already queued,
+    // so no block is trimmed before the work freeing it is on disk, and
+    // returns the number of bytes queued once they have been committed.
+    zx_status_t TrimFree(uint64_t* out_bytes);
+
+    // Counters for the file data held in the vnodes' VMOs. Reads update
+    // them concurrently, so they have a lock of their own.
+    fbl::Mutex cache_info_lock_;
+    vfs_cache_info_t cache_info_ __TA_GUARDED(cache_info_lock_){};
+
+    // Blocks written to files which are not yet allocated are reserved, so
+    // that allocating them later cannot run out of space. Returns false if
+    // there is not enough free space to reserve |count| more blocks.
+    bool ReserveBlocks(blk_t count);
+    void ReleaseBlocks(blk_t count);
+
+    // Allocates the pending blocks of every file, and enqueues their writes.
+    zx_status_t AllocatePending();
+
+    // Vnodes with written blocks still waiting for allocation.
+    fbl::DoublyLinkedList<VnodeMinfs*, PendingListTraits> pending_vnodes_{};
+
+    // Called as |vn| is released: keeps what it has read in from disk for
+    // the next VnodeGet of its inode, evicting the least recently released
+    // entries to stay within the cache's bounds.
+    void VnodeCacheInsertLocked(VnodeMinfs* vn) __TA_REQUIRES(hash_lock_);
 #endif
 
     // The following methods are used to read one block from the specified extent,
@@ -156,6 +239,11 @@ public:
     minfs_info_t info_{};
 #ifdef __Fuchsia__
     fbl::Mutex hash_lock_;
+
+    // Vnode operations which only read the filesystem hold this shared, and
+    // may run concurrently on the dispatcher's threads; everything else holds
+    // it exclusively. See ReadOpLock and WriteOpLock.
+    sync_rwlock_t lock_;
 #endif
 
 private:
@@ -172,6 +260,9 @@ private:
     // Enqueues an update for allocated inode/block counts
     zx_status_t CountUpdate(WriteTxn* txn);
 
+    // Allocates an empty journal for a filesystem which has none.
+    zx_status_t JournalNew(WriteTxn* txn);
+
     // If possible, attempt to resize the MinFS partition.
     zx_status_t AddInodes();
     zx_status_t AddBlocks();
@@ -182,6 +273,12 @@ private:
 
 #ifndef __Fuchsia__
     zx_status_t ReadBlk(blk_t bno, blk_t start, blk_t soft_max, blk_t hard_max, void* data);
+#else
+    // Hands whatever is cached for the inode of |vn| over to it.
+    void VnodeCacheTakeLocked(VnodeMinfs* vn) __TA_REQUIRES(hash_lock_);
+    // Evicts the least recently released entries until no more than
+    // |max_count| of them, holding no more than |max_bytes|, remain.
+    void VnodeCacheTrimLocked(size_t max_count, size_t max_bytes) __TA_REQUIRES(hash_lock_);
 #endif
 
     uint32_t abmblks_{};
@@ -203,6 +300,18 @@ private:
     vmoid_t info_vmoid_{};
     fbl::unique_ptr<WritebackBuffer> writeback_;
     uint64_t fs_id_{};
+    blk_t reserved_blocks_{};
+
+    // Released vnodes' cached state, by inode and least recently released
+    // first, and the bytes held by all of it.
+    fbl::HashTable<ino_t, CachedVnode*> vnode_cache_hash_ __TA_GUARDED(hash_lock_){};
+    fbl::DoublyLinkedList<fbl::unique_ptr<CachedVnode>> vnode_cache_lru_ __TA_GUARDED(hash_lock_){};
+    size_t vnode_cache_bytes_ __TA_GUARDED(hash_lock_){};
+    // Signaled while the system is low on memory, so the cache gives up half
+    // of what it holds at the warning level and all of it at the critical one.
+    // Either may be invalid if the events could not be obtained.
+    zx::event memory_warning_;
+    zx::event memory_critical_;
 #else
     // Store start block + length for all extents. These may differ from info block for
     // sparse files.
@@ -268,12 +377,25 @@ public:
     // fbl::Recyclable interface.
     void fbl_recycle() final;
 
+#ifdef __Fuchsia__
+    // Allocates disk blocks for every pending block of the file, and enqueues
+    // their writes along with the inode.
+    zx_status_t AllocatePending();
+
+    // Moves what the vnode has read in from disk to |entry|, if it is
+    // worth keeping once the vnode is released, or back from it.
+    bool SaveCachedState(CachedVnode* entry);
+    void RestoreCachedState(CachedVnode* entry);
+#endif
+
     // TODO(rvargas): Make private.
     fbl::RefPtr<Minfs> fs_;
 
 private:
     // Fsck can introspect Minfs
     friend class MinfsChecker;
+    friend struct PendingListTraits;
+    friend class ReadOpLock;
     friend zx_status_t Minfs::InoFree(VnodeMinfs* vn, WriteTxn* txn);
 
     VnodeMinfs(Minfs* fs);
@@ -292,6 +414,8 @@ private:
     zx_status_t Setattr(const vnattr_t* a) final;
     zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
                         size_t* out_actual) final;
+    zx_status_t ReaddirAttr(fs::vdircookie_t* cookie, void* dirents, size_t len,
+                            size_t* out_actual) final;
     zx_status_t Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name,
                        uint32_t mode) final;
     zx_status_t Unlink(fbl::StringPiece name, bool must_be_dir) final;
@@ -305,6 +429,13 @@ private:
 
     // Internal functions
     zx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
+    // Getattr, once the caller holds at least the ReadOpLock of any vnode.
+    void GetattrLocked(vnattr_t* a) const;
+    // Readdir and ReaddirAttr, once the caller holds the ReadOpLock.
+    zx_status_t ReaddirLocked(fs::vdircookie_t* cookie, fs::DirentFiller* df,
+                              size_t* out_actual);
+    // Write, once the caller holds the WriteOpLock.
+    zx_status_t WriteLocked(const void* data, size_t len, size_t offset, size_t* out_actual);
     zx_status_t ReadExactInternal(void* data, size_t len, size_t off);
     zx_status_t WriteInternal(WriteTxn* txn, const void* data, size_t len,
                               size_t off, size_t* actual);
@@ -322,9 +453,18 @@ private:
                                            minfs_dirent_t*, DirArgs*,
                                            DirectoryOffset*);
 
-    // Enumerates directories.
+    // Enumerates directories. Once the directory index is loaded, only the records it points at
+    // are passed to |func|: those with room for |args->reclen| bytes for |DirentCallbackAppend|,
+    // and those whose name hashes like |args->name| for every other callback.
     zx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
 
+    // Builds |dir_index_| from a scan of the directory, if it is not already built.
+    zx_status_t LoadDirectoryIndex();
+    // Keep |dir_index_| in step with the records the callbacks write. If the
+    // index cannot be updated it is dropped, to be rebuilt on the next access.
+    void DirectoryIndexAdd(size_t off, uint32_t reclen, const minfs_dirent_t* de);
+    void DirectoryIndexRemove(size_t off);
+
     // Directory callback functions.
     //
     // The following functions are passable to |ForEachDirent|, which reads the parent directory,
@@ -447,6 +587,22 @@ private:
                                            size_t count, uint32_t dib_vmo_offset,
                                            uint32_t ib_vmo_offset, blk_t* diarray, bool* dirty);
 
+    bool IsExtentMapped() const { return (inode_.flags & kMinfsInodeFlagExtents) != 0; }
+
+    // Reads the extents of an extent-mapped inode into |extents_|, if they
+    // have not been already.
+    zx_status_t LoadExtents();
+
+    // The extent-mapped counterparts of GetBno and BlocksShrink. New blocks are
+    // allocated right after the previous block of the file where possible,
+    // extending its extent.
+    zx_status_t GetBnoExtent(WriteTxn* txn, blk_t n, blk_t* bno);
+    zx_status_t BlocksShrinkExtent(WriteTxn* txn, blk_t start);
+
+    // Writes |extents_| from index |first| onwards back to the inode and the
+    // extent blocks, allocating or freeing extent blocks to fit.
+    zx_status_t SyncExtents(WriteTxn* txn, size_t first);
+
     // Update the vnode's inode and write it to disk.
     void InodeSync(WriteTxn* txn, uint32_t flags);
 
@@ -460,7 +616,28 @@ private:
 #ifdef __Fuchsia__
     zx_status_t Sync() final;
     zx_status_t AttachRemote(fs::MountChannel h) final;
+    zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) final;
+    // Enqueues the write of every block of the file, since a shared writable
+    // mapping may have changed any of them. Only those holding data are
+    // allocated, through DelayAllocation.
+    zx_status_t WriteMapped();
     zx_status_t InitVmo();
+    // Makes the blocks of vmo_ within [start, end) hold the file's contents,
+    // reading in those which don't yet. Reads pass |readahead| to also read in
+    // the blocks a sequential reader will want next.
+    zx_status_t PopulateVmo(blk_t start, blk_t end, bool readahead);
+    // Marks blocks [start, end) of vmo_ as holding the file's contents.
+    void MarkVmoPopulated(blk_t start, blk_t end);
+    // Enqueues the write of block |n| of vmo_ to data block |bno|. Directory
+    // blocks are metadata, and go through the journal; file blocks don't.
+    void EnqueueVmoBlock(WriteTxn* txn, blk_t n, blk_t bno);
+
+    // Sets |*delayed| if the write of block |n| of the file can wait, in
+    // vmo_, for AllocatePending: for extent-mapped files, if the block is not
+    // yet on disk and space for it can be reserved.
+    zx_status_t DelayAllocation(blk_t n, bool* delayed);
+    // Forgets the pending blocks without writing them, and their reservation.
+    void DropPending();
     zx_status_t InitIndirectVmo();
 
     // Loads indirect blocks up to and including the doubly indirect block at |index|.
@@ -500,19 +677,45 @@ private:
 #endif
 
 #ifdef __Fuchsia__
+    // Held by operations which only read the vnode, along with its
+    // filesystem's lock held shared, while they fill in the state below which
+    // caches what is on disk: vmo_ and its bookkeeping, vmo_indirect_,
+    // extents_ and dir_index_. Operations holding the filesystem's lock
+    // exclusively don't need it.
+    fbl::Mutex lock_;
+
     // TODO(smklein): When we have can register MinFS as a pager service, and
     // it can properly handle pages faults on a vnode's contents, then we can
     // avoid reading the entire file up-front. Until then, read the contents of
     // a VMO into memory when it is read/written.
     zx::vmo vmo_{};
+    // Set once vmo_ has been handed out for a shared writable mapping, after
+    // which its blocks are written back by WriteMapped on Sync and last Close.
+    bool mapped_writable_{};
 
-    // vmo_indirect_ contains all indirect and doubly indirect blocks in the following order:
+    // For block-mapped inodes, vmo_indirect_ contains all indirect and doubly indirect blocks in
+    // the following order:
     // First kMinfsIndirect blocks                                - initial set of indirect blocks
     // Next kMinfsDoublyIndirect blocks                           - doubly indirect blocks
     // Next kMinfsDoublyIndirect * kMinfsDirectPerIndirect blocks - indirect blocks pointed to
     //                                                              by doubly indirect blocks
     fbl::unique_ptr<MappedVmo> vmo_indirect_{};
 
+    // The blocks of vmo_ which have been read in or written since it was
+    // created. Blocks past its size then were never on disk, and are always
+    // treated as read in.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> vmo_populated_{};
+    // Where the next read starts if it is sequential, and how many blocks
+    // past it to read along with it.
+    blk_t readahead_next_{};
+    blk_t readahead_window_{};
+
+    // Blocks of the file, in order, which have been written to vmo_ but
+    // have no disk blocks yet; the vnode is on Minfs::pending_vnodes_ while
+    // there are any.
+    fbl::Vector<blk_t> pending_{};
+    fbl::DoublyLinkedListNodeState<VnodeMinfs*> pending_node_{};
+
     vmoid_t vmoid_{};
     vmoid_t vmoid_indirect_{};
 
@@ -523,6 +726,16 @@ private:
     ino_t ino_{};
     minfs_inode_t inode_{};
 
+    // Extent-mapped inodes only: every extent of the file, and the extent
+    // blocks holding those past the inline ones, in chain order. On Fuchsia
+    // vmo_indirect_ stages the extent blocks being written out, in that order.
+    fbl::Vector<minfs_extent_t> extents_{};
+    fbl::Vector<blk_t> extent_blocks_{};
+
+    // Directories only: built on first use, and dropped on any error while
+    // the directory is being modified.
+    fbl::unique_ptr<DirectoryIndex> dir_index_{};
+
     // This field tracks the current number of file descriptors with
     // an open reference to this Vnode. Notably, this is distinct from the
     // VnodeMinfs's own refcount, since there may still be filesystem
@@ -530,6 +743,51 @@ private:
     uint32_t fd_count_{};
 };
 
+#ifdef __Fuchsia__
+inline fbl::DoublyLinkedListNodeState<VnodeMinfs*>& PendingListTraits::node_state(
+        VnodeMinfs& vn) {
+    return vn.pending_node_;
+}
+#endif
+
+// Taken at the start of a vnode operation which only reads |vn| and the
+// filesystem: lookups, reads, readdir and getattr.
+class ReadOpLock {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(ReadOpLock);
+#ifdef __Fuchsia__
+    explicit ReadOpLock(VnodeMinfs* vn) : fs_(vn->fs_.get()), vn_lock_(&vn->lock_) {
+        sync_rwlock_read_lock(&fs_->lock_);
+        vn_lock_->Acquire();
+    }
+    ~ReadOpLock() {
+        vn_lock_->Release();
+        sync_rwlock_read_unlock(&fs_->lock_);
+    }
+
+private:
+    Minfs* fs_;
+    fbl::Mutex* vn_lock_;
+#else
+    explicit ReadOpLock(VnodeMinfs* vn) {}
+#endif
+};
+
+// Taken at the start of every other vnode operation.
+class WriteOpLock {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(WriteOpLock);
+#ifdef __Fuchsia__
+    explicit WriteOpLock(Minfs* fs) : fs_(fs) { sync_rwlock_write_lock(&fs_->lock_); }
+    ~WriteOpLock() { sync_rwlock_write_unlock(&fs_->lock_); }
+
+private:
+    Minfs* fs_;
+#else
+    explicit WriteOpLock(Minfs* fs) {}
+#endif
+};
+
 // Return the block offset in vmo_indirect_ of indirect blocks pointed to by the doubly indirect
 // block at dindex
 constexpr uint32_t GetVmoOffsetForIndirect(uint32_t dibindex) {
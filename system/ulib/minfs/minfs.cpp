@@ -21,10 +21,14 @@
 
 #ifdef __Fuchsia__
 #include <fbl/auto_lock.h>
+#include <zircon/process.h>
+#include <zircon/syscalls.h>
+#include <zircon/syscalls/system.h>
 #include <zx/event.h>
 #endif
 
 #include <minfs/fsck.h>
+#include "journal.h"
 #include "minfs-private.h"
 
 // #define DEBUG_PRINTF
@@ -79,6 +83,8 @@ void minfs_dump_info(const minfs_info_t* info) {
     xprintf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     xprintf("minfs: inode table  @ %10u\n", info->ino_block);
     xprintf("minfs: data blocks  @ %10u\n", info->dat_block);
+    xprintf("minfs: journal      @ %10u (%u blocks)\n", info->journal_start,
+            info->journal_blocks);
     xprintf("minfs: FVM-aware: %s\n", (info->flags & kMinfsFlagFVM) ? "YES" : "NO");
 }
 
@@ -98,11 +104,20 @@ zx_status_t minfs_check_info(const minfs_info_t* info, Bcache* bc) {
         FS_TRACE_ERROR("minfs: bad magic\n");
         return ZX_ERR_INVALID_ARGS;
     }
-    if (info->version != kMinfsVersion) {
+    if ((info->version != kMinfsVersion) && (info->version != kMinfsVersionNoJournal) &&
+        (info->version != kMinfsVersionBlockMap)) {
         FS_TRACE_ERROR("minfs: FS Version: %08x. Driver version: %08x\n", info->version,
               kMinfsVersion);
         return ZX_ERR_INVALID_ARGS;
     }
+    if ((info->journal_blocks != 0) &&
+        ((info->journal_start == 0) || (info->journal_start >= info->block_count) ||
+         (info->journal_blocks < kMinfsJournalMinBlocks) ||
+         (info->journal_blocks > info->block_count - info->journal_start))) {
+        FS_TRACE_ERROR("minfs: journal %u+%u out of range\n", info->journal_start,
+                       info->journal_blocks);
+        return ZX_ERR_INVALID_ARGS;
+    }
     if ((info->block_size != kMinfsBlockSize) ||
         (info->inode_size != kMinfsInodeSize)) {
         FS_TRACE_ERROR("minfs: bsz/isz %u/%u unsupported\n", info->block_size, info->inode_size);
@@ -265,6 +280,76 @@ zx_status_t Minfs::Sync(completion_t* completion) {
     EnqueueWork(fbl::move(wb));
     return ZX_OK;
 }
+
+zx_status_t Minfs::TrimFree(uint64_t* out_bytes) {
+    if (!bc_->TrimSupported()) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    completion_t completion;
+    completion_reset(&completion);
+    uint64_t blocks = 0;
+    {
+        WriteOpLock lock(this);
+        fbl::unique_ptr<WritebackWork> wb;
+        size_t start = 0;
+        while (block_map_.Find(false, start, block_map_.size(), 1, &start) == ZX_OK) {
+            size_t end;
+            if (block_map_.Find(true, start, block_map_.size(), 1, &end) != ZX_OK) {
+                end = block_map_.size();
+            }
+            if (wb == nullptr || wb->txn()->TrimCount() == MAX_TXN_MESSAGES) {
+                if (wb != nullptr) {
+                    EnqueueWork(fbl::move(wb));
+                }
+                fbl::AllocChecker ac;
+                wb.reset(new (&ac) WritebackWork(bc_.get()));
+                if (!ac.check()) {
+                    return ZX_ERR_NO_MEMORY;
+                }
+            }
+            wb->txn()->EnqueueTrim(info_.dat_block + start, end - start);
+            blocks += end - start;
+            start = end;
+        }
+        if (wb == nullptr) {
+            *out_bytes = 0;
+            return ZX_OK;
+        }
+        wb->SetCompletion(&completion);
+        EnqueueWork(fbl::move(wb));
+    }
+    zx_status_t status;
+    if ((status = completion_wait(&completion, ZX_SEC(15))) != ZX_OK) {
+        return status;
+    }
+    *out_bytes = blocks * kMinfsBlockSize;
+    return ZX_OK;
+}
+
+bool Minfs::ReserveBlocks(blk_t count) {
+    if (info_.alloc_block_count + reserved_blocks_ + count > info_.block_count) {
+        return false;
+    }
+    reserved_blocks_ += count;
+    return true;
+}
+
+void Minfs::ReleaseBlocks(blk_t count) {
+    ZX_DEBUG_ASSERT(reserved_blocks_ >= count);
+    reserved_blocks_ -= count;
+}
+
+zx_status_t Minfs::AllocatePending() {
+    zx_status_t result = ZX_OK;
+    // Each vnode takes itself off the list, even when it fails.
+    while (!pending_vnodes_.is_empty()) {
+        zx_status_t status = pending_vnodes_.front().AllocatePending();
+        if (status != ZX_OK) {
+            result = status;
+        }
+    }
+    return result;
+}
 #endif
 
 Minfs::Minfs(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(fbl::move(bc)) {
@@ -298,6 +383,10 @@ Minfs::Minfs(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(fbl::mo
 
 Minfs::~Minfs() {
     vnode_hash_.clear();
+#ifdef __Fuchsia__
+    vnode_cache_hash_.clear();
+    vnode_cache_lru_.clear();
+#endif
 }
 
 zx_status_t Minfs::InoFree(VnodeMinfs* vn, WriteTxn* txn) {
@@ -316,6 +405,28 @@ zx_status_t Minfs::InoFree(VnodeMinfs* vn, WriteTxn* txn) {
     txn->Enqueue(ibm_id, bitbno, info_.ibm_block + bitbno, 1);
     uint32_t block_count = vn->inode_.block_count;
 
+    if (vn->IsExtentMapped()) {
+        zx_status_t status;
+        if ((status = vn->LoadExtents()) != ZX_OK) {
+            return status;
+        }
+        for (const minfs_extent_t& extent : vn->extents_) {
+            for (uint32_t n = 0; n < extent.count; n++) {
+                BlockFree(txn, extent.start + n);
+            }
+            block_count -= extent.count;
+        }
+        for (blk_t xbno : vn->extent_blocks_) {
+            block_count--;
+            BlockFree(txn, xbno);
+        }
+
+        CountUpdate(txn);
+        ZX_DEBUG_ASSERT(block_count == 0);
+        ZX_DEBUG_ASSERT(vn->IsUnlinked());
+        return ZX_OK;
+    }
+
     // release all direct blocks
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         if (vn->inode_.dnum[n] == 0) {
@@ -652,6 +763,10 @@ void Minfs::VnodeInsert(VnodeMinfs* vn) {
 #ifdef __Fuchsia__
     fbl::AutoLock lock(&hash_lock_);
 #endif
+    VnodeInsertLocked(vn);
+}
+
+void Minfs::VnodeInsertLocked(VnodeMinfs* vn) {
     ZX_DEBUG_ASSERT_MSG(!vnode_hash_.find(vn->GetKey()).IsValid(), "ino %u already in map\n",
                         vn->GetKey());
     vnode_hash_.insert(vn);
@@ -660,6 +775,12 @@ void Minfs::VnodeInsert(VnodeMinfs* vn) {
 fbl::RefPtr<VnodeMinfs> Minfs::VnodeLookup(uint32_t ino) {
 #ifdef __Fuchsia__
     fbl::AutoLock lock(&hash_lock_);
+#endif
+    return VnodeLookupLocked(ino);
+}
+
+fbl::RefPtr<VnodeMinfs> Minfs::VnodeLookupLocked(uint32_t ino) {
+#ifdef __Fuchsia__
     auto rawVn = vnode_hash_.find(ino);
     if (!rawVn.IsValid()) {
         // Nothing exists in the lookup table
@@ -688,13 +809,87 @@ void Minfs::VnodeReleaseLocked(VnodeMinfs* vn) {
     vnode_hash_.erase(*vn);
 }
 
+#ifdef __Fuchsia__
+namespace {
+
+// Bounds on the state kept for released vnodes, which is mostly the file
+// data they had read in.
+constexpr size_t kVnodeCacheMaxCount = 1024;
+constexpr size_t kVnodeCacheMaxBytes = 32 * (1LU << 20);
+
+bool IsSignaled(const zx::event& event) {
+    zx_signals_t pending;
+    return event.is_valid() &&
+           event.wait_one(ZX_EVENT_SIGNALED, zx::time(), &pending) == ZX_OK;
+}
+
+} // namespace
+
+void Minfs::VnodeCacheInsertLocked(VnodeMinfs* vn) {
+    if (IsSignaled(memory_critical_)) {
+        VnodeCacheTrimLocked(0, 0);
+        return;
+    }
+    if (vnode_hash_.find(vn->GetKey()).IsValid()) {
+        // A lookup found |vn| dying and has already started its inode over.
+        return;
+    }
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<CachedVnode> entry(new (&ac) CachedVnode(bc_.get()));
+    if (!ac.check() || !vn->SaveCachedState(entry.get())) {
+        return;
+    }
+    ZX_DEBUG_ASSERT(!vnode_cache_hash_.find(entry->ino).IsValid());
+    vnode_cache_bytes_ += entry->bytes;
+    vnode_cache_hash_.insert(entry.get());
+    vnode_cache_lru_.push_back(fbl::move(entry));
+    if (IsSignaled(memory_warning_)) {
+        VnodeCacheTrimLocked(vnode_cache_hash_.size() / 2, vnode_cache_bytes_ / 2);
+    } else {
+        VnodeCacheTrimLocked(kVnodeCacheMaxCount, kVnodeCacheMaxBytes);
+    }
+}
+
+void Minfs::VnodeCacheTakeLocked(VnodeMinfs* vn) {
+    CachedVnode* entry = vnode_cache_hash_.erase(vn->GetKey());
+    {
+        fbl::AutoLock lock(&cache_info_lock_);
+        if (entry != nullptr) {
+            cache_info_.vnode_hits++;
+        } else {
+            cache_info_.vnode_misses++;
+        }
+    }
+    if (entry == nullptr) {
+        return;
+    }
+    fbl::unique_ptr<CachedVnode> owned = vnode_cache_lru_.erase(*entry);
+    vnode_cache_bytes_ -= owned->bytes;
+    vn->RestoreCachedState(owned.get());
+}
+
+void Minfs::VnodeCacheTrimLocked(size_t max_count, size_t max_bytes) {
+    while (!vnode_cache_lru_.is_empty() &&
+           (vnode_cache_hash_.size() > max_count || vnode_cache_bytes_ > max_bytes)) {
+        vnode_cache_hash_.erase(vnode_cache_lru_.front());
+        fbl::unique_ptr<CachedVnode> entry = vnode_cache_lru_.pop_front();
+        vnode_cache_bytes_ -= entry->bytes;
+    }
+}
+#endif
+
 zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
     TRACE_DURATION("minfs", "Minfs::VnodeGet", "ino", ino);
     if ((ino < 1) || (ino >= info_.inode_count)) {
         return ZX_ERR_OUT_OF_RANGE;
     }
 
-    fbl::RefPtr<VnodeMinfs> vn = VnodeLookup(ino);
+#ifdef __Fuchsia__
+    // Lookups run concurrently, so finding the vnode and inserting a new one
+    // must be a single step for them to agree on which vnode an inode has.
+    fbl::AutoLock lock(&hash_lock_);
+#endif
+    fbl::RefPtr<VnodeMinfs> vn = VnodeLookupLocked(ino);
     if (vn != nullptr) {
         *out = fbl::move(vn);
         return ZX_OK;
@@ -715,8 +910,11 @@ zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
     if ((status = VnodeMinfs::Recreate(this, ino, inode, &vn)) != ZX_OK) {
         return ZX_ERR_NO_MEMORY;
     }
+#ifdef __Fuchsia__
+    VnodeCacheTakeLocked(vn.get());
+#endif
 
-    VnodeInsert(vn.get());
+    VnodeInsertLocked(vn.get());
 
     *out = fbl::move(vn);
     return ZX_OK;
@@ -735,6 +933,9 @@ zx_status_t Minfs::BlockFree(WriteTxn* txn, blk_t bno) {
     info_.alloc_block_count--;
     blk_t bitbno = bno / kMinfsBlockBits;
     txn->Enqueue(bbm_id, bitbno, info_.abm_block + bitbno, 1);
+#ifdef __Fuchsia__
+    txn->EnqueueTrim(info_.dat_block + bno, 1);
+#endif
     return CountUpdate(txn);
 }
 
@@ -780,6 +981,79 @@ zx_status_t Minfs::BlockNew(WriteTxn* txn, blk_t hint, blk_t* out_bno) {
     return ZX_OK;
 }
 
+zx_status_t Minfs::UpgradeVersion() {
+    if (info_.version == kMinfsVersion) {
+        return ZX_OK;
+    }
+
+    // Existing inodes stay block-mapped, but new ones are extent-mapped, and
+    // metadata is journaled; older drivers can handle neither.
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(bc_.get()));
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    info_.version = kMinfsVersion;
+    zx_status_t status;
+    if ((info_.journal_blocks == 0) && (status = JournalNew(wb->txn())) != ZX_OK) {
+        FS_TRACE_WARN("minfs: no room for a journal, metadata is not journaled: %d\n", status);
+    }
+    status = CountUpdate(wb->txn());
+    EnqueueWork(fbl::move(wb));
+#ifdef __Fuchsia__
+    if ((status == ZX_OK) && (info_.journal_blocks != 0)) {
+        // The journal must be on disk before anything is committed to it.
+        completion_t completion;
+        completion_reset(&completion);
+        if ((status = Sync(&completion)) != ZX_OK) {
+            return status;
+        } else if ((status = completion_wait(&completion, ZX_SEC(15))) != ZX_OK) {
+            return status;
+        } else if (bc_->Sync() != 0) {
+            return ZX_ERR_IO;
+        }
+        status = writeback_->EnableJournal(&info_);
+    }
+#endif
+    return status;
+}
+
+zx_status_t Minfs::JournalNew(WriteTxn* txn) {
+    const blk_t blocks = JournalBlocks(info_.block_count);
+    size_t start;
+    zx_status_t status;
+    if (blocks == 0) {
+        return ZX_ERR_NO_SPACE;
+    } else if ((status = block_map_.Find(false, 0, block_map_.size(), blocks, &start)) != ZX_OK) {
+        return status;
+    }
+
+    // The journal starts out empty.
+    uint8_t blk[kMinfsBlockSize];
+    memset(blk, 0, sizeof(blk));
+    if ((status = bc_->Writeblk(info_.dat_block + static_cast<blk_t>(start), blk)) != ZX_OK) {
+        return status;
+    }
+
+    block_map_.Set(start, start + blocks);
+    info_.alloc_block_count += blocks;
+    info_.journal_start = static_cast<blk_t>(start);
+    info_.journal_blocks = blocks;
+
+    blk_t first = info_.journal_start / kMinfsBlockBits;
+    blk_t last = (info_.journal_start + blocks - 1) / kMinfsBlockBits;
+#ifdef __Fuchsia__
+    txn->Enqueue(block_map_.StorageUnsafe()->GetVmo(), first, info_.abm_block + first,
+                 last - first + 1);
+#else
+    for (blk_t n = first; n <= last; n++) {
+        void* bmdata = fs::GetBlock<kMinfsBlockSize>(block_map_.StorageUnsafe()->GetData(), n);
+        bc_->Writeblk(info_.abm_block + n, bmdata);
+    }
+#endif
+    return ZX_OK;
+}
+
 zx_status_t Minfs::CountUpdate(WriteTxn* txn) {
     zx_status_t status = ZX_OK;
 
@@ -921,6 +1195,11 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info,
                                           &fs->writeback_)) != ZX_OK) {
         return status;
     }
+    if ((fs->info_.journal_blocks != 0) &&
+        (status = fs->writeback_->EnableJournal(&fs->info_)) != ZX_OK) {
+        FS_TRACE_ERROR("Minfs::Create failed to enable journal: %d\n", status);
+        return status;
+    }
 
     status = fs->CreateFsId();
     if (status != ZX_OK) {
@@ -928,6 +1207,12 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info,
         return status;
     }
 
+    // Without these the vnode cache still works, it just never shrinks early.
+    zx_system_get_event(zx_job_default(), ZX_SYSTEM_EVENT_MEMORY_PRESSURE_WARNING,
+                        fs->memory_warning_.reset_and_get_address());
+    zx_system_get_event(zx_job_default(), ZX_SYSTEM_EVENT_MEMORY_PRESSURE_CRITICAL,
+                        fs->memory_critical_.reset_and_get_address());
+
 #else  // !__Fuchsia__
     for (uint32_t n = 0; n < fs->abmblks_; n++) {
         void* bmdata = fs::GetBlock<kMinfsBlockSize>(fs->block_map_.StorageUnsafe()->GetData(), n);
@@ -943,6 +1228,10 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info,
     }
 #endif
 
+    // The bitmaps were read straight into their storage.
+    fs->block_map_.RebuildSummary();
+    fs->inode_map_.RebuildSummary();
+
     *out = fs;
     return ZX_OK;
 }
@@ -956,7 +1245,11 @@ zx_status_t minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinf
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return status;
     }
-    const minfs_info_t* info = reinterpret_cast<minfs_info_t*>(blk);
+    minfs_info_t* info = reinterpret_cast<minfs_info_t*>(blk);
+    if ((status = ReplayJournal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not replay journal\n");
+        return status;
+    }
 
     fbl::RefPtr<Minfs> fs;
     if ((status = Minfs::Create(fbl::move(bc), info, &fs)) != ZX_OK) {
@@ -964,6 +1257,11 @@ zx_status_t minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinf
         return status;
     }
 
+    if ((status = fs->UpgradeVersion()) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: cannot upgrade from version %08x\n", fs->info_.version);
+        return status;
+    }
+
     fbl::RefPtr<VnodeMinfs> vn;
     if ((status = fs->VnodeGet(&vn, kMinfsRootIno)) != ZX_OK) {
         FS_TRACE_ERROR("minfs: cannot find root inode\n");
@@ -1159,6 +1457,17 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
     abm.Set(0, 2);
     info.alloc_block_count++;
 
+    // Reserve the journal right after it, and start it out empty.
+    const blk_t journal_blocks = JournalBlocks(info.block_count);
+    if (journal_blocks != 0) {
+        info.journal_start = 2;
+        info.journal_blocks = journal_blocks;
+        abm.Set(info.journal_start, info.journal_start + journal_blocks);
+        info.alloc_block_count += journal_blocks;
+        memset(blk, 0, sizeof(blk));
+        bc->Writeblk(info.dat_block + info.journal_start, blk);
+    }
+
     // write allocation bitmap
     for (uint32_t n = 0; n < abmblks; n++) {
         void* bmdata = fs::GetBlock<kMinfsBlockSize>(abm.StorageUnsafe()->GetData(), n);
@@ -1186,7 +1495,10 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
     ino[kMinfsRootIno].block_count = 1;
     ino[kMinfsRootIno].link_count = 2;
     ino[kMinfsRootIno].dirent_count = 2;
-    ino[kMinfsRootIno].dnum[0] = 1;
+    ino[kMinfsRootIno].flags = kMinfsInodeFlagExtents;
+    ino[kMinfsRootIno].extents[0].start = 1;
+    ino[kMinfsRootIno].extents[0].count = 1;
+    ino[kMinfsRootIno].extent_count = 1;
     bc->Writeblk(info.ino_block, blk);
 
     memset(blk, 0, sizeof(blk));
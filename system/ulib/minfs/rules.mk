@@ -10,6 +10,8 @@ MODULE_TYPE := userlib
 
 COMMON_SRCS := \
     $(LOCAL_DIR)/bcache.cpp \
+    $(LOCAL_DIR)/directory-index.cpp \
+    $(LOCAL_DIR)/journal.cpp \
     $(LOCAL_DIR)/minfs.cpp \
     $(LOCAL_DIR)/vnode.cpp \
     $(LOCAL_DIR)/writeback.cpp \
@@ -29,6 +31,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/zxcpp \
     system/ulib/fbl \
     system/ulib/sync \
+    third_party/ulib/cksum \
 
 MODULE_LIBS := \
     system/ulib/async.default \
@@ -46,6 +49,7 @@ MODULE_HOST_SRCS := \
     system/ulib/bitmap/raw-bitmap.cpp \
     system/ulib/fs/vfs.cpp \
     system/ulib/fs/vnode.cpp \
+    third_party/ulib/cksum/crc32.c \
 
 MODULE_HOST_COMPILEFLAGS := \
     -Werror-implicit-function-declaration \
@@ -55,6 +59,7 @@ MODULE_HOST_COMPILEFLAGS := \
     -Isystem/ulib/fdio/include \
     -Isystem/ulib/fbl/include \
     -Isystem/ulib/fs/include \
+    -Ithird_party/ulib/cksum/include \
 
 # host minfs lib
 
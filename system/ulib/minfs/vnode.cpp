@@ -212,7 +212,12 @@ zx_status_t VnodeMinfs::BlocksShrinkDoublyIndirect(WriteTxn *txn, uint32_t ibind
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 zx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, blk_t start) {
+    if (IsExtentMapped()) {
+        return BlocksShrinkExtent(txn, start);
+    }
+
     bool dirty = false;
+    const bool all = (start == 0);
     zx_status_t status = ZX_OK;
     size_t size = (kMinfsIndirect + kMinfsDoublyIndirect) * kMinfsBlockSize;
     size_t count = start <= kMinfsDirect ? kMinfsDirect - start : 0;
@@ -271,6 +276,13 @@ zx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, blk_t start) {
     }
 #endif
 
+    if (all && inode_.block_count == 0) {
+        // Nothing is mapped any more, so the inode can switch to extents.
+        memset(inode_.dnum, 0, sizeof(inode_.dnum) + sizeof(inode_.inum) + sizeof(inode_.dinum));
+        inode_.flags |= kMinfsInodeFlagExtents;
+        dirty = true;
+    }
+
     if (dirty) {
         InodeSync(txn, kMxFsSyncDefault);
     }
@@ -278,6 +290,171 @@ zx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, blk_t start) {
     return ZX_OK;
 }
 
+zx_status_t VnodeMinfs::BlocksShrinkExtent(WriteTxn* txn, blk_t start) {
+    zx_status_t status;
+    if ((status = LoadExtents()) != ZX_OK) {
+        return status;
+    }
+
+    // Extents are sorted, so only the ones at the end are affected.
+    bool dirty = false;
+    size_t first = extents_.size();
+    while (first > 0) {
+        minfs_extent_t* extent = &extents_[first - 1];
+        if (extent->file_block + extent->count <= start) {
+            break;
+        }
+        uint32_t keep = start > extent->file_block ? start - extent->file_block : 0;
+        for (uint32_t i = keep; i < extent->count; i++) {
+            fs_->BlockFree(txn, extent->start + i);
+        }
+        inode_.block_count -= extent->count - keep;
+        extent->count = keep;
+        dirty = true;
+        first--;
+        if (keep > 0) {
+            break;
+        }
+        extents_.pop_back();
+    }
+
+    if (!dirty) {
+        return ZX_OK;
+    }
+    return SyncExtents(txn, first);
+}
+
+zx_status_t VnodeMinfs::LoadExtents() {
+    if (extents_.size() == inode_.extent_count) {
+        return ZX_OK;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::Vector<minfs_extent_t> extents;
+    fbl::Vector<blk_t> extent_blocks;
+    extents.reserve(inode_.extent_count, &ac);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+
+    uint32_t inline_count = fbl::min(inode_.extent_count, kMinfsInlineExtents);
+    for (uint32_t i = 0; i < inline_count; i++) {
+        extents.push_back(inode_.extents[i]);
+    }
+
+    blk_t xbno = inode_.xnum;
+    while (extents.size() < inode_.extent_count) {
+        if (xbno == 0 || xbno >= fs_->info_.block_count) {
+            FS_TRACE_ERROR("minfs: ino %u: bad extent block %u\n", ino_, xbno);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        extent_blocks.push_back(xbno, &ac);
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+
+        minfs_extent_block_t xblock;
+        zx_status_t status;
+        if ((status = fs_->ReadDat(xbno, &xblock)) != ZX_OK) {
+            return status;
+        }
+        uint32_t remaining = inode_.extent_count - static_cast<uint32_t>(extents.size());
+        if (xblock.count != fbl::min(remaining, kMinfsExtentsPerBlock)) {
+            FS_TRACE_ERROR("minfs: ino %u: extent block %u holds %u extents\n", ino_, xbno,
+                           xblock.count);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+        for (uint32_t i = 0; i < xblock.count; i++) {
+            extents.push_back(xblock.extents[i]);
+        }
+        xbno = xblock.next;
+    }
+
+    extents_.swap(extents);
+    extent_blocks_.swap(extent_blocks);
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::SyncExtents(WriteTxn* txn, size_t first) {
+    const size_t count = extents_.size();
+    const size_t needed = count > kMinfsInlineExtents ?
+        (count - kMinfsInlineExtents + kMinfsExtentsPerBlock - 1) / kMinfsExtentsPerBlock : 0;
+    const size_t old_blocks = extent_blocks_.size();
+
+    zx_status_t status;
+    fbl::AllocChecker ac;
+    while (extent_blocks_.size() < needed) {
+        blk_t bno;
+        if ((status = fs_->BlockNew(txn, 0, &bno)) != ZX_OK) {
+            return status;
+        }
+        extent_blocks_.push_back(bno, &ac);
+        if (!ac.check()) {
+            fs_->BlockFree(txn, bno);
+            return ZX_ERR_NO_MEMORY;
+        }
+        inode_.block_count++;
+    }
+    while (extent_blocks_.size() > needed) {
+        fs_->BlockFree(txn, extent_blocks_[extent_blocks_.size() - 1]);
+        extent_blocks_.pop_back();
+        inode_.block_count--;
+    }
+
+    // Rewrite every extent block from the one holding |first|, and the one
+    // that now ends the chain if its length changed.
+    size_t first_block = first < kMinfsInlineExtents ? 0 :
+                         (first - kMinfsInlineExtents) / kMinfsExtentsPerBlock;
+    const size_t kept_blocks = fbl::min(old_blocks, needed);
+    if (old_blocks != needed && kept_blocks > 0) {
+        first_block = fbl::min(first_block, kept_blocks - 1);
+    }
+
+#ifdef __Fuchsia__
+    if (first_block < needed) {
+        if ((status = InitIndirectVmo()) != ZX_OK) {
+            return status;
+        }
+        if (vmo_indirect_->GetSize() < needed * kMinfsBlockSize) {
+            if ((status = vmo_indirect_->Grow(needed * kMinfsBlockSize)) != ZX_OK) {
+                return status;
+            }
+        }
+    }
+#endif
+
+    for (size_t i = first_block; i < needed; i++) {
+#ifdef __Fuchsia__
+        uintptr_t addr = reinterpret_cast<uintptr_t>(vmo_indirect_->GetData());
+        auto xblock = reinterpret_cast<minfs_extent_block_t*>(addr + kMinfsBlockSize * i);
+#else
+        minfs_extent_block_t data;
+        minfs_extent_block_t* xblock = &data;
+#endif
+        const size_t base = kMinfsInlineExtents + i * kMinfsExtentsPerBlock;
+        memset(xblock, 0, sizeof(*xblock));
+        xblock->next = (i + 1 < needed) ? extent_blocks_[i + 1] : 0;
+        xblock->count = static_cast<uint32_t>(fbl::min<size_t>(count - base,
+                                                               kMinfsExtentsPerBlock));
+        memcpy(xblock->extents, &extents_[base], xblock->count * sizeof(minfs_extent_t));
+#ifdef __Fuchsia__
+        txn->Enqueue(vmo_indirect_->GetVmo(), i, extent_blocks_[i] + fs_->info_.dat_block, 1);
+#else
+        fs_->bc_->Writeblk(extent_blocks_[i] + fs_->info_.dat_block, xblock);
+#endif
+    }
+
+    const size_t inline_count = fbl::min<size_t>(count, kMinfsInlineExtents);
+    memset(inode_.extents, 0, sizeof(inode_.extents));
+    if (inline_count > 0) {
+        memcpy(inode_.extents, &extents_[0], inline_count * sizeof(minfs_extent_t));
+    }
+    inode_.extent_count = static_cast<uint32_t>(count);
+    inode_.xnum = needed > 0 ? extent_blocks_[0] : 0;
+    InodeSync(txn, kMxFsSyncDefault);
+    return ZX_OK;
+}
+
 #ifdef __Fuchsia__
 zx_status_t VnodeMinfs::LoadIndirectBlocks(blk_t* iarray, uint32_t count, uint32_t offset,
                                            uint64_t size) {
@@ -326,8 +503,9 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
     }
 
     zx_status_t status;
-    if ((status = MappedVmo::Create(kMinfsBlockSize * (kMinfsIndirect + kMinfsDoublyIndirect),
-                                    "minfs-indirect", &vmo_indirect_)) != ZX_OK) {
+    size_t size = IsExtentMapped() ? kMinfsBlockSize :
+                  kMinfsBlockSize * (kMinfsIndirect + kMinfsDoublyIndirect);
+    if ((status = MappedVmo::Create(size, "minfs-indirect", &vmo_indirect_)) != ZX_OK) {
         return status;
     }
     if ((status = fs_->bc_->AttachVmo(vmo_indirect_->GetVmo(), &vmoid_indirect_)) != ZX_OK) {
@@ -335,6 +513,11 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
         return status;
     }
 
+    if (IsExtentMapped()) {
+        // Only used to write out extent blocks; LoadExtents reads them itself.
+        return ZX_OK;
+    }
+
     // Load initial set of indirect blocks
     if ((status = LoadIndirectBlocks(inode_.inum, kMinfsIndirect, 0, 0)) != ZX_OK) {
         vmo_indirect_ = nullptr;
@@ -353,12 +536,9 @@ zx_status_t VnodeMinfs::InitIndirectVmo() {
 }
 
 // Since we cannot yet register the filesystem as a paging service (and cleanly
-// fault on pages when they are actually needed), we currently read an entire
-// file to a VMO when a file's data block are accessed.
-//
-// TODO(smklein): Even this hack can be optimized; a bitmap could be used to
-// track all 'empty/read/dirty' blocks for each vnode, rather than reading
-// the entire file.
+// fault on pages when they are actually needed), file data is read into a VMO
+// as it is accessed. vmo_populated_ tracks which blocks of the VMO are valid;
+// PopulateVmo reads in the rest.
 zx_status_t VnodeMinfs::InitVmo() {
     if (vmo_.is_valid()) {
         return ZX_OK;
@@ -373,91 +553,196 @@ zx_status_t VnodeMinfs::InitVmo() {
 
     zx_object_set_property(vmo_.get(), ZX_PROP_NAME, "minfs-inode", 11);
 
+    if ((status = vmo_populated_.Reset(vmo_size / kMinfsBlockSize)) != ZX_OK) {
+        vmo_.reset();
+        return status;
+    }
     if ((status = fs_->bc_->AttachVmo(vmo_.get(), &vmoid_)) != ZX_OK) {
         vmo_.reset();
         return status;
     }
-    ReadTxn txn(fs_->bc_.get());
+    readahead_next_ = 0;
+    readahead_window_ = 0;
+    ValidateVmoTail();
+    return ZX_OK;
+}
 
-    // Initialize all direct blocks
-    blk_t bno;
-    for (uint32_t d = 0; d < kMinfsDirect; d++) {
-        if ((bno = inode_.dnum[d]) != 0) {
-            fs_->ValidateBno(bno);
-            txn.Enqueue(vmoid_, d, bno + fs_->info_.dat_block, 1);
+zx_status_t VnodeMinfs::PopulateVmo(blk_t start, blk_t end, bool readahead) {
+    const blk_t vmo_blocks = static_cast<blk_t>(vmo_populated_.size());
+    blk_t read_end = end;
+    if (readahead) {
+        if (start == readahead_next_) {
+            readahead_window_ = (readahead_window_ == 0) ? kMinfsReadaheadMin :
+                                fbl::min(readahead_window_ * 2, kMinfsReadaheadMax);
+        } else {
+            readahead_window_ = 0;
         }
+        readahead_next_ = end;
+        read_end = end + readahead_window_;
     }
+    read_end = fbl::min(read_end, vmo_blocks);
 
-    // Initialize all indirect blocks
-    for (uint32_t i = 0; i < kMinfsIndirect; i++) {
-        blk_t ibno;
-        if ((ibno = inode_.inum[i]) != 0) {
-            fs_->ValidateBno(ibno);
-
-            // Only initialize the indirect vmo if it is being used.
-            if ((status = InitIndirectVmo()) != ZX_OK) {
-                vmo_.reset();
+    // Runs of missing blocks go out as one request per run of contiguous disk
+    // blocks, since the ReadTxn merges adjacent requests.
+    ReadTxn txn(fs_->bc_.get());
+    uint64_t misses = 0;
+    uint64_t ahead = 0;
+    blk_t n = start;
+    while (n < read_end) {
+        blk_t missing = static_cast<blk_t>(vmo_populated_.Scan(n, read_end, true));
+        blk_t present = static_cast<blk_t>(vmo_populated_.Scan(missing, read_end, false));
+        for (n = missing; n < present; n++) {
+            zx_status_t status;
+            blk_t bno;
+            if ((status = GetBno(nullptr, n, &bno)) != ZX_OK) {
                 return status;
             }
+            if (bno != 0) {
+                fs_->ValidateBno(bno);
+                txn.Enqueue(vmoid_, n, bno + fs_->info_.dat_block, 1);
+            }
+            if (n < end) {
+                misses++;
+            } else {
+                ahead++;
+            }
+        }
+    }
 
-            uint32_t* ientry;
-            ReadIndirectVmoBlock(i, &ientry);
+    zx_status_t status;
+    if ((status = txn.Flush()) != ZX_OK) {
+        return status;
+    }
+    MarkVmoPopulated(start, read_end);
+    if (readahead) {
+        fbl::AutoLock lock(&fs_->cache_info_lock_);
+        fs_->cache_info_.hits += (end - start) - misses;
+        fs_->cache_info_.misses += misses;
+        fs_->cache_info_.readahead += ahead;
+    }
+    return ZX_OK;
+}
 
-            for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-                if ((bno = ientry[j]) != 0) {
-                    fs_->ValidateBno(bno);
-                    uint32_t n = kMinfsDirect + i * kMinfsDirectPerIndirect + j;
-                    txn.Enqueue(vmoid_, n, bno + fs_->info_.dat_block, 1);
-                }
+void VnodeMinfs::EnqueueVmoBlock(WriteTxn* txn, blk_t n, blk_t bno) {
+    if (IsDirectory()) {
+        txn->Enqueue(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+    } else {
+        txn->EnqueueData(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+    }
+}
+
+void VnodeMinfs::MarkVmoPopulated(blk_t start, blk_t end) {
+    end = fbl::min(end, static_cast<blk_t>(vmo_populated_.size()));
+    if (start < end) {
+        vmo_populated_.Set(start, end);
+    }
+}
+
+zx_status_t VnodeMinfs::DelayAllocation(blk_t n, bool* delayed) {
+    *delayed = false;
+    if (IsDirectory() || !IsExtentMapped()) {
+        return ZX_OK;
+    }
+
+    // Most writes append, so check the end of |pending_| before searching it.
+    size_t i = pending_.size();
+    if (i != 0 && pending_[i - 1] >= n) {
+        size_t lo = 0;
+        while (lo < i) {
+            size_t mid = lo + (i - lo) / 2;
+            if (pending_[mid] < n) {
+                lo = mid + 1;
+            } else {
+                i = mid;
             }
         }
+        if (pending_[i] == n) {
+            *delayed = true;
+            return ZX_OK;
+        }
+    }
+    if (pending_.size() >= kMinfsMaxPendingBlocks) {
+        return ZX_OK;
     }
 
-    // Initialize all doubly indirect blocks
-    for (uint32_t i = 0; i < kMinfsDoublyIndirect; i++) {
-        blk_t dibno;
+    zx_status_t status;
+    blk_t bno;
+    if ((status = GetBno(nullptr, n, &bno)) != ZX_OK) {
+        return status;
+    } else if (bno != 0) {
+        return ZX_OK;
+    }
 
-        if ((dibno = inode_.dinum[i]) != 0) {
-            fs_->ValidateBno(dibno);
+    // If the space can't be reserved, allocate the block now instead.
+    const bool first = pending_.is_empty();
+    const blk_t reserve = first ? 1 + kMinfsPendingMetadataBlocks : 1;
+    if (!fs_->ReserveBlocks(reserve)) {
+        return ZX_OK;
+    }
+    fbl::AllocChecker ac;
+    pending_.insert(i, n, &ac);
+    if (!ac.check()) {
+        fs_->ReleaseBlocks(reserve);
+        return ZX_OK;
+    }
+    if (first) {
+        fs_->pending_vnodes_.push_back(this);
+    }
+    *delayed = true;
+    return ZX_OK;
+}
 
-            // Only initialize the doubly indirect vmo if it is being used.
-            if ((status = InitIndirectVmo()) != ZX_OK) {
-                vmo_.reset();
-                return status;
-            }
+void VnodeMinfs::DropPending() {
+    if (!pending_node_.InContainer()) {
+        return;
+    }
+    fs_->ReleaseBlocks(static_cast<blk_t>(pending_.size()) + kMinfsPendingMetadataBlocks);
+    pending_.reset();
+    fs_->pending_vnodes_.erase(*this);
+}
 
-            uint32_t* dientry;
-            ReadIndirectVmoBlock(GetVmoOffsetForDoublyIndirect(i), &dientry);
-
-            for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
-                blk_t ibno;
-                if ((ibno = dientry[j]) != 0) {
-                    fs_->ValidateBno(ibno);
-
-                    // Only initialize the indirect vmo if it is being used.
-                    if ((status = LoadIndirectWithinDoublyIndirect(i)) != ZX_OK) {
-                        vmo_.reset();
-                        return status;
-                    }
-
-                    uint32_t* ientry;
-                    ReadIndirectVmoBlock(GetVmoOffsetForIndirect(i) + j, &ientry);
-
-                    for (uint32_t k = 0; k < kMinfsDirectPerIndirect; k++) {
-                        if ((bno = ientry[k]) != 0) {
-                            fs_->ValidateBno(bno);
-                            uint32_t n = kMinfsDirect + kMinfsIndirect * kMinfsDirectPerIndirect
-                                         + j * kMinfsDirectPerIndirect + k;
-                            txn.Enqueue(vmoid_, n, bno + fs_->info_.dat_block, 1);
-                        }
-                    }
-                }
+zx_status_t VnodeMinfs::AllocatePending() {
+    if (pending_.is_empty()) {
+        return ZX_OK;
+    }
+    TRACE_DURATION("minfs", "VnodeMinfs::AllocatePending", "ino", ino_,
+                   "count", pending_.size());
+
+    // Blocks are allocated in file order, each after the last where possible,
+    // so runs of them go out as single requests.
+    zx_status_t status = ZX_OK;
+    size_t done = 0;
+    while (status == ZX_OK && done < pending_.size()) {
+        fbl::AllocChecker ac;
+        fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(fs_->bc_.get()));
+        if (!ac.check()) {
+            status = ZX_ERR_NO_MEMORY;
+            break;
+        }
+        // Each allocation may also dirty bitmap, superblock and extent blocks,
+        // so leave the transaction plenty of room for them.
+        while (done < pending_.size() && wb->txn()->Count() < MAX_TXN_MESSAGES / 2) {
+            blk_t n = pending_[done];
+            blk_t bno;
+            if ((status = GetBno(wb->txn(), n, &bno)) != ZX_OK) {
+                break;
             }
+            ZX_DEBUG_ASSERT(bno != 0);
+            EnqueueVmoBlock(wb->txn(), n, bno);
+            done++;
+        }
+        if (wb->txn()->Count() != 0) {
+            InodeSync(wb->txn(), kMxFsSyncDefault);
+            wb->PinVnode(fbl::WrapRefPtr(this));
+            fs_->EnqueueWork(fbl::move(wb));
         }
     }
 
-    status = txn.Flush();
-    ValidateVmoTail();
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("minfs: Failed to allocate %zu pending blocks of ino %u: %d\n",
+                       pending_.size() - done, ino_, status);
+    }
+    DropPending();
     return status;
 }
 #endif
@@ -629,6 +914,10 @@ void VnodeMinfs::ClearIndirectBlock(blk_t bno) {
 
 // Get the bno corresponding to the nth logical block within the file.
 zx_status_t VnodeMinfs::GetBno(WriteTxn* txn, blk_t n, blk_t* bno) {
+    if (IsExtentMapped()) {
+        return GetBnoExtent(txn, n, bno);
+    }
+
     bool dirty = false;
 
     if (n < kMinfsDirect) {
@@ -685,6 +974,75 @@ zx_status_t VnodeMinfs::GetBno(WriteTxn* txn, blk_t n, blk_t* bno) {
     return ZX_ERR_OUT_OF_RANGE;
 }
 
+zx_status_t VnodeMinfs::GetBnoExtent(WriteTxn* txn, blk_t n, blk_t* bno) {
+    zx_status_t status;
+    if ((status = LoadExtents()) != ZX_OK) {
+        return status;
+    }
+
+    // Find the first extent past |n|; only the one before it can hold |n|.
+    size_t lo = 0;
+    size_t hi = extents_.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (extents_[mid].file_block <= n) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    minfs_extent_t* prev = lo > 0 ? &extents_[lo - 1] : nullptr;
+    if (prev != nullptr && n - prev->file_block < prev->count) {
+        *bno = prev->start + (n - prev->file_block);
+        fs_->ValidateBno(*bno);
+        return ZX_OK;
+    }
+
+    if (txn == nullptr) {
+        *bno = 0;
+        return ZX_OK;
+    }
+
+    // Place the block where it would be if the file were contiguous up to here.
+    blk_t hint = prev != nullptr ? prev->start + (n - prev->file_block) : 0;
+    if (hint >= fs_->info_.block_count) {
+        hint = 0;
+    }
+    if ((status = fs_->BlockNew(txn, hint, bno)) != ZX_OK) {
+        return status;
+    }
+    inode_.block_count++;
+
+    minfs_extent_t* next = lo < extents_.size() ? &extents_[lo] : nullptr;
+    bool joins_prev = prev != nullptr && prev->file_block + prev->count == n &&
+                      prev->start + prev->count == *bno;
+    bool joins_next = next != nullptr && next->file_block == n + 1 && next->start == *bno + 1;
+    size_t first;
+    if (joins_prev) {
+        prev->count++;
+        if (joins_next) {
+            prev->count += next->count;
+            extents_.erase(lo);
+        }
+        first = lo - 1;
+    } else if (joins_next) {
+        next->start--;
+        next->file_block--;
+        next->count++;
+        first = lo;
+    } else {
+        fbl::AllocChecker ac;
+        extents_.insert(lo, minfs_extent_t{*bno, 1, n}, &ac);
+        if (!ac.check()) {
+            fs_->BlockFree(txn, *bno);
+            inode_.block_count--;
+            return ZX_ERR_NO_MEMORY;
+        }
+        first = lo;
+    }
+    return SyncExtents(txn, first);
+}
+
 // Immediately stop iterating over the directory.
 #define DIR_CB_DONE 0
 // Access the next direntry in the directory. Offsets updated.
@@ -707,10 +1065,13 @@ zx_status_t VnodeMinfs::WriteExactInternal(WriteTxn* txn, const void* data,
                                            size_t len, size_t off) {
     size_t actual;
     zx_status_t status = WriteInternal(txn, data, len, off, &actual);
+    if (status == ZX_OK && actual != len) {
+        status = ZX_ERR_IO;
+    }
     if (status != ZX_OK) {
+        // Whatever part of the records made it out, the index can't say.
+        dir_index_.reset();
         return status;
-    } else if (actual != len) {
-        return ZX_ERR_IO;
     }
     InodeSync(txn, kMxFsSyncMtime);
     return ZX_OK;
@@ -782,6 +1143,8 @@ zx_status_t VnodeMinfs::UnlinkChild(WritebackWork* wb,
     // Read the direntries we're considering merging with.
     // Verify they are free and small enough to merge.
     size_t coalesced_size = MinfsReclen(de, off);
+    bool merged_next = false;
+    bool merged_prev = false;
     // Coalesce with "next" first, so the kMinfsReclenLast bit can easily flow
     // back to "de" and "de_prev".
     if (!(de->reclen & kMinfsReclenLast)) {
@@ -794,6 +1157,7 @@ zx_status_t VnodeMinfs::UnlinkChild(WritebackWork* wb,
             return status;
         }
         if (de_next.ino == 0) {
+            merged_next = true;
             coalesced_size += MinfsReclen(&de_next, off_next);
             // If the next entry *was* last, then 'de' is now last.
             de->reclen |= (de_next.reclen & kMinfsReclenLast);
@@ -809,6 +1173,7 @@ zx_status_t VnodeMinfs::UnlinkChild(WritebackWork* wb,
             return status;
         }
         if (de_prev.ino == 0) {
+            merged_prev = true;
             coalesced_size += MinfsReclen(&de_prev, off_prev);
             off = off_prev;
         }
@@ -825,6 +1190,14 @@ zx_status_t VnodeMinfs::UnlinkChild(WritebackWork* wb,
     if ((status = WriteExactInternal(wb->txn(), de, MINFS_DIRENT_SIZE, off)) != ZX_OK) {
         return status;
     }
+    DirectoryIndexRemove(offs->off);
+    if (merged_next) {
+        DirectoryIndexRemove(off_next);
+    }
+    if (merged_prev) {
+        DirectoryIndexRemove(off_prev);
+    }
+    DirectoryIndexAdd(off, MinfsReclen(de, off), de);
 
     if (de->reclen & kMinfsReclenLast) {
         // Truncating the directory merely removed unused space; if it fails,
@@ -980,6 +1353,7 @@ zx_status_t VnodeMinfs::DirentCallbackAppend(fbl::RefPtr<VnodeMinfs> vndir, minf
         if (status != ZX_OK) {
             return status;
         }
+        vndir->DirectoryIndexAdd(off, MinfsReclen(de, off), de);
         vndir->inode_.dirent_count++;
         if (args->type == kMinfsTypeDir) {
             // Child directory has '..' which will point to parent directory
@@ -995,6 +1369,7 @@ zx_status_t VnodeMinfs::DirentCallbackAppend(fbl::RefPtr<VnodeMinfs> vndir, minf
         if (args->reclen > reclen) {
             return do_next_dirent(de, offs);
         }
+        vndir->DirectoryIndexRemove(offs->off);
         return add_dirent(fbl::move(vndir), de, args, offs->off);
     } else {
         // filled entry, can we sub-divide?
@@ -1016,6 +1391,8 @@ zx_status_t VnodeMinfs::DirentCallbackAppend(fbl::RefPtr<VnodeMinfs> vndir, minf
         if (status != ZX_OK) {
             return status;
         }
+        vndir->DirectoryIndexRemove(offs->off);
+        vndir->DirectoryIndexAdd(offs->off, size, de);
         offs->off += size;
         // create new entry in the remaining space
         char data[kMinfsMaxDirentSize];
@@ -1037,6 +1414,9 @@ zx_status_t VnodeMinfs::DirentCallbackAppend(fbl::RefPtr<VnodeMinfs> vndir, minf
 //  'offs': Offset info about where in the directory this direntry is located.
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
+//
+// With the directory index loaded, 'func' is only called on the records the
+// index picks, and 'offs' is set from the index before each call.
 zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func) {
     char data[kMinfsMaxDirentSize];
     minfs_dirent_t* de = (minfs_dirent_t*) data;
@@ -1044,7 +1424,23 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
         .off = 0,
         .off_prev = 0,
     };
+    // If the index can't be built, visit every record as before.
+    const bool indexed = LoadDirectoryIndex() == ZX_OK;
+    const bool by_space = func == DirentCallbackAppend;
+    const uint32_t hash = by_space ? 0 : DirectoryIndex::HashName(args->name);
+    uint32_t search = 0;
     while (offs.off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+        if (indexed) {
+            uint32_t off = search;
+            if (!(by_space ? dir_index_->FindSpace(args->reclen, &off) :
+                             dir_index_->FindName(hash, &off))) {
+                return ZX_ERR_NOT_FOUND;
+            }
+            offs.off = off;
+            offs.off_prev = dir_index_->Prev(off);
+            // Names may collide; the next candidate comes after this one.
+            search = off + 1;
+        }
         xprintf("Reading dirent at offset %zd\n", offs.off);
         size_t r;
         zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, offs.off, &r);
@@ -1056,6 +1452,11 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
 
         switch ((status = func(fbl::RefPtr<VnodeMinfs>(this), de, args, &offs))) {
         case DIR_CB_NEXT:
+            if (indexed && by_space) {
+                // The index promised room which the record does not have.
+                dir_index_.reset();
+                return ZX_ERR_BAD_STATE;
+            }
             break;
         case DIR_CB_SAVE_SYNC:
             inode_.seq_num++;
@@ -1070,6 +1471,57 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t VnodeMinfs::LoadDirectoryIndex() {
+    if (dir_index_ != nullptr) {
+        return ZX_OK;
+    }
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<DirectoryIndex> index(new (&ac) DirectoryIndex());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    size_t off = 0;
+    while (off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+        size_t r;
+        zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, off, &r);
+        if (status != ZX_OK) {
+            return status;
+        } else if ((status = validate_dirent(de, r, off)) != ZX_OK) {
+            return status;
+        }
+        uint32_t reclen = MinfsReclen(de, off);
+        uint32_t used = de->ino ? static_cast<uint32_t>(DirentSize(de->namelen)) : 0;
+        status = index->Add(static_cast<uint32_t>(off), reclen, used,
+                            fbl::StringPiece(de->name, de->namelen));
+        if (status != ZX_OK) {
+            return status;
+        }
+        off += reclen;
+    }
+    dir_index_ = fbl::move(index);
+    return ZX_OK;
+}
+
+void VnodeMinfs::DirectoryIndexAdd(size_t off, uint32_t reclen, const minfs_dirent_t* de) {
+    if (dir_index_ == nullptr) {
+        return;
+    }
+    uint32_t used = de->ino ? static_cast<uint32_t>(DirentSize(de->namelen)) : 0;
+    if (dir_index_->Add(static_cast<uint32_t>(off), reclen, used,
+                        fbl::StringPiece(de->name, de->namelen)) != ZX_OK) {
+        dir_index_.reset();
+    }
+}
+
+void VnodeMinfs::DirectoryIndexRemove(size_t off) {
+    if (dir_index_ != nullptr) {
+        dir_index_->Remove(static_cast<uint32_t>(off));
+    }
+}
+
 void VnodeMinfs::fbl_recycle() {
     if (fd_count_ != 0 || !IsUnlinked()) {
         // If this node has not been purged already, remove it from the
@@ -1080,10 +1532,80 @@ void VnodeMinfs::fbl_recycle() {
         fbl::AutoLock lock(&fs_->hash_lock_);
 #endif
         fs_->VnodeReleaseLocked(this);
+#ifdef __Fuchsia__
+        fs_->VnodeCacheInsertLocked(this);
+#endif
     }
     delete this;
 }
 
+#ifdef __Fuchsia__
+bool VnodeMinfs::SaveCachedState(CachedVnode* entry) {
+    if (IsUnlinked() || !pending_.is_empty() || mapped_writable_) {
+        // A shared writable mapping may still change vmo_ behind our back.
+        return false;
+    }
+    if (!vmo_.is_valid() && vmo_indirect_ == nullptr && extents_.is_empty() &&
+        dir_index_ == nullptr) {
+        return false;
+    }
+    entry->ino = ino_;
+    entry->bytes = 0;
+    if (vmo_.is_valid()) {
+        uint64_t size;
+        if (vmo_.get_size(&size) == ZX_OK) {
+            entry->bytes += size;
+        }
+    }
+    if (vmo_indirect_ != nullptr) {
+        entry->bytes += vmo_indirect_->GetSize();
+    }
+    // Leaves the vnode with nothing for its destructor to detach.
+    entry->vmo = fbl::move(vmo_);
+    entry->vmoid = vmoid_;
+    entry->vmo_populated = fbl::move(vmo_populated_);
+    entry->vmo_indirect = fbl::move(vmo_indirect_);
+    entry->vmoid_indirect = vmoid_indirect_;
+    entry->extents = fbl::move(extents_);
+    entry->extent_blocks = fbl::move(extent_blocks_);
+    entry->dir_index = fbl::move(dir_index_);
+    return true;
+}
+
+void VnodeMinfs::RestoreCachedState(CachedVnode* entry) {
+    ZX_DEBUG_ASSERT(entry->ino == ino_);
+    vmo_ = fbl::move(entry->vmo);
+    vmoid_ = entry->vmoid;
+    vmo_populated_ = fbl::move(entry->vmo_populated);
+    vmo_indirect_ = fbl::move(entry->vmo_indirect);
+    vmoid_indirect_ = entry->vmoid_indirect;
+    extents_ = fbl::move(entry->extents);
+    extent_blocks_ = fbl::move(entry->extent_blocks);
+    dir_index_ = fbl::move(entry->dir_index);
+    ValidateVmoTail();
+}
+
+CachedVnode::~CachedVnode() {
+    size_t request_count = 0;
+    block_fifo_request_t request[2];
+    if (vmo.is_valid()) {
+        request[request_count].txnid = bc->TxnId();
+        request[request_count].vmoid = vmoid;
+        request[request_count].opcode = BLOCKIO_CLOSE_VMO;
+        request_count++;
+    }
+    if (vmo_indirect != nullptr) {
+        request[request_count].txnid = bc->TxnId();
+        request[request_count].vmoid = vmoid_indirect;
+        request[request_count].opcode = BLOCKIO_CLOSE_VMO;
+        request_count++;
+    }
+    if (request_count) {
+        bc->Txn(&request[0], request_count);
+    }
+}
+#endif
+
 VnodeMinfs::~VnodeMinfs() {
 #ifdef __Fuchsia__
     // Detach the vmoids from the underlying block device,
@@ -1105,6 +1627,7 @@ VnodeMinfs::~VnodeMinfs() {
     if (request_count) {
         fs_->bc_->Txn(&request[0], request_count);
     }
+    DropPending();
 #endif
 }
 
@@ -1121,6 +1644,7 @@ zx_status_t VnodeMinfs::ValidateFlags(uint32_t flags) {
 }
 
 zx_status_t VnodeMinfs::Open(uint32_t flags, fbl::RefPtr<Vnode>* out_redirect) {
+    WriteOpLock lock(fs_.get());
     fd_count_++;
     return ZX_OK;
 }
@@ -1129,6 +1653,7 @@ void VnodeMinfs::Purge(WriteTxn* txn) {
     ZX_DEBUG_ASSERT(fd_count_ == 0);
     ZX_DEBUG_ASSERT(IsUnlinked());
 #ifdef __Fuchsia__
+    DropPending();
     {
         fbl::AutoLock lock(&fs_->hash_lock_);
         fs_->VnodeReleaseLocked(this);
@@ -1146,6 +1671,7 @@ void VnodeMinfs::Purge(WriteTxn* txn) {
 }
 
 zx_status_t VnodeMinfs::Close() {
+    WriteOpLock lock(fs_.get());
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Closing ino with no fds open");
     fd_count_--;
 
@@ -1154,11 +1680,22 @@ zx_status_t VnodeMinfs::Close() {
         Purge(wb->txn());
         fs_->EnqueueWork(fbl::move(wb));
     }
+#ifdef __Fuchsia__
+    if (fd_count_ == 0 && !IsUnlinked()) {
+        // Don't hold the data of a closed file back from disk.
+        zx_status_t status;
+        if (mapped_writable_ && (status = WriteMapped()) != ZX_OK) {
+            return status;
+        }
+        return AllocatePending();
+    }
+#endif
     return ZX_OK;
 }
 
 zx_status_t VnodeMinfs::Read(void* data, size_t len, size_t off, size_t* out_actual) {
     TRACE_DURATION("minfs", "VnodeMinfs::Read", "ino", ino_, "len", len, "off", off);
+    ReadOpLock lock(this);
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Reading from ino with no fds open");
     xprintf("minfs_read() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, off);
     if (IsDirectory()) {
@@ -1184,8 +1721,13 @@ zx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 
     zx_status_t status;
 #ifdef __Fuchsia__
+    const blk_t start = static_cast<blk_t>(off / kMinfsBlockSize);
+    const blk_t end = static_cast<blk_t>(fbl::round_up(off + len, kMinfsBlockSize) /
+                                         kMinfsBlockSize);
     if ((status = InitVmo()) != ZX_OK) {
         return status;
+    } else if ((status = PopulateVmo(start, end, true)) != ZX_OK) {
+        return status;
     } else if ((status = vmo_.read(data, off, len, actual)) != ZX_OK) {
         return status;
     }
@@ -1229,6 +1771,12 @@ zx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 
 zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
                               size_t* out_actual) {
+    WriteOpLock lock(fs_.get());
+    return WriteLocked(data, len, offset, out_actual);
+}
+
+zx_status_t VnodeMinfs::WriteLocked(const void* data, size_t len, size_t offset,
+                                    size_t* out_actual) {
     TRACE_DURATION("minfs", "VnodeMinfs::Write", "ino", ino_, "len", len, "off", offset);
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Writing to ino with no fds open");
     xprintf("minfs_write() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, offset);
@@ -1246,16 +1794,30 @@ zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
         return status;
     }
     if (*out_actual != 0) {
-        InodeSync(wb->txn(), kMxFsSyncMtime);  // Successful writes updates mtime
-        wb->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
-        fs_->EnqueueWork(fbl::move(wb));
+#ifdef __Fuchsia__
+        if (wb->txn()->Count() == 0) {
+            // Every block written is pending; the inode goes out with them.
+            inode_.modify_time = minfs_gettime_utc();
+        } else
+#endif
+        {
+            InodeSync(wb->txn(), kMxFsSyncMtime);  // Successful writes updates mtime
+            wb->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
+            fs_->EnqueueWork(fbl::move(wb));
+        }
+    }
+#ifdef __Fuchsia__
+    if (pending_.size() >= kMinfsMaxPendingBlocks) {
+        return AllocatePending();
     }
+#endif
     return ZX_OK;
 }
 
 zx_status_t VnodeMinfs::Append(const void* data, size_t len, size_t* out_end,
                                size_t* out_actual) {
-    zx_status_t status = Write(data, len, inode_.size, out_actual);
+    WriteOpLock lock(fs_.get());
+    zx_status_t status = WriteLocked(data, len, inode_.size, out_actual);
     *out_end = inode_.size;
     return status;
 }
@@ -1298,18 +1860,30 @@ zx_status_t VnodeMinfs::WriteInternal(WriteTxn* txn, const void* data,
             }
         }
 
-        // Update this block of the in-memory VMO
+        // Update this block of the in-memory VMO, reading in the rest of
+        // it first if only part of it is being written.
+        if (xfer != kMinfsBlockSize && (status = PopulateVmo(n, n + 1, false)) != ZX_OK) {
+            goto done;
+        }
         if ((status = VmoWriteExact(data, xfer_off, xfer)) != ZX_OK) {
             goto done;
         }
+        MarkVmoPopulated(n, n + 1);
 
-        // Update this block on-disk
-        blk_t bno;
-        if ((status = GetBno(txn, n, &bno)) != ZX_OK) {
+        // Update this block on-disk, unless it has yet to be allocated and
+        // can wait for AllocatePending.
+        bool delayed;
+        if ((status = DelayAllocation(n, &delayed)) != ZX_OK) {
             goto done;
         }
-        ZX_DEBUG_ASSERT(bno != 0);
-        txn->Enqueue(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+        if (!delayed) {
+            blk_t bno;
+            if ((status = GetBno(txn, n, &bno)) != ZX_OK) {
+                goto done;
+            }
+            ZX_DEBUG_ASSERT(bno != 0);
+            EnqueueVmoBlock(txn, n, bno);
+        }
 #else
         blk_t bno;
         if ((status = GetBno(txn, n, &bno)) != ZX_OK) {
@@ -1357,6 +1931,7 @@ done:
 
 zx_status_t VnodeMinfs::Lookup(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name) {
     TRACE_DURATION("minfs", "VnodeMinfs::Lookup", "name", name);
+    ReadOpLock lock(this);
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(name));
 
     if (!IsDirectory()) {
@@ -1383,7 +1958,13 @@ zx_status_t VnodeMinfs::LookupInternal(fbl::RefPtr<fs::Vnode>* out, fbl::StringP
 }
 
 zx_status_t VnodeMinfs::Getattr(vnattr_t* a) {
+    ReadOpLock lock(this);
     xprintf("minfs_getattr() vn=%p(#%u)\n", this, ino_);
+    GetattrLocked(a);
+    return ZX_OK;
+}
+
+void VnodeMinfs::GetattrLocked(vnattr_t* a) const {
     a->mode = DTYPE_TO_VTYPE(MinfsMagicType(inode_.magic)) |
             V_IRUSR | V_IWUSR | V_IRGRP | V_IROTH;
     a->inode = ino_;
@@ -1393,10 +1974,10 @@ zx_status_t VnodeMinfs::Getattr(vnattr_t* a) {
     a->nlink = inode_.link_count;
     a->create_time = inode_.create_time;
     a->modify_time = inode_.modify_time;
-    return ZX_OK;
 }
 
 zx_status_t VnodeMinfs::Setattr(const vnattr_t* a) {
+    WriteOpLock lock(fs_.get());
     int dirty = 0;
     xprintf("minfs_setattr() vn=%p(#%u)\n", this, ino_);
     if ((a->valid & ~(ATTR_CTIME|ATTR_MTIME)) != 0) {
@@ -1436,9 +2017,29 @@ static_assert(sizeof(dircookie_t) <= sizeof(fs::vdircookie_t),
 zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
                                 size_t* out_actual) {
     TRACE_DURATION("minfs", "VnodeMinfs::Readdir");
+    ReadOpLock lock(this);
     xprintf("minfs_readdir() vn=%p(#%u) cookie=%p len=%zd\n", this, ino_, cookie, len);
-    dircookie_t* dc = reinterpret_cast<dircookie_t*>(cookie);
     fs::DirentFiller df(dirents, len);
+    zx_status_t status = ReaddirLocked(cookie, &df, out_actual);
+    ZX_DEBUG_ASSERT(*out_actual <= len); // Otherwise, we're overflowing the input buffer.
+    return status;
+}
+
+zx_status_t VnodeMinfs::ReaddirAttr(fs::vdircookie_t* cookie, void* dirents, size_t len,
+                                    size_t* out_actual) {
+    TRACE_DURATION("minfs", "VnodeMinfs::ReaddirAttr");
+    ReadOpLock lock(this);
+    xprintf("minfs_readdir_attr() vn=%p(#%u) cookie=%p len=%zd\n", this, ino_, cookie, len);
+    fs::DirentFiller df(dirents, len, true);
+    zx_status_t status = ReaddirLocked(cookie, &df, out_actual);
+    ZX_DEBUG_ASSERT(*out_actual <= len);
+    return status;
+}
+
+zx_status_t VnodeMinfs::ReaddirLocked(fs::vdircookie_t* cookie, fs::DirentFiller* df,
+                                      size_t* out_actual) {
+    dircookie_t* dc = reinterpret_cast<dircookie_t*>(cookie);
+    *out_actual = 0;
 
     if (!IsDirectory()) {
         return ZX_ERR_NOT_SUPPORTED;
@@ -1455,6 +2056,10 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
         // until we get to the direntry at or after the previously identified offset.
 
         size_t off_recovered = 0;
+        uint32_t seek = static_cast<uint32_t>(off);
+        if (LoadDirectoryIndex() == ZX_OK) {
+            off_recovered = dir_index_->Seek(&seek) ? seek : kMinfsMaxDirectorySize;
+        }
         while (off_recovered < off) {
             if (off_recovered + MINFS_DIRENT_SIZE >= kMinfsMaxDirectorySize) {
                 goto fail;
@@ -1480,7 +2085,20 @@ zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t
 
         if (de->ino && name != "..") {
             zx_status_t status;
-            if ((status = df.Next(name, de->type)) != ZX_OK) {
+            if (df->WithAttrs()) {
+                // Neither this directory nor the filesystem can change while we
+                // hold the ReadOpLock, so the child's inode can be read as is.
+                fbl::RefPtr<VnodeMinfs> child;
+                vnattr_t attr;
+                if (fs_->VnodeGet(&child, de->ino) != ZX_OK) {
+                    goto fail;
+                }
+                child->GetattrLocked(&attr);
+                status = df->Next(name, de->type, attr);
+            } else {
+                status = df->Next(name, de->type);
+            }
+            if (status != ZX_OK) {
                 // no more space
                 goto done;
             }
@@ -1493,8 +2111,7 @@ done:
     // save our place in the dircookie
     dc->off = off;
     dc->seqno = inode_.seq_num;
-    *out_actual = df.BytesFilled();
-    ZX_DEBUG_ASSERT(*out_actual <= len); // Otherwise, we're overflowing the input buffer.
+    *out_actual = df->BytesFilled();
     return ZX_OK;
 
 fail:
@@ -1528,6 +2145,7 @@ zx_status_t VnodeMinfs::Allocate(Minfs* fs, uint32_t type, fbl::RefPtr<VnodeMinf
     }
     memset(&(*out)->inode_, 0, sizeof((*out)->inode_));
     (*out)->inode_.magic = MinfsMagic(type);
+    (*out)->inode_.flags = kMinfsInodeFlagExtents;
     (*out)->inode_.create_time = (*out)->inode_.modify_time = minfs_gettime_utc();
     (*out)->inode_.link_count = (type == kMinfsTypeDir ? 2 : 1);
     return ZX_OK;
@@ -1547,6 +2165,7 @@ zx_status_t VnodeMinfs::Recreate(Minfs* fs, ino_t ino, const minfs_inode_t* inod
 
 zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name, uint32_t mode) {
     TRACE_DURATION("minfs", "VnodeMinfs::Create", "name", name);
+    WriteOpLock lock(fs_.get());
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(name));
 
     if (!IsDirectory()) {
@@ -1618,6 +2237,7 @@ zx_status_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, vo
             if (out_len < (sizeof(vfs_query_info_t) + strlen(kFsName))) {
                 return ZX_ERR_INVALID_ARGS;
             }
+            ReadOpLock lock(this);
 
             vfs_query_info_t* info = static_cast<vfs_query_info_t*>(out_buf);
             memset(info, 0, sizeof(*info));
@@ -1640,8 +2260,9 @@ zx_status_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, vo
             if (status != ZX_OK) {
                 FS_TRACE_ERROR("minfs unmount failed to sync; unmounting anyway: %d\n", status);
             }
-            // 'fs_' is deleted after Unmount is called.
+            // 'fs_' is deleted after Unmount is called, and never unlocked.
             *out_actual = 0;
+            WriteOpLock lock(fs_.get());
             return fs_->Unmount();
         }
 #ifdef __Fuchsia__
@@ -1656,6 +2277,25 @@ zx_status_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, vo
             }
             return len > 0 ? ZX_OK : static_cast<zx_status_t>(len);
         }
+        case IOCTL_VFS_TRIM_FS: {
+            if (out_len < sizeof(uint64_t)) {
+                return ZX_ERR_INVALID_ARGS;
+            }
+            zx_status_t status = fs_->TrimFree(static_cast<uint64_t*>(out_buf));
+            if (status == ZX_OK) {
+                *out_actual = sizeof(uint64_t);
+            }
+            return status;
+        }
+        case IOCTL_VFS_QUERY_CACHE: {
+            if (out_len < sizeof(vfs_cache_info_t)) {
+                return ZX_ERR_INVALID_ARGS;
+            }
+            fbl::AutoLock lock(&fs_->cache_info_lock_);
+            memcpy(out_buf, &fs_->cache_info_, sizeof(vfs_cache_info_t));
+            *out_actual = sizeof(vfs_cache_info_t);
+            return ZX_OK;
+        }
 #endif
         default: {
             return ZX_ERR_NOT_SUPPORTED;
@@ -1665,6 +2305,7 @@ zx_status_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, vo
 
 zx_status_t VnodeMinfs::Unlink(fbl::StringPiece name, bool must_be_dir) {
     TRACE_DURATION("minfs", "VnodeMinfs::Unlink", "name", name);
+    WriteOpLock lock(fs_.get());
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(name));
 
     if (!IsDirectory()) {
@@ -1689,6 +2330,7 @@ zx_status_t VnodeMinfs::Unlink(fbl::StringPiece name, bool must_be_dir) {
 
 zx_status_t VnodeMinfs::Truncate(size_t len) {
     TRACE_DURATION("minfs", "VnodeMinfs::Truncate");
+    WriteOpLock lock(fs_.get());
     if (IsDirectory()) {
         return ZX_ERR_NOT_FILE;
     }
@@ -1711,11 +2353,13 @@ zx_status_t VnodeMinfs::Truncate(size_t len) {
 zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
     zx_status_t r = 0;
 #ifdef __Fuchsia__
-    // TODO(smklein): We should only init up to 'len'; no need
-    // to read in the portion of a large file we plan on deleting.
     if (InitVmo() != ZX_OK) {
         return ZX_ERR_IO;
     }
+    // Shrinking and growing work on allocated blocks.
+    if ((r = AllocatePending()) != ZX_OK) {
+        return r;
+    }
 #endif
 
     if (len < inode_.size) {
@@ -1746,6 +2390,9 @@ zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
             if (bno != 0) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
+                if ((r = PopulateVmo(rel_bno, rel_bno + 1, false)) != ZX_OK) {
+                    return ZX_ERR_IO;
+                }
                 if ((r = VmoReadExact(bdata, len - adjust, adjust)) != ZX_OK) {
                     return ZX_ERR_IO;
                 }
@@ -1754,7 +2401,7 @@ zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
                 if ((r = VmoWriteExact(bdata, len - adjust, kMinfsBlockSize)) != ZX_OK) {
                     return ZX_ERR_IO;
                 }
-                txn->Enqueue(vmo_.get(), rel_bno, bno + fs_->info_.dat_block, 1);
+                EnqueueVmoBlock(txn, rel_bno, bno);
 #else
                 if (fs_->bc_->Readblk(bno + fs_->info_.dat_block, bdata)) {
                     return ZX_ERR_IO;
@@ -1809,6 +2456,7 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
                                fbl::StringPiece newname, bool src_must_be_dir,
                                bool dst_must_be_dir) {
     TRACE_DURATION("minfs", "VnodeMinfs::Rename", "src", oldname, "dst", newname);
+    WriteOpLock lock(fs_.get());
     auto newdir = fbl::RefPtr<VnodeMinfs>::Downcast(_newdir);
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(oldname));
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(newname));
@@ -1861,7 +2509,7 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     // moved to a new directory
     if ((args.type == kMinfsTypeDir) && (ino_ != newdir->ino_)) {
         fbl::RefPtr<fs::Vnode> vn_fs;
-        if ((status = newdir->Lookup(&vn_fs, newname)) < 0) {
+        if ((status = newdir->LookupInternal(&vn_fs, newname)) < 0) {
             return status;
         }
         auto vn = fbl::RefPtr<VnodeMinfs>::Downcast(vn_fs);
@@ -1887,6 +2535,7 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
 
 zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _target) {
     TRACE_DURATION("minfs", "VnodeMinfs::Link", "name", name);
+    WriteOpLock lock(fs_.get());
     ZX_DEBUG_ASSERT(fs::vfs_valid_name(name));
 
     if (!IsDirectory()) {
@@ -1939,10 +2588,23 @@ zx_status_t VnodeMinfs::Sync() {
     TRACE_DURATION("minfs", "VnodeMinfs::Sync");
     completion_t completion;
     zx_status_t status;
-    if ((status = fs_->Sync(&completion)) != ZX_OK) {
-        FS_TRACE_ERROR("VnodeMinfs::Sync fs sync failure: %d\n", status);
-        return status;
-    } else if ((status = completion_wait(&completion, ZX_SEC(15))) != ZX_OK) {
+    {
+        WriteOpLock lock(fs_.get());
+        if (mapped_writable_ && (status = WriteMapped()) != ZX_OK) {
+            FS_TRACE_ERROR("VnodeMinfs::Sync mapped writeback failure: %d\n", status);
+            return status;
+        }
+        // Enqueue the writes of every file's pending blocks ahead of the sync probe.
+        if ((status = fs_->AllocatePending()) != ZX_OK) {
+            FS_TRACE_ERROR("VnodeMinfs::Sync pending allocation failure: %d\n", status);
+            return status;
+        } else if ((status = fs_->Sync(&completion)) != ZX_OK) {
+            FS_TRACE_ERROR("VnodeMinfs::Sync fs sync failure: %d\n", status);
+            return status;
+        }
+    }
+    // Other operations may go on while the writeback thread drains.
+    if ((status = completion_wait(&completion, ZX_SEC(15))) != ZX_OK) {
         FS_TRACE_ERROR("VnodeMinfs::Sync Completion wait failure: %d\n", status);
         return status;
     } else if ((status = fs_->bc_->Sync()) != ZX_OK) {
@@ -1952,7 +2614,108 @@ zx_status_t VnodeMinfs::Sync() {
     return ZX_OK;
 }
 
+// Without a pager, the whole file is read into vmo_ before it is handed out,
+// and the blocks written through a shared mapping can't be told apart from the
+// rest. Writes and reads go through vmo_ too, so they stay coherent with any
+// mapping.
+zx_status_t VnodeMinfs::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) {
+    TRACE_DURATION("minfs", "VnodeMinfs::Mmap", "ino", ino_, "flags", flags);
+    if (IsDirectory()) {
+        return ZX_ERR_NOT_SUPPORTED;
+    } else if (flags & FDIO_MMAP_FLAG_STABLE) {
+        // The file may be written at any time.
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+
+    WriteOpLock lock(fs_.get());
+    zx_status_t status;
+    const blk_t blocks = static_cast<blk_t>(fbl::round_up(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    if ((status = InitVmo()) != ZX_OK) {
+        return status;
+    } else if ((status = PopulateVmo(0, blocks, false)) != ZX_OK) {
+        return status;
+    }
+
+    if (flags & FDIO_MMAP_FLAG_PRIVATE) {
+        return zx_vmo_clone(vmo_.get(), ZX_VMO_CLONE_COPY_ON_WRITE, 0, inode_.size, out);
+    }
+    zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP;
+    rights |= (flags & FDIO_MMAP_FLAG_READ) ? ZX_RIGHT_READ : 0;
+    rights |= (flags & FDIO_MMAP_FLAG_WRITE) ? ZX_RIGHT_WRITE : 0;
+    rights |= (flags & FDIO_MMAP_FLAG_EXEC) ? ZX_RIGHT_EXECUTE : 0;
+    if ((status = zx_handle_duplicate(vmo_.get(), rights, out)) != ZX_OK) {
+        return status;
+    }
+    if (flags & FDIO_MMAP_FLAG_WRITE) {
+        mapped_writable_ = true;
+    }
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::WriteMapped() {
+    TRACE_DURATION("minfs", "VnodeMinfs::WriteMapped", "ino", ino_);
+    zx_status_t status;
+    const blk_t blocks = static_cast<blk_t>(fbl::round_up(inode_.size, kMinfsBlockSize) /
+                                            kMinfsBlockSize);
+    // A mapping may have written past the end of the file, where the tail of
+    // the last block must read as zero.
+    const size_t tail = blocks * kMinfsBlockSize - inode_.size;
+    if (tail != 0) {
+        char zero[kMinfsBlockSize];
+        memset(zero, 0, tail);
+        if ((status = VmoWriteExact(zero, inode_.size, tail)) != ZX_OK) {
+            return status;
+        }
+    }
+
+    blk_t n = 0;
+    while (n < blocks) {
+        fbl::AllocChecker ac;
+        fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(fs_->bc_.get()));
+        if (!ac.check()) {
+            return ZX_ERR_NO_MEMORY;
+        }
+        // As in AllocatePending, leave room for the blocks allocations dirty.
+        for (; n < blocks && wb->txn()->Count() < MAX_TXN_MESSAGES / 2; n++) {
+            blk_t bno;
+            if ((status = GetBno(nullptr, n, &bno)) != ZX_OK) {
+                return status;
+            }
+            if (bno == 0) {
+                // Holes only need a block if the mapping wrote to them.
+                char data[kMinfsBlockSize];
+                if ((status = VmoReadExact(data, n * kMinfsBlockSize, kMinfsBlockSize)) != ZX_OK) {
+                    return status;
+                }
+                size_t i = 0;
+                while (i < sizeof(data) && data[i] == 0) {
+                    i++;
+                }
+                bool delayed;
+                if (i == sizeof(data)) {
+                    continue;
+                } else if ((status = DelayAllocation(n, &delayed)) != ZX_OK) {
+                    return status;
+                } else if (delayed) {
+                    continue;
+                } else if ((status = GetBno(wb->txn(), n, &bno)) != ZX_OK) {
+                    return status;
+                }
+            }
+            EnqueueVmoBlock(wb->txn(), n, bno);
+        }
+        if (wb->txn()->Count() != 0) {
+            InodeSync(wb->txn(), kMxFsSyncDefault);
+            wb->PinVnode(fbl::WrapRefPtr(this));
+            fs_->EnqueueWork(fbl::move(wb));
+        }
+    }
+    return ZX_OK;
+}
+
 zx_status_t VnodeMinfs::AttachRemote(fs::MountChannel h) {
+    WriteOpLock lock(fs_.get());
     if (kMinfsRootIno == ino_) {
         return ZX_ERR_ACCESS_DENIED;
     } else if (!IsDirectory() || IsUnlinked()) {
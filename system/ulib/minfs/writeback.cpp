@@ -5,8 +5,11 @@
 #include <inttypes.h>
 
 #ifdef __Fuchsia__
+#include <time.h>
+
 #include <fbl/auto_lock.h>
 #include <fbl/mutex.h>
+#include <zircon/syscalls.h>
 #include <zx/vmo.h>
 #endif
 
@@ -20,6 +23,7 @@
 #include <fs/mapped-vmo.h>
 #include <fs/vfs.h>
 
+#include "journal.h"
 #include "minfs-private.h"
 #include <minfs/writeback.h>
 
@@ -27,11 +31,11 @@ namespace minfs {
 
 #ifdef __Fuchsia__
 
-void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
-                       uint64_t nblocks) {
+void WriteTxn::EnqueueInternal(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                               uint64_t nblocks, bool data) {
     validate_vmo_size(vmo, static_cast<blk_t>(vmo_offset));
     for (size_t i = 0; i < count_; i++) {
-        if (requests_[i].vmo != vmo) {
+        if (requests_[i].vmo != vmo || requests_[i].data != data) {
             continue;
         }
 
@@ -55,6 +59,7 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
     requests_[count_].vmo_offset = vmo_offset;
     requests_[count_].dev_offset = dev_offset;
     requests_[count_].length = nblocks;
+    requests_[count_].data = data;
     count_++;
 
     // "-1" so we can split a txn into two if we need to wrap around the log.
@@ -62,28 +67,29 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
                   "Enqueueing too many messages for one operation");
 }
 
-zx_status_t WriteTxn::Flush(zx_handle_t vmo, vmoid_t vmoid) {
-    ZX_DEBUG_ASSERT(vmo != ZX_HANDLE_INVALID);
-    ZX_DEBUG_ASSERT(vmoid != VMOID_INVALID);
-
-    // Update all the outgoing transactions to be in "disk blocks",
-    // not "Minfs blocks".
-    block_fifo_request_t blk_reqs[MAX_TXN_MESSAGES];
-    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->BlockSize();
-    for (size_t i = 0; i < count_; i++) {
-        blk_reqs[i].txnid = bc_->TxnId();
-        blk_reqs[i].vmoid = vmoid;
-        blk_reqs[i].opcode = BLOCKIO_WRITE;
-        blk_reqs[i].vmo_offset = requests_[i].vmo_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].dev_offset = requests_[i].dev_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].length = requests_[i].length * kDiskBlocksPerMinfsBlock;
+void WriteTxn::EnqueueTrim(uint64_t dev_offset, uint64_t nblocks) {
+    if (!bc_->TrimSupported()) {
+        return;
     }
-
-    // Actually send the operations to the underlying block device.
-    zx_status_t status = bc_->Txn(blk_reqs, count_);
-
-    count_ = 0;
-    return status;
+    for (size_t i = 0; i < trim_count_; i++) {
+        if (trims_[i].dev_offset + trims_[i].length == dev_offset) {
+            trims_[i].length += nblocks;
+            return;
+        } else if (dev_offset + nblocks == trims_[i].dev_offset) {
+            trims_[i].dev_offset = dev_offset;
+            trims_[i].length += nblocks;
+            return;
+        }
+    }
+    if (trim_count_ == MAX_TXN_MESSAGES) {
+        return;
+    }
+    trims_[trim_count_].vmo = ZX_HANDLE_INVALID;
+    trims_[trim_count_].vmo_offset = 0;
+    trims_[trim_count_].dev_offset = dev_offset;
+    trims_[trim_count_].length = nblocks;
+    trims_[trim_count_].data = false;
+    trim_count_++;
 }
 
 size_t WriteTxn::BlkCount() const {
@@ -113,16 +119,11 @@ void WritebackWork::Reset() {
 }
 
 #ifdef __Fuchsia__
-// Returns the number of blocks of the writeback buffer that have been
-// consumed
-size_t WritebackWork::Complete(zx_handle_t vmo, vmoid_t vmoid) {
-    size_t blk_count = txn_.BlkCount();
-    txn_.Flush(vmo, vmoid);
+void WritebackWork::Complete() {
     if (completion_ != nullptr) {
         completion_signal(completion_);
     }
     Reset();
-    return blk_count;
 }
 
 void WritebackWork::SetCompletion(completion_t* completion) {
@@ -205,7 +206,10 @@ zx_status_t WritebackBuffer::EnsureSpaceLocked(size_t blocks) {
     }
     while (len_ + blocks > cap_) {
         // Not enough room to write back work, yet. Wait until
-        // room is available.
+        // room is available, making sure the queued work isn't
+        // waiting for company in the meantime.
+        flush_now_ = true;
+        cnd_signal(&consumer_cvar_);
         Waiter w;
         producer_queue_.push(&w);
 
@@ -273,9 +277,11 @@ void WritebackBuffer::CopyToBufferLocked(WriteTxn* txn) {
 
             // Insert the "new" request, which is the latter half of
             // the request we wrote out earlier
+            reqs[i].vmo = vmo;
             reqs[i].dev_offset = dev_offset;
             reqs[i].vmo_offset = 0;
             reqs[i].length = wb_len;
+            reqs[i].data = reqs[i - 1].data;
             txn->count_++;
         }
     }
@@ -311,34 +317,281 @@ void WritebackBuffer::Enqueue(fbl::unique_ptr<WritebackWork> work) {
         CopyToBufferLocked(work->txn());
     }
 
+    if (work_queue_.is_empty()) {
+        batch_start_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    }
+    if (work->HasCompletion()) {
+        flush_now_ = true;
+    }
     work_queue_.push(fbl::move(work));
     cnd_signal(&consumer_cvar_);
 }
 
+zx_status_t WritebackBuffer::EnableJournal(const minfs_info_t* info) {
+    fbl::unique_ptr<Journal> journal;
+    zx_status_t status = Journal::Create(bc_, info, buffer_.get(), buffer_vmoid_, &journal);
+    if (status != ZX_OK) {
+        return status;
+    }
+    fbl::AutoLock lock(&writeback_lock_);
+    journal_ = fbl::move(journal);
+    return ZX_OK;
+}
+
+bool WritebackBuffer::FlushDueLocked() const {
+    return unmounting_ || flush_now_ || len_ >= kWritebackFlushBlocks ||
+           zx_clock_get(ZX_CLOCK_MONOTONIC) >= batch_start_ + kWritebackDelay;
+}
+
+namespace {
+
+bool Overlaps(const write_request_t& a, const write_request_t& b) {
+    return a.dev_offset < b.dev_offset + b.length && b.dev_offset < a.dev_offset + a.length;
+}
+
+} // namespace
+
+bool WritebackBuffer::AddRequest(Group* group, const write_request_t& req, size_t capacity) {
+    // Metadata goes through the journal, unless it can never fit.
+    const bool journaled = !req.data && req.length <= capacity;
+    write_request_t* reqs = journaled ? group->meta : group->data;
+    size_t* count = journaled ? &group->meta_count : &group->data_count;
+
+    size_t overlapping = 0;
+    for (size_t j = 0; j < group->data_count; j++) {
+        overlapping += Overlaps(group->data[j], req) ? 1 : 0;
+    }
+    for (size_t j = 0; j < group->meta_count; j++) {
+        overlapping += Overlaps(group->meta[j], req) ? 1 : 0;
+    }
+    size_t same = *count;
+    size_t adjacent = *count;
+    for (size_t j = 0; j < *count; j++) {
+        if (Overlaps(reqs[j], req)) {
+            if (reqs[j].dev_offset == req.dev_offset && reqs[j].length == req.length) {
+                same = j;
+            }
+        } else if (reqs[j].vmo_offset + reqs[j].length == req.vmo_offset &&
+                   reqs[j].dev_offset + reqs[j].length == req.dev_offset) {
+            adjacent = j;
+        }
+    }
+
+    if (overlapping == 1 && same != *count) {
+        reqs[same].vmo_offset = req.vmo_offset;
+        return true;
+    } else if (overlapping != 0) {
+        return false;
+    } else if (journaled && group->meta_blocks + req.length > capacity) {
+        return false;
+    } else if (adjacent != *count) {
+        reqs[adjacent].length += req.length;
+    } else if (*count == MAX_TXN_MESSAGES) {
+        return false;
+    } else {
+        reqs[(*count)++] = req;
+    }
+    if (journaled) {
+        group->meta_blocks += req.length;
+    }
+    return true;
+}
+
+bool WritebackBuffer::AddWork(Group* group, WriteTxn* txn, size_t capacity) {
+    for (size_t i = 0; i < txn->Count(); i++) {
+        if (!AddRequest(group, txn->Requests()[i], capacity)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void WritebackBuffer::AddTrims(Group* group, const WriteTxn* txn) {
+    for (size_t i = 0; i < txn->TrimCount(); i++) {
+        const write_request_t& req = txn->Trims()[i];
+        size_t j = 0;
+        for (; j < group->trim_count; j++) {
+            write_request_t* trim = &group->trim[j];
+            if (trim->dev_offset + trim->length == req.dev_offset) {
+                trim->length += req.length;
+                break;
+            } else if (req.dev_offset + req.length == trim->dev_offset) {
+                trim->dev_offset = req.dev_offset;
+                trim->length += req.length;
+                break;
+            }
+        }
+        if (j == group->trim_count && group->trim_count < MAX_TXN_MESSAGES) {
+            group->trim[group->trim_count++] = req;
+        }
+    }
+}
+
+void WritebackBuffer::WriteRequests(const write_request_t* reqs, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    // Requests are gathered in "Minfs blocks", and converted to "disk blocks"
+    // as they are sent to the underlying block device.
+    block_fifo_request_t blk_reqs[MAX_TXN_MESSAGES];
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->BlockSize();
+    for (size_t i = 0; i < count; i++) {
+        blk_reqs[i].txnid = bc_->TxnId();
+        blk_reqs[i].vmoid = buffer_vmoid_;
+        blk_reqs[i].opcode = BLOCKIO_WRITE;
+        blk_reqs[i].vmo_offset = reqs[i].vmo_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[i].dev_offset = reqs[i].dev_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[i].length = static_cast<uint32_t>(reqs[i].length * kDiskBlocksPerMinfsBlock);
+    }
+    zx_status_t status = bc_->Txn(blk_reqs, count);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("minfs: writeback failed: %d\n", status);
+    }
+}
+
+void WritebackBuffer::TrimRequests(const Group* group) {
+    block_fifo_request_t blk_reqs[MAX_TXN_MESSAGES];
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->BlockSize();
+    size_t count = 0;
+    for (size_t i = 0; i < group->trim_count; i++) {
+        const write_request_t& trim = group->trim[i];
+        bool written = false;
+        for (size_t j = 0; j < group->data_count && !written; j++) {
+            written = Overlaps(group->data[j], trim);
+        }
+        for (size_t j = 0; j < group->meta_count && !written; j++) {
+            written = Overlaps(group->meta[j], trim);
+        }
+        if (written) {
+            continue;
+        }
+        blk_reqs[count].txnid = bc_->TxnId();
+        blk_reqs[count].vmoid = VMOID_INVALID;
+        blk_reqs[count].opcode = BLOCKIO_TRIM;
+        blk_reqs[count].vmo_offset = 0;
+        blk_reqs[count].dev_offset = trim.dev_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[count].length = static_cast<uint32_t>(trim.length * kDiskBlocksPerMinfsBlock);
+        count++;
+    }
+    if (count == 0) {
+        return;
+    }
+    zx_status_t status = bc_->Txn(blk_reqs, count);
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("minfs: trim failed: %d\n", status);
+    }
+}
+
+void WritebackBuffer::WriteGroup(Group* group, WorkQueue* done, Journal* journal) {
+    TRACE_DURATION("minfs", "WritebackBuffer::WriteGroup");
+    // File data goes first, so that no committed metadata points at blocks
+    // which don't hold it yet.
+    WriteRequests(group->data, group->data_count);
+    if (group->meta_count != 0) {
+        zx_status_t status = journal->Commit(group->meta, group->meta_count);
+        if (status != ZX_OK) {
+            FS_TRACE_ERROR("minfs: journal commit failed: %d\n", status);
+        }
+    }
+
+    while (!done->is_empty()) {
+        auto work = done->pop();
+        work->Complete();
+        TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
+    }
+
+    WriteRequests(group->meta, group->meta_count);
+    // Trimmed only now, since the blocks were in use until the group was
+    // written, and no later group writes to them until this returns.
+    TrimRequests(group);
+    group->data_count = 0;
+    group->meta_count = 0;
+    group->meta_blocks = 0;
+    group->trim_count = 0;
+}
+
+size_t WritebackBuffer::WriteBatch(WorkQueue* batch, Journal* journal) {
+    TRACE_DURATION("minfs", "WritebackBuffer::WriteBatch");
+    const size_t capacity = (journal != nullptr) ? journal->Capacity() : 0;
+    Group group;
+    group.data_count = 0;
+    group.meta_count = 0;
+    group.meta_blocks = 0;
+    group.trim_count = 0;
+    WorkQueue done;
+    size_t blks_consumed = 0;
+    while (!batch->is_empty()) {
+        auto work = batch->pop();
+        WriteTxn* txn = work->txn();
+        blks_consumed += txn->BlkCount();
+        // A unit of work which doesn't fit in the group so far starts the
+        // next one, so that a crash never commits only part of it.
+        Group saved = group;
+        if (!AddWork(&group, txn, capacity)) {
+            group = saved;
+            WriteGroup(&group, &done, journal);
+            if (!AddWork(&group, txn, capacity)) {
+                // It doesn't fit in a group by itself either; commit it in
+                // as many pieces as it takes.
+                group.data_count = 0;
+                group.meta_count = 0;
+                group.meta_blocks = 0;
+                group.trim_count = 0;
+                for (size_t i = 0; i < txn->Count(); i++) {
+                    if (!AddRequest(&group, txn->Requests()[i], capacity)) {
+                        WriteGroup(&group, &done, journal);
+                        ZX_ASSERT(AddRequest(&group, txn->Requests()[i], capacity));
+                    }
+                }
+            }
+        }
+        AddTrims(&group, txn);
+        txn->count_ = 0;
+        txn->trim_count_ = 0;
+        done.push(fbl::move(work));
+    }
+    WriteGroup(&group, &done, journal);
+    return blks_consumed;
+}
+
 int WritebackBuffer::WritebackThread(void* arg) {
     WritebackBuffer* b = reinterpret_cast<WritebackBuffer*>(arg);
 
     b->writeback_lock_.Acquire();
     while (true) {
-        while (!b->work_queue_.is_empty()) {
-            auto work = b->work_queue_.pop();
-            TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
+        if (!b->work_queue_.is_empty() && !b->FlushDueLocked()) {
+            // Let more work join what is queued, until the oldest of it has
+            // waited for kWritebackDelay.
+            zx_duration_t wait = b->batch_start_ + kWritebackDelay -
+                                 zx_clock_get(ZX_CLOCK_MONOTONIC);
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += wait % ZX_SEC(1);
+            deadline.tv_sec += wait / ZX_SEC(1) + deadline.tv_nsec / ZX_SEC(1);
+            deadline.tv_nsec %= ZX_SEC(1);
+            cnd_timedwait(&b->consumer_cvar_, b->writeback_lock_.GetInternal(), &deadline);
+            continue;
+        }
 
-            // Stay unlocked while processing a unit of work
+        if (!b->work_queue_.is_empty()) {
+            TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
+            WorkQueue batch;
+            while (!b->work_queue_.is_empty()) {
+                batch.push(b->work_queue_.pop());
+            }
+            b->flush_now_ = false;
+            Journal* journal = b->journal_.get();
+
+            // Stay unlocked while writing out the batch
             b->writeback_lock_.Release();
-
-            // TODO(smklein): We could add additional validation that the blocks
-            // in "work" are contiguous and in the range of [start_, len_) (including
-            // wraparound).
-            size_t blks_consumed = work->Complete(b->buffer_->GetVmo(), b->buffer_vmoid_);
-            TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
-            work = nullptr;
+            size_t blks_consumed = b->WriteBatch(&batch, journal);
 
             // Relock before checking the state of the queue
             b->writeback_lock_.Acquire();
             b->start_ = (b->start_ + blks_consumed) % b->cap_;
             b->len_ -= blks_consumed;
             cnd_signal(&b->producer_cvar_);
+            continue;
         }
 
         // Before waiting, we should check if we're unmounting.
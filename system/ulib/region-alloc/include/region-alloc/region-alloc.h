@@ -78,7 +78,8 @@
 //
 // == Thread Safety ==
 // RegionAllocator and RegionPools use fbl::Mutex objects to provide thread
-// safety in multi-threaded environments.  As such, RegionAllocators are not
+// safety in multi-threaded environments.  Bookkeeping which has been returned
+// to a RegionPool is handed out again without taking the pool's mutex.  As such, RegionAllocators are not
 // currently suitable for use in code which may run at IRQ context, or which
 // must never block.
 //
@@ -241,7 +242,13 @@ __END_CDECLS
 class RegionAllocator {
 public:
     class Region;
-    using RegionSlabTraits = fbl::ManualDeleteSlabAllocatorTraits<Region*, REGION_POOL_SLAB_SIZE>;
+    // Regions are recycled through the pool's free list without taking the
+    // pool's lock.  The lock is only needed when a new slab must be carved up.
+    using RegionSlabTraits = fbl::SlabAllocatorTraits<Region*,
+                                                      REGION_POOL_SLAB_SIZE,
+                                                      fbl::Mutex,
+                                                      fbl::SlabAllocatorFlavor::MANUAL_DELETE,
+                                                      true>;
 
     class Region : public ralloc_region_t,
                    public fbl::SlabAllocated<RegionSlabTraits>,
@@ -415,6 +422,11 @@ public:
     // specified size and alignment.  Note; the alignment must be a power of
     // two.  Pass 1 if alignment does not matter.
     //
+    // The allocation is carved out of the smallest available region which can
+    // hold it, except that only a handful of regions which turn out to be
+    // misaligned are considered before settling for the smallest region which
+    // is long enough to satisfy the alignment wherever its base lies.
+    //
     // Possible return values
     // ++ ZX_ERR_BAD_STATE : Allocator has no RegionPool assigned.
     // ++ ZX_ERR_NO_MEMORY : not enough bookkeeping memory available in our
@@ -6,6 +6,10 @@
 #include <region-alloc/region-alloc.h>
 #include <string.h>
 
+// The number of too-short or misaligned regions which GetRegion will consider
+// before looking up a region which is certain to satisfy an aligned request.
+static constexpr size_t MAX_ALIGNMENT_PROBES = 8;
+
 // Support for Pool allocated bookkeeping
 RegionAllocator::RegionPool::RefPtr RegionAllocator::RegionPool::Create(size_t max_memory) {
     // Sanity check our allocation arguments.
@@ -298,8 +302,24 @@ zx_status_t RegionAllocator::GetRegion(uint64_t size,
     // Consider all of the regions which are large enough to hold our
     // allocation.  Stop as soon as we find one which can satisfy the alignment
     // restrictions.
+    //
+    // Any region which is at least (size + mask) long can satisfy the alignment
+    // restrictions no matter where its base lies, so there is no need to visit
+    // every shorter region which turns out to be misaligned.  After
+    // MAX_ALIGNMENT_PROBES misses, skip straight to the smallest region which
+    // is certain to fit, if there is one.
     uint64_t aligned_base;
-    while (iter.IsValid()) {
+    for (size_t probes = 0; iter.IsValid(); ++probes) {
+        if (probes == MAX_ALIGNMENT_PROBES) {
+            uint64_t sure_fit_size = size + mask;
+            if (sure_fit_size > size) {
+                auto sure_fit = avail_regions_by_size_.lower_bound({ .base = 0,
+                                                                     .size = sure_fit_size });
+                if (sure_fit.IsValid())
+                    iter = sure_fit;
+            }
+        }
+
         ZX_DEBUG_ASSERT(iter->size >= size);
         aligned_base = (iter->base + mask) & inv_mask;
         uint64_t overhead = aligned_base - iter->base;
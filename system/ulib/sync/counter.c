@@ -0,0 +1,25 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sync/counter.h>
+
+#include <stddef.h>
+#include <zircon/process.h>
+
+// Handle values are distinct between the threads of a process and always
+// have the low bit set, so the bits above it spread threads over the shards.
+static inline size_t shard_index(void) {
+    return ((uint32_t)zx_thread_self() >> 1) % SYNC_COUNTER_SHARDS;
+}
+
+void sync_counter_add(sync_counter_t* counter, int64_t delta) {
+    __atomic_fetch_add(&counter->shards[shard_index()].value, delta, __ATOMIC_RELAXED);
+}
+
+int64_t sync_counter_read(const sync_counter_t* counter) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < SYNC_COUNTER_SHARDS; i++)
+        sum += __atomic_load_n(&counter->shards[i].value, __ATOMIC_RELAXED);
+    return sum;
+}
@@ -0,0 +1,26 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS;
+
+#define SYNC_COUNTER_SHARDS 16
+
+// A counter for values that many threads bump but few read. Each thread adds
+// to one of several cache line sized shards, and a read sums all of them,
+// so the total is only exact once the writers have stopped.
+typedef struct sync_counter {
+    struct {
+        int64_t value;
+    } __ALIGNED(64) shards[SYNC_COUNTER_SHARDS];
+} sync_counter_t;
+
+void sync_counter_add(sync_counter_t* counter, int64_t delta);
+int64_t sync_counter_read(const sync_counter_t* counter);
+
+__END_CDECLS;
@@ -0,0 +1,41 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sync/futex.h>
+#include <zircon/compiler.h>
+#include <zircon/types.h>
+
+__BEGIN_CDECLS;
+
+// An adaptive mutex. The futex word holds the owning thread's handle, so the
+// owner of a held mutex can be found without any extra state. A contended
+// lock spins for a short while before it waits in the kernel.
+typedef struct __TA_CAPABILITY("mutex") sync_mutex {
+    futex_t futex;
+
+#ifdef __cplusplus
+    sync_mutex() : futex(0) {}
+#endif
+} sync_mutex_t;
+
+#if !defined(__cplusplus)
+#define SYNC_MUTEX_INIT ((sync_mutex_t){0})
+#endif
+
+void sync_mutex_lock(sync_mutex_t* mutex) __TA_ACQUIRE(mutex);
+
+// Returns ZX_OK if the mutex was acquired, and ZX_ERR_BAD_STATE if it was
+// already held.
+zx_status_t sync_mutex_trylock(sync_mutex_t* mutex) __TA_TRY_ACQUIRE(0, mutex);
+
+// Must be called by the owner.
+void sync_mutex_unlock(sync_mutex_t* mutex) __TA_RELEASE(mutex);
+
+// Returns the handle of the thread holding the mutex, or ZX_HANDLE_INVALID
+// if it is not held. Only meaningful inside the owner's process.
+zx_handle_t sync_mutex_owner(const sync_mutex_t* mutex);
+
+__END_CDECLS;
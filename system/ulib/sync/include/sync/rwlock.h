@@ -0,0 +1,33 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <sync/futex.h>
+#include <zircon/compiler.h>
+#include <zircon/types.h>
+
+__BEGIN_CDECLS;
+
+// A futex based reader-writer lock. Once a writer is waiting, new readers
+// wait behind it, so a steady stream of readers can't starve writers.
+typedef struct __TA_CAPABILITY("mutex") sync_rwlock {
+    futex_t futex;
+
+#ifdef __cplusplus
+    sync_rwlock() : futex(0) {}
+#endif
+} sync_rwlock_t;
+
+#if !defined(__cplusplus)
+#define SYNC_RWLOCK_INIT ((sync_rwlock_t){0})
+#endif
+
+void sync_rwlock_read_lock(sync_rwlock_t* rwlock) __TA_ACQUIRE_SHARED(rwlock);
+void sync_rwlock_read_unlock(sync_rwlock_t* rwlock) __TA_RELEASE_SHARED(rwlock);
+
+void sync_rwlock_write_lock(sync_rwlock_t* rwlock) __TA_ACQUIRE(rwlock);
+void sync_rwlock_write_unlock(sync_rwlock_t* rwlock) __TA_RELEASE(rwlock);
+
+__END_CDECLS;
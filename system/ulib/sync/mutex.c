@@ -0,0 +1,102 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sync/mutex.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <zircon/process.h>
+#include <zircon/syscalls.h>
+
+// The futex word is 0 when the mutex is free, and otherwise holds the owner's
+// thread handle. Handle values never have the top bit set, so that bit marks
+// a mutex that threads may be waiting on.
+#define CONTESTED ((int)0x80000000)
+
+// How many times a contended lock polls the mutex before waiting in the
+// kernel. Only worth doing with another cpu around to release it.
+#define SPIN_ITERATIONS 100
+
+static inline void spin_pause(void) {
+#if defined(__x86_64__)
+    __asm__ volatile("pause" ::: "memory");
+#elif defined(__aarch64__)
+    __asm__ volatile("yield" ::: "memory");
+#endif
+}
+
+static bool spin_worthwhile(void) {
+    static atomic_int cpus;
+    int n = atomic_load_explicit(&cpus, memory_order_relaxed);
+    if (n == 0) {
+        n = (int)zx_system_get_num_cpus();
+        atomic_store_explicit(&cpus, n, memory_order_relaxed);
+    }
+    return n > 1;
+}
+
+zx_status_t sync_mutex_trylock(sync_mutex_t* mutex) __TA_NO_THREAD_SAFETY_ANALYSIS {
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&mutex->futex.futex, &expected, (int)zx_thread_self()))
+        return ZX_OK;
+    return ZX_ERR_BAD_STATE;
+}
+
+void sync_mutex_lock(sync_mutex_t* mutex) __TA_NO_THREAD_SAFETY_ANALYSIS {
+    atomic_int* futex = &mutex->futex.futex;
+    const int self = (int)zx_thread_self();
+
+    int value = 0;
+    if (atomic_compare_exchange_strong(futex, &value, self))
+        return;
+
+    // Spin while the owner looks busy. Once someone is waiting, the owner
+    // has been holding it long enough that spinning is unlikely to pay off.
+    if (spin_worthwhile()) {
+        for (int i = 0; i < SPIN_ITERATIONS && !(value & CONTESTED); i++) {
+            spin_pause();
+            value = atomic_load_explicit(futex, memory_order_relaxed);
+            if (value == 0 && atomic_compare_exchange_strong(futex, &value, self))
+                return;
+        }
+    }
+
+    for (;;) {
+        value = atomic_load(futex);
+        if (value == 0) {
+            // We don't know whether anyone else is still waiting, so keep
+            // the contested bit and let the unlock wake them.
+            if (atomic_compare_exchange_strong(futex, &value, self | CONTESTED))
+                return;
+            continue;
+        }
+        if (!(value & CONTESTED)) {
+            if (!atomic_compare_exchange_strong(futex, &value, value | CONTESTED))
+                continue;
+            value |= CONTESTED;
+        }
+        switch (zx_futex_wait(futex, value, ZX_TIME_INFINITE)) {
+        case ZX_OK:
+        case ZX_ERR_BAD_STATE:
+            break;
+        default:
+            __builtin_trap();
+        }
+    }
+}
+
+void sync_mutex_unlock(sync_mutex_t* mutex) __TA_NO_THREAD_SAFETY_ANALYSIS {
+    atomic_int* futex = &mutex->futex.futex;
+
+    int value = atomic_exchange(futex, 0);
+    if ((value & ~CONTESTED) != (int)zx_thread_self())
+        __builtin_trap();
+    if (value & CONTESTED)
+        zx_futex_wake(futex, 1);
+}
+
+zx_handle_t sync_mutex_owner(const sync_mutex_t* mutex) {
+    int value = atomic_load_explicit((atomic_int*)&mutex->futex.futex, memory_order_relaxed);
+    return (zx_handle_t)(value & ~CONTESTED);
+}
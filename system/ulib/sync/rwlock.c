@@ -0,0 +1,100 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <sync/rwlock.h>
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <zircon/syscalls.h>
+
+// The low bits of the futex word count the readers holding the lock.
+#define WRITER ((int)0x40000000)
+#define WAITERS ((int)0x80000000)
+#define READERS_MASK (WRITER - 1)
+
+// Sleeps until the word is no longer |value|, after making sure the thread
+// releasing the lock will know to wake us. Returns false if the word changed
+// before the waiters bit could be set.
+static bool wait_for_change(atomic_int* futex, int value) {
+    if (!(value & WAITERS)) {
+        if (!atomic_compare_exchange_strong(futex, &value, value | WAITERS))
+            return false;
+        value |= WAITERS;
+    }
+    switch (zx_futex_wait(futex, value, ZX_TIME_INFINITE)) {
+    case ZX_OK:
+    case ZX_ERR_BAD_STATE:
+        return true;
+    default:
+        __builtin_trap();
+    }
+}
+
+void sync_rwlock_read_lock(sync_rwlock_t* rwlock) {
+    atomic_int* futex = &rwlock->futex.futex;
+
+    for (;;) {
+        int value = atomic_load(futex);
+        // Readers queue up behind waiting writers (and behind readers that
+        // are waiting out a writer, which is harmless).
+        if (!(value & (WRITER | WAITERS))) {
+            if ((value & READERS_MASK) == READERS_MASK)
+                __builtin_trap();
+            if (atomic_compare_exchange_weak(futex, &value, value + 1))
+                return;
+            continue;
+        }
+        wait_for_change(futex, value);
+    }
+}
+
+void sync_rwlock_read_unlock(sync_rwlock_t* rwlock) {
+    atomic_int* futex = &rwlock->futex.futex;
+
+    int value = atomic_fetch_sub(futex, 1) - 1;
+    if ((value & READERS_MASK) != 0 || !(value & WAITERS))
+        return;
+
+    // Last reader out with someone waiting. Nobody can take the lock while
+    // the waiters bit is set, so this only fails if the word is changing
+    // under a waiter that hasn't gone to sleep yet.
+    while (value == WAITERS) {
+        if (atomic_compare_exchange_strong(futex, &value, 0)) {
+            zx_futex_wake(futex, UINT32_MAX);
+            return;
+        }
+    }
+}
+
+void sync_rwlock_write_lock(sync_rwlock_t* rwlock) __TA_NO_THREAD_SAFETY_ANALYSIS {
+    atomic_int* futex = &rwlock->futex.futex;
+
+    int value = 0;
+    if (atomic_compare_exchange_strong(futex, &value, WRITER))
+        return;
+
+    bool waited = false;
+    for (;;) {
+        value = atomic_load(futex);
+        if (value == 0) {
+            // Others may have been woken along with us, keep the waiters bit
+            // so that they get woken again when we are done.
+            if (atomic_compare_exchange_strong(futex, &value, waited ? WRITER | WAITERS : WRITER))
+                return;
+            continue;
+        }
+        waited |= wait_for_change(futex, value);
+    }
+}
+
+void sync_rwlock_write_unlock(sync_rwlock_t* rwlock) __TA_NO_THREAD_SAFETY_ANALYSIS {
+    atomic_int* futex = &rwlock->futex.futex;
+
+    int value = atomic_exchange(futex, 0);
+    if (!(value & WRITER))
+        __builtin_trap();
+    if (value & WAITERS)
+        zx_futex_wake(futex, UINT32_MAX);
+}
@@ -4,11 +4,14 @@
 
 #include "context_impl.h"
 
+#include <string.h>
+
 #include <zircon/compiler.h>
 #include <zircon/syscalls.h>
 
 #include <fbl/algorithm.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/unique_ptr.h>
 #include <zx/process.h>
@@ -103,6 +106,9 @@ struct ContextCache {
     // Thread reference created when this thread was registered.
     trace_thread_ref_t thread_ref{};
 
+    // The chunk of the buffer which this thread is writing into.
+    trace_context::Chunk chunk{nullptr, nullptr, trace_context::kNoChunk, 0u, {false, false}};
+
     // Maximum number of strings to cache per thread.
     static constexpr size_t kMaxStringEntries = 256;
 
@@ -129,10 +135,19 @@ ContextCache* GetCurrentContextCache(uint32_t generation) {
     }
     cache->generation = generation;
     cache->thread_ref = trace_make_unknown_thread_ref();
+    cache->chunk = {nullptr, nullptr, trace_context::kNoChunk, 0u, {false, false}};
     cache->string_table.clear();
     return cache;
 }
 
+// Like |GetCurrentContextCache()|, but never creates or resets the cache.
+ContextCache* PeekCurrentContextCache(uint32_t generation) {
+    ContextCache* cache = tls_cache.get();
+    if (likely(cache && cache->generation == generation))
+        return cache;
+    return nullptr;
+}
+
 StringEntry* CacheStringEntry(uint32_t generation,
                               const char* string_literal) {
     ContextCache* cache = GetCurrentContextCache(generation);
@@ -167,6 +182,19 @@ inline constexpr uint64_t MakeArgumentHeader(ArgumentType type, size_t size,
            ArgumentFields::NameRef::Make(name_ref->encoded_value);
 }
 
+// Covers the bytes from |ptr| up to |end| with a padding record, so readers
+// skip over whatever they hold.
+inline void WritePadding(uint8_t* ptr, uint8_t* end) {
+    size_t size = end - ptr;
+    ZX_DEBUG_ASSERT(size <= RecordFields::kMaxRecordSizeBytes);
+    if (size) {
+        *reinterpret_cast<uint64_t*>(ptr) =
+            MakeRecordHeader(RecordType::kMetadata, size) |
+            MetadataRecordFields::MetadataType::Make(
+                ToUnderlyingType(MetadataType::kPadding));
+    }
+}
+
 size_t SizeOfEncodedStringRef(const trace_string_ref_t* string_ref) {
     return trace_is_inline_string_ref(string_ref)
                ? Pad(trace_inline_string_ref_length(string_ref))
@@ -918,14 +946,47 @@ void* trace_context_alloc_record(trace_context_t* context, size_t num_bytes) {
 /* struct trace_context */
 
 trace_context::trace_context(void* buffer, size_t buffer_num_bytes,
+                             trace_buffering_mode_t buffering_mode,
                              trace_handler_t* handler)
     : generation_(trace::g_next_generation.fetch_add(1u, fbl::memory_order_relaxed) + 1u),
       buffer_start_(static_cast<uint8_t*>(buffer)),
       buffer_end_(buffer_start_ + buffer_num_bytes),
+      buffering_mode_(buffering_mode),
       buffer_current_(reinterpret_cast<uintptr_t>(buffer_start_)),
       buffer_full_mark_(0u),
+      num_chunks_(buffer_num_bytes / kChunkSize),
+      header_(buffering_mode == TRACE_BUFFERING_MODE_STREAMING
+                  ? static_cast<trace_buffer_header_t*>(buffer)
+                  : nullptr),
       handler_(handler) {
     ZX_DEBUG_ASSERT(generation_ != 0u);
+    if (buffering_mode_ == TRACE_BUFFERING_MODE_CIRCULAR) {
+        ZX_DEBUG_ASSERT(num_chunks_ >= 2u);
+        chunk_owned_.reset(new fbl::atomic<bool>[num_chunks_]());
+    }
+
+    streaming_buffers_[0] = streaming_buffers_[1] = nullptr;
+    streaming_buffer_size_ = 0u;
+    if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING) {
+        uint8_t* data = buffer_start_ + sizeof(trace_buffer_header_t);
+        streaming_buffer_size_ = ((buffer_end_ - data) / 2u) & ~static_cast<size_t>(7u);
+        ZX_DEBUG_ASSERT(streaming_buffer_size_ >= kChunkSize);
+        streaming_buffers_[0] = data;
+        streaming_buffers_[1] = data + streaming_buffer_size_;
+
+        memset(header_, 0, sizeof(*header_));
+        header_->magic = TRACE_BUFFER_HEADER_MAGIC;
+        header_->version = TRACE_BUFFER_HEADER_V0;
+        header_->buffering_mode = buffering_mode_;
+        header_->total_size = buffer_num_bytes;
+        header_->buffer_size = streaming_buffer_size_;
+    }
+    for (uint32_t i = 0u; i < 2u; i++) {
+        streaming_current_[i].store(reinterpret_cast<uintptr_t>(streaming_buffers_[i]),
+                                    fbl::memory_order_relaxed);
+        streaming_state_[i].store(i == 0u ? kWriting : kEmpty, fbl::memory_order_relaxed);
+        streaming_writers_[i].store(0u, fbl::memory_order_relaxed);
+    }
 }
 
 trace_context::~trace_context() = default;
@@ -935,34 +996,253 @@ uint64_t* trace_context::AllocRecord(size_t num_bytes) {
     if (unlikely(num_bytes > TRACE_ENCODED_RECORD_MAX_LENGTH))
         return nullptr;
 
+    // A thread which still holds a reference to an older context has moved
+    // on to a newer one since, so it has no chunk here.  Its record is
+    // dropped: writing it outside of a chunk would break up the chunks
+    // which follow, which readers rely on being whole.
+    trace::ContextCache* cache = trace::GetCurrentContextCache(generation_);
+    if (unlikely(!cache)) {
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING)
+            num_records_dropped_.fetch_add(1u, fbl::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Chunk* chunk = &cache->chunk;
+    if (unlikely(buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING))
+        return AllocStreamingRecord(chunk, num_bytes);
+
+    if (unlikely(!chunk->current ||
+                 static_cast<size_t>(chunk->end - chunk->current) < num_bytes)) {
+        if (!AllocChunk(chunk, num_bytes))
+            return nullptr;
+    }
+
+    uint8_t* ptr = chunk->current;
+    chunk->current += num_bytes;
+    trace::WritePadding(chunk->current, chunk->end);
+    return reinterpret_cast<uint64_t*>(ptr);
+}
+
+bool trace_context::AllocChunk(Chunk* chunk, size_t num_bytes) {
+    if (buffering_mode_ == TRACE_BUFFERING_MODE_CIRCULAR)
+        return AllocCircularChunk(chunk);
+
     uint8_t* ptr = reinterpret_cast<uint8_t*>(
-        buffer_current_.fetch_add(num_bytes,
-                                  fbl::memory_order_relaxed));
+        buffer_current_.fetch_add(kChunkSize, fbl::memory_order_relaxed));
     if (likely(ptr + num_bytes <= buffer_end_)) {
         ZX_DEBUG_ASSERT(ptr + num_bytes >= buffer_start_);
-        return reinterpret_cast<uint64_t*>(ptr); // success!
+        // The last chunk may be cut short by the end of the buffer.
+        chunk->current = ptr;
+        chunk->end = ptr + kChunkSize <= buffer_end_ ? ptr + kChunkSize : buffer_end_;
+        return true;
+    }
+
+    MarkBufferFull(ptr);
+    return false;
+}
+
+bool trace_context::AllocCircularChunk(Chunk* chunk) {
+    if (chunk->index != kNoChunk)
+        chunk_owned_[chunk->index].store(false, fbl::memory_order_release);
+    chunk->current = chunk->end = nullptr;
+    chunk->index = kNoChunk;
+
+    // Take the chunks in turn, skipping those which other threads are still
+    // writing into.  If every chunk is busy, the record is dropped.
+    for (size_t attempt = 0u; attempt < num_chunks_; attempt++) {
+        size_t count = next_chunk_.fetch_add(1u, fbl::memory_order_relaxed);
+        size_t index = count == 0u ? 0u : 1u + (count - 1u) % (num_chunks_ - 1u);
+        bool expected = false;
+        if (chunk_owned_[index].compare_exchange_strong(&expected, true,
+                                                        fbl::memory_order_acquire,
+                                                        fbl::memory_order_relaxed)) {
+            chunk->current = buffer_start_ + index * kChunkSize;
+            chunk->end = chunk->current + kChunkSize;
+            chunk->index = index;
+            return true;
+        }
     }
+    return false;
+}
+
+// In streaming mode, a thread which allocates a record in one of the buffers
+// is counted as writing into it until it releases its context reference, and
+// a full buffer is only handed off once no thread is writing into it.  The
+// counters and |wrapped_count_| are sequentially consistent so that a thread
+// either sees that writing has moved on to the other buffer, or is seen to be
+// writing by whoever moved it on.
+uint64_t* trace_context::AllocStreamingRecord(Chunk* chunk, size_t num_bytes) {
+    uint64_t wrapped_count = wrapped_count_.load(fbl::memory_order_seq_cst);
+    for (;;) {
+        uint32_t index = wrapped_count & 1u;
+        if (unlikely(!chunk->writing[index])) {
+            chunk->writing[index] = true;
+            streaming_writers_[index].fetch_add(1u, fbl::memory_order_seq_cst);
+            uint64_t latest = wrapped_count_.load(fbl::memory_order_seq_cst);
+            if (unlikely(latest != wrapped_count)) {
+                wrapped_count = latest;
+                continue;
+            }
+        }
+
+        // Leave behind any chunk in a buffer which has since filled up.
+        if (unlikely(chunk->wrapped_count != wrapped_count)) {
+            chunk->current = chunk->end = nullptr;
+            chunk->wrapped_count = wrapped_count;
+        }
+
+        if (unlikely(!chunk->current ||
+                     static_cast<size_t>(chunk->end - chunk->current) < num_bytes)) {
+            if (streaming_stalled_.load(fbl::memory_order_relaxed))
+                break;
+
+            uint8_t* ptr = reinterpret_cast<uint8_t*>(
+                streaming_current_[index].fetch_add(kChunkSize, fbl::memory_order_relaxed));
+            uint8_t* end = streaming_buffers_[index] + streaming_buffer_size_;
+            if (unlikely(ptr + num_bytes > end)) {
+                // Only the first chunk to go past the end sees space left over.
+                if (ptr < end)
+                    trace::WritePadding(ptr, end);
+                if (!SwitchStreamingBuffers(wrapped_count))
+                    break;
+                wrapped_count = wrapped_count_.load(fbl::memory_order_seq_cst);
+                continue;
+            }
+            chunk->current = ptr;
+            chunk->end = ptr + kChunkSize <= end ? ptr + kChunkSize : end;
+        }
 
+        uint8_t* ptr = chunk->current;
+        chunk->current += num_bytes;
+        trace::WritePadding(chunk->current, chunk->end);
+        return reinterpret_cast<uint64_t*>(ptr);
+    }
+
+    num_records_dropped_.fetch_add(1u, fbl::memory_order_relaxed);
+    return nullptr;
+}
+
+// Returns false if writing cannot move on because the other buffer is still
+// being saved.
+bool trace_context::SwitchStreamingBuffers(uint64_t wrapped_count) {
+    uint32_t full = wrapped_count & 1u;
+    uint32_t next = full ^ 1u;
+    bool overflow = false;
+    {
+        fbl::AutoLock lock(&streaming_mutex_);
+        if (wrapped_count_.load(fbl::memory_order_relaxed) != wrapped_count)
+            return true; // another thread got here first
+
+        if (streaming_state_[next].load(fbl::memory_order_relaxed) != kEmpty) {
+            overflow = !streaming_stalled_.exchange(true, fbl::memory_order_relaxed);
+        } else {
+            streaming_current_[next].store(reinterpret_cast<uintptr_t>(streaming_buffers_[next]),
+                                           fbl::memory_order_relaxed);
+            streaming_state_[next].store(kWriting, fbl::memory_order_relaxed);
+            streaming_state_[full].store(kFull, fbl::memory_order_seq_cst);
+            wrapped_count_.store(wrapped_count + 1u, fbl::memory_order_seq_cst);
+        }
+    }
+
+    if (streaming_stalled_.load(fbl::memory_order_relaxed)) {
+        if (overflow) {
+            num_stalls_.fetch_add(1u, fbl::memory_order_relaxed);
+            handler_->ops->buffer_overflow(handler_);
+        }
+        return false;
+    }
+    NotifyBufferFullIfDone(full);
+    return true;
+}
+
+void trace_context::NotifyBufferFullIfDone(uint32_t index) {
+    if (streaming_writers_[index].load(fbl::memory_order_seq_cst) != 0u)
+        return;
+    int expected = kFull;
+    if (!streaming_state_[index].compare_exchange_strong(&expected, kSaving,
+                                                         fbl::memory_order_seq_cst,
+                                                         fbl::memory_order_seq_cst))
+        return;
+
+    // Writing can't move on again until this buffer has been saved, so it is
+    // the one before the current one.
+    uint64_t wrapped_count = wrapped_count_.load(fbl::memory_order_relaxed) - 1u;
+    header_->wrapped_count = wrapped_count + 1u;
+    header_->full_wrapped_count = wrapped_count;
+    header_->num_stalls = num_stalls_.load(fbl::memory_order_relaxed);
+    header_->num_records_dropped = num_records_dropped_.load(fbl::memory_order_relaxed);
+    handler_->ops->notify_buffer_full(handler_, wrapped_count);
+}
+
+void trace_context::ReleaseStreamingWrites() {
+    trace::ContextCache* cache = trace::PeekCurrentContextCache(generation_);
+    if (!cache)
+        return;
+
+    for (uint32_t i = 0u; i < 2u; i++) {
+        if (!cache->chunk.writing[i])
+            continue;
+        cache->chunk.writing[i] = false;
+        if (streaming_writers_[i].fetch_sub(1u, fbl::memory_order_seq_cst) == 1u &&
+            streaming_state_[i].load(fbl::memory_order_seq_cst) == kFull)
+            NotifyBufferFullIfDone(i);
+    }
+}
+
+zx_status_t trace_context::MarkBufferSaved() {
+    fbl::AutoLock lock(&streaming_mutex_);
+    uint32_t index = (wrapped_count_.load(fbl::memory_order_relaxed) - 1u) & 1u;
+    if (streaming_state_[index].load(fbl::memory_order_relaxed) != kSaving)
+        return ZX_ERR_BAD_STATE;
+
+    streaming_state_[index].store(kEmpty, fbl::memory_order_relaxed);
+    streaming_stalled_.store(false, fbl::memory_order_relaxed);
+    return ZX_OK;
+}
+
+void trace_context::FinishStreaming() {
+    fbl::AutoLock lock(&streaming_mutex_);
+    uint64_t wrapped_count = wrapped_count_.load(fbl::memory_order_relaxed);
+    uint32_t index = wrapped_count & 1u;
+    uintptr_t start = reinterpret_cast<uintptr_t>(streaming_buffers_[index]);
+    uintptr_t current = fbl::min(streaming_current_[index].load(fbl::memory_order_relaxed),
+                                 start + streaming_buffer_size_);
+    header_->wrapped_count = wrapped_count;
+    header_->current_buffer_data_end = current - start;
+    header_->num_stalls = num_stalls_.load(fbl::memory_order_relaxed);
+    header_->num_records_dropped = num_records_dropped_.load(fbl::memory_order_relaxed);
+}
+
+void trace_context::MarkBufferFull(uint8_t* ptr) {
     // Buffer is full!
     // Snap to the endpoint to reduce likelihood of pointer wrap-around.
     buffer_current_.store(reinterpret_cast<uintptr_t>(buffer_end_),
                           fbl::memory_order_relaxed);
 
+    // Whatever space was left over is too small to be of use, but it is
+    // still read back, so pad it out.  Only the first allocation to fail
+    // can see space left over.
+    if (ptr < buffer_end_)
+        trace::WritePadding(ptr, buffer_end_);
+
     // Mark the end point if not already marked.
     uintptr_t expected_mark = 0u;
     if (buffer_full_mark_.compare_exchange_strong(&expected_mark,
-                                                  reinterpret_cast<uintptr_t>(ptr),
+                                                  reinterpret_cast<uintptr_t>(buffer_end_),
                                                   fbl::memory_order_relaxed,
                                                   fbl::memory_order_relaxed)) {
         // Notify the trace manager so it can notify the user that a record
         // (likely) got dropped.
         handler_->ops->buffer_overflow(handler_);
     }
-
-    return nullptr;
 }
 
 bool trace_context::AllocThreadIndex(trace_thread_index_t* out_index) {
+    // Thread records would eventually be overwritten in circular mode, and
+    // could be dropped in streaming mode.
+    if (buffering_mode_ != TRACE_BUFFERING_MODE_ONESHOT)
+        return false;
+
     trace_thread_index_t index = next_thread_index_.fetch_add(1u, fbl::memory_order_relaxed);
     if (unlikely(index > TRACE_ENCODED_THREAD_REF_MAX_INDEX)) {
         // Guard again possible wrapping.
@@ -975,6 +1255,11 @@ bool trace_context::AllocThreadIndex(trace_thread_index_t* out_index) {
 }
 
 bool trace_context::AllocStringIndex(trace_string_index_t* out_index) {
+    // String records would eventually be overwritten in circular mode, and
+    // could be dropped in streaming mode.
+    if (buffering_mode_ != TRACE_BUFFERING_MODE_ONESHOT)
+        return false;
+
     trace_string_index_t index = next_string_index_.fetch_add(1u, fbl::memory_order_relaxed);
     if (unlikely(index > TRACE_ENCODED_STRING_REF_MAX_INDEX)) {
         // Guard again possible wrapping.
@@ -6,8 +6,12 @@
 
 #include <zircon/assert.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/atomic.h>
+#include <fbl/mutex.h>
+#include <fbl/unique_ptr.h>
 
+#include <trace-engine/buffer.h>
 #include <trace-engine/context.h>
 #include <trace-engine/handler.h>
 
@@ -15,8 +19,36 @@
 // This structure is accessed concurrently from many threads which hold trace
 // context references.
 // Implements the opaque type declared in <trace-engine/context.h>.
+//
+// The buffer is handed out to threads in chunks of |kChunkSize| bytes, which
+// each thread then fills on its own, so that writers on different threads
+// don't contend for the allocation pointer.  The unused tail of each chunk
+// is always covered by a padding record, so the buffer can be read as one
+// stream of records whatever state the chunks are in.
 struct trace_context {
-    trace_context(void* buffer, size_t buffer_num_bytes, trace_handler_t* handler);
+    // The size of the chunks claimed by each thread.
+    // Large enough that any record fits into an empty chunk, and small enough
+    // that the padding after the first record always fits in one record.
+    static constexpr size_t kChunkSize = TRACE_BUFFER_CHUNK_SIZE;
+
+    // The chunk a thread is writing into.
+    struct Chunk {
+        // The next record goes here: before |end|, or at it when the chunk
+        // is full or none has been claimed yet.
+        uint8_t* current;
+        uint8_t* end;
+        // The chunk's position in the buffer, or |kNoChunk|.
+        size_t index;
+        // Streaming mode only: the number of the buffer the chunk is in, and
+        // whether the thread is counted as writing into each of the two
+        // buffers, which it is until it releases its context reference.
+        uint64_t wrapped_count;
+        bool writing[2];
+    };
+    static constexpr size_t kNoChunk = SIZE_MAX;
+
+    trace_context(void* buffer, size_t buffer_num_bytes,
+                  trace_buffering_mode_t buffering_mode, trace_handler_t* handler);
 
     ~trace_context();
 
@@ -24,14 +56,26 @@ struct trace_context {
 
     trace_handler_t* handler() const { return handler_; }
 
+    trace_buffering_mode_t buffering_mode() const { return buffering_mode_; }
+
     bool is_buffer_full() const {
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING)
+            return num_records_dropped_.load(fbl::memory_order_relaxed) != 0u;
         return buffer_full_mark_.load(fbl::memory_order_relaxed) != 0u;
     }
 
     size_t bytes_allocated() const {
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING)
+            return header_->current_buffer_data_end;
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_CIRCULAR) {
+            size_t chunks = fbl::min(next_chunk_.load(fbl::memory_order_relaxed),
+                                     num_chunks_);
+            return chunks * kChunkSize;
+        }
         uintptr_t tail = buffer_full_mark_.load(fbl::memory_order_relaxed);
         if (!tail)
-            tail = buffer_current_.load(fbl::memory_order_relaxed);
+            tail = fbl::min(buffer_current_.load(fbl::memory_order_relaxed),
+                            reinterpret_cast<uintptr_t>(buffer_end_));
         return reinterpret_cast<uint8_t*>(tail) - buffer_start_;
     }
 
@@ -39,7 +83,32 @@ struct trace_context {
     bool AllocThreadIndex(trace_thread_index_t* out_index);
     bool AllocStringIndex(trace_string_index_t* out_index);
 
+    // Streaming mode only.
+    // Called as the thread releases a context reference, once the records it
+    // has allocated are written.
+    void ReleaseStreamingWrites();
+    zx_status_t MarkBufferSaved();
+    // Records the final state of the buffers in the header.
+    void FinishStreaming();
+
 private:
+    // The states of each of the two buffers in streaming mode.
+    enum StreamingState : int {
+        kEmpty,
+        kWriting,
+        // Full, but some threads may still be writing records into it.
+        kFull,
+        // Handed off to be saved.
+        kSaving,
+    };
+
+    bool AllocChunk(Chunk* chunk, size_t num_bytes);
+    bool AllocCircularChunk(Chunk* chunk);
+    uint64_t* AllocStreamingRecord(Chunk* chunk, size_t num_bytes);
+    bool SwitchStreamingBuffers(uint64_t wrapped_count);
+    void NotifyBufferFullIfDone(uint32_t index);
+    void MarkBufferFull(uint8_t* ptr);
+
     // The generation counter associated with this context to distinguish
     // it from previously created contexts.
     uint32_t const generation_;
@@ -48,15 +117,62 @@ private:
     uint8_t* const buffer_start_;
     uint8_t* const buffer_end_;
 
-    // Current allocation pointer.
+    // How the buffer is filled.
+    trace_buffering_mode_t const buffering_mode_;
+
+    // Current allocation pointer, for chunks and for records which are not
+    // written into a chunk.
     // Starts at |buffer_start| and grows from there.
     // May exceed |buffer_end| when the buffer is full.
+    // Only used in oneshot mode.
     fbl::atomic<uintptr_t> buffer_current_;
 
     // Pointer beyond the last successful allocation, or null if not full.
     // Only ever set to non-null once in the lifetime of the trace context.
+    // Only used in oneshot mode.
     fbl::atomic<uintptr_t> buffer_full_mark_;
 
+    // The number of whole chunks in the buffer.
+    size_t const num_chunks_;
+
+    // The number of chunks claimed so far, which picks the next chunk to
+    // claim.  The first chunk, which holds the initialization record, is
+    // never claimed again; the others are reused in turn.
+    // Only used in circular mode.
+    fbl::atomic<size_t> next_chunk_{0u};
+
+    // Whether each chunk is being written to by a thread, which keeps it
+    // from being reused until that thread moves on.
+    // Only used in circular mode.
+    fbl::unique_ptr<fbl::atomic<bool>[]> chunk_owned_;
+
+    // The header at the start of the buffer, and the two buffers which
+    // follow it.
+    // Only used in streaming mode.
+    trace_buffer_header_t* const header_;
+    uint8_t* streaming_buffers_[2];
+    size_t streaming_buffer_size_;
+
+    // The number of times writing has moved on to the other buffer.
+    // Only used in streaming mode.
+    fbl::atomic<uint64_t> wrapped_count_{0u};
+
+    // The allocation pointer, state and number of writing threads of each
+    // of the two buffers.
+    // Only used in streaming mode.
+    fbl::atomic<uintptr_t> streaming_current_[2];
+    fbl::atomic<int> streaming_state_[2];
+    fbl::atomic<uint32_t> streaming_writers_[2];
+
+    // Set while both buffers are full, until the one being saved is saved.
+    // Only used in streaming mode.
+    fbl::atomic<bool> streaming_stalled_{false};
+    fbl::atomic<uint64_t> num_stalls_{0u};
+    fbl::atomic<uint64_t> num_records_dropped_{0u};
+
+    // Serializes moving between the buffers and saving them.
+    fbl::Mutex streaming_mutex_;
+
     // Handler associated with the trace session.
     trace_handler_t* const handler_;
 
@@ -132,10 +132,35 @@ zx_status_t trace_start_engine(async_t* async,
                                trace_handler_t* handler,
                                void* buffer,
                                size_t buffer_num_bytes) {
+    return trace_start_engine_etc(async, handler, buffer, buffer_num_bytes,
+                                  TRACE_BUFFERING_MODE_ONESHOT);
+}
+
+// thread-safe
+zx_status_t trace_start_engine_etc(async_t* async,
+                                   trace_handler_t* handler,
+                                   void* buffer,
+                                   size_t buffer_num_bytes,
+                                   trace_buffering_mode_t buffering_mode) {
     ZX_DEBUG_ASSERT(async);
     ZX_DEBUG_ASSERT(handler);
     ZX_DEBUG_ASSERT(buffer);
 
+    switch (buffering_mode) {
+    case TRACE_BUFFERING_MODE_ONESHOT:
+        break;
+    case TRACE_BUFFERING_MODE_CIRCULAR:
+        if (buffer_num_bytes < 2u * trace_context::kChunkSize)
+            return ZX_ERR_INVALID_ARGS;
+        break;
+    case TRACE_BUFFERING_MODE_STREAMING:
+        if (buffer_num_bytes < sizeof(trace_buffer_header_t) + 2u * trace_context::kChunkSize)
+            return ZX_ERR_INVALID_ARGS;
+        break;
+    default:
+        return ZX_ERR_INVALID_ARGS;
+    }
+
     fbl::AutoLock lock(&g_engine_mutex);
 
     // We must have fully stopped a prior tracing session before starting a new one.
@@ -166,12 +191,14 @@ zx_status_t trace_start_engine(async_t* async,
     g_async = async;
     g_handler = handler;
     g_disposition = ZX_OK;
-    g_context = new trace_context(buffer, buffer_num_bytes, handler);
+    g_context = new trace_context(buffer, buffer_num_bytes, buffering_mode, handler);
     g_event = fbl::move(event);
 
     // Write the trace initialization record first before allowing clients to
     // get in and write their own trace records.
     trace_context_write_initialization_record(g_context, zx_ticks_per_second());
+    if (buffering_mode == TRACE_BUFFERING_MODE_STREAMING)
+        g_context->ReleaseStreamingWrites();
 
     // After this point clients can acquire references to the trace context.
     g_context_refs.store(1u, fbl::memory_order_release);
@@ -282,6 +309,8 @@ void handle_context_released(async_t* async) {
         ZX_DEBUG_ASSERT(g_context != nullptr);
 
         // Get final disposition.
+        if (g_context->buffering_mode() == TRACE_BUFFERING_MODE_STREAMING)
+            g_context->FinishStreaming();
         if (g_context->is_buffer_full())
             update_disposition_locked(ZX_ERR_NO_MEMORY);
         disposition = g_disposition;
@@ -344,6 +373,17 @@ async_wait_result_t handle_event(async_t* async, async_wait_t* wait,
 
 } // namespace
 
+// thread-safe
+zx_status_t trace_engine_mark_buffer_saved() {
+    fbl::AutoLock lock(&g_engine_mutex);
+
+    if (g_state.load(fbl::memory_order_relaxed) == TRACE_STOPPED ||
+        g_context->buffering_mode() != TRACE_BUFFERING_MODE_STREAMING)
+        return ZX_ERR_BAD_STATE;
+
+    return g_context->MarkBufferSaved();
+}
+
 /*** Trace instrumentation functions ***/
 
 // thread-safe, lock-free
@@ -406,6 +446,10 @@ void trace_release_context(trace_context_t* context) {
     ZX_DEBUG_ASSERT(context == g_context);
     ZX_DEBUG_ASSERT(g_context_refs.load(fbl::memory_order_relaxed) != 0u);
 
+    // Let the buffers the records were written into be handed off.
+    if (unlikely(context->buffering_mode() == TRACE_BUFFERING_MODE_STREAMING))
+        context->ReleaseStreamingWrites();
+
     // Note the RELEASE fence here since the trace context and trace buffer
     // contents may have changes from the perspective of other threads.
     if (unlikely(g_context_refs.fetch_sub(1u, fbl::memory_order_release) == 1u)) {
@@ -0,0 +1,95 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+//
+// The layout of a trace buffer in streaming mode, shared by the trace engine
+// and whoever collects the buffer's contents while the trace is running.
+//
+// In streaming mode the buffer begins with a |trace_buffer_header_t|, which is
+// followed by two buffers of |buffer_size| bytes each.  The trace engine
+// writes records into one of them until it is full, then hands it off to be
+// saved and carries on writing into the other one.  Each buffer holds a
+// stream of records; saving them in order of |wrapped_count| gives the whole
+// trace.
+//
+// The handoff works like this:
+//
+// 1. When a buffer is full and all of the records being written into it are
+//    complete, the trace engine sets |full_wrapped_count| to the number of
+//    the buffer and invokes the handler's |notify_buffer_full()| method.
+//    Even numbers are the first buffer, odd numbers the second.
+// 2. The collector copies out all |buffer_size| bytes of that buffer, or
+//    swaps in fresh pages for it, then the handler calls
+//    |trace_engine_mark_buffer_saved()|.
+// 3. Meanwhile, the trace engine writes into the other buffer.  If that one
+//    fills up too before the first one has been saved, writing stalls:
+//    records are dropped and counted in |num_records_dropped| until it has
+//    been.
+//
+// Once tracing has stopped, the buffer numbered |wrapped_count| holds the
+// last |current_buffer_data_end| bytes of records.  If a full buffer was
+// still waiting to be saved, it goes before them.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// Identifies a trace buffer header.
+#define TRACE_BUFFER_HEADER_MAGIC ((uint64_t)0x7472616365627566u) // "tracebuf"
+
+// The trace engine hands its buffer out to writers in chunks of this many
+// bytes, and no record crosses from one chunk into the next, so a record
+// begins at every multiple of it from the start of the buffer, or in
+// streaming mode from the start of each of the two buffers.  Readers can
+// rely on this to decode the chunks separately.
+#define TRACE_BUFFER_CHUNK_SIZE ((size_t)32768u)
+
+// The current version of |trace_buffer_header_t|.
+#define TRACE_BUFFER_HEADER_V0 ((uint32_t)0u)
+
+typedef struct trace_buffer_header {
+    // |TRACE_BUFFER_HEADER_MAGIC|.
+    uint64_t magic;
+
+    // |TRACE_BUFFER_HEADER_V0|.
+    uint32_t version;
+
+    // The |trace_buffering_mode_t| of the trace.
+    // Before tracing starts, the collector may set |magic|, |version| and
+    // this field to ask a trace provider for that mode.
+    uint32_t buffering_mode;
+
+    // The size of the whole trace buffer, including this header.
+    uint64_t total_size;
+
+    // The size of each of the two buffers which follow this header.
+    uint64_t buffer_size;
+
+    // The number of times the trace engine has moved on to the other buffer,
+    // which is also the number of the buffer it is writing into.
+    uint64_t wrapped_count;
+
+    // The number of the buffer which is waiting to be saved.
+    uint64_t full_wrapped_count;
+
+    // The number of bytes of records in the current buffer.
+    // Only valid once tracing has stopped.
+    uint64_t current_buffer_data_end;
+
+    // The number of times writing stalled because both buffers were full,
+    // and the number of records dropped while it was.
+    uint64_t num_stalls;
+    uint64_t num_records_dropped;
+
+    // Reserved for future use.  Must be zero.
+    uint64_t reserved[7];
+} trace_buffer_header_t;
+
+__END_CDECLS
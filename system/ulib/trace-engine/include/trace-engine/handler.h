@@ -70,20 +70,63 @@ struct trace_handler_ops {
 
     // Called by the trace engine after an attempt to allocate space
     // for a new record has failed because the buffer is full.
+    // Not called in circular mode.  In streaming mode, called when records
+    // begin to be dropped because neither buffer has room for them.
     //
     // Called by instrumentation on any thread.  Must be thread-safe.
     void (*buffer_overflow)(trace_handler_t* handler);
+
+    // Called by the trace engine in streaming mode when one of the buffers
+    // is full and ready to be saved.  The handler must arrange for it to be
+    // saved and then call |trace_engine_mark_buffer_saved()|, but not from
+    // within this method, which may be called with engine locks held.
+    // See <trace-engine/buffer.h>.
+    //
+    // |wrapped_count| is the number of the buffer.
+    //
+    // Called by instrumentation on any thread.  Must be thread-safe.
+    void (*notify_buffer_full)(trace_handler_t* handler, uint64_t wrapped_count);
 };
 
+// Specifies how the trace engine fills its buffer.
+typedef enum {
+    // Records are written until the buffer is full, after which they are
+    // dropped and the handler's |buffer_overflow()| method is invoked.
+    TRACE_BUFFERING_MODE_ONESHOT = 0,
+    // Once the buffer is full, the chunks holding the oldest records are
+    // reused, so the buffer keeps the most recent records of each thread.
+    // The records are not in time order and the initialization record is
+    // kept; string and thread references are always written inline, since
+    // string and thread records would eventually be overwritten.
+    // The buffer must hold at least two chunks of 32 KB.
+    TRACE_BUFFERING_MODE_CIRCULAR = 1,
+    // The buffer is split into two, and each time one of them is full it is
+    // handed off to be saved while records are written into the other one.
+    // See <trace-engine/buffer.h> for the layout and the handoff.
+    // String and thread references are always written inline, since their
+    // records could be dropped.  Each buffer must hold at least one chunk.
+    TRACE_BUFFERING_MODE_STREAMING = 2,
+} trace_buffering_mode_t;
+
+// Asynchronously starts the trace engine in oneshot mode.
+//
+// Same as |trace_start_engine_etc()| with |TRACE_BUFFERING_MODE_ONESHOT|.
+zx_status_t trace_start_engine(async_t* async,
+                               trace_handler_t* handler,
+                               void* buffer,
+                               size_t buffer_num_bytes);
+
 // Asynchronously starts the trace engine.
 //
 // |async| is the asynchronous dispatcher which the trace engine will use for dispatch.
 // |handler| is the trace handler which will handle lifecycle events.
 // |buffer| is the trace buffer into which the trace engine will write trace events.
 // |buffer_num_bytes| is the size of the trace buffer in bytes.
+// |buffering_mode| specifies what happens once the buffer is full.
 //
 // Returns |ZX_OK| if tracing is ready to go.
 // Returns |ZX_ERR_BAD_STATE| if tracing is already in progress.
+// Returns |ZX_ERR_INVALID_ARGS| if the buffer is too small for |buffering_mode|.
 // Returns |ZX_ERR_NO_MEMORY| if allocation failed.
 //
 // This function is thread-safe.
@@ -104,10 +147,11 @@ struct trace_handler_ops {
 //
 // Better yet, don't shut down the trace engine's asynchronous dispatcher unless
 // the process is already about to exit.
-zx_status_t trace_start_engine(async_t* async,
-                               trace_handler_t* handler,
-                               void* buffer,
-                               size_t buffer_num_bytes);
+zx_status_t trace_start_engine_etc(async_t* async,
+                                   trace_handler_t* handler,
+                                   void* buffer,
+                                   size_t buffer_num_bytes,
+                                   trace_buffering_mode_t buffering_mode);
 
 // Asynchronously stops the trace engine.
 //
@@ -123,4 +167,15 @@ zx_status_t trace_start_engine(async_t* async,
 // This function is thread-safe.
 zx_status_t trace_stop_engine(zx_status_t disposition);
 
+// Tells the trace engine that the full buffer it handed off through
+// |trace_handler_ops.notify_buffer_full()| has been saved, so it can be
+// written into again.
+//
+// Returns |ZX_OK| if the buffer can be reused.
+// Returns |ZX_ERR_BAD_STATE| if tracing is not running in streaming mode, or
+// no buffer is waiting to be saved.
+//
+// This function is thread-safe.
+zx_status_t trace_engine_mark_buffer_saved(void);
+
 __END_CDECLS
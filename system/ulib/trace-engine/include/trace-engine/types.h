@@ -339,6 +339,7 @@ enum class MetadataType {
     kProviderInfo = 1,
     kProviderSection = 2,
     kProviderEvent = 3,
+    kPadding = 4,
 };
 
 // Enumerates all provider events.
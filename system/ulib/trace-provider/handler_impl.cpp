@@ -4,12 +4,14 @@
 
 #include "handler_impl.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 
 #include <zircon/assert.h>
 #include <zircon/status.h>
 #include <zircon/syscalls.h>
 
+#include <trace-engine/buffer.h>
 #include <trace-provider/provider.h>
 #include <zx/vmar.h>
 #include <fbl/type_support.h>
@@ -18,11 +20,14 @@ namespace trace {
 namespace internal {
 
 TraceHandlerImpl::TraceHandlerImpl(void* buffer, size_t buffer_num_bytes,
+                                   trace_buffering_mode_t buffering_mode,
                                    zx::eventpair fence,
                                    fbl::Vector<fbl::String> enabled_categories)
     : buffer_(buffer),
       buffer_num_bytes_(buffer_num_bytes),
+      buffering_mode_(buffering_mode),
       fence_(fbl::move(fence)),
+      fence_wait_(this, fence_.get(), TRACE_PROVIDER_SIGNAL_BUFFER_SAVED),
       enabled_categories_(fbl::move(enabled_categories)) {
     // Build a quick lookup table for IsCategoryEnabled().
     for (const auto& cat : enabled_categories_) {
@@ -55,12 +60,32 @@ zx_status_t TraceHandlerImpl::StartEngine(async_t* async,
     if (status != ZX_OK)
         return status;
 
+    // The trace manager may ask for another buffering mode in the header.
+    trace_buffering_mode_t buffering_mode = TRACE_BUFFERING_MODE_ONESHOT;
+    auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_ptr);
+    if (buffer_num_bytes >= sizeof(*header) &&
+        header->magic == TRACE_BUFFER_HEADER_MAGIC &&
+        header->version == TRACE_BUFFER_HEADER_V0) {
+        buffering_mode = static_cast<trace_buffering_mode_t>(header->buffering_mode);
+    }
+
     auto handler = new TraceHandlerImpl(reinterpret_cast<void*>(buffer_ptr),
-                                        buffer_num_bytes, fbl::move(fence),
+                                        buffer_num_bytes, buffering_mode,
+                                        fbl::move(fence),
                                         fbl::move(enabled_categories));
-    status = trace_start_engine(async, handler,
-                                handler->buffer_, handler->buffer_num_bytes_);
+    if (buffering_mode == TRACE_BUFFERING_MODE_STREAMING) {
+        status = handler->fence_wait_.Begin(async);
+        if (status != ZX_OK) {
+            delete handler;
+            return status;
+        }
+    }
+    status = trace_start_engine_etc(async, handler,
+                                    handler->buffer_, handler->buffer_num_bytes_,
+                                    buffering_mode);
     if (status != ZX_OK) {
+        if (buffering_mode == TRACE_BUFFERING_MODE_STREAMING)
+            handler->fence_wait_.Cancel(async);
         delete handler;
         return status;
     }
@@ -96,6 +121,17 @@ void TraceHandlerImpl::TraceStopped(async_t* async, zx_status_t disposition,
                                     size_t buffer_bytes_written) {
     // TODO: Report the disposition and bytes written back to the tracing system
     // so it has a better idea of what happened.
+    if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING) {
+        fence_wait_.Cancel(async);
+
+        // The trace manager finds the same counts in the header.
+        auto header = static_cast<const trace_buffer_header_t*>(buffer_);
+        if (header->num_records_dropped) {
+            printf("Trace provider dropped %" PRIu64 " records in %" PRIu64
+                   " stalls waiting for buffers to be saved\n",
+                   header->num_records_dropped, header->num_stalls);
+        }
+    }
     delete this;
 }
 
@@ -105,5 +141,28 @@ void TraceHandlerImpl::BufferOverflow() {
                     status == ZX_ERR_PEER_CLOSED);
 }
 
+void TraceHandlerImpl::NotifyBufferFull(uint64_t wrapped_count) {
+    // The trace manager learns which buffer is full from the header.
+    auto status = fence_.signal_peer(0u, TRACE_PROVIDER_SIGNAL_BUFFER_FULL);
+    ZX_DEBUG_ASSERT(status == ZX_OK ||
+                    status == ZX_ERR_PEER_CLOSED);
+}
+
+async_wait_result_t TraceHandlerImpl::HandleFence(async_t* async, zx_status_t status,
+                                                  const zx_packet_signal_t* signal) {
+    if (status != ZX_OK)
+        return ASYNC_WAIT_FINISHED;
+
+    // Clear the signal before the buffer can fill up again.
+    status = fence_.signal(TRACE_PROVIDER_SIGNAL_BUFFER_SAVED, 0u);
+    ZX_DEBUG_ASSERT(status == ZX_OK);
+    status = trace_engine_mark_buffer_saved();
+    if (status != ZX_OK) {
+        printf("Trace manager saved a buffer which was not full, status %s(%d)\n",
+               zx_status_get_string(status), status);
+    }
+    return ASYNC_WAIT_AGAIN;
+}
+
 } // namespace internal
 } // namespace trace
@@ -6,6 +6,7 @@
 
 #include <trace/handler.h>
 
+#include <async/wait.h>
 #include <zx/eventpair.h>
 #include <zx/vmo.h>
 #include <fbl/intrusive_hash_table.h>
@@ -27,6 +28,7 @@ public:
 
 private:
     TraceHandlerImpl(void* buffer, size_t buffer_num_bytes,
+                     trace_buffering_mode_t buffering_mode,
                      zx::eventpair fence,
                      fbl::Vector<fbl::String> enabled_categories);
     ~TraceHandlerImpl() override;
@@ -37,10 +39,16 @@ private:
     void TraceStopped(async_t* async,
                       zx_status_t disposition, size_t buffer_bytes_written) override;
     void BufferOverflow() override;
+    void NotifyBufferFull(uint64_t wrapped_count) override;
+
+    async_wait_result_t HandleFence(async_t* async, zx_status_t status,
+                                    const zx_packet_signal_t* signal);
 
     void* buffer_;
     size_t buffer_num_bytes_;
+    trace_buffering_mode_t const buffering_mode_;
     zx::eventpair fence_;
+    async::WaitMethod<TraceHandlerImpl, &TraceHandlerImpl::HandleFence> fence_wait_;
     fbl::Vector<fbl::String> const enabled_categories_;
 
     using CString = const char*;
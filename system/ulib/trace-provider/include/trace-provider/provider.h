@@ -23,8 +23,22 @@ __BEGIN_CDECLS
 // Indicate a record was dropped because the trace buffer is full.
 #define TRACE_PROVIDER_SIGNAL_BUFFER_OVERFLOW ZX_USER_SIGNAL_1
 
+// Indicate one of the buffers is full and ready to be saved, in streaming mode.
+// The trace buffer's header says which; see <trace-engine/buffer.h>.
+// The trace manager clears this signal before saving the buffer.
+#define TRACE_PROVIDER_SIGNAL_BUFFER_FULL ZX_USER_SIGNAL_2
+
+// Sent by the trace manager to indicate it has saved the full buffer.
+// The provider clears this signal before writing into the buffer again.
+#define TRACE_PROVIDER_SIGNAL_BUFFER_SAVED ZX_USER_SIGNAL_3
+
 // End signals for zx_object_signal_peer(fence).
 
+// The trace manager chooses how the buffer is filled by writing a
+// |trace_buffer_header_t| with the |magic|, |version| and |buffering_mode|
+// at the start of the buffer before starting the provider; otherwise the
+// buffer is filled once from the start.
+
 // Represents a trace provider.
 typedef struct trace_provider trace_provider_t;
 
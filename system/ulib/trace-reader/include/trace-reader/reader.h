@@ -5,6 +5,7 @@
 #pragma once
 
 #include <trace-reader/records.h>
+#include <trace-reader/views.h>
 
 #include <fbl/function.h>
 #include <fbl/intrusive_hash_table.h>
@@ -26,12 +27,29 @@ public:
     // return std::optional<Record> as an out parameter.
     using RecordConsumer = fbl::Function<void(Record)>;
 
+    // Called once for each event record read by |ReadRecords|, instead of
+    // the record consumer, by readers which decode events into views.
+    // The view is only valid during the call.
+    using EventViewConsumer = fbl::Function<void(const EventView&)>;
+
     // Callback invoked when decoding errors are detected in the trace.
     using ErrorHandler = fbl::Function<void(fbl::String)>;
 
+    // The most threads |ReadBufferInParallel| uses.
+    static constexpr size_t kMaxThreads = 16u;
+
     explicit TraceReader(RecordConsumer record_consumer,
                          ErrorHandler error_handler);
 
+    // Creates a reader which decodes event records into |EventView|s, without
+    // copying their strings and arguments, and gives all other records to the
+    // record consumer as usual.  Events make up the bulk of most traces, so
+    // this is much faster when the consumer only looks at some of their
+    // contents, or converts them into some other form anyway.
+    explicit TraceReader(EventViewConsumer event_view_consumer,
+                         RecordConsumer record_consumer,
+                         ErrorHandler error_handler);
+
     // Reads as many records as possible from the chunk, invoking the
     // record consumer for each one.  Returns true if the stream could possibly
     // contain more records if the chunk were extended with new data.
@@ -40,6 +58,27 @@ public:
     // chunks as they become available to resume decoding.
     bool ReadRecords(Chunk& chunk);
 
+    // Reads all of the records in a buffer written by one trace provider,
+    // such as its whole trace buffer in oneshot or circular mode or one of
+    // its buffers in streaming mode, decoding its events on up to
+    // |num_threads| threads at once.  The buffer may be mapped from a file;
+    // nothing is copied out of it.
+    //
+    // The trace engine hands its buffer out to writers in chunks of
+    // |TRACE_BUFFER_CHUNK_SIZE| bytes, and no record crosses from one chunk
+    // into the next, so once the string and thread tables have been read,
+    // each chunk can be decoded on its own.  So this first reads all records
+    // other than events, in order, on this thread, then splits the chunks into
+    // one run per thread and decodes the events of each run, in order.
+    //
+    // The event view consumer is called from all of the threads at once, so
+    // it must be thread-safe.  Errors are reported on this thread afterwards.
+    //
+    // Requires a reader created with an event view consumer which has not
+    // read any records yet.  Returns false if the buffer is unrecoverably
+    // corrupt.
+    bool ReadBufferInParallel(const void* buffer, size_t num_bytes, size_t num_threads);
+
     // Gets the current trace provider id.
     // Returns 0 if no providers have been registered yet.
     ProviderId current_provider_id() const { return current_provider_->id; }
@@ -55,6 +94,21 @@ public:
     fbl::String GetProviderName(ProviderId id) const;
 
 private:
+    // Which records |ReadRecords| reads.
+    enum class Pass {
+        kAll,
+        kAllButEvents,
+        kEventsOnly,
+    };
+
+    struct ChunkRun;
+
+    // Creates a reader which decodes the events of a run of chunks for
+    // |ReadBufferInParallel|, using |parent|'s tables and consumer.
+    TraceReader(const TraceReader* parent, ErrorHandler error_handler);
+
+    static void* ReadChunkRun(void* run);
+
     bool ReadMetadataRecord(Chunk& record,
                             RecordHeader header);
     bool ReadInitializationRecord(Chunk& record,
@@ -64,6 +118,7 @@ private:
     bool ReadThreadRecord(Chunk& record,
                           RecordHeader header);
     bool ReadEventRecord(Chunk& record, RecordHeader header);
+    bool ReadEventView(Chunk& record, RecordHeader header);
     bool ReadKernelObjectRecord(Chunk& record,
                                 RecordHeader header);
     bool ReadContextSwitchRecord(Chunk& record,
@@ -72,6 +127,10 @@ private:
     bool ReadArguments(Chunk& record,
                        size_t count,
                        fbl::Vector<Argument>* out_arguments);
+    bool ReadArgumentViews(Chunk& record,
+                           size_t count,
+                           ArgumentView* out_arguments,
+                           size_t* out_count) const;
 
     void SetCurrentProvider(ProviderId id);
     void RegisterProvider(ProviderId id, fbl::String name);
@@ -81,16 +140,29 @@ private:
     bool DecodeStringRef(Chunk& chunk,
                          trace_encoded_string_ref_t string_ref,
                          fbl::String* out_string) const;
+    bool DecodeStringRef(Chunk& chunk,
+                         trace_encoded_string_ref_t string_ref,
+                         fbl::StringPiece* out_string) const;
     bool DecodeThreadRef(Chunk& chunk,
                          trace_encoded_thread_ref_t thread_ref,
                          ProcessThread* out_process_thread) const;
 
     void ReportError(fbl::String error) const;
 
+    const EventViewConsumer& event_view_consumer() const {
+        return parent_ ? parent_->event_view_consumer_ : event_view_consumer_;
+    }
+
+    EventViewConsumer const event_view_consumer_;
     RecordConsumer const record_consumer_;
     ErrorHandler const error_handler_;
+    const TraceReader* const parent_ = nullptr;
 
     RecordHeader pending_header_ = 0u;
+    Pass pass_ = Pass::kAll;
+
+    // Reused for each event, when decoding into views.
+    EventView event_view_;
 
     struct StringTableEntry : public fbl::SinglyLinkedListable<
                                   fbl::unique_ptr<StringTableEntry>> {
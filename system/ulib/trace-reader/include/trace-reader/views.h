@@ -0,0 +1,62 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <trace-reader/records.h>
+
+#include <fbl/string_piece.h>
+
+namespace trace {
+
+// Named argument and value of an |EventView|.
+//
+// Unlike |Argument|, this does not own its strings: they point into the
+// trace buffer being read, or into the reader's string table.
+struct ArgumentView {
+    fbl::StringPiece name;
+    ArgumentType type;
+
+    // The value, according to |type|.  Strings are in |string_value|.
+    union {
+        int32_t int32_value;
+        uint32_t uint32_value;
+        int64_t int64_value;
+        uint64_t uint64_value;
+        double double_value;
+        uint64_t pointer_value;
+        zx_koid_t koid_value;
+    };
+    fbl::StringPiece string_value;
+};
+
+// Event record data, as decoded by a |TraceReader| without copying any of it.
+//
+// A view is only valid during the call to the consumer which receives it:
+// its strings point into the trace buffer being read, or into the reader's
+// string table, and the reader reuses the view for the next event.  Copy out
+// whatever needs to outlive the call.
+struct EventView {
+    // The most arguments an event record can have.
+    static constexpr size_t kMaxArguments = 15u;
+
+    EventType type;
+    trace_ticks_t timestamp;
+    ProcessThread process_thread;
+    fbl::StringPiece category;
+    fbl::StringPiece name;
+
+    // The scope of an |EventType::kInstant| event.
+    EventScope scope;
+
+    // The counter, async or flow id of events of those types.
+    uint64_t id;
+
+    size_t num_arguments;
+    ArgumentView arguments[kMaxArguments];
+};
+
+} // namespace trace
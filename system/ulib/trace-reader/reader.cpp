@@ -4,10 +4,54 @@
 
 #include <trace-reader/reader.h>
 
+#include <pthread.h>
+
+#include <fbl/algorithm.h>
 #include <fbl/string_printf.h>
+#include <trace-engine/buffer.h>
 #include <trace-engine/fields.h>
 
 namespace trace {
+namespace {
+
+constexpr size_t kChunkWords = TRACE_BUFFER_CHUNK_SIZE / sizeof(uint64_t);
+
+ArgumentValue MakeArgumentValue(const ArgumentView& view) {
+    switch (view.type) {
+    case ArgumentType::kInt32:
+        return ArgumentValue::MakeInt32(view.int32_value);
+    case ArgumentType::kUint32:
+        return ArgumentValue::MakeUint32(view.uint32_value);
+    case ArgumentType::kInt64:
+        return ArgumentValue::MakeInt64(view.int64_value);
+    case ArgumentType::kUint64:
+        return ArgumentValue::MakeUint64(view.uint64_value);
+    case ArgumentType::kDouble:
+        return ArgumentValue::MakeDouble(view.double_value);
+    case ArgumentType::kString:
+        return ArgumentValue::MakeString(fbl::String(view.string_value));
+    case ArgumentType::kPointer:
+        return ArgumentValue::MakePointer(view.pointer_value);
+    case ArgumentType::kKoid:
+        return ArgumentValue::MakeKoid(view.koid_value);
+    default:
+        return ArgumentValue::MakeNull();
+    }
+}
+
+} // namespace
+
+constexpr size_t TraceReader::kMaxThreads;
+
+// The chunks one thread decodes for |ReadBufferInParallel|.
+struct TraceReader::ChunkRun {
+    const TraceReader* parent;
+    const uint64_t* words;
+    size_t num_words;
+    size_t begin;
+    size_t end;
+    fbl::Vector<fbl::String> errors;
+};
 
 TraceReader::TraceReader(RecordConsumer record_consumer,
                          ErrorHandler error_handler)
@@ -16,6 +60,21 @@ TraceReader::TraceReader(RecordConsumer record_consumer,
     RegisterProvider(0u, "");
 }
 
+TraceReader::TraceReader(EventViewConsumer event_view_consumer,
+                         RecordConsumer record_consumer,
+                         ErrorHandler error_handler)
+    : event_view_consumer_(fbl::move(event_view_consumer)),
+      record_consumer_(fbl::move(record_consumer)),
+      error_handler_(fbl::move(error_handler)) {
+    RegisterProvider(0u, "");
+}
+
+TraceReader::TraceReader(const TraceReader* parent, ErrorHandler error_handler)
+    : error_handler_(fbl::move(error_handler)),
+      parent_(parent),
+      pass_(Pass::kEventsOnly),
+      current_provider_(parent->current_provider_) {}
+
 bool TraceReader::ReadRecords(Chunk& chunk) {
     while (true) {
         if (!pending_header_ && !chunk.ReadUint64(&pending_header_))
@@ -33,6 +92,12 @@ bool TraceReader::ReadRecords(Chunk& chunk) {
             return true; // need more data to decode record
 
         auto type = RecordFields::Type::Get<RecordType>(pending_header_);
+        if (pass_ != Pass::kAll &&
+            (type == RecordType::kEvent) != (pass_ == Pass::kEventsOnly)) {
+            // Read by the other pass of |ReadBufferInParallel|.
+            pending_header_ = 0u;
+            continue;
+        }
         switch (type) {
         case RecordType::kMetadata: {
             if (!ReadMetadataRecord(record, pending_header_)) {
@@ -93,6 +158,76 @@ bool TraceReader::ReadRecords(Chunk& chunk) {
     }
 }
 
+bool TraceReader::ReadBufferInParallel(const void* buffer, size_t num_bytes,
+                                       size_t num_threads) {
+    ZX_DEBUG_ASSERT(event_view_consumer_);
+    ZX_DEBUG_ASSERT(!pending_header_);
+
+    // Everything but the events is read first, in order, which fills in the
+    // string and thread tables the events refer to.
+    const uint64_t* words = static_cast<const uint64_t*>(buffer);
+    const size_t num_words = num_bytes / sizeof(uint64_t);
+    Chunk all(words, num_words);
+    pass_ = Pass::kAllButEvents;
+    bool ok = ReadRecords(all);
+    pass_ = Pass::kAll;
+    pending_header_ = 0u;
+    if (!ok)
+        return false;
+
+    // Then each thread decodes the events of a run of chunks, with this one
+    // taking the first.
+    const size_t num_chunks = fbl::round_up(num_words, kChunkWords) / kChunkWords;
+    num_threads = fbl::max(fbl::min(fbl::min(num_threads, kMaxThreads), num_chunks),
+                           static_cast<size_t>(1u));
+    const size_t per_thread = fbl::round_up(num_chunks, num_threads) / num_threads;
+    ChunkRun runs[kMaxThreads];
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads] = {};
+    for (size_t i = 0; i < num_threads; i++) {
+        runs[i].parent = this;
+        runs[i].words = words;
+        runs[i].num_words = num_words;
+        runs[i].begin = fbl::min(i * per_thread, num_chunks);
+        runs[i].end = fbl::min(runs[i].begin + per_thread, num_chunks);
+        if (i != 0) {
+            // If a thread can't be started, its run is decoded here instead.
+            started[i] = pthread_create(&threads[i], nullptr, ReadChunkRun, &runs[i]) == 0;
+        }
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        if (!started[i])
+            ReadChunkRun(&runs[i]);
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+        if (started[i])
+            pthread_join(threads[i], nullptr);
+        for (auto& error : runs[i].errors) {
+            ReportError(fbl::move(error));
+        }
+    }
+    return true;
+}
+
+void* TraceReader::ReadChunkRun(void* arg) {
+    auto run = static_cast<ChunkRun*>(arg);
+    TraceReader reader(run->parent, [run](fbl::String error) {
+        run->errors.push_back(fbl::move(error));
+    });
+    for (size_t i = run->begin; i < run->end; i++) {
+        const size_t offset = i * kChunkWords;
+        Chunk chunk(run->words + offset, fbl::min(kChunkWords, run->num_words - offset));
+        if (!reader.ReadRecords(chunk)) {
+            reader.ReportError(fbl::StringPrintf(
+                "Skipping the rest of chunk %zu", i));
+        }
+        // Only the last chunk can end partway through a record, if the buffer
+        // was cut short.
+        reader.pending_header_ = 0u;
+    }
+    return nullptr;
+}
+
 bool TraceReader::ReadMetadataRecord(Chunk& record, RecordHeader header) {
     auto type = MetadataRecordFields::MetadataType::Get<MetadataType>(header);
 
@@ -139,6 +274,10 @@ bool TraceReader::ReadMetadataRecord(Chunk& record, RecordHeader header) {
         }
         break;
     }
+    case MetadataType::kPadding: {
+        // Padding covers space which holds nothing of interest.
+        break;
+    }
     default: {
         // Ignore unknown metadata types for forward compatibility.
         ReportError(fbl::StringPrintf(
@@ -197,6 +336,9 @@ bool TraceReader::ReadThreadRecord(Chunk& record, RecordHeader header) {
 }
 
 bool TraceReader::ReadEventRecord(Chunk& record, RecordHeader header) {
+    if (event_view_consumer())
+        return ReadEventView(record, header);
+
     auto type = EventRecordFields::EventType::Get<EventType>(header);
     auto argument_count = EventRecordFields::ArgumentCount::Get<size_t>(header);
     auto thread_ref = EventRecordFields::ThreadRef::Get<trace_encoded_thread_ref_t>(header);
@@ -313,6 +455,58 @@ bool TraceReader::ReadEventRecord(Chunk& record, RecordHeader header) {
     return true;
 }
 
+bool TraceReader::ReadEventView(Chunk& record, RecordHeader header) {
+    auto argument_count = EventRecordFields::ArgumentCount::Get<size_t>(header);
+    auto thread_ref = EventRecordFields::ThreadRef::Get<trace_encoded_thread_ref_t>(header);
+    auto category_ref =
+        EventRecordFields::CategoryStringRef::Get<trace_encoded_string_ref_t>(header);
+    auto name_ref =
+        EventRecordFields::NameStringRef::Get<trace_encoded_string_ref_t>(header);
+
+    EventView& event = event_view_;
+    event.type = EventRecordFields::EventType::Get<EventType>(header);
+    event.scope = EventScope::kThread;
+    event.id = 0u;
+    if (!record.ReadUint64(&event.timestamp) ||
+        !DecodeThreadRef(record, thread_ref, &event.process_thread) ||
+        !DecodeStringRef(record, category_ref, &event.category) ||
+        !DecodeStringRef(record, name_ref, &event.name) ||
+        !ReadArgumentViews(record, argument_count, event.arguments, &event.num_arguments))
+        return false;
+
+    switch (event.type) {
+    case EventType::kInstant: {
+        uint64_t scope;
+        if (!record.ReadUint64(&scope))
+            return false;
+        event.scope = static_cast<EventScope>(scope);
+        break;
+    }
+    case EventType::kCounter:
+    case EventType::kAsyncBegin:
+    case EventType::kAsyncInstant:
+    case EventType::kAsyncEnd:
+    case EventType::kFlowBegin:
+    case EventType::kFlowStep:
+    case EventType::kFlowEnd: {
+        if (!record.ReadUint64(&event.id))
+            return false;
+        break;
+    }
+    case EventType::kDurationBegin:
+    case EventType::kDurationEnd:
+        break;
+    default: {
+        // Ignore unknown event types for forward compatibility.
+        ReportError(fbl::StringPrintf(
+            "Skipping event of unknown type %d", static_cast<uint32_t>(event.type)));
+        return true;
+    }
+    }
+    event_view_consumer()(event);
+    return true;
+}
+
 bool TraceReader::ReadKernelObjectRecord(Chunk& record, RecordHeader header) {
     auto object_type =
         KernelObjectRecordFields::ObjectType::Get<zx_obj_type_t>(header);
@@ -384,6 +578,28 @@ bool TraceReader::ReadLogRecord(Chunk& record, RecordHeader header) {
 bool TraceReader::ReadArguments(Chunk& record,
                                 size_t count,
                                 fbl::Vector<Argument>* out_arguments) {
+    ArgumentView views[EventView::kMaxArguments];
+    size_t num_views;
+    if (!ReadArgumentViews(record, count, views, &num_views))
+        return false;
+
+    for (size_t i = 0; i < num_views; i++) {
+        out_arguments->push_back(Argument{fbl::String(views[i].name),
+                                          MakeArgumentValue(views[i])});
+    }
+    return true;
+}
+
+bool TraceReader::ReadArgumentViews(Chunk& record,
+                                    size_t count,
+                                    ArgumentView* out_arguments,
+                                    size_t* out_count) const {
+    if (count > EventView::kMaxArguments) {
+        ReportError("Too many arguments");
+        return false;
+    }
+
+    *out_count = 0u;
     while (count-- > 0) {
         ArgumentHeader header;
         if (!record.ReadUint64(&header)) {
@@ -398,103 +614,79 @@ bool TraceReader::ReadArguments(Chunk& record,
             return false;
         }
 
+        ArgumentView& view = out_arguments[*out_count];
         auto name_ref = ArgumentFields::NameRef::Get<trace_encoded_string_ref_t>(header);
-        fbl::String name;
-        if (!DecodeStringRef(arg, name_ref, &name)) {
+        if (!DecodeStringRef(arg, name_ref, &view.name)) {
             ReportError("Failed to read argument name");
             return false;
         }
 
-        auto type = ArgumentFields::Type::Get<ArgumentType>(header);
-        switch (type) {
+        view.type = ArgumentFields::Type::Get<ArgumentType>(header);
+        switch (view.type) {
         case ArgumentType::kNull: {
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeNull()});
             break;
         }
         case ArgumentType::kInt32: {
-            auto value = Int32ArgumentFields::Value::Get<int32_t>(header);
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeInt32(value)});
+            view.int32_value = Int32ArgumentFields::Value::Get<int32_t>(header);
             break;
         }
         case ArgumentType::kUint32: {
-            auto value = Uint32ArgumentFields::Value::Get<uint32_t>(header);
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeUint32(value)});
+            view.uint32_value = Uint32ArgumentFields::Value::Get<uint32_t>(header);
             break;
         }
         case ArgumentType::kInt64: {
-            int64_t value;
-            if (!arg.ReadInt64(&value)) {
+            if (!arg.ReadInt64(&view.int64_value)) {
                 ReportError("Failed to read int64 argument value");
                 return false;
             }
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeInt64(value)});
             break;
         }
         case ArgumentType::kUint64: {
-            uint64_t value;
-            if (!arg.ReadUint64(&value)) {
+            if (!arg.ReadUint64(&view.uint64_value)) {
                 ReportError("Failed to read uint64 argument value");
                 return false;
             }
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeUint64(value)});
             break;
         }
         case ArgumentType::kDouble: {
-            double value;
-            if (!arg.ReadDouble(&value)) {
+            if (!arg.ReadDouble(&view.double_value)) {
                 ReportError("Failed to read double argument value");
                 return false;
             }
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeDouble(value)});
             break;
         }
         case ArgumentType::kString: {
             auto string_ref =
                 StringArgumentFields::Index::Get<trace_encoded_string_ref_t>(header);
-            fbl::String value;
-            if (!DecodeStringRef(arg, string_ref, &value)) {
+            if (!DecodeStringRef(arg, string_ref, &view.string_value)) {
                 ReportError("Failed to read string argument value");
                 return false;
             }
-            out_arguments->push_back(
-                Argument{fbl::move(name),
-                         ArgumentValue::MakeString(fbl::move(value))});
             break;
         }
         case ArgumentType::kPointer: {
-            uint64_t value;
-            if (!arg.ReadUint64(&value)) {
+            if (!arg.ReadUint64(&view.pointer_value)) {
                 ReportError("Failed to read pointer argument value");
                 return false;
             }
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakePointer(value)});
             break;
         }
         case ArgumentType::kKoid: {
-            zx_koid_t value;
-            if (!arg.ReadUint64(&value)) {
+            if (!arg.ReadUint64(&view.koid_value)) {
                 ReportError("Failed to read koid argument value");
                 return false;
             }
-            out_arguments->push_back(Argument{fbl::move(name),
-                                              ArgumentValue::MakeKoid(value)});
             break;
         }
         default: {
             // Ignore unknown argument types for forward compatibility.
             ReportError(fbl::StringPrintf(
                 "Skipping argument of unknown type %d, argument name %s",
-                static_cast<uint32_t>(type), name.c_str()));
-            break;
+                static_cast<uint32_t>(view.type), fbl::String(view.name).c_str()));
+            continue;
         }
         }
+        (*out_count)++;
     }
     return true;
 }
@@ -570,6 +762,33 @@ bool TraceReader::DecodeStringRef(Chunk& chunk,
     return true;
 }
 
+bool TraceReader::DecodeStringRef(Chunk& chunk,
+                                  trace_encoded_string_ref_t string_ref,
+                                  fbl::StringPiece* out_string) const {
+    if (string_ref == TRACE_ENCODED_STRING_REF_EMPTY) {
+        *out_string = fbl::StringPiece();
+        return true;
+    }
+
+    if (string_ref & TRACE_ENCODED_STRING_REF_INLINE_FLAG) {
+        size_t length = string_ref & TRACE_ENCODED_STRING_REF_LENGTH_MASK;
+        if (length > TRACE_ENCODED_STRING_REF_MAX_LENGTH ||
+            !chunk.ReadString(length, out_string)) {
+            ReportError("Could not read inline string");
+            return false;
+        }
+        return true;
+    }
+
+    auto it = current_provider_->string_table.find(string_ref);
+    if (it == current_provider_->string_table.end()) {
+        ReportError("String ref not in table");
+        return false;
+    }
+    *out_string = fbl::StringPiece(it->string.data(), it->string.length());
+    return true;
+}
+
 bool TraceReader::DecodeThreadRef(Chunk& chunk,
                                   trace_encoded_thread_ref_t thread_ref,
                                   ProcessThread* out_process_thread) const {
@@ -43,7 +43,7 @@ const char* ThreadStateToString(ThreadState state) {
 }
 
 const char* ObjectTypeToString(zx_obj_type_t type) {
-    static_assert(ZX_OBJ_TYPE_LAST == 24, "need to update switch below");
+    static_assert(ZX_OBJ_TYPE_LAST == 25, "need to update switch below");
 
     switch (type) {
     case ZX_OBJ_TYPE_PROCESS:
@@ -84,6 +84,8 @@ const char* ObjectTypeToString(zx_obj_type_t type) {
         return "timer";
     case ZX_OBJ_TYPE_IOMMU:
         return "iommu";
+    case ZX_OBJ_TYPE_WAIT_SET:
+        return "wait-set";
     default:
         return "???";
     }
@@ -199,6 +201,9 @@ void MetadataContent::Destroy() {
     case MetadataType::kProviderEvent:
         provider_event_.~ProviderEvent();
         break;
+    case MetadataType::kPadding:
+        // The reader skips padding, so there is no content for it.
+        break;
     }
 }
 
@@ -214,6 +219,8 @@ void MetadataContent::MoveFrom(MetadataContent&& other) {
     case MetadataType::kProviderEvent:
         new (&provider_event_) ProviderEvent(fbl::move(other.provider_event_));
         break;
+    case MetadataType::kPadding:
+        break;
     }
 }
 
@@ -240,6 +247,8 @@ fbl::String MetadataContent::ToString() const {
         return fbl::StringPrintf("ProviderEvent(id: %" PRId32 ", %s)",
                                  provider_event_.id, name.c_str());
     }
+    case MetadataType::kPadding:
+        break;
     }
     ZX_ASSERT(false);
 }
@@ -56,12 +56,22 @@ public:
     // the buffer was full.
     virtual void BufferOverflow() {}
 
+    // Called by the trace engine in streaming mode when one of the buffers
+    // is full and ready to be saved.  Once it has been saved, the handler
+    // must call |trace_engine_mark_buffer_saved()|, but not from here.
+    //
+    // |wrapped_count| is the number of the buffer.
+    //
+    // Called by instrumentation on any thread.  Must be thread-safe.
+    virtual void NotifyBufferFull(uint64_t wrapped_count) {}
+
 private:
     static bool CallIsCategoryEnabled(trace_handler_t* handler, const char* category);
     static void CallTraceStarted(trace_handler_t* handler);
     static void CallTraceStopped(trace_handler_t* handler, async_t* async,
                                  zx_status_t disposition, size_t buffer_bytes_written);
     static void CallBufferOverflow(trace_handler_t* handler);
+    static void CallNotifyBufferFull(trace_handler_t* handler, uint64_t wrapped_count);
 
     static const trace_handler_ops_t kOps;
 };
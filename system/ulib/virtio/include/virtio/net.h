@@ -10,29 +10,30 @@
 
 // clang-format off
 
-#define VIRTIO_NET_F_CSUM                   (1u << 0)
-#define VIRTIO_NET_F_GUEST_CSUM             (1u << 1)
-#define VIRTIO_NET_F_CNTRL_GUEST_OFFLOADS   (1u << 2)
-#define VIRTIO_NET_F_MAC                    (1u << 5)
-#define VIRTIO_NET_F_GSO                    (1u << 6)
-#define VIRTIO_NET_F_GUEST_TSO4             (1u << 7)
-#define VIRTIO_NET_F_GUEST_TSO6             (1u << 8)
-#define VIRTIO_NET_F_GUEST_ECN              (1u << 9)
-#define VIRTIO_NET_F_GUEST_UFO              (1u << 10)
-#define VIRTIO_NET_F_HOST_TSO4              (1u << 11)
-#define VIRTIO_NET_F_HOST_TSO6              (1u << 12)
-#define VIRTIO_NET_F_HOST_ECN               (1u << 13)
-#define VIRTIO_NET_F_HOST_UFO               (1u << 14)
-#define VIRTIO_NET_F_MRG_RXBUF              (1u << 15)
-#define VIRTIO_NET_F_STATUS                 (1u << 16)
-#define VIRTIO_NET_F_CTRL_VQ                (1u << 17)
-#define VIRTIO_NET_F_CTRL_RX                (1u << 18)
-#define VIRTIO_NET_F_CTRL_VLAN              (1u << 19)
-#define VIRTIO_NET_F_GUEST_ANNOUNCE         (1u << 21)
-#define VIRTIO_NET_F_MQ                     (1u << 22)
-#define VIRTIO_NET_F_CTRL_MAC_ADDR          (1u << 23)
+#define VIRTIO_NET_F_CSUM                   0
+#define VIRTIO_NET_F_GUEST_CSUM             1
+#define VIRTIO_NET_F_CNTRL_GUEST_OFFLOADS   2
+#define VIRTIO_NET_F_MAC                    5
+#define VIRTIO_NET_F_GSO                    6
+#define VIRTIO_NET_F_GUEST_TSO4             7
+#define VIRTIO_NET_F_GUEST_TSO6             8
+#define VIRTIO_NET_F_GUEST_ECN              9
+#define VIRTIO_NET_F_GUEST_UFO              10
+#define VIRTIO_NET_F_HOST_TSO4              11
+#define VIRTIO_NET_F_HOST_TSO6              12
+#define VIRTIO_NET_F_HOST_ECN               13
+#define VIRTIO_NET_F_HOST_UFO               14
+#define VIRTIO_NET_F_MRG_RXBUF              15
+#define VIRTIO_NET_F_STATUS                 16
+#define VIRTIO_NET_F_CTRL_VQ                17
+#define VIRTIO_NET_F_CTRL_RX                18
+#define VIRTIO_NET_F_CTRL_VLAN              19
+#define VIRTIO_NET_F_GUEST_ANNOUNCE         21
+#define VIRTIO_NET_F_MQ                     22
+#define VIRTIO_NET_F_CTRL_MAC_ADDR          23
 
 #define VIRTIO_NET_HDR_F_NEEDS_CSUM 1u
+#define VIRTIO_NET_HDR_F_DATA_VALID 2u
 
 #define VIRTIO_NET_HDR_GSO_NONE     0u
 #define VIRTIO_NET_HDR_GSO_TCPV4    1u
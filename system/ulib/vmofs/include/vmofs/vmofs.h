@@ -5,6 +5,7 @@
 #pragma once
 
 #include <fbl/array.h>
+#include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/string_piece.h>
 #include <fs/vfs.h>
@@ -41,10 +42,16 @@ public:
     uint32_t GetVType() final;
 
 private:
-    zx_handle_t vmo_;
-    zx_off_t offset_;
-    zx_off_t length_;
-    bool have_local_clone_;
+    // The file's contents never change, so reads need no lock.
+    zx_handle_t const vmo_;
+    zx_off_t const offset_;
+    zx_off_t const length_;
+
+    fbl::Mutex mutex_;
+
+    // Clone of just the file's window of |vmo_|, made the first time it is
+    // handed out.
+    zx_handle_t local_clone_ __TA_GUARDED(mutex_);
 };
 
 class VnodeDir : public Vnode {
@@ -9,6 +9,7 @@
 
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/auto_lock.h>
 #include <zircon/device/vfs.h>
 #include <zircon/syscalls.h>
 
@@ -37,11 +38,11 @@ VnodeFile::VnodeFile(zx_handle_t vmo,
                      zx_off_t offset,
                      zx_off_t length)
     : vmo_(vmo), offset_(offset), length_(length),
-      have_local_clone_(false) {}
+      local_clone_(ZX_HANDLE_INVALID) {}
 
 VnodeFile::~VnodeFile() {
-    if (have_local_clone_) {
-        zx_handle_close(vmo_);
+    if (local_clone_ != ZX_HANDLE_INVALID) {
+        zx_handle_close(local_clone_);
     }
 }
 
@@ -93,16 +94,16 @@ zx_status_t VnodeFile::GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* ty
     zx_handle_t vmo;
     zx_status_t status;
 
-    if (!have_local_clone_) {
-        status = zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, offset_, length_, &vmo_);
+    fbl::AutoLock lock(&mutex_);
+    if (local_clone_ == ZX_HANDLE_INVALID) {
+        status = zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, offset_, length_,
+                              &local_clone_);
         if (status < 0)
             return status;
-        offset_ = 0;
-        have_local_clone_ = true;
     }
 
     status = zx_handle_duplicate(
-        vmo_,
+        local_clone_,
         ZX_RIGHT_READ | ZX_RIGHT_EXECUTE | ZX_RIGHT_MAP |
         ZX_RIGHTS_BASIC | ZX_RIGHT_GET_PROPERTY,
         &vmo);
@@ -110,7 +111,7 @@ zx_status_t VnodeFile::GetHandles(uint32_t flags, zx_handle_t* hnd, uint32_t* ty
         return status;
     }
 
-    *offset = offset_;
+    *offset = 0;
     *length = length_;
     *hnd = vmo;
     *type = FDIO_PROTOCOL_VMOFILE;
@@ -7,7 +7,7 @@
 #include "private.h"
 
 zx_time_t _zx_deadline_after(zx_duration_t nanoseconds) {
-    auto now = VDSO_zx_clock_get(ZX_CLOCK_MONOTONIC);
+    auto now = VDSO_zx_time_get(ZX_CLOCK_MONOTONIC);
     auto deadline = nanoseconds + now;
     // Check for overflow.  |nanoseconds| is unsigned, so we only get a
     // deadline in the past if overflow occurred.
@@ -6,7 +6,51 @@
 
 #include "private.h"
 
+namespace {
+
+// This must round exactly like the kernel's u64_mul_u64_fp32_64, so that
+// the result matches what the syscall would have returned.
+uint64_t ticks_to_monotonic(uint64_t ticks) {
+    const uint32_t b_l0 = DATA_CONSTANTS.ns_per_tick_l0;
+    const uint32_t b_l32 = DATA_CONSTANTS.ns_per_tick_l32;
+    const uint32_t b_l64 = DATA_CONSTANTS.ns_per_tick_l64;
+    const uint32_t a_r32 = static_cast<uint32_t>(ticks >> 32);
+    const uint32_t a_0 = static_cast<uint32_t>(ticks);
+
+    uint64_t res_0 = (static_cast<uint64_t>(a_r32) * b_l0) << 32;
+    res_0 += static_cast<uint64_t>(a_0) * b_l0;
+    res_0 += static_cast<uint64_t>(a_r32) * b_l32;
+    uint64_t tmp = static_cast<uint64_t>(a_0) * b_l32;
+    res_0 += tmp >> 32;
+    uint64_t res_l32 = static_cast<uint32_t>(tmp);
+    tmp = static_cast<uint64_t>(a_r32) * b_l64;
+    res_0 += tmp >> 32;
+    res_l32 += static_cast<uint32_t>(tmp);
+    res_l32 += (static_cast<uint64_t>(a_0) * b_l64) >> 32;
+    res_0 += res_l32 >> 32;
+    return res_0 + (static_cast<uint32_t>(res_l32) >> 31);
+}
+
+bool monotonic_from_ticks() {
+    return (DATA_CONSTANTS.ns_per_tick_l0 |
+            DATA_CONSTANTS.ns_per_tick_l32 |
+            DATA_CONSTANTS.ns_per_tick_l64) != 0;
+}
+
+} // anonymous namespace
+
 zx_time_t _zx_time_get(uint32_t clock_id) {
+    switch (clock_id) {
+    case ZX_CLOCK_MONOTONIC:
+        if (monotonic_from_ticks())
+            return ticks_to_monotonic(VDSO_zx_ticks_get());
+        break;
+    case ZX_CLOCK_UTC:
+        if (monotonic_from_ticks())
+            return ticks_to_monotonic(VDSO_zx_ticks_get()) +
+                __atomic_load_n(&DATA_TIME_VALUES.utc_offset, __ATOMIC_RELAXED);
+        break;
+    }
     return SYSCALL_zx_clock_get(clock_id);
 }
 
@@ -17,6 +17,7 @@
 #include <fbl/unique_ptr.h>
 #include <zircon/device/block.h>
 #include <zircon/types.h>
+#include <zxcrypt/worker-pool.h>
 
 // |zxcrypt::Superblock| manages the interactions of both driver and library code with the metadata
 // used to format and operate zxcrypt devices.  Driver code uses the public constructor and instance
@@ -109,6 +110,11 @@ public:
     // zxcrypt driver.
     zx_status_t BindCiphers(crypto::Cipher* out_encrypt, crypto::Cipher* out_decrypt);
 
+    // Starts |out|'s workers with the data key and IV, so that large requests can be encrypted and
+    // decrypted on several threads.  |num_workers| is as for |WorkerPool::Init|.  This method can
+    // only be called if the superblock belongs to the zxcrypt driver.
+    zx_status_t BindWorkers(WorkerPool* out, size_t num_workers = 0);
+
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Superblock);
 
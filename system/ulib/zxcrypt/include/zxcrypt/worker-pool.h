@@ -0,0 +1,80 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include <crypto/bytes.h>
+#include <crypto/cipher.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/macros.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/types.h>
+
+// |zxcrypt::WorkerPool| encrypts and decrypts runs of device blocks on several threads at once.
+// Each block is transformed with the IV tweaked to its block offset, and a large run is divided
+// between the workers so that its throughput scales with the number of cores.  Each worker has its
+// own pair of ciphers, since tweaking changes a cipher's state.
+namespace zxcrypt {
+
+class WorkerPool final {
+public:
+    // The most workers a pool will start.
+    static const size_t kMaxWorkers;
+
+    // The fewest blocks handed to a single worker; smaller runs are not worth dividing.
+    static const size_t kMinBlocksPerWorker;
+
+    WorkerPool();
+    ~WorkerPool();
+
+    // Starts |num_workers| threads, or one per CPU if zero, each with ciphers using the given
+    // |cipher| algorithm, |key| and |iv|.  Blocks are |block_size| bytes long.
+    zx_status_t Init(crypto::Cipher::Algorithm cipher, const crypto::Bytes& key,
+                     const crypto::Bytes& iv, size_t block_size, size_t num_workers = 0);
+
+    // Encrypts |num_blocks| blocks from |in| to |out|, where the first of them is at block
+    // |offset| on the device.  Returns once all of them are done.
+    zx_status_t Encrypt(const uint8_t* in, uint64_t offset, size_t num_blocks, uint8_t* out);
+
+    // Decrypts |num_blocks| blocks from |in| to |out|, where the first of them is at block
+    // |offset| on the device.  Returns once all of them are done.
+    zx_status_t Decrypt(const uint8_t* in, uint64_t offset, size_t num_blocks, uint8_t* out);
+
+    // Stops and joins all of the worker threads.
+    void Reset();
+
+private:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(WorkerPool);
+
+    struct Request;
+    struct Chunk;
+    struct Worker;
+
+    // Divides the blocks of a request between the workers and waits for them to finish.
+    zx_status_t Transform(crypto::Cipher::Direction direction, const uint8_t* in, uint64_t offset,
+                          size_t num_blocks, uint8_t* out);
+
+    // Takes chunks off the queue until the pool is reset.
+    static int WorkerLoop(void* arg);
+
+    // Guards the fields below.
+    mtx_t mtx_;
+    // Signalled when chunks are queued or the pool is stopping.
+    cnd_t cnd_;
+    // Chunks yet to be picked up by a worker.
+    fbl::DoublyLinkedList<Chunk*> queue_;
+    // Set when the workers should exit.
+    bool stopping_;
+
+    // The worker threads and their ciphers.
+    fbl::unique_ptr<Worker[]> workers_;
+    size_t num_workers_;
+    size_t block_size_;
+};
+
+} // namespace zxcrypt
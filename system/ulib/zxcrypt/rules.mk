@@ -10,6 +10,7 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/superblock.cpp \
+    $(LOCAL_DIR)/worker-pool.cpp \
 
 MODULE_LIBS := \
     system/ulib/c \
@@ -294,6 +294,20 @@ zx_status_t Superblock::BindCiphers(crypto::Cipher* out_encrypt, crypto::Cipher*
     return ZX_OK;
 }
 
+zx_status_t Superblock::BindWorkers(WorkerPool* out, size_t num_workers) {
+    ZX_DEBUG_ASSERT(dev_); // Cannot bind from library
+
+    if (!out) {
+        xprintf("%s: missing output pointer\n", __PRETTY_FUNCTION__);
+        return ZX_ERR_INVALID_ARGS;
+    }
+    if (!block_.get()) {
+        xprintf("%s: not initialized\n", __PRETTY_FUNCTION__);
+        return ZX_ERR_BAD_STATE;
+    }
+    return out->Init(cipher_, data_key_, data_iv_, blk_.block_size, num_workers);
+}
+
 // Private methods
 
 Superblock::Superblock(fbl::unique_fd&& fd) : dev_(nullptr), fd_(fbl::move(fd)) {
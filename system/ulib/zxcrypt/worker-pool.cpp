@@ -0,0 +1,248 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include <crypto/bytes.h>
+#include <crypto/cipher.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/unique_ptr.h>
+#include <fdio/debug.h>
+#include <sync/completion.h>
+#include <zircon/errors.h>
+#include <zircon/status.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+#include <zxcrypt/worker-pool.h>
+
+#define MXDEBUG 0
+
+namespace zxcrypt {
+
+// More workers than this contend for memory bandwidth rather than adding throughput.
+const size_t WorkerPool::kMaxWorkers = 16;
+
+// Below this, handing blocks to another worker costs more than transforming them.
+const size_t WorkerPool::kMinBlocksPerWorker = 16;
+
+// A single call to |Encrypt| or |Decrypt|, which completes once all of its chunks have.
+struct WorkerPool::Request {
+    crypto::Cipher::Direction direction;
+    size_t remaining;
+    zx_status_t status;
+    completion_t done;
+};
+
+// A contiguous run of blocks from a request, transformed by one worker.
+struct WorkerPool::Chunk : public fbl::DoublyLinkedListable<Chunk*> {
+    Request* request;
+    const uint8_t* in;
+    uint8_t* out;
+    uint64_t offset;
+    size_t num_blocks;
+};
+
+struct WorkerPool::Worker {
+    WorkerPool* pool;
+    thrd_t thread;
+    bool started;
+    crypto::Cipher encrypt;
+    crypto::Cipher decrypt;
+};
+
+WorkerPool::WorkerPool() : stopping_(false), num_workers_(0), block_size_(0) {
+    mtx_init(&mtx_, mtx_plain);
+    cnd_init(&cnd_);
+}
+
+WorkerPool::~WorkerPool() {
+    Reset();
+    cnd_destroy(&cnd_);
+    mtx_destroy(&mtx_);
+}
+
+zx_status_t WorkerPool::Init(crypto::Cipher::Algorithm cipher, const crypto::Bytes& key,
+                             const crypto::Bytes& iv, size_t block_size, size_t num_workers) {
+    zx_status_t rc;
+
+    if (block_size == 0) {
+        xprintf("%s: bad parameter(s): block_size=%zu\n", __PRETTY_FUNCTION__, block_size);
+        return ZX_ERR_INVALID_ARGS;
+    }
+    Reset();
+
+    if (num_workers == 0) {
+        num_workers = zx_system_get_num_cpus();
+    }
+    num_workers = fbl::clamp(num_workers, static_cast<size_t>(1), kMaxWorkers);
+    fbl::AllocChecker ac;
+    workers_.reset(new (&ac) Worker[num_workers]);
+    if (!ac.check()) {
+        xprintf("%s: allocation failed: %zu bytes\n", __PRETTY_FUNCTION__,
+                sizeof(Worker) * num_workers);
+        return ZX_ERR_NO_MEMORY;
+    }
+    block_size_ = block_size;
+
+    // Each worker may be asked for any block on the device.
+    uint64_t tweakable = UINT64_MAX / block_size;
+    for (size_t i = 0; i < num_workers; i++) {
+        Worker* worker = &workers_[i];
+        worker->pool = this;
+        worker->started = false;
+        if ((rc = worker->encrypt.InitEncrypt(cipher, key, iv, tweakable)) != ZX_OK ||
+            (rc = worker->decrypt.InitDecrypt(cipher, key, iv, tweakable)) != ZX_OK) {
+            Reset();
+            return rc;
+        }
+    }
+    for (size_t i = 0; i < num_workers; i++) {
+        Worker* worker = &workers_[i];
+        if (thrd_create_with_name(&worker->thread, WorkerLoop, worker, "zxcrypt-worker") !=
+            thrd_success) {
+            xprintf("%s: failed to start worker %zu\n", __PRETTY_FUNCTION__, i);
+            num_workers_ = i;
+            Reset();
+            return ZX_ERR_NO_RESOURCES;
+        }
+        worker->started = true;
+    }
+    num_workers_ = num_workers;
+
+    return ZX_OK;
+}
+
+zx_status_t WorkerPool::Encrypt(const uint8_t* in, uint64_t offset, size_t num_blocks,
+                                uint8_t* out) {
+    return Transform(crypto::Cipher::kEncrypt, in, offset, num_blocks, out);
+}
+
+zx_status_t WorkerPool::Decrypt(const uint8_t* in, uint64_t offset, size_t num_blocks,
+                                uint8_t* out) {
+    return Transform(crypto::Cipher::kDecrypt, in, offset, num_blocks, out);
+}
+
+void WorkerPool::Reset() {
+    if (workers_) {
+        mtx_lock(&mtx_);
+        stopping_ = true;
+        cnd_broadcast(&cnd_);
+        mtx_unlock(&mtx_);
+        for (size_t i = 0; i < num_workers_; i++) {
+            if (workers_[i].started) {
+                thrd_join(workers_[i].thread, nullptr);
+            }
+        }
+        workers_.reset();
+    }
+    stopping_ = false;
+    num_workers_ = 0;
+    block_size_ = 0;
+}
+
+// Private methods
+
+zx_status_t WorkerPool::Transform(crypto::Cipher::Direction direction, const uint8_t* in,
+                                  uint64_t offset, size_t num_blocks, uint8_t* out) {
+    if (num_workers_ == 0) {
+        xprintf("%s: not initialized\n", __PRETTY_FUNCTION__);
+        return ZX_ERR_BAD_STATE;
+    }
+    if (num_blocks == 0) {
+        return ZX_OK;
+    }
+    if (!in || !out) {
+        xprintf("%s: bad parameter(s): in=%p, out=%p\n", __PRETTY_FUNCTION__, in, out);
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    size_t num_chunks = fbl::clamp(num_blocks / kMinBlocksPerWorker, static_cast<size_t>(1),
+                                   num_workers_);
+    Request request;
+    request.direction = direction;
+    request.remaining = num_chunks;
+    request.status = ZX_OK;
+    completion_reset(&request.done);
+
+    Chunk chunks[kMaxWorkers];
+    size_t per_chunk = num_blocks / num_chunks;
+    size_t extra = num_blocks % num_chunks;
+    mtx_lock(&mtx_);
+    for (size_t i = 0; i < num_chunks; i++) {
+        size_t n = per_chunk + (i < extra ? 1 : 0);
+        chunks[i].request = &request;
+        chunks[i].in = in;
+        chunks[i].out = out;
+        chunks[i].offset = offset;
+        chunks[i].num_blocks = n;
+        queue_.push_back(&chunks[i]);
+        in += n * block_size_;
+        out += n * block_size_;
+        offset += n;
+    }
+    cnd_broadcast(&cnd_);
+    mtx_unlock(&mtx_);
+
+    completion_wait(&request.done, ZX_TIME_INFINITE);
+
+    // The last worker signals while holding the lock; take it so |request| outlives that.
+    mtx_lock(&mtx_);
+    zx_status_t rc = request.status;
+    mtx_unlock(&mtx_);
+    return rc;
+}
+
+int WorkerPool::WorkerLoop(void* arg) {
+    Worker* worker = static_cast<Worker*>(arg);
+    WorkerPool* pool = worker->pool;
+    const size_t block_size = pool->block_size_;
+
+    mtx_lock(&pool->mtx_);
+    while (true) {
+        while (!pool->stopping_ && pool->queue_.is_empty()) {
+            cnd_wait(&pool->cnd_, &pool->mtx_);
+        }
+        if (pool->queue_.is_empty()) {
+            break;
+        }
+        Chunk* chunk = pool->queue_.pop_front();
+        mtx_unlock(&pool->mtx_);
+
+        Request* request = chunk->request;
+        zx_status_t rc = ZX_OK;
+        for (size_t i = 0; i < chunk->num_blocks && rc == ZX_OK; i++) {
+            const uint8_t* in = chunk->in + i * block_size;
+            uint8_t* out = chunk->out + i * block_size;
+            if (request->direction == crypto::Cipher::kEncrypt) {
+                if ((rc = worker->encrypt.Tweak(chunk->offset + i)) == ZX_OK) {
+                    rc = worker->encrypt.Encrypt(in, block_size, out);
+                }
+            } else {
+                if ((rc = worker->decrypt.Tweak(chunk->offset + i)) == ZX_OK) {
+                    rc = worker->decrypt.Decrypt(in, block_size, out);
+                }
+            }
+        }
+
+        mtx_lock(&pool->mtx_);
+        if (rc != ZX_OK && request->status == ZX_OK) {
+            xprintf("%s: failed to transform block %" PRIu64 ": %s\n", __PRETTY_FUNCTION__,
+                    chunk->offset, zx_status_get_string(rc));
+            request->status = rc;
+        }
+        if (--request->remaining == 0) {
+            completion_signal(&request->done);
+        }
+    }
+    mtx_unlock(&pool->mtx_);
+
+    return 0;
+}
+
+} // namespace zxcrypt
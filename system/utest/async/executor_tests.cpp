@@ -0,0 +1,214 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <zircon/syscalls.h>
+
+#include <async/executor.h>
+#include <async/task.h>
+#include <async/wait.h>
+
+#include <zx/event.h>
+#include <fbl/atomic.h>
+#include <fbl/function.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+inline zx_time_t now() {
+    return zx_clock_get(ZX_CLOCK_MONOTONIC);
+}
+
+// Each task posts two more, from its handler, until the pool runs out.
+// The last one to run signals |done|.
+class FanOutTask {
+public:
+    static constexpr size_t kCount = 1000u;
+
+    FanOutTask() {
+        op.set_handler(fbl::BindMember(this, &FanOutTask::Handle));
+    }
+
+    void Init(FanOutTask* pool, fbl::atomic<size_t>* next, fbl::atomic<size_t>* finished,
+              const zx::event* done) {
+        pool_ = pool;
+        next_ = next;
+        finished_ = finished;
+        done_ = done;
+    }
+
+    async::Task op;
+    uint32_t run_count = 0u;
+    bool saw_default = false;
+
+private:
+    async_task_result_t Handle(async_t* async, zx_status_t status) {
+        run_count++;
+        saw_default = async_get_default() == async;
+        for (int i = 0; i < 2; i++) {
+            size_t index = next_->fetch_add(1u);
+            if (index >= kCount)
+                break;
+            pool_[index].op.set_deadline(now());
+            pool_[index].op.Post(async);
+        }
+        if (finished_->fetch_add(1u) + 1u == kCount)
+            done_->signal(0u, ZX_USER_SIGNAL_0);
+        return ASYNC_TASK_FINISHED;
+    }
+
+    FanOutTask* pool_;
+    fbl::atomic<size_t>* next_;
+    fbl::atomic<size_t>* finished_;
+    const zx::event* done_;
+};
+
+class TestTask {
+public:
+    TestTask(zx_time_t deadline, const zx::event* done = nullptr)
+        : op(deadline), done_(done) {
+        op.set_handler(fbl::BindMember(this, &TestTask::Handle));
+    }
+
+    async::Task op;
+    uint32_t run_count = 0u;
+    zx_status_t last_status = ZX_ERR_INTERNAL;
+    zx_time_t run_time = 0u;
+
+private:
+    async_task_result_t Handle(async_t* async, zx_status_t status) {
+        run_count++;
+        last_status = status;
+        run_time = now();
+        if (done_)
+            done_->signal(0u, ZX_USER_SIGNAL_0);
+        return ASYNC_TASK_FINISHED;
+    }
+
+    const zx::event* done_;
+};
+
+bool task_fan_out_test() {
+    BEGIN_TEST;
+
+    async_executor_config_t config = {};
+    config.num_threads = 4u;
+    async::Executor executor(&config);
+
+    zx::event done;
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &done), "create event");
+
+    fbl::unique_ptr<FanOutTask[]> pool(new FanOutTask[FanOutTask::kCount]);
+    fbl::atomic<size_t> next(1u);
+    fbl::atomic<size_t> finished(0u);
+    for (size_t i = 0; i < FanOutTask::kCount; i++) {
+        pool[i].Init(pool.get(), &next, &finished, &done);
+    }
+
+    pool[0].op.set_deadline(now());
+    EXPECT_EQ(ZX_OK, pool[0].op.Post(executor.async()), "post");
+    EXPECT_EQ(ZX_OK, done.wait_one(ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, nullptr), "wait");
+
+    executor.Shutdown();
+    for (size_t i = 0; i < FanOutTask::kCount; i++) {
+        EXPECT_EQ(1u, pool[i].run_count, "run count");
+        EXPECT_TRUE(pool[i].saw_default, "default dispatcher");
+    }
+
+    END_TEST;
+}
+
+bool task_deadline_test() {
+    BEGIN_TEST;
+
+    async::Executor executor;
+
+    zx::event done;
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &done), "create event");
+
+    zx_time_t start_time = now();
+    TestTask task1(start_time + ZX_MSEC(10), &done);
+    TestTask task2(start_time + ZX_SEC(1000));
+    EXPECT_EQ(ZX_OK, task1.op.Post(executor.async()), "post 1");
+    EXPECT_EQ(ZX_OK, task2.op.Post(executor.async()), "post 2");
+
+    // Cancel task 2.
+    EXPECT_EQ(ZX_OK, task2.op.Cancel(executor.async()), "cancel 2");
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, task2.op.Cancel(executor.async()), "cancel 2 again");
+
+    EXPECT_EQ(ZX_OK, done.wait_one(ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, nullptr), "wait");
+    executor.Shutdown();
+
+    EXPECT_EQ(1u, task1.run_count, "run count 1");
+    EXPECT_EQ(ZX_OK, task1.last_status, "status 1");
+    EXPECT_GE(task1.run_time, task1.op.deadline(), "deadline 1");
+    EXPECT_EQ(0u, task2.run_count, "run count 2");
+
+    END_TEST;
+}
+
+bool wait_test() {
+    BEGIN_TEST;
+
+    async::Executor executor;
+
+    zx::event event, done;
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &event), "create event");
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &done), "create event");
+
+    uint32_t run_count = 0u;
+    zx_status_t last_status = ZX_ERR_INTERNAL;
+    async::Wait wait(event.get(), ZX_USER_SIGNAL_0);
+    wait.set_handler([&](async_t* async, zx_status_t status, const zx_packet_signal_t* signal) {
+        run_count++;
+        last_status = status;
+        done.signal(0u, ZX_USER_SIGNAL_0);
+        return ASYNC_WAIT_FINISHED;
+    });
+    EXPECT_EQ(ZX_OK, wait.Begin(executor.async()), "begin");
+    EXPECT_EQ(ZX_OK, event.signal(0u, ZX_USER_SIGNAL_0), "signal");
+
+    EXPECT_EQ(ZX_OK, done.wait_one(ZX_USER_SIGNAL_0, ZX_TIME_INFINITE, nullptr), "wait");
+    executor.Shutdown();
+
+    EXPECT_EQ(1u, run_count, "run count");
+    EXPECT_EQ(ZX_OK, last_status, "status");
+
+    END_TEST;
+}
+
+bool shutdown_test() {
+    BEGIN_TEST;
+
+    async::Executor executor;
+
+    TestTask task1(ZX_TIME_INFINITE);
+    task1.op.set_flags(ASYNC_FLAG_HANDLE_SHUTDOWN);
+    TestTask task2(ZX_TIME_INFINITE);
+    EXPECT_EQ(ZX_OK, task1.op.Post(executor.async()), "post 1");
+    EXPECT_EQ(ZX_OK, task2.op.Post(executor.async()), "post 2");
+
+    // When the executor shuts down:
+    //   |task1| notified because it was not yet serviced
+    //   |task2| not notified because it didn't ask to handle shutdown
+    executor.Shutdown();
+    EXPECT_EQ(1u, task1.run_count, "run count 1");
+    EXPECT_EQ(ZX_ERR_CANCELED, task1.last_status, "status 1");
+    EXPECT_EQ(0u, task2.run_count, "run count 2");
+
+    // Nothing more can be posted.
+    TestTask task3(now());
+    EXPECT_EQ(ZX_ERR_BAD_STATE, task3.op.Post(executor.async()), "post 3");
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(executor_tests)
+RUN_TEST(task_fan_out_test)
+RUN_TEST(task_deadline_test)
+RUN_TEST(wait_test)
+RUN_TEST(shutdown_test)
+END_TEST_CASE(executor_tests)
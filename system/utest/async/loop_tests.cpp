@@ -16,6 +16,7 @@
 #include <fbl/auto_lock.h>
 #include <fbl/function.h>
 #include <fbl/mutex.h>
+#include <fbl/unique_ptr.h>
 #include <unittest/unittest.h>
 
 namespace {
@@ -172,6 +173,23 @@ protected:
     }
 };
 
+class OrderedTask : public TestTask {
+public:
+    OrderedTask(zx_time_t deadline, uint32_t id, uint32_t* order, uint32_t* count)
+        : TestTask(deadline), id_(id), order_(order), count_(count) {}
+
+protected:
+    uint32_t id_;
+    uint32_t* order_;
+    uint32_t* count_;
+
+    async_task_result_t Handle(async_t* async, zx_status_t status) override {
+        TestTask::Handle(async, status);
+        order_[(*count_)++] = id_;
+        return ASYNC_TASK_FINISHED;
+    }
+};
+
 class TestReceiver {
 public:
     TestReceiver() {
@@ -550,6 +568,52 @@ bool task_test() {
     END_TEST;
 }
 
+bool task_order_test() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+
+    // Deadlines are scattered over a few hundred milliseconds and posted out of
+    // order, with several tasks sharing each one.
+    const uint32_t kTaskCount = 64u;
+    zx_time_t start_time = now();
+    uint32_t order[kTaskCount];
+    uint32_t count = 0u;
+    fbl::unique_ptr<OrderedTask> tasks[kTaskCount];
+    for (uint32_t i = 0; i < kTaskCount; i++) {
+        zx_time_t deadline = start_time + ZX_MSEC((i * 37u) % 16u * 20u);
+        tasks[i].reset(new OrderedTask(deadline, i, order, &count));
+        EXPECT_EQ(ZX_OK, tasks[i]->op.Post(loop.async()), "post");
+    }
+    QuitTask quit(start_time + ZX_MSEC(400));
+    EXPECT_EQ(ZX_OK, quit.op.Post(loop.async()), "post quit");
+
+    // Cancel a few along the way.
+    for (uint32_t i = 0; i < kTaskCount; i += 9u) {
+        EXPECT_EQ(ZX_OK, tasks[i]->op.Cancel(loop.async()), "cancel");
+    }
+
+    EXPECT_EQ(ZX_ERR_CANCELED, loop.Run(), "run loop");
+    EXPECT_EQ(kTaskCount - (kTaskCount + 8u) / 9u, count, "run count");
+
+    // Tasks ran in deadline order, and in the order they were posted among
+    // those with the same deadline.
+    for (uint32_t i = 1; i < count; i++) {
+        const auto& prev = tasks[order[i - 1]]->op;
+        const auto& cur = tasks[order[i]]->op;
+        EXPECT_TRUE(prev.deadline() < cur.deadline() ||
+                        (prev.deadline() == cur.deadline() && order[i - 1] < order[i]),
+                    "order");
+    }
+    for (uint32_t i = 0; i < kTaskCount; i++) {
+        EXPECT_EQ(i % 9u == 0u ? 0u : 1u, tasks[i]->run_count, "run once");
+    }
+
+    loop.Shutdown();
+
+    END_TEST;
+}
+
 bool task_shutdown_test() {
     BEGIN_TEST;
 
@@ -953,6 +1017,7 @@ RUN_TEST(wait_invalid_handle_test)
 RUN_TEST(wait_shutdown_test)
 RUN_TEST(wait_method_test)
 RUN_TEST(task_test)
+RUN_TEST(task_order_test)
 RUN_TEST(task_shutdown_test)
 RUN_TEST(receiver_test)
 RUN_TEST(receiver_shutdown_test)
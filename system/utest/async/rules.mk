@@ -11,9 +11,11 @@ MODULE_TYPE := usertest
 MODULE_SRCS += \
     $(LOCAL_DIR)/async_stub.cpp \
     $(LOCAL_DIR)/default_tests.cpp \
+    $(LOCAL_DIR)/executor_tests.cpp \
     $(LOCAL_DIR)/loop_tests.cpp \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/receiver_tests.cpp \
+    $(LOCAL_DIR)/sequence_tests.cpp \
     $(LOCAL_DIR)/task_tests.cpp \
     $(LOCAL_DIR)/wait_tests.cpp \
     $(LOCAL_DIR)/wait_with_timeout_tests.cpp
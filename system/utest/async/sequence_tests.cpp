@@ -0,0 +1,179 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <string.h>
+
+#include <zircon/syscalls.h>
+
+#include <async/loop.h>
+#include <async/sequence.h>
+
+#include <zx/channel.h>
+#include <zx/event.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+bool signals_then_deadline_test() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    async::Sequence seq(loop.async());
+
+    zx::event event;
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &event), "create event");
+
+    uint32_t steps = 0u;
+    zx_signals_t observed = ZX_SIGNAL_NONE;
+    zx_status_t last_status = ZX_ERR_INTERNAL;
+    EXPECT_EQ(ZX_OK, seq.AwaitSignals(event.get(), ZX_USER_SIGNAL_0,
+                                      [&](zx_status_t status, zx_signals_t signals) {
+        steps++;
+        observed = signals;
+        // Each step begins the next from its continuation.
+        EXPECT_EQ(ZX_OK, seq.AwaitDeadline(zx_clock_get(ZX_CLOCK_MONOTONIC),
+                                           [&](zx_status_t status) {
+            steps++;
+            last_status = status;
+        }), "await deadline");
+    }), "await signals");
+    EXPECT_TRUE(seq.is_pending(), "pending");
+    EXPECT_EQ(ZX_ERR_BAD_STATE, seq.AwaitDeadline(0u, [](zx_status_t status) {}), "busy");
+
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(0u, steps, "nothing yet");
+
+    EXPECT_EQ(ZX_OK, event.signal(0u, ZX_USER_SIGNAL_0), "signal");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(2u, steps, "both steps");
+    EXPECT_TRUE(observed & ZX_USER_SIGNAL_0, "observed");
+    EXPECT_EQ(ZX_OK, last_status, "status");
+    EXPECT_FALSE(seq.is_pending(), "done");
+
+    END_TEST;
+}
+
+bool read_test() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    async::Sequence seq(loop.async());
+
+    zx::channel local, remote;
+    ASSERT_EQ(ZX_OK, zx::channel::create(0u, &local, &remote), "create channel");
+
+    char buf[16] = {};
+    uint32_t read_bytes = 0u;
+    zx_status_t last_status = ZX_ERR_INTERNAL;
+    auto k = [&](zx_status_t status, uint32_t actual_bytes, uint32_t actual_handles) {
+        last_status = status;
+        read_bytes = actual_bytes;
+    };
+    EXPECT_EQ(ZX_OK, seq.AwaitRead(local.get(), buf, sizeof(buf), nullptr, 0u, k), "await read");
+    EXPECT_EQ(ZX_OK, remote.write(0u, "hello", 5u, nullptr, 0u), "write");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(ZX_OK, last_status, "status");
+    EXPECT_EQ(5u, read_bytes, "bytes");
+    EXPECT_EQ(0, memcmp(buf, "hello", 5u), "contents");
+
+    // Once the peer is gone, there is nothing more to read.
+    remote.reset();
+    EXPECT_EQ(ZX_OK, seq.AwaitRead(local.get(), buf, sizeof(buf), nullptr, 0u, k), "await read");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(ZX_ERR_PEER_CLOSED, last_status, "peer closed");
+
+    END_TEST;
+}
+
+bool call_test() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    async::Sequence client(loop.async());
+    async::Sequence server(loop.async());
+
+    zx::channel local, remote;
+    ASSERT_EQ(ZX_OK, zx::channel::create(0u, &local, &remote), "create channel");
+
+    // The server echoes each request back with its transaction id.
+    uint8_t request[8];
+    auto echo = [&](zx_status_t status, uint32_t actual_bytes, uint32_t actual_handles) {
+        EXPECT_EQ(ZX_OK, status, "server read");
+        EXPECT_EQ(ZX_OK, remote.write(0u, request, actual_bytes, nullptr, 0u), "reply");
+    };
+    EXPECT_EQ(ZX_OK, server.AwaitRead(remote.get(), request, sizeof(request), nullptr, 0u, echo),
+              "server await");
+
+    uint32_t out[2] = {42u, 7u};
+    uint32_t in[2] = {};
+    zx_channel_call_args_t args = {};
+    args.wr_bytes = out;
+    args.wr_num_bytes = sizeof(out);
+    args.rd_bytes = in;
+    args.rd_num_bytes = sizeof(in);
+    zx_status_t last_status = ZX_ERR_INTERNAL;
+    auto k = [&](zx_status_t status, uint32_t actual_bytes, uint32_t actual_handles) {
+        last_status = status;
+    };
+    EXPECT_EQ(ZX_OK, client.AwaitCall(local.get(), args, k), "call");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(ZX_OK, last_status, "status");
+    EXPECT_EQ(42u, in[0], "txid");
+    EXPECT_EQ(7u, in[1], "payload");
+
+    // A reply with the wrong transaction id is an error.
+    out[0] = 43u;
+    EXPECT_EQ(ZX_OK, client.AwaitCall(local.get(), args, k), "call");
+    uint32_t wrong[2] = {44u, 0u};
+    EXPECT_EQ(ZX_OK, remote.read(0u, request, sizeof(request), nullptr, nullptr, 0u, nullptr),
+              "drain");
+    EXPECT_EQ(ZX_OK, remote.write(0u, wrong, sizeof(wrong), nullptr, 0u), "reply");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(ZX_ERR_IO, last_status, "mismatch");
+
+    // Too short to carry an id.
+    args.wr_num_bytes = 2u;
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS, client.AwaitCall(local.get(), args, k), "short");
+
+    END_TEST;
+}
+
+bool cancel_test() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    async::Sequence seq(loop.async());
+
+    zx::event event;
+    ASSERT_EQ(ZX_OK, zx::event::create(0u, &event), "create event");
+
+    bool ran = false;
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, seq.Cancel(), "nothing to cancel");
+    EXPECT_EQ(ZX_OK, seq.AwaitSignals(event.get(), ZX_USER_SIGNAL_0,
+                                      [&](zx_status_t status, zx_signals_t signals) {
+        ran = true;
+    }), "await signals");
+    EXPECT_EQ(ZX_OK, seq.Cancel(), "cancel wait");
+    EXPECT_FALSE(seq.is_pending(), "not pending");
+
+    EXPECT_EQ(ZX_OK, seq.AwaitDeadline(ZX_TIME_INFINITE, [&](zx_status_t status) {
+        ran = true;
+    }), "await deadline");
+    EXPECT_EQ(ZX_OK, seq.Cancel(), "cancel task");
+
+    EXPECT_EQ(ZX_OK, event.signal(0u, ZX_USER_SIGNAL_0), "signal");
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_FALSE(ran, "canceled steps don't run");
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(sequence_tests)
+RUN_TEST(signals_then_deadline_test)
+RUN_TEST(read_test)
+RUN_TEST(call_test)
+RUN_TEST(cancel_test)
+END_TEST_CASE(sequence_tests)
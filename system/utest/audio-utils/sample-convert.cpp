@@ -0,0 +1,257 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio-utils/sample-convert.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+
+using namespace audio::utils;
+
+// The vector kernels must agree exactly with these, for every length, so
+// that the scalar tail and the vector body are indistinguishable.
+
+namespace {
+
+constexpr size_t kMaxLen = 67;
+
+float RefS16ToFloat(int16_t v) { return static_cast<float>(v) / 32768.0f; }
+
+int16_t RefFloatToS16(float v) {
+    v = fminf(fmaxf(v * 32768.0f, -32768.0f), 32767.0f);
+    return static_cast<int16_t>(lrintf(v));
+}
+
+float RefS24In32ToFloat(int32_t v) { return static_cast<float>(v >> 8) / 8388608.0f; }
+
+int32_t RefFloatToS24In32(float v) {
+    v = fminf(fmaxf(v * 8388608.0f, -8388608.0f), 8388607.0f);
+    return static_cast<int32_t>(static_cast<uint32_t>(lrintf(v)) << 8);
+}
+
+unsigned rand_state = 1;
+
+uint32_t NextRand() {
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+// Mostly in range, with some out of range to exercise saturation, and
+// exact half steps to exercise rounding.
+float RandSample() {
+    uint32_t r = NextRand();
+    if ((r & 0xf) == 0)
+        return (static_cast<float>(static_cast<int32_t>(r >> 4 & 0xffff) - 0x8000) + 0.5f) /
+               32768.0f;
+    return (static_cast<float>(r >> 4 & 0xfffff) / static_cast<float>(0x80000)) - 1.05f;
+}
+
+bool s16_float_test() {
+    BEGIN_TEST;
+
+    int16_t src[kMaxLen];
+    float dst[kMaxLen + 1];
+    int16_t back[kMaxLen + 1];
+    for (size_t len = 0; len <= kMaxLen; ++len) {
+        for (size_t i = 0; i < len; ++i)
+            src[i] = static_cast<int16_t>(NextRand());
+        dst[len] = 42.0f;
+        ConvertS16ToFloat(src, dst, len);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(RefS16ToFloat(src[i]), dst[i], "");
+        ASSERT_EQ(42.0f, dst[len], "wrote past the end");
+
+        // Every 16 bit value survives a round trip.
+        back[len] = 42;
+        ConvertFloatToS16(dst, back, len);
+        ASSERT_EQ(0, memcmp(src, back, len * sizeof(src[0])), "");
+        ASSERT_EQ(42, back[len], "wrote past the end");
+    }
+
+    float f[kMaxLen];
+    int16_t s[kMaxLen];
+    for (size_t len = 0; len <= kMaxLen; ++len) {
+        for (size_t i = 0; i < len; ++i)
+            f[i] = RandSample();
+        ConvertFloatToS16(f, s, len);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(RefFloatToS16(f[i]), s[i], "");
+    }
+
+    END_TEST;
+}
+
+bool s24_float_test() {
+    BEGIN_TEST;
+
+    int32_t src[kMaxLen];
+    float dst[kMaxLen + 1];
+    int32_t back[kMaxLen + 1];
+    for (size_t len = 0; len <= kMaxLen; ++len) {
+        // The low byte is padding, and is ignored.
+        for (size_t i = 0; i < len; ++i)
+            src[i] = static_cast<int32_t>((NextRand() << 8) | (NextRand() & 0xff));
+        dst[len] = 42.0f;
+        ConvertS24In32ToFloat(src, dst, len);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(RefS24In32ToFloat(src[i]), dst[i], "");
+        ASSERT_EQ(42.0f, dst[len], "wrote past the end");
+
+        back[len] = 42;
+        ConvertFloatToS24In32(dst, back, len);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(src[i] & ~0xff, back[i], "");
+        ASSERT_EQ(42, back[len], "wrote past the end");
+    }
+
+    float f[kMaxLen];
+    int32_t s[kMaxLen];
+    for (size_t len = 0; len <= kMaxLen; ++len) {
+        for (size_t i = 0; i < len; ++i)
+            f[i] = RandSample() / 256.0f;
+        ConvertFloatToS24In32(f, s, len);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(RefFloatToS24In32(f[i]), s[i], "");
+    }
+
+    END_TEST;
+}
+
+bool gain_test() {
+    BEGIN_TEST;
+
+    float orig[kMaxLen + 1];
+    float buf[kMaxLen + 1];
+    for (size_t len = 0; len <= kMaxLen; ++len) {
+        for (size_t i = 0; i <= len; ++i)
+            orig[i] = buf[i] = RandSample();
+        ApplyGain(buf, len, 0.3f);
+        for (size_t i = 0; i < len; ++i)
+            ASSERT_EQ(orig[i] * 0.3f, buf[i], "");
+        ASSERT_EQ(orig[len], buf[len], "wrote past the end");
+    }
+
+    END_TEST;
+}
+
+bool interleave_test() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kMaxChannels = 6;
+    float planes[kMaxChannels][kMaxLen];
+    float out_planes[kMaxChannels][kMaxLen];
+    float interleaved[kMaxChannels * kMaxLen];
+    const float* in[kMaxChannels];
+    float* out[kMaxChannels];
+    for (uint32_t c = 0; c < kMaxChannels; ++c) {
+        in[c] = planes[c];
+        out[c] = out_planes[c];
+        for (size_t i = 0; i < kMaxLen; ++i)
+            planes[c][i] = RandSample();
+    }
+
+    for (uint32_t channels = 1; channels <= kMaxChannels; ++channels) {
+        for (size_t frames = 0; frames <= kMaxLen; ++frames) {
+            Interleave(in, channels, frames, interleaved);
+            for (size_t i = 0; i < frames; ++i) {
+                for (uint32_t c = 0; c < channels; ++c)
+                    ASSERT_EQ(planes[c][i], interleaved[i * channels + c], "");
+            }
+
+            Deinterleave(interleaved, channels, frames, out);
+            for (uint32_t c = 0; c < channels; ++c)
+                ASSERT_EQ(0, memcmp(planes[c], out_planes[c], frames * sizeof(float)), "");
+        }
+    }
+
+    END_TEST;
+}
+
+// Benchmarks.
+
+constexpr size_t kBenchSamples = 1u << 18;
+constexpr int kBenchIterations = 100;
+
+void PrintRate(const char* what, uint64_t start) {
+    uint64_t ticks = zx_ticks_get() - start;
+    uint64_t nsec = ticks * 1000000000 / zx_ticks_per_second();
+    printf("\nBenchmark %s: [%8.3f] nsec per sample\n", what,
+           static_cast<double>(nsec) / (kBenchIterations * static_cast<double>(kBenchSamples)));
+}
+
+bool sample_convert_benchmarks() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<float[]> f(new (&ac) float[kBenchSamples]);
+    ASSERT_TRUE(ac.check(), "");
+    fbl::unique_ptr<float[]> f2(new (&ac) float[kBenchSamples]);
+    ASSERT_TRUE(ac.check(), "");
+    fbl::unique_ptr<int16_t[]> s16(new (&ac) int16_t[kBenchSamples]);
+    ASSERT_TRUE(ac.check(), "");
+    fbl::unique_ptr<int32_t[]> s32(new (&ac) int32_t[kBenchSamples]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kBenchSamples; ++i)
+        f[i] = RandSample();
+
+    uint64_t start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        ConvertFloatToS16(f.get(), s16.get(), kBenchSamples);
+    PrintRate("float->s16", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        ConvertS16ToFloat(s16.get(), f2.get(), kBenchSamples);
+    PrintRate("s16->float", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        ConvertFloatToS24In32(f.get(), s32.get(), kBenchSamples);
+    PrintRate("float->s24in32", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        ConvertS24In32ToFloat(s32.get(), f2.get(), kBenchSamples);
+    PrintRate("s24in32->float", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        ApplyGain(f2.get(), kBenchSamples, 0.999f);
+    PrintRate("gain", start);
+
+    // Stereo, as the planes of |f| and the interleaved frames in |f2|.
+    const float* in[2] = { f.get(), f.get() + kBenchSamples / 2 };
+    float* out[2] = { f.get(), f.get() + kBenchSamples / 2 };
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        Interleave(in, 2, kBenchSamples / 2, f2.get());
+    PrintRate("interleave stereo", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < kBenchIterations; ++i)
+        Deinterleave(f2.get(), 2, kBenchSamples / 2, out);
+    PrintRate("deinterleave stereo", start);
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(sample_convert_tests)
+RUN_TEST(s16_float_test)
+RUN_TEST(s24_float_test)
+RUN_TEST(gain_test)
+RUN_TEST(interleave_test)
+RUN_TEST_PERFORMANCE(sample_convert_benchmarks)
+END_TEST_CASE(sample_convert_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
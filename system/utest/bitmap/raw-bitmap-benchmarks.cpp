@@ -0,0 +1,81 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+
+#include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+
+namespace bitmap {
+namespace tests {
+namespace {
+
+constexpr size_t kIterations = 100;
+
+void PrintTime(const char* what, size_t bits, uint64_t start) {
+    uint64_t end = zx_ticks_get();
+    uint64_t ticks_per_usec = zx_ticks_per_second() / 1000000;
+    printf("\nBenchmark %s (%zu bits): [%10lu] usec/iter\n", what, bits,
+           (end - start) / ticks_per_usec / kIterations);
+}
+
+// Searches for the single clear bit at the end of an otherwise full bitmap,
+// which is what an allocator sees on a nearly full volume.
+template <size_t Bits>
+bool FindInFullBitmap() {
+    BEGIN_TEST;
+
+    RawBitmapGeneric<DefaultStorage> bitmap;
+    ASSERT_EQ(bitmap.Reset(Bits), ZX_OK, "");
+    ASSERT_EQ(bitmap.Set(0, Bits - 1), ZX_OK, "");
+
+    size_t out;
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < kIterations; i++) {
+        ASSERT_EQ(bitmap.Find(false, 0, Bits, 1, &out), ZX_OK, "");
+    }
+    PrintTime("find single clear bit", Bits, start);
+    EXPECT_EQ(out, Bits - 1, "");
+
+    END_TEST;
+}
+
+// Searches for a long run of set bits among many short ones.
+template <size_t Bits>
+bool FindRunInFragmentedBitmap() {
+    BEGIN_TEST;
+
+    constexpr size_t kRun = 1024;
+    RawBitmapGeneric<DefaultStorage> bitmap;
+    ASSERT_EQ(bitmap.Reset(Bits), ZX_OK, "");
+    for (size_t i = 0; i + 64 < Bits - kRun; i += 97) {
+        ASSERT_EQ(bitmap.Set(i, i + 64), ZX_OK, "");
+    }
+    ASSERT_EQ(bitmap.Set(Bits - kRun, Bits), ZX_OK, "");
+
+    size_t out;
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < kIterations; i++) {
+        ASSERT_EQ(bitmap.Find(true, 0, Bits, kRun, &out), ZX_OK, "");
+    }
+    PrintTime("find run of set bits", Bits, start);
+    EXPECT_EQ(out, Bits - kRun, "");
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(raw_bitmap_benchmarks)
+RUN_TEST_PERFORMANCE((FindInFullBitmap<1 << 20>))
+RUN_TEST_PERFORMANCE((FindInFullBitmap<1 << 24>))
+RUN_TEST_PERFORMANCE((FindInFullBitmap<1 << 28>))
+RUN_TEST_PERFORMANCE((FindRunInFragmentedBitmap<1 << 20>))
+RUN_TEST_PERFORMANCE((FindRunInFragmentedBitmap<1 << 24>))
+END_TEST_CASE(raw_bitmap_benchmarks)
+
+} // namespace tests
+} // namespace bitmap
@@ -7,6 +7,7 @@
 
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
 #include <unittest/unittest.h>
 
 namespace bitmap {
@@ -441,19 +442,136 @@ static bool GrowFailure(void) {
     END_TEST;
 }
 
+// A small, deterministic pseudo-random number generator for the tests below.
+class TestRng {
+public:
+    explicit TestRng(uint64_t seed) : state_(seed) {}
+    size_t Next(size_t limit) {
+        state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+        return static_cast<size_t>(state_ >> 33) % limit;
+    }
+
+private:
+    uint64_t state_;
+};
+
+// Checks Scan and Find on |bitmap| against a naive bit-by-bit walk of
+// |shadow|, which holds the expected value of every bit.
+template <typename RawBitmap>
+static bool CheckAgainstShadow(const RawBitmap& bitmap, const uint8_t* shadow,
+                               size_t bitoff, size_t bitmax, size_t run_len) {
+    BEGIN_HELPER;
+
+    for (int is_set = 0; is_set < 2; ++is_set) {
+        size_t expected = bitoff;
+        while (expected < bitmax && shadow[expected] == is_set) {
+            ++expected;
+        }
+        EXPECT_EQ(bitmap.Scan(bitoff, bitmax, is_set != 0), expected, "scan");
+
+        size_t expected_run = bitmax;
+        size_t run = 0;
+        for (size_t i = bitoff; i < bitmax; ++i) {
+            run = (shadow[i] == is_set) ? run + 1 : 0;
+            if (run == run_len) {
+                expected_run = i + 1 - run_len;
+                break;
+            }
+        }
+        size_t out;
+        zx_status_t status = bitmap.Find(is_set != 0, bitoff, bitmax, run_len, &out);
+        EXPECT_EQ(status, expected_run == bitmax ? ZX_ERR_NO_RESOURCES : ZX_OK, "find status");
+        EXPECT_EQ(out, expected_run, "find");
+    }
+
+    END_HELPER;
+}
+
+// Fills a bitmap mostly full, with scattered holes, and checks that scanning
+// agrees with a naive walk.  |size| decides whether the bitmap keeps a
+// summary of its full words.
+template <typename RawBitmap, size_t size>
+static bool ScanMatchesNaive(void) {
+    BEGIN_TEST;
+
+    RawBitmap bitmap;
+    ASSERT_EQ(bitmap.Reset(size), ZX_OK);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> shadow(new (&ac) uint8_t[size]());
+    ASSERT_TRUE(ac.check());
+
+    TestRng rng(size);
+    for (size_t round = 0; round < 64; ++round) {
+        // Mostly large sets, with a few small clears punching holes in them.
+        size_t bitoff = rng.Next(size);
+        bool set = rng.Next(4) != 0;
+        size_t len = set ? rng.Next(size / 8) : rng.Next(200);
+        size_t bitmax = fbl::min(size, bitoff + len);
+        if (set) {
+            ASSERT_EQ(bitmap.Set(bitoff, bitmax), ZX_OK);
+        } else {
+            ASSERT_EQ(bitmap.Clear(bitoff, bitmax), ZX_OK);
+        }
+        memset(&shadow[bitoff], set ? 1 : 0, bitmax - bitoff);
+
+        ASSERT_TRUE(CheckAgainstShadow(bitmap, shadow.get(), 0, size, 1 + rng.Next(100)));
+        size_t start = rng.Next(size);
+        ASSERT_TRUE(CheckAgainstShadow(bitmap, shadow.get(), start,
+                                       start + rng.Next(size - start) + 1, 1 + rng.Next(8)));
+    }
+
+    END_TEST;
+}
+
+// Bits changed behind the bitmap's back are seen once the summary is rebuilt.
+template <typename RawBitmap>
+static bool RebuildSummaryAfterDirectWrite(void) {
+    BEGIN_TEST;
+
+    constexpr size_t kSize = kBits * kBits * kBits;
+    RawBitmap bitmap;
+    ASSERT_EQ(bitmap.Reset(kSize), ZX_OK);
+    ASSERT_EQ(bitmap.Set(0, kSize), ZX_OK);
+    EXPECT_TRUE(bitmap.Get(0, kSize));
+
+    constexpr size_t kHole = kSize / 2 + 3;
+    size_t* data = static_cast<size_t*>(const_cast<void*>(bitmap.StorageUnsafe()->GetData()));
+    data[kHole / kBits] &= ~(static_cast<size_t>(1) << (kHole % kBits));
+    bitmap.RebuildSummary();
+
+    size_t first_unset;
+    EXPECT_FALSE(bitmap.Get(0, kSize, &first_unset));
+    EXPECT_EQ(first_unset, kHole);
+    size_t out;
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), ZX_OK);
+    EXPECT_EQ(out, kHole);
+
+    // Set and Clear keep the summary up to date from here.
+    EXPECT_EQ(bitmap.SetOne(kHole), ZX_OK);
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), ZX_ERR_NO_RESOURCES);
+    EXPECT_EQ(bitmap.ClearOne(kSize - 1), ZX_OK);
+    EXPECT_EQ(bitmap.Find(false, 0, kSize, 1, &out), ZX_OK);
+    EXPECT_EQ(out, kSize - 1);
+
+    END_TEST;
+}
+
 #define RUN_TEMPLATIZED_TEST(test, specialization) RUN_TEST(test<specialization>)
-#define ALL_TESTS(specialization)                           \
-    RUN_TEMPLATIZED_TEST(InitializedEmpty, specialization)  \
-    RUN_TEMPLATIZED_TEST(SingleBit, specialization)         \
-    RUN_TEMPLATIZED_TEST(SetTwice, specialization)          \
-    RUN_TEMPLATIZED_TEST(ClearTwice, specialization)        \
-    RUN_TEMPLATIZED_TEST(GetReturnArg, specialization)      \
-    RUN_TEMPLATIZED_TEST(SetRange, specialization)          \
-    RUN_TEMPLATIZED_TEST(FindSimple, specialization)        \
-    RUN_TEMPLATIZED_TEST(ClearSubrange, specialization)     \
-    RUN_TEMPLATIZED_TEST(BoundaryArguments, specialization) \
-    RUN_TEMPLATIZED_TEST(ClearAll, specialization)          \
-    RUN_TEMPLATIZED_TEST(SetOutOfOrder, specialization)
+#define ALL_TESTS(specialization)                                            \
+    RUN_TEMPLATIZED_TEST(InitializedEmpty, specialization)                   \
+    RUN_TEMPLATIZED_TEST(SingleBit, specialization)                          \
+    RUN_TEMPLATIZED_TEST(SetTwice, specialization)                           \
+    RUN_TEMPLATIZED_TEST(ClearTwice, specialization)                         \
+    RUN_TEMPLATIZED_TEST(GetReturnArg, specialization)                       \
+    RUN_TEMPLATIZED_TEST(SetRange, specialization)                           \
+    RUN_TEMPLATIZED_TEST(FindSimple, specialization)                         \
+    RUN_TEMPLATIZED_TEST(ClearSubrange, specialization)                      \
+    RUN_TEMPLATIZED_TEST(BoundaryArguments, specialization)                  \
+    RUN_TEMPLATIZED_TEST(ClearAll, specialization)                           \
+    RUN_TEMPLATIZED_TEST(SetOutOfOrder, specialization)                      \
+    RUN_TEST((ScanMatchesNaive<specialization, 5000>))                       \
+    RUN_TEST((ScanMatchesNaive<specialization, kBits * kBits * kBits + 77>)) \
+    RUN_TEMPLATIZED_TEST(RebuildSummaryAfterDirectWrite, specialization)
 
 BEGIN_TEST_CASE(raw_bitmap_tests)
 ALL_TESTS(RawBitmapGeneric<DefaultStorage>)
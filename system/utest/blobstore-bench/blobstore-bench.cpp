@@ -25,7 +25,6 @@
 using digest::Digest;
 using digest::MerkleTree;
 
-#define MOUNT_PATH "/blobbench"
 #define RESULT_FILE "/tmp/benchmark.csv"
 #define END_COUNT 100
 
@@ -36,7 +35,7 @@ using digest::MerkleTree;
    RUN_TEST_PERFORMANCE((test_type<blob_size, blob_count, FIRST>))   \
    RUN_TEST_PERFORMANCE((test_type<blob_size, blob_count, LAST>))
 
-static char start_time[50];
+char start_time[50];
 
 // Sets start_time to current time reported by rtc
 // Returns 0 on success, -1 otherwise
@@ -65,7 +64,7 @@ static int GetStartTime() {
 
 // Creates, writes, reads (to verify) and operates on a blob.
 // Returns the result of the post-processing 'func' (true == success).
-static bool GenerateBlob(fbl::unique_ptr<blob_info_t>* out, size_t blob_size) {
+bool GenerateBlob(fbl::unique_ptr<blob_info_t>* out, size_t blob_size) {
     // Generate a Blob of random data
     fbl::AllocChecker ac;
     fbl::unique_ptr<blob_info_t> info(new (&ac) blob_info_t);
@@ -103,21 +102,6 @@ static bool GenerateBlob(fbl::unique_ptr<blob_info_t>* out, size_t blob_size) {
     return true;
 }
 
-// Helper for streaming operations (such as read, write) which may need to be
-// repeated multiple times.
-template <typename T, typename U>
-static inline int StreamAll(T func, int fd, U* buf, size_t max) {
-    size_t n = 0;
-    while (n != max) {
-        ssize_t d = func(fd, &buf[n], max - n);
-        if (d < 0) {
-            return -1;
-        }
-        n += d;
-    }
-    return 0;
-}
-
 
 TestData::TestData(size_t blob_size, size_t blob_count, traversal_order_t order) : blob_size(blob_size), blob_count(blob_count), order(order) {
     indices = new size_t[blob_count];
@@ -431,7 +415,7 @@ bool TestData::unlink_blobs() {
     return true;
 }
 
-static bool StartBlobstoreBenchmark(size_t blob_size, size_t blob_count, traversal_order_t order) {
+bool StartBlobstoreBenchmark(size_t blob_size, size_t blob_count) {
     int mountfd = open(MOUNT_PATH, O_RDONLY);
     ASSERT_GT(mountfd, 0, "Failed to open - expected mounted blobstore partition");
 
@@ -453,7 +437,7 @@ static bool StartBlobstoreBenchmark(size_t blob_size, size_t blob_count, travers
     return true;
 }
 
-static bool EndBlobstoreBenchmark() {
+bool EndBlobstoreBenchmark() {
     DIR* dir = opendir(MOUNT_PATH);
     struct dirent* de;
     ASSERT_NONNULL(dir);
@@ -471,7 +455,7 @@ static bool EndBlobstoreBenchmark() {
 template <size_t BlobSize, size_t BlobCount, traversal_order_t Order>
 static bool benchmark_blob_basic() {
     BEGIN_TEST;
-    ASSERT_TRUE(StartBlobstoreBenchmark(BlobSize, BlobCount, Order));
+    ASSERT_TRUE(StartBlobstoreBenchmark(BlobSize, BlobCount));
     TestData data(BlobSize, BlobCount, Order);
     bool success = data.run_tests();
     ASSERT_TRUE(EndBlobstoreBenchmark()); //clean up
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#define MOUNT_PATH "/blobbench"
+
 constexpr size_t B = (1);
 constexpr size_t KB = (1 << 10);
 constexpr size_t MB = (1 << 20);
@@ -37,6 +39,33 @@ typedef struct blob_info {
     size_t size_data;
 } blob_info_t;
 
+// Helper for streaming operations (such as read, write) which may need to be
+// repeated multiple times.
+template <typename T, typename U>
+static inline int StreamAll(T func, int fd, U* buf, size_t max) {
+    size_t n = 0;
+    while (n != max) {
+        ssize_t d = func(fd, &buf[n], max - n);
+        if (d < 0) {
+            return -1;
+        }
+        n += d;
+    }
+    return 0;
+}
+
+// Fills |out| with |blob_size| bytes of random data, its merkle tree and
+// its path under MOUNT_PATH.
+bool GenerateBlob(fbl::unique_ptr<blob_info_t>* out, size_t blob_size);
+
+// Checks that MOUNT_PATH is an empty blobstore with room for the blobs, and
+// unlinks everything in it afterwards.
+bool StartBlobstoreBenchmark(size_t blob_size, size_t blob_count);
+bool EndBlobstoreBenchmark();
+
+// When the benchmarks started, as reported by the rtc, for the results files.
+extern char start_time[50];
+
 class TestData {
 public:
     TestData(size_t blob_size, size_t blob_count, traversal_order_t order);
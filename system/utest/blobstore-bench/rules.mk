@@ -12,6 +12,7 @@ MODULE_NAME := blobstore-bench-test
 
 MODULE_SRCS := \
     $(LOCAL_DIR)/blobstore-bench.cpp \
+    $(LOCAL_DIR)/workload.cpp \
 
 MODULE_STATIC_LIBS := \
     system/ulib/digest \
@@ -22,6 +23,7 @@ MODULE_STATIC_LIBS := \
 MODULE_LIBS := \
     system/ulib/c \
     system/ulib/fdio \
+    system/ulib/fs-management \
     system/ulib/zircon \
     system/ulib/unittest \
 
@@ -0,0 +1,403 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Workloads closer to what boot does than the single threaded, warm cache
+// runs of blobstore_benchmarks: blobs of mixed sizes, written and read by
+// several threads at once, with blobstore remounted between the phases so
+// that every read starts with cold caches.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <fs-management/mount.h>
+#include <zircon/device/block.h>
+#include <zircon/device/vfs.h>
+#include <zircon/syscalls.h>
+#include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <fbl/new.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <unittest/unittest.h>
+
+#include "blobstore-bench.h"
+
+#define WORKLOAD_RESULT_FILE "/tmp/benchmark-workloads.csv"
+// A file of "<size>[K|M] [count]" lines, # starting a comment.
+#define MANIFEST_ENV "BLOBSTORE_BENCH_MANIFEST"
+
+namespace {
+
+// Used when no manifest is given: mostly small blobs and a few large ones,
+// in roughly the proportions of a system image.
+const struct {
+    size_t size;
+    size_t count;
+} kDefaultManifest[] = {
+    {1 * KB, 200},
+    {4 * KB, 300},
+    {16 * KB, 200},
+    {64 * KB, 100},
+    {256 * KB, 50},
+    {1 * MB, 20},
+    {4 * MB, 5},
+};
+
+struct DeviceCounters {
+    uint64_t read_bytes = 0;
+    uint64_t write_bytes = 0;
+};
+
+// The results of one phase, over every blob.
+struct Phase {
+    const char* name;
+    fbl::unique_ptr<zx_time_t[]> samples;
+    zx_time_t elapsed;
+    uint64_t bytes;
+    DeviceCounters device;
+};
+
+struct Workload {
+    const char* name;
+    fbl::Vector<size_t> sizes;
+    uint32_t threads;
+    char device_path[PATH_MAX];
+    fbl::unique_ptr<fbl::unique_ptr<char[]>[]> paths;
+    // Indices into |sizes|, in the order the workers take blobs.
+    fbl::unique_ptr<size_t[]> order;
+    fbl::atomic<size_t> next;
+    fbl::atomic<bool> failed;
+    Phase* phase;
+};
+
+bool LoadManifest(fbl::Vector<size_t>* sizes) {
+    const char* path = getenv(MANIFEST_ENV);
+    fbl::AllocChecker ac;
+    if (path == nullptr) {
+        for (const auto& entry : kDefaultManifest) {
+            for (size_t i = 0; i < entry.count; i++) {
+                sizes->push_back(entry.size, &ac);
+                ASSERT_TRUE(ac.check());
+            }
+        }
+        return true;
+    }
+
+    FILE* manifest = fopen(path, "r");
+    ASSERT_NONNULL(manifest, "Failed to open manifest");
+    char line[128];
+    while (fgets(line, sizeof(line), manifest) != nullptr) {
+        char* p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\0')
+            continue;
+
+        char* end;
+        size_t size = strtoul(p, &end, 0);
+        if (*end == 'K' || *end == 'k') {
+            size *= KB;
+            end++;
+        } else if (*end == 'M' || *end == 'm') {
+            size *= MB;
+            end++;
+        }
+        size_t count = strtoul(end, &end, 0);
+        if (count == 0)
+            count = 1;
+        ASSERT_GT(size, 0u, "Bad manifest line");
+        for (size_t i = 0; i < count; i++) {
+            sizes->push_back(size, &ac);
+            ASSERT_TRUE(ac.check());
+        }
+    }
+    fclose(manifest);
+    ASSERT_GT(sizes->size(), 0u, "Empty manifest");
+    return true;
+}
+
+// Sums the blocks the device's clients have transferred.  The counters are
+// per client, and go away when blobstore does at unmount, so only compare
+// values taken during a single mount.
+void ReadDeviceCounters(const char* device_path, DeviceCounters* out) {
+    *out = DeviceCounters();
+    int fd = open(device_path, O_RDONLY);
+    if (fd < 0)
+        return;
+    block_info_t info;
+    block_stats_t stats;
+    if (ioctl_block_get_info(fd, &info) >= 0 && ioctl_block_get_stats(fd, &stats) >= 0) {
+        uint32_t clients = fbl::min(stats.client_count,
+                                    static_cast<uint32_t>(BLOCK_STATS_MAX_CLIENTS));
+        for (uint32_t i = 0; i < clients; i++) {
+            out->read_bytes += stats.clients[i].read.blocks * info.block_size;
+            out->write_bytes += stats.clients[i].write.blocks * info.block_size;
+        }
+    }
+    close(fd);
+}
+
+// Restarts blobstore, which throws away every cache it has.
+bool Remount(const char* device_path) {
+    ASSERT_EQ(umount(MOUNT_PATH), ZX_OK, "Failed to unmount blobstore");
+    int fd = open(device_path, O_RDWR);
+    ASSERT_GE(fd, 0, "Failed to open block device");
+    ASSERT_EQ(mount(fd, MOUNT_PATH, DISK_FORMAT_BLOBFS, &default_mount_options,
+                    launch_stdio_async), ZX_OK, "Failed to remount blobstore");
+    return true;
+}
+
+int WriteWorker(void* arg) {
+    Workload* w = static_cast<Workload*>(arg);
+    for (size_t i; (i = w->next.fetch_add(1)) < w->sizes.size();) {
+        size_t index = w->order[i];
+        size_t size = w->sizes[index];
+        fbl::unique_ptr<blob_info_t> info;
+        if (!GenerateBlob(&info, size)) {
+            w->failed.store(true);
+            return -1;
+        }
+        strcpy(w->paths[index].get(), info->path);
+
+        zx_time_t start = zx_ticks_get();
+        int fd = open(info->path, O_CREAT | O_RDWR);
+        bool ok = fd >= 0 && ftruncate(fd, size) == 0 &&
+                  StreamAll(write, fd, info->data.get(), size) == 0;
+        ok = (fd >= 0 && close(fd) == 0) && ok;
+        w->phase->samples[i] = zx_ticks_get() - start;
+        if (!ok) {
+            w->failed.store(true);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int ReadWorker(void* arg) {
+    Workload* w = static_cast<Workload*>(arg);
+    size_t max_size = 0;
+    for (size_t size : w->sizes)
+        max_size = fbl::max(max_size, size);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buf(new (&ac) char[max_size]);
+    if (!ac.check()) {
+        w->failed.store(true);
+        return -1;
+    }
+
+    for (size_t i; (i = w->next.fetch_add(1)) < w->sizes.size();) {
+        size_t index = w->order[i];
+        zx_time_t start = zx_ticks_get();
+        int fd = open(w->paths[index].get(), O_RDONLY);
+        bool ok = fd >= 0 && StreamAll(read, fd, buf.get(), w->sizes[index]) == 0;
+        ok = (fd >= 0 && close(fd) == 0) && ok;
+        w->phase->samples[i] = zx_ticks_get() - start;
+        if (!ok) {
+            w->failed.store(true);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int UnlinkWorker(void* arg) {
+    Workload* w = static_cast<Workload*>(arg);
+    for (size_t i; (i = w->next.fetch_add(1)) < w->sizes.size();) {
+        zx_time_t start = zx_ticks_get();
+        int r = unlink(w->paths[w->order[i]].get());
+        w->phase->samples[i] = zx_ticks_get() - start;
+        if (r != 0) {
+            w->failed.store(true);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Visits the blobs in a random order, the same one for every thread count.
+void Shuffle(Workload* w, unsigned int seed) {
+    size_t count = w->sizes.size();
+    for (size_t i = 0; i < count; i++)
+        w->order[i] = i;
+    for (size_t i = count - 1; i > 0; i--) {
+        size_t j = rand_r(&seed) % (i + 1);
+        size_t tmp = w->order[i];
+        w->order[i] = w->order[j];
+        w->order[j] = tmp;
+    }
+}
+
+bool RunPhase(Workload* w, Phase* phase, const char* name, thrd_start_t worker,
+              bool counts_bytes) {
+    size_t count = w->sizes.size();
+    fbl::AllocChecker ac;
+    phase->name = name;
+    phase->samples.reset(new (&ac) zx_time_t[count]);
+    ASSERT_TRUE(ac.check());
+    phase->bytes = 0;
+    if (counts_bytes) {
+        for (size_t size : w->sizes)
+            phase->bytes += size;
+    }
+
+    w->phase = phase;
+    w->next.store(0);
+    DeviceCounters before;
+    ReadDeviceCounters(w->device_path, &before);
+
+    zx_time_t start = zx_ticks_get();
+    thrd_t threads[w->threads];
+    uint32_t started = 0;
+    for (; started < w->threads; started++) {
+        if (thrd_create(&threads[started], worker, w) != thrd_success)
+            break;
+    }
+    for (uint32_t i = 0; i < started; i++)
+        thrd_join(threads[i], nullptr);
+    phase->elapsed = zx_ticks_get() - start;
+
+    ReadDeviceCounters(w->device_path, &phase->device);
+    phase->device.read_bytes -= fbl::min(phase->device.read_bytes, before.read_bytes);
+    phase->device.write_bytes -= fbl::min(phase->device.write_bytes, before.write_bytes);
+
+    ASSERT_GT(started, 0u, "Failed to create worker threads");
+    ASSERT_FALSE(w->failed.load(), "Phase failed");
+    return true;
+}
+
+int CompareTicks(const void* a, const void* b) {
+    zx_time_t ta = *static_cast<const zx_time_t*>(a);
+    zx_time_t tb = *static_cast<const zx_time_t*>(b);
+    return ta < tb ? -1 : ta > tb;
+}
+
+bool ReportPhase(const Workload& w, Phase* phase) {
+    size_t count = w.sizes.size();
+    qsort(phase->samples.get(), count, sizeof(zx_time_t), CompareTicks);
+
+    double ticks_per_msec = static_cast<double>(zx_ticks_per_second()) / 1000.0;
+    auto percentile = [&](size_t p) {
+        size_t index = fbl::min(count - 1, count * p / 100);
+        return static_cast<double>(phase->samples[index]) / ticks_per_msec;
+    };
+    double p50 = percentile(50), p90 = percentile(90), p99 = percentile(99);
+    double max = static_cast<double>(phase->samples[count - 1]) / ticks_per_msec;
+    double elapsed_ms = static_cast<double>(phase->elapsed) / ticks_per_msec;
+    double mb = static_cast<double>(phase->bytes) / MB;
+    double device_read_mb = static_cast<double>(phase->device.read_bytes) / MB;
+    double device_write_mb = static_cast<double>(phase->device.write_bytes) / MB;
+
+    printf("\nWorkload %s [%u threads] %8s: %8.1f msec, %8.2f MB/s, p50: [%8.3f] p90: [%8.3f] "
+           "p99: [%8.3f] max: [%8.3f] msec, device read: %.2f MB written: %.2f MB",
+           w.name, w.threads, phase->name, elapsed_ms,
+           elapsed_ms > 0 ? mb * 1000.0 / elapsed_ms : 0.0,
+           p50, p90, p99, max, device_read_mb, device_write_mb);
+
+    FILE* results = fopen(WORKLOAD_RESULT_FILE, "a");
+    ASSERT_NONNULL(results, "Failed to open results file");
+    fprintf(results, "%s,%s,%u,%zu,%s,%f,%f,%f,%f,%f,%f,%" PRIu64 ",%" PRIu64 "\n",
+            w.name, start_time, w.threads, count, phase->name, elapsed_ms, mb,
+            p50, p90, p99, max, phase->device.read_bytes, phase->device.write_bytes);
+    fclose(results);
+    return true;
+}
+
+// Writes every blob, then reads and unlinks them, each phase after a
+// remount and with the blobs taken in a new random order.
+bool RunWorkload(Workload* w) {
+    size_t count = w->sizes.size();
+    size_t total = 0;
+    for (size_t size : w->sizes)
+        total += size;
+    ASSERT_TRUE(StartBlobstoreBenchmark((total + count - 1) / count, count));
+
+    int mountfd = open(MOUNT_PATH, O_RDONLY | O_ADMIN);
+    ASSERT_GE(mountfd, 0, "Failed to open mount point");
+    ssize_t len = ioctl_vfs_get_device_path(mountfd, w->device_path,
+                                            sizeof(w->device_path) - 1);
+    close(mountfd);
+    ASSERT_GT(len, 0, "Failed to find block device");
+    w->device_path[len] = '\0';
+
+    fbl::AllocChecker ac;
+    w->paths.reset(new (&ac) fbl::unique_ptr<char[]>[count]);
+    ASSERT_TRUE(ac.check());
+    for (size_t i = 0; i < count; i++) {
+        w->paths[i].reset(new (&ac) char[PATH_MAX]);
+        ASSERT_TRUE(ac.check());
+        w->paths[i][0] = '\0';
+    }
+    w->order.reset(new (&ac) size_t[count]);
+    ASSERT_TRUE(ac.check());
+    w->failed.store(false);
+
+    Phase write, read, unlink;
+    unsigned int seed = static_cast<unsigned int>(count);
+
+    Shuffle(w, seed++);
+    bool ok = RunPhase(w, &write, "write", WriteWorker, true) && ReportPhase(*w, &write);
+    if (ok) {
+        Shuffle(w, seed++);
+        ok = Remount(w->device_path) &&
+             RunPhase(w, &read, "read", ReadWorker, true) && ReportPhase(*w, &read);
+    }
+    if (ok) {
+        Shuffle(w, seed++);
+        ok = Remount(w->device_path) &&
+             RunPhase(w, &unlink, "unlink", UnlinkWorker, false) && ReportPhase(*w, &unlink);
+    }
+
+    ASSERT_TRUE(EndBlobstoreBenchmark());
+    ASSERT_TRUE(ok);
+    return true;
+}
+
+template <size_t BlobSize, size_t BlobCount, uint32_t Threads>
+bool benchmark_blob_cold() {
+    BEGIN_TEST;
+    Workload w;
+    w.name = "uniform";
+    w.threads = Threads;
+    fbl::AllocChecker ac;
+    for (size_t i = 0; i < BlobCount; i++) {
+        w.sizes.push_back(BlobSize, &ac);
+        ASSERT_TRUE(ac.check());
+    }
+    ASSERT_TRUE(RunWorkload(&w));
+    END_TEST;
+}
+
+template <uint32_t Threads>
+bool benchmark_blob_manifest() {
+    BEGIN_TEST;
+    Workload w;
+    w.name = getenv(MANIFEST_ENV) ? "manifest" : "default-manifest";
+    w.threads = Threads;
+    ASSERT_TRUE(LoadManifest(&w.sizes));
+    ASSERT_TRUE(RunWorkload(&w));
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(blobstore_workloads)
+
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<KB, 1000, 1>))
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<KB, 1000, 4>))
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<128 * KB, 500, 1>))
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<128 * KB, 500, 4>))
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<MB, 100, 1>))
+RUN_TEST_PERFORMANCE((benchmark_blob_cold<MB, 100, 4>))
+
+RUN_TEST_PERFORMANCE((benchmark_blob_manifest<1>))
+RUN_TEST_PERFORMANCE((benchmark_blob_manifest<4>))
+RUN_TEST_PERFORMANCE((benchmark_blob_manifest<8>))
+
+END_TEST_CASE(blobstore_workloads)
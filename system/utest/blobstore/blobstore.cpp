@@ -476,6 +476,53 @@ static bool TestMmap(void) {
     END_TEST;
 }
 
+// Large reads are served by fdio from the blob's VMO; check that reads, seeks
+// and preads still agree with each other once that happens.
+template <fs_test_type_t TestType>
+static bool TestReadLocal(void) {
+    BEGIN_TEST;
+    test_info_t test_info;
+    ASSERT_EQ(StartBlobstoreTest<TestType>(&test_info), 0, "Mounting Blobstore");
+
+    fbl::unique_ptr<blob_info_t> info;
+    ASSERT_TRUE(GenerateBlob(1 << 17, &info));
+    int fd;
+    ASSERT_TRUE(MakeBlob(info->path, info->merkle.get(), info->size_merkle,
+                         info->data.get(), info->size_data, &fd));
+    ASSERT_EQ(close(fd), 0);
+    fd = open(info->path, O_RDONLY);
+    ASSERT_GT(fd, 0, "Failed to-reopen blob");
+
+    const size_t size = info->size_data;
+    const char* data = info->data.get();
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> buf(new (&ac) char[size]);
+    ASSERT_TRUE(ac.check());
+
+    // A small read goes to the server; the large one after it continues from
+    // where it left off.
+    ASSERT_EQ(read(fd, &buf[0], 100), 100);
+    ASSERT_EQ(read(fd, &buf[100], size / 2), (ssize_t)(size / 2));
+    ASSERT_EQ(memcmp(&buf[0], data, 100 + size / 2), 0);
+
+    ASSERT_EQ(pread(fd, &buf[0], 10, 7), 10);
+    ASSERT_EQ(memcmp(&buf[0], &data[7], 10), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)(100 + size / 2), "pread moved the seek pointer");
+
+    ASSERT_EQ(lseek(fd, -10, SEEK_END), (off_t)(size - 10));
+    ASSERT_EQ(read(fd, &buf[0], size), 10, "Read past the end of the blob");
+    ASSERT_EQ(memcmp(&buf[0], &data[size - 10], 10), 0);
+    ASSERT_EQ(read(fd, &buf[0], size), 0);
+    ASSERT_EQ(pread(fd, &buf[0], size, size + 1), 0);
+    ASSERT_LT(lseek(fd, -1, SEEK_SET), 0);
+
+    ASSERT_TRUE(VerifyContents(fd, data, size));
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(info->path), 0);
+    ASSERT_EQ(EndBlobstoreTest<TestType>(&test_info), 0, "unmounting blobstore");
+    END_TEST;
+}
+
 template <fs_test_type_t TestType>
 static bool TestReaddir(void) {
     BEGIN_TEST;
@@ -1108,6 +1155,62 @@ static bool CreateUmountRemountLargeMultithreaded(void) {
     END_TEST;
 }
 
+static int write_blob_thread(void* arg) {
+    blob_info_t* info = static_cast<blob_info_t*>(arg);
+    int fd = open(info->path, O_CREAT | O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+    // Small writes, so that the blob's data is hashed and written out in
+    // many pieces while the other threads write theirs.
+    constexpr size_t kWriteSize = 8192;
+    int r = ftruncate(fd, info->size_data);
+    for (size_t n = 0; (r == 0) && (n < info->size_data); n += kWriteSize) {
+        size_t len = fbl::min(kWriteSize, info->size_data - n);
+        r = StreamAll(write, fd, &info->data[n], len);
+    }
+    if (close(fd) != 0) {
+        return -1;
+    }
+    return r;
+}
+
+template <fs_test_type_t TestType>
+static bool ParallelWrites(void) {
+    BEGIN_TEST;
+    test_info_t test_info;
+    ASSERT_EQ(StartBlobstoreTest<TestType>(&test_info), 0, "Mounting Blobstore");
+
+    constexpr size_t kNumThreads = 8;
+    fbl::unique_ptr<blob_info_t> info[kNumThreads];
+    thrd_t threads[kNumThreads];
+    for (size_t i = 0; i < kNumThreads; i++) {
+        ASSERT_TRUE(GenerateBlob((1 << 20) + i * 1234, &info[i]));
+    }
+    for (size_t i = 0; i < kNumThreads; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], write_blob_thread, info[i].get()), thrd_success);
+    }
+    for (size_t i = 0; i < kNumThreads; i++) {
+        int res;
+        ASSERT_EQ(thrd_join(threads[i], &res), thrd_success);
+        ASSERT_EQ(res, 0, "Failed to write blob");
+    }
+
+    // Read the blobs back after a remount, so that they come from disk.
+    ASSERT_EQ(umount(MOUNT_PATH), ZX_OK, "Could not unmount blobstore");
+    ASSERT_EQ(MountBlobstore(test_info.ramdisk_path), 0, "Could not re-mount blobstore");
+    for (size_t i = 0; i < kNumThreads; i++) {
+        int fd = open(info[i]->path, O_RDONLY);
+        ASSERT_GT(fd, 0, "Failed to open blob");
+        ASSERT_TRUE(VerifyContents(fd, info[i]->data.get(), info[i]->size_data));
+        ASSERT_EQ(close(fd), 0);
+        ASSERT_EQ(unlink(info[i]->path), 0);
+    }
+
+    ASSERT_EQ(EndBlobstoreTest<TestType>(&test_info), 0, "unmounting blobstore");
+    END_TEST;
+}
+
 template <fs_test_type_t TestType>
 static bool NoSpace(void) {
     BEGIN_TEST;
@@ -1598,6 +1701,7 @@ static bool CorruptAtMount(void) {
 BEGIN_TEST_CASE(blobstore_tests)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestBasic)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestMmap)
+RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestReadLocal)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestReaddir)
 RUN_TEST_MEDIUM(TestQueryInfo<FS_TEST_FVM>)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, UseAfterUnlink)
@@ -1616,6 +1720,7 @@ RUN_TEST_FOR_ALL_TYPES(MEDIUM, InvalidOps)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, RootDirectory)
 RUN_TEST_FOR_ALL_TYPES(LARGE, CreateUmountRemountLargeMultithreaded)
 RUN_TEST_FOR_ALL_TYPES(LARGE, CreateUmountRemountLarge)
+RUN_TEST_FOR_ALL_TYPES(LARGE, ParallelWrites)
 RUN_TEST_FOR_ALL_TYPES(LARGE, NoSpace)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, QueryDevicePath)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestReadOnly)
@@ -18,9 +18,11 @@ MODULE_STATIC_LIBS := \
     system/ulib/digest \
     system/ulib/fs \
     system/ulib/gpt \
+    system/ulib/sync \
     system/ulib/zxcpp \
     system/ulib/fbl \
     system/ulib/blobstore \
+    third_party/ulib/lz4 \
     third_party/ulib/uboringssl \
 
 MODULE_LIBS := \
@@ -3,7 +3,9 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <limits.h>
 #include <zircon/compiler.h>
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/object.h>
 #include <unittest/unittest.h>
@@ -858,6 +860,161 @@ static bool channel_disallow_write_to_self(void) {
     END_TEST;
 }
 
+#define LOAN_SIZE (8 * PAGE_SIZE)
+
+static bool map_loan_buffer(uint8_t** out) {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    uintptr_t addr;
+    ASSERT_EQ(zx_vmo_create(LOAN_SIZE, 0u, &vmo), ZX_OK, "");
+    ASSERT_EQ(zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, LOAN_SIZE,
+                          ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr),
+              ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK, "");
+    *out = (uint8_t*)addr;
+
+    END_TEST;
+}
+
+static bool check_pattern(const uint8_t* buf, uint8_t seed) {
+    for (size_t i = 0; i < LOAN_SIZE; i++) {
+        if (buf[i] != (uint8_t)(i + seed))
+            return false;
+    }
+    return true;
+}
+
+static void fill_pattern(uint8_t* buf, uint8_t seed) {
+    for (size_t i = 0; i < LOAN_SIZE; i++)
+        buf[i] = (uint8_t)(i + seed);
+}
+
+static bool channel_write_loan(void) {
+    BEGIN_TEST;
+
+    zx_handle_t channel[2];
+    ASSERT_EQ(zx_channel_create(0, &channel[0], &channel[1]), ZX_OK, "");
+
+    uint8_t* send;
+    uint8_t* recv;
+    ASSERT_TRUE(map_loan_buffer(&send), "");
+    ASSERT_TRUE(map_loan_buffer(&recv), "");
+
+    // a loaned payload leaves the writer's buffer zeroed and arrives intact
+    // in a page aligned reader buffer
+    fill_pattern(send, 1u);
+    ASSERT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_LOAN, send, LOAN_SIZE, NULL, 0),
+              ZX_OK, "");
+    for (size_t i = 0; i < LOAN_SIZE; i += PAGE_SIZE)
+        EXPECT_EQ(send[i], 0u, "loaned buffer not cleared");
+    uint32_t size;
+    ASSERT_EQ(zx_channel_read(channel[1], 0u, recv, NULL, LOAN_SIZE, 0, &size, NULL), ZX_OK, "");
+    EXPECT_EQ(size, (uint32_t)LOAN_SIZE, "wrong size");
+    EXPECT_TRUE(check_pattern(recv, 1u), "wrong contents");
+
+    // an unaligned reader buffer gets a copy
+    uint8_t* copy = malloc(LOAN_SIZE + 1);
+    ASSERT_NONNULL(copy, "");
+    fill_pattern(send, 2u);
+    ASSERT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_LOAN, send, LOAN_SIZE, NULL, 0),
+              ZX_OK, "");
+    ASSERT_EQ(zx_channel_read(channel[1], 0u, copy + 1, NULL, LOAN_SIZE, 0, &size, NULL),
+              ZX_OK, "");
+    EXPECT_TRUE(check_pattern(copy + 1, 2u), "wrong contents");
+    free(copy);
+
+    // small or unaligned payloads are always copied
+    fill_pattern(send, 3u);
+    ASSERT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_LOAN, send + 1, PAGE_SIZE, NULL, 0),
+              ZX_OK, "");
+    EXPECT_EQ(send[PAGE_SIZE], (uint8_t)(PAGE_SIZE + 3u), "copied buffer changed");
+    ASSERT_EQ(zx_channel_read(channel[1], 0u, recv, NULL, LOAN_SIZE, 0, &size, NULL), ZX_OK, "");
+    EXPECT_EQ(size, (uint32_t)PAGE_SIZE, "wrong size");
+    EXPECT_EQ(recv[0], 4u, "wrong contents");
+
+    // a failed write gives the pages back
+    EXPECT_EQ(zx_handle_close(channel[1]), ZX_OK, "");
+    fill_pattern(send, 4u);
+    EXPECT_EQ(zx_channel_write(channel[0], ZX_CHANNEL_WRITE_LOAN, send, LOAN_SIZE, NULL, 0),
+              ZX_ERR_PEER_CLOSED, "");
+    EXPECT_TRUE(check_pattern(send, 4u), "buffer not restored");
+
+    EXPECT_EQ(zx_channel_write(channel[0], 2u, send, LOAN_SIZE, NULL, 0), ZX_ERR_INVALID_ARGS, "");
+
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)send, LOAN_SIZE), ZX_OK, "");
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)recv, LOAN_SIZE), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(channel[0]), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool channel_write_read_many(void) {
+    BEGIN_TEST;
+
+    zx_handle_t channel[2];
+    ASSERT_EQ(zx_channel_create(0, &channel[0], &channel[1]), ZX_OK, "");
+
+    uint32_t out[3] = {1u, 2u, 3u};
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "");
+    zx_channel_msg_t msgs[3] = {
+        {&out[0], NULL, sizeof(uint32_t), 0u},
+        {&out[1], &event, sizeof(uint32_t), 1u},
+        {&out[2], NULL, sizeof(uint32_t), 0u},
+    };
+    ASSERT_EQ(zx_channel_write_many(channel[0], 0u, msgs, 3u), ZX_OK, "");
+
+    // the first two fit, the third needs a bigger buffer than offered
+    uint32_t in[3] = {0u, 0u, 0u};
+    zx_handle_t handles[2] = {ZX_HANDLE_INVALID, ZX_HANDLE_INVALID};
+    zx_channel_msg_t rd[3] = {
+        {&in[0], &handles[0], sizeof(uint32_t), 1u},
+        {&in[1], &handles[1], sizeof(uint32_t), 1u},
+        {&in[2], NULL, 0u, 0u},
+    };
+    uint32_t actual = 0u;
+    ASSERT_EQ(zx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ZX_OK, "");
+    EXPECT_EQ(actual, 2u, "wrong message count");
+    EXPECT_EQ(in[0], 1u, "wrong contents");
+    EXPECT_EQ(in[1], 2u, "wrong contents");
+    EXPECT_EQ(rd[0].num_handles, 0u, "wrong handle count");
+    EXPECT_EQ(rd[1].num_handles, 1u, "wrong handle count");
+    EXPECT_EQ(zx_handle_close(handles[1]), ZX_OK, "");
+
+    rd[0].num_bytes = 0u;
+    EXPECT_EQ(zx_channel_read_many(channel[1], 0u, rd, 1u, &actual), ZX_ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(rd[0].num_bytes, sizeof(uint32_t), "wrong size");
+    rd[0].num_bytes = sizeof(uint32_t);
+    ASSERT_EQ(zx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ZX_OK, "");
+    EXPECT_EQ(actual, 1u, "wrong message count");
+    EXPECT_EQ(in[0], 3u, "wrong contents");
+    EXPECT_EQ(zx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ZX_ERR_SHOULD_WAIT, "");
+
+    // a batch with a bad handle in it is not written at all, and the good
+    // handles stay with us
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "");
+    zx_handle_t bad = ZX_HANDLE_INVALID;
+    msgs[1].handles = &event;
+    msgs[2].handles = &bad;
+    msgs[2].num_handles = 1u;
+    EXPECT_EQ(zx_channel_write_many(channel[0], 0u, msgs, 3u), ZX_ERR_BAD_HANDLE, "");
+    EXPECT_EQ(zx_object_wait_one(channel[1], ZX_CHANNEL_READABLE, 0u, NULL), ZX_ERR_TIMED_OUT,
+              "partial batch written");
+    EXPECT_EQ(zx_handle_close(event), ZX_OK, "handle not returned");
+
+    EXPECT_EQ(zx_channel_write_many(channel[0], 0u, msgs, 0u), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_channel_write_many(channel[0], 0u, msgs, ZX_CHANNEL_MAX_BATCH_MSGS + 1),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    EXPECT_EQ(zx_handle_close(channel[1]), ZX_OK, "");
+    msgs[2].num_handles = 0u;
+    EXPECT_EQ(zx_channel_write_many(channel[0], 0u, msgs, 1u), ZX_ERR_PEER_CLOSED, "");
+    EXPECT_EQ(zx_handle_close(channel[0]), ZX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(channel_tests)
 RUN_TEST(channel_test)
 RUN_TEST(channel_read_error_test)
@@ -871,6 +1028,8 @@ RUN_TEST(channel_call2)
 RUN_TEST(bad_channel_call_finish)
 RUN_TEST(channel_nest)
 RUN_TEST(channel_disallow_write_to_self)
+RUN_TEST(channel_write_loan)
+RUN_TEST(channel_write_read_many)
 END_TEST_CASE(channel_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -114,10 +114,52 @@ static bool signal_peer_test(void) {
     END_TEST;
 }
 
+static bool signal_many_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h[2] = {ZX_HANDLE_INVALID, ZX_HANDLE_INVALID};
+    ASSERT_EQ(zx_eventpair_create(0, &h[0], &h[1]), ZX_OK, "eventpair_create failed");
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "event_create failed");
+
+    zx_signal_item_t items[] = {
+        {h[0], 0u, 0u, ZX_USER_SIGNAL_0},
+        {h[0], ZX_SIGNAL_ITEM_PEER, 0u, ZX_USER_SIGNAL_1},
+        {event, 0u, 0u, ZX_EVENT_SIGNALED},
+        {h[0], 0u, ZX_USER_SIGNAL_0, ZX_USER_SIGNAL_2},
+    };
+    EXPECT_EQ(zx_object_signal_many(items, countof(items)), ZX_OK, "object_signal_many failed");
+    check_signals_state(h[0], ZX_USER_SIGNAL_2);
+    check_signals_state(h[1], ZX_USER_SIGNAL_1);
+    check_signals_state(event, ZX_EVENT_SIGNALED);
+
+    // A bad handle anywhere in the batch leaves every object alone.
+    zx_signal_item_t bad_items[] = {
+        {h[1], 0u, 0u, ZX_USER_SIGNAL_3},
+        {ZX_HANDLE_INVALID, 0u, 0u, ZX_USER_SIGNAL_3},
+    };
+    EXPECT_EQ(zx_object_signal_many(bad_items, countof(bad_items)), ZX_ERR_BAD_HANDLE, "");
+    check_signals_state(h[1], ZX_USER_SIGNAL_1);
+
+    zx_signal_item_t bad_options[] = {
+        {h[1], 2u, 0u, ZX_USER_SIGNAL_3},
+    };
+    EXPECT_EQ(zx_object_signal_many(bad_options, countof(bad_options)), ZX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(zx_object_signal_many(items, 0u), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_object_signal_many(items, ZX_SIGNAL_MANY_MAX_ITEMS + 1), ZX_ERR_OUT_OF_RANGE, "");
+
+    EXPECT_EQ(zx_handle_close(event), ZX_OK, "failed to close event handle");
+    EXPECT_EQ(zx_handle_close(h[0]), ZX_OK, "failed to close event pair handle");
+    EXPECT_EQ(zx_handle_close(h[1]), ZX_OK, "failed to close event pair handle");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(event_pair_tests)
 RUN_TEST(create_test)
 RUN_TEST(signal_test)
 RUN_TEST(signal_peer_test)
+RUN_TEST(signal_many_test)
 END_TEST_CASE(event_pair_tests)
 
 #ifndef BUILD_COMBINED_TESTS
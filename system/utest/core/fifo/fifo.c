@@ -3,12 +3,14 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <threads.h>
 #include <unistd.h>
 
+#include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <unittest/unittest.h>
 
@@ -118,8 +120,100 @@ static bool options_test(void) {
     END_TEST;
 }
 
+static zx_fifo_ring_header_t* map_ring(zx_handle_t vmo, size_t size) {
+    uintptr_t addr;
+    if (zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, size,
+                    ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &addr) != ZX_OK) {
+        return NULL;
+    }
+    return (zx_fifo_ring_header_t*)addr;
+}
+
+static uint64_t* ring_entries(zx_fifo_ring_header_t* ring) {
+    return (uint64_t*)((uintptr_t)ring + ZX_FIFO_RING_ENTRIES_OFFSET);
+}
+
+static bool shared_ring_test(void) {
+    BEGIN_TEST;
+    zx_handle_t a, b;
+    const size_t size = PAGE_SIZE;
+
+    EXPECT_EQ(zx_fifo_create(8, 8, ~ZX_FIFO_SHARED_RING, &a, &b), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(zx_fifo_create(8, 8, ZX_FIFO_SHARED_RING, &a, &b), ZX_OK, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE);
+    EXPECT_SIGNALS(b, ZX_FIFO_WRITABLE);
+
+    // the copying calls are not available on a shared ring
+    uint64_t n = 1u;
+    uint32_t actual;
+    EXPECT_EQ(zx_fifo_write(a, &n, sizeof(n), &actual), ZX_ERR_BAD_STATE, "");
+    EXPECT_EQ(zx_fifo_read(b, &n, sizeof(n), &actual), ZX_ERR_BAD_STATE, "");
+
+    zx_handle_t a_rx, a_tx, b_rx, b_tx;
+    ASSERT_EQ(zx_fifo_get_rings(a, &a_rx, &a_tx), ZX_OK, "");
+    ASSERT_EQ(zx_fifo_get_rings(b, &b_rx, &b_tx), ZX_OK, "");
+
+    zx_fifo_ring_header_t* tx = map_ring(a_tx, size);
+    zx_fifo_ring_header_t* rx = map_ring(b_rx, size);
+    ASSERT_NONNULL(tx, "");
+    ASSERT_NONNULL(rx, "");
+    EXPECT_EQ(tx->head, 0u, "");
+    EXPECT_EQ(tx->tail, 0u, "");
+
+    // fill the ring from a's side; both mappings see the same memory
+    for (uint32_t i = 0; i < 8; i++)
+        ring_entries(tx)[i] = i + 1;
+    __atomic_store_n(&tx->head, 8u, __ATOMIC_RELEASE);
+    EXPECT_EQ(__atomic_load_n(&rx->head, __ATOMIC_ACQUIRE), 8u, "");
+
+    // signals only move when the doorbell is rung
+    EXPECT_SIGNALS(b, ZX_FIFO_WRITABLE);
+    EXPECT_EQ(zx_fifo_notify(a), ZX_OK, "");
+    EXPECT_SIGNALS(a, 0u);
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE);
+
+    // drain half of it from b's side
+    for (uint32_t i = 0; i < 4; i++)
+        EXPECT_EQ(ring_entries(rx)[i], i + 1, "");
+    __atomic_store_n(&rx->tail, 4u, __ATOMIC_RELEASE);
+    EXPECT_EQ(zx_fifo_notify(b), ZX_OK, "");
+    EXPECT_SIGNALS(a, ZX_FIFO_WRITABLE);
+    EXPECT_SIGNALS(b, ZX_FIFO_READABLE | ZX_FIFO_WRITABLE);
+
+    __atomic_store_n(&rx->tail, 8u, __ATOMIC_RELEASE);
+    EXPECT_EQ(zx_fifo_notify(b), ZX_OK, "");
+    EXPECT_SIGNALS(b, ZX_FIFO_WRITABLE);
+
+    // indices that make no sense read as a full ring
+    __atomic_store_n(&tx->head, 100u, __ATOMIC_RELEASE);
+    EXPECT_EQ(zx_fifo_notify(a), ZX_OK, "");
+    EXPECT_SIGNALS(a, 0u);
+
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)tx, size), ZX_OK, "");
+    EXPECT_EQ(zx_vmar_unmap(zx_vmar_root_self(), (uintptr_t)rx, size), ZX_OK, "");
+    zx_handle_close(a_rx);
+    zx_handle_close(a_tx);
+    zx_handle_close(b_rx);
+    zx_handle_close(b_tx);
+
+    zx_handle_close(b);
+    EXPECT_SIGNALS(a, ZX_FIFO_PEER_CLOSED);
+    EXPECT_EQ(zx_fifo_notify(a), ZX_ERR_PEER_CLOSED, "");
+    zx_handle_close(a);
+
+    // the ring calls are not available on a copying fifo
+    ASSERT_EQ(zx_fifo_create(8, 8, 0, &a, &b), ZX_OK, "");
+    EXPECT_EQ(zx_fifo_get_rings(a, &a_rx, &a_tx), ZX_ERR_BAD_STATE, "");
+    EXPECT_EQ(zx_fifo_notify(a), ZX_ERR_BAD_STATE, "");
+    zx_handle_close(a);
+    zx_handle_close(b);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fifo_tests)
 RUN_TEST(basic_test)
+RUN_TEST(shared_ring_test)
 END_TEST_CASE(fifo_tests)
 
 #ifndef BUILD_COMBINED_TESTS
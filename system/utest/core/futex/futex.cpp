@@ -351,6 +351,77 @@ bool test_futex_requeue() {
     END_TEST;
 }
 
+// Same as above, but between futexes far enough apart that they are
+// unlikely to share a lock in the kernel.
+bool test_futex_requeue_distant() {
+    BEGIN_TEST;
+    static volatile int futex_values[4096];
+    volatile int* futex_value1 = &futex_values[0];
+    volatile int* futex_value2 = &futex_values[4000];
+    *futex_value1 = 100;
+    *futex_value2 = 200;
+    TestThread thread1(futex_value1);
+    TestThread thread2(futex_value1);
+    TestThread thread3(futex_value1);
+
+    zx_status_t rc = zx_futex_requeue(
+        const_cast<int*>(futex_value1), 1, *futex_value1,
+        const_cast<int*>(futex_value2), 1);
+    ASSERT_EQ(rc, ZX_OK, "Error in requeue");
+    thread1.assert_thread_woken();
+    thread2.assert_thread_not_woken();
+    thread3.assert_thread_not_woken();
+
+    check_futex_wake(futex_value2, INT_MAX);
+    thread2.assert_thread_woken();
+    thread3.assert_thread_not_woken();
+
+    check_futex_wake(futex_value1, 1);
+    thread3.assert_thread_woken();
+    END_TEST;
+}
+
+// Test that futex_requeue_many() wakes one thread across several futexes,
+// moves the other waiters of matching futexes and skips the others.
+bool test_futex_requeue_many() {
+    BEGIN_TEST;
+    volatile int futex_values[3] = {100, 100, 100};
+    volatile int futex_target = 200;
+    TestThread thread1(&futex_values[0]);
+    TestThread thread2(&futex_values[0]);
+    TestThread thread3(&futex_values[1]);
+    TestThread thread4(&futex_values[2]);
+    futex_values[2] = 101;
+
+    uintptr_t wake_ptrs[3];
+    for (int i = 0; i < 3; i++)
+        wake_ptrs[i] = reinterpret_cast<uintptr_t>(&futex_values[i]);
+
+    ASSERT_EQ(zx_futex_requeue_many(wake_ptrs, 0, 100, 1, const_cast<int*>(&futex_target)),
+              ZX_ERR_OUT_OF_RANGE, "empty requeue should fail");
+    ASSERT_EQ(zx_futex_requeue_many(wake_ptrs, 3, 100, 1, const_cast<int*>(&futex_values[1])),
+              ZX_ERR_INVALID_ARGS, "requeue onto a wake futex should fail");
+
+    zx_status_t rc = zx_futex_requeue_many(wake_ptrs, 3, 100, 1,
+                                           const_cast<int*>(&futex_target));
+    ASSERT_EQ(rc, ZX_OK, "Error in requeue_many");
+    thread1.assert_thread_woken();
+    thread2.assert_thread_not_woken();
+    thread3.assert_thread_not_woken();
+    thread4.assert_thread_not_woken();
+
+    // Both remaining waiters of the matching futexes moved to the target.
+    check_futex_wake(&futex_target, INT_MAX);
+    thread2.assert_thread_woken();
+    thread3.assert_thread_woken();
+    thread4.assert_thread_not_woken();
+
+    // The mismatched futex kept its waiter.
+    check_futex_wake(&futex_values[2], 1);
+    thread4.assert_thread_woken();
+    END_TEST;
+}
+
 // Test the case where futex_wait() times out after having been moved to a
 // different queue by futex_requeue().  Check that futex_wait() removes
 // itself from the correct queue in that case.
@@ -503,6 +574,62 @@ static int signal_thread3(void* arg) {
     return 0;
 }
 
+struct FutexPiArgs {
+    volatile int* futex_value;
+    zx_handle_t owner;
+};
+
+static int futex_wait_pi_thread(void* arg) {
+    FutexPiArgs* args = reinterpret_cast<FutexPiArgs*>(arg);
+    while (*args->futex_value == 1) {
+        zx_status_t rc = zx_futex_wait_pi(const_cast<int*>(args->futex_value), 1, args->owner,
+                                          ZX_TIME_INFINITE);
+        if (rc != ZX_OK && rc != ZX_ERR_BAD_STATE)
+            return -1;
+    }
+    return 0;
+}
+
+static bool test_futex_wait_pi() {
+    BEGIN_TEST;
+    volatile int futex_value = 1;
+
+    zx_handle_t self = thrd_get_zx_handle(thrd_current());
+    EXPECT_EQ(zx_futex_wait_pi(const_cast<int*>(&futex_value), 1, self, 0),
+              ZX_ERR_INVALID_ARGS, "self cannot own the futex");
+    EXPECT_EQ(zx_futex_wait_pi(const_cast<int*>(&futex_value), 1, ZX_HANDLE_INVALID, 0),
+              ZX_ERR_BAD_HANDLE, "");
+
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "");
+    EXPECT_EQ(zx_futex_wait_pi(const_cast<int*>(&futex_value), 1, event, 0),
+              ZX_ERR_WRONG_TYPE, "");
+    EXPECT_EQ(zx_handle_close(event), ZX_OK, "");
+
+    // The thread waits on a futex owned by this one.
+    FutexPiArgs args = {&futex_value, self};
+    thrd_t thread;
+    ASSERT_EQ(thrd_create_with_name(&thread, futex_wait_pi_thread, &args, "futex_wait_pi"),
+              thrd_success, "");
+    zx_handle_t owner = thrd_get_zx_handle(thread);
+    EXPECT_EQ(zx_futex_wait_pi(const_cast<int*>(&futex_value), 2, owner, 0),
+              ZX_ERR_BAD_STATE, "");
+    EXPECT_EQ(zx_futex_wait_pi(const_cast<int*>(&futex_value), 1, owner, 0),
+              ZX_ERR_TIMED_OUT, "");
+
+    // Give the thread time to block, lending its priority to us, then
+    // release the futex as a mutex unlock would.
+    struct timespec wait_time = {0, 100 * 1000000 /* nanoseconds */};
+    EXPECT_EQ(nanosleep(&wait_time, NULL), 0, "Error in nanosleep");
+    futex_value = 0;
+    EXPECT_EQ(zx_futex_wake(const_cast<int*>(&futex_value), 1), ZX_OK, "");
+
+    int ret;
+    ASSERT_EQ(thrd_join(thread, &ret), thrd_success, "");
+    EXPECT_EQ(ret, 0, "futex_wait_pi failed");
+    END_TEST;
+}
+
 static bool test_event_signaling() {
     BEGIN_TEST;
     thrd_t thread1, thread2, thread3;
@@ -540,10 +667,13 @@ RUN_TEST(test_futex_unqueued_on_timeout_3);
 RUN_TEST(test_futex_requeue_value_mismatch);
 RUN_TEST(test_futex_requeue_same_addr);
 RUN_TEST(test_futex_requeue);
+RUN_TEST(test_futex_requeue_distant);
+RUN_TEST(test_futex_requeue_many);
 RUN_TEST(test_futex_requeue_unqueued_on_timeout);
 RUN_TEST(test_futex_thread_killed);
 RUN_TEST(test_futex_thread_suspended);
 RUN_TEST(test_futex_misaligned);
+RUN_TEST(test_futex_wait_pi);
 RUN_TEST(test_event_signaling);
 END_TEST_CASE(futex_tests)
 
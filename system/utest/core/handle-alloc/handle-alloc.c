@@ -0,0 +1,98 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <zircon/syscalls.h>
+#include <unittest/unittest.h>
+
+#define NUM_THREADS 4
+#define NUM_ITERATIONS 2000
+#define HANDLES_PER_ITERATION 32
+
+// Each iteration creates a batch of events, duplicates each of them and then
+// closes everything, so the kernel's handle allocator sees bursts of makes
+// and deletes from several cpus at once.
+static int create_close_thread(void* arg) {
+    volatile int* errors = arg;
+    zx_handle_t handles[HANDLES_PER_ITERATION];
+    zx_handle_t dups[HANDLES_PER_ITERATION];
+
+    for (int i = 0; i < NUM_ITERATIONS; i++) {
+        for (int j = 0; j < HANDLES_PER_ITERATION; j++) {
+            if (zx_event_create(0u, &handles[j]) != ZX_OK ||
+                zx_handle_duplicate(handles[j], ZX_RIGHT_SAME_RIGHTS, &dups[j]) != ZX_OK) {
+                __atomic_fetch_add(errors, 1, __ATOMIC_SEQ_CST);
+                return -1;
+            }
+        }
+        for (int j = 0; j < HANDLES_PER_ITERATION; j++) {
+            if (zx_handle_close(handles[j]) != ZX_OK || zx_handle_close(dups[j]) != ZX_OK) {
+                __atomic_fetch_add(errors, 1, __ATOMIC_SEQ_CST);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static bool handle_stale_value_test(void) {
+    BEGIN_TEST;
+
+    // A closed handle's value must stay invalid even though its slot is
+    // quickly recycled by the next allocation.
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "");
+    ASSERT_EQ(zx_handle_close(event), ZX_OK, "");
+
+    zx_handle_t reused;
+    ASSERT_EQ(zx_event_create(0u, &reused), ZX_OK, "");
+    EXPECT_NE(reused, event, "handle value reused");
+    EXPECT_EQ(zx_handle_close(event), ZX_ERR_BAD_HANDLE, "stale handle still valid");
+    EXPECT_EQ(zx_handle_close(reused), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool handle_create_close_stress_test(void) {
+    BEGIN_TEST;
+
+    volatile int errors = 0;
+    thrd_t threads[NUM_THREADS];
+
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < NUM_THREADS; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], create_close_thread, (void*)&errors,
+                                        "handle stress"),
+                  thrd_success, "failed to create thread");
+    }
+    for (int i = 0; i < NUM_THREADS; i++) {
+        int ret;
+        ASSERT_EQ(thrd_join(threads[i], &ret), thrd_success, "failed to join thread");
+        EXPECT_EQ(ret, 0, "thread failed");
+    }
+    zx_time_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    EXPECT_EQ(errors, 0, "handle create, duplicate or close failed");
+
+    // every iteration makes and closes two handles per event
+    uint64_t ops = (uint64_t)NUM_THREADS * NUM_ITERATIONS * HANDLES_PER_ITERATION * 2;
+    unittest_printf("%" PRIu64 " handle create/close pairs on %d threads: %" PRIu64
+                    " ns per pair\n", ops, NUM_THREADS, elapsed / ops);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(handle_alloc_tests)
+RUN_TEST(handle_stale_value_test)
+RUN_TEST(handle_create_close_stress_test)
+END_TEST_CASE(handle_alloc_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
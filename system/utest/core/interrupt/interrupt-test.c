@@ -4,6 +4,8 @@
 
 #include <unittest/unittest.h>
 #include <zircon/syscalls.h>
+#include <zircon/syscalls/object.h>
+#include <zircon/syscalls/port.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -82,7 +84,131 @@ static bool interrupt_test_multiple(void) {
     END_TEST;
 }
 
+// Tests the per-slot counts and that virtual slots can't be steered
+static bool interrupt_slot_info_test(void) {
+    const uint32_t BOUND_SLOT = 3;
+    const uint32_t SIGNAL_COUNT = 5;
+
+    BEGIN_TEST;
+
+    zx_handle_t handle;
+    zx_handle_t rsrc = get_root_resource();
+    uint64_t slots;
+
+    ASSERT_EQ(zx_interrupt_create(rsrc, 0, &handle), ZX_OK, "");
+    ASSERT_EQ(zx_interrupt_bind(handle, BOUND_SLOT, rsrc, 0, ZX_INTERRUPT_VIRTUAL), ZX_OK, "");
+
+    for (uint32_t i = 0; i < SIGNAL_COUNT; i++) {
+        ASSERT_EQ(zx_interrupt_signal(handle, BOUND_SLOT, 0), ZX_OK, "");
+        ASSERT_EQ(zx_interrupt_wait(handle, &slots), ZX_OK, "");
+    }
+
+    // the user slot is prebound, so there are two records
+    zx_info_interrupt_slot_t info[4];
+    size_t actual, avail;
+    ASSERT_EQ(zx_object_get_info(handle, ZX_INFO_INTERRUPT_SLOTS, info, sizeof(info),
+                                 &actual, &avail), ZX_OK, "");
+    ASSERT_EQ(actual, 2u, "");
+    ASSERT_EQ(avail, 2u, "");
+
+    bool found = false;
+    for (size_t i = 0; i < actual; i++) {
+        EXPECT_EQ(info[i].flags, ZX_INFO_INTERRUPT_SLOT_VIRTUAL, "");
+        if (info[i].slot == BOUND_SLOT) {
+            EXPECT_EQ(info[i].count, SIGNAL_COUNT, "");
+            found = true;
+        } else {
+            EXPECT_EQ(info[i].slot, (uint32_t)ZX_INTERRUPT_SLOT_USER, "");
+            EXPECT_EQ(info[i].count, 0u, "");
+        }
+    }
+    EXPECT_TRUE(found, "bound slot not reported");
+
+    EXPECT_EQ(zx_interrupt_set_affinity(handle, BOUND_SLOT, 0), ZX_ERR_BAD_STATE, "");
+    EXPECT_EQ(zx_interrupt_set_affinity(handle, BOUND_SLOT + 1, 0), ZX_ERR_NOT_FOUND, "");
+    EXPECT_EQ(zx_interrupt_set_affinity(handle, BOUND_SLOT, zx_system_get_num_cpus()),
+              ZX_ERR_INVALID_ARGS, "");
+
+    ASSERT_EQ(zx_handle_close(handle), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool interrupt_port_test(void) {
+    const uint32_t BOUND_SLOT = 2;
+    const uint64_t KEY = 0x1234;
+
+    BEGIN_TEST;
+
+    zx_handle_t handle, port;
+    zx_handle_t rsrc = get_root_resource();
+    uint64_t slots;
+    zx_port_packet_t packet;
+
+    ASSERT_EQ(zx_interrupt_create(rsrc, 0, &handle), ZX_OK, "");
+    ASSERT_EQ(zx_interrupt_bind(handle, BOUND_SLOT, rsrc, 0, ZX_INTERRUPT_VIRTUAL), ZX_OK, "");
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK, "");
+
+    EXPECT_EQ(zx_interrupt_ack(handle), ZX_ERR_BAD_STATE, "ack before bind");
+    EXPECT_EQ(zx_interrupt_bind_port(handle, port, KEY, 1u), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(zx_interrupt_bind_port(handle, port, KEY, 0), ZX_OK, "");
+    EXPECT_EQ(zx_interrupt_bind_port(handle, port, KEY, 0), ZX_ERR_ALREADY_BOUND, "");
+    EXPECT_EQ(zx_interrupt_wait(handle, &slots), ZX_ERR_BAD_STATE, "");
+
+    ASSERT_EQ(zx_interrupt_signal(handle, BOUND_SLOT, 0), ZX_OK, "");
+    ASSERT_EQ(zx_port_wait(port, ZX_TIME_INFINITE, &packet, 0), ZX_OK, "");
+    EXPECT_EQ(packet.key, KEY, "");
+    EXPECT_EQ(packet.type, ZX_PKT_TYPE_INTERRUPT, "");
+    EXPECT_EQ(packet.interrupt.slots, 1ull << BOUND_SLOT, "");
+
+    // nothing more is sent until the packet is acked
+    ASSERT_EQ(zx_interrupt_signal(handle, BOUND_SLOT, 0), ZX_OK, "");
+    EXPECT_EQ(zx_port_wait(port, 0, &packet, 0), ZX_ERR_TIMED_OUT, "");
+    ASSERT_EQ(zx_interrupt_ack(handle), ZX_OK, "");
+    ASSERT_EQ(zx_port_wait(port, ZX_TIME_INFINITE, &packet, 0), ZX_OK, "");
+    EXPECT_EQ(packet.interrupt.slots, 1ull << BOUND_SLOT, "");
+    ASSERT_EQ(zx_interrupt_ack(handle), ZX_OK, "");
+    EXPECT_EQ(zx_interrupt_ack(handle), ZX_ERR_BAD_STATE, "ack with no packet outstanding");
+
+    ASSERT_EQ(zx_handle_close(handle), ZX_OK, "");
+    ASSERT_EQ(zx_handle_close(port), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool interrupt_poll_window_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t handle;
+    zx_handle_t rsrc = get_root_resource();
+    zx_duration_t window;
+
+    ASSERT_EQ(zx_interrupt_create(rsrc, 0, &handle), ZX_OK, "");
+    ASSERT_EQ(zx_object_get_property(handle, ZX_PROP_INTERRUPT_POLL_WINDOW,
+                                     &window, sizeof(window)), ZX_OK, "");
+    EXPECT_EQ(window, 0u, "polling is off by default");
+
+    window = ZX_USEC(50);
+    ASSERT_EQ(zx_object_set_property(handle, ZX_PROP_INTERRUPT_POLL_WINDOW,
+                                     &window, sizeof(window)), ZX_OK, "");
+    window = 0;
+    ASSERT_EQ(zx_object_get_property(handle, ZX_PROP_INTERRUPT_POLL_WINDOW,
+                                     &window, sizeof(window)), ZX_OK, "");
+    EXPECT_EQ(window, ZX_USEC(50), "");
+
+    window = ZX_SEC(1);
+    EXPECT_EQ(zx_object_set_property(handle, ZX_PROP_INTERRUPT_POLL_WINDOW,
+                                     &window, sizeof(window)), ZX_ERR_OUT_OF_RANGE, "");
+
+    ASSERT_EQ(zx_handle_close(handle), ZX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(interrupt_tests)
 RUN_TEST(interrupt_test)
 RUN_TEST(interrupt_test_multiple)
+RUN_TEST(interrupt_slot_info_test)
+RUN_TEST(interrupt_port_test)
+RUN_TEST(interrupt_poll_window_test)
 END_TEST_CASE(interrupt_tests)
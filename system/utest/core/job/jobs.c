@@ -10,6 +10,7 @@
 #include <zircon/process.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/policy.h>
+#include <zircon/syscalls/system.h>
 
 #include <mini-process/mini-process.h>
 #include <unittest/unittest.h>
@@ -164,6 +165,41 @@ static bool info_task_stats_fails(void) {
     END_TEST;
 }
 
+static bool memory_pressure_event_test(void) {
+    BEGIN_TEST;
+
+    zx_wait_item_t items[ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT];
+    for (uint32_t kind = 0; kind < ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT; kind++) {
+        ASSERT_EQ(zx_system_get_event(zx_job_default(), kind, &items[kind].handle), ZX_OK, "");
+        items[kind].waitfor = ZX_EVENT_SIGNALED;
+        items[kind].pending = 0;
+    }
+
+    // exactly one level is current
+    ASSERT_EQ(zx_object_wait_many(items, countof(items), 0), ZX_OK, "");
+    int signaled = 0;
+    for (size_t i = 0; i < countof(items); i++) {
+        if (items[i].pending & ZX_EVENT_SIGNALED)
+            signaled++;
+    }
+    EXPECT_EQ(signaled, 1, "");
+
+    // the kernel owns the signals
+    EXPECT_EQ(zx_object_signal(items[0].handle, 0u, ZX_EVENT_SIGNALED),
+              ZX_ERR_ACCESS_DENIED, "");
+
+    zx_handle_t event;
+    EXPECT_EQ(zx_system_get_event(zx_job_default(), ZX_SYSTEM_EVENT_MEMORY_PRESSURE_COUNT,
+                                  &event), ZX_ERR_INVALID_ARGS, "");
+    EXPECT_EQ(zx_system_get_event(items[0].handle, ZX_SYSTEM_EVENT_MEMORY_PRESSURE_NORMAL,
+                                  &event), ZX_ERR_WRONG_TYPE, "");
+
+    for (size_t i = 0; i < countof(items); i++)
+        EXPECT_EQ(zx_handle_close(items[i].handle), ZX_OK, "");
+
+    END_TEST;
+}
+
 // Show that there is a max job height.
 static bool max_height_smoke(void) {
     BEGIN_TEST;
@@ -222,4 +258,5 @@ RUN_TEST(kill_test)
 RUN_TEST(wait_test)
 RUN_TEST(info_task_stats_fails)
 RUN_TEST(max_height_smoke)
+RUN_TEST(memory_pressure_event_test)
 END_TEST_CASE(job_tests)
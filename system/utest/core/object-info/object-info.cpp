@@ -861,6 +861,55 @@ bool job_children_smoke() {
     return jobch_helper_smoke(ZX_INFO_JOB_CHILDREN, kTestJobChildJobs);
 }
 
+// Tests that ZX_INFO_JOB_THREAD_STATS reports the current thread.
+bool job_thread_stats_smoke() {
+    BEGIN_TEST;
+    zx_koid_t process_koid;
+    ASSERT_EQ(get_koid(zx_process_self(), &process_koid), ZX_OK);
+    zx_koid_t thread_koid;
+    ASSERT_EQ(get_koid(zx_thread_self(), &thread_koid), ZX_OK);
+    char name[ZX_MAX_NAME_LEN];
+    ASSERT_EQ(zx_object_get_property(zx_thread_self(), ZX_PROP_NAME,
+                                     name, sizeof(name)),
+              ZX_OK);
+
+    size_t actual;
+    size_t avail;
+    ASSERT_EQ(zx_object_get_info(zx_job_default(), ZX_INFO_JOB_THREAD_STATS,
+                                 nullptr, 0, &actual, &avail),
+              ZX_OK);
+    EXPECT_EQ(0u, actual);
+    ASSERT_GT(avail, 0u);
+
+    // Leave room for threads started by anything else in the job.
+    size_t capacity = avail + 16;
+    zx_info_job_thread_t* threads = static_cast<zx_info_job_thread_t*>(
+        malloc(capacity * sizeof(zx_info_job_thread_t)));
+    ASSERT_NONNULL(threads, "");
+    ASSERT_EQ(zx_object_get_info(zx_job_default(), ZX_INFO_JOB_THREAD_STATS,
+                                 threads, capacity * sizeof(zx_info_job_thread_t),
+                                 &actual, &avail),
+              ZX_OK);
+    EXPECT_EQ(actual, avail);
+
+    bool found = false;
+    for (size_t i = 0; i < actual; i++) {
+        if (threads[i].koid != thread_koid)
+            continue;
+        EXPECT_FALSE(found, "thread reported twice");
+        found = true;
+        EXPECT_EQ(process_koid, threads[i].process_koid);
+        EXPECT_EQ(ZX_THREAD_STATE_RUNNING, threads[i].state);
+        EXPECT_EQ(ZX_EXCEPTION_PORT_TYPE_NONE, threads[i].wait_exception_port_type);
+        EXPECT_GT(threads[i].total_runtime, 0);
+        EXPECT_STR_EQ(name, threads[i].name, sizeof(name), "");
+    }
+    EXPECT_TRUE(found, "current thread not reported");
+
+    free(threads);
+    END_TEST;
+}
+
 uint32_t handle_count_or_zero(zx_handle_t handle) {
     zx_info_handle_count_t info;
     if (ZX_OK != zx_object_get_info(
@@ -893,6 +942,50 @@ bool handle_count_valid() {
     return true;
 }
 
+bool channel_info_smoke() {
+    BEGIN_TEST;
+
+    zx_handle_t ch[2];
+    ASSERT_EQ(zx_channel_create(0u, &ch[0], &ch[1]), ZX_OK);
+
+    zx_info_channel_t info;
+    ASSERT_EQ(zx_object_get_info(ch[1], ZX_INFO_CHANNEL, &info, sizeof(info),
+                                 nullptr, nullptr), ZX_OK);
+    EXPECT_EQ(info.message_count, 0u);
+    EXPECT_EQ(info.message_bytes, 0u);
+    EXPECT_EQ(info.memory_bytes, 0u);
+
+    // Messages are accounted to the endpoint that will read them.
+    char data[100] = {};
+    ASSERT_EQ(zx_channel_write(ch[0], 0u, data, sizeof(data), nullptr, 0u), ZX_OK);
+    ASSERT_EQ(zx_channel_write(ch[0], 0u, data, 10u, nullptr, 0u), ZX_OK);
+    ASSERT_EQ(zx_object_get_info(ch[1], ZX_INFO_CHANNEL, &info, sizeof(info),
+                                 nullptr, nullptr), ZX_OK);
+    EXPECT_EQ(info.message_count, 2u);
+    EXPECT_EQ(info.message_bytes, sizeof(data) + 10u);
+    EXPECT_GE(info.memory_bytes, info.message_bytes);
+    const uint64_t peak = info.memory_bytes;
+    EXPECT_EQ(info.peak_memory_bytes, peak);
+
+    uint32_t actual_bytes;
+    ASSERT_EQ(zx_channel_read(ch[1], 0u, data, nullptr, sizeof(data), 0u,
+                              &actual_bytes, nullptr), ZX_OK);
+    ASSERT_EQ(zx_object_get_info(ch[1], ZX_INFO_CHANNEL, &info, sizeof(info),
+                                 nullptr, nullptr), ZX_OK);
+    EXPECT_EQ(info.message_count, 1u);
+    EXPECT_EQ(info.message_bytes, 10u);
+    EXPECT_LT(info.memory_bytes, peak);
+    EXPECT_EQ(info.peak_memory_bytes, peak);
+
+    ASSERT_EQ(zx_object_get_info(ch[0], ZX_INFO_CHANNEL, &info, sizeof(info),
+                                 nullptr, nullptr), ZX_OK);
+    EXPECT_EQ(info.message_count, 0u);
+
+    zx_handle_close(ch[0]);
+    zx_handle_close(ch[1]);
+    END_TEST;
+}
+
 } // namespace
 
 // Tests that should pass for any topic. Use the wrappers below instead of
@@ -961,6 +1054,14 @@ RUN_TEST((wrong_handle_type_fails<ZX_INFO_JOB_CHILDREN, zx_koid_t, zx_thread_sel
 RUN_TEST((missing_rights_fails<ZX_INFO_JOB_CHILDREN, zx_koid_t, get_test_job,
                                ZX_RIGHT_ENUMERATE>));
 
+RUN_TEST(job_thread_stats_smoke);
+RUN_TEST((wrong_handle_type_fails<ZX_INFO_JOB_THREAD_STATS, zx_info_job_thread_t,
+                                  get_test_process>));
+RUN_TEST((wrong_handle_type_fails<ZX_INFO_JOB_THREAD_STATS, zx_info_job_thread_t,
+                                  zx_thread_self>));
+RUN_TEST((missing_rights_fails<ZX_INFO_JOB_THREAD_STATS, zx_info_job_thread_t, get_test_job,
+                               ZX_RIGHT_ENUMERATE>));
+
 // Basic tests for all other topics.
 
 RUN_SINGLE_ENTRY_TESTS(ZX_INFO_HANDLE_BASIC, zx_info_handle_basic_t, get_test_job);
@@ -970,6 +1071,9 @@ RUN_SINGLE_ENTRY_TESTS(ZX_INFO_HANDLE_BASIC, zx_info_handle_basic_t, zx_vmar_roo
 
 RUN_SINGLE_ENTRY_TESTS(ZX_INFO_HANDLE_COUNT, zx_info_handle_count_t, zx_thread_self);
 
+RUN_TEST(channel_info_smoke);
+RUN_TEST((wrong_handle_type_fails<ZX_INFO_CHANNEL, zx_info_channel_t, zx_thread_self>));
+
 RUN_SINGLE_ENTRY_TESTS(ZX_INFO_PROCESS, zx_info_process_t, get_test_process);
 RUN_TEST((wrong_handle_type_fails<ZX_INFO_PROCESS, zx_info_process_t, get_test_job>));
 RUN_TEST((wrong_handle_type_fails<ZX_INFO_PROCESS, zx_info_process_t, zx_thread_self>));
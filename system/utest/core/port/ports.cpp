@@ -139,6 +139,41 @@ static bool wait_count_invalid_test() {
     END_TEST;
 }
 
+static bool wait_many_test() {
+    BEGIN_TEST;
+
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0u, &port), ZX_OK);
+
+    for (uint64_t key = 1u; key <= 5u; key++) {
+        const zx_port_packet_t in = {key, ZX_PKT_TYPE_USER, 0, {}};
+        ASSERT_EQ(zx_port_queue(port, &in, 1u), ZX_OK);
+    }
+
+    // Takes what is queued, in order, without waiting for the rest.
+    zx_port_packet_t out[ZX_PORT_MAX_BATCH_PACKETS] = {};
+    size_t actual = 0u;
+    EXPECT_EQ(zx_port_wait_many(port, 0ull, out, 3u, &actual), ZX_OK);
+    EXPECT_EQ(actual, 3u);
+    for (size_t i = 0; i < actual; i++)
+        EXPECT_EQ(out[i].key, i + 1u);
+
+    EXPECT_EQ(zx_port_wait_many(port, 0ull, out, ZX_PORT_MAX_BATCH_PACKETS, &actual), ZX_OK);
+    EXPECT_EQ(actual, 2u);
+    EXPECT_EQ(out[0].key, 4u);
+    EXPECT_EQ(out[1].key, 5u);
+
+    EXPECT_EQ(zx_port_wait_many(port, 0ull, out, ZX_PORT_MAX_BATCH_PACKETS, &actual),
+              ZX_ERR_TIMED_OUT);
+    EXPECT_EQ(zx_port_wait_many(port, 0ull, out, 0u, &actual), ZX_ERR_OUT_OF_RANGE);
+    EXPECT_EQ(zx_port_wait_many(port, 0ull, out, ZX_PORT_MAX_BATCH_PACKETS + 1u, &actual),
+              ZX_ERR_OUT_OF_RANGE);
+
+    EXPECT_EQ(zx_handle_close(port), ZX_OK);
+
+    END_TEST;
+}
+
 static bool queue_and_close_test(void) {
     BEGIN_TEST;
     zx_status_t status;
@@ -407,6 +442,98 @@ static bool async_wait_invalid_option() {
     END_TEST;
 }
 
+static bool priority_test() {
+    BEGIN_TEST;
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    // user packets go in by priority in |type|, the key says which one
+    const uint32_t kPriorities[] = {
+        ZX_PORT_PRIORITY_DEFAULT, ZX_PORT_PRIORITY_URGENT, ZX_PORT_PRIORITY_DEFAULT,
+        ZX_PORT_PRIORITY_HIGH, ZX_PORT_PRIORITY_URGENT,
+    };
+    for (uint64_t ix = 0; ix != fbl::count_of(kPriorities); ++ix) {
+        zx_port_packet_t in = {};
+        in.key = ix;
+        in.type = ZX_PKT_TYPE_USER | ZX_PKT_PRIORITY(kPriorities[ix]);
+        ASSERT_EQ(zx_port_queue(port, &in, 1u), ZX_OK);
+    }
+
+    zx_port_packet_t in = {};
+    in.type = ZX_PKT_PRIORITY(3u);
+    EXPECT_EQ(zx_port_queue(port, &in, 1u), ZX_ERR_INVALID_ARGS);
+
+    // and a signal packet in the middle
+    zx_handle_t ev;
+    ASSERT_EQ(zx_event_create(0u, &ev), ZX_OK);
+    EXPECT_EQ(zx_object_wait_async(ev, port, 5u, ZX_EVENT_SIGNALED,
+                                   ZX_WAIT_ASYNC_ONCE |
+                                   ZX_WAIT_ASYNC_PRIORITY(ZX_PORT_PRIORITY_HIGH)), ZX_OK);
+    EXPECT_EQ(zx_object_wait_async(ev, port, 6u, ZX_EVENT_SIGNALED,
+                                   ZX_WAIT_ASYNC_ONCE | ZX_WAIT_ASYNC_PRIORITY(3u)),
+              ZX_ERR_INVALID_ARGS);
+    ASSERT_EQ(zx_object_signal(ev, 0u, ZX_EVENT_SIGNALED), ZX_OK);
+
+    const uint64_t kOrder[] = {1u, 4u, 3u, 5u, 0u, 2u};
+    for (uint64_t key : kOrder) {
+        zx_port_packet_t out = {};
+        ASSERT_EQ(zx_port_wait(port, 0ull, &out, 1u), ZX_OK);
+        EXPECT_EQ(out.key, key);
+        EXPECT_EQ(out.type, key == 5u ? ZX_PKT_TYPE_SIGNAL_ONE : ZX_PKT_TYPE_USER);
+    }
+
+    zx_port_packet_t out = {};
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out, 1u), ZX_ERR_TIMED_OUT);
+
+    ASSERT_EQ(zx_handle_close(ev), ZX_OK);
+    ASSERT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
+static bool coalesce_test() {
+    BEGIN_TEST;
+    zx_handle_t port;
+    ASSERT_EQ(zx_port_create(0, &port), ZX_OK);
+
+    const uint32_t kNumEvents = 8;
+    zx_handle_t ev[kNumEvents];
+    for (auto& e : ev) {
+        ASSERT_EQ(zx_event_create(0u, &e), ZX_OK);
+        EXPECT_EQ(zx_object_wait_async(e, port, 1u, ZX_USER_SIGNAL_0 | ZX_USER_SIGNAL_1,
+                                       ZX_WAIT_ASYNC_ONCE | ZX_WAIT_ASYNC_COALESCE), ZX_OK);
+    }
+    // a wait without the option gets a packet of its own
+    EXPECT_EQ(zx_object_wait_async(ev[0], port, 1u, ZX_USER_SIGNAL_0, ZX_WAIT_ASYNC_ONCE),
+              ZX_OK);
+
+    for (uint32_t ix = 0; ix != kNumEvents; ++ix) {
+        ASSERT_EQ(zx_object_signal(ev[ix], 0u, ix == 3 ? ZX_USER_SIGNAL_1 : ZX_USER_SIGNAL_0),
+                  ZX_OK);
+    }
+
+    // one merged packet for all the events, and the separate one for ev[0]
+    const zx_signals_t kBoth = ZX_USER_SIGNAL_0 | ZX_USER_SIGNAL_1;
+    zx_port_packet_t out[2] = {};
+    for (auto& o : out) {
+        ASSERT_EQ(zx_port_wait(port, 0ull, &o, 1u), ZX_OK);
+        EXPECT_EQ(o.key, 1u);
+    }
+    EXPECT_TRUE((out[0].signal.observed == kBoth && out[1].signal.observed == ZX_USER_SIGNAL_0) ||
+                (out[0].signal.observed == ZX_USER_SIGNAL_0 && out[1].signal.observed == kBoth),
+                "merged");
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out[0], 1u), ZX_ERR_TIMED_OUT);
+
+    // the merged one-shot waits are over
+    ASSERT_EQ(zx_object_signal(ev[5], ZX_USER_SIGNAL_0, 0u), ZX_OK);
+    ASSERT_EQ(zx_object_signal(ev[5], 0u, ZX_USER_SIGNAL_0), ZX_OK);
+    EXPECT_EQ(zx_port_wait(port, 0ull, &out[0], 1u), ZX_ERR_TIMED_OUT);
+
+    for (auto e : ev)
+        ASSERT_EQ(zx_handle_close(e), ZX_OK);
+    ASSERT_EQ(zx_handle_close(port), ZX_OK);
+    END_TEST;
+}
+
 static bool pre_writes_channel_test(uint32_t mode) {
     BEGIN_TEST;
     zx_status_t status;
@@ -746,11 +873,14 @@ RUN_TEST(wait_count_valid_test<0u>)
 RUN_TEST(wait_count_valid_test<1u>)
 RUN_TEST(wait_count_invalid_test<2u>)
 RUN_TEST(wait_count_invalid_test<23u>)
+RUN_TEST(wait_many_test)
 RUN_TEST(queue_and_close_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
 RUN_TEST(async_wait_invalid_option)
+RUN_TEST(priority_test)
+RUN_TEST(coalesce_test)
 RUN_TEST(async_wait_close_order_1)
 RUN_TEST(async_wait_close_order_2)
 RUN_TEST(async_wait_close_order_3)
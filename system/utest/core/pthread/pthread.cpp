@@ -7,6 +7,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -320,12 +321,84 @@ static bool pthread_getstack_other_thread_explicit_size() {
     END_TEST;
 }
 
+// More waiters than one futex_requeue_many() batch, so that a broadcast
+// has to requeue in several steps.
+#define BROADCAST_WAITERS 80
+#define BROADCAST_ROUNDS 100
+
+struct broadcast_state {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int generation;
+    int waiting;
+};
+
+static void* broadcast_waiter(void* arg) {
+    broadcast_state* state = static_cast<broadcast_state*>(arg);
+    pthread_mutex_lock(&state->mutex);
+    for (int round = 0; round < BROADCAST_ROUNDS; round++) {
+        int generation = state->generation;
+        state->waiting++;
+        while (state->generation == generation)
+            pthread_cond_wait(&state->cond, &state->mutex);
+    }
+    pthread_mutex_unlock(&state->mutex);
+    return NULL;
+}
+
+// Every round, all the waiters block on the condvar and one broadcast has
+// to get each of them through the mutex again.
+static bool pthread_cond_broadcast_test() {
+    BEGIN_TEST;
+
+    broadcast_state state = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0};
+    pthread_t threads[BROADCAST_WAITERS];
+    for (int i = 0; i < BROADCAST_WAITERS; i++)
+        ASSERT_EQ(pthread_create(&threads[i], NULL, broadcast_waiter, &state), 0, "");
+
+    zx_time_t elapsed = 0;
+    for (int round = 0; round < BROADCAST_ROUNDS; round++) {
+        pthread_mutex_lock(&state.mutex);
+        while (state.waiting < BROADCAST_WAITERS) {
+            pthread_mutex_unlock(&state.mutex);
+            sched_yield();
+            pthread_mutex_lock(&state.mutex);
+        }
+        state.waiting = 0;
+        state.generation++;
+        zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        pthread_cond_broadcast(&state.cond);
+        pthread_mutex_unlock(&state.mutex);
+
+        // The round is over once every waiter has run and blocked again,
+        // or, in the last round, exited.
+        if (round + 1 < BROADCAST_ROUNDS) {
+            pthread_mutex_lock(&state.mutex);
+            while (state.waiting < BROADCAST_WAITERS) {
+                pthread_mutex_unlock(&state.mutex);
+                sched_yield();
+                pthread_mutex_lock(&state.mutex);
+            }
+            pthread_mutex_unlock(&state.mutex);
+            elapsed += zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+        }
+    }
+    for (int i = 0; i < BROADCAST_WAITERS; i++)
+        ASSERT_EQ(pthread_join(threads[i], NULL), 0, "");
+
+    unittest_printf("%d waiters: %" PRIu64 " ns per broadcast round\n", BROADCAST_WAITERS,
+                    elapsed / (BROADCAST_ROUNDS - 1));
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(pthread_tests)
 RUN_TEST(pthread_test)
 RUN_TEST(pthread_self_main_thread_test)
 RUN_TEST(pthread_big_stack_size)
 RUN_TEST(pthread_getstack_main_thread)
 RUN_TEST(pthread_getstack_other_thread)
+RUN_TEST(pthread_cond_broadcast_test)
 END_TEST_CASE(pthread_tests)
 
 #ifndef BUILD_COMBINED_TESTS
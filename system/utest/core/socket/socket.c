@@ -8,6 +8,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 static zx_signals_t get_satisfied_signals(zx_handle_t handle) {
@@ -569,6 +570,219 @@ static bool socket_datagram_no_short_write(void) {
     END_TEST;
 }
 
+static bool socket_vector_io(void) {
+    BEGIN_TEST;
+
+    zx_status_t status;
+    size_t count;
+
+    zx_handle_t h0, h1;
+    status = zx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, ZX_OK, "");
+
+    char header[] = "head";
+    char body[] = "body of the message";
+    zx_iovec_t wvec[] = {
+        { header, 4u },
+        { NULL, 0u },
+        { body, sizeof(body) },
+    };
+    status = zx_socket_writev(h0, 0u, wvec, 3u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u + sizeof(body), "");
+
+    // The read splits the data at a different point than the write did.
+    char rbuf0[6] = {0};
+    char rbuf1[64] = {0};
+    zx_iovec_t rvec[] = {
+        { rbuf0, sizeof(rbuf0) },
+        { rbuf1, sizeof(rbuf1) },
+    };
+    status = zx_socket_readv(h1, 0u, rvec, 2u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u + sizeof(body), "");
+    EXPECT_EQ(memcmp(rbuf0, "headbo", 6u), 0, "");
+    EXPECT_EQ(memcmp(rbuf1, body + 2, sizeof(body) - 2), 0, "");
+
+    zx_iovec_t bad[] = {
+        { NULL, 4u },
+    };
+    status = zx_socket_writev(h0, 0u, bad, 1u, &count);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS, "");
+    status = zx_socket_writev(h0, 0u, wvec, ZX_SOCKET_MAX_IOVECS + 1, &count);
+    EXPECT_EQ(status, ZX_ERR_OUT_OF_RANGE, "");
+
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    // A vector datagram write is one packet.
+    status = zx_socket_create(ZX_SOCKET_DATAGRAM, &h0, &h1);
+    ASSERT_EQ(status, ZX_OK, "");
+
+    status = zx_socket_writev(h0, 0u, wvec, 3u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    status = zx_socket_write(h0, 0u, "next", 4u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+
+    memset(rbuf1, 0, sizeof(rbuf1));
+    status = zx_socket_read(h1, 0u, rbuf1, sizeof(rbuf1), &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u + sizeof(body), "");
+    EXPECT_EQ(memcmp(rbuf1, "headbody", 8u), 0, "");
+    status = zx_socket_read(h1, 0u, rbuf1, sizeof(rbuf1), &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u, "");
+
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_rx_capacity(void) {
+    BEGIN_TEST;
+
+    zx_status_t status;
+
+    zx_handle_t h0, h1;
+    status = zx_socket_create(0, &h0, &h1);
+    ASSERT_EQ(status, ZX_OK, "");
+
+    size_t capacity = 0;
+    status = zx_object_get_property(h1, ZX_PROP_SOCKET_RX_CAPACITY, &capacity,
+                                    sizeof(capacity));
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_GT(capacity, 0u, "");
+
+    capacity = 0;
+    status = zx_object_set_property(h1, ZX_PROP_SOCKET_RX_CAPACITY, &capacity,
+                                    sizeof(capacity));
+    EXPECT_EQ(status, ZX_ERR_OUT_OF_RANGE, "");
+
+    // Fill a small buffer; the writer stops being writable at the capacity.
+    capacity = 8192;
+    status = zx_object_set_property(h1, ZX_PROP_SOCKET_RX_CAPACITY, &capacity,
+                                    sizeof(capacity));
+    EXPECT_EQ(status, ZX_OK, "");
+
+    char* buffer = calloc(1, 4 * capacity);
+    size_t written = 0;
+    status = zx_socket_write(h0, 0u, buffer, 4 * capacity, &written);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(written, capacity, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & ZX_SOCKET_WRITABLE, 0u, "");
+    status = zx_socket_write(h0, 0u, buffer, 1u, &written);
+    EXPECT_EQ(status, ZX_ERR_SHOULD_WAIT, "");
+
+    // Growing the buffer makes the writer writable again.
+    capacity *= 2;
+    status = zx_object_set_property(h1, ZX_PROP_SOCKET_RX_CAPACITY, &capacity,
+                                    sizeof(capacity));
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(get_satisfied_signals(h0) & ZX_SOCKET_WRITABLE, ZX_SOCKET_WRITABLE, "");
+    status = zx_socket_write(h0, 0u, buffer, 4 * capacity, &written);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(written, capacity / 2, "");
+
+    free(buffer);
+    zx_handle_close(h0);
+    zx_handle_close(h1);
+
+    END_TEST;
+}
+
+static bool socket_splice(void) {
+    BEGIN_TEST;
+
+    zx_status_t status;
+    size_t count;
+
+    // a0 -> a1 is relayed to b0 -> b1.
+    zx_handle_t a0, a1, b0, b1;
+    status = zx_socket_create(0, &a0, &a1);
+    ASSERT_EQ(status, ZX_OK, "");
+    status = zx_socket_create(0, &b0, &b1);
+    ASSERT_EQ(status, ZX_OK, "");
+
+    status = zx_socket_splice(a1, 0u, b0, 16u, &count);
+    EXPECT_EQ(status, ZX_ERR_SHOULD_WAIT, "");
+
+    // Enough data to span several mbufs, moved in two steps so the first
+    // one splits an mbuf.
+    const size_t len = 10000u;
+    char* wbuf = malloc(len);
+    char* rbuf = calloc(1, len);
+    for (size_t i = 0; i < len; i++)
+        wbuf[i] = (char)i;
+    status = zx_socket_write(a0, 0u, wbuf, len, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, len, "");
+
+    status = zx_socket_splice(a1, 0u, b0, 3000u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 3000u, "");
+    EXPECT_EQ(get_satisfied_signals(b1) & ZX_SOCKET_READABLE, ZX_SOCKET_READABLE, "");
+    status = zx_socket_splice(a1, 0u, b0, len, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, len - 3000u, "");
+    EXPECT_EQ(get_satisfied_signals(a1) & ZX_SOCKET_READABLE, 0u, "");
+
+    status = zx_socket_read(b1, 0u, rbuf, len, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, len, "");
+    EXPECT_EQ(memcmp(rbuf, wbuf, len), 0, "");
+
+    // Splicing into a socket's own peer is refused.
+    status = zx_socket_write(a0, 0u, wbuf, 1u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    status = zx_socket_splice(a1, 0u, a0, 1u, &count);
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS, "");
+
+    // Datagrams move whole, keeping their boundaries.
+    zx_handle_t d0, d1, e0, e1;
+    status = zx_socket_create(ZX_SOCKET_DATAGRAM, &d0, &d1);
+    ASSERT_EQ(status, ZX_OK, "");
+    status = zx_socket_create(ZX_SOCKET_DATAGRAM, &e0, &e1);
+    ASSERT_EQ(status, ZX_OK, "");
+
+    status = zx_socket_splice(a1, 0u, e0, 1u, &count);
+    EXPECT_EQ(status, ZX_ERR_NOT_SUPPORTED, "");
+
+    status = zx_socket_write(d0, 0u, "packet", 6u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    status = zx_socket_write(d0, 0u, "next", 4u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    status = zx_socket_splice(d1, 0u, e0, 4u, &count);
+    EXPECT_EQ(status, ZX_ERR_OUT_OF_RANGE, "");
+    status = zx_socket_splice(d1, 0u, e0, 8u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 6u, "");
+    status = zx_socket_splice(d1, 0u, e0, 8u, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u, "");
+
+    status = zx_socket_read(e1, 0u, rbuf, len, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 6u, "");
+    EXPECT_EQ(memcmp(rbuf, "packet", 6u), 0, "");
+    status = zx_socket_read(e1, 0u, rbuf, len, &count);
+    EXPECT_EQ(status, ZX_OK, "");
+    EXPECT_EQ(count, 4u, "");
+
+    free(wbuf);
+    free(rbuf);
+    zx_handle_close(a0);
+    zx_handle_close(a1);
+    zx_handle_close(b0);
+    zx_handle_close(b1);
+    zx_handle_close(d0);
+    zx_handle_close(d1);
+    zx_handle_close(e0);
+    zx_handle_close(e1);
+
+    END_TEST;
+}
+
 static bool socket_control_plane_absent(void) {
     BEGIN_TEST;
 
@@ -810,6 +1024,9 @@ RUN_TEST(socket_bytes_outstanding_shutdown_read)
 RUN_TEST(socket_short_write)
 RUN_TEST(socket_datagram)
 RUN_TEST(socket_datagram_no_short_write)
+RUN_TEST(socket_vector_io)
+RUN_TEST(socket_rx_capacity)
+RUN_TEST(socket_splice)
 RUN_TEST(socket_control_plane_absent)
 RUN_TEST(socket_control_plane)
 RUN_TEST(socket_control_plane_shutdown)
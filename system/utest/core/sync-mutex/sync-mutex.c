@@ -0,0 +1,219 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <sync/counter.h>
+#include <sync/mutex.h>
+#include <sync/rwlock.h>
+#include <zircon/process.h>
+#include <zircon/syscalls.h>
+#include <unittest/unittest.h>
+
+#define MAX_THREADS 64
+#define ITERATIONS 2000
+#define BENCH_ITERATIONS 10000
+
+static bool mutex_owner_test(void) {
+    BEGIN_TEST;
+
+    sync_mutex_t mutex = SYNC_MUTEX_INIT;
+    EXPECT_EQ(sync_mutex_owner(&mutex), ZX_HANDLE_INVALID, "free mutex has an owner");
+
+    sync_mutex_lock(&mutex);
+    EXPECT_EQ(sync_mutex_owner(&mutex), zx_thread_self(), "owner not published");
+    EXPECT_EQ(sync_mutex_trylock(&mutex), ZX_ERR_BAD_STATE, "trylock of a held mutex");
+    sync_mutex_unlock(&mutex);
+
+    EXPECT_EQ(sync_mutex_trylock(&mutex), ZX_OK, "trylock of a free mutex");
+    sync_mutex_unlock(&mutex);
+    EXPECT_EQ(sync_mutex_owner(&mutex), ZX_HANDLE_INVALID, "owner left behind");
+
+    END_TEST;
+}
+
+static sync_mutex_t g_mutex = SYNC_MUTEX_INIT;
+static uint64_t g_protected;
+
+static int mutex_increment_thread(void* arg) {
+    for (int i = 0; i < ITERATIONS; i++) {
+        sync_mutex_lock(&g_mutex);
+        uint64_t value = g_protected;
+        if ((i & 15) == 0)
+            thrd_yield();
+        g_protected = value + 1;
+        sync_mutex_unlock(&g_mutex);
+    }
+    return 0;
+}
+
+static bool mutex_contention_test(void) {
+    BEGIN_TEST;
+
+    const int num_threads = 8;
+    thrd_t threads[num_threads];
+    g_protected = 0;
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], mutex_increment_thread, NULL, "mutex test"),
+                  thrd_success, "");
+    }
+    for (int i = 0; i < num_threads; i++)
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+
+    EXPECT_EQ(g_protected, (uint64_t)num_threads * ITERATIONS, "lost an update");
+    EXPECT_EQ(sync_mutex_owner(&g_mutex), ZX_HANDLE_INVALID, "");
+
+    END_TEST;
+}
+
+// Writers keep the two values equal; readers must never see them differ.
+static sync_rwlock_t g_rwlock = SYNC_RWLOCK_INIT;
+static volatile uint64_t g_first, g_second;
+static volatile int g_torn_reads;
+
+static int rwlock_thread(void* arg) {
+    bool writer = (uintptr_t)arg != 0;
+    for (int i = 0; i < ITERATIONS; i++) {
+        if (writer) {
+            sync_rwlock_write_lock(&g_rwlock);
+            g_first++;
+            thrd_yield();
+            g_second++;
+            sync_rwlock_write_unlock(&g_rwlock);
+        } else {
+            sync_rwlock_read_lock(&g_rwlock);
+            if (g_first != g_second)
+                __atomic_fetch_add(&g_torn_reads, 1, __ATOMIC_SEQ_CST);
+            sync_rwlock_read_unlock(&g_rwlock);
+        }
+    }
+    return 0;
+}
+
+static bool rwlock_test(void) {
+    BEGIN_TEST;
+
+    const int num_threads = 8;
+    thrd_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], rwlock_thread, (void*)(uintptr_t)(i % 4 == 0),
+                                        "rwlock test"),
+                  thrd_success, "");
+    }
+    for (int i = 0; i < num_threads; i++)
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+
+    EXPECT_EQ(g_torn_reads, 0, "reader overlapped a writer");
+    EXPECT_EQ(g_first, (uint64_t)(num_threads / 4) * ITERATIONS, "lost a write");
+    EXPECT_EQ(g_first, g_second, "");
+
+    END_TEST;
+}
+
+static sync_counter_t g_counter;
+
+static int counter_thread(void* arg) {
+    for (int i = 0; i < ITERATIONS; i++)
+        sync_counter_add(&g_counter, 3);
+    return 0;
+}
+
+static bool counter_test(void) {
+    BEGIN_TEST;
+
+    const int num_threads = 16;
+    thrd_t threads[num_threads];
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], counter_thread, NULL, "counter test"),
+                  thrd_success, "");
+    }
+    for (int i = 0; i < num_threads; i++)
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+
+    EXPECT_EQ(sync_counter_read(&g_counter), 3 * num_threads * ITERATIONS, "");
+
+    END_TEST;
+}
+
+// Microbenchmarks: every thread takes and drops the same lock around a tiny
+// critical section, and we report the average cost of one lock/unlock pair.
+typedef struct {
+    void (*lock)(void* lock);
+    void (*unlock)(void* lock);
+    void* lock_arg;
+    volatile uint64_t counter;
+} bench_t;
+
+static void mtx_lock_fn(void* m) __TA_NO_THREAD_SAFETY_ANALYSIS { mtx_lock(m); }
+static void mtx_unlock_fn(void* m) __TA_NO_THREAD_SAFETY_ANALYSIS { mtx_unlock(m); }
+static void sync_lock_fn(void* m) __TA_NO_THREAD_SAFETY_ANALYSIS { sync_mutex_lock(m); }
+static void sync_unlock_fn(void* m) __TA_NO_THREAD_SAFETY_ANALYSIS { sync_mutex_unlock(m); }
+
+static int bench_thread(void* arg) {
+    bench_t* bench = arg;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        bench->lock(bench->lock_arg);
+        bench->counter++;
+        bench->unlock(bench->lock_arg);
+    }
+    return 0;
+}
+
+static bool run_bench(bench_t* bench, int num_threads, zx_duration_t* per_op) {
+    BEGIN_HELPER;
+
+    thrd_t threads[MAX_THREADS];
+    bench->counter = 0;
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < num_threads; i++) {
+        ASSERT_EQ(thrd_create_with_name(&threads[i], bench_thread, bench, "lock bench"),
+                  thrd_success, "");
+    }
+    for (int i = 0; i < num_threads; i++)
+        ASSERT_EQ(thrd_join(threads[i], NULL), thrd_success, "");
+    zx_duration_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    uint64_t ops = (uint64_t)num_threads * BENCH_ITERATIONS;
+    EXPECT_EQ(bench->counter, ops, "lost an update");
+    *per_op = elapsed / ops;
+
+    END_HELPER;
+}
+
+static bool mutex_bench(void) {
+    BEGIN_TEST;
+
+    mtx_t mtx;
+    ASSERT_EQ(mtx_init(&mtx, mtx_plain), thrd_success, "");
+    sync_mutex_t mutex = SYNC_MUTEX_INIT;
+    bench_t mtx_bench = {mtx_lock_fn, mtx_unlock_fn, &mtx, 0};
+    bench_t sync_bench = {sync_lock_fn, sync_unlock_fn, &mutex, 0};
+
+    unittest_printf("\n%8s %14s %14s\n", "threads", "mtx_t ns", "sync_mutex ns");
+    for (int num_threads = 2; num_threads <= MAX_THREADS; num_threads *= 2) {
+        zx_duration_t mtx_ns, sync_ns;
+        ASSERT_TRUE(run_bench(&mtx_bench, num_threads, &mtx_ns), "");
+        ASSERT_TRUE(run_bench(&sync_bench, num_threads, &sync_ns), "");
+        unittest_printf("%8d %14" PRIu64 " %14" PRIu64 "\n", num_threads, mtx_ns, sync_ns);
+    }
+
+    mtx_destroy(&mtx);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(sync_mutex_tests)
+RUN_TEST(mutex_owner_test)
+RUN_TEST(mutex_contention_test)
+RUN_TEST(rwlock_test)
+RUN_TEST(counter_test)
+RUN_TEST_LARGE(mutex_bench)
+END_TEST_CASE(sync_mutex_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
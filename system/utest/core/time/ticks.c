@@ -25,8 +25,28 @@ static bool elapsed_time_using_ticks(void) {
     END_TEST;
 }
 
+// zx_time_get may be answered in the vDSO, but it must agree with the
+// kernel's own clocks.
+static bool time_get_matches_clock_get(void) {
+    BEGIN_TEST;
+
+    static const uint32_t clocks[] = {ZX_CLOCK_MONOTONIC, ZX_CLOCK_UTC};
+    for (size_t i = 0; i < countof(clocks); i++) {
+        for (int j = 0; j < 100; j++) {
+            zx_time_t before = zx_clock_get(clocks[i]);
+            zx_time_t now = zx_time_get(clocks[i]);
+            zx_time_t after = zx_clock_get(clocks[i]);
+            ASSERT_GE(now, before, "zx_time_get behind zx_clock_get");
+            ASSERT_LE(now, after, "zx_time_get ahead of zx_clock_get");
+        }
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ticks_tests)
 RUN_TEST(elapsed_time_using_ticks)
+RUN_TEST(time_get_matches_clock_get)
 END_TEST_CASE(ticks_tests)
 
 #ifndef BUILD_COMBINED_TESTS
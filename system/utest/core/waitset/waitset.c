@@ -0,0 +1,154 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <zircon/syscalls.h>
+#include <unittest/unittest.h>
+
+#define NUM_EVENTS 256
+#define NUM_ROUNDS 1000
+
+static bool waitset_basic_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t ws;
+    EXPECT_EQ(zx_waitset_create(1u, &ws), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(zx_waitset_create(0u, &ws), ZX_OK, "");
+
+    zx_handle_t ev[2];
+    ASSERT_EQ(zx_event_create(0u, &ev[0]), ZX_OK, "");
+    ASSERT_EQ(zx_event_create(0u, &ev[1]), ZX_OK, "");
+
+    ASSERT_EQ(zx_waitset_add(ws, 1u, ev[0], ZX_EVENT_SIGNALED), ZX_OK, "");
+    ASSERT_EQ(zx_waitset_add(ws, 2u, ev[1], ZX_EVENT_SIGNALED), ZX_OK, "");
+    EXPECT_EQ(zx_waitset_add(ws, 2u, ev[0], ZX_USER_SIGNAL_0), ZX_ERR_ALREADY_EXISTS, "");
+    EXPECT_EQ(zx_waitset_add(ws, 3u, ws, ZX_EVENT_SIGNALED), ZX_ERR_NOT_SUPPORTED, "");
+
+    zx_waitset_result_t results[ZX_WAITSET_MAX_RESULTS];
+    size_t n;
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, 0u, &n), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS + 1, &n),
+              ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n),
+              ZX_ERR_TIMED_OUT, "");
+
+    // only the signaled entry is reported, for as long as it stays signaled
+    ASSERT_EQ(zx_object_signal(ev[1], 0u, ZX_EVENT_SIGNALED), ZX_OK, "");
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n), ZX_OK, "");
+        ASSERT_EQ(n, 1u, "");
+        EXPECT_EQ(results[0].cookie, 2u, "");
+        EXPECT_TRUE(results[0].observed & ZX_EVENT_SIGNALED, "");
+    }
+    ASSERT_EQ(zx_object_signal(ev[1], ZX_EVENT_SIGNALED, 0u), ZX_OK, "");
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n),
+              ZX_ERR_TIMED_OUT, "");
+
+    // a removed entry is no longer reported
+    ASSERT_EQ(zx_waitset_remove(ws, 2u), ZX_OK, "");
+    EXPECT_EQ(zx_waitset_remove(ws, 2u), ZX_ERR_NOT_FOUND, "");
+    ASSERT_EQ(zx_object_signal(ev[1], 0u, ZX_EVENT_SIGNALED), ZX_OK, "");
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n),
+              ZX_ERR_TIMED_OUT, "");
+
+    // closing a watched handle reports it until the entry is removed
+    ASSERT_EQ(zx_handle_close(ev[0]), ZX_OK, "");
+    ASSERT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n), ZX_OK, "");
+    ASSERT_EQ(n, 1u, "");
+    EXPECT_EQ(results[0].cookie, 1u, "");
+    EXPECT_TRUE(results[0].observed & ZX_SIGNAL_HANDLE_CLOSED, "");
+    ASSERT_EQ(zx_waitset_remove(ws, 1u), ZX_OK, "");
+    EXPECT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n),
+              ZX_ERR_TIMED_OUT, "");
+
+    // closing the wait set with live entries drops them
+    ASSERT_EQ(zx_waitset_add(ws, 4u, ev[1], ZX_EVENT_SIGNALED), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(ws), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(ev[1]), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool waitset_rotation_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t ws;
+    ASSERT_EQ(zx_waitset_create(0u, &ws), ZX_OK, "");
+
+    zx_handle_t ev[NUM_EVENTS];
+    for (uint64_t i = 0; i < NUM_EVENTS; i++) {
+        ASSERT_EQ(zx_event_create(0u, &ev[i]), ZX_OK, "");
+        ASSERT_EQ(zx_object_signal(ev[i], 0u, ZX_EVENT_SIGNALED), ZX_OK, "");
+        ASSERT_EQ(zx_waitset_add(ws, i, ev[i], ZX_EVENT_SIGNALED), ZX_OK, "");
+    }
+
+    // with every entry ready, consecutive small waits cover all of them
+    bool seen[NUM_EVENTS] = {};
+    zx_waitset_result_t results[ZX_WAITSET_MAX_RESULTS];
+    for (int i = 0; i < NUM_EVENTS / ZX_WAITSET_MAX_RESULTS; i++) {
+        size_t n;
+        ASSERT_EQ(zx_waitset_wait(ws, 0u, results, ZX_WAITSET_MAX_RESULTS, &n), ZX_OK, "");
+        ASSERT_EQ(n, ZX_WAITSET_MAX_RESULTS, "");
+        for (size_t j = 0; j < n; j++) {
+            ASSERT_LT(results[j].cookie, (uint64_t)NUM_EVENTS, "");
+            EXPECT_FALSE(seen[results[j].cookie], "entry reported twice");
+            seen[results[j].cookie] = true;
+        }
+    }
+
+    for (int i = 0; i < NUM_EVENTS; i++)
+        EXPECT_EQ(zx_handle_close(ev[i]), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(ws), ZX_OK, "");
+
+    END_TEST;
+}
+
+static bool waitset_one_ready_benchmark(void) {
+    BEGIN_TEST;
+
+    zx_handle_t ws;
+    ASSERT_EQ(zx_waitset_create(0u, &ws), ZX_OK, "");
+
+    zx_handle_t ev[NUM_EVENTS];
+    for (uint64_t i = 0; i < NUM_EVENTS; i++) {
+        ASSERT_EQ(zx_event_create(0u, &ev[i]), ZX_OK, "");
+        ASSERT_EQ(zx_waitset_add(ws, i, ev[i], ZX_EVENT_SIGNALED), ZX_OK, "");
+    }
+
+    // one ready entry out of many: a wait shouldn't depend on the set size
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < NUM_ROUNDS; i++) {
+        zx_handle_t h = ev[i % NUM_EVENTS];
+        ASSERT_EQ(zx_object_signal(h, 0u, ZX_EVENT_SIGNALED), ZX_OK, "");
+        zx_waitset_result_t result;
+        size_t n;
+        ASSERT_EQ(zx_waitset_wait(ws, ZX_TIME_INFINITE, &result, 1u, &n), ZX_OK, "");
+        ASSERT_EQ(n, 1u, "");
+        EXPECT_EQ(result.cookie, (uint64_t)(i % NUM_EVENTS), "");
+        ASSERT_EQ(zx_object_signal(h, ZX_EVENT_SIGNALED, 0u), ZX_OK, "");
+    }
+    zx_time_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+    unittest_printf("%d waits on %d handles: %" PRIu64 " ns per wait\n",
+                    NUM_ROUNDS, NUM_EVENTS, elapsed / NUM_ROUNDS);
+
+    for (int i = 0; i < NUM_EVENTS; i++)
+        EXPECT_EQ(zx_handle_close(ev[i]), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(ws), ZX_OK, "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(waitset_tests)
+RUN_TEST(waitset_basic_test)
+RUN_TEST(waitset_rotation_test)
+RUN_TEST(waitset_one_ready_benchmark)
+END_TEST_CASE(waitset_tests)
+
+#ifndef BUILD_COMBINED_TESTS
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
+#endif
@@ -5,6 +5,7 @@
 #include <digest/merkle-tree.h>
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <digest/digest.h>
 #include <zircon/assert.h>
@@ -362,6 +363,25 @@ bool CreateCAll(void) {
     END_TEST;
 }
 
+// Used by CreateParallel below.
+uint8_t gParallelTree[sizeof(gTree)];
+
+bool CreateParallel(void) {
+    BEGIN_TEST_WITH_RC;
+    // Large enough to be split between threads, and not node-aligned.
+    for (uint64_t i = 0; i < kUnalignedLarge; ++i) {
+        gData[i] = static_cast<uint8_t>(rand());
+    }
+    size_t tree_len = MerkleTree::GetTreeLength(kUnalignedLarge);
+    Digest expected, actual;
+    ASSERT_OK(MerkleTree::Create(gData, kUnalignedLarge, gTree, tree_len, &expected));
+    ASSERT_OK(MerkleTree::CreateParallel(gData, kUnalignedLarge, gParallelTree, tree_len,
+                                         &actual, 4));
+    ASSERT_TRUE(expected == actual, "Parallel root digest differs");
+    ASSERT_EQ(memcmp(gTree, gParallelTree, tree_len), 0, "Parallel tree differs");
+    END_TEST;
+}
+
 bool CreateByteByByte(void) {
     BEGIN_TEST_WITH_RC;
     size_t tree_len = MerkleTree::GetTreeLength(kSmall);
@@ -603,6 +623,19 @@ bool VerifyBadTree(void) {
     END_TEST;
 }
 
+bool VerifyBadTreeShortRange(void) {
+    BEGIN_TEST_WITH_RC;
+    size_t tree_len = MerkleTree::GetTreeLength(kLarge);
+    Digest digest;
+    ASSERT_OK(MerkleTree::Create(gData, kLarge, gTree, tree_len, &digest));
+    // Leave the digest of the range itself alone, but not the node holding it.
+    gTree[Digest::kLength] ^= 1;
+    ASSERT_ERR(
+        ZX_ERR_IO_DATA_INTEGRITY,
+        MerkleTree::Verify(gData, kLarge, gTree, tree_len, 0, 1, digest));
+    END_TEST;
+}
+
 bool VerifyGoodPartOfBadLeaves(void) {
     BEGIN_TEST_WITH_RC;
     size_t tree_len = MerkleTree::GetTreeLength(kSmall);
@@ -718,6 +751,7 @@ RUN_TEST(CreateFinalIncompleteData)
 RUN_TEST(CreateAll)
 RUN_TEST(CreateFinalCAll)
 RUN_TEST(CreateCAll)
+RUN_TEST(CreateParallel)
 RUN_TEST(CreateByteByByte)
 RUN_TEST(CreateMissingData)
 RUN_TEST(CreateMissingTree)
@@ -737,6 +771,7 @@ RUN_TEST(VerifyZeroLength)
 RUN_TEST(VerifyBadRoot)
 RUN_TEST(VerifyGoodPartOfBadTree)
 RUN_TEST(VerifyBadTree)
+RUN_TEST(VerifyBadTreeShortRange)
 RUN_TEST(VerifyGoodPartOfBadLeaves)
 RUN_TEST(VerifyBadLeaves)
 RUN_TEST(CreateAndVerifyHugePRNGData)
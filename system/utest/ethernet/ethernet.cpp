@@ -251,6 +251,26 @@ class EthernetClient {
         return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
     }
 
+    zx_status_t GetStats(eth_stats_t* stats) {
+        ssize_t rc = ioctl_ethernet_get_stats(fd_, stats);
+        return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
+    }
+
+    zx_status_t GetRxQueue(uint32_t queue, zx::fifo* out) {
+        ssize_t rc = ioctl_ethernet_get_rx_queue(fd_, &queue, out->reset_and_get_address());
+        return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
+    }
+
+    zx_status_t SetRss(const eth_rss_config_t& config) {
+        ssize_t rc = ioctl_ethernet_set_rss(fd_, &config);
+        return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
+    }
+
+    zx_status_t SetOffloads(uint32_t features) {
+        ssize_t rc = ioctl_ethernet_set_offloads(fd_, &features);
+        return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
+    }
+
     zx_status_t SetPromisc(bool on) {
         ssize_t rc = ioctl_ethernet_set_promisc(fd_, &on);
         return rc < 0 ? static_cast<zx_status_t>(rc) : ZX_OK;
@@ -606,6 +626,128 @@ static bool EthernetDataTest_Send() {
     END_TEST;
 }
 
+// Sends several packets with one fifo write, and checks that their completions come back
+// together too.
+static bool EthernetDataTest_SendBatch() {
+    BEGIN_TEST;
+    zx::socket sock;
+    ASSERT_EQ(ZX_OK, CreateEthertap(1500, __func__, &sock));
+
+    int devfd = -1;
+    ASSERT_EQ(ZX_OK, OpenEthertapDev(&devfd));
+    ASSERT_GE(devfd, 0);
+
+    EthernetClient client(devfd);
+    ASSERT_EQ(ZX_OK, client.Register(__func__, 32, 2048));
+    ASSERT_EQ(ZX_OK, client.Start());
+
+    sock.signal_peer(0, ETHERTAP_SIGNAL_ONLINE);
+
+    constexpr uint32_t kPackets = 8;
+    eth_fifo_entry_t entries[kPackets];
+    for (uint32_t i = 0; i < kPackets; i++) {
+        auto entry = client.GetTxBuffer();
+        ASSERT_TRUE(entry != nullptr);
+        uint8_t* buf = static_cast<uint8_t*>(entry->cookie);
+        memset(buf, static_cast<int>(i), 32);
+        entry->length = 32;
+        entries[i] = *entry;
+    }
+    uint32_t actual = 0;
+    ASSERT_EQ(ZX_OK, client.tx_fifo()->write(entries, sizeof(entries), &actual));
+    ASSERT_EQ(kPackets, actual);
+
+    for (uint32_t i = 0; i < kPackets; i++) {
+        ExpectPacketRead(&sock, 32, entries[i].cookie, "");
+    }
+
+    uint32_t returned = 0;
+    while (returned < kPackets) {
+        zx_signals_t obs;
+        ASSERT_EQ(ZX_OK, client.tx_fifo()->wait_one(ZX_FIFO_READABLE, FAIL_TIMEOUT, &obs));
+        eth_fifo_entry_t return_entries[kPackets];
+        ASSERT_EQ(ZX_OK, client.tx_fifo()->read(return_entries, sizeof(return_entries),
+                                                &actual));
+        for (uint32_t i = 0; i < actual; i++) {
+            EXPECT_TRUE(return_entries[i].flags & ETH_FIFO_TX_OK);
+            client.ReturnTxBuffer(&return_entries[i]);
+        }
+        returned += actual;
+    }
+    ASSERT_EQ(kPackets, returned);
+
+    eth_stats_t stats;
+    ASSERT_EQ(ZX_OK, client.GetStats(&stats));
+    EXPECT_EQ(kPackets, stats.tx_entries);
+    EXPECT_EQ(0u, stats.tx_fifo_full);
+    EXPECT_LT(stats.tx_batches, kPackets, "completions were not batched");
+
+    EXPECT_EQ(ZX_OK, client.Stop());
+    sock.reset();
+
+    ETHTEST_CLEANUP_DELAY;
+    END_TEST;
+}
+
+// Checks that offloads the device lacks can't be enabled, and that packets asking for them are
+// handed back without being sent.
+static bool EthernetDataTest_SendOffloadUnsupported() {
+    BEGIN_TEST;
+    zx::socket sock;
+    ASSERT_EQ(ZX_OK, CreateEthertap(1500, __func__, &sock));
+
+    int devfd = -1;
+    ASSERT_EQ(ZX_OK, OpenEthertapDev(&devfd));
+    ASSERT_GE(devfd, 0);
+
+    eth_info_t info;
+    ASSERT_GE(ioctl_ethernet_get_info(devfd, &info), 0);
+    EXPECT_EQ(0u, info.features & (ETH_FEATURE_TX_CSUM | ETH_FEATURE_TSO | ETH_FEATURE_RX_CSUM |
+                                   ETH_FEATURE_LRO));
+
+    EthernetClient client(devfd);
+    ASSERT_EQ(ZX_OK, client.Register(__func__, 32, 2048));
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED, client.SetOffloads(ETH_FEATURE_TX_CSUM));
+    EXPECT_EQ(ZX_OK, client.SetOffloads(0));
+    ASSERT_EQ(ZX_OK, client.Start());
+
+    sock.signal_peer(0, ETHERTAP_SIGNAL_ONLINE);
+
+    auto entry = client.GetTxBuffer();
+    ASSERT_TRUE(entry != nullptr);
+    eth_tx_offload_t offload = {};
+    offload.flags = ETH_TX_OFFLOAD_CSUM;
+    offload.csum_start = 34;
+    offload.csum_offset = 16;
+    uint8_t* buf = static_cast<uint8_t*>(entry->cookie);
+    memset(buf, 0, 128);
+    memcpy(buf, &offload, sizeof(offload));
+    entry->length = 128;
+    entry->flags = ETH_FIFO_TX_OFFLOAD;
+
+    uint32_t actual = 0;
+    ASSERT_EQ(ZX_OK, client.tx_fifo()->write(entry, sizeof(eth_fifo_entry_t), &actual));
+    EXPECT_EQ(1u, actual);
+
+    zx_signals_t obs;
+    ASSERT_EQ(ZX_OK, client.tx_fifo()->wait_one(ZX_FIFO_READABLE, FAIL_TIMEOUT, &obs));
+    eth_fifo_entry_t return_entry;
+    ASSERT_EQ(ZX_OK, client.tx_fifo()->read(&return_entry, sizeof(eth_fifo_entry_t), &actual));
+    EXPECT_EQ(1u, actual);
+    EXPECT_EQ(ETH_FIFO_INVALID, return_entry.flags);
+    EXPECT_EQ(entry->offset, return_entry.offset);
+    EXPECT_EQ(entry->length, return_entry.length);
+    client.ReturnTxBuffer(&return_entry);
+
+    EXPECT_EQ(ZX_ERR_TIMED_OUT, sock.wait_one(ZX_SOCKET_READABLE, zx::time(), &obs));
+
+    EXPECT_EQ(ZX_OK, client.Stop());
+    sock.reset();
+
+    ETHTEST_CLEANUP_DELAY;
+    END_TEST;
+}
+
 static bool EthernetDataTest_Recv() {
     BEGIN_TEST;
     // Set up the tap device and the ethernet client
@@ -666,6 +808,73 @@ static bool EthernetDataTest_Recv() {
     END_TEST;
 }
 
+// Steers all IPv4 packets to a second rx queue, and checks that one arrives there.
+static bool EthernetDataTest_RecvRss() {
+    BEGIN_TEST;
+    zx::socket sock;
+    ASSERT_EQ(ZX_OK, CreateEthertap(1500, __func__, &sock));
+
+    int devfd = -1;
+    ASSERT_EQ(ZX_OK, OpenEthertapDev(&devfd));
+    ASSERT_GE(devfd, 0);
+
+    EthernetClient client(devfd);
+    ASSERT_EQ(ZX_OK, client.Register(__func__, 32, 2048));
+
+    zx::fifo queue;
+    ASSERT_EQ(ZX_OK, client.GetRxQueue(1, &queue));
+    EXPECT_EQ(ZX_ERR_ALREADY_BOUND, client.GetRxQueue(1, &queue));
+    zx::fifo bad_queue;
+    EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, client.GetRxQueue(ETH_MAX_RX_QUEUES, &bad_queue));
+
+    // The client's tx buffers are otherwise unused here.
+    auto buffer = client.GetTxBuffer();
+    ASSERT_TRUE(buffer != nullptr);
+    eth_fifo_entry_t posted = *buffer;
+    posted.length = 2048;
+    uint32_t actual_entries = 0;
+    ASSERT_EQ(ZX_OK, queue.write(&posted, sizeof(posted), &actual_entries));
+
+    eth_rss_config_t config = {};
+    config.hash_types = ETH_RSS_HASH_IPV4;
+    for (size_t i = 0; i < ETH_RSS_KEY_SIZE; i++) {
+        config.key[i] = static_cast<uint8_t>(i * 7 + 1);
+    }
+    memset(config.indirection, 1, sizeof(config.indirection));
+    ASSERT_EQ(ZX_OK, client.SetRss(config));
+    ASSERT_EQ(ZX_OK, client.Start());
+
+    sock.signal_peer(0, ETHERTAP_SIGNAL_ONLINE);
+
+    // A minimal IPv4 packet: ethernet header, then an IP header with no payload.
+    uint8_t packet[34] = {};
+    packet[12] = 0x08;
+    packet[13] = 0x00;
+    packet[14] = 0x45;
+    packet[23] = 17;
+    for (int i = 26; i < 34; i++) {
+        packet[i] = static_cast<uint8_t>(i);
+    }
+    size_t actual = 0;
+    EXPECT_EQ(ZX_OK, sock.write(0, packet, sizeof(packet), &actual));
+    EXPECT_EQ(sizeof(packet), actual);
+
+    zx_signals_t obs;
+    ASSERT_EQ(ZX_OK, queue.wait_one(ZX_FIFO_READABLE, FAIL_TIMEOUT, &obs));
+    eth_fifo_entry_t entry;
+    ASSERT_EQ(ZX_OK, queue.read(&entry, sizeof(entry), &actual_entries));
+    EXPECT_TRUE(entry.flags & ETH_FIFO_RX_OK);
+    ASSERT_EQ(sizeof(packet), entry.length);
+    EXPECT_BYTES_EQ(packet, client.GetRxBuffer(entry.offset), sizeof(packet), "");
+    EXPECT_EQ(ZX_ERR_TIMED_OUT, client.rx_fifo()->wait_one(ZX_FIFO_READABLE, zx::time(), &obs));
+
+    EXPECT_EQ(ZX_OK, client.Stop());
+    sock.reset();
+
+    ETHTEST_CLEANUP_DELAY;
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(EthernetSetupTests)
 RUN_TEST_MEDIUM(EthernetStartTest)
 RUN_TEST_MEDIUM(EthernetLinkStatusTest)
@@ -678,7 +887,10 @@ END_TEST_CASE(EthernetConfigTests)
 
 BEGIN_TEST_CASE(EthernetDataTests)
 RUN_TEST_MEDIUM(EthernetDataTest_Send)
+RUN_TEST_MEDIUM(EthernetDataTest_SendBatch)
+RUN_TEST_MEDIUM(EthernetDataTest_SendOffloadUnsupported)
 RUN_TEST_MEDIUM(EthernetDataTest_Recv)
+RUN_TEST_MEDIUM(EthernetDataTest_RecvRss)
 END_TEST_CASE(EthernetDataTests)
 
 int main(int argc, char* argv[]) {
@@ -0,0 +1,271 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/flat_hash_map.h>
+#include <fbl/tests/lfsr.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace fbl {
+namespace tests {
+namespace {
+
+// A move-only value which keeps track of how many of it are alive, so the
+// tests can tell that the map destroys what it holds.
+struct TestValue {
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(TestValue);
+    explicit TestValue(size_t val) : alive_(true), val_(val) { ++live_count_; }
+    TestValue(TestValue&& r) : alive_(r.alive_), val_(r.val_) { r.alive_ = false; }
+    TestValue& operator=(TestValue&& r) {
+        if (alive_)
+            --live_count_;
+        alive_ = r.alive_;
+        val_ = r.val_;
+        r.alive_ = false;
+        return *this;
+    }
+    ~TestValue() {
+        if (alive_)
+            --live_count_;
+    }
+
+    bool alive_;
+    size_t val_;
+
+    static size_t live_count_;
+};
+
+size_t TestValue::live_count_ = 0;
+
+// Fails every allocation once |fail_| is set.
+struct FailingAllocatorTraits {
+    static void* Allocate(size_t size) {
+        return fail_ ? nullptr : DefaultAllocatorTraits::Allocate(size);
+    }
+    static void Deallocate(void* object) { DefaultAllocatorTraits::Deallocate(object); }
+
+    static bool fail_;
+};
+
+bool FailingAllocatorTraits::fail_ = false;
+
+using IntMap = FlatHashMap<uint32_t, uint32_t>;
+
+bool flat_hash_map_insert_find_erase() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kCount = 1000u;
+    IntMap map;
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_NULL(map.find(0u), "");
+    EXPECT_FALSE(map.erase(0u), "");
+
+    for (uint32_t i = 0; i < kCount; ++i) {
+        AllocChecker ac;
+        EXPECT_TRUE(map.insert(i * 3u, i, &ac), "");
+        EXPECT_TRUE(ac.check(), "");
+    }
+    EXPECT_EQ(kCount, map.size(), "");
+    EXPECT_LE(map.size(), map.capacity() - map.capacity() / 8, "");
+
+    for (uint32_t i = 0; i < kCount * 3u; ++i) {
+        uint32_t* value = map.find(i);
+        if (i % 3u) {
+            EXPECT_NULL(value, "");
+            EXPECT_FALSE(map.contains(i), "");
+        } else {
+            ASSERT_NONNULL(value, "");
+            EXPECT_EQ(i / 3u, *value, "");
+        }
+    }
+
+    // A second insert of the same key leaves the first value alone;
+    // insert_or_assign replaces it.
+    AllocChecker ac;
+    EXPECT_FALSE(map.insert(3u, 42u, &ac), "");
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_EQ(1u, *map.find(3u), "");
+    map.insert_or_assign(3u, 42u, &ac);
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_EQ(42u, *map.find(3u), "");
+    EXPECT_EQ(kCount, map.size(), "");
+
+    for (uint32_t i = 0; i < kCount; i += 2u)
+        EXPECT_TRUE(map.erase(i * 3u), "");
+    EXPECT_EQ(kCount / 2u, map.size(), "");
+    for (uint32_t i = 0; i < kCount; ++i)
+        EXPECT_EQ(i & 1u, map.contains(i * 3u) ? 1u : 0u, "");
+
+    map.clear();
+    EXPECT_TRUE(map.is_empty(), "");
+    EXPECT_FALSE(map.contains(9u), "");
+
+    END_TEST;
+}
+
+bool flat_hash_map_iterate() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kCount = 300u;
+    IntMap map;
+    EXPECT_TRUE(map.begin() == map.end(), "");
+
+    for (uint32_t i = 0; i < kCount; ++i)
+        map.insert(i, i + 1u);
+
+    uint8_t seen[kCount] = {};
+    size_t visited = 0;
+    for (const auto& entry : map) {
+        ASSERT_LT(entry.key, kCount, "");
+        EXPECT_EQ(entry.key + 1u, entry.value, "");
+        ++seen[entry.key];
+        ++visited;
+    }
+    EXPECT_EQ(kCount, visited, "");
+    for (uint32_t i = 0; i < kCount; ++i)
+        EXPECT_EQ(1u, seen[i], "");
+
+    for (auto& entry : map)
+        entry.value = 0u;
+    EXPECT_EQ(0u, *map.find(7u), "");
+
+    END_TEST;
+}
+
+// Erasing and inserting over and over fills the map with deleted slots,
+// which it must clean out rather than grow without end.
+bool flat_hash_map_churn() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kLive = 50u;
+    IntMap map;
+    Lfsr<uint32_t> lfsr(0x1234u);
+    uint32_t keys[kLive];
+    for (uint32_t i = 0; i < kLive; ++i) {
+        keys[i] = lfsr.GetNext();
+        map.insert(keys[i], i);
+    }
+    size_t capacity = map.capacity();
+
+    for (uint32_t round = 0; round < 20000u; ++round) {
+        uint32_t slot = round % kLive;
+        EXPECT_TRUE(map.erase(keys[slot]), "");
+        keys[slot] = lfsr.GetNext();
+        AllocChecker ac;
+        EXPECT_TRUE(map.insert(keys[slot], slot, &ac), "");
+        ASSERT_TRUE(ac.check(), "");
+    }
+    EXPECT_EQ(kLive, map.size(), "");
+    EXPECT_EQ(capacity, map.capacity(), "");
+    for (uint32_t i = 0; i < kLive; ++i) {
+        uint32_t* value = map.find(keys[i]);
+        ASSERT_NONNULL(value, "");
+        EXPECT_EQ(i, *value, "");
+    }
+
+    END_TEST;
+}
+
+bool flat_hash_map_move_only_values() {
+    BEGIN_TEST;
+
+    TestValue::live_count_ = 0;
+    {
+        FlatHashMap<size_t, TestValue> map;
+        for (size_t i = 0; i < 100; ++i)
+            EXPECT_TRUE(map.insert(i, TestValue(i)), "");
+        EXPECT_EQ(100u, TestValue::live_count_, "");
+
+        // Both the replaced value and the one which failed to go in are gone.
+        map.insert_or_assign(5u, TestValue(500u));
+        EXPECT_FALSE(map.insert(6u, TestValue(600u)), "");
+        EXPECT_EQ(100u, TestValue::live_count_, "");
+        EXPECT_EQ(500u, map.find(5u)->val_, "");
+        EXPECT_EQ(6u, map.find(6u)->val_, "");
+
+        EXPECT_TRUE(map.erase(5u), "");
+        EXPECT_EQ(99u, TestValue::live_count_, "");
+
+        FlatHashMap<size_t, TestValue> other(fbl::move(map));
+        EXPECT_TRUE(map.is_empty(), "");
+        EXPECT_EQ(0u, map.capacity(), "");
+        EXPECT_EQ(99u, other.size(), "");
+        EXPECT_EQ(99u, TestValue::live_count_, "");
+
+        map = fbl::move(other);
+        EXPECT_EQ(99u, map.size(), "");
+        EXPECT_EQ(7u, map.find(7u)->val_, "");
+    }
+    EXPECT_EQ(0u, TestValue::live_count_, "");
+
+    // Values may be unique_ptrs, and keys pointers.
+    FlatHashMap<const void*, unique_ptr<size_t>> ptrs;
+    size_t objs[4];
+    for (size_t i = 0; i < 4; ++i) {
+        AllocChecker ac;
+        unique_ptr<size_t> p(new (&ac) size_t(i));
+        ASSERT_TRUE(ac.check(), "");
+        ptrs.insert(&objs[i], fbl::move(p));
+    }
+    ASSERT_NONNULL(ptrs.find(&objs[2]), "");
+    EXPECT_EQ(2u, **ptrs.find(&objs[2]), "");
+
+    END_TEST;
+}
+
+bool flat_hash_map_alloc_failure() {
+    BEGIN_TEST;
+
+    FailingAllocatorTraits::fail_ = false;
+    FlatHashMap<uint32_t, uint32_t, DefaultFlatHashTraits<uint32_t>, FailingAllocatorTraits> map;
+
+    AllocChecker ac;
+    map.reserve(10, &ac);
+    ASSERT_TRUE(ac.check(), "");
+    size_t capacity = map.capacity();
+    EXPECT_GE(capacity, 10u, "");
+
+    // Filling the map up to its capacity does not allocate.
+    FailingAllocatorTraits::fail_ = true;
+    uint32_t count = 0;
+    while (map.size() < capacity - capacity / 8) {
+        EXPECT_TRUE(map.insert(count, count, &ac), "");
+        EXPECT_TRUE(ac.check(), "");
+        ++count;
+    }
+
+    // One more needs to grow, which fails and leaves the map as it was.
+    EXPECT_FALSE(map.insert(count, count, &ac), "");
+    EXPECT_FALSE(ac.check(), "");
+    EXPECT_EQ(count, map.size(), "");
+    EXPECT_EQ(capacity, map.capacity(), "");
+    EXPECT_FALSE(map.contains(count), "");
+    for (uint32_t i = 0; i < count; ++i)
+        EXPECT_TRUE(map.contains(i), "");
+
+    // Existing keys can still be found and assigned without allocating.
+    map.insert_or_assign(0u, 99u, &ac);
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_EQ(99u, *map.find(0u), "");
+
+    FailingAllocatorTraits::fail_ = false;
+    EXPECT_TRUE(map.insert(count, count, &ac), "");
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_GT(map.capacity(), capacity, "");
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(flat_hash_map_tests)
+RUN_TEST(flat_hash_map_insert_find_erase)
+RUN_TEST(flat_hash_map_iterate)
+RUN_TEST(flat_hash_map_churn)
+RUN_TEST(flat_hash_map_move_only_values)
+RUN_TEST(flat_hash_map_alloc_failure)
+END_TEST_CASE(flat_hash_map_tests)
+
+} // namespace tests
+} // namespace fbl
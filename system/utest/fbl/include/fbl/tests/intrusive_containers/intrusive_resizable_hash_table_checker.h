@@ -0,0 +1,69 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <unittest/unittest.h>
+#include <fbl/intrusive_resizable_hash_table.h>
+#include <fbl/tests/intrusive_containers/intrusive_doubly_linked_list_checker.h>
+#include <fbl/tests/intrusive_containers/intrusive_singly_linked_list_checker.h>
+#include <fbl/tests/intrusive_containers/test_environment_utils.h>
+
+namespace fbl {
+namespace tests {
+namespace intrusive_containers {
+
+// The resizable hash table sanity checker implementation is shared across
+// ResizableHashTables of all bucket types.
+class ResizableHashTableChecker {
+public:
+    template <typename ContainerType>
+    static bool SanityCheck(const ContainerType& container) {
+        using BucketType    = typename ContainerType::BucketType;
+        using BucketChecker = typename BucketType::CheckerType;
+        using HashTraits    = typename ContainerType::HashTraits;
+        using KeyTraits     = typename ContainerType::KeyTraits;
+
+        BEGIN_TEST;
+
+        // The bucket bookkeeping must describe a valid stage of a split.
+        size_t level = container.level_buckets_;
+        ASSERT_EQ(0u, level & (level - 1), "");
+        ASSERT_LT(container.split_, level, "");
+        ASSERT_EQ(level + container.split_, container.bucket_count(), "");
+        ASSERT_GE(container.bucket_count(), ContainerType::kSegmentBuckets, "");
+
+        // Every segment which holds buckets must have been allocated, and no
+        // other segment may be.
+        size_t segments = (container.bucket_count() + ContainerType::kSegmentBuckets - 1) /
+                          ContainerType::kSegmentBuckets;
+        for (size_t i = 1; i < container.segment_capacity_; ++i)
+            EXPECT_EQ(i < segments, container.segments_[i] != nullptr, "");
+
+        // Demand that every bucket pass its sanity check.  Keep a running total
+        // of the total size of the table in the process.
+        size_t total_size = 0;
+        for (size_t i = 0; i < container.bucket_count(); ++i) {
+            const BucketType& bucket = container.GetBucket(i);
+            ASSERT_TRUE(BucketChecker::SanityCheck(bucket), "");
+            total_size += SizeUtils<BucketType>::size(bucket);
+
+            // For every element in the bucket, make sure that the bucket index
+            // matches the hash of the element.
+            for (const auto& obj : bucket) {
+                ASSERT_EQ(container.BucketIndexForHash(
+                              ContainerType::Mix(HashTraits::GetHash(KeyTraits::GetKey(obj)))),
+                          i, "");
+            }
+        }
+
+        EXPECT_EQ(container.size(), total_size, "");
+
+        END_TEST;
+    }
+};
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace fbl
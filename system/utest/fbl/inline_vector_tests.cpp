@@ -0,0 +1,223 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/inline_vector.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace fbl {
+namespace tests {
+namespace {
+
+constexpr size_t kInlineCount = 4;
+
+// A move-only object which keeps track of how many of it are alive.
+struct TestObject {
+    DISALLOW_COPY_AND_ASSIGN_ALLOW_MOVE(TestObject);
+    explicit TestObject(size_t val) : alive_(true), val_(val) { ++live_count_; }
+    TestObject(TestObject&& r) : alive_(r.alive_), val_(r.val_) { r.alive_ = false; }
+    TestObject& operator=(TestObject&& r) {
+        if (alive_)
+            --live_count_;
+        alive_ = r.alive_;
+        val_ = r.val_;
+        r.alive_ = false;
+        return *this;
+    }
+    ~TestObject() {
+        if (alive_)
+            --live_count_;
+    }
+
+    bool alive_;
+    size_t val_;
+
+    static size_t live_count_;
+};
+
+size_t TestObject::live_count_ = 0;
+
+// Counts allocations, and fails every one of them once |fail_| is set.
+struct CountingAllocatorTraits {
+    static void* Allocate(size_t size) {
+        ++allocation_count_;
+        return fail_ ? nullptr : DefaultAllocatorTraits::Allocate(size);
+    }
+    static void Deallocate(void* object) { DefaultAllocatorTraits::Deallocate(object); }
+
+    static size_t allocation_count_;
+    static bool fail_;
+};
+
+size_t CountingAllocatorTraits::allocation_count_ = 0;
+bool CountingAllocatorTraits::fail_ = false;
+
+using IntVector = InlineVector<size_t, kInlineCount, CountingAllocatorTraits>;
+using ObjVector = InlineVector<TestObject, kInlineCount, CountingAllocatorTraits>;
+
+size_t GetValue(size_t val) { return val; }
+size_t GetValue(const TestObject& obj) { return obj.val_; }
+
+template <typename VectorType>
+bool CheckValues(const VectorType& vector, size_t count, size_t first) {
+    BEGIN_HELPER;
+    ASSERT_EQ(count, vector.size(), "");
+    for (size_t i = 0; i < count; ++i)
+        EXPECT_EQ(first + i, GetValue(vector[i]), "");
+    END_HELPER;
+}
+
+template <typename VectorType, typename ItemType>
+bool inline_vector_spill_and_return() {
+    BEGIN_TEST;
+
+    CountingAllocatorTraits::allocation_count_ = 0;
+    CountingAllocatorTraits::fail_ = false;
+    TestObject::live_count_ = 0;
+    {
+        VectorType vector;
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_EQ(kInlineCount, vector.capacity(), "");
+
+        // Filling the inline storage never allocates.
+        for (size_t i = 0; i < kInlineCount; ++i) {
+            AllocChecker ac;
+            vector.push_back(ItemType(i), &ac);
+            EXPECT_TRUE(ac.check(), "");
+        }
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_EQ(0u, CountingAllocatorTraits::allocation_count_, "");
+        EXPECT_TRUE(CheckValues(vector, kInlineCount, 0u), "");
+
+        // One more moves everything to the heap.
+        AllocChecker ac;
+        vector.push_back(ItemType(kInlineCount), &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_FALSE(vector.is_inline(), "");
+        EXPECT_EQ(1u, CountingAllocatorTraits::allocation_count_, "");
+        EXPECT_GT(vector.capacity(), kInlineCount, "");
+        EXPECT_TRUE(CheckValues(vector, kInlineCount + 1u, 0u), "");
+
+        // Dropping back to |kInlineCount| elements returns to inline storage.
+        EXPECT_EQ(0u, GetValue(vector.erase(0u)), "");
+        EXPECT_TRUE(vector.is_inline(), "");
+        EXPECT_EQ(kInlineCount, vector.capacity(), "");
+        EXPECT_TRUE(CheckValues(vector, kInlineCount, 1u), "");
+
+        vector.pop_back();
+        EXPECT_TRUE(CheckValues(vector, kInlineCount - 1u, 1u), "");
+
+        // Inserting at the front shifts the inline elements.
+        vector.insert(0u, ItemType(0u), &ac);
+        EXPECT_TRUE(ac.check(), "");
+        EXPECT_TRUE(CheckValues(vector, kInlineCount, 0u), "");
+        EXPECT_EQ(1u, CountingAllocatorTraits::allocation_count_, "");
+    }
+    EXPECT_EQ(0u, TestObject::live_count_, "");
+
+    END_TEST;
+}
+
+bool inline_vector_move_and_swap() {
+    BEGIN_TEST;
+
+    TestObject::live_count_ = 0;
+    CountingAllocatorTraits::fail_ = false;
+    {
+        ObjVector small;
+        for (size_t i = 0; i < 2; ++i)
+            small.push_back(TestObject(i));
+        ObjVector big;
+        for (size_t i = 0; i < 10; ++i)
+            big.push_back(TestObject(100u + i));
+        EXPECT_EQ(12u, TestObject::live_count_, "");
+
+        // Moving an inline vector moves its elements; moving a heap vector
+        // moves its storage.
+        TestObject* big_storage = big.get();
+        ObjVector moved_small(fbl::move(small));
+        ObjVector moved_big(fbl::move(big));
+        EXPECT_TRUE(small.is_empty(), "");
+        EXPECT_TRUE(small.is_inline(), "");
+        EXPECT_TRUE(big.is_empty(), "");
+        EXPECT_TRUE(big.is_inline(), "");
+        EXPECT_TRUE(moved_small.is_inline(), "");
+        EXPECT_EQ(big_storage, moved_big.get(), "");
+        EXPECT_TRUE(CheckValues(moved_small, 2u, 0u), "");
+        EXPECT_TRUE(CheckValues(moved_big, 10u, 100u), "");
+        EXPECT_EQ(12u, TestObject::live_count_, "");
+
+        moved_small.swap(moved_big);
+        EXPECT_FALSE(moved_small.is_inline(), "");
+        EXPECT_TRUE(moved_big.is_inline(), "");
+        EXPECT_TRUE(CheckValues(moved_small, 10u, 100u), "");
+        EXPECT_TRUE(CheckValues(moved_big, 2u, 0u), "");
+
+        moved_big = fbl::move(moved_small);
+        EXPECT_TRUE(CheckValues(moved_big, 10u, 100u), "");
+        EXPECT_EQ(10u, TestObject::live_count_, "");
+
+        moved_big.reset();
+        EXPECT_TRUE(moved_big.is_inline(), "");
+        EXPECT_EQ(0u, TestObject::live_count_, "");
+    }
+
+    // unique_ptrs may be held inline too.
+    InlineVector<unique_ptr<size_t>, kInlineCount> ptrs;
+    for (size_t i = 0; i < kInlineCount * 2; ++i) {
+        AllocChecker ac;
+        unique_ptr<size_t> p(new (&ac) size_t(i));
+        ASSERT_TRUE(ac.check(), "");
+        ptrs.push_back(fbl::move(p));
+    }
+    for (size_t i = 0; i < kInlineCount * 2; ++i)
+        EXPECT_EQ(i, *ptrs[i], "");
+
+    END_TEST;
+}
+
+bool inline_vector_alloc_failure() {
+    BEGIN_TEST;
+
+    CountingAllocatorTraits::fail_ = true;
+    IntVector vector;
+    AllocChecker ac;
+    vector.reserve(kInlineCount, &ac);
+    EXPECT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kInlineCount; ++i) {
+        vector.push_back(i, &ac);
+        EXPECT_TRUE(ac.check(), "");
+    }
+
+    // Growing past the inline storage fails, and leaves the vector intact.
+    vector.push_back(kInlineCount, &ac);
+    EXPECT_FALSE(ac.check(), "");
+    vector.insert(0u, kInlineCount, &ac);
+    EXPECT_FALSE(ac.check(), "");
+    vector.reserve(kInlineCount * 2, &ac);
+    EXPECT_FALSE(ac.check(), "");
+    EXPECT_TRUE(vector.is_inline(), "");
+    EXPECT_TRUE(CheckValues(vector, kInlineCount, 0u), "");
+
+    CountingAllocatorTraits::fail_ = false;
+    vector.reserve(kInlineCount * 2, &ac);
+    EXPECT_TRUE(ac.check(), "");
+    EXPECT_FALSE(vector.is_inline(), "");
+    EXPECT_EQ(kInlineCount * 2, vector.capacity(), "");
+    EXPECT_TRUE(CheckValues(vector, kInlineCount, 0u), "");
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(inline_vector_tests)
+RUN_TEST((inline_vector_spill_and_return<IntVector, size_t>))
+RUN_TEST((inline_vector_spill_and_return<ObjVector, TestObject>))
+RUN_TEST(inline_vector_move_and_swap)
+RUN_TEST(inline_vector_alloc_failure)
+END_TEST_CASE(inline_vector_tests)
+
+} // namespace tests
+} // namespace fbl
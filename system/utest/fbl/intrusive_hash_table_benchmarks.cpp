@@ -0,0 +1,101 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/intrusive_hash_table.h>
+#include <fbl/intrusive_resizable_hash_table.h>
+#include <fbl/intrusive_single_list.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+
+namespace {
+
+// Not pass/fail tests: these print how long HashTable and ResizableHashTable
+// each take to insert, find and erase a growing number of elements.
+
+struct BenchmarkObj : public fbl::SinglyLinkedListable<BenchmarkObj*> {
+    uint64_t key;
+
+    uint64_t GetKey() const { return key; }
+    static uint64_t GetHash(uint64_t key) { return key * 0x9e3779b97f4a7c15ull; }
+};
+
+using FixedTable = fbl::HashTable<uint64_t, BenchmarkObj*>;
+using ResizableTable = fbl::ResizableHashTable<uint64_t, BenchmarkObj*>;
+
+struct Timings {
+    zx_time_t insert;
+    zx_time_t find;
+    zx_time_t erase;
+};
+
+template <typename TableType>
+bool RunBenchmark(BenchmarkObj* objs, size_t count, Timings* timings) {
+    BEGIN_HELPER;
+
+    TableType table;
+
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < count; ++i)
+        table.insert(&objs[i]);
+    zx_time_t inserted = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    size_t found = 0;
+    for (size_t i = 0; i < count; ++i)
+        found += table.find(objs[i].key).IsValid() ? 1 : 0;
+    zx_time_t finished_finding = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    for (size_t i = 0; i < count; ++i)
+        table.erase(objs[i].key);
+    zx_time_t erased = zx_clock_get(ZX_CLOCK_MONOTONIC);
+
+    EXPECT_EQ(count, found, "");
+    EXPECT_TRUE(table.is_empty(), "");
+
+    timings->insert = inserted - start;
+    timings->find = finished_finding - inserted;
+    timings->erase = erased - finished_finding;
+
+    END_HELPER;
+}
+
+void PrintTimings(const char* name, const Timings& timings, size_t count) {
+    printf("%-12s %12.1f %12.1f %12.1f\n", name,
+           static_cast<double>(timings.insert) / static_cast<double>(count),
+           static_cast<double>(timings.find) / static_cast<double>(count),
+           static_cast<double>(timings.erase) / static_cast<double>(count));
+}
+
+bool hash_table_benchmark() {
+    BEGIN_TEST;
+
+    constexpr size_t kMaxCount = 100000;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<BenchmarkObj[]> objs(new (&ac) BenchmarkObj[kMaxCount]);
+    ASSERT_TRUE(ac.check(), "");
+    for (size_t i = 0; i < kMaxCount; ++i)
+        objs[i].key = i;
+
+    for (size_t count = 100; count <= kMaxCount; count *= 10) {
+        Timings fixed, resizable;
+        ASSERT_TRUE(RunBenchmark<FixedTable>(objs.get(), count, &fixed), "");
+        ASSERT_TRUE(RunBenchmark<ResizableTable>(objs.get(), count, &resizable), "");
+
+        printf("\n%zu elements\n", count);
+        printf("%-12s %12s %12s %12s\n", "ns/element", "insert", "find", "erase");
+        PrintTimings("fixed", fixed, count);
+        PrintTimings("resizable", resizable, count);
+    }
+
+    END_TEST;
+}
+
+}  // namespace
+
+BEGIN_TEST_CASE(hash_table_benchmarks)
+RUN_TEST(hash_table_benchmark)
+END_TEST_CASE(hash_table_benchmarks)
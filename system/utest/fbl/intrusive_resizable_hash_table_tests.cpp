@@ -0,0 +1,331 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <unittest/unittest.h>
+#include <fbl/intrusive_single_list.h>
+#include <fbl/intrusive_resizable_hash_table.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/tests/intrusive_containers/associative_container_test_environment.h>
+#include <fbl/tests/intrusive_containers/intrusive_resizable_hash_table_checker.h>
+#include <fbl/tests/intrusive_containers/test_thunks.h>
+
+namespace fbl {
+namespace tests {
+namespace intrusive_containers {
+
+using OtherKeyType  = uint16_t;
+using OtherHashType = uint32_t;
+
+// A small segment size, so that the tests below grow and shrink the tables
+// with only a handful of objects.
+static constexpr size_t kTestSegmentBuckets = 4;
+
+template <typename PtrType>
+struct OtherHashTraits {
+    using ObjType = typename ::fbl::internal::ContainerPtrTraits<PtrType>::ValueType;
+    using BucketStateType = SinglyLinkedListNodeState<PtrType>;
+
+    // Linked List Traits
+    static BucketStateType& node_state(ObjType& obj) {
+        return obj.other_container_state_.bucket_state_;
+    }
+
+    // Keyed Object Traits
+    static OtherKeyType GetKey(const ObjType& obj) {
+        return obj.other_container_state_.key_;
+    }
+
+    static bool LessThan(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 <  key2;
+    }
+
+    static bool EqualTo(const OtherKeyType& key1, const OtherKeyType& key2) {
+        return key1 == key2;
+    }
+
+    // Hash Traits
+    static OtherHashType GetHash(const OtherKeyType& key) {
+        return static_cast<OtherHashType>(key * 0xaee58187);
+    }
+
+    // Set key is a trait which is only used by the tests, not by the containers
+    // themselves.
+    static void SetKey(ObjType& obj, OtherKeyType key) {
+        obj.other_container_state_.key_ = key;
+    }
+};
+
+template <typename PtrType>
+struct OtherHashState {
+private:
+    friend struct OtherHashTraits<PtrType>;
+    OtherKeyType key_;
+    typename OtherHashTraits<PtrType>::BucketStateType bucket_state_;
+};
+
+template <typename PtrType>
+class RHTSLLTraits {
+public:
+    using ObjType = typename ::fbl::internal::ContainerPtrTraits<PtrType>::ValueType;
+
+    using ContainerType           = ResizableHashTable<size_t,
+                                                       PtrType,
+                                                       SinglyLinkedList<PtrType>,
+                                                       size_t,
+                                                       kTestSegmentBuckets>;
+    using ContainableBaseClass    = SinglyLinkedListable<PtrType>;
+    using ContainerStateType      = SinglyLinkedListNodeState<PtrType>;
+    using KeyType                 = typename ContainerType::KeyType;
+    using HashType                = typename ContainerType::HashType;
+
+    using OtherContainerTraits    = OtherHashTraits<PtrType>;
+    using OtherContainerStateType = OtherHashState<PtrType>;
+    using OtherBucketType         = SinglyLinkedList<PtrType, OtherContainerTraits>;
+    using OtherContainerType      = ResizableHashTable<OtherKeyType,
+                                                       PtrType,
+                                                       OtherBucketType,
+                                                       OtherHashType,
+                                                       kTestSegmentBuckets,
+                                                       OtherContainerTraits,
+                                                       OtherContainerTraits>;
+
+    // The table mods nothing by a number of buckets, so the hash only needs
+    // to be the same for equal keys.
+    using TestObjBaseType  = HashedTestObjBase<typename ContainerType::KeyType,
+                                               typename ContainerType::HashType,
+                                               static_cast<HashType>(-1)>;
+};
+
+DEFINE_TEST_OBJECTS(RHTSLL);
+using UMTE = DEFINE_TEST_THUNK(Associative, RHTSLL, Unmanaged);
+using UPTE = DEFINE_TEST_THUNK(Associative, RHTSLL, UniquePtr);
+using RPTE = DEFINE_TEST_THUNK(Associative, RHTSLL, RefPtr);
+
+// Tests of the resizing itself, with enough objects to grow the table through
+// many levels of splits and back down again.
+struct ResizeTestObj : public SinglyLinkedListable<ResizeTestObj*> {
+    size_t key;
+
+    size_t GetKey() const { return key; }
+
+    // An identity hash, which leaves it to the table to spread the keys out.
+    static size_t GetHash(size_t key) { return key; }
+};
+
+using ResizeTestTable = ResizableHashTable<size_t,
+                                           ResizeTestObj*,
+                                           SinglyLinkedList<ResizeTestObj*>,
+                                           size_t,
+                                           kTestSegmentBuckets>;
+
+static constexpr size_t kResizeTestObjCount = 4096;
+
+bool GrowAndShrinkTest() {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    fbl::unique_ptr<ResizeTestObj[]> objs(new (&ac) ResizeTestObj[kResizeTestObjCount]);
+    ASSERT_TRUE(ac.check(), "");
+
+    ResizeTestTable table;
+    EXPECT_EQ(ResizeTestTable::kSegmentBuckets, table.bucket_count(), "");
+
+    // The table keeps its average chain length bounded as it grows.
+    for (size_t i = 0; i < kResizeTestObjCount; ++i) {
+        objs[i].key = i * 7;
+        table.insert(&objs[i]);
+        EXPECT_LE(table.size(),
+                  table.bucket_count() * ResizeTestTable::kMaxAverageChainLength, "");
+        if ((i & (i + 1)) == 0)
+            ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+    }
+    ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+    EXPECT_GE(table.bucket_count(), kResizeTestObjCount / ResizeTestTable::kMaxAverageChainLength,
+              "");
+
+    for (size_t i = 0; i < kResizeTestObjCount; ++i) {
+        auto iter = table.find(i * 7);
+        ASSERT_TRUE(iter.IsValid(), "");
+        EXPECT_EQ(&objs[i], &(*iter), "");
+        EXPECT_FALSE(table.find(i * 7 + 1).IsValid(), "");
+    }
+
+    // Erasing shrinks it again, all the way back down to its first segment.
+    size_t peak_buckets = table.bucket_count();
+    for (size_t i = 0; i < kResizeTestObjCount; ++i) {
+        if (i & 1) {
+            EXPECT_EQ(&objs[i], table.erase(objs[i]), "");
+        } else {
+            EXPECT_EQ(&objs[i], table.erase(i * 7), "");
+        }
+        if ((i & (i + 1)) == 0)
+            ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+        if (i == (kResizeTestObjCount * 7 / 8))
+            EXPECT_LT(table.bucket_count(), peak_buckets, "");
+    }
+    EXPECT_TRUE(table.is_empty(), "");
+    EXPECT_EQ(ResizeTestTable::kSegmentBuckets, table.bucket_count(), "");
+    ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+
+    END_TEST;
+}
+
+bool IterEraseKeepsBucketsTest() {
+    BEGIN_TEST;
+
+    AllocChecker ac;
+    fbl::unique_ptr<ResizeTestObj[]> objs(new (&ac) ResizeTestObj[kResizeTestObjCount]);
+    ASSERT_TRUE(ac.check(), "");
+
+    ResizeTestTable table;
+    for (size_t i = 0; i < kResizeTestObjCount; ++i) {
+        objs[i].key = i;
+        table.insert(&objs[i]);
+    }
+
+    // Erasing through iterators never moves elements, so the iteration visits
+    // every element exactly once.
+    size_t buckets = table.bucket_count();
+    size_t erased = 0;
+    for (auto iter = table.begin(); iter != table.end();) {
+        EXPECT_NONNULL(table.erase(iter++), "");
+        ++erased;
+    }
+    EXPECT_EQ(kResizeTestObjCount, erased, "");
+    EXPECT_TRUE(table.is_empty(), "");
+    EXPECT_EQ(buckets, table.bucket_count(), "");
+    ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+
+    // Clearing gives back the segments.
+    for (size_t i = 0; i < kResizeTestObjCount; ++i)
+        table.insert(&objs[i]);
+    table.clear();
+    EXPECT_TRUE(table.is_empty(), "");
+    EXPECT_EQ(ResizeTestTable::kSegmentBuckets, table.bucket_count(), "");
+    ASSERT_TRUE(ResizableHashTableChecker::SanityCheck(table), "");
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(resizable_hashtable_tests)
+//////////////////////////////////////////
+// General container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("Clear (unmanaged)",            UMTE::ClearTest)
+RUN_NAMED_TEST("Clear (unique)",               UPTE::ClearTest)
+RUN_NAMED_TEST("Clear (RefPtr)",               RPTE::ClearTest)
+
+RUN_NAMED_TEST("ClearUnsafe (unmanaged)",      UMTE::ClearUnsafeTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("ClearUnsafe (unique)",         UPTE::ClearUnsafeTest)
+RUN_NAMED_TEST("ClearUnsafe (RefPtr)",         RPTE::ClearUnsafeTest)
+#endif
+
+RUN_NAMED_TEST("IsEmpty (unmanaged)",          UMTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (unique)",             UPTE::IsEmptyTest)
+RUN_NAMED_TEST("IsEmpty (RefPtr)",             RPTE::IsEmptyTest)
+
+RUN_NAMED_TEST("Iterate (unmanaged)",          UMTE::IterateTest)
+RUN_NAMED_TEST("Iterate (unique)",             UPTE::IterateTest)
+RUN_NAMED_TEST("Iterate (RefPtr)",             RPTE::IterateTest)
+
+// Hashtables with singly linked list bucket can perform direct
+// iterator/reference erase operations, but the operations will be O(n)
+RUN_NAMED_TEST("IterErase (unmanaged)",        UMTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (unique)",           UPTE::IterEraseTest)
+RUN_NAMED_TEST("IterErase (RefPtr)",           RPTE::IterEraseTest)
+
+RUN_NAMED_TEST("DirectErase (unmanaged)",      UMTE::DirectEraseTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("DirectErase (unique)",         UPTE::DirectEraseTest)
+#endif
+RUN_NAMED_TEST("DirectErase (RefPtr)",         RPTE::DirectEraseTest)
+
+RUN_NAMED_TEST("MakeIterator (unmanaged)",     UMTE::MakeIteratorTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("MakeIterator (unique)",        UPTE::MakeIteratorTest)
+#endif
+RUN_NAMED_TEST("MakeIterator (RefPtr)",        RPTE::MakeIteratorTest)
+
+// HashTables with SinglyLinkedList buckets cannot iterate backwards (because
+// their buckets cannot iterate backwards)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("ReverseIterErase (unmanaged)", UMTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (unique)",    UPTE::ReverseIterEraseTest)
+RUN_NAMED_TEST("ReverseIterErase (RefPtr)",    RPTE::ReverseIterEraseTest)
+
+RUN_NAMED_TEST("ReverseIterate (unmanaged)",   UMTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (unique)",      UPTE::ReverseIterateTest)
+RUN_NAMED_TEST("ReverseIterate (RefPtr)",      RPTE::ReverseIterateTest)
+#endif
+
+// Hash tables do not support swapping or Rvalue operations (Assignment or
+// construction) as doing so would be an O(n) operation (With 'n' == to the
+// number of buckets in the hashtable)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("Swap (unmanaged)",             UMTE::SwapTest)
+RUN_NAMED_TEST("Swap (unique)",                UPTE::SwapTest)
+RUN_NAMED_TEST("Swap (RefPtr)",                RPTE::SwapTest)
+
+RUN_NAMED_TEST("Rvalue Ops (unmanaged)",       UMTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (unique)",          UPTE::RvalueOpsTest)
+RUN_NAMED_TEST("Rvalue Ops (RefPtr)",          RPTE::RvalueOpsTest)
+#endif
+
+RUN_NAMED_TEST("Scope (unique)",               UPTE::ScopeTest)
+RUN_NAMED_TEST("Scope (RefPtr)",               RPTE::ScopeTest)
+
+RUN_NAMED_TEST("TwoContainer (unmanaged)",     UMTE::TwoContainerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("TwoContainer (unique)",        UPTE::TwoContainerTest)
+#endif
+RUN_NAMED_TEST("TwoContainer (RefPtr)",        RPTE::TwoContainerTest)
+
+RUN_NAMED_TEST("IterCopyPointer (unmanaged)",  UMTE::IterCopyPointerTest)
+#if TEST_WILL_NOT_COMPILE || 0
+RUN_NAMED_TEST("IterCopyPointer (unique)",     UPTE::IterCopyPointerTest)
+#endif
+RUN_NAMED_TEST("IterCopyPointer (RefPtr)",     RPTE::IterCopyPointerTest)
+
+RUN_NAMED_TEST("EraseIf (unmanaged)",          UMTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (unique)",             UPTE::EraseIfTest)
+RUN_NAMED_TEST("EraseIf (RefPtr)",             RPTE::EraseIfTest)
+
+RUN_NAMED_TEST("FindIf (unmanaged)",           UMTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (unique)",              UPTE::FindIfTest)
+RUN_NAMED_TEST("FindIf (RefPtr)",              RPTE::FindIfTest)
+
+//////////////////////////////////////////
+// Associative container specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("InsertByKey (unmanaged)",      UMTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (unique)",         UPTE::InsertByKeyTest)
+RUN_NAMED_TEST("InsertByKey (RefPtr)",         RPTE::InsertByKeyTest)
+
+RUN_NAMED_TEST("FindByKey (unmanaged)",        UMTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (unique)",           UPTE::FindByKeyTest)
+RUN_NAMED_TEST("FindByKey (RefPtr)",           RPTE::FindByKeyTest)
+
+RUN_NAMED_TEST("EraseByKey (unmanaged)",       UMTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (unique)",          UPTE::EraseByKeyTest)
+RUN_NAMED_TEST("EraseByKey (RefPtr)",          RPTE::EraseByKeyTest)
+
+RUN_NAMED_TEST("InsertOrFind (unmanaged)",     UMTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (unique)",        UPTE::InsertOrFindTest)
+RUN_NAMED_TEST("InsertOrFind (RefPtr)",        RPTE::InsertOrFindTest)
+
+RUN_NAMED_TEST("InsertOrReplace (unmanaged)",  UMTE::InsertOrReplaceTest)
+RUN_NAMED_TEST("InsertOrReplace (unique)",     UPTE::InsertOrReplaceTest)
+RUN_NAMED_TEST("InsertOrReplace (RefPtr)",     RPTE::InsertOrReplaceTest)
+
+//////////////////////////////////////////
+// Resizing specific tests.
+//////////////////////////////////////////
+RUN_NAMED_TEST("GrowAndShrink",                GrowAndShrinkTest)
+RUN_NAMED_TEST("IterEraseKeepsBuckets",        IterEraseKeepsBucketsTest)
+END_TEST_CASE(resizable_hashtable_tests);
+
+}  // namespace intrusive_containers
+}  // namespace tests
+}  // namespace fbl
@@ -138,6 +138,30 @@ public:
     static void RecordEraseRotation()           { ++op_counts_.erase_rotations_; }
     static void RecordEraseDoubleRotation()     { ++op_counts_.erase_double_rotations_; }
 
+    // Keep a count of the nodes in each subtree as well, so that the rank
+    // checks can also verify that the tree reported every change it made to
+    // the shape of the tree.
+    static constexpr bool kTracksSubtrees = true;
+
+    template <typename TreeType>
+    static void RecordSubtreeChanged(typename TreeType::RawPtrType node) {
+        node->set_subtree_size(ExpectedSubtreeSize<TreeType>(node));
+    }
+
+    template <typename TreeType>
+    static size_t ExpectedSubtreeSize(typename TreeType::RawPtrType node) {
+        using NodeTraits = typename TreeType::NodeTraits;
+        using PtrTraits  = typename TreeType::PtrTraits;
+
+        const auto& ns = NodeTraits::node_state(*node);
+        size_t count = 1;
+        if (PtrTraits::IsValid(ns.left_))
+            count += ns.left_->subtree_size();
+        if (PtrTraits::IsValid(ns.right_))
+            count += ns.right_->subtree_size();
+        return count;
+    }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         BEGIN_TEST;
@@ -152,6 +176,8 @@ public:
         //    differences are non-negative)
         const auto& ns = NodeTraits::node_state(*node);
         ASSERT_LE(0, ns.rank_, "All ranks must be non-negative.");
+        ASSERT_EQ(ExpectedSubtreeSize<TreeType>(node), node->subtree_size(),
+                  "Subtree size is out of date!");
 
         if (!PtrTraits::IsValid(ns.left_) && !PtrTraits::IsValid(ns.right_)) {
             ASSERT_EQ(0, ns.rank_, "Leaf nodes must have rank 0!");
@@ -261,6 +287,9 @@ public:
 
     bool InContainer() const { return wavl_node_state_.InContainer(); }
 
+    size_t subtree_size() const { return subtree_size_; }
+    void set_subtree_size(size_t size) { subtree_size_ = size; }
+
 private:
     friend DefaultWAVLTreeTraits<BalanceTestObjPtr, int32_t>;
 
@@ -272,6 +301,7 @@ private:
 
     BalanceTestKeyType key_;
     BalanceTestObj* erase_deck_ptr_;
+    size_t subtree_size_ = 0;
     WAVLTreeNodeState<BalanceTestObjPtr, int32_t> wavl_node_state_;
 };
 
@@ -13,13 +13,16 @@ fbl_common_tests := \
     $(LOCAL_DIR)/array_tests.cpp \
     $(LOCAL_DIR)/atomic_tests.cpp \
     $(LOCAL_DIR)/auto_call_tests.cpp \
+    $(LOCAL_DIR)/flat_hash_map_tests.cpp \
     $(LOCAL_DIR)/forward_tests.cpp \
     $(LOCAL_DIR)/function_tests.cpp \
     $(LOCAL_DIR)/initializer_list_tests.cpp \
+    $(LOCAL_DIR)/inline_vector_tests.cpp \
     $(LOCAL_DIR)/intrusive_container_tests.cpp \
     $(LOCAL_DIR)/intrusive_doubly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_hash_table_dll_tests.cpp \
     $(LOCAL_DIR)/intrusive_hash_table_sll_tests.cpp \
+    $(LOCAL_DIR)/intrusive_resizable_hash_table_tests.cpp \
     $(LOCAL_DIR)/intrusive_singly_linked_list_tests.cpp \
     $(LOCAL_DIR)/intrusive_wavl_tree_tests.cpp \
     $(LOCAL_DIR)/main.c \
@@ -49,6 +52,10 @@ fbl_device_tests += \
 fbl_device_tests += \
     $(LOCAL_DIR)/vmo_vmar_tests.cpp \
 
+# These benchmarks time themselves with zx_clock_get.
+fbl_device_tests += \
+    $(LOCAL_DIR)/intrusive_hash_table_benchmarks.cpp \
+
 fbl_host_tests := $(fbl_common_tests)
 
 # Userspace tests.
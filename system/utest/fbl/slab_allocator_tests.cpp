@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <pthread.h>
+
 #include <fbl/alloc_checker.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/ref_counted.h>
@@ -118,11 +120,13 @@ struct ReleaseHelper<SATraits, typename fbl::enable_if<
 
 // Traits which define the various test flavors.
 template <typename LockType,
-          fbl::SlabAllocatorFlavor AllocatorFlavor = fbl::SlabAllocatorFlavor::INSTANCED>
+          fbl::SlabAllocatorFlavor AllocatorFlavor = fbl::SlabAllocatorFlavor::INSTANCED,
+          bool LockFree = false>
 struct UnmanagedTestTraits {
     class ObjType;
     using PtrType       = ObjType*;
-    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType, AllocatorFlavor>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType, AllocatorFlavor,
+                                                   LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -141,11 +145,12 @@ struct UnmanagedTestTraits {
     static constexpr size_t MaxAllocs(size_t slabs) { return AllocatorType::AllocsPerSlab * slabs; }
 };
 
-template <typename LockType>
+template <typename LockType, bool LockFree = false>
 struct UniquePtrTestTraits {
     class ObjType;
     using PtrType       = fbl::unique_ptr<ObjType>;
-    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::INSTANCED, LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -165,11 +170,12 @@ struct UniquePtrTestTraits {
     static constexpr size_t MaxAllocs(size_t slabs) { return AllocatorType::AllocsPerSlab * slabs; }
 };
 
-template <typename LockType>
+template <typename LockType, bool LockFree = false>
 struct RefPtrTestTraits {
     class ObjType;
     using PtrType       = fbl::RefPtr<ObjType>;
-    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::INSTANCED, LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -271,11 +277,12 @@ bool slab_test() {
     END_TEST;
 }
 
-template <typename LockType>
+template <typename LockType, bool LockFree = false>
 struct StaticUnmanagedTestTraits {
     class ObjType;
     using PtrType       = ObjType*;
-    using AllocTraits   = fbl::StaticSlabAllocatorTraits<PtrType, 1024, LockType>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::STATIC, LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -295,11 +302,12 @@ struct StaticUnmanagedTestTraits {
     static constexpr bool   IsManaged = false;
 };
 
-template <typename LockType>
+template <typename LockType, bool LockFree = false>
 struct StaticUniquePtrTestTraits {
     class ObjType;
     using PtrType       = fbl::unique_ptr<ObjType>;
-    using AllocTraits   = fbl::StaticSlabAllocatorTraits<PtrType, 1024, LockType>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::STATIC, LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -319,11 +327,12 @@ struct StaticUniquePtrTestTraits {
     static constexpr bool   IsManaged = false;
 };
 
-template <typename LockType>
+template <typename LockType, bool LockFree = false>
 struct StaticRefPtrTestTraits {
     class ObjType;
     using PtrType       = fbl::RefPtr<ObjType>;
-    using AllocTraits   = fbl::StaticSlabAllocatorTraits<PtrType, 1024, LockType>;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::STATIC, LockFree>;
     using AllocatorType = fbl::SlabAllocator<AllocTraits>;
     using RefList       = fbl::DoublyLinkedList<PtrType>;
 
@@ -428,6 +437,87 @@ bool static_slab_test() {
 
     END_TEST;
 }
+
+// Hammer a single allocator from several threads at once, each allocating and
+// freeing objects in batches, and make sure that no object is ever handed out
+// twice.
+template <typename Traits>
+struct ThreadedSlabTest {
+    static constexpr size_t kThreadCount = 8;
+    static constexpr size_t kBatchSize   = 16;
+    static constexpr size_t kIterations  = 2000;
+
+    struct ThreadArgs {
+        typename Traits::AllocatorType* allocator;
+        size_t id;
+        bool ok;
+    };
+
+    static void* ThreadFn(void* ctx) {
+        auto args = static_cast<ThreadArgs*>(ctx);
+        typename Traits::PtrType objs[kBatchSize];
+
+        args->ok = true;
+        for (size_t iter = 0; iter < kIterations; ++iter) {
+            for (size_t i = 0; i < kBatchSize; ++i) {
+                objs[i] = args->allocator->New(args->id);
+                if (objs[i] == nullptr) {
+                    args->ok = false;
+                    return nullptr;
+                }
+                objs[i]->stamp_ = (args->id << 32) | (iter * kBatchSize + i);
+            }
+
+            // If anyone else was handed one of our objects, they will have
+            // scribbled their own stamp on it.
+            for (size_t i = 0; i < kBatchSize; ++i) {
+                if (objs[i]->stamp_ != ((args->id << 32) | (iter * kBatchSize + i)))
+                    args->ok = false;
+                delete objs[i];
+            }
+        }
+
+        return nullptr;
+    }
+
+    static bool Run() {
+        BEGIN_TEST;
+
+        // Enough slabs for every thread to have a full batch outstanding.
+        constexpr size_t kMaxSlabs = ((kThreadCount * kBatchSize) /
+                                      Traits::AllocatorType::AllocsPerSlab) + 1;
+        typename Traits::AllocatorType allocator(kMaxSlabs);
+
+        pthread_t threads[kThreadCount];
+        ThreadArgs args[kThreadCount];
+        for (size_t i = 0; i < kThreadCount; ++i) {
+            args[i] = { &allocator, i, false };
+            ASSERT_EQ(0, pthread_create(&threads[i], nullptr, ThreadFn, &args[i]));
+        }
+
+        for (size_t i = 0; i < kThreadCount; ++i) {
+            EXPECT_EQ(0, pthread_join(threads[i], nullptr));
+            EXPECT_TRUE(args[i].ok, "thread saw a corrupted or failed allocation");
+        }
+
+        END_TEST;
+    }
+};
+
+template <typename LockType, bool LockFree>
+struct ThreadedTestTraits {
+    class ObjType;
+    using PtrType       = ObjType*;
+    using AllocTraits   = fbl::SlabAllocatorTraits<PtrType, 1024, LockType,
+                                                   fbl::SlabAllocatorFlavor::INSTANCED, LockFree>;
+    using AllocatorType = fbl::SlabAllocator<AllocTraits>;
+
+    class ObjType : public fbl::SlabAllocated<AllocTraits> {
+    public:
+        explicit ObjType(size_t id) : stamp_(id) { }
+        volatile uint64_t stamp_;
+    };
+};
 }  // anon namespace
 
 using MutexLock = ::fbl::Mutex;
@@ -441,6 +531,14 @@ DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticUnmanagedTestTraits<NullLock>::Alloc
 DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticUniquePtrTestTraits<NullLock>::AllocTraits, 1);
 DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(StaticRefPtrTestTraits<NullLock>::AllocTraits, 1);
 
+using LockFreeStaticUnmanagedTraits = StaticUnmanagedTestTraits<MutexLock, true>;
+using LockFreeStaticUniquePtrTraits = StaticUniquePtrTestTraits<MutexLock, true>;
+using LockFreeStaticRefPtrTraits    = StaticRefPtrTestTraits<MutexLock, true>;
+
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(LockFreeStaticUnmanagedTraits::AllocTraits, 1);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(LockFreeStaticUniquePtrTraits::AllocTraits, 1);
+DECLARE_STATIC_SLAB_ALLOCATOR_STORAGE(LockFreeStaticRefPtrTraits::AllocTraits, 1);
+
 BEGIN_TEST_CASE(slab_allocator_tests)
 RUN_NAMED_TEST("Unmanaged Single Slab (mutex)", (slab_test<UnmanagedTestTraits<MutexLock>, 1>))
 RUN_NAMED_TEST("Unmanaged Multi Slab  (mutex)", (slab_test<UnmanagedTestTraits<MutexLock>>))
@@ -456,10 +554,24 @@ RUN_NAMED_TEST("UniquePtr Multi Slab  (unlock)", (slab_test<UniquePtrTestTraits<
 RUN_NAMED_TEST("RefPtr Single Slab    (unlock)", (slab_test<RefPtrTestTraits<NullLock>, 1>))
 RUN_NAMED_TEST("RefPtr Multi Slab     (unlock)", (slab_test<RefPtrTestTraits<NullLock>>))
 
+RUN_NAMED_TEST("Unmanaged Single Slab (lockfree)",
+               (slab_test<UnmanagedTestTraits<MutexLock,
+                                              fbl::SlabAllocatorFlavor::INSTANCED, true>, 1>))
+RUN_NAMED_TEST("Unmanaged Multi Slab  (lockfree)",
+               (slab_test<UnmanagedTestTraits<MutexLock,
+                                              fbl::SlabAllocatorFlavor::INSTANCED, true>>))
+RUN_NAMED_TEST("UniquePtr Single Slab (lockfree)", (slab_test<UniquePtrTestTraits<MutexLock, true>, 1>))
+RUN_NAMED_TEST("UniquePtr Multi Slab  (lockfree)", (slab_test<UniquePtrTestTraits<MutexLock, true>>))
+RUN_NAMED_TEST("RefPtr Single Slab    (lockfree)", (slab_test<RefPtrTestTraits<MutexLock, true>, 1>))
+RUN_NAMED_TEST("RefPtr Multi Slab     (lockfree)", (slab_test<RefPtrTestTraits<MutexLock, true>>))
+
 RUN_NAMED_TEST("Manual Delete Unmanaged (mutex)",
               (slab_test<UnmanagedTestTraits<MutexLock, fbl::SlabAllocatorFlavor::MANUAL_DELETE>>))
 RUN_NAMED_TEST("Manual Delete Unmanaged (unlock)",
               (slab_test<UnmanagedTestTraits<NullLock, fbl::SlabAllocatorFlavor::MANUAL_DELETE>>))
+RUN_NAMED_TEST("Manual Delete Unmanaged (lockfree)",
+              (slab_test<UnmanagedTestTraits<MutexLock,
+                                             fbl::SlabAllocatorFlavor::MANUAL_DELETE, true>>))
 
 RUN_NAMED_TEST("Static Unmanaged (unlock)", (static_slab_test<StaticUnmanagedTestTraits<NullLock>>))
 RUN_NAMED_TEST("Static UniquePtr (unlock)", (static_slab_test<StaticUniquePtrTestTraits<NullLock>>))
@@ -469,7 +581,16 @@ RUN_NAMED_TEST("Static Unmanaged (mutex)", (static_slab_test<StaticUnmanagedTest
 RUN_NAMED_TEST("Static UniquePtr (mutex)", (static_slab_test<StaticUniquePtrTestTraits<MutexLock>>))
 RUN_NAMED_TEST("Static RefPtr    (mutex)", (static_slab_test<StaticRefPtrTestTraits<MutexLock>>))
 
+RUN_NAMED_TEST("Static Unmanaged (lockfree)", (static_slab_test<LockFreeStaticUnmanagedTraits>))
+RUN_NAMED_TEST("Static UniquePtr (lockfree)", (static_slab_test<LockFreeStaticUniquePtrTraits>))
+RUN_NAMED_TEST("Static RefPtr    (lockfree)", (static_slab_test<LockFreeStaticRefPtrTraits>))
+
 RUN_NAMED_TEST("Static Unmanaged (unlock)", (static_slab_test<StaticUnmanagedTestTraits<NullLock>>))
 RUN_NAMED_TEST("Static UniquePtr (unlock)", (static_slab_test<StaticUniquePtrTestTraits<NullLock>>))
 RUN_NAMED_TEST("Static RefPtr    (unlock)", (static_slab_test<StaticRefPtrTestTraits<NullLock>>))
+
+RUN_NAMED_TEST("Threaded (mutex)",
+               (ThreadedSlabTest<ThreadedTestTraits<MutexLock, false>>::Run))
+RUN_NAMED_TEST("Threaded (lockfree)",
+               (ThreadedSlabTest<ThreadedTestTraits<MutexLock, true>>::Run))
 END_TEST_CASE(slab_allocator_tests);
@@ -198,42 +198,58 @@ bool non_empty_string_test() {
 bool copy_move_and_assignment_test() {
     BEGIN_TEST;
 
+    // Strings longer than |kInlineCapacity| share their buffer with copies.
+
     {
-        fbl::String abc("abc");
+        fbl::String abc("abcdefghijklmnopqrstuvwxyz");
         fbl::String copy(abc);
-        EXPECT_CSTR_EQ("abc", abc.data());
+        EXPECT_CSTR_EQ("abcdefghijklmnopqrstuvwxyz", abc.data());
         EXPECT_EQ(abc.data(), copy.data());
-        EXPECT_EQ(3u, copy.length());
+        EXPECT_EQ(26u, copy.length());
     }
 
     {
-        fbl::String abc("abc");
+        fbl::String abc("abcdefghijklmnopqrstuvwxyz");
         fbl::String copy(abc);
         fbl::String move(fbl::move(copy));
-        EXPECT_CSTR_EQ("abc", abc.data());
+        EXPECT_CSTR_EQ("abcdefghijklmnopqrstuvwxyz", abc.data());
         EXPECT_CSTR_EQ("", copy.data());
         EXPECT_EQ(abc.data(), move.data());
-        EXPECT_EQ(3u, move.length());
+        EXPECT_EQ(26u, move.length());
     }
 
     {
-        fbl::String abc("abc");
+        fbl::String abc("abcdefghijklmnopqrstuvwxyz");
         fbl::String str;
         str = abc;
-        EXPECT_CSTR_EQ("abc", abc.data());
+        EXPECT_CSTR_EQ("abcdefghijklmnopqrstuvwxyz", abc.data());
         EXPECT_EQ(abc.data(), str.data());
-        EXPECT_EQ(3u, str.length());
+        EXPECT_EQ(26u, str.length());
     }
 
     {
-        fbl::String abc("abc");
+        fbl::String abc("abcdefghijklmnopqrstuvwxyz");
         fbl::String copy(abc);
         fbl::String str;
         str = fbl::move(copy);
-        EXPECT_CSTR_EQ("abc", abc.data());
+        EXPECT_CSTR_EQ("abcdefghijklmnopqrstuvwxyz", abc.data());
         EXPECT_CSTR_EQ("", copy.data());
         EXPECT_EQ(abc.data(), str.data());
-        EXPECT_EQ(3u, str.length());
+        EXPECT_EQ(26u, str.length());
+    }
+
+    // Short strings are copied into each object's inline storage.
+
+    {
+        fbl::String abc("abc");
+        fbl::String copy(abc);
+        fbl::String move(fbl::move(copy));
+        EXPECT_CSTR_EQ("abc", abc.data());
+        EXPECT_CSTR_EQ("abc", move.data());
+        EXPECT_CSTR_EQ("", copy.data());
+        EXPECT_NE(abc.data(), move.data());
+        EXPECT_EQ(3u, move.length());
+        EXPECT_EQ(0u, copy.length());
     }
 
     {
@@ -644,48 +660,29 @@ bool swap_test() {
 bool ref_count_test() {
     BEGIN_TEST;
 
-    // Empty strings
+    // Strings which fit in |kInlineCapacity|, including empty ones, are
+    // stored inline and have no ref count.
 
     {
         fbl::String empty;
-        unsigned int initial_ref_count = StringTestHelper::GetRefCount(empty);
-        EXPECT_GT(initial_ref_count, 1u);
-        {
-            fbl::String copy(empty);
-            EXPECT_EQ(empty.data(), copy.data());
-            EXPECT_EQ(initial_ref_count + 1u, StringTestHelper::GetRefCount(empty));
-            {
-                fbl::String another_empty("");
-                EXPECT_EQ(empty.data(), another_empty.data());
-                EXPECT_EQ(initial_ref_count + 2u, StringTestHelper::GetRefCount(empty));
-                {
-                    fbl::String assigned_from_empty = another_empty;
-                    EXPECT_EQ(empty.data(), assigned_from_empty.data());
-                    EXPECT_EQ(initial_ref_count + 3u, StringTestHelper::GetRefCount(empty));
-
-                    assigned_from_empty = "";
-                    EXPECT_EQ(empty.data(), assigned_from_empty.data());
-                    EXPECT_EQ(initial_ref_count + 3u, StringTestHelper::GetRefCount(empty));
-
-                    assigned_from_empty = empty;
-                    EXPECT_EQ(empty.data(), assigned_from_empty.data());
-                    EXPECT_EQ(initial_ref_count + 3u, StringTestHelper::GetRefCount(empty));
+        EXPECT_EQ(0u, StringTestHelper::GetRefCount(empty));
+        fbl::String copy(empty);
+        EXPECT_EQ(0u, StringTestHelper::GetRefCount(copy));
+        EXPECT_NE(empty.data(), copy.data());
 
-                    assigned_from_empty.clear();
-                    EXPECT_EQ(empty.data(), assigned_from_empty.data());
-                    EXPECT_EQ(initial_ref_count + 3u, StringTestHelper::GetRefCount(empty));
-                }
-                EXPECT_EQ(initial_ref_count + 2u, StringTestHelper::GetRefCount(empty));
-            }
-            EXPECT_EQ(initial_ref_count + 1u, StringTestHelper::GetRefCount(empty));
-        }
-        EXPECT_EQ(initial_ref_count, StringTestHelper::GetRefCount(empty));
+        fbl::String abc("abc");
+        EXPECT_EQ(0u, StringTestHelper::GetRefCount(abc));
+        fbl::String assigned_from_abc;
+        assigned_from_abc = abc;
+        EXPECT_EQ(0u, StringTestHelper::GetRefCount(assigned_from_abc));
+        EXPECT_NE(abc.data(), assigned_from_abc.data());
+        EXPECT_CSTR_EQ("abc", assigned_from_abc.data());
     }
 
     // C-string initialized strings.
 
     {
-        fbl::String abc("abc");
+        fbl::String abc("abcdefghijklmnopqrstuvwxyz");
         EXPECT_EQ(1u, StringTestHelper::GetRefCount(abc));
         {
             fbl::String copy1(abc);
@@ -722,7 +719,7 @@ bool ref_count_test() {
     // Repeated character initialized strings.
 
     {
-        fbl::String xs(10u, 'x');
+        fbl::String xs(20u, 'x');
         EXPECT_EQ(1u, StringTestHelper::GetRefCount(xs));
         {
             fbl::String copy1(xs);
@@ -759,6 +756,47 @@ bool ref_count_test() {
     END_TEST;
 }
 
+bool inline_storage_test() {
+    BEGIN_TEST;
+
+    static_assert(fbl::String::kInlineCapacity >= 7u, "");
+    const size_t kCap = fbl::String::kInlineCapacity;
+
+    // The longest inline string, and the shortest which is not.
+    fbl::String longest_inline(kCap, 'a');
+    fbl::String shortest_heap(kCap + 1u, 'b');
+    EXPECT_EQ(kCap, longest_inline.length());
+    EXPECT_EQ(0, longest_inline[kCap]);
+    EXPECT_EQ(0u, StringTestHelper::GetRefCount(longest_inline));
+    EXPECT_EQ(kCap + 1u, shortest_heap.length());
+    EXPECT_EQ(0, shortest_heap[kCap + 1u]);
+    EXPECT_EQ(1u, StringTestHelper::GetRefCount(shortest_heap));
+
+    // Concatenation and swapping move between the two representations.
+    fbl::String concat = fbl::String::Concat({longest_inline, "c"});
+    EXPECT_EQ(kCap + 1u, concat.length());
+    EXPECT_EQ(1u, StringTestHelper::GetRefCount(concat));
+    EXPECT_EQ('c', concat[kCap]);
+
+    longest_inline.swap(shortest_heap);
+    EXPECT_EQ(kCap + 1u, longest_inline.length());
+    EXPECT_EQ('b', longest_inline[0u]);
+    EXPECT_EQ(1u, StringTestHelper::GetRefCount(longest_inline));
+    EXPECT_EQ(kCap, shortest_heap.length());
+    EXPECT_EQ('a', shortest_heap[0u]);
+    EXPECT_EQ(0u, StringTestHelper::GetRefCount(shortest_heap));
+
+    // Assigning a short string over a long one drops the heap buffer.
+    fbl::String heap_copy(longest_inline);
+    EXPECT_EQ(2u, StringTestHelper::GetRefCount(longest_inline));
+    heap_copy = "short";
+    EXPECT_CSTR_EQ("short", heap_copy.data());
+    EXPECT_EQ(5u, heap_copy.length());
+    EXPECT_EQ(1u, StringTestHelper::GetRefCount(longest_inline));
+
+    END_TEST;
+}
+
 constexpr char kFakeStringData[] = "hello";
 constexpr size_t kFakeStringLength = fbl::count_of(kFakeStringData);
 
@@ -852,6 +890,7 @@ RUN_TEST(alloc_checker_test)
 RUN_TEST(to_string_piece_test)
 RUN_TEST(swap_test)
 RUN_TEST(ref_count_test)
+RUN_TEST(inline_storage_test)
 RUN_TEST(conversion_from_string_like_object)
 RUN_TEST(assignment_from_string_like_object)
 END_TEST_CASE(string_tests)
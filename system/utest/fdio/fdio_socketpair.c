@@ -397,6 +397,54 @@ bool socketpair_shutdown_peer_rd_during_send_test(void) {
     END_TEST;
 }
 
+#define POLL_MANY_PAIRS 40
+
+// More descriptors than zx_object_wait_many() takes, polled repeatedly so
+// the cached wait set sees both unchanged and replaced descriptors.
+bool socketpair_poll_many_test(void) {
+    BEGIN_TEST;
+
+    int fds[POLL_MANY_PAIRS][2];
+    for (int i = 0; i < POLL_MANY_PAIRS; i++) {
+        ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]), 0, "socketpair failed");
+    }
+
+    struct pollfd pfds[POLL_MANY_PAIRS];
+    for (int i = 0; i < POLL_MANY_PAIRS; i++) {
+        pfds[i].fd = fds[i][0];
+        pfds[i].events = POLLIN;
+    }
+    EXPECT_EQ(poll(pfds, POLL_MANY_PAIRS, 0), 0, "nothing should be readable");
+
+    char c = 'x';
+    for (int round = 0; round < 3; round++) {
+        ASSERT_EQ(write(fds[3][1], &c, 1), 1, "write failed");
+        ASSERT_EQ(write(fds[37][1], &c, 1), 1, "write failed");
+        EXPECT_EQ(poll(pfds, POLL_MANY_PAIRS, 1000), 2, "two entries should be readable");
+        EXPECT_EQ(pfds[3].revents, POLLIN, "");
+        EXPECT_EQ(pfds[37].revents, POLLIN, "");
+        EXPECT_EQ(pfds[4].revents, 0, "");
+        ASSERT_EQ(read(fds[3][0], &c, 1), 1, "read failed");
+        ASSERT_EQ(read(fds[37][0], &c, 1), 1, "read failed");
+    }
+
+    // replace one descriptor between polls
+    EXPECT_EQ(close(fds[10][0]), 0, "");
+    EXPECT_EQ(close(fds[10][1]), 0, "");
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds[10]), 0, "socketpair failed");
+    pfds[10].fd = fds[10][0];
+    ASSERT_EQ(write(fds[10][1], &c, 1), 1, "write failed");
+    EXPECT_EQ(poll(pfds, POLL_MANY_PAIRS, 1000), 1, "new descriptor should be readable");
+    EXPECT_EQ(pfds[10].revents, POLLIN, "");
+
+    for (int i = 0; i < POLL_MANY_PAIRS; i++) {
+        EXPECT_EQ(close(fds[i][0]), 0, "");
+        EXPECT_EQ(close(fds[i][1]), 0, "");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fdio_socketpair_test)
 RUN_TEST(socketpair_test);
 RUN_TEST(socketpair_shutdown_rd_test);
@@ -408,4 +456,5 @@ RUN_TEST(socketpair_shutdown_self_rd_during_recv_test);
 RUN_TEST(socketpair_shutdown_peer_wr_during_recv_test);
 RUN_TEST(socketpair_shutdown_self_wr_during_send_test);
 RUN_TEST(socketpair_shutdown_peer_rd_during_send_test);
+RUN_TEST(socketpair_poll_many_test);
 END_TEST_CASE(fdio_socketpair_test)
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <fidl/cpp/builder.h>
+#include <fidl/cpp/message_buffer.h>
 #include <fidl/cpp/message_builder.h>
 #include <fidl/cpp/message.h>
 #include <fidl/cpp/string_view.h>
@@ -90,9 +91,78 @@ bool message_builder_test() {
     END_TEST;
 }
 
+bool message_buffer_pool_test() {
+    BEGIN_TEST;
+
+    fidl::MessageBufferPool pool(1024u, 4u, 2u);
+    EXPECT_EQ(pool.cached_count(), 0u);
+
+    uint8_t* first_bytes;
+    {
+        fidl::MessageBuffer buffer(&pool);
+        EXPECT_EQ(buffer.bytes_capacity(), 1024u);
+        EXPECT_EQ(buffer.handles_capacity(), 4u);
+        first_bytes = buffer.bytes();
+    }
+    EXPECT_EQ(pool.cached_count(), 1u);
+
+    // The next buffer reuses the memory of the last.
+    {
+        fidl::MessageBuffer buffer(&pool);
+        EXPECT_EQ(buffer.bytes(), first_bytes);
+        EXPECT_EQ(pool.cached_count(), 0u);
+
+        fidl::MessageBuffer second(&pool);
+        fidl::MessageBuffer third(&pool);
+        EXPECT_NE(second.bytes(), first_bytes);
+    }
+    // Only |max_cached| of the three are kept.
+    EXPECT_EQ(pool.cached_count(), 2u);
+
+    pool.Trim();
+    EXPECT_EQ(pool.cached_count(), 0u);
+
+    END_TEST;
+}
+
+bool message_builder_pool_test() {
+    BEGIN_TEST;
+
+    fidl::MessageBufferPool pool;
+    for (uint32_t i = 0u; i < 3u; i++) {
+        fidl::MessageBuilder builder(&nonnullable_handle_message_type, &pool);
+        for (uint32_t txid = 1u; txid <= 2u; txid++) {
+            builder.Reset();
+            builder.header()->txid = txid;
+            builder.header()->ordinal = 42u;
+
+            // The message takes ownership of the event.
+            zx::event e;
+            EXPECT_EQ(zx::event::create(0, &e), ZX_OK);
+            zx_handle_t event_handle = e.get();
+            zx_handle_t* handle = builder.New<zx_handle_t>();
+            *handle = e.release();
+
+            fidl::Message message;
+            const char* error_msg;
+            EXPECT_EQ(builder.Encode(&message, &error_msg), ZX_OK);
+            EXPECT_EQ(message.txid(), txid);
+            EXPECT_EQ(message.bytes().actual(),
+                      sizeof(fidl_message_header_t) + sizeof(zx_handle_t));
+            EXPECT_EQ(message.handles().actual(), 1u);
+            EXPECT_EQ(message.handles().data()[0], event_handle);
+        }
+    }
+    EXPECT_EQ(pool.cached_count(), 1u);
+
+    END_TEST;
+}
+
 }  // namespace
 
 BEGIN_TEST_CASE(message_tests)
 RUN_NAMED_TEST("Message test", message_test)
 RUN_NAMED_TEST("MessageBuilder test", message_builder_test)
+RUN_NAMED_TEST("MessageBufferPool test", message_buffer_pool_test)
+RUN_NAMED_TEST("MessageBuilder with MessageBufferPool test", message_builder_pool_test)
 END_TEST_CASE(message_tests);
@@ -16,6 +16,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/fidl_coded_types.cpp \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/message_tests.cpp \
+    $(LOCAL_DIR)/static_coding_tests.cpp \
 
 MODULE_NAME := fidl-test
 
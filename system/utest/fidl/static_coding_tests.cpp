@@ -0,0 +1,339 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <fidl/coding.h>
+#include <fidl/cpp/message.h>
+#include <fidl/cpp/static_coding.h>
+#include <fidl/internal.h>
+#include <zircon/syscalls.h>
+
+#include <unittest/unittest.h>
+
+namespace fidl {
+namespace {
+
+constexpr zx_handle_t dummy_handle_0 = static_cast<zx_handle_t>(23);
+constexpr zx_handle_t dummy_handle_1 = static_cast<zx_handle_t>(24);
+constexpr zx_handle_t dummy_handle_2 = static_cast<zx_handle_t>(25);
+constexpr zx_handle_t dummy_handle_3 = static_cast<zx_handle_t>(26);
+
+// A message with something of most kinds in it:
+//
+//   struct Payload { uint32 padding; handle handle; };
+//   Mixed(handle handle, uint32 count, string:32 string, vector<handle>:2 vector,
+//         Payload? payload);
+struct mixed_payload {
+    uint32_t padding;
+    zx_handle_t handle;
+};
+struct mixed_inline_data {
+    fidl_message_header_t header;
+    zx_handle_t handle;
+    uint32_t count;
+    fidl_string_t string;
+    fidl_vector_t vector;
+    mixed_payload* payload;
+};
+struct mixed_message_layout {
+    mixed_inline_data inline_struct;
+    alignas(FIDL_ALIGNMENT) char string_data[8];
+    alignas(FIDL_ALIGNMENT) zx_handle_t handles[2];
+    alignas(FIDL_ALIGNMENT) mixed_payload payload;
+};
+
+// The coding table for the interpreter...
+const fidl_type_t nonnullable_handle =
+    fidl_type_t(FidlCodedHandle(ZX_OBJ_TYPE_NONE, kNonnullable));
+const fidl_type_t bounded_32_string = fidl_type_t(FidlCodedString(32u, kNonnullable));
+const fidl_type_t bounded_2_vector_of_handles = fidl_type_t(
+    FidlCodedVector(&nonnullable_handle, 2u, sizeof(zx_handle_t), kNonnullable));
+const FidlField mixed_payload_fields[] = {
+    FidlField(&nonnullable_handle, offsetof(mixed_payload, handle)),
+};
+const fidl_type_t mixed_payload_struct = fidl_type_t(FidlCodedStruct(
+    mixed_payload_fields, 1u, sizeof(mixed_payload)));
+const fidl_type_t mixed_payload_struct_pointer =
+    fidl_type_t(FidlCodedStructPointer(&mixed_payload_struct.coded_struct));
+const FidlField mixed_fields[] = {
+    FidlField(&nonnullable_handle, offsetof(mixed_inline_data, handle)),
+    FidlField(&bounded_32_string, offsetof(mixed_inline_data, string)),
+    FidlField(&bounded_2_vector_of_handles, offsetof(mixed_inline_data, vector)),
+    FidlField(&mixed_payload_struct_pointer, offsetof(mixed_inline_data, payload)),
+};
+const fidl_type_t mixed_message_type = fidl_type_t(FidlCodedStruct(
+    mixed_fields, 4u, sizeof(mixed_inline_data)));
+
+// ...and the same type for |DecodeInPlace()| and |EncodeInPlace()|.
+using MixedPayloadType = coded::Struct<
+    sizeof(mixed_payload),
+    coded::Field<offsetof(mixed_payload, handle), coded::Handle<>>>;
+using MixedMessageType = coded::Struct<
+    sizeof(mixed_inline_data),
+    coded::Field<offsetof(mixed_inline_data, handle), coded::Handle<>>,
+    coded::Field<offsetof(mixed_inline_data, string), coded::String<32u>>,
+    coded::Field<offsetof(mixed_inline_data, vector),
+                 coded::Vector<coded::Handle<>, sizeof(zx_handle_t), 2u>>,
+    coded::Field<offsetof(mixed_inline_data, payload),
+                 coded::StructPointer<MixedPayloadType>>>;
+
+// Fills in |message| as it would arrive from a channel.
+void MakeEncodedMixedMessage(mixed_message_layout* message) {
+    memset(message, 0, sizeof(*message));
+    message->inline_struct.handle = FIDL_HANDLE_PRESENT;
+    message->inline_struct.count = 42u;
+    message->inline_struct.string.size = 6u;
+    message->inline_struct.string.data = reinterpret_cast<char*>(FIDL_ALLOC_PRESENT);
+    message->inline_struct.vector.count = 2u;
+    message->inline_struct.vector.data = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
+    message->inline_struct.payload = reinterpret_cast<mixed_payload*>(FIDL_ALLOC_PRESENT);
+    memcpy(message->string_data, "hello!", 6u);
+    message->handles[0] = FIDL_HANDLE_PRESENT;
+    message->handles[1] = FIDL_HANDLE_PRESENT;
+    message->payload.padding = 7u;
+    message->payload.handle = FIDL_HANDLE_PRESENT;
+}
+
+const zx_handle_t mixed_handles[] = {
+    dummy_handle_0, dummy_handle_1, dummy_handle_2, dummy_handle_3,
+};
+
+bool static_decode_matches_interpreter() {
+    BEGIN_TEST;
+
+    mixed_message_layout interpreted;
+    MakeEncodedMixedMessage(&interpreted);
+    const char* error = nullptr;
+    EXPECT_EQ(fidl_decode(&mixed_message_type, &interpreted, sizeof(interpreted),
+                          mixed_handles, 4u, &error),
+              ZX_OK, error);
+
+    mixed_message_layout message;
+    MakeEncodedMixedMessage(&message);
+    error = nullptr;
+    EXPECT_EQ(DecodeInPlace<MixedMessageType>(&message, sizeof(message), mixed_handles, 4u,
+                                              &error),
+              ZX_OK, error);
+    EXPECT_NULL(error, error);
+
+    EXPECT_EQ(message.inline_struct.handle, dummy_handle_0);
+    EXPECT_EQ(message.inline_struct.count, 42u);
+    EXPECT_EQ(message.inline_struct.string.data, message.string_data);
+    EXPECT_EQ(message.inline_struct.vector.data, message.handles);
+    EXPECT_EQ(message.handles[0], dummy_handle_1);
+    EXPECT_EQ(message.handles[1], dummy_handle_2);
+    EXPECT_EQ(message.inline_struct.payload, &message.payload);
+    EXPECT_EQ(message.payload.handle, dummy_handle_3);
+
+    // Apart from the pointers, which point into each message, the two
+    // decode the same.
+    EXPECT_EQ(interpreted.inline_struct.handle, message.inline_struct.handle);
+    EXPECT_EQ(interpreted.handles[0], message.handles[0]);
+    EXPECT_EQ(interpreted.handles[1], message.handles[1]);
+    EXPECT_EQ(interpreted.payload.handle, message.payload.handle);
+
+    END_TEST;
+}
+
+bool static_decode_errors_match_interpreter() {
+    BEGIN_TEST;
+
+    struct Case {
+        const char* name;
+        void (*corrupt)(mixed_message_layout* message);
+        uint32_t num_bytes;
+        uint32_t num_handles;
+    };
+    const Case cases[] = {
+        {"valid", [](mixed_message_layout* message) {},
+         sizeof(mixed_message_layout), 4u},
+        {"too few handles", [](mixed_message_layout* message) {},
+         sizeof(mixed_message_layout), 3u},
+        {"too few bytes", [](mixed_message_layout* message) {},
+         sizeof(mixed_message_layout) - FIDL_ALIGNMENT, 4u},
+        {"too many bytes", [](mixed_message_layout* message) {},
+         sizeof(mixed_message_layout) - 4u, 4u},
+        {"shorter than the inline struct", [](mixed_message_layout* message) {},
+         sizeof(mixed_inline_data) - 4u, 4u},
+        {"absent handle", [](mixed_message_layout* message) {
+             message->inline_struct.handle = FIDL_HANDLE_ABSENT;
+         }, sizeof(mixed_message_layout), 4u},
+        {"garbage handle", [](mixed_message_layout* message) {
+             message->inline_struct.handle = 1234u;
+         }, sizeof(mixed_message_layout), 4u},
+        {"string too long", [](mixed_message_layout* message) {
+             message->inline_struct.string.size = 33u;
+         }, sizeof(mixed_message_layout), 4u},
+        {"absent string", [](mixed_message_layout* message) {
+             message->inline_struct.string.data = reinterpret_cast<char*>(FIDL_ALLOC_ABSENT);
+         }, sizeof(mixed_message_layout), 4u},
+        {"vector too long", [](mixed_message_layout* message) {
+             message->inline_struct.vector.count = 3u;
+         }, sizeof(mixed_message_layout), 4u},
+        {"short vector", [](mixed_message_layout* message) {
+             message->inline_struct.vector.count = 1u;
+         }, sizeof(mixed_message_layout), 4u},
+        {"garbage vector", [](mixed_message_layout* message) {
+             message->inline_struct.vector.data = reinterpret_cast<void*>(1u);
+         }, sizeof(mixed_message_layout), 4u},
+        {"absent payload", [](mixed_message_layout* message) {
+             message->inline_struct.payload = reinterpret_cast<mixed_payload*>(FIDL_ALLOC_ABSENT);
+         }, sizeof(mixed_message_layout) - sizeof(mixed_payload), 3u},
+        {"garbage payload", [](mixed_message_layout* message) {
+             message->inline_struct.payload = reinterpret_cast<mixed_payload*>(1u);
+         }, sizeof(mixed_message_layout), 4u},
+    };
+
+    for (const Case& c : cases) {
+        mixed_message_layout interpreted;
+        MakeEncodedMixedMessage(&interpreted);
+        c.corrupt(&interpreted);
+        const char* interpreted_error = nullptr;
+        zx_status_t interpreted_status =
+            fidl_decode(&mixed_message_type, &interpreted, c.num_bytes,
+                        mixed_handles, c.num_handles, &interpreted_error);
+
+        mixed_message_layout message;
+        MakeEncodedMixedMessage(&message);
+        c.corrupt(&message);
+        const char* error = nullptr;
+        zx_status_t status = DecodeInPlace<MixedMessageType>(
+            &message, c.num_bytes, mixed_handles, c.num_handles, &error);
+
+        EXPECT_EQ(interpreted_status, status, c.name);
+        if (interpreted_error == nullptr || error == nullptr) {
+            EXPECT_EQ(interpreted_error, error, c.name);
+        } else {
+            EXPECT_STR_EQ(interpreted_error, error, strlen(interpreted_error) + 1, c.name);
+        }
+    }
+
+    END_TEST;
+}
+
+bool static_encode_round_trip() {
+    BEGIN_TEST;
+
+    mixed_message_layout message;
+    MakeEncodedMixedMessage(&message);
+    const char* error = nullptr;
+    ASSERT_EQ(DecodeInPlace<MixedMessageType>(&message, sizeof(message), mixed_handles, 4u,
+                                              &error),
+              ZX_OK, error);
+
+    zx_handle_t handles[4] = {};
+    uint32_t actual_handles = 0u;
+    EXPECT_EQ(EncodeInPlace<MixedMessageType>(&message, sizeof(message), handles, 4u,
+                                              &actual_handles, &error),
+              ZX_OK, error);
+    EXPECT_EQ(actual_handles, 4u);
+    EXPECT_EQ(memcmp(handles, mixed_handles, sizeof(handles)), 0);
+
+    mixed_message_layout expected;
+    MakeEncodedMixedMessage(&expected);
+    EXPECT_EQ(memcmp(&message, &expected, sizeof(message)), 0, "encodes back to the original");
+
+    // Encoding must find each out-of-line object where it goes.
+    ASSERT_EQ(DecodeInPlace<MixedMessageType>(&message, sizeof(message), mixed_handles, 4u,
+                                              &error),
+              ZX_OK, error);
+    message.inline_struct.payload = &expected.payload;
+    EXPECT_EQ(EncodeInPlace<MixedMessageType>(&message, sizeof(message), handles, 4u,
+                                              &actual_handles, &error),
+              ZX_ERR_INVALID_ARGS);
+    const char kMisplaced[] = "message wanted to store too large of a nullable struct";
+    EXPECT_STR_EQ(kMisplaced, error, sizeof(kMisplaced), "misplaced payload");
+
+    END_TEST;
+}
+
+bool static_message_decode_encode() {
+    BEGIN_TEST;
+
+    mixed_message_layout storage;
+    MakeEncodedMixedMessage(&storage);
+    zx_handle_t handles[4];
+    memcpy(handles, mixed_handles, sizeof(handles));
+
+    Message message(BytePart(reinterpret_cast<uint8_t*>(&storage), sizeof(storage),
+                             sizeof(storage)),
+                    HandlePart(handles, 4u, 4u));
+    const char* error = nullptr;
+    EXPECT_EQ(message.Decode<MixedMessageType>(&error), ZX_OK, error);
+    EXPECT_EQ(message.handles().actual(), 0u);
+    EXPECT_EQ(storage.payload.handle, dummy_handle_3);
+
+    EXPECT_EQ(message.Encode<MixedMessageType>(&error), ZX_OK, error);
+    EXPECT_EQ(message.handles().actual(), 4u);
+    EXPECT_EQ(handles[3], dummy_handle_3);
+
+    END_TEST;
+}
+
+// Not a pass/fail test: prints how long the interpreter and the
+// specialized code each take to decode and encode the message above.
+bool static_coding_benchmark() {
+    BEGIN_TEST;
+
+    constexpr uint32_t kIterations = 100000u;
+    mixed_message_layout message;
+    zx_handle_t handles[4];
+    uint32_t actual_handles = 0u;
+    const char* error = nullptr;
+
+    zx_time_t decode_interpreted = 0u;
+    zx_time_t encode_interpreted = 0u;
+    MakeEncodedMixedMessage(&message);
+    for (uint32_t i = 0u; i < kIterations; i++) {
+        zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        zx_status_t status = fidl_decode(&mixed_message_type, &message, sizeof(message),
+                                         mixed_handles, 4u, &error);
+        zx_time_t middle = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        status |= fidl_encode(&mixed_message_type, &message, sizeof(message),
+                              handles, 4u, &actual_handles, &error);
+        zx_time_t end = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        ASSERT_EQ(status, ZX_OK, error);
+        decode_interpreted += middle - start;
+        encode_interpreted += end - middle;
+    }
+
+    zx_time_t decode_static = 0u;
+    zx_time_t encode_static = 0u;
+    for (uint32_t i = 0u; i < kIterations; i++) {
+        zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        zx_status_t status = DecodeInPlace<MixedMessageType>(&message, sizeof(message),
+                                                             mixed_handles, 4u, &error);
+        zx_time_t middle = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        status |= EncodeInPlace<MixedMessageType>(&message, sizeof(message),
+                                                  handles, 4u, &actual_handles, &error);
+        zx_time_t end = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        ASSERT_EQ(status, ZX_OK, error);
+        decode_static += middle - start;
+        encode_static += end - middle;
+    }
+
+    printf("\n%-12s %12s %12s\n", "ns/message", "decode", "encode");
+    printf("%-12s %12.1f %12.1f\n", "interpreted",
+           static_cast<double>(decode_interpreted) / kIterations,
+           static_cast<double>(encode_interpreted) / kIterations);
+    printf("%-12s %12.1f %12.1f\n", "specialized",
+           static_cast<double>(decode_static) / kIterations,
+           static_cast<double>(encode_static) / kIterations);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(static_coding)
+RUN_TEST(static_decode_matches_interpreter)
+RUN_TEST(static_decode_errors_match_interpreter)
+RUN_TEST(static_encode_round_trip)
+RUN_TEST(static_message_decode_encode)
+RUN_TEST(static_coding_benchmark)
+END_TEST_CASE(static_coding)
+
+} // namespace
+} // namespace fidl
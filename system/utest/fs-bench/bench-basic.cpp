@@ -9,12 +9,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <zircon/device/vfs.h>
 #include <zircon/syscalls.h>
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/string_piece.h>
 #include <fbl/unique_ptr.h>
@@ -202,6 +205,176 @@ bool benchmark_path_walk(void) {
     END_TEST;
 }
 
+// Creates, looks up and unlinks |NumFiles| entries of a single directory, so
+// that the cost of finding a name among many dominates.
+template <size_t NumFiles>
+bool benchmark_wide_directory(void) {
+    BEGIN_TEST;
+    static_assert(NumFiles <= 26 * 26 * 26, "Not enough distinct names");
+    printf("\nBenchmarking Wide directory (%lu entries)\n", NumFiles);
+    ASSERT_EQ(mkdir(MOUNT_POINT "/wide", 0666), 0);
+    char path[PATH_MAX];
+    const size_t dir_len = strlen(MOUNT_POINT "/wide");
+    uint64_t start;
+
+    const char* ops[] = { "create", "stat", "unlink" };
+    for (size_t op = 0; op < fbl::count_of(ops); op++) {
+        strcpy(path, MOUNT_POINT "/wide" START_STRING);
+        start = zx_ticks_get();
+        for (size_t i = 0; i < NumFiles; i++) {
+            if (op == 0) {
+                int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+                ASSERT_GE(fd, 0, "Could not create file");
+                ASSERT_EQ(close(fd), 0);
+            } else if (op == 1) {
+                ASSERT_TRUE(stat_callback(path));
+            } else {
+                ASSERT_TRUE(unlink_callback(path));
+            }
+            increment_str<kComponentLength>(path + dir_len);
+        }
+        time_end(ops[op], start);
+    }
+
+    ASSERT_EQ(rmdir(MOUNT_POINT "/wide"), 0);
+    int fd = open(MOUNT_POINT, O_DIRECTORY | O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(syncfs(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
+constexpr size_t kConcurrentReadSize = 4 * MB;
+constexpr size_t kConcurrentReadChunk = 8 * KB;
+constexpr int kConcurrentReadCycles = 8;
+
+struct ConcurrentReader {
+    int fd;
+    bool ok;
+};
+
+int concurrent_read_thread(void* arg) {
+    ConcurrentReader* reader = static_cast<ConcurrentReader*>(arg);
+    uint8_t data[kConcurrentReadChunk];
+    for (int i = 0; i < kConcurrentReadCycles; i++) {
+        for (size_t off = 0; off < kConcurrentReadSize; off += sizeof(data)) {
+            if (pread(reader->fd, data, sizeof(data), off) != sizeof(data) ||
+                data[0] != kMagicByte) {
+                reader->ok = false;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Reads a file of its own on each of |NumThreads| threads at once. Each thread
+// reads as much as the last, so the time taken against the thread count shows
+// how well the filesystem serves readers in parallel.
+template <size_t NumThreads>
+bool benchmark_concurrent_read(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Concurrent read (%lu threads, %lu MB each)\n", NumThreads,
+           kConcurrentReadSize * kConcurrentReadCycles / MB);
+
+    uint8_t data[kConcurrentReadChunk];
+    memset(data, kMagicByte, sizeof(data));
+    ConcurrentReader readers[NumThreads];
+    for (size_t i = 0; i < NumThreads; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), MOUNT_POINT "/reader-%zu", i);
+        readers[i].fd = open(path, O_CREAT | O_RDWR, 0644);
+        readers[i].ok = true;
+        ASSERT_GT(readers[i].fd, 0, "Cannot create file");
+        for (size_t off = 0; off < kConcurrentReadSize; off += sizeof(data)) {
+            ASSERT_EQ(write(readers[i].fd, data, sizeof(data)), sizeof(data));
+        }
+    }
+    ASSERT_EQ(syncfs(readers[0].fd), 0);
+
+    thrd_t threads[NumThreads];
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < NumThreads; i++) {
+        ASSERT_EQ(thrd_create(&threads[i], concurrent_read_thread, &readers[i]), thrd_success);
+    }
+    for (size_t i = 0; i < NumThreads; i++) {
+        ASSERT_EQ(thrd_join(threads[i], nullptr), thrd_success);
+    }
+    time_end("read", start);
+
+    for (size_t i = 0; i < NumThreads; i++) {
+        ASSERT_TRUE(readers[i].ok, "Read failure");
+        ASSERT_EQ(close(readers[i].fd), 0);
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), MOUNT_POINT "/reader-%zu", i);
+        ASSERT_EQ(unlink(path), 0);
+    }
+
+    int fd = open(MOUNT_POINT, O_DIRECTORY | O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(syncfs(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
+constexpr size_t kAppendSize = 32 * MB;
+constexpr size_t kMapSize = 32 * MB;
+
+// Grows a file by many small writes, which on memfs measures how often its
+// VMO has to be resized.
+template <size_t WriteSize>
+bool benchmark_append(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Append (%lu MB in %lu byte writes)\n", kAppendSize / MB, WriteSize);
+    int fd = open(MOUNT_POINT "/appendfile", O_CREAT | O_RDWR | O_APPEND, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+
+    uint8_t data[WriteSize];
+    memset(data, kMagicByte, sizeof(data));
+    uint64_t start = zx_ticks_get();
+    for (size_t off = 0; off < kAppendSize; off += sizeof(data)) {
+        ASSERT_EQ(write(fd, data, sizeof(data)), sizeof(data));
+    }
+    time_end("append", start);
+
+    ASSERT_EQ(syncfs(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(MOUNT_POINT "/appendfile"), 0);
+    END_TEST;
+}
+
+// Reads a file through a mapping of the VMO its server hands out, against
+// reading it through the channel. Filesystems which can't map files, memfs
+// being the main one which can, are skipped.
+bool benchmark_mmap_read(void) {
+    BEGIN_TEST;
+    int fd = open(MOUNT_POINT "/mapfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file");
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kMapSize]);
+    ASSERT_EQ(ac.check(), true);
+    memset(data.get(), kMagicByte, kMapSize);
+    ASSERT_EQ(write(fd, data.get(), kMapSize), kMapSize);
+
+    void* addr = mmap(nullptr, kMapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr != MAP_FAILED) {
+        printf("\nBenchmarking Mapped read (%lu MB)\n", kMapSize / MB);
+        uint64_t start = zx_ticks_get();
+        ASSERT_EQ(pread(fd, data.get(), kMapSize, 0), kMapSize);
+        time_end("read", start);
+
+        start = zx_ticks_get();
+        memcpy(data.get(), addr, kMapSize);
+        time_end("mapped read", start);
+        ASSERT_EQ(data[kMapSize - 1], kMagicByte);
+        ASSERT_EQ(munmap(addr, kMapSize), 0);
+    }
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(MOUNT_POINT "/mapfile"), 0);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(basic_benchmarks)
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 1024>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 2048>))
@@ -212,4 +385,12 @@ RUN_TEST_PERFORMANCE((benchmark_path_walk<125>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<250>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<500>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<1000>))
+RUN_TEST_PERFORMANCE((benchmark_wide_directory<1000>))
+RUN_TEST_PERFORMANCE((benchmark_wide_directory<10000>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_read<1>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_read<2>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_read<4>))
+RUN_TEST_PERFORMANCE((benchmark_append<512>))
+RUN_TEST_PERFORMANCE((benchmark_append<8 * KB>))
+RUN_TEST_PERFORMANCE(benchmark_mmap_read)
 END_TEST_CASE(basic_benchmarks)
@@ -0,0 +1,416 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+#include <zircon/device/vfs.h>
+#include <zircon/syscalls.h>
+
+// A suite in the spirit of fio: sequential, random and mixed IO at several
+// block sizes and queue depths, fsync latency, and storms of metadata
+// operations. Each benchmark prints a summary for people, and a line starting
+// with "FSBENCH " holding a JSON object for tools tracking results across
+// builds.
+//
+// fdio IO is synchronous, so a queue depth of N is N threads, each with a file
+// descriptor of its own, issuing operations at once.
+
+#define MOUNT_POINT "/benchmark"
+
+namespace {
+
+constexpr size_t KB = (1 << 10);
+constexpr size_t MB = (1 << 20);
+
+// The file the IO benchmarks run against, and how much each moves.
+constexpr size_t kFileSize = 16 * MB;
+// Of the operations of the mixed benchmark, how many in a hundred are reads.
+constexpr unsigned kMixedReadPercent = 70;
+constexpr size_t kFsyncOps = 256;
+
+enum class Pattern {
+    kSeqRead,
+    kSeqWrite,
+    kRandRead,
+    kRandWrite,
+    kMixed,
+};
+
+const char* PatternName(Pattern pattern) {
+    switch (pattern) {
+    case Pattern::kSeqRead:
+        return "seq-read";
+    case Pattern::kSeqWrite:
+        return "seq-write";
+    case Pattern::kRandRead:
+        return "rand-read";
+    case Pattern::kRandWrite:
+        return "rand-write";
+    case Pattern::kMixed:
+        return "mixed";
+    }
+    return "unknown";
+}
+
+// The name of the filesystem mounted at MOUNT_POINT, or "unknown".
+void GetFsName(char* out, size_t len) {
+    snprintf(out, len, "unknown");
+    int fd = open(MOUNT_POINT, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return;
+    }
+    char buf[sizeof(vfs_query_info_t) + MAX_FS_NAME_LEN + 1];
+    vfs_query_info_t* info = reinterpret_cast<vfs_query_info_t*>(buf);
+    ssize_t r = ioctl_vfs_query_fs(fd, info, sizeof(buf) - 1);
+    close(fd);
+    if (r > static_cast<ssize_t>(sizeof(vfs_query_info_t))) {
+        buf[r] = '\0';
+        snprintf(out, len, "%s", reinterpret_cast<const char*>(info + 1));
+    }
+}
+
+bool IsBlobstore() {
+    char name[MAX_FS_NAME_LEN + 1];
+    GetFsName(name, sizeof(name));
+    return strcmp(name, "blobstore") == 0;
+}
+
+int CompareTicks(const void* a, const void* b) {
+    uint64_t x = *static_cast<const uint64_t*>(a);
+    uint64_t y = *static_cast<const uint64_t*>(b);
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+// The latency of each operation of a benchmark, added to from any thread.
+class Latencies {
+public:
+    bool Init(size_t capacity) {
+        fbl::AllocChecker ac;
+        samples_.reset(new (&ac) uint64_t[capacity]);
+        capacity_ = capacity;
+        count_.store(0);
+        return ac.check();
+    }
+
+    void Add(uint64_t ticks) {
+        size_t i = count_.fetch_add(1);
+        if (i < capacity_) {
+            samples_[i] = ticks;
+        }
+    }
+
+    // Prints the percentiles of the latencies, and the throughput of the
+    // |bytes| moved in |elapsed| ticks.
+    void Report(const char* name, size_t bytes, uint64_t elapsed) {
+        size_t count = fbl::min(count_.load(), capacity_);
+        qsort(samples_.get(), count, sizeof(uint64_t), CompareTicks);
+        const double ns_per_tick = 1e9 / static_cast<double>(zx_ticks_per_second());
+        double p50 = Percentile(count, 50.0) * ns_per_tick / 1000;
+        double p99 = Percentile(count, 99.0) * ns_per_tick / 1000;
+        double p999 = Percentile(count, 99.9) * ns_per_tick / 1000;
+        double secs = static_cast<double>(elapsed) * ns_per_tick / 1e9;
+        double mb_per_sec = (secs > 0) ? static_cast<double>(bytes) / MB / secs : 0;
+        double ops_per_sec = (secs > 0) ? static_cast<double>(count) / secs : 0;
+
+        char fs[MAX_FS_NAME_LEN + 1];
+        GetFsName(fs, sizeof(fs));
+        printf("Benchmark %s: %zu ops, %.1f ops/s, %.2f MB/s, "
+               "p50 %.1f us, p99 %.1f us, p99.9 %.1f us\n",
+               name, count, ops_per_sec, mb_per_sec, p50, p99, p999);
+        printf("FSBENCH {\"fs\":\"%s\",\"name\":\"%s\",\"ops\":%zu,\"bytes\":%zu,"
+               "\"ops_per_sec\":%.1f,\"mb_per_sec\":%.2f,"
+               "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f}\n",
+               fs, name, count, bytes, ops_per_sec, mb_per_sec, p50, p99, p999);
+    }
+
+private:
+    double Percentile(size_t count, double p) const {
+        if (count == 0) {
+            return 0;
+        }
+        size_t i = static_cast<size_t>(p / 100.0 * static_cast<double>(count));
+        return static_cast<double>(samples_[fbl::min(i, count - 1)]);
+    }
+
+    fbl::unique_ptr<uint64_t[]> samples_;
+    size_t capacity_ = 0;
+    fbl::atomic<size_t> count_{0};
+};
+
+// Creates a file of |size| bytes, filled with random data, and returns its
+// path. On blobstore, the name of the file is the merkle root of that data.
+bool CreateFile(const char* name, size_t size, char* path, size_t path_len) {
+    BEGIN_HELPER;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[size]);
+    ASSERT_TRUE(ac.check());
+    static unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<uint8_t>(rand_r(&seed));
+    }
+
+    if (IsBlobstore()) {
+        size_t tree_len = digest::MerkleTree::GetTreeLength(size);
+        fbl::unique_ptr<uint8_t[]> tree;
+        if (tree_len != 0) {
+            tree.reset(new (&ac) uint8_t[tree_len]);
+            ASSERT_TRUE(ac.check());
+        }
+        digest::Digest digest;
+        ASSERT_EQ(digest::MerkleTree::Create(data.get(), size, tree.get(), tree_len, &digest),
+                  ZX_OK);
+        int n = snprintf(path, path_len, MOUNT_POINT "/");
+        ASSERT_EQ(digest.ToString(path + n, path_len - n), ZX_OK);
+    } else {
+        snprintf(path, path_len, MOUNT_POINT "/%s", name);
+    }
+
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    ASSERT_GE(fd, 0, "Cannot create file (FS benchmarks assume mounted FS exists at '/benchmark')");
+    ASSERT_EQ(ftruncate(fd, size), 0);
+    for (size_t off = 0; off < size; off += 64 * KB) {
+        size_t len = fbl::min(size - off, 64 * KB);
+        ASSERT_EQ(write(fd, data.get() + off, len), static_cast<ssize_t>(len));
+    }
+    ASSERT_EQ(close(fd), 0);
+    END_HELPER;
+}
+
+struct IoWorker {
+    const char* path;
+    Pattern pattern;
+    size_t block_size;
+    // The part of the file this worker reads or writes sequentially.
+    size_t start;
+    size_t len;
+    Latencies* latencies;
+    unsigned int seed;
+    bool ok;
+};
+
+int IoThread(void* arg) {
+    IoWorker* worker = static_cast<IoWorker*>(arg);
+    worker->ok = false;
+    const bool writes = (worker->pattern != Pattern::kSeqRead) &&
+                        (worker->pattern != Pattern::kRandRead);
+    int fd = open(worker->path, writes ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[worker->block_size]);
+    if (!ac.check()) {
+        close(fd);
+        return -1;
+    }
+    memset(buf.get(), 0xee, worker->block_size);
+
+    const size_t blocks = kFileSize / worker->block_size;
+    const size_t ops = worker->len / worker->block_size;
+    for (size_t i = 0; i < ops; i++) {
+        size_t off;
+        bool read_op;
+        switch (worker->pattern) {
+        case Pattern::kSeqRead:
+        case Pattern::kSeqWrite:
+            off = worker->start + i * worker->block_size;
+            read_op = (worker->pattern == Pattern::kSeqRead);
+            break;
+        default:
+            off = (rand_r(&worker->seed) % blocks) * worker->block_size;
+            read_op = (worker->pattern == Pattern::kRandRead) ||
+                      ((worker->pattern == Pattern::kMixed) &&
+                       (rand_r(&worker->seed) % 100u < kMixedReadPercent));
+            break;
+        }
+        uint64_t start = zx_ticks_get();
+        ssize_t r = read_op ? pread(fd, buf.get(), worker->block_size, off)
+                            : pwrite(fd, buf.get(), worker->block_size, off);
+        worker->latencies->Add(zx_ticks_get() - start);
+        if (r != static_cast<ssize_t>(worker->block_size)) {
+            close(fd);
+            return -1;
+        }
+    }
+    worker->ok = (close(fd) == 0);
+    return 0;
+}
+
+// Moves kFileSize bytes in |BlockSize| chunks, split between |Depth| threads.
+template <Pattern P, size_t BlockSize, size_t Depth>
+bool benchmark_io(void) {
+    BEGIN_TEST;
+    static_assert(kFileSize % (BlockSize * Depth) == 0, "Each thread needs whole blocks");
+    char name[64];
+    snprintf(name, sizeof(name), "%s-%zuk-qd%zu", PatternName(P), BlockSize / KB, Depth);
+    printf("\nBenchmarking %s\n", name);
+    if (P != Pattern::kSeqRead && P != Pattern::kRandRead && IsBlobstore()) {
+        printf("Skipped: blobs can't be written once created\n");
+        return true;
+    }
+
+    char path[PATH_MAX];
+    ASSERT_TRUE(CreateFile("iofile", kFileSize, path, sizeof(path)));
+    Latencies latencies;
+    ASSERT_TRUE(latencies.Init(kFileSize / BlockSize));
+
+    IoWorker workers[Depth];
+    thrd_t threads[Depth];
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < Depth; i++) {
+        workers[i].path = path;
+        workers[i].pattern = P;
+        workers[i].block_size = BlockSize;
+        workers[i].len = kFileSize / Depth;
+        workers[i].start = i * workers[i].len;
+        workers[i].latencies = &latencies;
+        workers[i].seed = static_cast<unsigned int>(zx_ticks_get() + i);
+        ASSERT_EQ(thrd_create(&threads[i], IoThread, &workers[i]), thrd_success);
+    }
+    for (size_t i = 0; i < Depth; i++) {
+        ASSERT_EQ(thrd_join(threads[i], nullptr), thrd_success);
+    }
+    uint64_t elapsed = zx_ticks_get() - start;
+    for (size_t i = 0; i < Depth; i++) {
+        ASSERT_TRUE(workers[i].ok, "IO failure");
+    }
+    latencies.Report(name, kFileSize, elapsed);
+
+    ASSERT_EQ(unlink(path), 0);
+    END_TEST;
+}
+
+// Times small writes which are each made durable before the next.
+bool benchmark_fsync(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking fsync (%zu 4k writes)\n", kFsyncOps);
+    if (IsBlobstore()) {
+        printf("Skipped: blobs can't be written once created\n");
+        return true;
+    }
+    int fd = open(MOUNT_POINT "/fsyncfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GE(fd, 0, "Cannot create file");
+    Latencies latencies;
+    ASSERT_TRUE(latencies.Init(kFsyncOps));
+
+    uint8_t buf[4 * KB];
+    memset(buf, 0xee, sizeof(buf));
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < kFsyncOps; i++) {
+        uint64_t op_start = zx_ticks_get();
+        ASSERT_EQ(write(fd, buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+        ASSERT_EQ(fsync(fd), 0);
+        latencies.Add(zx_ticks_get() - op_start);
+    }
+    latencies.Report("fsync-4k", kFsyncOps * sizeof(buf), zx_ticks_get() - start);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(MOUNT_POINT "/fsyncfile"), 0);
+    END_TEST;
+}
+
+// Creates, stats and unlinks |NumFiles| small files in one directory, timing
+// each phase. Blobs are named by their contents, so these are made up front.
+template <size_t NumFiles>
+bool benchmark_metadata(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Metadata storm (%zu files)\n", NumFiles);
+    const bool blobstore = IsBlobstore();
+    constexpr size_t kFileData = 64;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<char[]> paths(new (&ac) char[NumFiles * PATH_MAX]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[NumFiles * kFileData]);
+    ASSERT_TRUE(ac.check());
+    if (!blobstore) {
+        ASSERT_EQ(mkdir(MOUNT_POINT "/storm", 0666), 0);
+    }
+    for (size_t i = 0; i < NumFiles; i++) {
+        char* path = &paths[i * PATH_MAX];
+        uint8_t* contents = &data[i * kFileData];
+        memset(contents, 0xee, kFileData);
+        memcpy(contents, &i, sizeof(i));
+        if (blobstore) {
+            // Blobs this small have no tree past the root.
+            static_assert(kFileData <= digest::MerkleTree::kNodeSize, "Blob needs a tree");
+            digest::Digest digest;
+            ASSERT_EQ(digest::MerkleTree::Create(contents, kFileData, nullptr, 0, &digest),
+                      ZX_OK);
+            int n = snprintf(path, PATH_MAX, MOUNT_POINT "/");
+            ASSERT_EQ(digest.ToString(path + n, PATH_MAX - n), ZX_OK);
+        } else {
+            snprintf(path, PATH_MAX, MOUNT_POINT "/storm/file-%zu", i);
+        }
+    }
+
+    const char* phases[] = { "create", "stat", "unlink" };
+    for (size_t phase = 0; phase < fbl::count_of(phases); phase++) {
+        Latencies latencies;
+        ASSERT_TRUE(latencies.Init(NumFiles));
+        uint64_t start = zx_ticks_get();
+        for (size_t i = 0; i < NumFiles; i++) {
+            const char* path = &paths[i * PATH_MAX];
+            uint64_t op_start = zx_ticks_get();
+            if (phase == 0) {
+                int fd = open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+                ASSERT_GE(fd, 0, "Could not create file");
+                ASSERT_EQ(ftruncate(fd, kFileData), 0);
+                ASSERT_EQ(write(fd, &data[i * kFileData], kFileData),
+                          static_cast<ssize_t>(kFileData));
+                ASSERT_EQ(close(fd), 0);
+            } else if (phase == 1) {
+                struct stat s;
+                ASSERT_EQ(stat(path, &s), 0, "Could not stat file");
+            } else {
+                ASSERT_EQ(unlink(path), 0, "Could not unlink file");
+            }
+            latencies.Add(zx_ticks_get() - op_start);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "metadata-%s-%zu", phases[phase], NumFiles);
+        latencies.Report(name, (phase == 0) ? NumFiles * kFileData : 0,
+                         zx_ticks_get() - start);
+    }
+
+    if (!blobstore) {
+        ASSERT_EQ(rmdir(MOUNT_POINT "/storm"), 0);
+    }
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(suite_benchmarks)
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kSeqWrite, 4 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kSeqWrite, 64 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kSeqRead, 4 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kSeqRead, 64 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kSeqRead, 64 * KB, 4>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kRandRead, 4 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kRandRead, 4 * KB, 4>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kRandRead, 64 * KB, 4>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kRandWrite, 4 * KB, 1>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kRandWrite, 4 * KB, 4>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kMixed, 4 * KB, 4>))
+RUN_TEST_PERFORMANCE((benchmark_io<Pattern::kMixed, 64 * KB, 4>))
+RUN_TEST_PERFORMANCE(benchmark_fsync)
+RUN_TEST_PERFORMANCE((benchmark_metadata<1000>))
+RUN_TEST_PERFORMANCE((benchmark_metadata<5000>))
+END_TEST_CASE(suite_benchmarks)
@@ -15,10 +15,13 @@ MODULE_NAME := fs-bench-test
 MODULE_SRCS := \
     $(LOCAL_DIR)/main.cpp \
     $(LOCAL_DIR)/bench-basic.cpp \
+    $(LOCAL_DIR)/bench-suite.cpp \
 
 MODULE_STATIC_LIBS := \
+    system/ulib/digest \
     system/ulib/zxcpp \
     system/ulib/fbl \
+    third_party/ulib/uboringssl \
 
 MODULE_LIBS := \
     system/ulib/c \
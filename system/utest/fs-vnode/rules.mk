@@ -23,6 +23,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/fs \
     system/ulib/async \
     system/ulib/async.loop \
+    system/ulib/sync \
     system/ulib/trace \
     system/ulib/vmofs \
     system/ulib/zx \
@@ -356,7 +356,7 @@ fs_info_t FILESYSTEMS[NUM_FILESYSTEMS] = {
         .supports_hardlinks = true,
         .supports_watchers = true,
         .supports_create_by_vmo = false,
-        .supports_mmap = false,
+        .supports_mmap = true,
         .supports_resize = true,
         .nsec_granularity = 1,
     },
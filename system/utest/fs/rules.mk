@@ -55,6 +55,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/fs \
     system/ulib/gpt \
     system/ulib/digest \
+    system/ulib/sync \
     system/ulib/trace \
     system/ulib/zxcpp \
     system/ulib/fbl \
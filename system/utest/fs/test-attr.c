@@ -13,6 +13,7 @@
 #include <sys/time.h>
 
 #include <zircon/syscalls.h>
+#include <fdio/io.h>
 #include <fdio/vfs.h>
 
 #include "filesystems.h"
@@ -163,8 +164,47 @@ bool test_parent_directory_time(void) {
     END_TEST;
 }
 
+bool test_attr_cache(void) {
+    BEGIN_TEST;
+
+    ASSERT_EQ(mkdir("::dir", 0666), 0, "");
+    fdio_set_attr_cache(ZX_SEC(60));
+
+    // Missing files are cached, until they are created
+    struct stat statb;
+    ASSERT_EQ(stat("::dir/file", &statb), -1, "");
+    ASSERT_EQ(stat("::dir/file", &statb), -1, "");
+    int fd = open("::dir/file", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(stat("::dir/file", &statb), 0, "");
+    ASSERT_EQ(statb.st_size, 0, "");
+
+    // Writes and truncation are seen despite the lease
+    char buf[16] = {'a'};
+    ASSERT_EQ(write(fd, buf, sizeof(buf)), (ssize_t)sizeof(buf), "");
+    ASSERT_EQ(stat("::dir/file", &statb), 0, "");
+    ASSERT_EQ(statb.st_size, (off_t)sizeof(buf), "");
+    ASSERT_EQ(ftruncate(fd, 1), 0, "");
+    ASSERT_EQ(stat("::dir/file", &statb), 0, "");
+    ASSERT_EQ(statb.st_size, 1, "");
+    ASSERT_EQ(close(fd), 0, "");
+
+    // As are renames and unlinks
+    ASSERT_EQ(rename("::dir/file", "::dir/other"), 0, "");
+    ASSERT_EQ(stat("::dir/file", &statb), -1, "");
+    ASSERT_EQ(stat("::dir/other", &statb), 0, "");
+    ASSERT_EQ(unlink("::dir/other"), 0, "");
+    ASSERT_EQ(stat("::dir/other", &statb), -1, "");
+
+    fdio_set_attr_cache(0);
+    ASSERT_EQ(rmdir("::dir"), 0, "");
+
+    END_TEST;
+}
+
 RUN_FOR_ALL_FILESYSTEMS(attr_tests,
     RUN_TEST_MEDIUM(test_attr)
     RUN_TEST_MEDIUM(test_blksize)
     RUN_TEST_MEDIUM(test_parent_directory_time)
+    RUN_TEST_MEDIUM(test_attr_cache)
 )
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -44,6 +45,17 @@ bool test_basic(void) {
     ASSERT_EQ(read(fd1, tmp, 14), -1, "");
     ASSERT_EQ(close(fd1), -1, "");
 
+    // pipelined path-only opens still learn why the open failed, on first use
+    struct stat st;
+    fd1 = open("::alpha/bravo/charlie/delta/echo/foxtrot", O_PATH | O_PIPELINE);
+    ASSERT_GT(fd1, 0, "");
+    ASSERT_EQ(fstat(fd1, &st), 0, "");
+    ASSERT_EQ(st.st_size, 14, "");
+    ASSERT_EQ(close(fd1), 0, "");
+    ASSERT_EQ(stat("::alpha/bravo/charlie/delta/echo/foxtrot", &st), 0, "");
+    ASSERT_EQ(stat("::alpha/banana", &st), -1, "");
+    ASSERT_EQ(errno, ENOENT, "");
+
     fd1 = open("::file.txt", O_CREAT | O_RDWR, 0644);
     ASSERT_GT(fd1, 0, "");
     ASSERT_EQ(close(fd1), 0, "");
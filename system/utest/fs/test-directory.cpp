@@ -14,6 +14,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <fdio/io.h>
 #include <zircon/compiler.h>
 
 #include "filesystems.h"
@@ -302,6 +303,54 @@ bool test_directory_readdir(void) {
     END_TEST;
 }
 
+// Checks readdir() with attributes agrees with stat(), over more entries than
+// one read from the filesystem returns.
+bool test_directory_readdir_attr(void) {
+    BEGIN_TEST;
+
+    const size_t kNumFiles = 64;
+    char path[PATH_MAX];
+    char buf[kNumFiles];
+    memset(buf, 'a', sizeof(buf));
+    ASSERT_EQ(mkdir("::a", 0755), 0, "");
+    ASSERT_EQ(mkdir("::a/dir", 0755), 0, "");
+    for (size_t i = 0; i < kNumFiles; i++) {
+        snprintf(path, sizeof(path), "::a/file%05zu", i);
+        int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(write(fd, buf, i), static_cast<ssize_t>(i), "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+
+    DIR* dir = opendir("::a");
+    ASSERT_NONNULL(dir, "");
+    fdio_dir_read_attrs(dir);
+    struct dirent* de;
+    size_t num_entries = 0;
+    while ((de = readdir(dir)) != NULL) {
+        struct stat fast, slow;
+        ASSERT_EQ(fdio_dirent_stat(dir, de, &fast), 0, "");
+        ASSERT_EQ(fstatat(dirfd(dir), de->d_name, &slow, 0), 0, "");
+        EXPECT_EQ(fast.st_mode, slow.st_mode, de->d_name);
+        EXPECT_EQ(fast.st_ino, slow.st_ino, de->d_name);
+        EXPECT_EQ(fast.st_size, slow.st_size, de->d_name);
+        EXPECT_EQ(fast.st_nlink, slow.st_nlink, de->d_name);
+        num_entries++;
+    }
+    // Along with "." and "dir"
+    ASSERT_EQ(num_entries, kNumFiles + 2, "");
+    ASSERT_EQ(closedir(dir), 0, "");
+
+    for (size_t i = 0; i < kNumFiles; i++) {
+        snprintf(path, sizeof(path), "::a/file%05zu", i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    ASSERT_EQ(rmdir("::a/dir"), 0, "");
+    ASSERT_EQ(rmdir("::a"), 0, "");
+
+    END_TEST;
+}
+
 // Create a directory named "::dir" with entries "00000", "00001" ... up to
 // num_entries.
 bool large_dir_setup(size_t num_entries) {
@@ -459,6 +508,7 @@ RUN_FOR_ALL_FILESYSTEMS(directory_tests,
     RUN_TEST_LARGE(test_directory_large)
     RUN_TEST_MEDIUM(test_directory_trailing_slash)
     RUN_TEST_MEDIUM(test_directory_readdir)
+    RUN_TEST_MEDIUM(test_directory_readdir_attr)
     RUN_TEST_LARGE(test_directory_readdir_rm_all)
     RUN_TEST_MEDIUM(test_directory_rewind)
     RUN_TEST_MEDIUM(test_directory_after_rmdir)
@@ -7,8 +7,11 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <fdio/vfs.h>
 #include <minfs/format.h>
 #include <unittest/unittest.h>
 #include <zircon/device/vfs.h>
@@ -64,9 +67,165 @@ bool TestQueryInfo(void) {
     END_TEST;
 }
 
+// Writes every other block first, so that the file needs more extents than
+// fit in the inode, then fills in the holes so they merge again.
+bool TestFragmentedExtents(void) {
+    BEGIN_TEST;
+
+    constexpr size_t kBlocks = 64;
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/fragmented", MOUNT_PATH);
+    int fd = open(path, O_CREAT | O_RDWR);
+    ASSERT_GT(fd, 0, "Failed to create file");
+
+    char buf[minfs::kMinfsBlockSize];
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (size_t i = pass; i < kBlocks; i += 2) {
+            memset(buf, static_cast<int>(i + 1), sizeof(buf));
+            ASSERT_EQ(pwrite(fd, buf, sizeof(buf), i * sizeof(buf)),
+                      static_cast<ssize_t>(sizeof(buf)));
+        }
+    }
+    ASSERT_EQ(close(fd), 0);
+
+    fd = open(path, O_RDWR);
+    ASSERT_GT(fd, 0, "Failed to reopen file");
+    ASSERT_EQ(ftruncate(fd, (kBlocks / 2) * sizeof(buf) + 1), 0);
+    for (size_t i = 0; i <= kBlocks / 2; i++) {
+        size_t len = i < kBlocks / 2 ? sizeof(buf) : 1;
+        ASSERT_EQ(pread(fd, buf, len, i * sizeof(buf)), static_cast<ssize_t>(len));
+        for (size_t j = 0; j < len; j++) {
+            ASSERT_EQ(buf[j], static_cast<char>(i + 1));
+        }
+    }
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(path), 0);
+    END_TEST;
+}
+
+// Reads a file sequentially and checks that every block read shows up in the
+// cache counters, whether or not readahead got to it first.
+bool TestSequentialRead(void) {
+    BEGIN_TEST;
+
+    constexpr size_t kBlocks = 64;
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/sequential", MOUNT_PATH);
+    int fd = open(path, O_CREAT | O_RDWR);
+    ASSERT_GT(fd, 0, "Failed to create file");
+    char buf[minfs::kMinfsBlockSize];
+    for (size_t i = 0; i < kBlocks; i++) {
+        memset(buf, static_cast<int>(i + 1), sizeof(buf));
+        ASSERT_EQ(write(fd, buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+    }
+    ASSERT_EQ(close(fd), 0);
+
+    fd = open(path, O_RDWR);
+    ASSERT_GT(fd, 0, "Failed to reopen file");
+    vfs_cache_info_t before;
+    ASSERT_EQ(ioctl_vfs_query_cache(fd, &before), static_cast<ssize_t>(sizeof(before)));
+    for (size_t i = 0; i < kBlocks; i++) {
+        ASSERT_EQ(read(fd, buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+        ASSERT_EQ(buf[0], static_cast<char>(i + 1));
+        ASSERT_EQ(buf[sizeof(buf) - 1], static_cast<char>(i + 1));
+    }
+    vfs_cache_info_t after;
+    ASSERT_EQ(ioctl_vfs_query_cache(fd, &after), static_cast<ssize_t>(sizeof(after)));
+    ASSERT_EQ((after.hits - before.hits) + (after.misses - before.misses), kBlocks);
+    ASSERT_GE(after.readahead, before.readahead);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(path), 0);
+    END_TEST;
+}
+
+// Closes a file and opens it again, and checks that it picks up what it had
+// cached before, contents included, rather than starting from disk.
+bool TestVnodeCache(void) {
+    BEGIN_TEST;
+
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/vnode-cache", MOUNT_PATH);
+    int dirfd = open(MOUNT_PATH, O_RDONLY | O_DIRECTORY);
+    ASSERT_GT(dirfd, 0);
+
+    char buf[minfs::kMinfsBlockSize];
+    for (int i = 1; i <= 3; i++) {
+        int fd = open(path, O_CREAT | O_RDWR);
+        ASSERT_GT(fd, 0);
+        if (i > 1) {
+            ASSERT_EQ(read(fd, buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+            ASSERT_EQ(buf[0], static_cast<char>(i - 1));
+            ASSERT_EQ(buf[sizeof(buf) - 1], static_cast<char>(i - 1));
+        }
+        memset(buf, i, sizeof(buf));
+        ASSERT_EQ(pwrite(fd, buf, sizeof(buf), 0), static_cast<ssize_t>(sizeof(buf)));
+        // Writeback holds on to the vnode until it is done.
+        ASSERT_EQ(fsync(fd), 0);
+        ASSERT_EQ(close(fd), 0);
+    }
+
+    vfs_cache_info_t before;
+    ASSERT_EQ(ioctl_vfs_query_cache(dirfd, &before), static_cast<ssize_t>(sizeof(before)));
+    int fd = open(path, O_RDWR);
+    ASSERT_GT(fd, 0);
+    vfs_cache_info_t after;
+    ASSERT_EQ(ioctl_vfs_query_cache(dirfd, &after), static_cast<ssize_t>(sizeof(after)));
+    // The old vnode may not be gone yet, in which case it is simply reused.
+    ASSERT_LE(after.vnode_hits, before.vnode_hits + 1);
+    ASSERT_EQ(after.vnode_misses, before.vnode_misses, "Reopened file started from disk");
+    ASSERT_EQ(read(fd, buf, sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+    ASSERT_EQ(buf[0], 3);
+    ASSERT_EQ(close(fd), 0);
+
+    ASSERT_EQ(unlink(path), 0);
+    ASSERT_EQ(close(dirfd), 0);
+    END_TEST;
+}
+
+// Writes a file's blocks out of order, in pieces, and checks that they are
+// all allocated and hold what was written once the file is synced.
+bool TestDelayedAllocation(void) {
+    BEGIN_TEST;
+
+    constexpr size_t kBlocks = 32;
+    constexpr size_t kPiece = minfs::kMinfsBlockSize / 4;
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/delayed", MOUNT_PATH);
+    int fd = open(path, O_CREAT | O_RDWR);
+    ASSERT_GT(fd, 0, "Failed to create file");
+    char buf[minfs::kMinfsBlockSize];
+    for (size_t i = kBlocks; i-- > 0;) {
+        memset(buf, static_cast<int>(i + 1), sizeof(buf));
+        for (size_t off = 0; off < sizeof(buf); off += kPiece) {
+            ASSERT_EQ(pwrite(fd, buf + off, kPiece, i * sizeof(buf) + off),
+                      static_cast<ssize_t>(kPiece));
+        }
+    }
+    ASSERT_EQ(fsync(fd), 0);
+
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0);
+    ASSERT_EQ(st.st_size, static_cast<off_t>(kBlocks * sizeof(buf)));
+    ASSERT_EQ(st.st_blocks, static_cast<blkcnt_t>(kBlocks * sizeof(buf) / VNATTR_BLKSIZE));
+    for (size_t i = 0; i < kBlocks; i++) {
+        ASSERT_EQ(pread(fd, buf, sizeof(buf), i * sizeof(buf)), static_cast<ssize_t>(sizeof(buf)));
+        ASSERT_EQ(buf[0], static_cast<char>(i + 1));
+        ASSERT_EQ(buf[sizeof(buf) - 1], static_cast<char>(i + 1));
+    }
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(path), 0);
+    END_TEST;
+}
+
 #define RUN_MINFS_TESTS(name, CASE_TESTS) \
     FS_TEST_CASE(name, DEFAULT_DISK_SIZE, CASE_TESTS, FS_TEST_FVM, minfs, 1)
 
 RUN_MINFS_TESTS(FsMinfsTestsFvm,
     RUN_TEST_MEDIUM(TestQueryInfo)
+    RUN_TEST_MEDIUM(TestFragmentedExtents)
+    RUN_TEST_MEDIUM(TestSequentialRead)
+    RUN_TEST_MEDIUM(TestVnodeCache)
+    RUN_TEST_MEDIUM(TestDelayedAllocation)
 )
@@ -17,6 +17,7 @@
 #include <unittest/unittest.h>
 
 #include "filesystems.h"
+#include "misc.h"
 
 // Certain filesystems delay creation of internal structures
 // until the file is initially accessed. Test that we can
@@ -227,6 +228,46 @@ bool test_mmap_shared(void) {
     END_TEST;
 }
 
+// Test that writes through a shared mapping reach the disk once the file is
+// synced, and once it is closed.
+bool test_mmap_shared_persist(void) {
+    BEGIN_TEST;
+    if (!test_info->supports_mmap || !test_info->can_be_mounted) {
+        return true;
+    }
+
+    constexpr char kFilename[] = "::mmap_shared_persist";
+    int fd = open(kFilename, O_RDWR | O_CREAT | O_EXCL);
+    ASSERT_GT(fd, 0);
+    // Spans several blocks, all of them holes until the mapping writes to some.
+    constexpr size_t kSize = PAGE_SIZE * 8;
+    ASSERT_EQ(ftruncate(fd, kSize), 0);
+    void* addr = mmap(NULL, kSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+
+    char tmp1[] = "written through the mapping, then synced";
+    char tmp2[] = "written through the mapping, then closed";
+    char* caddr = static_cast<char*>(addr);
+    memcpy(caddr + kSize / 2, tmp1, sizeof(tmp1));
+    ASSERT_EQ(fsync(fd), 0);
+    memcpy(caddr + kSize - sizeof(tmp2), tmp2, sizeof(tmp2));
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(munmap(addr, kSize), 0, "munmap failed");
+
+    ASSERT_TRUE(check_remount(), "Could not remount filesystem");
+    fd = open(kFilename, O_RDONLY);
+    ASSERT_GT(fd, 0);
+    char buf[sizeof(tmp1)];
+    ASSERT_EQ(pread(fd, buf, sizeof(tmp1), kSize / 2), sizeof(tmp1));
+    ASSERT_EQ(memcmp(buf, tmp1, sizeof(tmp1)), 0);
+    ASSERT_EQ(pread(fd, buf, sizeof(tmp2), kSize - sizeof(tmp2)), sizeof(tmp2));
+    ASSERT_EQ(memcmp(buf, tmp2, sizeof(tmp2)), 0);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(kFilename), 0);
+
+    END_TEST;
+}
+
 // Test that MAP_PRIVATE keeps all copies of the buffer
 // separate
 bool test_mmap_private(void) {
@@ -445,6 +486,7 @@ RUN_FOR_ALL_FILESYSTEMS(fs_mmap_tests,
     RUN_TEST_MEDIUM(test_mmap_writable)
     RUN_TEST_MEDIUM(test_mmap_unlinked)
     RUN_TEST_MEDIUM(test_mmap_shared)
+    RUN_TEST_MEDIUM(test_mmap_shared_persist)
     RUN_TEST_MEDIUM(test_mmap_private)
     RUN_TEST_MEDIUM(test_mmap_evil)
     RUN_TEST_ENABLE_CRASH_HANDLER(test_mmap_death)
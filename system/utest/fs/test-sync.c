@@ -5,9 +5,12 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <fdio/io.h>
+
 #include "filesystems.h"
 #include "misc.h"
 
@@ -39,6 +42,61 @@ bool test_sync(void) {
     END_TEST;
 }
 
+bool test_write_behind(void) {
+    BEGIN_TEST;
+
+    const size_t kChunk = 8192;
+    const size_t kChunks = 64;
+    char* buf = malloc(kChunk * kChunks);
+    char* out = malloc(kChunk * kChunks);
+    ASSERT_NONNULL(buf, "");
+    ASSERT_NONNULL(out, "");
+    for (size_t i = 0; i < kChunk * kChunks; i++) {
+        buf[i] = (char)(i * 13 + i / kChunk);
+    }
+
+    int fd = open("::alpha", O_RDWR | O_CREAT | O_EXCL, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(fdio_set_write_behind(fd, FDIO_MAX_WRITE_BEHIND + 1), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(fdio_set_write_behind(fd, 8), ZX_OK, "");
+
+    // Writes in flight stay in order with each other and with what follows.
+    for (size_t i = 0; i < kChunks; i++) {
+        ASSERT_EQ(write(fd, buf + i * kChunk, kChunk), (ssize_t)kChunk, "");
+    }
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), (off_t)(kChunk * kChunks), "");
+    ASSERT_EQ(pwrite(fd, buf, kChunk, 0), (ssize_t)kChunk, "");
+    ASSERT_EQ(pread(fd, out, kChunk * kChunks, 0), (ssize_t)(kChunk * kChunks), "");
+    ASSERT_EQ(memcmp(buf, out, kChunk * kChunks), 0, "");
+    ASSERT_EQ(fsync(fd), 0, "");
+    ASSERT_EQ(fdio_set_write_behind(fd, 0), ZX_OK, "");
+    ASSERT_STREAM_ALL(write, fd, "Hello, World!\n", 14);
+    ASSERT_EQ(close(fd), 0, "");
+
+    // A write refused by the server returns, and fails the next fsync, once.
+    fd = open("::alpha", O_RDONLY, 0644);
+    ASSERT_GT(fd, 0, "");
+    ASSERT_EQ(fdio_set_write_behind(fd, 4), ZX_OK, "");
+    ASSERT_EQ(write(fd, buf, kChunk), (ssize_t)kChunk, "");
+    ASSERT_EQ(fsync(fd), -1, "");
+    ASSERT_EQ(fsync(fd), 0, "");
+
+    // ... or the next write, which must wait for the reply to the one before.
+    ASSERT_EQ(fdio_set_write_behind(fd, 1), ZX_OK, "");
+    ASSERT_EQ(write(fd, buf, kChunk), (ssize_t)kChunk, "");
+    ASSERT_EQ(write(fd, buf, kChunk), -1, "");
+
+    // ... or close.
+    ASSERT_EQ(write(fd, buf, kChunk), (ssize_t)kChunk, "");
+    ASSERT_EQ(close(fd), -1, "");
+    ASSERT_EQ(unlink("::alpha"), 0, "");
+
+    free(buf);
+    free(out);
+    END_TEST;
+}
+
 RUN_FOR_ALL_FILESYSTEMS(sync_tests,
     RUN_TEST_MEDIUM(test_sync)
+    RUN_TEST_MEDIUM(test_write_behind)
 )
@@ -5,6 +5,7 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include <hid-parser/decoder.h>
 #include <hid-parser/item.h>
 #include <hid-parser/parser.h>
 #include <hid-parser/usages.h>
@@ -570,12 +571,93 @@ static bool parse_acer12_touch() {
     END_TEST;
 }
 
+static bool decode_boot_mouse() {
+    BEGIN_TEST;
+
+    hid::DeviceDescriptor* dev = nullptr;
+    auto res = hid::ParseReportDescriptor(
+        boot_mouse_r_desc, sizeof(boot_mouse_r_desc), &dev);
+    ASSERT_EQ(res, hid::ParseResult::kParseOk);
+
+    hid::ReportDecoder* dec = nullptr;
+    res = hid::MakeReportDecoder(dev->report[0], hid::kInput, &dec);
+    ASSERT_EQ(res, hid::ParseResult::kParseOk);
+
+    // The padding field is dropped, leaving 3 buttons then X and Y.
+    EXPECT_EQ(dec->report_id, 0);
+    EXPECT_EQ(dec->byte_sz, 3u);
+    ASSERT_EQ(dec->count, 5u);
+    EXPECT_EQ(dec->field[2].bit_offset, 2u);
+    EXPECT_EQ(dec->field[3].bit_offset, 8u);
+    EXPECT_EQ(dec->field[3].usage.usage, hid::usage::GenericDesktop::kX);
+    EXPECT_EQ(dec->field[4].bit_offset, 16u);
+    EXPECT_TRUE(dec->field[4].field == &dev->report[0].first_field[5]);
+
+    // Buttons 1 and 3 down, X = -1, Y = 2.
+    const uint8_t report[] = { 0x05, 0xff, 0x02 };
+    int32_t values[5] = {};
+    ASSERT_TRUE(hid::DecodeReport(*dec, report, sizeof(report), values));
+    EXPECT_EQ(values[0], 1);
+    EXPECT_EQ(values[1], 0);
+    EXPECT_EQ(values[2], 1);
+    EXPECT_EQ(values[3], -1);
+    EXPECT_EQ(values[4], 2);
+
+    // Without a physical range the physical value is the logical one.
+    EXPECT_EQ(hid::ToPhysical(dec->field[3], values[3]), -1);
+
+    // Short reports are rejected.
+    EXPECT_FALSE(hid::DecodeReport(*dec, report, 2, values));
+
+    delete dec;
+    delete dev;
+    END_TEST;
+}
+
+static bool decode_adaf_trinket() {
+    BEGIN_TEST;
+
+    hid::DeviceDescriptor* dev = nullptr;
+    auto res = hid::ParseReportDescriptor(
+        trinket_r_desc, sizeof(trinket_r_desc), &dev);
+    ASSERT_EQ(res, hid::ParseResult::kParseOk);
+
+    // The mouse report is the boot mouse behind report id 1.
+    hid::ReportDecoder* dec = nullptr;
+    res = hid::MakeReportDecoder(dev->report[0], hid::kInput, &dec);
+    ASSERT_EQ(res, hid::ParseResult::kParseOk);
+
+    EXPECT_EQ(dec->report_id, 1);
+    EXPECT_EQ(dec->byte_sz, 4u);
+    ASSERT_EQ(dec->count, 5u);
+    EXPECT_EQ(dec->field[0].bit_offset, 8u);
+
+    const uint8_t report[] = { 0x01, 0x02, 0x81, 0x7f };
+    int32_t values[5] = {};
+    ASSERT_TRUE(hid::DecodeReport(*dec, report, sizeof(report), values));
+    EXPECT_EQ(values[0], 0);
+    EXPECT_EQ(values[1], 1);
+    EXPECT_EQ(values[2], 0);
+    EXPECT_EQ(values[3], -127);
+    EXPECT_EQ(values[4], 127);
+
+    // A report with another id does not match.
+    const uint8_t other[] = { 0x02, 0x02, 0x81, 0x7f };
+    EXPECT_FALSE(hid::DecodeReport(*dec, other, sizeof(other), values));
+
+    delete dec;
+    delete dev;
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(hidparser_tests)
 RUN_TEST(itemize_acer12_rpt1)
 RUN_TEST(parse_boot_mouse)
 RUN_TEST(parse_adaf_trinket)
 RUN_TEST(parse_ps3_controller)
 RUN_TEST(parse_acer12_touch)
+RUN_TEST(decode_boot_mouse)
+RUN_TEST(decode_adaf_trinket)
 END_TEST_CASE(hidparser_tests)
 
 int main(int argc, char** argv) {
@@ -654,6 +654,49 @@ static bool decode_test_f6(void) {
     END_TEST;
 }
 
+static bool decode_cached(void) {
+    BEGIN_TEST;
+
+    inst_cache_t cache = {};
+    zx_vcpu_state_t vcpu_state;
+    zx_vcpu_state_t other_state;
+    instruction_t inst;
+
+    // mov %ecx, (%rax)
+    uint8_t mov[] = {0x89, 0b00001000};
+    EXPECT_EQ(inst_decode_cached(&cache, mov, 2, &vcpu_state, &inst), ZX_OK);
+    EXPECT_EQ(inst.type, INST_MOV_WRITE);
+    EXPECT_EQ(inst.reg, &vcpu_state.rcx);
+
+    // A hit refers to the registers of the state it is given.
+    EXPECT_EQ(inst_decode_cached(&cache, mov, 2, &other_state, &inst), ZX_OK);
+    EXPECT_EQ(inst.type, INST_MOV_WRITE);
+    EXPECT_EQ(inst.access_size, 4u);
+    EXPECT_EQ(inst.imm, 0u);
+    EXPECT_EQ(inst.reg, &other_state.rcx);
+    EXPECT_NULL(inst.flags);
+
+    // test 0x1, (%rax)
+    uint8_t test[] = {0xf6, 0, 0x1};
+    EXPECT_EQ(inst_decode_cached(&cache, test, 3, &vcpu_state, &inst), ZX_OK);
+    EXPECT_EQ(inst_decode_cached(&cache, test, 3, &other_state, &inst), ZX_OK);
+    EXPECT_EQ(inst.type, INST_TEST);
+    EXPECT_EQ(inst.imm, 0x1u);
+    EXPECT_NULL(inst.reg);
+    EXPECT_EQ(inst.flags, &other_state.rflags);
+
+    // A prefix of a cached instruction is decoded on its own.
+    EXPECT_EQ(inst_decode_cached(&cache, test, 2, &vcpu_state, &inst), ZX_ERR_OUT_OF_RANGE);
+
+    // Failures are not cached.
+    uint8_t bad_len[] = {0, 0};
+    EXPECT_EQ(inst_decode_cached(&cache, bad_len, 2, &vcpu_state, &inst), ZX_ERR_NOT_SUPPORTED);
+    EXPECT_EQ(inst_decode_cached(&cache, bad_len, 2, &vcpu_state, &inst), ZX_ERR_NOT_SUPPORTED);
+    EXPECT_EQ(inst_decode_cached(&cache, nullptr, 0, nullptr, nullptr), ZX_ERR_BAD_STATE);
+
+    END_TEST;
+}
+
 static bool test_computing_flags(void) {
     BEGIN_TEST;
 
@@ -678,5 +721,6 @@ RUN_TEST(decode_mov_c7)
 RUN_TEST(decode_movz_0f_b6)
 RUN_TEST(decode_movz_0f_b7)
 RUN_TEST(decode_test_f6)
+RUN_TEST(decode_cached)
 RUN_TEST(test_computing_flags)
 END_TEST_CASE(decode)
@@ -367,6 +367,39 @@ static bool guest_set_trap_with_bell(void) {
     END_TEST;
 }
 
+static bool guest_set_trap_with_event(void) {
+    BEGIN_TEST;
+
+    test_t test;
+    ASSERT_TRUE(setup(&test, guest_set_trap_start, guest_set_trap_end));
+    if (!test.supported) {
+        // The hypervisor isn't supported, so don't run the test.
+        return true;
+    }
+
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0, &event), ZX_OK);
+
+    // Signal the event on access of TRAP_ADDR, and keep running the VCPU.
+    ASSERT_EQ(zx_guest_set_trap(test.guest.handle(), ZX_GUEST_TRAP_BELL, TRAP_ADDR, PAGE_SIZE, event,
+                                kTrapKey),
+              ZX_OK);
+
+    zx_port_packet_t packet = {};
+    ASSERT_EQ(zx_vcpu_resume(test.vcpu, &packet), ZX_OK);
+    EXPECT_EQ(packet.type, ZX_PKT_TYPE_GUEST_BELL);
+    EXPECT_EQ(packet.guest_bell.addr, EXIT_TEST_ADDR);
+
+    zx_signals_t observed;
+    EXPECT_EQ(zx_object_wait_one(event, ZX_EVENT_SIGNALED, 0, &observed), ZX_OK);
+    EXPECT_EQ(observed & ZX_EVENT_SIGNALED, ZX_EVENT_SIGNALED);
+
+    EXPECT_EQ(zx_handle_close(event), ZX_OK);
+    ASSERT_TRUE(teardown(&test));
+
+    END_TEST;
+}
+
 static bool guest_set_trap_with_io(void) {
     BEGIN_TEST;
 
@@ -407,6 +440,7 @@ RUN_TEST(vcpu_read_write_state)
 RUN_TEST(vcpu_interrupt)
 RUN_TEST(guest_set_trap_with_mem)
 RUN_TEST(guest_set_trap_with_bell)
+RUN_TEST(guest_set_trap_with_event)
 #if __aarch64__
 RUN_TEST(vcpu_wfi)
 #elif __x86_64__
@@ -125,9 +125,61 @@ static bool argument_size_test(void) {
     return ok;
 }
 
+static bool template_test(void) {
+    BEGIN_TEST;
+
+    launchpad_template_t* tmpl;
+    ASSERT_EQ(launchpad_template_create_from_file("/boot/bin/sh", &tmpl),
+              ZX_OK, "");
+
+    // The second process uses the libraries cached for the first.
+    for (int i = 0; i < 2; ++i) {
+        launchpad_t* lp;
+        ASSERT_EQ(launchpad_create(ZX_HANDLE_INVALID, "template test", &lp),
+                  ZX_OK, "");
+        const char* const argv[] = { "/boot/bin/sh", "-c", "exit 7" };
+        EXPECT_EQ(launchpad_set_args(lp, countof(argv), argv), ZX_OK, "");
+        EXPECT_EQ(launchpad_load_from_template(lp, tmpl), ZX_OK, "");
+
+        zx_handle_t proc = ZX_HANDLE_INVALID;
+        const char* errmsg = "???";
+        ASSERT_EQ(launchpad_go(lp, &proc, &errmsg), ZX_OK, errmsg);
+
+        EXPECT_EQ(zx_object_wait_one(proc, ZX_PROCESS_TERMINATED,
+                                     ZX_TIME_INFINITE, NULL), ZX_OK, "");
+        zx_info_process_t info;
+        EXPECT_EQ(zx_object_get_info(proc, ZX_INFO_PROCESS,
+                                     &info, sizeof(info), NULL, NULL), ZX_OK, "");
+        EXPECT_EQ(zx_handle_close(proc), ZX_OK, "");
+
+        EXPECT_EQ(info.return_code, 7, "shell exit status");
+    }
+
+    launchpad_template_destroy(tmpl);
+
+    END_TEST;
+}
+
+static bool template_script_test(void) {
+    BEGIN_TEST;
+
+    static const char script[] = "#!/boot/bin/sh\n";
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(PAGE_SIZE, 0, &vmo), ZX_OK, "");
+    size_t n;
+    ASSERT_EQ(zx_vmo_write(vmo, script, 0, sizeof(script) - 1, &n), ZX_OK, "");
+
+    launchpad_template_t* tmpl;
+    EXPECT_EQ(launchpad_template_create(vmo, &tmpl), ZX_ERR_NOT_SUPPORTED, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(launchpad_test);
 RUN_TEST(argument_size_test);
+RUN_TEST(template_test);
+RUN_TEST(template_script_test);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv)
@@ -21,6 +21,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/fs \
     system/ulib/async \
     system/ulib/async.loop \
+    system/ulib/sync \
     system/ulib/trace \
     system/ulib/zx \
     system/ulib/zxcpp \
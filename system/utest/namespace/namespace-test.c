@@ -84,8 +84,55 @@ static bool namespace_create_test(void) {
     END_TEST;
 }
 
+static bool namespace_bind_test(void) {
+    BEGIN_TEST;
+
+    fdio_ns_t* ns;
+    ASSERT_EQ(fdio_ns_create(&ns), ZX_OK, "");
+    int fd = open("/tmp", O_RDONLY | O_DIRECTORY);
+    ASSERT_GT(fd, 0, "");
+
+    // A bad segment partway down leaves nothing behind.
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a/b/../c", fd), ZX_ERR_INVALID_ARGS, "");
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a//c", fd), ZX_ERR_INVALID_ARGS, "");
+    fdio_flat_namespace_t* flat;
+    ASSERT_EQ(fdio_ns_export(ns, &flat), ZX_OK, "");
+    ASSERT_EQ(flat->count, 0u, "");
+    free(flat);
+
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a/b/c", fd), ZX_OK, "");
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a/b/d", fd), ZX_OK, "");
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a/b/c", fd), ZX_ERR_ALREADY_EXISTS, "");
+    ASSERT_EQ(fdio_ns_bind_fd(ns, "/a/b", fd), ZX_ERR_ALREADY_EXISTS, "");
+
+    ASSERT_EQ(fdio_ns_export(ns, &flat), ZX_OK, "");
+    ASSERT_EQ(flat->count, 2u, "");
+    ASSERT_EQ(strcmp(flat->path[0], "/a/b/d"), 0, "");
+    ASSERT_EQ(strcmp(flat->path[1], "/a/b/c"), 0, "");
+    for (size_t n = 0; n < flat->count; n++) {
+        zx_handle_close(flat->handle[n]);
+    }
+    free(flat);
+
+    // Paths below a bound remote are handed to it; paths that only
+    // match intermediate nodes are not found.
+    zx_handle_t h0, h1;
+    ASSERT_EQ(zx_channel_create(0, &h0, &h1), ZX_OK, "");
+    ASSERT_EQ(fdio_ns_connect(ns, "/a/b/c/missing", h0), ZX_OK, "");
+    zx_handle_close(h1);
+    ASSERT_EQ(zx_channel_create(0, &h0, &h1), ZX_OK, "");
+    ASSERT_EQ(fdio_ns_connect(ns, "/a/x", h0), ZX_ERR_NOT_FOUND, "");
+    zx_handle_close(h1);
+
+    ASSERT_EQ(close(fd), 0, "");
+    ASSERT_EQ(fdio_ns_destroy(ns), ZX_OK, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(namespace_tests)
 RUN_TEST_MEDIUM(namespace_create_test)
+RUN_TEST(namespace_bind_test)
 END_TEST_CASE(namespace_tests)
 
 int main(int argc, char** argv) {
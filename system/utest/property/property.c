@@ -283,12 +283,140 @@ static bool bad_importance_value_fails(void) {
     END_TEST;
 }
 
+static bool thread_sched_weight_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t self = thrd_get_zx_handle(thrd_current());
+    uint32_t weight;
+
+    // Threads start out round robin scheduled.
+    ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_WEIGHT,
+                                     &weight, sizeof(weight)),
+              ZX_OK, "");
+    EXPECT_EQ(weight, ZX_THREAD_SCHED_WEIGHT_NONE, "");
+
+    static const uint32_t good_values[] = {
+        ZX_THREAD_SCHED_WEIGHT_DEFAULT,
+        1u,
+        ZX_THREAD_SCHED_WEIGHT_MAX,
+        ZX_THREAD_SCHED_WEIGHT_NONE,
+    };
+    for (size_t i = 0; i < countof(good_values); i++) {
+        EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_WEIGHT,
+                                         &good_values[i], sizeof(uint32_t)),
+                  ZX_OK, "");
+        ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_WEIGHT,
+                                         &weight, sizeof(weight)),
+                  ZX_OK, "");
+        EXPECT_EQ(weight, good_values[i], "");
+
+        // Give the scheduler a chance to requeue us with the new weight.
+        zx_nanosleep(0);
+    }
+
+    uint32_t bad_value = ZX_THREAD_SCHED_WEIGHT_MAX + 1;
+    EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_WEIGHT,
+                                     &bad_value, sizeof(bad_value)),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    // Only threads have a scheduling weight.
+    EXPECT_EQ(zx_object_set_property(zx_process_self(), ZX_PROP_THREAD_SCHED_WEIGHT,
+                                     &good_values[0], sizeof(uint32_t)),
+              ZX_ERR_WRONG_TYPE, "");
+
+    END_TEST;
+}
+
+static bool thread_sched_deadline_test(void) {
+    BEGIN_TEST;
+
+    zx_handle_t self = thrd_get_zx_handle(thrd_current());
+    zx_sched_deadline_params_t params;
+
+    ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &params, sizeof(params)),
+              ZX_OK, "");
+    EXPECT_EQ(params.capacity, 0u, "");
+
+    // 1ms every 10ms fits on any cpu.
+    zx_sched_deadline_params_t set = {
+        .capacity = ZX_MSEC(1),
+        .relative_deadline = ZX_MSEC(5),
+        .period = ZX_MSEC(10),
+    };
+    ASSERT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &set, sizeof(set)),
+              ZX_OK, "");
+    ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &params, sizeof(params)),
+              ZX_OK, "");
+    EXPECT_EQ(params.capacity, set.capacity, "");
+    EXPECT_EQ(params.relative_deadline, set.relative_deadline, "");
+    EXPECT_EQ(params.period, set.period, "");
+
+    // Run through a few periods with the reservation in place.
+    for (int i = 0; i < 10; i++) {
+        zx_nanosleep(zx_deadline_after(ZX_MSEC(2)));
+    }
+
+    // A reservation of the whole cpu is never admitted.
+    zx_sched_deadline_params_t too_big = {
+        .capacity = ZX_MSEC(10),
+        .relative_deadline = ZX_MSEC(10),
+        .period = ZX_MSEC(10),
+    };
+    EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &too_big, sizeof(too_big)),
+              ZX_ERR_NO_RESOURCES, "");
+
+    // The failed request leaves the old reservation in place.
+    ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &params, sizeof(params)),
+              ZX_OK, "");
+    EXPECT_EQ(params.capacity, set.capacity, "");
+
+    zx_sched_deadline_params_t bad = {
+        .capacity = ZX_MSEC(6),
+        .relative_deadline = ZX_MSEC(5),
+        .period = ZX_MSEC(10),
+    };
+    EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &bad, sizeof(bad)),
+              ZX_ERR_INVALID_ARGS, "");
+
+    bad.capacity = ZX_SEC(1);
+    bad.relative_deadline = ZX_SEC(2);
+    bad.period = ZX_SEC(2);
+    EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &bad, sizeof(bad)),
+              ZX_ERR_OUT_OF_RANGE, "");
+
+    // A deadline thread can't also be fair-share scheduled.
+    uint32_t weight = ZX_THREAD_SCHED_WEIGHT_DEFAULT;
+    EXPECT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_WEIGHT,
+                                     &weight, sizeof(weight)),
+              ZX_ERR_BAD_STATE, "");
+
+    zx_sched_deadline_params_t clear = {};
+    ASSERT_EQ(zx_object_set_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &clear, sizeof(clear)),
+              ZX_OK, "");
+    ASSERT_EQ(zx_object_get_property(self, ZX_PROP_THREAD_SCHED_DEADLINE,
+                                     &params, sizeof(params)),
+              ZX_OK, "");
+    EXPECT_EQ(params.capacity, 0u, "");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(property_tests)
 RUN_TEST(process_name_test);
 RUN_TEST(thread_name_test);
 RUN_TEST(vmo_name_test);
 RUN_TEST(importance_smoke_test);
 RUN_TEST(bad_importance_value_fails);
+RUN_TEST(thread_sched_weight_test);
+RUN_TEST(thread_sched_deadline_test);
 END_TEST_CASE(property_tests)
 
 int main(int argc, char** argv) {
@@ -15,14 +15,17 @@
 #include <threads.h>
 #include <unistd.h>
 
+#include <async/loop.h>
 #include <block-client/client.h>
 #include <fs-management/ramdisk.h>
+#include <sync/completion.h>
 #include <zircon/device/block.h>
 #include <zircon/device/ramdisk.h>
 #include <zircon/syscalls.h>
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <fbl/atomic.h>
 #include <fbl/limits.h>
 #include <fbl/unique_ptr.h>
 #include <unittest/unittest.h>
@@ -96,6 +99,55 @@ static bool ramdisk_test_vmo(void) {
     END_TEST;
 }
 
+// Writes and reads back a few pages through a ramdisk with the given options.
+static bool ramdisk_options_helper(uint32_t options, uint32_t num_workers) {
+    BEGIN_HELPER;
+    char ramdisk_path[PATH_MAX];
+    ASSERT_EQ(create_ramdisk_ex(PAGE_SIZE, 512, options, num_workers, ramdisk_path), 0);
+    int fd = open(ramdisk_path, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open ramdisk device");
+
+    uint8_t buf[PAGE_SIZE * 4];
+    uint8_t out[PAGE_SIZE * 4];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = static_cast<uint8_t>(i * 7 + i / PAGE_SIZE);
+    }
+    memset(out, 0, sizeof(out));
+
+    EXPECT_EQ(write(fd, buf, sizeof(buf)), (ssize_t)sizeof(buf));
+    EXPECT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    EXPECT_EQ(read(fd, out, sizeof(out)), (ssize_t)sizeof(out));
+    EXPECT_EQ(memcmp(out, buf, sizeof(out)), 0);
+
+    EXPECT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    close(fd);
+    END_HELPER;
+}
+
+static bool ramdisk_test_options(void) {
+    BEGIN_TEST;
+    EXPECT_TRUE(ramdisk_options_helper(0, 0));
+    EXPECT_TRUE(ramdisk_options_helper(0, RAMDISK_MAX_WORKERS));
+    EXPECT_TRUE(ramdisk_options_helper(RAMDISK_OPT_INLINE, 0));
+    EXPECT_TRUE(ramdisk_options_helper(RAMDISK_OPT_PREFAULT, 4));
+    EXPECT_TRUE(ramdisk_options_helper(RAMDISK_OPT_INLINE | RAMDISK_OPT_PREFAULT, 0));
+
+    int fd = open(RAMCTL_PATH, O_RDWR);
+    ASSERT_GE(fd, 0, "Could not open ramctl");
+    ramdisk_ioctl_config_ex_t config;
+    config.blk_size = PAGE_SIZE;
+    config.blk_count = 512;
+    config.options = ~RAMDISK_OPT_MASK;
+    config.num_workers = 0;
+    ramdisk_ioctl_config_response_t response;
+    EXPECT_EQ(ioctl_ramdisk_config_ex(fd, &config, &response), ZX_ERR_INVALID_ARGS);
+    config.options = 0;
+    config.num_workers = RAMDISK_MAX_WORKERS + 1;
+    EXPECT_EQ(ioctl_ramdisk_config_ex(fd, &config, &response), ZX_ERR_INVALID_ARGS);
+    close(fd);
+    END_TEST;
+}
+
 // This test creates a ramdisk, verifies it is visible in the filesystem
 // (where we expect it to be!) and verifies that it is removed when we
 // "unplug" the device.
@@ -463,6 +515,262 @@ bool ramdisk_test_fifo_basic(void) {
     END_TEST;
 }
 
+bool ramdisk_test_fifo_trim(void) {
+    BEGIN_TEST;
+    const size_t kBlockSize = PAGE_SIZE;
+    const uint64_t kBlockCount = 512;
+    int fd = get_ramdisk(kBlockSize, kBlockCount);
+    block_info_t info;
+    ASSERT_GE(ioctl_block_get_info(fd, &info), 0);
+    ASSERT_TRUE(info.flags & BLOCK_FLAG_TRIM_SUPPORT);
+
+    zx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    uint64_t vmo_size = kBlockSize * 3;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(vmo_size, 0, &vmo), ZX_OK, "Failed to create VMO");
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check());
+    fill_random(buf.get(), vmo_size);
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, buf.get(), 0, vmo_size, &actual), ZX_OK);
+
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    zx_handle_t xfer_vmo;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &xfer_vmo), ZX_OK);
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected,
+              "Failed to attach vmo");
+
+    block_fifo_request_t request;
+    request.txnid      = txnid;
+    request.vmoid      = vmoid;
+    request.opcode     = BLOCKIO_WRITE;
+    request.length     = 3;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), ZX_OK);
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), ZX_OK);
+
+    // Trim the last two blocks, as adjacent requests which need no vmo
+    block_fifo_request_t trims[2];
+    for (size_t i = 0; i < fbl::count_of(trims); i++) {
+        trims[i].txnid      = txnid;
+        trims[i].vmoid      = VMOID_INVALID;
+        trims[i].opcode     = BLOCKIO_TRIM;
+        trims[i].length     = 1;
+        trims[i].vmo_offset = 0;
+        trims[i].dev_offset = 1 + i;
+    }
+    ASSERT_EQ(block_fifo_txn(client, &trims[0], fbl::count_of(trims)), ZX_OK);
+
+    // The first block is untouched, and the trimmed ones read back as zeroes
+    fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check());
+    request.opcode = BLOCKIO_READ;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), ZX_OK);
+    ASSERT_EQ(zx_vmo_read(vmo, out.get(), 0, vmo_size, &actual), ZX_OK);
+    ASSERT_EQ(memcmp(buf.get(), out.get(), kBlockSize), 0, "Untrimmed block changed");
+    memset(buf.get(), 0, vmo_size);
+    ASSERT_EQ(memcmp(buf.get(), out.get() + kBlockSize, 2 * kBlockSize), 0,
+              "Trimmed blocks not zeroed");
+
+    // Trims are checked like reads and writes
+    trims[0].length = 0;
+    ASSERT_EQ(block_fifo_txn(client, &trims[0], 1), ZX_ERR_INVALID_ARGS);
+    trims[0].length = 2;
+    trims[0].dev_offset = kBlockCount - 1;
+    ASSERT_EQ(block_fifo_txn(client, &trims[0], 1), ZX_ERR_OUT_OF_RANGE);
+
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), ZX_OK);
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
+static uint64_t latency_total(const block_op_stats_t* stats) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < BLOCK_STATS_BUCKETS; i++) {
+        total += stats->latency[i];
+    }
+    return total;
+}
+
+bool ramdisk_test_fifo_stats(void) {
+    BEGIN_TEST;
+    int fd = get_ramdisk(PAGE_SIZE, 512);
+    block_stats_t stats;
+    ASSERT_LT(ioctl_block_get_stats(fd, &stats), 0, "Stats without a FIFO server");
+
+    zx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    uint64_t vmo_size = PAGE_SIZE * 3;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(vmo_size, 0, &vmo), ZX_OK, "Failed to create VMO");
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    zx_handle_t xfer_vmo;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &xfer_vmo), ZX_OK);
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected,
+              "Failed to attach vmo");
+
+    block_fifo_request_t requests[2];
+    requests[0].txnid      = txnid;
+    requests[0].vmoid      = vmoid;
+    requests[0].opcode     = BLOCKIO_WRITE;
+    requests[0].length     = 1;
+    requests[0].vmo_offset = 0;
+    requests[0].dev_offset = 0;
+
+    requests[1].txnid      = txnid;
+    requests[1].vmoid      = vmoid;
+    requests[1].opcode     = BLOCKIO_WRITE;
+    requests[1].length     = 2;
+    requests[1].vmo_offset = 1;
+    requests[1].dev_offset = 100;
+
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), ZX_OK);
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], fbl::count_of(requests)), ZX_OK);
+    requests[0].opcode = BLOCKIO_READ;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], 1), ZX_OK);
+
+    expected = sizeof(stats);
+    ASSERT_EQ(ioctl_block_get_stats(fd, &stats), expected, "Failed to get stats");
+    ASSERT_EQ(stats.client_count, 1);
+    ASSERT_EQ(stats.in_flight, 0);
+    ASSERT_EQ(stats.queued, 0);
+    ASSERT_GE(stats.max_in_flight, 1);
+    const block_client_stats_t* cs = &stats.clients[0];
+    ASSERT_EQ(cs->txnid, txnid);
+    ASSERT_EQ(cs->in_flight, 0);
+    ASSERT_EQ(cs->write.count, 2);
+    ASSERT_EQ(cs->write.blocks, 3);
+    ASSERT_EQ(latency_total(&cs->write), 2);
+    ASSERT_GE(cs->write.total_ns, cs->write.queue_ns);
+    ASSERT_EQ(cs->read.count, 1);
+    ASSERT_EQ(cs->read.blocks, 1);
+    ASSERT_EQ(latency_total(&cs->read), 1);
+
+    // Stats go with the txn
+    ASSERT_EQ(ioctl_block_free_txn(fd, &txnid), ZX_OK, "Failed to free txn");
+    ASSERT_EQ(ioctl_block_get_stats(fd, &stats), expected, "Failed to get stats");
+    ASSERT_EQ(stats.client_count, 0);
+
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
+typedef struct {
+    fbl::atomic<uint32_t> remaining;
+    fbl::atomic<zx_status_t> status;
+    completion_t done;
+} async_txns_t;
+
+static void async_txn_done(void* cookie, zx_status_t status) {
+    async_txns_t* txns = static_cast<async_txns_t*>(cookie);
+    if (status != ZX_OK) {
+        txns->status.store(status);
+    }
+    if (txns->remaining.fetch_sub(1) == 1) {
+        completion_signal(&txns->done);
+    }
+}
+
+bool ramdisk_test_fifo_async(void) {
+    BEGIN_TEST;
+    int fd = get_ramdisk(PAGE_SIZE, 512);
+    zx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+
+    constexpr size_t kTxns = 4;
+    txnid_t txnids[kTxns];
+    expected = sizeof(txnid_t);
+    for (size_t i = 0; i < kTxns; i++) {
+        ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnids[i]), expected, "Failed to allocate txn");
+    }
+
+    uint64_t vmo_size = PAGE_SIZE * kTxns;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(vmo_size, 0, &vmo), ZX_OK, "Failed to create VMO");
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check());
+    fill_random(buf.get(), vmo_size);
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, buf.get(), 0, vmo_size, &actual), ZX_OK);
+
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    zx_handle_t xfer_vmo;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &xfer_vmo), ZX_OK);
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected,
+              "Failed to attach vmo");
+
+    async::Loop loop;
+    ASSERT_EQ(loop.StartThread(), ZX_OK);
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), ZX_OK);
+    ASSERT_EQ(block_fifo_set_async(client, loop.async()), ZX_OK);
+
+    // Keep every txn in flight at once, each writing a page to its own
+    // spot on the disk.
+    async_txns_t txns;
+    txns.remaining.store(kTxns);
+    txns.status.store(ZX_OK);
+    completion_reset(&txns.done);
+    block_fifo_request_t requests[kTxns];
+    for (size_t i = 0; i < kTxns; i++) {
+        requests[i].txnid      = txnids[i];
+        requests[i].vmoid      = vmoid;
+        requests[i].opcode     = BLOCKIO_WRITE;
+        requests[i].length     = 1;
+        requests[i].vmo_offset = i;
+        requests[i].dev_offset = i * 10;
+        ASSERT_EQ(block_fifo_txn_async(client, &requests[i], 1, async_txn_done, &txns), ZX_OK);
+    }
+    ASSERT_EQ(completion_wait(&txns.done, ZX_SEC(5)), ZX_OK);
+    ASSERT_EQ(txns.status.load(), ZX_OK);
+
+    // Synchronous txns still work once responses are read by the loop.
+    fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[vmo_size]());
+    ASSERT_TRUE(ac.check());
+    ASSERT_EQ(zx_vmo_write(vmo, out.get(), 0, vmo_size, &actual), ZX_OK);
+    for (size_t i = 0; i < kTxns; i++) {
+        requests[i].opcode = BLOCKIO_READ;
+        ASSERT_EQ(block_fifo_txn(client, &requests[i], 1), ZX_OK);
+    }
+    ASSERT_EQ(zx_vmo_read(vmo, out.get(), 0, vmo_size, &actual), ZX_OK);
+    ASSERT_EQ(memcmp(buf.get(), out.get(), vmo_size), 0, "Read data not equal to written data");
+
+    requests[0].opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], 1), ZX_OK);
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+    block_fifo_release_client(client);
+    ASSERT_GE(ioctl_ramdisk_unlink(fd), 0, "Could not unlink ramdisk device");
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
 typedef struct {
     uint64_t vmo_size;
     zx_handle_t vmo;
@@ -1172,6 +1480,7 @@ bool ramdisk_test_fifo_bad_client_bad_vmo(void) {
 BEGIN_TEST_CASE(ramdisk_tests)
 RUN_TEST_SMALL(ramdisk_test_simple)
 RUN_TEST_SMALL(ramdisk_test_vmo)
+RUN_TEST_SMALL(ramdisk_test_options)
 RUN_TEST_SMALL(ramdisk_test_filesystem)
 RUN_TEST_SMALL(ramdisk_test_rebind)
 RUN_TEST_SMALL(ramdisk_test_bad_requests)
@@ -1180,6 +1489,9 @@ RUN_TEST_SMALL(ramdisk_test_release_during_fifo_access)
 RUN_TEST_SMALL(ramdisk_test_multiple)
 RUN_TEST_SMALL(ramdisk_test_fifo_no_op)
 RUN_TEST_SMALL(ramdisk_test_fifo_basic)
+RUN_TEST_SMALL(ramdisk_test_fifo_trim)
+RUN_TEST_SMALL(ramdisk_test_fifo_stats)
+RUN_TEST_SMALL(ramdisk_test_fifo_async)
 RUN_TEST_SMALL(ramdisk_test_fifo_multiple_vmo)
 RUN_TEST_SMALL(ramdisk_test_fifo_multiple_vmo_multithreaded)
 // TODO(smklein): Test ops across different vmos
@@ -15,12 +15,15 @@ MODULE_SRCS += \
 MODULE_NAME := ramdisk-test
 
 MODULE_STATIC_LIBS := \
+    system/ulib/async \
+    system/ulib/async.loop \
     system/ulib/block-client \
     system/ulib/sync \
     system/ulib/zxcpp \
     system/ulib/fbl \
 
 MODULE_LIBS := \
+    system/ulib/async.default \
     system/ulib/c \
     system/ulib/fs-management \
     system/ulib/zircon \
@@ -155,6 +155,53 @@ static bool ralloc_by_size_test() {
     END_TEST;
 }
 
+static bool ralloc_by_size_aligned_test() {
+    BEGIN_TEST;
+
+    constexpr uint64_t kSize  = 0x1000;
+    constexpr uint64_t kAlign = 0x100000;
+    constexpr size_t   kMisalignedCount = 32;
+
+    RegionAllocator alloc(RegionAllocator::RegionPool::Create(REGION_POOL_MAX_SIZE));
+
+    // Add a bunch of regions which are large enough to hold the allocation,
+    // but which cannot satisfy the alignment, followed by one which is large
+    // enough to satisfy it no matter where its base lies.
+    for (size_t i = 0; i < kMisalignedCount; ++i) {
+        ralloc_region_t tmp = { .base = (i * 2 * kAlign) + kSize, .size = 2 * kSize };
+        ASSERT_EQ(ZX_OK, alloc.AddRegion(tmp));
+    }
+    const ralloc_region_t big = { .base = (kMisalignedCount * 2 * kAlign) + kSize,
+                                  .size = kAlign + kSize };
+    ASSERT_EQ(ZX_OK, alloc.AddRegion(big));
+
+    // The allocation must come from the big region.
+    RegionAllocator::Region::UPtr r1;
+    ASSERT_EQ(ZX_OK, alloc.GetRegion(kSize, kAlign, r1));
+    ASSERT_NONNULL(r1);
+    EXPECT_TRUE(region_contains_region(&big, r1.get()));
+    EXPECT_EQ(0u, r1->base & (kAlign - 1));
+
+    // An aligned region just large enough sorts ahead of the misaligned ones,
+    // and is still the best fit.
+    const ralloc_region_t exact = { .base = (kMisalignedCount * 4 * kAlign), .size = kSize };
+    ASSERT_EQ(ZX_OK, alloc.AddRegion(exact));
+
+    RegionAllocator::Region::UPtr r2;
+    ASSERT_EQ(ZX_OK, alloc.GetRegion(kSize, kAlign, r2));
+    ASSERT_NONNULL(r2);
+    EXPECT_EQ(exact.base, r2->base);
+
+    // With the big region gone, there is nothing left which can satisfy the
+    // request.
+    RegionAllocator::Region::UPtr r3;
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, alloc.GetRegion(kAlign, kAlign, r3));
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, alloc.GetRegion(kSize, kAlign, r3));
+    EXPECT_NULL(r3);
+
+    END_TEST;
+}
+
 static bool ralloc_specific_test() {
     BEGIN_TEST;
 
@@ -240,6 +287,7 @@ static bool ralloc_subtract_test() {
 BEGIN_TEST_CASE(ralloc_tests)
 RUN_NAMED_TEST("Region Pools",   ralloc_region_pools_test)
 RUN_NAMED_TEST("Alloc by size",  ralloc_by_size_test)
+RUN_NAMED_TEST("Alloc aligned",  ralloc_by_size_aligned_test)
 RUN_NAMED_TEST("Alloc specific", ralloc_specific_test)
 RUN_NAMED_TEST("Add/Overlap",    ralloc_add_overlap_test)
 RUN_NAMED_TEST("Subtract",       ralloc_subtract_test)
@@ -0,0 +1,211 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+
+// The optimized string functions read whole aligned blocks at a time.
+// Check them against simple byte loops for every small length and
+// alignment, with the buffers ending right before an unmapped page so that
+// any read past the end of a page they should not touch faults.
+
+#define MAX_LEN 300
+
+static size_t slow_strlen(const char* s) {
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+static const void* slow_memchr(const void* s, int c, size_t n) {
+    const unsigned char* p = s;
+    for (size_t i = 0; i < n; ++i) {
+        if (p[i] == (unsigned char)c)
+            return p + i;
+    }
+    return NULL;
+}
+
+static int slow_memcmp(const void* l, const void* r, size_t n) {
+    const unsigned char* a = l;
+    const unsigned char* b = r;
+    for (size_t i = 0; i < n; ++i) {
+        if (a[i] != b[i])
+            return a[i] - b[i];
+    }
+    return 0;
+}
+
+// Returns a page which is followed by an unmapped page.
+static char* map_guarded_page(void) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    char* p = mmap(NULL, page * 2, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED)
+        return NULL;
+    if (munmap(p + page, page) != 0) {
+        munmap(p, page * 2);
+        return NULL;
+    }
+    return p;
+}
+
+static unsigned rand_state = 1;
+
+static unsigned next_rand(void) {
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 16;
+}
+
+static bool strlen_test(void) {
+    BEGIN_TEST;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    char* p = map_guarded_page();
+    ASSERT_NONNULL(p, "");
+
+    for (size_t len = 0; len < MAX_LEN; ++len) {
+        // At the start of the page at every alignment, and at the very end.
+        for (size_t align = 0; align <= 16; ++align) {
+            char* s = (align == 16) ? p + page - len - 1 : p + align;
+            for (size_t i = 0; i < len; ++i)
+                s[i] = (char)(1 + next_rand() % 255);
+            s[len] = '\0';
+            ASSERT_EQ(slow_strlen(s), strlen(s), "");
+        }
+    }
+
+    munmap(p, page);
+    END_TEST;
+}
+
+static bool memchr_test(void) {
+    BEGIN_TEST;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    char* p = map_guarded_page();
+    ASSERT_NONNULL(p, "");
+
+    for (size_t len = 0; len < MAX_LEN; ++len) {
+        for (size_t align = 0; align <= 16; ++align) {
+            char* s = (align == 16) ? p + page - len : p + align;
+            for (size_t i = 0; i < len; ++i)
+                s[i] = (char)(next_rand() % 8);
+            for (int c = 0; c < 9; ++c) {
+                ASSERT_EQ(slow_memchr(s, c, len), memchr(s, c, len), "");
+                // Only the low byte of |c| counts.
+                ASSERT_EQ(slow_memchr(s, c, len), memchr(s, c + 0x100, len), "");
+            }
+        }
+    }
+
+    munmap(p, page);
+    END_TEST;
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static bool memcmp_test(void) {
+    BEGIN_TEST;
+
+    size_t page = sysconf(_SC_PAGESIZE);
+    char* p = map_guarded_page();
+    ASSERT_NONNULL(p, "");
+
+    for (size_t len = 0; len < MAX_LEN; ++len) {
+        for (size_t align = 0; align < 16; ++align) {
+            // One buffer at the end of the page, the other near the start.
+            char* l = p + page - len;
+            char* r = p + align;
+            for (size_t i = 0; i < len; ++i)
+                l[i] = r[i] = (char)next_rand();
+            ASSERT_EQ(0, memcmp(l, r, len), "");
+            if (len == 0)
+                continue;
+
+            // Make them differ at one spot, in either direction.
+            size_t spot = next_rand() % len;
+            l[spot] = (char)(r[spot] + 1 + next_rand() % 255);
+            ASSERT_EQ(sign(slow_memcmp(l, r, len)), sign(memcmp(l, r, len)), "");
+            ASSERT_EQ(sign(slow_memcmp(r, l, len)), sign(memcmp(r, l, len)), "");
+        }
+    }
+
+    munmap(p, page);
+    END_TEST;
+}
+
+// Benchmarks.
+
+#define BENCH_SIZE (1u << 20)
+#define BENCH_ITERATIONS 100
+
+static void print_rate(const char* what, uint64_t start) {
+    uint64_t ticks = zx_ticks_get() - start;
+    uint64_t usec = ticks * 1000000 / zx_ticks_per_second();
+    printf("\nBenchmark %s: [%10lu] usec per MB\n", what,
+           usec / BENCH_ITERATIONS);
+}
+
+static bool string_benchmarks(void) {
+    BEGIN_TEST;
+
+    char* a = malloc(BENCH_SIZE + 1);
+    char* b = malloc(BENCH_SIZE + 1);
+    ASSERT_NONNULL(a, "");
+    ASSERT_NONNULL(b, "");
+    memset(a, 'a', BENCH_SIZE);
+    a[BENCH_SIZE] = '\0';
+    volatile size_t sink = 0;
+
+    uint64_t start = zx_ticks_get();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+        memcpy(b, a, BENCH_SIZE + 1);
+    print_rate("memcpy", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+        memset(b, 'a', BENCH_SIZE);
+    print_rate("memset", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+        sink += (size_t)memcmp(a, b, BENCH_SIZE);
+    print_rate("memcmp", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+        sink += (size_t)memchr(a, 'b', BENCH_SIZE);
+    print_rate("memchr", start);
+
+    start = zx_ticks_get();
+    for (int i = 0; i < BENCH_ITERATIONS; ++i)
+        sink += strlen(a);
+    print_rate("strlen", start);
+
+    free(a);
+    free(b);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(string_tests)
+RUN_TEST(strlen_test)
+RUN_TEST(memchr_test)
+RUN_TEST(memcmp_test)
+RUN_TEST_PERFORMANCE(string_benchmarks)
+END_TEST_CASE(string_tests)
+
+int main(int argc, char** argv) {
+    return unittest_run_all_tests(argc, argv) ? 0 : -1;
+}
@@ -5,9 +5,14 @@
 #include <trace-reader/reader.h>
 
 #include <stdint.h>
+#include <string.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/atomic.h>
+#include <fbl/unique_ptr.h>
 #include <fbl/vector.h>
+#include <trace-engine/buffer.h>
+#include <trace-engine/fields.h>
 #include <unittest/unittest.h>
 
 namespace {
@@ -180,6 +185,149 @@ bool empty_buffer_test() {
 
 // NOTE: Most of the reader is covered by the libtrace tests.
 
+constexpr size_t kChunkWords = TRACE_BUFFER_CHUNK_SIZE / sizeof(uint64_t);
+
+uint64_t MakeHeader(trace::RecordType type, size_t num_words) {
+    return trace::RecordFields::Type::Make(trace::ToUnderlyingType(type)) |
+           trace::RecordFields::RecordSize::Make(num_words);
+}
+
+uint64_t MakeString(const char* string) {
+    uint64_t word = 0u;
+    memcpy(&word, string, strlen(string));
+    return word;
+}
+
+// Covers the rest of the chunk which begins at |chunk|, which ends at |ptr|,
+// the way the trace engine does.
+void PadChunk(uint64_t* chunk, uint64_t* ptr) {
+    *ptr = MakeHeader(trace::RecordType::kMetadata, chunk + kChunkWords - ptr) |
+           trace::MetadataRecordFields::MetadataType::Make(
+               trace::ToUnderlyingType(trace::MetadataType::kPadding));
+}
+
+// Fills |buffer| with two chunks: the first registers a string and a thread
+// and uses them in an instant event, the second has a counter event which
+// refers back to them.
+void WriteTwoChunks(uint64_t* buffer) {
+    using namespace trace;
+
+    uint64_t* ptr = buffer;
+    *ptr++ = MakeHeader(RecordType::kString, 2u) |
+             StringRecordFields::StringIndex::Make(1u) |
+             StringRecordFields::StringLength::Make(3u);
+    *ptr++ = MakeString("cat");
+    *ptr++ = MakeHeader(RecordType::kThread, 3u) |
+             ThreadRecordFields::ThreadIndex::Make(1u);
+    *ptr++ = 11u;
+    *ptr++ = 12u;
+    *ptr++ = MakeHeader(RecordType::kEvent, 5u) |
+             EventRecordFields::EventType::Make(ToUnderlyingType(EventType::kInstant)) |
+             EventRecordFields::ArgumentCount::Make(1u) |
+             EventRecordFields::ThreadRef::Make(1u) |
+             EventRecordFields::CategoryStringRef::Make(1u) |
+             EventRecordFields::NameStringRef::Make(TRACE_ENCODED_STRING_REF_INLINE_FLAG | 2u);
+    *ptr++ = 100u;
+    *ptr++ = MakeString("hi");
+    *ptr++ = ArgumentFields::Type::Make(ToUnderlyingType(ArgumentType::kInt32)) |
+             ArgumentFields::ArgumentSize::Make(1u) |
+             ArgumentFields::NameRef::Make(1u) |
+             Int32ArgumentFields::Value::Make(42u);
+    *ptr++ = ToUnderlyingType(EventScope::kProcess);
+    PadChunk(buffer, ptr);
+
+    uint64_t* chunk = buffer + kChunkWords;
+    ptr = chunk;
+    *ptr++ = MakeHeader(RecordType::kEvent, 5u) |
+             EventRecordFields::EventType::Make(ToUnderlyingType(EventType::kCounter)) |
+             EventRecordFields::ThreadRef::Make(TRACE_ENCODED_THREAD_REF_INLINE) |
+             EventRecordFields::CategoryStringRef::Make(1u) |
+             EventRecordFields::NameStringRef::Make(1u);
+    *ptr++ = 200u;
+    *ptr++ = 21u;
+    *ptr++ = 22u;
+    *ptr++ = 7u;
+    PadChunk(chunk, ptr);
+}
+
+// Counts the events written by |WriteTwoChunks|, checking their contents.
+struct EventCounts {
+    fbl::atomic<size_t> instants{0u};
+    fbl::atomic<size_t> counters{0u};
+    fbl::atomic<size_t> others{0u};
+
+    void Count(const trace::EventView& event) {
+        if (event.type == trace::EventType::kInstant &&
+            event.timestamp == 100u &&
+            event.process_thread == trace::ProcessThread(11u, 12u) &&
+            event.category == "cat" && event.name == "hi" &&
+            event.scope == trace::EventScope::kProcess &&
+            event.num_arguments == 1u &&
+            event.arguments[0].name == "cat" &&
+            event.arguments[0].type == trace::ArgumentType::kInt32 &&
+            event.arguments[0].int32_value == 42) {
+            instants.fetch_add(1u);
+        } else if (event.type == trace::EventType::kCounter &&
+                   event.timestamp == 200u &&
+                   event.process_thread == trace::ProcessThread(21u, 22u) &&
+                   event.category == "cat" && event.name == "cat" &&
+                   event.id == 7u && event.num_arguments == 0u) {
+            counters.fetch_add(1u);
+        } else {
+            others.fetch_add(1u);
+        }
+    }
+};
+
+bool event_view_test() {
+    BEGIN_TEST;
+
+    fbl::unique_ptr<uint64_t[]> buffer(new uint64_t[2u * kChunkWords]);
+    WriteTwoChunks(buffer.get());
+
+    EventCounts counts;
+    fbl::Vector<trace::Record> records;
+    fbl::String error;
+    trace::TraceReader reader([&counts](const trace::EventView& event) { counts.Count(event); },
+                              MakeRecordConsumer(&records), MakeErrorHandler(&error));
+
+    trace::Chunk chunk(buffer.get(), 2u * kChunkWords);
+    EXPECT_TRUE(reader.ReadRecords(chunk));
+    EXPECT_EQ(1u, counts.instants.load());
+    EXPECT_EQ(1u, counts.counters.load());
+    EXPECT_EQ(0u, counts.others.load());
+    EXPECT_EQ(2u, records.size(), "string and thread");
+    EXPECT_TRUE(error.empty());
+
+    END_TEST;
+}
+
+bool parallel_test() {
+    BEGIN_TEST;
+
+    fbl::unique_ptr<uint64_t[]> buffer(new uint64_t[2u * kChunkWords]);
+    WriteTwoChunks(buffer.get());
+
+    for (size_t num_threads = 1u; num_threads <= 4u; num_threads++) {
+        EventCounts counts;
+        fbl::Vector<trace::Record> records;
+        fbl::String error;
+        trace::TraceReader reader(
+            [&counts](const trace::EventView& event) { counts.Count(event); },
+            MakeRecordConsumer(&records), MakeErrorHandler(&error));
+
+        EXPECT_TRUE(reader.ReadBufferInParallel(buffer.get(),
+                                                2u * TRACE_BUFFER_CHUNK_SIZE, num_threads));
+        EXPECT_EQ(1u, counts.instants.load());
+        EXPECT_EQ(1u, counts.counters.load());
+        EXPECT_EQ(0u, counts.others.load());
+        EXPECT_EQ(2u, records.size(), "string and thread");
+        EXPECT_TRUE(error.empty());
+    }
+
+    END_TEST;
+}
+
 } // namespace
 
 BEGIN_TEST_CASE(reader_tests)
@@ -187,4 +335,6 @@ RUN_TEST(empty_chunk_test)
 RUN_TEST(non_empty_chunk_test)
 RUN_TEST(initial_state_test)
 RUN_TEST(empty_buffer_test)
+RUN_TEST(event_view_test)
+RUN_TEST(parallel_test)
 END_TEST_CASE(reader_tests)
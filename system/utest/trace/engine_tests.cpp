@@ -6,6 +6,7 @@
 
 #include <threads.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/function.h>
 #include <fbl/string.h>
 #include <fbl/string_printf.h>
@@ -387,6 +388,104 @@ bool test_event_with_inline_everything() {
     END_TRACE_TEST;
 }
 
+bool test_circular_mode() {
+    BEGIN_TRACE_TEST;
+
+    fixture_start_tracing_etc(TRACE_BUFFERING_MODE_CIRCULAR);
+
+    // Write several times as many events as the buffer holds.
+    static constexpr uint64_t kCount = 100000u;
+    {
+        auto context = trace::TraceContext::Acquire();
+
+        trace_thread_ref_t thread;
+        trace_context_register_current_thread(context.get(), &thread);
+        EXPECT_TRUE(trace_is_inline_thread_ref(&thread));
+
+        trace_string_ref_t cat = trace_make_inline_c_string_ref("cat");
+        trace_string_ref_t name = trace_make_inline_c_string_ref("name");
+        for (uint64_t i = 0u; i < kCount; i++) {
+            trace_arg_t args[] = {
+                trace_make_arg(trace_make_inline_c_string_ref("i"),
+                               trace_make_uint64_arg_value(i))};
+            trace_context_write_instant_event_record(context.get(), zx_ticks_get(),
+                                                     &thread, &cat, &name,
+                                                     TRACE_SCOPE_THREAD,
+                                                     args, fbl::count_of(args));
+        }
+    }
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records), "read records");
+    EXPECT_EQ(ZX_OK, fixture_get_disposition());
+
+    // The initialization record is kept, and so are the most recent events.
+    ASSERT_GE(records.size(), 1u, "expected an initialization record");
+    EXPECT_EQ(trace::RecordType::kInitialization, records[0].type());
+    size_t num_events = 0u;
+    uint64_t last = 0u;
+    for (const auto& record : records) {
+        if (record.type() != trace::RecordType::kEvent)
+            continue;
+        num_events++;
+        last = fbl::max(last, record.GetEvent().arguments[0].value().GetUint64());
+    }
+    EXPECT_GT(num_events, 0u);
+    EXPECT_LT(num_events, kCount);
+    EXPECT_EQ(kCount - 1u, last);
+
+    END_TRACE_TEST;
+}
+
+bool test_streaming_mode() {
+    BEGIN_TRACE_TEST;
+
+    fixture_start_tracing_etc(TRACE_BUFFERING_MODE_STREAMING);
+
+    // Write several times as many events as the buffer holds.
+    static constexpr uint64_t kCount = 100000u;
+    {
+        auto context = trace::TraceContext::Acquire();
+
+        trace_thread_ref_t thread = trace_make_inline_thread_ref(123, 456);
+        trace_string_ref_t cat = trace_make_inline_c_string_ref("cat");
+        trace_string_ref_t name = trace_make_inline_c_string_ref("name");
+        for (uint64_t i = 0u; i < kCount; i++) {
+            trace_arg_t args[] = {
+                trace_make_arg(trace_make_inline_c_string_ref("i"),
+                               trace_make_uint64_arg_value(i))};
+            trace_context_write_instant_event_record(context.get(), zx_ticks_get(),
+                                                     &thread, &cat, &name,
+                                                     TRACE_SCOPE_THREAD,
+                                                     args, fbl::count_of(args));
+        }
+    }
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records), "read records");
+    EXPECT_GT(fixture_get_num_buffers_saved(), 0u);
+
+    // Every event was either saved, in order, or counted as dropped.
+    ASSERT_GE(records.size(), 1u, "expected an initialization record");
+    EXPECT_EQ(trace::RecordType::kInitialization, records[0].type());
+    size_t num_events = 0u;
+    uint64_t next = 0u;
+    bool in_order = true;
+    for (const auto& record : records) {
+        if (record.type() != trace::RecordType::kEvent)
+            continue;
+        uint64_t i = record.GetEvent().arguments[0].value().GetUint64();
+        if (i < next)
+            in_order = false;
+        next = i + 1u;
+        num_events++;
+    }
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(kCount, num_events + fixture_get_num_records_dropped());
+
+    END_TRACE_TEST;
+}
+
 // NOTE: The functions for writing trace records are exercised by other trace tests.
 
 } // namespace
@@ -406,4 +505,6 @@ RUN_TEST(test_register_string_literal_multiple_threads)
 RUN_TEST(test_register_string_literal_table_overflow)
 RUN_TEST(test_maximum_record_length)
 RUN_TEST(test_event_with_inline_everything)
+RUN_TEST(test_circular_mode)
+RUN_TEST(test_streaming_mode)
 END_TEST_CASE(engine_tests)
@@ -12,12 +12,15 @@
 #include <zircon/assert.h>
 
 #include <async/loop.h>
+#include <async/task.h>
 #include <zx/event.h>
 #include <fbl/algorithm.h>
 #include <fbl/array.h>
+#include <fbl/function.h>
 #include <fbl/string.h>
 #include <fbl/string_buffer.h>
 #include <fbl/vector.h>
+#include <trace-engine/buffer.h>
 #include <trace-reader/reader.h>
 #include <trace/handler.h>
 #include <unittest/unittest.h>
@@ -32,22 +35,25 @@ public:
         : buffer_(new uint8_t[kBufferSizeBytes], kBufferSizeBytes) {
         zx_status_t status = zx::event::create(0u, &trace_stopped_);
         ZX_DEBUG_ASSERT(status == ZX_OK);
+        save_task_.set_handler(fbl::BindMember(this, &Fixture::SaveBuffer));
     }
 
     ~Fixture() {
         StopTracing(false);
     }
 
-    void StartTracing() {
+    void StartTracing(trace_buffering_mode_t buffering_mode) {
         if (trace_running_)
             return;
 
         trace_running_ = true;
+        buffering_mode_ = buffering_mode;
         loop_.StartThread("trace test");
 
         // Asynchronously start the engine.
-        zx_status_t status = trace_start_engine(loop_.async(), this,
-                                                buffer_.get(), buffer_.size());
+        zx_status_t status = trace_start_engine_etc(loop_.async(), this,
+                                                    buffer_.get(), buffer_.size(),
+                                                    buffering_mode);
         ZX_DEBUG_ASSERT(status == ZX_OK);
     }
 
@@ -85,9 +91,19 @@ public:
         trace::TraceReader reader(
             [out_records](trace::Record record) { out_records->push_back(fbl::move(record)); },
             [out_errors](fbl::String error) { out_errors->push_back(fbl::move(error)); });
-        trace::Chunk chunk(reinterpret_cast<uint64_t*>(buffer_.get()),
-                           buffer_bytes_written_ / 8u);
-        if (buffer_bytes_written_ & 7u) {
+        const uint8_t* data = buffer_.get();
+        size_t num_bytes = buffer_bytes_written_;
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING) {
+            // Put whatever was not saved while tracing after what was.
+            auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+            if (num_buffers_saved_ < header->wrapped_count)
+                AppendBuffer(header->wrapped_count - 1u, header->buffer_size);
+            AppendBuffer(header->wrapped_count, buffer_bytes_written_);
+            data = saved_.get();
+            num_bytes = saved_.size();
+        }
+        trace::Chunk chunk(reinterpret_cast<const uint64_t*>(data), num_bytes / 8u);
+        if (num_bytes & 7u) {
             out_errors->push_back(fbl::String("Buffer contains extraneous bytes"));
         }
         if (!reader.ReadRecords(chunk)) {
@@ -96,6 +112,15 @@ public:
         return out_errors->is_empty();
     }
 
+    size_t num_buffers_saved() const {
+        return num_buffers_saved_;
+    }
+
+    uint64_t num_records_dropped() const {
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        return header->num_records_dropped;
+    }
+
 private:
     bool IsCategoryEnabled(const char* category) override {
         // All categories which begin with + are enabled.
@@ -114,13 +139,47 @@ private:
         trace_stopped_.signal(0u, ZX_EVENT_SIGNALED);
     }
 
+    void NotifyBufferFull(uint64_t wrapped_count) override {
+        // Save the buffer from the loop, since the engine may not be called
+        // back from here.
+        zx_status_t status = save_task_.Post(loop_.async());
+        ZX_DEBUG_ASSERT(status == ZX_OK || status == ZX_ERR_BAD_STATE);
+    }
+
+    async_task_result_t SaveBuffer(async_t* async, zx_status_t status) {
+        if (status != ZX_OK)
+            return ASYNC_TASK_FINISHED;
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        AppendBuffer(header->full_wrapped_count, header->buffer_size);
+        num_buffers_saved_++;
+        trace_engine_mark_buffer_saved();
+        return ASYNC_TASK_FINISHED;
+    }
+
+    void AppendBuffer(uint64_t wrapped_count, size_t num_bytes) {
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        const uint8_t* start = buffer_.get() + sizeof(*header) +
+                               (wrapped_count & 1u) * header->buffer_size;
+        fbl::Array<uint8_t> saved(new uint8_t[saved_.size() + num_bytes],
+                                  saved_.size() + num_bytes);
+        memcpy(saved.get(), saved_.get(), saved_.size());
+        memcpy(saved.get() + saved_.size(), start, num_bytes);
+        saved_ = fbl::move(saved);
+    }
+
     async::Loop loop_;
     fbl::Array<uint8_t> buffer_;
+    trace_buffering_mode_t buffering_mode_ = TRACE_BUFFERING_MODE_ONESHOT;
     bool trace_running_ = false;
     zx_status_t disposition_ = ZX_ERR_INTERNAL;
     size_t buffer_bytes_written_ = 0u;
     zx::event trace_stopped_;
     bool observed_stopped_callback_ = false;
+
+    // Streaming mode only: the buffers saved so far, in order.
+    async::Task save_task_;
+    fbl::Array<uint8_t> saved_;
+    size_t num_buffers_saved_ = 0u;
 };
 
 Fixture* g_fixture{nullptr};
@@ -139,8 +198,12 @@ void fixture_tear_down(void) {
 }
 
 void fixture_start_tracing() {
+    fixture_start_tracing_etc(TRACE_BUFFERING_MODE_ONESHOT);
+}
+
+void fixture_start_tracing_etc(trace_buffering_mode_t buffering_mode) {
     ZX_DEBUG_ASSERT(g_fixture);
-    g_fixture->StartTracing();
+    g_fixture->StartTracing(buffering_mode);
 }
 
 void fixture_stop_tracing() {
@@ -153,25 +216,44 @@ void fixture_stop_tracing_hard() {
     g_fixture->StopTracing(true);
 }
 
+size_t fixture_get_num_buffers_saved(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    return g_fixture->num_buffers_saved();
+}
+
+uint64_t fixture_get_num_records_dropped(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    return g_fixture->num_records_dropped();
+}
+
 zx_status_t fixture_get_disposition(void) {
     ZX_DEBUG_ASSERT(g_fixture);
     return g_fixture->disposition();
 }
 
-bool fixture_compare_records(const char* expected) {
+bool fixture_read_records(fbl::Vector<trace::Record>* out_records) {
     ZX_DEBUG_ASSERT(g_fixture);
     BEGIN_HELPER;
 
     g_fixture->StopTracing(false);
 
-    fbl::Vector<trace::Record> records;
     fbl::Vector<fbl::String> errors;
-    EXPECT_TRUE(g_fixture->ReadRecords(&records, &errors), "read error");
+    EXPECT_TRUE(g_fixture->ReadRecords(out_records, &errors), "read error");
 
     for (const auto& error : errors)
         printf("error: %s\n", error.c_str());
     ASSERT_EQ(0u, errors.size(), "errors encountered");
 
+    END_HELPER;
+}
+
+bool fixture_compare_records(const char* expected) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    BEGIN_HELPER;
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records), "read records");
+
     ASSERT_GE(records.size(), 1u, "expected an initialization record");
     ASSERT_EQ(trace::RecordType::kInitialization, records[0].type(),
               "expected initialization record");
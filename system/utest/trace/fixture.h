@@ -10,16 +10,25 @@
 #pragma once
 
 #include <zircon/compiler.h>
+#include <trace-engine/handler.h>
 #include <unittest/unittest.h>
 
+#ifdef __cplusplus
+#include <fbl/vector.h>
+#include <trace-reader/records.h>
+#endif
+
 __BEGIN_CDECLS
 
 void fixture_set_up(void);
 void fixture_tear_down(void);
 void fixture_start_tracing(void);
+void fixture_start_tracing_etc(trace_buffering_mode_t buffering_mode);
 void fixture_stop_tracing(void);
 void fixture_stop_tracing_hard(void);
 zx_status_t fixture_get_disposition(void);
+size_t fixture_get_num_buffers_saved(void);
+uint64_t fixture_get_num_records_dropped(void);
 bool fixture_compare_records(const char* expected);
 
 inline void fixture_scope_cleanup(bool* scope) {
@@ -49,3 +58,8 @@ inline void fixture_scope_cleanup(bool* scope) {
 #endif // NTRACE
 
 __END_CDECLS
+
+#ifdef __cplusplus
+// Stops tracing and reads back all of the records, reporting any errors.
+bool fixture_read_records(fbl::Vector<trace::Record>* out_records);
+#endif
@@ -18,6 +18,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/atomic.h>
 #include <fbl/function.h>
+#include <fbl/unique_ptr.h>
 #include <pretty/hexdump.h>
 #include <unittest/unittest.h>
 
@@ -95,6 +96,99 @@ bool vmo_read_write_test() {
     END_TEST;
 }
 
+// Large copies take a different path through the kernel's user copy code
+// (non-temporal stores above the last level cache size), so check that
+// unaligned buffers and odd lengths still come back intact.
+bool vmo_large_read_write_test() {
+    BEGIN_TEST;
+
+    const size_t len = 64 * 1024 * 1024;
+    const size_t kSkew = 3;
+    const size_t copy_len = len - 2 * kSkew - 1;
+
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(len, 0, &vmo), ZX_OK, "");
+
+    fbl::unique_ptr<uint8_t[]> src(new uint8_t[len]);
+    fbl::unique_ptr<uint8_t[]> dst(new uint8_t[len]);
+    for (size_t i = 0; i < len; i++)
+        src[i] = static_cast<uint8_t>(i * 7 + (i >> 12));
+    memset(dst.get(), 0, len);
+
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, src.get() + kSkew, kSkew, copy_len, &actual), ZX_OK, "");
+    EXPECT_EQ(actual, copy_len, "");
+    ASSERT_EQ(zx_vmo_read(vmo, dst.get() + 1, kSkew, copy_len, &actual), ZX_OK, "");
+    EXPECT_EQ(actual, copy_len, "");
+
+    EXPECT_EQ(dst[0], 0u, "wrote before the buffer");
+    EXPECT_EQ(memcmp(src.get() + kSkew, dst.get() + 1, copy_len), 0, "");
+    EXPECT_EQ(dst[copy_len + 1], 0u, "wrote past the buffer");
+
+    EXPECT_EQ(zx_handle_close(vmo), ZX_OK, "");
+    END_TEST;
+}
+
+bool vmo_copy_range_test() {
+    BEGIN_TEST;
+
+    const size_t len = PAGE_SIZE * 4;
+    zx_handle_t src, dst;
+    ASSERT_EQ(zx_vmo_create(len, 0, &src), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_create(len, 0, &dst), ZX_OK, "");
+
+    uint8_t buf[len];
+    for (size_t i = 0; i < len; i++)
+        buf[i] = static_cast<uint8_t>(i * 3 + (i >> 12));
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(src, buf, 0, len, &actual), ZX_OK, "");
+
+    // unaligned copy spanning several pages
+    const size_t off = 17;
+    const size_t copy_len = len - PAGE_SIZE;
+    EXPECT_EQ(zx_vmo_copy_range(dst, off + 5, src, off, copy_len), ZX_OK, "");
+    uint8_t out[len];
+    ASSERT_EQ(zx_vmo_read(dst, out, 0, len, &actual), ZX_OK, "");
+    EXPECT_EQ(out[off + 4], 0u, "wrote before the range");
+    EXPECT_BYTES_EQ(buf + off, out + off + 5, copy_len, "copied range");
+    EXPECT_EQ(out[off + 5 + copy_len], 0u, "wrote past the range");
+
+    // overlapping ranges of one vmo behave like memmove, in both directions
+    memmove(buf + 100, buf, len - PAGE_SIZE);
+    EXPECT_EQ(zx_vmo_copy_range(src, 100, src, 0, len - PAGE_SIZE), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_read(src, out, 0, len, &actual), ZX_OK, "");
+    EXPECT_BYTES_EQ(buf, out, len, "forward overlap");
+
+    memmove(buf, buf + PAGE_SIZE + 1, len - PAGE_SIZE - 1);
+    EXPECT_EQ(zx_vmo_copy_range(src, 0, src, PAGE_SIZE + 1, len - PAGE_SIZE - 1), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_read(src, out, 0, len, &actual), ZX_OK, "");
+    EXPECT_BYTES_EQ(buf, out, len, "backward overlap");
+
+    EXPECT_EQ(zx_vmo_copy_range(dst, 0, src, 0, 0), ZX_OK, "empty copy");
+    EXPECT_EQ(zx_vmo_copy_range(dst, 1, src, 0, len), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_vmo_copy_range(dst, 0, src, 1, len), ZX_ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(zx_vmo_copy_range(dst, UINT64_MAX, src, 0, 2), ZX_ERR_OUT_OF_RANGE, "");
+
+    // the destination needs WRITE and the source needs READ
+    zx_handle_t ro;
+    ASSERT_EQ(zx_handle_duplicate(dst, ZX_RIGHT_READ | ZX_RIGHT_TRANSFER, &ro), ZX_OK, "");
+    EXPECT_EQ(zx_vmo_copy_range(ro, 0, src, 0, PAGE_SIZE), ZX_ERR_ACCESS_DENIED, "");
+    zx_handle_t wo;
+    ASSERT_EQ(zx_handle_duplicate(src, ZX_RIGHT_WRITE | ZX_RIGHT_TRANSFER, &wo), ZX_OK, "");
+    EXPECT_EQ(zx_vmo_copy_range(dst, 0, wo, 0, PAGE_SIZE), ZX_ERR_ACCESS_DENIED, "");
+
+    zx_handle_t event;
+    ASSERT_EQ(zx_event_create(0u, &event), ZX_OK, "");
+    EXPECT_EQ(zx_vmo_copy_range(dst, 0, event, 0, PAGE_SIZE), ZX_ERR_WRONG_TYPE, "");
+
+    EXPECT_EQ(zx_handle_close(event), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(wo), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(ro), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(dst), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(src), ZX_OK, "");
+    END_TEST;
+}
+
 bool vmo_map_test() {
     BEGIN_TEST;
 
@@ -1100,6 +1194,48 @@ bool vmo_cache_op_test() {
     END_TEST;
 }
 
+bool vmo_cache_op_ranges_test() {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    const size_t size = 0x8000;
+
+    EXPECT_EQ(ZX_OK, zx_vmo_create(size, 0, &vmo), "creation for cache op");
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_COMMIT, 0, size, nullptr, 0), "commit");
+
+    // More ranges than the kernel copies in at once.
+    zx_vmo_range_t ranges[40];
+    for (size_t i = 0; i < fbl::count_of(ranges); i++) {
+        ranges[i].offset = (i * 0x1300) % (size - 0x1000);
+        ranges[i].size = 1 + i * 0x40;
+    }
+
+    auto t = [vmo, &ranges](uint32_t op) {
+        EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, op, 0, 0, ranges, sizeof(ranges)), "ranges");
+        EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, op, 0, 0, ranges, sizeof(ranges[0])), "one range");
+
+        EXPECT_EQ(ZX_ERR_INVALID_ARGS, zx_vmo_op_range(vmo, op, 0, 1, ranges, sizeof(ranges)),
+                  "size with ranges");
+        EXPECT_EQ(ZX_ERR_INVALID_ARGS, zx_vmo_op_range(vmo, op, 0, 0, ranges, 0), "no ranges");
+        EXPECT_EQ(ZX_ERR_INVALID_ARGS, zx_vmo_op_range(vmo, op, 0, 0, ranges, sizeof(ranges[0]) - 1),
+                  "partial range");
+
+        zx_vmo_range_t bad[2] = {{0, 1}, {size, 1}};
+        EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, zx_vmo_op_range(vmo, op, 0, 0, bad, sizeof(bad)), "bad range");
+        bad[1].offset = 0;
+        bad[1].size = 0;
+        EXPECT_EQ(ZX_ERR_INVALID_ARGS, zx_vmo_op_range(vmo, op, 0, 0, bad, sizeof(bad)), "empty range");
+    };
+
+    t(ZX_VMO_OP_CACHE_SYNC);
+    t(ZX_VMO_OP_CACHE_CLEAN);
+    t(ZX_VMO_OP_CACHE_CLEAN_INVALIDATE);
+    t(ZX_VMO_OP_CACHE_INVALIDATE);
+
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo), "close handle");
+    END_TEST;
+}
+
 bool vmo_cache_flush_test() {
     BEGIN_TEST;
 
@@ -1157,6 +1293,104 @@ bool vmo_decommit_misaligned_test() {
     END_TEST;
 }
 
+bool vmo_discardable_test() {
+    BEGIN_TEST;
+
+    zx_handle_t vmo;
+    ASSERT_EQ(ZX_OK, zx_vmo_create(PAGE_SIZE * 4, ZX_VMO_DISCARDABLE, &vmo), "");
+
+    // discardable objects start out unlocked
+    EXPECT_EQ(ZX_ERR_BAD_STATE, zx_vmo_op_range(vmo, ZX_VMO_OP_UNLOCK, 0, 0, NULL, 0), "");
+
+    uint32_t discarded = 2;
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_LOCK, 0, 0, &discarded, sizeof(discarded)),
+              "");
+    EXPECT_EQ(0u, discarded, "nothing to discard yet");
+
+    // locked contents survive, and locks nest
+    const uint8_t data[] = {1, 2, 3, 4};
+    size_t actual;
+    EXPECT_EQ(ZX_OK, zx_vmo_write(vmo, data, 0, sizeof(data), &actual), "");
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_LOCK, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_UNLOCK, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_UNLOCK, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_ERR_BAD_STATE, zx_vmo_op_range(vmo, ZX_VMO_OP_UNLOCK, 0, 0, NULL, 0), "");
+
+    zx_handle_t clone;
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED,
+              zx_vmo_clone(vmo, ZX_VMO_CLONE_COPY_ON_WRITE, 0, PAGE_SIZE, &clone), "");
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo), "");
+
+    // locking only applies to discardable objects
+    ASSERT_EQ(ZX_OK, zx_vmo_create(PAGE_SIZE, 0, &vmo), "");
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED, zx_vmo_op_range(vmo, ZX_VMO_OP_LOCK, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_ERR_NOT_SUPPORTED, zx_vmo_op_range(vmo, ZX_VMO_OP_UNLOCK, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo), "");
+
+    END_TEST;
+}
+
+bool vmo_dirty_tracking_test() {
+    BEGIN_TEST;
+
+    const size_t size = PAGE_SIZE * 16;
+    zx_handle_t vmo;
+    ASSERT_EQ(ZX_OK, zx_vmo_create(size, 0, &vmo), "");
+
+    uint8_t bitmap[2];
+    EXPECT_EQ(ZX_ERR_BAD_STATE,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 0, size, bitmap, sizeof(bitmap)),
+              "not tracking yet");
+
+    uintptr_t ptr;
+    ASSERT_EQ(ZX_OK, zx_vmar_map(zx_vmar_root_self(), 0, vmo, 0, size,
+                                 ZX_VM_FLAG_PERM_READ | ZX_VM_FLAG_PERM_WRITE, &ptr), "");
+    volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(ptr);
+
+    // pages faulted in before tracking starts have to fault again
+    p[0] = 1;
+    p[PAGE_SIZE * 9] = 1;
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_TRACK_DIRTY, 0, 0, NULL, 0), "");
+
+    p[0] = 2;
+    p[PAGE_SIZE * 9] = 2;
+    uint8_t data = 3;
+    size_t actual;
+    EXPECT_EQ(ZX_OK, zx_vmo_write(vmo, &data, PAGE_SIZE * 3, 1, &actual), "");
+    EXPECT_EQ(p[PAGE_SIZE * 12], 0, "reads don't count");
+
+    EXPECT_EQ(ZX_ERR_BUFFER_TOO_SMALL,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 0, size, bitmap, 1), "");
+    EXPECT_EQ(ZX_ERR_INVALID_ARGS,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 1, PAGE_SIZE, bitmap, 1), "");
+
+    EXPECT_EQ(ZX_OK,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 0, size, bitmap, sizeof(bitmap)), "");
+    EXPECT_EQ(0x09, bitmap[0], "pages 0 and 3");
+    EXPECT_EQ(0x02, bitmap[1], "page 9");
+
+    // queried writes are forgotten...
+    EXPECT_EQ(ZX_OK,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 0, size, bitmap, sizeof(bitmap)), "");
+    EXPECT_EQ(0, bitmap[0], "");
+    EXPECT_EQ(0, bitmap[1], "");
+
+    // ...and the pages are write protected again
+    p[PAGE_SIZE * 9] = 4;
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, PAGE_SIZE * 8, PAGE_SIZE * 8,
+                                     bitmap, 1), "");
+    EXPECT_EQ(0x02, bitmap[0], "page 9 of the range from page 8");
+
+    EXPECT_EQ(ZX_OK, zx_vmo_op_range(vmo, ZX_VMO_OP_UNTRACK_DIRTY, 0, 0, NULL, 0), "");
+    EXPECT_EQ(ZX_ERR_BAD_STATE,
+              zx_vmo_op_range(vmo, ZX_VMO_OP_QUERY_DIRTY, 0, size, bitmap, sizeof(bitmap)), "");
+
+    EXPECT_EQ(ZX_OK, zx_vmar_unmap(zx_vmar_root_self(), ptr, size), "");
+    EXPECT_EQ(ZX_OK, zx_handle_close(vmo), "");
+
+    END_TEST;
+}
+
 // test set 4: deal with clones with nonzero offsets and offsets that extend beyond the original
 bool vmo_clone_test_4() {
     BEGIN_TEST;
@@ -1410,6 +1644,8 @@ bool vmo_unmap_coherency() {
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
+RUN_TEST_LARGE(vmo_large_read_write_test);
+RUN_TEST(vmo_copy_range_test);
 RUN_TEST(vmo_map_test);
 RUN_TEST(vmo_read_only_map_test);
 RUN_TEST(vmo_no_perm_map_test);
@@ -1419,8 +1655,11 @@ RUN_TEST(vmo_rights_test);
 RUN_TEST(vmo_lookup_test);
 RUN_TEST(vmo_commit_test);
 RUN_TEST(vmo_decommit_misaligned_test);
+RUN_TEST(vmo_discardable_test);
+RUN_TEST(vmo_dirty_tracking_test);
 RUN_TEST(vmo_cache_test);
 RUN_TEST(vmo_cache_op_test);
+RUN_TEST(vmo_cache_op_ranges_test);
 RUN_TEST(vmo_cache_flush_test);
 RUN_TEST(vmo_zero_page_test);
 RUN_TEST(vmo_clone_test_1);
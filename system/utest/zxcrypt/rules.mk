@@ -12,6 +12,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/superblock.cpp \
     $(LOCAL_DIR)/test-device.cpp \
+    $(LOCAL_DIR)/worker-pool.cpp \
 
 MODULE_NAME := zxcrypt-test
 
@@ -0,0 +1,136 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <crypto/bytes.h>
+#include <crypto/cipher.h>
+#include <unittest/unittest.h>
+#include <zircon/errors.h>
+#include <zircon/types.h>
+#include <zxcrypt/worker-pool.h>
+
+#include "crypto/utils.h"
+
+namespace zxcrypt {
+namespace testing {
+namespace {
+
+// Enough blocks to be divided between several workers, and not a multiple of their number.
+const size_t kNumBlocks = 101;
+const size_t kBlockSize = 512;
+const size_t kLen = kNumBlocks * kBlockSize;
+
+bool GenerateKeyMaterial(crypto::Bytes* key, crypto::Bytes* iv) {
+    BEGIN_HELPER;
+    size_t key_len, iv_len;
+    ASSERT_OK(crypto::Cipher::GetKeyLen(crypto::Cipher::kAES256_XTS, &key_len));
+    ASSERT_OK(crypto::Cipher::GetIVLen(crypto::Cipher::kAES256_XTS, &iv_len));
+    ASSERT_OK(key->InitRandom(key_len));
+    ASSERT_OK(iv->InitRandom(iv_len));
+    END_HELPER;
+}
+
+bool TestUninitialized(void) {
+    BEGIN_TEST;
+    crypto::Bytes ptext, ctext;
+    ASSERT_OK(ptext.InitRandom(kLen));
+    ASSERT_OK(ctext.InitZero(kLen));
+
+    WorkerPool pool;
+    EXPECT_ZX(pool.Encrypt(ptext.get(), 0, kNumBlocks, ctext.get()), ZX_ERR_BAD_STATE);
+    EXPECT_ZX(pool.Decrypt(ptext.get(), 0, kNumBlocks, ctext.get()), ZX_ERR_BAD_STATE);
+
+    crypto::Bytes key, iv;
+    ASSERT_TRUE(GenerateKeyMaterial(&key, &iv));
+    EXPECT_ZX(pool.Init(crypto::Cipher::kAES256_XTS, key, iv, 0), ZX_ERR_INVALID_ARGS);
+    EXPECT_ZX(pool.Init(crypto::Cipher::kUninitialized, key, iv, kBlockSize),
+              ZX_ERR_INVALID_ARGS);
+    EXPECT_ZX(pool.Encrypt(ptext.get(), 0, kNumBlocks, ctext.get()), ZX_ERR_BAD_STATE);
+    END_TEST;
+}
+
+bool TestBadArgs(void) {
+    BEGIN_TEST;
+    crypto::Bytes key, iv, ptext, ctext;
+    ASSERT_TRUE(GenerateKeyMaterial(&key, &iv));
+    ASSERT_OK(ptext.InitRandom(kLen));
+    ASSERT_OK(ctext.InitZero(kLen));
+
+    WorkerPool pool;
+    ASSERT_OK(pool.Init(crypto::Cipher::kAES256_XTS, key, iv, kBlockSize, 4));
+    EXPECT_ZX(pool.Encrypt(nullptr, 0, kNumBlocks, ctext.get()), ZX_ERR_INVALID_ARGS);
+    EXPECT_ZX(pool.Encrypt(ptext.get(), 0, kNumBlocks, nullptr), ZX_ERR_INVALID_ARGS);
+    EXPECT_OK(pool.Encrypt(ptext.get(), 0, 0, ctext.get()));
+
+    // Past the end of the tweakable offsets
+    EXPECT_ZX(pool.Encrypt(ptext.get(), UINT64_MAX, 1, ctext.get()), ZX_ERR_INVALID_ARGS);
+    END_TEST;
+}
+
+// Checks the pool transforms each block just as a single cipher, tweaked to the block's offset,
+// would.
+bool TestTransform(size_t num_workers) {
+    BEGIN_TEST;
+    crypto::Bytes key, iv, ptext, ctext, expected, result;
+    ASSERT_TRUE(GenerateKeyMaterial(&key, &iv));
+    ASSERT_OK(ptext.InitRandom(kLen));
+    ASSERT_OK(ctext.InitZero(kLen));
+    ASSERT_OK(expected.InitZero(kLen));
+    ASSERT_OK(result.InitZero(kLen));
+
+    const uint64_t offset = 7;
+    crypto::Cipher encrypt;
+    ASSERT_OK(encrypt.InitEncrypt(crypto::Cipher::kAES256_XTS, key, iv, UINT64_MAX / kBlockSize));
+    for (size_t i = 0; i < kNumBlocks; i++) {
+        ASSERT_OK(encrypt.Tweak(offset + i));
+        ASSERT_OK(encrypt.Encrypt(ptext.get() + i * kBlockSize, kBlockSize,
+                                  expected.get() + i * kBlockSize));
+    }
+
+    WorkerPool pool;
+    ASSERT_OK(pool.Init(crypto::Cipher::kAES256_XTS, key, iv, kBlockSize, num_workers));
+    EXPECT_OK(pool.Encrypt(ptext.get(), offset, kNumBlocks, ctext.get()));
+    EXPECT_EQ(memcmp(ctext.get(), expected.get(), kLen), 0);
+    EXPECT_OK(pool.Decrypt(ctext.get(), offset, kNumBlocks, result.get()));
+    EXPECT_EQ(memcmp(ptext.get(), result.get(), kLen), 0);
+
+    // Wrong offset
+    EXPECT_OK(pool.Decrypt(ctext.get(), offset + 1, kNumBlocks, result.get()));
+    EXPECT_NE(memcmp(ptext.get(), result.get(), kLen), 0);
+
+    // Workers stop and restart cleanly
+    pool.Reset();
+    EXPECT_ZX(pool.Decrypt(ctext.get(), offset, kNumBlocks, result.get()), ZX_ERR_BAD_STATE);
+    ASSERT_OK(pool.Init(crypto::Cipher::kAES256_XTS, key, iv, kBlockSize, num_workers));
+    EXPECT_OK(pool.Decrypt(ctext.get(), offset, kNumBlocks, result.get()));
+    EXPECT_EQ(memcmp(ptext.get(), result.get(), kLen), 0);
+    END_TEST;
+}
+
+bool TestTransformOneWorker(void) {
+    return TestTransform(1);
+}
+
+bool TestTransformManyWorkers(void) {
+    return TestTransform(4);
+}
+
+bool TestTransformPerCpu(void) {
+    return TestTransform(0);
+}
+
+BEGIN_TEST_CASE(WorkerPoolTest)
+RUN_TEST(TestUninitialized)
+RUN_TEST(TestBadArgs)
+RUN_TEST(TestTransformOneWorker)
+RUN_TEST(TestTransformManyWorkers)
+RUN_TEST(TestTransformPerCpu)
+END_TEST_CASE(WorkerPoolTest)
+
+} // namespace
+} // namespace testing
+} // namespace zxcrypt
@@ -40,5 +40,9 @@
 #if !defined(_WIN32) && defined(JEMALLOC_PURGE_MADVISE_DONTNEED)
 #  define PAGES_CAN_PURGE_FORCED
 #endif
+/* On Fuchsia, heap pages are purged by decommitting them from their vmo. */
+#if defined(__Fuchsia__)
+#  define PAGES_CAN_PURGE_FORCED
+#endif
 
 #endif /* JEMALLOC_INTERNAL_PAGES_TYPES_H */
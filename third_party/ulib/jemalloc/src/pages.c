@@ -93,9 +93,24 @@ static void* fuchsia_pages_map(void* start, size_t len) {
 	return (void*)ptr;
 }
 
+// The heap vmo backs the whole pages_vmar at the same offsets, so the
+// pages behind any heap address can be released directly from the vmo.
+// Pages read back as zero the next time they are touched.
+static zx_status_t fuchsia_pages_decommit(void* addr, size_t size) {
+	uintptr_t ptr = (uintptr_t)addr;
+	return _zx_vmo_op_range(pages_vmo, ZX_VMO_OP_DECOMMIT,
+	    ptr - pages_base, size, NULL, 0);
+}
+
 static zx_status_t fuchsia_pages_free(void* addr, size_t size) {
 	uintptr_t ptr = (uintptr_t)addr;
-	return _zx_vmar_unmap(pages_vmar, ptr, size);
+	zx_status_t status = _zx_vmar_unmap(pages_vmar, ptr, size);
+	if (status != ZX_OK)
+		return status;
+	// Unmapping leaves the pages committed in the vmo. Release them,
+	// both to return the memory and so that the range is zeroed if it
+	// is ever mapped again.
+	return fuchsia_pages_decommit(addr, size);
 }
 
 static void* fuchsia_pages_trim(void* ret, void* addr, size_t size,
@@ -291,6 +306,8 @@ pages_purge_forced(void *addr, size_t size)
 
 #if defined(JEMALLOC_PURGE_MADVISE_DONTNEED)
 	return (madvise(addr, size, MADV_DONTNEED) != 0);
+#elif defined(__Fuchsia__)
+	return (fuchsia_pages_decommit(addr, size) != ZX_OK);
 #else
 	not_reached();
 #endif
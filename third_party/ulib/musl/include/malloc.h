@@ -17,6 +17,14 @@ void* memalign(size_t, size_t);
 
 size_t malloc_usable_size(void*);
 
+// Introspection and tuning of the allocator; see jemalloc(3).  Options
+// may also be set at startup through the MALLOC_CONF environment
+// variable, e.g. MALLOC_CONF=decay_time:1,narenas:2,lg_tcache_max:16.
+int mallctl(const char*, void*, size_t*, void*, size_t);
+int mallctlnametomib(const char*, size_t*, size_t*);
+int mallctlbymib(const size_t*, size_t, void*, size_t*, void*, size_t);
+void malloc_stats_print(void (*)(void*, const char*), void*, const char*);
+
 #ifdef __cplusplus
 }
 #endif
@@ -80,6 +80,9 @@ struct dso {
     struct tls_module tls;
     size_t tls_id;
     size_t relro_start, relro_end;
+    // Set if the PLT is bound lazily, for _dl_lazy_fixup.
+    size_t* jmprel;
+    size_t jmprel_stride;
     void** new_dtv;
     unsigned char* new_tls;
     atomic_int new_dtv_idx, new_tls_idx;
@@ -146,6 +149,10 @@ struct r_debug* _dl_debug_addr = &debug;
 // post-processing the h/w trace.
 static bool trace_maps = false;
 
+// Set from LD_BIND_NOW: bind every PLT entry at startup even in modules
+// that were not linked with -z now.
+static bool bind_now = false;
+
 __attribute__((__visibility__("hidden"))) void (*const __init_array_start)(void) = 0,
                                                        (*const __fini_array_start)(void) = 0;
 
@@ -410,7 +417,8 @@ static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
 __attribute__((__visibility__("hidden"))) ptrdiff_t __tlsdesc_static(void), __tlsdesc_dynamic(void);
 
 __NO_SAFESTACK NO_ASAN static void do_relocs(struct dso* dso, size_t* rel,
-                                             size_t rel_size, size_t stride) {
+                                             size_t rel_size, size_t stride,
+                                             bool lazy) {
     ElfW(Addr) base = dso->l_map.l_addr;
     Sym* syms = dso->syms;
     char* strings = dso->strings;
@@ -439,6 +447,12 @@ __NO_SAFESTACK NO_ASAN static void do_relocs(struct dso* dso, size_t* rel,
         type = R_TYPE(rel[1]);
         if (type == REL_NONE)
             continue;
+        if (lazy && type == REL_PLT) {
+            // The slot holds the link-time address of the code in the
+            // PLT that jumps to _dl_lazy_resolve.
+            *(size_t*)laddr(dso, rel[0]) += base;
+            continue;
+        }
         sym_index = R_SYM(rel[1]);
         reloc_addr = laddr(dso, rel[0]);
         if (sym_index) {
@@ -1279,15 +1293,42 @@ __NO_SAFESTACK static void load_preload(char* s) {
     }
 }
 
-__NO_SAFESTACK NO_ASAN static void reloc_all(struct dso* p) {
+__attribute__((__visibility__("hidden"))) void _dl_lazy_resolve(void);
+
+// A module's PLT can be bound lazily if it was not linked with -z now,
+// which also keeps its GOT out of RELRO where it could not be written.
+__NO_SAFESTACK NO_ASAN static bool can_bind_lazily(struct dso* p, size_t* dyn) {
+    if (p == &ldso || !(dyn[0] & (1UL << DT_PLTGOT)) ||
+        (dyn[0] & (1UL << DT_BIND_NOW)) || (dyn[DT_FLAGS] & DF_BIND_NOW))
+        return false;
+    size_t flags_1;
+    if (search_vec(p->l_map.l_ld, &flags_1, DT_FLAGS_1) && (flags_1 & DF_1_NOW))
+        return false;
+    return dyn[DT_PLTGOT] < p->relro_start || dyn[DT_PLTGOT] >= p->relro_end;
+}
+
+// With |lazy|, PLT entries of the modules that allow it are bound on
+// their first call instead (see _dl_lazy_fixup).  That is only done for
+// the modules loaded at startup, which are all in the global namespace.
+__NO_SAFESTACK NO_ASAN static void reloc_all(struct dso* p, bool lazy) {
     size_t dyn[DYN_CNT];
     for (; p; p = dso_next(p)) {
         if (p->relocated)
             continue;
         decode_vec(p->l_map.l_ld, dyn, DYN_CNT);
-        do_relocs(p, laddr(p, dyn[DT_JMPREL]), dyn[DT_PLTRELSZ], 2 + (dyn[DT_PLTREL] == DT_RELA));
-        do_relocs(p, laddr(p, dyn[DT_REL]), dyn[DT_RELSZ], 2);
-        do_relocs(p, laddr(p, dyn[DT_RELA]), dyn[DT_RELASZ], 3);
+        size_t* jmprel = laddr(p, dyn[DT_JMPREL]);
+        size_t jmprel_stride = 2 + (dyn[DT_PLTREL] == DT_RELA);
+        bool lazy_plt = lazy && can_bind_lazily(p, dyn);
+        do_relocs(p, jmprel, dyn[DT_PLTRELSZ], jmprel_stride, lazy_plt);
+        do_relocs(p, laddr(p, dyn[DT_REL]), dyn[DT_RELSZ], 2, false);
+        do_relocs(p, laddr(p, dyn[DT_RELA]), dyn[DT_RELASZ], 3, false);
+        if (lazy_plt) {
+            size_t* got = laddr(p, dyn[DT_PLTGOT]);
+            got[1] = (size_t)p;
+            got[2] = (size_t)&_dl_lazy_resolve;
+            p->jmprel = jmprel;
+            p->jmprel_stride = jmprel_stride;
+        }
 
         if (head != &ldso && p->relro_start != p->relro_end) {
             zx_status_t status =
@@ -1549,7 +1590,7 @@ dl_start_return_t __dls2(
     saved_addends = addends;
 
     head = &ldso;
-    reloc_all(&ldso);
+    reloc_all(&ldso, false);
 
     ldso.relocated = 0;
 
@@ -1604,6 +1645,10 @@ __NO_SAFESTACK static void* dls3(zx_handle_t exec_vmo, int argc, char** argv) {
             trace_maps = true;
     }
 
+    const char* ld_bind_now = getenv("LD_BIND_NOW");
+    if (ld_bind_now != NULL && ld_bind_now[0] != '\0')
+        bind_now = true;
+
     zx_status_t status = map_library(exec_vmo, &app);
     _zx_handle_close(exec_vmo);
     if (status != ZX_OK) {
@@ -1671,8 +1716,8 @@ __NO_SAFESTACK static void* dls3(zx_handle_t exec_vmo, int argc, char** argv) {
 
     /* The main program must be relocated LAST since it may contin
      * copy relocations which depend on libraries' relocations. */
-    reloc_all(dso_next(&app));
-    reloc_all(&app);
+    reloc_all(dso_next(&app), !bind_now);
+    reloc_all(&app, !bind_now);
 
     update_tls_size();
     static_tls_cnt = tls_cnt;
@@ -1877,6 +1922,29 @@ static void set_global(struct dso* p, int global) {
     }
 }
 
+// Called by _dl_lazy_resolve on the first call through PLT entry |index|
+// of |p|.  Binds the entry and returns the address to jump to.
+__attribute__((__visibility__("hidden")))
+size_t _dl_lazy_fixup(struct dso* p, size_t index) {
+    pthread_rwlock_rdlock(&lock);
+    size_t* rel = p->jmprel + index * p->jmprel_stride;
+    Sym* sym = p->syms + R_SYM(rel[1]);
+    const char* name = p->strings + sym->st_name;
+    struct symdef def = find_sym(head, name, 1);
+    if (def.sym == NULL) {
+        pthread_rwlock_unlock(&lock);
+        debugmsg("Error relocating %s: %s: symbol not found\n",
+                 p->l_map.l_name, name);
+        __builtin_trap();
+    }
+    size_t addend = p->jmprel_stride > 2 ? rel[2] : 0;
+    size_t value = saddr(def.dso, def.sym->st_value) + addend;
+    atomic_store_explicit((_Atomic size_t*)laddr(p, rel[0]), value,
+                          memory_order_relaxed);
+    pthread_rwlock_unlock(&lock);
+    return value;
+}
+
 static void* dlopen_internal(zx_handle_t vmo, const char* file, int mode) {
     pthread_rwlock_wrlock(&lock);
     __thread_allocation_inhibit();
@@ -1936,7 +2004,7 @@ static void* dlopen_internal(zx_handle_t vmo, const char* file, int mode) {
     if (!p->deps) {
         load_deps(p);
         set_global(p, -1);
-        reloc_all(p);
+        reloc_all(p, false);
         set_global(p, 0);
     }
 
@@ -1097,6 +1097,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/arch/$(MUSL_ARCH)/dl-entry.S \
     $(LOCAL_DIR)/ldso/dlstart.c \
     $(LOCAL_DIR)/ldso/dynlink.c \
+    $(LOCAL_DIR)/ldso/dynlink-lazy.S \
     $(LOCAL_DIR)/ldso/dynlink-sancov.S \
 
 MODULE_SRCS += \
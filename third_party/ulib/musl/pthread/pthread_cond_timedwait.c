@@ -15,6 +15,10 @@
  * modified again, but can only be traversed in reverse order, and are
  * protected by the "barrier" locks in each node, which are unlocked
  * in turn to control wake order.
+ *
+ * A broadcast instead moves the whole detached list onto the mutex
+ * futex itself, and marks each node as batched so that it skips that
+ * chain.  cnd_timedwait() shares this layout.
  */
 
 struct waiter {
@@ -22,6 +26,9 @@ struct waiter {
     atomic_int state;
     atomic_int barrier;
     atomic_int* notify;
+    atomic_int* mutex;
+    atomic_int* mutex_waiters;
+    int batched;
 };
 
 enum {
@@ -30,6 +37,12 @@ enum {
     LEAVING,
 };
 
+enum {
+    BATCH_NONE,
+    BATCH_HEAD,
+    BATCH_REQUEUED,
+};
+
 int pthread_cond_timedwait(pthread_cond_t* restrict c, pthread_mutex_t* restrict m,
                            const struct timespec* restrict ts) {
     int e, clock = c->_c_clock, oldstate, tmp;
@@ -47,6 +60,8 @@ int pthread_cond_timedwait(pthread_cond_t* restrict c, pthread_mutex_t* restrict
     struct waiter node = {
         .barrier = ATOMIC_VAR_INIT(seq),
         .state = ATOMIC_VAR_INIT(WAITING),
+        .mutex = &m->_m_lock,
+        .mutex_waiters = &m->_m_waiters,
     };
     atomic_int* fut = &node.barrier;
 
@@ -137,6 +152,14 @@ int pthread_cond_timedwait(pthread_cond_t* restrict c, pthread_mutex_t* restrict
     if (oldstate == WAITING)
         goto done;
 
+    /* A broadcast that requeued our list already did the work of the
+     * chain below, and counted each requeued waiter in _m_waiters. */
+    if (node.batched) {
+        if (node.batched == BATCH_REQUEUED)
+            atomic_fetch_sub(&m->_m_waiters, 1);
+        goto done;
+    }
+
     /* By this point, our part of the waiter list cannot change further.
      * It has been unlinked from the condvar by __private_cond_signal().
      * It consists only of waiters that were woken explicitly by
@@ -164,6 +187,65 @@ done:
     return e;
 }
 
+/* Releases |first| (if not null) and the |n| waiters starting at |p|
+ * with one futex_requeue_many() call, waking only |first|.  Returns the
+ * waiter after the last one released. */
+static struct waiter* requeue_batch(struct waiter* first, struct waiter* p, uint32_t n,
+                                    atomic_int* mutex) {
+    uintptr_t futexes[ZX_FUTEX_MAX_REQUEUE_MANY];
+    uint32_t count = 0;
+
+    if (first)
+        futexes[count++] = (uintptr_t)&first->barrier;
+    /* A node can return as soon as its barrier is unlocked, so walk the
+     * list before unlocking any of them. */
+    for (; n; n--, p = p->prev)
+        futexes[count++] = (uintptr_t)&p->barrier;
+    for (uint32_t i = 0; i < count; i++)
+        atomic_store((atomic_int*)futexes[i], UNLOCKED);
+
+    if (_zx_futex_requeue_many(futexes, count, UNLOCKED, first ? 1 : 0, mutex) != ZX_OK) {
+        for (uint32_t i = 0; i < count; i++)
+            __wake((atomic_int*)futexes[i], 1);
+    }
+    return p;
+}
+
+/* Moves every signaled waiter after |first| straight onto the mutex
+ * futex, then wakes |first|, rather than having each woken waiter requeue
+ * the next one in turn. */
+static void requeue_broadcast(struct waiter* first) {
+    atomic_int* mutex = first->mutex;
+    struct waiter* p;
+    uint32_t count = 0;
+
+    for (p = first->prev; p; p = p->prev) {
+        /* Waiting with different mutexes is undefined; leave such a list
+         * to the chained wakeup. */
+        if (p->mutex != mutex) {
+            unlock(&first->barrier);
+            return;
+        }
+        count++;
+    }
+
+    /* No node can go away before its barrier is unlocked, so all of them
+     * can be marked, and the mutex waiter count taken, up front. */
+    first->batched = BATCH_HEAD;
+    for (p = first->prev; p; p = p->prev)
+        p->batched = BATCH_REQUEUED;
+    if (first->mutex_waiters)
+        atomic_fetch_add(first->mutex_waiters, count);
+
+    /* Requeue full batches first, so that everything is on the mutex
+     * futex before |first| is woken by the last one and starts the run of
+     * mutex unlocks that hands the lock to each waiter in turn. */
+    p = first->prev;
+    for (; count >= ZX_FUTEX_MAX_REQUEUE_MANY; count -= ZX_FUTEX_MAX_REQUEUE_MANY)
+        p = requeue_batch(NULL, p, ZX_FUTEX_MAX_REQUEUE_MANY, mutex);
+    requeue_batch(first, p, count, mutex);
+}
+
 /* This will wake upto |n| threads that are waiting on the condvar.  This
  * is used to implement pthread_cond_signal() (for n=1) and
  * pthread_cond_broadcast() (for n=-1). */
@@ -206,7 +288,10 @@ void __private_cond_signal(void* condvar, int n) {
     while ((cur = atomic_load(&ref)))
         __wait(&ref, 0, cur);
 
-    /* Allow first signaled waiter, if any, to proceed. */
-    if (first)
+    /* Allow first signaled waiter, if any, to proceed.  When more than
+     * one was signaled, move the others straight to the mutex. */
+    if (first && first->prev)
+        requeue_broadcast(first);
+    else if (first)
         unlock(&first->barrier);
 }
@@ -125,6 +125,11 @@ static inline struct pthread* tp_to_pthread(void* tp) {
 // The bit used in the recursive and errorchecking cases, which track thread owners.
 #define PTHREAD_MUTEX_OWNED_LOCK_BIT 0x80000000
 #define PTHREAD_MUTEX_OWNED_LOCK_MASK 0x7fffffff
+// Set in the type of PTHREAD_PRIO_INHERIT mutexes. These track their owner
+// whatever their type, so that waiters can lend it their priority.
+#define PTHREAD_MUTEX_PRIO_INHERIT_BIT 8
+#define PTHREAD_MUTEX_TRACKS_OWNER(type) \
+    (((type) & (PTHREAD_MUTEX_MASK | PTHREAD_MUTEX_PRIO_INHERIT_BIT)) != PTHREAD_MUTEX_NORMAL)
 
 extern void* __pthread_tsd_main[];
 extern volatile size_t __pthread_tsd_size;
@@ -165,6 +170,10 @@ int __pthread_key_delete(tss_t k) ATTR_LIBC_VISIBILITY;
 // This is guaranteed to only return 0, EINVAL, or ETIMEDOUT.
 int __timedwait(atomic_int*, int, clockid_t, const struct timespec*)
     ATTR_LIBC_VISIBILITY;
+// As __timedwait, lending the caller's priority to the |owner| thread
+// while blocked.
+int __timedwait_pi(atomic_int*, int, zx_handle_t owner, clockid_t, const struct timespec*)
+    ATTR_LIBC_VISIBILITY;
 
 // Loading a library can introduce more thread_local variables. Thread
 // allocation bases bookkeeping decisions based on the current state
@@ -3,7 +3,8 @@
 #include <zircon/syscalls.h>
 #include <time.h>
 
-int __timedwait(atomic_int* futex, int val, clockid_t clk, const struct timespec* at) {
+static int timedwait(atomic_int* futex, int val, zx_handle_t owner, clockid_t clk,
+                     const struct timespec* at) {
     struct timespec to;
     zx_time_t deadline = ZX_TIME_INFINITE;
 
@@ -22,11 +23,24 @@ int __timedwait(atomic_int* futex, int val, clockid_t clk, const struct timespec
         deadline = _zx_deadline_after(ZX_SEC(to.tv_sec) + to.tv_nsec);
     }
 
+    zx_status_t status;
+    if (owner != ZX_HANDLE_INVALID) {
+        status = _zx_futex_wait_pi(futex, val, owner, deadline);
+        // The owner's handle is stale if it exited without unlocking, or
+        // it is our own if we are relocking a normal mutex. Either way there
+        // is nobody to lend to, so just wait.
+        if (status == ZX_ERR_BAD_HANDLE || status == ZX_ERR_WRONG_TYPE ||
+            status == ZX_ERR_INVALID_ARGS)
+            status = _zx_futex_wait(futex, val, deadline);
+    } else {
+        status = _zx_futex_wait(futex, val, deadline);
+    }
+
     // zx_futex_wait will return ZX_ERR_BAD_STATE if someone modifying *addr
     // races with this call. But this is indistinguishable from
     // otherwise being woken up just before someone else changes the
     // value. Therefore this functions returns 0 in that case.
-    switch (_zx_futex_wait(futex, val, deadline)) {
+    switch (status) {
     case ZX_OK:
     case ZX_ERR_BAD_STATE:
         return 0;
@@ -37,3 +51,12 @@ int __timedwait(atomic_int* futex, int val, clockid_t clk, const struct timespec
         __builtin_trap();
     }
 }
+
+int __timedwait(atomic_int* futex, int val, clockid_t clk, const struct timespec* at) {
+    return timedwait(futex, val, ZX_HANDLE_INVALID, clk, at);
+}
+
+int __timedwait_pi(atomic_int* futex, int val, zx_handle_t owner, clockid_t clk,
+                   const struct timespec* at) {
+    return timedwait(futex, val, owner, clk, at);
+}
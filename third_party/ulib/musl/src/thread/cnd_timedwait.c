@@ -8,11 +8,16 @@
 #include "libc.h"
 #include "pthread_impl.h"
 
+/* This must match the struct waiter of pthread_cond_timedwait(), which
+ * __private_cond_signal() uses. */
 struct waiter {
     struct waiter *prev, *next;
     atomic_int state;
     atomic_int barrier;
     atomic_int* notify;
+    atomic_int* mutex;
+    atomic_int* mutex_waiters;
+    int batched;
 };
 
 enum {
@@ -34,6 +39,7 @@ int cnd_timedwait(cnd_t* restrict c, mtx_t* restrict mutex,
     struct waiter node = {
         .barrier = ATOMIC_VAR_INIT(seq),
         .state = ATOMIC_VAR_INIT(WAITING),
+        .mutex = &m->futex,
     };
     atomic_int* fut = &node.barrier;
     /* Add our waiter node onto the condvar's list.  We add the node to the
@@ -130,10 +136,11 @@ int cnd_timedwait(cnd_t* restrict c, mtx_t* restrict mutex,
      * It is therefore safe now to read node.next and node.prev without
      * holding _c_lock. */
 
-    if (oldstate != WAITING && node.prev) {
+    if (oldstate != WAITING && node.prev && !node.batched) {
         /* Unlock the barrier that's holding back the next waiter, and
          * requeue it to the mutex so that it will be woken when the
-         * mutex is unlocked. */
+         * mutex is unlocked.  A broadcast that batched our list has
+         * already requeued the rest of it. */
         unlock_requeue(&node.prev->barrier, &m->futex);
     }
 